@@ -22,10 +22,12 @@ option(USE_WEBP "Enable WebP export support" ON)
 option(USE_AVIF "Enable AVIF support" ON)
 option(USE_XCF "Enable XCF support" ON)
 option(BUILD_CMSTEST "Build a test program to check your system's color management setup" ON)
+option(BUILD_BENCH "Build darktable-bench, which times the processing modules one by one" ON)
 option(USE_OPENEXR "Enable OpenEXR support" ON)
 option(BUILD_PRINT "Build the print module" ON)
 option(BUILD_RS_IDENTIFY "Build the darktable-rs-identify debug aid" ON)
 option(BUILD_SSE2_CODEPATHS "(EXPERIMENTAL OPTION, DO NOT DISABLE) Building SSE2-optimized codepaths" ON)
+option(BUILD_AVX_CODEPATHS "Build AVX2 and AVX-512 kernels, picked at runtime when the cpu has them" ON)
 option(VALIDATE_APPDATA_FILE "Use appstream-util (if found) to validate the .appdata file" OFF)
 option(BUILD_BATTERY_INDICATOR "Add an icon to the top toolbar showing the state of a laptop battery" OFF)
 option(BUILD_MSYS2_INSTALL "Build an MSYS2 version of the install, aka for Windows platform, but without dependency installs" OFF)
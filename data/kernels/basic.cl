@@ -1991,146 +1991,6 @@ borders_fill (write_only image2d_t out, const int left, const int top, const int
 }
 
 
-/* kernel for the overexposed plugin. */
-kernel void
-overexposed (read_only image2d_t in, write_only image2d_t out, read_only image2d_t tmp, const int width, const int height,
-             const float lower, const float upper, const float4 lower_color, const float4 upper_color)
-{
-  const int x = get_global_id(0);
-  const int y = get_global_id(1);
-
-  if(x >= width || y >= height) return;
-
-  float4 pixel = read_imagef(in, sampleri, (int2)(x, y));
-  float4 pixel_tmp = read_imagef(tmp, sampleri, (int2)(x, y));
-
-  if(pixel_tmp.x >= upper || pixel_tmp.y >= upper || pixel_tmp.z >= upper)
-  {
-    pixel.xyz = upper_color.xyz;
-  }
-  else if(pixel_tmp.x <= lower && pixel_tmp.y <= lower && pixel_tmp.z <= lower)
-  {
-    pixel.xyz = lower_color.xyz;
-  }
-
-  write_imagef (out, (int2)(x, y), pixel);
-}
-
-
-/* kernel for the rawoverexposed plugin. */
-kernel void
-rawoverexposed_mark_cfa (
-        read_only image2d_t in, write_only image2d_t out, global float *pi,
-        const int width, const int height,
-        read_only image2d_t raw, const int raw_width, const int raw_height,
-        const unsigned int filters, global const unsigned char (*const xtrans)[6],
-        global unsigned int *threshold, global float *colors)
-{
-  const int x = get_global_id(0);
-  const int y = get_global_id(1);
-
-  if(x >= width || y >= height) return;
-
-  const int piwidth = 2*width;
-  global float *ppi = pi + mad24(y, piwidth, 2*x);
-
-  const int raw_x = ppi[0];
-  const int raw_y = ppi[1];
-
-  if(raw_x < 0 || raw_y < 0 || raw_x >= raw_width || raw_y >= raw_height) return;
-
-  const uint raw_pixel = read_imageui(raw, sampleri, (int2)(raw_x, raw_y)).x;
-
-  const int c = (filters == 9u) ? FCxtrans(raw_y, raw_x, xtrans) : FC(raw_y, raw_x, filters);
-
-  if(raw_pixel < threshold[c]) return;
-
-  float4 pixel = read_imagef(in, sampleri, (int2)(x, y));
-
-  global float *color = colors + mad24(4, c, 0);
-
-  // cfa color
-  pixel.x = color[0];
-  pixel.y = color[1];
-  pixel.z = color[2];
-
-  write_imagef (out, (int2)(x, y), pixel);
-}
-
-kernel void
-rawoverexposed_mark_solid (
-        read_only image2d_t in, write_only image2d_t out, global float *pi,
-        const int width, const int height,
-        read_only image2d_t raw, const int raw_width, const int raw_height,
-        const unsigned int filters, global const unsigned char (*const xtrans)[6],
-        global unsigned int *threshold, const float4 solid_color)
-{
-  const int x = get_global_id(0);
-  const int y = get_global_id(1);
-
-  if(x >= width || y >= height) return;
-
-  const int piwidth = 2*width;
-  global float *ppi = pi + mad24(y, piwidth, 2*x);
-
-  const int raw_x = ppi[0];
-  const int raw_y = ppi[1];
-
-  if(raw_x < 0 || raw_y < 0 || raw_x >= raw_width || raw_y >= raw_height) return;
-
-  const uint raw_pixel = read_imageui(raw, sampleri, (int2)(raw_x, raw_y)).x;
-
-  const int c = (filters == 9u) ? FCxtrans(raw_y, raw_x, xtrans) : FC(raw_y, raw_x, filters);
-
-  if(raw_pixel < threshold[c]) return;
-
-  float4 pixel = read_imagef(in, sampleri, (int2)(x, y));
-
-  // solid color
-  pixel.xyz = solid_color.xyz;
-
-  write_imagef (out, (int2)(x, y), pixel);
-}
-
-kernel void
-rawoverexposed_falsecolor (
-        read_only image2d_t in, write_only image2d_t out, global float *pi,
-        const int width, const int height,
-        read_only image2d_t raw, const int raw_width, const int raw_height,
-        const unsigned int filters, global const unsigned char (*const xtrans)[6],
-        global unsigned int *threshold)
-{
-  const int x = get_global_id(0);
-  const int y = get_global_id(1);
-
-  if(x >= width || y >= height) return;
-
-  const int piwidth = 2*width;
-  global float *ppi = pi + mad24(y, piwidth, 2*x);
-
-  const int raw_x = ppi[0];
-  const int raw_y = ppi[1];
-
-  if(raw_x < 0 || raw_y < 0 || raw_x >= raw_width || raw_y >= raw_height) return;
-
-  const uint raw_pixel = read_imageui(raw, sampleri, (int2)(raw_x, raw_y)).x;
-
-  const int c = (filters == 9u) ? FCxtrans(raw_y, raw_x, xtrans) : FC(raw_y, raw_x, filters);
-
-  if(raw_pixel < threshold[c]) return;
-
-  float4 pixel = read_imagef(in, sampleri, (int2)(x, y));
-
-  float p[4];
-  vstore4(pixel, 0, p);
-  // falsecolor
-  p[c] = 0.0f;
-  pixel = vload4(0, p);
-
-  write_imagef (out, (int2)(x, y), pixel);
-}
-
-
 /* kernel for the lowlight plugin. */
 kernel void
 lowlight (read_only image2d_t in, write_only image2d_t out, const int width, const int height,
@@ -2328,3 +2188,45 @@ interpolation_resample (read_only image2d_t in, write_only image2d_t out, const
     write_imagef (out, (int2)(x, y), buffer[ylid]);
   }
 }
+
+/* hot pixel detection and correction for bayer sensors, see process_bayer() in hotpixels.c.
+   the cpu variant can also mark the fixed pixels, that is only done there. */
+kernel void
+hotpixels_bayer(read_only image2d_t in, write_only image2d_t out, const int width, const int height,
+                const float threshold, const float multiplier, const int min_neighbours,
+                global int *fixed, const int count)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+
+  if(x >= width || y >= height) return;
+
+  const float pixel = read_imagef(in, sampleri, (int2)(x, y)).x;
+  float result = pixel;
+
+  if(x >= 2 && y >= 2 && x < width - 2 && y < height - 2 && pixel > threshold)
+  {
+    const float mid = pixel * multiplier;
+    const float other[4] = { read_imagef(in, sampleri, (int2)(x - 2, y)).x,
+                             read_imagef(in, sampleri, (int2)(x, y - 2)).x,
+                             read_imagef(in, sampleri, (int2)(x + 2, y)).x,
+                             read_imagef(in, sampleri, (int2)(x, y + 2)).x };
+    int neighbours = 0;
+    float maxin = 0.0f;
+    for(int k = 0; k < 4; k++)
+    {
+      if(mid > other[k])
+      {
+        neighbours++;
+        maxin = fmax(maxin, other[k]);
+      }
+    }
+    if(neighbours >= min_neighbours)
+    {
+      result = maxin;
+      if(count) atomic_inc(fixed);
+    }
+  }
+
+  write_imagef(out, (int2)(x, y), (float4)(result, 0.0f, 0.0f, 0.0f));
+}
@@ -0,0 +1,148 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common.h"
+#include "colorspace.cl"
+
+// these follow src/iop/clahe.c, keep them in sync
+#define BINS 256
+
+
+// the luminance of the pixel, quantized to the histogram bins
+kernel void
+clahe_luminance(read_only image2d_t in, write_only image2d_t out, const int width, const int height)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if(x >= width || y >= height) return;
+
+  const float4 i = read_imagef(in, sampleri, (int2)(x, y));
+  const float pmax = clamp(fmax(i.x, fmax(i.y, i.z)), 0.0f, 1.0f);
+  const float pmin = clamp(fmin(i.x, fmin(i.y, i.z)), 0.0f, 1.0f);
+  const float bin = (float)(int)((pmax + pmin) * 0.5f * (float)BINS + 0.5f);
+  write_imagef(out, (int2)(x, y), (float4)(bin, 0.0f, 0.0f, 0.0f));
+}
+
+
+// one work group per tile: the histogram of the window around the center of the tile is gathered in local
+// memory, then the first work item clips it and writes the normalized cdf to maps
+kernel void
+clahe_tile_mapping(read_only image2d_t lum, global float *maps, const int width, const int height,
+                   const int nx, const int step, const int rad, const float slope, local int *hist)
+{
+  const int tile = get_group_id(0);
+  const int lid = get_local_id(0);
+  const int lsize = get_local_size(0);
+
+  const int cx = min((tile % nx) * step, width - 1);
+  const int cy = min((tile / nx) * step, height - 1);
+  const int xMin = max(0, cx - rad), xMax = min(width, cx + rad + 1);
+  const int yMin = max(0, cy - rad), yMax = min(height, cy + rad + 1);
+  const int w = xMax - xMin;
+  const int n = w * (yMax - yMin);
+
+  for(int b = lid; b <= BINS; b += lsize) hist[b] = 0;
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  for(int k = lid; k < n; k += lsize)
+  {
+    const int bin = (int)read_imagef(lum, sampleri, (int2)(xMin + k % w, yMin + k / w)).x;
+    atomic_inc(hist + bin);
+  }
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  if(lid != 0) return;
+
+  const int limit = (int)(slope * n / BINS + 0.5f);
+
+  // clip histogram and redistribute clipped entries
+  int ce = 0, ceb = 0;
+  do
+  {
+    ceb = ce;
+    ce = 0;
+    for(int b = 0; b <= BINS; b++)
+    {
+      const int d = hist[b] - limit;
+      if(d > 0)
+      {
+        ce += d;
+        hist[b] = limit;
+      }
+    }
+
+    const int d = (int)(ce / (float)(BINS + 1));
+    const int m = ce % (BINS + 1);
+    for(int b = 0; b <= BINS; b++) hist[b] += d;
+
+    if(m != 0)
+    {
+      const int s = (int)(BINS / (float)m);
+      for(int b = 0; b <= BINS; b += s) hist[b]++;
+    }
+  } while(ce != ceb);
+
+  // build cdf of clipped histogram
+  int hMin = BINS;
+  for(int b = 0; b < hMin; b++)
+    if(hist[b] != 0) hMin = b;
+
+  int cdfMax = 0;
+  for(int b = hMin; b <= BINS; b++) cdfMax += hist[b];
+  const int cdfMin = hist[hMin];
+  const float norm = 1.0f / max(cdfMax - cdfMin, 1);
+
+  global float *map = maps + tile * (BINS + 1);
+  int cdf = 0;
+  for(int b = 0; b <= BINS; b++)
+  {
+    if(b >= hMin) cdf += hist[b];
+    map[b] = (cdf - cdfMin) * norm;
+  }
+}
+
+
+// interpolates the mappings of the four surrounding tile centers and sets the lightness of the pixel
+kernel void
+clahe_apply(read_only image2d_t in, read_only image2d_t lum, global const float *maps, write_only image2d_t out,
+            const int width, const int height, const int nx, const int ny, const int step)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if(x >= width || y >= height) return;
+
+  const int tx = min(x / step, nx - 1);
+  const int tx1 = min(tx + 1, nx - 1);
+  const int ty = min(y / step, ny - 1);
+  const int ty1 = min(ty + 1, ny - 1);
+  const int cx = min(tx * step, width - 1), cx1 = min(tx1 * step, width - 1);
+  const int cy = min(ty * step, height - 1), cy1 = min(ty1 * step, height - 1);
+  const float wx = (cx1 > cx) ? (x - cx) / (float)(cx1 - cx) : 0.0f;
+  const float wy = (cy1 > cy) ? (y - cy) / (float)(cy1 - cy) : 0.0f;
+
+  const int v = (int)read_imagef(lum, sampleri, (int2)(x, y)).x;
+  const float top = maps[(ty * nx + tx) * (BINS + 1) + v] * (1.0f - wx)
+                    + maps[(ty * nx + tx1) * (BINS + 1) + v] * wx;
+  const float bottom = maps[(ty1 * nx + tx) * (BINS + 1) + v] * (1.0f - wx)
+                       + maps[(ty1 * nx + tx1) * (BINS + 1) + v] * wx;
+
+  const float4 i = read_imagef(in, sampleri, (int2)(x, y));
+  float4 hsl = RGB_2_HSL(i);
+  hsl.z = top * (1.0f - wy) + bottom * wy;
+  write_imagef(out, (int2)(x, y), HSL_2_RGB(hsl));
+}
@@ -0,0 +1,96 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common.h"
+
+// these follow src/iop/dither.c, keep them in sync
+#define TEA_ROUNDS 8
+
+constant int bayer8[8][8] = { {  0, 32,  8, 40,  2, 34, 10, 42 },
+                              { 48, 16, 56, 24, 50, 18, 58, 26 },
+                              { 12, 44,  4, 36, 14, 46,  6, 38 },
+                              { 60, 28, 52, 20, 62, 30, 54, 22 },
+                              {  3, 35, 11, 43,  1, 33,  9, 41 },
+                              { 51, 19, 59, 27, 49, 17, 57, 25 },
+                              { 15, 47,  7, 39, 13, 45,  5, 37 },
+                              { 63, 31, 55, 23, 61, 29, 53, 21 } };
+
+inline float
+clipnan(const float x)
+{
+  return isnan(x) ? 0.5f : clamp(x, 0.0f, 1.0f);
+}
+
+uint
+encrypt_tea(uint v0, uint v1)
+{
+  const uint key[] = { 0xa341316c, 0xc8013ea4, 0xad90777d, 0x7e95761e };
+  uint sum = 0;
+  const uint delta = 0x9e3779b9;
+  for(int i = 0; i < TEA_ROUNDS; i++)
+  {
+    sum += delta;
+    v0 += ((v1 << 4) + key[0]) ^ (v1 + sum) ^ ((v1 >> 5) + key[1]);
+    v1 += ((v0 << 4) + key[2]) ^ (v0 + sum) ^ ((v0 >> 5) + key[3]);
+  }
+  return v0;
+}
+
+inline float
+tpdf(const uint urandom)
+{
+  const float frandom = (float)urandom / (float)0xFFFFFFFFu;
+  return frandom < 0.5f ? (sqrt(2.0f * frandom) - 1.0f) : (1.0f - sqrt(2.0f * (1.0f - frandom)));
+}
+
+// every pixel seeds its own generator, so the noise does not depend on the order of the work items
+kernel void
+dither_random(read_only image2d_t in, write_only image2d_t out, const int width, const int height,
+              const float dither)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if(x >= width || y >= height) return;
+
+  float4 pixel = read_imagef(in, sampleri, (int2)(x, y));
+  const float dith = dither * tpdf(encrypt_tea(y * width + x, y));
+  pixel.xyz = clamp(pixel.xyz + dith, 0.0f, 1.0f);
+  write_imagef(out, (int2)(x, y), pixel);
+}
+
+// ordered dithering to levels = f + 1 with an 8x8 bayer threshold, anchored to the full image so tiles line up.
+// f = 0 only clips
+kernel void
+dither_ordered(read_only image2d_t in, write_only image2d_t out, const int width, const int height,
+               const int roi_x, const int roi_y, const float f, const float rf, const int gray)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if(x >= width || y >= height) return;
+
+  float4 pixel = read_imagef(in, sampleri, (int2)(x, y));
+  float4 val = (float4)(clipnan(pixel.x), clipnan(pixel.y), clipnan(pixel.z), 0.0f);
+  if(f > 0.0f)
+  {
+    const float t = (bayer8[(roi_y + y) & 7][(roi_x + x) & 7] + 0.5f) / 64.0f;
+    if(gray) val.xyz = 0.30f * val.x + 0.59f * val.y + 0.11f * val.z;
+    val.xyz = clamp(floor(val.xyz * f + t) * rf, 0.0f, 1.0f);
+  }
+  pixel.xyz = val.xyz;
+  write_imagef(out, (int2)(x, y), pixel);
+}
@@ -0,0 +1,147 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common.h"
+
+// these follow src/iop/grain.c, keep them in sync
+#define GRAIN_LIGHTNESS_STRENGTH_SCALE 0.15f
+#define GRAIN_LUT_SIZE 128
+#define OCTAVES 3
+
+constant float amplitude[OCTAVES] = { 0.2340f, 0.7850f, 1.2150f };
+
+constant int grad3[12][3] = { { 1, 1, 0 }, { -1, 1, 0 }, { 1, -1, 0 }, { -1, -1, 0 },
+                              { 1, 0, 1 }, { -1, 0, 1 }, { 1, 0, -1 }, { -1, 0, -1 },
+                              { 0, 1, 1 }, { 0, -1, 1 }, { 0, 1, -1 }, { 0, -1, -1 } };
+
+inline float
+corner(const int gi, const float x, const float y, const float z)
+{
+  const float t = 0.6f - x * x - y * y - z * z;
+  if(t < 0.0f) return 0.0f;
+  const float t2 = t * t;
+  return t2 * t2 * (grad3[gi][0] * x + grad3[gi][1] * y + grad3[gi][2] * z);
+}
+
+// 3d simplex noise as _simplex_noise() on the cpu, in float: the host keeps the coordinates small by
+// wrapping the per image offset, the noise repeats every 768 along x
+float
+simplex_noise(const float xin, const float yin, const float zin, constant int *perm)
+{
+  const float F3 = 1.0f / 3.0f;
+  const float G3 = 1.0f / 6.0f;
+  const float s = (xin + yin + zin) * F3;
+  const int i = (int)floor(xin + s);
+  const int j = (int)floor(yin + s);
+  const int k = (int)floor(zin + s);
+  const float t = (i + j + k) * G3;
+  const float x0 = xin - (i - t);
+  const float y0 = yin - (j - t);
+  const float z0 = zin - (k - t);
+
+  int i1, j1, k1, i2, j2, k2;
+  if(x0 >= y0)
+  {
+    if(y0 >= z0)      { i1 = 1; j1 = 0; k1 = 0; i2 = 1; j2 = 1; k2 = 0; }
+    else if(x0 >= z0) { i1 = 1; j1 = 0; k1 = 0; i2 = 1; j2 = 0; k2 = 1; }
+    else              { i1 = 0; j1 = 0; k1 = 1; i2 = 1; j2 = 0; k2 = 1; }
+  }
+  else
+  {
+    if(y0 < z0)       { i1 = 0; j1 = 0; k1 = 1; i2 = 0; j2 = 1; k2 = 1; }
+    else if(x0 < z0)  { i1 = 0; j1 = 1; k1 = 0; i2 = 0; j2 = 1; k2 = 1; }
+    else              { i1 = 0; j1 = 1; k1 = 0; i2 = 1; j2 = 1; k2 = 0; }
+  }
+
+  const int ii = i & 255;
+  const int jj = j & 255;
+  const int kk = k & 255;
+  const int gi0 = perm[ii + perm[jj + perm[kk]]] % 12;
+  const int gi1 = perm[ii + i1 + perm[jj + j1 + perm[kk + k1]]] % 12;
+  const int gi2 = perm[ii + i2 + perm[jj + j2 + perm[kk + k2]]] % 12;
+  const int gi3 = perm[ii + 1 + perm[jj + 1 + perm[kk + 1]]] % 12;
+
+  const float n0 = corner(gi0, x0, y0, z0);
+  const float n1 = corner(gi1, x0 - i1 + G3, y0 - j1 + G3, z0 - k1 + G3);
+  const float n2 = corner(gi2, x0 - i2 + 2.0f * G3, y0 - j2 + 2.0f * G3, z0 - k2 + 2.0f * G3);
+  const float n3 = corner(gi3, x0 - 1.0f + 3.0f * G3, y0 - 1.0f + 3.0f * G3, z0 - 1.0f + 3.0f * G3);
+  return 32.0f * (n0 + n1 + n2 + n3);
+}
+
+inline float
+grain_noise(const float x, const float y, const float4 freq, const float4 offset, constant int *perm)
+{
+  return simplex_noise(x * freq.x + offset.x, y * freq.x, 0.0f, perm) * amplitude[0]
+       + simplex_noise(x * freq.y + offset.y, y * freq.y, 1.0f, perm) * amplitude[1]
+       + simplex_noise(x * freq.z + offset.z, y * freq.z, 2.0f, perm) * amplitude[2];
+}
+
+inline float
+lut_lookup_2d(read_only image2d_t lut, const float x, const float y)
+{
+  const float _x = clamp((x + 0.5f) * (GRAIN_LUT_SIZE - 1), 0.0f, (float)(GRAIN_LUT_SIZE - 1));
+  const float _y = clamp(y * (GRAIN_LUT_SIZE - 1), 0.0f, (float)(GRAIN_LUT_SIZE - 1));
+  const int _x0 = min((int)_x, GRAIN_LUT_SIZE - 2);
+  const int _y0 = min((int)_y, GRAIN_LUT_SIZE - 2);
+  const float x_diff = _x - _x0;
+  const float y_diff = _y - _y0;
+
+  const float l00 = read_imagef(lut, sampleri, (int2)(_x0, _y0)).x;
+  const float l01 = read_imagef(lut, sampleri, (int2)(_x0 + 1, _y0)).x;
+  const float l10 = read_imagef(lut, sampleri, (int2)(_x0, _y0 + 1)).x;
+  const float l11 = read_imagef(lut, sampleri, (int2)(_x0 + 1, _y0 + 1)).x;
+
+  const float xy0 = (1.0f - y_diff) * l00 + l10 * y_diff;
+  const float xy1 = (1.0f - y_diff) * l01 + l11 * y_diff;
+  return xy0 * (1.0f - x_diff) + xy1 * x_diff;
+}
+
+// x and y are normalized to the shorter side of the image as on the cpu, norm = 1 / (roi scale * that side)
+kernel void
+grain(read_only image2d_t in, write_only image2d_t out, const int width, const int height,
+      const int roi_x, const int roi_y, const float norm, constant int *perm, read_only image2d_t lut,
+      const float4 freq, const float4 offset, const float strength, const float filtermul, const int filter)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if(x >= width || y >= height) return;
+
+  float4 pixel = read_imagef(in, sampleri, (int2)(x, y));
+
+  const float wx = (roi_x + x) * norm;
+  const float wy = (roi_y + y) * norm;
+
+  float noise = 0.0f;
+  if(filter)
+  {
+    // rank-1 lattice downsampling when zoomed out, fib1 = 34 and fib2 = 21
+    for(int l = 0; l < 21; l++)
+    {
+      const float px = l / 21.0f;
+      float py = l * (34.0f / 21.0f);
+      py -= (int)py;
+      noise += grain_noise(wx + px * filtermul, wy + py * filtermul, freq, offset, perm);
+    }
+    noise *= 1.0f / 21.0f;
+  }
+  else
+    noise = grain_noise(wx, wy, freq, offset, perm);
+
+  pixel.x += lut_lookup_2d(lut, noise * strength * GRAIN_LIGHTNESS_STRENGTH_SCALE, pixel.x / 100.0f);
+  write_imagef(out, (int2)(x, y), pixel);
+}
@@ -0,0 +1,129 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common.h"
+#include "colorspace.cl"
+
+// these follow src/common/histogram.c, keep them in sync
+typedef enum dt_histogram_cl_mode_t
+{
+  DT_HISTOGRAM_CL_RAW = 0,
+  DT_HISTOGRAM_CL_RGB = 1,
+  DT_HISTOGRAM_CL_LAB = 2,
+  DT_HISTOGRAM_CL_LCH = 3
+} dt_histogram_cl_mode_t;
+
+
+// the bin of v, clamped like in histogram.c. NaN goes to bin 0
+static inline int
+bin(const float v, const int bins)
+{
+  return (int)clamp(isnan(v) ? 0.0f : v, 0.0f, (float)(bins - 1));
+}
+
+
+// every work group counts the rows y = crop_y + step * (group + k * groups) in its own histogram in local
+// memory, with the 4 * bins counters interleaved like on the cpu. the groups are then added to the histogram
+// on the device, which has to be zeroed before.
+kernel void
+histogram_collect(read_only image2d_t in, global unsigned int *histogram, const int crop_x, const int crop_y,
+                  const int x_end, const int y_end, const int step, const int bins, const float mul,
+                  const int mode, local unsigned int *buffer)
+{
+  const int lid = get_local_id(0);
+  const int lsz = get_local_size(0);
+  const int group = get_group_id(0);
+  const int groups = get_num_groups(0);
+
+  for(int k = lid; k < 4 * bins; k += lsz) buffer[k] = 0;
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  for(int y = crop_y + step * group; y < y_end; y += step * groups)
+  {
+    for(int x = crop_x + step * lid; x < x_end; x += step * lsz)
+    {
+      const float4 pixel = read_imagef(in, sampleri, (int2)(x, y));
+
+      if(mode == DT_HISTOGRAM_CL_RAW)
+      {
+        atomic_inc(buffer + 4 * bin(mul * pixel.x, bins));
+        continue;
+      }
+
+      float4 v;
+      if(mode == DT_HISTOGRAM_CL_RGB)
+        v = mul * pixel;
+      else if(mode == DT_HISTOGRAM_CL_LAB)
+        v = (float4)(mul / 100.0f * pixel.x, mul / 256.0f * (pixel.y + 128.0f), mul / 256.0f * (pixel.z + 128.0f), 0.0f);
+      else
+      {
+        const float4 LCh = Lab_2_LCH(pixel);
+        v = (float4)(mul * LCh.x / 100.0f, mul * LCh.y / (128.0f * sqrt(2.0f)), mul * LCh.z, 0.0f);
+      }
+
+      atomic_inc(buffer + 4 * bin(v.x, bins));
+      atomic_inc(buffer + 4 * bin(v.y, bins) + 1);
+      atomic_inc(buffer + 4 * bin(v.z, bins) + 2);
+    }
+  }
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  for(int k = lid; k < 4 * bins; k += lsz)
+  {
+    const unsigned int count = buffer[k];
+    if(count) atomic_add(histogram + k, count);
+  }
+}
+
+
+// counts the pixels into the bins of the waveform, see dt_histogram_waveform(). buf holds the
+// waveform_width x waveform_height x 3 counters and has to be zeroed before.
+kernel void
+histogram_waveform(read_only image2d_t in, global unsigned int *buf, const int width, const int height,
+                   const int bin_width, const int waveform_width, const int waveform_height)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if(x >= width || y >= height) return;
+
+  const float4 pixel = read_imagef(in, sampleri, (int2)(x, y));
+  const int out_x = x / bin_width;
+  // blue, green, red like on the cpu, 1.0 is at 8/9 of the height
+  const float4 v = 1.0f - (8.0f / 9.0f) * (float4)(pixel.z, pixel.y, pixel.x, 0.0f);
+  const float h = (float)(waveform_height - 1);
+
+  atomic_inc(buf + (out_x + waveform_width * (int)(clamp(isnan(v.x) ? 0.0f : v.x, 0.0f, 1.0f) * h)) * 3 + 0);
+  atomic_inc(buf + (out_x + waveform_width * (int)(clamp(isnan(v.y) ? 0.0f : v.y, 0.0f, 1.0f) * h)) * 3 + 1);
+  atomic_inc(buf + (out_x + waveform_width * (int)(clamp(isnan(v.z) ? 0.0f : v.z, 0.0f, 1.0f) * h)) * 3 + 2);
+}
+
+
+// turns the counts into the 3 planes of 8 bit rows of the waveform
+kernel void
+histogram_waveform_map(global const unsigned int *buf, global unsigned char *waveform, const int waveform_width,
+                       const int waveform_height, const int waveform_stride, const float scale, const float gamma)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if(x >= waveform_width || y >= 3 * waveform_height) return;
+
+  const int k = y / waveform_height;
+  const int out_y = y - k * waveform_height;
+  const float v = (float)buf[(x + waveform_width * out_y) * 3 + k];
+  waveform[waveform_stride * y + x] = (unsigned char)clamp(pow(v * scale, gamma) * 255.0f, 0.0f, 255.0f);
+}
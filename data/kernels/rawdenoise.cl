@@ -0,0 +1,88 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common.h"
+
+// the wavelet denoise of src/iop/rawdenoise.c for bayer sensors: every cfa plane is taken out of the
+// mosaic at half size, decomposed with the a trous hat filter and put back. the planes are plain buffers of
+// hwidth x hheight, offx and offy locate the plane in the 2x2 cfa block
+
+inline int
+mirror(int i, const int size)
+{
+  if(i < 0) i = -i;
+  if(i > size - 1) i = 2 * (size - 1) - i;
+  return clamp(i, 0, size - 1);
+}
+
+kernel void
+rawdenoise_extract(read_only image2d_t in, global float *low, global float *acc, const int hwidth,
+                   const int hheight, const int offx, const int offy)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if(x >= hwidth || y >= hheight) return;
+
+  const float v = read_imagef(in, sampleri, (int2)(2 * x + offx, 2 * y + offy)).x;
+  const int k = mad24(y, hwidth, x);
+  low[k] = sqrt(fmax(0.0f, v));
+  acc[k] = 0.0f;
+}
+
+kernel void
+rawdenoise_hat_h(global const float *in, global float *out, const int hwidth, const int hheight,
+                 const int scale)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if(x >= hwidth || y >= hheight) return;
+
+  global const float *row = in + mul24(y, hwidth);
+  out[mad24(y, hwidth, x)]
+      = (2.0f * row[x] + row[mirror(x - scale, hwidth)] + row[mirror(x + scale, hwidth)]) * 0.25f;
+}
+
+// second half of the hat filter, which also adds the thresholded detail of this level to acc
+kernel void
+rawdenoise_hat_v(global const float *in, global const float *prev, global float *low, global float *acc,
+                 const int hwidth, const int hheight, const int scale, const float thold)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if(x >= hwidth || y >= hheight) return;
+
+  const int k = mad24(y, hwidth, x);
+  const float l = (2.0f * in[k] + in[mad24(mirror(y - scale, hheight), hwidth, x)]
+                   + in[mad24(mirror(y + scale, hheight), hwidth, x)]) * 0.25f;
+  low[k] = l;
+  const float diff = prev[k] - l;
+  acc[k] += copysign(fmax(fabs(diff) - thold, 0.0f), diff);
+}
+
+kernel void
+rawdenoise_insert(global const float *acc, global const float *low, write_only image2d_t out,
+                  const int hwidth, const int hheight, const int offx, const int offy)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if(x >= hwidth || y >= hheight) return;
+
+  const int k = mad24(y, hwidth, x);
+  const float d = acc[k] + low[k];
+  write_imagef(out, (int2)(2 * x + offx, 2 * y + offy), (float4)(d * d, 0.0f, 0.0f, 0.0f));
+}
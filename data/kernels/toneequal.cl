@@ -0,0 +1,241 @@
+/*
+    This file is part of darktable,
+    copyright (c) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common.h"
+
+// these follow src/common/luminance_mask.h and src/common/fast_guided_filter.h, keep them in sync
+
+#define MIN_FLOAT 1.52587890625e-05f // 2^-16
+
+typedef enum dt_iop_luminance_mask_method_t
+{
+  DT_TONEEQ_MEAN = 0,
+  DT_TONEEQ_LIGHTNESS,
+  DT_TONEEQ_VALUE,
+  DT_TONEEQ_NORM_1,
+  DT_TONEEQ_NORM_2,
+  DT_TONEEQ_NORM_POWER,
+  DT_TONEEQ_GEOMEAN,
+  DT_TONEEQ_LAST
+} dt_iop_luminance_mask_method_t;
+
+
+kernel void
+toneeq_luminance_mask(read_only image2d_t in, write_only image2d_t out, const int width, const int height,
+                      const int method, const float exposure_boost, const float fulcrum,
+                      const float contrast_boost)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if(x >= width || y >= height) return;
+
+  const float4 i = read_imagef(in, sampleri, (int2)(x, y));
+  float lum;
+
+  switch(method)
+  {
+    case DT_TONEEQ_MEAN:
+      lum = (i.x + i.y + i.z) / 3.0f;
+      break;
+    case DT_TONEEQ_LIGHTNESS:
+      lum = (fmax(fmax(i.x, i.y), i.z) + fmin(fmin(i.x, i.y), i.z)) / 2.0f;
+      break;
+    case DT_TONEEQ_VALUE:
+      lum = fmax(fmax(i.x, i.y), i.z);
+      break;
+    case DT_TONEEQ_NORM_1:
+      lum = fabs(i.x) + fabs(i.y) + fabs(i.z);
+      break;
+    case DT_TONEEQ_NORM_POWER:
+    {
+      const float4 a = fabs(i);
+      const float4 a2 = a * a;
+      lum = (a2.x * a.x + a2.y * a.y + a2.z * a.z) / (a2.x + a2.y + a2.z);
+      break;
+    }
+    case DT_TONEEQ_GEOMEAN:
+      lum = native_powr(fabs(i.x * i.y * i.z), 1.0f / 3.0f);
+      break;
+    case DT_TONEEQ_NORM_2:
+    default:
+      lum = sqrt(i.x * i.x + i.y * i.y + i.z * i.z);
+      break;
+  }
+
+  lum = fmax((exposure_boost * lum - fulcrum) * contrast_boost + fulcrum, MIN_FLOAT);
+  write_imagef(out, (int2)(x, y), (float4)(lum, 0.0f, 0.0f, 0.0f));
+}
+
+
+// bilinear sample of in at the position of the pixel (x, y) of a width_out x height_out image,
+// same sampling positions as interpolate_bilinear()
+static inline float4
+bilinear(read_only image2d_t in, const int x, const int y, const int width_in, const int height_in,
+         const int width_out, const int height_out)
+{
+  const float x_in = (float)x / (float)width_out * (float)width_in;
+  const float y_in = (float)y / (float)height_out * (float)height_in;
+  const int x_prev = min((int)floor(x_in), width_in - 1);
+  const int x_next = min((int)floor(x_in) + 1, width_in - 1);
+  const int y_prev = min((int)floor(y_in), height_in - 1);
+  const int y_next = min((int)floor(y_in) + 1, height_in - 1);
+
+  const float Dy_next = floor(y_in) + 1.0f - y_in;
+  const float Dy_prev = 1.0f - Dy_next;
+  const float Dx_next = floor(x_in) + 1.0f - x_in;
+  const float Dx_prev = 1.0f - Dx_next;
+
+  const float4 NW = read_imagef(in, sampleri, (int2)(x_prev, y_prev));
+  const float4 NE = read_imagef(in, sampleri, (int2)(x_next, y_prev));
+  const float4 SE = read_imagef(in, sampleri, (int2)(x_next, y_next));
+  const float4 SW = read_imagef(in, sampleri, (int2)(x_prev, y_next));
+
+  return Dy_prev * (SW * Dx_next + SE * Dx_prev) + Dy_next * (NW * Dx_next + NE * Dx_prev);
+}
+
+
+kernel void
+toneeq_resample(read_only image2d_t in, write_only image2d_t out, const int width_in, const int height_in,
+                const int width_out, const int height_out)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if(x >= width_out || y >= height_out) return;
+
+  write_imagef(out, (int2)(x, y), bilinear(in, x, y, width_in, height_in, width_out, height_out));
+}
+
+
+// quantizes the image into the guide I, and stores { I, p, I * I, I * p } for the variance analysis
+kernel void
+toneeq_moments(read_only image2d_t image, write_only image2d_t out, const int width, const int height,
+               const float sampling, const float clip_min, const float clip_max)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if(x >= width || y >= height) return;
+
+  const float p = read_imagef(image, sampleri, (int2)(x, y)).x;
+  const float I = (sampling == 0.0f) ? p : clamp(exp2(floor(log2(p) / sampling) * sampling), clip_min, clip_max);
+  write_imagef(out, (int2)(x, y), (float4)(I, p, I * I, I * p));
+}
+
+
+// box average over 2 * radius + 1 pixels, the window is cropped at the borders
+kernel void
+toneeq_box_vertical(read_only image2d_t in, write_only image2d_t out, const int width, const int height,
+                    const int radius)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if(x >= width || y >= height) return;
+
+  const int begin = max(y - radius, 0);
+  const int end = min(y + radius, height - 1);
+  float4 sum = (float4)0.0f;
+  for(int j = begin; j <= end; j++) sum += read_imagef(in, sampleri, (int2)(x, j));
+  write_imagef(out, (int2)(x, y), sum / (float)(end - begin + 1));
+}
+
+
+kernel void
+toneeq_box_horizontal(read_only image2d_t in, write_only image2d_t out, const int width, const int height,
+                      const int radius)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if(x >= width || y >= height) return;
+
+  const int begin = max(x - radius, 0);
+  const int end = min(x + radius, width - 1);
+  float4 sum = (float4)0.0f;
+  for(int i = begin; i <= end; i++) sum += read_imagef(in, sampleri, (int2)(i, y));
+  write_imagef(out, (int2)(x, y), sum / (float)(end - begin + 1));
+}
+
+
+// the a and b of the linear model p = a * I + b from the box-averaged moments
+kernel void
+toneeq_linear_model(read_only image2d_t in, write_only image2d_t out, const int width, const int height,
+                    const float feathering)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if(x >= width || y >= height) return;
+
+  const float4 m = read_imagef(in, sampleri, (int2)(x, y));
+  const float d = fmax((m.z - m.x * m.x) + feathering, 1e-15f);
+  const float a = (m.w - m.x * m.y) / d;
+  const float b = m.y - a * m.x;
+  write_imagef(out, (int2)(x, y), (float4)(a, b, 0.0f, 0.0f));
+}
+
+
+// image = a * image + b, or the geometric mean of both. ab may be smaller than the image, it is then upsampled
+kernel void
+toneeq_blend(read_only image2d_t image, read_only image2d_t ab, write_only image2d_t out, const int width,
+             const int height, const int ab_width, const int ab_height, const int geomean)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if(x >= width || y >= height) return;
+
+  const float i = read_imagef(image, sampleri, (int2)(x, y)).x;
+  const float4 c = (ab_width == width && ab_height == height) ? read_imagef(ab, sampleri, (int2)(x, y))
+                                                              : bilinear(ab, x, y, ab_width, ab_height, width, height);
+  const float o = fmax(i * c.x + c.y, MIN_FLOAT);
+  write_imagef(out, (int2)(x, y), (float4)(geomean ? sqrt(i * o) : o, 0.0f, 0.0f, 0.0f));
+}
+
+
+// builds the correction from the gaussian channels and applies it, or shows the mask.
+// the input may be padded by offset_x, offset_y with respect to the output.
+kernel void
+toneeq_apply(read_only image2d_t in, read_only image2d_t luminance, write_only image2d_t out,
+             const int width, const int height, const int offset_x, const int offset_y,
+             global const float *factors, const float gauss_denom, const int mask_display)
+{
+  const int x = get_global_id(0);
+  const int y = get_global_id(1);
+  if(x >= width || y >= height) return;
+
+  const int2 pos = (int2)(x + offset_x, y + offset_y);
+  const float4 i = read_imagef(in, sampleri, pos);
+  const float lum = read_imagef(luminance, sampleri, pos).x;
+  float4 o;
+
+  if(mask_display)
+  {
+    o = (float4)(lum, lum, lum, i.w);
+  }
+  else
+  {
+    // the radial-basis interpolation is valid in [-8; 0] EV, centers split it in 7 even steps
+    const float exposure = clamp(log2(lum), -8.0f, 0.0f);
+    float result = 0.0f;
+    for(int k = 0; k < 8; k++)
+    {
+      const float r = exposure - (float)(8 * k - 56) / 7.0f;
+      result += native_exp(-r * r / gauss_denom) * factors[k];
+    }
+    o = i * clamp(result, 0.25f, 4.0f);
+    o.w = i.w;
+  }
+
+  write_imagef(out, (int2)(x, y), o);
+}
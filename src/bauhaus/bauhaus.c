@@ -2325,6 +2325,24 @@ void dt_bauhaus_slider_set_soft(GtkWidget *widget, float pos)
   dt_bauhaus_slider_set(widget, rpos);
 }
 
+// remembers when a value has been sent to the pipe while dragging
+static void _slider_value_sent(dt_bauhaus_slider_data_t *d)
+{
+  d->sent_timestamp = darktable.develop ? darktable.develop->timestamp : 0;
+  d->sent_time = dt_get_wtime();
+}
+
+// whether the preview pipe has processed the last value sent, so a new one doesn't cancel it. waits no
+// longer than DT_BAUHAUS_SLIDER_VALUE_CHANGED_DELAY_MAX, and not at all outside of the darkroom.
+static gboolean _slider_value_processed(const dt_bauhaus_slider_data_t *d)
+{
+  const dt_develop_t *dev = darktable.develop;
+  if(!dev || !dev->gui_attached || !dev->preview_pipe) return TRUE;
+  if(dt_get_wtime() - d->sent_time > DT_BAUHAUS_SLIDER_VALUE_CHANGED_DELAY_MAX / 1000.0) return TRUE;
+  return dev->preview_status == DT_DEV_PIXELPIPE_VALID
+         && (uint32_t)dev->preview_pipe->input_timestamp >= d->sent_timestamp;
+}
+
 static void dt_bauhaus_slider_set_normalized(dt_bauhaus_widget_t *w, float pos)
 {
   dt_bauhaus_slider_data_t *d = &w->data.slider;
@@ -2341,6 +2359,7 @@ static void dt_bauhaus_slider_set_normalized(dt_bauhaus_widget_t *w, float pos)
   {
     g_signal_emit_by_name(G_OBJECT(w), "value-changed");
     d->is_changed = 0;
+    _slider_value_sent(d);
   }
 }
 
@@ -2350,19 +2369,18 @@ static gboolean dt_bauhaus_slider_postponed_value_change(gpointer data)
 
   dt_bauhaus_widget_t *w = (dt_bauhaus_widget_t *)data;
   dt_bauhaus_slider_data_t *d = &w->data.slider;
-  if(d->is_changed)
+  // send the latest value once the former one has been rendered, the value on release is always sent
+  if(d->is_changed && _slider_value_processed(d))
   {
     g_signal_emit_by_name(G_OBJECT(w), "value-changed");
     d->is_changed = 0;
+    _slider_value_sent(d);
   }
 
   if(!d->is_dragging) d->timeout_handle = 0;
   else
-  {
-    int delay = CLAMP(darktable.develop->average_delay * 3 / 2, DT_BAUHAUS_SLIDER_VALUE_CHANGED_DELAY_MIN,
-                      DT_BAUHAUS_SLIDER_VALUE_CHANGED_DELAY_MAX);
-    d->timeout_handle = g_timeout_add(delay, dt_bauhaus_slider_postponed_value_change, data);
-  }
+    d->timeout_handle = g_timeout_add(DT_BAUHAUS_SLIDER_VALUE_CHANGED_DELAY_MIN,
+                                      dt_bauhaus_slider_postponed_value_change, data);
 
   return FALSE;
 }
@@ -2527,14 +2545,14 @@ static gboolean dt_bauhaus_slider_button_press(GtkWidget *widget, GdkEventButton
     {
       const float l = 0.0f;
       const float r = slider_right_pos((float)allocation.width);
+      darktable.bauhaus->dragging = TRUE;
       dt_bauhaus_slider_set_normalized(w, (event->x / allocation.width - l) / (r - l));
       dt_bauhaus_slider_data_t *d = &w->data.slider;
       d->is_dragging = 1;
-      int delay = CLAMP(darktable.develop->average_delay * 3 / 2, DT_BAUHAUS_SLIDER_VALUE_CHANGED_DELAY_MIN,
-                        DT_BAUHAUS_SLIDER_VALUE_CHANGED_DELAY_MAX);
       // timeout_handle should always be zero here, but check just in case
       if(!d->timeout_handle)
-        d->timeout_handle = g_timeout_add(delay, dt_bauhaus_slider_postponed_value_change, widget);
+        d->timeout_handle = g_timeout_add(DT_BAUHAUS_SLIDER_VALUE_CHANGED_DELAY_MIN,
+                                          dt_bauhaus_slider_postponed_value_change, widget);
     }
     return TRUE;
   }
@@ -2559,6 +2577,7 @@ static gboolean dt_bauhaus_slider_button_release(GtkWidget *widget, GdkEventButt
     const float l = 0.0f;
     const float r = slider_right_pos((float)tmp.width);
     dt_bauhaus_slider_set_normalized(w, (event->x / tmp.width - l) / (r - l));
+    darktable.bauhaus->dragging = FALSE;
 
     return TRUE;
   }
@@ -86,6 +86,8 @@ typedef struct dt_bauhaus_slider_data_t
   int is_dragging;      // indicates is mouse is dragging slider
   int is_changed;       // indicates new data
   guint timeout_handle; // used to store id of timeout routine
+  uint32_t sent_timestamp; // develop timestamp after the last value sent while dragging
+  double sent_time;        // and the time it was sent
   float (*curve)(GtkWidget*, float, dt_bauhaus_curve_t); // callback function
 } dt_bauhaus_slider_data_t;
 
@@ -193,6 +195,8 @@ typedef struct dt_bauhaus_t
   guint signals[DT_BAUHAUS_LAST_SIGNAL];
   // flag set on button press indicating that popup should be hidden in button release handler
   gboolean hiding;
+  // a slider is dragged, the history items of its values make up one undo step
+  gboolean dragging;
 
   // vim-style keyboard interfacing/scripting stuff:
   GHashTable *keymap; // hashtable translating control name -> bauhaus widget ptr
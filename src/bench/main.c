@@ -0,0 +1,652 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * times the processing modules one by one. the image (a raw or any other file, or a synthetic one) is loaded
+ * into an export pipe with its history, then every module is enabled in turn with its default or the given
+ * params, and the plain, sse2, avx2 and avx512 variants of its process() and its process_cl() are run on their
+ * own at several sizes and thread counts. the input of a module is cut from the image where it takes the format
+ * of the pipe input, and is a synthetic buffer in its format elsewhere.
+ *
+ * one line per run is written as tab separated values: module, instance, code path, device, output width and
+ * height, threads, median seconds, MPix/s, scaling efficiency against the fewest threads and the peak memory
+ * in MB the run took on top of its buffers (host memory is only known on linux).
+ *
+ * with --replay a darkroom recording is timed instead, see replay.c.
+ */
+
+#include "bench/bench.h"
+#include "common/darktable.h"
+#include "common/exif.h"
+#include "common/film.h"
+#include "common/image.h"
+#include "common/imageio.h"
+#include "common/mipmap_cache.h"
+#include "common/opencl.h"
+#include "develop/develop.h"
+#include "develop/format.h"
+#include "develop/imageop.h"
+#include "develop/pixelpipe.h"
+
+#include <glib/gstdio.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+#include "osx/osx.h"
+#endif
+
+#ifdef _WIN32
+#include "win/main_wrapper.h"
+#endif
+
+#define BENCH_MAX_VALUES 16
+
+typedef struct dt_bench_options_t
+{
+  gchar **modules;  // NULL for all of them
+  GHashTable *params; // op -> encoded params as in the xmp files
+  int sizes[BENCH_MAX_VALUES], num_sizes;
+  int threads[BENCH_MAX_VALUES], num_threads;
+  int runs;
+  int synthetic_width, synthetic_height;
+  gboolean cpu, cl;
+  FILE *out;
+} dt_bench_options_t;
+
+// what one run took
+typedef struct dt_bench_result_t
+{
+  double seconds;
+  double peak_mb; // negative if unknown
+} dt_bench_result_t;
+
+static void usage(const char *progname)
+{
+  fprintf(stderr, "usage: %s [<input file>] [options] [--core <darktable options>]\n", progname);
+  fprintf(stderr, "\n");
+  fprintf(stderr, "without an input file a synthetic image is benchmarked.\n");
+  fprintf(stderr, "\n");
+  fprintf(stderr, "options:\n");
+  fprintf(stderr, "   --modules <op>[,<op>...] default: all of them\n");
+  fprintf(stderr, "   --params <op>=<params> params of the module, encoded as in the xmp files. default: defaults\n");
+  fprintf(stderr, "   --sizes <width>[,<width>...] output widths, default: 1024,2048,4096\n");
+  fprintf(stderr, "   --threads <n>[,<n>...] default: 1, 2, 4 ... up to all cores\n");
+  fprintf(stderr, "   --runs <n> timed runs of which the median is taken, default: 5\n");
+  fprintf(stderr, "   --synthetic <width>x<height> size of the synthetic image, default: 6000x4000\n");
+  fprintf(stderr, "   --cpu-only\n");
+  fprintf(stderr, "   --opencl-only\n");
+  fprintf(stderr, "   --output <file> default: stdout\n");
+  fprintf(stderr, "   --replay <darkroom recording> times the recorded changes instead of the modules\n");
+  fprintf(stderr, "   --help,-h\n");
+}
+
+static int _parse_list(const char *arg, int *values)
+{
+  gchar **tokens = g_strsplit(arg, ",", BENCH_MAX_VALUES);
+  int n = 0;
+  for(gchar **t = tokens; *t; t++)
+  {
+    const int v = atoi(*t);
+    if(v > 0) values[n++] = v;
+  }
+  g_strfreev(tokens);
+  return n;
+}
+
+// a smooth gradient with edges and noise, written as pfm so that it is imported like any other image
+static gchar *_write_synthetic(const int width, const int height)
+{
+  gchar *filename = NULL;
+  const int fd = g_file_open_tmp("darktable-bench-XXXXXX.pfm", &filename, NULL);
+  if(fd < 0) return NULL;
+  FILE *f = fdopen(fd, "wb");
+  if(!f)
+  {
+    close(fd);
+    g_free(filename);
+    return NULL;
+  }
+
+  fprintf(f, "PF\n%d %d\n-1.0\n", width, height);
+  float *row = malloc(sizeof(float) * 3 * width);
+  uint32_t seed = 0x12345678u;
+  for(int j = 0; j < height; j++)
+  {
+    for(int i = 0; i < width; i++)
+    {
+      const float x = (float)i / width, y = (float)j / height;
+      const float edge = (((i / 64) + (j / 64)) & 1) ? 0.1f : 0.0f;
+      for(int c = 0; c < 3; c++)
+      {
+        seed = seed * 1664525u + 1013904223u;
+        const float noise = ((seed >> 8) / (float)(1 << 24) - 0.5f) * 0.02f;
+        row[3 * i + c] = 0.05f + 0.8f * (c == 0 ? x : c == 1 ? y : 1.0f - x * y) + edge + noise;
+      }
+    }
+    fwrite(row, sizeof(float), 3 * width, f);
+  }
+  free(row);
+  fclose(f);
+  return filename;
+}
+
+uint32_t dt_bench_import(const char *filename)
+{
+  dt_film_t film;
+  gchar *directory = g_path_get_dirname(filename);
+  const int filmid = dt_film_new(&film, directory);
+  g_free(directory);
+  return dt_image_import(filmid, filename, TRUE);
+}
+
+// the resident and the peak resident memory of the process in kB, -1 where they can't be read
+static void _memory_kb(long *rss, long *peak)
+{
+  *rss = *peak = -1;
+  FILE *f = g_fopen("/proc/self/status", "r");
+  if(!f) return;
+  char line[256];
+  while(fgets(line, sizeof(line), f))
+  {
+    if(!strncmp(line, "VmRSS:", 6)) *rss = atol(line + 6);
+    if(!strncmp(line, "VmHWM:", 6)) *peak = atol(line + 6);
+  }
+  fclose(f);
+}
+
+// starts the peak resident memory again from the current one, returns FALSE if it can't be done
+static gboolean _memory_peak_reset(void)
+{
+  FILE *f = g_fopen("/proc/self/clear_refs", "w");
+  if(!f) return FALSE;
+  const gboolean ok = fputs("5", f) >= 0;
+  return fclose(f) == 0 && ok;
+}
+
+// fills the buffer with the image if it comes in the format of the pipe input, else with synthetic values
+static void _fill_input(void *buf, const dt_iop_buffer_dsc_t *dsc, const dt_iop_roi_t *roi,
+                        const dt_dev_pixelpipe_t *pipe)
+{
+  const size_t bpp = dt_iop_buffer_dsc_to_bpp(dsc);
+  const gboolean from_image = pipe->input && dsc->channels == pipe->dsc.channels
+                              && dsc->datatype == pipe->dsc.datatype;
+  for(int j = 0; j < roi->height; j++)
+    for(int i = 0; i < roi->width; i++)
+    {
+      char *out = (char *)buf + ((size_t)j * roi->width + i) * bpp;
+      if(from_image)
+      {
+        const int x = CLAMP(roi->x + i, 0, pipe->iwidth - 1);
+        const int y = CLAMP(roi->y + j, 0, pipe->iheight - 1);
+        memcpy(out, (const char *)pipe->input + ((size_t)y * pipe->iwidth + x) * bpp, bpp);
+        continue;
+      }
+      const float v = 0.1f + 0.7f * (float)(i + j) / (roi->width + roi->height) + ((i ^ j) & 7) * 0.01f;
+      for(int c = 0; c < dsc->channels; c++)
+      {
+        if(dsc->datatype == TYPE_UINT16)
+          ((uint16_t *)out)[c] = (uint16_t)(v * 65535.0f);
+        else
+          ((float *)out)[c] = c == 3 ? 0.0f : v;
+      }
+    }
+}
+
+static double _median(double *t, const int n)
+{
+  for(int i = 1; i < n; i++)
+    for(int k = i; k > 0 && t[k - 1] > t[k]; k--)
+    {
+      const double tmp = t[k];
+      t[k] = t[k - 1];
+      t[k - 1] = tmp;
+    }
+  return n & 1 ? t[n / 2] : 0.5 * (t[n / 2 - 1] + t[n / 2]);
+}
+
+typedef void (*dt_bench_process_t)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                                   const void *const i, void *const o, const struct dt_iop_roi_t *const roi_in,
+                                   const struct dt_iop_roi_t *const roi_out);
+
+static dt_bench_result_t _bench_cpu(dt_bench_process_t process, dt_iop_module_t *module,
+                                    dt_dev_pixelpipe_iop_t *piece, const void *in, void *out,
+                                    const dt_iop_roi_t *roi_in, const dt_iop_roi_t *roi_out, const int runs)
+{
+  dt_bench_result_t result = { 0.0, -1.0 };
+
+  // the first run warms up and tells the memory
+  long rss = -1, peak = -1;
+  const gboolean memory = _memory_peak_reset();
+  if(memory) _memory_kb(&rss, &peak);
+  process(module, piece, in, out, roi_in, roi_out);
+  if(memory && rss >= 0)
+  {
+    long rss_after;
+    _memory_kb(&rss_after, &peak);
+    if(peak >= 0) result.peak_mb = MAX(peak - rss, 0) / 1024.0;
+  }
+
+  double *t = malloc(sizeof(double) * runs);
+  for(int k = 0; k < runs; k++)
+  {
+    const double start = dt_get_wtime();
+    process(module, piece, in, out, roi_in, roi_out);
+    t[k] = dt_get_wtime() - start;
+  }
+  result.seconds = _median(t, runs);
+  free(t);
+  return result;
+}
+
+#ifdef HAVE_OPENCL
+// runs process_cl() on buffers which are on the device already, the transfers are not timed.
+// returns FALSE if the module failed on the device.
+static gboolean _bench_cl(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, void *in, const size_t bpp_in,
+                          const size_t bpp_out, const dt_iop_roi_t *roi_in, const dt_iop_roi_t *roi_out,
+                          const int runs, int *devid, dt_bench_result_t *result)
+{
+  dt_dev_pixelpipe_t *pipe = piece->pipe;
+  *devid = dt_opencl_lock_device(pipe->type);
+  if(*devid < 0) return FALSE;
+
+  gboolean ok = FALSE;
+  cl_mem dev_in = dt_opencl_copy_host_to_device(*devid, in, roi_in->width, roi_in->height, bpp_in);
+  cl_mem dev_out = dt_opencl_alloc_device(*devid, roi_out->width, roi_out->height, bpp_out);
+  double *t = malloc(sizeof(double) * runs);
+  if(!dev_in || !dev_out) goto error;
+
+  pipe->devid = *devid;
+  dt_opencl_memory_mark(*devid);
+  if(!module->process_cl(module, piece, dev_in, dev_out, roi_in, roi_out)) goto error;
+  dt_opencl_finish(*devid);
+  result->peak_mb = dt_opencl_memory_peak_since_mark(*devid) / (1024.0 * 1024.0);
+
+  for(int k = 0; k < runs; k++)
+  {
+    const double start = dt_get_wtime();
+    if(!module->process_cl(module, piece, dev_in, dev_out, roi_in, roi_out)) goto error;
+    dt_opencl_finish(*devid);
+    t[k] = dt_get_wtime() - start;
+  }
+  result->seconds = _median(t, runs);
+  ok = TRUE;
+
+error:
+  free(t);
+  pipe->devid = -1;
+  if(dev_in) dt_opencl_release_mem_object(dev_in);
+  if(dev_out) dt_opencl_release_mem_object(dev_out);
+  dt_opencl_unlock_device(*devid);
+  return ok;
+}
+#endif
+
+static void _report(const dt_bench_options_t *opt, const dt_iop_module_t *module, const char *path,
+                    const char *device, const dt_iop_roi_t *roi_out, const int threads,
+                    const dt_bench_result_t *result, const double efficiency)
+{
+  const double mpix = (double)roi_out->width * roi_out->height / 1e6;
+  fprintf(opt->out, "%s\t%s\t%s\t%s\t%d\t%d\t%d\t%.6f\t%.2f\t", module->op, module->multi_name, path, device,
+          roi_out->width, roi_out->height, threads, result->seconds, mpix / MAX(result->seconds, 1e-9));
+  if(efficiency > 0.0)
+    fprintf(opt->out, "%.3f\t", efficiency);
+  else
+    fprintf(opt->out, "-\t");
+  if(result->peak_mb >= 0.0)
+    fprintf(opt->out, "%.1f\n", result->peak_mb);
+  else
+    fprintf(opt->out, "-\n");
+  fflush(opt->out);
+}
+
+static void _bench_size(const dt_bench_options_t *opt, dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece,
+                        const dt_iop_buffer_dsc_t *dsc_in, const int width)
+{
+  dt_dev_pixelpipe_t *pipe = piece->pipe;
+
+  if(piece->buf_out.width <= 0 || piece->buf_out.height <= 0) return;
+
+  // the output keeps the aspect of what the module puts out for the whole image
+  dt_iop_roi_t roi_out = piece->buf_out;
+  roi_out.x = roi_out.y = 0;
+  roi_out.scale = 1.0f;
+  roi_out.width = MIN(width, piece->buf_out.width);
+  roi_out.height = MAX(1, (int)((double)roi_out.width * piece->buf_out.height / piece->buf_out.width));
+  dt_iop_roi_t roi_in = roi_out;
+  module->modify_roi_in(module, piece, &roi_out, &roi_in);
+  if(roi_in.width <= 0 || roi_in.height <= 0) return;
+
+  piece->dsc_in = piece->dsc_out = *dsc_in;
+  piece->dsc_in.cst = module->input_colorspace(module, pipe, piece);
+  module->output_format(module, pipe, piece, &piece->dsc_out);
+  const dt_iop_buffer_dsc_t pipe_dsc = pipe->dsc;
+  pipe->dsc = piece->dsc_in;
+  piece->processed_roi_in = roi_in;
+  piece->processed_roi_out = roi_out;
+
+  const size_t bpp_in = dt_iop_buffer_dsc_to_bpp(&piece->dsc_in);
+  const size_t bpp_out = dt_iop_buffer_dsc_to_bpp(&piece->dsc_out);
+  void *in = dt_alloc_align(64, bpp_in * roi_in.width * roi_in.height);
+  void *out = dt_alloc_align(64, bpp_out * roi_out.width * roi_out.height);
+  if(!in || !out)
+  {
+    fprintf(stderr, "[bench] `%s': not enough memory for %dx%d\n", module->op, roi_out.width, roi_out.height);
+    goto end;
+  }
+  _fill_input(in, &piece->dsc_in, &roi_in, pipe);
+  memset(out, 0, bpp_out * roi_out.width * roi_out.height);
+
+  if(opt->cpu)
+  {
+    const struct
+    {
+      const char *name;
+      dt_bench_process_t process;
+    } paths[] = { { "plain", module->process_plain },
+                  { "sse2", module->process_sse2 },
+                  { "avx2", module->process_avx2 },
+                  { "avx512", module->process_avx512 } };
+
+    for(size_t p = 0; p < sizeof(paths) / sizeof(paths[0]); p++)
+    {
+      if(!paths[p].process) continue;
+      double first = 0.0;
+      for(int k = 0; k < opt->num_threads; k++)
+      {
+#ifdef _OPENMP
+        omp_set_num_threads(opt->threads[k]);
+#endif
+        const dt_bench_result_t result
+            = _bench_cpu(paths[p].process, module, piece, in, out, &roi_in, &roi_out, opt->runs);
+        // how much of the added threads turned into speed, against the run with the fewest threads
+        if(k == 0) first = result.seconds * opt->threads[0];
+        const double efficiency = k > 0 ? first / (result.seconds * opt->threads[k]) : 0.0;
+        _report(opt, module, paths[p].name, "cpu", &roi_out, opt->threads[k], &result, efficiency);
+      }
+    }
+#ifdef _OPENMP
+    omp_set_num_threads(darktable.num_openmp_threads);
+#endif
+  }
+
+#ifdef HAVE_OPENCL
+  if(opt->cl && module->process_cl && piece->process_cl_ready && dt_opencl_is_enabled())
+  {
+    dt_bench_result_t result = { 0.0, -1.0 };
+    int devid = -1;
+    if(_bench_cl(module, piece, in, bpp_in, bpp_out, &roi_in, &roi_out, opt->runs, &devid, &result))
+      _report(opt, module, "opencl", darktable.opencl->dev[devid].cname, &roi_out, 1, &result, 0.0);
+    else if(devid >= 0)
+      fprintf(stderr, "[bench] `%s' failed on device %d at %dx%d\n", module->op, devid, roi_out.width,
+              roi_out.height);
+  }
+#endif
+
+end:
+  pipe->dsc = pipe_dsc;
+  dt_free_align(in);
+  dt_free_align(out);
+}
+
+static gboolean _wanted(const dt_bench_options_t *opt, const dt_iop_module_t *module)
+{
+  if(!opt->modules) return TRUE;
+  for(gchar **m = opt->modules; *m; m++)
+    if(!strcmp(*m, module->op)) return TRUE;
+  return FALSE;
+}
+
+static void _bench_module(const dt_bench_options_t *opt, dt_develop_t *dev, dt_dev_pixelpipe_t *pipe,
+                          dt_dev_pixelpipe_iop_t *piece, const dt_iop_buffer_dsc_t *dsc_in)
+{
+  dt_iop_module_t *module = piece->module;
+
+  dt_iop_params_t *params = module->default_params;
+  unsigned char *given = NULL;
+  const char *encoded = g_hash_table_lookup(opt->params, module->op);
+  if(encoded)
+  {
+    int len = 0;
+    given = dt_exif_xmp_decode(encoded, strlen(encoded), &len);
+    if(!given || len != module->params_size)
+    {
+      fprintf(stderr, "[bench] `%s': the params are not of version %d, using the defaults\n", module->op,
+              module->version());
+      free(given);
+      given = NULL;
+    }
+    else
+      params = (dt_iop_params_t *)given;
+  }
+
+  // enable the module alone with these params, the others stay as the history has them
+  dt_pthread_mutex_lock(&pipe->busy_mutex);
+  piece->enabled = TRUE;
+  piece->commit_hash = 0;
+  dt_iop_commit_params(module, params, module->default_blendop_params, pipe, piece);
+  dt_pthread_mutex_unlock(&pipe->busy_mutex);
+
+  if(piece->enabled)
+  {
+    int width, height;
+    dt_dev_pixelpipe_get_dimensions(pipe, dev, pipe->iwidth, pipe->iheight, &width, &height);
+    for(int k = 0; k < opt->num_sizes; k++) _bench_size(opt, module, piece, dsc_in, opt->sizes[k]);
+  }
+  else
+    fprintf(stderr, "[bench] `%s' doesn't work on this image, skipped\n", module->op);
+
+  free(given);
+  piece->commit_hash = 0;
+  dt_dev_pixelpipe_synch_all(pipe, dev);
+}
+
+static int _bench(const char *filename, const dt_bench_options_t *opt)
+{
+  const uint32_t imgid = dt_bench_import(filename);
+  if(!imgid)
+  {
+    fprintf(stderr, "error: can't open file %s\n", filename);
+    return 1;
+  }
+
+  dt_develop_t dev;
+  dt_dev_init(&dev, 0);
+  dt_dev_load_image(&dev, imgid);
+
+  dt_mipmap_buffer_t buf;
+  dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, DT_MIPMAP_FULL, DT_MIPMAP_BLOCKING, 'r');
+  if(!buf.buf || !buf.width || !buf.height)
+  {
+    fprintf(stderr, "error: can't load image %s\n", filename);
+    dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+    dt_dev_cleanup(&dev);
+    return 1;
+  }
+
+  dt_dev_pixelpipe_t pipe;
+  if(!dt_dev_pixelpipe_init_export(&pipe, dev.image_storage.width, dev.image_storage.height,
+                                   IMAGEIO_RGB | IMAGEIO_FLOAT, FALSE))
+  {
+    fprintf(stderr, "error: can't allocate the pixelpipe\n");
+    dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+    dt_dev_cleanup(&dev);
+    return 1;
+  }
+  dt_dev_pixelpipe_set_input(&pipe, &dev, (float *)buf.buf, buf.width, buf.height, buf.iscale);
+  dt_dev_pixelpipe_create_nodes(&pipe, &dev);
+  dt_dev_pixelpipe_synch_all(&pipe, &dev);
+  pipe.devid = -1;
+
+  fprintf(opt->out, "module\tinstance\tpath\tdevice\twidth\theight\tthreads\tseconds\tmpix_per_s\t"
+                    "efficiency\tpeak_mb\n");
+
+  // the format every module gets from the ones before it as the history has them
+  dt_iop_buffer_dsc_t dsc = pipe.dsc;
+  for(GList *nodes = pipe.nodes; nodes; nodes = g_list_next(nodes))
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    const dt_iop_buffer_dsc_t dsc_in = dsc;
+    if(piece->enabled)
+    {
+      piece->module->output_format(piece->module, &pipe, piece, &dsc);
+      dsc.cst = piece->module->output_colorspace(piece->module, &pipe, piece);
+    }
+
+    if(!_wanted(opt, piece->module)) continue;
+    fprintf(stderr, "[bench] %s %s\n", piece->module->op, piece->module->multi_name);
+    _bench_module(opt, &dev, &pipe, piece, &dsc_in);
+  }
+
+  dt_dev_pixelpipe_cleanup(&pipe);
+  dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+  dt_dev_cleanup(&dev);
+  return 0;
+}
+
+int main(int argc, char *arg[])
+{
+#ifdef __APPLE__
+  dt_osx_prepare_environment();
+#endif
+
+  dt_bench_options_t opt = { .runs = 5, .synthetic_width = 6000, .synthetic_height = 4000, .cpu = TRUE,
+                             .cl = TRUE, .out = stdout };
+  opt.params = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  opt.num_sizes = _parse_list("1024,2048,4096", opt.sizes);
+  const char *input_filename = NULL;
+  const char *output_filename = NULL;
+  const char *replay_filename = NULL;
+
+  int k;
+  for(k = 1; k < argc; k++)
+  {
+    if(!strcmp(arg[k], "-h") || !strcmp(arg[k], "--help"))
+    {
+      usage(arg[0]);
+      exit(1);
+    }
+    else if(!strcmp(arg[k], "--modules") && argc > k + 1)
+      opt.modules = g_strsplit(arg[++k], ",", -1);
+    else if(!strcmp(arg[k], "--params") && argc > k + 1)
+    {
+      gchar **kv = g_strsplit(arg[++k], "=", 2);
+      if(kv[0] && kv[1]) g_hash_table_insert(opt.params, g_strdup(kv[0]), g_strdup(kv[1]));
+      g_strfreev(kv);
+    }
+    else if(!strcmp(arg[k], "--sizes") && argc > k + 1)
+      opt.num_sizes = _parse_list(arg[++k], opt.sizes);
+    else if(!strcmp(arg[k], "--threads") && argc > k + 1)
+      opt.num_threads = _parse_list(arg[++k], opt.threads);
+    else if(!strcmp(arg[k], "--runs") && argc > k + 1)
+      opt.runs = MAX(atoi(arg[++k]), 1);
+    else if(!strcmp(arg[k], "--synthetic") && argc > k + 1)
+    {
+      if(sscanf(arg[++k], "%dx%d", &opt.synthetic_width, &opt.synthetic_height) != 2
+         || opt.synthetic_width < 16 || opt.synthetic_height < 16)
+      {
+        usage(arg[0]);
+        exit(1);
+      }
+    }
+    else if(!strcmp(arg[k], "--cpu-only"))
+      opt.cl = FALSE;
+    else if(!strcmp(arg[k], "--opencl-only"))
+      opt.cpu = FALSE;
+    else if(!strcmp(arg[k], "--output") && argc > k + 1)
+      output_filename = arg[++k];
+    else if(!strcmp(arg[k], "--replay") && argc > k + 1)
+      replay_filename = arg[++k];
+    else if(!strcmp(arg[k], "--core"))
+    {
+      // everything from here on should be passed to the core
+      k++;
+      break;
+    }
+    else if(arg[k][0] != '-' && !input_filename)
+      input_filename = arg[k];
+    else
+    {
+      usage(arg[0]);
+      exit(1);
+    }
+  }
+
+  int m_argc = 0;
+  char **m_arg = malloc((7 + argc - k + 1) * sizeof(char *));
+  m_arg[m_argc++] = "darktable-bench";
+  m_arg[m_argc++] = "--library";
+  m_arg[m_argc++] = ":memory:";
+  m_arg[m_argc++] = "--conf";
+  m_arg[m_argc++] = "write_sidecar_files=FALSE";
+  if(!opt.cl)
+  {
+    m_arg[m_argc++] = "--conf";
+    m_arg[m_argc++] = "opencl=FALSE";
+  }
+  for(; k < argc; k++) m_arg[m_argc++] = arg[k];
+  m_arg[m_argc] = NULL;
+
+  // init dt without gui and without data.db, so that no presets of the user get in
+  if(dt_init(m_argc, m_arg, FALSE, FALSE, NULL))
+  {
+    free(m_arg);
+    exit(1);
+  }
+
+  if(!opt.num_threads)
+  {
+    for(int n = 1; n < dt_get_num_threads() && opt.num_threads < BENCH_MAX_VALUES - 1; n *= 2)
+      opt.threads[opt.num_threads++] = n;
+    opt.threads[opt.num_threads++] = dt_get_num_threads();
+  }
+
+  int res = 1;
+  gchar *synthetic = NULL;
+  if(!input_filename && !replay_filename)
+  {
+    synthetic = _write_synthetic(opt.synthetic_width, opt.synthetic_height);
+    input_filename = synthetic;
+  }
+  if(output_filename) opt.out = g_fopen(output_filename, "w");
+
+  if(!opt.out)
+    fprintf(stderr, "error: can't write to %s\n", output_filename);
+  else if(replay_filename)
+    res = dt_bench_replay(replay_filename, opt.out);
+  else if(!input_filename)
+    fprintf(stderr, "error: can't write the synthetic image\n");
+  else
+    res = _bench(input_filename, &opt);
+
+  if(opt.out && opt.out != stdout) fclose(opt.out);
+  if(synthetic) g_unlink(synthetic);
+  g_free(synthetic);
+  g_strfreev(opt.modules);
+  g_hash_table_destroy(opt.params);
+
+  dt_cleanup();
+
+  free(m_arg);
+  return res;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
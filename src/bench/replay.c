@@ -0,0 +1,323 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * replays a darkroom recording without the gui. the develop gets a full and a preview pipe as in the darkroom,
+ * the recorded changes are applied to it as fast as the pipes keep up, and after every change both pipes run
+ * at the same time, the way the darkroom jobs do. changes which came within DT_BENCH_REPLAY_GROUP seconds of
+ * each other count as one step, like a slider that is dragged sets several values per frame.
+ *
+ * one line per step is written as tab separated values: the step, its time in the recording, the events, the
+ * seconds to the preview and to the full render, the same as they were recorded and the size of the full
+ * render. the progressive rendering of the darkroom isn't done, the full render is the finished one.
+ */
+
+#include "bench/bench.h"
+#include "common/darktable.h"
+#include "common/mipmap_cache.h"
+#include "develop/blend.h"
+#include "develop/develop.h"
+#include "develop/imageop.h"
+#include "develop/pixelpipe.h"
+#include "develop/record.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define DT_BENCH_REPLAY_GROUP 0.01
+
+typedef struct dt_bench_replay_pipe_t
+{
+  dt_develop_t *dev;
+  dt_dev_pixelpipe_t *pipe;
+  const dt_dev_record_event_t *view;
+  double start;
+  double seconds; // negative if the pipe failed
+  int width, height;
+} dt_bench_replay_pipe_t;
+
+static dt_iop_module_t *_find_module(dt_develop_t *dev, const dt_dev_record_event_t *event)
+{
+  for(GList *modules = dev->iop; modules; modules = g_list_next(modules))
+  {
+    dt_iop_module_t *module = (dt_iop_module_t *)modules->data;
+    if(!strcmp(module->op, event->op) && module->multi_priority == event->multi_priority) return module;
+  }
+  return NULL;
+}
+
+// the history change of the event, as the gui of the module makes it. returns FALSE if it can't be applied.
+static gboolean _apply_item(dt_develop_t *dev, const dt_dev_record_event_t *event)
+{
+  dt_iop_module_t *module = _find_module(dev, event);
+  if(!module || event->params_size != module->params_size
+     || (event->blend_params && event->blend_params_size != sizeof(dt_develop_blend_params_t)))
+  {
+    fprintf(stderr, "[replay] can't apply the history item of %s %d\n", event->op, event->multi_priority);
+    return FALSE;
+  }
+  memcpy(module->params, event->params, module->params_size);
+  if(event->blend_params) memcpy(module->blend_params, event->blend_params, sizeof(dt_develop_blend_params_t));
+  module->enabled = event->enabled;
+  dt_dev_add_history_item_ext(dev, module, FALSE, FALSE);
+  return TRUE;
+}
+
+// the scale of the full pipe as dt_dev_get_zoom_scale() has it, with the zoom of the recording
+static float _zoom_scale(const dt_develop_t *dev, const dt_dev_record_event_t *view)
+{
+  const float w = dev->pipe->processed_width;
+  const float h = dev->pipe->processed_height;
+  switch(view->zoom)
+  {
+    case DT_ZOOM_FIT:
+      return fminf(dev->width / w, dev->height / h);
+    case DT_ZOOM_FILL:
+      return fmaxf(dev->width / w, dev->height / h);
+    case DT_ZOOM_1:
+      return 1.0f;
+    default:
+      return view->zoom_scale;
+  }
+}
+
+static void *_process_preview(void *data)
+{
+  dt_bench_replay_pipe_t *p = (dt_bench_replay_pipe_t *)data;
+  dt_develop_t *dev = p->dev;
+  dt_dev_pixelpipe_change(p->pipe, dev);
+  p->width = p->pipe->processed_width * dev->preview_downsampling;
+  p->height = p->pipe->processed_height * dev->preview_downsampling;
+  const int err = dt_dev_pixelpipe_process(p->pipe, dev, 0, 0, p->width, p->height, dev->preview_downsampling);
+  p->seconds = err ? -1.0 : dt_get_wtime() - p->start;
+  return NULL;
+}
+
+// the region of the image in the view, as dt_dev_process_image_job() has it
+static void *_process_full(void *data)
+{
+  dt_bench_replay_pipe_t *p = (dt_bench_replay_pipe_t *)data;
+  dt_develop_t *dev = p->dev;
+  const dt_dev_record_event_t *view = p->view;
+  dt_dev_pixelpipe_change(p->pipe, dev);
+
+  // the position was recorded after the darkroom kept it within the image
+  const float scale = _zoom_scale(dev, view) * view->ppd;
+  int window_width = dev->width * view->ppd;
+  int window_height = dev->height * view->ppd;
+  if(view->closeup)
+  {
+    window_width /= 1 << view->closeup;
+    window_height /= 1 << view->closeup;
+  }
+  p->width = MIN(window_width, p->pipe->processed_width * scale);
+  p->height = MIN(window_height, p->pipe->processed_height * scale);
+  const int x = MAX(0, scale * p->pipe->processed_width * (.5 + view->zoom_x) - p->width / 2);
+  const int y = MAX(0, scale * p->pipe->processed_height * (.5 + view->zoom_y) - p->height / 2);
+
+  const int err = dt_dev_pixelpipe_process(p->pipe, dev, x, y, p->width, p->height, scale);
+  p->seconds = err ? -1.0 : dt_get_wtime() - p->start;
+  return NULL;
+}
+
+static void _write_seconds(FILE *out, const double seconds)
+{
+  if(seconds >= 0.0)
+    fprintf(out, "\t%.4f", seconds);
+  else
+    fputs("\t-", out);
+}
+
+// the latency of the recorded session: when the pipe first finished after the step, if before the next one
+static double _recorded(GList *from, const double start, const double end, const dt_dev_record_type_t type)
+{
+  for(GList *l = from; l; l = g_list_next(l))
+  {
+    const dt_dev_record_event_t *event = (dt_dev_record_event_t *)l->data;
+    if(event->time >= end) break;
+    if(event->type == type) return event->time - start;
+  }
+  return -1.0;
+}
+
+static gboolean _interactive(const dt_dev_record_event_t *event)
+{
+  return event->type == DT_DEV_RECORD_LOAD || event->type == DT_DEV_RECORD_HISTORY
+         || event->type == DT_DEV_RECORD_POP || event->type == DT_DEV_RECORD_VIEW;
+}
+
+static int _replay(GList *events, const uint32_t imgid, FILE *out)
+{
+  dt_develop_t dev;
+  dt_dev_init(&dev, 0);
+  dev.pipe = (dt_dev_pixelpipe_t *)malloc(sizeof(dt_dev_pixelpipe_t));
+  dev.preview_pipe = (dt_dev_pixelpipe_t *)malloc(sizeof(dt_dev_pixelpipe_t));
+  dev.preview2_pipe = (dt_dev_pixelpipe_t *)malloc(sizeof(dt_dev_pixelpipe_t));
+  dt_dev_pixelpipe_init(dev.pipe);
+  dt_dev_pixelpipe_init_preview(dev.preview_pipe);
+  dt_dev_pixelpipe_init_preview2(dev.preview2_pipe);
+  dt_dev_load_image(&dev, imgid);
+
+  dt_mipmap_buffer_t full, preview;
+  dt_mipmap_cache_get(darktable.mipmap_cache, &full, imgid, DT_MIPMAP_FULL, DT_MIPMAP_BLOCKING, 'r');
+  dt_mipmap_cache_get(darktable.mipmap_cache, &preview, imgid, DT_MIPMAP_F, DT_MIPMAP_BLOCKING, 'r');
+  if(!full.buf || !preview.buf)
+  {
+    fprintf(stderr, "error: can't load the image of the recording\n");
+    dt_mipmap_cache_release(darktable.mipmap_cache, &full);
+    dt_mipmap_cache_release(darktable.mipmap_cache, &preview);
+    dt_dev_cleanup(&dev);
+    return 1;
+  }
+  dt_dev_pixelpipe_set_input(dev.pipe, &dev, (float *)full.buf, full.width, full.height, 1.0);
+  dt_dev_pixelpipe_set_input(dev.preview_pipe, &dev, (float *)preview.buf, preview.width, preview.height,
+                             preview.iscale);
+  dt_dev_pixelpipe_create_nodes(dev.pipe, &dev);
+  dt_dev_pixelpipe_create_nodes(dev.preview_pipe, &dev);
+
+  // the history as it was when the image was loaded, instead of the one in the library now. events starts
+  // with the load, the items follow it.
+  dt_dev_pop_history_items_ext(&dev, 0);
+  for(GList *l = g_list_next(events); l && ((dt_dev_record_event_t *)l->data)->type == DT_DEV_RECORD_BASE;
+      l = g_list_next(l))
+    _apply_item(&dev, (dt_dev_record_event_t *)l->data);
+  dev.pipe->changed |= DT_DEV_PIPE_SYNCH;
+  dev.preview_pipe->changed |= DT_DEV_PIPE_SYNCH;
+
+  // the first viewport applies from the start
+  dt_dev_record_event_t view = { .width = 1024, .height = 768, .ppd = 1.0f, .zoom = DT_ZOOM_FIT };
+  for(GList *l = events; l; l = g_list_next(l))
+    if(((dt_dev_record_event_t *)l->data)->type == DT_DEV_RECORD_VIEW)
+    {
+      view = *(dt_dev_record_event_t *)l->data;
+      break;
+    }
+
+  fprintf(out, "step\ttime\tevents\tpreview_s\tfull_s\trecorded_preview_s\trecorded_full_s\twidth\theight\n");
+
+  int step = 0;
+  GList *l = events;
+  while(l)
+  {
+    const dt_dev_record_event_t *first = (dt_dev_record_event_t *)l->data;
+    // the darkroom went on to another image
+    if(first->type == DT_DEV_RECORD_LOAD && step > 0) break;
+    if(!_interactive(first))
+    {
+      l = g_list_next(l);
+      continue;
+    }
+
+    // the changes of this step
+    GString *names = g_string_new(NULL);
+    double last = first->time;
+    for(; l; l = g_list_next(l))
+    {
+      const dt_dev_record_event_t *event = (dt_dev_record_event_t *)l->data;
+      if(event->time > first->time + DT_BENCH_REPLAY_GROUP || (event->type == DT_DEV_RECORD_LOAD && event != first))
+        break;
+      if(!_interactive(event)) continue;
+      last = event->time;
+
+      dt_pthread_mutex_lock(&dev.history_mutex);
+      if(event->type == DT_DEV_RECORD_HISTORY && _apply_item(&dev, event))
+        g_string_append_printf(names, "%shistory:%s", names->len ? "," : "", event->op);
+      else if(event->type == DT_DEV_RECORD_POP)
+      {
+        dt_dev_pop_history_items_ext(&dev, MIN(event->history_end, (int)g_list_length(dev.history)));
+        dev.pipe->changed |= DT_DEV_PIPE_SYNCH;
+        dev.preview_pipe->changed |= DT_DEV_PIPE_SYNCH;
+        g_string_append_printf(names, "%spop:%d", names->len ? "," : "", event->history_end);
+      }
+      else if(event->type == DT_DEV_RECORD_VIEW)
+      {
+        view = *event;
+        dev.pipe->changed |= DT_DEV_PIPE_ZOOMED;
+        g_string_append_printf(names, "%sview", names->len ? "," : "");
+      }
+      else if(event->type == DT_DEV_RECORD_LOAD)
+        g_string_append_printf(names, "%sload", names->len ? "," : "");
+      dt_dev_invalidate_all(&dev);
+      dt_pthread_mutex_unlock(&dev.history_mutex);
+    }
+    double next = G_MAXDOUBLE;
+    for(GList *n = l; n; n = g_list_next(n))
+      if(_interactive((dt_dev_record_event_t *)n->data))
+      {
+        next = ((dt_dev_record_event_t *)n->data)->time;
+        break;
+      }
+
+    dev.width = view.width;
+    dev.height = view.height;
+
+    // both at the same time, as the darkroom runs them
+    const double start = dt_get_wtime();
+    dt_bench_replay_pipe_t p_preview = { &dev, dev.preview_pipe, &view, start, -1.0, 0, 0 };
+    dt_bench_replay_pipe_t p_full = { &dev, dev.pipe, &view, start, -1.0, 0, 0 };
+    pthread_t preview_thread;
+    const gboolean threaded = !dt_pthread_create(&preview_thread, _process_preview, &p_preview);
+    if(!threaded) _process_preview(&p_preview);
+    _process_full(&p_full);
+    if(threaded) pthread_join(preview_thread, NULL);
+
+    fprintf(out, "%d\t%.3f\t%s", step, first->time, names->str);
+    _write_seconds(out, p_preview.seconds);
+    _write_seconds(out, p_full.seconds);
+    _write_seconds(out, _recorded(l, last, next, DT_DEV_RECORD_PREVIEW));
+    _write_seconds(out, _recorded(l, last, next, DT_DEV_RECORD_FULL));
+    fprintf(out, "\t%d\t%d\n", p_full.width, p_full.height);
+    fflush(out);
+    g_string_free(names, TRUE);
+    step++;
+  }
+
+  dt_mipmap_cache_release(darktable.mipmap_cache, &full);
+  dt_mipmap_cache_release(darktable.mipmap_cache, &preview);
+  dt_dev_cleanup(&dev);
+  return 0;
+}
+
+int dt_bench_replay(const char *recording, FILE *out)
+{
+  GList *events = dt_dev_record_read(recording);
+  if(!events)
+  {
+    fprintf(stderr, "error: can't read the recording %s\n", recording);
+    return 1;
+  }
+
+  // only the first image of a recording is replayed
+  const dt_dev_record_event_t *load = NULL;
+  for(GList *l = events; l && !load; l = g_list_next(l))
+    if(((dt_dev_record_event_t *)l->data)->type == DT_DEV_RECORD_LOAD) load = l->data;
+
+  int res = 1;
+  const uint32_t imgid = load ? dt_bench_import(load->filename) : 0;
+  if(!imgid)
+    fprintf(stderr, "error: can't open the image of the recording %s\n", recording);
+  else
+    res = _replay(g_list_find(events, load), imgid, out);
+
+  dt_dev_record_free(events);
+  return res;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -954,7 +954,7 @@ static int compare_L_source(const void *x_, const void *y_)
 }
 
 static void process_data(dt_lut_t *self, double *target_L, double *target_a, double *target_b,
-                         double *colorchecker_Lab, int N, int sparsity)
+                         double *colorchecker_Lab, int N, int sparsity, double target_err)
 {
   // get all the memory, just in case:
   double *cx = malloc(sizeof(double)*N);
@@ -1055,7 +1055,8 @@ static void process_data(dt_lut_t *self, double *target_L, double *target_a, dou
   double *coeff[] = { coeff_L, coeff_a, coeff_b };
   int *perm = malloc((N + 4) * sizeof(int));
   double avgerr, maxerr;
-  sparsity = thinplate_match(&tonecurve, 3, N, colorchecker_Lab, target, sparsity, perm, coeff, &avgerr, &maxerr);
+  sparsity = thinplate_match(&tonecurve, 3, N, colorchecker_Lab, target, sparsity, target_err, perm, coeff,
+                             &avgerr, &maxerr);
 
   if (self->result_label != NULL)
   {
@@ -1123,7 +1124,7 @@ static void process_button_clicked_callback(GtkButton *button, gpointer user_dat
 
   int sparsity = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(self->number_patches)) + 4;
 
-  process_data(self, target_L, target_a, target_b, colorchecker_Lab, N, sparsity);
+  process_data(self, target_L, target_a, target_b, colorchecker_Lab, N, sparsity, 0.0);
 
   gtk_widget_set_sensitive(self->export_button, TRUE);
   gtk_widget_set_sensitive(self->export_raw_button, TRUE);
@@ -1846,6 +1847,8 @@ static int main_csv(dt_lut_t *self, int argc, char *argv[])
   const char *filename_csv = argv[2];
   const int num_patches = atoi(argv[3]);
   const char *filename_style = argv[4];
+  // optionally stop adding patches once the average delta E is below this
+  const double target_err = argc >= 6 ? g_ascii_strtod(argv[5], NULL) : 0.0;
 
   int sparsity = num_patches + 4;
 
@@ -1870,7 +1873,7 @@ static int main_csv(dt_lut_t *self, int argc, char *argv[])
 
   add_hdr_patches(&N, &target_L, &target_a, &target_b, &colorchecker_Lab);
 
-  process_data(self, target_L, target_a, target_b, colorchecker_Lab, N, sparsity);
+  process_data(self, target_L, target_a, target_b, colorchecker_Lab, N, sparsity, target_err);
 
   // TODO: add command line options to control what modules to include
   export_style(self, filename_style, name, description, TRUE, TRUE, TRUE, TRUE);
@@ -1888,7 +1891,7 @@ static int main_csv(dt_lut_t *self, int argc, char *argv[])
 static void show_usage(const char *exe)
 {
   fprintf(stderr, "Usage: %s [<input Lab pfm file>] [<cht file>] [<reference cgats/it8 or Lab pfm file>]\n"
-                  "       %s --csv <csv file> <number patches> <output dtstyle file>\n",
+                  "       %s --csv <csv file> <number patches> <output dtstyle file> [<target average delta E>]\n",
           exe, exe);
 }
 
@@ -1913,7 +1916,7 @@ int main(int argc, char *argv[])
     show_usage(argv[0]);
   else if(argc >= 2 && !g_strcmp0(argv[1], "--csv"))
   {
-    if(argc != 5)
+    if(argc != 5 && argc != 6)
       show_usage(argv[0]);
     else
       res = main_csv(self, argc, argv);
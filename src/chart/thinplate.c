@@ -25,6 +25,7 @@
 
 #include "chart/thinplate.h"
 #include "chart/deltaE.h"
+#include "common/darktable.h"
 #include "iop/svd.h"
 
 #include <assert.h>
@@ -137,8 +138,49 @@ static inline int solve(double *As, double *w, double *v, const double *b, doubl
   return 0;
 }
 
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wvla"
+// without replacement every iteration only adds a column to the ones chosen before, so the least squares
+// problem can be updated instead of solved again from scratch
+#if !defined(EXACT) && !defined(REPLACEMENT)
+#define INCREMENTAL
+#endif
+
+#ifdef INCREMENTAL
+// appends column a to the thin qr decomposition Q R of the s columns chosen so far. Q holds the orthonormal
+// columns one after the other, R is upper triangular with row stride S. the new column is orthogonalised
+// twice, which keeps Q orthogonal to working precision.
+static void qr_append(double *Q, double *R, const double *a, int wd, int s, int S)
+{
+  double *q = Q + (size_t)s * wd;
+  memcpy(q, a, wd * sizeof(double));
+  for(int i = 0; i <= s; i++) R[i * S + s] = 0.0;
+  for(int pass = 0; pass < 2; pass++)
+    for(int i = 0; i < s; i++)
+    {
+      const double *qi = Q + (size_t)i * wd;
+      double h = 0.0;
+      for(int j = 0; j < wd; j++) h += qi[j] * q[j];
+      for(int j = 0; j < wd; j++) q[j] -= h * qi[j];
+      R[i * S + s] += h;
+    }
+  double n = 0.0;
+  for(int j = 0; j < wd; j++) n += q[j] * q[j];
+  n = sqrt(n);
+  R[s * S + s] = n;
+  if(n > 0.0)
+    for(int j = 0; j < wd; j++) q[j] /= n;
+}
+
+// coefficients of the first s chosen columns from R c = Q^t b, with z = Q^t b
+static void qr_coefficients(const double *R, const double *z, double *coeff, int s, int S)
+{
+  for(int i = s - 1; i >= 0; i--)
+  {
+    double sum = z[i];
+    for(int k = i + 1; k < s; k++) sum -= R[i * S + k] * coeff[k];
+    coeff[i] = sum / R[i * S + i];
+  }
+}
+#endif
 
 // returns sparsity <= S
 int thinplate_match(const tonecurve_t *curve, // tonecurve to apply after this (needed for error estimation)
@@ -147,6 +189,7 @@ int thinplate_match(const tonecurve_t *curve, // tonecurve to apply after this (
                     const double *point,      // dim-strided points
                     const double **target,    // target values, one pointer per dimension
                     int S,                    // desired sparsity level, actual result will be returned
+                    double target_err,        // stop before S once the average error is below, 0 to never
                     int *permutation, // pointing to original order of points, to identify correct output coeff
                     double **coeff,   // output coefficient arrays for each dimension, ordered according to
                                       // permutation[dim]
@@ -190,18 +233,25 @@ int thinplate_match(const tonecurve_t *curve, // tonecurve to apply after this (
   }
 
   // XXX do we need these explicitly?
-  // residual = target vector
-  double(*r)[wd] = malloc(dim * wd * sizeof(double));
+  // residual = target vector, one row of wd per dimension
+  double *r = malloc(dim * wd * sizeof(double));
   const double **b = malloc(dim * sizeof(double *));
   for(int k = 0; k < dim; k++) b[k] = target[k];
-  for(int k = 0; k < dim; k++) memcpy(r[k], b[k], wd * sizeof(double));
+  for(int k = 0; k < dim; k++) memcpy(r + k * wd, b[k], wd * sizeof(double));
 
   double *w = malloc(S * sizeof(double));
   double *v = malloc(S * S * sizeof(double));
   double *As = calloc(wd * S, sizeof(double));
+  // how well each column matches the residual, for the greedy choice
+  double *dots = malloc(wd * sizeof(double));
+#ifdef INCREMENTAL
+  double *Q = malloc((size_t)wd * S * sizeof(double));
+  double *R = calloc(S * S, sizeof(double));
+  double *z = calloc(dim * S, sizeof(double)); // Q^t b per dimension
+#endif
 
   // for rank from 0 to sparsity level
-  int s = 0, patches = 0;
+  int s = 0, patches = 0, result = -1;
   double olderr = FLT_MAX;
   // in case of replacement, iterate all the way to wd
   for(; s < wd; s++)
@@ -210,21 +260,18 @@ int thinplate_match(const tonecurve_t *curve, // tonecurve to apply after this (
 #ifndef REPLACEMENT
     if(patches >= S - 4)
     {
-      free(r);
-      free(b);
-      free(w);
-      free(v);
-      free(As);
-      free(norm);
-      free(A);
-      return sparsity;
+      result = sparsity;
+      goto end;
     }
     assert(sparsity < S + 4);
 #endif
     // find (sparsity+1)-th column a_m by m = argmax_t{ a_t^t r . norm_t}
     // by searching over all three residuals
-    double maxdot = 0.0;
-    int maxcol = 0;
+#if defined(_OPENMP) && !defined(EXACT)
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(A, dim, dots, norm, r, wd) \
+  schedule(static)
+#endif
     for(int t = 0; t < wd; t++)
     {
       double dot = 0.0;
@@ -241,43 +288,45 @@ int thinplate_match(const tonecurve_t *curve, // tonecurve to apply after this (
 
           if(solve(As, w, v, b[ch], coeff[ch], wd, sparsity, S))
           {
-            free(r);
-            free(b);
-            free(w);
-            free(v);
-            free(As);
-            free(norm);
-            free(A);
-            return sparsity;
+            result = sparsity;
+            goto end;
           }
 
           // compute tentative residual:
           // r = b - As c
           for(int j = 0; j < wd; j++)
           {
-            r[ch][j] = b[ch][j];
-            for(int i = 0; i <= sparsity; i++) r[ch][j] -= A[j * wd + permutation[i]] * coeff[ch][i];
+            r[ch * wd + j] = b[ch][j];
+            for(int i = 0; i <= sparsity; i++) r[ch * wd + j] -= A[j * wd + permutation[i]] * coeff[ch][i];
           }
         }
 
         // compute error:
-        const double err = compute_error(curve, target, r[0], r[1], r[2], wd, 0);
+        const double err = compute_error(curve, target, r, r + wd, r + 2 * wd, wd, 0);
         dot = 1. / err; // searching for smallest error or largest dot
 #else                   // use dot product
+        // A is symmetric, so its column t is row t
+        const double *a = A + (size_t)t * wd;
         for(int ch = 0; ch < dim; ch++)
         {
           double chdot = 0.0;
-          for(int j = 0; j < wd; j++) chdot += A[j * wd + t] * r[ch][j];
+          for(int j = 0; j < wd; j++) chdot += a[j] * r[ch * wd + j];
           dot += fabs(chdot);
         }
         dot *= norm[t];
 #endif
       }
-      // fprintf(stderr, "dot %d = %g\n", i, dot);
-      if(dot > maxdot)
+      dots[t] = dot;
+    }
+    double maxdot = 0.0;
+    int maxcol = 0;
+    for(int t = 0; t < wd; t++)
+    {
+      // fprintf(stderr, "dot %d = %g\n", t, dots[t]);
+      if(dots[t] > maxdot)
       {
         maxcol = t;
-        maxdot = dot;
+        maxdot = dots[t];
       }
     }
 
@@ -308,33 +357,27 @@ int thinplate_match(const tonecurve_t *curve, // tonecurve to apply after this (
 
           if(solve(As, w, v, b[ch], coeff[ch], wd, sparsity-1, S))
           {
-            free(r);
-            free(b);
-            free(w);
-            free(v);
-            free(As);
-            free(norm);
-            free(A);
-            return s;
+            result = s;
+            goto end;
           }
 
           // compute tentative residual:
           // r = b - As c
           for(int j = 0; j < wd; j++)
           {
-            r[ch][j] = b[ch][j];
-            for(int i = 0; i < sparsity; i++) r[ch][j] -= A[j * wd + permutation[i]] * coeff[ch][i];
+            r[ch * wd + j] = b[ch][j];
+            for(int i = 0; i < sparsity; i++) r[ch * wd + j] -= A[j * wd + permutation[i]] * coeff[ch][i];
           }
         }
 
         // compute error:
-        const double err = compute_error(curve, target, r[0], r[1], r[2], wd, 0);
+        const double err = compute_error(curve, target, r, r + wd, r + 2 * wd, wd, 0);
 #else
         double dot = 0.0;
         for(int ch = 0; ch < dim; ch++)
         {
           double chdot = 0.0;
-          for(int j = 0; j < wd; j++) chdot += A[j * wd + t] * r[ch][j];
+          for(int j = 0; j < wd; j++) chdot += A[j * wd + t] * r[ch * wd + j];
           dot += fabs(chdot);
         }
         double n = 0.0; // recompute column norm
@@ -373,6 +416,28 @@ int thinplate_match(const tonecurve_t *curve, // tonecurve to apply after this (
     double err = 1. / maxdot;
 #else
     const int sp = MIN(sparsity, S-1); // need to fix up for replacement
+#ifdef INCREMENTAL
+    // add the new column to the decomposition of the chosen ones. if it is (nearly) a combination of those
+    // already chosen we're done, return the last valid configuration.
+    qr_append(Q, R, A + (size_t)permutation[sp] * wd, wd, sp, S);
+    if(R[sp * S + sp] < 1e-3)
+    {
+      result = sparsity;
+      goto end;
+    }
+
+    // the residual loses its part along the new direction:
+    // r = b - Q Q^t b
+    const double *q = Q + (size_t)sp * wd;
+    for(int ch = 0; ch < dim; ch++)
+    {
+      double *rc = r + ch * wd;
+      double proj = 0.0;
+      for(int j = 0; j < wd; j++) proj += q[j] * rc[j];
+      for(int j = 0; j < wd; j++) rc[j] -= proj * q[j];
+      z[ch * S + sp] = proj;
+    }
+#else
     // solve linear least squares for sparse c for every output channel:
     for(int ch = 0; ch < dim; ch++)
     {
@@ -384,27 +449,32 @@ int thinplate_match(const tonecurve_t *curve, // tonecurve to apply after this (
       // on error, return last valid configuration
       if(solve(As, w, v, b[ch], coeff[ch], wd, sp, S))
       {
-        free(r);
-        free(b);
-        free(w);
-        free(v);
-        free(As);
-        free(norm);
-        free(A);
-        return sparsity;
+        result = sparsity;
+        goto end;
       }
 
       // compute new residual:
       // r = b - As c
       for(int j = 0; j < wd; j++)
       {
-        r[ch][j] = b[ch][j];
-        for(int i = 0; i <= sp; i++) r[ch][j] -= A[j * wd + permutation[i]] * coeff[ch][i];
+        r[ch * wd + j] = b[ch][j];
+        for(int i = 0; i <= sp; i++) r[ch * wd + j] -= A[j * wd + permutation[i]] * coeff[ch][i];
       }
     }
+#endif
 
     double merr = 0.0;
-    const double err = compute_error(curve, target, r[0], r[1], r[2], wd, &merr);
+    const double err = compute_error(curve, target, r, r + wd, r + 2 * wd, wd, &merr);
+
+    // good enough already, no need for more patches
+    if(target_err > 0.0 && err < target_err && patches < S - 4)
+    {
+      if(avgerr) *avgerr = err;
+      if(maxerr) *maxerr = merr;
+      fprintf(stderr, "rank %d/%d avg DE %g max DE %g, target reached\n", sp + 1, patches, err, merr);
+      result = sp + 1;
+      goto end;
+    }
 #endif
     // residual is max CIE76 delta E now
     // everything < 2 is usually considired a very good approximation:
@@ -420,6 +490,17 @@ int thinplate_match(const tonecurve_t *curve, // tonecurve to apply after this (
     // if(err < 2.0) return sparsity+1;
     olderr = err;
   }
+
+end:
+#ifdef INCREMENTAL
+  // the coefficients were never needed on the way, only for the columns returned
+  if(result > 0)
+    for(int ch = 0; ch < dim; ch++) qr_coefficients(R, z + ch * S, coeff[ch], result, S);
+  free(Q);
+  free(R);
+  free(z);
+#endif
+  free(dots);
   free(r);
   free(b);
   free(w);
@@ -427,11 +508,9 @@ int thinplate_match(const tonecurve_t *curve, // tonecurve to apply after this (
   free(As);
   free(norm);
   free(A);
-  return -1;
+  return result;
 }
 
-#pragma GCC diagnostic pop
-
 float thinplate_color_pos(float L, float a, float b)
 {
   const float pi = 3.14153f; // clearly true.
@@ -26,6 +26,7 @@ int thinplate_match(const tonecurve_t *curve, // tonecurve to apply after this (
                     const double *point,      // dim-strided points
                     const double **target,    // target values, one pointer per dimension
                     int S,                    // desired sparsity level, actual result will be returned
+                    double target_err,        // stop before S once the average error is below, 0 to never
                     int *permutation, // pointing to original order of points, to identify correct output coeff
                     double **coeff,   // output coefficient arrays for each dimension, ordered according to
                                       // permutation[dim]
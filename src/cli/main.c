@@ -30,6 +30,7 @@
 #include "common/debug.h"
 #include "common/exif.h"
 #include "common/film.h"
+#include "common/grealpath.h"
 #include "common/history.h"
 #include "common/image.h"
 #include "common/image_cache.h"
@@ -37,11 +38,16 @@
 #include "common/imageio_jpeg.h"
 #include "common/imageio_module.h"
 #include "common/points.h"
+#include "common/utility.h"
 #include "control/conf.h"
 #include "develop/imageop.h"
+#ifdef HAVE_HTTP_SERVER
+#include "common/http_server.h"
+#endif
 
 #include <inttypes.h>
 #include <libintl.h>
+#include <sys/stat.h>
 #include <sys/time.h>
 #include <unistd.h>
 
@@ -55,10 +61,44 @@
 
 #define DT_MAX_STYLE_NAME_LENGTH 128
 
+typedef struct dt_cli_options_t
+{
+  int width, height;
+  const char *style;
+  const char *out_ext; // format of streamed output, which has no file name to tell
+  gboolean verbose, high_quality, upscale, style_overwrite, export_masks;
+} dt_cli_options_t;
+
+// how far an export got and where its time went, filled in by _export() as it goes
+typedef struct dt_cli_stats_t
+{
+  int done, total;                 // images
+  double import, history, export_; // seconds
+} dt_cli_stats_t;
+
 static void usage(const char *progname)
 {
   fprintf(stderr, "usage: %s <input file> [<xmp file>] <output file> [options] [--core <darktable options>]\n", progname);
+  fprintf(stderr, "       %s --batch <manifest file> [options] [--core <darktable options>]\n", progname);
+#ifdef HAVE_HTTP_SERVER
+  fprintf(stderr, "       %s --serve <port> [-j <N>] [options] [--core <darktable options>]\n", progname);
+#endif
+  fprintf(stderr, "\n");
+  fprintf(stderr, "the manifest has one export per line: <input file> [<xmp file>] <output file>,\n");
+  fprintf(stderr, "separated by tabs. empty lines and lines starting with # are skipped.\n");
+#ifdef HAVE_HTTP_SERVER
+  fprintf(stderr, "\n");
+  fprintf(stderr, "the server takes exports posted to http://localhost:<port>/jobs with input=<file> and\n");
+  fprintf(stderr, "output=<file>, xmp, style, width, height, hq and upscale as further fields, and runs up to N\n");
+  fprintf(stderr, "of them at once. /jobs?id=<id> tells how far one got, posting quit=1 stops the server.\n");
+  fprintf(stderr, "every request needs token=<token>, with the token printed when the server starts.\n");
+#endif
+  fprintf(stderr, "\n");
+#ifndef _WIN32
+  fprintf(stderr, "an output file of - writes the image to stdout, fd:<N> writes it to file descriptor N.\n");
+  fprintf(stderr, "this only works for a single export, not in a batch or from the server.\n");
   fprintf(stderr, "\n");
+#endif
   fprintf(stderr, "options:\n");
   fprintf(stderr, "   --width <max width> default: 0 = full resolution\n");
   fprintf(stderr, "   --height <max height> default: 0 = full resolution\n");
@@ -68,12 +108,670 @@ static void usage(const char *progname)
   fprintf(stderr, "   --export_masks <0|1|false|true>, default: false\n");
   fprintf(stderr, "   --style <style name>\n");
   fprintf(stderr, "   --style-overwrite\n");
+  fprintf(stderr, "   --out-ext <extension> format of streamed output, default: jpg\n");
   fprintf(stderr, "   --apply-custom-presets <0|1|false|true>, default: true\n");
   fprintf(stderr, "   --verbose\n");
   fprintf(stderr, "   --help,-h\n");
   fprintf(stderr, "   --version\n");
 }
 
+static gboolean _is_stream(const char *output_arg)
+{
+  return !strcmp(output_arg, "-") || g_str_has_prefix(output_arg, "fd:");
+}
+
+#ifndef _WIN32
+// the file descriptor an output of - or fd:<N> streams to, -1 if there is none
+static int _stream_fd(const char *output_arg)
+{
+  if(!strcmp(output_arg, "-")) return STDOUT_FILENO;
+  char *end = NULL;
+  const long fd = strtol(output_arg + 3, &end, 10);
+  return (end != output_arg + 3 && *end == '\0' && fd >= 0 && fd <= G_MAXINT) ? fd : -1;
+}
+#endif
+
+// exports one input file or folder. in a batch the images are removed from the library again after the
+// export, so an input coming up twice doesn't keep the history of the first time.
+static int _export(const char *input_filename, const char *xmp_filename, const char *output_arg,
+                   const dt_cli_options_t *opt, const gboolean batch, dt_cli_stats_t *stats)
+{
+  dt_cli_stats_t dummy_stats;
+  if(!stats) stats = &dummy_stats;
+  memset(stats, 0, sizeof(dt_cli_stats_t));
+
+  // streamed output goes straight from the format module to the descriptor, the disk storage would want a
+  // file name to make unique and to attach the xmp to afterwards. a batch or the server writes files only,
+  // whoever sends a job there has no business with the descriptors of this process.
+  int stream_fd = -1, own_fd = -1;
+  struct stat stream_stat;
+  if(_is_stream(output_arg))
+  {
+#ifdef _WIN32
+    fprintf(stderr, "%s\n", _("error: streamed output is not supported on this platform"));
+    return 1;
+#else
+    if(batch)
+    {
+      fprintf(stderr, "%s\n", _("error: only a single export can be streamed"));
+      return 1;
+    }
+    stream_fd = _stream_fd(output_arg);
+    if(stream_fd < 0 || fstat(stream_fd, &stream_stat))
+    {
+      fprintf(stderr, _("error: can't write to file descriptor %s"), output_arg);
+      fprintf(stderr, "\n");
+      return 1;
+    }
+    // anything printed while importing and processing must not end up in the image, so the image gets a
+    // private copy of stdout and stdout goes to stderr from here on
+    if(stream_fd == STDOUT_FILENO)
+    {
+      fflush(stdout);
+      stream_fd = dup(STDOUT_FILENO);
+      if(stream_fd < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0)
+      {
+        fprintf(stderr, "%s\n", _("error: can't write to stdout"));
+        if(stream_fd >= 0) close(stream_fd);
+        return 1;
+      }
+      own_fd = stream_fd;
+    }
+#endif
+  }
+
+  if(stream_fd < 0 && g_file_test(output_arg, G_FILE_TEST_IS_DIR))
+  {
+    fprintf(stderr, _("error: output file is a directory. please specify file name"));
+    fprintf(stderr, "\n");
+    return 1;
+  }
+
+  // the output file already exists, so there will be a sequence number added
+  if(stream_fd < 0 && g_file_test(output_arg, G_FILE_TEST_EXISTS))
+  {
+    fprintf(stderr, "%s\n", _("output file already exists, it will get renamed"));
+  }
+
+  GList *id_list = NULL;
+  double start = dt_get_wtime();
+
+  if(g_file_test(input_filename, G_FILE_TEST_IS_DIR))
+  {
+    const int filmid = dt_film_import(input_filename);
+    if(!filmid)
+    {
+      fprintf(stderr, _("error: can't open folder %s"), input_filename);
+      fprintf(stderr, "\n");
+      if(own_fd >= 0) close(own_fd);
+      return 1;
+    }
+    id_list = dt_film_get_image_ids(filmid);
+  }
+  else
+  {
+    dt_film_t film;
+    int id = 0;
+    int filmid = 0;
+
+    gchar *directory = g_path_get_dirname(input_filename);
+    filmid = dt_film_new(&film, directory);
+    id = dt_image_import(filmid, input_filename, TRUE);
+    g_free(directory);
+    if(!id)
+    {
+      fprintf(stderr, _("error: can't open file %s"), input_filename);
+      fprintf(stderr, "\n");
+      if(own_fd >= 0) close(own_fd);
+      return 1;
+    }
+
+    id_list = g_list_append(id_list, GINT_TO_POINTER(id));
+  }
+
+  const int total = g_list_length(id_list);
+  stats->total = total;
+  stats->import = dt_get_wtime() - start;
+  start = dt_get_wtime();
+
+  if(total == 0)
+  {
+    fprintf(stderr, _("no images to export, aborting\n"));
+    if(own_fd >= 0) close(own_fd);
+    return 1;
+  }
+
+  // the format modules open the file by name, which truncates a regular file every time
+  if(stream_fd >= 0 && total > 1 && S_ISREG(stream_stat.st_mode))
+  {
+    fprintf(stderr, "%s\n", _("error: only one image can be streamed to a regular file"));
+    g_list_free(id_list);
+    if(own_fd >= 0) close(own_fd);
+    return 1;
+  }
+
+  int res = 0;
+  // a stream gets a made up name so the extension can be taken off below like from any other
+  char *output_filename = stream_fd >= 0
+                              ? g_strdup_printf("/dev/fd/%d.%s", stream_fd, opt->out_ext ? opt->out_ext : "jpg")
+                              : g_strdup(output_arg);
+  dt_imageio_module_format_t *format = NULL;
+  dt_imageio_module_storage_t *storage = NULL;
+  dt_imageio_module_data_t *sdata = NULL, *fdata = NULL;
+
+  // attach xmp, if requested:
+  if(xmp_filename)
+  {
+    for(GList *iter = id_list; iter; iter = g_list_next(iter))
+    {
+      int id = GPOINTER_TO_INT(iter->data);
+      dt_image_t *image = dt_image_cache_get(darktable.image_cache, id, 'w');
+      const int failed = dt_exif_xmp_read(image, xmp_filename, 1) != 0;
+      // don't write new xmp:
+      dt_image_cache_write_release(darktable.image_cache, image, DT_IMAGE_CACHE_RELAXED);
+      if(failed)
+      {
+        fprintf(stderr, _("error: can't open xmp file %s"), xmp_filename);
+        fprintf(stderr, "\n");
+        res = 1;
+        goto cleanup;
+      }
+    }
+  }
+
+  stats->history = dt_get_wtime() - start;
+  start = dt_get_wtime();
+
+  // print the history stack. only look at the first image and assume all got the same processing applied
+  if(opt->verbose)
+  {
+    int id = GPOINTER_TO_INT(id_list->data);
+    gchar *history = dt_history_get_items_as_string(id);
+    if(history)
+      printf("%s\n", history);
+    else
+      printf("[%s]\n", _("empty history stack"));
+    g_free(history);
+  }
+
+  // try to find out the export format from the output_filename
+  char *ext = output_filename + strlen(output_filename);
+  while(ext > output_filename && *ext != '.') ext--;
+  *ext = '\0';
+  ext++;
+
+  if(!strcmp(ext, "jpg")) ext = "jpeg";
+
+  if(!strcmp(ext, "tif")) ext = "tiff";
+
+  // init the export data structures
+  if(stream_fd < 0) storage = dt_imageio_get_storage_by_name("disk"); // only exporting to disk makes sense
+  if(stream_fd < 0 && storage == NULL)
+  {
+    fprintf(
+        stderr, "%s\n",
+        _("cannot find disk storage module. please check your installation, something seems to be broken."));
+    res = 1;
+    goto cleanup;
+  }
+
+  if(storage) sdata = storage->get_params(storage);
+  if(storage && sdata == NULL)
+  {
+    fprintf(stderr, "%s\n", _("failed to get parameters from storage module, aborting export ..."));
+    res = 1;
+    goto cleanup;
+  }
+
+  // and now for the really ugly hacks. don't tell your children about this one or they won't sleep at night
+  // any longer ...
+  if(sdata) g_strlcpy((char *)sdata, output_filename, DT_MAX_PATH_FOR_PARAMS);
+  // all is good now, the last line didn't happen.
+
+  format = dt_imageio_get_format_by_name(ext);
+  if(format == NULL)
+  {
+    fprintf(stderr, _("unknown extension '.%s'"), ext);
+    fprintf(stderr, "\n");
+    res = 1;
+    goto cleanup;
+  }
+
+  fdata = format->get_params(format);
+  if(fdata == NULL)
+  {
+    fprintf(stderr, "%s\n", _("failed to get parameters from format module, aborting export ..."));
+    res = 1;
+    goto cleanup;
+  }
+
+  // tiff seeks back to write its directory, which a pipe can't do
+  if(stream_fd >= 0 && !strcmp(ext, "tiff") && lseek(stream_fd, 0, SEEK_CUR) == -1)
+  {
+    fprintf(stderr, "%s\n", _("error: tiff can only be streamed to a regular file"));
+    res = 1;
+    goto cleanup;
+  }
+
+  uint32_t w, h, fw, fh, sw, sh;
+  fw = fh = sw = sh = 0;
+  if(storage) storage->dimension(storage, sdata, &sw, &sh);
+  format->dimension(format, fdata, &fw, &fh);
+
+  if(sw == 0 || fw == 0)
+    w = sw > fw ? sw : fw;
+  else
+    w = sw < fw ? sw : fw;
+
+  if(sh == 0 || fh == 0)
+    h = sh > fh ? sh : fh;
+  else
+    h = sh < fh ? sh : fh;
+
+  fdata->max_width = opt->width;
+  fdata->max_height = opt->height;
+  fdata->max_width = (w != 0 && fdata->max_width > w) ? w : fdata->max_width;
+  fdata->max_height = (h != 0 && fdata->max_height > h) ? h : fdata->max_height;
+  fdata->style[0] = '\0';
+  fdata->style_append = 1; // make append the default and override with --style-overwrite
+
+  if(opt->style)
+  {
+    g_strlcpy((char *)fdata->style, opt->style, DT_MAX_STYLE_NAME_LENGTH);
+    fdata->style[127] = '\0';
+    if(opt->style_overwrite)
+      fdata->style_append = 0;
+  }
+
+  if(storage && storage->initialize_store)
+  {
+    storage->initialize_store(storage, sdata, &format, &fdata, &id_list, opt->high_quality, opt->upscale);
+
+    format->set_params(format, fdata, format->params_size(format));
+    storage->set_params(storage, sdata, storage->params_size(storage));
+  }
+
+  // TODO: do we want to use the settings from conf?
+  // TODO: expose these via command line arguments
+  dt_colorspaces_color_profile_type_t icc_type = DT_COLORSPACE_NONE;
+  const gchar *icc_filename = NULL;
+  dt_iop_color_intent_t icc_intent = DT_INTENT_LAST;
+
+  // TODO: add a callback to set the bpp without going through the config
+
+  int num = 1;
+  for(GList *iter = id_list; iter; iter = g_list_next(iter), num++)
+  {
+    const int id = GPOINTER_TO_INT(iter->data);
+    // TODO: have a parameter in command line to get the export presets
+    dt_export_metadata_t metadata;
+    metadata.flags = dt_lib_export_metadata_default_flags();
+    metadata.list = NULL;
+    if(stream_fd >= 0)
+    {
+      // without copying the metadata, exiv2 would reopen the file to add the xmp
+      if(dt_imageio_export(id, output_filename, format, fdata, opt->high_quality, opt->upscale, FALSE,
+                           opt->export_masks, icc_type, icc_filename, icc_intent, NULL, NULL, num, total,
+                           &metadata))
+        res = 1;
+    }
+    else if(storage->store(storage, sdata, id, format, fdata, num, total, opt->high_quality, opt->upscale,
+                           opt->export_masks, icc_type, icc_filename, icc_intent, &metadata))
+      res = 1;
+    stats->done = num;
+    stats->export_ = dt_get_wtime() - start;
+  }
+
+  if(storage && storage->finalize_store) storage->finalize_store(storage, sdata);
+
+cleanup:
+  if(sdata) storage->free_params(storage, sdata);
+  if(fdata) format->free_params(format, fdata);
+  if(batch)
+    g_list_free(dt_image_remove_list(id_list));
+  g_list_free(id_list);
+  g_free(output_filename);
+  // the reader of the stream only sees its end once the last copy of the descriptor is closed
+  if(own_fd >= 0) close(own_fd);
+  return res;
+}
+
+// one export per line, the fields separated by tabs as paths may contain spaces
+static GList *_read_manifest(const char *filename)
+{
+  gchar *content = NULL;
+  if(!g_file_get_contents(filename, &content, NULL, NULL))
+  {
+    fprintf(stderr, _("error: can't open manifest file %s"), filename);
+    fprintf(stderr, "\n");
+    return NULL;
+  }
+
+  GList *jobs = NULL;
+  gchar **lines = g_strsplit(content, "\n", -1);
+  g_free(content);
+  for(int n = 0; lines[n]; n++)
+  {
+    gchar *line = g_strstrip(lines[n]);
+    if(!line[0] || line[0] == '#') continue;
+    gchar **fields = g_strsplit(line, "\t", -1);
+    const guint count = g_strv_length(fields);
+    if(count < 2 || count > 3)
+    {
+      fprintf(stderr, _("error: line %d of the manifest needs an input and an output file"), n + 1);
+      fprintf(stderr, "\n");
+      g_strfreev(fields);
+      g_list_free_full(jobs, (GDestroyNotify)g_strfreev);
+      g_strfreev(lines);
+      return NULL;
+    }
+    jobs = g_list_prepend(jobs, fields);
+  }
+  g_strfreev(lines);
+  return g_list_reverse(jobs);
+}
+
+#ifdef HAVE_HTTP_SERVER
+// finished jobs kept for their status
+#define DT_CLI_SERVER_KEEP 1000
+
+typedef enum dt_cli_job_state_t
+{
+  DT_CLI_JOB_QUEUED,
+  DT_CLI_JOB_RUNNING,
+  DT_CLI_JOB_DONE,
+  DT_CLI_JOB_FAILED
+} dt_cli_job_state_t;
+
+typedef struct dt_cli_job_t
+{
+  int id;
+  gchar *input, *xmp, *output, *style;
+  gchar *resolved; // the input as the library knows it, the images get their ids from that
+  dt_cli_options_t opt;
+  dt_cli_job_state_t state;
+  double queued, wait; // when it was queued, how long it waited for a pipe
+  dt_cli_stats_t stats;
+} dt_cli_job_t;
+
+// everything under lock, except the stats of running jobs which are only read for reporting
+static struct
+{
+  dt_pthread_mutex_t lock;
+  pthread_cond_t cond;
+  GHashTable *jobs;    // id -> dt_cli_job_t
+  GQueue finished;     // ids of finished jobs, oldest first
+  GHashTable *inputs;  // resolved inputs being exported, the same image twice at once would share its history
+  GThreadPool *pool;
+  GMainLoop *loop;
+  int next_id;
+  const dt_cli_options_t *defaults;
+  gchar *token;        // every request has to come with it
+} _server;
+
+static void _job_free(gpointer data)
+{
+  dt_cli_job_t *job = (dt_cli_job_t *)data;
+  g_free(job->input);
+  g_free(job->resolved);
+  g_free(job->xmp);
+  g_free(job->output);
+  g_free(job->style);
+  g_free(job);
+}
+
+// the absolute path without links, which all spellings of the same file or folder come down to
+static gchar *_resolve_input(const char *input)
+{
+  gchar *normalized = dt_util_normalize_path(input);
+  gchar *resolved = normalized ? g_realpath(normalized) : NULL;
+  if(!resolved) resolved = normalized ? g_strdup(normalized) : g_strdup(input);
+  g_free(normalized);
+  return resolved;
+}
+
+// whether a job with this resolved input would import any image a running job has. a folder takes all the
+// images inside it.
+static gboolean _input_busy(const char *resolved)
+{
+  const size_t len = strlen(resolved);
+  GHashTableIter iter;
+  gpointer key;
+  g_hash_table_iter_init(&iter, _server.inputs);
+  while(g_hash_table_iter_next(&iter, &key, NULL))
+  {
+    const char *busy = (const char *)key;
+    const size_t busy_len = strlen(busy);
+    const size_t common = MIN(len, busy_len);
+    if(!strncmp(busy, resolved, common)
+       && (len == busy_len || (len > busy_len ? resolved : busy)[common] == G_DIR_SEPARATOR))
+      return TRUE;
+  }
+  return FALSE;
+}
+
+static void _job_run(gpointer data, gpointer user_data)
+{
+  dt_cli_job_t *job = (dt_cli_job_t *)data;
+
+  // the image ids only exist between the import and the removal at the end of the export. the path they are
+  // looked up by is held for all of that instead.
+  job->resolved = _resolve_input(job->input);
+  dt_pthread_mutex_lock(&_server.lock);
+  while(_input_busy(job->resolved)) dt_pthread_cond_wait(&_server.cond, &_server.lock);
+  g_hash_table_add(_server.inputs, job->resolved);
+  job->state = DT_CLI_JOB_RUNNING;
+  job->wait = dt_get_wtime() - job->queued;
+  dt_pthread_mutex_unlock(&_server.lock);
+
+  const int res = _export(job->input, job->xmp, job->output, &job->opt, TRUE, &job->stats);
+
+  dt_pthread_mutex_lock(&_server.lock);
+  g_hash_table_remove(_server.inputs, job->resolved);
+  job->state = res ? DT_CLI_JOB_FAILED : DT_CLI_JOB_DONE;
+  g_queue_push_tail(&_server.finished, GINT_TO_POINTER(job->id));
+  while(g_queue_get_length(&_server.finished) > DT_CLI_SERVER_KEEP)
+    g_hash_table_remove(_server.jobs, g_queue_pop_head(&_server.finished));
+  pthread_cond_broadcast(&_server.cond);
+  dt_pthread_mutex_unlock(&_server.lock);
+}
+
+static void _json_string(GString *json, const char *str)
+{
+  g_string_append_c(json, '"');
+  for(const char *c = str ? str : ""; *c; c++)
+  {
+    if(*c == '"' || *c == '\\')
+      g_string_append_printf(json, "\\%c", *c);
+    else if((unsigned char)*c < 0x20)
+      g_string_append_printf(json, "\\u%04x", (unsigned char)*c);
+    else
+      g_string_append_c(json, *c);
+  }
+  g_string_append_c(json, '"');
+}
+
+static void _job_to_json(GString *json, const dt_cli_job_t *job)
+{
+  static const char *states[] = { "queued", "running", "done", "failed" };
+  g_string_append_printf(json, "{\"id\": %d, \"state\": \"%s\", \"input\": ", job->id, states[job->state]);
+  _json_string(json, job->input);
+  g_string_append(json, ", \"output\": ");
+  _json_string(json, job->output);
+  g_string_append_printf(json,
+                         ", \"done\": %d, \"total\": %d, \"wait\": %.6f, \"import\": %.6f, \"history\": %.6f,"
+                         " \"export\": %.6f}",
+                         job->stats.done, job->stats.total, job->wait, job->stats.import, job->stats.history,
+                         job->stats.export_);
+}
+
+static gboolean _quit(gpointer user_data)
+{
+  g_main_loop_quit(_server.loop);
+  return FALSE;
+}
+
+static gboolean _query_bool(GHashTable *query, const char *key, const gboolean def)
+{
+  const char *value = g_hash_table_lookup(query, key);
+  if(!value) return def;
+  return !g_ascii_strcasecmp(value, "1") || !g_ascii_strcasecmp(value, "true");
+}
+
+static gint _compare_ids(gconstpointer a, gconstpointer b)
+{
+  return GPOINTER_TO_INT(a) - GPOINTER_TO_INT(b);
+}
+
+// 128 bits from the random source of the system, as hex
+static gchar *_make_token()
+{
+  guint32 bits[4];
+  gboolean ok = FALSE;
+#ifndef _WIN32
+  FILE *f = fopen("/dev/urandom", "rb");
+  if(f)
+  {
+    ok = fread(bits, sizeof(bits), 1, f) == 1;
+    fclose(f);
+  }
+#endif
+  if(!ok)
+    for(int k = 0; k < 4; k++) bits[k] = g_random_int();
+  return g_strdup_printf("%08x%08x%08x%08x", bits[0], bits[1], bits[2], bits[3]);
+}
+
+// without leaking how much of it matched through the time taken
+static gboolean _token_valid(const char *token)
+{
+  if(!token) return FALSE;
+  const size_t len = strlen(_server.token);
+  if(strlen(token) != len) return FALSE;
+  unsigned char diff = 0;
+  for(size_t k = 0; k < len; k++) diff |= token[k] ^ _server.token[k];
+  return diff == 0;
+}
+
+// POST /jobs with input=<file>&output=<file>[&xmp=<file>&style=<name>&style_overwrite=1&width=<n>&height=<n>
+// &hq=<0|1>&upscale=<0|1>&export_masks=<0|1>] queues an export and returns its id, GET /jobs?id=<n> returns
+// the status of that export, GET /jobs all of them and POST /jobs with quit=1 stops the server after the queued
+// exports. any other process on the machine can reach the port, so every request needs the token as well.
+static char *_serve(GHashTable *query, const gboolean post, const char **content_type, gpointer user_data)
+{
+  if(!query || !_token_valid(g_hash_table_lookup(query, "token"))) return NULL;
+
+  *content_type = "application/json";
+  GString *json = g_string_new(NULL);
+  const char *input = g_hash_table_lookup(query, "input");
+  const char *output = g_hash_table_lookup(query, "output");
+  const char *id = g_hash_table_lookup(query, "id");
+  const gboolean quit = _query_bool(query, "quit", FALSE);
+
+  dt_pthread_mutex_lock(&_server.lock);
+  if(!post && (quit || input || output))
+  {
+    // nothing is changed by a GET, a link or a prefetch can't do it
+  }
+  else if(quit)
+  {
+    g_string_append(json, "{\"quit\": true}\n");
+    g_timeout_add(100, _quit, NULL);
+  }
+  else if(input && output)
+  {
+    dt_cli_job_t *job = g_malloc0(sizeof(dt_cli_job_t));
+    job->id = ++_server.next_id;
+    job->input = g_strdup(input);
+    job->output = g_strdup(output);
+    job->xmp = g_strdup(g_hash_table_lookup(query, "xmp"));
+    job->style = g_strdup(g_hash_table_lookup(query, "style"));
+    job->opt = *_server.defaults;
+    if(job->style) job->opt.style = job->style;
+    job->opt.style_overwrite = _query_bool(query, "style_overwrite", job->opt.style_overwrite);
+    job->opt.high_quality = _query_bool(query, "hq", job->opt.high_quality);
+    job->opt.upscale = _query_bool(query, "upscale", job->opt.upscale);
+    job->opt.export_masks = _query_bool(query, "export_masks", job->opt.export_masks);
+    const char *width = g_hash_table_lookup(query, "width");
+    const char *height = g_hash_table_lookup(query, "height");
+    if(width) job->opt.width = MAX(atoi(width), 0);
+    if(height) job->opt.height = MAX(atoi(height), 0);
+    job->state = DT_CLI_JOB_QUEUED;
+    job->queued = dt_get_wtime();
+    g_hash_table_insert(_server.jobs, GINT_TO_POINTER(job->id), job);
+    g_thread_pool_push(_server.pool, job, NULL);
+    g_string_append_printf(json, "{\"id\": %d}\n", job->id);
+  }
+  else if(id)
+  {
+    const dt_cli_job_t *job = g_hash_table_lookup(_server.jobs, GINT_TO_POINTER(atoi(id)));
+    if(job)
+    {
+      _job_to_json(json, job);
+      g_string_append_c(json, '\n');
+    }
+  }
+  else
+  {
+    GList *ids = g_list_sort(g_hash_table_get_keys(_server.jobs), (GCompareFunc)_compare_ids);
+    g_string_append_c(json, '[');
+    for(GList *l = ids; l; l = g_list_next(l))
+    {
+      g_string_append(json, l == ids ? "\n  " : ",\n  ");
+      _job_to_json(json, g_hash_table_lookup(_server.jobs, l->data));
+    }
+    g_string_append(json, "\n]\n");
+    g_list_free(ids);
+  }
+  dt_pthread_mutex_unlock(&_server.lock);
+
+  if(!json->len)
+  {
+    g_string_free(json, TRUE);
+    return NULL;
+  }
+  return g_string_free(json, FALSE);
+}
+
+// answers on http://localhost:<port>/jobs until asked to quit, with up to threads exports at once
+static int _serve_jobs(const int port, const int threads, const dt_cli_options_t *defaults)
+{
+  dt_pthread_mutex_init(&_server.lock, NULL);
+  pthread_cond_init(&_server.cond, NULL);
+  _server.jobs = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, _job_free);
+  _server.inputs = g_hash_table_new(g_str_hash, g_str_equal);
+  g_queue_init(&_server.finished);
+  _server.next_id = 0;
+  _server.defaults = defaults;
+  _server.token = _make_token();
+  _server.pool = g_thread_pool_new(_job_run, NULL, MAX(threads, 1), TRUE, NULL);
+
+  dt_http_server_t *server = dt_http_server_create_endpoint(port, "jobs", _serve, NULL);
+  if(!server)
+  {
+    g_thread_pool_free(_server.pool, TRUE, TRUE);
+    g_free(_server.token);
+    return 1;
+  }
+  fprintf(stderr, _("waiting for jobs on %s\n"), server->url);
+  fprintf(stderr, _("token: %s\n"), _server.token);
+
+  _server.loop = g_main_loop_new(NULL, FALSE);
+  g_main_loop_run(_server.loop);
+  g_main_loop_unref(_server.loop);
+  dt_http_server_kill(server);
+
+  // finish what was queued
+  g_thread_pool_free(_server.pool, FALSE, TRUE);
+  g_queue_clear(&_server.finished);
+  g_hash_table_destroy(_server.inputs);
+  g_hash_table_destroy(_server.jobs);
+  g_free(_server.token);
+  pthread_cond_destroy(&_server.cond);
+  dt_pthread_mutex_destroy(&_server.lock);
+  return 0;
+}
+#endif
+
 int main(int argc, char *arg[])
 {
 #ifdef __APPLE__
@@ -89,16 +787,29 @@ int main(int argc, char *arg[])
   char *input_filename = NULL;
   char *xmp_filename = NULL;
   char *output_filename = NULL;
-  char *style = NULL;
+  char *manifest_filename = NULL;
+  int serve_port = 0;
+#ifdef HAVE_HTTP_SERVER
+  int threads = 1;
+#endif
   int file_counter = 0;
-  int width = 0, height = 0, bpp = 0;
-  gboolean verbose = FALSE, high_quality = TRUE, upscale = FALSE,
-           style_overwrite = FALSE, custom_presets = TRUE, export_masks = FALSE;
+  int bpp = 0;
+  gboolean custom_presets = TRUE;
+  dt_cli_options_t opt = { .width = 0,
+                           .height = 0,
+                           .style = NULL,
+                           .out_ext = NULL,
+                           .verbose = FALSE,
+                           .high_quality = TRUE,
+                           .upscale = FALSE,
+                           .style_overwrite = FALSE,
+                           .export_masks = FALSE };
 
   int k;
   for(k = 1; k < argc; k++)
   {
-    if(arg[k][0] == '-')
+    // a lone - is the output going to stdout
+    if(arg[k][0] == '-' && arg[k][1])
     {
       if(!strcmp(arg[k], "--help") || !strcmp(arg[k], "-h"))
       {
@@ -114,12 +825,12 @@ int main(int argc, char *arg[])
       else if(!strcmp(arg[k], "--width") && argc > k + 1)
       {
         k++;
-        width = MAX(atoi(arg[k]), 0);
+        opt.width = MAX(atoi(arg[k]), 0);
       }
       else if(!strcmp(arg[k], "--height") && argc > k + 1)
       {
         k++;
-        height = MAX(atoi(arg[k]), 0);
+        opt.height = MAX(atoi(arg[k]), 0);
       }
       else if(!strcmp(arg[k], "--bpp") && argc > k + 1)
       {
@@ -133,9 +844,9 @@ int main(int argc, char *arg[])
         k++;
         gchar *str = g_ascii_strup(arg[k], -1);
         if(!g_strcmp0(str, "0") || !g_strcmp0(str, "FALSE"))
-          high_quality = FALSE;
+          opt.high_quality = FALSE;
         else if(!g_strcmp0(str, "1") || !g_strcmp0(str, "TRUE"))
-          high_quality = TRUE;
+          opt.high_quality = TRUE;
         else
         {
           fprintf(stderr, "%s: %s\n", _("unknown option for --hq"), arg[k]);
@@ -149,9 +860,9 @@ int main(int argc, char *arg[])
         k++;
         gchar *str = g_ascii_strup(arg[k], -1);
         if(!g_strcmp0(str, "0") || !g_strcmp0(str, "FALSE"))
-          export_masks = FALSE;
+          opt.export_masks = FALSE;
         else if(!g_strcmp0(str, "1") || !g_strcmp0(str, "TRUE"))
-          export_masks = TRUE;
+          opt.export_masks = TRUE;
         else
         {
           fprintf(stderr, "%s: %s\n", _("unknown option for --export_masks"), arg[k]);
@@ -165,9 +876,9 @@ int main(int argc, char *arg[])
         k++;
         gchar *str = g_ascii_strup(arg[k], -1);
         if(!g_strcmp0(str, "0") || !g_strcmp0(str, "FALSE"))
-          upscale = FALSE;
+          opt.upscale = FALSE;
         else if(!g_strcmp0(str, "1") || !g_strcmp0(str, "TRUE"))
-          upscale= TRUE;
+          opt.upscale = TRUE;
         else
         {
           fprintf(stderr, "%s: %s\n", _("unknown option for --upscale"), arg[k]);
@@ -179,11 +890,17 @@ int main(int argc, char *arg[])
       else if(!strcmp(arg[k], "--style") && argc > k + 1)
       {
         k++;
-        style = arg[k];
+        opt.style = arg[k];
       }
       else if(!strcmp(arg[k], "--style-overwrite"))
       {
-        style_overwrite = TRUE;
+        opt.style_overwrite = TRUE;
+      }
+      else if(!strcmp(arg[k], "--out-ext") && argc > k + 1)
+      {
+        k++;
+        opt.out_ext = arg[k];
+        if(opt.out_ext[0] == '.') opt.out_ext++;
       }
       else if(!strcmp(arg[k], "--apply-custom-presets") && argc > k + 1)
       {
@@ -202,9 +919,26 @@ int main(int argc, char *arg[])
         g_free(str);
       }
 
+      else if(!strcmp(arg[k], "--batch") && argc > k + 1)
+      {
+        k++;
+        manifest_filename = arg[k];
+      }
+#ifdef HAVE_HTTP_SERVER
+      else if(!strcmp(arg[k], "--serve") && argc > k + 1)
+      {
+        k++;
+        serve_port = MAX(atoi(arg[k]), 0);
+      }
+      else if((!strcmp(arg[k], "-j") || !strcmp(arg[k], "--jobs")) && argc > k + 1)
+      {
+        k++;
+        threads = MAX(atoi(arg[k]), 1);
+      }
+#endif
       else if(!strcmp(arg[k], "-v") || !strcmp(arg[k], "--verbose"))
       {
-        verbose = TRUE;
+        opt.verbose = TRUE;
       }
       else if(!strcmp(arg[k], "--core"))
       {
@@ -235,33 +969,20 @@ int main(int argc, char *arg[])
   for(; k < argc; k++) m_arg[m_argc++] = arg[k];
   m_arg[m_argc] = NULL;
 
-  if(file_counter < 2 || file_counter > 3)
+  const gboolean no_files = manifest_filename || serve_port;
+  if(no_files ? file_counter != 0 : (file_counter < 2 || file_counter > 3))
   {
     usage(arg[0]);
     free(m_arg);
     exit(1);
   }
-  else if(file_counter == 2)
+  else if(!no_files && file_counter == 2)
   {
     // no xmp file given
     output_filename = xmp_filename;
     xmp_filename = NULL;
   }
 
-  if(g_file_test(output_filename, G_FILE_TEST_IS_DIR))
-  {
-    fprintf(stderr, _("error: output file is a directory. please specify file name"));
-    fprintf(stderr, "\n");
-    free(m_arg);
-    exit(1);
-  }
-
-  // the output file already exists, so there will be a sequence number added
-  if(g_file_test(output_filename, G_FILE_TEST_EXISTS))
-  {
-    fprintf(stderr, "%s\n", _("output file already exists, it will get renamed"));
-  }
-
   // init dt without gui and without data.db:
   if(dt_init(m_argc, m_arg, FALSE, custom_presets, NULL))
   {
@@ -269,202 +990,40 @@ int main(int argc, char *arg[])
     exit(1);
   }
 
-  GList *id_list = NULL;
-
-  if(g_file_test(input_filename, G_FILE_TEST_IS_DIR))
-  {
-    const int filmid = dt_film_import(input_filename);
-    if(!filmid)
-    {
-      fprintf(stderr, _("error: can't open folder %s"), input_filename);
-      fprintf(stderr, "\n");
-      free(m_arg);
-      exit(1);
-    }
-    id_list = dt_film_get_image_ids(filmid);
-  }
+  int res = 0;
+#ifdef HAVE_HTTP_SERVER
+  if(serve_port)
+    res = _serve_jobs(serve_port, threads, &opt);
   else
+#endif
+  if(manifest_filename)
   {
-    dt_film_t film;
-    int id = 0;
-    int filmid = 0;
-
-    gchar *directory = g_path_get_dirname(input_filename);
-    filmid = dt_film_new(&film, directory);
-    id = dt_image_import(filmid, input_filename, TRUE);
-    if(!id)
+    // one runtime for all of them: the modules, the opencl kernels and the caches stay loaded
+    GList *jobs = _read_manifest(manifest_filename);
+    if(!jobs) res = 1;
+    const int total = g_list_length(jobs);
+    int num = 1, failed = 0;
+    for(GList *iter = jobs; iter; iter = g_list_next(iter), num++)
     {
-      fprintf(stderr, _("error: can't open file %s"), input_filename);
-      fprintf(stderr, "\n");
-      free(m_arg);
-      exit(1);
+      gchar **fields = (gchar **)iter->data;
+      const guint count = g_strv_length(fields);
+      fprintf(stderr, "[%d/%d] %s\n", num, total, fields[0]);
+      if(_export(fields[0], count == 3 ? fields[1] : NULL, fields[count - 1], &opt, TRUE, NULL)) failed++;
     }
-    g_free(directory);
-
-    id_list = g_list_append(id_list, GINT_TO_POINTER(id));
-  }
-
-  const int total = g_list_length(id_list);
-
-  if(total == 0)
-  {
-    fprintf(stderr, _("no images to export, aborting\n"));
-    free(m_arg);
-    exit(1);
-  }
-
-  // attach xmp, if requested:
-  if(xmp_filename)
-  {
-    for(GList *iter = id_list; iter; iter = g_list_next(iter))
+    if(failed)
     {
-      int id = GPOINTER_TO_INT(iter->data);
-      dt_image_t *image = dt_image_cache_get(darktable.image_cache, id, 'w');
-      if(dt_exif_xmp_read(image, xmp_filename, 1) != 0)
-      {
-        fprintf(stderr, _("error: can't open xmp file %s"), xmp_filename);
-        fprintf(stderr, "\n");
-        free(m_arg);
-        exit(1);
-      }
-      // don't write new xmp:
-      dt_image_cache_write_release(darktable.image_cache, image, DT_IMAGE_CACHE_RELAXED);
+      fprintf(stderr, _("%d of %d exports failed\n"), failed, total);
+      res = 1;
     }
+    g_list_free_full(jobs, (GDestroyNotify)g_strfreev);
   }
-
-  // print the history stack. only look at the first image and assume all got the same processing applied
-  if(verbose)
-  {
-    int id = GPOINTER_TO_INT(id_list->data);
-    gchar *history = dt_history_get_items_as_string(id);
-    if(history)
-      printf("%s\n", history);
-    else
-      printf("[%s]\n", _("empty history stack"));
-  }
-
-  // try to find out the export format from the output_filename
-  char *ext = output_filename + strlen(output_filename);
-  while(ext > output_filename && *ext != '.') ext--;
-  *ext = '\0';
-  ext++;
-
-  if(!strcmp(ext, "jpg")) ext = "jpeg";
-
-  if(!strcmp(ext, "tif")) ext = "tiff";
-
-  // init the export data structures
-  dt_imageio_module_format_t *format;
-  dt_imageio_module_storage_t *storage;
-  dt_imageio_module_data_t *sdata, *fdata;
-
-  storage = dt_imageio_get_storage_by_name("disk"); // only exporting to disk makes sense
-  if(storage == NULL)
-  {
-    fprintf(
-        stderr, "%s\n",
-        _("cannot find disk storage module. please check your installation, something seems to be broken."));
-    free(m_arg);
-    exit(1);
-  }
-
-  sdata = storage->get_params(storage);
-  if(sdata == NULL)
-  {
-    fprintf(stderr, "%s\n", _("failed to get parameters from storage module, aborting export ..."));
-    free(m_arg);
-    exit(1);
-  }
-
-  // and now for the really ugly hacks. don't tell your children about this one or they won't sleep at night
-  // any longer ...
-  g_strlcpy((char *)sdata, output_filename, DT_MAX_PATH_FOR_PARAMS);
-  // all is good now, the last line didn't happen.
-
-  format = dt_imageio_get_format_by_name(ext);
-  if(format == NULL)
-  {
-    fprintf(stderr, _("unknown extension '.%s'"), ext);
-    fprintf(stderr, "\n");
-    free(m_arg);
-    exit(1);
-  }
-
-  fdata = format->get_params(format);
-  if(fdata == NULL)
-  {
-    fprintf(stderr, "%s\n", _("failed to get parameters from format module, aborting export ..."));
-    free(m_arg);
-    exit(1);
-  }
-
-  uint32_t w, h, fw, fh, sw, sh;
-  fw = fh = sw = sh = 0;
-  storage->dimension(storage, sdata, &sw, &sh);
-  format->dimension(format, fdata, &fw, &fh);
-
-  if(sw == 0 || fw == 0)
-    w = sw > fw ? sw : fw;
-  else
-    w = sw < fw ? sw : fw;
-
-  if(sh == 0 || fh == 0)
-    h = sh > fh ? sh : fh;
   else
-    h = sh < fh ? sh : fh;
-
-  fdata->max_width = width;
-  fdata->max_height = height;
-  fdata->max_width = (w != 0 && fdata->max_width > w) ? w : fdata->max_width;
-  fdata->max_height = (h != 0 && fdata->max_height > h) ? h : fdata->max_height;
-  fdata->style[0] = '\0';
-  fdata->style_append = 1; // make append the default and override with --style-overwrite
-
-  if(style)
-  {
-    g_strlcpy((char *)fdata->style, style, DT_MAX_STYLE_NAME_LENGTH);
-    fdata->style[127] = '\0';
-    if(style_overwrite)
-      fdata->style_append = 0;
-  }
-
-  if(storage->initialize_store)
-  {
-    storage->initialize_store(storage, sdata, &format, &fdata, &id_list, high_quality, upscale);
-
-    format->set_params(format, fdata, format->params_size(format));
-    storage->set_params(storage, sdata, storage->params_size(storage));
-  }
-
-  // TODO: do we want to use the settings from conf?
-  // TODO: expose these via command line arguments
-  dt_colorspaces_color_profile_type_t icc_type = DT_COLORSPACE_NONE;
-  const gchar *icc_filename = NULL;
-  dt_iop_color_intent_t icc_intent = DT_INTENT_LAST;
-
-  // TODO: add a callback to set the bpp without going through the config
-
-  int num = 1;
-  for(GList *iter = id_list; iter; iter = g_list_next(iter), num++)
-  {
-    const int id = GPOINTER_TO_INT(iter->data);
-    // TODO: have a parameter in command line to get the export presets
-    dt_export_metadata_t metadata;
-    metadata.flags = dt_lib_export_metadata_default_flags();
-    metadata.list = NULL;
-    storage->store(storage, sdata, id, format, fdata, num, total, high_quality, upscale, export_masks,
-                   icc_type, icc_filename, icc_intent, &metadata);
-  }
-
-  // cleanup time
-  if(storage->finalize_store) storage->finalize_store(storage, sdata);
-  storage->free_params(storage, sdata);
-  format->free_params(format, fdata);
-  g_list_free(id_list);
+    res = _export(input_filename, xmp_filename, output_filename, &opt, FALSE, NULL);
 
   dt_cleanup();
 
   free(m_arg);
+  return res;
 }
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
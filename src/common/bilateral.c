@@ -44,7 +44,8 @@ size_t dt_bilateral_memory_use(const int width,     // width of input image
   size_t size_y = CLAMPS((int)_y, 4, DT_COMMON_BILATERAL_MAX_RES_S) + 1;
   size_t size_z = CLAMPS((int)_z, 4, DT_COMMON_BILATERAL_MAX_RES_R) + 1;
 
-  return dt_get_num_threads() * size_x * size_y * size_z * sizeof(float);
+  // the grid and the slabs of dt_bilateral_splat(), which overlap by at most two rows per thread
+  return (2 * size_y + 2 * dt_get_num_threads()) * size_x * size_z * sizeof(float);
 }
 
 // for the CPU path this is just an alias as no additional temp buffer is needed
@@ -68,7 +69,7 @@ size_t dt_bilateral_singlebuffer_size(const int width,     // width of input ima
   size_t size_y = CLAMPS((int)_y, 4, DT_COMMON_BILATERAL_MAX_RES_S) + 1;
   size_t size_z = CLAMPS((int)_z, 4, DT_COMMON_BILATERAL_MAX_RES_R) + 1;
 
-  return dt_get_num_threads() * size_x * size_y * size_z * sizeof(float);
+  return size_x * size_y * size_z * sizeof(float);
 }
 
 // for the CPU path this is just an alias as no additional temp buffer is needed
@@ -109,10 +110,9 @@ dt_bilateral_t *dt_bilateral_init(const int width,     // width of input image
   b->height = height;
   b->sigma_s = MAX(height / (b->size_y - 1.0f), width / (b->size_x - 1.0f));
   b->sigma_r = 100.0f / (b->size_z - 1.0f);
-  const int nthreads = /*darktable.num_openmp_threads*/ dt_get_num_threads();
-  b->buf = dt_alloc_align(64, b->size_x * b->size_y * b->size_z * sizeof(float) * nthreads);
+  b->buf = dt_alloc_align(64, b->size_x * b->size_y * b->size_z * sizeof(float));
 
-  memset(b->buf, 0, b->size_x * b->size_y * b->size_z * sizeof(float) * nthreads);
+  memset(b->buf, 0, b->size_x * b->size_y * b->size_z * sizeof(float));
 #if 0
   fprintf(stderr, "[bilateral] created grid [%d %d %d]"
           " with sigma (%f %f) (%f %f)\n", b->size_x, b->size_y, b->size_z,
@@ -121,30 +121,28 @@ dt_bilateral_t *dt_bilateral_init(const int width,     // width of input image
   return b;
 }
 
-#ifdef _OPENMP
-#pragma omp declare simd aligned(in:64)
-#endif
-void dt_bilateral_splat(dt_bilateral_t *b, const float *const in)
+// the lower of the two grid rows image row j splats into
+static inline int _bilateral_grid_row(const dt_bilateral_t *const b, const int j)
+{
+  float x, y, z;
+  image_to_grid(b, 0, j, 0.0f, &x, &y, &z);
+  return MIN((int)y, b->size_y - 2);
+}
+
+// splats the image rows [j0, j1) into slab, which holds the grid rows [y0, y0 + ny)
+static void _bilateral_splat_rows(const dt_bilateral_t *const b, const float *const in, float *const slab,
+                                  const int j0, const int j1, const int y0, const int ny)
 {
   const int ox = 1;
   const int oy = b->size_x;
-  const int oz = b->size_y * b->size_x;
+  const int oz = ny * b->size_x;
   const float sigma_s = b->sigma_s * b->sigma_s;
-  float *const buf = b->buf;
-  const int bufsize = b->size_x * b->size_y * b->size_z;
 
-// splat into downsampled grid
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(in, oy, oz, ox, sigma_s, buf, bufsize)    \
-  shared(b) \
-  collapse(2)
-#endif
-  for(int j = 0; j < b->height; j++)
+  for(int j = j0; j < j1; j++)
   {
     for(int i = 0; i < b->width; i++)
     {
-      size_t index = 4 * (j * b->width + i);
+      size_t index = 4 * ((size_t)j * b->width + i);
       float x, y, z;
       const float L = in[index];
       image_to_grid(b, i, j, L, &x, &y, &z);
@@ -155,32 +153,242 @@ void dt_bilateral_splat(dt_bilateral_t *b, const float *const in)
       const float yf = y - yi;
       const float zf = z - zi;
       // nearest neighbour splatting:
-      const size_t grid_index = xi + b->size_x * (yi + b->size_y * zi) + bufsize * dt_get_thread_num();
+      const size_t grid_index = xi + b->size_x * ((yi - y0) + ny * zi);
       // sum up payload here, doesn't have to be same as edge stopping data
       // for cross bilateral applications.
       // also note that this is not clipped (as L->z is), so potentially hdr/out of gamut
       // should not cause clipping here.
 #ifdef _OPENMP
-#pragma omp simd aligned(buf:64)
+#pragma omp simd
 #endif
       for(int k = 0; k < 8; k++)
       {
         const size_t ii = grid_index + ((k & 1) ? ox : 0) + ((k & 2) ? oy : 0) + ((k & 4) ? oz : 0);
         const float contrib = ((k & 1) ? xf : (1.0f - xf)) * ((k & 2) ? yf : (1.0f - yf))
                               * ((k & 4) ? zf : (1.0f - zf)) * 100.0f / sigma_s;
-        buf[ii] += contrib;
+        slab[ii] += contrib;
       }
     }
   }
+}
+
+void dt_bilateral_splat(dt_bilateral_t *b, const float *const in)
+{
+  const int size_x = b->size_x;
+  const int size_y = b->size_y;
+  const int size_z = b->size_z;
+  const int height = b->height;
+  float *const buf = b->buf;
+
+  // every thread splats a band of image rows into a slab of its own, which only spans the grid rows the band
+  // reaches. the slabs are added into the grid afterwards, so no two threads ever write to the same cell.
+  const int nbands = MAX(1, MIN(dt_get_num_threads(), height / 2));
+  int *const y0 = malloc(sizeof(int) * 2 * nbands);
+  int *const ny = y0 + nbands;
+  size_t *const offset = malloc(sizeof(size_t) * (nbands + 1));
+  float *slabs = NULL;
+  if(y0 && offset && nbands > 1)
+  {
+    offset[0] = 0;
+    for(int t = 0; t < nbands; t++)
+    {
+      y0[t] = _bilateral_grid_row(b, (int64_t)height * t / nbands);
+      ny[t] = _bilateral_grid_row(b, (int64_t)height * (t + 1) / nbands - 1) + 2 - y0[t];
+      offset[t + 1] = offset[t] + (size_t)size_x * ny[t] * size_z;
+    }
+    slabs = dt_alloc_align(64, sizeof(float) * offset[nbands]);
+  }
+
+  if(!slabs)
+  {
+    // single band right into the grid
+    _bilateral_splat_rows(b, in, buf, 0, height, 0, size_y);
+    free(y0);
+    free(offset);
+    return;
+  }
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(b, in, slabs, y0, ny, offset, height, nbands) \
+  schedule(static)
+#endif
+  for(int t = 0; t < nbands; t++)
+  {
+    float *const slab = slabs + offset[t];
+    memset(slab, 0, sizeof(float) * (offset[t + 1] - offset[t]));
+    _bilateral_splat_rows(b, in, slab, (int64_t)height * t / nbands, (int64_t)height * (t + 1) / nbands, y0[t],
+                          ny[t]);
+  }
+
+  // merge the slabs into the grid, row by row
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(buf, slabs, y0, ny, offset, size_x, size_y, size_z, nbands) \
+  schedule(static) \
+  collapse(2)
+#endif
+  for(int z = 0; z < size_z; z++)
+  {
+    for(int y = 0; y < size_y; y++)
+    {
+      float *const row = buf + (size_t)size_x * (y + (size_t)size_y * z);
+      for(int t = 0; t < nbands; t++)
+      {
+        if(y < y0[t] || y >= y0[t] + ny[t]) continue;
+        const float *const srow = slabs + offset[t] + (size_t)size_x * ((y - y0[t]) + (size_t)ny[t] * z);
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+        for(int x = 0; x < size_x; x++) row[x] += srow[x];
+      }
+    }
+  }
+
+  dt_free_align(slabs);
+  free(y0);
+  free(offset);
+}
+
+// lines that run next to each other are blurred together in chunks of this many lines
+#define BILATERAL_LINES 256
+
+// the blur of blur_line() on n neighbouring lines at once, line l of sample i is at buf[i * stride + l].
+// t holds 3 * BILATERAL_LINES floats for the samples that are overwritten already.
+static inline void _blur_lines(float *const buf, const size_t stride, const int n, const int size3,
+                               float *const t)
+{
+  const float w0 = 6.f / 16.f;
+  const float w1 = 4.f / 16.f;
+  const float w2 = 1.f / 16.f;
+  float *tmp1 = t, *tmp2 = t + BILATERAL_LINES, *tmp3 = t + 2 * BILATERAL_LINES;
+  float *r = buf;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+  for(int l = 0; l < n; l++)
+  {
+    tmp1[l] = r[l];
+    r[l] = r[l] * w0 + w1 * r[l + stride] + w2 * r[l + 2 * stride];
+  }
+  r += stride;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+  for(int l = 0; l < n; l++)
+  {
+    tmp2[l] = r[l];
+    r[l] = r[l] * w0 + w1 * (r[l + stride] + tmp1[l]) + w2 * r[l + 2 * stride];
+  }
+  r += stride;
+  for(int i = 2; i < size3 - 2; i++)
+  {
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for(int l = 0; l < n; l++)
+    {
+      tmp3[l] = r[l];
+      r[l] = r[l] * w0 + w1 * (r[l + stride] + tmp2[l]) + w2 * (r[l + 2 * stride] + tmp1[l]);
+    }
+    r += stride;
+    float *const swap = tmp1;
+    tmp1 = tmp2;
+    tmp2 = tmp3;
+    tmp3 = swap;
+  }
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+  for(int l = 0; l < n; l++)
+  {
+    tmp3[l] = r[l];
+    r[l] = r[l] * w0 + w1 * (r[l + stride] + tmp2[l]) + w2 * tmp1[l];
+  }
+  r += stride;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+  for(int l = 0; l < n; l++) r[l] = r[l] * w0 + w1 * tmp3[l] + w2 * tmp2[l];
+}
 
-  // merge the per-thread results into the final result
-  const int nthreads = /*darktable.num_openmp_threads*/ dt_get_num_threads();
-  for(int index = 0; index < bufsize; index++)
+// the blur of blur_line_z() on n neighbouring lines at once, see _blur_lines()
+static inline void _blur_lines_z(float *const buf, const size_t stride, const int n, const int size3,
+                                 float *const t)
+{
+  const float w1 = 4.f / 16.f;
+  const float w2 = 2.f / 16.f;
+  float *tmp1 = t, *tmp2 = t + BILATERAL_LINES, *tmp3 = t + 2 * BILATERAL_LINES;
+  float *r = buf;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+  for(int l = 0; l < n; l++)
   {
-    for(int i = 1; i < nthreads; i++)
+    tmp1[l] = r[l];
+    r[l] = w1 * r[l + stride] + w2 * r[l + 2 * stride];
+  }
+  r += stride;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+  for(int l = 0; l < n; l++)
+  {
+    tmp2[l] = r[l];
+    r[l] = w1 * (r[l + stride] - tmp1[l]) + w2 * r[l + 2 * stride];
+  }
+  r += stride;
+  for(int i = 2; i < size3 - 2; i++)
+  {
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for(int l = 0; l < n; l++)
     {
-      buf[index] += buf[index + i*bufsize];
+      tmp3[l] = r[l];
+      r[l] = +w1 * (r[l + stride] - tmp2[l]) + w2 * (r[l + 2 * stride] - tmp1[l]);
     }
+    r += stride;
+    float *const swap = tmp1;
+    tmp1 = tmp2;
+    tmp2 = tmp3;
+    tmp3 = swap;
+  }
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+  for(int l = 0; l < n; l++)
+  {
+    tmp3[l] = r[l];
+    r[l] = w1 * (r[l + stride] - tmp2[l]) - w2 * tmp1[l];
+  }
+  r += stride;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+  for(int l = 0; l < n; l++) r[l] = -w1 * tmp3[l] - w2 * tmp2[l];
+}
+
+// runs blur on the groups of n neighbouring lines that start every group_stride floats, in chunks of
+// BILATERAL_LINES lines
+static void _blur_line_groups(float *const buf, const size_t group_stride, const int groups, const int n,
+                              const size_t stride, const int size3, const int z)
+{
+  const int chunks = (n + BILATERAL_LINES - 1) / BILATERAL_LINES;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(buf, group_stride, groups, n, stride, size3, z, chunks) \
+  schedule(static)
+#endif
+  for(int c = 0; c < groups * chunks; c++)
+  {
+    float t[3 * BILATERAL_LINES];
+    const int l0 = (c % chunks) * BILATERAL_LINES;
+    float *const lines = buf + (c / chunks) * group_stride + l0;
+    if(z)
+      _blur_lines_z(lines, stride, MIN(BILATERAL_LINES, n - l0), size3, t);
+    else
+      _blur_lines(lines, stride, MIN(BILATERAL_LINES, n - l0), size3, t);
   }
 }
 
@@ -190,6 +398,13 @@ void dt_bilateral_splat(dt_bilateral_t *b, const float *const in)
 static void blur_line_z(float *buf, const int offset1, const int offset2, const int offset3, const int size1,
                         const int size2, const int size3)
 {
+  // the lines of a plane are next to each other, blur them together
+  if(offset1 == 1 && offset2 == size1)
+  {
+    _blur_line_groups(buf, 0, 1, size1 * size2, offset3, size3, TRUE);
+    return;
+  }
+
   const float w1 = 4.f / 16.f;
   const float w2 = 2.f / 16.f;
 #ifdef _OPENMP
@@ -232,6 +447,13 @@ static void blur_line_z(float *buf, const int offset1, const int offset2, const
 static void blur_line(float *buf, const int offset1, const int offset2, const int offset3, const int size1,
                       const int size2, const int size3)
 {
+  // neighbouring lines, blur them together
+  if(offset2 == 1)
+  {
+    _blur_line_groups(buf, offset1, size1, size2, offset3, size3, FALSE);
+    return;
+  }
+
   const float w0 = 6.f / 16.f;
   const float w1 = 4.f / 16.f;
   const float w2 = 1.f / 16.f;
@@ -298,20 +520,27 @@ void dt_bilateral_slice(const dt_bilateral_t *const b, const float *const in, fl
   const int size_z = b->size_z;
   const int width = b->width;
   const int height = b->height;
+  const float sigma_s = b->sigma_s;
+  const float sigma_r = b->sigma_r;
 
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(b, in, norm, ox, oy, oz, size_x, size_y, size_z, height, width, buf) \
-    shared(out) collapse(2)
+  dt_omp_firstprivate(in, norm, sigma_s, sigma_r, ox, oy, oz, size_x, size_y, size_z, height, width, buf) \
+    shared(out) schedule(static)
 #endif
   for(int j = 0; j < height; j++)
   {
+    // the lookups of a row are independent, see image_to_grid()
+    const float y = CLAMPS(j / sigma_s, 0, size_y - 1);
+#ifdef _OPENMP
+#pragma omp simd
+#endif
     for(int i = 0; i < width; i++)
     {
-      size_t index = 4 * (j * width + i);
-      float x, y, z;
+      size_t index = 4 * ((size_t)j * width + i);
       const float L = in[index];
-      image_to_grid(b, i, j, L, &x, &y, &z);
+      const float x = CLAMPS(i / sigma_s, 0, size_x - 1);
+      const float z = CLAMPS(L / sigma_r, 0, size_z - 1);
       // trilinear lookup:
       const int xi = MIN((int)x, size_x - 2);
       const int yi = MIN((int)y, size_y - 2);
@@ -355,20 +584,27 @@ void dt_bilateral_slice_to_output(const dt_bilateral_t *const b, const float *co
   const int size_z = b->size_z;
   const int width = b->width;
   const int height = b->height;
+  const float sigma_s = b->sigma_s;
+  const float sigma_r = b->sigma_r;
 
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(b, in, norm, oy, oz, ox, buf, size_x, size_y, size_z, width, height) \
-  shared(out) collapse(2)
+  dt_omp_firstprivate(in, norm, sigma_s, sigma_r, oy, oz, ox, buf, size_x, size_y, size_z, width, height) \
+  shared(out) schedule(static)
 #endif
   for(int j = 0; j < height; j++)
   {
+    // the lookups of a row are independent, see image_to_grid()
+    const float y = CLAMPS(j / sigma_s, 0, size_y - 1);
+#ifdef _OPENMP
+#pragma omp simd
+#endif
     for(int i = 0; i < width; i++)
     {
-      size_t index = 4 * (j * width + i);
-      float x, y, z;
+      size_t index = 4 * ((size_t)j * width + i);
       const float L = in[index];
-      image_to_grid(b, i, j, L, &x, &y, &z);
+      const float x = CLAMPS(i / sigma_s, 0, size_x - 1);
+      const float z = CLAMPS(L / sigma_r, 0, size_z - 1);
       // trilinear lookup:
       const int xi = MIN((int)x, size_x - 2);
       const int yi = MIN((int)y, size_y - 2);
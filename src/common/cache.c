@@ -27,7 +27,31 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-// this implements a concurrent LRU cache
+// this implements a concurrent segmented LRU cache
+
+static inline dt_cache_shard_t *_shard(dt_cache_t *cache, const uint32_t key)
+{
+  // fibonacci hashing, image ids are dense. shifted in 64 bits so that a single shard works, too
+  return &cache->shard[(uint64_t)(uint32_t)(key * 2654435761u) >> (32 - DT_CACHE_SHARDS_BITS)];
+}
+
+// frees an entry which is no longer in the hash table nor in the lru list and which we hold the write lock of
+static void _free_entry(dt_cache_t *cache, dt_cache_entry_t *entry)
+{
+  if(cache->cleanup)
+  {
+    assert(entry->data_size);
+    ASAN_UNPOISON_MEMORY_REGION(entry->data, entry->data_size);
+
+    cache->cleanup(cache->cleanup_data, entry);
+  }
+  else
+    dt_free_align(entry->data);
+
+  dt_pthread_rwlock_unlock(&entry->lock);
+  dt_pthread_rwlock_destroy(&entry->lock);
+  g_slice_free1(sizeof(*entry), entry);
+}
 
 void dt_cache_init(
     dt_cache_t *cache,
@@ -35,21 +59,30 @@ void dt_cache_init(
     size_t cost_quota)
 {
   cache->cost = 0;
-  cache->lru = 0;
+  g_queue_init(&cache->lru);
+  g_queue_init(&cache->lru_protected);
+  cache->protected_cost = 0;
   cache->entry_size = entry_size;
   cache->cost_quota = cost_quota;
-  dt_pthread_mutex_init(&cache->lock, 0);
+  for(int k = 0; k < DT_CACHE_SHARDS; k++)
+  {
+    dt_pthread_mutex_init(&cache->shard[k].lock, 0);
+    cache->shard[k].hashtable = g_hash_table_new(0, 0);
+  }
+  dt_pthread_mutex_init(&cache->lru_lock, 0);
   cache->allocate = 0;
   cache->allocate_data = 0;
   cache->cleanup = 0;
   cache->cleanup_data = 0;
-  cache->hashtable = g_hash_table_new(0, 0);
 }
 
 void dt_cache_cleanup(dt_cache_t *cache)
 {
-  g_hash_table_destroy(cache->hashtable);
-  GList *l = cache->lru;
+  for(int k = 0; k < DT_CACHE_SHARDS; k++) g_hash_table_destroy(cache->shard[k].hashtable);
+  GList *all = g_list_concat(cache->lru.head, cache->lru_protected.head);
+  g_queue_init(&cache->lru);
+  g_queue_init(&cache->lru_protected);
+  GList *l = all;
   while(l)
   {
     dt_cache_entry_t *entry = (dt_cache_entry_t *)l->data;
@@ -68,15 +101,17 @@ void dt_cache_cleanup(dt_cache_t *cache)
     g_slice_free1(sizeof(*entry), entry);
     l = g_list_next(l);
   }
-  g_list_free(cache->lru);
-  dt_pthread_mutex_destroy(&cache->lock);
+  g_list_free(all);
+  for(int k = 0; k < DT_CACHE_SHARDS; k++) dt_pthread_mutex_destroy(&cache->shard[k].lock);
+  dt_pthread_mutex_destroy(&cache->lru_lock);
 }
 
 int32_t dt_cache_contains(dt_cache_t *cache, const uint32_t key)
 {
-  dt_pthread_mutex_lock(&cache->lock);
-  int32_t result = g_hash_table_contains(cache->hashtable, GINT_TO_POINTER(key));
-  dt_pthread_mutex_unlock(&cache->lock);
+  dt_cache_shard_t *shard = _shard(cache, key);
+  dt_pthread_mutex_lock(&shard->lock);
+  int32_t result = g_hash_table_contains(shard->hashtable, GINT_TO_POINTER(key));
+  dt_pthread_mutex_unlock(&shard->lock);
   return result;
 }
 
@@ -85,22 +120,26 @@ int dt_cache_for_all(
     int (*process)(const uint32_t key, const void *data, void *user_data),
     void *user_data)
 {
-  dt_pthread_mutex_lock(&cache->lock);
-  GHashTableIter iter;
-  gpointer key, value;
-
-  g_hash_table_iter_init (&iter, cache->hashtable);
-  while (g_hash_table_iter_next (&iter, &key, &value))
+  for(int k = 0; k < DT_CACHE_SHARDS; k++)
   {
-    dt_cache_entry_t *entry = (dt_cache_entry_t *)value;
-    const int err = process(GPOINTER_TO_INT(key), entry->data, user_data);
-    if(err)
+    dt_cache_shard_t *shard = &cache->shard[k];
+    dt_pthread_mutex_lock(&shard->lock);
+    GHashTableIter iter;
+    gpointer key, value;
+
+    g_hash_table_iter_init (&iter, shard->hashtable);
+    while (g_hash_table_iter_next (&iter, &key, &value))
     {
-      dt_pthread_mutex_unlock(&cache->lock);
-      return err;
+      dt_cache_entry_t *entry = (dt_cache_entry_t *)value;
+      const int err = process(GPOINTER_TO_INT(key), entry->data, user_data);
+      if(err)
+      {
+        dt_pthread_mutex_unlock(&shard->lock);
+        return err;
+      }
     }
+    dt_pthread_mutex_unlock(&shard->lock);
   }
-  dt_pthread_mutex_unlock(&cache->lock);
   return 0;
 }
 
@@ -111,9 +150,10 @@ dt_cache_entry_t *dt_cache_testget(dt_cache_t *cache, const uint32_t key, char m
   gpointer orig_key, value;
   gboolean res;
   double start = dt_get_wtime();
-  dt_pthread_mutex_lock(&cache->lock);
+  dt_cache_shard_t *shard = _shard(cache, key);
+  dt_pthread_mutex_lock(&shard->lock);
   res = g_hash_table_lookup_extended(
-      cache->hashtable, GINT_TO_POINTER(key), &orig_key, &value);
+      shard->hashtable, GINT_TO_POINTER(key), &orig_key, &value);
   if(res)
   {
     dt_cache_entry_t *entry = (dt_cache_entry_t *)value;
@@ -123,13 +163,12 @@ dt_cache_entry_t *dt_cache_testget(dt_cache_t *cache, const uint32_t key, char m
     if(result)
     { // need to give up mutex so other threads have a chance to get in between and
       // free the lock we're trying to acquire:
-      dt_pthread_mutex_unlock(&cache->lock);
+      dt_pthread_mutex_unlock(&shard->lock);
       return 0;
     }
-    // bubble up in lru list:
-    cache->lru = g_list_remove_link(cache->lru, entry->link);
-    cache->lru = g_list_concat(cache->lru, entry->link);
-    dt_pthread_mutex_unlock(&cache->lock);
+    // give it a second chance in gc:
+    g_atomic_int_set(&entry->_referenced, 1);
+    dt_pthread_mutex_unlock(&shard->lock);
     double end = dt_get_wtime();
     if(end - start > 0.1)
       fprintf(stderr, "try+ wait time %.06fs mode %c \n", end - start, mode);
@@ -144,7 +183,7 @@ dt_cache_entry_t *dt_cache_testget(dt_cache_t *cache, const uint32_t key, char m
 
     return entry;
   }
-  dt_pthread_mutex_unlock(&cache->lock);
+  dt_pthread_mutex_unlock(&shard->lock);
   double end = dt_get_wtime();
   if(end - start > 0.1)
     fprintf(stderr, "try- wait time %.06fs\n", end - start);
@@ -159,11 +198,13 @@ dt_cache_entry_t *dt_cache_get_with_caller(dt_cache_t *cache, const uint32_t key
   gpointer orig_key, value;
   gboolean res;
   int result;
+  gboolean collected = FALSE;
   double start = dt_get_wtime();
+  dt_cache_shard_t *shard = _shard(cache, key);
 restart:
-  dt_pthread_mutex_lock(&cache->lock);
+  dt_pthread_mutex_lock(&shard->lock);
   res = g_hash_table_lookup_extended(
-      cache->hashtable, GINT_TO_POINTER(key), &orig_key, &value);
+      shard->hashtable, GINT_TO_POINTER(key), &orig_key, &value);
   if(res)
   { // yay, found. read lock and pass on.
     dt_cache_entry_t *entry = (dt_cache_entry_t *)value;
@@ -172,14 +213,13 @@ restart:
     if(result)
     { // need to give up mutex so other threads have a chance to get in between and
       // free the lock we're trying to acquire:
-      dt_pthread_mutex_unlock(&cache->lock);
+      dt_pthread_mutex_unlock(&shard->lock);
       g_usleep(5);
       goto restart;
     }
-    // bubble up in lru list:
-    cache->lru = g_list_remove_link(cache->lru, entry->link);
-    cache->lru = g_list_concat(cache->lru, entry->link);
-    dt_pthread_mutex_unlock(&cache->lock);
+    // give it a second chance in gc:
+    g_atomic_int_set(&entry->_referenced, 1);
+    dt_pthread_mutex_unlock(&shard->lock);
 
 #ifdef _DEBUG
     const pthread_t writer = dt_pthread_rwlock_get_writer(&entry->lock);
@@ -206,12 +246,14 @@ restart:
 
   // else, not found, need to allocate.
 
-  // first try to clean up.
-  // also wait if we can't free more than the requested fill ratio.
-  if(cache->cost > 0.8f * cache->cost_quota)
+  // first try to clean up. gc takes the shard locks itself, so look again afterwards, someone else may have
+  // added the entry meanwhile.
+  if(!collected && cache->cost > 0.8f * cache->cost_quota)
   {
-    // need to roll back all the way to get a consistent lock state:
+    dt_pthread_mutex_unlock(&shard->lock);
     dt_cache_gc(cache, 0.8f);
+    collected = TRUE;
+    goto restart;
   }
 
   // here dies your 32-bit system:
@@ -224,8 +266,12 @@ restart:
   entry->link = g_list_append(0, entry);
   entry->key = key;
   entry->_lock_demoting = 0;
+  entry->_referenced = 0;
+  entry->_protected = 0;
+  entry->_seen = 0;
+  entry->keep = 0;
 
-  g_hash_table_insert(cache->hashtable, GINT_TO_POINTER(key), entry);
+  g_hash_table_insert(shard->hashtable, GINT_TO_POINTER(key), entry);
 
   assert(cache->allocate || entry->data_size);
 
@@ -244,12 +290,15 @@ restart:
   if(write) dt_pthread_rwlock_wrlock_with_caller(&entry->lock, file, line);
   else      dt_pthread_rwlock_rdlock_with_caller(&entry->lock, file, line);
 
-  cache->cost += entry->cost;
+  __sync_fetch_and_add(&cache->cost, entry->cost);
+  entry->_rounds = entry->keep;
 
-  // put at end of lru list (most recently used):
-  cache->lru = g_list_concat(cache->lru, entry->link);
+  // put at end of probation list (most recently used):
+  dt_pthread_mutex_lock(&cache->lru_lock);
+  g_queue_push_tail_link(&cache->lru, entry->link);
+  dt_pthread_mutex_unlock(&cache->lru_lock);
 
-  dt_pthread_mutex_unlock(&cache->lock);
+  dt_pthread_mutex_unlock(&shard->lock);
   double end = dt_get_wtime();
   if(end - start > 0.1)
     fprintf(stderr, "wait time %.06fs\n", end - start);
@@ -265,22 +314,23 @@ int dt_cache_remove(dt_cache_t *cache, const uint32_t key)
   gboolean res;
   int result;
   dt_cache_entry_t *entry;
+  dt_cache_shard_t *shard = _shard(cache, key);
 restart:
-  dt_pthread_mutex_lock(&cache->lock);
+  dt_pthread_mutex_lock(&shard->lock);
 
   res = g_hash_table_lookup_extended(
-      cache->hashtable, GINT_TO_POINTER(key), &orig_key, &value);
+      shard->hashtable, GINT_TO_POINTER(key), &orig_key, &value);
   entry = (dt_cache_entry_t *)value;
   if(!res)
   { // not found in cache, not deleting.
-    dt_pthread_mutex_unlock(&cache->lock);
+    dt_pthread_mutex_unlock(&shard->lock);
     return 1;
   }
   // need write lock to be able to delete:
   result = dt_pthread_rwlock_trywrlock(&entry->lock);
   if(result)
   {
-    dt_pthread_mutex_unlock(&cache->lock);
+    dt_pthread_mutex_unlock(&shard->lock);
     g_usleep(5);
     goto restart;
   }
@@ -289,77 +339,133 @@ restart:
   {
     // oops, we are currently demoting (rw -> r) lock to this entry in some thread. do not touch!
     dt_pthread_rwlock_unlock(&entry->lock);
-    dt_pthread_mutex_unlock(&cache->lock);
+    dt_pthread_mutex_unlock(&shard->lock);
     g_usleep(5);
     goto restart;
   }
 
-  gboolean removed = g_hash_table_remove(cache->hashtable, GINT_TO_POINTER(key));
+  gboolean removed = g_hash_table_remove(shard->hashtable, GINT_TO_POINTER(key));
   (void)removed; // make non-assert compile happy
   assert(removed);
-  cache->lru = g_list_delete_link(cache->lru, entry->link);
-
-  if(cache->cleanup)
+  dt_pthread_mutex_lock(&cache->lru_lock);
+  if(entry->_protected)
   {
-    assert(entry->data_size);
-    ASAN_UNPOISON_MEMORY_REGION(entry->data, entry->data_size);
-
-    cache->cleanup(cache->cleanup_data, entry);
+    g_queue_delete_link(&cache->lru_protected, entry->link);
+    cache->protected_cost -= entry->cost;
   }
   else
-    dt_free_align(entry->data);
-
-  dt_pthread_rwlock_unlock(&entry->lock);
-  dt_pthread_rwlock_destroy(&entry->lock);
-  cache->cost -= entry->cost;
-  g_slice_free1(sizeof(*entry), entry);
+    g_queue_delete_link(&cache->lru, entry->link);
+  dt_pthread_mutex_unlock(&cache->lru_lock);
+  __sync_fetch_and_sub(&cache->cost, entry->cost);
+  dt_pthread_mutex_unlock(&shard->lock);
 
-  dt_pthread_mutex_unlock(&cache->lock);
+  // nobody can find it any more, so the cleanup doesn't hold up the others
+  _free_entry(cache, entry);
   return 0;
 }
 
+// moves the oldest protected entry on, the caller holds lru_lock
+static void _gc_protected(dt_cache_t *cache)
+{
+  GList *l = g_queue_pop_head_link(&cache->lru_protected);
+  dt_cache_entry_t *entry = (dt_cache_entry_t *)l->data;
+  if(g_atomic_int_get(&entry->_referenced))
+  {
+    g_atomic_int_set(&entry->_referenced, 0);
+    entry->_rounds = entry->keep;
+    g_queue_push_tail_link(&cache->lru_protected, l);
+  }
+  else if(entry->_rounds > 0)
+  {
+    entry->_rounds--;
+    g_queue_push_tail_link(&cache->lru_protected, l);
+  }
+  else
+  {
+    // back to probation, where one more use brings it back
+    entry->_protected = 0;
+    entry->_seen = 1;
+    cache->protected_cost -= entry->cost;
+    g_queue_push_tail_link(&cache->lru, l);
+  }
+}
+
 // best-effort garbage collection. never blocks, never fails. well, sometimes it just doesn't free anything.
+// must not be called with a shard lock held.
 void dt_cache_gc(dt_cache_t *cache, const float fill_ratio)
 {
-  GList *l = cache->lru;
-  int cnt = 0;
-  while(l)
+  GList *victims = NULL;
+  dt_pthread_mutex_lock(&cache->lru_lock);
+  const size_t protected_quota = cache->cost_quota * DT_CACHE_PROTECTED_SHARE;
+  // without extra rounds every entry gets looked at about three times: to clear its referenced flag, to move it
+  // out of the protected list and to remove it
+  int steps = 4 * (cache->lru.length + cache->lru_protected.length);
+  while((cache->lru.head || cache->lru_protected.head) && steps-- > 0)
   {
-    cnt++;
-    dt_cache_entry_t *entry = (dt_cache_entry_t *)l->data;
-    assert(entry->link->data == entry);
-    l = g_list_next(l); // we might remove this element, so walk to the next one while we still have the pointer..
     if(cache->cost < cache->cost_quota * fill_ratio) break;
 
-    // if still locked by anyone else give up:
-    if(dt_pthread_rwlock_trywrlock(&entry->lock)) continue;
-
-    if(entry->_lock_demoting)
+    if(cache->lru_protected.head && (!cache->lru.head || cache->protected_cost > protected_quota))
     {
-      // oops, we are currently demoting (rw -> r) lock to this entry in some thread. do not touch!
-      dt_pthread_rwlock_unlock(&entry->lock);
+      _gc_protected(cache);
       continue;
     }
 
-    // delete!
-    g_hash_table_remove(cache->hashtable, GINT_TO_POINTER(entry->key));
-    cache->lru = g_list_delete_link(cache->lru, entry->link);
-    cache->cost -= entry->cost;
+    GList *l = g_queue_pop_head_link(&cache->lru);
+    dt_cache_entry_t *entry = (dt_cache_entry_t *)l->data;
+    assert(entry->link->data == entry);
 
-    if(cache->cleanup)
+    gboolean evict = FALSE;
+    dt_cache_shard_t *shard = _shard(cache, entry->key);
+    if(g_atomic_int_get(&entry->_referenced))
     {
-      assert(entry->data_size);
-      ASAN_UNPOISON_MEMORY_REGION(entry->data, entry->data_size);
+      // uses right after it came in don't count, it has to be wanted again later
+      g_atomic_int_set(&entry->_referenced, 0);
+      if(entry->_seen)
+      {
+        entry->_protected = 1;
+        entry->_rounds = entry->keep;
+        cache->protected_cost += entry->cost;
+        g_queue_push_tail_link(&cache->lru_protected, l);
+        continue;
+      }
+    }
+    else if(entry->_rounds > 0)
+      entry->_rounds--;
+    // if still locked by anyone else give up:
+    else if(!dt_pthread_mutex_trylock(&shard->lock))
+    {
+      if(!dt_pthread_rwlock_trywrlock(&entry->lock))
+      {
+        if(entry->_lock_demoting)
+        {
+          // oops, we are currently demoting (rw -> r) lock to this entry in some thread. do not touch!
+          dt_pthread_rwlock_unlock(&entry->lock);
+        }
+        else
+        {
+          // delete!
+          g_hash_table_remove(shard->hashtable, GINT_TO_POINTER(entry->key));
+          evict = TRUE;
+        }
+      }
+      dt_pthread_mutex_unlock(&shard->lock);
+    }
 
-      cache->cleanup(cache->cleanup_data, entry);
+    entry->_seen = 1;
+    if(evict)
+    {
+      __sync_fetch_and_sub(&cache->cost, entry->cost);
+      g_list_free_1(l);
+      victims = g_list_prepend(victims, entry);
     }
     else
-      dt_free_align(entry->data);
-
-    dt_pthread_rwlock_unlock(&entry->lock);
-    dt_pthread_rwlock_destroy(&entry->lock);
-    g_slice_free1(sizeof(*entry), entry);
+      g_queue_push_tail_link(&cache->lru, l); // try again on the next round
   }
+  dt_pthread_mutex_unlock(&cache->lru_lock);
+
+  // the cleanup may write thumbnails to disk, do that without holding up the other threads
+  for(GList *l = victims; l; l = g_list_next(l)) _free_entry(cache, (dt_cache_entry_t *)l->data);
+  g_list_free(victims);
 }
 
 void dt_cache_release_with_caller(dt_cache_t *cache, dt_cache_entry_t *entry, const char *file, int line)
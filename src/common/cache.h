@@ -28,9 +28,14 @@ typedef struct dt_cache_entry_t
   void *data;
   size_t data_size;
   size_t cost;
-  GList *link;
+  GList *link; // in one of the lru lists
   dt_pthread_rwlock_t lock;
   int _lock_demoting;
+  int _referenced; // used since gc last looked at it
+  int _protected;  // in which lru list it is
+  int _seen;       // gc has passed it in the probation list before
+  int _rounds;     // rounds of gc it has left before it may be removed
+  int keep;        // extra rounds of gc an unused entry survives, set by allocate if it is expensive to recreate
   uint32_t key;
 }
 dt_cache_entry_t;
@@ -38,16 +43,42 @@ dt_cache_entry_t;
 typedef void((*dt_cache_allocate_t)(void *userdata, dt_cache_entry_t *entry));
 typedef void((*dt_cache_cleanup_t)(void *userdata, dt_cache_entry_t *entry));
 
+// the hash table is split by key into this many parts with their own lock
+#ifndef DT_CACHE_SHARDS_BITS
+#define DT_CACHE_SHARDS_BITS 4
+#endif
+#define DT_CACHE_SHARDS (1 << DT_CACHE_SHARDS_BITS)
+// part of the quota for entries which have been used more than once
+#ifndef DT_CACHE_PROTECTED_SHARE
+#define DT_CACHE_PROTECTED_SHARE 0.8f
+#endif
+
+typedef struct dt_cache_shard_t
+{
+  dt_pthread_mutex_t lock;
+  GHashTable *hashtable; // stores (key, entry) pairs
+}
+dt_cache_shard_t;
+
 typedef struct dt_cache_t
 {
-  dt_pthread_mutex_t lock; // big fat lock. we're only expecting a couple hand full of cpu threads to use this concurrently.
+  // a lookup only locks the shard of its key. the lru lists and the cost have their own lock, which is only
+  // taken to add and to remove entries, always after the shard lock.
+  dt_cache_shard_t shard[DT_CACHE_SHARDS];
+  dt_pthread_mutex_t lru_lock;
 
   size_t entry_size; // cache line allocation
-  size_t cost;       // user supplied cost per cache line (bytes?)
+  size_t cost;       // user supplied cost per cache line (bytes?), changed atomically
   size_t cost_quota; // quota to try and meet. but don't use as hard limit.
 
-  GHashTable *hashtable; // stores (key, entry) pairs
-  GList *lru;            // last element is most recently used, first is about to be kicked from cache.
+  // segmented lru: entries are appended to the probation list when added and gc removes them from its front.
+  // entries which are used again after gc has passed them once move to the protected list, which gets up to
+  // DT_CACHE_PROTECTED_SHARE of the quota and whose oldest entries go back to probation. so a single sweep
+  // through many images only replaces what was in probation. within a list, entries which have been used
+  // since gc last passed them get moved to the back instead of being removed (CLOCK).
+  GQueue lru;
+  GQueue lru_protected;
+  size_t protected_cost; // under lru_lock
 
   // callback functions for cache misses/garbage collection
   dt_cache_allocate_t allocate;
@@ -87,7 +118,7 @@ void dt_cache_release_with_caller(dt_cache_t *cache, dt_cache_entry_t *entry, co
 int32_t dt_cache_contains(dt_cache_t *cache, const uint32_t key);
 // returns 0 on success, 1 if the key was not found.
 int32_t dt_cache_remove(dt_cache_t *cache, const uint32_t key);
-// removes from the tip of the lru list, until the fill ratio of the hashtable
+// removes from the tip of the lru lists, until the fill ratio of the hashtable
 // goes below the given parameter, in terms of the user defined cost measure.
 // will never lock and never fail, but sometimes not free memory (in case all
 // is locked)
@@ -333,40 +333,16 @@ static void _camera_process_job(const dt_camctl_t *c, const dt_camera_t *camera,
       }
       else
       {
-        // everything worked
-        GError *error = NULL;
-        GdkPixbufLoader *loader = gdk_pixbuf_loader_new_with_mime_type(
-            "image/jpeg", &error); // there were cases where GDKPixbufLoader failed to recognize the JPEG
-        if(error)
-        {
-          dt_print(DT_DEBUG_CAMCTL, "[camera_control] live view failed to create jpeg image loader: %s\n",
-                   error->message);
-          g_error_free(error);
-        }
-        else
-        {
-          if(gdk_pixbuf_loader_write(loader, (guchar *)data, data_size, NULL) == TRUE)
-          {
-            dt_pthread_mutex_lock(&cam->live_view_pixbuf_mutex);
-            if(cam->live_view_pixbuf != NULL) g_object_unref(cam->live_view_pixbuf);
-            // Calling gdk_pixbuf_loader_close forces the data to be parsed by the
-            // loader.  We must do this before calling gdk_pixbuf_loader_get_pixbuf.
-            gdk_pixbuf_loader_close(loader, &error);
-            if(error)
-            {
-              dt_print(DT_DEBUG_CAMCTL, "[camera_control] live view failed to close image loader: %s\n",
-                       error->message);
-              g_error_free(error);
-            }
-            cam->live_view_pixbuf = gdk_pixbuf_loader_get_pixbuf(loader);
-            dt_pthread_mutex_unlock(&cam->live_view_pixbuf_mutex);
-          }
-        }
-        gdk_pixbuf_loader_close(loader, NULL);
+        // hand the frame over to the decode thread, which only ever decodes the last one
+        dt_pthread_mutex_lock(&cam->live_view_frame_mutex);
+        if(cam->live_view_frame) gp_file_unref(cam->live_view_frame);
+        cam->live_view_frame = fp;
+        fp = NULL;
+        pthread_cond_signal(&cam->live_view_frame_cond);
+        dt_pthread_mutex_unlock(&cam->live_view_frame_mutex);
       }
-      if(fp) gp_file_free(fp);
+      if(fp) gp_file_unref(fp);
       dt_pthread_mutex_BAD_unlock(&cam->live_view_synch);
-      dt_control_queue_redraw_center();
     }
     break;
 
@@ -516,6 +492,109 @@ static void *dt_camctl_camera_get_live_view(void *data)
   return NULL;
 }
 
+static void _live_view_size_prepared(GdkPixbufLoader *loader, gint width, gint height, gpointer user_data)
+{
+  const gint *size = (const gint *)user_data;
+  if(size[0] <= 0 || size[1] <= 0) return;
+
+  // the jpeg loader decodes at 1/2, 1/4 or 1/8 of the size directly when asked for a smaller image
+  const double scale = fmin((double)size[0] / width, (double)size[1] / height);
+  if(scale < 1.0) gdk_pixbuf_loader_set_size(loader, MAX(1, width * scale), MAX(1, height * scale));
+}
+
+static GdkPixbuf *_live_view_decode(CameraFile *fp, const gint width, const gint height)
+{
+  const gchar *data = NULL;
+  unsigned long int data_size = 0;
+  int res = GP_OK;
+  if((res = gp_file_get_data_and_size(fp, &data, &data_size)) != GP_OK)
+  {
+    dt_print(DT_DEBUG_CAMCTL, "[camera_control] live view failed to get preview data: %s\n",
+             gp_result_as_string(res));
+    return NULL;
+  }
+
+  GError *error = NULL;
+  GdkPixbufLoader *loader = gdk_pixbuf_loader_new_with_mime_type(
+      "image/jpeg", &error); // there were cases where GDKPixbufLoader failed to recognize the JPEG
+  if(error)
+  {
+    dt_print(DT_DEBUG_CAMCTL, "[camera_control] live view failed to create jpeg image loader: %s\n",
+             error->message);
+    g_error_free(error);
+    return NULL;
+  }
+
+  const gint size[2] = { width, height };
+  g_signal_connect(loader, "size-prepared", G_CALLBACK(_live_view_size_prepared), (gpointer)size);
+
+  GdkPixbuf *pixbuf = NULL;
+  if(gdk_pixbuf_loader_write(loader, (guchar *)data, data_size, NULL) == TRUE)
+  {
+    // Calling gdk_pixbuf_loader_close forces the data to be parsed by the
+    // loader.  We must do this before calling gdk_pixbuf_loader_get_pixbuf.
+    gdk_pixbuf_loader_close(loader, &error);
+    if(error)
+    {
+      dt_print(DT_DEBUG_CAMCTL, "[camera_control] live view failed to close image loader: %s\n",
+               error->message);
+      g_error_free(error);
+    }
+    pixbuf = gdk_pixbuf_loader_get_pixbuf(loader);
+    if(pixbuf) g_object_ref(pixbuf);
+  }
+  else
+    gdk_pixbuf_loader_close(loader, NULL);
+  g_object_unref(loader);
+  return pixbuf;
+}
+
+/* decodes the frames the live view jobs capture. the capture doesn't wait for the decoding, and when the
+ * decoding can't keep up the frames captured in the meantime are dropped but for the last one. */
+static void *_camctl_camera_decode_live_view(void *data)
+{
+  dt_camera_t *cam = (dt_camera_t *)data;
+
+  dt_pthread_setname("live view dec");
+
+  dt_pthread_mutex_lock(&cam->live_view_frame_mutex);
+  while(cam->is_live_viewing == TRUE)
+  {
+    if(!cam->live_view_frame)
+    {
+      dt_pthread_cond_wait(&cam->live_view_frame_cond, &cam->live_view_frame_mutex);
+      continue;
+    }
+    CameraFile *fp = cam->live_view_frame;
+    cam->live_view_frame = NULL;
+    // the zoomed live view is shown at the full size of the camera
+    const gint width = cam->live_view_zoom ? 0 : cam->live_view_width;
+    const gint height = cam->live_view_zoom ? 0 : cam->live_view_height;
+    dt_pthread_mutex_unlock(&cam->live_view_frame_mutex);
+
+    GdkPixbuf *pixbuf = _live_view_decode(fp, width, height);
+    gp_file_unref(fp);
+
+    if(pixbuf)
+    {
+      dt_pthread_mutex_lock(&cam->live_view_pixbuf_mutex);
+      if(cam->live_view_pixbuf != NULL) g_object_unref(cam->live_view_pixbuf);
+      cam->live_view_pixbuf = pixbuf;
+      dt_pthread_mutex_unlock(&cam->live_view_pixbuf_mutex);
+      dt_control_queue_redraw_center();
+    }
+
+    dt_pthread_mutex_lock(&cam->live_view_frame_mutex);
+  }
+  if(cam->live_view_frame)
+  {
+    gp_file_unref(cam->live_view_frame);
+    cam->live_view_frame = NULL;
+  }
+  dt_pthread_mutex_unlock(&cam->live_view_frame_mutex);
+  return NULL;
+}
+
 gboolean dt_camctl_camera_start_live_view(const dt_camctl_t *c)
 {
   dt_camctl_t *camctl = (dt_camctl_t *)c;
@@ -536,6 +615,7 @@ gboolean dt_camctl_camera_start_live_view(const dt_camctl_t *c)
   cam->is_live_viewing = TRUE;
   dt_camctl_camera_set_property_int(camctl, NULL, "eosviewfinder", 1);
 
+  dt_pthread_create(&cam->live_view_decode_thread, &_camctl_camera_decode_live_view, (void *)cam);
   dt_pthread_create(&cam->live_view_thread, &dt_camctl_camera_get_live_view, (void *)camctl);
 
   return TRUE;
@@ -553,6 +633,10 @@ void dt_camctl_camera_stop_live_view(const dt_camctl_t *c)
   dt_print(DT_DEBUG_CAMCTL, "[camera_control] Stopping live view\n");
   cam->is_live_viewing = FALSE;
   pthread_join(cam->live_view_thread, NULL);
+  dt_pthread_mutex_lock(&cam->live_view_frame_mutex);
+  pthread_cond_signal(&cam->live_view_frame_cond);
+  dt_pthread_mutex_unlock(&cam->live_view_frame_mutex);
+  pthread_join(cam->live_view_decode_thread, NULL);
   // tell camera to get back to normal state (close mirror)
   dt_camctl_camera_set_property_int(camctl, NULL, "eosviewfinder", 0);
 }
@@ -611,7 +695,7 @@ dt_camctl_t *dt_camctl_new()
            gp_abilities_list_count(camctl->gpcams));
 
   dt_pthread_mutex_init(&camctl->lock, NULL);
-  dt_pthread_mutex_init(&camctl->listeners_lock, NULL);
+  dt_pthread_rwlock_init(&camctl->listeners_lock, NULL);
 
   return camctl;
 }
@@ -633,11 +717,15 @@ static void dt_camctl_camera_destroy(dt_camera_t *cam)
     g_object_unref(cam->live_view_pixbuf);
     cam->live_view_pixbuf = NULL; // just in case someone else is using this
   }
+  if(cam->live_view_frame) gp_file_unref(cam->live_view_frame);
   g_free(cam->model);
   g_free(cam->port);
   dt_pthread_mutex_destroy(&cam->config_lock);
+  dt_pthread_mutex_destroy(&cam->import_lock);
   dt_pthread_mutex_destroy(&cam->live_view_pixbuf_mutex);
   dt_pthread_mutex_destroy(&cam->live_view_synch);
+  dt_pthread_mutex_destroy(&cam->live_view_frame_mutex);
+  pthread_cond_destroy(&cam->live_view_frame_cond);
   // TODO: cam->jobqueue
   g_free(cam);
 }
@@ -654,7 +742,7 @@ void dt_camctl_destroy(dt_camctl_t *camctl)
   gp_abilities_list_free(camctl->gpcams);
   gp_port_info_list_free(camctl->gpports);
   dt_pthread_mutex_destroy(&camctl->lock);
-  dt_pthread_mutex_destroy(&camctl->listeners_lock);
+  dt_pthread_rwlock_destroy(&camctl->listeners_lock);
   g_free(camctl);
 }
 
@@ -668,7 +756,7 @@ void dt_camctl_register_listener(const dt_camctl_t *c, dt_camctl_listener_t *lis
 {
   dt_camctl_t *camctl = (dt_camctl_t *)c;
   // Just locking mutex and prevent signalling CAMERA_CONTROL_BUSY
-  dt_pthread_mutex_lock(&camctl->listeners_lock);
+  dt_pthread_rwlock_wrlock(&camctl->listeners_lock);
   if(g_list_find(camctl->listeners, listener) == NULL)
   {
     camctl->listeners = g_list_append(camctl->listeners, listener);
@@ -676,17 +764,17 @@ void dt_camctl_register_listener(const dt_camctl_t *c, dt_camctl_listener_t *lis
   }
   else
     dt_print(DT_DEBUG_CAMCTL, "[camera_control] registering already registered listener %p\n", listener);
-  dt_pthread_mutex_unlock(&camctl->listeners_lock);
+  dt_pthread_rwlock_unlock(&camctl->listeners_lock);
 }
 
 void dt_camctl_unregister_listener(const dt_camctl_t *c, dt_camctl_listener_t *listener)
 {
   dt_camctl_t *camctl = (dt_camctl_t *)c;
   // Just locking mutex and prevent signalling CAMERA_CONTROL_BUSY
-  dt_pthread_mutex_lock(&camctl->listeners_lock);
+  dt_pthread_rwlock_wrlock(&camctl->listeners_lock);
   dt_print(DT_DEBUG_CAMCTL, "[camera_control] unregistering listener %p\n", listener);
   camctl->listeners = g_list_remove(camctl->listeners, listener);
-  dt_pthread_mutex_unlock(&camctl->listeners_lock);
+  dt_pthread_rwlock_unlock(&camctl->listeners_lock);
 }
 
 static gint _compare_camera_by_port(gconstpointer a, gconstpointer b)
@@ -728,8 +816,11 @@ static void dt_camctl_detect_cameras(const dt_camctl_t *c)
     gp_list_get_value(available_cameras, i, &s);
     camera->port = g_strdup(s);
     dt_pthread_mutex_init(&camera->config_lock, NULL);
+    dt_pthread_mutex_init(&camera->import_lock, NULL);
     dt_pthread_mutex_init(&camera->live_view_pixbuf_mutex, NULL);
     dt_pthread_mutex_init(&camera->live_view_synch, NULL);
+    dt_pthread_mutex_init(&camera->live_view_frame_mutex, NULL);
+    pthread_cond_init(&camera->live_view_frame_cond, NULL);
 
     // if(g_strcmp0(camera->port,"usb:")==0) { g_free(camera); continue; }
     GList *citem;
@@ -920,8 +1011,9 @@ static gboolean _camera_initialize(const dt_camctl_t *c, dt_camera_t *cam)
 
 void dt_camctl_import(const dt_camctl_t *c, const dt_camera_t *cam, GList *images)
 {
-  // dt_camctl_t *camctl=(dt_camctl_t *)c;
-  _camctl_lock(c, cam);
+  // only this camera is locked, the others stay free for imports from further cards or for tethering
+  dt_camera_t *camera = (dt_camera_t *)cam;
+  dt_pthread_mutex_lock(&camera->import_lock);
 
   GList *ifile = g_list_first(images);
 
@@ -962,12 +1054,27 @@ void dt_camctl_import(const dt_camctl_t *c, const dt_camera_t *cam, GList *image
 
       const char *output_path = _dispatch_request_image_path(c, have_exif_time ? &exif_time : NULL, cam);
       const char *fname = _dispatch_request_image_filename(c, filename, have_exif_time ? &exif_time : NULL, cam);
-      if(!fname) continue;
+      if(!fname)
+      {
+        gp_file_free(camfile);
+        continue;
+      }
 
       char *output = g_build_filename(output_path, fname, (char *)NULL);
+      g_free((char *)fname);
 
-      int handle = g_open(output, O_CREAT | O_WRONLY, 0666);
-      if(handle > 0)
+      // another import may have taken the name since it was handed out, ask again rather than overwrite
+      int handle = g_open(output, O_CREAT | O_EXCL | O_WRONLY, 0666);
+      for(int retry = 0; handle < 0 && errno == EEXIST && retry < 8; retry++)
+      {
+        fname = _dispatch_request_image_filename(c, filename, have_exif_time ? &exif_time : NULL, cam);
+        if(!fname) break;
+        g_free(output);
+        output = g_build_filename(output_path, fname, (char *)NULL);
+        g_free((char *)fname);
+        handle = g_open(output, O_CREAT | O_EXCL | O_WRONLY, 0666);
+      }
+      if(handle >= 0)
       {
         size_t written = 0;
 
@@ -1011,8 +1118,7 @@ void dt_camctl_import(const dt_camctl_t *c, const dt_camera_t *cam, GList *image
       g_free(output);
     } while((ifile = g_list_next(ifile)));
 
-  _dispatch_control_status(c, CAMERA_CONTROL_AVAILABLE);
-  _camctl_unlock(c);
+  dt_pthread_mutex_unlock(&camera->import_lock);
 }
 
 
@@ -1152,7 +1258,9 @@ void dt_camctl_select_camera(const dt_camctl_t *c, const dt_camera_t *cam)
 void dt_camctl_get_previews(const dt_camctl_t *c, dt_camera_preview_flags_t flags, dt_camera_t *cam)
 {
   _camctl_lock(c, cam);
+  dt_pthread_mutex_lock(&cam->import_lock);
   _camctl_recursive_get_previews(c, cam, flags, "/");
+  dt_pthread_mutex_unlock(&cam->import_lock);
   _camctl_unlock(c);
 }
 
@@ -1663,15 +1771,15 @@ static const char *_dispatch_request_image_filename(const dt_camctl_t *c, const
   dt_camctl_t *camctl = (dt_camctl_t *)c;
   GList *listener;
   const char *path = NULL;
-  dt_pthread_mutex_lock(&camctl->listeners_lock);
+  dt_pthread_rwlock_rdlock(&camctl->listeners_lock);
   if((listener = g_list_first(camctl->listeners)) != NULL) do
     {
-      if(((dt_camctl_listener_t *)listener->data)->request_image_filename != NULL)
+      if(!path && ((dt_camctl_listener_t *)listener->data)->request_image_filename != NULL)
         path = ((dt_camctl_listener_t *)listener->data)
                    ->request_image_filename(camera, filename, exif_time,
                                             ((dt_camctl_listener_t *)listener->data)->data);
     } while((listener = g_list_next(listener)) != NULL);
-  dt_pthread_mutex_unlock(&camctl->listeners_lock);
+  dt_pthread_rwlock_unlock(&camctl->listeners_lock);
   return path;
 }
 
@@ -1680,14 +1788,14 @@ static const char *_dispatch_request_image_path(const dt_camctl_t *c, time_t *ex
   dt_camctl_t *camctl = (dt_camctl_t *)c;
   GList *listener;
   const char *path = NULL;
-  dt_pthread_mutex_lock(&camctl->listeners_lock);
+  dt_pthread_rwlock_rdlock(&camctl->listeners_lock);
   if((listener = g_list_first(camctl->listeners)) != NULL) do
     {
-      if(((dt_camctl_listener_t *)listener->data)->request_image_path != NULL)
+      if(!path && ((dt_camctl_listener_t *)listener->data)->request_image_path != NULL)
         path = ((dt_camctl_listener_t *)listener->data)
                    ->request_image_path(camera, exif_time, ((dt_camctl_listener_t *)listener->data)->data);
     } while((listener = g_list_next(listener)) != NULL);
-  dt_pthread_mutex_unlock(&camctl->listeners_lock);
+  dt_pthread_rwlock_unlock(&camctl->listeners_lock);
   return path;
 }
 
@@ -1695,42 +1803,42 @@ static void _dispatch_camera_connected(const dt_camctl_t *c, const dt_camera_t *
 {
   dt_camctl_t *camctl = (dt_camctl_t *)c;
   GList *listener;
-  dt_pthread_mutex_lock(&camctl->listeners_lock);
+  dt_pthread_rwlock_rdlock(&camctl->listeners_lock);
   if((listener = g_list_first(camctl->listeners)) != NULL) do
     {
       if(((dt_camctl_listener_t *)listener->data)->camera_connected != NULL)
         ((dt_camctl_listener_t *)listener->data)
             ->camera_connected(camera, ((dt_camctl_listener_t *)listener->data)->data);
     } while((listener = g_list_next(listener)) != NULL);
-  dt_pthread_mutex_unlock(&camctl->listeners_lock);
+  dt_pthread_rwlock_unlock(&camctl->listeners_lock);
 }
 
 static void _dispatch_camera_disconnected(const dt_camctl_t *c, const dt_camera_t *camera)
 {
   dt_camctl_t *camctl = (dt_camctl_t *)c;
   GList *listener;
-  dt_pthread_mutex_lock(&camctl->listeners_lock);
+  dt_pthread_rwlock_rdlock(&camctl->listeners_lock);
   if((listener = g_list_first(camctl->listeners)) != NULL) do
     {
       if(((dt_camctl_listener_t *)listener->data)->camera_disconnected != NULL)
         ((dt_camctl_listener_t *)listener->data)
             ->camera_disconnected(camera, ((dt_camctl_listener_t *)listener->data)->data);
     } while((listener = g_list_next(listener)) != NULL);
-  dt_pthread_mutex_unlock(&camctl->listeners_lock);
+  dt_pthread_rwlock_unlock(&camctl->listeners_lock);
 }
 
 static void _dispatch_camera_image_downloaded(const dt_camctl_t *c, const dt_camera_t *camera, const char *filename)
 {
   dt_camctl_t *camctl = (dt_camctl_t *)c;
   GList *listener;
-  dt_pthread_mutex_lock(&camctl->listeners_lock);
+  dt_pthread_rwlock_rdlock(&camctl->listeners_lock);
   if((listener = g_list_first(camctl->listeners)) != NULL) do
     {
       if(((dt_camctl_listener_t *)listener->data)->image_downloaded != NULL)
         ((dt_camctl_listener_t *)listener->data)
             ->image_downloaded(camera, filename, ((dt_camctl_listener_t *)listener->data)->data);
     } while((listener = g_list_next(listener)) != NULL);
-  dt_pthread_mutex_unlock(&camctl->listeners_lock);
+  dt_pthread_rwlock_unlock(&camctl->listeners_lock);
 }
 
 static int _dispatch_camera_storage_image_filename(const dt_camctl_t *c, const dt_camera_t *camera,
@@ -1739,7 +1847,7 @@ static int _dispatch_camera_storage_image_filename(const dt_camctl_t *c, const d
   int res = 0;
   dt_camctl_t *camctl = (dt_camctl_t *)c;
   GList *listener;
-  dt_pthread_mutex_lock(&camctl->listeners_lock);
+  dt_pthread_rwlock_rdlock(&camctl->listeners_lock);
   if((listener = g_list_first(camctl->listeners)) != NULL) do
     {
       if(((dt_camctl_listener_t *)listener->data)->camera_storage_image_filename != NULL)
@@ -1747,7 +1855,7 @@ static int _dispatch_camera_storage_image_filename(const dt_camctl_t *c, const d
                   ->camera_storage_image_filename(camera, filename, preview,
                                                   ((dt_camctl_listener_t *)listener->data)->data);
     } while((listener = g_list_next(listener)) != NULL);
-  dt_pthread_mutex_unlock(&camctl->listeners_lock);
+  dt_pthread_rwlock_unlock(&camctl->listeners_lock);
   return res;
 }
 
@@ -1755,14 +1863,14 @@ static void _dispatch_control_status(const dt_camctl_t *c, dt_camctl_status_t st
 {
   dt_camctl_t *camctl = (dt_camctl_t *)c;
   GList *listener;
-  dt_pthread_mutex_lock(&camctl->listeners_lock);
+  dt_pthread_rwlock_rdlock(&camctl->listeners_lock);
   if((listener = g_list_first(camctl->listeners)) != NULL) do
     {
       if(((dt_camctl_listener_t *)listener->data)->control_status != NULL)
         ((dt_camctl_listener_t *)listener->data)
             ->control_status(status, ((dt_camctl_listener_t *)listener->data)->data);
     } while((listener = g_list_next(listener)) != NULL);
-  dt_pthread_mutex_unlock(&camctl->listeners_lock);
+  dt_pthread_rwlock_unlock(&camctl->listeners_lock);
 }
 
 static void _dispatch_camera_property_value_changed(const dt_camctl_t *c, const dt_camera_t *camera,
@@ -1770,7 +1878,7 @@ static void _dispatch_camera_property_value_changed(const dt_camctl_t *c, const
 {
   dt_camctl_t *camctl = (dt_camctl_t *)c;
   GList *listener;
-  dt_pthread_mutex_lock(&camctl->listeners_lock);
+  dt_pthread_rwlock_rdlock(&camctl->listeners_lock);
   if((listener = g_list_first(camctl->listeners)) != NULL) do
     {
       if(((dt_camctl_listener_t *)listener->data)->camera_property_value_changed != NULL)
@@ -1778,7 +1886,7 @@ static void _dispatch_camera_property_value_changed(const dt_camctl_t *c, const
             ->camera_property_value_changed(camera, name, value,
                                             ((dt_camctl_listener_t *)listener->data)->data);
     } while((listener = g_list_next(listener)) != NULL);
-  dt_pthread_mutex_unlock(&camctl->listeners_lock);
+  dt_pthread_rwlock_unlock(&camctl->listeners_lock);
 }
 
 /*
@@ -1787,7 +1895,7 @@ static void _dispatch_camera_property_accessibility_changed(const dt_camctl_t *c
 {
   dt_camctl_t *camctl = (dt_camctl_t *)c;
   GList *listener;
-  dt_pthread_mutex_lock(&camctl->listeners_lock);
+  dt_pthread_rwlock_rdlock(&camctl->listeners_lock);
   if((listener = g_list_first(camctl->listeners)) != NULL) do
     {
       if(((dt_camctl_listener_t *)listener->data)->camera_property_accessibility_changed != NULL)
@@ -1795,7 +1903,7 @@ static void _dispatch_camera_property_accessibility_changed(const dt_camctl_t *c
             ->camera_property_accessibility_changed(camera, name, read_only,
                                                     ((dt_camctl_listener_t *)listener->data)->data);
     } while((listener = g_list_next(listener)) != NULL);
-  dt_pthread_mutex_unlock(&camctl->listeners_lock);
+  dt_pthread_rwlock_unlock(&camctl->listeners_lock);
 }
 */
 
@@ -1803,14 +1911,14 @@ static void _dispatch_camera_error(const dt_camctl_t *c, const dt_camera_t *came
 {
   dt_camctl_t *camctl = (dt_camctl_t *)c;
   GList *listener;
-  dt_pthread_mutex_lock(&camctl->listeners_lock);
+  dt_pthread_rwlock_rdlock(&camctl->listeners_lock);
   if((listener = g_list_first(camctl->listeners)) != NULL) do
     {
       if(((dt_camctl_listener_t *)listener->data)->camera_error != NULL)
         ((dt_camctl_listener_t *)listener->data)
             ->camera_error(camera, error, ((dt_camctl_listener_t *)listener->data)->data);
     } while((listener = g_list_next(listener)) != NULL);
-  dt_pthread_mutex_unlock(&camctl->listeners_lock);
+  dt_pthread_rwlock_unlock(&camctl->listeners_lock);
 }
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
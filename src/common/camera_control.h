@@ -49,6 +49,8 @@ typedef struct dt_camera_t
 
   gboolean config_changed;
   dt_pthread_mutex_t config_lock;
+  /** Held while files are read off this camera, so that imports from several devices run side by side */
+  dt_pthread_mutex_t import_lock;
   /** This camera/device can import images. */
   gboolean can_import;
   /** This camera/device can do tethered shoots. */
@@ -103,6 +105,16 @@ typedef struct dt_camera_t
   dt_pthread_mutex_t live_view_pixbuf_mutex;
   /** A flag to tell the live view thread that the last job was completed */
   dt_pthread_mutex_t live_view_synch;
+  /** The thread decoding the live view frames */
+  pthread_t live_view_decode_thread;
+  /** The last frame from the camera which hasn't been decoded yet, older ones are dropped */
+  CameraFile *live_view_frame;
+  /** A guard for live_view_frame, live_view_width and live_view_height */
+  dt_pthread_mutex_t live_view_frame_mutex;
+  /** Signaled when a new frame is waiting or live view stops */
+  pthread_cond_t live_view_frame_cond;
+  /** The size the frames are shown at, they are decoded to fit it. 0 for the full size of the camera */
+  gint live_view_width, live_view_height;
 } dt_camera_t;
 
 /** Camera control status.
@@ -137,7 +149,8 @@ typedef enum dt_camera_error_t
 typedef struct dt_camctl_t
 {
   dt_pthread_mutex_t lock;
-  dt_pthread_mutex_t listeners_lock;
+  /** Read locked while dispatching, so that the imports of several cameras do not wait for each other */
+  dt_pthread_rwlock_t listeners_lock;
 
   /** Camera event thread. */
   pthread_t camera_event_thread;
@@ -168,11 +181,11 @@ typedef struct dt_camctl_listener_t
   void (*control_status)(dt_camctl_status_t status, void *data);
 
   /** Invoked before images are fetched from camera and when tethered capture fetching an image. \note That
-   * only one listener should implement this at time... */
+   * only one listener should answer for a camera, the others return NULL */
   const char *(*request_image_path)(const dt_camera_t *camera, time_t *exif_time, void *data);
 
   /** Invoked before images are fetched from camera and when tethered capture fetching an image. \note That
-   * only one listener should implement this at time... */
+   * only one listener should answer for a camera, the others return NULL */
   const char *(*request_image_filename)(const dt_camera_t *camera, const char *filename, time_t *exif_time,
                                         void *data);
 
@@ -230,7 +243,7 @@ int dt_camctl_can_enter_tether_mode(const dt_camctl_t *c, const dt_camera_t *cam
 void dt_camctl_tether_mode(const dt_camctl_t *c, const dt_camera_t *cam, gboolean enable);
 /** traverse filesystem on camera an retrieves previews of images */
 void dt_camctl_get_previews(const dt_camctl_t *c, dt_camera_preview_flags_t flags, dt_camera_t *cam);
-/** Imports the images in list from specified camera */
+/** Imports the images in list from specified camera, without blocking the other cameras */
 void dt_camctl_import(const dt_camctl_t *c, const dt_camera_t *cam, GList *images);
 
 /** Execute remote capture of camera.*/
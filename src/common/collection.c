@@ -76,8 +76,12 @@ const dt_collection_t *dt_collection_new(const dt_collection_t *clone)
     memcpy(&collection->params, &clone->params, sizeof(dt_collection_params_t));
     memcpy(&collection->store, &clone->store, sizeof(dt_collection_params_t));
     collection->where_ext = g_strdupv(clone->where_ext);
+    collection->filtered = clone->filtered;
     collection->query = g_strdup(clone->query);
     collection->query_no_group = g_strdup(clone->query_no_group);
+    collection->subset_pre = g_strdup(clone->subset_pre);
+    collection->subset_pre_no_group = g_strdup(clone->subset_pre_no_group);
+    collection->subset_post = g_strdup(clone->subset_post);
     collection->clone = 1;
     collection->count = clone->count;
     collection->count_no_group = clone->count_no_group;
@@ -113,6 +117,9 @@ void dt_collection_free(const dt_collection_t *collection)
 
   g_free(collection->query);
   g_free(collection->query_no_group);
+  g_free(collection->subset_pre);
+  g_free(collection->subset_pre_no_group);
+  g_free(collection->subset_post);
   g_strfreev(collection->where_ext);
   g_free((dt_collection_t *)collection);
 }
@@ -178,6 +185,168 @@ void dt_collection_memory_update()
   g_free(ins_query);
 }
 
+// above that many changed images the full rebuild is about as fast
+#define DT_COLLECTION_MAX_INCREMENTAL 200
+
+static gchar *_id_list(GArray *ids)
+{
+  GString *txt = g_string_new(NULL);
+  for(guint i = 0; i < ids->len; i++)
+    g_string_append_printf(txt, "%s%d", i ? "," : "", g_array_index(ids, int, i));
+  return g_string_free(txt, FALSE);
+}
+
+static GArray *_query_ids(const gchar *query)
+{
+  GArray *ids = g_array_new(FALSE, FALSE, sizeof(int));
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    const int id = sqlite3_column_int(stmt, 0);
+    g_array_append_val(ids, id);
+  }
+  sqlite3_finalize(stmt);
+  return ids;
+}
+
+/* after a change of only the images in list (rating, labels, tags...) brings memory.collected_images up to
+ * date without running the whole query again. these images can only have left the collection or moved in
+ * it, so they are checked together with their neighbours in the table: if none of them joined the collection
+ * and they are still in the same order, dropping the ones which left is enough. returns FALSE without
+ * touching anything if the full rebuild is needed. */
+static gboolean _collection_memory_update_images(const dt_collection_t *collection, GList *list)
+{
+  if(!list || !collection->subset_pre || collection != darktable.collection) return FALSE;
+  // the aspect ratios computed meanwhile may move any image
+  if(collection->params.sort == DT_COLLECTION_SORT_ASPECT_RATIO) return FALSE;
+
+  const guint length = g_list_length(list);
+  if(length > DT_COLLECTION_MAX_INCREMENTAL) return FALSE;
+
+  GArray *changed = g_array_sized_new(FALSE, FALSE, sizeof(int), length);
+  for(GList *l = list; l; l = g_list_next(l))
+  {
+    const int id = GPOINTER_TO_INT(l->data);
+    g_array_append_val(changed, id);
+  }
+  gchar *ids = _id_list(changed);
+  g_array_free(changed, TRUE);
+
+  // with grouping another image of the group may have to stand in for a changed one
+  if(darktable.gui && darktable.gui->grouping)
+  {
+    gchar *query = g_strdup_printf("SELECT id FROM main.images WHERE group_id IN"
+                                   " (SELECT group_id FROM main.images WHERE id IN (%s))",
+                                   ids);
+    GArray *members = _query_ids(query);
+    g_free(query);
+    g_free(ids);
+    if(members->len > DT_COLLECTION_MAX_INCREMENTAL)
+    {
+      g_array_free(members, TRUE);
+      return FALSE;
+    }
+    ids = _id_list(members);
+    g_array_free(members, TRUE);
+  }
+
+  // the changed images and their closest unchanged neighbours, in the order of the table
+  gchar *query = g_strdup_printf("SELECT imgid FROM memory.collected_images WHERE imgid IN (%s)"
+                                 " OR imgid IN (SELECT (SELECT imgid FROM memory.collected_images"
+                                 "                      WHERE rowid < c.rowid AND imgid NOT IN (%s)"
+                                 "                      ORDER BY rowid DESC LIMIT 1)"
+                                 "              FROM memory.collected_images AS c WHERE c.imgid IN (%s))"
+                                 " OR imgid IN (SELECT (SELECT imgid FROM memory.collected_images"
+                                 "                      WHERE rowid > c.rowid AND imgid NOT IN (%s)"
+                                 "                      ORDER BY rowid LIMIT 1)"
+                                 "              FROM memory.collected_images AS c WHERE c.imgid IN (%s))"
+                                 " ORDER BY rowid",
+                                 ids, ids, ids, ids, ids);
+  GArray *before = _query_ids(query);
+  g_free(query);
+
+  // the same images as the collection would have them now
+  gchar *all_ids = before->len ? _id_list(before) : NULL;
+  query = g_strconcat(collection->subset_pre, ids, all_ids ? "," : "", all_ids ? all_ids : "",
+                      collection->subset_post, NULL);
+  GArray *after = _query_ids(query);
+  g_free(query);
+  g_free(all_ids);
+
+  GHashTable *present = g_hash_table_new(NULL, NULL);
+  for(guint i = 0; i < before->len; i++)
+    g_hash_table_add(present, GINT_TO_POINTER(g_array_index(before, int, i)));
+  GHashTable *kept = g_hash_table_new(NULL, NULL);
+  gboolean ok = TRUE;
+  for(guint i = 0; i < after->len && ok; i++)
+  {
+    const int id = g_array_index(after, int, i);
+    // a new image would need its place among all the others
+    if(!g_hash_table_contains(present, GINT_TO_POINTER(id))) ok = FALSE;
+    g_hash_table_add(kept, GINT_TO_POINTER(id));
+  }
+
+  GArray *left = g_array_new(FALSE, FALSE, sizeof(int));
+  for(guint i = 0, k = 0; i < before->len && ok; i++)
+  {
+    const int id = g_array_index(before, int, i);
+    if(!g_hash_table_contains(kept, GINT_TO_POINTER(id)))
+      g_array_append_val(left, id);
+    // a shuffled collection keeps its order, any other has to match the one in the table
+    else if(collection->params.sort != DT_COLLECTION_SORT_SHUFFLE && g_array_index(after, int, k++) != id)
+      ok = FALSE;
+  }
+  g_hash_table_destroy(present);
+  g_hash_table_destroy(kept);
+  g_array_free(before, TRUE);
+  g_array_free(after, TRUE);
+
+  if(ok && left->len)
+  {
+    sqlite3 *db = dt_database_get(darktable.db);
+    gchar *left_ids = _id_list(left);
+    query = g_strdup_printf("SELECT rowid FROM memory.collected_images WHERE imgid IN (%s) ORDER BY rowid",
+                            left_ids);
+    GArray *rows = _query_ids(query);
+    g_free(query);
+    query = g_strdup_printf("DELETE FROM memory.collected_images WHERE imgid IN (%s)", left_ids);
+    DT_DEBUG_SQLITE3_EXEC(db, query, NULL, NULL, NULL);
+    g_free(query);
+    g_free(left_ids);
+
+    // the rowids are the positions in the collection, close the gaps. the rows go negative first so that none
+    // of them collides with one not moved yet.
+    for(guint i = 0; i < rows->len; i++)
+    {
+      if(i + 1 < rows->len)
+        query = g_strdup_printf("UPDATE memory.collected_images SET rowid = %u - rowid"
+                                " WHERE rowid > %d AND rowid < %d",
+                                i + 1, g_array_index(rows, int, i), g_array_index(rows, int, i + 1));
+      else
+        query = g_strdup_printf("UPDATE memory.collected_images SET rowid = %u - rowid WHERE rowid > %d", i + 1,
+                                g_array_index(rows, int, i));
+      DT_DEBUG_SQLITE3_EXEC(db, query, NULL, NULL, NULL);
+      g_free(query);
+    }
+    DT_DEBUG_SQLITE3_EXEC(db, "UPDATE memory.collected_images SET rowid = -rowid WHERE rowid < 0", NULL, NULL,
+                          NULL);
+    g_array_free(rows, TRUE);
+  }
+  g_array_free(left, TRUE);
+
+  if(ok)
+  {
+    // these images may also have left the collection without grouping
+    query = g_strconcat("DELETE FROM main.selected_images WHERE imgid IN (", ids, ") AND imgid NOT IN (",
+                        collection->subset_pre_no_group, ids, collection->subset_post, ")", NULL);
+    DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), query, NULL, NULL, NULL);
+    g_free(query);
+  }
+  g_free(ids);
+  return ok;
+}
+
 static void _dt_collection_set_selq_pre_sort(const dt_collection_t *collection, char **selq_pre)
 {
   const uint32_t tagid = collection->tagid;
@@ -198,14 +367,26 @@ static void _dt_collection_set_selq_pre_sort(const dt_collection_t *collection,
                               tagid ? tag : "");
 }
 
-int dt_collection_update(const dt_collection_t *collection)
+static void _collection_recount(const dt_collection_t *collection)
+{
+  /* update the cached count. collection isn't a real const anyway, we are writing to it in
+   * _dt_collection_store, too. */
+  ((dt_collection_t *)collection)->count = _dt_collection_compute_count(collection, FALSE);
+  ((dt_collection_t *)collection)->count_no_group = _dt_collection_compute_count(collection, TRUE);
+  dt_collection_hint_message(collection);
+
+  _collection_update_aspect_ratio(collection);
+}
+
+static int _collection_update(const dt_collection_t *collection, const gboolean recount)
 {
   uint32_t result;
   gchar *wq, *wq_no_group, *sq, *selq_pre, *selq_post, *query, *query_no_group;
   wq = wq_no_group = sq = selq_pre = selq_post = query = query_no_group = NULL;
 
   /* build where part */
-  gchar *where_ext = dt_collection_get_extended_where(collection, -1);
+  gchar *where_ext = collection->filtered ? g_strdup("(id IN (SELECT id FROM memory.collection_filter))")
+                                          : dt_collection_get_extended_where(collection, -1);
   if(!(collection->params.query_flags & COLLECTION_QUERY_USE_ONLY_WHERE_EXT))
   {
     char *rejected_check = g_strdup_printf("((flags & %d) == %d)", DT_IMAGE_REJECTED, DT_IMAGE_REJECTED);
@@ -448,6 +629,25 @@ int dt_collection_update(const dt_collection_t *collection)
                         (collection->params.query_flags & COLLECTION_QUERY_USE_LIMIT) ? " " LIMIT_QUERY : "");
   result = _dt_collection_store(collection, query, query_no_group);
 
+  /* and the same without limit for a few images only, see _collection_memory_update_images() */
+  g_free(collection->subset_pre);
+  g_free(collection->subset_pre_no_group);
+  g_free(collection->subset_post);
+  if(!(collection->params.query_flags & COLLECTION_QUERY_USE_ONLY_WHERE_EXT))
+  {
+    ((dt_collection_t *)collection)->subset_pre = g_strconcat(selq_pre, "(", wq, ") AND mi.id IN (", NULL);
+    ((dt_collection_t *)collection)->subset_pre_no_group
+        = g_strconcat(selq_pre, "(", wq_no_group, ") AND mi.id IN (", NULL);
+    ((dt_collection_t *)collection)->subset_post
+        = g_strconcat(")", selq_post ? selq_post : "", " ", sq ? sq : "", NULL);
+  }
+  else
+  {
+    ((dt_collection_t *)collection)->subset_pre = NULL;
+    ((dt_collection_t *)collection)->subset_pre_no_group = NULL;
+    ((dt_collection_t *)collection)->subset_post = NULL;
+  }
+
 #ifdef _DEBUG
   printf("SQL Collection for 1st:%d and 2nd:%d: %s\n\n",collection->params.sort,collection->params.sort_second_order,query);/*only for debugging*/
 #endif
@@ -462,17 +662,16 @@ int dt_collection_update(const dt_collection_t *collection)
   g_free(query);
   g_free(query_no_group);
 
-  /* update the cached count. collection isn't a real const anyway, we are writing to it in
-   * _dt_collection_store, too. */
-  ((dt_collection_t *)collection)->count = _dt_collection_compute_count(collection, FALSE);
-  ((dt_collection_t *)collection)->count_no_group = _dt_collection_compute_count(collection, TRUE);
-  dt_collection_hint_message(collection);
-
-  _collection_update_aspect_ratio(collection);
+  if(recount) _collection_recount(collection);
 
   return result;
 }
 
+int dt_collection_update(const dt_collection_t *collection)
+{
+  return _collection_update(collection, TRUE);
+}
+
 void dt_collection_reset(const dt_collection_t *collection)
 {
   dt_collection_params_t *params = (dt_collection_params_t *)&collection->params;
@@ -567,6 +766,7 @@ void dt_collection_set_extended_where(const dt_collection_t *collection, gchar *
 
   /* set new from parameter */
   ((dt_collection_t *)collection)->where_ext = g_strdupv(extended_where);
+  ((dt_collection_t *)collection)->filtered = FALSE;
 }
 
 void dt_collection_set_film_id(const dt_collection_t *collection, const uint32_t film_id)
@@ -1001,7 +1201,8 @@ static uint32_t _dt_collection_compute_count(const dt_collection_t *collection,
   else
     count_query = dt_util_dstrcat(count_query, "SELECT COUNT(DISTINCT mi.id) %s", fq);
 
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), count_query, -1, &stmt, NULL);
+  // the same as long as the collection doesn't change, while ratings and such get counted again
+  DT_DEBUG_SQLITE3_PREPARE_CACHED(darktable.db, count_query, &stmt);
   if((collection->params.query_flags & COLLECTION_QUERY_USE_LIMIT)
      && !(collection->params.query_flags & COLLECTION_QUERY_USE_ONLY_WHERE_EXT))
   {
@@ -1010,7 +1211,7 @@ static uint32_t _dt_collection_compute_count(const dt_collection_t *collection,
   }
 
   if(sqlite3_step(stmt) == SQLITE_ROW) count = sqlite3_column_int(stmt, 0);
-  sqlite3_finalize(stmt);
+  DT_DEBUG_SQLITE3_RELEASE_CACHED(darktable.db, stmt);
   g_free(count_query);
   return count;
 }
@@ -1029,10 +1230,9 @@ uint32_t dt_collection_get_selected_count(const dt_collection_t *collection)
 {
   sqlite3_stmt *stmt = NULL;
   uint32_t count = 0;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT COUNT(*) FROM main.selected_images", -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_PREPARE_CACHED(darktable.db, "SELECT COUNT(*) FROM main.selected_images", &stmt);
   if(sqlite3_step(stmt) == SQLITE_ROW) count = sqlite3_column_int(stmt, 0);
-  sqlite3_finalize(stmt);
+  DT_DEBUG_SQLITE3_RELEASE_CACHED(darktable.db, stmt);
   return count;
 }
 
@@ -1436,6 +1636,109 @@ gchar *dt_collection_get_makermodel(const char *exif_maker, const char *exif_mod
   return makermodel;
 }
 
+/* trigram index over the texts searched with LIKE '%...%', so that these don't scan whole tables. it lives
+ * on the connection (temp schema), is built on the first search and kept up to date by temp triggers.
+ * rowid = id * 32 + slot, the slot being the metadata key, 30 for tag names or 31 for filenames. */
+#define DT_TEXT_INDEX_TAG 30
+#define DT_TEXT_INDEX_FILENAME 31
+
+static gboolean _text_index_create(void)
+{
+  sqlite3 *db = dt_database_get(darktable.db);
+  // needs sqlite 3.34. the trigram tokenizer folds case by default, which lets LIKE use the index
+  if(sqlite3_exec(db, "CREATE VIRTUAL TABLE temp.dt_text_index USING fts5(value, tokenize='trigram')", NULL,
+                  NULL, NULL) != SQLITE_OK)
+  {
+    dt_print(DT_DEBUG_SQL, "[collection] no trigram index for text searches: %s\n", sqlite3_errmsg(db));
+    return FALSE;
+  }
+
+  const double start = dt_get_wtime();
+  dt_database_start_transaction(darktable.db);
+  DT_DEBUG_SQLITE3_EXEC(db, "INSERT OR REPLACE INTO temp.dt_text_index (rowid, value)"
+                            " SELECT id * 32 + key, value FROM main.meta_data",
+                        NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(db, "INSERT INTO temp.dt_text_index (rowid, value)"
+                            " SELECT id * 32 + 31, filename FROM main.images",
+                        NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(db, "INSERT INTO temp.dt_text_index (rowid, value)"
+                            " SELECT id * 32 + 30, name FROM data.tags",
+                        NULL, NULL, NULL);
+
+  // tables in trigger bodies can't be qualified, the temp schema comes first when looking them up
+  DT_DEBUG_SQLITE3_EXEC(db, "CREATE TEMP TRIGGER dt_text_index_meta_insert AFTER INSERT ON main.meta_data"
+                            " BEGIN"
+                            "  INSERT OR REPLACE INTO dt_text_index (rowid, value)"
+                            "   VALUES (new.id * 32 + new.key, new.value);"
+                            " END",
+                        NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(db, "CREATE TEMP TRIGGER dt_text_index_meta_update AFTER UPDATE ON main.meta_data"
+                            " BEGIN"
+                            "  DELETE FROM dt_text_index WHERE rowid = old.id * 32 + old.key;"
+                            "  INSERT OR REPLACE INTO dt_text_index (rowid, value)"
+                            "   VALUES (new.id * 32 + new.key, new.value);"
+                            " END",
+                        NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(db, "CREATE TEMP TRIGGER dt_text_index_meta_delete AFTER DELETE ON main.meta_data"
+                            " BEGIN"
+                            "  DELETE FROM dt_text_index WHERE rowid = old.id * 32 + old.key;"
+                            " END",
+                        NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(db, "CREATE TEMP TRIGGER dt_text_index_image_insert AFTER INSERT ON main.images"
+                            " BEGIN"
+                            "  INSERT OR REPLACE INTO dt_text_index (rowid, value)"
+                            "   VALUES (new.id * 32 + 31, new.filename);"
+                            " END",
+                        NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(db, "CREATE TEMP TRIGGER dt_text_index_image_update"
+                            " AFTER UPDATE OF filename ON main.images"
+                            " BEGIN"
+                            "  INSERT OR REPLACE INTO dt_text_index (rowid, value)"
+                            "   VALUES (new.id * 32 + 31, new.filename);"
+                            " END",
+                        NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(db, "CREATE TEMP TRIGGER dt_text_index_image_delete AFTER DELETE ON main.images"
+                            " BEGIN"
+                            "  DELETE FROM dt_text_index WHERE rowid >= old.id * 32 AND rowid < old.id * 32 + 32;"
+                            " END",
+                        NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(db, "CREATE TEMP TRIGGER dt_text_index_tag_insert AFTER INSERT ON data.tags"
+                            " BEGIN"
+                            "  INSERT OR REPLACE INTO dt_text_index (rowid, value)"
+                            "   VALUES (new.id * 32 + 30, new.name);"
+                            " END",
+                        NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(db, "CREATE TEMP TRIGGER dt_text_index_tag_update AFTER UPDATE OF name ON data.tags"
+                            " BEGIN"
+                            "  INSERT OR REPLACE INTO dt_text_index (rowid, value)"
+                            "   VALUES (new.id * 32 + 30, new.name);"
+                            " END",
+                        NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(db, "CREATE TEMP TRIGGER dt_text_index_tag_delete AFTER DELETE ON data.tags"
+                            " BEGIN"
+                            "  DELETE FROM dt_text_index WHERE rowid = old.id * 32 + 30;"
+                            " END",
+                        NULL, NULL, NULL);
+  dt_database_release_transaction(darktable.db);
+
+  dt_print(DT_DEBUG_SQL | DT_DEBUG_PERF, "[collection] text index built in %.3fs\n", dt_get_wtime() - start);
+  return TRUE;
+}
+
+static gboolean _text_index_ready(void)
+{
+  static gsize ready = 0;
+  if(g_once_init_enter(&ready)) g_once_init_leave(&ready, _text_index_create() ? 2 : 1);
+  return ready == 2;
+}
+
+// ids matching pattern in one slot of the text index, to be used as "x IN (...)"
+static gchar *_text_index_query(const int slot, const char *pattern)
+{
+  return g_strdup_printf("SELECT rowid / 32 FROM temp.dt_text_index WHERE value LIKE '%s' AND rowid %% 32 = %d",
+                         pattern, slot);
+}
+
 static gchar *get_query_string(const dt_collection_properties_t property, const gchar *text)
 {
   char *escaped_text = sqlite3_mprintf("%q", text);
@@ -1561,9 +1864,16 @@ static gchar *get_query_string(const dt_collection_properties_t property, const
       query = dt_util_dstrcat(query, ")");
       break;
     case DT_COLLECTION_PROP_TAG: // tag
-      query = dt_util_dstrcat(query, "(id IN (SELECT imgid FROM main.tagged_images AS a JOIN "
-                                     "data.tags AS b ON a.tagid = b.id WHERE name LIKE '%s'))",
-                              escaped_text);
+      if(_text_index_ready())
+      {
+        gchar *tags = _text_index_query(DT_TEXT_INDEX_TAG, escaped_text);
+        query = dt_util_dstrcat(query, "(id IN (SELECT imgid FROM main.tagged_images WHERE tagid IN (%s)))", tags);
+        g_free(tags);
+      }
+      else
+        query = dt_util_dstrcat(query, "(id IN (SELECT imgid FROM main.tagged_images AS a JOIN "
+                                       "data.tags AS b ON a.tagid = b.id WHERE name LIKE '%s'))",
+                                escaped_text);
       break;
 
     case DT_COLLECTION_PROP_LENS: // lens
@@ -1672,8 +1982,20 @@ static gchar *get_query_string(const dt_collection_properties_t property, const
       GList *list, *l;
       list = dt_util_str_to_glist(",", escaped_text);
 
+      const gboolean indexed = _text_index_ready();
       for (l = list; l != NULL; l = l->next)
-        l->data = dt_util_dstrcat(query, "(filename LIKE '%%%s%%')", (char *)l->data);
+      {
+        if(indexed)
+        {
+          gchar *pattern = g_strdup_printf("%%%s%%", (char *)l->data);
+          gchar *ids = _text_index_query(DT_TEXT_INDEX_FILENAME, pattern);
+          l->data = dt_util_dstrcat(query, "(id IN (%s))", ids);
+          g_free(ids);
+          g_free(pattern);
+        }
+        else
+          l->data = dt_util_dstrcat(query, "(filename LIKE '%%%s%%')", (char *)l->data);
+      }
 
       query = dt_util_glist_to_str(" OR ", list);
       g_list_free(list);
@@ -1785,7 +2107,15 @@ static gchar *get_query_string(const dt_collection_properties_t property, const
            && property < DT_COLLECTION_PROP_METADATA + DT_METADATA_NUMBER)
         {
           const int keyid = dt_metadata_get_keyid_by_display_order(property - DT_COLLECTION_PROP_METADATA);
-          if(strcmp(escaped_text, _("not defined")) != 0)
+          if(strcmp(escaped_text, _("not defined")) != 0 && _text_index_ready())
+          {
+            gchar *pattern = g_strdup_printf("%%%s%%", escaped_text);
+            gchar *ids = _text_index_query(keyid, pattern);
+            query = dt_util_dstrcat(query, "(id IN (%s))", ids);
+            g_free(ids);
+            g_free(pattern);
+          }
+          else if(strcmp(escaped_text, _("not defined")) != 0)
             query = dt_util_dstrcat(query, "(id IN (SELECT id FROM main.meta_data WHERE key = %d AND value "
                                            "LIKE '%%%s%%'))", keyid, escaped_text);
           else
@@ -1888,6 +2218,202 @@ void dt_collection_deserialize(char *buf)
   dt_collection_update_query(darktable.collection, DT_COLLECTION_CHANGE_NEW_QUERY, NULL);
 }
 
+/* the rules of the collect module evaluated to sets of image ids. every rule is read with one query over
+ * main.images into a bitmap indexed by image id, the bitmaps are combined the way SQL reads the extended where
+ * (NOT before AND before OR) and only the ids of the result which changed are written to
+ * memory.collection_filter. the queries of the collection then look that table up instead of evaluating all
+ * the rules for every image again, several times per update. */
+#define DT_COLLECTION_MAX_RULES 10
+
+static struct
+{
+  int num_rules;
+  gchar *rule[DT_COLLECTION_MAX_RULES]; // the condition of the rule, NULL if the rule is empty
+  int mode[DT_COLLECTION_MAX_RULES];    // 0: AND, 1: OR, 2: AND NOT
+  uint64_t *ids;                        // the ids in memory.collection_filter
+  size_t words;
+} _filter;
+
+// TRUE if the whole condition is one pair of parentheses, so that it can't mix with the other rules
+static gboolean _filter_rule_supported(const gchar *rule)
+{
+  if(rule[0] != '(') return FALSE;
+  int depth = 0;
+  gboolean quoted = FALSE;
+  for(const gchar *c = rule; *c; c++)
+  {
+    if(*c == '\'')
+      quoted = !quoted;
+    else if(!quoted && *c == '(')
+      depth++;
+    else if(!quoted && *c == ')' && --depth == 0 && c[1] != '\0')
+      return FALSE;
+  }
+  return depth == 0 && !quoted;
+}
+
+static void _filter_ids_query(uint64_t *ids, const size_t words, const gchar *query)
+{
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    const int64_t id = sqlite3_column_int64(stmt, 0);
+    if(id >= 0 && id < (int64_t)words * 64) ids[id / 64] |= (uint64_t)1 << (id % 64);
+  }
+  sqlite3_finalize(stmt);
+}
+
+static void _filter_write(const uint64_t *ids, const size_t words)
+{
+  sqlite3 *db = dt_database_get(darktable.db);
+  sqlite3_stmt *del_stmt, *ins_stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(db, "DELETE FROM memory.collection_filter WHERE id = ?1", -1, &del_stmt, NULL);
+  DT_DEBUG_SQLITE3_PREPARE_V2(db, "INSERT OR IGNORE INTO memory.collection_filter (id) VALUES (?1)", -1,
+                              &ins_stmt, NULL);
+
+  dt_database_start_transaction(darktable.db);
+  const size_t all_words = MAX(words, _filter.words);
+  for(size_t w = 0; w < all_words; w++)
+  {
+    const uint64_t now = w < words ? ids[w] : 0;
+    const uint64_t before = w < _filter.words ? _filter.ids[w] : 0;
+    uint64_t changed = now ^ before;
+    while(changed)
+    {
+      const int bit = __builtin_ctzll(changed);
+      changed &= changed - 1;
+      sqlite3_stmt *stmt = (now >> bit) & 1 ? ins_stmt : del_stmt;
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, (int)(w * 64 + bit));
+      sqlite3_step(stmt);
+      sqlite3_reset(stmt);
+      sqlite3_clear_bindings(stmt);
+    }
+  }
+  dt_database_release_transaction(darktable.db);
+
+  sqlite3_finalize(del_stmt);
+  sqlite3_finalize(ins_stmt);
+}
+
+// evaluates the rules again for the images of list, or for all images if list is NULL. returns FALSE if there
+// is no filter.
+static gboolean _filter_refresh(GList *list)
+{
+  if(!_filter.num_rules) return FALSE;
+
+  const double start = dt_get_wtime();
+  sqlite3_stmt *stmt;
+  int64_t max_id = 0;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT MAX(id) FROM main.images", -1, &stmt, NULL);
+  if(sqlite3_step(stmt) == SQLITE_ROW) max_id = sqlite3_column_int64(stmt, 0);
+  sqlite3_finalize(stmt);
+
+  const size_t words = MAX(max_id / 64 + 1, _filter.words);
+  uint64_t *all = calloc(words, sizeof(uint64_t));
+  uint64_t *group = calloc(words, sizeof(uint64_t));
+  uint64_t *rule = calloc(words, sizeof(uint64_t));
+  uint64_t *result = calloc(words, sizeof(uint64_t));
+
+  // only the images of list are looked at, the others keep their state
+  gchar *only = NULL;
+  if(list)
+  {
+    GString *ids = g_string_new(NULL);
+    for(GList *l = list; l; l = g_list_next(l))
+    {
+      const int id = GPOINTER_TO_INT(l->data);
+      g_string_append_printf(ids, "%s%d", l == list ? "" : ",", id);
+      if(id >= 0 && id < (int64_t)words * 64) rule[id / 64] |= (uint64_t)1 << (id % 64);
+    }
+    only = g_strdup_printf("id IN (%s) AND ", ids->str);
+    g_string_free(ids, TRUE);
+    for(size_t w = 0; w < _filter.words; w++) result[w] = _filter.ids[w] & ~rule[w];
+  }
+
+  gchar *query = only ? g_strdup_printf("SELECT id FROM main.images WHERE %s1", only)
+                      : g_strdup("SELECT id FROM main.images");
+  _filter_ids_query(all, words, query);
+  g_free(query);
+  memcpy(group, all, words * sizeof(uint64_t));
+
+  // the AND of the rules since the last OR is in group, the OR of the groups before in result
+  for(int i = 0; i < _filter.num_rules; i++)
+  {
+    const int mode = _filter.mode[i];
+    if(!_filter.rule[i])
+    {
+      // an empty rule is left out, or is " OR 1=1"
+      if(mode == 1)
+      {
+        for(size_t w = 0; w < words; w++) result[w] |= group[w];
+        memcpy(group, all, words * sizeof(uint64_t));
+      }
+      continue;
+    }
+
+    // NOT is taken by SQL, so that unknown values are left out as with the full query
+    memset(rule, 0, words * sizeof(uint64_t));
+    query = g_strdup_printf("SELECT id FROM main.images WHERE %s%s%s", only ? only : "", mode == 2 ? "NOT " : "",
+                            _filter.rule[i]);
+    _filter_ids_query(rule, words, query);
+    g_free(query);
+
+    if(mode == 1)
+    {
+      for(size_t w = 0; w < words; w++) result[w] |= group[w];
+      memcpy(group, rule, words * sizeof(uint64_t));
+    }
+    else
+      for(size_t w = 0; w < words; w++) group[w] &= rule[w];
+  }
+  for(size_t w = 0; w < words; w++) result[w] |= group[w];
+
+  _filter_write(result, words);
+  free(_filter.ids);
+  _filter.ids = result;
+  _filter.words = words;
+
+  free(all);
+  free(group);
+  free(rule);
+  g_free(only);
+
+  dt_print(DT_DEBUG_SQL | DT_DEBUG_PERF, "[collection] %d rules evaluated for %s in %.3fs\n", _filter.num_rules,
+           list ? "changed images" : "all images", dt_get_wtime() - start);
+  return TRUE;
+}
+
+// takes the rules of the collect module and evaluates them, only for the images of list if the rules are the
+// same as before. returns FALSE, and keeps no filter, if one of the rules can't be taken apart from the others
+// or if there is nothing to filter.
+static gboolean _filter_set_rules(const int num_rules, gchar **rules, const int *modes, GList *list)
+{
+  gboolean same = (num_rules == _filter.num_rules);
+  for(int i = 0; i < num_rules && same; i++)
+    same = !g_strcmp0(rules[i], _filter.rule[i]) && modes[i] == _filter.mode[i];
+  if(same && list && g_list_length(list) <= DT_COLLECTION_MAX_INCREMENTAL) return _filter_refresh(list);
+
+  for(int i = 0; i < _filter.num_rules; i++) g_free(_filter.rule[i]);
+  _filter.num_rules = 0;
+
+  gboolean any = FALSE;
+  for(int i = 0; i < num_rules; i++)
+  {
+    if(rules[i] && !_filter_rule_supported(rules[i])) return FALSE;
+    if(rules[i] || modes[i] == 1) any = TRUE;
+  }
+  if(!any) return FALSE;
+
+  for(int i = 0; i < num_rules; i++)
+  {
+    _filter.rule[i] = g_strdup(rules[i]);
+    _filter.mode[i] = modes[i];
+  }
+  _filter.num_rules = num_rules;
+  return _filter_refresh(NULL);
+}
+
 void dt_collection_update_query(const dt_collection_t *collection, dt_collection_change_t query_change, GList *list)
 {
   int next = -1;
@@ -1932,11 +2458,13 @@ void dt_collection_update_query(const dt_collection_t *collection, dt_collection
   char confname[200];
 
   const int _n_r = dt_conf_get_int("plugins/lighttable/collect/num_rules");
-  const int num_rules = CLAMP(_n_r, 1, 10);
+  const int num_rules = CLAMP(_n_r, 1, DT_COLLECTION_MAX_RULES);
   char *conj[] = { "AND", "OR", "AND NOT" };
 
   gchar **query_parts = g_new (gchar*, num_rules + 1);
   query_parts[num_rules] =  NULL;
+  gchar *rules[DT_COLLECTION_MAX_RULES] = { NULL };
+  int modes[DT_COLLECTION_MAX_RULES] = { 0 };
 
   for(int i = 0; i < num_rules; i++)
   {
@@ -1946,6 +2474,7 @@ void dt_collection_update_query(const dt_collection_t *collection, dt_collection
     gchar *text = dt_conf_get_string(confname);
     snprintf(confname, sizeof(confname), "plugins/lighttable/collect/mode%1d", i);
     const int mode = dt_conf_get_int(confname);
+    modes[i] = mode;
 
     if(!text || text[0] == '\0')
     {
@@ -1960,7 +2489,7 @@ void dt_collection_update_query(const dt_collection_t *collection, dt_collection
 
       query_parts[i] =  g_strdup_printf(" %s %s", conj[mode], query);
 
-      g_free(query);
+      rules[i] = g_strstrip(query);
     }
     g_free(text);
   }
@@ -1969,6 +2498,9 @@ void dt_collection_update_query(const dt_collection_t *collection, dt_collection
   /* set the extended where and the use of it in the query */
   dt_collection_set_extended_where(collection, query_parts);
   g_strfreev(query_parts);
+  if(!collection->clone)
+    ((dt_collection_t *)collection)->filtered = _filter_set_rules(num_rules, rules, modes, list);
+  for(int i = 0; i < num_rules; i++) g_free(rules[i]);
   dt_collection_set_query_flags(collection,
                                 (dt_collection_get_query_flags(collection) | COLLECTION_QUERY_USE_WHERE_EXT));
 
@@ -1977,7 +2509,28 @@ void dt_collection_update_query(const dt_collection_t *collection, dt_collection
                                  (dt_collection_get_filter_flags(collection) & ~COLLECTION_FILTER_FILM_ID));
 
   /* update query and at last the visual */
-  dt_collection_update(collection);
+  gchar *old_query = g_strdup(collection->query);
+  _collection_update(collection, FALSE);
+
+  // after edits of a few images the query stays the same and only these images need a look
+  if(!collection->clone && query_change == DT_COLLECTION_CHANGE_RELOAD && !g_strcmp0(old_query, collection->query)
+     && _collection_memory_update_images(collection, list))
+  {
+    g_free(old_query);
+    sqlite3_stmt *stmt = NULL;
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT COUNT(*) FROM memory.collected_images", -1,
+                                &stmt, NULL);
+    if(sqlite3_step(stmt) == SQLITE_ROW) ((dt_collection_t *)collection)->count = sqlite3_column_int(stmt, 0);
+    sqlite3_finalize(stmt);
+    ((dt_collection_t *)collection)->count_no_group
+        = (darktable.gui && darktable.gui->grouping) ? _dt_collection_compute_count(collection, TRUE)
+                                                     : collection->count;
+    dt_collection_hint_message(collection);
+    dt_control_signal_raise(darktable.signals, DT_SIGNAL_COLLECTION_CHANGED, query_change, list, next);
+    return;
+  }
+  g_free(old_query);
+  _collection_recount(collection);
 
   // remove from selected images where not in this query.
   sqlite3_stmt *stmt = NULL;
@@ -2093,6 +2646,8 @@ int dt_collection_image_offset(int imgid)
 static void _dt_collection_recount_callback_1(gpointer instance, gpointer user_data)
 {
   dt_collection_t *collection = (dt_collection_t *)user_data;
+  // images or tags changed, the clones follow the filter of the original
+  if(collection->filtered && !collection->clone) _filter_refresh(NULL);
   int old_count = collection->count;
   collection->count = _dt_collection_compute_count(collection, FALSE);
   collection->count_no_group = _dt_collection_compute_count(collection, TRUE);
@@ -2217,7 +2772,7 @@ void dt_collection_move_before(const int32_t image_id, GList * selected_images)
     dt_collection_shift_image_positions(selected_images_length, target_image_pos, tagid);
 
     sqlite3_stmt *stmt = NULL;
-    DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "BEGIN", NULL, NULL, NULL);
+    dt_database_start_transaction(darktable.db);
 
     // move images to their intended positions
     int64_t new_image_pos = target_image_pos;
@@ -2248,7 +2803,7 @@ void dt_collection_move_before(const int32_t image_id, GList * selected_images)
       new_image_pos++;
     }
     sqlite3_finalize(stmt);
-    DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+    dt_database_release_transaction(darktable.db);
   }
   else
   {
@@ -2275,7 +2830,7 @@ void dt_collection_move_before(const int32_t image_id, GList * selected_images)
     sqlite3_finalize(stmt);
     sqlite3_stmt *update_stmt = NULL;
 
-    DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "BEGIN", NULL, NULL, NULL);
+    dt_database_start_transaction(darktable.db);
 
     // move images to last position in custom image order table
     DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
@@ -2304,7 +2859,7 @@ void dt_collection_move_before(const int32_t image_id, GList * selected_images)
     }
 
     sqlite3_finalize(update_stmt);
-    DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+    dt_database_release_transaction(darktable.db);
   }
 }
 
@@ -162,7 +162,11 @@ typedef struct dt_collection_t
 {
   int clone;
   gchar *query, *query_no_group;
+  // the query restricted to a list of image ids, which goes between the two parts
+  gchar *subset_pre, *subset_pre_no_group, *subset_post;
   gchar **where_ext;
+  // the extended where has been evaluated to memory.collection_filter
+  gboolean filtered;
   unsigned int count, count_no_group;
   unsigned int tagid;
   dt_collection_params_t params;
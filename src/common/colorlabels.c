@@ -52,19 +52,7 @@ int dt_colorlabels_get_labels(const int imgid)
   return colors;
 }
 
-static void _pop_undo_execute(const int imgid, const uint8_t before, const uint8_t after)
-{
-  for(int color=0; color<5; color++)
-  {
-    if(after & (1<<color))
-    {
-      if (!(before & (1<<color)))
-        dt_colorlabels_set_label(imgid, color);
-    }
-    else if (before & (1<<color))
-      dt_colorlabels_remove_label(imgid, color);
-  }
-}
+static void _colorlabels_apply_changes(GList *changes, const gboolean undo);
 
 static void _pop_undo(gpointer user_data, dt_undo_type_t type, dt_undo_data_t data, dt_undo_action_t action, GList **imgs)
 {
@@ -72,13 +60,11 @@ static void _pop_undo(gpointer user_data, dt_undo_type_t type, dt_undo_data_t da
   {
     GList *list = (GList *)data;
 
+    _colorlabels_apply_changes(list, action == DT_ACTION_UNDO);
+
     while(list)
     {
       dt_undo_colorlabels_t *undocolorlabels = (dt_undo_colorlabels_t *)list->data;
-
-      const uint8_t before = (action == DT_ACTION_UNDO) ? undocolorlabels->after : undocolorlabels->before;
-      const uint8_t after = (action == DT_ACTION_UNDO) ? undocolorlabels->before : undocolorlabels->after;
-      _pop_undo_execute(undocolorlabels->imgid, before, after);
       *imgs = g_list_prepend(*imgs, GINT_TO_POINTER(undocolorlabels->imgid));
       list = g_list_next(list);
     }
@@ -89,7 +75,7 @@ static void _pop_undo(gpointer user_data, dt_undo_type_t type, dt_undo_data_t da
 static void _colorlabels_undo_data_free(gpointer data)
 {
   GList *l = (GList *)data;
-  g_list_free(l);
+  g_list_free_full(l, free);
 }
 
 void dt_colorlabels_remove_labels(const int imgid)
@@ -133,13 +119,110 @@ typedef enum dt_colorlabels_actions_t
 
 
 
+// puts the images of the list into memory.color_labels_temp, for the set based statements below
+static void _colorlabels_stage(const GList *imgs)
+{
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "DELETE FROM memory.color_labels_temp", NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "INSERT OR IGNORE INTO memory.color_labels_temp (imgid) VALUES (?1)", -1, &stmt,
+                              NULL);
+  for(const GList *l = imgs; l; l = g_list_next(l))
+  {
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, GPOINTER_TO_INT(l->data));
+    sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+  }
+  sqlite3_finalize(stmt);
+}
+
+// removes the labels of the mask remove from all staged images and adds those of the mask add
+static void _colorlabels_apply_staged(const uint8_t remove, const uint8_t add)
+{
+  sqlite3_stmt *stmt;
+  if(remove)
+  {
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                                "DELETE FROM main.color_labels"
+                                " WHERE imgid IN (SELECT imgid FROM memory.color_labels_temp)"
+                                "   AND ((1 << color) & ?1) != 0",
+                                -1, &stmt, NULL);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, remove);
+    sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+  }
+  if(add)
+  {
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                                "INSERT OR IGNORE INTO main.color_labels (imgid, color)"
+                                " SELECT imgid, ?1 FROM memory.color_labels_temp",
+                                -1, &stmt, NULL);
+    for(int color = 0; color < DT_COLORLABELS_LAST; color++)
+    {
+      if(!(add & (1<<color))) continue;
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, color);
+      sqlite3_step(stmt);
+      sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+  }
+}
+
+// applies a list of dt_undo_colorlabels_t, backwards for undo. all the images which lose and gain the same
+// labels are changed by the same statements.
+static void _colorlabels_apply_changes(GList *changes, const gboolean undo)
+{
+  GHashTable *groups = g_hash_table_new(NULL, NULL);
+  for(GList *l = changes; l; l = g_list_next(l))
+  {
+    const dt_undo_colorlabels_t *change = (dt_undo_colorlabels_t *)l->data;
+    const uint8_t before = undo ? change->after : change->before;
+    const uint8_t after = undo ? change->before : change->after;
+    if(before == after) continue;
+    const int key = ((before & ~after) << 8) | (after & ~before);
+    GList *imgs = (GList *)g_hash_table_lookup(groups, GINT_TO_POINTER(key));
+    g_hash_table_insert(groups, GINT_TO_POINTER(key), g_list_prepend(imgs, GINT_TO_POINTER(change->imgid)));
+  }
+
+  dt_database_start_transaction(darktable.db);
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, groups);
+  while(g_hash_table_iter_next(&iter, &key, &value))
+  {
+    _colorlabels_stage((GList *)value);
+    _colorlabels_apply_staged(GPOINTER_TO_INT(key) >> 8, GPOINTER_TO_INT(key) & 0xff);
+    g_list_free((GList *)value);
+  }
+  dt_database_release_transaction(darktable.db);
+
+  g_hash_table_destroy(groups);
+}
+
 static void _colorlabels_execute(const GList *imgs, const int labels, GList **undo, const gboolean undo_on, const int action)
 {
-  GList *images = (GList *)imgs;
-  while(images)
+  // the labels of all the images before, with one query
+  GHashTable *labels_before = g_hash_table_new(NULL, NULL);
+  _colorlabels_stage(imgs);
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT imgid, color FROM main.color_labels"
+                              " WHERE imgid IN (SELECT imgid FROM memory.color_labels_temp)",
+                              -1, &stmt, NULL);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    const int imgid = sqlite3_column_int(stmt, 0);
+    const int colors = GPOINTER_TO_INT(g_hash_table_lookup(labels_before, GINT_TO_POINTER(imgid)));
+    g_hash_table_insert(labels_before, GINT_TO_POINTER(imgid),
+                        GINT_TO_POINTER(colors | (1<<sqlite3_column_int(stmt, 1))));
+  }
+  sqlite3_finalize(stmt);
+
+  GList *changes = NULL;
+  for(const GList *images = imgs; images; images = g_list_next(images))
   {
     const int image_id = GPOINTER_TO_INT(images->data);
-    const uint8_t before = dt_colorlabels_get_labels(image_id);
+    const uint8_t before = GPOINTER_TO_INT(g_hash_table_lookup(labels_before, GINT_TO_POINTER(image_id)));
     uint8_t after = 0;
     switch(action)
     {
@@ -157,19 +240,21 @@ static void _colorlabels_execute(const GList *imgs, const int labels, GList **un
         break;
     }
 
-    if(undo_on)
-    {
-      dt_undo_colorlabels_t *undocolorlabels = (dt_undo_colorlabels_t *)malloc(sizeof(dt_undo_colorlabels_t));
-      undocolorlabels->imgid = image_id;
-      undocolorlabels->before = before;
-      undocolorlabels->after = after;
-      *undo = g_list_append(*undo, undocolorlabels);
-    }
+    dt_undo_colorlabels_t *undocolorlabels = (dt_undo_colorlabels_t *)malloc(sizeof(dt_undo_colorlabels_t));
+    undocolorlabels->imgid = image_id;
+    undocolorlabels->before = before;
+    undocolorlabels->after = after;
+    changes = g_list_prepend(changes, undocolorlabels);
+  }
+  g_hash_table_destroy(labels_before);
+  changes = g_list_reverse(changes);
 
-    _pop_undo_execute(image_id, before, after);
+  _colorlabels_apply_changes(changes, FALSE);
 
-    images = g_list_next(images);
-  }
+  if(undo_on)
+    *undo = g_list_concat(*undo, changes);
+  else
+    g_list_free_full(changes, free);
 }
 
 void dt_colorlabels_set_labels(const GList *img, const int labels, const gboolean clear_on,
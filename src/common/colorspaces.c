@@ -261,16 +261,130 @@ static int dt_colorspaces_get_matrix_from_profile(cmsHPROFILE prof, float *matri
   return 0;
 }
 
+// md5 of the serialised profile, the same for all copies of a profile
+static gboolean _profile_digest(cmsHPROFILE profile, guint8 *digest)
+{
+  cmsUInt32Number size = 0;
+  if(!profile || !cmsSaveProfileToMem(profile, NULL, &size) || size == 0) return FALSE;
+
+  void *data = malloc(size);
+  const gboolean res = data && cmsSaveProfileToMem(profile, data, &size);
+  if(res)
+  {
+    GChecksum *checksum = g_checksum_new(G_CHECKSUM_MD5);
+    g_checksum_update(checksum, data, size);
+    gsize len = 16;
+    g_checksum_get_digest(checksum, digest, &len);
+    g_checksum_free(checksum);
+  }
+  free(data);
+  return res;
+}
+
+// the number of matrices and tone curves dt_colorspaces_get_matrix_from_*_profile() keeps around
+#define DT_COLORSPACES_MATRICES 8
+
+typedef struct dt_colorspaces_matrix_t
+{
+  guint8 digest[16];
+  int input;
+  int intent;
+  int lutsize;
+  float matrix[9];
+  float *lut; // red, green and blue, lutsize each
+  uint64_t age;
+} dt_colorspaces_matrix_t;
+
+// dt_colorspaces_get_matrix_from_profile() for profiles we have seen before. sampling the tone curves is what
+// takes the time, the modules ask again on every commit of their parameters and for every pipe.
+static int _get_cached_matrix_from_profile(cmsHPROFILE prof, float *matrix, float *lutr, float *lutg,
+                                           float *lutb, const int lutsize, const int input, const int intent)
+{
+  dt_colorspaces_t *self = darktable.color_profiles;
+  guint8 digest[16];
+
+  // profiles which can't be handled are rejected quickly, no need to remember them
+  if(!self || lutsize < 1 || !prof || !cmsIsMatrixShaper(prof)
+     || cmsIsCLUT(prof, intent, input ? LCMS_USED_AS_INPUT : LCMS_USED_AS_OUTPUT) || !_profile_digest(prof, digest))
+    return dt_colorspaces_get_matrix_from_profile(prof, matrix, lutr, lutg, lutb, lutsize, input, intent);
+
+  float *const luts[3] = { lutr, lutg, lutb };
+
+  dt_pthread_mutex_lock(&self->cache_lock);
+  for(GList *iter = self->matrices; iter; iter = g_list_next(iter))
+  {
+    dt_colorspaces_matrix_t *m = (dt_colorspaces_matrix_t *)iter->data;
+    if(!memcmp(m->digest, digest, sizeof(digest)) && m->input == input && m->intent == intent
+       && m->lutsize == lutsize)
+    {
+      memcpy(matrix, m->matrix, sizeof(m->matrix));
+      for(int c = 0; c < 3; c++)
+      {
+        // linear curves are marked in the first entry only
+        const float *const lut = m->lut + (size_t)c * lutsize;
+        if(lut[0] < 0.0f)
+          luts[c][0] = -1.0f;
+        else
+          memcpy(luts[c], lut, sizeof(float) * lutsize);
+      }
+      m->age = ++self->cache_age;
+      dt_pthread_mutex_unlock(&self->cache_lock);
+      return 0;
+    }
+  }
+  dt_pthread_mutex_unlock(&self->cache_lock);
+
+  const int res = dt_colorspaces_get_matrix_from_profile(prof, matrix, lutr, lutg, lutb, lutsize, input, intent);
+  if(res) return res;
+
+  float *lut = malloc(sizeof(float) * 3 * lutsize);
+  if(!lut) return res;
+  for(int c = 0; c < 3; c++)
+  {
+    if(luts[c][0] < 0.0f)
+      lut[(size_t)c * lutsize] = -1.0f;
+    else
+      memcpy(lut + (size_t)c * lutsize, luts[c], sizeof(float) * lutsize);
+  }
+
+  dt_pthread_mutex_lock(&self->cache_lock);
+  dt_colorspaces_matrix_t *m = NULL;
+  if(g_list_length(self->matrices) < DT_COLORSPACES_MATRICES)
+  {
+    m = (dt_colorspaces_matrix_t *)calloc(1, sizeof(dt_colorspaces_matrix_t));
+    self->matrices = g_list_prepend(self->matrices, m);
+  }
+  else
+  {
+    for(GList *iter = self->matrices; iter; iter = g_list_next(iter))
+    {
+      dt_colorspaces_matrix_t *u = (dt_colorspaces_matrix_t *)iter->data;
+      if(!m || u->age < m->age) m = u;
+    }
+    free(m->lut);
+  }
+  memcpy(m->digest, digest, sizeof(digest));
+  m->input = input;
+  m->intent = intent;
+  m->lutsize = lutsize;
+  memcpy(m->matrix, matrix, sizeof(m->matrix));
+  m->lut = lut;
+  m->age = ++self->cache_age;
+  dt_pthread_mutex_unlock(&self->cache_lock);
+
+  return res;
+}
+
 int dt_colorspaces_get_matrix_from_input_profile(cmsHPROFILE prof, float *matrix, float *lutr, float *lutg,
                                                  float *lutb, const int lutsize, const int intent)
 {
-  return dt_colorspaces_get_matrix_from_profile(prof, matrix, lutr, lutg, lutb, lutsize, 1, intent);
+  return _get_cached_matrix_from_profile(prof, matrix, lutr, lutg, lutb, lutsize, 1, intent);
 }
 
 int dt_colorspaces_get_matrix_from_output_profile(cmsHPROFILE prof, float *matrix, float *lutr, float *lutg,
                                                   float *lutb, const int lutsize, const int intent)
 {
-  return dt_colorspaces_get_matrix_from_profile(prof, matrix, lutr, lutg, lutb, lutsize, 0, intent);
+  return _get_cached_matrix_from_profile(prof, matrix, lutr, lutg, lutb, lutsize, 0, intent);
 }
 
 static cmsHPROFILE dt_colorspaces_create_lab_profile()
@@ -1207,6 +1321,131 @@ void dt_colorspaces_update_display2_transforms()
   _update_display2_transforms(darktable.color_profiles);
 }
 
+// the number of transforms dt_colorspaces_get_transform() keeps around
+#define DT_COLORSPACES_TRANSFORMS 16
+
+typedef struct dt_colorspaces_transform_t
+{
+  guint8 input[16]; // digests of the profiles
+  cmsUInt32Number input_format;
+  guint8 output[16];
+  cmsUInt32Number output_format;
+  int intent;
+  cmsHTRANSFORM xform;
+  int users;
+  uint64_t age;
+} dt_colorspaces_transform_t;
+
+static dt_colorspaces_transform_t *_find_transform(dt_colorspaces_t *self, const guint8 *input,
+                                                   cmsUInt32Number input_format, const guint8 *output,
+                                                   cmsUInt32Number output_format, int intent)
+{
+  for(GList *iter = self->transforms; iter; iter = g_list_next(iter))
+  {
+    dt_colorspaces_transform_t *t = (dt_colorspaces_transform_t *)iter->data;
+    if(!memcmp(t->input, input, sizeof(t->input)) && t->input_format == input_format
+       && !memcmp(t->output, output, sizeof(t->output)) && t->output_format == output_format
+       && t->intent == intent)
+      return t;
+  }
+  return NULL;
+}
+
+cmsHTRANSFORM dt_colorspaces_get_transform(cmsHPROFILE input, cmsUInt32Number input_format, cmsHPROFILE output,
+                                           cmsUInt32Number output_format, int intent)
+{
+  dt_colorspaces_t *self = darktable.color_profiles;
+  if(!input || !output) return NULL;
+
+  // the profiles are keyed by their content, so the private copies of the modules share transforms as well
+  // and a profile can go away without taking its transforms along
+  guint8 input_digest[16], output_digest[16];
+  if(!_profile_digest(input, input_digest) || !_profile_digest(output, output_digest))
+    return cmsCreateTransform(input, input_format, output, output_format, intent, 0);
+
+  dt_pthread_mutex_lock(&self->cache_lock);
+  dt_colorspaces_transform_t *t
+      = _find_transform(self, input_digest, input_format, output_digest, output_format, intent);
+  if(t)
+  {
+    t->users++;
+    t->age = ++self->cache_age;
+    dt_pthread_mutex_unlock(&self->cache_lock);
+    return t->xform;
+  }
+  dt_pthread_mutex_unlock(&self->cache_lock);
+
+  // creating a transform takes a while, don't block the others meanwhile
+  cmsHTRANSFORM xform = cmsCreateTransform(input, input_format, output, output_format, intent, 0);
+  if(!xform) return NULL;
+
+  dt_pthread_mutex_lock(&self->cache_lock);
+  t = _find_transform(self, input_digest, input_format, output_digest, output_format, intent);
+  if(t)
+  {
+    // someone else was faster
+    cmsDeleteTransform(xform);
+    t->users++;
+    t->age = ++self->cache_age;
+    xform = t->xform;
+  }
+  else
+  {
+    // take a new entry while there is room, else the oldest unused one. if all are in use the transform stays
+    // private and is deleted on release.
+    if(g_list_length(self->transforms) < DT_COLORSPACES_TRANSFORMS)
+    {
+      t = (dt_colorspaces_transform_t *)calloc(1, sizeof(dt_colorspaces_transform_t));
+      self->transforms = g_list_prepend(self->transforms, t);
+    }
+    else
+    {
+      for(GList *iter = self->transforms; iter; iter = g_list_next(iter))
+      {
+        dt_colorspaces_transform_t *u = (dt_colorspaces_transform_t *)iter->data;
+        if(u->users == 0 && (!t || u->age < t->age)) t = u;
+      }
+      if(t) cmsDeleteTransform(t->xform);
+    }
+    if(t)
+    {
+      memcpy(t->input, input_digest, sizeof(t->input));
+      t->input_format = input_format;
+      memcpy(t->output, output_digest, sizeof(t->output));
+      t->output_format = output_format;
+      t->intent = intent;
+      t->xform = xform;
+      t->users = 1;
+      t->age = ++self->cache_age;
+    }
+  }
+  dt_pthread_mutex_unlock(&self->cache_lock);
+
+  return xform;
+}
+
+void dt_colorspaces_release_transform(cmsHTRANSFORM xform)
+{
+  dt_colorspaces_t *self = darktable.color_profiles;
+  if(!xform) return;
+
+  dt_pthread_mutex_lock(&self->cache_lock);
+  for(GList *iter = self->transforms; iter; iter = g_list_next(iter))
+  {
+    dt_colorspaces_transform_t *t = (dt_colorspaces_transform_t *)iter->data;
+    if(t->xform == xform && t->users > 0)
+    {
+      t->users--;
+      dt_pthread_mutex_unlock(&self->cache_lock);
+      return;
+    }
+  }
+  dt_pthread_mutex_unlock(&self->cache_lock);
+
+  // not in the cache
+  cmsDeleteTransform(xform);
+}
+
 // make sure that darktable.color_profiles->xprofile_lock is held when calling this!
 static void _update_display_profile(guchar *tmp_data, gsize size, char *name, size_t name_size)
 {
@@ -1368,6 +1607,7 @@ dt_colorspaces_t *dt_colorspaces_init()
   _compute_prequantized_primaries(&D65xyY, &Rec709_Primaries, &Rec709_Primaries_Prequantized);
 
   pthread_rwlock_init(&res->xprofile_lock, NULL);
+  dt_pthread_mutex_init(&res->cache_lock, NULL);
 
   int in_pos = -1,
       out_pos = -1,
@@ -1573,6 +1813,14 @@ void dt_colorspaces_cleanup(dt_colorspaces_t *self)
   if(self->transform_adobe_rgb_to_display2) cmsDeleteTransform(self->transform_adobe_rgb_to_display2);
   self->transform_adobe_rgb_to_display2 = NULL;
 
+  for(GList *iter = self->transforms; iter; iter = g_list_next(iter))
+    cmsDeleteTransform(((dt_colorspaces_transform_t *)iter->data)->xform);
+  g_list_free_full(self->transforms, free);
+  for(GList *iter = self->matrices; iter; iter = g_list_next(iter))
+    free(((dt_colorspaces_matrix_t *)iter->data)->lut);
+  g_list_free_full(self->matrices, free);
+  dt_pthread_mutex_destroy(&self->cache_lock);
+
   for(GList *iter = self->profiles; iter; iter = g_list_next(iter))
   {
     dt_colorspaces_color_profile_t *p = (dt_colorspaces_color_profile_t *)iter->data;
@@ -133,6 +133,13 @@ typedef struct dt_colorspaces_t
   cmsHTRANSFORM transform_srgb_to_display, transform_adobe_rgb_to_display;
   cmsHTRANSFORM transform_srgb_to_display2, transform_adobe_rgb_to_display2;
 
+  // transforms shared by dt_colorspaces_get_transform() and the matrices and tone curves of the matrix
+  // profiles seen by dt_colorspaces_get_matrix_from_*_profile()
+  dt_pthread_mutex_t cache_lock;
+  GList *transforms;
+  GList *matrices;
+  uint64_t cache_age;
+
 } dt_colorspaces_t;
 
 typedef struct dt_colorspaces_color_profile_t
@@ -219,6 +226,14 @@ dt_colorspaces_get_profile(dt_colorspaces_color_profile_type_t type, const char
  *  or just a base name */
 gboolean  dt_colorspaces_is_profile_equal(const char *fullname, const char *filename);
 
+/** like cmsCreateTransform() without flags, but the transform is shared with all other users of profiles
+ *  with the same content, formats and intent and kept around for them. don't delete it but hand it back with
+ *  dt_colorspaces_release_transform(). */
+cmsHTRANSFORM dt_colorspaces_get_transform(cmsHPROFILE input, cmsUInt32Number input_format, cmsHPROFILE output,
+                                           cmsUInt32Number output_format, int intent);
+/** release a transform of dt_colorspaces_get_transform() */
+void dt_colorspaces_release_transform(cmsHTRANSFORM xform);
+
 /** update the display transforms of srgb and adobergb to the display profile.
  * make sure that darktable.color_profiles->xprofile_lock is held when calling this! */
 void dt_colorspaces_update_display_transforms();
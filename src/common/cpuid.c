@@ -35,6 +35,14 @@
 #endif
 
 #if defined(HAVE___GET_GPUID)
+// which register sets the os saves on context switches
+static guint32 _xgetbv(void)
+{
+  guint32 lo, hi;
+  __asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+  return lo;
+}
+
 dt_cpu_flags_t dt_detect_cpu_features()
 {
   guint32 ax, bx, cx, dx;
@@ -44,6 +52,9 @@ dt_cpu_flags_t dt_detect_cpu_features()
   g_mutex_lock(&lock);
   if(__get_cpuid(0x00000000,&ax,&bx,&cx,&dx))
   {
+    const guint32 max_level = ax;
+    guint32 xcr0 = 0;
+
     /* Request for standard features */
     if(__get_cpuid(0x00000001,&ax,&bx,&cx,&dx))
     {
@@ -57,7 +68,21 @@ dt_cpu_flags_t dt_detect_cpu_features()
       if(cx & 0x00040000) cpuflags |= CPU_FLAG_SSE4_1;
       if(cx & 0x00080000) cpuflags |= CPU_FLAG_SSE4_2;
 
-      if(cx & 0x08000000) cpuflags |= CPU_FLAG_AVX;
+      // ymm and zmm registers need os support
+      if(cx & 0x08000000) xcr0 = _xgetbv();
+      if((cx & 0x10000000) && (xcr0 & 0x06) == 0x06)
+      {
+        cpuflags |= CPU_FLAG_AVX;
+        if(cx & 0x00001000) cpuflags |= CPU_FLAG_FMA;
+      }
+    }
+
+    /* Structured extended features */
+    if(max_level >= 7 && (cpuflags & CPU_FLAG_AVX))
+    {
+      __cpuid_count(7, 0, ax, bx, cx, dx);
+      if(bx & 0x00000020) cpuflags |= CPU_FLAG_AVX2;
+      if((bx & 0x00010000) && (xcr0 & 0xe6) == 0xe6) cpuflags |= CPU_FLAG_AVX512F;
     }
 
     /* Are there extensions? */
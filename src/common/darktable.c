@@ -35,6 +35,7 @@
 #include "common/pwstorage/pwstorage.h"
 #include "common/selection.h"
 #include "common/system_signal_handling.h"
+#include "common/trace.h"
 #ifdef HAVE_GPHOTO2
 #include "common/camera_control.h"
 #endif
@@ -42,17 +43,23 @@
 #include "common/cpuid.h"
 #include "common/file_location.h"
 #include "common/film.h"
+#include "common/focus_peaking.h"
 #include "common/grealpath.h"
 #include "common/image.h"
 #include "common/image_cache.h"
 #include "common/imageio_module.h"
+#include "common/interpolation.h"
 #include "common/iop_order.h"
 #include "common/l10n.h"
+#include "common/memory_accounting.h"
+#include "common/memory_governor.h"
+#include "common/metrics.h"
 #include "common/mipmap_cache.h"
 #include "common/noiseprofiles.h"
 #include "common/opencl.h"
 #include "common/points.h"
 #include "common/resource_limits.h"
+#include "common/tags.h"
 #include "common/undo.h"
 #include "control/conf.h"
 #include "control/control.h"
@@ -61,9 +68,14 @@
 #include "control/signal.h"
 #include "develop/blend.h"
 #include "develop/imageop.h"
+#include "develop/perf_model.h"
+#include "develop/pixelpipe_cache.h"
+#include "develop/record.h"
+#include "develop/tiling_calibration.h"
 #include "gui/gtk.h"
 #include "gui/guides.h"
 #include "gui/presets.h"
+#include "gui/watchdog.h"
 #include "libs/lib.h"
 #include "lua/init.h"
 #include "views/view.h"
@@ -138,8 +150,10 @@ static int usage(const char *argv0)
 #endif
   printf("  --moduledir <module directory>\n");
   printf("  --noiseprofiles <noiseprofiles json file>\n");
+  printf("  --record <darkroom recording file>\n");
   printf("  -t <num openmp threads>\n");
   printf("  --tmpdir <tmp directory>\n");
+  printf("  --trace <chrome trace json file>\n");
   printf("  --version\n");
 #ifdef _WIN32
   printf("\n");
@@ -305,15 +319,29 @@ static void dt_codepaths_init()
   {
 #ifdef HAVE_BUILTIN_CPU_SUPPORTS
     darktable.codepath.SSE2 = (__builtin_cpu_supports("sse") && __builtin_cpu_supports("sse2"));
+    darktable.codepath.AVX2 = (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"));
+    darktable.codepath.AVX512 = (darktable.codepath.AVX2 && __builtin_cpu_supports("avx512f"));
 #else
     dt_cpu_flags_t flags = dt_detect_cpu_features();
     darktable.codepath.SSE2 = ((flags & (CPU_FLAG_SSE)) && (flags & (CPU_FLAG_SSE2)));
+    darktable.codepath.AVX2 = ((flags & (CPU_FLAG_AVX2)) && (flags & (CPU_FLAG_FMA)));
+    darktable.codepath.AVX512 = (darktable.codepath.AVX2 && (flags & (CPU_FLAG_AVX512F)));
 #endif
   }
 
+  // kernels which were not built can't be used either
+#ifndef HAVE_AVX2_CODEPATH
+  darktable.codepath.AVX2 = 0;
+#endif
+#ifndef HAVE_AVX512_CODEPATH
+  darktable.codepath.AVX512 = 0;
+#endif
+
   // second, apply overrides from conf
   // NOTE: all intrinsics sets can only be overridden to OFF
   if(!dt_conf_get_bool("codepaths/sse2")) darktable.codepath.SSE2 = 0;
+  if(!dt_conf_get_bool("codepaths/avx2")) darktable.codepath.AVX2 = 0;
+  if(!dt_conf_get_bool("codepaths/avx512")) darktable.codepath.AVX512 = 0;
 
   // last: do we have any intrinsics sets enabled?
   darktable.codepath._no_intrinsics = !(darktable.codepath.SSE2);
@@ -327,9 +355,17 @@ static void dt_codepaths_init()
 #endif
   {
     darktable.codepath.OPENMP_SIMD = 1;
+    // on arm and power the plain codepath is the native one, written for the compiler to vectorise
+#if !defined(__ARM_NEON) && !defined(__VSX__)
     fprintf(stderr, "[dt_codepaths_init] will be using HIGHLY EXPERIMENTAL plain OpenMP SIMD codepath.\n");
+#endif
   }
 
+#if defined(__ARM_NEON)
+  dt_print(DT_DEBUG_PERF, "[dt_codepaths_init] plain codepath, vectorised for neon\n");
+#elif defined(__VSX__)
+  dt_print(DT_DEBUG_PERF, "[dt_codepaths_init] plain codepath, vectorised for vsx\n");
+#else
 #if defined(__SSE__)
   if(darktable.codepath._no_intrinsics)
 #endif
@@ -338,11 +374,70 @@ static void dt_codepaths_init()
     fprintf(stderr,
             "[dt_codepaths_init] expect a LOT of functionality to be broken. you have been warned.\n");
   }
+#endif
+}
+
+// the phases of dt_init(), reported once startup is done
+#define DT_STARTUP_MAX_PHASES 32
+
+static struct
+{
+  dt_times_t last;
+  int count;
+  struct
+  {
+    const char *name;
+    double start, wall, user;
+  } phase[DT_STARTUP_MAX_PHASES];
+} _startup;
+
+static void _startup_begin(void)
+{
+  dt_get_times(&_startup.last);
+  _startup.count = 0;
+}
+
+// ends the phase which began with the previous call
+static void _startup_phase(const char *name)
+{
+  dt_times_t now;
+  dt_get_times(&now);
+  if(_startup.count < DT_STARTUP_MAX_PHASES)
+  {
+    _startup.phase[_startup.count].name = name;
+    _startup.phase[_startup.count].start = _startup.last.clock;
+    _startup.phase[_startup.count].wall = now.clock - _startup.last.clock;
+    _startup.phase[_startup.count].user = now.user - _startup.last.user;
+    _startup.count++;
+  }
+  _startup.last = now;
+}
+
+// as startup.<phase> gauges in ms, so metrics_file keeps them, as trace events and with -d perf as a table
+static void _startup_report(void)
+{
+  double wall = 0.0, user = 0.0;
+  dt_print(DT_DEBUG_PERF, "[startup] %-20s %9s %9s\n", "phase", "wall", "cpu");
+  for(int i = 0; i < _startup.count; i++)
+  {
+    const char *name = _startup.phase[i].name;
+    char metric[128];
+    snprintf(metric, sizeof(metric), "startup.%s", name);
+    dt_metrics_set(dt_metrics_get(metric, DT_METRIC_GAUGE), (int64_t)(_startup.phase[i].wall * 1e3));
+    dt_trace_duration("startup", name, _startup.phase[i].start, _startup.phase[i].start + _startup.phase[i].wall);
+    dt_print(DT_DEBUG_PERF, "[startup] %-20s %8.3fs %8.3fs\n", name, _startup.phase[i].wall,
+             _startup.phase[i].user);
+    wall += _startup.phase[i].wall;
+    user += _startup.phase[i].user;
+  }
+  dt_metrics_set(dt_metrics_get("startup.total", DT_METRIC_GAUGE), (int64_t)(wall * 1e3));
+  dt_print(DT_DEBUG_PERF, "[startup] %-20s %8.3fs %8.3fs\n", "total", wall, user);
 }
 
 int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load_data, lua_State *L)
 {
   double start_wtime = dt_get_wtime();
+  _startup_begin();
 
 #ifndef _WIN32
   if(getuid() == 0 || geteuid() == 0)
@@ -449,6 +544,7 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   dt_pthread_mutex_init(&(darktable.capabilities_threadsafe), NULL);
   dt_pthread_mutex_init(&(darktable.exiv2_threadsafe), NULL);
   dt_pthread_mutex_init(&(darktable.readFile_mutex), NULL);
+  dt_pthread_mutex_init(&(darktable.pixelpipe_cache_threadsafe), NULL);
   darktable.control = (dt_control_t *)calloc(1, sizeof(dt_control_t));
 
   // database
@@ -460,6 +556,8 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   char *tmpdir_from_command = NULL;
   char *configdir_from_command = NULL;
   char *cachedir_from_command = NULL;
+  char *trace_from_command = NULL;
+  char *record_from_command = NULL;
 
 #ifdef HAVE_OPENCL
   gboolean exclude_opencl = FALSE;
@@ -514,6 +612,12 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
 #else
                "  SSE2 optimized codepath disabled\n"
 #endif
+#ifdef HAVE_AVX2_CODEPATH
+               "  AVX2 kernels built\n"
+#endif
+#ifdef HAVE_AVX512_CODEPATH
+               "  AVX-512 kernels built\n"
+#endif
 #ifdef _OPENMP
                "  OpenMP support enabled\n"
 #else
@@ -596,6 +700,18 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
         argv[k-1] = NULL;
         argv[k] = NULL;
       }
+      else if(!strcmp(argv[k], "--trace") && argc > k + 1)
+      {
+        trace_from_command = argv[++k];
+        argv[k-1] = NULL;
+        argv[k] = NULL;
+      }
+      else if(!strcmp(argv[k], "--record") && argc > k + 1)
+      {
+        record_from_command = argv[++k];
+        argv[k-1] = NULL;
+        argv[k] = NULL;
+      }
       else if(!strcmp(argv[k], "--configdir") && argc > k + 1)
       {
         configdir_from_command = argv[++k];
@@ -746,6 +862,11 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
     }
   }
 
+  if(trace_from_command && dt_trace_init(trace_from_command)) return usage(argv[0]);
+  if(record_from_command && dt_dev_record_init(record_from_command)) return usage(argv[0]);
+  dt_memory_accounting_init((darktable.unmuted & DT_DEBUG_MEMORY) || dt_trace_enabled());
+  _startup_phase("options");
+
   if(darktable.unmuted & DT_DEBUG_MEMORY)
   {
     fprintf(stderr, "[memory] at startup\n");
@@ -778,6 +899,7 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
 #ifdef USE_LUA
   dt_lua_init_early(L);
 #endif
+  _startup_phase("directories");
 
   // thread-safe init:
   dt_exif_init();
@@ -791,6 +913,10 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   dt_conf_init(darktable.conf, darktablerc, config_override);
   g_slist_free_full(config_override, g_free);
 
+  // before anything which feeds it
+  dt_metrics_init();
+  _startup_phase("config");
+
   // set the interface language and prepare selection for prefs
   darktable.l10n = dt_l10n_init(init_gui);
 
@@ -827,11 +953,14 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
     }
   }
 
+  _startup_phase("l10n_gtk");
+
   // detect cpu features and decide which codepaths to enable
   dt_codepaths_init();
 
   // get the list of color profiles
   darktable.color_profiles = dt_colorspaces_init();
+  _startup_phase("color_profiles");
 
   // initialize the database
   darktable.db = dt_database_init(dbfilename_from_command, load_data, init_gui);
@@ -875,19 +1004,15 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
 
   //db maintenance on startup (if configured to do so)
   dt_database_maybe_maintenance(darktable.db, init_gui, FALSE);
+  _startup_phase("database");
+
+  // before the signals, so their handlers are timed from the start
+  if(init_gui) dt_gui_watchdog_init();
 
   // Initialize the signal system
   darktable.signals = dt_control_signal_init();
 
   // Make sure that the database and xmp files are in sync
-  // We need conf and db to be up and running for that which is the case here.
-  // FIXME: is this also useful in non-gui mode?
-  GList *changed_xmp_files = NULL;
-  if(init_gui && dt_conf_get_bool("run_crawler_on_start"))
-  {
-    changed_xmp_files = dt_control_crawler_run();
-  }
-
   if(init_gui)
   {
     dt_control_init(darktable.control);
@@ -916,6 +1041,7 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   darktable.guides = dt_guides_init();
 
   darktable.themes = NULL;
+  _startup_phase("control");
 
 #ifdef HAVE_GRAPHICSMAGICK
   /* GraphicsMagick init */
@@ -927,11 +1053,20 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   /* ImageMagick init */
   MagickWandGenesis();
 #endif
+#if defined(HAVE_GRAPHICSMAGICK) || defined(HAVE_IMAGEMAGICK)
+  _startup_phase("magick");
+#endif
+
+  // the caches, pipes and OpenCL memory pools size themselves within its budgets
+  dt_memory_governor_init();
 
   darktable.opencl = (dt_opencl_t *)calloc(1, sizeof(dt_opencl_t));
 #ifdef HAVE_OPENCL
   dt_opencl_init(darktable.opencl, exclude_opencl, print_statistics);
 #endif
+  dt_tiling_calibration_init();
+  dt_perf_model_init();
+  _startup_phase("opencl");
 
   darktable.points = (dt_points_t *)calloc(1, sizeof(dt_points_t));
   dt_points_init(darktable.points, dt_get_num_threads());
@@ -946,6 +1081,12 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   darktable.mipmap_cache = (dt_mipmap_cache_t *)calloc(1, sizeof(dt_mipmap_cache_t));
   dt_mipmap_cache_init(darktable.mipmap_cache);
 
+  // intermediate buffers shared between the darkroom pixelpipes, lines are allocated on demand
+  darktable.pixelpipe_cache = (dt_dev_pixelpipe_cache_t *)calloc(1, sizeof(dt_dev_pixelpipe_cache_t));
+  dt_dev_pixelpipe_cache_init(darktable.pixelpipe_cache, 0, 0,
+                              (size_t)MAX(dt_conf_get_int64("pixelpipe_cache_shared_memory"), 0));
+  _startup_phase("caches");
+
   // The GUI must be initialized before the views, because the init()
   // functions of the views depend on darktable.control->accels_* to register
   // their keyboard accelerators
@@ -959,6 +1100,7 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
       return 1;
     }
     dt_bauhaus_init();
+    _startup_phase("gui");
   }
   else
     darktable.gui = NULL;
@@ -972,6 +1114,7 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
     fprintf(stderr, "ERROR: can't init develop system, aborting.\n");
     return 1;
   }
+  _startup_phase("views");
 
   darktable.imageio = (dt_imageio_t *)calloc(1, sizeof(dt_imageio_t));
   dt_imageio_init(darktable.imageio);
@@ -981,6 +1124,7 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   // load iop order rules
   darktable.iop_order_rules = dt_ioppr_get_iop_order_rules();
   // load the darkroom mode plugins once:
+  _startup_phase("imageio");
   dt_iop_load_modules_so();
   // check if all modules have a iop order assigned
   if(dt_ioppr_check_so_iop_order(darktable.iop, darktable.iop_order_list))
@@ -994,6 +1138,7 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
 
   // set up the list of exiv2 metadata
   dt_exif_set_exiv2_taglist();
+  _startup_phase("iop_modules");
 
   if(init_gui)
   {
@@ -1002,10 +1147,12 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
     // this is done late so that the gui can react to the signal sent but before switching to lighttable!
     darktable.camctl = dt_camctl_new();
     dt_camctl_background_detect_cameras();
+    _startup_phase("camera");
 #endif
 
     darktable.lib = (dt_lib_t *)calloc(1, sizeof(dt_lib_t));
     dt_lib_init(darktable.lib);
+    _startup_phase("libs");
 
     dt_gui_gtk_load_config();
 
@@ -1030,6 +1177,7 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
 
     // initialize undo struct
     darktable.undo = dt_undo_init();
+    _startup_phase("views_gui");
   }
 
   if(darktable.unmuted & DT_DEBUG_MEMORY)
@@ -1039,10 +1187,12 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
   }
 
   dt_image_local_copy_synch();
+  _startup_phase("local_copies");
 
 /* init lua last, since it's user made stuff it must be in the real environment */
 #ifdef USE_LUA
   dt_lua_init(darktable.lua_state.state, lua_command);
+  _startup_phase("lua");
 #endif
 
   if(init_gui)
@@ -1069,6 +1219,8 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
     // we have to call dt_ctl_switch_mode_to() here already to not run into a lua deadlock.
     // having another call later is ok
     dt_ctl_switch_mode_to(mode);
+    // with the first collection query
+    _startup_phase("lighttable");
 
 #ifndef MAC_INTEGRATION
     // load image(s) specified on cmdline.
@@ -1096,17 +1248,19 @@ int dt_init(int argc, char *argv[], const gboolean init_gui, const gboolean load
       dt_control_set_mouse_over_id(last_id);
       dt_ctl_switch_mode_to("darkroom");
     }
+    if(loaded_images) _startup_phase("command_line_images");
 #endif
   }
 
-  // last but not least construct the popup that asks the user about images whose xmp files are newer than the
-  // db entry
-  if(init_gui && changed_xmp_files)
+  // last but not least look for images whose xmp files are newer than the db entry, the popup asking the user
+  // about them shows up once the background job is done
+  if(init_gui && dt_conf_get_bool("run_crawler_on_start"))
   {
-    dt_control_crawler_show_image_list(changed_xmp_files);
+    dt_control_crawler_start();
   }
 
   dt_print(DT_DEBUG_CONTROL, "[init] startup took %f seconds\n", dt_get_wtime() - start_wtime);
+  _startup_report();
 
   return 0;
 }
@@ -1130,7 +1284,14 @@ void dt_cleanup()
     dt_dbus_destroy(darktable.dbus);
 
     dt_control_shutdown(darktable.control);
-
+    dt_control_crawler_cleanup();
+    dt_gui_watchdog_cleanup();
+  }
+  // while the libs are still there to show the progress
+  dt_image_sidecar_cleanup();
+  dt_tag_index_cleanup();
+  if(init_gui)
+  {
     dt_lib_cleanup(darktable.lib);
     free(darktable.lib);
   }
@@ -1139,6 +1300,8 @@ void dt_cleanup()
 #endif
   dt_view_manager_cleanup(darktable.view_manager);
   free(darktable.view_manager);
+  // while the caches it reports on are still there
+  dt_metrics_cleanup();
   if(init_gui)
   {
     dt_imageio_cleanup(darktable.imageio);
@@ -1149,6 +1312,9 @@ void dt_cleanup()
   free(darktable.image_cache);
   dt_mipmap_cache_cleanup(darktable.mipmap_cache);
   free(darktable.mipmap_cache);
+  dt_dev_pixelpipe_cache_cleanup(darktable.pixelpipe_cache);
+  free(darktable.pixelpipe_cache);
+  darktable.pixelpipe_cache = NULL;
   if(init_gui)
   {
     dt_control_cleanup(darktable.control);
@@ -1161,12 +1327,15 @@ void dt_cleanup()
   dt_points_cleanup(darktable.points);
   free(darktable.points);
   dt_iop_unload_modules_so();
+  dt_tiling_calibration_cleanup();
+  dt_perf_model_cleanup();
   g_list_free_full(darktable.iop_order_list, free);
   darktable.iop_order_list = NULL;
   g_list_free_full(darktable.iop_order_rules, free);
   darktable.iop_order_rules = NULL;
   dt_opencl_cleanup(darktable.opencl);
   free(darktable.opencl);
+  dt_memory_governor_cleanup();
 #ifdef HAVE_GPHOTO2
   dt_camctl_destroy((dt_camctl_t *)darktable.camctl);
 #endif
@@ -1199,8 +1368,19 @@ void dt_cleanup()
   dt_pthread_mutex_destroy(&(darktable.capabilities_threadsafe));
   dt_pthread_mutex_destroy(&(darktable.exiv2_threadsafe));
   dt_pthread_mutex_destroy(&(darktable.readFile_mutex));
+  dt_pthread_mutex_destroy(&(darktable.pixelpipe_cache_threadsafe));
 
   dt_exif_cleanup();
+
+  dt_interpolation_cleanup();
+
+  dt_focuspeaking_cleanup();
+
+  dt_trace_cleanup();
+
+  dt_dev_record_cleanup();
+
+  dt_memory_accounting_cleanup();
 }
 
 void dt_print(dt_debug_thread_t thread, const char *msg, ...)
@@ -1232,14 +1412,15 @@ void *dt_alloc_align(size_t alignment, size_t size)
 {
   const size_t aligned_size = dt_round_size(size, alignment);
 #if defined(__FreeBSD_version) && __FreeBSD_version < 700013
-  return malloc(aligned_size);
+  void *ptr = malloc(aligned_size);
 #elif defined(_WIN32)
-  return _aligned_malloc(aligned_size, alignment);
+  void *ptr = _aligned_malloc(aligned_size, alignment);
 #else
   void *ptr = NULL;
   if(posix_memalign(&ptr, alignment, aligned_size)) return NULL;
-  return ptr;
 #endif
+  dt_memory_accounting_host_alloc(ptr, aligned_size);
+  return ptr;
 }
 
 size_t dt_round_size(const size_t size, const size_t alignment)
@@ -1255,12 +1436,15 @@ size_t dt_round_size_sse(const size_t size)
 }
 
 
-#ifdef _WIN32
 void dt_free_align(void *mem)
 {
+  dt_memory_accounting_host_free(mem);
+#ifdef _WIN32
   _aligned_free(mem);
-}
+#else
+  free(mem);
 #endif
+}
 
 void dt_show_times(const dt_times_t *start, const char *prefix)
 {
@@ -25,6 +25,7 @@
 #include "common/debug.h"
 #include "common/file_location.h"
 #include "common/iop_order.h"
+#include "common/metrics.h"
 #include "common/styles.h"
 #include "common/history.h"
 #include "control/conf.h"
@@ -44,9 +45,12 @@
 
 // whenever _create_*_schema() gets changed you HAVE to bump this version and add an update path to
 // _upgrade_*_schema_step()!
-#define CURRENT_DATABASE_VERSION_LIBRARY 30
+#define CURRENT_DATABASE_VERSION_LIBRARY 31
 #define CURRENT_DATABASE_VERSION_DATA     6
 
+// prepared statements kept by dt_database_release_cached()
+#define DT_DATABASE_MAX_CACHED_STATEMENTS 64
+
 typedef struct dt_database_t
 {
   gboolean lock_acquired;
@@ -60,6 +64,24 @@ typedef struct dt_database_t
   /* ondisk DB */
   sqlite3 *handle;
 
+  /* prepared statements not in use right now, sql text -> sqlite3_stmt */
+  dt_pthread_mutex_t stmt_lock;
+  GHashTable *stmt_cache;
+
+  /* held by the thread with a transaction open on the shared handle, for as long as it is open */
+  GRecMutex transaction_lock;
+
+  /* writes handed to the writer thread, see dt_database_write_async(). the thread has a connection of its own
+     to the library, which only works along with the shared one in wal mode */
+  gboolean wal;
+  dt_pthread_mutex_t write_lock;
+  pthread_cond_t write_cond;
+  GQueue write_queue;
+  int writes_pending;
+  gboolean writer_started, writer_quit;
+  pthread_t writer;
+  sqlite3 *write_handle;
+
   gchar *error_message, *error_dbfilename;
   int error_other_pid;
 } dt_database_t;
@@ -1672,6 +1694,13 @@ static int _upgrade_library_schema_step(dt_database_t *db, int version)
     sqlite3_exec(db->handle, "COMMIT", NULL, NULL, NULL);
     new_version = 30;
   }
+  else if(version == 30)
+  {
+    // the modification times of film roll folders as seen by the last crawler run
+    TRY_EXEC("CREATE TABLE main.crawler_folders (film_id INTEGER PRIMARY KEY, mtime INTEGER)",
+             "[init] can't create table crawler_folders\n");
+    new_version = 31;
+  }
   else
     new_version = version; // should be the fallback so that calling code sees that we are in an infinite loop
 
@@ -1987,6 +2016,8 @@ static void _create_library_schema(dt_database_t *db)
   sqlite3_exec(db->handle, "CREATE TABLE main.history_hash (imgid INTEGER PRIMARY KEY, "
                "basic_hash BLOB, auto_hash BLOB, current_hash BLOB, mipmap_hash BLOB)",
                NULL, NULL, NULL);
+  sqlite3_exec(db->handle, "CREATE TABLE main.crawler_folders (film_id INTEGER PRIMARY KEY, mtime INTEGER)",
+               NULL, NULL, NULL);
 }
 
 /* create the current database schema and set the version in db_info accordingly */
@@ -2045,6 +2076,21 @@ static void _create_memory_schema(dt_database_t *db)
       "CREATE TABLE memory.collected_images (rowid INTEGER PRIMARY KEY AUTOINCREMENT, imgid INTEGER)", NULL,
       NULL, NULL);
   sqlite3_exec(db->handle, "CREATE TABLE memory.tmp_selection (imgid INTEGER PRIMARY KEY)", NULL, NULL, NULL);
+  sqlite3_exec(db->handle, "CREATE TABLE memory.removed_images (imgid INTEGER PRIMARY KEY)", NULL, NULL, NULL);
+  // bumped by every change of the presets, for the caches of them. temp triggers can watch the other databases
+  // but only name tables unqualified, so the name has to be unique
+  sqlite3_exec(db->handle, "CREATE TABLE memory.presets_version (version INTEGER)", NULL, NULL, NULL);
+  sqlite3_exec(db->handle, "INSERT INTO memory.presets_version VALUES (0)", NULL, NULL, NULL);
+  sqlite3_exec(db->handle, "CREATE TEMP TRIGGER presets_insert AFTER INSERT ON data.presets"
+                           " BEGIN UPDATE presets_version SET version = version + 1; END",
+               NULL, NULL, NULL);
+  sqlite3_exec(db->handle, "CREATE TEMP TRIGGER presets_update AFTER UPDATE ON data.presets"
+                           " BEGIN UPDATE presets_version SET version = version + 1; END",
+               NULL, NULL, NULL);
+  sqlite3_exec(db->handle, "CREATE TEMP TRIGGER presets_delete AFTER DELETE ON data.presets"
+                           " BEGIN UPDATE presets_version SET version = version + 1; END",
+               NULL, NULL, NULL);
+  sqlite3_exec(db->handle, "CREATE TABLE memory.collection_filter (id INTEGER PRIMARY KEY)", NULL, NULL, NULL);
   sqlite3_exec(db->handle, "CREATE TABLE memory.taglist "
                            "(tmpid INTEGER PRIMARY KEY, id INTEGER UNIQUE ON CONFLICT IGNORE, count INTEGER)",
                NULL, NULL, NULL);
@@ -2432,6 +2478,19 @@ void dt_database_backup(const char *filename)
   g_free(backup);
 }
 
+// one histogram per kind of statement, named after its first word, e.g. sql.select
+static int _profile_statement(unsigned type, void *user_data, void *statement, void *nanoseconds)
+{
+  const char *sql = sqlite3_sql((sqlite3_stmt *)statement);
+  char name[32] = "sql.";
+  size_t len = strlen(name);
+  while(sql && g_ascii_isspace(*sql)) sql++;
+  for(; sql && g_ascii_isalpha(*sql) && len < sizeof(name) - 1; sql++) name[len++] = g_ascii_tolower(*sql);
+  name[len] = '\0';
+  dt_metrics_time(len > strlen("sql.") ? name : "sql.other", *(const sqlite3_int64 *)nanoseconds * 1e-9);
+  return 0;
+}
+
 dt_database_t *dt_database_init(const char *alternative, const gboolean load_data, const gboolean has_gui)
 {
   /*  set the threading mode to Serialized */
@@ -2488,6 +2547,13 @@ start:
   dt_database_t *db = (dt_database_t *)g_malloc0(sizeof(dt_database_t));
   db->dbfilename_data = g_strdup(dbfilename_data);
   db->dbfilename_library = g_strdup(dbfilename_library);
+  // the keys belong to the statements
+  db->stmt_cache = g_hash_table_new(g_str_hash, g_str_equal);
+  dt_pthread_mutex_init(&db->stmt_lock, NULL);
+  g_rec_mutex_init(&db->transaction_lock);
+  dt_pthread_mutex_init(&db->write_lock, NULL);
+  pthread_cond_init(&db->write_cond, NULL);
+  g_queue_init(&db->write_queue);
 
   /* make sure the folder exists. this might not be the case for new databases */
   /* also check if a database backup is needed */
@@ -2530,6 +2596,11 @@ start:
     dt_loc_get_datadir(dbfilename_library, sizeof(dbfilename_library));
     fprintf(stderr, "[init] try `cp %s/darktablerc %s/darktablerc'\n", dbfilename_library, datadir);
     sqlite3_close(db->handle);
+    g_hash_table_destroy(db->stmt_cache);
+    dt_pthread_mutex_destroy(&db->stmt_lock);
+    g_rec_mutex_clear(&db->transaction_lock);
+    dt_pthread_mutex_destroy(&db->write_lock);
+    pthread_cond_destroy(&db->write_cond);
     g_free(dbname);
     g_free(db->lockfile_data);
     g_free(db->dbfilename_data);
@@ -2539,6 +2610,10 @@ start:
     return NULL;
   }
 
+  // the time of every statement goes to the metrics, which print their percentiles at exit
+  if(darktable.unmuted & DT_DEBUG_PERF)
+    sqlite3_trace_v2(db->handle, SQLITE_TRACE_PROFILE, _profile_statement, NULL);
+
   /* attach a memory database to db connection for use with temporary tables
      used during instance life time, which is discarded on exit.
   */
@@ -2560,8 +2635,26 @@ start:
   sqlite3_finalize(stmt);
 
   // some sqlite3 config
-  sqlite3_exec(db->handle, "PRAGMA synchronous = OFF", NULL, NULL, NULL);
-  sqlite3_exec(db->handle, "PRAGMA journal_mode = MEMORY", NULL, NULL, NULL);
+  gchar *journal_mode = dt_conf_get_string("database/journal_mode");
+  if(!g_strcmp0(journal_mode, "wal"))
+  {
+    // a crash loses at most the last transactions but never corrupts the database, and readers don't wait
+    // for the commits of writers. an in-memory library stays as it is
+    if(sqlite3_prepare_v2(db->handle, "PRAGMA journal_mode = WAL", -1, &stmt, NULL) == SQLITE_OK)
+    {
+      db->wal = sqlite3_step(stmt) == SQLITE_ROW && !g_strcmp0((const char *)sqlite3_column_text(stmt, 0), "wal");
+      sqlite3_finalize(stmt);
+    }
+    sqlite3_exec(db->handle, "PRAGMA synchronous = NORMAL", NULL, NULL, NULL);
+    // the writer thread may hold the write lock for a moment
+    if(db->wal) sqlite3_busy_timeout(db->handle, 5000);
+  }
+  else
+  {
+    sqlite3_exec(db->handle, "PRAGMA synchronous = OFF", NULL, NULL, NULL);
+    sqlite3_exec(db->handle, "PRAGMA journal_mode = MEMORY", NULL, NULL, NULL);
+  }
+  g_free(journal_mode);
   sqlite3_exec(db->handle, "PRAGMA page_size = 32768", NULL, NULL, NULL);
 
   /* now that we got functional databases that are locked for us we can make sure that the schema is set up */
@@ -2792,6 +2885,25 @@ error:
 
 void dt_database_destroy(const dt_database_t *db)
 {
+  dt_database_t *wdb = (dt_database_t *)db;
+  dt_pthread_mutex_lock(&wdb->write_lock);
+  wdb->writer_quit = TRUE;
+  pthread_cond_broadcast(&wdb->write_cond);
+  dt_pthread_mutex_unlock(&wdb->write_lock);
+  // the writer finishes what is queued before it quits
+  if(db->writer_started) pthread_join(db->writer, NULL);
+  dt_pthread_mutex_destroy(&wdb->write_lock);
+  pthread_cond_destroy(&wdb->write_cond);
+
+  // sqlite refuses to close while statements are left
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, db->stmt_cache);
+  while(g_hash_table_iter_next(&iter, &key, &value)) sqlite3_finalize((sqlite3_stmt *)value);
+  g_hash_table_destroy(db->stmt_cache);
+  dt_pthread_mutex_destroy((dt_pthread_mutex_t *)&db->stmt_lock);
+  g_rec_mutex_clear(&wdb->transaction_lock);
+
   sqlite3_close(db->handle);
   if (db->lockfile_data)
   {
@@ -2815,6 +2927,182 @@ sqlite3 *dt_database_get(const dt_database_t *db)
   return db ? db->handle : NULL;
 }
 
+int dt_database_prepare_cached(const dt_database_t *db, const char *sql, sqlite3_stmt **stmt)
+{
+  dt_pthread_mutex_t *lock = (dt_pthread_mutex_t *)&db->stmt_lock;
+  dt_pthread_mutex_lock(lock);
+  // taken out while in use, so two threads never share one
+  *stmt = g_hash_table_lookup(db->stmt_cache, sql);
+  if(*stmt) g_hash_table_remove(db->stmt_cache, sql);
+  dt_pthread_mutex_unlock(lock);
+  if(*stmt) return SQLITE_OK;
+  return sqlite3_prepare_v2(db->handle, sql, -1, stmt, NULL);
+}
+
+void dt_database_release_cached(const dt_database_t *db, sqlite3_stmt *stmt)
+{
+  if(!stmt) return;
+  sqlite3_reset(stmt);
+  sqlite3_clear_bindings(stmt);
+
+  dt_pthread_mutex_t *lock = (dt_pthread_mutex_t *)&db->stmt_lock;
+  dt_pthread_mutex_lock(lock);
+  // keep one per query, more are only around while several threads run it at once
+  const char *sql = sqlite3_sql(stmt);
+  const gboolean keep = sql && !g_hash_table_contains(db->stmt_cache, sql);
+  GList *dropped = NULL;
+  if(keep)
+  {
+    // queries built on the fly pile up over time, start over once there are too many
+    if(g_hash_table_size(db->stmt_cache) >= DT_DATABASE_MAX_CACHED_STATEMENTS)
+    {
+      dropped = g_hash_table_get_values(db->stmt_cache);
+      g_hash_table_remove_all(db->stmt_cache);
+    }
+    g_hash_table_insert(db->stmt_cache, (gpointer)sql, stmt);
+  }
+  dt_pthread_mutex_unlock(lock);
+  if(!keep) sqlite3_finalize(stmt);
+  for(GList *l = dropped; l; l = g_list_next(l)) sqlite3_finalize((sqlite3_stmt *)l->data);
+  g_list_free(dropped);
+}
+
+typedef struct dt_database_write_job_t
+{
+  dt_database_write_t write;
+  dt_database_written_t done;
+  gpointer data;
+} dt_database_write_job_t;
+
+// runs everything queued in one transaction on its own connection, then the callbacks of all of it
+static void *_database_writer(void *arg)
+{
+  dt_database_t *db = (dt_database_t *)arg;
+  sqlite3 *handle = db->write_handle;
+  dt_pthread_setname("db writer");
+  dt_pthread_mutex_lock(&db->write_lock);
+  while(TRUE)
+  {
+    while(g_queue_is_empty(&db->write_queue) && !db->writer_quit)
+      dt_pthread_cond_wait(&db->write_cond, &db->write_lock);
+    if(g_queue_is_empty(&db->write_queue)) break;
+
+    GQueue batch = db->write_queue;
+    g_queue_init(&db->write_queue);
+    dt_pthread_mutex_unlock(&db->write_lock);
+
+    // immediate, so that the write lock is taken here, where the busy timeout applies, and not on the way
+    gboolean committed = sqlite3_exec(handle, "BEGIN IMMEDIATE", NULL, NULL, NULL) == SQLITE_OK;
+    if(committed)
+    {
+      for(GList *l = batch.head; l; l = g_list_next(l))
+      {
+        const dt_database_write_job_t *job = (dt_database_write_job_t *)l->data;
+        job->write(handle, job->data);
+      }
+      committed = sqlite3_exec(handle, "COMMIT", NULL, NULL, NULL) == SQLITE_OK;
+      if(!committed) sqlite3_exec(handle, "ROLLBACK", NULL, NULL, NULL);
+    }
+    if(!committed)
+      fprintf(stderr, "[db writer] %d writes are lost: %s\n", batch.length, sqlite3_errmsg(handle));
+    for(GList *l = batch.head; l; l = g_list_next(l))
+    {
+      const dt_database_write_job_t *job = (dt_database_write_job_t *)l->data;
+      if(job->done) job->done(job->data, committed);
+    }
+    const int n = batch.length;
+    g_list_free_full(batch.head, g_free);
+
+    dt_pthread_mutex_lock(&db->write_lock);
+    db->writes_pending -= n;
+    pthread_cond_broadcast(&db->write_cond);
+  }
+  dt_pthread_mutex_unlock(&db->write_lock);
+  sqlite3_close(handle);
+  return NULL;
+}
+
+// the connection of the writer thread, NULL if the library cannot have a second one
+static sqlite3 *_database_open_writer(const dt_database_t *db)
+{
+  if(!db->wal) return NULL;
+  sqlite3 *handle = NULL;
+  if(sqlite3_open_v2(db->dbfilename_library, &handle, SQLITE_OPEN_READWRITE, NULL) != SQLITE_OK)
+  {
+    fprintf(stderr, "[db writer] can't open `%s': %s\n", db->dbfilename_library, sqlite3_errmsg(handle));
+    sqlite3_close(handle);
+    return NULL;
+  }
+  sqlite3_busy_timeout(handle, 5000);
+  sqlite3_exec(handle, "PRAGMA synchronous = NORMAL", NULL, NULL, NULL);
+  return handle;
+}
+
+void dt_database_write_async(const dt_database_t *db, dt_database_write_t write, dt_database_written_t done,
+                             gpointer data)
+{
+  dt_database_t *wdb = (dt_database_t *)db;
+  dt_pthread_mutex_lock(&wdb->write_lock);
+  if(!wdb->writer_started && !wdb->writer_quit && (wdb->write_handle = _database_open_writer(wdb)))
+  {
+    wdb->writer_started = !dt_pthread_create(&wdb->writer, _database_writer, wdb);
+    if(!wdb->writer_started)
+    {
+      sqlite3_close(wdb->write_handle);
+      wdb->write_handle = NULL;
+      // no second try
+      wdb->wal = FALSE;
+    }
+  }
+  if(!wdb->writer_started || wdb->writer_quit)
+  {
+    // no thread to hand it to, write it right now on the shared connection. the caller's thread may have a
+    // transaction open there, the write becomes part of it
+    dt_pthread_mutex_unlock(&wdb->write_lock);
+    write(db->handle, data);
+    if(done) done(data, TRUE);
+    return;
+  }
+  dt_database_write_job_t *job = g_malloc(sizeof(dt_database_write_job_t));
+  job->write = write;
+  job->done = done;
+  job->data = data;
+  g_queue_push_tail(&wdb->write_queue, job);
+  wdb->writes_pending++;
+  pthread_cond_broadcast(&wdb->write_cond);
+  dt_pthread_mutex_unlock(&wdb->write_lock);
+}
+
+void dt_database_write_flush(const dt_database_t *db)
+{
+  dt_database_t *wdb = (dt_database_t *)db;
+  dt_pthread_mutex_lock(&wdb->write_lock);
+  while(wdb->writes_pending > 0) dt_pthread_cond_wait(&wdb->write_cond, &wdb->write_lock);
+  dt_pthread_mutex_unlock(&wdb->write_lock);
+}
+
+// savepoints instead of BEGIN/COMMIT, so that they nest: the outermost one starts and commits the transaction.
+// the connection is shared by all threads and sqlite knows nothing about them, so the lock keeps the
+// transactions of other threads from nesting into this one and committing or rolling back part of it.
+void dt_database_start_transaction(const dt_database_t *db)
+{
+  g_rec_mutex_lock(&((dt_database_t *)db)->transaction_lock);
+  sqlite3_exec(db->handle, "SAVEPOINT dt_transaction", NULL, NULL, NULL);
+}
+
+void dt_database_release_transaction(const dt_database_t *db)
+{
+  sqlite3_exec(db->handle, "RELEASE dt_transaction", NULL, NULL, NULL);
+  g_rec_mutex_unlock(&((dt_database_t *)db)->transaction_lock);
+}
+
+void dt_database_rollback_transaction(const dt_database_t *db)
+{
+  sqlite3_exec(db->handle, "ROLLBACK TO dt_transaction", NULL, NULL, NULL);
+  sqlite3_exec(db->handle, "RELEASE dt_transaction", NULL, NULL, NULL);
+  g_rec_mutex_unlock(&((dt_database_t *)db)->transaction_lock);
+}
+
 const gchar *dt_database_get_path(const struct dt_database_t *db)
 {
   return db->dbfilename_library;
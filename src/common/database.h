@@ -28,6 +28,30 @@ struct dt_database_t *dt_database_init(const char *alternative, const gboolean l
 void dt_database_destroy(const struct dt_database_t *);
 /** get handle */
 struct sqlite3 *dt_database_get(const struct dt_database_t *);
+/** like sqlite3_prepare_v2() on the handle, but reuses the statement of an earlier call with the same sql
+ * which was given back with dt_database_release_cached(). */
+int dt_database_prepare_cached(const struct dt_database_t *db, const char *sql,
+                               struct sqlite3_stmt **stmt);
+/** resets the statement and keeps it for the next dt_database_prepare_cached(), instead of sqlite3_finalize(). */
+void dt_database_release_cached(const struct dt_database_t *db, struct sqlite3_stmt *stmt);
+/** groups the writes until the matching release into one transaction. these nest, an inner rollback only
+ * undoes what was written since its start. other threads starting a transaction wait until the outermost one
+ * is released, so never leave one open across waiting on another thread. */
+void dt_database_start_transaction(const struct dt_database_t *db);
+void dt_database_release_transaction(const struct dt_database_t *db);
+void dt_database_rollback_transaction(const struct dt_database_t *db);
+/** a write to be done on the writer thread, and what to do once its transaction has ended, committed or not. */
+typedef void (*dt_database_write_t)(struct sqlite3 *handle, gpointer data);
+typedef void (*dt_database_written_t)(gpointer data, gboolean committed);
+/** hands write to the writer thread, which runs everything queued meanwhile in one transaction on a connection
+ * of its own and calls done (if not NULL) after it, from that thread. write only sees the main schema of the
+ * library. the writes run in the order they were queued, but writes done on the shared handle may overtake
+ * them, so this is for writes nobody reads back right away. without the wal journal there is no writer thread
+ * and write and done run right away, on the shared handle. */
+void dt_database_write_async(const struct dt_database_t *db, dt_database_write_t write,
+                             dt_database_written_t done, gpointer data);
+/** waits until the writes queued so far are done. */
+void dt_database_write_flush(const struct dt_database_t *db);
 /** Returns database path */
 const gchar *dt_database_get_path(const struct dt_database_t *db);
 /** test if database was already locked by another instance */
@@ -98,6 +98,19 @@
     __DT_DEBUG_SQL_QUERY__(b)                                                                                     \
   } while(0)
 
+// for hot paths, a statement from the cache of the database a, to be given back with
+// DT_DEBUG_SQLITE3_RELEASE_CACHED() instead of being finalized. b has to be the same text every time.
+#define DT_DEBUG_SQLITE3_PREPARE_CACHED(a, b, c)                                                                  \
+  do                                                                                                              \
+  {                                                                                                               \
+    dt_print(DT_DEBUG_SQL, "[sql] %s:%d, function %s(): prepare cached \"%s\"\n", __FILE__, __LINE__,             \
+             __FUNCTION__, (b));                                                                                  \
+    __DT_DEBUG_ASSERT_WITH_QUERY__(dt_database_prepare_cached(a, b, c), (b));                                     \
+    __DT_DEBUG_SQL_QUERY__(b)                                                                                     \
+  } while(0)
+
+#define DT_DEBUG_SQLITE3_RELEASE_CACHED(a, b) dt_database_release_cached(a, b)
+
 #define DT_DEBUG_SQLITE3_BIND_INT(a, b, c) __DT_DEBUG_ASSERT__(sqlite3_bind_int(a, b, c))
 #define DT_DEBUG_SQLITE3_BIND_INT64(a, b, c) __DT_DEBUG_ASSERT__(sqlite3_bind_int64(a, b, c))
 #define DT_DEBUG_SQLITE3_BIND_DOUBLE(a, b, c) __DT_DEBUG_ASSERT__(sqlite3_bind_double(a, b, c))
@@ -182,6 +182,11 @@ dt_dlopencl_t *dt_dlopencl_init(const char *name)
                                            (void (**)(void)) & ocl->symbols->dt_clGetKernelInfo);
     success = success && dt_gmodule_symbol(module, "clEnqueueBarrier",
                                            (void (**)(void)) & ocl->symbols->dt_clEnqueueBarrier);
+    success = success && dt_gmodule_symbol(module, "clEnqueueMarker",
+                                           (void (**)(void)) & ocl->symbols->dt_clEnqueueMarker);
+    success = success && dt_gmodule_symbol(module, "clEnqueueWaitForEvents",
+                                           (void (**)(void)) & ocl->symbols->dt_clEnqueueWaitForEvents);
+    success = success && dt_gmodule_symbol(module, "clFlush", (void (**)(void)) & ocl->symbols->dt_clFlush);
     success = success && dt_gmodule_symbol(module, "clGetKernelWorkGroupInfo",
                                            (void (**)(void)) & ocl->symbols->dt_clGetKernelWorkGroupInfo);
     success = success && dt_gmodule_symbol(module, "clEnqueueReadBuffer",
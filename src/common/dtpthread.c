@@ -25,8 +25,13 @@
 #include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <inttypes.h>
 
+#ifdef __linux__
+#include <sched.h>
+#endif
+
 #ifdef _WIN32
 #include "win/dtwin.h"
 #endif // _WIN32
@@ -93,6 +98,63 @@ void dt_pthread_setname(const char *name)
 #endif
 }
 
+#ifdef __linux__
+// reads the cpus of a node from sysfs, in the form "0-7,16-23". returns the number of cpus, 0 if the node
+// doesn't exist.
+static int _numa_node_cpus(const int node, cpu_set_t *set)
+{
+  char path[64];
+  snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+  FILE *f = fopen(path, "r");
+  if(!f) return 0;
+
+  char line[1024] = { 0 };
+  const int read = fgets(line, sizeof(line), f) != NULL;
+  fclose(f);
+  if(!read) return 0;
+
+  CPU_ZERO(set);
+  char *c = line;
+  while(*c >= '0' && *c <= '9')
+  {
+    const long first = strtol(c, &c, 10);
+    const long last = *c == '-' ? strtol(c + 1, &c, 10) : first;
+    for(long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) CPU_SET(cpu, set);
+    if(*c == ',') c++;
+  }
+  return CPU_COUNT(set);
+}
+#endif
+
+int dt_pthread_numa_nodes(void)
+{
+#ifdef __linux__
+  int nodes = 0;
+  cpu_set_t set;
+  while(nodes < 64 && _numa_node_cpus(nodes, &set) > 0) nodes++;
+  return nodes ? nodes : 1;
+#else
+  return 1;
+#endif
+}
+
+int dt_pthread_bind_numa_node(const int node)
+{
+#ifdef __linux__
+  cpu_set_t set;
+  const int cpus = _numa_node_cpus(node, &set);
+  if(cpus <= 0) return 0;
+  const int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  if(ret != 0)
+  {
+    fprintf(stderr, "[dt_pthread_bind_numa_node] error: pthread_setaffinity_np() returned %i\n", ret);
+    return 0;
+  }
+  return cpus;
+#else
+  return 0;
+#endif
+}
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
@@ -362,6 +362,13 @@ int dt_pthread_create(pthread_t *thread, void *(*start_routine)(void *), void *a
 
 void dt_pthread_setname(const char *name);
 
+// the number of numa nodes with cpus, 1 where that isn't known
+int dt_pthread_numa_nodes(void);
+
+// keeps the calling thread, and the threads it creates from now on, on the cpus of the node. the pages
+// they write first are then allocated on that node. returns the number of cpus, 0 if it failed.
+int dt_pthread_bind_numa_node(int node);
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
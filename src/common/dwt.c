@@ -46,6 +46,7 @@ dwt_params_t *dt_dwt_init(float *image, const int width, const int height, const
   p->user_data = user_data;
   p->preview_scale = preview_scale;
   p->use_sse = use_sse;
+  p->cache = NULL;
 
   return p;
 }
@@ -57,6 +58,81 @@ void dt_dwt_free(dwt_params_t *p)
   free(p);
 }
 
+void dt_dwt_free_cache(dwt_cache_t *c)
+{
+  if(!c) return;
+
+  if(c->layers)
+  {
+    for(int i = 0; i <= c->scales; i++) dt_free_align(c->layers[i]);
+    free(c->layers);
+  }
+  memset(c, 0, sizeof(dwt_cache_t));
+}
+
+// fnv-1a over the bits of the image, by blocks so that the threads can share the work
+static uint64_t _dwt_image_hash(const float *const img, const size_t size)
+{
+  const size_t block = 1 << 16;
+  const size_t nblocks = (size + block - 1) / block;
+  uint64_t *hashes = malloc(sizeof(uint64_t) * MAX(nblocks, 1));
+  if(!hashes) return 0;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(img, size, block, nblocks, hashes) \
+  schedule(static)
+#endif
+  for(size_t b = 0; b < nblocks; b++)
+  {
+    const uint32_t *const w = (const uint32_t *)(img + b * block);
+    const size_t n = MIN(block, size - b * block);
+    uint64_t h = 14695981039346656037ull;
+    for(size_t i = 0; i < n; i++) h = (h ^ w[i]) * 1099511628211ull;
+    hashes[b] = h;
+  }
+
+  uint64_t hash = 14695981039346656037ull;
+  for(size_t b = 0; b < nblocks; b++) hash = (hash ^ hashes[b]) * 1099511628211ull;
+  free(hashes);
+  return hash;
+}
+
+// prepares p->cache for this decomposition, returns TRUE when it holds the scales of img
+static int _dwt_cache_lookup(dwt_params_t *const p, const float *const img)
+{
+  dwt_cache_t *c = p->cache;
+  const size_t size = (size_t)p->width * p->height * p->ch;
+  const uint64_t hash = _dwt_image_hash(img, size);
+
+  if(c->valid && c->layers && c->hash == hash && c->width == p->width && c->height == p->height
+     && c->ch == p->ch && c->scales == p->scales && c->preview_scale == p->preview_scale)
+    return 1;
+
+  if(!c->layers || c->width != p->width || c->height != p->height || c->ch != p->ch || c->scales != p->scales)
+  {
+    dt_dwt_free_cache(c);
+    c->layers = calloc(p->scales + 1, sizeof(float *));
+    c->scales = p->scales;
+    for(int i = 0; c->layers && i <= p->scales; i++)
+    {
+      c->layers[i] = dt_alloc_align(64, size * sizeof(float));
+      if(c->layers[i] == NULL)
+      {
+        dt_dwt_free_cache(c);
+        break;
+      }
+    }
+  }
+  c->hash = hash;
+  c->width = p->width;
+  c->height = p->height;
+  c->ch = p->ch;
+  c->preview_scale = p->preview_scale;
+  c->valid = 0;
+  return 0;
+}
+
 static int _get_max_scale(const int width, const int height, const float preview_scale)
 {
   int maxscale = 0;
@@ -294,6 +370,10 @@ static void dwt_wavelet_decompose(float *img, dwt_params_t *const p, _dwt_layer_
 
   if(p->scales <= 0) goto cleanup;
 
+  // the scales of this image may be known from the last run
+  const int cached = p->cache ? _dwt_cache_lookup(p, img) : 0;
+  float **const store = (p->cache && !cached) ? p->cache->layers : NULL;
+
   /* image buffers */
   buffer[0] = img;
   /* temporary storage */
@@ -340,23 +420,32 @@ static void dwt_wavelet_decompose(float *img, dwt_params_t *const p, _dwt_layer_
   {
     unsigned int lpass = (1 - (lev & 1));
 
-    for(int row = 0; row < p->height; row++)
+    if(cached)
     {
-      dwt_hat_transform(temp, buffer[hpass] + (row * p->width * p->ch), 1, p->width, 1 << lev, p);
-      memcpy(&(buffer[lpass][row * p->width * p->ch]), temp, p->width * p->ch * sizeof(float));
+      // the coarse image is not needed, the next scale comes from the cache too
+      memcpy(buffer[hpass], p->cache->layers[lev], size * sizeof(float));
     }
-
-    for(int col = 0; col < p->width; col++)
+    else
     {
-      dwt_hat_transform(temp, buffer[lpass] + col * p->ch, p->width, p->height, 1 << lev, p);
       for(int row = 0; row < p->height; row++)
       {
-        for(int c = 0; c < p->ch; c++)
-          buffer[lpass][INDEX_WT_IMAGE(row * p->width + col, p->ch, c)] = temp[INDEX_WT_IMAGE(row, p->ch, c)];
+        dwt_hat_transform(temp, buffer[hpass] + (row * p->width * p->ch), 1, p->width, 1 << lev, p);
+        memcpy(&(buffer[lpass][row * p->width * p->ch]), temp, p->width * p->ch * sizeof(float));
       }
-    }
 
-    dwt_subtract_layer(buffer[lpass], buffer[hpass], p);
+      for(int col = 0; col < p->width; col++)
+      {
+        dwt_hat_transform(temp, buffer[lpass] + col * p->ch, p->width, p->height, 1 << lev, p);
+        for(int row = 0; row < p->height; row++)
+        {
+          for(int c = 0; c < p->ch; c++)
+            buffer[lpass][INDEX_WT_IMAGE(row * p->width + col, p->ch, c)] = temp[INDEX_WT_IMAGE(row, p->ch, c)];
+        }
+      }
+
+      dwt_subtract_layer(buffer[lpass], buffer[hpass], p);
+      if(store) memcpy(store[lev], buffer[hpass], size * sizeof(float));
+    }
 
     // no merge scales or we didn't reach the merge scale from yet
     if(p->merge_from_scale == 0 || p->merge_from_scale > lev + 1)
@@ -404,6 +493,14 @@ static void dwt_wavelet_decompose(float *img, dwt_params_t *const p, _dwt_layer_
   // all scales have been processed
   if(bcontinue)
   {
+    if(cached)
+      memcpy(buffer[hpass], p->cache->layers[p->scales], size * sizeof(float));
+    else if(store)
+    {
+      memcpy(store[p->scales], buffer[hpass], size * sizeof(float));
+      p->cache->valid = 1;
+    }
+
     // allow to process residual image
     if(layer_func) layer_func(buffer[hpass], p, p->scales + 1);
 
@@ -19,6 +19,25 @@
 #ifndef DT_DEVELOP_DWT_H
 #define DT_DEVELOP_DWT_H
 
+#include <stdint.h>
+
+/* the detail scales and the residual of the last decomposition, before layer_func touched them. when the image
+ * is the same after layer_func on scale 0, dwt_decompose() copies them back instead of transforming again.
+ * zero it before the first use and release it with dt_dwt_free_cache() */
+typedef struct dwt_cache_t
+{
+  uint64_t hash;
+  int width;
+  int height;
+  int ch;
+  int scales;
+  float preview_scale;
+  int valid;
+  float **layers;
+} dwt_cache_t;
+
+void dt_dwt_free_cache(dwt_cache_t *c);
+
 /* structure returned by dt_dwt_init() to be used when calling dwt_decompose() */
 typedef struct dwt_params_t
 {
@@ -32,6 +51,7 @@ typedef struct dwt_params_t
   void *user_data;
   float preview_scale;
   int use_sse;
+  dwt_cache_t *cache; // optional, NULL from dt_dwt_init()
 } dwt_params_t;
 
 /* function prototype for the layer_func on dwt_decompose() call */
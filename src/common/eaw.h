@@ -0,0 +1,77 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <glib.h>
+#include <stdint.h>
+
+#define DT_EAW_MAX_SCALES 8
+
+typedef void((*eaw_decompose_t)(float *const out, const float *const in, float *const detail, const int scale,
+                                const float sharpen, const int32_t width, const int32_t height));
+
+typedef void((*eaw_synthesize_t)(float *const out, const float *const in, const float *const detail,
+                                 const float *thrsf, const float *boostf, const int32_t width,
+                                 const int32_t height));
+
+/** splits in into the coarser out and the detail of this scale, edges in L and chroma weighted by sharpen. */
+void dt_eaw_decompose(float *const out, const float *const in, float *const detail, const int scale,
+                      const float sharpen, const int32_t width, const int32_t height);
+/** the same, weighted by the distance in a noise-stabilized space scaled by inv_sigma2. */
+void dt_eaw_dn_decompose(float *const out, const float *const in, float *const detail, const int scale,
+                         const float inv_sigma2, const int32_t width, const int32_t height);
+/** adds the detail, shrunk by the threshold and scaled by boost per channel, back to in. */
+void dt_eaw_synthesize(float *const out, const float *const in, const float *const detail,
+                       const float *thrsf, const float *boostf, const int32_t width, const int32_t height);
+
+#if defined(__SSE2__)
+void dt_eaw_decompose_sse2(float *const out, const float *const in, float *const detail, const int scale,
+                           const float sharpen, const int32_t width, const int32_t height);
+void dt_eaw_dn_decompose_sse2(float *const out, const float *const in, float *const detail, const int scale,
+                              const float inv_sigma2, const int32_t width, const int32_t height);
+void dt_eaw_synthesize_sse2(float *const out, const float *const in, const float *const detail,
+                            const float *thrsf, const float *boostf, const int32_t width,
+                            const int32_t height);
+#endif
+
+/** the detail layers and coarse residual of one decomposition, kept on the piece so that changes which
+ *  only touch the synthesis do not have to decompose the same input again. */
+typedef struct dt_eaw_layers_t
+{
+  uint64_t hash; // of the input and decomposition parameters, 0 if the layers are not valid
+  int32_t width, height;
+  int scales;
+  float *detail[DT_EAW_MAX_SCALES];
+  float *coarse;
+} dt_eaw_layers_t;
+
+/** decomposes in into scales layers, unless layers already hold them for this hash (0 to force).
+ *  params[scale] is passed on to decompose, tmp is a scratch buffer of the same size as in.
+ *  returns the coarse residual, or NULL if the buffers could not be allocated. */
+const float *dt_eaw_layers_decompose(dt_eaw_layers_t *layers, const uint64_t hash, const float *const in,
+                                     float *const tmp, const int32_t width, const int32_t height,
+                                     const int scales, const eaw_decompose_t decompose, const float *const params);
+/** frees the buffers of the layers. */
+void dt_eaw_layers_cleanup(dt_eaw_layers_t *layers);
+/** whether the layers are small enough to be kept until the next run. */
+gboolean dt_eaw_layers_keep(const dt_eaw_layers_t *layers);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -30,6 +30,12 @@ extern "C" {
 #include <time.h>
 #include <unistd.h>
 #include <zlib.h>
+#if defined(__linux__)
+#include <sys/vfs.h>
+#elif !defined(_WIN32)
+#include <sys/param.h>
+#include <sys/mount.h>
+#endif
 }
 
 #include <cassert>
@@ -287,6 +293,60 @@ public:
   image->readMetadata();                                      \
 }
 
+// files on network shares are not mapped: a read error there raises SIGBUS when exiv2 touches the page, instead
+// of an error it could handle. where this can't be told, files are read as before
+static bool _exif_file_is_local(const char *path)
+{
+#if defined(__linux__)
+  struct statfs fs;
+  if(statfs(path, &fs) != 0) return false;
+  switch((uint32_t)fs.f_type)
+  {
+    case 0x6969:     // nfs
+    case 0x517B:     // smb
+    case 0xFF534D42: // cifs
+    case 0xFE534D42: // smb2
+    case 0x65735546: // fuse, sshfs and the like
+    case 0x01021997: // 9p
+    case 0x5346414F: // afs
+    case 0x73757245: // coda
+    case 0x00C36400: // ceph
+      return false;
+    default:
+      return true;
+  }
+#elif defined(MNT_LOCAL)
+  struct statfs fs;
+  if(statfs(path, &fs) != 0) return false;
+  return (fs.f_flags & MNT_LOCAL) != 0;
+#else
+  return false;
+#endif
+}
+
+// the whole file mapped for exiv2, which otherwise reads the ifds and maker notes piece by piece with a seek
+// and a read each. only the pages exiv2 looks at get read. the mapping has to outlive the image opened from it.
+class MappedFile
+{
+public:
+  explicit MappedFile(const char *path)
+    : map(_exif_file_is_local(path) ? g_mapped_file_new(path, FALSE, NULL) : NULL) {}
+  ~MappedFile() { if(map) g_mapped_file_unref(map); }
+
+  // falls back to reading the file if it can't be mapped
+  std::unique_ptr<Exiv2::Image> open(const char *path)
+  {
+    if(map && g_mapped_file_get_length(map) > 0)
+      return std::unique_ptr<Exiv2::Image>(
+          Exiv2::ImageFactory::open((const Exiv2::byte *)g_mapped_file_get_contents(map),
+                                    g_mapped_file_get_length(map)));
+    return std::unique_ptr<Exiv2::Image>(Exiv2::ImageFactory::open(WIDEN(path)));
+  }
+
+private:
+  GMappedFile *map;
+};
+
 static void _exif_import_tags(dt_image_t *img, Exiv2::XmpData::iterator &pos);
 static gboolean read_xmp_timestamps(Exiv2::XmpData &xmpData, const int imgid);
 
@@ -661,7 +721,8 @@ void dt_exif_img_check_usercrop(dt_image_t *img, const char *filename)
 {
   try
   {
-    std::unique_ptr<Exiv2::Image> image(Exiv2::ImageFactory::open(WIDEN(filename)));
+    MappedFile file(filename);
+    std::unique_ptr<Exiv2::Image> image(file.open(filename));
     assert(image.get() != 0);
     read_metadata_threadsafe(image);
     Exiv2::ExifData &exifData = image->exifData();
@@ -984,9 +1045,10 @@ static bool _exif_decode_exif_data(dt_image_t *img, Exiv2::ExifData &exifData)
     }
 
     /* Read lens name */
+    std::string canon_lens;
     if((FIND_EXIF_TAG("Exif.CanonCs.LensType")
-        && pos->print(&exifData) != "(0)"
-        && pos->print(&exifData) != "(65535)")
+        && (canon_lens = pos->print(&exifData)) != "(0)"
+        && canon_lens != "(65535)")
        || FIND_EXIF_TAG("Exif.Canon.0x0095"))
     {
       dt_strlcpy_to_utf8(img->exif_lens, sizeof(img->exif_lens), pos, exifData);
@@ -1356,7 +1418,8 @@ int dt_exif_get_thumbnail(const char *path, uint8_t **buffer, size_t *size, char
 {
   try
   {
-    std::unique_ptr<Exiv2::Image> image(Exiv2::ImageFactory::open(WIDEN(path)));
+    MappedFile file(path);
+    std::unique_ptr<Exiv2::Image> image(file.open(path));
     assert(image.get() != 0);
     read_metadata_threadsafe(image);
 
@@ -1403,6 +1466,29 @@ int dt_exif_get_thumbnail(const char *path, uint8_t **buffer, size_t *size, char
 /** read the metadata of an image.
  * XMP data trumps IPTC data trumps EXIF data
  */
+dt_image_orientation_t dt_exif_get_orientation(const char *path)
+{
+  try
+  {
+    MappedFile file(path);
+    std::unique_ptr<Exiv2::Image> image(file.open(path));
+    assert(image.get() != 0);
+    read_metadata_threadsafe(image);
+
+    Exiv2::ExifData &exifData = image->exifData();
+    Exiv2::ExifData::const_iterator pos;
+    if(FIND_EXIF_TAG("Exif.Image.Orientation") || FIND_EXIF_TAG("Exif.PanasonicRaw.Orientation"))
+      return dt_image_orientation_to_flip_bits(pos->toLong());
+    return ORIENTATION_NONE;
+  }
+  catch(Exiv2::AnyError &e)
+  {
+    std::string s(e.what());
+    std::cerr << "[exiv2 dt_exif_get_orientation] " << path << ": " << s << std::endl;
+    return ORIENTATION_NONE;
+  }
+}
+
 int dt_exif_read(dt_image_t *img, const char *path)
 {
   // at least set datetime taken to something useful in case there is no exif data in this file (pfm, png,
@@ -1417,7 +1503,8 @@ int dt_exif_read(dt_image_t *img, const char *path)
 
   try
   {
-    std::unique_ptr<Exiv2::Image> image(Exiv2::ImageFactory::open(WIDEN(path)));
+    MappedFile file(path);
+    std::unique_ptr<Exiv2::Image> image(file.open(path));
     assert(image.get() != 0);
     read_metadata_threadsafe(image);
     bool res = true;
@@ -2075,6 +2162,7 @@ static void _exif_import_tags(dt_image_t *img, Exiv2::XmpData::iterator &pos)
   sqlite3_finalize(stmt_sel_id);
   sqlite3_finalize(stmt_ins_tags);
   sqlite3_finalize(stmt_ins_tagged);
+  dt_tag_index_invalidate();
 }
 
 typedef struct history_entry_t
@@ -2806,7 +2894,7 @@ int dt_exif_xmp_read(dt_image_t *img, const char *filename, const int history_on
 
     // now add all masks that are not used for cloning. keeping them might be useful.
     // TODO: make this configurable? or remove it altogether?
-    sqlite3_exec(dt_database_get(darktable.db), "BEGIN TRANSACTION", NULL, NULL, NULL);
+    dt_database_start_transaction(darktable.db);
     if(version < 3)
     {
       g_hash_table_foreach(mask_entries, add_non_clone_mask_entries_to_db, &img->id);
@@ -2823,7 +2911,7 @@ int dt_exif_xmp_read(dt_image_t *img, const char *filename, const int history_on
         m_entries = g_list_next(m_entries);
       }
     }
-    sqlite3_exec(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+    dt_database_release_transaction(darktable.db);
 
     // history
     int num = 0;
@@ -2846,7 +2934,7 @@ int dt_exif_xmp_read(dt_image_t *img, const char *filename, const int history_on
       return 1;
     }
 
-    sqlite3_exec(dt_database_get(darktable.db), "BEGIN TRANSACTION", NULL, NULL, NULL);
+    dt_database_start_transaction(darktable.db);
 
     DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "DELETE FROM main.history WHERE imgid = ?1", -1,
                                 &stmt, NULL);
@@ -3085,7 +3173,7 @@ int dt_exif_xmp_read(dt_image_t *img, const char *filename, const int history_on
 
     if(all_ok)
     {
-      sqlite3_exec(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+      dt_database_release_transaction(darktable.db);
 
       // history_hash
       dt_history_hash_values_t hash = {NULL, 0, NULL, 0, NULL, 0};
@@ -3121,7 +3209,7 @@ int dt_exif_xmp_read(dt_image_t *img, const char *filename, const int history_on
     else
     {
       std::cerr << "[exif] error reading history from '" << filename << "'" << std::endl;
-      sqlite3_exec(dt_database_get(darktable.db), "ROLLBACK TRANSACTION", NULL, NULL, NULL);
+      dt_database_rollback_transaction(darktable.db);
       return 1;
     }
 
@@ -69,6 +69,9 @@ void dt_exif_apply_default_metadata(dt_image_t *img);
 /** fetch largest exif thumbnail jpg bytestream into buffer*/
 int dt_exif_get_thumbnail(const char *path, uint8_t **buffer, size_t *size, char **mime_type);
 
+/** read only the orientation of the image in path, ORIENTATION_NONE if it has none */
+dt_image_orientation_t dt_exif_get_orientation(const char *path);
+
 /** thread safe init and cleanup. */
 void dt_exif_init();
 void dt_exif_cleanup();
@@ -24,6 +24,7 @@
 #include <time.h>
 
 #include "common/darktable.h"
+#include "common/guided_filter.h"
 
 /** Note :
  * we use finite-math-only and fast-math because divisions by zero are manually avoided in the code
@@ -176,106 +177,38 @@ static inline void variance_analyse(const float *const restrict guide, // I
   const size_t Ndimch = width * height * 4;
 
   float *const restrict temp = dt_alloc_sse_ps(Ndimch); // array of structs { { mean_I, mean_p, corr_I, corr_Ip } }
-  float *const restrict guide_x_mask = dt_alloc_sse_ps(Ndim);
-  float *const restrict guide_x_guide = dt_alloc_sse_ps(Ndim);
 
   // Pre-multiply guide and mask
 #ifdef _OPENMP
 #pragma omp parallel for simd default(none) \
-  dt_omp_firstprivate(guide, mask, guide_x_mask, guide_x_guide, Ndim, radius) \
-  schedule(simd:static) aligned(guide, mask, guide_x_mask, guide_x_guide:64)
+  dt_omp_firstprivate(guide, mask, temp, Ndim) \
+  schedule(simd:static) aligned(guide, mask, temp:64)
 #endif
   for(size_t k = 0; k < Ndim; k++)
   {
-    guide_x_mask[k] = guide[k] * mask[k];
-    guide_x_guide[k] = guide[k] * guide[k];
+    temp[4 * k + 0] = guide[k];
+    temp[4 * k + 1] = mask[k];
+    temp[4 * k + 2] = guide[k] * guide[k];
+    temp[4 * k + 3] = guide[k] * mask[k];
   }
 
-  // Convolve box average along columns
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(guide, mask, temp, guide_x_mask, guide_x_guide, width, height, radius) \
-  schedule(simd:static) collapse(2)
-#endif
-  for(size_t i = 0; i < height; i++)
-  {
-    for(size_t j = 0; j < width; j++)
-    {
-      const size_t begin_convol = (i < radius) ? 0 : i - radius;
-      size_t end_convol = i + radius;
-      end_convol = (end_convol < height) ? end_convol : height - 1;
-      const float num_elem = 1.0f / ((float)end_convol - (float)begin_convol + 1.0f);
-      float tmp[4] DT_ALIGNED_PIXEL = { 0.0f }; // = { w_mean_I, w_mean_p, w_corr_I, w_corr_Ip }
+  // the 4 moments in a single sweep of the box filter of guided_filter.c
+  dt_box_mean(temp, height, width, 4, radius);
 
+  // Get a and b
 #ifdef _OPENMP
-#pragma omp simd reduction(+:tmp) aligned(tmp:16) aligned(guide, mask, guide_x_mask, guide_x_guide:64)
-#endif
-      for(size_t c = begin_convol; c <= end_convol; c++)
-      {
-        const size_t index = c * width + j;
-        tmp[0] += guide[index];
-        tmp[1] += mask[index];
-        tmp[2] += guide_x_guide[index];
-        tmp[3] += guide_x_mask[index];
-      }
-
-      const size_t index = (i * width + j) * 4;
-
-#ifdef _OPENMP
-#pragma omp simd aligned(tmp:16) aligned(temp:64)
-#endif
-      for(size_t c = 0; c < 4; c++)
-        temp[index + c] = tmp[c] * num_elem;
-    }
-  }
-
-  if(guide_x_guide != NULL) dt_free_align(guide_x_guide);
-  if(guide_x_mask != NULL) dt_free_align(guide_x_mask);
-
-  // Convolve box average along rows and output result
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(ab, temp, width, height, radius, feathering) \
-  schedule(simd:static) collapse(2)
+#pragma omp parallel for simd default(none) \
+  dt_omp_firstprivate(ab, temp, Ndim, feathering) \
+  schedule(simd:static) aligned(ab, temp:64)
 #endif
-  for(size_t i = 0; i < height; i++)
+  for(size_t k = 0; k < Ndim; k++)
   {
-    for(size_t j = 0; j < width; j++)
-    {
-      const size_t begin_convol = (j < radius) ? 0 : j - radius;
-      size_t end_convol = j + radius;
-      end_convol = (end_convol < width) ? end_convol : width - 1;
-      const float num_elem = 1.0f / ((float)end_convol - (float)begin_convol + 1.0f);
-      float tmp[4] DT_ALIGNED_PIXEL = { 0.0f }; // = { w_mean_I, w_mean_p, w_corr_I, w_corr_Ip }
-
-      for(size_t c = begin_convol; c <= end_convol; c++)
-      {
-        const size_t index = (i * width + c) * 4;
-#ifdef _OPENMP
-#pragma omp simd aligned(temp:64) aligned(tmp:16) reduction(+:tmp)
-#endif
-        for(size_t k = 0; k < 4; ++k)
-          tmp[k] += temp[index + k];
-      }
-
-#ifdef _OPENMP
-#pragma omp simd aligned(tmp:16) reduction(*:tmp)
-#endif
-      for(size_t c = 0; c < 4; c++)
-        tmp[c] *= num_elem;
-
-      const size_t index = (i * width + j) * 2;
-      const float d = fmaxf((tmp[2] - tmp[0] * tmp[0]) + feathering, 1e-15f); // avoid division by 0.
-      const float a = (tmp[3] - tmp[0] * tmp[1]) / d;
-      const float b = tmp[1] - a * tmp[0];
-      const float ab_temp[2] DT_ALIGNED_PIXEL = { a, b };
-
-#ifdef _OPENMP
-#pragma omp simd aligned(ab_temp:16) aligned(ab:64)
-#endif
-      for(size_t c = 0; c < 2; c++)
-        ab[index + c] = ab_temp[c];
-    }
+    const float *const tmp = temp + 4 * k; // = { mean_I, mean_p, corr_I, corr_Ip }
+    const float d = fmaxf((tmp[2] - tmp[0] * tmp[0]) + feathering, 1e-15f); // avoid division by 0.
+    const float a = (tmp[3] - tmp[0] * tmp[1]) / d;
+    const float b = tmp[1] - a * tmp[0];
+    ab[2 * k + 0] = a;
+    ab[2 * k + 1] = b;
   }
 
   if(temp != NULL) dt_free_align(temp);
@@ -288,92 +221,12 @@ static inline void box_average(float *const restrict in,
                                const int radius)
 {
   // Compute in-place a box average (filter) on a multi-channel image over a window of size 2*radius + 1
-  // We make use of the separable nature of the filter kernel to speed-up the computation
-  // by convolving along columns and rows separately (complexity O(2 × radius) instead of O(radius²)).
+  // We make use of the separable nature of the filter kernel and of moving sums to speed-up the computation
+  // (complexity O(1) per pixel instead of O(radius²)), see dt_box_mean().
 
   assert(ch <= 4);
 
-  const size_t Ndim = width * height * ch;
-  float *const restrict temp = dt_alloc_sse_ps(Ndim);
-
-  // Convolve box average along columns
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(in, temp, width, height, ch, radius) \
-  schedule(simd:static) collapse(2)
-#endif
-  for(size_t j = 0; j < width; j++)
-  {
-    for(size_t i = 0; i < height; i++)
-    {
-      const size_t begin_convol = (i < radius) ? 0 : i - radius;
-      size_t end_convol = i + radius;
-      end_convol = (end_convol < height) ? end_convol : height - 1;
-      const float num_elem = (float)end_convol - (float)begin_convol + 1.0f;
-      const size_t index = (i * width + j) * ch;
-
-      float w[4] DT_ALIGNED_PIXEL = { 0.0f };
-
-      // Convolve
-      for(size_t c = begin_convol; c <= end_convol; c++)
-      {
-        const size_t index_c = (c * width + j) * ch;
-#ifdef _OPENMP
-#pragma omp simd aligned(in:64) aligned(w:16) reduction(+:w)
-#endif
-        for(size_t k = 0; k < ch; ++k)
-          w[k] += in[index_c + k];
-      }
-
-    // Normalize and Save
-#ifdef _OPENMP
-#pragma omp simd aligned(temp:64) aligned(w:16)
-#endif
-      for(size_t k = 0; k < ch; ++k)
-        temp[index + k] = w[k] / num_elem;
-    }
-  }
-
-  // Convolve box average along rows and output result
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(in, temp, width, height, ch, radius) \
-  schedule(simd:static) collapse(2)
-#endif
-  for(size_t i = 0; i < height; i++)
-  {
-    for(size_t j = 0; j < width; j++)
-    {
-      const size_t begin_convol = (j < radius) ? 0 : j - radius;
-      size_t end_convol = j + radius;
-      end_convol = (end_convol < width) ? end_convol : width - 1;
-      const float num_elem = (float)end_convol - (float)begin_convol + 1.0f;
-      const size_t stride = i * width;
-      const size_t index = (stride + j) * ch;
-
-      float w[4] DT_ALIGNED_PIXEL = { 0.0f };
-
-      // Convolve
-      for(size_t c = begin_convol; c <= end_convol; c++)
-      {
-        const size_t index_c = (stride + c) * ch;
-#ifdef _OPENMP
-#pragma omp simd aligned(temp:64) aligned(w:16) reduction(+:w)
-#endif
-        for(size_t k = 0; k < ch; ++k)
-          w[k] += temp[index_c + k];
-      }
-
-      // Normalize and Save
-#ifdef _OPENMP
-#pragma omp simd aligned(w:16) aligned(in:64)
-#endif
-      for(size_t k = 0; k < ch; ++k)
-        in[index + k] = w[k] / num_elem;
-    }
-  }
-
-  if(temp != NULL) dt_free_align(temp);
+  dt_box_mean(in, height, width, ch, radius);
 }
 
 
@@ -0,0 +1,396 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/fileop.h"
+#include "common/darktable.h"
+#include "control/conf.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/syscall.h>
+#endif
+
+// large enough to keep the disks streaming, small enough to cancel quickly
+#define DT_FILEOP_CHUNK (4 << 20)
+
+typedef struct dt_fileop_batch_t
+{
+  dt_fileop_mode_t mode;
+  gboolean verify;
+  int cancelled;
+  int64_t done; // bytes, updated by the workers
+  int pending;
+  GMutex lock;
+  GCond cond;
+} dt_fileop_batch_t;
+
+GList *dt_fileop_list_append(GList *ops, const char *src, const char *dest)
+{
+  dt_fileop_t *op = g_malloc0(sizeof(dt_fileop_t));
+  op->src = g_strdup(src);
+  op->dest = g_strdup(dest);
+  return g_list_prepend(ops, op);
+}
+
+static void _fileop_free(gpointer data)
+{
+  dt_fileop_t *op = (dt_fileop_t *)data;
+  g_free(op->src);
+  g_free(op->dest);
+  g_free(op);
+}
+
+void dt_fileop_list_free(GList *ops)
+{
+  g_list_free_full(ops, _fileop_free);
+}
+
+static inline gboolean _cancelled(dt_fileop_batch_t *batch)
+{
+  return __sync_fetch_and_add(&batch->cancelled, 0) != 0;
+}
+
+// md5 is plenty to catch a broken transfer, this is not about tampering
+static int _checksum_file(dt_fileop_batch_t *batch, const char *path, gchar **digest)
+{
+  FILE *f = g_fopen(path, "rb");
+  if(!f) return errno;
+  GChecksum *sum = g_checksum_new(G_CHECKSUM_MD5);
+  guchar *buf = g_malloc(DT_FILEOP_CHUNK);
+  int err = 0;
+  size_t n;
+  while((n = fread(buf, 1, DT_FILEOP_CHUNK, f)) > 0)
+  {
+    g_checksum_update(sum, buf, n);
+    if(_cancelled(batch))
+    {
+      err = ECANCELED;
+      break;
+    }
+  }
+  if(!err && ferror(f)) err = EIO;
+  fclose(f);
+  g_free(buf);
+  *digest = err ? NULL : g_strdup(g_checksum_get_string(sum));
+  g_checksum_free(sum);
+  return err;
+}
+
+static int _verify(dt_fileop_batch_t *batch, const char *path, const gchar *expected)
+{
+  gchar *digest = NULL;
+  int err = _checksum_file(batch, path, &digest);
+  if(!err && g_strcmp0(digest, expected))
+  {
+    fprintf(stderr, "[fileop] checksum of `%s' does not match its source\n", path);
+    err = EIO;
+  }
+  g_free(digest);
+  return err;
+}
+
+#ifdef _WIN32
+
+static int _copy_file(dt_fileop_batch_t *batch, const char *src, const char *dest)
+{
+  GFile *in = g_file_new_for_path(src);
+  GFile *out = g_file_new_for_path(dest);
+  GError *error = NULL;
+  int err = 0;
+  if(!g_file_copy(in, out, G_FILE_COPY_NONE, NULL, NULL, NULL, &error))
+    err = g_error_matches(error, G_IO_ERROR, G_IO_ERROR_EXISTS) ? EEXIST : EIO;
+  g_clear_error(&error);
+  g_object_unref(in);
+  g_object_unref(out);
+
+  if(!err && batch->verify)
+  {
+    gchar *digest = NULL;
+    err = _checksum_file(batch, src, &digest);
+    if(!err) err = _verify(batch, dest, digest);
+    g_free(digest);
+    if(err) g_unlink(dest);
+  }
+  return err;
+}
+
+#else
+
+static int _write_all(int fd, const guchar *buf, size_t len)
+{
+  while(len)
+  {
+    const ssize_t n = write(fd, buf, len);
+    if(n < 0)
+    {
+      if(errno == EINTR) continue;
+      return errno;
+    }
+    buf += n;
+    len -= n;
+  }
+  return 0;
+}
+
+// copies in to out, in the kernel if nothing needs to see the data
+static int _copy_fd(dt_fileop_batch_t *batch, int in, int out, GChecksum *sum)
+{
+  if(!sum)
+  {
+#ifdef FICLONE
+    // on btrfs, xfs and the like the copy shares the extents of the original and is instant
+    struct stat st;
+    if(ioctl(out, FICLONE, in) == 0 && fstat(in, &st) == 0)
+    {
+      __sync_fetch_and_add(&batch->done, (int64_t)st.st_size);
+      return 0;
+    }
+#endif
+#ifdef SYS_copy_file_range
+    // through the syscall, the glibc wrapper is recent
+    gboolean copied = FALSE;
+    while(TRUE)
+    {
+      if(_cancelled(batch)) return ECANCELED;
+      const ssize_t n = syscall(SYS_copy_file_range, in, NULL, out, NULL, (size_t)DT_FILEOP_CHUNK, 0);
+      if(n == 0) return 0;
+      if(n > 0)
+      {
+        copied = TRUE;
+        __sync_fetch_and_add(&batch->done, (int64_t)n);
+        continue;
+      }
+      if(errno == EINTR) continue;
+      // not supported between these file systems or by this kernel, copy below unless something was written
+      if(!copied && (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP)) break;
+      return errno;
+    }
+#endif
+  }
+
+  guchar *buf = g_malloc(DT_FILEOP_CHUNK);
+  int err = 0;
+  while(!err)
+  {
+    if(_cancelled(batch))
+    {
+      err = ECANCELED;
+      break;
+    }
+    const ssize_t n = read(in, buf, DT_FILEOP_CHUNK);
+    if(n == 0) break;
+    if(n < 0)
+    {
+      if(errno != EINTR) err = errno;
+      continue;
+    }
+    if(sum) g_checksum_update(sum, buf, n);
+    err = _write_all(out, buf, n);
+    __sync_fetch_and_add(&batch->done, (int64_t)n);
+  }
+  g_free(buf);
+  return err;
+}
+
+static int _copy_file(dt_fileop_batch_t *batch, const char *src, const char *dest)
+{
+  const int in = g_open(src, O_RDONLY, 0);
+  if(in < 0) return errno;
+  struct stat st;
+  if(fstat(in, &st))
+  {
+    const int err = errno;
+    close(in);
+    return err;
+  }
+  const int out = g_open(dest, O_WRONLY | O_CREAT | O_EXCL, st.st_mode & 0777);
+  if(out < 0)
+  {
+    const int err = errno;
+    close(in);
+    return err;
+  }
+
+  // the checksum of the source is taken while copying, that of the copy is read back afterwards
+  GChecksum *sum = batch->verify ? g_checksum_new(G_CHECKSUM_MD5) : NULL;
+  int err = _copy_fd(batch, in, out, sum);
+  if(!err)
+  {
+    // keep the time stamps, as g_file_copy() does
+#ifdef __APPLE__
+    const struct timespec times[2] = { st.st_atimespec, st.st_mtimespec };
+#else
+    const struct timespec times[2] = { st.st_atim, st.st_mtim };
+#endif
+    futimens(out, times);
+  }
+  if(!err && sum)
+  {
+    // read the copy back from the disk rather than from the page cache
+    if(fsync(out)) err = errno;
+#ifdef POSIX_FADV_DONTNEED
+    if(!err) posix_fadvise(out, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+  }
+  close(in);
+  if(close(out) && !err) err = errno;
+
+  if(!err && sum) err = _verify(batch, dest, g_checksum_get_string(sum));
+  if(sum) g_checksum_free(sum);
+
+  if(err) g_unlink(dest);
+  return err;
+}
+
+#endif
+
+#ifndef _WIN32
+// rename() would replace an existing destination, this fails with EEXIST instead and leaves it alone
+static int _rename_noreplace(const char *src, const char *dest)
+{
+#if defined(SYS_renameat2) && defined(RENAME_NOREPLACE)
+  if(syscall(SYS_renameat2, AT_FDCWD, src, AT_FDCWD, dest, RENAME_NOREPLACE) == 0) return 0;
+  // older kernels and some file systems don't know the flag
+  if(errno != ENOSYS && errno != EINVAL) return errno;
+#endif
+  if(link(src, dest)) return errno;
+  if(unlink(src))
+  {
+    const int err = errno;
+    unlink(dest);
+    return err;
+  }
+  return 0;
+}
+#endif
+
+static int _move_file(dt_fileop_batch_t *batch, const char *src, const char *dest)
+{
+  GStatBuf st;
+  if(g_stat(src, &st)) return errno;
+#ifdef _WIN32
+  // g_rename() would replace it
+  if(g_file_test(dest, G_FILE_TEST_EXISTS)) return EEXIST;
+  const int err = g_rename(src, dest) ? errno : 0;
+  const gboolean other_volume = err == EXDEV;
+#else
+  const int err = _rename_noreplace(src, dest);
+  // across volumes, or on a file system without hard links
+  const gboolean other_volume = err == EXDEV || err == EPERM || err == EOPNOTSUPP || err == ENOSYS;
+#endif
+  if(!err)
+  {
+    __sync_fetch_and_add(&batch->done, (int64_t)st.st_size);
+    return 0;
+  }
+  if(!other_volume) return err;
+
+  // the source only goes once the copy is complete, and verified if asked to. the copy is created exclusively,
+  // so an existing destination is not replaced either
+  int copy_err = _copy_file(batch, src, dest);
+  if(!copy_err && g_unlink(src))
+  {
+    // keep the image in one place, where the database says it is
+    copy_err = errno;
+    g_unlink(dest);
+  }
+  return copy_err;
+}
+
+static void _worker(gpointer data, gpointer user_data)
+{
+  dt_fileop_t *op = (dt_fileop_t *)data;
+  dt_fileop_batch_t *batch = (dt_fileop_batch_t *)user_data;
+
+  if(_cancelled(batch))
+    op->error = ECANCELED;
+  else if(batch->mode == DT_FILEOP_MOVE)
+    op->error = _move_file(batch, op->src, op->dest);
+  else
+  {
+    op->error = _copy_file(batch, op->src, op->dest);
+    if(op->error == EEXIST) op->error = 0;
+  }
+
+  if(op->error && op->error != ECANCELED)
+    fprintf(stderr, "[fileop] `%s' -> `%s': %s\n", op->src, op->dest, g_strerror(op->error));
+
+  g_mutex_lock(&batch->lock);
+  batch->pending--;
+  g_cond_signal(&batch->cond);
+  g_mutex_unlock(&batch->lock);
+}
+
+int dt_fileop_run(GList *ops, const dt_fileop_mode_t mode, dt_fileop_progress_t progress, void *data)
+{
+  dt_fileop_batch_t batch = { .mode = mode, .verify = dt_conf_get_bool("fileop_verify") };
+  g_mutex_init(&batch.lock);
+  g_cond_init(&batch.cond);
+
+  int64_t total = 0;
+  for(GList *l = ops; l; l = g_list_next(l))
+  {
+    GStatBuf st;
+    if(!g_stat(((dt_fileop_t *)l->data)->src, &st)) total += st.st_size;
+  }
+
+  // a few in flight keep several disks or a network share busy, more only make a single disk seek
+  const int workers = CLAMP(dt_conf_get_int("fileop_workers"), 1, 16);
+  GThreadPool *pool = g_thread_pool_new(_worker, &batch, workers, FALSE, NULL);
+  g_mutex_lock(&batch.lock);
+  for(GList *l = ops; l; l = g_list_next(l))
+  {
+    batch.pending++;
+    g_thread_pool_push(pool, l->data, NULL);
+  }
+
+  while(batch.pending)
+  {
+    g_cond_wait_until(&batch.cond, &batch.lock, g_get_monotonic_time() + G_TIME_SPAN_SECOND / 10);
+    g_mutex_unlock(&batch.lock);
+    const double done = __sync_fetch_and_add(&batch.done, 0);
+    if(progress && !progress(total > 0 ? MIN(done / total, 1.0) : 0.0, data))
+      __sync_lock_test_and_set(&batch.cancelled, 1);
+    g_mutex_lock(&batch.lock);
+  }
+  g_mutex_unlock(&batch.lock);
+  g_thread_pool_free(pool, FALSE, TRUE);
+
+  g_mutex_clear(&batch.lock);
+  g_cond_clear(&batch.cond);
+
+  int failed = 0;
+  for(GList *l = ops; l; l = g_list_next(l))
+    if(((dt_fileop_t *)l->data)->error) failed++;
+  return failed;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
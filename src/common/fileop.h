@@ -0,0 +1,56 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <glib.h>
+
+/**
+ * transfers a batch of files with a few threads, for the copy, move and local copy jobs which are limited by
+ * the disks and not the cpu. files are reflinked or copied in the kernel where the platform allows, and
+ * optionally verified with a checksum of the source and of the written copy before a move removes the
+ * source. the number of threads and the verification are set by fileop_workers and fileop_verify.
+ *
+ * only the files are handled, updating the database is up to the caller once they are in place.
+ */
+
+typedef enum dt_fileop_mode_t
+{
+  DT_FILEOP_COPY = 0, // an existing destination is left alone and counts as done
+  DT_FILEOP_MOVE = 1  // an existing destination is an error
+} dt_fileop_mode_t;
+
+typedef struct dt_fileop_t
+{
+  gchar *src, *dest;
+  int error; // errno of the failure, 0 once the file is in place
+} dt_fileop_t;
+
+/** is called on the calling thread with the fraction of bytes done, returning FALSE cancels the rest. */
+typedef gboolean (*dt_fileop_progress_t)(double fraction, void *data);
+
+/** adds the transfer of src to dest to the list of dt_fileop_t, to be freed with dt_fileop_list_free(). */
+GList *dt_fileop_list_append(GList *ops, const char *src, const char *dest);
+void dt_fileop_list_free(GList *ops);
+
+/** transfers all files of the list and returns the number which failed or were cancelled. */
+int dt_fileop_run(GList *ops, const dt_fileop_mode_t mode, dt_fileop_progress_t progress, void *data);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -338,6 +338,11 @@ void dt_film_remove_empty()
     DT_DEBUG_SQLITE3_BIND_INT(inner_stmt, 1, id);
     sqlite3_step(inner_stmt);
     sqlite3_finalize(inner_stmt);
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "DELETE FROM main.crawler_folders WHERE film_id=?1",
+                                -1, &inner_stmt, NULL);
+    DT_DEBUG_SQLITE3_BIND_INT(inner_stmt, 1, id);
+    sqlite3_step(inner_stmt);
+    sqlite3_finalize(inner_stmt);
 
     if(dt_util_is_dir_empty(folder))
     {
@@ -401,6 +406,7 @@ void dt_film_remove(const int id)
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, id);
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
+  dt_tag_index_invalidate();
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "DELETE FROM main.history WHERE imgid IN "
                                                              "(SELECT id FROM main.images WHERE film_id = ?1)",
                               -1, &stmt, NULL);
@@ -456,6 +462,11 @@ void dt_film_remove(const int id)
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, id);
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "DELETE FROM main.crawler_folders WHERE film_id = ?1",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, id);
+  sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
   // dt_control_update_recent_films();
 
   dt_control_signal_raise(darktable.signals, DT_SIGNAL_FILMROLLS_CHANGED);
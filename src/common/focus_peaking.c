@@ -0,0 +1,347 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2019-2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/focus_peaking.h"
+#include "common/fast_guided_filter.h"
+#include "gui/gtk.h"
+
+/* the overlays are kept for the last images drawn, so that repainting the lighttable or the darkroom doesn't
+ * run the filters again. an overlay is found by image, mipmap size and buffer size, and is only taken while
+ * the hash of the buffer is the same, so an edited image gets a new one. */
+#define FOCUS_PEAKING_CACHE 8
+
+// the overlay colors, as native endian cairo ARGB32 pixels
+#define FOCUS_PEAKING_YELLOW 0xFFFFFF00u
+#define FOCUS_PEAKING_GREEN 0xFF00FF00u
+#define FOCUS_PEAKING_BLUE 0xFF0000FFu
+
+typedef struct dt_focuspeaking_overlay_t
+{
+  int imgid;
+  dt_mipmap_size_t mip;
+  int width, height;
+  uint64_t hash;
+  uint32_t *overlay;
+  uint64_t age;
+} dt_focuspeaking_overlay_t;
+
+static GMutex _overlay_lock;
+static dt_focuspeaking_overlay_t _overlay_cache[FOCUS_PEAKING_CACHE];
+static uint64_t _overlay_age = 0;
+
+static uint64_t _buffer_hash(const uint32_t *const restrict image, const size_t npixels)
+{
+  // an order independent mix of every pixel with its position, the padding byte of RGB24 is left out
+  uint64_t hash = 0;
+#ifdef _OPENMP
+#pragma omp parallel for simd default(none) \
+  dt_omp_firstprivate(image, npixels) \
+  schedule(static) reduction(^:hash)
+#endif
+  for(size_t k = 0; k < npixels; k++)
+  {
+    uint64_t x = ((uint64_t)(image[k] & 0xFFFFFFu) << 32 | k) * 0x9E3779B97F4A7C15ull;
+    hash ^= x ^ (x >> 29);
+  }
+  return hash;
+}
+
+// the luma of image as the euclidian norm of the RGB channels
+static void _focuspeaking_luma(const uint8_t *const restrict image, float *const restrict luma,
+                               const size_t npixels)
+{
+  // remove gamma 2.2 and take the square, for all the 8 bits values
+  static float lut[256];
+  static gsize lut_init = 0;
+  if(g_once_init_enter(&lut_init))
+  {
+    for(int k = 0; k < 256; k++) lut[k] = powf((float)k / 255.0f, 2.0f * 2.2f);
+    g_once_init_leave(&lut_init, 1);
+  }
+
+#ifdef _OPENMP
+#pragma omp parallel for simd default(none) \
+  dt_omp_firstprivate(image, luma, npixels) shared(lut) \
+  schedule(static) aligned(luma:64)
+#endif
+  for(size_t k = 0; k < npixels; k++)
+    luma[k] = sqrtf(lut[image[4 * k]] + lut[image[4 * k + 1]] + lut[image[4 * k + 2]]);
+}
+
+// the magnitude of the gradient over the principal directions and over the diagonal directions, averaged
+static inline float _gradient(const float *const restrict up, const float *const restrict center,
+                              const float *const restrict down, const size_t j, const size_t d)
+{
+  const float dx = center[j + d] - center[j - d];
+  const float dy = down[j] - up[j];
+  const float d1 = down[j + d] - up[j - d];
+  const float d2 = down[j - d] - up[j + d];
+
+  // we assume the gradients follow an hyper-laplacian distributions in natural images,
+  // which is baked by some examples the litterature, but is still very hacky
+  // https://www.sciencedirect.com/science/article/pii/S0165168415004168
+  // http://citeseerx.ist.psu.edu/viewdoc/download?doi=10.1.1.154.539&rep=rep1&type=pdf
+  return (sqrtf(dx * dx + dy * dy) + sqrtf(d1 * d1 + d2 * d2)) / 2.0f;
+}
+
+static void _focuspeaking_sharpness(const float *const restrict luma, float *const restrict sharpness,
+                                    const size_t width, const size_t height)
+{
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(luma, sharpness, width, height) \
+  schedule(static)
+#endif
+  for(size_t i = 0; i < height; i++)
+  {
+    float *const restrict out = sharpness + i * width;
+    if(i < 2 || i >= height - 2)
+    {
+      memset(out, 0, sizeof(float) * width);
+      continue;
+    }
+
+    const float *const restrict up2 = luma + (i - 2) * width;
+    const float *const restrict up1 = luma + (i - 1) * width;
+    const float *const restrict center = luma + i * width;
+    const float *const restrict down1 = luma + (i + 1) * width;
+    const float *const restrict down2 = luma + (i + 2) * width;
+
+    out[0] = out[1] = out[width - 2] = out[width - 1] = 0.0f;
+
+    // Computing the gradient on the closest neighbours gives us the rate of variation, but doesn't say if we are
+    // looking at local contrast or optical sharpness.
+    // so we compute again the gradient on neighbours a bit further.
+    // if both gradients have the same magnitude, it means we have no sharpness but just a big step in intensity,
+    // aka local contrast. If the closest is higher than the farthest, is means we have indeed a sharp something,
+    // either noise or edge. To mitigate that, we just subtract half the farthest gradient but add a noise threshold
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for(size_t j = 2; j < width - 2; j++)
+      out[j] = _gradient(up1, center, down1, j, 1)
+               - 0.67f * (_gradient(up2, center, down2, j, 2) - 0.00390625f);
+  }
+}
+
+// the mean of the sharpness inside the borders, and the mean deviation from it
+static void _focuspeaking_stats(const float *const restrict sharpness, const size_t width, const size_t height,
+                                float *const mean, float *const deviation)
+{
+  const float n = (float)(height - 4) * (float)(width - 4);
+
+  float TV_sum = 0.0f;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(sharpness, width, height) \
+  schedule(static) reduction(+:TV_sum)
+#endif
+  for(size_t i = 2; i < height - 2; i++)
+  {
+    const float *const restrict row = sharpness + i * width;
+    float sum = 0.0f;
+#ifdef _OPENMP
+#pragma omp simd reduction(+:sum)
+#endif
+    for(size_t j = 2; j < width - 2; j++) sum += row[j];
+    TV_sum += sum;
+  }
+  TV_sum /= n;
+
+  // the predicator of the hyper-laplacian distribution
+  // (similar to the standard deviation if we had a gaussian distribution)
+  float sigma = 0.0f;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(sharpness, width, height, TV_sum) \
+  schedule(static) reduction(+:sigma)
+#endif
+  for(size_t i = 2; i < height - 2; i++)
+  {
+    const float *const restrict row = sharpness + i * width;
+    float sum = 0.0f;
+#ifdef _OPENMP
+#pragma omp simd reduction(+:sum)
+#endif
+    for(size_t j = 2; j < width - 2; j++) sum += fabsf(row[j] - TV_sum);
+    sigma += sum;
+  }
+
+  *mean = TV_sum;
+  *deviation = sigma / n;
+}
+
+// paints the overlay from the sharpness thresholds, and clears the borders of the image in the same pass
+static void _focuspeaking_paint(const float *const restrict sharpness, uint32_t *const restrict overlay,
+                                const size_t width, const size_t height, const float six_sigma,
+                                const float four_sigma, const float two_sigma)
+{
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(sharpness, overlay, width, height, six_sigma, four_sigma, two_sigma) \
+  schedule(static)
+#endif
+  for(size_t i = 0; i < height; i++)
+  {
+    uint32_t *const restrict out = overlay + i * width;
+    if(i < 4 || i >= height - 5)
+    {
+      memset(out, 0, sizeof(uint32_t) * width);
+      continue;
+    }
+
+    const float *const restrict row = sharpness + i * width;
+    out[0] = out[1] = out[2] = out[3] = 0;
+    out[width - 5] = out[width - 4] = out[width - 3] = out[width - 2] = out[width - 1] = 0;
+
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for(size_t j = 4; j < width - 5; j++)
+    {
+      // very sharp : yellow, medium sharp : green, little sharp : blue, not sharp enough : transparent
+      const float TV = row[j];
+      out[j] = TV > six_sigma    ? FOCUS_PEAKING_YELLOW
+               : TV > four_sigma ? FOCUS_PEAKING_GREEN
+               : TV > two_sigma  ? FOCUS_PEAKING_BLUE
+                                 : 0u;
+    }
+  }
+}
+
+static void _focuspeaking_compute(const uint8_t *const restrict image, uint32_t *const restrict overlay,
+                                  const size_t width, const size_t height)
+{
+  float *const restrict luma = dt_alloc_sse_ps(width * height);
+  float *const restrict sharpness = dt_alloc_sse_ps(width * height);
+
+  _focuspeaking_luma(image, luma, width * height);
+
+  // Prefilter noise
+  fast_surface_blur(luma, width, height, 12, 0.00001f, 4, DT_GF_BLENDING_LINEAR, 1, 0.0f, exp2f(-8.0f), 1.0f);
+
+  _focuspeaking_sharpness(luma, sharpness, width, height);
+
+  // Anti-aliasing
+  box_average(sharpness, width, height, 1, 2);
+
+  float TV_sum, sigma;
+  _focuspeaking_stats(sharpness, width, height, &TV_sum, &sigma);
+
+  // Postfilter to connect isolated dots and draw lines
+  fast_surface_blur(sharpness, width, height, 12, 0.00001f, 4, DT_GF_BLENDING_LINEAR, 1, 0.0f, exp2f(-8.0f),
+                    1.0f);
+
+  // Set the sharpness thresholds
+  _focuspeaking_paint(sharpness, overlay, width, height, TV_sum + 10.0f * sigma, TV_sum + 5.0f * sigma,
+                      TV_sum + 2.5f * sigma);
+
+  dt_free_align(luma);
+  dt_free_align(sharpness);
+}
+
+static void _focuspeaking_draw(cairo_t *cr, uint32_t *const overlay, const int buf_width, const int buf_height)
+{
+  cairo_save(cr);
+  cairo_rectangle(cr, 0, 0, buf_width, buf_height);
+  cairo_surface_t *surface = cairo_image_surface_create_for_data((unsigned char *)overlay,
+                                                                 CAIRO_FORMAT_ARGB32,
+                                                                 buf_width, buf_height,
+                                                                 cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, buf_width));
+  cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+  cairo_set_source_surface(cr, surface, 0.0, 0.0);
+  cairo_pattern_set_filter(cairo_get_source(cr), darktable.gui->filter_image);
+  cairo_fill(cr);
+  cairo_restore(cr);
+  cairo_surface_destroy(surface);
+}
+
+static dt_focuspeaking_overlay_t *_find_overlay(const int imgid, const dt_mipmap_size_t mip, const int width,
+                                                const int height)
+{
+  for(int k = 0; k < FOCUS_PEAKING_CACHE; k++)
+  {
+    dt_focuspeaking_overlay_t *o = _overlay_cache + k;
+    if(o->overlay && o->imgid == imgid && o->mip == mip && o->width == width && o->height == height) return o;
+  }
+  return NULL;
+}
+
+void dt_focuspeaking(cairo_t *cr, int width, int height, uint8_t *const restrict image,
+                     const int buf_width, const int buf_height, const int imgid, const dt_mipmap_size_t mip)
+{
+  // the filters need some pixels around the borders
+  if(buf_width < 16 || buf_height < 16) return;
+
+  const size_t npixels = (size_t)buf_width * buf_height;
+  const uint64_t hash = imgid < 0 ? 0 : _buffer_hash((const uint32_t *)image, npixels);
+
+  if(imgid >= 0)
+  {
+    g_mutex_lock(&_overlay_lock);
+    dt_focuspeaking_overlay_t *o = _find_overlay(imgid, mip, buf_width, buf_height);
+    if(o && o->hash == hash)
+    {
+      o->age = ++_overlay_age;
+      _focuspeaking_draw(cr, o->overlay, buf_width, buf_height);
+      g_mutex_unlock(&_overlay_lock);
+      return;
+    }
+    g_mutex_unlock(&_overlay_lock);
+  }
+
+  // computed without the lock, so that thumbnails being drawn at the same time don't wait for each other
+  uint32_t *overlay = dt_alloc_align(64, npixels * sizeof(uint32_t));
+  if(!overlay) return;
+  _focuspeaking_compute(image, overlay, buf_width, buf_height);
+
+  if(imgid < 0)
+  {
+    _focuspeaking_draw(cr, overlay, buf_width, buf_height);
+    dt_free_align(overlay);
+    return;
+  }
+
+  g_mutex_lock(&_overlay_lock);
+  // the overlay of the former buffer of this image is replaced, else the least recently drawn one
+  dt_focuspeaking_overlay_t *o = _find_overlay(imgid, mip, buf_width, buf_height);
+  for(int k = 0; k < FOCUS_PEAKING_CACHE && !o; k++)
+    if(!_overlay_cache[k].overlay) o = _overlay_cache + k;
+  for(int k = 0; k < FOCUS_PEAKING_CACHE && !o; k++)
+    if(k == 0 || _overlay_cache[k].age < o->age) o = _overlay_cache + k;
+  dt_free_align(o->overlay);
+  *o = (dt_focuspeaking_overlay_t){ .imgid = imgid, .mip = mip, .width = buf_width, .height = buf_height,
+                                    .hash = hash, .overlay = overlay, .age = ++_overlay_age };
+  _focuspeaking_draw(cr, o->overlay, buf_width, buf_height);
+  g_mutex_unlock(&_overlay_lock);
+}
+
+void dt_focuspeaking_cleanup(void)
+{
+  g_mutex_lock(&_overlay_lock);
+  for(int k = 0; k < FOCUS_PEAKING_CACHE; k++)
+  {
+    dt_free_align(_overlay_cache[k].overlay);
+    _overlay_cache[k] = (dt_focuspeaking_overlay_t){ 0 };
+  }
+  g_mutex_unlock(&_overlay_lock);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
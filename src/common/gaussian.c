@@ -33,6 +33,20 @@
 
 #define BLOCKSIZE (1 << 6)
 
+#define DT_GAUSSIAN_BLUR_BLOCKED dt_gaussian_blur_blocked_plain
+#include "common/gaussian_blocked.h"
+
+typedef int(dt_gaussian_blur_blocked_t)(const float *const in, float *const out, float *const temp,
+                                        const int width, const int height, const int ch,
+                                        const float *const min, const float *const max, const float *const coef);
+
+#ifdef HAVE_AVX2_CODEPATH
+dt_gaussian_blur_blocked_t dt_gaussian_blur_blocked_avx2;
+#endif
+#ifdef HAVE_AVX512_CODEPATH
+dt_gaussian_blur_blocked_t dt_gaussian_blur_blocked_avx512;
+#endif
+
 static void compute_gauss_params(const float sigma, dt_gaussian_order_t order, float *a0, float *a1,
                                  float *a2, float *a3, float *b1, float *b2, float *coefp, float *coefn)
 {
@@ -171,6 +185,20 @@ void dt_gaussian_blur(dt_gaussian_t *g, const float *const in, float *const out)
   float *Labmax = g->max;
   float *Labmin = g->min;
 
+  // 1, 2 and 4 channels are filtered in blocks of columns, see gaussian_blocked.h
+  if(GAUSSIAN_LANES % ch == 0)
+  {
+    dt_gaussian_blur_blocked_t *blur = dt_gaussian_blur_blocked_plain;
+#ifdef HAVE_AVX2_CODEPATH
+    if(darktable.codepath.AVX2) blur = dt_gaussian_blur_blocked_avx2;
+#endif
+#ifdef HAVE_AVX512_CODEPATH
+    if(darktable.codepath.AVX512) blur = dt_gaussian_blur_blocked_avx512;
+#endif
+    const float coef[8] = { a0, a1, a2, a3, b1, b2, coefp, coefn };
+    if(blur(in, out, temp, width, height, ch, Labmin, Labmax, coef)) return;
+  }
+
 // vertical blur column by column
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
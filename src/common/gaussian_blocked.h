@@ -0,0 +1,187 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// the recursive gaussian of gaussian.c on blocks of GAUSSIAN_LANES floats at once. included by gaussian.c and
+// by gaussian_avx2.c and gaussian_avx512.c, which are built with the flags of their instruction sets. define
+// DT_GAUSSIAN_BLUR_BLOCKED to the name of the function before including.
+//
+// the vertical pass filters the lanes of neighbouring columns, which are contiguous in every row. the
+// horizontal pass copies strips of rows transposed into a small buffer per thread, so that the same lanes
+// run along the rows there.
+
+#include "common/darktable.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#ifndef GAUSSIAN_LANES
+#define GAUSSIAN_LANES 16
+#endif
+
+// filters n <= GAUSSIAN_LANES lanes of len samples each forward and backward. sample t of lane l is read from
+// x[t * xstride + l], clamped to [lmin[l], lmax[l]] and the sum of both directions is written to
+// y[t * ystride + l]. coef holds a0, a1, a2, a3, b1, b2, coefp, coefn of compute_gauss_params().
+static inline void _gaussian_lanes(const float *const x, const size_t xstride, float *const y,
+                                   const size_t ystride, const int len, const int n,
+                                   const float *const lmin, const float *const lmax, const float *const coef)
+{
+  const float a0 = coef[0], a1 = coef[1], a2 = coef[2], a3 = coef[3];
+  const float b1 = coef[4], b2 = coef[5], coefp = coef[6], coefn = coef[7];
+  float xp[GAUSSIAN_LANES], yb[GAUSSIAN_LANES], yp[GAUSSIAN_LANES];
+  float xn[GAUSSIAN_LANES], xa[GAUSSIAN_LANES], yn[GAUSSIAN_LANES], ya[GAUSSIAN_LANES];
+
+  // forward filter
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+  for(int l = 0; l < n; l++)
+  {
+    const float v = x[l];
+    xp[l] = v < lmin[l] ? lmin[l] : (v > lmax[l] ? lmax[l] : v);
+    yb[l] = xp[l] * coefp;
+    yp[l] = yb[l];
+  }
+
+  for(int t = 0; t < len; t++)
+  {
+    const float *const xr = x + t * xstride;
+    float *const yr = y + t * ystride;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for(int l = 0; l < n; l++)
+    {
+      const float v = xr[l];
+      const float xc = v < lmin[l] ? lmin[l] : (v > lmax[l] ? lmax[l] : v);
+      const float yc = (a0 * xc) + (a1 * xp[l]) - (b1 * yp[l]) - (b2 * yb[l]);
+      yr[l] = yc;
+      xp[l] = xc;
+      yb[l] = yp[l];
+      yp[l] = yc;
+    }
+  }
+
+  // backward filter
+  const float *const xlast = x + (len - 1) * xstride;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+  for(int l = 0; l < n; l++)
+  {
+    const float v = xlast[l];
+    xn[l] = v < lmin[l] ? lmin[l] : (v > lmax[l] ? lmax[l] : v);
+    xa[l] = xn[l];
+    yn[l] = xn[l] * coefn;
+    ya[l] = yn[l];
+  }
+
+  for(int t = len - 1; t > -1; t--)
+  {
+    const float *const xr = x + t * xstride;
+    float *const yr = y + t * ystride;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for(int l = 0; l < n; l++)
+    {
+      const float v = xr[l];
+      const float xc = v < lmin[l] ? lmin[l] : (v > lmax[l] ? lmax[l] : v);
+      const float yc = (a2 * xn[l]) + (a3 * xa[l]) - (b1 * yn[l]) - (b2 * ya[l]);
+      xa[l] = xn[l];
+      xn[l] = xc;
+      ya[l] = yn[l];
+      yn[l] = yc;
+      yr[l] += yc;
+    }
+  }
+}
+
+// blurs in to out through temp, both of width x height pixels of ch channels. ch has to divide
+// GAUSSIAN_LANES. in and out may be the same buffer. returns FALSE if the strip buffers could not be
+// allocated, nothing is written then.
+int DT_GAUSSIAN_BLUR_BLOCKED(const float *const in, float *const out, float *const temp, const int width,
+                             const int height, const int ch, const float *const min, const float *const max,
+                             const float *const coef)
+{
+  const int rows = GAUSSIAN_LANES / ch; // rows per strip of the horizontal pass
+  const size_t stride = (size_t)width * ch;
+  float lmin[GAUSSIAN_LANES], lmax[GAUSSIAN_LANES];
+  for(int l = 0; l < GAUSSIAN_LANES; l++)
+  {
+    lmin[l] = min[l % ch];
+    lmax[l] = max[l % ch];
+  }
+
+  // one pair of transposed strips per thread
+  const size_t strip = (size_t)GAUSSIAN_LANES * width;
+  float *const strips = dt_alloc_align(64, sizeof(float) * 2 * strip * dt_get_num_threads());
+  if(!strips) return FALSE;
+
+  // vertical blur, GAUSSIAN_LANES / ch columns at a time
+  const int blocks = (stride + GAUSSIAN_LANES - 1) / GAUSSIAN_LANES;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(in, temp, height, stride, blocks, lmin, lmax, coef) \
+  schedule(static)
+#endif
+  for(int b = 0; b < blocks; b++)
+  {
+    const size_t c0 = (size_t)b * GAUSSIAN_LANES;
+    const int n = MIN(GAUSSIAN_LANES, stride - c0);
+    _gaussian_lanes(in + c0, stride, temp + c0, stride, height, n, lmin, lmax, coef);
+  }
+
+  // horizontal blur, rows rows at a time. the lanes of rows past the end repeat the last row.
+  const int nstrips = (height + rows - 1) / rows;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(out, temp, width, height, ch, rows, stride, strip, strips, nstrips, lmin, lmax, coef) \
+  schedule(static)
+#endif
+  for(int s = 0; s < nstrips; s++)
+  {
+    float *const x = strips + 2 * strip * dt_get_thread_num();
+    float *const y = x + strip;
+    const int j0 = s * rows;
+
+    for(int r = 0; r < rows; r++)
+    {
+      const float *const row = temp + MIN(j0 + r, height - 1) * stride;
+      for(int i = 0; i < width; i++)
+        for(int k = 0; k < ch; k++) x[(size_t)i * GAUSSIAN_LANES + r * ch + k] = row[(size_t)i * ch + k];
+    }
+
+    _gaussian_lanes(x, GAUSSIAN_LANES, y, GAUSSIAN_LANES, width, GAUSSIAN_LANES, lmin, lmax, coef);
+
+    for(int r = 0; r < rows && j0 + r < height; r++)
+    {
+      float *const row = out + (size_t)(j0 + r) * stride;
+      for(int i = 0; i < width; i++)
+        for(int k = 0; k < ch; k++) row[(size_t)i * ch + k] = y[(size_t)i * GAUSSIAN_LANES + r * ch + k];
+    }
+  }
+
+  dt_free_align(strips);
+  return TRUE;
+}
+
+#undef DT_GAUSSIAN_BLUR_BLOCKED
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -40,6 +40,10 @@ typedef struct dt_gpx_t
   /* the list of track records parsed */
   GList *track;
 
+  /* the same sorted by time, for the lookups */
+  _gpx_track_point_t **points;
+  guint count;
+
   /* currently parsed track point */
   _gpx_track_point_t *current_track_point;
   _gpx_parser_element_t current_parser_element;
@@ -107,6 +111,11 @@ dt_gpx_t *dt_gpx_new(const gchar *filename)
   /* safeguard against corrupt gpx files that have the points not ordered by time */
   gpx->track = g_list_sort(gpx->track, _sort_track);
 
+  gpx->count = g_list_length(gpx->track);
+  gpx->points = g_malloc_n(MAX(gpx->count, 1), sizeof(_gpx_track_point_t *));
+  guint i = 0;
+  for(GList *item = gpx->track; item; item = g_list_next(item)) gpx->points[i++] = item->data;
+
   return gpx;
 
 error:
@@ -130,6 +139,7 @@ void dt_gpx_destroy(struct dt_gpx_t *gpx)
   g_assert(gpx != NULL);
 
   if(gpx->track) g_list_free_full(gpx->track, g_free);
+  g_free(gpx->points);
 
   g_free(gpx);
 }
@@ -138,40 +148,28 @@ gboolean dt_gpx_get_location(struct dt_gpx_t *gpx, GTimeVal *timestamp, dt_image
 {
   g_assert(gpx != NULL);
 
-  GList *item = g_list_first(gpx->track);
-
   /* verify that we got at least 2 trackpoints */
-  if(!item || !item->next) return FALSE;
+  if(gpx->count < 2) return FALSE;
 
-  do
+  /* the first point not before timestamp, the one before it starts the segment timestamp is in */
+  guint lo = 0, hi = gpx->count;
+  while(lo < hi)
   {
+    const guint mid = lo + (hi - lo) / 2;
+    if(gpx->points[mid]->time.tv_sec < timestamp->tv_sec)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
 
-    _gpx_track_point_t *tp = (_gpx_track_point_t *)item->data;
-
-    /* if timestamp is out of time range return false but fill
-       closest location value start or end point */
-    if((!item->next && timestamp->tv_sec >= tp->time.tv_sec) || (timestamp->tv_sec <= tp->time.tv_sec))
-    {
-      geoloc->longitude = tp->longitude;
-      geoloc->latitude = tp->latitude;
-      geoloc->elevation = tp->elevation;
-      return FALSE;
-    }
-
-    /* check if timestamp is within current and next trackpoint */
-    if(timestamp->tv_sec >= tp->time.tv_sec
-       && timestamp->tv_sec <= ((_gpx_track_point_t *)item->next->data)->time.tv_sec)
-    {
-      geoloc->longitude = tp->longitude;
-      geoloc->latitude = tp->latitude;
-      geoloc->elevation = tp->elevation;
-      return TRUE;
-    }
-
-  } while((item = g_list_next(item)) != NULL);
-
-  /* should not reach this point */
-  return FALSE;
+  /* if timestamp is out of time range return false but fill
+     closest location value start or end point */
+  const gboolean inside = lo > 0 && lo < gpx->count;
+  const _gpx_track_point_t *tp = gpx->points[lo == 0 ? 0 : lo - 1];
+  geoloc->longitude = tp->longitude;
+  geoloc->latitude = tp->latitude;
+  geoloc->elevation = tp->elevation;
+  return inside;
 }
 
 /*
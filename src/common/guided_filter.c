@@ -58,19 +58,6 @@ typedef struct gray_image
   int width, height;
 } gray_image;
 
-// allocate space for 1-component image of size width x height
-static inline gray_image new_gray_image(int width, int height)
-{
-  return (gray_image){ dt_alloc_align(64, sizeof(float) * width * height), width, height };
-}
-
-// free space for 1-component image
-static inline void free_gray_image(gray_image *img_p)
-{
-  dt_free_align(img_p->data);
-  img_p->data = NULL;
-}
-
 // minimum of two integers
 static inline int min_i(int a, int b)
 {
@@ -83,99 +70,105 @@ static inline int max_i(int a, int b)
   return a > b ? a : b;
 }
 
-// Kahan summation algorithm
-static inline float Kahan_sum(const float m, float *c, const float add)
+#define DT_BOX_MEAN_LANES dt_box_mean_lanes_plain
+#include "common/guided_filter_box_mean.h"
+
+typedef void(dt_box_mean_lanes_t)(float *const x, const size_t stride, const int N, const int n, const int w,
+                                  float *const ring, float *const m, float *const c);
+
+#ifdef HAVE_AVX2_CODEPATH
+dt_box_mean_lanes_t dt_box_mean_lanes_avx2;
+#endif
+
+static dt_box_mean_lanes_t *box_mean_lanes()
 {
-   const float t1 = add - (*c);
-   const float t2 = m + t1;
-   *c = (t2 - m) - t1;
-   return t2;
+#ifdef HAVE_AVX2_CODEPATH
+  if(darktable.codepath.AVX2) return dt_box_mean_lanes_avx2;
+#endif
+  return dt_box_mean_lanes_plain;
 }
 
-// calculate the one-dimensional moving average over a window of size 2*w+1
-// input array x has stride 1, output array y has stride stride_y
-static inline void box_mean_1d(int N, const float *x, float *y, size_t stride_y, int w)
+// number of lanes the vertical pass runs on at once
+#define BOX_MEAN_CHUNK 256
+
+// floats of scratch space box_mean_rows() and box_mean_columns() need
+static inline size_t box_mean_scratch(const int ch, const int w)
 {
-  float m = 0.f, n_box = 0.f, c = 0.f;
-  if(N > 2 * w)
-  {
-    for(int i = 0, i_end = w + 1; i < i_end; i++)
-    {
-      m = Kahan_sum(m, &c, x[i]);
-      n_box++;
-    }
-    for(int i = 0, i_end = w; i < i_end; i++)
-    {
-      y[i * stride_y] = m / n_box;
-      m = Kahan_sum(m, &c, x[i + w + 1]);
-      n_box++;
-    }
-    for(int i = w, i_end = N - w - 1; i < i_end; i++)
-    {
-      y[i * stride_y] = m / n_box;
-      m = Kahan_sum(m, &c, x[i + w + 1]),
-      m = Kahan_sum(m, &c, -x[i - w]);
-    }
-    for(int i = N - w - 1, i_end = N; i < i_end; i++)
-    {
-      y[i * stride_y] = m / n_box;
-      m = Kahan_sum(m, &c, -x[i - w]);
-      n_box--;
-    }
-  }
-  else
+  return (size_t)(w + 3) * max_i(ch, BOX_MEAN_CHUNK);
+}
+
+// horizontal moving average of the rows [j0, j1) of an image of ch interleaved channels
+static void box_mean_rows(dt_box_mean_lanes_t *lanes, float *const buf, const int width, const int ch,
+                          const int w, const int j0, const int j1, float *const scratch)
+{
+  for(int j = j0; j < j1; j++)
+    lanes(buf + (size_t)j * width * ch, ch, width, ch, w, scratch, scratch + (size_t)(w + 1) * ch,
+          scratch + (size_t)(w + 2) * ch);
+}
+
+// vertical moving average of the values [l0, l1) of all rows, BOX_MEAN_CHUNK of them at a time
+static void box_mean_columns(dt_box_mean_lanes_t *lanes, float *const buf, const int width, const int height,
+                             const int ch, const int w, const size_t l0, const size_t l1, float *const scratch)
+{
+  for(size_t l = l0; l < l1; l += BOX_MEAN_CHUNK)
   {
-    for(int i = 0, i_end = min_i(w + 1, N); i < i_end; i++)
-    {
-      m = Kahan_sum(m, &c, x[i]);
-      n_box++;
-    }
-    for(int i = 0; i < N; i++)
-    {
-      y[i * stride_y] = m / n_box;
-      if(i - w >= 0)
-      {
-        m = Kahan_sum(m, &c, -x[i - w]);
-        n_box--;
-      }
-      if(i + w + 1 < N)
-      {
-        m = Kahan_sum(m, &c, x[i + w + 1]);
-        n_box++;
-      }
-    }
+    const int n = l1 - l < BOX_MEAN_CHUNK ? l1 - l : BOX_MEAN_CHUNK;
+    lanes(buf + l, (size_t)width * ch, height, n, w, scratch, scratch + (size_t)(w + 1) * n,
+          scratch + (size_t)(w + 2) * n);
   }
 }
 
-// calculate the two-dimensional moving average over a box of size (2*w+1) x (2*w+1)
-// does the calculation in-place if input and output images are identical
+// calculate the two-dimensional moving average over a box of size (2*w+1) x (2*w+1) in-place, for all ch
+// channels of the image at once
 // this function is always called from a OpenMP thread, thus no parallelization
-static void box_mean(gray_image img1, gray_image img2, int w)
+static void box_mean(float *const buf, const int width, const int height, const int ch, const int w)
 {
-  gray_image img2_bak;
-  if(img1.data == img2.data)
-  {
-    img2_bak = new_gray_image(max_i(img2.width, img2.height), 1);
-    for(int i1 = 0; i1 < img2.height; i1++)
-    {
-      memcpy(img2_bak.data, img2.data + (size_t)i1 * img2.width, sizeof(float) * img2.width);
-      box_mean_1d(img2.width, img2_bak.data, img2.data + (size_t)i1 * img2.width, 1, w);
-    }
-  }
-  else
-  {
-    for(int i1 = 0; i1 < img1.height; i1++)
-      box_mean_1d(img1.width, img1.data + (size_t)i1 * img1.width, img2.data + (size_t)i1 * img2.width, 1, w);
-    img2_bak = new_gray_image(1, img2.height);
-  }
-  for(int i0 = 0; i0 < img1.width; i0++)
+  dt_box_mean_lanes_t *lanes = box_mean_lanes();
+  float *const scratch = dt_alloc_align(64, sizeof(float) * box_mean_scratch(ch, w));
+  box_mean_rows(lanes, buf, width, ch, w, 0, height, scratch);
+  box_mean_columns(lanes, buf, width, height, ch, w, 0, (size_t)width * ch, scratch);
+  dt_free_align(scratch);
+}
+
+void dt_box_mean(float *const buf, const size_t height, const size_t width, const int ch, const int radius)
+{
+  dt_box_mean_lanes_t *lanes = box_mean_lanes();
+  const size_t scratch_size = box_mean_scratch(ch, radius);
+  float *const scratch = dt_alloc_align(64, sizeof(float) * scratch_size * dt_get_num_threads());
+  const size_t values = width * ch;
+  const int chunks = (values + BOX_MEAN_CHUNK - 1) / BOX_MEAN_CHUNK;
+
+#ifdef _OPENMP
+#pragma omp parallel default(none) \
+  dt_omp_firstprivate(buf, height, width, ch, radius, lanes, scratch, scratch_size, values, chunks)
+#endif
   {
-    for(int i1 = 0; i1 < img1.height; i1++) img2_bak.data[i1] = img2.data[i0 + (size_t)i1 * img2.width];
-    box_mean_1d(img1.height, img2_bak.data, img2.data + i0, img1.width, w);
+    float *const s = scratch + scratch_size * dt_get_thread_num();
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+    for(int j = 0; j < (int)height; j++) box_mean_rows(lanes, buf, width, ch, radius, j, j + 1, s);
+
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+    for(int k = 0; k < chunks; k++)
+      box_mean_columns(lanes, buf, width, height, ch, radius, (size_t)k * BOX_MEAN_CHUNK,
+                       MIN(values, (size_t)(k + 1) * BOX_MEAN_CHUNK), s);
   }
-  free_gray_image(&img2_bak);
+
+  dt_free_align(scratch);
 }
 
+// the channels of the single buffer of guided_filter_tiling(), means first
+enum
+{
+  GF_MEAN_R, GF_MEAN_G, GF_MEAN_B, GF_MEAN_P,
+  GF_COV_R, GF_COV_G, GF_COV_B,
+  GF_VAR_RR, GF_VAR_RG, GF_VAR_RB, GF_VAR_GG, GF_VAR_GB, GF_VAR_BB,
+  GF_CHANNELS
+};
+
 // apply guided filter to single-component image img using the 3-components
 // image imgg as a guide
 static void guided_filter_tiling(color_image imgg, gray_image img, gray_image img_out, tile target, const int w,
@@ -186,37 +179,9 @@ static void guided_filter_tiling(color_image imgg, gray_image img, gray_image im
   const int width = source.right - source.left;
   const int height = source.upper - source.lower;
   size_t size = (size_t)width * (size_t)height;
-  gray_image imgg_mean_r = new_gray_image(width, height);
-  gray_image imgg_mean_g = new_gray_image(width, height);
-  gray_image imgg_mean_b = new_gray_image(width, height);
-  gray_image img_mean = new_gray_image(width, height);
-  for(int j_imgg = source.lower; j_imgg < source.upper; j_imgg++)
-  {
-    int j = j_imgg - source.lower;
-    for(int i_imgg = source.left; i_imgg < source.right; i_imgg++)
-    {
-      int i = i_imgg - source.left;
-      float *pixel = get_color_pixel(imgg, i_imgg + (size_t)j_imgg * imgg.width);
-      size_t k = i + (size_t)j * width;
-      imgg_mean_r.data[k] = pixel[0] * guide_weight;
-      imgg_mean_g.data[k] = pixel[1] * guide_weight;
-      imgg_mean_b.data[k] = pixel[2] * guide_weight;
-      img_mean.data[k] = img.data[i_imgg + (size_t)j_imgg * img.width];
-    }
-  }
-  box_mean(imgg_mean_r, imgg_mean_r, w);
-  box_mean(imgg_mean_g, imgg_mean_g, w);
-  box_mean(imgg_mean_b, imgg_mean_b, w);
-  box_mean(img_mean, img_mean, w);
-  gray_image cov_imgg_img_r = new_gray_image(width, height);
-  gray_image cov_imgg_img_g = new_gray_image(width, height);
-  gray_image cov_imgg_img_b = new_gray_image(width, height);
-  gray_image var_imgg_rr = new_gray_image(width, height);
-  gray_image var_imgg_gg = new_gray_image(width, height);
-  gray_image var_imgg_bb = new_gray_image(width, height);
-  gray_image var_imgg_rg = new_gray_image(width, height);
-  gray_image var_imgg_rb = new_gray_image(width, height);
-  gray_image var_imgg_gb = new_gray_image(width, height);
+  // the means of the guide and of img, the covariances of guide and img and the variances of the guide are
+  // interleaved in one buffer and averaged in a single sweep
+  float *const moments = dt_alloc_align(64, sizeof(float) * GF_CHANNELS * size);
   for(int j_imgg = source.lower; j_imgg < source.upper; j_imgg++)
   {
     int j = j_imgg - source.lower;
@@ -225,134 +190,98 @@ static void guided_filter_tiling(color_image imgg, gray_image img, gray_image im
       int i = i_imgg - source.left;
       float *pixel_ = get_color_pixel(imgg, i_imgg + (size_t)j_imgg * imgg.width);
       float pixel[3] = { pixel_[0] * guide_weight, pixel_[1] * guide_weight, pixel_[2] * guide_weight };
-      size_t k = i + (size_t)j * width;
-      cov_imgg_img_r.data[k] = pixel[0] * img.data[i_imgg + (size_t)j_imgg * imgg.width];
-      cov_imgg_img_g.data[k] = pixel[1] * img.data[i_imgg + (size_t)j_imgg * imgg.width];
-      cov_imgg_img_b.data[k] = pixel[2] * img.data[i_imgg + (size_t)j_imgg * imgg.width];
-      var_imgg_rr.data[k] = pixel[0] * pixel[0];
-      var_imgg_rg.data[k] = pixel[0] * pixel[1];
-      var_imgg_rb.data[k] = pixel[0] * pixel[2];
-      var_imgg_gg.data[k] = pixel[1] * pixel[1];
-      var_imgg_gb.data[k] = pixel[1] * pixel[2];
-      var_imgg_bb.data[k] = pixel[2] * pixel[2];
+      const float p = img.data[i_imgg + (size_t)j_imgg * img.width];
+      float *const v = moments + GF_CHANNELS * (i + (size_t)j * width);
+      v[GF_MEAN_R] = pixel[0];
+      v[GF_MEAN_G] = pixel[1];
+      v[GF_MEAN_B] = pixel[2];
+      v[GF_MEAN_P] = p;
+      v[GF_COV_R] = pixel[0] * p;
+      v[GF_COV_G] = pixel[1] * p;
+      v[GF_COV_B] = pixel[2] * p;
+      v[GF_VAR_RR] = pixel[0] * pixel[0];
+      v[GF_VAR_RG] = pixel[0] * pixel[1];
+      v[GF_VAR_RB] = pixel[0] * pixel[2];
+      v[GF_VAR_GG] = pixel[1] * pixel[1];
+      v[GF_VAR_GB] = pixel[1] * pixel[2];
+      v[GF_VAR_BB] = pixel[2] * pixel[2];
     }
   }
-  box_mean(cov_imgg_img_r, cov_imgg_img_r, w);
-  box_mean(cov_imgg_img_g, cov_imgg_img_g, w);
-  box_mean(cov_imgg_img_b, cov_imgg_img_b, w);
-  box_mean(var_imgg_rr, var_imgg_rr, w);
-  box_mean(var_imgg_rg, var_imgg_rg, w);
-  box_mean(var_imgg_rb, var_imgg_rb, w);
-  box_mean(var_imgg_gg, var_imgg_gg, w);
-  box_mean(var_imgg_gb, var_imgg_gb, w);
-  box_mean(var_imgg_bb, var_imgg_bb, w);
+  box_mean(moments, width, height, GF_CHANNELS, w);
+  // the coefficients a_r, a_g, a_b and b are packed into the first 4 * size floats of the buffer, pixel i only
+  // overwrites values of the pixels up to i
+  float *const ab = moments;
   for(size_t i = 0; i < size; i++)
   {
-    cov_imgg_img_r.data[i] -= imgg_mean_r.data[i] * img_mean.data[i];
-    cov_imgg_img_g.data[i] -= imgg_mean_g.data[i] * img_mean.data[i];
-    cov_imgg_img_b.data[i] -= imgg_mean_b.data[i] * img_mean.data[i];
-    var_imgg_rr.data[i] -= imgg_mean_r.data[i] * imgg_mean_r.data[i];
-    var_imgg_rr.data[i] += eps;
-    var_imgg_rg.data[i] -= imgg_mean_r.data[i] * imgg_mean_g.data[i];
-    var_imgg_rb.data[i] -= imgg_mean_r.data[i] * imgg_mean_b.data[i];
-    var_imgg_gg.data[i] -= imgg_mean_g.data[i] * imgg_mean_g.data[i];
-    var_imgg_gg.data[i] += eps;
-    var_imgg_gb.data[i] -= imgg_mean_g.data[i] * imgg_mean_b.data[i];
-    var_imgg_bb.data[i] -= imgg_mean_b.data[i] * imgg_mean_b.data[i];
-    var_imgg_bb.data[i] += eps;
-  }
-  // we will recycle memory of the arrays imgg_mean_? and img_mean for the new coefficient arrays a_? and b to
-  // reduce memory foot print
-  gray_image a_r = imgg_mean_r;
-  gray_image a_g = imgg_mean_g;
-  gray_image a_b = imgg_mean_b;
-  gray_image b = img_mean;
-  for(int i1 = 0; i1 < height; i1++)
-  {
-    size_t i = (size_t)i1 * width;
-    for(int i0 = 0; i0 < width; i0++)
+    const float *const v = moments + GF_CHANNELS * i;
+    const float imgg_mean_r = v[GF_MEAN_R], imgg_mean_g = v[GF_MEAN_G], imgg_mean_b = v[GF_MEAN_B];
+    const float img_mean = v[GF_MEAN_P];
+    // solve linear system of equations of size 3x3 via Cramer's rule
+    // symmetric coefficient matrix
+    const float Sigma_0_0 = v[GF_VAR_RR] - imgg_mean_r * imgg_mean_r + eps;
+    const float Sigma_0_1 = v[GF_VAR_RG] - imgg_mean_r * imgg_mean_g;
+    const float Sigma_0_2 = v[GF_VAR_RB] - imgg_mean_r * imgg_mean_b;
+    const float Sigma_1_1 = v[GF_VAR_GG] - imgg_mean_g * imgg_mean_g + eps;
+    const float Sigma_1_2 = v[GF_VAR_GB] - imgg_mean_g * imgg_mean_b;
+    const float Sigma_2_2 = v[GF_VAR_BB] - imgg_mean_b * imgg_mean_b + eps;
+    const float cov_imgg_img[3] = { v[GF_COV_R] - imgg_mean_r * img_mean, v[GF_COV_G] - imgg_mean_g * img_mean,
+                                    v[GF_COV_B] - imgg_mean_b * img_mean };
+    const float det0 = Sigma_0_0 * (Sigma_1_1 * Sigma_2_2 - Sigma_1_2 * Sigma_1_2)
+                       - Sigma_0_1 * (Sigma_0_1 * Sigma_2_2 - Sigma_0_2 * Sigma_1_2)
+                       + Sigma_0_2 * (Sigma_0_1 * Sigma_1_2 - Sigma_0_2 * Sigma_1_1);
+    float a_r_, a_g_, a_b_;
+    if(fabsf(det0) > 4.f * FLT_EPSILON)
+    {
+      const float det1 = cov_imgg_img[0] * (Sigma_1_1 * Sigma_2_2 - Sigma_1_2 * Sigma_1_2)
+                         - Sigma_0_1 * (cov_imgg_img[1] * Sigma_2_2 - cov_imgg_img[2] * Sigma_1_2)
+                         + Sigma_0_2 * (cov_imgg_img[1] * Sigma_1_2 - cov_imgg_img[2] * Sigma_1_1);
+      const float det2 = Sigma_0_0 * (cov_imgg_img[1] * Sigma_2_2 - cov_imgg_img[2] * Sigma_1_2)
+                         - cov_imgg_img[0] * (Sigma_0_1 * Sigma_2_2 - Sigma_0_2 * Sigma_1_2)
+                         + Sigma_0_2 * (Sigma_0_1 * cov_imgg_img[2] - Sigma_0_2 * cov_imgg_img[1]);
+      const float det3 = Sigma_0_0 * (Sigma_1_1 * cov_imgg_img[2] - Sigma_1_2 * cov_imgg_img[1])
+                         - Sigma_0_1 * (Sigma_0_1 * cov_imgg_img[2] - Sigma_0_2 * cov_imgg_img[1])
+                         + cov_imgg_img[0] * (Sigma_0_1 * Sigma_1_2 - Sigma_0_2 * Sigma_1_1);
+      a_r_ = det1 / det0;
+      a_g_ = det2 / det0;
+      a_b_ = det3 / det0;
+    }
+    else
     {
-      // solve linear system of equations of size 3x3 via Cramer's rule
-      // symmetric coefficient matrix
-      const float Sigma_0_0 = var_imgg_rr.data[i];
-      const float Sigma_0_1 = var_imgg_rg.data[i];
-      const float Sigma_0_2 = var_imgg_rb.data[i];
-      const float Sigma_1_1 = var_imgg_gg.data[i];
-      const float Sigma_1_2 = var_imgg_gb.data[i];
-      const float Sigma_2_2 = var_imgg_bb.data[i];
-      const float cov_imgg_img[3] = { cov_imgg_img_r.data[i], cov_imgg_img_g.data[i], cov_imgg_img_b.data[i] };
-      const float det0 = Sigma_0_0 * (Sigma_1_1 * Sigma_2_2 - Sigma_1_2 * Sigma_1_2)
-                         - Sigma_0_1 * (Sigma_0_1 * Sigma_2_2 - Sigma_0_2 * Sigma_1_2)
-                         + Sigma_0_2 * (Sigma_0_1 * Sigma_1_2 - Sigma_0_2 * Sigma_1_1);
-      float a_r_, a_g_, a_b_;
-      if(fabsf(det0) > 4.f * FLT_EPSILON)
-      {
-        const float det1 = cov_imgg_img[0] * (Sigma_1_1 * Sigma_2_2 - Sigma_1_2 * Sigma_1_2)
-                           - Sigma_0_1 * (cov_imgg_img[1] * Sigma_2_2 - cov_imgg_img[2] * Sigma_1_2)
-                           + Sigma_0_2 * (cov_imgg_img[1] * Sigma_1_2 - cov_imgg_img[2] * Sigma_1_1);
-        const float det2 = Sigma_0_0 * (cov_imgg_img[1] * Sigma_2_2 - cov_imgg_img[2] * Sigma_1_2)
-                           - cov_imgg_img[0] * (Sigma_0_1 * Sigma_2_2 - Sigma_0_2 * Sigma_1_2)
-                           + Sigma_0_2 * (Sigma_0_1 * cov_imgg_img[2] - Sigma_0_2 * cov_imgg_img[1]);
-        const float det3 = Sigma_0_0 * (Sigma_1_1 * cov_imgg_img[2] - Sigma_1_2 * cov_imgg_img[1])
-                           - Sigma_0_1 * (Sigma_0_1 * cov_imgg_img[2] - Sigma_0_2 * cov_imgg_img[1])
-                           + cov_imgg_img[0] * (Sigma_0_1 * Sigma_1_2 - Sigma_0_2 * Sigma_1_1);
-        a_r_ = det1 / det0;
-        a_g_ = det2 / det0;
-        a_b_ = det3 / det0;
-      }
-      else
-      {
-        // linear system is singular
-        a_r_ = 0.f;
-        a_g_ = 0.f;
-        a_b_ = 0.f;
-      }
-      b.data[i] -= a_r_ * imgg_mean_r.data[i];
-      b.data[i] -= a_g_ * imgg_mean_g.data[i];
-      b.data[i] -= a_b_ * imgg_mean_b.data[i];
-      // now data of imgg_mean_? is no longer needed, we can safely overwrite aliasing arrays
-      a_r.data[i] = a_r_;
-      a_g.data[i] = a_g_;
-      a_b.data[i] = a_b_;
-      ++i;
+      // linear system is singular
+      a_r_ = 0.f;
+      a_g_ = 0.f;
+      a_b_ = 0.f;
     }
+    float b = img_mean;
+    b -= a_r_ * imgg_mean_r;
+    b -= a_g_ * imgg_mean_g;
+    b -= a_b_ * imgg_mean_b;
+    ab[4 * i + 0] = a_r_;
+    ab[4 * i + 1] = a_g_;
+    ab[4 * i + 2] = a_b_;
+    ab[4 * i + 3] = b;
   }
-  box_mean(a_r, a_r, w);
-  box_mean(a_g, a_g, w);
-  box_mean(a_b, a_b, w);
-  box_mean(b, b, w);
+  box_mean(ab, width, height, 4, w);
   for(int j_imgg = target.lower; j_imgg < target.upper; j_imgg++)
   {
     // index of the left most target pixel in the current row
     size_t l = target.left + (size_t)j_imgg * imgg.width;
     // index of the left most source pixel in the current row of the
-    // smaller auxiliary gray-scale images a_r, a_g, a_b, and b
+    // smaller auxiliary coefficients a_r, a_g, a_b, and b
     // excluding boundary data from neighboring tiles
     size_t k = (target.left - source.left) + (size_t)(j_imgg - source.lower) * width;
     for(int i_imgg = target.left; i_imgg < target.right; i_imgg++, k++, l++)
     {
       float *pixel = get_color_pixel(imgg, l);
-      float res = a_r.data[k] * pixel[0] + a_g.data[k] * pixel[1] + a_b.data[k] * pixel[2];
+      float res = ab[4 * k + 0] * pixel[0] + ab[4 * k + 1] * pixel[1] + ab[4 * k + 2] * pixel[2];
       res *= guide_weight;
-      res += b.data[k];
+      res += ab[4 * k + 3];
       if(res < min) res = min;
       if(res > max) res = max;
       img_out.data[i_imgg + (size_t)j_imgg * imgg.width] = res;
     }
   }
-  free_gray_image(&var_imgg_rr);
-  free_gray_image(&var_imgg_rg);
-  free_gray_image(&var_imgg_rb);
-  free_gray_image(&var_imgg_gg);
-  free_gray_image(&var_imgg_gb);
-  free_gray_image(&var_imgg_bb);
-  free_gray_image(&cov_imgg_img_r);
-  free_gray_image(&cov_imgg_img_g);
-  free_gray_image(&cov_imgg_img_b);
-  free_gray_image(&img_mean);
-  free_gray_image(&imgg_mean_r);
-  free_gray_image(&imgg_mean_g);
-  free_gray_image(&imgg_mean_b);
+  dt_free_align(moments);
 }
 
 
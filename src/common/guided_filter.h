@@ -20,11 +20,17 @@
 
 #include "common/opencl.h"
 
+#include <stddef.h>
+
 struct dt_iop_roi_t;
 
 void guided_filter(const float *guide, const float *in, float *out, int width, int height, int ch, int w,
                    float sqrt_eps, float guide_weight, float min, float max);
 
+// in-place moving average over a box of size (2*radius+1) x (2*radius+1) of an image of ch interleaved
+// channels, the box is cut at the borders. the same Kahan sums as guided_filter().
+void dt_box_mean(float *buf, size_t height, size_t width, int ch, int radius);
+
 #ifdef HAVE_OPENCL
 
 typedef struct dt_guided_filter_cl_global_t
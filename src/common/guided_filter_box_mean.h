@@ -0,0 +1,141 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// the moving average of guided_filter.c on many lanes at once. included by guided_filter.c and by
+// guided_filter_avx2.c, which is built with the AVX2 flags. define DT_BOX_MEAN_LANES to the name of the
+// function before including.
+//
+// the lanes are the channels of a row for the horizontal pass and all the values of a row for the vertical
+// pass. every lane sees the Kahan sums of the former one dimensional box mean in the same order.
+
+#include <stddef.h>
+
+#ifdef _OPENMP
+#define BOX_MEAN_SIMD _Pragma("omp simd")
+#else
+#define BOX_MEAN_SIMD
+#endif
+
+// m += x[i * stride + l] with the compensation c, for all lanes
+#define BOX_MEAN_ADD(i)                                                                                      \
+  {                                                                                                          \
+    const float *const xi = x + (size_t)(i) * stride;                                                        \
+    BOX_MEAN_SIMD                                                                                            \
+    for(int l = 0; l < n; l++)                                                                               \
+    {                                                                                                        \
+      const float t1 = xi[l] - c[l];                                                                         \
+      const float t2 = m[l] + t1;                                                                            \
+      c[l] = (t2 - m[l]) - t1;                                                                               \
+      m[l] = t2;                                                                                             \
+    }                                                                                                        \
+  }
+
+// m -= the sample i, which has already been overwritten and is taken from the ring
+#define BOX_MEAN_SUB(i)                                                                                      \
+  {                                                                                                          \
+    const float *const ri = ring + (size_t)((i) % (w + 1)) * n;                                              \
+    BOX_MEAN_SIMD                                                                                            \
+    for(int l = 0; l < n; l++)                                                                               \
+    {                                                                                                        \
+      const float t1 = -ri[l] - c[l];                                                                        \
+      const float t2 = m[l] + t1;                                                                            \
+      c[l] = (t2 - m[l]) - t1;                                                                               \
+      m[l] = t2;                                                                                             \
+    }                                                                                                        \
+  }
+
+// keeps sample i in the ring and replaces it by the mean
+#define BOX_MEAN_OUT(i)                                                                                      \
+  {                                                                                                          \
+    float *const xi = x + (size_t)(i) * stride;                                                              \
+    float *const ri = ring + (size_t)((i) % (w + 1)) * n;                                                    \
+    BOX_MEAN_SIMD                                                                                            \
+    for(int l = 0; l < n; l++)                                                                               \
+    {                                                                                                        \
+      ri[l] = xi[l];                                                                                         \
+      xi[l] = m[l] / n_box;                                                                                  \
+    }                                                                                                        \
+  }
+
+// replaces the N samples of n lanes, sample i of lane l at x[i * stride + l], by their moving average over a
+// window of size 2*w+1. ring holds (w + 1) * n floats, m and c n floats each.
+void DT_BOX_MEAN_LANES(float *const x, const size_t stride, const int N, const int n, const int w,
+                       float *const ring, float *const m, float *const c)
+{
+  float n_box = 0.f;
+  for(int l = 0; l < n; l++) m[l] = c[l] = 0.f;
+
+  if(N > 2 * w)
+  {
+    for(int i = 0; i < w + 1; i++)
+    {
+      BOX_MEAN_ADD(i);
+      n_box++;
+    }
+    for(int i = 0; i < w; i++)
+    {
+      BOX_MEAN_OUT(i);
+      BOX_MEAN_ADD(i + w + 1);
+      n_box++;
+    }
+    for(int i = w; i < N - w - 1; i++)
+    {
+      BOX_MEAN_OUT(i);
+      BOX_MEAN_ADD(i + w + 1);
+      BOX_MEAN_SUB(i - w);
+    }
+    for(int i = N - w - 1; i < N; i++)
+    {
+      BOX_MEAN_OUT(i);
+      BOX_MEAN_SUB(i - w);
+      n_box--;
+    }
+  }
+  else
+  {
+    for(int i = 0; i < w + 1 && i < N; i++)
+    {
+      BOX_MEAN_ADD(i);
+      n_box++;
+    }
+    for(int i = 0; i < N; i++)
+    {
+      BOX_MEAN_OUT(i);
+      if(i - w >= 0)
+      {
+        BOX_MEAN_SUB(i - w);
+        n_box--;
+      }
+      if(i + w + 1 < N)
+      {
+        BOX_MEAN_ADD(i + w + 1);
+        n_box++;
+      }
+    }
+  }
+}
+
+#undef BOX_MEAN_OUT
+#undef BOX_MEAN_SUB
+#undef BOX_MEAN_ADD
+#undef BOX_MEAN_SIMD
+#undef DT_BOX_MEAN_LANES
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -27,13 +27,62 @@
 #include "common/colorspaces_inline_conversions.h"
 #include "common/darktable.h"
 #include "common/histogram.h"
+#include "common/opencl.h"
 #include "develop/imageop.h"
 
+#define DT_HISTOGRAM_BINS dt_histogram_bins_plain
+#include "common/histogram_bins.h"
+
 #define S(V, params) ((params->mul) * ((float)V))
 #define P(V, params) (CLAMP((V), 0, (params->bins_count - 1)))
 #define PU(V, params) (MIN((V), (params->bins_count - 1)))
 #define PS(V, params) (P(S(V, params), params))
 
+// pixels whose bins are looked up in one go, small enough for the stack
+#define BINS_RUN 256
+
+typedef void(dt_histogram_bins_t)(const float *const in, uint32_t *const bins, const int n, const int step,
+                                  const float *const scale, const float *const shift, const float max);
+
+#ifdef HAVE_AVX2_CODEPATH
+dt_histogram_bins_t dt_histogram_bins_avx2;
+#endif
+
+// rows and columns are sampled every step pixels, previews don't need all of them
+static inline int _histogram_step(const dt_dev_histogram_collection_params_t *const histogram_params)
+{
+  return MAX(histogram_params->step, 1);
+}
+
+// the sampled pixels of a row of width pixels starting at crop_x
+static inline int _histogram_samples(const int width, const int step)
+{
+  return width > 0 ? (width + step - 1) / step : 0;
+}
+
+// counts the first three channels of the sampled pixels of a 4 channel row, see histogram_bins.h
+static void _histogram_row_binned(const dt_dev_histogram_collection_params_t *const histogram_params,
+                                  const float *const in, uint32_t *histogram, const int width,
+                                  const float *const scale, const float *const shift)
+{
+  dt_histogram_bins_t *lookup = dt_histogram_bins_plain;
+#ifdef HAVE_AVX2_CODEPATH
+  if(darktable.codepath.AVX2) lookup = dt_histogram_bins_avx2;
+#endif
+  const int step = _histogram_step(histogram_params);
+  const int n = _histogram_samples(width, step);
+  const float max = histogram_params->bins_count - 1;
+  uint32_t bins[3 * BINS_RUN];
+
+  for(int i = 0; i < n; i += BINS_RUN)
+  {
+    const int run = MIN(BINS_RUN, n - i);
+    lookup(in + (size_t)4 * i * step, bins, run, step, scale, shift, max);
+    // the partial histogram belongs to this thread, plain increments are enough
+    for(int k = 0; k < 3 * run; k++) histogram[bins[k]]++;
+  }
+}
+
 //------------------------------------------------------------------------------
 
 inline static void histogram_helper_cs_RAW_helper_process_pixel_float(
@@ -48,8 +97,9 @@ inline static void histogram_helper_cs_RAW(const dt_dev_histogram_collection_par
                                            const dt_iop_order_iccprofile_info_t *const profile_info)
 {
   const dt_histogram_roi_t *roi = histogram_params->roi;
+  const int step = _histogram_step(histogram_params);
   const float *input = (float *)pixel + roi->width * j + roi->crop_x;
-  for(int i = 0; i < roi->width - roi->crop_width - roi->crop_x; i++, input++)
+  for(int i = 0; i < roi->width - roi->crop_width - roi->crop_x; i += step, input += step)
   {
     histogram_helper_cs_RAW_helper_process_pixel_float(histogram_params, input, histogram);
   }
@@ -70,26 +120,16 @@ inline void dt_histogram_helper_cs_RAW_uint16(const dt_dev_histogram_collection_
                                               const dt_iop_order_iccprofile_info_t *const profile_info)
 {
   const dt_histogram_roi_t *roi = histogram_params->roi;
+  const int step = _histogram_step(histogram_params);
   uint16_t *in = (uint16_t *)pixel + roi->width * j + roi->crop_x;
 
   // process pixels
-  for(int i = 0; i < roi->width - roi->crop_width - roi->crop_x; i++, in++)
+  for(int i = 0; i < roi->width - roi->crop_width - roi->crop_x; i += step, in += step)
     histogram_helper_cs_RAW_helper_process_pixel_uint16(histogram_params, in, histogram);
 }
 
 //------------------------------------------------------------------------------
 
-inline static void __attribute__((__unused__)) histogram_helper_cs_rgb_helper_process_pixel_float(
-    const dt_dev_histogram_collection_params_t *const histogram_params, const float *pixel, uint32_t *histogram)
-{
-  const uint32_t R = PS(pixel[0], histogram_params);
-  const uint32_t G = PS(pixel[1], histogram_params);
-  const uint32_t B = PS(pixel[2], histogram_params);
-  histogram[4 * R]++;
-  histogram[4 * G + 1]++;
-  histogram[4 * B + 2]++;
-}
-
 inline static void __attribute__((__unused__)) histogram_helper_cs_rgb_helper_process_pixel_float_compensated(
     const dt_dev_histogram_collection_params_t *const histogram_params, const float *pixel, uint32_t *histogram, 
     const dt_iop_order_iccprofile_info_t *const profile_info)
@@ -164,18 +204,27 @@ inline static void histogram_helper_cs_rgb(const dt_dev_histogram_collection_par
                                            const dt_iop_order_iccprofile_info_t *const profile_info)
 {
   const dt_histogram_roi_t *roi = histogram_params->roi;
+  const int step = _histogram_step(histogram_params);
   float *in = (float *)pixel + 4 * (roi->width * j + roi->crop_x);
+  const int width = roi->width - roi->crop_width - roi->crop_x;
+
+  if(darktable.codepath.OPENMP_SIMD || darktable.codepath.AVX2)
+  {
+    const float mul = histogram_params->mul;
+    const float scale[3] = { mul, mul, mul };
+    const float shift[3] = { 0.0f, 0.0f, 0.0f };
+    _histogram_row_binned(histogram_params, in, histogram, width, scale, shift);
+    return;
+  }
 
   // process aligned pixels with SSE
-  for(int i = 0; i < roi->width - roi->crop_width - roi->crop_x; i++, in += 4)
+  for(int i = 0; i < width; i += step, in += 4 * step)
   {
-    if(darktable.codepath.OPENMP_SIMD)
-      histogram_helper_cs_rgb_helper_process_pixel_float(histogram_params, in, histogram);
 #if defined(__SSE2__)
-    else if(darktable.codepath.SSE2)
+    if(darktable.codepath.SSE2)
       histogram_helper_cs_rgb_helper_process_pixel_m128(histogram_params, in, histogram);
-#endif
     else
+#endif
       dt_unreachable_codepath();
   }
 }
@@ -185,10 +234,11 @@ inline static void histogram_helper_cs_rgb_compensated(const dt_dev_histogram_co
                                            const dt_iop_order_iccprofile_info_t *const profile_info)
 {
   const dt_histogram_roi_t *roi = histogram_params->roi;
+  const int step = _histogram_step(histogram_params);
   float *in = (float *)pixel + 4 * (roi->width * j + roi->crop_x);
 
   // process aligned pixels with SSE
-  for(int i = 0; i < roi->width - roi->crop_width - roi->crop_x; i++, in += 4)
+  for(int i = 0; i < roi->width - roi->crop_width - roi->crop_x; i += step, in += 4 * step)
   {
     if(darktable.codepath.OPENMP_SIMD)
       histogram_helper_cs_rgb_helper_process_pixel_float_compensated(histogram_params, in, histogram, profile_info);
@@ -203,21 +253,6 @@ inline static void histogram_helper_cs_rgb_compensated(const dt_dev_histogram_co
 
 //------------------------------------------------------------------------------
 
-inline static void __attribute__((__unused__)) histogram_helper_cs_Lab_helper_process_pixel_float(
-    const dt_dev_histogram_collection_params_t *const histogram_params, const float *pixel, uint32_t *histogram)
-{
-  const float Lv = pixel[0];
-  const float av = pixel[1];
-  const float bv = pixel[2];
-  const float max = histogram_params->bins_count - 1;
-  const uint32_t L = CLAMP(histogram_params->mul / 100.0f * (Lv), 0, max);
-  const uint32_t a = CLAMP(histogram_params->mul / 256.0f * (av + 128.0f), 0, max);
-  const uint32_t b = CLAMP(histogram_params->mul / 256.0f * (bv + 128.0f), 0, max);
-  histogram[4 * L]++;
-  histogram[4 * a + 1]++;
-  histogram[4 * b + 2]++;
-}
-
 #if defined(__SSE2__)
 inline static void histogram_helper_cs_Lab_helper_process_pixel_m128(
     const dt_dev_histogram_collection_params_t *const histogram_params, const float *pixel, uint32_t *histogram)
@@ -253,18 +288,27 @@ inline static void histogram_helper_cs_Lab(const dt_dev_histogram_collection_par
                                            const dt_iop_order_iccprofile_info_t *const profile_info)
 {
   const dt_histogram_roi_t *roi = histogram_params->roi;
+  const int step = _histogram_step(histogram_params);
   float *in = (float *)pixel + 4 * (roi->width * j + roi->crop_x);
+  const int width = roi->width - roi->crop_width - roi->crop_x;
+
+  if(darktable.codepath.OPENMP_SIMD || darktable.codepath.AVX2)
+  {
+    const float mul = histogram_params->mul;
+    const float scale[3] = { mul / 100.0f, mul / 256.0f, mul / 256.0f };
+    const float shift[3] = { 0.0f, 128.0f, 128.0f };
+    _histogram_row_binned(histogram_params, in, histogram, width, scale, shift);
+    return;
+  }
 
   // process aligned pixels with SSE
-  for(int i = 0; i < roi->width - roi->crop_width - roi->crop_x; i++, in += 4)
+  for(int i = 0; i < width; i += step, in += 4 * step)
   {
-    if(darktable.codepath.OPENMP_SIMD)
-      histogram_helper_cs_Lab_helper_process_pixel_float(histogram_params, in, histogram);
 #if defined(__SSE2__)
-    else if(darktable.codepath.SSE2)
+    if(darktable.codepath.SSE2)
       histogram_helper_cs_Lab_helper_process_pixel_m128(histogram_params, in, histogram);
-#endif
     else
+#endif
       dt_unreachable_codepath();
   }
 }
@@ -287,10 +331,11 @@ inline static void histogram_helper_cs_Lab_LCh(const dt_dev_histogram_collection
                                                const dt_iop_order_iccprofile_info_t *const profile_info)
 {
   const dt_histogram_roi_t *roi = histogram_params->roi;
+  const int step = _histogram_step(histogram_params);
   float *in = (float *)pixel + 4 * (roi->width * j + roi->crop_x);
 
   // TODO: process aligned pixels with SSE
-  for(int i = 0; i < roi->width - roi->crop_width - roi->crop_x; i++, in += 4)
+  for(int i = 0; i < roi->width - roi->crop_width - roi->crop_x; i += step, in += 4 * step)
   {
     //    if(darktable.codepath.OPENMP_SIMD)
     histogram_helper_cs_Lab_LCh_helper_process_pixel_float(histogram_params, in, histogram);
@@ -319,14 +364,15 @@ void dt_histogram_worker(dt_dev_histogram_collection_params_t *const histogram_p
   if(histogram_params->mul == 0) histogram_params->mul = (double)(histogram_params->bins_count - 1);
 
   const dt_histogram_roi_t *const roi = histogram_params->roi;
+  const int step = _histogram_step(histogram_params);
 
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(histogram_params, pixel, Worker, profile_info, bins_total, roi) \
+  dt_omp_firstprivate(histogram_params, pixel, Worker, profile_info, bins_total, roi, step) \
   shared(partial_hists) \
   schedule(static)
 #endif
-  for(int j = roi->crop_y; j < roi->height - roi->crop_height; j++)
+  for(int j = roi->crop_y; j < roi->height - roi->crop_height; j += step)
   {
     uint32_t *thread_hist = (uint32_t *)partial_hists + bins_total * omp_get_thread_num();
     Worker(histogram_params, pixel, thread_hist, j, profile_info);
@@ -356,8 +402,8 @@ void dt_histogram_worker(dt_dev_histogram_collection_params_t *const histogram_p
   free(partial_hists);
 
   histogram_stats->bins_count = histogram_params->bins_count;
-  histogram_stats->pixels = (roi->width - roi->crop_width - roi->crop_x)
-                            * (roi->height - roi->crop_height - roi->crop_y);
+  histogram_stats->pixels = _histogram_samples(roi->width - roi->crop_width - roi->crop_x, step)
+                            * _histogram_samples(roi->height - roi->crop_height - roi->crop_y, step);
 }
 
 //------------------------------------------------------------------------------
@@ -393,6 +439,286 @@ void dt_histogram_helper(dt_dev_histogram_collection_params_t *histogram_params,
   }
 }
 
+//------------------------------------------------------------------------------
+
+// columns of the image that go into one column of the waveform. integral sized bins keep the columns equal,
+// otherwise they would show banding. the gui scales the waveform horizontally.
+static inline int _waveform_bin_width(const int width, const int waveform_stride)
+{
+  return ceilf(width / (float)waveform_stride);
+}
+
+// maps the counts of a waveform bin to 0..1 for the gamma correction. does about the same as the old scale for
+// 1MP views, and scales to hidpi.
+static inline float _waveform_scale(const int width, const int height, const int waveform_width,
+                                    const int waveform_height)
+{
+  return 0.5 * 1e6f / (height * width) * (waveform_width * waveform_height) / (350.0f * 233.) / 255.0f;
+}
+
+// TODO make this settable from the gui?
+#define WAVEFORM_GAMMA (1.0 / 1.5)
+
+void dt_histogram_waveform(const float *const input, const int width, const int height, uint8_t *const waveform,
+                           const int waveform_height, const int waveform_stride, uint32_t *waveform_width_out)
+{
+  const int bin_width = _waveform_bin_width(width, waveform_stride);
+  const int waveform_width = ceilf(width / (float)bin_width);
+  *waveform_width_out = waveform_width;
+
+  // max input size should be 1440x900, and with a bin_width of 1,
+  // that makes a maximum possible count of 900 in buf, while even if
+  // waveform buffer is 128 (about smallest possible), bin_width is
+  // 12, making max count of 10,800, still much smaller than uint16_t
+  uint16_t *buf = calloc(waveform_width * waveform_height * 3, sizeof(uint16_t));
+
+  // 1.0 is at 8/9 of the height!
+  const float _height = (float)(waveform_height - 1);
+
+  // count the colors into buf ...
+#ifdef _OPENMP
+#pragma omp parallel for SIMD() default(none) \
+  dt_omp_firstprivate(width, height, bin_width, _height, waveform_width, input, buf) \
+  schedule(static)
+#endif
+  for(int in_y = 0; in_y < height; in_y++)
+  {
+    for(int in_x = 0; in_x < width; in_x++)
+    {
+      const float *const in = input + 4 * (in_y * width + in_x);
+      const int out_x = in_x / bin_width;
+      for(int k = 0; k < 3; k++)
+      {
+        const float v = 1.0f - (8.0f / 9.0f) * in[2 - k];
+        // flipped from dt's CLAMPS so as to treat NaN's as 0 (NaN compares false)
+        const int out_y = (v < 1.0f ? (v > 0.0f ? v : 0.0f) : 1.0f) * _height;
+        __sync_add_and_fetch(buf + (out_x + waveform_width * out_y) * 3 + k, 1);
+      }
+    }
+  }
+
+  // ... and scale that into a nice image. putting the pixels into the image directly gets too
+  // saturated/clips.
+  const float scale = _waveform_scale(width, height, waveform_width, waveform_height);
+  const float gamma = WAVEFORM_GAMMA;
+  // even bin_width 12 and height 900 image gives 10,800 byte cache, more normal will ~1K
+  const int cache_size = (height * bin_width) + 1;
+  uint8_t *cache = (uint8_t *)calloc(cache_size, sizeof(uint8_t));
+
+#ifdef _OPENMP
+#pragma omp parallel for SIMD() default(none) \
+  dt_omp_firstprivate(waveform_width, waveform_height, waveform_stride, buf, waveform, cache, scale, gamma) \
+  schedule(static) collapse(2)
+#endif
+  for(int k = 0; k < 3; k++)
+  {
+    for(int out_y = 0; out_y < waveform_height; out_y++)
+    {
+      const uint16_t *const in = buf + (waveform_width * out_y) * 3 + k;
+      uint8_t *const out = waveform + (waveform_stride * (waveform_height * k + out_y));
+      for(int out_x = 0; out_x < waveform_width; out_x++)
+      {
+        const uint16_t v = in[out_x * 3];
+        // cache XORd result so common casees cached and cache misses are quick to find
+        if(!cache[v])
+        {
+          // multiple threads may be writing to cache[v], but as
+          // they're writing the same value, don't declare omp atomic
+          cache[v] = (uint8_t)(CLAMP(powf(v * scale, gamma) * 255.0, 0, 255)) ^ 1;
+        }
+        out[out_x] = cache[v] ^ 1;
+      }
+    }
+  }
+
+  free(cache);
+  free(buf);
+}
+
+#ifdef HAVE_OPENCL
+// keep in sync with histogram.cl
+typedef enum dt_histogram_cl_mode_t
+{
+  DT_HISTOGRAM_CL_RAW = 0,
+  DT_HISTOGRAM_CL_RGB = 1,
+  DT_HISTOGRAM_CL_LAB = 2,
+  DT_HISTOGRAM_CL_LCH = 3
+} dt_histogram_cl_mode_t;
+
+dt_histogram_cl_global_t *dt_histogram_init_cl_global(void)
+{
+  dt_histogram_cl_global_t *g = malloc(sizeof(*g));
+  const int program = 33; // histogram.cl, from programs.conf
+  g->kernel_histogram_collect = dt_opencl_create_kernel(program, "histogram_collect");
+  g->kernel_histogram_waveform = dt_opencl_create_kernel(program, "histogram_waveform");
+  g->kernel_histogram_waveform_map = dt_opencl_create_kernel(program, "histogram_waveform_map");
+  return g;
+}
+
+void dt_histogram_free_cl_global(dt_histogram_cl_global_t *g)
+{
+  if(!g) return;
+  dt_opencl_free_kernel(g->kernel_histogram_collect);
+  dt_opencl_free_kernel(g->kernel_histogram_waveform);
+  dt_opencl_free_kernel(g->kernel_histogram_waveform_map);
+  free(g);
+}
+
+int dt_histogram_helper_cl(const int devid, dt_dev_histogram_collection_params_t *histogram_params,
+                           dt_dev_histogram_stats_t *histogram_stats, const dt_iop_colorspace_type_t cst,
+                           const dt_iop_colorspace_type_t cst_to, cl_mem img, uint32_t **histogram,
+                           const int compensate_middle_grey,
+                           const dt_iop_order_iccprofile_info_t *const profile_info)
+{
+  // the middle grey compensation goes through the luts of the profile, which only live on the host
+  if(cst == iop_cs_rgb && compensate_middle_grey && profile_info) return FALSE;
+  // every pixel is counted with atomics in local memory
+  if(darktable.opencl->avoid_atomics) return FALSE;
+
+  const dt_histogram_cl_mode_t mode = cst == iop_cs_RAW ? DT_HISTOGRAM_CL_RAW
+                                      : cst == iop_cs_rgb ? DT_HISTOGRAM_CL_RGB
+                                      : cst_to == iop_cs_LCh ? DT_HISTOGRAM_CL_LCH
+                                      : DT_HISTOGRAM_CL_LAB;
+  const int bpp = dt_opencl_get_image_element_size(img);
+  if(bpp != (mode == DT_HISTOGRAM_CL_RAW ? 1 : 4) * (int)sizeof(float)) return FALSE;
+
+  const int kernel = darktable.opencl->histogram->kernel_histogram_collect;
+  const dt_histogram_roi_t *const roi = histogram_params->roi;
+  const int bins = histogram_params->bins_count;
+  const size_t buf_size = (size_t)4 * bins * sizeof(uint32_t);
+  const int step = _histogram_step(histogram_params);
+  const int x_end = roi->width - roi->crop_width;
+  const int y_end = roi->height - roi->crop_height;
+  const int rows = _histogram_samples(y_end - roi->crop_y, step);
+  if(rows <= 0 || x_end <= roi->crop_x) return FALSE;
+
+  size_t maxsizes[3] = { 0 };
+  size_t workgroupsize = 0;
+  unsigned long localmemsize = 0;
+  size_t groupsize = 0;
+  if(dt_opencl_get_work_group_limits(devid, maxsizes, &workgroupsize, &localmemsize) != CL_SUCCESS
+     || localmemsize < buf_size)
+    return FALSE;
+  if(dt_opencl_get_kernel_work_group_size(devid, kernel, &groupsize) != CL_SUCCESS || groupsize == 0)
+    return FALSE;
+  groupsize = MIN(groupsize, 256);
+  // enough groups to fill the device, few enough to keep the additions to the global bins rare
+  const int groups = MIN(rows, 64);
+
+  if(histogram_params->mul == 0) histogram_params->mul = (double)(bins - 1);
+  const float mul = histogram_params->mul;
+
+  cl_int err = -999;
+  cl_mem dev_hist = NULL;
+  uint32_t *hist = calloc(1, buf_size);
+  if(hist == NULL) goto error;
+  dev_hist = dt_opencl_alloc_device_buffer(devid, buf_size);
+  if(dev_hist == NULL) goto error;
+  err = dt_opencl_write_buffer_to_device(devid, hist, dev_hist, 0, buf_size, CL_TRUE);
+  if(err != CL_SUCCESS) goto error;
+
+  size_t sizes[3] = { groupsize * groups, 1, 1 };
+  size_t local[3] = { groupsize, 1, 1 };
+  dt_opencl_set_kernel_arg(devid, kernel, 0, sizeof(cl_mem), (void *)&img);
+  dt_opencl_set_kernel_arg(devid, kernel, 1, sizeof(cl_mem), (void *)&dev_hist);
+  dt_opencl_set_kernel_arg(devid, kernel, 2, sizeof(int), (void *)&roi->crop_x);
+  dt_opencl_set_kernel_arg(devid, kernel, 3, sizeof(int), (void *)&roi->crop_y);
+  dt_opencl_set_kernel_arg(devid, kernel, 4, sizeof(int), (void *)&x_end);
+  dt_opencl_set_kernel_arg(devid, kernel, 5, sizeof(int), (void *)&y_end);
+  dt_opencl_set_kernel_arg(devid, kernel, 6, sizeof(int), (void *)&step);
+  dt_opencl_set_kernel_arg(devid, kernel, 7, sizeof(int), (void *)&bins);
+  dt_opencl_set_kernel_arg(devid, kernel, 8, sizeof(float), (void *)&mul);
+  dt_opencl_set_kernel_arg(devid, kernel, 9, sizeof(int), (void *)&mode);
+  dt_opencl_set_kernel_arg(devid, kernel, 10, buf_size, NULL);
+  err = dt_opencl_enqueue_kernel_2d_with_local(devid, kernel, sizes, local);
+  if(err != CL_SUCCESS) goto error;
+
+  err = dt_opencl_read_buffer_from_device(devid, hist, dev_hist, 0, buf_size, CL_TRUE);
+  if(err != CL_SUCCESS) goto error;
+
+  dt_opencl_release_mem_object(dev_hist);
+  free(*histogram);
+  *histogram = hist;
+
+  histogram_stats->bins_count = bins;
+  histogram_stats->pixels = _histogram_samples(x_end - roi->crop_x, step) * rows;
+  histogram_stats->ch = mode == DT_HISTOGRAM_CL_RAW ? 1u : 3u;
+  return TRUE;
+
+error:
+  dt_opencl_release_mem_object(dev_hist);
+  free(hist);
+  dt_print(DT_DEBUG_OPENCL, "[opencl_histogram] couldn't enqueue kernel! %d\n", err);
+  return FALSE;
+}
+
+int dt_histogram_waveform_cl(const int devid, cl_mem img, const int width, const int height,
+                             uint8_t *const waveform, const int waveform_height, const int waveform_stride,
+                             uint32_t *waveform_width_out)
+{
+  // the counts are gathered with atomics in global memory
+  if(darktable.opencl->avoid_atomics) return FALSE;
+  if(dt_opencl_get_image_element_size(img) != 4 * (int)sizeof(float)) return FALSE;
+
+  const dt_histogram_cl_global_t *const gd = darktable.opencl->histogram;
+  const int bin_width = _waveform_bin_width(width, waveform_stride);
+  const int waveform_width = ceilf(width / (float)bin_width);
+  const float scale = _waveform_scale(width, height, waveform_width, waveform_height);
+  const float gamma = WAVEFORM_GAMMA;
+  const size_t buf_size = sizeof(uint32_t) * waveform_width * waveform_height * 3;
+  const size_t waveform_size = sizeof(uint8_t) * waveform_stride * waveform_height * 3;
+
+  cl_int err = -999;
+  cl_mem dev_buf = NULL;
+  cl_mem dev_waveform = NULL;
+  uint32_t *zero = calloc(1, buf_size);
+  if(zero == NULL) goto error;
+  dev_buf = dt_opencl_alloc_device_buffer(devid, buf_size);
+  dev_waveform = dt_opencl_alloc_device_buffer(devid, waveform_size);
+  if(dev_buf == NULL || dev_waveform == NULL) goto error;
+  err = dt_opencl_write_buffer_to_device(devid, zero, dev_buf, 0, buf_size, CL_TRUE);
+  if(err != CL_SUCCESS) goto error;
+
+  size_t sizes[3] = { ROUNDUPWD(width), ROUNDUPHT(height), 1 };
+  dt_opencl_set_kernel_arg(devid, gd->kernel_histogram_waveform, 0, sizeof(cl_mem), (void *)&img);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_histogram_waveform, 1, sizeof(cl_mem), (void *)&dev_buf);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_histogram_waveform, 2, sizeof(int), (void *)&width);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_histogram_waveform, 3, sizeof(int), (void *)&height);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_histogram_waveform, 4, sizeof(int), (void *)&bin_width);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_histogram_waveform, 5, sizeof(int), (void *)&waveform_width);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_histogram_waveform, 6, sizeof(int), (void *)&waveform_height);
+  err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_histogram_waveform, sizes);
+  if(err != CL_SUCCESS) goto error;
+
+  size_t msizes[3] = { ROUNDUPWD(waveform_width), ROUNDUPHT(3 * waveform_height), 1 };
+  dt_opencl_set_kernel_arg(devid, gd->kernel_histogram_waveform_map, 0, sizeof(cl_mem), (void *)&dev_buf);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_histogram_waveform_map, 1, sizeof(cl_mem), (void *)&dev_waveform);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_histogram_waveform_map, 2, sizeof(int), (void *)&waveform_width);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_histogram_waveform_map, 3, sizeof(int), (void *)&waveform_height);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_histogram_waveform_map, 4, sizeof(int), (void *)&waveform_stride);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_histogram_waveform_map, 5, sizeof(float), (void *)&scale);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_histogram_waveform_map, 6, sizeof(float), (void *)&gamma);
+  err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_histogram_waveform_map, msizes);
+  if(err != CL_SUCCESS) goto error;
+
+  err = dt_opencl_read_buffer_from_device(devid, waveform, dev_waveform, 0, waveform_size, CL_TRUE);
+  if(err != CL_SUCCESS) goto error;
+
+  dt_opencl_release_mem_object(dev_buf);
+  dt_opencl_release_mem_object(dev_waveform);
+  free(zero);
+  *waveform_width_out = waveform_width;
+  return TRUE;
+
+error:
+  dt_opencl_release_mem_object(dev_buf);
+  dt_opencl_release_mem_object(dev_waveform);
+  free(zero);
+  dt_print(DT_DEBUG_OPENCL, "[opencl_histogram_waveform] couldn't enqueue kernel! %d\n", err);
+  return FALSE;
+}
+#endif
+
 void dt_histogram_max_helper(const dt_dev_histogram_stats_t *const histogram_stats,
                              const dt_iop_colorspace_type_t cst, const dt_iop_colorspace_type_t cst_to,
                              uint32_t **histogram, uint32_t *histogram_max)
@@ -449,6 +775,9 @@ void dt_histogram_max_helper(const dt_dev_histogram_stats_t *const histogram_sta
   }
 }
 
+#undef WAVEFORM_GAMMA
+#undef BINS_RUN
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
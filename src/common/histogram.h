@@ -23,6 +23,7 @@
 #include "develop/imageop.h"
 #include "develop/pixelpipe.h"
 #include "common/iop_profile.h"
+#include "common/opencl.h"
 
 /*
  * histogram region of interest
@@ -54,6 +55,46 @@ void dt_histogram_helper(dt_dev_histogram_collection_params_t *histogram_params,
                          const dt_iop_colorspace_type_t cst_to, const void *pixel, uint32_t **histogram,
                          const int compensate_middle_grey, const dt_iop_order_iccprofile_info_t *const profile_info);
 
+/*
+ * waveform of the 4 channel rgb image input: every column of the waveform counts the values of bin_width
+ * columns of the image, 1.0 is at 8/9 of waveform_height. the channels are stored as 3 planes of
+ * waveform_height rows of waveform_stride bytes, blue first. waveform_width is set to the used width.
+ */
+void dt_histogram_waveform(const float *const input, const int width, const int height, uint8_t *const waveform,
+                           const int waveform_height, const int waveform_stride, uint32_t *waveform_width);
+
+#ifdef HAVE_OPENCL
+typedef struct dt_histogram_cl_global_t
+{
+  int kernel_histogram_collect;
+  int kernel_histogram_waveform;
+  int kernel_histogram_waveform_map;
+} dt_histogram_cl_global_t;
+
+dt_histogram_cl_global_t *dt_histogram_init_cl_global(void);
+
+void dt_histogram_free_cl_global(dt_histogram_cl_global_t *g);
+
+/*
+ * same as dt_histogram_helper() for an image on the device. every work group counts its rows in local memory
+ * and adds them to the histogram on the device, only the bins are copied back to the host. returns FALSE if
+ * the device can't do it, the caller then has to copy img to the host and use dt_histogram_helper().
+ */
+int dt_histogram_helper_cl(const int devid, dt_dev_histogram_collection_params_t *histogram_params,
+                           dt_dev_histogram_stats_t *histogram_stats, const dt_iop_colorspace_type_t cst,
+                           const dt_iop_colorspace_type_t cst_to, cl_mem img, uint32_t **histogram,
+                           const int compensate_middle_grey,
+                           const dt_iop_order_iccprofile_info_t *const profile_info);
+
+/*
+ * same as dt_histogram_waveform() for an image on the device, only the waveform is copied back.
+ * returns FALSE if the device can't do it.
+ */
+int dt_histogram_waveform_cl(const int devid, cl_mem img, const int width, const int height,
+                             uint8_t *const waveform, const int waveform_height, const int waveform_stride,
+                             uint32_t *waveform_width);
+#endif
+
 void dt_histogram_max_helper(const dt_dev_histogram_stats_t *const histogram_stats,
                              const dt_iop_colorspace_type_t cst, const dt_iop_colorspace_type_t cst_to,
                              uint32_t **histogram, uint32_t *histogram_max);
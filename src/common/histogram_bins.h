@@ -0,0 +1,59 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// bin lookup of the rgb and Lab histograms. included by histogram.c and by histogram_avx2.c, which is built
+// with the AVX2 flags. the bins of a run of pixels are computed in one vector loop and only the increments
+// are left scalar. define DT_HISTOGRAM_BINS to the name of the function before including.
+
+#include "common/darktable.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// writes the offsets 4 * bin + channel of the first three channels of n pixels, taken every step pixels
+// from in, to bins. a channel is mapped to (value + shift[c]) * scale[c] and clamped to [0, max] with
+// selects, NaN goes to bin 0.
+void DT_HISTOGRAM_BINS(const float *const in, uint32_t *const bins, const int n, const int step,
+                       const float *const scale, const float *const shift, const float max)
+{
+  const float s0 = scale[0], s1 = scale[1], s2 = scale[2];
+  const float h0 = shift[0], h1 = shift[1], h2 = shift[2];
+
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+  for(int k = 0; k < n; k++)
+  {
+    const float *const p = in + (size_t)4 * k * step;
+    const float v0 = (p[0] + h0) * s0;
+    const float v1 = (p[1] + h1) * s1;
+    const float v2 = (p[2] + h2) * s2;
+    const float c0 = v0 > 0.0f ? (v0 < max ? v0 : max) : 0.0f;
+    const float c1 = v1 > 0.0f ? (v1 < max ? v1 : max) : 0.0f;
+    const float c2 = v2 > 0.0f ? (v2 < max ? v2 : max) : 0.0f;
+    bins[3 * k + 0] = 4 * (int)c0;
+    bins[3 * k + 1] = 4 * (int)c1 + 1;
+    bins[3 * k + 2] = 4 * (int)c2 + 2;
+  }
+}
+
+#undef DT_HISTOGRAM_BINS
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
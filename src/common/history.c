@@ -484,36 +484,32 @@ int dt_history_merge_module_into_history(dt_develop_t *dev_dest, dt_develop_t *d
   return module_added;
 }
 
-static int _history_copy_and_paste_on_image_merge(int32_t imgid, int32_t dest_imgid, GList *ops)
+// the source image of a paste with the modules to merge, loaded once for all the images it is pasted on
+typedef struct dt_history_copy_source_t
 {
-  GList *modules_used = NULL;
-
-  dt_develop_t _dev_src = { 0 };
-  dt_develop_t _dev_dest = { 0 };
+  int32_t imgid;
+  dt_develop_t dev;
+  GList *mod_list;
+} dt_history_copy_source_t;
 
-  dt_develop_t *dev_src = &_dev_src;
-  dt_develop_t *dev_dest = &_dev_dest;
+static void _history_copy_source_init(dt_history_copy_source_t *src, int32_t imgid, GList *ops)
+{
+  dt_develop_t *dev_src = &src->dev;
+  src->imgid = imgid;
+  src->mod_list = NULL;
 
-  // we will do the copy/paste on memory so we can deal with masks
   dt_dev_init(dev_src, FALSE);
-  dt_dev_init(dev_dest, FALSE);
-
   dev_src->iop = dt_iop_load_modules_ext(dev_src, TRUE);
-  dev_dest->iop = dt_iop_load_modules_ext(dev_dest, TRUE);
 
+  dt_lock_image(imgid);
   dt_dev_read_history_ext(dev_src, imgid, TRUE);
+  dt_unlock_image(imgid);
 
-  // This prepends the default modules and converts just in case it's an empty history
-  dt_dev_read_history_ext(dev_dest, dest_imgid, TRUE);
-
-  dt_ioppr_check_iop_order(dev_src, imgid, "_history_copy_and_paste_on_image_merge ");
-  dt_ioppr_check_iop_order(dev_dest, dest_imgid, "_history_copy_and_paste_on_image_merge ");
+  dt_ioppr_check_iop_order(dev_src, imgid, "_history_copy_source_init ");
 
   dt_dev_pop_history_items_ext(dev_src, dev_src->history_end);
-  dt_dev_pop_history_items_ext(dev_dest, dev_dest->history_end);
 
-  dt_ioppr_check_iop_order(dev_src, imgid, "_history_copy_and_paste_on_image_merge 1");
-  dt_ioppr_check_iop_order(dev_dest, dest_imgid, "_history_copy_and_paste_on_image_merge 1");
+  dt_ioppr_check_iop_order(dev_src, imgid, "_history_copy_source_init 1");
 
   GList *mod_list = NULL;
 
@@ -566,10 +562,43 @@ static int _history_copy_and_paste_on_image_merge(int32_t imgid, int32_t dest_im
   }
   if (DT_IOP_ORDER_INFO) fprintf(stderr,"\nvvvvv\n");
 
+  src->mod_list = mod_list;
+}
+
+static void _history_copy_source_cleanup(dt_history_copy_source_t *src)
+{
+  g_list_free(src->mod_list);
+  src->mod_list = NULL;
+  dt_dev_cleanup(&src->dev);
+}
+
+static int _history_copy_and_paste_on_image_merge(dt_history_copy_source_t *src, int32_t dest_imgid)
+{
+  GList *modules_used = NULL;
+
+  dt_develop_t _dev_dest = { 0 };
+
+  dt_develop_t *dev_src = &src->dev;
+  dt_develop_t *dev_dest = &_dev_dest;
+
+  // we will do the copy/paste on memory so we can deal with masks
+  dt_dev_init(dev_dest, FALSE);
+
+  dev_dest->iop = dt_iop_load_modules_ext(dev_dest, TRUE);
+
+  // This prepends the default modules and converts just in case it's an empty history
+  dt_dev_read_history_ext(dev_dest, dest_imgid, TRUE);
+
+  dt_ioppr_check_iop_order(dev_dest, dest_imgid, "_history_copy_and_paste_on_image_merge ");
+
+  dt_dev_pop_history_items_ext(dev_dest, dev_dest->history_end);
+
+  dt_ioppr_check_iop_order(dev_dest, dest_imgid, "_history_copy_and_paste_on_image_merge 1");
+
   // update iop-order list to have entries for the new modules
-  dt_ioppr_update_for_modules(dev_dest, mod_list, FALSE);
+  dt_ioppr_update_for_modules(dev_dest, src->mod_list, FALSE);
 
-  GList *l = mod_list;
+  GList *l = src->mod_list;
   while(l)
   {
     dt_iop_module_t *mod = (dt_iop_module_t *)l->data;
@@ -578,14 +607,13 @@ static int _history_copy_and_paste_on_image_merge(int32_t imgid, int32_t dest_im
   }
 
   // update iop-order list to have entries for the new modules
-  dt_ioppr_update_for_modules(dev_dest, mod_list, FALSE);
+  dt_ioppr_update_for_modules(dev_dest, src->mod_list, FALSE);
 
   dt_ioppr_check_iop_order(dev_dest, dest_imgid, "_history_copy_and_paste_on_image_merge 2");
 
   // write history and forms to db
   dt_dev_write_history_ext(dev_dest, dest_imgid);
 
-  dt_dev_cleanup(dev_src);
   dt_dev_cleanup(dev_dest);
 
   g_list_free(modules_used);
@@ -593,7 +621,8 @@ static int _history_copy_and_paste_on_image_merge(int32_t imgid, int32_t dest_im
   return 0;
 }
 
-static int _history_copy_and_paste_on_image_overwrite(int32_t imgid, int32_t dest_imgid, GList *ops)
+static int _history_copy_and_paste_on_image_overwrite(dt_history_copy_source_t *src, int32_t imgid,
+                                                     int32_t dest_imgid, GList *ops)
 {
   int ret_val = 0;
   sqlite3_stmt *stmt;
@@ -711,28 +740,21 @@ static int _history_copy_and_paste_on_image_overwrite(int32_t imgid, int32_t des
   else
   {
     // since the history and masks where deleted we can do a merge
-    ret_val = _history_copy_and_paste_on_image_merge(imgid, dest_imgid, ops);
+    ret_val = _history_copy_and_paste_on_image_merge(src, dest_imgid);
   }
 
   return ret_val;
 }
 
-int dt_history_copy_and_paste_on_image(int32_t imgid, int32_t dest_imgid, gboolean merge, GList *ops, gboolean copy_iop_order)
+// pastes onto one image. src is loaded by the caller when the history is merged or ops are given, the
+// current darkroom history has to be written before.
+static int _history_copy_and_paste_on_image_ext(dt_history_copy_source_t *src, int32_t imgid, int32_t dest_imgid,
+                                                gboolean merge, GList *ops, gboolean copy_iop_order)
 {
   if(imgid == dest_imgid) return 1;
 
-  if(imgid == -1)
-  {
-    dt_control_log(_("you need to copy history from an image before you paste it onto another"));
-    return 1;
-  }
-
   dt_lock_image_pair(imgid,dest_imgid);
 
-  // be sure the current history is written before pasting some other history data
-  const dt_view_t *cv = dt_view_manager_get_current_view(darktable.view_manager);
-  if(cv->view((dt_view_t *)cv) == DT_VIEW_DARKROOM) dt_dev_write_history(darktable.develop);
-
   dt_undo_lt_history_t *hist = dt_history_snapshot_item_init();
   hist->imgid = dest_imgid;
   dt_history_snapshot_undo_create(hist->imgid, &hist->before, &hist->before_history_end);
@@ -746,9 +768,9 @@ int dt_history_copy_and_paste_on_image(int32_t imgid, int32_t dest_imgid, gboole
 
   int ret_val = 0;
   if(merge)
-    ret_val = _history_copy_and_paste_on_image_merge(imgid, dest_imgid, ops);
+    ret_val = _history_copy_and_paste_on_image_merge(src, dest_imgid);
   else
-    ret_val = _history_copy_and_paste_on_image_overwrite(imgid, dest_imgid, ops);
+    ret_val = _history_copy_and_paste_on_image_overwrite(src, imgid, dest_imgid, ops);
 
   dt_history_snapshot_undo_create(hist->imgid, &hist->after, &hist->after_history_end);
   dt_undo_start_group(darktable.undo, DT_UNDO_LT_HISTORY);
@@ -790,6 +812,71 @@ int dt_history_copy_and_paste_on_image(int32_t imgid, int32_t dest_imgid, gboole
   return ret_val;
 }
 
+// the source is needed unless the whole history is copied over
+static gboolean _history_copy_needs_source(const gboolean merge, GList *ops)
+{
+  return merge || ops;
+}
+
+int dt_history_copy_and_paste_on_image(int32_t imgid, int32_t dest_imgid, gboolean merge, GList *ops, gboolean copy_iop_order)
+{
+  if(imgid == dest_imgid) return 1;
+
+  if(imgid == -1)
+  {
+    dt_control_log(_("you need to copy history from an image before you paste it onto another"));
+    return 1;
+  }
+
+  // be sure the current history is written before pasting some other history data
+  const dt_view_t *cv = dt_view_manager_get_current_view(darktable.view_manager);
+  if(cv->view((dt_view_t *)cv) == DT_VIEW_DARKROOM) dt_dev_write_history(darktable.develop);
+
+  dt_history_copy_source_t src;
+  const gboolean need_src = _history_copy_needs_source(merge, ops);
+  if(need_src) _history_copy_source_init(&src, imgid, ops);
+
+  const int ret_val
+      = _history_copy_and_paste_on_image_ext(need_src ? &src : NULL, imgid, dest_imgid, merge, ops, copy_iop_order);
+
+  if(need_src) _history_copy_source_cleanup(&src);
+  return ret_val;
+}
+
+int dt_history_copy_and_paste_on_list(int32_t imgid, const GList *list, gboolean merge, GList *ops,
+                                      gboolean copy_iop_order)
+{
+  if(imgid == -1)
+  {
+    dt_control_log(_("you need to copy history from an image before you paste it onto another"));
+    return 1;
+  }
+
+  // be sure the current history is written before pasting some other history data
+  const dt_view_t *cv = dt_view_manager_get_current_view(darktable.view_manager);
+  if(cv->view((dt_view_t *)cv) == DT_VIEW_DARKROOM) dt_dev_write_history(darktable.develop);
+
+  // the source and the modules to merge are the same for all the images
+  dt_history_copy_source_t src;
+  const gboolean need_src = _history_copy_needs_source(merge, ops);
+  if(need_src) _history_copy_source_init(&src, imgid, ops);
+
+  // the histories of all the images are written in one transaction, the .xmp files are queued to the sidecar
+  // writer anyway
+  int ret_val = 0;
+  dt_database_start_transaction(darktable.db);
+  for(const GList *l = list; l; l = g_list_next(l))
+  {
+    const int dest = GPOINTER_TO_INT(l->data);
+    ret_val |= _history_copy_and_paste_on_image_ext(need_src ? &src : NULL, imgid, dest, merge, ops,
+                                                    copy_iop_order);
+  }
+  dt_database_release_transaction(darktable.db);
+
+  if(need_src) _history_copy_source_cleanup(&src);
+  return ret_val;
+}
+
 GList *dt_history_get_items(int32_t imgid, gboolean enabled)
 {
   GList *result = NULL;
@@ -932,9 +1019,8 @@ static int dt_history_end_attop(int32_t imgid)
   - is used in lighttable and darkroom mode
   - It compresses history *exclusively* in the database and does *not* touch anything on the history stack
 */
-void dt_history_compress_on_image(int32_t imgid)
+static void _history_compress_on_image(int32_t imgid)
 {
-  dt_lock_image(imgid);
   sqlite3_stmt *stmt;
 
   // get history_end for image
@@ -950,7 +1036,6 @@ void dt_history_compress_on_image(int32_t imgid)
   if (my_history_end == 0)
   {
     dt_history_delete_on_image(imgid);
-    dt_unlock_image(imgid);
     return;
   }
 
@@ -1047,18 +1132,67 @@ void dt_history_compress_on_image(int32_t imgid)
     sqlite3_step(stmt);
     sqlite3_finalize(stmt);
   }
+}
+
+void dt_history_compress_on_image(int32_t imgid)
+{
+  dt_lock_image(imgid);
+  dt_database_start_transaction(darktable.db);
+  _history_compress_on_image(imgid);
+  dt_database_release_transaction(darktable.db);
   dt_unlock_image(imgid);
   dt_history_hash_write_from_history(imgid, DT_HISTORY_HASH_CURRENT);
 
-  GList *imgs = g_list_append(NULL, GINT_TO_POINTER(imgid));
-  dt_control_signal_raise(darktable.signals, DT_SIGNAL_DEVELOP_MIPMAP_UPDATED, imgs);
+  dt_control_signal_raise(darktable.signals, DT_SIGNAL_DEVELOP_MIPMAP_UPDATED, imgid);
+}
+
+// closes the gaps the compression left in the nums of the history of an image and sets history_end to the
+// top. the nums only ever move down, in ascending order they never collide.
+static void _history_renumber(int32_t imgid, sqlite3_stmt *select, sqlite3_stmt *update, sqlite3_stmt *end)
+{
+  GArray *nums = g_array_new(FALSE, FALSE, sizeof(int));
+  DT_DEBUG_SQLITE3_BIND_INT(select, 1, imgid);
+  while(sqlite3_step(select) == SQLITE_ROW)
+  {
+    const int num = sqlite3_column_int(select, 0);
+    g_array_append_val(nums, num);
+  }
+  sqlite3_reset(select);
+
+  int done = 0;
+  for(; done < (int)nums->len; done++)
+  {
+    const int num = g_array_index(nums, int, done);
+    if(num == done) continue;
+    DT_DEBUG_SQLITE3_BIND_INT(update, 1, imgid);
+    DT_DEBUG_SQLITE3_BIND_INT(update, 2, num);
+    DT_DEBUG_SQLITE3_BIND_INT(update, 3, done);
+    sqlite3_step(update);
+    sqlite3_reset(update);
+  }
+  g_array_free(nums, TRUE);
+
+  DT_DEBUG_SQLITE3_BIND_INT(end, 1, imgid);
+  DT_DEBUG_SQLITE3_BIND_INT(end, 2, done);
+  sqlite3_step(end);
+  sqlite3_reset(end);
 }
 
 int dt_history_compress_on_list(const GList *imgs)
 {
   int uncompressed=0;
 
-  // Get the list of selected images
+  sqlite3_stmt *select, *update, *end;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+    "SELECT num FROM main.history WHERE imgid = ?1 ORDER BY num", -1, &select, NULL);
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+    "UPDATE main.history SET num = ?3 WHERE imgid = ?1 AND num = ?2", -1, &update, NULL);
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+    "UPDATE main.images SET history_end = ?2 WHERE id = ?1", -1, &end, NULL);
+
+  // all images of the list are done in one transaction, their sidecars are written by the queue later
+  dt_database_start_transaction(darktable.db);
+
   GList *l = g_list_first((GList *)imgs);
   while(l)
   {
@@ -1068,64 +1202,10 @@ int dt_history_compress_on_list(const GList *imgs)
     if (test == 1) // we do a compression and we know for sure history_end is at the top!
     {
       dt_history_set_compress_problem(imgid, FALSE);
-      dt_history_compress_on_image(imgid);
+      _history_compress_on_image(imgid);
 
       // now the modules are in right order but need renumbering to remove leaks
-      int max=0;    // the maximum num in main_history for an image
-      int size=0;   // the number of items in main_history for an image
-      int done=0;   // used for renumbering index
-
-      sqlite3_stmt *stmt2;
-
-      // get highest num in history
-      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-        "SELECT MAX(num) FROM main.history WHERE imgid=?1", -1, &stmt2, NULL);
-      DT_DEBUG_SQLITE3_BIND_INT(stmt2, 1, imgid);
-      if (sqlite3_step(stmt2) == SQLITE_ROW)
-        max = sqlite3_column_int(stmt2, 0);
-      sqlite3_finalize(stmt2);
-
-      // get number of items in main.history
-      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-        "SELECT COUNT(*) FROM main.history WHERE imgid = ?1", -1, &stmt2, NULL);
-      DT_DEBUG_SQLITE3_BIND_INT(stmt2, 1, imgid);
-      if(sqlite3_step(stmt2) == SQLITE_ROW)
-        size = sqlite3_column_int(stmt2, 0);
-      sqlite3_finalize(stmt2);
-
-      if ((size>0) && (max>0))
-      {
-        for (int index=0;index<(max+1);index++)
-        {
-          sqlite3_stmt *stmt3;
-          DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-            "SELECT num FROM main.history WHERE imgid=?1 AND num=?2", -1, &stmt3, NULL);
-          DT_DEBUG_SQLITE3_BIND_INT(stmt3, 1, imgid);
-          DT_DEBUG_SQLITE3_BIND_INT(stmt3, 2, index);
-          if (sqlite3_step(stmt3) == SQLITE_ROW)
-          {
-            sqlite3_stmt *stmt4;
-            // step by step set the correct num
-            DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-              "UPDATE main.history SET num = ?3 WHERE imgid = ?1 AND num = ?2", -1, &stmt4, NULL);
-            DT_DEBUG_SQLITE3_BIND_INT(stmt4, 1, imgid);
-            DT_DEBUG_SQLITE3_BIND_INT(stmt4, 2, index);
-            DT_DEBUG_SQLITE3_BIND_INT(stmt4, 3, done);
-            sqlite3_step(stmt4);
-            sqlite3_finalize(stmt4);
-
-            done++;
-          }
-          sqlite3_finalize(stmt3);
-        }
-      }
-      // update history end
-      DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-        "UPDATE main.images SET history_end = ?2 WHERE id = ?1", -1, &stmt2, NULL);
-      DT_DEBUG_SQLITE3_BIND_INT(stmt2, 1, imgid);
-      DT_DEBUG_SQLITE3_BIND_INT(stmt2, 2, done);
-      sqlite3_step(stmt2);
-      sqlite3_finalize(stmt2);
+      _history_renumber(imgid, select, update, end);
 
       dt_image_write_sidecar_file(imgid);
     }
@@ -1142,6 +1222,15 @@ int dt_history_compress_on_list(const GList *imgs)
     l = g_list_next(l);
   }
 
+  dt_database_release_transaction(darktable.db);
+
+  sqlite3_finalize(select);
+  sqlite3_finalize(update);
+  sqlite3_finalize(end);
+
+  for(l = g_list_first((GList *)imgs); l; l = g_list_next(l))
+    dt_control_signal_raise(darktable.signals, DT_SIGNAL_DEVELOP_MIPMAP_UPDATED, GPOINTER_TO_INT(l->data));
+
   return uncompressed;
 }
 
@@ -1455,17 +1544,53 @@ const gboolean dt_history_hash_is_mipmap_synced(const int32_t imgid)
   return status;
 }
 
+typedef struct dt_history_mipmap_hash_t
+{
+  int32_t imgid;
+  int len;
+  uint8_t hash[];
+} dt_history_mipmap_hash_t;
+
+static void _history_hash_write_mipmap(sqlite3 *handle, gpointer data)
+{
+  const dt_history_mipmap_hash_t *h = (dt_history_mipmap_hash_t *)data;
+  sqlite3_stmt *stmt;
+  // unless the history changed meanwhile
+  DT_DEBUG_SQLITE3_PREPARE_V2(handle,
+                              "UPDATE main.history_hash"
+                              " SET mipmap_hash = ?2"
+                              " WHERE imgid = ?1 AND current_hash = ?2",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, h->imgid);
+  DT_DEBUG_SQLITE3_BIND_BLOB(stmt, 2, h->hash, h->len, SQLITE_STATIC);
+  sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
+}
+
+// a lost write only means the thumbnail is regenerated once more
+static void _history_hash_written_mipmap(gpointer data, gboolean committed)
+{
+  g_free(data);
+}
+
 void dt_history_hash_set_mipmap(const int32_t imgid)
 {
   if(imgid == -1) return;
   sqlite3_stmt *stmt;
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "UPDATE main.history_hash"
-                              " SET mipmap_hash = current_hash"
-                              " WHERE imgid = ?1",
+                              "SELECT current_hash FROM main.history_hash WHERE imgid = ?1",
                               -1, &stmt, NULL);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
-  sqlite3_step(stmt);
+  if(sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_type(stmt, 0) == SQLITE_BLOB)
+  {
+    // nothing reads this back soon, it only spares regenerating thumbnails later
+    const int len = sqlite3_column_bytes(stmt, 0);
+    dt_history_mipmap_hash_t *h = g_malloc(sizeof(dt_history_mipmap_hash_t) + len);
+    h->imgid = imgid;
+    h->len = len;
+    memcpy(h->hash, sqlite3_column_blob(stmt, 0), len);
+    dt_database_write_async(darktable.db, _history_hash_write_mipmap, _history_hash_written_mipmap, h);
+  }
   sqlite3_finalize(stmt);
 }
 
@@ -1536,14 +1661,9 @@ gboolean dt_history_paste_on_list(const GList *list, gboolean undo)
   if(mode == 0) merge = TRUE;
 
   if(undo) dt_undo_start_group(darktable.undo, DT_UNDO_LT_HISTORY);
-  GList *l = (GList *)list;
-  while(l)
-  {
-    const int dest = GPOINTER_TO_INT(l->data);
-    dt_history_copy_and_paste_on_image(darktable.view_manager->copy_paste.copied_imageid, dest, merge,
-                                       darktable.view_manager->copy_paste.selops, darktable.view_manager->copy_paste.copy_iop_order);
-    l = g_list_next(l);
-  }
+  dt_history_copy_and_paste_on_list(darktable.view_manager->copy_paste.copied_imageid, list, merge,
+                                    darktable.view_manager->copy_paste.selops,
+                                    darktable.view_manager->copy_paste.copy_iop_order);
   if(undo) dt_undo_end_group(darktable.undo);
   return TRUE;
 }
@@ -1573,15 +1693,9 @@ gboolean dt_history_paste_parts_on_list(const GList *list, gboolean undo)
   }
 
   if(undo) dt_undo_start_group(darktable.undo, DT_UNDO_LT_HISTORY);
-  GList *l = l_copy;
-  while(l)
-  {
-    const int dest = GPOINTER_TO_INT(l->data);
-    dt_history_copy_and_paste_on_image(darktable.view_manager->copy_paste.copied_imageid, dest, merge,
-                                       darktable.view_manager->copy_paste.selops,
-                                       darktable.view_manager->copy_paste.copy_iop_order);
-    l = g_list_next(l);
-  }
+  dt_history_copy_and_paste_on_list(darktable.view_manager->copy_paste.copied_imageid, l_copy, merge,
+                                    darktable.view_manager->copy_paste.selops,
+                                    darktable.view_manager->copy_paste.copy_iop_order);
   if(undo) dt_undo_end_group(darktable.undo);
 
   g_list_free(l_copy);
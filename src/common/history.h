@@ -65,6 +65,10 @@ int dt_history_merge_module_into_history(struct dt_develop_t *dev_dest, struct d
 
 /** copy history from imgid and pasts on dest_imgid, merge or overwrite... */
 int dt_history_copy_and_paste_on_image(int32_t imgid, int32_t dest_imgid, gboolean merge, GList *ops, gboolean copy_iop_order);
+/** like dt_history_copy_and_paste_on_image() for all the images of list, with the source loaded once and
+ * all the histories written in one transaction */
+int dt_history_copy_and_paste_on_list(int32_t imgid, const GList *list, gboolean merge, GList *ops,
+                                      gboolean copy_iop_order);
 
 /** delete all history for the given image */
 void dt_history_delete_on_image(int32_t imgid);
@@ -22,6 +22,114 @@
 #include "common/history.h"
 #include "control/signal.h"
 
+// the snapshots are shared by the undo items with the same history, mostly the after state of one change and
+// the before state of the next. they are counted here, imgid and id -> number of references. the last
+// snapshot taken of every image is kept to compare the next one with.
+static struct
+{
+  GMutex lock;
+  GHashTable *refs;
+  GHashTable *last; // imgid -> id
+  int next_id;
+} _snapshots = { .refs = NULL };
+
+static gint64 _snapshot_key(int32_t imgid, int snap_id)
+{
+  return ((gint64)imgid << 32) | (guint32)snap_id;
+}
+
+static void _snapshot_ref(int32_t imgid, int snap_id)
+{
+  g_mutex_lock(&_snapshots.lock);
+  const gint64 key = _snapshot_key(imgid, snap_id);
+  const int refs = GPOINTER_TO_INT(g_hash_table_lookup(_snapshots.refs, &key));
+  g_hash_table_insert(_snapshots.refs, g_memdup(&key, sizeof(key)), GINT_TO_POINTER(refs + 1));
+  g_mutex_unlock(&_snapshots.lock);
+}
+
+// returns TRUE if that was the last reference
+static gboolean _snapshot_unref(int32_t imgid, int snap_id)
+{
+  g_mutex_lock(&_snapshots.lock);
+  const gint64 key = _snapshot_key(imgid, snap_id);
+  const int refs = _snapshots.refs ? GPOINTER_TO_INT(g_hash_table_lookup(_snapshots.refs, &key)) : 0;
+  if(refs > 1)
+    g_hash_table_insert(_snapshots.refs, g_memdup(&key, sizeof(key)), GINT_TO_POINTER(refs - 1));
+  else if(_snapshots.refs)
+    g_hash_table_remove(_snapshots.refs, &key);
+  g_mutex_unlock(&_snapshots.lock);
+  return refs <= 1;
+}
+
+// the last snapshot of imgid still in use, -1 if none
+static int _snapshot_last(int32_t imgid)
+{
+  g_mutex_lock(&_snapshots.lock);
+  if(!_snapshots.refs)
+  {
+    _snapshots.refs = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, NULL);
+    _snapshots.last = g_hash_table_new(NULL, NULL);
+  }
+  int snap_id = -1;
+  gpointer value;
+  if(g_hash_table_lookup_extended(_snapshots.last, GINT_TO_POINTER(imgid), NULL, &value))
+  {
+    const gint64 key = _snapshot_key(imgid, GPOINTER_TO_INT(value));
+    if(g_hash_table_contains(_snapshots.refs, &key)) snap_id = GPOINTER_TO_INT(value);
+  }
+  g_mutex_unlock(&_snapshots.lock);
+  return snap_id;
+}
+
+// a new snapshot id, which becomes the last one of imgid
+static int _snapshot_new(int32_t imgid)
+{
+  g_mutex_lock(&_snapshots.lock);
+  const int snap_id = ++_snapshots.next_id;
+  g_hash_table_insert(_snapshots.last, GINT_TO_POINTER(imgid), GINT_TO_POINTER(snap_id));
+  g_mutex_unlock(&_snapshots.lock);
+  return snap_id;
+}
+
+// whether the snapshot snap_id holds the current history, masks and module order of imgid
+static gboolean _snapshot_is_current(int32_t imgid, int snap_id)
+{
+  sqlite3_stmt *stmt;
+  gboolean current = FALSE;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT"
+                              "  (SELECT COUNT(*) FROM main.history WHERE imgid=?1)"
+                              "   = (SELECT COUNT(*) FROM memory.undo_history WHERE imgid=?1 AND id=?2)"
+                              "  AND NOT EXISTS"
+                              "   (SELECT num, module, operation, op_params, enabled, "
+                              "           blendop_params, blendop_version, multi_priority, multi_name"
+                              "    FROM main.history WHERE imgid=?1"
+                              "    EXCEPT"
+                              "    SELECT num, module, operation, op_params, enabled, "
+                              "           blendop_params, blendop_version, multi_priority, multi_name"
+                              "    FROM memory.undo_history WHERE imgid=?1 AND id=?2)"
+                              "  AND (SELECT COUNT(*) FROM main.masks_history WHERE imgid=?1)"
+                              "   = (SELECT COUNT(*) FROM memory.undo_masks_history WHERE imgid=?1 AND id=?2)"
+                              "  AND NOT EXISTS"
+                              "   (SELECT num, formid, form, name, version, points, points_count, source"
+                              "    FROM main.masks_history WHERE imgid=?1"
+                              "    EXCEPT"
+                              "    SELECT num, formid, form, name, version, points, points_count, source"
+                              "    FROM memory.undo_masks_history WHERE imgid=?1 AND id=?2)"
+                              "  AND (SELECT COUNT(*) FROM main.module_order WHERE imgid=?1)"
+                              "   = (SELECT COUNT(*) FROM memory.undo_module_order WHERE imgid=?1 AND id=?2)"
+                              "  AND NOT EXISTS"
+                              "   (SELECT version, iop_list FROM main.module_order WHERE imgid=?1"
+                              "    EXCEPT"
+                              "    SELECT version, iop_list FROM memory.undo_module_order WHERE imgid=?1 AND id=?2)",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, snap_id);
+  if(sqlite3_step(stmt) == SQLITE_ROW) current = sqlite3_column_int(stmt, 0);
+  sqlite3_finalize(stmt);
+  return current;
+}
+
 dt_undo_lt_history_t *dt_history_snapshot_item_init(void)
 {
   return (dt_undo_lt_history_t *)g_malloc0(sizeof(dt_undo_lt_history_t));
@@ -45,18 +153,18 @@ void dt_history_snapshot_undo_create(int32_t imgid, int *snap_id, int *history_e
     *history_end = sqlite3_column_int(stmt, 0);
   sqlite3_finalize(stmt);
 
-  // get max snapshot
+  // most changes start from the state the previous one ended with, that snapshot is shared then
+  *snap_id = _snapshot_last(imgid);
+  if(*snap_id >= 0 && _snapshot_is_current(imgid, *snap_id))
+  {
+    _snapshot_ref(imgid, *snap_id);
+    dt_unlock_image(imgid);
+    return;
+  }
 
-  *snap_id = 0;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT MAX(id) FROM memory.undo_history WHERE imgid=?1", -1, &stmt, NULL);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+  *snap_id = _snapshot_new(imgid);
 
-  if (sqlite3_step(stmt) == SQLITE_ROW)
-    *snap_id = sqlite3_column_int(stmt, 0) + 1;
-  sqlite3_finalize(stmt);
-
-  sqlite3_exec(dt_database_get(darktable.db), "BEGIN TRANSACTION", NULL, NULL, NULL);
+  dt_database_start_transaction(darktable.db);
 
   // copy current state into undo_history
 
@@ -97,9 +205,11 @@ void dt_history_snapshot_undo_create(int32_t imgid, int *snap_id, int *history_e
   sqlite3_finalize(stmt);
 
   if(all_ok)
-    sqlite3_exec(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+    dt_database_release_transaction(darktable.db);
   else
-    sqlite3_exec(dt_database_get(darktable.db), "ROLLBACK_TRANSACTION", NULL, NULL, NULL);
+    dt_database_rollback_transaction(darktable.db);
+
+  _snapshot_ref(imgid, *snap_id);
 
   dt_unlock_image(imgid);
 }
@@ -112,7 +222,7 @@ static void _history_snapshot_undo_restore(int32_t imgid, int snap_id, int histo
 
   dt_lock_image(imgid);
 
-  sqlite3_exec(dt_database_get(darktable.db), "BEGIN TRANSACTION", NULL, NULL, NULL);
+  dt_database_start_transaction(darktable.db);
 
   dt_history_delete_on_image_ext(imgid, FALSE);
   dt_control_signal_raise(darktable.signals, DT_SIGNAL_TAG_CHANGED);
@@ -165,9 +275,9 @@ static void _history_snapshot_undo_restore(int32_t imgid, int snap_id, int histo
   sqlite3_finalize(stmt);
 
   if(all_ok)
-    sqlite3_exec(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+    dt_database_release_transaction(darktable.db);
   else
-    sqlite3_exec(dt_database_get(darktable.db), "ROLLBACK_TRANSACTION", NULL, NULL, NULL);
+    dt_database_rollback_transaction(darktable.db);
 
   dt_unlock_image(imgid);
 }
@@ -202,11 +312,8 @@ void dt_history_snapshot_undo_lt_history_data_free(gpointer data)
 {
   dt_undo_lt_history_t *hist = (dt_undo_lt_history_t *)data;
 
-  _clear_undo_snapshot(hist->imgid, hist->after);
-
-  // this is the first element in for this image, it corresponds to the initial status, we can safely remove it now
-  if(hist->before == 0)
-    _clear_undo_snapshot(hist->imgid, hist->before);
+  if(_snapshot_unref(hist->imgid, hist->before)) _clear_undo_snapshot(hist->imgid, hist->before);
+  if(_snapshot_unref(hist->imgid, hist->after)) _clear_undo_snapshot(hist->imgid, hist->after);
 
   g_free(hist);
 }
@@ -19,6 +19,7 @@
 #include <glib/gi18n.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "common/darktable.h"
 #include "common/http_server.h"
@@ -119,8 +120,8 @@ end:
   }
 }
 
-dt_http_server_t *dt_http_server_create(const int *ports, const int n_ports, const char *id,
-                                        const dt_http_server_callback callback, gpointer user_data)
+// binds to the first free port out of ports on localhost
+static SoupServer *_listen(const int *ports, const int n_ports, int *bound_port)
 {
   SoupServer *httpserver = NULL;
   int port = 0;
@@ -186,6 +187,17 @@ dt_http_server_t *dt_http_server_create(const int *ports, const int n_ports, con
 
 #endif
 
+  *bound_port = port;
+  return httpserver;
+}
+
+dt_http_server_t *dt_http_server_create(const int *ports, const int n_ports, const char *id,
+                                        const dt_http_server_callback callback, gpointer user_data)
+{
+  int port = 0;
+  SoupServer *httpserver = _listen(ports, n_ports, &port);
+  if(!httpserver) return NULL;
+
   dt_http_server_t *server = (dt_http_server_t *)malloc(sizeof(dt_http_server_t));
   server->server = httpserver;
 
@@ -211,6 +223,85 @@ dt_http_server_t *dt_http_server_create(const int *ports, const int n_ports, con
   return server;
 }
 
+typedef struct _endpoint_t
+{
+  dt_http_server_content_callback callback;
+  gpointer user_data;
+} _endpoint_t;
+
+// this is always in the gui thread
+static void _endpoint_request(SoupServer *server, SoupMessage *msg, const char *path, GHashTable *query,
+                              SoupClientContext *client, gpointer user_data)
+{
+  _endpoint_t *params = (_endpoint_t *)user_data;
+
+  const gboolean post = msg->method == SOUP_METHOD_POST;
+  if(msg->method != SOUP_METHOD_GET && !post)
+  {
+    soup_message_set_status(msg, SOUP_STATUS_NOT_IMPLEMENTED);
+    return;
+  }
+
+  GHashTable *form = NULL;
+  if(post)
+  {
+    SoupBuffer *request = soup_message_body_flatten(msg->request_body);
+    form = request->length ? soup_form_decode(request->data)
+                           : g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    soup_buffer_free(request);
+    if(query)
+    {
+      GHashTableIter iter;
+      gpointer key, value;
+      g_hash_table_iter_init(&iter, query);
+      while(g_hash_table_iter_next(&iter, &key, &value))
+        if(!g_hash_table_contains(form, key)) g_hash_table_insert(form, g_strdup(key), g_strdup(value));
+    }
+    query = form;
+  }
+
+  const char *content_type = "text/plain";
+  char *body = params->callback(query, post, &content_type, params->user_data);
+  if(form) g_hash_table_destroy(form);
+  if(!body)
+  {
+    soup_message_set_status(msg, SOUP_STATUS_NOT_FOUND);
+    return;
+  }
+
+  soup_message_set_status(msg, SOUP_STATUS_OK);
+  soup_message_set_response(msg, content_type, SOUP_MEMORY_TAKE, body, strlen(body));
+}
+
+dt_http_server_t *dt_http_server_create_endpoint(const int port, const char *id,
+                                                 const dt_http_server_content_callback callback,
+                                                 gpointer user_data)
+{
+  int bound_port = 0;
+  SoupServer *httpserver = _listen(&port, 1, &bound_port);
+  if(!httpserver) return NULL;
+
+  dt_http_server_t *server = (dt_http_server_t *)malloc(sizeof(dt_http_server_t));
+  server->server = httpserver;
+
+  _endpoint_t *params = (_endpoint_t *)malloc(sizeof(_endpoint_t));
+  params->callback = callback;
+  params->user_data = user_data;
+
+  char *path = g_strdup_printf("/%s", id);
+  server->url = g_strdup_printf("http://localhost:%d/%s", bound_port, id);
+  soup_server_add_handler(httpserver, path, _endpoint_request, params, free);
+  g_free(path);
+
+#ifdef OLD_API
+  soup_server_run_async(httpserver);
+#endif
+
+  dt_print(DT_DEBUG_CONTROL, "[http server] serving %s\n", server->url);
+
+  return server;
+}
+
 void dt_http_server_kill(dt_http_server_t *server)
 {
   if(server->server)
@@ -35,6 +35,19 @@ typedef struct dt_http_server_t
 dt_http_server_t *dt_http_server_create(const int *ports, const int n_ports, const char *id,
                                         const dt_http_server_callback callback, gpointer user_data);
 
+/** returns the body of the reply to a GET or POST request as a newly allocated string, NULL for a 404.
+ *  the query of a POST has the form fields of its body over those of the url. content_type defaults to
+ *  text/plain. */
+typedef char *(*dt_http_server_content_callback)(GHashTable *query, const gboolean post, const char **content_type,
+                                                 gpointer user_data);
+
+/** create a http server on localhost:port which keeps answering GET and POST requests on /id with what the
+ *  callback returns, until it gets killed. it only answers while the glib main loop runs.
+ */
+dt_http_server_t *dt_http_server_create_endpoint(const int port, const char *id,
+                                                 const dt_http_server_content_callback callback,
+                                                 gpointer user_data);
+
 /** call this to kill a server manually. don't call this if the request was received.
  *  this also frees server.
  */
@@ -38,6 +38,7 @@
 #include "control/control.h"
 #include "control/jobs.h"
 #include "develop/lightroom.h"
+#include "develop/pixelpipe_cache_disk.h"
 #include "win/filepath.h"
 #ifdef USE_LUA
 #include "lua/image.h"
@@ -90,6 +91,7 @@ static int64_t create_next_image_position()
 }
 
 static void _image_local_copy_full_path(const int imgid, char *pathname, size_t pathname_len);
+static void _image_write_sidecar_file_now(const int imgid);
 
 int dt_image_is_ldr(const dt_image_t *img)
 {
@@ -448,11 +450,45 @@ void dt_image_set_locations(const GList *img, const dt_image_geoloc_t *geoloc, c
       dt_undo_end_group(darktable.undo);
     }
 
-    g_list_free(imgs);
     dt_control_signal_raise(darktable.signals, DT_SIGNAL_MOUSE_OVER_IMAGE_CHANGE);
+    dt_control_signal_raise(darktable.signals, DT_SIGNAL_IMAGE_INFO_CHANGED, imgs);
   }
 }
 
+void dt_image_set_location_list(const GList *imgs, const dt_image_geoloc_t *geolocs, const gboolean undo_on)
+{
+  if(!imgs) return;
+
+  GList *undo = NULL;
+  if(undo_on) dt_undo_start_group(darktable.undo, DT_UNDO_GEOTAG);
+  dt_database_start_transaction(darktable.db);
+
+  int i = 0;
+  for(const GList *l = imgs; l; l = g_list_next(l), i++)
+  {
+    const int imgid = GPOINTER_TO_INT(l->data);
+    if(undo_on)
+    {
+      dt_undo_geotag_t *undogeotag = (dt_undo_geotag_t *)malloc(sizeof(dt_undo_geotag_t));
+      undogeotag->imgid = imgid;
+      dt_image_get_location(imgid, &undogeotag->before);
+      memcpy(&undogeotag->after, &geolocs[i], sizeof(dt_image_geoloc_t));
+      undo = g_list_prepend(undo, undogeotag);
+    }
+    _set_location(imgid, &geolocs[i]);
+  }
+
+  dt_database_release_transaction(darktable.db);
+  if(undo_on)
+  {
+    dt_undo_record(darktable.undo, NULL, DT_UNDO_GEOTAG, g_list_reverse(undo), _pop_undo, _geotag_undo_data_free);
+    dt_undo_end_group(darktable.undo);
+  }
+
+  dt_control_signal_raise(darktable.signals, DT_SIGNAL_MOUSE_OVER_IMAGE_CHANGE);
+  dt_control_signal_raise(darktable.signals, DT_SIGNAL_IMAGE_INFO_CHANGED, g_list_copy((GList *)imgs));
+}
+
 void dt_image_set_location(const int32_t imgid, const dt_image_geoloc_t *geoloc, const gboolean undo_on, const gboolean group_on)
 {
   GList *imgs = NULL;
@@ -621,9 +657,9 @@ dt_image_orientation_t dt_image_get_orientation(const int imgid)
 
   if(orientation == ORIENTATION_NULL)
   {
-    const dt_image_t *img = dt_image_cache_get(darktable.image_cache, imgid, 'r');
-    orientation = dt_image_orientation(img);
-    dt_image_cache_read_release(darktable.image_cache, img);
+    dt_image_snapshot_t img;
+    if(dt_image_cache_get_snapshot(darktable.image_cache, imgid, &img))
+      orientation = img.orientation != ORIENTATION_NULL ? img.orientation : ORIENTATION_NONE;
   }
 
   return orientation;
@@ -907,6 +943,7 @@ int32_t _image_duplicate_with_version(const int32_t imgid, const int32_t newvers
     }
     g_list_free(tags);
 #endif
+    dt_tag_index_invalidate();
 
     if(darktable.develop->image_storage.id == imgid)
     {
@@ -979,69 +1016,86 @@ int32_t dt_image_duplicate_with_version(const int32_t imgid, const int32_t newve
 
 void dt_image_remove(const int32_t imgid)
 {
-  // if a local copy exists, remove it
+  GList *imgs = g_list_append(NULL, GINT_TO_POINTER(imgid));
+  g_list_free(dt_image_remove_list(imgs));
+  g_list_free(imgs);
+}
 
-  if(dt_image_local_copy_reset(imgid)) return;
+GList *dt_image_remove_list(GList *imgs)
+{
+  // if a local copy exists, remove it
+  GList *removed = NULL;
+  for(GList *l = imgs; l; l = g_list_next(l))
+    if(!dt_image_local_copy_reset(GPOINTER_TO_INT(l->data))) removed = g_list_prepend(removed, l->data);
+  if(!removed) return NULL;
+  removed = g_list_reverse(removed);
 
   sqlite3_stmt *stmt;
-  const dt_image_t *img = dt_image_cache_get(darktable.image_cache, imgid, 'r');
-  int old_group_id = img->group_id;
-  dt_image_cache_read_release(darktable.image_cache, img);
+  dt_database_start_transaction(darktable.db);
+  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "DELETE FROM memory.removed_images", NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "INSERT INTO memory.removed_images VALUES (?1)", -1,
+                              &stmt, NULL);
+  for(GList *l = removed; l; l = g_list_next(l))
+  {
+    const int32_t imgid = GPOINTER_TO_INT(l->data);
+    const dt_image_t *img = dt_image_cache_get(darktable.image_cache, imgid, 'r');
+    int old_group_id = img->group_id;
+    dt_image_cache_read_release(darktable.image_cache, img);
 
-  // make sure we remove from the cache first, or else the cache will look for imgid in sql
-  dt_image_cache_remove(darktable.image_cache, imgid);
+    // make sure we remove from the cache first, or else the cache will look for imgid in sql
+    dt_image_cache_remove(darktable.image_cache, imgid);
 
-  int new_group_id = dt_grouping_remove_from_group(imgid);
-  if(darktable.gui && darktable.gui->expanded_group_id == old_group_id)
-    darktable.gui->expanded_group_id = new_group_id;
+    int new_group_id = dt_grouping_remove_from_group(imgid);
+    if(darktable.gui && darktable.gui->expanded_group_id == old_group_id)
+      darktable.gui->expanded_group_id = new_group_id;
 
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "DELETE FROM main.images WHERE id = ?1", -1, &stmt,
-                              NULL);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
-  sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "DELETE FROM main.tagged_images WHERE imgid = ?1", -1,
-                              &stmt, NULL);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
-  sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "DELETE FROM main.history WHERE imgid = ?1", -1,
-                              &stmt, NULL);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
-  sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "DELETE FROM main.masks_history WHERE imgid = ?1", -1,
-                              &stmt, NULL);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
-  sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "DELETE FROM main.color_labels WHERE imgid = ?1", -1,
-                              &stmt, NULL);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
-  sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "DELETE FROM main.meta_data WHERE id = ?1", -1, &stmt,
-                              NULL);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
-  sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "DELETE FROM main.selected_images WHERE imgid = ?1",
-                              -1, &stmt, NULL);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
-  sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "DELETE FROM main.module_order WHERE imgid = ?1",
-                              -1, &stmt, NULL);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
-  sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "DELETE FROM main.history_hash WHERE imgid = ?1",
-                              -1, &stmt, NULL);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
-  sqlite3_step(stmt);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+    sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+  }
   sqlite3_finalize(stmt);
-  // also clear all thumbnails in mipmap_cache.
-  dt_mipmap_cache_remove(darktable.mipmap_cache, imgid);
+
+  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db),
+                        "DELETE FROM main.images WHERE id IN (SELECT imgid FROM memory.removed_images)",
+                        NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db),
+                        "DELETE FROM main.tagged_images WHERE imgid IN (SELECT imgid FROM memory.removed_images)",
+                        NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db),
+                        "DELETE FROM main.history WHERE imgid IN (SELECT imgid FROM memory.removed_images)",
+                        NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db),
+                        "DELETE FROM main.masks_history WHERE imgid IN (SELECT imgid FROM memory.removed_images)",
+                        NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db),
+                        "DELETE FROM main.color_labels WHERE imgid IN (SELECT imgid FROM memory.removed_images)",
+                        NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db),
+                        "DELETE FROM main.meta_data WHERE id IN (SELECT imgid FROM memory.removed_images)",
+                        NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db),
+                        "DELETE FROM main.selected_images WHERE imgid IN (SELECT imgid FROM memory.removed_images)",
+                        NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db),
+                        "DELETE FROM main.module_order WHERE imgid IN (SELECT imgid FROM memory.removed_images)",
+                        NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db),
+                        "DELETE FROM main.history_hash WHERE imgid IN (SELECT imgid FROM memory.removed_images)",
+                        NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "DELETE FROM memory.removed_images", NULL, NULL, NULL);
+  dt_database_release_transaction(darktable.db);
+  dt_tag_index_invalidate();
+
+  for(GList *l = removed; l; l = g_list_next(l))
+  {
+    const int32_t imgid = GPOINTER_TO_INT(l->data);
+    // also clear all thumbnails in mipmap_cache.
+    dt_mipmap_cache_remove(darktable.mipmap_cache, imgid);
+    // and the pixelpipe checkpoints, the id might be reused by another image
+    dt_dev_pixelpipe_cache_disk_remove(imgid);
+  }
+  return removed;
 }
 
 gboolean dt_image_altered(const uint32_t imgid)
@@ -1421,8 +1475,9 @@ static uint32_t _image_import_internal(const int32_t film_id, const char *filena
   dt_tag_new(tagname, &tagid);
   dt_tag_attach(tagid, id, FALSE, FALSE);
 
-  // make sure that there are no stale thumbnails left
+  // make sure that there are no stale thumbnails or pixelpipe checkpoints left
   dt_mipmap_cache_remove(darktable.mipmap_cache, id);
+  dt_dev_pixelpipe_cache_disk_remove(id);
 
   // read all sidecar files
   _image_read_duplicates(id, normalized_filename);
@@ -1547,7 +1602,8 @@ void dt_image_refresh_makermodel(dt_image_t *img)
   g_strlcpy(img->camera_makermodel+len+1, img->camera_model, sizeof(img->camera_makermodel)-len-1);
 }
 
-int32_t dt_image_rename(const int32_t imgid, const int32_t filmid, const gchar *newname)
+static int32_t _image_rename(const int32_t imgid, const int32_t filmid, const gchar *newname,
+                             const gboolean transferred)
 {
   // TODO: several places where string truncation could occur unnoticed
   int32_t result = -1;
@@ -1599,12 +1655,15 @@ int32_t dt_image_rename(const int32_t imgid, const int32_t filmid, const gchar *
 
   if(new)
   {
+    // the queued sidecars are written before their files move
+    dt_image_sidecar_flush();
+
     // get current local copy if any
     _image_local_copy_full_path(imgid, copysrcpath, sizeof(copysrcpath));
 
     // move image
     GError *moveError = NULL;
-    gboolean moveStatus = g_file_move(old, new, 0, NULL, NULL, NULL, &moveError);
+    gboolean moveStatus = transferred || g_file_move(old, new, 0, NULL, NULL, NULL, &moveError);
 
     if(moveStatus)
     {
@@ -1734,12 +1793,23 @@ int32_t dt_image_rename(const int32_t imgid, const int32_t filmid, const gchar *
   return result;
 }
 
+int32_t dt_image_rename(const int32_t imgid, const int32_t filmid, const gchar *newname)
+{
+  return _image_rename(imgid, filmid, newname, FALSE);
+}
+
 int32_t dt_image_move(const int32_t imgid, const int32_t filmid)
 {
-  return dt_image_rename(imgid, filmid, NULL);
+  return _image_rename(imgid, filmid, NULL, FALSE);
 }
 
-int32_t dt_image_copy_rename(const int32_t imgid, const int32_t filmid, const gchar *newname)
+int32_t dt_image_move_transferred(const int32_t imgid, const int32_t filmid)
+{
+  return _image_rename(imgid, filmid, NULL, TRUE);
+}
+
+static int32_t _image_copy_rename(const int32_t imgid, const int32_t filmid, const gchar *newname,
+                                  const gboolean transferred)
 {
   int32_t newid = -1;
   sqlite3_stmt *stmt;
@@ -1798,7 +1868,7 @@ int32_t dt_image_copy_rename(const int32_t imgid, const int32_t filmid, const gc
     // copy image to new folder
     // if image file already exists, continue
     GError *gerror = NULL;
-    gboolean copyStatus = g_file_copy(src, dest, G_FILE_COPY_NONE, NULL, NULL, NULL, &gerror);
+    gboolean copyStatus = transferred || g_file_copy(src, dest, G_FILE_COPY_NONE, NULL, NULL, NULL, &gerror);
 
     if(copyStatus || g_error_matches(gerror, G_IO_ERROR, G_IO_ERROR_EXISTS))
     {
@@ -1907,6 +1977,7 @@ int32_t dt_image_copy_rename(const int32_t imgid, const int32_t filmid, const gc
         }
         g_list_free(tags);
 #endif
+        dt_tag_index_invalidate();
         // get max_version of image duplicates in destination filmroll
         int32_t max_version = -1;
         DT_DEBUG_SQLITE3_PREPARE_V2
@@ -2001,9 +2072,24 @@ int32_t dt_image_copy_rename(const int32_t imgid, const int32_t filmid, const gc
   return newid;
 }
 
+int32_t dt_image_copy_rename(const int32_t imgid, const int32_t filmid, const gchar *newname)
+{
+  return _image_copy_rename(imgid, filmid, newname, FALSE);
+}
+
 int32_t dt_image_copy(const int32_t imgid, const int32_t filmid)
 {
-  return dt_image_copy_rename(imgid, filmid, NULL);
+  return _image_copy_rename(imgid, filmid, NULL, FALSE);
+}
+
+int32_t dt_image_copy_transferred(const int32_t imgid, const int32_t filmid)
+{
+  return _image_copy_rename(imgid, filmid, NULL, TRUE);
+}
+
+void dt_image_local_copy_path(const int32_t imgid, char *pathname, size_t pathname_len)
+{
+  _image_local_copy_full_path(imgid, pathname, pathname_len);
 }
 
 int dt_image_local_copy_set(const int32_t imgid)
@@ -2122,9 +2208,9 @@ int dt_image_local_copy_reset(const int32_t imgid)
   {
     GFile *dest = g_file_new_for_path(locppath);
 
-    // first sync the xmp with the original picture
+    // first sync the xmp with the original picture, before the local copy goes away
 
-    dt_image_write_sidecar_file(imgid);
+    _image_write_sidecar_file_now(imgid);
 
     // delete image from cache directory only if there is no other local cache image referencing it
     // for example duplicates are all referencing the same base picture.
@@ -2159,7 +2245,7 @@ int dt_image_local_copy_reset(const int32_t imgid)
 // xmp stuff
 // *******************************************************
 
-void dt_image_write_sidecar_file(int imgid)
+static void _image_write_sidecar_file_now(const int imgid)
 {
   // TODO: compute hash and don't write if not needed!
   // write .xmp file
@@ -2200,6 +2286,156 @@ void dt_image_write_sidecar_file(int imgid)
   }
 }
 
+// bursts of edits write each sidecar only once, after they are over
+#define DT_SIDECAR_DEBOUNCE (G_TIME_SPAN_SECOND / 2)
+// but no sidecar waits longer than this during a long burst
+#define DT_SIDECAR_MAX_DELAY (3 * G_TIME_SPAN_SECOND)
+// backlogs from this size on show up in the progress ui
+#define DT_SIDECAR_PROGRESS_MIN 20
+
+static struct
+{
+  GMutex lock;
+  GCond cond;
+  GThread *thread;
+  GQueue order;       // imgids in the order they were queued first
+  GHashTable *queued; // set of the imgids in order
+  gint64 first, last; // when the oldest and the newest were queued
+  gboolean closed;
+  int writing;        // imgids being written right now, for dt_image_sidecar_flush()
+  dt_progress_t *progress;
+  int progress_done;
+} _sidecars = { .thread = NULL };
+
+// with the lock held. FALSE if there is nothing left.
+static gboolean _image_sidecar_write_next(void)
+{
+  if(g_queue_is_empty(&_sidecars.order)) return FALSE;
+  const int imgid = GPOINTER_TO_INT(g_queue_pop_head(&_sidecars.order));
+  // a change meanwhile queues it again
+  g_hash_table_remove(_sidecars.queued, GINT_TO_POINTER(imgid));
+  _sidecars.writing++;
+  g_mutex_unlock(&_sidecars.lock);
+  _image_write_sidecar_file_now(imgid);
+  g_mutex_lock(&_sidecars.lock);
+  _sidecars.writing--;
+  g_cond_broadcast(&_sidecars.cond);
+  return TRUE;
+}
+
+static void _image_sidecar_progress(void)
+{
+  const int left = g_queue_get_length(&_sidecars.order);
+  if(!_sidecars.progress && left >= DT_SIDECAR_PROGRESS_MIN && darktable.gui && !_sidecars.closed)
+  {
+    _sidecars.progress = dt_control_progress_create(darktable.control, TRUE, _("writing sidecar files"));
+    _sidecars.progress_done = 0;
+  }
+  if(!_sidecars.progress) return;
+  if(left == 0 || _sidecars.closed)
+  {
+    dt_control_progress_destroy(darktable.control, _sidecars.progress);
+    _sidecars.progress = NULL;
+  }
+  else
+    dt_control_progress_set_progress(darktable.control, _sidecars.progress,
+                                     (double)_sidecars.progress_done / (_sidecars.progress_done + left));
+}
+
+static gpointer _image_sidecar_writer(gpointer data)
+{
+  dt_pthread_setname("sidecars");
+  g_mutex_lock(&_sidecars.lock);
+  while(!_sidecars.closed)
+  {
+    if(g_queue_is_empty(&_sidecars.order))
+    {
+      g_cond_wait(&_sidecars.cond, &_sidecars.lock);
+      continue;
+    }
+    const gint64 until = MIN(_sidecars.last + DT_SIDECAR_DEBOUNCE, _sidecars.first + DT_SIDECAR_MAX_DELAY);
+    if(g_get_monotonic_time() < until)
+    {
+      g_cond_wait_until(&_sidecars.cond, &_sidecars.lock, until);
+      continue;
+    }
+    // what comes in while this backlog is written waits for its own turn
+    _sidecars.first = _sidecars.last = g_get_monotonic_time();
+    while(!_sidecars.closed && _image_sidecar_write_next())
+    {
+      _sidecars.progress_done++;
+      _image_sidecar_progress();
+    }
+    _image_sidecar_progress();
+  }
+  g_mutex_unlock(&_sidecars.lock);
+  return NULL;
+}
+
+void dt_image_write_sidecar_file(int imgid)
+{
+  if(imgid <= 0 || !dt_conf_get_bool("write_sidecar_files")) return;
+
+  g_mutex_lock(&_sidecars.lock);
+  if(!_sidecars.thread && !_sidecars.closed)
+  {
+    _sidecars.queued = g_hash_table_new(NULL, NULL);
+    g_queue_init(&_sidecars.order);
+    _sidecars.thread = g_thread_try_new("sidecars", _image_sidecar_writer, NULL, NULL);
+    if(!_sidecars.thread) g_hash_table_destroy(_sidecars.queued);
+  }
+  if(!_sidecars.thread || _sidecars.closed)
+  {
+    g_mutex_unlock(&_sidecars.lock);
+    _image_write_sidecar_file_now(imgid);
+    return;
+  }
+  if(!g_hash_table_contains(_sidecars.queued, GINT_TO_POINTER(imgid)))
+  {
+    const gint64 now = g_get_monotonic_time();
+    if(g_queue_is_empty(&_sidecars.order)) _sidecars.first = now;
+    _sidecars.last = now;
+    g_hash_table_add(_sidecars.queued, GINT_TO_POINTER(imgid));
+    g_queue_push_tail(&_sidecars.order, GINT_TO_POINTER(imgid));
+    g_cond_broadcast(&_sidecars.cond);
+  }
+  g_mutex_unlock(&_sidecars.lock);
+}
+
+void dt_image_sidecar_flush(void)
+{
+  g_mutex_lock(&_sidecars.lock);
+  if(_sidecars.thread)
+  {
+    while(_image_sidecar_write_next())
+      ;
+    // and what the writer thread is busy with
+    while(_sidecars.writing) g_cond_wait(&_sidecars.cond, &_sidecars.lock);
+  }
+  g_mutex_unlock(&_sidecars.lock);
+}
+
+void dt_image_sidecar_cleanup(void)
+{
+  g_mutex_lock(&_sidecars.lock);
+  _sidecars.closed = TRUE;
+  g_cond_broadcast(&_sidecars.cond);
+  GThread *thread = _sidecars.thread;
+  g_mutex_unlock(&_sidecars.lock);
+  if(!thread) return;
+
+  g_thread_join(thread);
+  // from now on sidecars are written right away
+  g_mutex_lock(&_sidecars.lock);
+  while(_image_sidecar_write_next())
+    ;
+  _image_sidecar_progress();
+  g_hash_table_destroy(_sidecars.queued);
+  _sidecars.queued = NULL;
+  _sidecars.thread = NULL;
+  g_mutex_unlock(&_sidecars.lock);
+}
+
 void dt_image_synch_xmps(const GList *img)
 {
   if(!img) return;
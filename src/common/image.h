@@ -266,6 +266,10 @@ uint32_t dt_image_import(int32_t film_id, const char *filename, gboolean overrid
 uint32_t dt_image_import_lua(int32_t film_id, const char *filename, gboolean override_ignore_jpegs);
 /** removes the given image from the database. */
 void dt_image_remove(const int32_t imgid);
+/** removes the given images from the database in one transaction, with a statement per table rather than per
+    image. images with a local copy whose original is not accessible are kept, the list of the removed ones is
+    returned. */
+GList *dt_image_remove_list(GList *imgs);
 /** duplicates the given image in the database with the duplicate getting the supplied version number. if that
     version already exists just return the imgid without producing new duplicate. called with newversion -1 a new
     duplicate is produced with the next free version number. */
@@ -285,6 +289,9 @@ void dt_image_set_location(const int32_t imgid, const dt_image_geoloc_t *geoloc,
 /** set images location lon/lat/ele */
 void dt_image_set_locations(const GList *img, const dt_image_geoloc_t *geoloc,
                            const gboolean undo_on);
+/** set a location of its own to each image, geolocs has one per entry of imgs. written in one transaction as one
+    undo step, with one signal for all */
+void dt_image_set_location_list(const GList *imgs, const dt_image_geoloc_t *geolocs, const gboolean undo_on);
 /** get image location lon/lat/ele */
 void dt_image_get_location(const int32_t imgid, dt_image_geoloc_t *geoloc);
 /** returns TRUE if current hash is not basic nor auto_apply, FALSE otherwise. */
@@ -348,6 +355,14 @@ int32_t dt_image_copy(const int32_t imgid, const int32_t filmid);
 /** physically copy image to the folder of the film roll with filmid and
  *  the name given by newname, and duplicate update database entries. */
 int32_t dt_image_copy_rename(const int32_t imgid, const int32_t filmid, const gchar *newname);
+/** as dt_image_move() and dt_image_copy(), for an image the caller already transferred to the folder of the
+ *  film roll under its name, e.g. with dt_fileop_run(). only the sidecars, the local copy and the database are
+ *  updated. */
+int32_t dt_image_move_transferred(const int32_t imgid, const int32_t filmid);
+int32_t dt_image_copy_transferred(const int32_t imgid, const int32_t filmid);
+/** where the local copy of the image is, or would be, kept. dt_image_local_copy_set() only updates the flags
+ *  if a file is there already. */
+void dt_image_local_copy_path(const int32_t imgid, char *pathname, size_t pathname_len);
 int dt_image_local_copy_set(const int32_t imgid);
 int dt_image_local_copy_reset(const int32_t imgid);
 /* check whether it is safe to remove a file */
@@ -355,7 +370,13 @@ gboolean dt_image_safe_remove(const int32_t imgid);
 /* try to sync .xmp for all local copies */
 void dt_image_local_copy_synch(void);
 // xmp functions:
+/** queues writing the .xmp of the image. bursts of changes are written once, after they are over, by a
+ * background thread. */
 void dt_image_write_sidecar_file(int imgid);
+/** writes all queued .xmp files now. */
+void dt_image_sidecar_flush(void);
+/** writes what is still queued and stops the background writer, later writes happen right away. */
+void dt_image_sidecar_cleanup(void);
 void dt_image_synch_xmp(const int selected);
 void dt_image_synch_xmps(const GList *img);
 void dt_image_synch_all_xmp(const gchar *pathname);
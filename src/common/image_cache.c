@@ -27,6 +27,56 @@
 #include <sqlite3.h>
 #include <inttypes.h>
 
+static void _snapshot_fill(dt_image_snapshot_t *snap, const dt_image_t *img)
+{
+  snap->id = img->id;
+  snap->group_id = img->group_id;
+  snap->film_id = img->film_id;
+  snap->flags = img->flags;
+  snap->version = img->version;
+  snap->orientation = img->orientation;
+  snap->width = img->width;
+  snap->height = img->height;
+  snap->final_width = img->final_width;
+  snap->final_height = img->final_height;
+  snap->p_width = img->p_width;
+  snap->p_height = img->p_height;
+  snap->aspect_ratio = img->aspect_ratio;
+  snap->is_hdr = dt_image_is_hdr(img);
+}
+
+static void _snapshot_publish(dt_image_cache_t *cache, const dt_image_t *img)
+{
+  if(!cache->snapshots || img->id <= 0) return;
+  dt_image_snapshot_slot_t *slot = cache->snapshots + (img->id & (DT_IMAGE_SNAPSHOT_SLOTS - 1));
+
+  // writers go one after the other, readers retry while seq is odd or has changed
+  dt_pthread_mutex_lock(&cache->snapshot_lock);
+  slot->seq++;
+  __sync_synchronize();
+  _snapshot_fill(&slot->snap, img);
+  __sync_synchronize();
+  slot->seq++;
+  dt_pthread_mutex_unlock(&cache->snapshot_lock);
+}
+
+static void _snapshot_clear(dt_image_cache_t *cache, const uint32_t imgid)
+{
+  if(!cache->snapshots) return;
+  dt_image_snapshot_slot_t *slot = cache->snapshots + (imgid & (DT_IMAGE_SNAPSHOT_SLOTS - 1));
+
+  dt_pthread_mutex_lock(&cache->snapshot_lock);
+  if(slot->snap.id == (int32_t)imgid)
+  {
+    slot->seq++;
+    __sync_synchronize();
+    slot->snap.id = 0;
+    __sync_synchronize();
+    slot->seq++;
+  }
+  dt_pthread_mutex_unlock(&cache->snapshot_lock);
+}
+
 void dt_image_cache_allocate(void *data, dt_cache_entry_t *entry)
 {
   entry->cost = sizeof(dt_image_t);
@@ -36,15 +86,15 @@ void dt_image_cache_allocate(void *data, dt_cache_entry_t *entry)
   entry->data = img;
   // load stuff from db and store in cache:
   sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(
-      dt_database_get(darktable.db),
+  DT_DEBUG_SQLITE3_PREPARE_CACHED(
+      darktable.db,
       "SELECT id, group_id, film_id, width, height, filename, maker, model, lens, exposure, "
       "aperture, iso, focal_length, datetime_taken, flags, crop, orientation, focus_distance, "
       "raw_parameters, longitude, latitude, altitude, color_matrix, colorspace, version, raw_black, "
       "raw_maximum, aspect_ratio, exposure_bias, "
       "import_timestamp, change_timestamp, export_timestamp, print_timestamp "
       "FROM main.images WHERE id = ?1",
-      -1, &stmt, NULL);
+      &stmt);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, entry->key);
   if(sqlite3_step(stmt) == SQLITE_ROW)
   {
@@ -153,10 +203,11 @@ void dt_image_cache_allocate(void *data, dt_cache_entry_t *entry)
     fprintf(stderr, "[image_cache_allocate] failed to open image %" PRIu32 " from database: %s\n", entry->key,
             sqlite3_errmsg(dt_database_get(darktable.db)));
   }
-  sqlite3_finalize(stmt);
+  DT_DEBUG_SQLITE3_RELEASE_CACHED(darktable.db, stmt);
   img->cache_entry = entry; // init backref
   // could downgrade lock write->read on entry->lock if we were using concurrencykit..
   dt_image_refresh_makermodel(img);
+  _snapshot_publish((dt_image_cache_t *)data, img);
 }
 
 void dt_image_cache_deallocate(void *data, dt_cache_entry_t *entry)
@@ -176,6 +227,8 @@ void dt_image_cache_init(dt_image_cache_t *cache)
   //       can we get away with a fixed size?
   const uint32_t max_mem = 50 * 1024 * 1024;
   const uint32_t num = (uint32_t)(1.5f * max_mem / sizeof(dt_image_t));
+  dt_pthread_mutex_init(&cache->snapshot_lock, NULL);
+  cache->snapshots = g_malloc0_n(DT_IMAGE_SNAPSHOT_SLOTS, sizeof(dt_image_snapshot_slot_t));
   dt_cache_init(&cache->cache, sizeof(dt_image_t), max_mem);
   dt_cache_set_allocate_callback(&cache->cache, &dt_image_cache_allocate, cache);
   dt_cache_set_cleanup_callback(&cache->cache, &dt_image_cache_deallocate, cache);
@@ -186,6 +239,9 @@ void dt_image_cache_init(dt_image_cache_t *cache)
 void dt_image_cache_cleanup(dt_image_cache_t *cache)
 {
   dt_cache_cleanup(&cache->cache);
+  g_free(cache->snapshots);
+  cache->snapshots = NULL;
+  dt_pthread_mutex_destroy(&cache->snapshot_lock);
 }
 
 void dt_image_cache_print(dt_image_cache_t *cache)
@@ -216,6 +272,39 @@ dt_image_t *dt_image_cache_testget(dt_image_cache_t *cache, const uint32_t imgid
   return img;
 }
 
+gboolean dt_image_cache_get_snapshot(dt_image_cache_t *cache, const uint32_t imgid, dt_image_snapshot_t *snap)
+{
+  if(imgid <= 0) return FALSE;
+  if(cache->snapshots)
+  {
+    const dt_image_snapshot_slot_t *slot = cache->snapshots + (imgid & (DT_IMAGE_SNAPSHOT_SLOTS - 1));
+    // a writer only holds the slot for a few stores, so give up after a while rather than spinning
+    for(int tries = 0; tries < 100; tries++)
+    {
+      const uint32_t seq = slot->seq;
+      if(seq & 1) continue;
+      __sync_synchronize();
+      *snap = slot->snap;
+      __sync_synchronize();
+      if(slot->seq != seq) continue;
+      if(snap->id == (int32_t)imgid) return TRUE;
+      break;
+    }
+  }
+
+  // not there or taken by another image, read it the slow way and publish it for next time
+  const dt_image_t *img = dt_image_cache_get(cache, imgid, 'r');
+  if(!img) return FALSE;
+  const gboolean found = img->id == (int32_t)imgid;
+  if(found)
+  {
+    _snapshot_fill(snap, img);
+    _snapshot_publish(cache, img);
+  }
+  dt_image_cache_read_release(cache, img);
+  return found;
+}
+
 // drops the read lock on an image struct
 void dt_image_cache_read_release(dt_image_cache_t *cache, const dt_image_t *img)
 {
@@ -243,8 +332,8 @@ void dt_image_cache_write_release(dt_image_cache_t *cache, dt_image_t *img, dt_i
   if(img->id <= 0) return;
 
   sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(
-      dt_database_get(darktable.db),
+  DT_DEBUG_SQLITE3_PREPARE_CACHED(
+      darktable.db,
       "UPDATE main.images SET width = ?1, height = ?2, filename = ?3, maker = ?4, model = ?5, "
       "lens = ?6, exposure = ?7, aperture = ?8, iso = ?9, focal_length = ?10, "
       "focus_distance = ?11, film_id = ?12, datetime_taken = ?13, flags = ?14, "
@@ -253,7 +342,7 @@ void dt_image_cache_write_release(dt_image_cache_t *cache, dt_image_t *img, dt_i
       "raw_maximum = ?25, aspect_ratio = ROUND(?26,1), exposure_bias = ?27, "
       "change_timestamp = ?28, change_timestamp = ?29, export_timestamp = ?30, print_timestamp = ?31 "
       "WHERE id = ?32",
-      -1, &stmt, NULL);
+      &stmt);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, img->width);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, img->height);
   DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 3, img->filename, -1, SQLITE_STATIC);
@@ -289,7 +378,7 @@ void dt_image_cache_write_release(dt_image_cache_t *cache, dt_image_t *img, dt_i
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 32, img->id);
   const int rc = sqlite3_step(stmt);
   if(rc != SQLITE_DONE) fprintf(stderr, "[image_cache_write_release] sqlite3 error %d\n", rc);
-  sqlite3_finalize(stmt);
+  DT_DEBUG_SQLITE3_RELEASE_CACHED(darktable.db, stmt);
 
   // TODO: make this work in relaxed mode, too.
   if(mode == DT_IMAGE_CACHE_SAFE)
@@ -298,6 +387,7 @@ void dt_image_cache_write_release(dt_image_cache_t *cache, dt_image_t *img, dt_i
     // also synch dttags file:
     dt_image_write_sidecar_file(img->id);
   }
+  _snapshot_publish(cache, img);
   dt_cache_release(&cache->cache, img->cache_entry);
 }
 
@@ -305,6 +395,7 @@ void dt_image_cache_write_release(dt_image_cache_t *cache, dt_image_t *img, dt_i
 // remove the image from the cache
 void dt_image_cache_remove(dt_image_cache_t *cache, const uint32_t imgid)
 {
+  _snapshot_clear(cache, imgid);
   dt_cache_remove(&cache->cache, imgid);
 }
 
@@ -21,9 +21,35 @@
 #include "common/cache.h"
 #include "common/image.h"
 
+// the fields of an image struct most views read, see dt_image_cache_get_snapshot()
+typedef struct dt_image_snapshot_t
+{
+  int32_t id, group_id, film_id, flags, version;
+  dt_image_orientation_t orientation;
+  int32_t width, height, final_width, final_height, p_width, p_height;
+  float aspect_ratio;
+  gboolean is_hdr; // dt_image_is_hdr(), which also looks at the file name
+}
+dt_image_snapshot_t;
+
+// one snapshot per slot, the key is the image id modulo the number of slots. seq is odd while the slot is
+// being written.
+typedef struct dt_image_snapshot_slot_t
+{
+  volatile uint32_t seq;
+  dt_image_snapshot_t snap;
+}
+dt_image_snapshot_slot_t;
+
+#define DT_IMAGE_SNAPSHOT_SLOTS (1 << 15)
+
 typedef struct dt_image_cache_t
 {
   dt_cache_t cache;
+
+  // snapshots are written when an image struct is loaded or released after writing, under this lock
+  dt_image_snapshot_slot_t *snapshots;
+  dt_pthread_mutex_t snapshot_lock;
 }
 dt_image_cache_t;
 
@@ -55,6 +81,11 @@ dt_image_t *dt_image_cache_get(dt_image_cache_t *cache, const uint32_t imgid, ch
 // is currently unavailable.
 dt_image_t *dt_image_cache_testget(dt_image_cache_t *cache, const uint32_t imgid, char mode);
 
+// copies the fields in dt_image_snapshot_t without locking anything, unless the image has not been
+// snapshotted since it was loaded, then this reads it like dt_image_cache_get() once.
+// returns FALSE if there is no such image.
+gboolean dt_image_cache_get_snapshot(dt_image_cache_t *cache, const uint32_t imgid, dt_image_snapshot_t *snap);
+
 // drops the read lock on an image struct
 void dt_image_cache_read_release(dt_image_cache_t *cache, const dt_image_t *img);
 
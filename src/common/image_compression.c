@@ -16,6 +16,7 @@
     along with darktable.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include "common/image_compression.h"
+#include "common/darktable.h"
 
 #include <math.h>
 #include <stdio.h>
@@ -151,6 +152,148 @@ void dt_image_compress(const float *in, uint8_t *out, const int32_t width, const
   }
 }
 
+// samples coded together with the bit width of the largest residual
+#define DT_RAW_GROUP 16
+// worst case of a group: its width and 16 residuals of 17 bits
+#define DT_RAW_GROUP_MAX (1 + (DT_RAW_GROUP * 17 + 7) / 8)
+
+static inline size_t _raw_row_max(const int32_t width)
+{
+  return (size_t)((width + DT_RAW_GROUP - 1) / DT_RAW_GROUP) * DT_RAW_GROUP_MAX;
+}
+
+static size_t _compress_raw_row(const uint16_t *in, const int32_t width, uint8_t *out)
+{
+  size_t len = 0;
+  for(int32_t i = 0; i < width; i += DT_RAW_GROUP)
+  {
+    const int n = MIN(DT_RAW_GROUP, width - i);
+    uint32_t v[DT_RAW_GROUP];
+    uint32_t all = 0;
+    for(int k = 0; k < n; k++)
+    {
+      const int32_t x = i + k;
+      const int32_t residual = (int32_t)in[x] - (x >= 2 ? (int32_t)in[x - 2] : 0);
+      v[k] = ((uint32_t)residual << 1) ^ (uint32_t)(residual >> 31);
+      all |= v[k];
+    }
+    const int bits = all ? 32 - __builtin_clz(all) : 0;
+    out[len++] = bits;
+
+    uint64_t acc = 0;
+    int fill = 0;
+    for(int k = 0; k < n; k++)
+    {
+      acc |= (uint64_t)v[k] << fill;
+      fill += bits;
+      for(; fill >= 8; fill -= 8, acc >>= 8) out[len++] = acc & 0xff;
+    }
+    if(fill > 0) out[len++] = acc & 0xff;
+  }
+  return len;
+}
+
+static int _uncompress_raw_row(const uint8_t *in, const size_t length, uint16_t *out, const int32_t width)
+{
+  const uint8_t *end = in + length;
+  for(int32_t i = 0; i < width; i += DT_RAW_GROUP)
+  {
+    const int n = MIN(DT_RAW_GROUP, width - i);
+    if(in >= end) return 1;
+    const int bits = *in++;
+    if(bits > 17 || in + (n * bits + 7) / 8 > end) return 1;
+
+    const uint32_t mask = (1u << bits) - 1;
+    uint64_t acc = 0;
+    int fill = 0;
+    for(int k = 0; k < n; k++)
+    {
+      for(; fill < bits; fill += 8) acc |= (uint64_t)*in++ << fill;
+      const uint32_t v = acc & mask;
+      acc >>= bits;
+      fill -= bits;
+      const int32_t x = i + k;
+      const int32_t residual = (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+      out[x] = residual + (x >= 2 ? out[x - 2] : 0);
+    }
+  }
+  return 0;
+}
+
+size_t dt_image_compress_raw(const uint16_t *in, const int32_t width, const int32_t height, uint8_t **out)
+{
+  *out = NULL;
+  const size_t row_max = _raw_row_max(width);
+  const size_t header = (height + 1) * sizeof(uint64_t);
+  uint8_t *blob = g_try_malloc(header + row_max * height);
+  if(!blob) return 0;
+
+  // every row gets coded into its worst case slot in parallel, then they are moved together
+  uint64_t *offsets = (uint64_t *)blob;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) dt_omp_firstprivate(in, width, height, row_max, header, blob, offsets) \
+  schedule(static)
+#endif
+  for(int32_t j = 0; j < height; j++)
+    offsets[j + 1] = _compress_raw_row(in + (size_t)j * width, width, blob + header + row_max * j);
+
+  offsets[0] = header;
+  for(int32_t j = 0; j < height; j++)
+  {
+    const size_t len = offsets[j + 1];
+    memmove(blob + offsets[j], blob + header + row_max * j, len);
+    offsets[j + 1] = offsets[j] + len;
+  }
+  const size_t length = offsets[height];
+  *out = g_realloc(blob, length);
+  return length;
+}
+
+int dt_image_uncompress_raw(const uint8_t *in, const size_t length, uint16_t *out, const int32_t width,
+                            const int32_t height)
+{
+  const uint64_t *offsets = (const uint64_t *)in;
+  const size_t header = (height + 1) * sizeof(uint64_t);
+  if(length < header || offsets[0] != header || offsets[height] != length) return 1;
+
+  int err = 0;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) dt_omp_firstprivate(in, out, offsets, width, height) reduction(| : err) \
+  schedule(static)
+#endif
+  for(int32_t j = 0; j < height; j++)
+  {
+    if(offsets[j + 1] < offsets[j])
+      err |= 1;
+    else
+      err |= _uncompress_raw_row(in + offsets[j], offsets[j + 1] - offsets[j], out + (size_t)j * width, width);
+  }
+  return err;
+}
+
+size_t dt_image_compress_half(const float *in, const size_t n, uint8_t **out)
+{
+  uint16_t *half = g_try_malloc(n * sizeof(uint16_t));
+  *out = (uint8_t *)half;
+  if(!half) return 0;
+#ifdef _OPENMP
+#pragma omp parallel for simd default(none) dt_omp_firstprivate(in, half, n) schedule(static)
+#endif
+  for(size_t i = 0; i < n; i++) half[i] = dt_image_float_to_half(in[i]);
+  return n * sizeof(uint16_t);
+}
+
+int dt_image_uncompress_half(const uint8_t *in, const size_t length, float *out, const size_t n)
+{
+  if(length != n * sizeof(uint16_t)) return 1;
+  const uint16_t *half = (const uint16_t *)in;
+#ifdef _OPENMP
+#pragma omp parallel for simd default(none) dt_omp_firstprivate(half, out, n) schedule(static)
+#endif
+  for(size_t i = 0; i < n; i++) out[i] = dt_image_half_to_float(half[i]);
+  return 0;
+}
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -19,12 +19,69 @@
 #pragma once
 
 #include <inttypes.h>
+#include <stddef.h>
 
 /** K. Roimela, T. Aarnio and J. Itäranta. High Dynamic Range Texture Compression. Proceedings of SIGGRAPH
  * 2006. */
 void dt_image_compress(const float *in, uint8_t *out, const int32_t width, const int32_t height);
 void dt_image_uncompress(const uint8_t *in, float *out, const int32_t width, const int32_t height);
 
+/** lossless compression of a single channel uint16 raw buffer. every sample is predicted by the one two columns
+ * to the left, which has the same colour on a bayer sensor, and the residuals are bit packed in groups of 16 at the
+ * width of the largest one. rows are coded independently, so both directions run in parallel.
+ * returns the length of the data put into *out, which is freed with g_free(), or 0 on failure. */
+size_t dt_image_compress_raw(const uint16_t *in, const int32_t width, const int32_t height, uint8_t **out);
+/** returns non-zero if the data is broken. */
+int dt_image_uncompress_raw(const uint8_t *in, const size_t length, uint16_t *out, const int32_t width,
+                            const int32_t height);
+
+/** near-lossless compression of n floats to half floats, for buffers which are only read like the input of the
+ * preview pipe. returns the length of the data put into *out, which is freed with g_free(), or 0 on failure. */
+size_t dt_image_compress_half(const float *in, const size_t n, uint8_t **out);
+/** returns non-zero if the data doesn't hold n values. */
+int dt_image_uncompress_half(const uint8_t *in, const size_t length, float *out, const size_t n);
+
+// float <-> half conversion with round to nearest even. values beyond the half range are clamped
+// to the largest finite half, scene referred data is allowed to go that high.
+static inline uint16_t dt_image_float_to_half(const float f)
+{
+  union { float f; uint32_t i; } u = { .f = f };
+  const uint32_t sign = (u.i >> 16) & 0x8000u;
+  uint32_t abs = u.i & 0x7fffffffu;
+
+  if(abs > 0x7f800000u) return sign | 0x7e00u;       // nan
+  if(abs == 0x7f800000u) return sign | 0x7c00u;      // inf
+  if(abs >= 0x477ff000u) return sign | 0x7bffu;      // rounds to inf, clamp
+  if(abs < 0x38800000u)
+  {
+    // denormal half: let the fpu do the rounding by adding a magic number
+    union { uint32_t i; float f; } magic = { .i = 0x3f000000u }, v = { .i = abs };
+    v.f += magic.f;
+    return sign | (uint16_t)(v.i - magic.i);
+  }
+  const uint32_t odd = (abs >> 13) & 1u;
+  abs += 0xc8000fffu + odd; // rebias the exponent and round
+  return sign | (uint16_t)(abs >> 13);
+}
+
+static inline float dt_image_half_to_float(const uint16_t h)
+{
+  union { uint32_t i; float f; } o = { .i = (uint32_t)(h & 0x7fffu) << 13 };
+  const uint32_t exp = o.i & 0x0f800000u;
+  o.i += 0x38000000u;
+  if(exp == 0x0f800000u)
+    o.i += 0x38000000u; // inf and nan
+  else if(exp == 0)
+  {
+    // denormal half
+    const union { uint32_t i; float f; } magic = { .i = 0x38800000u };
+    o.i += 0x00800000u;
+    o.f -= magic.f;
+  }
+  o.i |= (uint32_t)(h & 0x8000u) << 16;
+  return o.f;
+}
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -46,12 +46,14 @@
 #include "common/imageio_avif.h"
 #endif
 #include "common/mipmap_cache.h"
+#include "common/opencl.h"
 #include "common/styles.h"
 #include "control/conf.h"
 #include "control/control.h"
 #include "develop/blend.h"
 #include "develop/develop.h"
 #include "develop/imageop.h"
+#include "develop/masks.h"
 
 #ifdef HAVE_GRAPHICSMAGICK
 #include <magick/api.h>
@@ -596,6 +598,44 @@ void dt_imageio_to_fractional(float in, uint32_t *num, uint32_t *den)
   }
 }
 
+// images being exported right now, see dt_imageio_export_threads()
+static gint _exports_running = 0;
+
+int dt_imageio_export_threads(const int threads)
+{
+  return MAX(threads / MAX(g_atomic_int_get(&_exports_running), 1), 1);
+}
+
+static int _export_with_flags(const uint32_t imgid, const char *filename, dt_imageio_module_format_t *format,
+                              dt_imageio_module_data_t *format_params, const gboolean ignore_exif,
+                              const gboolean display_byteorder, const gboolean high_quality, const gboolean upscale,
+                              const gboolean thumbnail_export, const char *filter, const gboolean copy_metadata,
+                              const gboolean export_masks, dt_colorspaces_color_profile_type_t icc_type,
+                              const gchar *icc_filename, dt_iop_color_intent_t icc_intent,
+                              dt_imageio_module_storage_t *storage, dt_imageio_module_data_t *storage_params,
+                              int num, int total, dt_export_metadata_t *metadata, const gboolean tmpfile_event);
+
+static int _export(const uint32_t imgid, const char *filename, dt_imageio_module_format_t *format,
+                   dt_imageio_module_data_t *format_params, const gboolean high_quality, const gboolean upscale,
+                   const gboolean copy_metadata, const gboolean export_masks,
+                   dt_colorspaces_color_profile_type_t icc_type, const gchar *icc_filename,
+                   dt_iop_color_intent_t icc_intent, dt_imageio_module_storage_t *storage,
+                   dt_imageio_module_data_t *storage_params, int num, int total, dt_export_metadata_t *metadata,
+                   const gboolean tmpfile_event)
+{
+  if(strcmp(format->mime(format_params), "x-copy") == 0)
+    /* This is a just a copy, skip process and just export */
+    return format->write_image(format_params, filename, NULL, icc_type, icc_filename, NULL, 0, imgid, num, total, NULL,
+                               export_masks);
+
+  g_atomic_int_inc(&_exports_running);
+  const int res = _export_with_flags(imgid, filename, format, format_params, FALSE, FALSE, high_quality, upscale,
+                                     FALSE, NULL, copy_metadata, export_masks, icc_type, icc_filename, icc_intent,
+                                     storage, storage_params, num, total, metadata, tmpfile_event);
+  g_atomic_int_dec_and_test(&_exports_running);
+  return res;
+}
+
 int dt_imageio_export(const uint32_t imgid, const char *filename, dt_imageio_module_format_t *format,
                       dt_imageio_module_data_t *format_params, const gboolean high_quality, const gboolean upscale,
                       const gboolean copy_metadata, const gboolean export_masks,
@@ -603,14 +643,312 @@ int dt_imageio_export(const uint32_t imgid, const char *filename, dt_imageio_mod
                       dt_iop_color_intent_t icc_intent, dt_imageio_module_storage_t *storage,
                       dt_imageio_module_data_t *storage_params, int num, int total, dt_export_metadata_t *metadata)
 {
-  if(strcmp(format->mime(format_params), "x-copy") == 0)
-    /* This is a just a copy, skip process and just export */
-    return format->write_image(format_params, filename, NULL, icc_type, icc_filename, NULL, 0, imgid, num, total, NULL,
-                               export_masks);
+  return _export(imgid, filename, format, format_params, high_quality, upscale, copy_metadata, export_masks,
+                 icc_type, icc_filename, icc_intent, storage, storage_params, num, total, metadata, TRUE);
+}
+
+int dt_imageio_export_staged(const uint32_t imgid, const char *filename, dt_imageio_module_format_t *format,
+                             dt_imageio_module_data_t *format_params, const gboolean high_quality,
+                             const gboolean upscale, const gboolean copy_metadata, const gboolean export_masks,
+                             dt_colorspaces_color_profile_type_t icc_type, const gchar *icc_filename,
+                             dt_iop_color_intent_t icc_intent, dt_imageio_module_storage_t *storage,
+                             dt_imageio_module_data_t *storage_params, int num, int total,
+                             dt_export_metadata_t *metadata)
+{
+  return _export(imgid, filename, format, format_params, high_quality, upscale, copy_metadata, export_masks,
+                 icc_type, icc_filename, icc_intent, storage, storage_params, num, total, metadata, FALSE);
+}
+
+void dt_imageio_export_tmpfile_event(const uint32_t imgid, const char *filename, dt_imageio_module_format_t *format,
+                                     dt_imageio_module_data_t *format_params, dt_imageio_module_storage_t *storage,
+                                     dt_imageio_module_data_t *storage_params)
+{
+  if(!strcmp(format->mime(format_params), "memory") || (format->flags(format_params) & FORMAT_FLAGS_NO_TMPFILE))
+    return;
+
+#ifdef USE_LUA
+  //Synchronous calling of lua intermediate-export-image events
+  dt_lua_lock();
+
+  lua_State *L = darktable.lua_state.state;
+
+  luaA_push(L, dt_lua_image_t, &imgid);
+
+  lua_pushstring(L, filename);
+
+  luaA_push_type(L, format->parameter_lua_type, format_params);
+
+  if (storage)
+    luaA_push_type(L, storage->parameter_lua_type, storage_params);
+  else
+    lua_pushnil(L);
+
+  dt_lua_event_trigger(L, "intermediate-export-image", 4);
+
+  dt_lua_unlock();
+#endif
+
+  dt_control_signal_raise(darktable.signals, DT_SIGNAL_IMAGE_EXPORT_TMPFILE, imgid, filename, format,
+                          format_params, storage, storage_params);
+}
+
+// converts the float or 8-bit output of the pipe in place to what the format writer takes
+static void _export_convert(uint8_t *const outbuf, const size_t npixels, const int bpp, const gboolean float_input,
+                            const gboolean display_byteorder)
+{
+  if(bpp == 8)
+  {
+    if(display_byteorder)
+    {
+      if(float_input)
+      {
+        const float *const inbuf = (float *)outbuf;
+        for(size_t k = 0; k < npixels; k++)
+        {
+          // convert in place, this is unfortunately very serial..
+          const uint8_t r = CLAMP(inbuf[4 * k + 2] * 0xff, 0, 0xff);
+          const uint8_t g = CLAMP(inbuf[4 * k + 1] * 0xff, 0, 0xff);
+          const uint8_t b = CLAMP(inbuf[4 * k + 0] * 0xff, 0, 0xff);
+          outbuf[4 * k + 0] = r;
+          outbuf[4 * k + 1] = g;
+          outbuf[4 * k + 2] = b;
+        }
+      }
+      // else processing output was 8-bit already, and no need to swap order
+    }
+    else // need to flip
+    {
+      // ldr output: char
+      if(float_input)
+      {
+        const float *const inbuf = (float *)outbuf;
+        for(size_t k = 0; k < npixels; k++)
+        {
+          // convert in place, this is unfortunately very serial..
+          const uint8_t r = CLAMP(inbuf[4 * k + 0] * 0xff, 0, 0xff);
+          const uint8_t g = CLAMP(inbuf[4 * k + 1] * 0xff, 0, 0xff);
+          const uint8_t b = CLAMP(inbuf[4 * k + 2] * 0xff, 0, 0xff);
+          outbuf[4 * k + 0] = r;
+          outbuf[4 * k + 1] = g;
+          outbuf[4 * k + 2] = b;
+        }
+      }
+      else
+      { // !display_byteorder, need to swap:
+        uint8_t *const buf8 = outbuf;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(npixels, buf8) \
+  schedule(static)
+#endif
+        // just flip byte order
+        for(size_t k = 0; k < npixels; k++)
+        {
+          uint8_t tmp = buf8[4 * k + 0];
+          buf8[4 * k + 0] = buf8[4 * k + 2];
+          buf8[4 * k + 2] = tmp;
+        }
+      }
+    }
+  }
+  else if(bpp == 16)
+  {
+    // uint16_t per color channel
+    float *buff = (float *)outbuf;
+    uint16_t *buf16 = (uint16_t *)outbuf;
+    for(size_t k = 0; k < npixels; k++)
+    {
+      // convert in place
+      for(int i = 0; i < 3; i++) buf16[4 * k + i] = CLAMP(buff[4 * k + i] * 0x10000, 0, 0xffff);
+    }
+  }
+  // else output float, no further harm done to the pixels :)
+}
+
+// hands the strips of a streamed export to the format writer
+typedef struct _export_sink_t
+{
+  dt_imageio_module_format_t *format;
+  dt_imageio_module_data_t *format_params;
+  void *state; // of the format writer
+  int width, bpp;
+  gboolean float_input, display_byteorder;
+  uint8_t *rows; // the pipe output is converted in a copy, the pipe might still hold on to it
+  size_t rows_size;
+} _export_sink_t;
+
+static int _export_sink(const uint8_t *buf, const size_t bpp, const int y, const int height, void *data)
+{
+  _export_sink_t *sink = (_export_sink_t *)data;
+  const size_t size = bpp * sink->width * height;
+  if(size > sink->rows_size)
+  {
+    dt_free_align(sink->rows);
+    sink->rows = dt_alloc_align(64, size);
+    sink->rows_size = sink->rows ? size : 0;
+    if(!sink->rows) return 1;
+  }
+  memcpy(sink->rows, buf, size);
+  _export_convert(sink->rows, (size_t)sink->width * height, sink->bpp, sink->float_input, sink->display_byteorder);
+  return sink->format->write_rows(sink->format_params, sink->state, sink->rows, y, height);
+}
+
+// the develop and the pipe of an export. during a batch, the last one of every thread is kept for the next
+// image if that has the same history and comes from the same camera, so that its modules don't have to be
+// instantiated and committed again.
+typedef struct _export_template_t
+{
+  uint64_t key;
+  dt_develop_t dev;
+  dt_dev_pixelpipe_t pipe;
+} _export_template_t;
+
+static __thread struct
+{
+  int depth;
+  _export_template_t *template;
+} _export_batch = { 0, NULL };
+
+#define EXPORT_HASH(hash, value) dt_dev_pixelpipe_cache_hash_data(hash, &(value), sizeof(value))
+
+// everything the nodes of a pipe are committed from: the params of the modules and their order, the
+// properties of the image the modules look at and the settings of the export.
+static uint64_t _export_template_key(dt_develop_t *dev, const dt_mipmap_buffer_t *buf,
+                                     const gboolean thumbnail_export, const int levels, const gboolean export_masks,
+                                     const dt_colorspaces_color_profile_type_t icc_type, const gchar *icc_filename,
+                                     const dt_iop_color_intent_t icc_intent, const char *filter)
+{
+  uint64_t hash = 0;
+  hash = EXPORT_HASH(hash, thumbnail_export);
+  hash = EXPORT_HASH(hash, levels);
+  hash = EXPORT_HASH(hash, export_masks);
+  hash = EXPORT_HASH(hash, icc_type);
+  hash = EXPORT_HASH(hash, icc_intent);
+  if(icc_filename) hash = dt_dev_pixelpipe_cache_hash_data(hash, icc_filename, strlen(icc_filename));
+  if(filter) hash = dt_dev_pixelpipe_cache_hash_data(hash, filter, strlen(filter) + 1);
+  hash = EXPORT_HASH(hash, buf->width);
+  hash = EXPORT_HASH(hash, buf->height);
+  hash = EXPORT_HASH(hash, buf->iscale);
+
+  const dt_image_t *img = &dev->image_storage;
+  hash = EXPORT_HASH(hash, img->orientation);
+  hash = EXPORT_HASH(hash, img->exif_exposure);
+  hash = EXPORT_HASH(hash, img->exif_exposure_bias);
+  hash = EXPORT_HASH(hash, img->exif_aperture);
+  hash = EXPORT_HASH(hash, img->exif_iso);
+  hash = EXPORT_HASH(hash, img->exif_focal_length);
+  hash = EXPORT_HASH(hash, img->exif_focus_distance);
+  hash = EXPORT_HASH(hash, img->exif_crop);
+  hash = EXPORT_HASH(hash, img->exif_maker);
+  hash = EXPORT_HASH(hash, img->exif_model);
+  hash = EXPORT_HASH(hash, img->exif_lens);
+  hash = EXPORT_HASH(hash, img->camera_makermodel);
+  hash = EXPORT_HASH(hash, img->width);
+  hash = EXPORT_HASH(hash, img->height);
+  hash = EXPORT_HASH(hash, img->p_width);
+  hash = EXPORT_HASH(hash, img->p_height);
+  hash = EXPORT_HASH(hash, img->crop_x);
+  hash = EXPORT_HASH(hash, img->crop_y);
+  hash = EXPORT_HASH(hash, img->crop_width);
+  hash = EXPORT_HASH(hash, img->crop_height);
+  hash = EXPORT_HASH(hash, img->flags);
+  hash = EXPORT_HASH(hash, img->loader);
+  hash = EXPORT_HASH(hash, img->buf_dsc.channels);
+  hash = EXPORT_HASH(hash, img->buf_dsc.datatype);
+  hash = EXPORT_HASH(hash, img->buf_dsc.filters);
+  hash = EXPORT_HASH(hash, img->buf_dsc.xtrans);
+  hash = EXPORT_HASH(hash, img->buf_dsc.processed_maximum);
+  hash = EXPORT_HASH(hash, img->d65_color_matrix);
+  if(img->profile) hash = dt_dev_pixelpipe_cache_hash_data(hash, img->profile, img->profile_size);
+  hash = EXPORT_HASH(hash, img->colorspace);
+  hash = EXPORT_HASH(hash, img->raw_black_level);
+  hash = EXPORT_HASH(hash, img->raw_black_level_separate);
+  hash = EXPORT_HASH(hash, img->raw_white_point);
+  hash = EXPORT_HASH(hash, img->fuji_rotation_pos);
+  hash = EXPORT_HASH(hash, img->pixel_aspect_ratio);
+  hash = EXPORT_HASH(hash, img->wb_coeffs);
+  hash = EXPORT_HASH(hash, img->usercrop);
+
+  // the defaults of the modules, which the pipe starts from, and the history on top
+  for(GList *modules = dev->iop; modules; modules = g_list_next(modules))
+  {
+    const dt_iop_module_t *module = (dt_iop_module_t *)modules->data;
+    hash = dt_dev_pixelpipe_cache_hash_data(hash, module->op, strlen(module->op));
+    hash = EXPORT_HASH(hash, module->multi_priority);
+    hash = EXPORT_HASH(hash, module->iop_order);
+    hash = EXPORT_HASH(hash, module->default_enabled);
+    hash = dt_dev_pixelpipe_cache_hash_data(hash, module->default_params, module->params_size);
+    if(module->default_blendop_params)
+      hash = dt_dev_pixelpipe_cache_hash_data(hash, module->default_blendop_params,
+                                              sizeof(dt_develop_blend_params_t));
+  }
+  GList *history = dev->history;
+  for(int k = 0; k < dev->history_end && history; k++, history = g_list_next(history))
+  {
+    const dt_dev_history_item_t *hist = (dt_dev_history_item_t *)history->data;
+    hash = dt_dev_pixelpipe_cache_hash_data(hash, hist->module->op, strlen(hist->module->op));
+    hash = EXPORT_HASH(hash, hist->module->multi_priority);
+    hash = EXPORT_HASH(hash, hist->enabled);
+    hash = dt_dev_pixelpipe_cache_hash_data(hash, hist->params, hist->module->params_size);
+    if(hist->blend_params)
+    {
+      hash = dt_dev_pixelpipe_cache_hash_data(hash, hist->blend_params, sizeof(dt_develop_blend_params_t));
+      dt_masks_form_t *grp = dt_masks_get_from_id(dev, hist->blend_params->mask_id);
+      const int length = dt_masks_group_get_hash_buffer_length(grp);
+      if(length > 0)
+      {
+        char *str = malloc(length);
+        dt_masks_group_get_hash_buffer(grp, str);
+        hash = dt_dev_pixelpipe_cache_hash_data(hash, str, length);
+        free(str);
+      }
+    }
+  }
+  return hash;
+}
+
+#undef EXPORT_HASH
+
+static void _export_template_free(_export_template_t *t)
+{
+  if(!t) return;
+  dt_dev_pixelpipe_cleanup(&t->pipe);
+  dt_dev_cleanup(&t->dev);
+  free(t);
+}
+
+// returns the kept export of this thread if it has the key, and drops it otherwise
+static _export_template_t *_export_template_take(const uint64_t key)
+{
+  _export_template_t *t = _export_batch.template;
+  _export_batch.template = NULL;
+  if(t && t->key == key) return t;
+  _export_template_free(t);
+  return NULL;
+}
+
+// keeps the export for the next image of the batch, or frees it
+static void _export_template_keep(_export_template_t *t)
+{
+  if(_export_batch.depth > 0 && dt_conf_get_bool("plugins/lighttable/export/reuse_pipe"))
+  {
+    _export_template_free(_export_batch.template);
+    _export_batch.template = t;
+  }
   else
-    return dt_imageio_export_with_flags(imgid, filename, format, format_params, FALSE, FALSE, high_quality, upscale,
-                                        FALSE, NULL, copy_metadata, export_masks, icc_type, icc_filename, icc_intent,
-                                        storage, storage_params, num, total, metadata);
+    _export_template_free(t);
+}
+
+void dt_imageio_export_batch_begin(void)
+{
+  _export_batch.depth++;
+}
+
+void dt_imageio_export_batch_end(void)
+{
+  if(--_export_batch.depth > 0) return;
+  _export_template_free(_export_batch.template);
+  _export_batch.template = NULL;
 }
 
 // internal function: to avoid exif blob reading + 8-bit byteorder flag + high-quality override
@@ -624,12 +962,37 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
                                  dt_imageio_module_data_t *storage_params, int num, int total,
                                  dt_export_metadata_t *metadata)
 {
-  dt_develop_t dev;
-  dt_dev_init(&dev, 0);
-  dt_dev_load_image(&dev, imgid);
+  return _export_with_flags(imgid, filename, format, format_params, ignore_exif, display_byteorder, high_quality,
+                            upscale, thumbnail_export, filter, copy_metadata, export_masks, icc_type, icc_filename,
+                            icc_intent, storage, storage_params, num, total, metadata, TRUE);
+}
 
+static int _export_with_flags(const uint32_t imgid, const char *filename, dt_imageio_module_format_t *format,
+                              dt_imageio_module_data_t *format_params, const gboolean ignore_exif,
+                              const gboolean display_byteorder, const gboolean high_quality, const gboolean upscale,
+                              const gboolean thumbnail_export, const char *filter, const gboolean copy_metadata,
+                              const gboolean export_masks, dt_colorspaces_color_profile_type_t icc_type,
+                              const gchar *icc_filename, dt_iop_color_intent_t icc_intent,
+                              dt_imageio_module_storage_t *storage, dt_imageio_module_data_t *storage_params,
+                              int num, int total, dt_export_metadata_t *metadata, const gboolean tmpfile_event)
+{
+  _export_template_t *t = (_export_template_t *)calloc(1, sizeof(_export_template_t));
+  dt_develop_t *dev = &t->dev;
+  dt_dev_pixelpipe_t *pipe = &t->pipe;
+  dt_dev_init(dev, 0);
+  dt_dev_load_image(dev, imgid);
+
+  // small thumbnails of bayer raws lose nothing by starting from the half size mosaic of the mip_f buffer, which
+  // has twice the pixels of the largest of them even after cropping to half the width. this saves running the
+  // modules before demosaic on the whole sensor.
+  const dt_mipmap_cache_t *cache = darktable.mipmap_cache;
+  const gboolean small_thumbnail
+      = thumbnail_export && dev->image_storage.buf_dsc.filters && dev->image_storage.buf_dsc.filters != 9u
+        && format_params->max_width > 0 && format_params->max_height > 0
+        && (uint32_t)format_params->max_width <= cache->max_width[DT_MIPMAP_F]
+        && (uint32_t)format_params->max_height <= cache->max_height[DT_MIPMAP_F];
   const int buf_is_downscaled
-      = (thumbnail_export && dt_conf_get_bool("plugins/lighttable/low_quality_thumbnails"));
+      = (thumbnail_export && (small_thumbnail || dt_conf_get_bool("plugins/lighttable/low_quality_thumbnails")));
 
   dt_mipmap_buffer_t buf;
   if(buf_is_downscaled)
@@ -637,7 +1000,7 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
   else
     dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, DT_MIPMAP_FULL, DT_MIPMAP_BLOCKING, 'r');
 
-  const dt_image_t *img = &dev.image_storage;
+  const dt_image_t *img = &dev->image_storage;
 
   if(!buf.buf || !buf.width || !buf.height)
   {
@@ -654,17 +1017,6 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
 
   dt_times_t start;
   dt_get_times(&start);
-  dt_dev_pixelpipe_t pipe;
-  res = thumbnail_export ? dt_dev_pixelpipe_init_thumbnail(&pipe, wd, ht)
-                         : dt_dev_pixelpipe_init_export(&pipe, wd, ht, format->levels(format_params), export_masks);
-  if(!res)
-  {
-    dt_control_log(
-        _("failed to allocate memory for %s, please lower the threads used for export or buy more memory."),
-        thumbnail_export ? C_("noun", "thumbnail export") : C_("noun", "export"));
-    goto error;
-  }
-
   //  If a style is to be applied during export, add the iop params into the history
   if(!thumbnail_export && format_params->style[0] != '\0')
   {
@@ -672,20 +1024,20 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
     if(!style_items)
     {
       dt_control_log(_("cannot find the style '%s' to apply during export."), format_params->style);
-      goto error;
+      goto error_early;
     }
 
     GList *modules_used = NULL;
 
-    dt_dev_pop_history_items_ext(&dev, dev.history_end);
+    dt_dev_pop_history_items_ext(dev, dev->history_end);
 
-    dt_ioppr_update_for_style_items(&dev, style_items, format_params->style_append);
+    dt_ioppr_update_for_style_items(dev, style_items, format_params->style_append);
 
     GList *st_items = g_list_first(style_items);
     while(st_items)
     {
       dt_style_item_t *st_item = (dt_style_item_t *)st_items->data;
-      dt_styles_apply_style_item(&dev, st_item, &modules_used, format_params->style_append);
+      dt_styles_apply_style_item(dev, st_item, &modules_used, format_params->style_append);
 
       st_items = g_list_next(st_items);
     }
@@ -694,21 +1046,52 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
     g_list_free_full(style_items, dt_style_item_free);
   }
 
-  dt_ioppr_resync_modules_order(&dev);
-
-  dt_dev_pixelpipe_set_icc(&pipe, icc_type, icc_filename, icc_intent);
-  dt_dev_pixelpipe_set_input(&pipe, &dev, (float *)buf.buf, buf.width, buf.height, buf.iscale);
-  dt_dev_pixelpipe_create_nodes(&pipe, &dev);
-  dt_dev_pixelpipe_synch_all(&pipe, &dev);
+  dt_ioppr_resync_modules_order(dev);
 
-  if(filter)
+  t->key = _export_template_key(dev, &buf, thumbnail_export, format->levels(format_params), export_masks, icc_type,
+                                icc_filename, icc_intent, filter);
+  _export_template_t *reused = _export_template_take(t->key);
+  if(reused)
   {
-    if(!strncmp(filter, "pre:", 4)) dt_dev_pixelpipe_disable_after(&pipe, filter + 4);
-    if(!strncmp(filter, "post:", 5)) dt_dev_pixelpipe_disable_before(&pipe, filter + 5);
+    // the nodes of the last image are committed with the same params already, only the image changes
+    reused->dev.image_storage = dev->image_storage;
+    dt_dev_cleanup(dev);
+    free(t);
+    t = reused;
+    dev = &t->dev;
+    pipe = &t->pipe;
+    img = &dev->image_storage;
+    pipe->cache_obsolete = 1;
+    dt_dev_pixelpipe_set_input(pipe, dev, (float *)buf.buf, buf.width, buf.height, buf.iscale);
+    dt_print(DT_DEBUG_IMAGEIO, "[dt_imageio_export] imgid %d reuses the pipe of the last export\n", imgid);
+  }
+  else
+  {
+    res = thumbnail_export
+              ? dt_dev_pixelpipe_init_thumbnail(pipe, wd, ht)
+              : dt_dev_pixelpipe_init_export(pipe, wd, ht, format->levels(format_params), export_masks);
+    if(!res)
+    {
+      dt_control_log(
+          _("failed to allocate memory for %s, please lower the threads used for export or buy more memory."),
+          thumbnail_export ? C_("noun", "thumbnail export") : C_("noun", "export"));
+      goto error;
+    }
+
+    dt_dev_pixelpipe_set_icc(pipe, icc_type, icc_filename, icc_intent);
+    dt_dev_pixelpipe_set_input(pipe, dev, (float *)buf.buf, buf.width, buf.height, buf.iscale);
+    dt_dev_pixelpipe_create_nodes(pipe, dev);
+    dt_dev_pixelpipe_synch_all(pipe, dev);
+
+    if(filter)
+    {
+      if(!strncmp(filter, "pre:", 4)) dt_dev_pixelpipe_disable_after(pipe, filter + 4);
+      if(!strncmp(filter, "post:", 5)) dt_dev_pixelpipe_disable_before(pipe, filter + 5);
+    }
   }
 
-  dt_dev_pixelpipe_get_dimensions(&pipe, &dev, pipe.iwidth, pipe.iheight, &pipe.processed_width,
-                                  &pipe.processed_height);
+  dt_dev_pixelpipe_get_dimensions(pipe, dev, pipe->iwidth, pipe->iheight, &pipe->processed_width,
+                                  &pipe->processed_height);
 
   dt_show_times(&start, "[export] creating pixelpipe");
 
@@ -720,7 +1103,7 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
   }
   else if(icc_type == DT_COLORSPACE_NONE)
   {
-    GList *modules = dev.iop;
+    GList *modules = dev->iop;
     dt_iop_module_t *colorout = NULL;
     while(modules)
     {
@@ -741,8 +1124,8 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
 
   // get only once at the beginning, in case the user changes it on the way:
   const gboolean high_quality_processing
-      = ((format_params->max_width == 0 || format_params->max_width >= pipe.processed_width)
-         && (format_params->max_height == 0 || format_params->max_height >= pipe.processed_height))
+      = ((format_params->max_width == 0 || format_params->max_width >= pipe->processed_width)
+         && (format_params->max_height == 0 || format_params->max_height >= pipe->processed_height))
             ? FALSE
             : high_quality;
 
@@ -766,8 +1149,8 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
   */
 
   const gboolean iscropped =
-    ((pipe.processed_width < (wd - img->crop_x - img->crop_width)) ||
-     (pipe.processed_height < (ht - img->crop_y - img->crop_height)));
+    ((pipe->processed_width < (wd - img->crop_x - img->crop_width)) ||
+     (pipe->processed_height < (ht - img->crop_y - img->crop_height)));
 
   const gboolean exact_size = (
       iscropped ||
@@ -781,14 +1164,14 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
 
   if(iscropped && !thumbnail_export && width == 0 && height == 0)
   {
-    width = pipe.processed_width;
-    height = pipe.processed_height;
+    width = pipe->processed_width;
+    height = pipe->processed_height;
   }
 
   const double max_scale = ( upscale && ( width > 0 || height > 0 )) ? 100.0 : 1.0;
 
-  const double scalex = width > 0 ? fmin((double)width / (double)pipe.processed_width, max_scale) : max_scale;
-  const double scaley = height > 0 ? fmin((double)height / (double)pipe.processed_height, max_scale) : max_scale;
+  const double scalex = width > 0 ? fmin((double)width / (double)pipe->processed_width, max_scale) : max_scale;
+  const double scaley = height > 0 ? fmin((double)height / (double)pipe->processed_height, max_scale) : max_scale;
   double scale = fmin(scalex, scaley);
   double corrscale = 1.0f;
 
@@ -798,21 +1181,21 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
   gboolean corrected = FALSE;
   float origin[] = { 0.0f, 0.0f };
 
-  if(dt_dev_distort_backtransform_plus(&dev, &pipe, 0.f, DT_DEV_TRANSFORM_DIR_ALL, origin, 1))
+  if(dt_dev_distort_backtransform_plus(dev, pipe, 0.f, DT_DEV_TRANSFORM_DIR_ALL, origin, 1))
   {
     if((width == 0) && exact_size)
-      width = pipe.processed_width;
+      width = pipe->processed_width;
     if((height == 0) && exact_size)
-      height = pipe.processed_height;
+      height = pipe->processed_height;
 
-    scale = fmin(width >  0 ? fmin((double)width / (double)pipe.processed_width, max_scale) : max_scale,
-                 height > 0 ? fmin((double)height / (double)pipe.processed_height, max_scale) : max_scale);
+    scale = fmin(width >  0 ? fmin((double)width / (double)pipe->processed_width, max_scale) : max_scale,
+                 height > 0 ? fmin((double)height / (double)pipe->processed_height, max_scale) : max_scale);
 
-    processed_width = scale * pipe.processed_width + 0.8f;
-    processed_height = scale * pipe.processed_height + 0.8f;
+    processed_width = scale * pipe->processed_width + 0.8f;
+    processed_height = scale * pipe->processed_height + 0.8f;
 
-    if((ceil((double)processed_width / scale) + origin[0] > pipe.iwidth) ||
-       (ceil((double)processed_height / scale) + origin[1] > pipe.iheight))
+    if((ceil((double)processed_width / scale) + origin[0] > pipe->iwidth) ||
+       (ceil((double)processed_height / scale) + origin[1] > pipe->iheight))
     {
       corrected = TRUE;
      /* Here the scale is too **small** so while reading data from the right or low borders we are out-of-bounds.
@@ -822,8 +1205,8 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
      */
       if(exact_size)
       {
-        corrscale = fmax( ((double)(pipe.processed_width + 1) / (double)(pipe.processed_width)),
-                           ((double)(pipe.processed_height +1) / (double)(pipe.processed_height)) );
+        corrscale = fmax( ((double)(pipe->processed_width + 1) / (double)(pipe->processed_width)),
+                           ((double)(pipe->processed_height +1) / (double)(pipe->processed_height)) );
         scale = scale * corrscale;
       }
       else
@@ -834,28 +1217,69 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
     }
 
     dt_print(DT_DEBUG_IMAGEIO,"[dt_imageio_export] imgid %d, pipe %ix%i, range %ix%i --> exact %i, upscale %i, corrected %i, scale %.7f, corr %.6f, size %ix%i\n",
-             imgid, pipe.processed_width, pipe.processed_height, format_params->max_width, format_params->max_height,
+             imgid, pipe->processed_width, pipe->processed_height, format_params->max_width, format_params->max_height,
              exact_size, upscale, corrected, scale, corrscale, processed_width, processed_height);
   }
   else
   {
-    processed_width = floor(scale * pipe.processed_width);
-    processed_height = floor(scale * pipe.processed_height);
+    processed_width = floor(scale * pipe->processed_width);
+    processed_height = floor(scale * pipe->processed_height);
     dt_print(DT_DEBUG_IMAGEIO,"[dt_imageio_export] (direct) imgid %d, pipe %ix%i, range %ix%i --> size %ix%i / %ix%i\n",
-             imgid, pipe.processed_width, pipe.processed_height, format_params->max_width, format_params->max_height,
+             imgid, pipe->processed_width, pipe->processed_height, format_params->max_width, format_params->max_height,
              processed_width, processed_height, width, height);
   }
 
   const int bpp = format->bpp(format_params);
 
+  // process the export in strips, so at most the final image has to fit into memory in one piece. some
+  // formats ask for it themselves as they can't afford the full image.
+  const gboolean streamed = (format->flags && (format->flags(format_params) & FORMAT_FLAGS_STREAMED))
+                            || dt_conf_get_bool("plugins/lighttable/export/tile_streaming");
+  const int strip_height = (!thumbnail_export && streamed)
+                               ? dt_conf_get_int("plugins/lighttable/export/tile_streaming_height")
+                               : 0;
+  // and spread them over several opencl devices if allowed
+  const int devices = thumbnail_export ? 1 : dt_opencl_export_devices();
+
+  format_params->width = processed_width;
+  format_params->height = processed_height;
+
+  int length = 0;
+  uint8_t *exif_profile = NULL; // Exif data should be 65536 bytes max, but if original size is close to that,
+                                // adding new tags could make it go over that... so let it be and see what
+                                // happens when we write the image
+  if(!ignore_exif)
+  {
+    char pathname[PATH_MAX] = { 0 };
+    gboolean from_cache = TRUE;
+    dt_image_full_path(imgid, pathname, sizeof(pathname), &from_cache);
+    // last param is dng mode, it's false here
+    length = dt_exif_read_blob(&exif_profile, pathname, imgid, sRGB, processed_width, processed_height, 0);
+  }
+
+  // formats which can take rows get the strips as they are done, so the output image is never assembled.
+  // masks are written from the pipe after the image, so they need the classic way.
+  _export_sink_t sink = { .format = format,
+                          .format_params = format_params,
+                          .width = processed_width,
+                          .bpp = bpp,
+                          .float_input = bpp != 8 || high_quality_processing,
+                          .display_byteorder = display_byteorder };
+  if(strip_height > 0 && format->write_rows && !export_masks)
+    sink.state = format->write_image_begin(format_params, filename, icc_type, icc_filename, exif_profile, length,
+                                           imgid, num, total);
+  dt_dev_pixelpipe_strip_sink_t strip_sink = sink.state ? _export_sink : NULL;
+
   dt_get_times(&start);
+  int pipe_err;
   if(high_quality_processing)
   {
     /*
      * if high quality processing was requested, downsampling will be done
      * at the very end of the pipe (just before border and watermark)
      */
-    dt_dev_pixelpipe_process_no_gamma(&pipe, &dev, 0, 0, processed_width, processed_height, scale);
+    pipe_err = dt_dev_pixelpipe_process_streamed(pipe, dev, processed_width, processed_height, scale, FALSE,
+                                                 strip_height, devices, strip_sink, &sink);
   }
   else
   {
@@ -866,7 +1290,7 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
     // find the finalscale module
     dt_dev_pixelpipe_iop_t *finalscale = NULL;
     {
-      GList *nodes = g_list_last(pipe.nodes);
+      GList *nodes = g_list_last(pipe->nodes);
       while(nodes)
       {
         dt_dev_pixelpipe_iop_t *node = (dt_dev_pixelpipe_iop_t *)(nodes->data);
@@ -882,117 +1306,33 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
     if(finalscale) finalscale->enabled = 0;
 
     // do the processing (8-bit with special treatment, to make sure we can use openmp further down):
-    if(bpp == 8)
-      dt_dev_pixelpipe_process(&pipe, &dev, 0, 0, processed_width, processed_height, scale);
-    else
-      dt_dev_pixelpipe_process_no_gamma(&pipe, &dev, 0, 0, processed_width, processed_height, scale);
+    pipe_err = dt_dev_pixelpipe_process_streamed(pipe, dev, processed_width, processed_height, scale, bpp == 8,
+                                                 strip_height, devices, strip_sink, &sink);
 
     if(finalscale) finalscale->enabled = 1;
   }
   dt_show_times(&start, thumbnail_export ? "[dev_process_thumbnail] pixel pipeline processing"
                                          : "[dev_process_export] pixel pipeline processing");
 
-  uint8_t *outbuf = pipe.backbuf;
-
-  // downconversion to low-precision formats:
-  if(bpp == 8)
+  if(sink.state)
   {
-    if(display_byteorder)
-    {
-      if(high_quality_processing)
-      {
-        const float *const inbuf = (float *)outbuf;
-        for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
-        {
-          // convert in place, this is unfortunately very serial..
-          const uint8_t r = CLAMP(inbuf[4 * k + 2] * 0xff, 0, 0xff);
-          const uint8_t g = CLAMP(inbuf[4 * k + 1] * 0xff, 0, 0xff);
-          const uint8_t b = CLAMP(inbuf[4 * k + 0] * 0xff, 0, 0xff);
-          outbuf[4 * k + 0] = r;
-          outbuf[4 * k + 1] = g;
-          outbuf[4 * k + 2] = b;
-        }
-      }
-      // else processing output was 8-bit already, and no need to swap order
-    }
-    else // need to flip
-    {
-      // ldr output: char
-      if(high_quality_processing)
-      {
-        const float *const inbuf = (float *)outbuf;
-        for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
-        {
-          // convert in place, this is unfortunately very serial..
-          const uint8_t r = CLAMP(inbuf[4 * k + 0] * 0xff, 0, 0xff);
-          const uint8_t g = CLAMP(inbuf[4 * k + 1] * 0xff, 0, 0xff);
-          const uint8_t b = CLAMP(inbuf[4 * k + 2] * 0xff, 0, 0xff);
-          outbuf[4 * k + 0] = r;
-          outbuf[4 * k + 1] = g;
-          outbuf[4 * k + 2] = b;
-        }
-      }
-      else
-      { // !display_byteorder, need to swap:
-        uint8_t *const buf8 = pipe.backbuf;
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(processed_width, processed_height, buf8) \
-  schedule(static)
-#endif
-        // just flip byte order
-        for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
-        {
-          uint8_t tmp = buf8[4 * k + 0];
-          buf8[4 * k + 0] = buf8[4 * k + 2];
-          buf8[4 * k + 2] = tmp;
-        }
-      }
-    }
+    res = format->write_image_end(format_params, sink.state, pipe_err);
+    if(pipe_err) res = 1;
+    dt_free_align(sink.rows);
   }
-  else if(bpp == 16)
+  else
   {
-    // uint16_t per color channel
-    float *buff = (float *)outbuf;
-    uint16_t *buf16 = (uint16_t *)outbuf;
-    for(int y = 0; y < processed_height; y++)
-      for(int x = 0; x < processed_width; x++)
-      {
-        // convert in place
-        const size_t k = (size_t)processed_width * y + x;
-        for(int i = 0; i < 3; i++) buf16[4 * k + i] = CLAMP(buff[4 * k + i] * 0x10000, 0, 0xffff);
-      }
-  }
-  // else output float, no further harm done to the pixels :)
-
-  format_params->width = processed_width;
-  format_params->height = processed_height;
+    uint8_t *outbuf = pipe->backbuf;
 
-  if(!ignore_exif)
-  {
-    int length;
-    uint8_t *exif_profile = NULL; // Exif data should be 65536 bytes max, but if original size is close to that,
-                                  // adding new tags could make it go over that... so let it be and see what
-                                  // happens when we write the image
-    char pathname[PATH_MAX] = { 0 };
-    gboolean from_cache = TRUE;
-    dt_image_full_path(imgid, pathname, sizeof(pathname), &from_cache);
-    // last param is dng mode, it's false here
-    length = dt_exif_read_blob(&exif_profile, pathname, imgid, sRGB, processed_width, processed_height, 0);
+    // downconversion to low-precision formats:
+    _export_convert(outbuf, (size_t)processed_width * processed_height, bpp, sink.float_input, display_byteorder);
 
     res = format->write_image(format_params, filename, outbuf, icc_type, icc_filename, exif_profile, length, imgid,
-                              num, total, &pipe, export_masks);
-
-    free(exif_profile);
-  }
-  else
-  {
-    res = format->write_image(format_params, filename, outbuf, icc_type, icc_filename, NULL, 0, imgid, num, total,
-                              &pipe, export_masks);
+                              num, total, pipe, export_masks);
   }
+  free(exif_profile);
 
-  dt_dev_pixelpipe_cleanup(&pipe);
-  dt_dev_cleanup(&dev);
+  _export_template_keep(t);
   dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
 
   /* now write xmp into that container, if possible */
@@ -1002,41 +1342,16 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
     // no need to cancel the export if this fail
   }
 
-  if(!thumbnail_export && strcmp(format->mime(format_params), "memory")
-    && !(format->flags(format_params) & FORMAT_FLAGS_NO_TMPFILE))
-  {
-#ifdef USE_LUA
-    //Synchronous calling of lua intermediate-export-image events
-    dt_lua_lock();
-
-    lua_State *L = darktable.lua_state.state;
-
-    luaA_push(L, dt_lua_image_t, &imgid);
-
-    lua_pushstring(L, filename);
-
-    luaA_push_type(L, format->parameter_lua_type, format_params);
-
-    if (storage)
-      luaA_push_type(L, storage->parameter_lua_type, storage_params);
-    else
-      lua_pushnil(L);
-
-    dt_lua_event_trigger(L, "intermediate-export-image", 4);
-
-    dt_lua_unlock();
-#endif
-
-    dt_control_signal_raise(darktable.signals, DT_SIGNAL_IMAGE_EXPORT_TMPFILE, imgid, filename, format,
-                            format_params, storage, storage_params);
-  }
+  if(!thumbnail_export && tmpfile_event)
+    dt_imageio_export_tmpfile_event(imgid, filename, format, format_params, storage, storage_params);
 
   return res;
 
 error:
-  dt_dev_pixelpipe_cleanup(&pipe);
+  dt_dev_pixelpipe_cleanup(pipe);
 error_early:
-  dt_dev_cleanup(&dev);
+  dt_dev_cleanup(dev);
+  free(t);
   dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
   return 1;
 }
@@ -77,6 +77,24 @@ int dt_imageio_export(const uint32_t imgid, const char *filename, struct dt_imag
                       dt_iop_color_intent_t icc_intent, dt_imageio_module_storage_t *storage,
                       dt_imageio_module_data_t *storage_params, int num, int total, dt_export_metadata_t *metadata);
 
+/** like dt_imageio_export(), for a file which is moved to its destination afterwards. the caller raises
+ *  dt_imageio_export_tmpfile_event() once it is there, so scripts see the file under its final name. */
+int dt_imageio_export_staged(const uint32_t imgid, const char *filename, struct dt_imageio_module_format_t *format,
+                             struct dt_imageio_module_data_t *format_params, const gboolean high_quality,
+                             const gboolean upscale, const gboolean copy_metadata, const gboolean export_masks,
+                             dt_colorspaces_color_profile_type_t icc_type, const gchar *icc_filename,
+                             dt_iop_color_intent_t icc_intent, dt_imageio_module_storage_t *storage,
+                             dt_imageio_module_data_t *storage_params, int num, int total,
+                             dt_export_metadata_t *metadata);
+/** the intermediate-export-image event of the lua scripts and DT_SIGNAL_IMAGE_EXPORT_TMPFILE for an exported file */
+void dt_imageio_export_tmpfile_event(const uint32_t imgid, const char *filename,
+                                     struct dt_imageio_module_format_t *format,
+                                     struct dt_imageio_module_data_t *format_params,
+                                     dt_imageio_module_storage_t *storage, dt_imageio_module_data_t *storage_params);
+
+// the share of `threads' an encoder should use while several images are being exported at the same time
+int dt_imageio_export_threads(const int threads);
+
 int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
                                  struct dt_imageio_module_format_t *format,
                                  struct dt_imageio_module_data_t *format_params, const gboolean ignore_exif,
@@ -87,6 +105,11 @@ int dt_imageio_export_with_flags(const uint32_t imgid, const char *filename,
                                  dt_imageio_module_storage_t *storage, dt_imageio_module_data_t *storage_params,
                                  int num, int total, dt_export_metadata_t *metadata);
 
+// between these, the exports of the calling thread keep their pipe for the next image with the same history
+// and camera, see plugins/lighttable/export/reuse_pipe
+void dt_imageio_export_batch_begin(void);
+void dt_imageio_export_batch_end(void);
+
 size_t dt_imageio_write_pos(int i, int j, int wd, int ht, float fwd, float fht,
                             dt_image_orientation_t orientation);
 
@@ -39,7 +39,9 @@ typedef enum dt_imageio_format_flags_t
 {
   FORMAT_FLAGS_SUPPORT_XMP = 1,
   FORMAT_FLAGS_NO_TMPFILE = 2,
-  FORMAT_FLAGS_SUPPORT_LAYERS = 4
+  FORMAT_FLAGS_SUPPORT_LAYERS = 4,
+  FORMAT_FLAGS_STREAMED = 8, // always exported in strips handed to write_rows(), whatever the preferences say
+  FORMAT_FLAGS_PARALLEL = 16 // several images may be written at the same time, each with its own params
 } dt_imageio_format_flags_t;
 
 /**
@@ -122,6 +124,12 @@ typedef struct dt_imageio_module_format_t
                      dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
                      void *exif, int exif_len, int imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
                      const gboolean export_masks);
+  /* optional row-wise writing of images as the pipe finishes them, NULL if not supported. */
+  void *(*write_image_begin)(dt_imageio_module_data_t *data, const char *filename,
+                             dt_colorspaces_color_profile_type_t over_type, const char *over_filename, void *exif,
+                             int exif_len, int imgid, int num, int total);
+  int (*write_rows)(dt_imageio_module_data_t *data, void *state, const void *in, int y, int height);
+  int (*write_image_end)(dt_imageio_module_data_t *data, void *state, const gboolean failed);
   /* flag that describes the available precision/levels of output format. mainly used for dithering. */
   int (*levels)(dt_imageio_module_data_t *data);
 
@@ -183,6 +191,8 @@ typedef struct dt_imageio_module_storage_t
                dt_iop_color_intent_t icc_intent, dt_export_metadata_t *metadata_flags);
   /* called once at the end (after exporting all images), if implemented. */
   void (*finalize_store)(struct dt_imageio_module_storage_t *self, dt_imageio_module_data_t *data);
+  /* true if store() may be called for several images at the same time, if implemented. */
+  int (*parallel_store)(struct dt_imageio_module_storage_t *self);
 
   void *(*legacy_params)(struct dt_imageio_module_storage_t *self, const void *const old_params,
                          const size_t old_params_size, const int old_version, const int new_version,
@@ -22,7 +22,11 @@
 
 #include "RawSpeed-API.h"
 
+#include <gio/gio.h>
 #include <memory>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
 
 #define __STDC_LIMIT_MACROS
 
@@ -103,6 +107,36 @@ void dt_rawspeed_lookup_makermodel(const char *maker, const char *model,
   }
 }
 
+// the raw file mapped instead of read into a heap buffer. the decoder works on the page cache directly, which
+// other processes decoding the same file share. files on remote filesystems aren't mapped: the mapping faults
+// when the server goes away and they gain nothing from it. NULL if the file should be read.
+static GMappedFile *_map_raw_file(const char *filename)
+{
+  GFile *file = g_file_new_for_path(filename);
+  GFileInfo *info = g_file_query_filesystem_info(file, G_FILE_ATTRIBUTE_FILESYSTEM_REMOTE, NULL, NULL);
+  const gboolean remote = info && g_file_info_get_attribute_boolean(info, G_FILE_ATTRIBUTE_FILESYSTEM_REMOTE);
+  if(info) g_object_unref(info);
+  g_object_unref(file);
+  if(remote) return NULL;
+
+  GMappedFile *map = g_mapped_file_new(filename, FALSE, NULL);
+  if(!map) return NULL;
+  const size_t length = g_mapped_file_get_length(map);
+  if(length == 0 || length > UINT32_MAX)
+  {
+    g_mapped_file_unref(map);
+    return NULL;
+  }
+
+#ifndef _WIN32
+  // the whole file gets decoded, have the kernel read it ahead of the decoder
+  char *data = g_mapped_file_get_contents(map);
+  madvise(data, length, MADV_SEQUENTIAL);
+  madvise(data, length, MADV_WILLNEED);
+#endif
+  return map;
+}
+
 uint32_t dt_rawspeed_crop_dcraw_filters(uint32_t filters, uint32_t crop_x, uint32_t crop_y)
 {
   if(!filters || filters == 9u) return filters;
@@ -119,6 +153,8 @@ dt_imageio_retval_t dt_imageio_open_rawspeed(dt_image_t *img, const char *filena
   snprintf(filen, sizeof(filen), "%s", filename);
   FileReader f(filen);
 
+  // has to outlive the buffer and the decoder using it
+  std::unique_ptr<GMappedFile, decltype(&g_mapped_file_unref)> map(_map_raw_file(filen), g_mapped_file_unref);
   std::unique_ptr<RawDecoder> d;
   std::unique_ptr<const Buffer> m;
 
@@ -127,7 +163,17 @@ dt_imageio_retval_t dt_imageio_open_rawspeed(dt_image_t *img, const char *filena
     dt_rawspeed_load_meta();
 
     dt_pthread_mutex_lock(&darktable.readFile_mutex);
-    m = f.readFile();
+    if(map)
+    {
+      const uint8_t *data = (const uint8_t *)g_mapped_file_get_contents(map.get());
+      const size_t length = g_mapped_file_get_length(map.get());
+      // still read the file one at a time, touching a byte per page pulls it into the page cache without a copy
+      volatile uint8_t sink;
+      for(size_t k = 0; k < length; k += 4096) sink = data[k];
+      m = std::unique_ptr<const Buffer>(new Buffer(data, length));
+    }
+    else
+      m = f.readFile();
     dt_pthread_mutex_unlock(&darktable.readFile_mutex);
 
     RawParser t(m.get());
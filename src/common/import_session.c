@@ -339,6 +339,21 @@ const char *dt_import_session_path(struct dt_import_session_t *self, gboolean cu
 
   return self->current_path;
 }
+
+gboolean dt_import_session_path_changed(struct dt_import_session_t *self)
+{
+  if(self->current_path == NULL) return TRUE;
+
+  char *pattern = _import_session_path_pattern();
+  if(pattern == NULL) return FALSE;
+
+  char *new_path = dt_variables_expand(self->vp, pattern, FALSE);
+  g_free(pattern);
+  const gboolean changed = strcmp(self->current_path, new_path) != 0;
+  g_free(new_path);
+  return changed;
+}
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -63,6 +63,8 @@ const char *dt_import_session_filename(struct dt_import_session_t *self, gboolea
     without evaluating a new filename.
 */
 const char *dt_import_session_path(struct dt_import_session_t *self, gboolean current);
+/** \brief TRUE if the next dt_import_session_path() moves the session to another film roll */
+gboolean dt_import_session_path_changed(struct dt_import_session_t *self);
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
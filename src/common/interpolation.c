@@ -906,20 +906,27 @@ static void dt_interpolation_compute_pixel4c_plain(const struct dt_interpolation
     in = (float *)in + linestride * iy + ix * 4;
     in = in - (itor->width - 1) * (4 + linestride);
 
-    // Apply the kernel
+    // Apply the kernel, on all four channels as the sse version does so that the compiler keeps one pixel in
+    // a vector register (neon, vsx)
     float pixel[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
     for(int i = 0; i < 2 * itor->width; i++)
     {
       float h[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
       for(int j = 0; j < 2 * itor->width; j++)
       {
-        for(int c = 0; c < 3; c++) h[c] += kernelh[j] * in[j * 4 + c];
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+        for(int c = 0; c < 4; c++) h[c] += kernelh[j] * in[j * 4 + c];
       }
-      for(int c = 0; c < 3; c++) pixel[c] += kernelv[i] * h[c];
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+      for(int c = 0; c < 4; c++) pixel[c] += kernelv[i] * h[c];
       in += linestride;
     }
 
-    for(int c = 0; c < 3; c++) out[c] = oonorm * pixel[c];
+    for(int c = 0; c < 4; c++) out[c] = oonorm * pixel[c];
   }
   else if(ix >= 0 && iy >= 0 && ix < width && iy < height)
   {
@@ -950,16 +957,22 @@ static void dt_interpolation_compute_pixel4c_plain(const struct dt_interpolation
       {
         int clip_x = clip(ix + j, 0, width - 1, bordermode);
         const float *ipixel = in + clip_y * linestride + clip_x * 4;
-        for(int c = 0; c < 3; c++) h[c] += kernelh[j] * ipixel[c];
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+        for(int c = 0; c < 4; c++) h[c] += kernelh[j] * ipixel[c];
       }
-      for(int c = 0; c < 3; c++) pixel[c] += kernelv[i] * h[c];
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+      for(int c = 0; c < 4; c++) pixel[c] += kernelv[i] * h[c];
     }
 
-    for(int c = 0; c < 3; c++) out[c] = oonorm * pixel[c];
+    for(int c = 0; c < 4; c++) out[c] = oonorm * pixel[c];
   }
   else
   {
-    for(int c = 0; c < 3; c++) out[c] = 0.0f;
+    for(int c = 0; c < 4; c++) out[c] = 0.0f;
   }
 }
 
@@ -1449,167 +1462,173 @@ static int prepare_resampling_plan(const struct dt_interpolation *itor, int in,
   return 0;
 }
 
-static void dt_interpolation_resample_plain(const struct dt_interpolation *itor, float *out,
-                                            const dt_iop_roi_t *const roi_out, const int32_t out_stride,
-                                            const float *const in, const dt_iop_roi_t *const roi_in,
-                                            const int32_t in_stride)
-{
-  int *hindex = NULL;
-  int *hlength = NULL;
-  float *hkernel = NULL;
-  int *vindex = NULL;
-  int *vlength = NULL;
-  float *vkernel = NULL;
-  int *vmeta = NULL;
-
-  int r;
-
-  debug_info("resampling %p (%dx%d@%dx%d scale %f) -> %p (%dx%d@%dx%d scale %f)\n", in, roi_in->width,
-             roi_in->height, roi_in->x, roi_in->y, roi_in->scale, out, roi_out->width, roi_out->height,
-             roi_out->x, roi_out->y, roi_out->scale);
+/* The plans only depend on the geometry and the interpolator, and the pipes resample the same geometry over
+ * and over (finalscale, clipping, scalepixels, the previews). So a few of them are kept around. A plan is
+ * handed out as long as it has users and only replaced when it has none, plans that do not fit go back to
+ * the caller, who frees them in _put_resampling_plan() like before. */
+#define RESAMPLING_PLAN_CACHE 8
 
-  // Fast code path for 1:1 copy, only cropping area can change
-  if(roi_out->scale == 1.f)
+typedef struct dt_resampling_plan_t
+{
+  enum dt_interpolation_type itor;
+  int in, in_x0, out, out_x0;
+  float scale;
+  int *length; // start of the allocation
+  float *kernel;
+  int *index;
+  int *meta;
+  int users;
+  uint64_t age;
+} dt_resampling_plan_t;
+
+static GMutex _plan_lock;
+static dt_resampling_plan_t _plan_cache[RESAMPLING_PLAN_CACHE];
+static uint64_t _plan_age = 0;
+
+static dt_resampling_plan_t *_find_resampling_plan(const struct dt_interpolation *itor, const int in,
+                                                   const int in_x0, const int out, const int out_x0,
+                                                   const float scale)
+{
+  for(int k = 0; k < RESAMPLING_PLAN_CACHE; k++)
   {
-    const int x0 = roi_out->x * 4 * sizeof(float);
-#if DEBUG_RESAMPLING_TIMING
-    int64_t ts_resampling = getts();
-#endif
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-    dt_omp_firstprivate(in, in_stride, out_stride, roi_out, x0) \
-    shared(out)
-#endif
-    for(int y = 0; y < roi_out->height; y++)
-    {
-      memcpy((char *)out + (size_t)out_stride * y,
-             (char *)in + (size_t)in_stride * (y + roi_out->y) + x0,
-             out_stride);
-    }
-#if DEBUG_RESAMPLING_TIMING
-    ts_resampling = getts() - ts_resampling;
-    fprintf(stderr, "resampling %p plan:0us resampling:%" PRId64 "us\n", in, ts_resampling);
-#endif
-    // All done, so easy case
-    return;
+    dt_resampling_plan_t *p = _plan_cache + k;
+    if(p->length && p->itor == itor->id && p->in == in && p->in_x0 == in_x0 && p->out == out
+       && p->out_x0 == out_x0 && p->scale == scale)
+      return p;
   }
+  return NULL;
+}
 
-// Generic non 1:1 case... much more complicated :D
-#if DEBUG_RESAMPLING_TIMING
-  int64_t ts_plan = getts();
-#endif
+static void _use_resampling_plan(dt_resampling_plan_t *p, int **plength, float **pkernel, int **pindex,
+                                 int **pmeta)
+{
+  p->users++;
+  p->age = ++_plan_age;
+  *plength = p->length;
+  *pkernel = p->kernel;
+  *pindex = p->index;
+  if(pmeta) *pmeta = p->meta;
+}
 
-  // Prepare resampling plans once and for all
-  r = prepare_resampling_plan(itor, roi_in->width, roi_in->x, roi_out->width, roi_out->x, roi_out->scale,
-                              &hlength, &hkernel, &hindex, NULL);
-  if(r)
-  {
-    goto exit;
-  }
+/** prepare_resampling_plan() through the plan cache. The plan always has its meta array, pmeta may be NULL
+ * when it is not needed. Release the plan with _put_resampling_plan(*plength). */
+static int _get_resampling_plan(const struct dt_interpolation *itor, const int in, const int in_x0,
+                                const int out, const int out_x0, const float scale, int **plength,
+                                float **pkernel, int **pindex, int **pmeta)
+{
+  // no plan at all for 1:1
+  if(scale == 1.f)
+    return prepare_resampling_plan(itor, in, in_x0, out, out_x0, scale, plength, pkernel, pindex, pmeta);
+
+  g_mutex_lock(&_plan_lock);
+  dt_resampling_plan_t *p = _find_resampling_plan(itor, in, in_x0, out, out_x0, scale);
+  if(p) _use_resampling_plan(p, plength, pkernel, pindex, pmeta);
+  g_mutex_unlock(&_plan_lock);
+  if(p) return 0;
 
-  r = prepare_resampling_plan(itor, roi_in->height, roi_in->y, roi_out->height, roi_out->y, roi_out->scale,
-                              &vlength, &vkernel, &vindex, &vmeta);
+  int *length, *index, *meta;
+  float *kernel;
+  const int r = prepare_resampling_plan(itor, in, in_x0, out, out_x0, scale, &length, &kernel, &index, &meta);
   if(r)
   {
-    goto exit;
+    *plength = NULL;
+    *pkernel = NULL;
+    *pindex = NULL;
+    if(pmeta) *pmeta = NULL;
+    return r;
   }
 
-#if DEBUG_RESAMPLING_TIMING
-  ts_plan = getts() - ts_plan;
-#endif
-
-#if DEBUG_RESAMPLING_TIMING
-  int64_t ts_resampling = getts();
-#endif
-
-// Process each output line
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(in, in_stride, out_stride, roi_out) \
-  shared(out, hindex, hlength, hkernel, vindex, vlength, vkernel, vmeta)
-#endif
-  for(int oy = 0; oy < roi_out->height; oy++)
+  g_mutex_lock(&_plan_lock);
+  // another thread may have been faster
+  p = _find_resampling_plan(itor, in, in_x0, out, out_x0, scale);
+  if(p)
+    dt_free_align(length);
+  else
   {
-    // Initialize column resampling indexes
-    int vlidx = vmeta[3 * oy + 0]; // V(ertical) L(ength) I(n)d(e)x
-    int vkidx = vmeta[3 * oy + 1]; // V(ertical) K(ernel) I(n)d(e)x
-    int viidx = vmeta[3 * oy + 2]; // V(ertical) I(ndex) I(n)d(e)x
-
-    // Initialize row resampling indexes
-    int hlidx = 0; // H(orizontal) L(ength) I(n)d(e)x
-    int hkidx = 0; // H(orizontal) K(ernel) I(n)d(e)x
-    int hiidx = 0; // H(orizontal) I(ndex) I(n)d(e)x
-
-    // Number of lines contributing to the output line
-    int vl = vlength[vlidx++]; // V(ertical) L(ength)
-
-    // Process each output column
-    for(int ox = 0; ox < roi_out->width; ox++)
+    // an empty slot or the oldest unused plan
+    for(int k = 0; k < RESAMPLING_PLAN_CACHE; k++)
     {
-      debug_extra("output %p [% 4d % 4d]\n", out, ox, oy);
-
-      // This will hold the resulting pixel
-      float vs[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
-
-      // Number of horizontal samples contributing to the output
-      int hl = hlength[hlidx++]; // H(orizontal) L(ength)
-
-      for(int iy = 0; iy < vl; iy++)
-      {
-        // This is our input line
-        const float *i = (float *)((char *)in + (size_t)in_stride * vindex[viidx++]);
-
-        float vhs[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
-
-        for(int ix = 0; ix < hl; ix++)
-        {
-          // Apply the precomputed filter kernel
-          size_t baseidx = (size_t)hindex[hiidx++] * 4;
-          const float htap = hkernel[hkidx++];
-          for(int c = 0; c < 3; c++) vhs[c] += i[baseidx + c] * htap;
-        }
-
-        // Accumulate contribution from this line
-        const float vtap = vkernel[vkidx++];
-        for(int c = 0; c < 3; c++) vs[c] += vhs[c] * vtap;
-
-        // Reset horizontal resampling context
-        hkidx -= hl;
-        hiidx -= hl;
-      }
+      dt_resampling_plan_t *q = _plan_cache + k;
+      if(q->users) continue;
+      if(!p || !q->length || (p->length && q->age < p->age)) p = q;
+    }
+    if(p)
+    {
+      dt_free_align(p->length);
+      *p = (dt_resampling_plan_t){ .itor = itor->id, .in = in, .in_x0 = in_x0, .out = out, .out_x0 = out_x0,
+                                   .scale = scale, .length = length, .kernel = kernel, .index = index,
+                                   .meta = meta, .users = 0 };
+    }
+  }
+  if(p) _use_resampling_plan(p, plength, pkernel, pindex, pmeta);
+  g_mutex_unlock(&_plan_lock);
 
-      // Output pixel is ready
-      float *o = (float *)((char *)out + (size_t)oy * out_stride + (size_t)ox * 4 * sizeof(float));
-      for(int c = 0; c < 3; c++) o[c] = vs[c];
+  if(!p)
+  {
+    // all slots are busy, this one is the caller's
+    *plength = length;
+    *pkernel = kernel;
+    *pindex = index;
+    if(pmeta) *pmeta = meta;
+  }
+  return 0;
+}
 
-      // Reset vertical resampling context
-      viidx -= vl;
-      vkidx -= vl;
+static void _put_resampling_plan(int *length)
+{
+  if(!length) return;
+  g_mutex_lock(&_plan_lock);
+  dt_resampling_plan_t *p = NULL;
+  for(int k = 0; k < RESAMPLING_PLAN_CACHE && !p; k++)
+    if(_plan_cache[k].length == length) p = _plan_cache + k;
+  if(p)
+    p->users--;
+  else
+    dt_free_align(length);
+  g_mutex_unlock(&_plan_lock);
+}
 
-      // Progress in horizontal context
-      hiidx += hl;
-      hkidx += hl;
-    }
+void dt_interpolation_cleanup()
+{
+  g_mutex_lock(&_plan_lock);
+  for(int k = 0; k < RESAMPLING_PLAN_CACHE; k++)
+  {
+    dt_free_align(_plan_cache[k].length);
+    _plan_cache[k] = (dt_resampling_plan_t){ 0 };
   }
+  g_mutex_unlock(&_plan_lock);
+}
 
-#if DEBUG_RESAMPLING_TIMING
-  ts_resampling = getts() - ts_resampling;
-  fprintf(stderr, "resampling %p plan:%" PRId64 "us resampling:%" PRId64 "us\n", in, ts_plan, ts_resampling);
+#define DT_INTERPOLATION_RESAMPLE_BAND dt_interpolation_resample_band_plain
+#include "common/interpolation_resample.h"
+
+typedef void (*dt_interpolation_resample_band_t)(float *const out, const int32_t out_stride, const int width,
+                                                 const float *const in, const int32_t in_stride, const int oy0,
+                                                 const int oy1, const int *const hlength,
+                                                 const float *const hkernel, const int *const hindex,
+                                                 const int *const vlength, const float *const vkernel,
+                                                 const int *const vindex, const int *const vmeta,
+                                                 float *const lines);
+#ifdef HAVE_AVX2_CODEPATH
+void dt_interpolation_resample_band_avx2(float *const out, const int32_t out_stride, const int width,
+                                         const float *const in, const int32_t in_stride, const int oy0,
+                                         const int oy1, const int *const hlength, const float *const hkernel,
+                                         const int *const hindex, const int *const vlength,
+                                         const float *const vkernel, const int *const vindex,
+                                         const int *const vmeta, float *const lines);
 #endif
 
-exit:
-  /* Free the resampling plans. It's nasty to optimize allocs like that, but
-   * it simplifies the code :-D. The length array is in fact the only memory
-   * allocated. */
-  dt_free_align(hlength);
-  dt_free_align(vlength);
-}
+// output rows per band of the separable passes. the input lines of neighbouring bands overlap by the kernel
+// support, so not too few.
+#define RESAMPLING_BAND_ROWS 32
 
-#if defined(__SSE2__)
-static void dt_interpolation_resample_sse(const struct dt_interpolation *itor, float *out,
-                                          const dt_iop_roi_t *const roi_out, const int32_t out_stride,
-                                          const float *const in, const dt_iop_roi_t *const roi_in,
-                                          const int32_t in_stride)
+/** Applies resampling (re-scaling) on *full* input and output buffers.
+ *  roi_in and roi_out define the part of the buffers that is affected.
+ */
+void dt_interpolation_resample(const struct dt_interpolation *itor, float *out,
+                               const dt_iop_roi_t *const roi_out, const int32_t out_stride,
+                               const float *const in, const dt_iop_roi_t *const roi_in,
+                               const int32_t in_stride)
 {
   int *hindex = NULL;
   int *hlength = NULL;
@@ -1618,6 +1637,7 @@ static void dt_interpolation_resample_sse(const struct dt_interpolation *itor, f
   int *vlength = NULL;
   float *vkernel = NULL;
   int *vmeta = NULL;
+  float *lines = NULL;
 
   int r;
 
@@ -1639,9 +1659,9 @@ static void dt_interpolation_resample_sse(const struct dt_interpolation *itor, f
 #endif
     for(int y = 0; y < roi_out->height; y++)
     {
-      float *i = (float *)((char *)in + (size_t)in_stride * (y + roi_out->y) + x0);
-      float *o = (float *)((char *)out + (size_t)out_stride * y);
-      memcpy(o, i, out_stride);
+      memcpy((char *)out + (size_t)out_stride * y,
+             (char *)in + (size_t)in_stride * (y + roi_out->y) + x0,
+             out_stride);
     }
 #if DEBUG_RESAMPLING_TIMING
     ts_resampling = getts() - ts_resampling;
@@ -1657,20 +1677,45 @@ static void dt_interpolation_resample_sse(const struct dt_interpolation *itor, f
 #endif
 
   // Prepare resampling plans once and for all
-  r = prepare_resampling_plan(itor, roi_in->width, roi_in->x, roi_out->width, roi_out->x, roi_out->scale,
-                              &hlength, &hkernel, &hindex, NULL);
+  r = _get_resampling_plan(itor, roi_in->width, roi_in->x, roi_out->width, roi_out->x, roi_out->scale,
+                           &hlength, &hkernel, &hindex, NULL);
   if(r)
   {
     goto exit;
   }
 
-  r = prepare_resampling_plan(itor, roi_in->height, roi_in->y, roi_out->height, roi_out->y, roi_out->scale,
-                              &vlength, &vkernel, &vindex, &vmeta);
+  r = _get_resampling_plan(itor, roi_in->height, roi_in->y, roi_out->height, roi_out->y, roi_out->scale,
+                           &vlength, &vkernel, &vindex, &vmeta);
   if(r)
   {
     goto exit;
   }
 
+  // horizontally resampled input lines of one band per thread
+  const int height = roi_out->height;
+  const int width = roi_out->width;
+  const int bands = (height + RESAMPLING_BAND_ROWS - 1) / RESAMPLING_BAND_ROWS;
+  int maxlines = 0;
+  for(int b = 0; b < bands; b++)
+  {
+    int vmin;
+    const int n = _resample_band_lines(vlength, vindex, vmeta, b * RESAMPLING_BAND_ROWS,
+                                       MIN(height, (b + 1) * RESAMPLING_BAND_ROWS), &vmin);
+    maxlines = MAX(maxlines, n);
+  }
+  const size_t linessize = (size_t)maxlines * 4 * width;
+  lines = dt_alloc_align(64, sizeof(float) * linessize * dt_get_num_threads());
+  if(!lines)
+  {
+    fprintf(stderr, "[dt_interpolation_resample] could not allocate %dx%d line buffers\n", maxlines, width);
+    goto exit;
+  }
+
+  dt_interpolation_resample_band_t resample_band = dt_interpolation_resample_band_plain;
+#ifdef HAVE_AVX2_CODEPATH
+  if(darktable.codepath.AVX2) resample_band = dt_interpolation_resample_band_avx2;
+#endif
+
 #if DEBUG_RESAMPLING_TIMING
   ts_plan = getts() - ts_plan;
 #endif
@@ -1679,110 +1724,29 @@ static void dt_interpolation_resample_sse(const struct dt_interpolation *itor, f
   int64_t ts_resampling = getts();
 #endif
 
-// Process each output line
+// Process each band of output lines
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(in, in_stride, out_stride, roi_out) \
-  shared(out, hindex, hlength, hkernel, vindex, vlength, vkernel, vmeta)
+  dt_omp_firstprivate(in, in_stride, out_stride, width, height, bands, lines, linessize, resample_band) \
+  shared(out, hindex, hlength, hkernel, vindex, vlength, vkernel, vmeta) \
+  schedule(dynamic, 1)
 #endif
-  for(int oy = 0; oy < roi_out->height; oy++)
+  for(int b = 0; b < bands; b++)
   {
-    // Initialize column resampling indexes
-    int vlidx = vmeta[3 * oy + 0]; // V(ertical) L(ength) I(n)d(e)x
-    int vkidx = vmeta[3 * oy + 1]; // V(ertical) K(ernel) I(n)d(e)x
-    int viidx = vmeta[3 * oy + 2]; // V(ertical) I(ndex) I(n)d(e)x
-
-    // Initialize row resampling indexes
-    int hlidx = 0; // H(orizontal) L(ength) I(n)d(e)x
-    int hkidx = 0; // H(orizontal) K(ernel) I(n)d(e)x
-    int hiidx = 0; // H(orizontal) I(ndex) I(n)d(e)x
-
-    // Number of lines contributing to the output line
-    int vl = vlength[vlidx++]; // V(ertical) L(ength)
-
-    // Process each output column
-    for(int ox = 0; ox < roi_out->width; ox++)
-    {
-      debug_extra("output %p [% 4d % 4d]\n", out, ox, oy);
-
-      // This will hold the resulting pixel
-      __m128 vs = _mm_setzero_ps();
-
-      // Number of horizontal samples contributing to the output
-      int hl = hlength[hlidx++]; // H(orizontal) L(ength)
-
-      for(int iy = 0; iy < vl; iy++)
-      {
-        // This is our input line
-        const float *i = (float *)((char *)in + (size_t)in_stride * vindex[viidx++]);
-
-        __m128 vhs = _mm_setzero_ps();
-
-        for(int ix = 0; ix < hl; ix++)
-        {
-          // Apply the precomputed filter kernel
-          size_t baseidx = (size_t)hindex[hiidx++] * 4;
-          float htap = hkernel[hkidx++];
-          __m128 vhtap = _mm_set_ps1(htap);
-          vhs = _mm_add_ps(vhs, _mm_mul_ps(*(__m128 *)&i[baseidx], vhtap));
-        }
-
-        // Accumulate contribution from this line
-        float vtap = vkernel[vkidx++];
-        __m128 vvtap = _mm_set_ps1(vtap);
-        vs = _mm_add_ps(vs, _mm_mul_ps(vhs, vvtap));
-
-        // Reset horizontal resampling context
-        hkidx -= hl;
-        hiidx -= hl;
-      }
-
-      // Output pixel is ready
-      float *o = (float *)((char *)out + (size_t)oy * out_stride + (size_t)ox * 4 * sizeof(float));
-      _mm_stream_ps(o, vs);
-
-      // Reset vertical resampling context
-      viidx -= vl;
-      vkidx -= vl;
-
-      // Progress in horizontal context
-      hiidx += hl;
-      hkidx += hl;
-    }
+    resample_band(out, out_stride, width, in, in_stride, b * RESAMPLING_BAND_ROWS,
+                  MIN(height, (b + 1) * RESAMPLING_BAND_ROWS), hlength, hkernel, hindex, vlength, vkernel,
+                  vindex, vmeta, lines + linessize * dt_get_thread_num());
   }
 
-  _mm_sfence();
-
 #if DEBUG_RESAMPLING_TIMING
   ts_resampling = getts() - ts_resampling;
   fprintf(stderr, "resampling %p plan:%" PRId64 "us resampling:%" PRId64 "us\n", in, ts_plan, ts_resampling);
 #endif
 
 exit:
-  /* Free the resampling plans. It's nasty to optimize allocs like that, but
-   * it simplifies the code :-D. The length array is in fact the only memory
-   * allocated. */
-  dt_free_align(hlength);
-  dt_free_align(vlength);
-}
-#endif
-
-/** Applies resampling (re-scaling) on *full* input and output buffers.
- *  roi_in and roi_out define the part of the buffers that is affected.
- */
-void dt_interpolation_resample(const struct dt_interpolation *itor, float *out,
-                               const dt_iop_roi_t *const roi_out, const int32_t out_stride,
-                               const float *const in, const dt_iop_roi_t *const roi_in,
-                               const int32_t in_stride)
-{
-  if(darktable.codepath.OPENMP_SIMD)
-    return dt_interpolation_resample_plain(itor, out, roi_out, out_stride, in, roi_in, in_stride);
-#if defined(__SSE2__)
-  else if(darktable.codepath.SSE2)
-    return dt_interpolation_resample_sse(itor, out, roi_out, out_stride, in, roi_in, in_stride);
-#endif
-  else
-    dt_unreachable_codepath();
+  dt_free_align(lines);
+  _put_resampling_plan(hlength);
+  _put_resampling_plan(vlength);
 }
 
 /** Applies resampling (re-scaling) on a specific region-of-interest of an image. The input
@@ -1894,15 +1858,15 @@ int dt_interpolation_resample_cl(const struct dt_interpolation *itor, int devid,
 #endif
 
   // Prepare resampling plans once and for all
-  r = prepare_resampling_plan(itor, roi_in->width, roi_in->x, roi_out->width, roi_out->x, roi_out->scale,
-                              &hlength, &hkernel, &hindex, &hmeta);
+  r = _get_resampling_plan(itor, roi_in->width, roi_in->x, roi_out->width, roi_out->x, roi_out->scale,
+                           &hlength, &hkernel, &hindex, &hmeta);
   if(r)
   {
     goto error;
   }
 
-  r = prepare_resampling_plan(itor, roi_in->height, roi_in->y, roi_out->height, roi_out->y, roi_out->scale,
-                              &vlength, &vkernel, &vindex, &vmeta);
+  r = _get_resampling_plan(itor, roi_in->height, roi_in->y, roi_out->height, roi_out->y, roi_out->scale,
+                           &vlength, &vkernel, &vindex, &vmeta);
   if(r)
   {
     goto error;
@@ -2019,8 +1983,8 @@ int dt_interpolation_resample_cl(const struct dt_interpolation *itor, int devid,
   dt_opencl_release_mem_object(dev_vlength);
   dt_opencl_release_mem_object(dev_vkernel);
   dt_opencl_release_mem_object(dev_vmeta);
-  dt_free_align(hlength);
-  dt_free_align(vlength);
+  _put_resampling_plan(hlength);
+  _put_resampling_plan(vlength);
   return CL_SUCCESS;
 
 error:
@@ -2032,8 +1996,8 @@ error:
   dt_opencl_release_mem_object(dev_vlength);
   dt_opencl_release_mem_object(dev_vkernel);
   dt_opencl_release_mem_object(dev_vmeta);
-  dt_free_align(hlength);
-  dt_free_align(vlength);
+  _put_resampling_plan(hlength);
+  _put_resampling_plan(vlength);
   dt_print(DT_DEBUG_OPENCL, "[opencl_resampling] couldn't enqueue kernel! %d\n", err);
   return err;
 }
@@ -2107,15 +2071,15 @@ static void dt_interpolation_resample_1c_plain(const struct dt_interpolation *it
 #endif
 
   // Prepare resampling plans once and for all
-  r = prepare_resampling_plan(itor, roi_in->width, roi_in->x, roi_out->width, roi_out->x, roi_out->scale,
-                              &hlength, &hkernel, &hindex, NULL);
+  r = _get_resampling_plan(itor, roi_in->width, roi_in->x, roi_out->width, roi_out->x, roi_out->scale,
+                           &hlength, &hkernel, &hindex, NULL);
   if(r)
   {
     goto exit;
   }
 
-  r = prepare_resampling_plan(itor, roi_in->height, roi_in->y, roi_out->height, roi_out->y, roi_out->scale,
-                              &vlength, &vkernel, &vindex, &vmeta);
+  r = _get_resampling_plan(itor, roi_in->height, roi_in->y, roi_out->height, roi_out->y, roi_out->scale,
+                           &vlength, &vkernel, &vindex, &vmeta);
   if(r)
   {
     goto exit;
@@ -2208,8 +2172,8 @@ static void dt_interpolation_resample_1c_plain(const struct dt_interpolation *it
   /* Free the resampling plans. It's nasty to optimize allocs like that, but
    * it simplifies the code :-D. The length array is in fact the only memory
    * allocated. */
-  dt_free_align(hlength);
-  dt_free_align(vlength);
+  _put_resampling_plan(hlength);
+  _put_resampling_plan(vlength);
 }
 
 /** Applies resampling (re-scaling) on *full* input and output buffers.
@@ -0,0 +1,116 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// the separable passes of dt_interpolation_resample() over a band of output rows. included by
+// interpolation.c and by interpolation_avx2.c, which is built with the AVX2 flags. define
+// DT_INTERPOLATION_RESAMPLE_BAND to the name of the function before including.
+//
+// the horizontal pass resamples every input line the band needs once, the vertical pass then runs along the
+// rows of those lines. the sums are taken in the order of the former per pixel loop.
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef DT_INTERPOLATION_RESAMPLE_BAND_LINES
+#define DT_INTERPOLATION_RESAMPLE_BAND_LINES
+
+// the range of input lines [*vmin, *vmin + return value) the output rows [oy0, oy1) read
+static inline int _resample_band_lines(const int *const vlength, const int *const vindex,
+                                       const int *const vmeta, const int oy0, const int oy1, int *vmin)
+{
+  int lo = INT_MAX, hi = -1;
+  for(int oy = oy0; oy < oy1; oy++)
+  {
+    const int *const idx = vindex + vmeta[3 * oy + 2];
+    for(int iy = 0; iy < vlength[vmeta[3 * oy]]; iy++)
+    {
+      lo = idx[iy] < lo ? idx[iy] : lo;
+      hi = idx[iy] > hi ? idx[iy] : hi;
+    }
+  }
+  *vmin = lo;
+  return hi < lo ? 0 : hi - lo + 1;
+}
+#endif
+
+// resamples the output rows [oy0, oy1) of width pixels of 4 channels. lines holds the horizontally resampled
+// input lines of the band, see _resample_band_lines(). the strides are in bytes.
+void DT_INTERPOLATION_RESAMPLE_BAND(float *const out, const int32_t out_stride, const int width,
+                                    const float *const in, const int32_t in_stride, const int oy0, const int oy1,
+                                    const int *const hlength, const float *const hkernel,
+                                    const int *const hindex, const int *const vlength,
+                                    const float *const vkernel, const int *const vindex,
+                                    const int *const vmeta, float *const lines)
+{
+  int vmin;
+  const int nlines = _resample_band_lines(vlength, vindex, vmeta, oy0, oy1, &vmin);
+  const size_t linesize = (size_t)4 * width;
+
+  // horizontal pass
+  for(int l = 0; l < nlines; l++)
+  {
+    const float *const i = (const float *)((const char *)in + (size_t)in_stride * (vmin + l));
+    float *const h = lines + l * linesize;
+    int hidx = 0;
+    for(int ox = 0; ox < width; ox++)
+    {
+      const int hl = hlength[ox];
+      float vhs[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+      for(int ix = 0; ix < hl; ix++)
+      {
+        const float *const p = i + (size_t)4 * hindex[hidx + ix];
+        const float htap = hkernel[hidx + ix];
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+        for(int c = 0; c < 4; c++) vhs[c] += p[c] * htap;
+      }
+      hidx += hl;
+      for(int c = 0; c < 4; c++) h[4 * ox + c] = vhs[c];
+    }
+  }
+
+  // vertical pass
+  for(int oy = oy0; oy < oy1; oy++)
+  {
+    float *const o = (float *)((char *)out + (size_t)out_stride * oy);
+    const int vl = vlength[vmeta[3 * oy]];
+    const float *const vk = vkernel + vmeta[3 * oy + 1];
+    const int *const vi = vindex + vmeta[3 * oy + 2];
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for(size_t j = 0; j < linesize; j++) o[j] = 0.0f;
+    for(int iy = 0; iy < vl; iy++)
+    {
+      const float *const h = lines + (vi[iy] - vmin) * linesize;
+      const float vtap = vk[iy];
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+      for(size_t j = 0; j < linesize; j++) o[j] += h[j] * vtap;
+    }
+  }
+}
+
+#undef DT_INTERPOLATION_RESAMPLE_BAND
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -307,6 +307,47 @@ static GList *_insert_before(GList *iop_order_list, const char *module, const ch
 }
 
 
+// the custom orders in use resolved from their text, shared by the darkroom, the exports and the styles.
+// the key is the serialized list as stored in main.module_order, which is all a resolved list depends on.
+#define DT_IOPPR_ORDER_CACHE_SIZE 64
+
+static GMutex _order_cache_lock;
+static GHashTable *_order_cache = NULL;
+
+static void _order_cache_free(gpointer data)
+{
+  g_list_free_full((GList *)data, free);
+}
+
+static GList *_get_custom_iop_order_list(const char *buf)
+{
+  g_mutex_lock(&_order_cache_lock);
+  if(!_order_cache)
+    _order_cache = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, _order_cache_free);
+
+  GList *resolved = (GList *)g_hash_table_lookup(_order_cache, buf);
+  if(!resolved)
+  {
+    resolved = dt_ioppr_deserialize_text_iop_order_list(buf);
+    if(resolved)
+    {
+      // @@_NEW_MOUDLE: For new module it is required to insert the new module name in the iop-order list here.
+      //                The insertion can be done depending on the current iop-order list kind.
+      _insert_before(resolved, "nlmeans", "negadoctor");
+
+      // there are only a few orders in a collection, start over rather than keeping track of the oldest
+      if(g_hash_table_size(_order_cache) >= DT_IOPPR_ORDER_CACHE_SIZE) g_hash_table_remove_all(_order_cache);
+      g_hash_table_insert(_order_cache, g_strdup(buf), resolved);
+    }
+  }
+
+  // the callers own and change their list
+  GList *iop_order_list = dt_ioppr_iop_order_copy_deep(resolved);
+  g_mutex_unlock(&_order_cache_lock);
+
+  return iop_order_list;
+}
+
 dt_iop_order_t dt_ioppr_get_iop_order_version(const int32_t imgid)
 {
   char *workflow = dt_conf_get_string("plugins/darkroom/workflow");
@@ -315,14 +356,13 @@ dt_iop_order_t dt_ioppr_get_iop_order_version(const int32_t imgid)
 
   // check current iop order version
   sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT version FROM main.module_order WHERE imgid = ?1",
-                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_PREPARE_CACHED(darktable.db, "SELECT version FROM main.module_order WHERE imgid = ?1", &stmt);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
   if(sqlite3_step(stmt) == SQLITE_ROW)
   {
     iop_order_version = sqlite3_column_int(stmt, 0);
   }
-  sqlite3_finalize(stmt);
+  DT_DEBUG_SQLITE3_RELEASE_CACHED(darktable.db, stmt);
 
   return iop_order_version;
 }
@@ -606,10 +646,10 @@ GList *dt_ioppr_get_iop_order_list(int32_t imgid, gboolean sorted)
     // search, but there will not be many such presets and we do call this routine
     // only when loading an image and when changing the iop-order.
 
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                                "SELECT version, iop_list"
-                                " FROM main.module_order"
-                                " WHERE imgid=?1", -1, &stmt, NULL);
+    DT_DEBUG_SQLITE3_PREPARE_CACHED(darktable.db,
+                                    "SELECT version, iop_list"
+                                    " FROM main.module_order"
+                                    " WHERE imgid=?1", &stmt);
     DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
 
     if(sqlite3_step(stmt) == SQLITE_ROW)
@@ -620,19 +660,13 @@ GList *dt_ioppr_get_iop_order_list(int32_t imgid, gboolean sorted)
       if(version == DT_IOP_ORDER_CUSTOM || has_iop_list)
       {
         const char *buf = (char *)sqlite3_column_text(stmt, 1);
-        if(buf) iop_order_list = dt_ioppr_deserialize_text_iop_order_list(buf);
+        if(buf) iop_order_list = _get_custom_iop_order_list(buf);
 
         if(!iop_order_list)
         {
           // preset not found, fall back to last built-in version, will be loaded below
           fprintf(stderr, "[dt_ioppr_get_iop_order_list] error building iop_order_list imgid %d\n", imgid);
         }
-        else
-        {
-          // @@_NEW_MOUDLE: For new module it is required to insert the new module name in the iop-order list here.
-          //                The insertion can be done depending on the current iop-order list kind.
-          _insert_before(iop_order_list, "nlmeans", "negadoctor");
-        }
       }
       else if(version == DT_IOP_ORDER_LEGACY)
       {
@@ -651,7 +685,7 @@ GList *dt_ioppr_get_iop_order_list(int32_t imgid, gboolean sorted)
       }
     }
 
-    sqlite3_finalize(stmt);
+    DT_DEBUG_SQLITE3_RELEASE_CACHED(darktable.db, stmt);
   }
 
   // fallback to last iop order list (also used to initialize the pipe when imgid = 0)
@@ -979,6 +1013,13 @@ void dt_ioppr_update_for_entries(dt_develop_t *dev, GList *entry_list, gboolean
   {
     const dt_iop_order_entry_t *const restrict ep = (dt_iop_order_entry_t *)e_list->data;
 
+    // all instances of an operation are set up with its first entry
+    if(_operation_already_handled(e_list, ep->operation))
+    {
+      e_list = g_list_next(e_list);
+      continue;
+    }
+
     gboolean force_append = FALSE;
 
     // we also need to force append (even if overwrite mode is
@@ -1002,7 +1043,7 @@ void dt_ioppr_update_for_entries(dt_develop_t *dev, GList *entry_list, gboolean
     while(l)
     {
       const dt_iop_order_entry_t *const restrict e = (dt_iop_order_entry_t *)l->data;
-      if(!strcmp(e->operation, ep->operation) && !_operation_already_handled(e_list, ep->operation))
+      if(!strcmp(e->operation, ep->operation))
       {
         // how many instances of this module in the entry list, and re-number multi-priority accordingly
         const int new_active_instances = _count_entries_operation(entry_list, ep->operation);
@@ -1113,7 +1154,7 @@ void dt_ioppr_update_for_style_items(dt_develop_t *dev, GList *st_items, gboolea
     si_list = g_list_next(si_list);
   }
 
-  g_list_free(e_list);
+  g_list_free_full(e_list, free);
 }
 
 void dt_ioppr_update_for_modules(dt_develop_t *dev, GList *modules, gboolean append)
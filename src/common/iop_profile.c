@@ -104,7 +104,7 @@ static void _transform_from_to_rgb_lab_lcms2(const float *const image_in, float
     output_format = TYPE_RGBA_FLT;
   }
 
-  xform = cmsCreateTransform(input_profile, input_format, output_profile, output_format, intent, 0);
+  xform = dt_colorspaces_get_transform(input_profile, input_format, output_profile, output_format, intent);
   if(xform)
   {
 #ifdef _OPENMP
@@ -124,7 +124,7 @@ static void _transform_from_to_rgb_lab_lcms2(const float *const image_in, float
   else
     fprintf(stderr, "[_transform_from_to_rgb_lab_lcms2] cannot create transform\n");
 
-  if(xform) cmsDeleteTransform(xform);
+  dt_colorspaces_release_transform(xform);
 }
 
 static void _transform_rgb_to_rgb_lcms2(const float *const image_in, float *const image_out, const int width,
@@ -198,7 +198,7 @@ static void _transform_rgb_to_rgb_lcms2(const float *const image_in, float *cons
   output_format = TYPE_RGBA_FLT;
 
   if(input_profile && output_profile)
-    xform = cmsCreateTransform(input_profile, input_format, output_profile, output_format, intent, 0);
+    xform = dt_colorspaces_get_transform(input_profile, input_format, output_profile, output_format, intent);
 
   if(type_from == DT_COLORSPACE_DISPLAY || type_to == DT_COLORSPACE_DISPLAY || type_from == DT_COLORSPACE_DISPLAY2
      || type_to == DT_COLORSPACE_DISPLAY2)
@@ -223,7 +223,7 @@ static void _transform_rgb_to_rgb_lcms2(const float *const image_in, float *cons
   else
     fprintf(stderr, "[_transform_rgb_to_rgb_lcms2] cannot create transform\n");
 
-  if(xform) cmsDeleteTransform(xform);
+  dt_colorspaces_release_transform(xform);
 }
 
 static void _transform_lcms2(struct dt_iop_module_t *self, const float *const image_in, float *const image_out,
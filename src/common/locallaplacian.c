@@ -238,6 +238,9 @@ static inline void gauss_reduce_sse2(
 }
 #endif
 
+// the plain version, separable so that both passes run along the rows and vectorise with whatever simd unit the
+// compiler targets (neon, vsx, sse). the 1 4 6 4 1 binomial is summed vertically into a row of the fine
+// resolution, which is then reduced horizontally.
 static inline void gauss_reduce(
     const float *const input, // fine input buffer
     float *const coarse,      // coarse scale, blurred input buf
@@ -247,25 +250,36 @@ static inline void gauss_reduce(
   // blur, store only coarse res
   const int cw = (wd-1)/2+1, ch = (ht-1)/2+1;
 
-  // this is the scalar (non-simd) code:
-  const float w[5] = { 1.f/16.f, 4.f/16.f, 6.f/16.f, 4.f/16.f, 1.f/16.f };
-  memset(coarse, 0, sizeof(float)*cw*ch);
-  // direct 5x5 stencil only on required pixels:
+  float *const rows = dt_alloc_align(64, sizeof(float) * wd * dt_get_num_threads());
 #ifdef _OPENMP
   // DON'T parallelize the very smallest levels of the pyramid, as the threading overhead
   // is greater than the time needed to do it sequentially
 #pragma omp parallel for default(none) if (ch*cw>500)  \
-  dt_omp_firstprivate(coarse, cw, ch, input, w, wd) \
-  schedule(static) \
-  collapse(2)
+  dt_omp_firstprivate(coarse, cw, ch, input, wd, rows) \
+  schedule(static)
 #endif
   for(int j=1;j<ch-1;j++)
+  {
+    float *const v = rows + (size_t)wd * dt_get_thread_num();
+    const float *const r0 = input + (size_t)(2*j-2)*wd;
+    const float *const r1 = r0 + wd;
+    const float *const r2 = r1 + wd;
+    const float *const r3 = r2 + wd;
+    const float *const r4 = r3 + wd;
+#ifdef _OPENMP
+#pragma omp simd aligned(v:64)
+#endif
+    for(int i=0;i<wd;i++)
+      v[i] = r0[i] + r4[i] + 4.0f*(r1[i] + r3[i]) + 6.0f*r2[i];
+
+    float *const out = coarse + (size_t)j*cw;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
     for(int i=1;i<cw-1;i++)
-    {
-      for(int jj=-2;jj<=2;jj++)
-        for(int ii=-2;ii<=2;ii++)
-          coarse[j*cw+i] += input[(2*j+jj)*wd+2*i+ii] * w[ii+2] * w[jj+2];
-    }
+      out[i] = (v[2*i-2] + v[2*i+2] + 4.0f*(v[2*i-1] + v[2*i+1]) + 6.0f*v[2*i]) * (1.0f/256.0f);
+  }
+  dt_free_align(rows);
   ll_fill_boundary1(coarse, cw, ch);
 }
 
@@ -396,6 +410,7 @@ static inline float ll_laplacian(
   return fine[j*wd+i] - c;
 }
 
+// written with selects rather than branches, the same way as curve_vec4(), so that loops over it vectorise
 static inline float curve_scalar(
     const float x,
     const float g,
@@ -405,27 +420,19 @@ static inline float curve_scalar(
     const float clarity)
 {
   const float c = x-g;
-  float val;
+  // shadows for c >= 0, highlights below with the sign of sigma flipped
+  const float ssigma = c < 0.0f ? -sigma : sigma;
+  const float shadhi = c < 0.0f ? highlights : shadows;
+  // linear part for |c| > 2*sigma
+  const float vlin = g + ssigma + shadhi * (c-ssigma);
   // blend in via quadratic bezier
-  if     (c >  2*sigma) val = g + sigma + shadows    * (c-sigma);
-  else if(c < -2*sigma) val = g - sigma + highlights * (c+sigma);
-  else if(c > 0.0f)
-  { // shadow contrast
-    const float t = CLAMPS(c / (2.0f*sigma), 0.0f, 1.0f);
-    const float t2 = t * t;
-    const float mt = 1.0f-t;
-    val = g + sigma * 2.0f*mt*t + t2*(sigma + sigma*shadows);
-  }
-  else
-  { // highlight contrast
-    const float t = CLAMPS(-c / (2.0f*sigma), 0.0f, 1.0f);
-    const float t2 = t * t;
-    const float mt = 1.0f-t;
-    val = g - sigma * 2.0f*mt*t + t2*(- sigma - sigma*highlights);
-  }
+  const float t = CLAMPS(c / (2.0f*ssigma), 0.0f, 1.0f);
+  const float t2 = t * t;
+  const float mt = 1.0f-t;
+  const float vmid = g + ssigma * 2.0f*mt*t + t2*(ssigma + ssigma*shadhi);
+  const float val = fabsf(c) > 2.0f*sigma ? vlin : vmid;
   // midtone local contrast
-  val += clarity * c * dt_fast_expf(-c*c/(2.0*sigma*sigma/3.0f));
-  return val;
+  return val + clarity * c * dt_fast_expf(-c*c/(2.0f*sigma*sigma/3.0f));
 }
 
 #if defined(__SSE2__)
@@ -549,10 +556,15 @@ void apply_curve(
 #endif
   for(uint32_t j=padding;j<h-padding;j++)
   {
-    const float *in2  = in  + j*w + padding;
+    const float *const in2  = in  + j*w + padding;
     float *out2 = out + j*w + padding;
-    for(uint32_t i=padding;i<w-padding;i++)
-      (*out2++) = curve_scalar(*(in2++), g, sigma, shadows, highlights, clarity);
+    const int n = w - 2*padding;
+    // the plain counterpart of apply_curve_sse2(), vectorised by the compiler for neon or vsx
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for(int i=0;i<n;i++)
+      out2[i] = curve_scalar(in2[i], g, sigma, shadows, highlights, clarity);
     out2 = out + j*w;
     for(int i=0;i<padding;i++)   out2[i] = out2[padding];
     for(int i=w-padding;i<w;i++) out2[i] = out2[w-padding-1];
@@ -615,10 +627,22 @@ void local_laplacian_internal(
   for(int k=0;k<num_gamma;k++) gamma[k] = (k+.5f)/(float)num_gamma;
   // for(int k=0;k<num_gamma;k++) gamma[k] = k/(num_gamma-1.0f);
 
-  // allocate memory for intermediate laplacian pyramids
-  float *buf[num_gamma][max_levels] = {{0}};
-  for(int k=0;k<num_gamma;k++) for(int l=0;l<=last_level;l++)
-    buf[k][l] = dt_alloc_align(64, sizeof(float)*dl(w,l)*dl(h,l));
+  // the output pyramid is linear in the laplacian coefficients, so instead of keeping one
+  // pyramid per gamma around we stream through them: output[l] for l < last_level first only
+  // collects the interpolated laplacian coefficients of one curve after the other, and the
+  // coarse to fine expansion is done once at the end. that way only a single intermediate
+  // pyramid is live at any time, see local_laplacian_memory_use().
+  float *buf[max_levels] = {0};
+  for(int l=0;l<=last_level;l++)
+    buf[l] = dt_alloc_align(64, sizeof(float)*dl(w,l)*dl(h,l));
+  for(int l=0;l<last_level;l++)
+    memset(output[l], 0, sizeof(float)*dl(w,l)*dl(h,l));
+
+  // the rows of all levels are processed by one parallel loop, so the coarse levels don't
+  // run on a single thread each:
+  int rows[max_levels+1] = {0};
+  for(int l=0;l<last_level;l++) rows[l+1] = rows[l] + dl(h,l);
+  const int num_rows = rows[last_level];
 
   // the paper says remapping only level 3 not 0 does the trick, too
   // (but i really like the additional octave of sharpness we get,
@@ -627,19 +651,50 @@ void local_laplacian_internal(
   { // process images
 #if defined(__SSE2__)
     if(use_sse2)
-      apply_curve_sse2(buf[k][0], padded[0], w, h, max_supp, gamma[k], sigma, shadows, highlights, clarity);
+      apply_curve_sse2(buf[0], padded[0], w, h, max_supp, gamma[k], sigma, shadows, highlights, clarity);
     else // brackets in next line needed for silly gcc warning:
 #endif
-    {apply_curve(buf[k][0], padded[0], w, h, max_supp, gamma[k], sigma, shadows, highlights, clarity);}
+    {apply_curve(buf[0], padded[0], w, h, max_supp, gamma[k], sigma, shadows, highlights, clarity);}
 
-    // create gaussian pyramids
+    // create gaussian pyramid
     for(int l=1;l<=last_level;l++)
 #if defined(__SSE2__)
       if(use_sse2)
-        gauss_reduce_sse2(buf[k][l-1], buf[k][l], dl(w,l-1), dl(h,l-1));
+        gauss_reduce_sse2(buf[l-1], buf[l], dl(w,l-1), dl(h,l-1));
       else
 #endif
-        gauss_reduce(buf[k][l-1], buf[k][l], dl(w,l-1), dl(h,l-1));
+        gauss_reduce(buf[l-1], buf[l], dl(w,l-1), dl(h,l-1));
+
+    // add the coefficients of this curve to all pixels whose brightness is next to gamma[k]:
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+    dt_omp_firstprivate(k, num_rows) \
+    shared(w,h,buf,output,gamma,padded,rows) \
+    schedule(dynamic, 16)
+#endif
+    for(int r=0;r<num_rows;r++)
+    {
+      int l = 0;
+      while(r >= rows[l+1]) l++;
+      const int j = r - rows[l];
+      const int pw = dl(w,l), ph = dl(h,l);
+      for(int i=0;i<pw;i++)
+      {
+        const float v = padded[l][j*pw+i];
+        int hi = 1;
+        for(;hi<num_gamma-1 && gamma[hi] <= v;hi++);
+        if(k != hi && k != hi-1) continue;
+        const float a = CLAMPS((v - gamma[hi-1])/(gamma[hi]-gamma[hi-1]), 0.0f, 1.0f);
+        const float weight = k == hi ? a : 1.0f-a;
+        if(weight == 0.0f) continue;
+        output[l][j*pw+i] += weight * ll_laplacian(buf[l+1], buf[l], i, j, pw, ph);
+        // we could do this to save on memory (no need for finest buf[][]).
+        // unfortunately it results in a quite noticeable loss of sharpness, i think
+        // the extra level is worth it.
+        // else if(l == 0) // use finest scale from input to not amplify noise (and use less memory)
+        //   output[l][j*pw+i] += ll_laplacian(padded[l+1], padded[l], i, j, pw, ph);
+      }
+    }
   }
 
   // resample output[last_level] from preview
@@ -700,41 +755,26 @@ void local_laplacian_internal(
     debug_dump_PFM("/tmp/newcoarse.pfm", output[last_level], pw, ph);
   }
 
-  // assemble output pyramid coarse to fine
+  // assemble output pyramid coarse to fine, the gamma pyramid is free now and holds the upsampled levels
   for(int l=last_level-1;l >= 0; l--)
   {
     const int pw = dl(w,l), ph = dl(h,l);
+    float *const coarse = buf[l];
+    float *const fine = output[l];
 
-    gauss_expand(output[l+1], output[l], pw, ph);
-    // go through all coefficients in the upsampled gauss buffer:
+    gauss_expand(output[l+1], coarse, pw, ph);
 #ifdef _OPENMP
-#pragma omp parallel for default(none) \
-    dt_omp_firstprivate(ph, pw) \
-    shared(w,h,buf,output,l,gamma,padded) \
-    schedule(static) \
-    collapse(2)
+#pragma omp parallel for simd default(none) \
+    dt_omp_firstprivate(coarse, fine, ph, pw) \
+    schedule(static)
 #endif
-    for(int j=0;j<ph;j++) for(int i=0;i<pw;i++)
-    {
-      const float v = padded[l][j*pw+i];
-      int hi = 1;
-      for(;hi<num_gamma-1 && gamma[hi] <= v;hi++);
-      int lo = hi-1;
-      const float a = CLAMPS((v - gamma[lo])/(gamma[hi]-gamma[lo]), 0.0f, 1.0f);
-      const float l0 = ll_laplacian(buf[lo][l+1], buf[lo][l], i, j, pw, ph);
-      const float l1 = ll_laplacian(buf[hi][l+1], buf[hi][l], i, j, pw, ph);
-      output[l][j*pw+i] += l0 * (1.0f-a) + l1 * a;
-      // we could do this to save on memory (no need for finest buf[][]).
-      // unfortunately it results in a quite noticeable loss of sharpness, i think
-      // the extra level is worth it.
-      // else if(l == 0) // use finest scale from input to not amplify noise (and use less memory)
-      //   output[l][j*pw+i] += ll_laplacian(padded[l+1], padded[l], i, j, pw, ph);
-    }
+    for(size_t k=0;k<(size_t)pw*ph;k++)
+      fine[k] += coarse[k];
   }
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
   dt_omp_firstprivate(ht, input, max_supp, out, wd) \
-  shared(w,output,buf) \
+  shared(w,output) \
   schedule(static) \
   collapse(2)
 #endif
@@ -759,7 +799,7 @@ void local_laplacian_internal(
   {
     if(!b || b->mode != 1 || l)   dt_free_align(padded[l]);
     if(!b || b->mode != 1)        dt_free_align(output[l]);
-    for(int k=0; k<num_gamma;k++) dt_free_align(buf[k][l]);
+    dt_free_align(buf[l]);
   }
 }
 
@@ -774,8 +814,9 @@ size_t local_laplacian_memory_use(const int width,     // width of input image
 
   size_t memory_use = 0;
 
+  // padded input, output and one gamma pyramid
   for(int l=0;l<num_levels;l++)
-    memory_use += (size_t)(2 + num_gamma) * dl(paddwd, l) * dl(paddht, l) * sizeof(float);
+    memory_use += (size_t)3 * dl(paddwd, l) * dl(paddht, l) * sizeof(float);
 
   return memory_use;
 }
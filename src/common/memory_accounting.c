@@ -0,0 +1,109 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/memory_accounting.h"
+#include "common/dtpthread.h"
+
+typedef struct dt_memory_accounting_frame_t
+{
+  gboolean open;
+  int64_t host, host_peak;
+  int64_t device, device_peak;
+} dt_memory_accounting_frame_t;
+
+static gboolean _enabled = FALSE;
+// the size of every buffer allocated inside a frame, to know how much a free gives back
+static GHashTable *_sizes = NULL;
+static dt_pthread_mutex_t _sizes_mutex;
+
+static __thread dt_memory_accounting_frame_t _frame = { 0 };
+
+void dt_memory_accounting_init(const gboolean enabled)
+{
+  if(!enabled || _enabled) return;
+  dt_pthread_mutex_init(&_sizes_mutex, NULL);
+  _sizes = g_hash_table_new(g_direct_hash, g_direct_equal);
+  _enabled = TRUE;
+}
+
+void dt_memory_accounting_cleanup(void)
+{
+  if(!_enabled) return;
+  _enabled = FALSE;
+  dt_pthread_mutex_lock(&_sizes_mutex);
+  g_hash_table_destroy(_sizes);
+  _sizes = NULL;
+  dt_pthread_mutex_unlock(&_sizes_mutex);
+  dt_pthread_mutex_destroy(&_sizes_mutex);
+}
+
+gboolean dt_memory_accounting_enabled(void)
+{
+  return _enabled;
+}
+
+void dt_memory_accounting_begin(void)
+{
+  _frame.host = _frame.host_peak = 0;
+  _frame.device = _frame.device_peak = 0;
+  _frame.open = _enabled;
+}
+
+void dt_memory_accounting_end(size_t *host_peak, size_t *device_peak)
+{
+  *host_peak = _frame.open ? _frame.host_peak : 0;
+  *device_peak = _frame.open ? _frame.device_peak : 0;
+  _frame.open = FALSE;
+}
+
+void dt_memory_accounting_host_alloc(void *mem, const size_t size)
+{
+  if(!_frame.open || !mem) return;
+
+  dt_pthread_mutex_lock(&_sizes_mutex);
+  g_hash_table_insert(_sizes, mem, GSIZE_TO_POINTER(size));
+  dt_pthread_mutex_unlock(&_sizes_mutex);
+
+  _frame.host += size;
+  _frame.host_peak = MAX(_frame.host_peak, _frame.host);
+}
+
+void dt_memory_accounting_host_free(void *mem)
+{
+  if(!_enabled || !mem) return;
+
+  gpointer size = NULL;
+  dt_pthread_mutex_lock(&_sizes_mutex);
+  const gboolean known = g_hash_table_lookup_extended(_sizes, mem, NULL, &size);
+  if(known) g_hash_table_remove(_sizes, mem);
+  dt_pthread_mutex_unlock(&_sizes_mutex);
+
+  // buffers can be freed on another thread than the one which allocated them, they count where they are freed
+  if(known && _frame.open) _frame.host -= GPOINTER_TO_SIZE(size);
+}
+
+void dt_memory_accounting_device(const int64_t bytes)
+{
+  if(!_frame.open) return;
+  _frame.device += bytes;
+  _frame.device_peak = MAX(_frame.device_peak, _frame.device);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,52 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <glib.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * what the modules really allocate, next to the estimates of their tiling callbacks. only active with -d memory
+ * or --trace.
+ *
+ * the pixelpipe opens a frame around every module it processes, on the thread which processes it. while it is
+ * open dt_alloc_align(), dt_free_align(), the buffers handed out by the pixelpipe pool and the OpenCL
+ * allocations are added to it, and the frame keeps the peak of host and device bytes the module held on top of
+ * what was there when it started. allocations on other threads (e.g. inside OpenMP loops) are not seen.
+ */
+
+void dt_memory_accounting_init(const gboolean enabled);
+void dt_memory_accounting_cleanup(void);
+gboolean dt_memory_accounting_enabled(void);
+
+/** opens a frame on this thread, or starts it over if it is open already, as after a module which failed. */
+void dt_memory_accounting_begin(void);
+/** closes the frame of this thread and returns its peaks, 0 if accounting is off. */
+void dt_memory_accounting_end(size_t *host_peak, size_t *device_peak);
+
+/** host memory, called by the allocators. */
+void dt_memory_accounting_host_alloc(void *mem, const size_t size);
+void dt_memory_accounting_host_free(void *mem);
+/** device memory, positive for allocations and negative for releases. */
+void dt_memory_accounting_device(const int64_t bytes);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,252 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/memory_governor.h"
+#include "common/darktable.h"
+#include "common/metrics.h"
+#include "control/conf.h"
+
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// the part of the ceiling each consumer may use
+static const struct
+{
+  const char *name;
+  float share;
+} _shares[] = {
+  { "mipmap", 0.4f },
+  { "pixelpipe", 0.3f },
+  { "tiling", 0.3f },
+};
+#define DT_MEMORY_KINDS (int)(sizeof(_shares) / sizeof(_shares[0]))
+
+// the process is looked at no more often than this, in seconds
+#define DT_MEMORY_CHECK_INTERVAL 0.5
+
+typedef struct dt_memory_consumer_t
+{
+  int kind; // index into _shares
+  dt_memory_usage_t usage;
+  dt_memory_shrink_t shrink;
+  dt_memory_relax_t relax;
+  gpointer user_data;
+} dt_memory_consumer_t;
+
+static struct
+{
+  size_t ceiling;
+  dt_pthread_mutex_t lock; // consumers and pressure
+  GList *consumers;
+  dt_pthread_mutex_t check_lock; // one check at a time
+  double last_check;
+  gboolean pressure; // consumers have been shrunk and not relaxed since
+} _governor = { .ceiling = 0 };
+
+static int _kind(const char *name)
+{
+  for(int k = 0; k < DT_MEMORY_KINDS; k++)
+    if(!strcmp(_shares[k].name, name)) return k;
+  return -1;
+}
+
+// the resident size of the process, 0 if it can't be read
+static size_t _resident_size(void)
+{
+#ifdef __linux__
+  FILE *f = g_fopen("/proc/self/statm", "r");
+  if(!f) return 0;
+  unsigned long size = 0, resident = 0;
+  const int read = fscanf(f, "%lu %lu", &size, &resident);
+  fclose(f);
+  return read == 2 ? (size_t)resident * sysconf(_SC_PAGESIZE) : 0;
+#else
+  return 0;
+#endif
+}
+
+// the usage of every kind and their sum, under lock
+static size_t _usage(size_t usage[DT_MEMORY_KINDS])
+{
+  size_t total = 0;
+  for(int k = 0; k < DT_MEMORY_KINDS; k++) usage[k] = 0;
+  for(GList *l = _governor.consumers; l; l = g_list_next(l))
+  {
+    const dt_memory_consumer_t *c = (dt_memory_consumer_t *)l->data;
+    if(!c->usage) continue;
+    const size_t u = c->usage(c->user_data);
+    usage[c->kind] += u;
+    total += u;
+  }
+  return total;
+}
+
+static void _collect_metrics(gpointer user_data)
+{
+  size_t usage[DT_MEMORY_KINDS];
+  dt_pthread_mutex_lock(&_governor.lock);
+  _usage(usage);
+  dt_pthread_mutex_unlock(&_governor.lock);
+
+  char name[64];
+  for(int k = 0; k < DT_MEMORY_KINDS; k++)
+  {
+    snprintf(name, sizeof(name), "memory.%s.bytes", _shares[k].name);
+    dt_metrics_set(dt_metrics_get(name, DT_METRIC_GAUGE), usage[k]);
+    snprintf(name, sizeof(name), "memory.%s.budget", _shares[k].name);
+    dt_metrics_set(dt_metrics_get(name, DT_METRIC_GAUGE), dt_memory_governor_budget(_shares[k].name));
+  }
+  dt_metrics_set(dt_metrics_get("memory.ceiling", DT_METRIC_GAUGE), _governor.ceiling);
+  dt_metrics_set(dt_metrics_get("memory.resident", DT_METRIC_GAUGE), _resident_size());
+}
+
+void dt_memory_governor_init(void)
+{
+  dt_pthread_mutex_init(&_governor.lock, NULL);
+  dt_pthread_mutex_init(&_governor.check_lock, NULL);
+  _governor.consumers = NULL;
+  _governor.last_check = 0.0;
+  _governor.pressure = FALSE;
+  _governor.ceiling = (size_t)MAX(dt_conf_get_int64("memory_ceiling"), 0) << 20;
+  if(_governor.ceiling)
+    dt_print(DT_DEBUG_MEMORY, "[memory governor] ceiling of %zu MB\n", _governor.ceiling >> 20);
+  dt_metrics_add_collector(_collect_metrics, NULL);
+}
+
+void dt_memory_governor_cleanup(void)
+{
+  g_list_free_full(_governor.consumers, g_free);
+  _governor.consumers = NULL;
+  dt_pthread_mutex_destroy(&_governor.check_lock);
+  dt_pthread_mutex_destroy(&_governor.lock);
+}
+
+void dt_memory_governor_register(const char *name, dt_memory_usage_t usage, dt_memory_shrink_t shrink,
+                                 dt_memory_relax_t relax, gpointer user_data)
+{
+  const int kind = _kind(name);
+  if(kind < 0) return;
+  dt_memory_consumer_t *c = g_malloc(sizeof(dt_memory_consumer_t));
+  c->kind = kind;
+  c->usage = usage;
+  c->shrink = shrink;
+  c->relax = relax;
+  c->user_data = user_data;
+  dt_pthread_mutex_lock(&_governor.lock);
+  _governor.consumers = g_list_prepend(_governor.consumers, c);
+  dt_pthread_mutex_unlock(&_governor.lock);
+}
+
+void dt_memory_governor_unregister(gpointer user_data)
+{
+  dt_pthread_mutex_lock(&_governor.lock);
+  GList *l = _governor.consumers;
+  while(l)
+  {
+    GList *next = g_list_next(l);
+    if(((dt_memory_consumer_t *)l->data)->user_data == user_data)
+    {
+      g_free(l->data);
+      _governor.consumers = g_list_delete_link(_governor.consumers, l);
+    }
+    l = next;
+  }
+  dt_pthread_mutex_unlock(&_governor.lock);
+}
+
+size_t dt_memory_governor_ceiling(void)
+{
+  return _governor.ceiling;
+}
+
+size_t dt_memory_governor_budget(const char *name)
+{
+  const int kind = _kind(name);
+  if(kind < 0) return 0;
+  return _governor.ceiling * _shares[kind].share;
+}
+
+size_t dt_memory_governor_limit(const char *name, const size_t limit)
+{
+  const size_t budget = dt_memory_governor_budget(name);
+  return budget ? MIN(limit, budget) : limit;
+}
+
+void dt_memory_governor_check(void)
+{
+  if(!_governor.ceiling || dt_pthread_mutex_trylock(&_governor.check_lock)) return;
+  const double now = dt_get_wtime();
+  if(now - _governor.last_check < DT_MEMORY_CHECK_INTERVAL)
+  {
+    dt_pthread_mutex_unlock(&_governor.check_lock);
+    return;
+  }
+  _governor.last_check = now;
+
+  dt_pthread_mutex_lock(&_governor.lock);
+  size_t usage[DT_MEMORY_KINDS];
+  const size_t consumers = _usage(usage);
+  const size_t resident = _resident_size();
+  const size_t used = resident ? resident : consumers;
+
+  if(used > _governor.ceiling)
+  {
+    // the kinds furthest over their budget shrink first
+    int order[DT_MEMORY_KINDS];
+    int64_t over[DT_MEMORY_KINDS];
+    for(int k = 0; k < DT_MEMORY_KINDS; k++)
+    {
+      over[k] = (int64_t)usage[k] - (int64_t)dt_memory_governor_budget(_shares[k].name);
+      int i = k;
+      for(; i > 0 && over[order[i - 1]] < over[k]; i--) order[i] = order[i - 1];
+      order[i] = k;
+    }
+
+    size_t excess = used - _governor.ceiling;
+    dt_print(DT_DEBUG_MEMORY, "[memory governor] %zu MB used of %zu MB, shrinking\n", used >> 20,
+             _governor.ceiling >> 20);
+    for(int i = 0; i < DT_MEMORY_KINDS && excess; i++)
+      for(GList *l = _governor.consumers; l && excess; l = g_list_next(l))
+      {
+        const dt_memory_consumer_t *c = (dt_memory_consumer_t *)l->data;
+        if(c->kind != order[i] || !c->shrink) continue;
+        excess -= MIN(excess, c->shrink(c->user_data, excess));
+      }
+    _governor.pressure = TRUE;
+    dt_metrics_count("memory.shrinks", 1);
+  }
+  else if(_governor.pressure && used < _governor.ceiling / 4 * 3)
+  {
+    for(GList *l = _governor.consumers; l; l = g_list_next(l))
+    {
+      const dt_memory_consumer_t *c = (dt_memory_consumer_t *)l->data;
+      if(c->relax) c->relax(c->user_data);
+    }
+    _governor.pressure = FALSE;
+    dt_print(DT_DEBUG_MEMORY, "[memory governor] %zu MB used of %zu MB, relaxing\n", used >> 20,
+             _governor.ceiling >> 20);
+  }
+  dt_pthread_mutex_unlock(&_governor.lock);
+  dt_pthread_mutex_unlock(&_governor.check_lock);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,66 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <glib.h>
+#include <stddef.h>
+
+/**
+ * one ceiling for the memory of the whole process, memory_ceiling in MB. 0 leaves every consumer to its own limit.
+ *
+ * the consumers are named: "mipmap" (the mipmap cache and its compressed buffers), "pixelpipe" (the caches of
+ * all pipes and the idle objects of the OpenCL memory pools) and "tiling" (what one tiled module may allocate).
+ * each one has a fixed share of the ceiling as its budget, which caps the limit it is configured with. consumers
+ * which hold memory register with callbacks telling how much they use and giving some of it back. several
+ * consumers of the same name share its budget.
+ *
+ * dt_memory_governor_check() compares the resident size of the process (or the sum of the consumers where that
+ * can't be read) to the ceiling. above it the consumers furthest over their budget are asked to shrink first;
+ * once the process is back below 3/4 of the ceiling they may grow to their limits again. usage and budget of
+ * every consumer are in the metrics as memory.<name>.bytes and memory.<name>.budget.
+ */
+
+/** the bytes the consumer holds. */
+typedef size_t (*dt_memory_usage_t)(gpointer user_data);
+/** gives back about bytes if it can, returns what was freed or will be soon. */
+typedef size_t (*dt_memory_shrink_t)(gpointer user_data, const size_t bytes);
+/** the pressure is gone, the consumer may use its configured limit again. */
+typedef void (*dt_memory_relax_t)(gpointer user_data);
+
+void dt_memory_governor_init(void);
+void dt_memory_governor_cleanup(void);
+
+/** relax may be NULL. */
+void dt_memory_governor_register(const char *name, dt_memory_usage_t usage, dt_memory_shrink_t shrink,
+                                 dt_memory_relax_t relax, gpointer user_data);
+void dt_memory_governor_unregister(gpointer user_data);
+
+/** the ceiling in bytes, 0 if there is none. */
+size_t dt_memory_governor_ceiling(void);
+/** the budget of the consumer in bytes, 0 if there is no ceiling. */
+size_t dt_memory_governor_budget(const char *name);
+/** limit capped by the budget of the consumer. */
+size_t dt_memory_governor_limit(const char *name, const size_t limit);
+
+/** shrinks the consumers if the process is above the ceiling. cheap, meant to be called after large allocations. */
+void dt_memory_governor_check(void);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
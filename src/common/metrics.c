@@ -0,0 +1,315 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/metrics.h"
+#include "common/darktable.h"
+#include "control/conf.h"
+#ifdef HAVE_HTTP_SERVER
+#include "common/http_server.h"
+#endif
+
+#include <glib/gstdio.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+// log linear buckets like a HDR histogram: 16 per power of two from 1us, which keeps the percentiles within about
+// 4% of the real value. the last one takes everything above 2^28us (~4.5 minutes)
+#define DT_METRICS_BUCKETS_PER_OCTAVE 16
+#define DT_METRICS_BUCKETS (28 * DT_METRICS_BUCKETS_PER_OCTAVE + 1)
+
+typedef struct dt_metrics_collector_entry_t
+{
+  dt_metrics_collector_t collector;
+  gpointer user_data;
+} dt_metrics_collector_entry_t;
+
+struct dt_metric_t
+{
+  char name[128];
+  dt_metric_type_t type;
+  int64_t value;
+  // histograms only, under lock
+  dt_pthread_mutex_t lock;
+  uint64_t count;
+  double sum, min, max;
+  uint64_t buckets[DT_METRICS_BUCKETS];
+};
+
+static struct
+{
+  dt_pthread_mutex_t lock;
+  GHashTable *metrics; // name -> dt_metric_t
+  GList *collectors;
+  double start;
+#ifdef HAVE_HTTP_SERVER
+  dt_http_server_t *server;
+#endif
+} _metrics = { .metrics = NULL };
+
+static void _free_metric(gpointer data)
+{
+  dt_metric_t *metric = (dt_metric_t *)data;
+  if(metric->type == DT_METRIC_HISTOGRAM) dt_pthread_mutex_destroy(&metric->lock);
+  g_free(metric);
+}
+
+#ifdef HAVE_HTTP_SERVER
+static char *_serve(GHashTable *query, const char **content_type, gpointer user_data)
+{
+  const char *format = query ? g_hash_table_lookup(query, "format") : NULL;
+  if(format && !strcmp(format, "text")) return dt_metrics_to_text();
+  *content_type = "application/json";
+  return dt_metrics_to_json();
+}
+#endif
+
+void dt_metrics_init(void)
+{
+  dt_pthread_mutex_init(&_metrics.lock, NULL);
+  _metrics.metrics = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, _free_metric);
+  _metrics.collectors = NULL;
+  _metrics.start = dt_get_wtime();
+
+#ifdef HAVE_HTTP_SERVER
+  _metrics.server = NULL;
+  const int port = dt_conf_get_int("metrics_port");
+  if(port > 0) _metrics.server = dt_http_server_create_endpoint(port, "metrics", _serve, NULL);
+#endif
+}
+
+void dt_metrics_cleanup(void)
+{
+  if(!_metrics.metrics) return;
+
+#ifdef HAVE_HTTP_SERVER
+  if(_metrics.server) dt_http_server_kill(_metrics.server);
+  _metrics.server = NULL;
+#endif
+
+  if(darktable.unmuted & DT_DEBUG_PERF)
+  {
+    char *text = dt_metrics_to_text();
+    dt_print(DT_DEBUG_PERF, "[metrics]\n%s", text);
+    g_free(text);
+  }
+
+  gchar *filename = dt_conf_get_string("metrics_file");
+  if(filename && filename[0])
+  {
+    char *json = dt_metrics_to_json();
+    if(!g_file_set_contents(filename, json, -1, NULL))
+      fprintf(stderr, "[metrics] can't write `%s'\n", filename);
+    g_free(json);
+  }
+  g_free(filename);
+
+  dt_pthread_mutex_lock(&_metrics.lock);
+  GHashTable *metrics = _metrics.metrics;
+  _metrics.metrics = NULL;
+  g_list_free_full(_metrics.collectors, g_free);
+  _metrics.collectors = NULL;
+  dt_pthread_mutex_unlock(&_metrics.lock);
+  g_hash_table_destroy(metrics);
+  dt_pthread_mutex_destroy(&_metrics.lock);
+}
+
+dt_metric_t *dt_metrics_get(const char *name, const dt_metric_type_t type)
+{
+  if(!_metrics.metrics || !name) return NULL;
+
+  dt_pthread_mutex_lock(&_metrics.lock);
+  dt_metric_t *metric = g_hash_table_lookup(_metrics.metrics, name);
+  if(!metric)
+  {
+    metric = g_malloc0(sizeof(dt_metric_t));
+    g_strlcpy(metric->name, name, sizeof(metric->name));
+    metric->type = type;
+    if(type == DT_METRIC_HISTOGRAM) dt_pthread_mutex_init(&metric->lock, NULL);
+    g_hash_table_insert(_metrics.metrics, metric->name, metric);
+  }
+  else if(metric->type != type)
+    metric = NULL;
+  dt_pthread_mutex_unlock(&_metrics.lock);
+  return metric;
+}
+
+void dt_metrics_add(dt_metric_t *metric, const int64_t value)
+{
+  if(!metric || metric->type == DT_METRIC_HISTOGRAM) return;
+  __sync_fetch_and_add(&metric->value, value);
+}
+
+void dt_metrics_set(dt_metric_t *metric, const int64_t value)
+{
+  if(!metric || metric->type == DT_METRIC_HISTOGRAM) return;
+  __sync_lock_test_and_set(&metric->value, value);
+}
+
+void dt_metrics_observe(dt_metric_t *metric, const double seconds)
+{
+  if(!metric || metric->type != DT_METRIC_HISTOGRAM) return;
+
+  const double us = seconds * 1e6;
+  const int bucket = us > 1.0 ? MIN((int)(DT_METRICS_BUCKETS_PER_OCTAVE * log2(us)), DT_METRICS_BUCKETS - 1) : 0;
+
+  dt_pthread_mutex_lock(&metric->lock);
+  if(metric->count == 0 || seconds < metric->min) metric->min = seconds;
+  if(metric->count == 0 || seconds > metric->max) metric->max = seconds;
+  metric->count++;
+  metric->sum += seconds;
+  metric->buckets[bucket]++;
+  dt_pthread_mutex_unlock(&metric->lock);
+}
+
+void dt_metrics_count(const char *name, const int64_t value)
+{
+  dt_metrics_add(dt_metrics_get(name, DT_METRIC_COUNTER), value);
+}
+
+void dt_metrics_time(const char *name, const double seconds)
+{
+  dt_metrics_observe(dt_metrics_get(name, DT_METRIC_HISTOGRAM), seconds);
+}
+
+void dt_metrics_add_collector(dt_metrics_collector_t collector, gpointer user_data)
+{
+  if(!_metrics.metrics) return;
+  dt_metrics_collector_entry_t *entry = g_malloc(sizeof(dt_metrics_collector_entry_t));
+  entry->collector = collector;
+  entry->user_data = user_data;
+  dt_pthread_mutex_lock(&_metrics.lock);
+  _metrics.collectors = g_list_append(_metrics.collectors, entry);
+  dt_pthread_mutex_unlock(&_metrics.lock);
+}
+
+// upper end of the bucket, clamped to what has been seen
+static double _percentile(const dt_metric_t *metric, const double fraction)
+{
+  const uint64_t rank = (uint64_t)ceil(fraction * metric->count);
+  uint64_t seen = 0;
+  for(int b = 0; b < DT_METRICS_BUCKETS; b++)
+  {
+    seen += metric->buckets[b];
+    if(seen >= rank)
+      return CLAMP(exp2((b + 1) / (double)DT_METRICS_BUCKETS_PER_OCTAVE) * 1e-6, metric->min, metric->max);
+  }
+  return metric->max;
+}
+
+static gint _compare_by_name(gconstpointer a, gconstpointer b)
+{
+  return strcmp(((const dt_metric_value_t *)a)->name, ((const dt_metric_value_t *)b)->name);
+}
+
+GList *dt_metrics_snapshot(void)
+{
+  if(!_metrics.metrics) return NULL;
+
+  // collectors set metrics themselves, so they run without the lock
+  dt_pthread_mutex_lock(&_metrics.lock);
+  GList *collectors = g_list_copy(_metrics.collectors);
+  dt_pthread_mutex_unlock(&_metrics.lock);
+  for(GList *l = collectors; l; l = g_list_next(l))
+  {
+    const dt_metrics_collector_entry_t *entry = (dt_metrics_collector_entry_t *)l->data;
+    entry->collector(entry->user_data);
+  }
+  g_list_free(collectors);
+  dt_metrics_set(dt_metrics_get("uptime_ms", DT_METRIC_GAUGE), (int64_t)((dt_get_wtime() - _metrics.start) * 1e3));
+
+  GList *list = NULL;
+  dt_pthread_mutex_lock(&_metrics.lock);
+  GHashTableIter iter;
+  gpointer key, data;
+  g_hash_table_iter_init(&iter, _metrics.metrics);
+  while(g_hash_table_iter_next(&iter, &key, &data))
+  {
+    dt_metric_t *metric = (dt_metric_t *)data;
+    dt_metric_value_t *value = g_malloc0(sizeof(dt_metric_value_t));
+    g_strlcpy(value->name, metric->name, sizeof(value->name));
+    value->type = metric->type;
+    if(metric->type == DT_METRIC_HISTOGRAM)
+    {
+      dt_pthread_mutex_lock(&metric->lock);
+      value->count = metric->count;
+      value->sum = metric->sum;
+      value->min = metric->min;
+      value->max = metric->max;
+      if(metric->count)
+      {
+        value->p50 = _percentile(metric, 0.50);
+        value->p90 = _percentile(metric, 0.90);
+        value->p95 = _percentile(metric, 0.95);
+        value->p99 = _percentile(metric, 0.99);
+      }
+      dt_pthread_mutex_unlock(&metric->lock);
+    }
+    else
+      value->value = __sync_fetch_and_add(&metric->value, 0);
+    list = g_list_prepend(list, value);
+  }
+  dt_pthread_mutex_unlock(&_metrics.lock);
+  return g_list_sort(list, _compare_by_name);
+}
+
+char *dt_metrics_to_json(void)
+{
+  GList *list = dt_metrics_snapshot();
+  GString *json = g_string_new("{");
+  for(GList *l = list; l; l = g_list_next(l))
+  {
+    const dt_metric_value_t *value = (dt_metric_value_t *)l->data;
+    // names are ours, no need to escape them
+    g_string_append_printf(json, "%s\n  \"%s\": ", l == list ? "" : ",", value->name);
+    if(value->type == DT_METRIC_HISTOGRAM)
+      g_string_append_printf(json,
+                             "{\"count\": %" PRIu64 ", \"sum\": %.6f, \"mean\": %.6f, \"min\": %.6f, "
+                             "\"max\": %.6f, \"p50\": %.6f, \"p90\": %.6f, \"p95\": %.6f, \"p99\": %.6f}",
+                             value->count, value->sum, value->count ? value->sum / value->count : 0.0, value->min,
+                             value->max, value->p50, value->p90, value->p95, value->p99);
+    else
+      g_string_append_printf(json, "%" PRId64, value->value);
+  }
+  g_string_append(json, "\n}\n");
+  g_list_free_full(list, g_free);
+  return g_string_free(json, FALSE);
+}
+
+char *dt_metrics_to_text(void)
+{
+  GList *list = dt_metrics_snapshot();
+  GString *text = g_string_new(NULL);
+  for(GList *l = list; l; l = g_list_next(l))
+  {
+    const dt_metric_value_t *value = (dt_metric_value_t *)l->data;
+    if(value->type == DT_METRIC_HISTOGRAM)
+      g_string_append_printf(text, "%-40s %8" PRIu64 " runs %10.3fs total %9.3fms mean %9.3fms p50 %9.3fms p95 "
+                                   "%9.3fms p99 %9.3fms max\n",
+                             value->name, value->count, value->sum, value->sum / MAX(value->count, 1) * 1e3,
+                             value->p50 * 1e3, value->p95 * 1e3, value->p99 * 1e3, value->max * 1e3);
+    else
+      g_string_append_printf(text, "%-40s %12" PRId64 "\n", value->name, value->value);
+  }
+  g_list_free_full(list, g_free);
+  return g_string_free(text, FALSE);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
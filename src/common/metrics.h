@@ -0,0 +1,84 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <glib.h>
+#include <inttypes.h>
+
+/**
+ * registry of named counters, gauges and time histograms. the job system, the caches, the pixelpipe, the
+ * startup phases (startup.*, in ms), the profiling timers (timer.*) and with -d perf the sql statements (sql.*)
+ * feed it. lua reads it as darktable.configuration.metrics(), -d perf prints it at exit, metrics_file has it
+ * written there at exit as json and metrics_port serves it on http://localhost:<port>/metrics while the gui runs
+ * (?format=text for plain text).
+ *
+ * histograms have log linear buckets, which give count, mean and percentiles within about 4% of the real
+ * values at a fixed cost per observation.
+ *
+ * names are dotted paths like "jobs.system_fg.wait". a metric lives until dt_metrics_cleanup(), so callers
+ * may keep the pointer they got.
+ */
+
+typedef enum dt_metric_type_t
+{
+  DT_METRIC_COUNTER = 0, // only goes up
+  DT_METRIC_GAUGE,       // the current value of something
+  DT_METRIC_HISTOGRAM    // distribution of durations in seconds
+} dt_metric_type_t;
+
+typedef struct dt_metric_t dt_metric_t;
+
+/** a copy of a metric, see dt_metrics_snapshot(). */
+typedef struct dt_metric_value_t
+{
+  char name[128];
+  dt_metric_type_t type;
+  int64_t value; // counters and gauges
+  uint64_t count; // histograms
+  double sum, min, max, p50, p90, p95, p99;
+} dt_metric_value_t;
+
+/** fills in metrics which are kept elsewhere, called before every snapshot. */
+typedef void (*dt_metrics_collector_t)(gpointer user_data);
+
+void dt_metrics_init(void);
+/** prints the metrics with -d perf and writes metrics_file, then frees all of them. */
+void dt_metrics_cleanup(void);
+
+/** returns the metric of that name, creating it if needed. NULL if the name is taken by another type. */
+dt_metric_t *dt_metrics_get(const char *name, const dt_metric_type_t type);
+void dt_metrics_add(dt_metric_t *metric, const int64_t value);
+void dt_metrics_set(dt_metric_t *metric, const int64_t value);
+void dt_metrics_observe(dt_metric_t *metric, const double seconds);
+
+/** shortcuts looking up the metric by name every time. */
+void dt_metrics_count(const char *name, const int64_t value);
+void dt_metrics_time(const char *name, const double seconds);
+
+void dt_metrics_add_collector(dt_metrics_collector_t collector, gpointer user_data);
+
+/** all metrics sorted by name as dt_metric_value_t, free with g_list_free_full(list, g_free). */
+GList *dt_metrics_snapshot(void);
+/** all metrics as one json object or as lines of text, free with g_free(). */
+char *dt_metrics_to_json(void);
+char *dt_metrics_to_text(void);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -23,9 +23,13 @@
 #include "common/file_location.h"
 #include "common/grealpath.h"
 #include "common/image_cache.h"
+#include "common/image_compression.h"
 #include "common/imageio.h"
 #include "common/imageio_jpeg.h"
 #include "common/imageio_module.h"
+#include "common/memory_governor.h"
+#include "common/metrics.h"
+#include "common/mipmap_pack.h"
 #include "control/conf.h"
 #include "control/jobs.h"
 #include "develop/imageop_math.h"
@@ -45,6 +49,10 @@
 #if defined(__SSE__)
 #include <xmmintrin.h>
 #endif
+#ifdef HAVE_WEBP
+#include <webp/decode.h>
+#include <webp/encode.h>
+#endif
 
 #if !defined(_WIN32)
 #include <sys/statvfs.h>
@@ -56,6 +64,8 @@
 #define DT_MIPMAP_CACHE_FILE_MAGIC 0xD71337
 #define DT_MIPMAP_CACHE_FILE_VERSION 23
 #define DT_MIPMAP_CACHE_DEFAULT_FILE_NAME "mipmaps"
+// evicted buffers waiting to be compressed, more get dropped
+#define DT_MIPMAP_CACHE_MAX_COMPRESSING 2
 
 typedef enum dt_mipmap_buffer_dsc_flags
 {
@@ -237,6 +247,183 @@ exit:
   return r;
 }
 
+static inline gboolean _use_disk_backend(const dt_mipmap_cache_t *cache, const dt_mipmap_size_t mip)
+{
+  return cache->cachedir[0] && ((dt_conf_value_bool(cache->disk_backend) && mip < DT_MIPMAP_8)
+                                || (dt_conf_value_bool(cache->disk_backend_full) && mip == DT_MIPMAP_8));
+}
+
+// thumbnail file of the layout without packs, still read if there is no pack or it doesn't have the image
+static inline void _ondisk_filename(const dt_mipmap_cache_t *cache, const dt_mipmap_size_t mip,
+                                    const uint32_t imgid, char *filename, const size_t size)
+{
+  snprintf(filename, size, "%s.d/%d/%" PRIu32 ".jpg", cache->cachedir, (int)mip, imgid);
+}
+
+static gboolean _ondisk_has_space(const char *filename)
+{
+  struct statvfs vfsbuf;
+  if(!statvfs(filename, &vfsbuf))
+  {
+    const int64_t free_mb = ((vfsbuf.f_frsize * vfsbuf.f_bavail) >> 20);
+    if(free_mb < 100)
+    {
+      fprintf(stderr, "Aborting image write as only %" PRId64 " MB free to write %s\n", free_mb, filename);
+      return FALSE;
+    }
+  }
+  else
+  {
+    fprintf(stderr, "Aborting image write since couldn't determine free space available to write %s\n", filename);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+// how thumbnails are stored in the packs, kept with each of them. thumbnails of the old layout are jpeg
+typedef enum dt_mipmap_disk_codec_t
+{
+  DT_MIPMAP_DISK_CODEC_JPEG = 0,
+  DT_MIPMAP_DISK_CODEC_RAW = 1, // width and height, then the pixels as they are in the buffer
+  DT_MIPMAP_DISK_CODEC_WEBP = 2
+} dt_mipmap_disk_codec_t;
+
+static dt_mipmap_disk_codec_t _disk_codec(void)
+{
+  gchar *codec = dt_conf_get_string("cache_disk_backend_codec");
+  dt_mipmap_disk_codec_t res = DT_MIPMAP_DISK_CODEC_JPEG;
+  if(codec && !strcmp(codec, "raw"))
+    res = DT_MIPMAP_DISK_CODEC_RAW;
+#ifdef HAVE_WEBP
+  else if(codec && !strcmp(codec, "webp"))
+    res = DT_MIPMAP_DISK_CODEC_WEBP;
+#endif
+  g_free(codec);
+  return res;
+}
+
+#ifdef HAVE_WEBP
+typedef struct dt_mipmap_webp_writer_t
+{
+  uint8_t *out;
+  size_t size, used;
+} dt_mipmap_webp_writer_t;
+
+static int _webp_write(const uint8_t *data, size_t data_size, const WebPPicture *const pic)
+{
+  dt_mipmap_webp_writer_t *writer = (dt_mipmap_webp_writer_t *)pic->custom_ptr;
+  if(writer->used + data_size > writer->size) return 0;
+  memcpy(writer->out + writer->used, data, data_size);
+  writer->used += data_size;
+  return 1;
+}
+#endif
+
+// encodes the 8-bit thumbnail into *blob, which is allocated here. returns the length, 0 on failure
+static size_t _disk_encode(const dt_mipmap_disk_codec_t codec, const uint8_t *in, const uint32_t width,
+                           const uint32_t height, uint8_t **blob)
+{
+  const int quality = MIN(100, MAX(10, dt_conf_get_int("database_cache_quality")));
+  const size_t pixels = (size_t)4 * width * height;
+  *blob = dt_alloc_align(64, 2 * sizeof(uint32_t) + pixels);
+  if(!*blob) return 0;
+
+  if(codec == DT_MIPMAP_DISK_CODEC_RAW)
+  {
+    const uint32_t size[2] = { width, height };
+    memcpy(*blob, size, sizeof(size));
+    memcpy(*blob + sizeof(size), in, pixels);
+    return sizeof(size) + pixels;
+  }
+#ifdef HAVE_WEBP
+  else if(codec == DT_MIPMAP_DISK_CODEC_WEBP)
+  {
+    // the fastest method, and no loop filter for the decoder to undo
+    WebPConfig config;
+    WebPPicture pic;
+    if(!WebPConfigPreset(&config, WEBP_PRESET_PICTURE, quality) || !WebPPictureInit(&pic)) return 0;
+    config.method = 0;
+    config.filter_strength = 0;
+    dt_mipmap_webp_writer_t writer = { *blob, pixels, 0 };
+    pic.width = width;
+    pic.height = height;
+    pic.writer = _webp_write;
+    pic.custom_ptr = &writer;
+    const int ok = WebPPictureImportRGBX(&pic, in, 4 * width) && WebPEncode(&config, &pic);
+    WebPPictureFree(&pic);
+    return ok ? writer.used : 0;
+  }
+#endif
+
+  const int len = dt_imageio_jpeg_compress(in, *blob, width, height, quality);
+  // compress returns 1 on errors, which is no jpeg either
+  return len > 1 ? len : 0;
+}
+
+// decodes a thumbnail of at most max_width x max_height into out, returns non-zero on failure
+static int _disk_decode(const dt_mipmap_disk_codec_t codec, const uint8_t *blob, const size_t len,
+                        const uint32_t max_width, const uint32_t max_height, uint8_t *out, uint32_t *width,
+                        uint32_t *height)
+{
+  if(codec == DT_MIPMAP_DISK_CODEC_JPEG)
+  {
+    dt_imageio_jpeg_t jpg;
+    if(dt_imageio_jpeg_decompress_header(blob, len, &jpg) || jpg.width > max_width || jpg.height > max_height
+       || dt_imageio_jpeg_decompress(&jpg, out))
+      return 1;
+    *width = jpg.width;
+    *height = jpg.height;
+    return 0;
+  }
+  else if(codec == DT_MIPMAP_DISK_CODEC_RAW)
+  {
+    uint32_t size[2] = { 0 };
+    if(len < sizeof(size)) return 1;
+    memcpy(size, blob, sizeof(size));
+    if(size[0] > max_width || size[1] > max_height || len != sizeof(size) + (size_t)4 * size[0] * size[1])
+      return 1;
+    memcpy(out, blob + sizeof(size), len - sizeof(size));
+    *width = size[0];
+    *height = size[1];
+    return 0;
+  }
+#ifdef HAVE_WEBP
+  else if(codec == DT_MIPMAP_DISK_CODEC_WEBP)
+  {
+    WebPDecoderConfig config;
+    if(!WebPInitDecoderConfig(&config) || WebPGetFeatures(blob, len, &config.input) != VP8_STATUS_OK
+       || (uint32_t)config.input.width > max_width || (uint32_t)config.input.height > max_height)
+      return 1;
+    // trade a little smoothness for decoding speed, these are only thumbnails
+    config.options.bypass_filtering = 1;
+    config.options.no_fancy_upsampling = 1;
+    config.output.colorspace = MODE_RGBA;
+    config.output.is_external_memory = 1;
+    config.output.u.RGBA.rgba = out;
+    config.output.u.RGBA.stride = 4 * config.input.width;
+    config.output.u.RGBA.size = (size_t)4 * config.input.width * config.input.height;
+    const int err = WebPDecode(blob, len, &config) != VP8_STATUS_OK;
+    WebPFreeDecBuffer(&config.output);
+    if(err) return 1;
+    *width = config.input.width;
+    *height = config.input.height;
+    return 0;
+  }
+#endif
+  // written by a build with more codecs
+  return 1;
+}
+
+gboolean dt_mipmap_cache_has_ondisk_thumbnail(const dt_mipmap_cache_t *cache, const uint32_t imgid,
+                                               const dt_mipmap_size_t mip)
+{
+  if(!cache->cachedir[0] || mip >= DT_MIPMAP_F || (int)mip < DT_MIPMAP_0) return FALSE;
+  if(dt_mipmap_pack_contains(cache->pack[mip], imgid)) return TRUE;
+  char filename[PATH_MAX] = { 0 };
+  _ondisk_filename(cache, mip, imgid, filename, sizeof(filename));
+  return g_file_test(filename, G_FILE_TEST_EXISTS);
+}
+
 static void _init_f(dt_mipmap_buffer_t *mipmap_buf, float *buf, uint32_t *width, uint32_t *height, float *iscale,
                     const uint32_t imgid);
 static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, float *iscale,
@@ -367,15 +554,42 @@ void dt_mipmap_cache_allocate_dynamic(void *data, dt_cache_entry_t *entry)
   assert(dsc->size >= sizeof(*dsc));
 
   int loaded_from_disk = 0;
-  if(mip < DT_MIPMAP_F)
+  if(mip < DT_MIPMAP_F && _use_disk_backend(cache, mip))
   {
-    if(cache->cachedir[0] && ((dt_conf_get_bool("cache_disk_backend") && mip < DT_MIPMAP_8)
-                              || (dt_conf_get_bool("cache_disk_backend_full") && mip == DT_MIPMAP_8)))
+    const uint32_t imgid = get_imgid(entry->key);
+    dt_mipmap_pack_t *pack = cache->pack[mip];
+    const uint8_t *packed = NULL;
+    size_t packed_len = 0;
+    int packed_color_space = DT_COLORSPACE_NONE;
+    uint32_t packed_codec = DT_MIPMAP_DISK_CODEC_JPEG;
+    GMappedFile *map = dt_mipmap_pack_get(pack, imgid, &packed, &packed_len, &packed_color_space, &packed_codec);
+    if(map)
+    {
+      // decode straight from the mapping
+      uint32_t width = 0, height = 0;
+      if(_disk_decode(packed_codec, packed, packed_len, cache->max_width[mip], cache->max_height[mip],
+                      entry->data + sizeof(*dsc), &width, &height))
+      {
+        fprintf(stderr, "[mipmap_cache] failed to decompress thumbnail for image %" PRIu32 " from pack!\n", imgid);
+        dt_mipmap_pack_remove(pack, imgid);
+      }
+      else
+      {
+        dt_print(DT_DEBUG_CACHE, "[mipmap_cache] grab mip %d for image %" PRIu32 " from disk pack\n", mip, imgid);
+        dsc->width = width;
+        dsc->height = height;
+        dsc->iscale = 1.0f;
+        dsc->color_space = packed_color_space;
+        loaded_from_disk = 1;
+      }
+      g_mapped_file_unref(map);
+    }
+
+    if(!loaded_from_disk)
     {
       // try and load from disk, if successful set flag
       char filename[PATH_MAX] = {0};
-      snprintf(filename, sizeof(filename), "%s.d/%d/%" PRIu32 ".jpg", cache->cachedir, (int)mip,
-               get_imgid(entry->key));
+      _ondisk_filename(cache, mip, imgid, filename, sizeof(filename));
       FILE *f = g_fopen(filename, "rb");
       if(f)
       {
@@ -396,16 +610,19 @@ void dt_mipmap_cache_allocate_dynamic(void *data, dt_cache_entry_t *entry)
            || dt_imageio_jpeg_decompress(&jpg, entry->data + sizeof(*dsc)))
         {
           fprintf(stderr, "[mipmap_cache] failed to decompress thumbnail for image %" PRIu32 " from `%s'!\n",
-                  get_imgid(entry->key), filename);
+                  imgid, filename);
           goto read_error;
         }
         dt_print(DT_DEBUG_CACHE, "[mipmap_cache] grab mip %d for image %" PRIu32 " from disk cache\n", mip,
-                 get_imgid(entry->key));
+                 imgid);
         dsc->width = jpg.width;
         dsc->height = jpg.height;
         dsc->iscale = 1.0f;
         dsc->color_space = color_space;
         loaded_from_disk = 1;
+        // move it over as it is, encoding it again would only lose quality
+        if(pack && !dt_mipmap_pack_put(pack, imgid, blob, len, color_space, DT_MIPMAP_DISK_CODEC_JPEG))
+          g_unlink(filename);
         if(0)
         {
 read_error:
@@ -429,6 +646,15 @@ read_error:
     entry->cost = entry->data_size;
   else
     entry->cost = cache->buffer_size[mip];
+
+  // let what is expensive to recreate survive more rounds of gc: thumbnails the disk backend can't give back
+  // have to go through the pixelpipe again, full previews and buffers mean decoding the raw.
+  if(mip >= DT_MIPMAP_8)
+    entry->keep = 2;
+  else if(!_use_disk_backend(cache, mip))
+    entry->keep = 1;
+  else
+    entry->keep = 0;
 }
 
 static void dt_mipmap_cache_unlink_ondisk_thumbnail(void *data, uint32_t imgid, dt_mipmap_size_t mip)
@@ -440,16 +666,281 @@ static void dt_mipmap_cache_unlink_ondisk_thumbnail(void *data, uint32_t imgid,
   // if(dt_conf_get_bool("cache_disk_backend"))
   if(cache->cachedir[0])
   {
+    dt_mipmap_pack_remove(cache->pack[mip], imgid);
     char filename[PATH_MAX] = { 0 };
-    snprintf(filename, sizeof(filename), "%s.d/%d/%"PRIu32".jpg", cache->cachedir, (int)mip, imgid);
+    _ondisk_filename(cache, mip, imgid, filename, sizeof(filename));
     g_unlink(filename);
   }
 }
 
+typedef enum dt_mipmap_compressed_codec_t
+{
+  DT_MIPMAP_COMPRESSED_RAW = 0, // single channel uint16, lossless
+  DT_MIPMAP_COMPRESSED_HALF = 1 // floats as half floats
+} dt_mipmap_compressed_codec_t;
+
+typedef struct dt_mipmap_compressed_t
+{
+  uint32_t imgid;
+  dt_mipmap_size_t mip; // DT_MIPMAP_F or DT_MIPMAP_FULL
+  int32_t width, height;
+  float iscale;
+  dt_mipmap_compressed_codec_t codec;
+  size_t samples; // width * height times the channels
+  uint8_t *blob;
+  size_t length;
+} dt_mipmap_compressed_t;
+
+typedef struct dt_mipmap_compress_job_t
+{
+  dt_mipmap_cache_t *cache;
+  uint32_t imgid;
+  dt_mipmap_size_t mip;
+  int32_t width, height;
+  float iscale;
+  void *data; // the evicted entry, the samples follow the dsc
+  // the cache took the entry out of its cost when evicting it, it is counted again until the job frees it
+  dt_cache_t *owner;
+  size_t cost;
+} dt_mipmap_compress_job_t;
+
+static void _compressed_free(gpointer data)
+{
+  dt_mipmap_compressed_t *c = (dt_mipmap_compressed_t *)data;
+  g_free(c->blob);
+  g_free(c);
+}
+
+// under compressed_lock
+static GList *_compressed_find(dt_mipmap_cache_t *cache, const uint32_t imgid, const dt_mipmap_size_t mip)
+{
+  for(GList *l = cache->compressed.head; l; l = g_list_next(l))
+  {
+    const dt_mipmap_compressed_t *c = (dt_mipmap_compressed_t *)l->data;
+    if(c->imgid == imgid && c->mip == mip) return l;
+  }
+  return NULL;
+}
+
+static void _compressed_remove(dt_mipmap_cache_t *cache, const uint32_t imgid, const dt_mipmap_size_t mip)
+{
+  if(!cache->compressed_max) return;
+  dt_pthread_mutex_lock(&cache->compressed_lock);
+  GList *l = _compressed_find(cache, imgid, mip);
+  if(l)
+  {
+    dt_mipmap_compressed_t *c = (dt_mipmap_compressed_t *)l->data;
+    cache->compressed_size -= c->length;
+    g_queue_delete_link(&cache->compressed, l);
+    _compressed_free(c);
+  }
+  dt_pthread_mutex_unlock(&cache->compressed_lock);
+}
+
+// how the float buffer of an image is compressed. raws stay mosaiced there, so they keep the samples and the
+// data type of the full buffer. FALSE if the image cache doesn't hold what the loader found out anymore.
+static gboolean _f_codec(const uint32_t imgid, const int32_t width, const int32_t height,
+                         dt_mipmap_compressed_codec_t *codec, size_t *samples)
+{
+  const dt_image_t *img = dt_image_cache_get(darktable.image_cache, imgid, 'r');
+  if(!img) return FALSE;
+  const gboolean known = img->loader != LOADER_UNKNOWN;
+  const gboolean mosaic = img->buf_dsc.filters != 0;
+  const gboolean uint16 = img->buf_dsc.datatype == TYPE_UINT16;
+  dt_image_cache_read_release(darktable.image_cache, img);
+
+  *codec = mosaic && uint16 ? DT_MIPMAP_COMPRESSED_RAW : DT_MIPMAP_COMPRESSED_HALF;
+  *samples = (size_t)width * height * (mosaic ? 1 : 4);
+  return known;
+}
+
+static inline size_t _compressed_bytes(const dt_mipmap_compressed_t *c)
+{
+  return c->samples * (c->codec == DT_MIPMAP_COMPRESSED_RAW ? sizeof(uint16_t) : sizeof(float));
+}
+
+static int32_t _compress_job_run(dt_job_t *job)
+{
+  dt_mipmap_compress_job_t *params = (dt_mipmap_compress_job_t *)dt_control_job_get_params(job);
+  dt_mipmap_cache_t *cache = params->cache;
+  const double start = dt_get_wtime();
+
+  dt_mipmap_compressed_t *c = g_malloc0(sizeof(dt_mipmap_compressed_t));
+  c->imgid = params->imgid;
+  c->mip = params->mip;
+  c->width = params->width;
+  c->height = params->height;
+  c->iscale = params->iscale;
+  c->codec = DT_MIPMAP_COMPRESSED_RAW;
+  c->samples = (size_t)c->width * c->height;
+  const void *in = (uint8_t *)params->data + sizeof(struct dt_mipmap_buffer_dsc);
+  if(c->mip == DT_MIPMAP_F && !_f_codec(c->imgid, c->width, c->height, &c->codec, &c->samples))
+    c->length = 0;
+  else if(c->codec == DT_MIPMAP_COMPRESSED_RAW)
+    c->length = dt_image_compress_raw((const uint16_t *)in, c->width, c->height, &c->blob);
+  else
+    c->length = dt_image_compress_half((const float *)in, c->samples, &c->blob);
+  const char *name = c->mip == DT_MIPMAP_F ? "float" : "full";
+  if(c->length)
+  {
+    dt_metrics_time(c->mip == DT_MIPMAP_F ? "mipmap_cache.float.compress" : "mipmap_cache.full.compress",
+                    dt_get_wtime() - start);
+    dt_print(DT_DEBUG_CACHE, "[mipmap_cache] compressed %s buffer of image %u to %.1f%%\n", name, c->imgid,
+             100.0 * c->length / _compressed_bytes(c));
+  }
+
+  dt_pthread_mutex_lock(&cache->compressed_lock);
+  if(c->length && c->length <= cache->compressed_max && !_compressed_find(cache, c->imgid, c->mip))
+  {
+    g_queue_push_head(&cache->compressed, c);
+    cache->compressed_size += c->length;
+    c = NULL;
+    while(cache->compressed_size > cache->compressed_max)
+    {
+      dt_mipmap_compressed_t *old = (dt_mipmap_compressed_t *)g_queue_pop_tail(&cache->compressed);
+      cache->compressed_size -= old->length;
+      _compressed_free(old);
+    }
+  }
+  dt_pthread_mutex_unlock(&cache->compressed_lock);
+  if(c) _compressed_free(c);
+  return 0;
+}
+
+static void _compress_job_cleanup(void *p)
+{
+  dt_mipmap_compress_job_t *params = (dt_mipmap_compress_job_t *)p;
+  dt_free_align(params->data);
+  __sync_fetch_and_sub(&params->owner->cost, params->cost);
+  __sync_fetch_and_sub(&params->cache->compressing, 1);
+  free(params);
+}
+
+// hands an evicted full or float buffer to a job compressing it, returns FALSE if it is to be freed right away
+static gboolean _compress_evicted(dt_mipmap_cache_t *cache, dt_cache_entry_t *entry, const dt_mipmap_size_t mip)
+{
+  const struct dt_mipmap_buffer_dsc *dsc = (struct dt_mipmap_buffer_dsc *)entry->data;
+  if(!cache->compressed_max || (void *)dsc == (void *)dt_mipmap_cache_static_dead_image || dsc->width <= 8
+     || dsc->height <= 8
+     || (dsc->flags & (DT_MIPMAP_BUFFER_DSC_FLAG_GENERATE | DT_MIPMAP_BUFFER_DSC_FLAG_INVALIDATE)))
+    return FALSE;
+  // of the full buffers only single channel uint16 raws, floats hardly compress without loss and other files
+  // load fast. the float buffers are only read by the preview pipe, which doesn't tell half floats apart.
+  if(mip == DT_MIPMAP_FULL && dsc->size - sizeof(*dsc) != (size_t)dsc->width * dsc->height * sizeof(uint16_t))
+    return FALSE;
+  if(mip == DT_MIPMAP_F && !cache->compress_f) return FALSE;
+  // compressing would hold on to memory the governor wants back
+  if(cache->pressure) return FALSE;
+  // without workers the job would run right here, and there is no going back to an image anyway
+  if(!dt_control_running()) return FALSE;
+
+  const uint32_t imgid = get_imgid(entry->key);
+  dt_pthread_mutex_lock(&cache->compressed_lock);
+  const gboolean have = _compressed_find(cache, imgid, mip) != NULL;
+  dt_pthread_mutex_unlock(&cache->compressed_lock);
+  if(have) return FALSE;
+  if(__sync_add_and_fetch(&cache->compressing, 1) > DT_MIPMAP_CACHE_MAX_COMPRESSING)
+  {
+    __sync_fetch_and_sub(&cache->compressing, 1);
+    return FALSE;
+  }
+
+  dt_job_t *job = dt_control_job_create(&_compress_job_run, "compress evicted buffer");
+  if(!job)
+  {
+    __sync_fetch_and_sub(&cache->compressing, 1);
+    return FALSE;
+  }
+  dt_mipmap_compress_job_t *params = (dt_mipmap_compress_job_t *)malloc(sizeof(dt_mipmap_compress_job_t));
+  params->cache = cache;
+  params->imgid = imgid;
+  params->mip = mip;
+  params->width = dsc->width;
+  params->height = dsc->height;
+  params->iscale = dsc->iscale;
+  params->data = entry->data;
+  params->owner = mip == DT_MIPMAP_F ? &cache->mip_f.cache : &cache->mip_full.cache;
+  params->cost = entry->cost;
+  __sync_fetch_and_add(&params->owner->cost, params->cost);
+  dt_control_job_set_params(job, params, _compress_job_cleanup);
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_BG, job);
+  return TRUE;
+}
+
+// fills a full buffer from its compressed copy. the image cache has to still hold what the loader found out about
+// the image, which isn't in the database.
+static gboolean _full_from_compressed(dt_mipmap_cache_t *cache, dt_mipmap_buffer_t *buf, const dt_image_t *img)
+{
+  if(!cache->compressed_max || img->loader == LOADER_UNKNOWN || img->buf_dsc.datatype != TYPE_UINT16
+     || img->buf_dsc.channels != 1)
+    return FALSE;
+
+  const double start = dt_get_wtime();
+  gboolean ok = FALSE;
+  dt_pthread_mutex_lock(&cache->compressed_lock);
+  GList *l = _compressed_find(cache, img->id, DT_MIPMAP_FULL);
+  const dt_mipmap_compressed_t *c = l ? (dt_mipmap_compressed_t *)l->data : NULL;
+  if(c && c->width == img->width && c->height == img->height)
+  {
+    g_queue_unlink(&cache->compressed, l);
+    g_queue_push_head_link(&cache->compressed, l);
+    uint16_t *out = (uint16_t *)dt_mipmap_cache_alloc(buf, img);
+    ok = out && !dt_image_uncompress_raw(c->blob, c->length, out, c->width, c->height);
+  }
+  dt_pthread_mutex_unlock(&cache->compressed_lock);
+  if(ok)
+  {
+    dt_metrics_time("mipmap_cache.full.uncompress", dt_get_wtime() - start);
+    dt_print(DT_DEBUG_CACHE, "[mipmap_cache] full buffer of image %u uncompressed instead of loaded\n", img->id);
+  }
+  else if(c)
+    _compressed_remove(cache, img->id, DT_MIPMAP_FULL);
+  return ok;
+}
+
+// fills the float buffer of an image from its compressed copy, straight into the entry the preview pipe reads
+static gboolean _f_from_compressed(dt_mipmap_cache_t *cache, dt_mipmap_buffer_t *buf,
+                                   struct dt_mipmap_buffer_dsc *dsc, const uint32_t imgid)
+{
+  if(!cache->compressed_max || !cache->compress_f) return FALSE;
+
+  const double start = dt_get_wtime();
+  gboolean ok = FALSE;
+  dt_pthread_mutex_lock(&cache->compressed_lock);
+  GList *l = _compressed_find(cache, imgid, DT_MIPMAP_F);
+  const dt_mipmap_compressed_t *c = l ? (dt_mipmap_compressed_t *)l->data : NULL;
+  if(c && _compressed_bytes(c) <= dsc->size - sizeof(*dsc))
+  {
+    g_queue_unlink(&cache->compressed, l);
+    g_queue_push_head_link(&cache->compressed, l);
+    if(c->codec == DT_MIPMAP_COMPRESSED_RAW)
+      ok = !dt_image_uncompress_raw(c->blob, c->length, (uint16_t *)(dsc + 1), c->width, c->height);
+    else
+      ok = !dt_image_uncompress_half(c->blob, c->length, (float *)(dsc + 1), c->samples);
+    if(ok)
+    {
+      dsc->width = c->width;
+      dsc->height = c->height;
+      dsc->iscale = c->iscale;
+      buf->color_space = DT_COLORSPACE_NONE;
+    }
+  }
+  dt_pthread_mutex_unlock(&cache->compressed_lock);
+  if(ok)
+  {
+    dt_metrics_time("mipmap_cache.float.uncompress", dt_get_wtime() - start);
+    dt_print(DT_DEBUG_CACHE, "[mipmap_cache] float buffer of image %u uncompressed instead of downscaled\n", imgid);
+  }
+  else if(c)
+    _compressed_remove(cache, imgid, DT_MIPMAP_F);
+  return ok;
+}
+
 void dt_mipmap_cache_deallocate_dynamic(void *data, dt_cache_entry_t *entry)
 {
   dt_mipmap_cache_t *cache = (dt_mipmap_cache_t *)data;
   const dt_mipmap_size_t mip = get_size(entry->key);
+  if(mip >= DT_MIPMAP_F && _compress_evicted(cache, entry, mip)) return;
   if(mip < DT_MIPMAP_F)
   {
     struct dt_mipmap_buffer_dsc *dsc = (struct dt_mipmap_buffer_dsc *)entry->data;
@@ -460,8 +951,26 @@ void dt_mipmap_cache_deallocate_dynamic(void *data, dt_cache_entry_t *entry)
       {
         dt_mipmap_cache_unlink_ondisk_thumbnail(data, get_imgid(entry->key), mip);
       }
-      else if(cache->cachedir[0] && ((dt_conf_get_bool("cache_disk_backend") && mip < DT_MIPMAP_8)
-                                     || (dt_conf_get_bool("cache_disk_backend_full") && mip == DT_MIPMAP_8)))
+      else if(cache->pack[mip] && _use_disk_backend(cache, mip))
+      {
+        // serialize to the pack, again don't write existing thumbnails
+        const uint32_t imgid = get_imgid(entry->key);
+        char filename[PATH_MAX] = {0};
+        snprintf(filename, sizeof(filename), "%s.d", cache->cachedir);
+        if(!dt_mipmap_pack_contains(cache->pack[mip], imgid) && _ondisk_has_space(filename))
+        {
+          const dt_mipmap_disk_codec_t codec = _disk_codec();
+          uint8_t *blob = NULL;
+          const size_t len = _disk_encode(codec, entry->data + sizeof(*dsc), dsc->width, dsc->height, &blob);
+          if(len && !dt_mipmap_pack_put(cache->pack[mip], imgid, blob, len, dsc->color_space, codec))
+          {
+            _ondisk_filename(cache, mip, imgid, filename, sizeof(filename));
+            g_unlink(filename);
+          }
+          dt_free_align(blob);
+        }
+      }
+      else if(_use_disk_backend(cache, mip))
       {
         // serialize to disk
         char filename[PATH_MAX] = {0};
@@ -469,28 +978,13 @@ void dt_mipmap_cache_deallocate_dynamic(void *data, dt_cache_entry_t *entry)
         const int mkd = g_mkdir_with_parents(filename, 0750);
         if(!mkd)
         {
-          snprintf(filename, sizeof(filename), "%s.d/%d/%" PRIu32 ".jpg", cache->cachedir, (int)mip,
-                   get_imgid(entry->key));
+          _ondisk_filename(cache, mip, get_imgid(entry->key), filename, sizeof(filename));
           // Don't write existing files as both performance and quality (lossy jpg) suffer
           FILE *f = NULL;
           if (!g_file_test(filename, G_FILE_TEST_EXISTS) && (f = g_fopen(filename, "wb")))
           {
             // first check the disk isn't full
-            struct statvfs vfsbuf;
-            if (!statvfs(filename, &vfsbuf))
-            {
-              const int64_t free_mb = ((vfsbuf.f_frsize * vfsbuf.f_bavail) >> 20);
-              if (free_mb < 100)
-              {
-                fprintf(stderr, "Aborting image write as only %" PRId64 " MB free to write %s\n", free_mb, filename);
-                goto write_error;
-              }
-            }
-            else
-            {
-              fprintf(stderr, "Aborting image write since couldn't determine free space available to write %s\n", filename);
-              goto write_error;
-            }
+            if(!_ondisk_has_space(filename)) goto write_error;
 
             const int cache_quality = dt_conf_get_int("database_cache_quality");
             const uint8_t *exif = NULL;
@@ -526,9 +1020,100 @@ static uint32_t nearest_power_of_two(const uint32_t value)
   return rc;
 }
 
+static void _collect_metrics_one(const char *name, dt_mipmap_cache_one_t *one)
+{
+  const struct
+  {
+    const char *what;
+    int64_t value;
+  } stats[] = { { "requests", one->stats_requests }, { "near_match", one->stats_near_match },
+                { "misses", one->stats_misses },     { "fetches", one->stats_fetches },
+                { "standin", one->stats_standin },   { "cost", one->cache.cost },
+                { "cost_quota", one->cache.cost_quota } };
+  char key[64];
+  for(int k = 0; k < sizeof(stats) / sizeof(stats[0]); k++)
+  {
+    snprintf(key, sizeof(key), "mipmap_cache.%s.%s", name, stats[k].what);
+    dt_metrics_set(dt_metrics_get(key, DT_METRIC_GAUGE), stats[k].value);
+  }
+}
+
+// the cache keeps its own stats, they are copied whenever the metrics are read
+static void _collect_metrics(gpointer user_data)
+{
+  dt_mipmap_cache_t *cache = (dt_mipmap_cache_t *)user_data;
+  _collect_metrics_one("thumbs", &cache->mip_thumbs);
+  _collect_metrics_one("float", &cache->mip_f);
+  _collect_metrics_one("full", &cache->mip_full);
+  dt_metrics_set(dt_metrics_get("mipmap_cache.full.compressed_bytes", DT_METRIC_GAUGE), cache->compressed_size);
+  dt_metrics_set(dt_metrics_get("mipmap_cache.full.compressed_entries", DT_METRIC_GAUGE),
+                 cache->compressed.length);
+}
+
+// the full buffers aren't counted, their cost is per buffer. they are in the resident size of the process.
+static size_t _governor_usage(gpointer user_data)
+{
+  dt_mipmap_cache_t *cache = (dt_mipmap_cache_t *)user_data;
+  return cache->mip_thumbs.cache.cost + cache->mip_f.cache.cost * cache->buffer_size[DT_MIPMAP_F]
+         + cache->compressed_size;
+}
+
+// drops what is cheapest to get back first: the compressed copies, the thumbnails, which mostly are on disk, then
+// the float and the full buffers which aren't in use.
+static size_t _governor_shrink(gpointer user_data, const size_t bytes)
+{
+  dt_mipmap_cache_t *cache = (dt_mipmap_cache_t *)user_data;
+  cache->pressure = TRUE;
+  size_t freed = 0;
+
+  dt_pthread_mutex_lock(&cache->compressed_lock);
+  while(freed < bytes && cache->compressed.length)
+  {
+    dt_mipmap_compressed_t *old = (dt_mipmap_compressed_t *)g_queue_pop_tail(&cache->compressed);
+    cache->compressed_size -= old->length;
+    freed += old->length;
+    _compressed_free(old);
+  }
+  dt_pthread_mutex_unlock(&cache->compressed_lock);
+
+  if(freed < bytes)
+  {
+    // the quota stays down, or the cache would grow back with the next thumbnails
+    dt_cache_t *thumbs = &cache->mip_thumbs.cache;
+    const size_t cost = thumbs->cost;
+    thumbs->cost_quota = MAX(cost > bytes - freed ? cost - (bytes - freed) : 0, cache->thumbs_quota / 8);
+    dt_cache_gc(thumbs, 1.0f);
+    freed += cost - MIN(cost, thumbs->cost);
+  }
+  if(freed < bytes)
+  {
+    const size_t count = cache->mip_f.cache.cost;
+    dt_cache_gc(&cache->mip_f.cache, 0.0f);
+    freed += (count - MIN(count, cache->mip_f.cache.cost)) * cache->buffer_size[DT_MIPMAP_F];
+  }
+  if(freed < bytes) dt_cache_gc(&cache->mip_full.cache, 0.0f);
+  return freed;
+}
+
+static void _governor_relax(gpointer user_data)
+{
+  dt_mipmap_cache_t *cache = (dt_mipmap_cache_t *)user_data;
+  cache->mip_thumbs.cache.cost_quota = cache->thumbs_quota;
+  cache->pressure = FALSE;
+}
+
+static int32_t _compact_packs_job_run(dt_job_t *job)
+{
+  dt_mipmap_cache_t *cache = (dt_mipmap_cache_t *)dt_control_job_get_params(job);
+  for(dt_mipmap_size_t k = DT_MIPMAP_0; k < DT_MIPMAP_F; k++) dt_mipmap_pack_compact(cache->pack[k]);
+  return 0;
+}
+
 void dt_mipmap_cache_init(dt_mipmap_cache_t *cache)
 {
   dt_mipmap_cache_get_filename(cache->cachedir, sizeof(cache->cachedir));
+  cache->disk_backend = dt_conf_value("cache_disk_backend");
+  cache->disk_backend_full = dt_conf_value("cache_disk_backend_full");
   // make sure static memory is initialized
   struct dt_mipmap_buffer_dsc *dsc = (struct dt_mipmap_buffer_dsc *)dt_mipmap_cache_static_dead_image;
   dead_image_f((dt_mipmap_buffer_t *)(dsc + 1));
@@ -537,7 +1122,7 @@ void dt_mipmap_cache_init(dt_mipmap_cache_t *cache)
   // we want at least 100MB, and consider 8G just still reasonable.
   const int64_t cache_memory = dt_conf_get_int64("cache_memory");
   const int worker_threads = dt_conf_get_int("worker_threads");
-  const size_t max_mem = CLAMPS(cache_memory, 100u << 20, ((size_t)8) << 30);
+  const size_t max_mem = dt_memory_governor_limit("mipmap", CLAMPS(cache_memory, 100u << 20, ((size_t)8) << 30));
   const uint32_t parallel = CLAMP(worker_threads, 1, 8);
 
   // Fixed sizes for the thumbnail mip levels, selected for coverage of most screen sizes
@@ -604,13 +1189,75 @@ void dt_mipmap_cache_init(dt_mipmap_cache_t *cache)
   cache->buffer_size[DT_MIPMAP_F] = sizeof(struct dt_mipmap_buffer_dsc)
                                         + 4 * sizeof(float) * cache->max_width[DT_MIPMAP_F]
                                           * cache->max_height[DT_MIPMAP_F];
+
+  // one pack per size instead of a file per thumbnail, see mipmap_pack.h
+  gboolean compact = FALSE;
+  for(dt_mipmap_size_t k = DT_MIPMAP_0; k < DT_MIPMAP_F; k++)
+  {
+    cache->pack[k] = NULL;
+    if(!dt_conf_get_bool("cache_disk_backend_packed") || !_use_disk_backend(cache, k)) continue;
+    char path[PATH_MAX] = { 0 };
+    snprintf(path, sizeof(path), "%s.d/%d", cache->cachedir, (int)k);
+    cache->pack[k] = dt_mipmap_pack_open(path);
+    compact |= dt_mipmap_pack_needs_compaction(cache->pack[k]);
+  }
+  // without workers the job would run right here and hold up the start
+  if(compact && dt_control_running())
+  {
+    dt_job_t *job = dt_control_job_create(&_compact_packs_job_run, "compact thumbnail packs");
+    if(job)
+    {
+      dt_control_job_set_params(job, cache, NULL);
+      dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_BG, job);
+    }
+  }
+
+  cache->derive_smaller = dt_conf_get_bool("cache_derive_smaller_thumbnails");
+
+  cache->content = NULL;
+  if(dt_conf_get_bool("cache_share_identical_thumbnails"))
+  {
+    dt_pthread_mutex_init(&cache->content_lock, NULL);
+    cache->content = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  }
+
+  dt_pthread_mutex_init(&cache->compressed_lock, NULL);
+  g_queue_init(&cache->compressed);
+  cache->compressed_size = 0;
+  cache->compressed_max
+      = dt_memory_governor_limit("mipmap", MAX(dt_conf_get_int64("cache_compressed_full_memory"), 0));
+  cache->compress_f = dt_conf_get_bool("cache_compressed_float_preview");
+  cache->compressing = 0;
+
+  dt_metrics_add_collector(_collect_metrics, cache);
+
+  cache->thumbs_quota = cache->mip_thumbs.cache.cost_quota;
+  cache->pressure = FALSE;
+  dt_memory_governor_register("mipmap", _governor_usage, _governor_shrink, _governor_relax, cache);
 }
 
 void dt_mipmap_cache_cleanup(dt_mipmap_cache_t *cache)
 {
+  dt_memory_governor_unregister(cache);
   dt_cache_cleanup(&cache->mip_thumbs.cache);
   dt_cache_cleanup(&cache->mip_full.cache);
   dt_cache_cleanup(&cache->mip_f.cache);
+  dt_mipmap_compressed_t *c;
+  while((c = (dt_mipmap_compressed_t *)g_queue_pop_head(&cache->compressed))) _compressed_free(c);
+  cache->compressed_size = 0;
+  dt_pthread_mutex_destroy(&cache->compressed_lock);
+  // after the caches, these write their thumbnails there
+  for(dt_mipmap_size_t k = DT_MIPMAP_0; k < DT_MIPMAP_F; k++)
+  {
+    dt_mipmap_pack_close(cache->pack[k]);
+    cache->pack[k] = NULL;
+  }
+  if(cache->content)
+  {
+    g_hash_table_destroy(cache->content);
+    cache->content = NULL;
+    dt_pthread_mutex_destroy(&cache->content_lock);
+  }
 }
 
 void dt_mipmap_cache_print(dt_mipmap_cache_t *cache)
@@ -679,6 +1326,45 @@ static dt_mipmap_cache_one_t *_get_cache(dt_mipmap_cache_t *cache, const dt_mipm
   }
 }
 
+// fills the smaller thumbnails of an image which aren't there yet from one just generated, each one from the
+// next larger, so a size asked for later doesn't need another run of the pixelpipe
+static void _derive_smaller(dt_mipmap_cache_t *cache, const uint32_t imgid, const dt_mipmap_size_t mip,
+                            const struct dt_mipmap_buffer_dsc *src_dsc)
+{
+  dt_cache_t *thumbs = &cache->mip_thumbs.cache;
+  const struct dt_mipmap_buffer_dsc *src = src_dsc;
+  dt_cache_entry_t *src_entry = NULL; // the derived one used as source, locked here
+  for(int k = (int)mip - 1; k >= DT_MIPMAP_0; k--)
+  {
+    if(dt_cache_contains(thumbs, get_key(imgid, k)) || dt_mipmap_cache_has_ondisk_thumbnail(cache, imgid, k))
+      continue;
+
+    dt_cache_entry_t *entry = dt_cache_get(thumbs, get_key(imgid, k), 'w');
+    struct dt_mipmap_buffer_dsc *dsc = (struct dt_mipmap_buffer_dsc *)entry->data;
+    if(!(dsc->flags & DT_MIPMAP_BUFFER_DSC_FLAG_GENERATE))
+    {
+      // someone else was quicker
+      dt_cache_release(thumbs, entry);
+      continue;
+    }
+
+    ASAN_UNPOISON_MEMORY_REGION(dsc + 1, dsc->size - sizeof(struct dt_mipmap_buffer_dsc));
+    dt_iop_flip_and_zoom_8((const uint8_t *)(src + 1), src->width, src->height, (uint8_t *)(dsc + 1),
+                           cache->max_width[k], cache->max_height[k], ORIENTATION_NONE, &dsc->width,
+                           &dsc->height);
+    dsc->iscale = 1.0f;
+    dsc->color_space = src->color_space;
+    dsc->flags &= ~DT_MIPMAP_BUFFER_DSC_FLAG_GENERATE;
+    dt_print(DT_DEBUG_CACHE, "[mipmap_cache] derive mip %d for image %" PRIu32 " from level %d\n", k, imgid,
+             (int)mip);
+
+    if(src_entry) dt_cache_release(thumbs, src_entry);
+    src_entry = entry;
+    src = dsc;
+  }
+  if(src_entry) dt_cache_release(thumbs, src_entry);
+}
+
 void dt_mipmap_cache_get_with_caller(
     dt_mipmap_cache_t *cache,
     dt_mipmap_buffer_t *buf,
@@ -735,10 +1421,8 @@ void dt_mipmap_cache_get_with_caller(
     if(!cache->cachedir[0]) return;
     if(mip > DT_MIPMAP_FULL || (int)mip < DT_MIPMAP_0)
       return; // remove the (int) once we no longer have to support gcc < 4.8 :/
-    char filename[PATH_MAX] = {0};
-    snprintf(filename, sizeof(filename), "%s.d/%d/%"PRIu32".jpg", cache->cachedir, (int)mip, key);
     // don't attempt to load if disk cache doesn't exist
-    if(!g_file_test(filename, G_FILE_TEST_EXISTS)) return;
+    if(!dt_mipmap_cache_has_ondisk_thumbnail(cache, imgid, mip)) return;
     dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_FG, dt_image_load_job_create(imgid, mip));
   }
   else if(flags == DT_MIPMAP_BLOCKING)
@@ -781,7 +1465,11 @@ void dt_mipmap_cache_get_with_caller(
         buf->width = buf->height = 0;
         buf->iscale = 0.0f;
         buf->color_space = DT_COLORSPACE_NONE; // TODO: does the full buffer need to know this?
-        dt_imageio_retval_t ret = dt_imageio_open(&buffered_image, filename, buf); // TODO: color_space?
+        const gboolean uncompressed = _full_from_compressed(cache, buf, &buffered_image);
+        const double load_start = dt_get_wtime();
+        dt_imageio_retval_t ret
+            = uncompressed ? DT_IMAGEIO_OK : dt_imageio_open(&buffered_image, filename, buf); // TODO: color_space?
+        if(!uncompressed) dt_metrics_time("mipmap_cache.full.load", dt_get_wtime() - load_start);
         // might have been reallocated:
         ASAN_UNPOISON_MEMORY_REGION(entry->data, dt_mipmap_buffer_dsc_size);
         dsc = (struct dt_mipmap_buffer_dsc *)buf->cache_entry->data;
@@ -799,7 +1487,7 @@ void dt_mipmap_cache_get_with_caller(
             dsc->color_space = DT_COLORSPACE_NONE;
           }
         }
-        else
+        else if(!uncompressed)
         {
           // swap back new image data:
           dt_image_t *img = dt_image_cache_get(darktable.image_cache, imgid, 'w');
@@ -813,13 +1501,20 @@ void dt_mipmap_cache_get_with_caller(
       else if(mip == DT_MIPMAP_F)
       {
         ASAN_UNPOISON_MEMORY_REGION(dsc + 1, dsc->size - sizeof(struct dt_mipmap_buffer_dsc));
-        _init_f(buf, (float *)(dsc + 1), &dsc->width, &dsc->height, &dsc->iscale, imgid);
+        if(!_f_from_compressed(cache, buf, dsc, imgid))
+        {
+          const double load_start = dt_get_wtime();
+          _init_f(buf, (float *)(dsc + 1), &dsc->width, &dsc->height, &dsc->iscale, imgid);
+          dt_metrics_time("mipmap_cache.float.load", dt_get_wtime() - load_start);
+        }
       }
       else
       {
         // 8-bit thumbs
         ASAN_UNPOISON_MEMORY_REGION(dsc + 1, dsc->size - sizeof(struct dt_mipmap_buffer_dsc));
+        const double load_start = dt_get_wtime();
         _init_8((uint8_t *)(dsc + 1), &dsc->width, &dsc->height, &dsc->iscale, &buf->color_space, imgid, mip);
+        dt_metrics_time("mipmap_cache.thumbnail.load", dt_get_wtime() - load_start);
       }
       dsc->color_space = buf->color_space;
       dsc->flags &= ~DT_MIPMAP_BUFFER_DSC_FLAG_GENERATE;
@@ -854,10 +1549,17 @@ void dt_mipmap_cache_get_with_caller(
     }
 #endif
 
+    // only from a read lock, a writer may still change the buffer
+    if(mipmap_generated && mode == 'r' && cache->derive_smaller && mip > DT_MIPMAP_0 && mip <= DT_MIPMAP_8
+       && dsc->width > 0 && dsc->height > 0)
+      _derive_smaller(cache, imgid, mip, dsc);
+
     if(mipmap_generated)
     {
       /* raise signal that mipmaps has been flushed to cache */
       g_idle_add(_raise_signal_mipmap_updated, GINT_TO_POINTER(imgid));
+      // the float and full buffers are the large ones
+      if(mip >= DT_MIPMAP_F) dt_memory_governor_check();
     }
 
     buf->width = dsc->width;
@@ -918,13 +1620,8 @@ void dt_mipmap_cache_get_with_caller(
     __sync_fetch_and_add(&(_get_cache(cache, mip)->stats_misses), 1);
     // in case we don't even have a disk cache for our requested thumbnail,
     // prefetch at least mip0, in case we have that in the disk caches:
-    if(cache->cachedir[0])
-    {
-      char filename[PATH_MAX] = {0};
-      snprintf(filename, sizeof(filename), "%s.d/%d/%"PRIu32".jpg", cache->cachedir, (int)mip, key);
-      if(g_file_test(filename, G_FILE_TEST_EXISTS))
-        dt_mipmap_cache_get(cache, 0, imgid, DT_MIPMAP_0, DT_MIPMAP_PREFETCH_DISK, 0);
-    }
+    if(dt_mipmap_cache_has_ondisk_thumbnail(cache, imgid, mip))
+      dt_mipmap_cache_get(cache, 0, imgid, DT_MIPMAP_0, DT_MIPMAP_PREFETCH_DISK, 0);
     // nothing found :(
     buf->buf = NULL;
     buf->imgid = 0;
@@ -1007,6 +1704,8 @@ void dt_mipmap_cache_evict_at_size(dt_mipmap_cache_t *cache, const uint32_t imgi
   const uint32_t key = get_key(imgid, mip);
   // write thumbnail to disc if not existing there
   dt_cache_remove(&_get_cache(cache, mip)->cache, key);
+  // a full or float buffer is evicted when it is outdated, so its compressed copy is as well
+  if(mip >= DT_MIPMAP_F) _compressed_remove(cache, imgid, mip);
 }
 
 void dt_mimap_cache_evict(dt_mipmap_cache_t *cache, const uint32_t imgid)
@@ -1143,6 +1842,159 @@ static int _write_image(dt_imageio_module_data_t *data, const char *filename, co
   return 0;
 }
 
+// what a thumbnail is rendered from: the source file, which duplicates share, and the part of the history and
+// its drawn masks which is applied. NULL if the image isn't known.
+static gchar *_content_key(const uint32_t imgid, const dt_mipmap_size_t size)
+{
+  sqlite3_stmt *stmt;
+  GChecksum *checksum = g_checksum_new(G_CHECKSUM_MD5);
+  gboolean found = FALSE;
+
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT film_id, filename, history_end FROM main.images WHERE id = ?1",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+  int history_end = 0;
+  if(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    const int film_id = sqlite3_column_int(stmt, 0);
+    const char *filename = (const char *)sqlite3_column_text(stmt, 1);
+    history_end = sqlite3_column_int(stmt, 2);
+    g_checksum_update(checksum, (const guchar *)&film_id, sizeof(film_id));
+    if(filename) g_checksum_update(checksum, (const guchar *)filename, -1);
+    g_checksum_update(checksum, (const guchar *)&history_end, sizeof(history_end));
+    found = TRUE;
+  }
+  sqlite3_finalize(stmt);
+
+  if(!found)
+  {
+    g_checksum_free(checksum);
+    return NULL;
+  }
+
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT operation, op_params, blendop_params, multi_priority"
+                              " FROM main.history"
+                              " WHERE imgid = ?1 AND enabled = 1 AND num < ?2"
+                              " ORDER BY num",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, history_end);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    const char *op = (const char *)sqlite3_column_text(stmt, 0);
+    if(op) g_checksum_update(checksum, (const guchar *)op, -1);
+    for(int k = 1; k <= 2; k++)
+    {
+      const guchar *blob = sqlite3_column_blob(stmt, k);
+      if(blob) g_checksum_update(checksum, blob, sqlite3_column_bytes(stmt, k));
+    }
+    const int multi_priority = sqlite3_column_int(stmt, 3);
+    g_checksum_update(checksum, (const guchar *)&multi_priority, sizeof(multi_priority));
+  }
+  sqlite3_finalize(stmt);
+
+  // the drawn masks of the history items, all of them up to history_end. a mask of an item which is not used
+  // any more only keeps two images from sharing their mips
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT num, formid, form, name, version, points, points_count, source"
+                              " FROM main.masks_history"
+                              " WHERE imgid = ?1 AND num < ?2"
+                              " ORDER BY num, formid",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, history_end);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    const int ids[] = { sqlite3_column_int(stmt, 0), sqlite3_column_int(stmt, 1), sqlite3_column_int(stmt, 2),
+                        sqlite3_column_int(stmt, 4), sqlite3_column_int(stmt, 6) };
+    g_checksum_update(checksum, (const guchar *)ids, sizeof(ids));
+    const char *name = (const char *)sqlite3_column_text(stmt, 3);
+    if(name) g_checksum_update(checksum, (const guchar *)name, -1);
+    for(int k = 5; k <= 7; k += 2)
+    {
+      const guchar *blob = sqlite3_column_blob(stmt, k);
+      if(blob) g_checksum_update(checksum, blob, sqlite3_column_bytes(stmt, k));
+    }
+  }
+  sqlite3_finalize(stmt);
+
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT version, iop_list FROM main.module_order WHERE imgid = ?1", -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+  if(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    const int version = sqlite3_column_int(stmt, 0);
+    const char *iop_list = (const char *)sqlite3_column_text(stmt, 1);
+    g_checksum_update(checksum, (const guchar *)&version, sizeof(version));
+    if(iop_list) g_checksum_update(checksum, (const guchar *)iop_list, -1);
+  }
+  sqlite3_finalize(stmt);
+
+  gchar *key = g_strdup_printf("%d:%s", (int)size, g_checksum_get_string(checksum));
+  g_checksum_free(checksum);
+  return key;
+}
+
+// copies the thumbnail of another image rendered from the same file and history, from memory or from the
+// disk backend. returns non-zero if there is none.
+static int _init_8_from_identical(const char *key, uint8_t *buf, uint32_t *width, uint32_t *height,
+                                  dt_colorspaces_color_profile_type_t *color_space, const uint32_t imgid,
+                                  const dt_mipmap_size_t size)
+{
+  dt_mipmap_cache_t *cache = darktable.mipmap_cache;
+  dt_pthread_mutex_lock(&cache->content_lock);
+  const uint32_t other = GPOINTER_TO_UINT(g_hash_table_lookup(cache->content, key));
+  dt_pthread_mutex_unlock(&cache->content_lock);
+  if(!other || other == imgid) return 1;
+
+  // the other image may have been edited since
+  gchar *other_key = _content_key(other, size);
+  const gboolean same = other_key && !strcmp(key, other_key);
+  g_free(other_key);
+  if(!same) return 1;
+
+  dt_mipmap_buffer_t tmp;
+  dt_mipmap_cache_get(cache, &tmp, other, size, DT_MIPMAP_TESTLOCK, 'r');
+  if(tmp.buf)
+  {
+    const gboolean fits = tmp.width <= *width && tmp.height <= *height;
+    if(fits)
+    {
+      memcpy(buf, tmp.buf, (size_t)tmp.width * tmp.height * 4);
+      *width = tmp.width;
+      *height = tmp.height;
+      *color_space = tmp.color_space;
+    }
+    dt_mipmap_cache_release(cache, &tmp);
+    if(fits)
+    {
+      dt_print(DT_DEBUG_CACHE, "[mipmap_cache] share mip %d of image %d with image %d\n", size, other, imgid);
+      return 0;
+    }
+  }
+
+  if(size >= DT_MIPMAP_F || !cache->pack[size]) return 1;
+  const uint8_t *blob = NULL;
+  size_t len = 0;
+  int packed_color_space = DT_COLORSPACE_NONE;
+  uint32_t codec = DT_MIPMAP_DISK_CODEC_JPEG;
+  GMappedFile *map = dt_mipmap_pack_get(cache->pack[size], other, &blob, &len, &packed_color_space, &codec);
+  if(!map) return 1;
+  uint32_t wd = 0, ht = 0;
+  const int res = _disk_decode(codec, blob, len, *width, *height, buf, &wd, &ht);
+  g_mapped_file_unref(map);
+  if(res) return 1;
+
+  dt_print(DT_DEBUG_CACHE, "[mipmap_cache] share mip %d of image %d from disk with image %d\n", size, other,
+           imgid);
+  *width = wd;
+  *height = ht;
+  *color_space = packed_color_space;
+  return 0;
+}
+
 static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, float *iscale,
                     dt_colorspaces_color_profile_type_t *color_space, const uint32_t imgid,
                     const dt_mipmap_size_t size)
@@ -1247,10 +2099,16 @@ static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, float *isca
     }
   }
 
+  // the same file with the same history has been rendered for another image, a duplicate or one which got
+  // the same style
+  gchar *content_key = darktable.mipmap_cache->content ? _content_key(imgid, size) : NULL;
+  if(res && content_key)
+    res = _init_8_from_identical(content_key, buf, width, height, color_space, imgid, size);
+
   if(res)
   {
     // try the real thing: rawspeed + pixelpipe
-    dt_imageio_module_format_t format;
+    dt_imageio_module_format_t format = { 0 };
     _dummy_data_t dat;
     format.bpp = _bpp;
     format.write_image = _write_image;
@@ -1271,8 +2129,16 @@ static void _init_8(uint8_t *buf, uint32_t *width, uint32_t *height, float *isca
       *height = dat.head.height;
       *iscale = 1.0f;
       *color_space = dt_mipmap_cache_get_colorspace();
+
+      if(content_key)
+      {
+        dt_pthread_mutex_lock(&darktable.mipmap_cache->content_lock);
+        g_hash_table_replace(darktable.mipmap_cache->content, g_strdup(content_key), GUINT_TO_POINTER(imgid));
+        dt_pthread_mutex_unlock(&darktable.mipmap_cache->content_lock);
+      }
     }
   }
+  g_free(content_key);
 
   // fprintf(stderr, "[mipmap init 8] export image %u finished (sizes %d %d => %d %d)!\n", imgid, wd, ht,
   // dat.head.width, dat.head.height);
@@ -1302,15 +2168,27 @@ dt_colorspaces_color_profile_type_t dt_mipmap_cache_get_colorspace()
 
 void dt_mipmap_cache_copy_thumbnails(const dt_mipmap_cache_t *cache, const uint32_t dst_imgid, const uint32_t src_imgid)
 {
-  if(cache->cachedir[0] && dt_conf_get_bool("cache_disk_backend"))
+  if(cache->cachedir[0] && dt_conf_value_bool(cache->disk_backend))
   {
     for(dt_mipmap_size_t mip = DT_MIPMAP_0; mip < DT_MIPMAP_F; mip++)
     {
+      const uint8_t *blob = NULL;
+      size_t len = 0;
+      int color_space = DT_COLORSPACE_NONE;
+      uint32_t codec = DT_MIPMAP_DISK_CODEC_JPEG;
+      GMappedFile *map = dt_mipmap_pack_get(cache->pack[mip], src_imgid, &blob, &len, &color_space, &codec);
+      if(map)
+      {
+        dt_mipmap_pack_put(cache->pack[mip], dst_imgid, blob, len, color_space, codec);
+        g_mapped_file_unref(map);
+        continue;
+      }
+
       // try and load from disk, if successful set flag
       char srcpath[PATH_MAX] = {0};
       char dstpath[PATH_MAX] = {0};
-      snprintf(srcpath, sizeof(srcpath), "%s.d/%d/%"PRIu32".jpg", cache->cachedir, (int)mip, src_imgid);
-      snprintf(dstpath, sizeof(dstpath), "%s.d/%d/%"PRIu32".jpg", cache->cachedir, (int)mip, dst_imgid);
+      _ondisk_filename(cache, mip, src_imgid, srcpath, sizeof(srcpath));
+      _ondisk_filename(cache, mip, dst_imgid, dstpath, sizeof(dstpath));
       GFile *src = g_file_new_for_path(srcpath);
       GFile *dst = g_file_new_for_path(dstpath);
       GError *gerror = NULL;
@@ -99,6 +99,28 @@ typedef struct dt_mipmap_cache_t
   dt_mipmap_cache_one_t mip_f;
   dt_mipmap_cache_one_t mip_full;
   char cachedir[PATH_MAX]; // cached sha1sum filename for faster access
+  // packed disk backend of each thumbnail size, NULL if thumbnails go to one file each
+  struct dt_mipmap_pack_t *pack[DT_MIPMAP_F];
+  // generating a thumbnail fills the missing smaller ones too
+  gboolean derive_smaller;
+  // thumbnails rendered in this run by what went into them, so images with the same source and history can
+  // share them: "<mip>:<md5 of file and history>" -> imgid. NULL if sharing is off.
+  dt_pthread_mutex_t content_lock;
+  GHashTable *content;
+  // evicted full raw buffers, losslessly compressed so going back to an image skips the raw decode, and with
+  // compress_f the float buffers of the preview pipe as well. most recent first, at most compressed_max bytes of
+  // them. compressing counts the buffers still handed to jobs.
+  dt_pthread_mutex_t compressed_lock;
+  GQueue compressed;
+  size_t compressed_size, compressed_max;
+  gboolean compress_f;
+  // the quota of the thumbnail cache as configured. the memory governor lowers it under pressure, no evicted
+  // buffers are compressed then.
+  size_t thumbs_quota;
+  gboolean pressure;
+  int compressing;
+  // cache_disk_backend and cache_disk_backend_full, checked for every buffer
+  const struct dt_conf_value_t *disk_backend, *disk_backend_full;
 } dt_mipmap_cache_t;
 
 // dynamic memory allocation interface for imageio backend: a write locked
@@ -160,6 +182,10 @@ dt_mipmap_size_t dt_mipmap_cache_get_matching_size(
 // returns the colorspace to use for created thumbnails, takes config into account
 dt_colorspaces_color_profile_type_t dt_mipmap_cache_get_colorspace();
 
+// true if the disk backend has a thumbnail of the image at that size
+gboolean dt_mipmap_cache_has_ondisk_thumbnail(const dt_mipmap_cache_t *cache, const uint32_t imgid,
+                                               const dt_mipmap_size_t mip);
+
 // copy over thumbnails. used by file operation that copies raw files, to speed up thumbnail generation.
 // only copies over the jpg backend on disk, doesn't directly affect the in-memory cache.
 void dt_mipmap_cache_copy_thumbnails(const dt_mipmap_cache_t *cache, const uint32_t dst_imgid, const uint32_t src_imgid);
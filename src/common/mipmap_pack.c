@@ -0,0 +1,425 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/mipmap_pack.h"
+#include "common/darktable.h"
+
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+
+#define DT_MIPMAP_PACK_DATA_MAGIC 0x444d5044 // "DPMD"
+#define DT_MIPMAP_PACK_INDEX_MAGIC 0x494d5044 // "DPMI"
+#define DT_MIPMAP_PACK_RECORD_MAGIC 0x524d5044 // "DPMR"
+#define DT_MIPMAP_PACK_VERSION 2
+
+// don't bother rewriting less than this
+#define DT_MIPMAP_PACK_MIN_WASTE (64 << 20)
+
+typedef struct dt_mipmap_pack_header_t
+{
+  uint32_t magic;
+  uint32_t version;
+} dt_mipmap_pack_header_t;
+
+// in front of every thumbnail in the data file, records are padded to 8 bytes
+typedef struct dt_mipmap_pack_record_t
+{
+  uint32_t magic;
+  uint32_t imgid;
+  uint32_t length;
+  int32_t color_space;
+  uint32_t format;
+  uint32_t reserved;
+} dt_mipmap_pack_record_t;
+
+// the index file is a log of these, the last one of an image wins and length 0 means removed
+typedef struct dt_mipmap_pack_index_t
+{
+  uint32_t imgid;
+  uint32_t length;
+  uint64_t offset; // of the record in the data file
+  int32_t color_space;
+  uint32_t format;
+} dt_mipmap_pack_index_t;
+
+struct dt_mipmap_pack_t
+{
+  dt_pthread_mutex_t lock;
+  char *data_path, *index_path;
+  FILE *data, *index; // opened for appending, NULL once writing failed
+  uint64_t data_size;
+  uint64_t live_size;  // bytes of the records still in the index
+  GMappedFile *map;    // of the data file, remapped when a record lies beyond it
+  GHashTable *entries; // imgid -> dt_mipmap_pack_index_t
+  gboolean compacting;
+};
+
+static inline size_t _record_size(const size_t length)
+{
+  return (sizeof(dt_mipmap_pack_record_t) + length + 7) & ~(size_t)7;
+}
+
+// opens the file for appending, starting over if it doesn't have the expected header
+static FILE *_open_file(const char *filename, const uint32_t magic, uint64_t *size)
+{
+  GStatBuf st;
+  if(!g_stat(filename, &st) && st.st_size >= sizeof(dt_mipmap_pack_header_t))
+  {
+    FILE *f = g_fopen(filename, "a+b");
+    if(f)
+    {
+      dt_mipmap_pack_header_t header = { 0 };
+      fseek(f, 0, SEEK_SET);
+      if(fread(&header, sizeof(header), 1, f) == 1 && header.magic == magic
+         && header.version == DT_MIPMAP_PACK_VERSION)
+      {
+        *size = st.st_size;
+        return f;
+      }
+      fclose(f);
+    }
+  }
+
+  FILE *f = g_fopen(filename, "w+b");
+  if(!f) return NULL;
+  const dt_mipmap_pack_header_t header = { magic, DT_MIPMAP_PACK_VERSION };
+  if(fwrite(&header, sizeof(header), 1, f) != 1 || fflush(f))
+  {
+    fclose(f);
+    return NULL;
+  }
+  *size = sizeof(header);
+  return f;
+}
+
+static void _set_entry(dt_mipmap_pack_t *pack, const dt_mipmap_pack_index_t *entry)
+{
+  const dt_mipmap_pack_index_t *old = g_hash_table_lookup(pack->entries, GUINT_TO_POINTER(entry->imgid));
+  if(old) pack->live_size -= _record_size(old->length);
+
+  if(entry->length)
+  {
+    g_hash_table_insert(pack->entries, GUINT_TO_POINTER(entry->imgid), g_memdup(entry, sizeof(*entry)));
+    pack->live_size += _record_size(entry->length);
+  }
+  else if(old)
+    g_hash_table_remove(pack->entries, GUINT_TO_POINTER(entry->imgid));
+}
+
+// appends to the index log, the caller holds the lock
+static void _log_entry(dt_mipmap_pack_t *pack, const dt_mipmap_pack_index_t *entry)
+{
+  if(!pack->index) return;
+  if(fwrite(entry, sizeof(*entry), 1, pack->index) != 1)
+  {
+    fprintf(stderr, "[mipmap_pack] can't write `%s', not storing any more thumbnails there\n", pack->index_path);
+    fclose(pack->index);
+    pack->index = NULL;
+  }
+}
+
+// appends a record to f
+static int _write_record(FILE *f, const uint32_t imgid, const uint8_t *blob, const size_t length,
+                         const int color_space, const uint32_t format)
+{
+  static const uint8_t padding[8] = { 0 };
+  const dt_mipmap_pack_record_t record = { DT_MIPMAP_PACK_RECORD_MAGIC, imgid, length, color_space, format, 0 };
+  const size_t pad = _record_size(length) - sizeof(record) - length;
+  return fwrite(&record, sizeof(record), 1, f) != 1 || fwrite(blob, 1, length, f) != length
+         || (pad && fwrite(padding, 1, pad, f) != pad);
+}
+
+// makes sure the mapping covers the record of entry and returns it, the caller holds the lock
+static const dt_mipmap_pack_record_t *_map_record(dt_mipmap_pack_t *pack, const dt_mipmap_pack_index_t *entry)
+{
+  const uint64_t end = entry->offset + _record_size(entry->length);
+  if(end > pack->data_size) return NULL;
+  if(!pack->map || g_mapped_file_get_length(pack->map) < end)
+  {
+    if(pack->data) fflush(pack->data);
+    if(pack->map) g_mapped_file_unref(pack->map);
+    pack->map = g_mapped_file_new(pack->data_path, FALSE, NULL);
+    if(!pack->map || g_mapped_file_get_length(pack->map) < end) return NULL;
+  }
+
+  const dt_mipmap_pack_record_t *record
+      = (const dt_mipmap_pack_record_t *)(g_mapped_file_get_contents(pack->map) + entry->offset);
+  if(record->magic != DT_MIPMAP_PACK_RECORD_MAGIC || record->imgid != entry->imgid
+     || record->length != entry->length)
+    return NULL;
+  return record;
+}
+
+dt_mipmap_pack_t *dt_mipmap_pack_open(const char *path)
+{
+  gchar *dirname = g_path_get_dirname(path);
+  const int mkd = g_mkdir_with_parents(dirname, 0750);
+  g_free(dirname);
+  if(mkd) return NULL;
+
+  dt_mipmap_pack_t *pack = g_malloc0(sizeof(dt_mipmap_pack_t));
+  pack->data_path = g_strdup_printf("%s.pack", path);
+  pack->index_path = g_strdup_printf("%s.idx", path);
+  pack->entries = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+  dt_pthread_mutex_init(&pack->lock, NULL);
+
+  uint64_t index_size = 0;
+  pack->data = _open_file(pack->data_path, DT_MIPMAP_PACK_DATA_MAGIC, &pack->data_size);
+  // without the records the index is useless, and the other way round
+  if(pack->data && pack->data_size == sizeof(dt_mipmap_pack_header_t)) g_unlink(pack->index_path);
+  pack->index = pack->data ? _open_file(pack->index_path, DT_MIPMAP_PACK_INDEX_MAGIC, &index_size) : NULL;
+  if(!pack->data || !pack->index)
+  {
+    fprintf(stderr, "[mipmap_pack] can't open `%s'\n", pack->data_path);
+    dt_mipmap_pack_close(pack);
+    return NULL;
+  }
+
+  // replay the log. entries pointing past the data file are from a crash before it was flushed
+  fseek(pack->index, sizeof(dt_mipmap_pack_header_t), SEEK_SET);
+  dt_mipmap_pack_index_t entry;
+  while(fread(&entry, sizeof(entry), 1, pack->index) == 1)
+  {
+    if(entry.imgid == 0 || (entry.length && entry.offset + _record_size(entry.length) > pack->data_size))
+      continue;
+    _set_entry(pack, &entry);
+  }
+
+  dt_print(DT_DEBUG_CACHE, "[mipmap_pack] %u thumbnails in `%s', %.1f of %.1f MB used\n",
+           g_hash_table_size(pack->entries), pack->data_path, pack->live_size / (1024.0 * 1024.0),
+           pack->data_size / (1024.0 * 1024.0));
+  return pack;
+}
+
+void dt_mipmap_pack_close(dt_mipmap_pack_t *pack)
+{
+  if(!pack) return;
+  if(pack->data) fclose(pack->data);
+  if(pack->index) fclose(pack->index);
+  if(pack->map) g_mapped_file_unref(pack->map);
+  g_hash_table_destroy(pack->entries);
+  dt_pthread_mutex_destroy(&pack->lock);
+  g_free(pack->data_path);
+  g_free(pack->index_path);
+  g_free(pack);
+}
+
+gboolean dt_mipmap_pack_contains(dt_mipmap_pack_t *pack, const uint32_t imgid)
+{
+  if(!pack) return FALSE;
+  dt_pthread_mutex_lock(&pack->lock);
+  const gboolean found = g_hash_table_contains(pack->entries, GUINT_TO_POINTER(imgid));
+  dt_pthread_mutex_unlock(&pack->lock);
+  return found;
+}
+
+GMappedFile *dt_mipmap_pack_get(dt_mipmap_pack_t *pack, const uint32_t imgid, const uint8_t **blob, size_t *length,
+                                int *color_space, uint32_t *format)
+{
+  if(!pack) return NULL;
+  GMappedFile *map = NULL;
+  dt_pthread_mutex_lock(&pack->lock);
+  const dt_mipmap_pack_index_t *entry = g_hash_table_lookup(pack->entries, GUINT_TO_POINTER(imgid));
+  const dt_mipmap_pack_record_t *record = entry ? _map_record(pack, entry) : NULL;
+  if(record)
+  {
+    *blob = (const uint8_t *)(record + 1);
+    *length = record->length;
+    *color_space = record->color_space;
+    *format = record->format;
+    map = g_mapped_file_ref(pack->map);
+  }
+  dt_pthread_mutex_unlock(&pack->lock);
+  return map;
+}
+
+int dt_mipmap_pack_put(dt_mipmap_pack_t *pack, const uint32_t imgid, const uint8_t *blob, const size_t length,
+                       const int color_space, const uint32_t format)
+{
+  if(!pack || !imgid || !length || length > G_MAXUINT32) return 1;
+  int err = 1;
+  dt_pthread_mutex_lock(&pack->lock);
+  if(pack->data && pack->index)
+  {
+    const dt_mipmap_pack_index_t entry = { imgid, length, pack->data_size, color_space, format };
+    if(_write_record(pack->data, imgid, blob, length, color_space, format))
+    {
+      // we don't know what made it to the file, so the offsets of later records would be off
+      fprintf(stderr, "[mipmap_pack] can't write `%s', not storing any more thumbnails there\n",
+              pack->data_path);
+      fclose(pack->data);
+      pack->data = NULL;
+    }
+    else
+    {
+      pack->data_size += _record_size(length);
+      _set_entry(pack, &entry);
+      _log_entry(pack, &entry);
+      err = 0;
+    }
+  }
+  dt_pthread_mutex_unlock(&pack->lock);
+  return err;
+}
+
+void dt_mipmap_pack_remove(dt_mipmap_pack_t *pack, const uint32_t imgid)
+{
+  if(!pack) return;
+  dt_pthread_mutex_lock(&pack->lock);
+  if(g_hash_table_contains(pack->entries, GUINT_TO_POINTER(imgid)))
+  {
+    const dt_mipmap_pack_index_t entry = { imgid, 0, 0, 0, 0 };
+    _set_entry(pack, &entry);
+    _log_entry(pack, &entry);
+  }
+  dt_pthread_mutex_unlock(&pack->lock);
+}
+
+gboolean dt_mipmap_pack_needs_compaction(dt_mipmap_pack_t *pack)
+{
+  if(!pack) return FALSE;
+  dt_pthread_mutex_lock(&pack->lock);
+  const uint64_t waste = pack->data_size - pack->live_size;
+  const gboolean needed = !pack->compacting && pack->data && pack->index && waste > DT_MIPMAP_PACK_MIN_WASTE
+                          && waste > pack->live_size / 2;
+  dt_pthread_mutex_unlock(&pack->lock);
+  return needed;
+}
+
+// copies the record of entry from the mapping to f and fills in where it went
+static int _copy_record(FILE *f, uint64_t *size, const dt_mipmap_pack_record_t *record,
+                        dt_mipmap_pack_index_t *entry)
+{
+  if(_write_record(f, entry->imgid, (const uint8_t *)(record + 1), entry->length, entry->color_space,
+                   entry->format))
+    return 1;
+  entry->offset = *size;
+  *size += _record_size(entry->length);
+  return 0;
+}
+
+void dt_mipmap_pack_compact(dt_mipmap_pack_t *pack)
+{
+  if(!dt_mipmap_pack_needs_compaction(pack)) return;
+
+  // first copy what is there now without holding the lock, then what changed meanwhile with it
+  dt_pthread_mutex_lock(&pack->lock);
+  pack->compacting = TRUE;
+  const uint64_t copied_end = pack->data_size;
+  GList *entries = NULL;
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, pack->entries);
+  while(g_hash_table_iter_next(&iter, &key, &value))
+    if(_map_record(pack, (dt_mipmap_pack_index_t *)value))
+      entries = g_list_prepend(entries, g_memdup(value, sizeof(dt_mipmap_pack_index_t)));
+  GMappedFile *map = pack->map ? g_mapped_file_ref(pack->map) : NULL;
+  dt_pthread_mutex_unlock(&pack->lock);
+
+  gchar *data_tmp = g_strdup_printf("%s.tmp", pack->data_path);
+  gchar *index_tmp = g_strdup_printf("%s.tmp", pack->index_path);
+  uint64_t data_size = 0, index_size = 0;
+  FILE *data = NULL, *index = NULL;
+  g_unlink(data_tmp);
+  g_unlink(index_tmp);
+  int err = (entries && !map) || !(data = _open_file(data_tmp, DT_MIPMAP_PACK_DATA_MAGIC, &data_size))
+            || !(index = _open_file(index_tmp, DT_MIPMAP_PACK_INDEX_MAGIC, &index_size));
+
+  // imgid -> entry in the new file. a thumbnail replaced meanwhile is beyond copied_end in the old one
+  GHashTable *moved = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+  for(GList *l = entries; l; l = g_list_next(l))
+  {
+    dt_mipmap_pack_index_t *entry = (dt_mipmap_pack_index_t *)l->data;
+    g_hash_table_insert(moved, GUINT_TO_POINTER(entry->imgid), entry);
+    const char *contents = map ? g_mapped_file_get_contents(map) : NULL;
+    if(!err)
+      err = _copy_record(data, &data_size, (const dt_mipmap_pack_record_t *)(contents + entry->offset), entry);
+  }
+  g_list_free(entries);
+  if(map) g_mapped_file_unref(map);
+
+  dt_pthread_mutex_lock(&pack->lock);
+  GHashTable *compacted = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+  uint64_t live_size = 0;
+  g_hash_table_iter_init(&iter, pack->entries);
+  while(!err && g_hash_table_iter_next(&iter, &key, &value))
+  {
+    const dt_mipmap_pack_index_t *current = (dt_mipmap_pack_index_t *)value;
+    dt_mipmap_pack_index_t entry = *current;
+    if(current->offset >= copied_end)
+    {
+      // written after the first pass
+      const dt_mipmap_pack_record_t *record = _map_record(pack, current);
+      if(!record) continue;
+      err = _copy_record(data, &data_size, record, &entry);
+    }
+    else
+    {
+      const dt_mipmap_pack_index_t *copy = g_hash_table_lookup(moved, key);
+      if(!copy) continue; // was broken already
+      entry = *copy;
+    }
+    if(!err) err = fwrite(&entry, sizeof(entry), 1, index) != 1;
+    g_hash_table_insert(compacted, key, g_memdup(&entry, sizeof(entry)));
+    live_size += _record_size(entry.length);
+  }
+  if(data && fclose(data)) err = 1;
+  if(index && fclose(index)) err = 1;
+
+  if(!err)
+  {
+    // readers holding a reference keep the old mapping
+    if(pack->data) fclose(pack->data);
+    if(pack->index) fclose(pack->index);
+    if(pack->map) g_mapped_file_unref(pack->map);
+    pack->map = NULL;
+    if(g_rename(data_tmp, pack->data_path) || g_rename(index_tmp, pack->index_path))
+    {
+      // now files and entries don't match, start over
+      fprintf(stderr, "[mipmap_pack] can't replace `%s', dropping all thumbnails there\n", pack->data_path);
+      g_unlink(pack->data_path);
+      g_unlink(pack->index_path);
+      g_hash_table_remove_all(compacted);
+      live_size = 0;
+    }
+    g_hash_table_destroy(pack->entries);
+    pack->entries = compacted;
+    pack->live_size = live_size;
+    pack->data = _open_file(pack->data_path, DT_MIPMAP_PACK_DATA_MAGIC, &pack->data_size);
+    pack->index = pack->data ? _open_file(pack->index_path, DT_MIPMAP_PACK_INDEX_MAGIC, &index_size) : NULL;
+    dt_print(DT_DEBUG_CACHE, "[mipmap_pack] compacted `%s' to %.1f MB\n", pack->data_path,
+             pack->data_size / (1024.0 * 1024.0));
+  }
+  else
+  {
+    g_hash_table_destroy(compacted);
+    g_unlink(data_tmp);
+    g_unlink(index_tmp);
+  }
+  pack->compacting = FALSE;
+  dt_pthread_mutex_unlock(&pack->lock);
+
+  g_hash_table_destroy(moved);
+  g_free(data_tmp);
+  g_free(index_tmp);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
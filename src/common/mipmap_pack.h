@@ -0,0 +1,60 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <glib.h>
+#include <inttypes.h>
+#include <stddef.h>
+
+/**
+ * packed on-disk store for the thumbnails of one mipmap size. instead of one file per image, the encoded
+ * thumbnails are appended to <path>.pack and their offsets to <path>.idx. how they are encoded is up to the
+ * caller, which tells the formats apart by a number kept with each of them. the index is read once when the
+ * pack is opened and the data file is memory mapped, so a lookup needs neither open() nor stat(). replaced
+ * and removed thumbnails leave holes which dt_mipmap_pack_compact() squeezes out.
+ *
+ * all functions are thread safe.
+ */
+
+typedef struct dt_mipmap_pack_t dt_mipmap_pack_t;
+
+/** opens or creates the pack files <path>.pack and <path>.idx. NULL if they can't be created. */
+dt_mipmap_pack_t *dt_mipmap_pack_open(const char *path);
+void dt_mipmap_pack_close(dt_mipmap_pack_t *pack);
+
+gboolean dt_mipmap_pack_contains(dt_mipmap_pack_t *pack, const uint32_t imgid);
+
+/** points blob into the mapping of the data file. the mapping stays valid until it is released with
+ * g_mapped_file_unref(), even if the pack is compacted meanwhile. NULL if the image has no thumbnail. */
+GMappedFile *dt_mipmap_pack_get(dt_mipmap_pack_t *pack, const uint32_t imgid, const uint8_t **blob, size_t *length,
+                                int *color_space, uint32_t *format);
+
+/** stores the thumbnail of an image, replacing the old one. returns non-zero on failure. */
+int dt_mipmap_pack_put(dt_mipmap_pack_t *pack, const uint32_t imgid, const uint8_t *blob, const size_t length,
+                       const int color_space, const uint32_t format);
+void dt_mipmap_pack_remove(dt_mipmap_pack_t *pack, const uint32_t imgid);
+
+/** true if enough of the data file is unused to be worth rewriting. */
+gboolean dt_mipmap_pack_needs_compaction(dt_mipmap_pack_t *pack);
+/** rewrites the data file without the holes. lookups and writes may go on meanwhile. */
+void dt_mipmap_pack_compact(dt_mipmap_pack_t *pack);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,110 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define DT_NLMEANS_KERNEL dt_nlmeans_denoise_plain
+#include "common/nlmeans_core_kernel.h"
+
+#include <stdlib.h>
+
+typedef void(dt_nlmeans_kernel_t)(const float *const in, float *const out, const int width, const int height,
+                                  const dt_nlmeans_param_t *const params, const int *const shifts,
+                                  const int num_shifts, float *const scratch, const size_t scratch_size);
+
+#ifdef HAVE_AVX2_CODEPATH
+dt_nlmeans_kernel_t dt_nlmeans_denoise_avx2;
+#endif
+#ifdef HAVE_AVX512_CODEPATH
+dt_nlmeans_kernel_t dt_nlmeans_denoise_avx512;
+#endif
+
+static int _sign(const int a)
+{
+  return (a > 0) - (a < 0);
+}
+
+// fills shifts with the (x, y) offsets of the search window and returns how many there are
+static int _nlmeans_shifts(const dt_nlmeans_param_t *const params, int *const shifts)
+{
+  const int K = params->search_radius;
+  const float scattering = params->scattering;
+  const float scale = params->scale;
+  int num = 0;
+  for(int kj_index = -K; kj_index <= K; kj_index++)
+  {
+    for(int ki_index = -K; ki_index <= K; ki_index++)
+    {
+      if(params->decimate && ((ki_index + kj_index) & 1)) continue;
+      // This formula is made for:
+      // - ensuring that kj = kj_index and ki = ki_index when scattering is 0
+      // - ensuring that no patch can appear twice (provided that scattering is in 0,1 range)
+      // - avoiding grid artifacts by trying to take patches on various lines and columns
+      const int abs_kj = abs(kj_index);
+      const int abs_ki = abs(ki_index);
+      shifts[2 * num] = scale * ((abs_ki * abs_ki * abs_ki + 7.0 * abs_ki * sqrt(abs_kj)) * _sign(ki_index)
+                                 * scattering / 6.0 + ki_index);
+      shifts[2 * num + 1] = scale * ((abs_kj * abs_kj * abs_kj + 7.0 * abs_kj * sqrt(abs_ki)) * _sign(kj_index)
+                                     * scattering / 6.0 + kj_index);
+      num++;
+    }
+  }
+  return num;
+}
+
+void dt_nlmeans_denoise(const float *const in, float *const out, const int width, const int height,
+                        const dt_nlmeans_param_t *const params)
+{
+  const int P = params->patch_radius;
+  const int K = params->search_radius;
+  // differences of the padded tile, the column sums and their prefix sum, rounded to a cache line
+  const size_t dw = DT_NLMEANS_TILE_W + 2 * P;
+  const size_t scratch_size = ((dw * (DT_NLMEANS_TILE_H + 2 * P) + 2 * dw + 1) + 15) & ~(size_t)15;
+
+  int *shifts = malloc(sizeof(int) * 2 * (2 * K + 1) * (2 * K + 1));
+  float *scratch = dt_alloc_align(64, sizeof(float) * scratch_size * dt_get_num_threads());
+  memset(out, 0, sizeof(float) * 4 * width * height);
+  if(!shifts || !scratch)
+  {
+    // keep the input, with a weight of one
+    fprintf(stderr, "[nlmeans] out of memory, skipping\n");
+    for(size_t k = 0; k < (size_t)width * height; k++)
+    {
+      for(int c = 0; c < 3; c++) out[4 * k + c] = in[4 * k + c];
+      out[4 * k + 3] = 1.0f;
+    }
+    free(shifts);
+    dt_free_align(scratch);
+    return;
+  }
+  const int num_shifts = _nlmeans_shifts(params, shifts);
+
+  dt_nlmeans_kernel_t *kernel = dt_nlmeans_denoise_plain;
+#ifdef HAVE_AVX2_CODEPATH
+  if(darktable.codepath.AVX2) kernel = dt_nlmeans_denoise_avx2;
+#endif
+#ifdef HAVE_AVX512_CODEPATH
+  if(darktable.codepath.AVX512) kernel = dt_nlmeans_denoise_avx512;
+#endif
+  kernel(in, out, width, height, params, shifts, num_shifts, scratch, scratch_size);
+
+  free(shifts);
+  dt_free_align(scratch);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,49 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// non-local means on the cpu, shared by the denoise (non-local means) and denoise (profiled) modules.
+//
+// for every shift of the search window, the squared differences between the image and its shifted copy
+// are box-summed over the patch with a running sum down the columns and a prefix sum along the rows.
+// the image is cut into tiles small enough to stay in the cache, and all shifts are run over one tile
+// before going to the next, so every thread owns its piece of the output and nothing has to be summed
+// over more than one tile height.
+
+typedef struct dt_nlmeans_param_t
+{
+  int patch_radius;    // P, the patches are 2P+1 pixels wide
+  int search_radius;   // K, the shifts are taken from a 2K+1 wide window
+  float scattering;    // spreads the shifts of the window further out, 0 keeps them dense
+  float scale;         // zoom factor applied to the shifts
+  float sharpness;     // a pixel is weighted by 2^-max(0, dissimilarity * sharpness - offset)
+  float offset;
+  float center_weight; // extra weight of the center pixel of the patch, 0 for none
+  float norm[3];       // weights of the squared channel differences
+  int decimate;        // only visit every other shift of the window, in a checkerboard. for previews
+} dt_nlmeans_param_t;
+
+// in and out are 4 channel buffers of width x height. out is overwritten with the weighted sum of the
+// shifted pixels and the sum of the weights in out[3], normalizing is left to the caller.
+void dt_nlmeans_denoise(const float *const in, float *const out, const int width, const int height,
+                        const dt_nlmeans_param_t *const params);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
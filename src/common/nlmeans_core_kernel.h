@@ -0,0 +1,177 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// the tiled box-sum loop of the non-local means engine. included by nlmeans_core.c and by
+// nlmeans_core_avx2.c / nlmeans_core_avx512.c, which are built with the flags of their instruction set.
+// define DT_NLMEANS_KERNEL to the name of the function before including.
+
+#include "common/darktable.h"
+#include "common/nlmeans_core.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifndef DT_NLMEANS_TILE_W
+// 128 x 64 pixels of output plus the padded differences of one shift take about 170k,
+// which leaves room in L2 for the rows of the input the tile reads.
+#define DT_NLMEANS_TILE_W 128
+#define DT_NLMEANS_TILE_H 64
+#endif
+
+// very fast approximation for 2^-x (returns 0 for x > 126), same as in the modules
+static inline float _nlmeans_mexp2f(const float x)
+{
+  const float i1 = (float)0x3f800000u; // 2^0
+  const float i2 = (float)0x3f000000u; // 2^-1
+  const float k0 = i1 + x * (i2 - i1);
+  union { float f; int32_t i; } k;
+  k.i = k0 >= (float)0x800000u ? (int32_t)k0 : 0;
+  return k.f;
+}
+
+// shifts holds num_shifts pairs of (x, y) offsets, scratch has room for scratch_size floats per thread.
+void DT_NLMEANS_KERNEL(const float *const in, float *const out, const int width, const int height,
+                       const dt_nlmeans_param_t *const params, const int *const shifts, const int num_shifts,
+                       float *const scratch, const size_t scratch_size)
+{
+  const int P = params->patch_radius;
+  const float sharpness = params->sharpness;
+  const float offset = params->offset;
+  const float n0 = params->norm[0], n1 = params->norm[1], n2 = params->norm[2];
+  // the center contribution is scaled by the patch area to not depend on the patch size
+  const float center_scale = (2 * P + 1) * (2 * P + 1) * params->center_weight;
+  const float center_norm = 1.0f / (1.0f + params->center_weight);
+  const int tiles_x = (width + DT_NLMEANS_TILE_W - 1) / DT_NLMEANS_TILE_W;
+  const int tiles_y = (height + DT_NLMEANS_TILE_H - 1) / DT_NLMEANS_TILE_H;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(in, out, width, height, shifts, num_shifts, scratch, scratch_size, P, sharpness, offset) \
+  dt_omp_firstprivate(n0, n1, n2, center_scale, center_norm, tiles_x, tiles_y) \
+  schedule(dynamic)
+#endif
+  for(int t = 0; t < tiles_x * tiles_y; t++)
+  {
+    const int tx0 = (t % tiles_x) * DT_NLMEANS_TILE_W;
+    const int ty0 = (t / tiles_x) * DT_NLMEANS_TILE_H;
+    const int tw = MIN(DT_NLMEANS_TILE_W, width - tx0);
+    const int th = MIN(DT_NLMEANS_TILE_H, height - ty0);
+    // the differences are kept for the tile plus a border of P pixels
+    const int dw = tw + 2 * P;
+    const int dh = th + 2 * P;
+    float *const D = scratch + scratch_size * dt_get_thread_num();
+    float *const V = D + (size_t)dw * dh;
+    float *const C = V + dw;
+
+    for(int s = 0; s < num_shifts; s++)
+    {
+      const int ki = shifts[2 * s];
+      const int kj = shifts[2 * s + 1];
+      // output pixels of this tile which have a shifted counterpart in the image
+      const int i0 = MAX(tx0, -ki), i1 = MIN(tx0 + tw, width - ki);
+      const int j0 = MAX(ty0, -kj), j1 = MIN(ty0 + th, height - kj);
+      if(i0 >= i1 || j0 >= j1) continue;
+
+      // weighted squared differences, zero wherever one of the two pixels is outside the image
+      const int xa = MAX(tx0 - P, MAX(0, -ki)) - (tx0 - P);
+      const int xb = MIN(tx0 + tw + P, MIN(width, width - ki)) - (tx0 - P);
+      for(int jj = 0; jj < dh; jj++)
+      {
+        const int y = ty0 - P + jj;
+        float *const d = D + (size_t)jj * dw;
+        if(y < 0 || y >= height || y + kj < 0 || y + kj >= height || xa >= xb)
+        {
+          memset(d, 0, sizeof(float) * dw);
+          continue;
+        }
+        memset(d, 0, sizeof(float) * xa);
+        memset(d + xb, 0, sizeof(float) * (dw - xb));
+        const float *const p = in + 4 * ((size_t)y * width + tx0 - P);
+        const float *const q = in + 4 * ((size_t)(y + kj) * width + tx0 - P + ki);
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+        for(int x = xa; x < xb; x++)
+        {
+          const float d0 = p[4 * x] - q[4 * x];
+          const float d1 = p[4 * x + 1] - q[4 * x + 1];
+          const float d2 = p[4 * x + 2] - q[4 * x + 2];
+          d[x] = n0 * d0 * d0 + n1 * d1 * d1 + n2 * d2 * d2;
+        }
+      }
+
+      for(int r = 0; r < th; r++)
+      {
+        // column sums over the 2P+1 rows of the patch, slid down one row at a time
+        if(r == 0)
+        {
+          memset(V, 0, sizeof(float) * dw);
+          for(int jj = 0; jj <= 2 * P; jj++)
+          {
+            const float *const d = D + (size_t)jj * dw;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+            for(int x = 0; x < dw; x++) V[x] += d[x];
+          }
+        }
+        else
+        {
+          const float *const dp = D + (size_t)(r + 2 * P) * dw;
+          const float *const dm = D + (size_t)(r - 1) * dw;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+          for(int x = 0; x < dw; x++) V[x] += dp[x] - dm[x];
+        }
+
+        const int y = ty0 + r;
+        if(y < j0 || y >= j1) continue;
+
+        // prefix sum along the row, the patch sum is the difference of two entries
+        C[0] = 0.0f;
+        for(int x = 0; x < dw; x++) C[x + 1] = C[x] + V[x];
+
+        const float *const center = D + (size_t)(r + P) * dw + P;
+        const float *const ins = in + 4 * ((size_t)(y + kj) * width + ki);
+        float *const o = out + 4 * (size_t)y * width;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+        for(int i = i0; i < i1; i++)
+        {
+          const int x = i - tx0;
+          const float patch = C[x + 2 * P + 1] - C[x];
+          const float dissimilarity = (patch + center[x] * center_scale) * center_norm;
+          const float w = _nlmeans_mexp2f(fmaxf(0.0f, dissimilarity * sharpness - offset));
+          o[4 * i + 0] += w * ins[4 * i + 0];
+          o[4 * i + 1] += w * ins[4 * i + 1];
+          o[4 * i + 2] += w * ins[4 * i + 2];
+          o[4 * i + 3] += w;
+        }
+      }
+    }
+  }
+}
+
+#undef DT_NLMEANS_KERNEL
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -27,13 +27,17 @@
 #include "common/gaussian.h"
 #include "common/guided_filter.h"
 #include "common/heal.h"
+#include "common/histogram.h"
 #include "common/interpolation.h"
 #include "common/locallaplaciancl.h"
+#include "common/memory_accounting.h"
+#include "common/memory_governor.h"
 #include "common/nvidia_gpus.h"
 #include "common/opencl_drivers_blacklist.h"
 #include "control/conf.h"
 #include "control/control.h"
 #include "develop/blend.h"
+#include "develop/perf_model.h"
 #include "develop/pixelpipe.h"
 
 #include <assert.h>
@@ -61,13 +65,162 @@ static void dt_opencl_update_priorities(const char *configstr);
 /** read scheduling profile for config variables */
 static dt_opencl_scheduling_profile_t dt_opencl_get_scheduling_profile(void);
 /** read config of when/if to sync to cache */
-static dt_opencl_sync_cache_t dt_opencl_get_sync_cache(void);
+static dt_opencl_sync_cache_t dt_opencl_get_sync_cache(const dt_conf_value_t *conf);
 /** adjust opencl subsystem according to scheduling profile */
 static void dt_opencl_apply_scheduling_profile(dt_opencl_scheduling_profile_t profile);
 /** set opencl specific synchronization timeout */
 static void dt_opencl_set_synchronization_timeout(int value);
+/** free the pinned memory transfers are staged through */
+static void _staging_release(const int devid);
+/** the idle objects of the memory pool as seen by the memory governor */
+static size_t _pool_governor_usage(gpointer user_data);
+static size_t _pool_governor_shrink(gpointer user_data, const size_t bytes);
 
 
+/** a program that still has to be built, see dt_opencl_t.build_thread */
+typedef struct dt_opencl_pending_program_t
+{
+  int prog;
+  char *name;
+  char *binname;
+  char *cachedir;
+  char md5sum[33];
+} dt_opencl_pending_program_t;
+
+static void _free_pending_program(gpointer data)
+{
+  dt_opencl_pending_program_t *pending = (dt_opencl_pending_program_t *)data;
+  g_free(pending->name);
+  g_free(pending->binname);
+  g_free(pending->cachedir);
+  free(pending);
+}
+
+static void _free_pending_programs(dt_opencl_t *cl, const int dev)
+{
+  g_list_free_full(cl->dev[dev].pending_programs, _free_pending_program);
+  cl->dev[dev].pending_programs = NULL;
+  cl->dev[dev].programs_pending = 0;
+}
+
+// run times of one kernel, the histogram has quarter power-of-two steps starting at a microsecond
+typedef struct dt_opencl_kernel_histogram_t
+{
+  int count;
+  double total;
+  unsigned int bucket[DT_OPENCL_STATS_BUCKETS];
+} dt_opencl_kernel_histogram_t;
+
+static void _kernel_stats_record(const int devid, const char *tag, const cl_ulong nanoseconds)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  if(!tag || tag[0] == '\0') return;
+
+  const double us = nanoseconds * 1e-3;
+  const int b = us > 1.0 ? CLAMP((int)(4.0 * log2(us)), 0, DT_OPENCL_STATS_BUCKETS - 1) : 0;
+
+  dt_pthread_mutex_lock(&cl->dev[devid].stats_lock);
+  dt_opencl_kernel_histogram_t *h = g_hash_table_lookup(cl->dev[devid].kernel_stats, tag);
+  if(!h)
+  {
+    h = g_malloc0(sizeof(dt_opencl_kernel_histogram_t));
+    g_hash_table_insert(cl->dev[devid].kernel_stats, g_strdup(tag), h);
+  }
+  h->count++;
+  h->total += nanoseconds * 1e-9;
+  h->bucket[b]++;
+  dt_pthread_mutex_unlock(&cl->dev[devid].stats_lock);
+}
+
+static double _kernel_stats_percentile(const dt_opencl_kernel_histogram_t *h, const double q)
+{
+  const unsigned int rank = MAX(1, (unsigned int)ceil(q * h->count));
+  unsigned int seen = 0;
+  for(int b = 0; b < DT_OPENCL_STATS_BUCKETS; b++)
+  {
+    seen += h->bucket[b];
+    // middle of the bucket in seconds
+    if(seen >= rank) return 1e-6 * exp2((b + 0.5) / 4.0);
+  }
+  return 1e-6 * exp2(DT_OPENCL_STATS_BUCKETS / 4.0);
+}
+
+static void _transfer_stats_add(const int devid, const gboolean to_device, const size_t bytes)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  if(!cl->kernel_statistics || devid < 0) return;
+  dt_pthread_mutex_lock(&cl->dev[devid].stats_lock);
+  if(to_device)
+    cl->dev[devid].bytes_to_device += bytes;
+  else
+    cl->dev[devid].bytes_from_device += bytes;
+  dt_pthread_mutex_unlock(&cl->dev[devid].stats_lock);
+}
+
+static gint _kernel_stats_by_total(gconstpointer a, gconstpointer b)
+{
+  const double ta = ((const dt_opencl_kernel_stats_t *)a)->total;
+  const double tb = ((const dt_opencl_kernel_stats_t *)b)->total;
+  return (ta < tb) - (ta > tb);
+}
+
+GList *dt_opencl_get_kernel_stats(const int devid)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  if(!cl->inited || devid < 0 || devid >= cl->num_devs || !cl->dev[devid].kernel_stats) return NULL;
+
+  GList *list = NULL;
+  dt_pthread_mutex_lock(&cl->dev[devid].stats_lock);
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, cl->dev[devid].kernel_stats);
+  while(g_hash_table_iter_next(&iter, &key, &value))
+  {
+    const dt_opencl_kernel_histogram_t *h = (dt_opencl_kernel_histogram_t *)value;
+    dt_opencl_kernel_stats_t *stats = g_malloc0(sizeof(dt_opencl_kernel_stats_t));
+    g_strlcpy(stats->name, (const char *)key, sizeof(stats->name));
+    stats->count = h->count;
+    stats->total = h->total;
+    stats->p50 = _kernel_stats_percentile(h, 0.5);
+    stats->p99 = _kernel_stats_percentile(h, 0.99);
+    list = g_list_prepend(list, stats);
+  }
+  dt_pthread_mutex_unlock(&cl->dev[devid].stats_lock);
+  return g_list_sort(list, _kernel_stats_by_total);
+}
+
+void dt_opencl_get_transfer_stats(const int devid, size_t *to_device, size_t *from_device)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  *to_device = *from_device = 0;
+  if(!cl->inited || devid < 0 || devid >= cl->num_devs) return;
+  dt_pthread_mutex_lock(&cl->dev[devid].stats_lock);
+  *to_device = cl->dev[devid].bytes_to_device;
+  *from_device = cl->dev[devid].bytes_from_device;
+  dt_pthread_mutex_unlock(&cl->dev[devid].stats_lock);
+}
+
+static void _print_kernel_stats(const int devid)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  GList *list = dt_opencl_get_kernel_stats(devid);
+  size_t to_device, from_device;
+  dt_opencl_get_transfer_stats(devid, &to_device, &from_device);
+  if(!list && !to_device && !from_device) return;
+
+  dt_print(DT_DEBUG_OPENCL | DT_DEBUG_PERF,
+           "[opencl_summary_statistics] device '%s' (%d): %.1f MB to and %.1f MB from the device\n",
+           cl->dev[devid].name, devid, to_device / (1024.0 * 1024.0), from_device / (1024.0 * 1024.0));
+  for(GList *l = list; l; l = g_list_next(l))
+  {
+    const dt_opencl_kernel_stats_t *stats = (dt_opencl_kernel_stats_t *)l->data;
+    dt_print(DT_DEBUG_OPENCL | DT_DEBUG_PERF,
+             "[opencl_summary_statistics] %8d x %-40s total %9.4fs p50 %9.6fs p99 %9.6fs\n", stats->count,
+             stats->name, stats->total, stats->p50, stats->p99);
+  }
+  g_list_free_full(list, g_free);
+}
+
 int dt_opencl_get_device_info(dt_opencl_t *cl, cl_device_id device, cl_device_info param_name, void **param_value,
                               size_t *param_value_size)
 {
@@ -142,8 +295,19 @@ static int dt_opencl_device_init(dt_opencl_t *cl, const int dev, cl_device_id *d
   memset(cl->dev[dev].program_used, 0x0, sizeof(int) * DT_OPENCL_MAX_PROGRAMS);
   memset(cl->dev[dev].kernel, 0x0, sizeof(cl_kernel) * DT_OPENCL_MAX_KERNELS);
   memset(cl->dev[dev].kernel_used, 0x0, sizeof(int) * DT_OPENCL_MAX_KERNELS);
+  memset(cl->dev[dev].program_ready, 0x0, sizeof(int) * DT_OPENCL_MAX_PROGRAMS);
+  memset(cl->dev[dev].kernel_name, 0x0, sizeof(char *) * DT_OPENCL_MAX_KERNELS);
+  memset(cl->dev[dev].kernel_program, 0x0, sizeof(int) * DT_OPENCL_MAX_KERNELS);
+  cl->dev[dev].pending_programs = NULL;
+  cl->dev[dev].programs_pending = 0;
+  cl->dev[dev].build_failed = 0;
   cl->dev[dev].eventlist = NULL;
   cl->dev[dev].eventtags = NULL;
+  cl->dev[dev].transfer_queue = NULL;
+  cl->dev[dev].pool_idle = NULL;
+  cl->dev[dev].pool_used = NULL;
+  cl->dev[dev].pool_idle_size = 0;
+  cl->dev[dev].pool_ceiling = 0;
   cl->dev[dev].numevents = 0;
   cl->dev[dev].eventsconsolidated = 0;
   cl->dev[dev].maxevents = 0;
@@ -160,6 +324,8 @@ static int dt_opencl_device_init(dt_opencl_t *cl, const int dev, cl_device_id *d
   cl->dev[dev].options = NULL;
   cl->dev[dev].memory_in_use = 0;
   cl->dev[dev].peak_memory = 0;
+  cl->dev[dev].mark_memory = 0;
+  cl->dev[dev].peak_since_mark = 0;
   cl_device_id devid = cl->dev[dev].devid = devices[k];
 
   char *infostr = NULL;
@@ -352,6 +518,23 @@ static int dt_opencl_device_init(dt_opencl_t *cl, const int dev, cl_device_id *d
 
   dt_pthread_mutex_init(&cl->dev[dev].lock, NULL);
 
+  dt_pthread_mutex_init(&cl->dev[dev].stats_lock, NULL);
+  cl->dev[dev].kernel_stats = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  cl->dev[dev].bytes_to_device = 0;
+  cl->dev[dev].bytes_from_device = 0;
+
+  cl->dev[dev].staging = NULL;
+  cl->dev[dev].staging_host = NULL;
+  cl->dev[dev].staging_size = (size_t)MAX(0, dt_conf_get_int("opencl_pinned_staging")) * 1024 * 1024;
+  cl->dev[dev].staging_failed = 0;
+
+  dt_pthread_mutex_init(&cl->dev[dev].pool_lock, NULL);
+  const size_t pool_ceiling = (size_t)MAX(0, dt_conf_get_int("opencl_memory_pool")) * 1024 * 1024;
+  cl->dev[dev].pool_ceiling
+      = dt_memory_governor_limit("pixelpipe", MIN(pool_ceiling, cl->dev[dev].max_global_mem / 4));
+  if(cl->dev[dev].pool_ceiling)
+    dt_memory_governor_register("pixelpipe", _pool_governor_usage, _pool_governor_shrink, NULL, &cl->dev[dev]);
+
   cl->dev[dev].context = (cl->dlocl->symbols->dt_clCreateContext)(0, 1, &devid, NULL, NULL, &err);
   if(err != CL_SUCCESS)
   {
@@ -361,13 +544,21 @@ static int dt_opencl_device_init(dt_opencl_t *cl, const int dev, cl_device_id *d
   }
   // create a command queue for first device the context reported
   cl->dev[dev].cmd_queue = (cl->dlocl->symbols->dt_clCreateCommandQueue)(
-      cl->dev[dev].context, devid, (darktable.unmuted & DT_DEBUG_PERF) ? CL_QUEUE_PROFILING_ENABLE : 0, &err);
+      cl->dev[dev].context, devid, ((darktable.unmuted & DT_DEBUG_PERF) || cl->kernel_statistics) ? CL_QUEUE_PROFILING_ENABLE : 0, &err);
   if(err != CL_SUCCESS)
   {
     dt_print(DT_DEBUG_OPENCL, "[opencl_init] could not create command queue for device %d: %d\n", k, err);
     res = -1;
     goto end;
   }
+  // tiling works without it, just without overlapping transfers and kernels
+  cl->dev[dev].transfer_queue = (cl->dlocl->symbols->dt_clCreateCommandQueue)(
+      cl->dev[dev].context, devid, ((darktable.unmuted & DT_DEBUG_PERF) || cl->kernel_statistics) ? CL_QUEUE_PROFILING_ENABLE : 0, &err);
+  if(err != CL_SUCCESS)
+  {
+    dt_print(DT_DEBUG_OPENCL, "[opencl_init] could not create transfer queue for device %d: %d\n", k, err);
+    cl->dev[dev].transfer_queue = NULL;
+  }
 
   double tstart, tend, tdiff;
   dt_loc_get_user_cache_dir(dtcache, PATH_MAX * sizeof(char));
@@ -421,8 +612,9 @@ static int dt_opencl_device_init(dt_opencl_t *cl, const int dev, cl_device_id *d
   char *includemd5[DT_OPENCL_MAX_INCLUDES] = { NULL };
   dt_opencl_md5sum(clincludes, includemd5);
 
-  // now load all darktable cl kernels.
-  // TODO: compile as a job?
+  // now load all darktable cl kernels. cached binaries are built right away, sources are compiled in the
+  // background unless told otherwise, as that takes minutes after a driver update.
+  const gboolean compile_in_background = dt_conf_get_bool("opencl_compile_in_background");
   tstart = dt_get_wtime();
   FILE *f = g_fopen(filename, "rb");
   if(f)
@@ -474,8 +666,30 @@ static int dt_opencl_device_init(dt_opencl_t *cl, const int dev, cl_device_id *d
       dt_print(DT_DEBUG_OPENCL, "[opencl_init] compiling program `%s' ..\n", programname);
       int loaded_cached;
       char md5sum[33];
-      if(dt_opencl_load_program(dev, prog, filename, binname, cachedir, md5sum, includemd5, &loaded_cached)
-         && dt_opencl_build_program(dev, prog, binname, cachedir, md5sum, loaded_cached) != CL_SUCCESS)
+      if(!dt_opencl_load_program(dev, prog, filename, binname, cachedir, md5sum, includemd5, &loaded_cached))
+      {
+        g_strfreev(tokens);
+        continue;
+      }
+
+      if(compile_in_background && !loaded_cached)
+      {
+        dt_opencl_pending_program_t *pending
+            = (dt_opencl_pending_program_t *)calloc(1, sizeof(dt_opencl_pending_program_t));
+        pending->prog = prog;
+        pending->name = g_strdup(programname);
+        pending->binname = g_strdup(binname);
+        pending->cachedir = g_strdup(cachedir);
+        g_strlcpy(pending->md5sum, md5sum, sizeof(pending->md5sum));
+        cl->dev[dev].pending_programs = g_list_append(cl->dev[dev].pending_programs, pending);
+        cl->dev[dev].programs_pending++;
+        g_strfreev(tokens);
+        continue;
+      }
+
+      if(dt_opencl_build_program(dev, prog, binname, cachedir, md5sum, loaded_cached) == CL_SUCCESS)
+        cl->dev[dev].program_ready[prog] = 1;
+      else
       {
         dt_print(DT_DEBUG_OPENCL, "[opencl_init] failed to compile program `%s'!\n", programname);
         fclose(f);
@@ -521,13 +735,153 @@ end:
   free(confentry);
   free(binname);
 
+  // the slot of a failed device is reused for the next one
+  if(res != 0)
+  {
+    _free_pending_programs(cl, dev);
+    g_hash_table_destroy(cl->dev[dev].kernel_stats);
+    cl->dev[dev].kernel_stats = NULL;
+    dt_memory_governor_unregister(&cl->dev[dev]);
+  }
+
   return res;
 }
 
+// benchmarks CPU and devices if the device setup has changed and picks the scheduling profile accordingly
+static void _benchmark_devices(dt_opencl_t *cl, const gboolean lock_devices)
+{
+  char checksum[64];
+  snprintf(checksum, sizeof(checksum), "%u", cl->crc);
+  char *oldchecksum = dt_conf_get_string("opencl_checksum");
+
+  // check if the configuration (OpenCL device setup) has changed, indicated by checksum != oldchecksum
+  if(strcasecmp(oldchecksum, "OFF") != 0 && strcmp(oldchecksum, checksum) != 0)
+  {
+    // store new checksum value in config
+    dt_conf_set_string("opencl_checksum", checksum);
+    // do CPU bencharking
+    float tcpu = dt_opencl_benchmark_cpu(1024, 1024, 5, 100.0f);
+    // get best benchmarking value of all detected OpenCL devices
+    float tgpumin = INFINITY;
+    for(int n = 0; n < cl->num_devs; n++)
+    {
+      // a device whose programs failed to build has no kernels to run
+      if(!dt_opencl_device_ready(n)) continue;
+      // pipes may already use the devices if the programs have been built in the background
+      if(lock_devices) dt_pthread_mutex_BAD_lock(&cl->dev[n].lock);
+      float tgpu = cl->dev[n].benchmark = dt_opencl_benchmark_gpu(n, 1024, 1024, 5, 100.0f);
+      if(lock_devices) dt_pthread_mutex_BAD_unlock(&cl->dev[n].lock);
+      tgpumin = fmin(tgpu, tgpumin);
+    }
+    dt_print(DT_DEBUG_OPENCL, "[opencl_init] benchmarking results: %f seconds for fastest GPU versus %f seconds for CPU.\n",
+         tgpumin, tcpu);
+
+    if(tcpu <= 1.5f * tgpumin)
+    {
+      // de-activate opencl for darktable in case of too slow GPU(s). user can always manually overrule this later.
+      cl->enabled = FALSE;
+      dt_conf_set_bool("opencl", FALSE);
+      dt_print(DT_DEBUG_OPENCL, "[opencl_init] due to a slow GPU the opencl flag has been set to OFF.\n");
+      dt_control_log(_("due to a slow GPU hardware acceleration via opencl has been de-activated."));
+    }
+    else if(cl->num_devs >= 2)
+    {
+      // set scheduling profile to "multiple GPUs" if more than one device has been found
+      dt_conf_set_string("opencl_scheduling_profile", "multiple GPUs");
+      dt_print(DT_DEBUG_OPENCL, "[opencl_init] set scheduling profile for multiple GPUs.\n");
+      dt_control_log(_("multiple GPUs detected - opencl scheduling profile has been set accordingly."));
+    }
+    else if(tcpu >= 6.0f * tgpumin)
+    {
+      // set scheduling profile to "very fast GPU" if CPU is way too slow
+      dt_conf_set_string("opencl_scheduling_profile", "very fast GPU");
+      dt_print(DT_DEBUG_OPENCL, "[opencl_init] set scheduling profile for very fast GPU.\n");
+      dt_control_log(_("very fast GPU detected - opencl scheduling profile has been set accordingly."));
+    }
+    else
+    {
+      // set scheduling profile to "default"
+      dt_conf_set_string("opencl_scheduling_profile", "default");
+      dt_print(DT_DEBUG_OPENCL, "[opencl_init] set scheduling profile to default.\n");
+      dt_control_log(_("opencl scheduling profile set to default."));
+    }
+  }
+  g_free(oldchecksum);
+}
+
+// builds the programs which had no cached binary, devices are handed to pipes once all their programs are built
+static void *_build_programs(void *data)
+{
+  dt_opencl_t *cl = (dt_opencl_t *)data;
+  dt_pthread_setname("opencl_build");
+
+  for(int dev = 0; dev < cl->num_devs; dev++)
+  {
+    for(GList *l = cl->dev[dev].pending_programs; l; l = g_list_next(l))
+    {
+      if(cl->build_shutdown) return NULL;
+      dt_opencl_pending_program_t *pending = (dt_opencl_pending_program_t *)l->data;
+      const double tstart = dt_get_wtime();
+      const int err
+          = dt_opencl_build_program(dev, pending->prog, pending->binname, pending->cachedir, pending->md5sum, 0);
+
+      dt_pthread_mutex_lock(&cl->lock);
+      if(err == CL_SUCCESS)
+      {
+        cl->dev[dev].program_ready[pending->prog] = 1;
+        // kernels asked for while the program was built
+        for(int k = 0; k < DT_OPENCL_MAX_KERNELS; k++)
+        {
+          if(!cl->dev[dev].kernel_used[k] || cl->dev[dev].kernel[k] || !cl->dev[dev].kernel_name[k]
+             || cl->dev[dev].kernel_program[k] != pending->prog)
+            continue;
+          cl_int kerr;
+          cl->dev[dev].kernel[k] = (cl->dlocl->symbols->dt_clCreateKernel)(cl->dev[dev].program[pending->prog],
+                                                                           cl->dev[dev].kernel_name[k], &kerr);
+          if(kerr != CL_SUCCESS)
+          {
+            dt_print(DT_DEBUG_OPENCL, "[opencl_build_programs] could not create kernel `%s'! (%d)\n",
+                     cl->dev[dev].kernel_name[k], kerr);
+            cl->dev[dev].kernel[k] = NULL;
+            cl->dev[dev].build_failed = 1;
+          }
+        }
+      }
+      else
+      {
+        dt_print(DT_DEBUG_OPENCL, "[opencl_build_programs] failed to compile program `%s' for device %d!\n",
+                 pending->name, dev);
+        cl->dev[dev].build_failed = 1;
+      }
+      cl->dev[dev].programs_pending--;
+      dt_pthread_mutex_unlock(&cl->lock);
+
+      dt_print(DT_DEBUG_OPENCL, "[opencl_build_programs] built program `%s' for device %d in %.3f seconds\n",
+               pending->name, dev, dt_get_wtime() - tstart);
+    }
+    if(cl->dev[dev].build_failed)
+      dt_print(DT_DEBUG_OPENCL, "[opencl_build_programs] device %d (%s) will not be used\n", dev,
+               cl->dev[dev].name);
+  }
+
+  if(cl->benchmark_pending && !cl->build_shutdown)
+  {
+    cl->benchmark_pending = 0;
+    _benchmark_devices(cl, TRUE);
+    dt_opencl_apply_scheduling_profile(dt_opencl_get_scheduling_profile());
+  }
+  return NULL;
+}
+
 void dt_opencl_init(dt_opencl_t *cl, const gboolean exclude_opencl, const gboolean print_statistics)
 {
   char *str;
   dt_pthread_mutex_init(&cl->lock, NULL);
+  cl->conf_enabled = dt_conf_value("opencl");
+  cl->conf_scheduling_profile = dt_conf_value("opencl_scheduling_profile");
+  cl->conf_sync_cache = dt_conf_value("opencl_synch_cache");
+  cl->conf_sync_cache_preview = dt_conf_value("opencl_synch_cache_preview");
+  cl->conf_sync_checkpoint = dt_conf_value("opencl_synch_cache_checkpoint");
   cl->inited = 0;
   cl->enabled = 0;
   cl->stopped = 0;
@@ -548,10 +902,20 @@ void dt_opencl_init(dt_opencl_t *cl, const gboolean exclude_opencl, const gboole
 
   cl->avoid_atomics = dt_conf_get_bool("opencl_avoid_atomics");
   cl->async_pixelpipe = dt_conf_get_bool("opencl_async_pixelpipe");
-  cl->sync_cache = dt_opencl_get_sync_cache();
+  cl->async_export = dt_conf_get_bool("opencl_async_export");
+  // measured peaks are what tiling calibration is made of
+  cl->track_memory = dt_conf_get_bool("tiling_calibrate");
+  // run times come from the profiling info of the events
+  cl->kernel_statistics = cl->use_events && dt_conf_get_bool("opencl_kernel_statistics");
+  cl->sync_cache = dt_opencl_get_sync_cache(cl->conf_sync_cache);
+  cl->sync_cache_preview = dt_opencl_get_sync_cache(cl->conf_sync_cache_preview);
+  cl->sync_checkpoint = dt_conf_value_int(cl->conf_sync_checkpoint) / 1000.0f;
   cl->micro_nap = dt_conf_get_int("opencl_micro_nap");
   cl->crc = 5781;
   cl->dlocl = NULL;
+  cl->build_thread_started = 0;
+  cl->build_shutdown = 0;
+  cl->benchmark_pending = 0;
   cl->dev_priority_image = NULL;
   cl->dev_priority_preview = NULL;
   cl->dev_priority_preview2 = NULL;
@@ -596,9 +960,16 @@ void dt_opencl_init(dt_opencl_t *cl, const gboolean exclude_opencl, const gboole
            dt_conf_get_int("opencl_size_roundup"));
   dt_print(DT_DEBUG_OPENCL, "[opencl_init] opencl_async_pixelpipe: %d\n",
            dt_conf_get_bool("opencl_async_pixelpipe"));
+  dt_print(DT_DEBUG_OPENCL, "[opencl_init] opencl_async_export: %d\n",
+           dt_conf_get_bool("opencl_async_export"));
   str = dt_conf_get_string("opencl_synch_cache");
   dt_print(DT_DEBUG_OPENCL, "[opencl_init] opencl_synch_cache: %s\n", str);
   g_free(str);
+  str = dt_conf_get_string("opencl_synch_cache_preview");
+  dt_print(DT_DEBUG_OPENCL, "[opencl_init] opencl_synch_cache_preview: %s\n", str);
+  g_free(str);
+  dt_print(DT_DEBUG_OPENCL, "[opencl_init] opencl_synch_cache_checkpoint: %d\n",
+           dt_conf_get_int("opencl_synch_cache_checkpoint"));
   dt_print(DT_DEBUG_OPENCL, "[opencl_init] opencl_number_event_handles: %d\n",
            dt_conf_get_int("opencl_number_event_handles"));
   dt_print(DT_DEBUG_OPENCL, "[opencl_init] opencl_micro_nap: %d\n", dt_conf_get_int("opencl_micro_nap"));
@@ -760,73 +1131,55 @@ finally:
     cl->heal = dt_heal_init_cl_global();
     cl->colorspaces = dt_colorspaces_init_cl_global();
     cl->guided_filter = dt_guided_filter_init_cl_global();
+    cl->histogram = dt_histogram_init_cl_global();
 
-    char checksum[64];
-    snprintf(checksum, sizeof(checksum), "%u", cl->crc);
-    char *oldchecksum = dt_conf_get_string("opencl_checksum");
+    int pending = 0;
+    for(int n = 0; n < cl->num_devs; n++) pending += cl->dev[n].programs_pending;
 
-    // check if the configuration (OpenCL device setup) has changed, indicated by checksum != oldchecksum
-    if(strcasecmp(oldchecksum, "OFF") != 0 && strcmp(oldchecksum, checksum) != 0)
-    {
-      // store new checksum value in config
-      dt_conf_set_string("opencl_checksum", checksum);
-      // do CPU bencharking
-      float tcpu = dt_opencl_benchmark_cpu(1024, 1024, 5, 100.0f);
-      // get best benchmarking value of all detected OpenCL devices
-      float tgpumin = INFINITY;
-      for(int n = 0; n < cl->num_devs; n++)
-      {
-        float tgpu = cl->dev[n].benchmark = dt_opencl_benchmark_gpu(n, 1024, 1024, 5, 100.0f);
-        tgpumin = fmin(tgpu, tgpumin);
-      }
-      dt_print(DT_DEBUG_OPENCL, "[opencl_init] benchmarking results: %f seconds for fastest GPU versus %f seconds for CPU.\n",
-           tgpumin, tcpu);
-
-      if(tcpu <= 1.5f * tgpumin)
-      {
-        // de-activate opencl for darktable in case of too slow GPU(s). user can always manually overrule this later.
-        cl->enabled = FALSE;
-        dt_conf_set_bool("opencl", FALSE);
-        dt_print(DT_DEBUG_OPENCL, "[opencl_init] due to a slow GPU the opencl flag has been set to OFF.\n");
-        dt_control_log(_("due to a slow GPU hardware acceleration via opencl has been de-activated."));
-      }
-      else if(cl->num_devs >= 2)
-      {
-        // set scheduling profile to "multiple GPUs" if more than one device has been found
-        dt_conf_set_string("opencl_scheduling_profile", "multiple GPUs");
-        dt_print(DT_DEBUG_OPENCL, "[opencl_init] set scheduling profile for multiple GPUs.\n");
-        dt_control_log(_("multiple GPUs detected - opencl scheduling profile has been set accordingly."));
-      }
-      else if(tcpu >= 6.0f * tgpumin)
-      {
-        // set scheduling profile to "very fast GPU" if CPU is way too slow
-        dt_conf_set_string("opencl_scheduling_profile", "very fast GPU");
-        dt_print(DT_DEBUG_OPENCL, "[opencl_init] set scheduling profile for very fast GPU.\n");
-        dt_control_log(_("very fast GPU detected - opencl scheduling profile has been set accordingly."));
-      }
-      else
-      {
-        // set scheduling profile to "default"
-        dt_conf_set_string("opencl_scheduling_profile", "default");
-        dt_print(DT_DEBUG_OPENCL, "[opencl_init] set scheduling profile to default.\n");
-        dt_control_log(_("opencl scheduling profile set to default."));
-      }
-    }
-    g_free(oldchecksum);
+    // the benchmark needs all kernels, with programs still to build it's done once they are
+    if(pending)
+      cl->benchmark_pending = 1;
+    else
+      _benchmark_devices(cl, FALSE);
 
     // apply config settings for scheduling profile: sets device priorities and pixelpipe synchronization timeout
     dt_opencl_scheduling_profile_t profile = dt_opencl_get_scheduling_profile();
     dt_opencl_apply_scheduling_profile(profile);
+
+    // until their programs are built, devices are not handed to pipes and the CPU does the work
+    if(pending)
+    {
+      dt_print(DT_DEBUG_OPENCL, "[opencl_init] building %d programs in the background\n", pending);
+      cl->build_thread_started = !dt_pthread_create(&cl->build_thread, _build_programs, cl);
+      if(!cl->build_thread_started)
+      {
+        // without a thread all devices with programs to build stay unused
+        for(int n = 0; n < cl->num_devs; n++)
+          if(cl->dev[n].programs_pending) cl->dev[n].build_failed = 1;
+      }
+    }
   }
   else // initialization failed
   {
     for(int i = 0; cl->dev && i < cl->num_devs; i++)
     {
+      _free_pending_programs(cl, i);
+      for(int k = 0; k < DT_OPENCL_MAX_KERNELS; k++) g_free(cl->dev[i].kernel_name[k]);
       dt_pthread_mutex_destroy(&cl->dev[i].lock);
+      dt_memory_governor_unregister(&cl->dev[i]);
+      dt_opencl_memory_pool_flush(i);
+      _staging_release(i);
+      if(cl->dev[i].pool_used) g_hash_table_destroy(cl->dev[i].pool_used);
+      dt_pthread_mutex_destroy(&cl->dev[i].pool_lock);
+      if(cl->dev[i].kernel_stats) g_hash_table_destroy(cl->dev[i].kernel_stats);
+      dt_pthread_mutex_destroy(&cl->dev[i].stats_lock);
       for(int k = 0; k < DT_OPENCL_MAX_KERNELS; k++)
-        if(cl->dev[i].kernel_used[k]) (cl->dlocl->symbols->dt_clReleaseKernel)(cl->dev[i].kernel[k]);
+        if(cl->dev[i].kernel_used[k] && cl->dev[i].kernel[k])
+          (cl->dlocl->symbols->dt_clReleaseKernel)(cl->dev[i].kernel[k]);
       for(int k = 0; k < DT_OPENCL_MAX_PROGRAMS; k++)
         if(cl->dev[i].program_used[k]) (cl->dlocl->symbols->dt_clReleaseProgram)(cl->dev[i].program[k]);
+      if(cl->dev[i].transfer_queue)
+        (cl->dlocl->symbols->dt_clReleaseCommandQueue)(cl->dev[i].transfer_queue);
       (cl->dlocl->symbols->dt_clReleaseCommandQueue)(cl->dev[i].cmd_queue);
       (cl->dlocl->symbols->dt_clReleaseContext)(cl->dev[i].context);
       if(cl->use_events)
@@ -857,6 +1210,10 @@ void dt_opencl_cleanup(dt_opencl_t *cl)
 {
   if(cl->inited)
   {
+    // a program being built is finished, the remaining ones are skipped
+    cl->build_shutdown = 1;
+    if(cl->build_thread_started) pthread_join(cl->build_thread, NULL);
+
     dt_develop_blend_free_cl_global(cl->blendop);
     dt_bilateral_free_cl_global(cl->bilateral);
     dt_gaussian_free_cl_global(cl->gaussian);
@@ -865,14 +1222,29 @@ void dt_opencl_cleanup(dt_opencl_t *cl)
     dt_heal_free_cl_global(cl->heal);
     dt_colorspaces_free_cl_global(cl->colorspaces);
     dt_guided_filter_free_cl_global(cl->guided_filter);
+    dt_histogram_free_cl_global(cl->histogram);
 
     for(int i = 0; i < cl->num_devs; i++)
     {
+      if(cl->print_statistics && cl->kernel_statistics) _print_kernel_stats(i);
+
+      _free_pending_programs(cl, i);
+      for(int k = 0; k < DT_OPENCL_MAX_KERNELS; k++) g_free(cl->dev[i].kernel_name[k]);
       dt_pthread_mutex_destroy(&cl->dev[i].lock);
+      dt_memory_governor_unregister(&cl->dev[i]);
+      dt_opencl_memory_pool_flush(i);
+      _staging_release(i);
+      if(cl->dev[i].pool_used) g_hash_table_destroy(cl->dev[i].pool_used);
+      dt_pthread_mutex_destroy(&cl->dev[i].pool_lock);
+      if(cl->dev[i].kernel_stats) g_hash_table_destroy(cl->dev[i].kernel_stats);
+      dt_pthread_mutex_destroy(&cl->dev[i].stats_lock);
       for(int k = 0; k < DT_OPENCL_MAX_KERNELS; k++)
-        if(cl->dev[i].kernel_used[k]) (cl->dlocl->symbols->dt_clReleaseKernel)(cl->dev[i].kernel[k]);
+        if(cl->dev[i].kernel_used[k] && cl->dev[i].kernel[k])
+          (cl->dlocl->symbols->dt_clReleaseKernel)(cl->dev[i].kernel[k]);
       for(int k = 0; k < DT_OPENCL_MAX_PROGRAMS; k++)
         if(cl->dev[i].program_used[k]) (cl->dlocl->symbols->dt_clReleaseProgram)(cl->dev[i].program[k]);
+      if(cl->dev[i].transfer_queue)
+        (cl->dlocl->symbols->dt_clReleaseCommandQueue)(cl->dev[i].transfer_queue);
       (cl->dlocl->symbols->dt_clReleaseCommandQueue)(cl->dev[i].cmd_queue);
       (cl->dlocl->symbols->dt_clReleaseContext)(cl->dev[i].context);
 
@@ -1128,6 +1500,28 @@ int dt_opencl_finish(const int devid)
   return (err == CL_SUCCESS && success == CL_COMPLETE);
 }
 
+int dt_opencl_pipe_is_synchronous(const int pipe_type)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  // nobody waits for an export to show up on screen, so a late error only costs a rerun
+  if((pipe_type & DT_DEV_PIXELPIPE_EXPORT) == DT_DEV_PIXELPIPE_EXPORT) return !cl->async_export;
+  return !cl->async_pixelpipe;
+}
+
+int dt_opencl_export_devices(void)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  if(!cl->inited || !cl->enabled || cl->stopped || !dt_conf_get_bool("opencl_multi_device_export")) return 1;
+
+  // all devices the export priority list allows, in use or not. a band whose pipe finds no free
+  // device just runs on the cpu.
+  dt_pthread_mutex_lock(&cl->lock);
+  int count = 0;
+  for(const int *prio = cl->dev_priority_export; prio && *prio != -1; prio++) count++;
+  dt_pthread_mutex_unlock(&cl->lock);
+  return MAX(count, 1);
+}
+
 int dt_opencl_enqueue_barrier(const int devid)
 {
   dt_opencl_t *cl = darktable.opencl;
@@ -1387,6 +1781,44 @@ static void dt_opencl_update_priorities(const char *configstr)
              cl->mandatory[1], cl->mandatory[2], cl->mandatory[3], cl->mandatory[4]);
 }
 
+// devices which have been faster so far go first. devices without runs to compare keep their place, so the
+// order of the scheduling profile still holds until there is something better to go by.
+static void _sort_priorities_by_model(int *priority)
+{
+  int count = 0;
+  while(priority[count] != -1) count++;
+  if(count < 2) return;
+
+  // the places of the devices with a score, and these devices sorted by score
+  int *place = (int *)malloc(sizeof(int) * count);
+  int *sorted = (int *)malloc(sizeof(int) * count);
+  float *score = (float *)malloc(sizeof(float) * count);
+  if(place && sorted && score)
+  {
+    int known = 0;
+    for(int k = 0; k < count; k++)
+    {
+      const float s = dt_perf_model_device_score(priority[k]);
+      if(s <= 0.0f) continue;
+      // stable insertion
+      int j = known;
+      while(j > 0 && score[j - 1] > s)
+      {
+        score[j] = score[j - 1];
+        sorted[j] = sorted[j - 1];
+        j--;
+      }
+      score[j] = s;
+      sorted[j] = priority[k];
+      place[known++] = k;
+    }
+    for(int k = 0; k < known; k++) priority[place[k]] = sorted[k];
+  }
+  free(place);
+  free(sorted);
+  free(score);
+}
+
 int dt_opencl_lock_device(const int pipetype)
 {
   dt_opencl_t *cl = darktable.opencl;
@@ -1429,6 +1861,8 @@ int dt_opencl_lock_device(const int pipetype)
 
   dt_pthread_mutex_unlock(&cl->lock);
 
+  if(priority && dt_perf_model_enabled()) _sort_priorities_by_model(priority);
+
   if(priority)
   {
     const int usec = 5000;
@@ -1441,7 +1875,7 @@ int dt_opencl_lock_device(const int pipetype)
 
       while(*prio != -1)
       {
-        if(!dt_pthread_mutex_BAD_trylock(&cl->dev[*prio].lock))
+        if(dt_opencl_device_ready(*prio) && !dt_pthread_mutex_BAD_trylock(&cl->dev[*prio].lock))
         {
           int devid = *prio;
           free(priority);
@@ -1465,7 +1899,8 @@ int dt_opencl_lock_device(const int pipetype)
     for(int try_dev = 0; try_dev < cl->num_devs; try_dev++)
     {
       // get first currently unused processor
-      if(!dt_pthread_mutex_BAD_trylock(&cl->dev[try_dev].lock)) return try_dev;
+      if(dt_opencl_device_ready(try_dev) && !dt_pthread_mutex_BAD_trylock(&cl->dev[try_dev].lock))
+        return try_dev;
     }
   }
 
@@ -1476,6 +1911,16 @@ int dt_opencl_lock_device(const int pipetype)
   return -1;
 }
 
+int dt_opencl_device_ready(const int devid)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  if(!cl->inited || devid < 0 || devid >= cl->num_devs) return 0;
+  dt_pthread_mutex_lock(&cl->lock);
+  const int ready = cl->dev[devid].programs_pending == 0 && !cl->dev[devid].build_failed;
+  dt_pthread_mutex_unlock(&cl->lock);
+  return ready;
+}
+
 void dt_opencl_unlock_device(const int dev)
 {
   dt_opencl_t *cl = darktable.opencl;
@@ -1830,23 +2275,21 @@ int dt_opencl_build_program(const int dev, const int prog, const char *binname,
           if(bytes_written != binary_sizes[i]) goto ret;
           fclose(f);
 
-          // create link (e.g. basic.cl.bin -> f1430102c53867c162bb60af6c163328)
-          char cwd[PATH_MAX] = { 0 };
-          if(!getcwd(cwd, sizeof(cwd))) goto ret;
-          if(chdir(cachedir) != 0) goto ret;
+          // create link (e.g. basic.cl.bin -> f1430102c53867c162bb60af6c163328). binname is in cachedir, so
+          // the relative target works without changing the working directory, which programs built in the
+          // background must not do.
+#if defined(_WIN32)
           char dup[PATH_MAX] = { 0 };
           g_strlcpy(dup, binname, sizeof(dup));
           char *bname = basename(dup);
-#if defined(_WIN32)
           //CreateSymbolicLink in Windows requires admin privileges, which we don't want/need
           //store has using a simple filerename
           char finalfilename[PATH_MAX] = { 0 };
           snprintf(finalfilename, sizeof(finalfilename), "%s" G_DIR_SEPARATOR_S "%s.%s", cachedir, bname, md5sum);
           rename(link_dest, finalfilename);
 #else
-          if(symlink(md5sum, bname) != 0) goto ret;
+          if(symlink(md5sum, binname) != 0) goto ret;
 #endif //!defined(_WIN32)
-          if(chdir(cwd) != 0) goto ret;
         }
 
     ret:
@@ -1873,12 +2316,22 @@ int dt_opencl_create_kernel(const int prog, const char *name)
       if(!cl->dev[dev].kernel_used[k])
       {
         cl->dev[dev].kernel_used[k] = 1;
+        cl->dev[dev].kernel_name[k] = g_strdup(name);
+        cl->dev[dev].kernel_program[k] = prog;
+        if(!cl->dev[dev].program_ready[prog])
+        {
+          // the program is still being built, the build thread creates the kernel in this slot
+          cl->dev[dev].kernel[k] = NULL;
+          break;
+        }
         cl->dev[dev].kernel[k]
             = (cl->dlocl->symbols->dt_clCreateKernel)(cl->dev[dev].program[prog], name, &err);
         if(err != CL_SUCCESS)
         {
           dt_print(DT_DEBUG_OPENCL, "[opencl_create_kernel] could not create kernel `%s'! (%d)\n", name, err);
           cl->dev[dev].kernel_used[k] = 0;
+          g_free(cl->dev[dev].kernel_name[k]);
+          cl->dev[dev].kernel_name[k] = NULL;
           goto error;
         }
         else
@@ -1911,7 +2364,10 @@ void dt_opencl_free_kernel(const int kernel)
   for(int dev = 0; dev < cl->num_devs; dev++)
   {
     cl->dev[dev].kernel_used[kernel] = 0;
-    (cl->dlocl->symbols->dt_clReleaseKernel)(cl->dev[dev].kernel[kernel]);
+    if(cl->dev[dev].kernel[kernel]) (cl->dlocl->symbols->dt_clReleaseKernel)(cl->dev[dev].kernel[kernel]);
+    cl->dev[dev].kernel[kernel] = NULL;
+    g_free(cl->dev[dev].kernel_name[kernel]);
+    cl->dev[dev].kernel_name[kernel] = NULL;
   }
   dt_pthread_mutex_unlock(&cl->lock);
 }
@@ -1982,7 +2438,9 @@ int dt_opencl_enqueue_kernel_2d_with_local(const int dev, const int kernel, cons
   int err;
   char buf[256];
   buf[0] = '\0';
-  if(darktable.unmuted & DT_DEBUG_OPENCL)
+  if(cl->kernel_statistics && cl->dev[dev].kernel_name[kernel])
+    g_strlcpy(buf, cl->dev[dev].kernel_name[kernel], sizeof(buf));
+  else if(darktable.unmuted & DT_DEBUG_OPENCL)
     (cl->dlocl->symbols->dt_clGetKernelInfo)(cl->dev[dev].kernel[kernel], CL_KERNEL_FUNCTION_NAME, 256, buf,
                                             NULL);
   cl_event *eventp = dt_opencl_events_get_slot(dev, buf);
@@ -2004,10 +2462,139 @@ int dt_opencl_read_host_from_device(const int devid, void *host, void *device, c
   return dt_opencl_read_host_from_device_rowpitch(devid, host, device, width, height, bpp * width);
 }
 
+// pinned host memory the device can reach directly, allocated on first use. NULL if there is none.
+static void *_staging_get(const int devid)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  dt_opencl_device_t *dev = &cl->dev[devid];
+  if(dev->staging_host) return dev->staging_host;
+  if(dev->staging_failed || dev->staging_size == 0) return NULL;
+
+  cl_int err;
+  dev->staging = (cl->dlocl->symbols->dt_clCreateBuffer)(dev->context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR,
+                                                         dev->staging_size, NULL, &err);
+  if(err == CL_SUCCESS)
+    dev->staging_host = (cl->dlocl->symbols->dt_clEnqueueMapBuffer)(
+        dev->cmd_queue, dev->staging, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, dev->staging_size, 0, NULL, NULL,
+        &err);
+  if(err != CL_SUCCESS || !dev->staging_host)
+  {
+    dt_print(DT_DEBUG_OPENCL, "[opencl_staging] could not get %zu bytes of pinned memory for device %d: %d\n",
+             dev->staging_size, devid, err);
+    if(dev->staging) (cl->dlocl->symbols->dt_clReleaseMemObject)(dev->staging);
+    dev->staging = NULL;
+    dev->staging_host = NULL;
+    dev->staging_failed = 1;
+  }
+  return dev->staging_host;
+}
+
+static void _staging_release(const int devid)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  dt_opencl_device_t *dev = &cl->dev[devid];
+  if(!dev->staging) return;
+  if(dev->staging_host)
+  {
+    (cl->dlocl->symbols->dt_clEnqueueUnmapMemObject)(dev->cmd_queue, dev->staging, dev->staging_host, 0, NULL,
+                                                     NULL);
+    (cl->dlocl->symbols->dt_clFinish)(dev->cmd_queue);
+  }
+  (cl->dlocl->symbols->dt_clReleaseMemObject)(dev->staging);
+  dev->staging = NULL;
+  dev->staging_host = NULL;
+}
+
+// rows of a full image transfer that fit into half of the staging memory, 0 if staging doesn't pay off
+static int _staging_rows(const int devid, const int height, const int rowpitch)
+{
+  const size_t half = darktable.opencl->dev[devid].staging_size / 2;
+  if(rowpitch <= 0 || (size_t)height * rowpitch <= half) return 0;
+  return MIN(height, (int)(half / rowpitch));
+}
+
+static void _staging_wait(const int devid, cl_event *event)
+{
+  if(!*event) return;
+  (darktable.opencl->dlocl->symbols->dt_clWaitForEvents)(1, event);
+  (darktable.opencl->dlocl->symbols->dt_clReleaseEvent)(*event);
+  *event = NULL;
+}
+
+// pageable memory would be copied to the driver's own staging memory anyway. doing it here in chunks lets
+// copying the next chunk overlap with the transfer of the current one.
+static int _staged_write(const int devid, void *host, void *device, const int width, const int height,
+                         const int rowpitch, const int rows)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  char *staging = (char *)cl->dev[devid].staging_host;
+  const size_t half = cl->dev[devid].staging_size / 2;
+  cl_event event[2] = { NULL, NULL };
+  cl_int err = CL_SUCCESS;
+
+  for(int y = 0, i = 0; y < height && err == CL_SUCCESS; y += rows, i ^= 1)
+  {
+    const int n = MIN(rows, height - y);
+    _staging_wait(devid, &event[i]);
+    memcpy(staging + i * half, (char *)host + (size_t)y * rowpitch, (size_t)n * rowpitch);
+    const size_t origin[] = { 0, y, 0 };
+    const size_t region[] = { width, n, 1 };
+    err = (cl->dlocl->symbols->dt_clEnqueueWriteImage)(cl->dev[devid].cmd_queue, device, CL_FALSE, origin, region,
+                                                       rowpitch, 0, staging + i * half, 0, NULL, &event[i]);
+    if(err == CL_SUCCESS) (cl->dlocl->symbols->dt_clFlush)(cl->dev[devid].cmd_queue);
+  }
+  _staging_wait(devid, &event[0]);
+  _staging_wait(devid, &event[1]);
+  if(err == CL_SUCCESS) _transfer_stats_add(devid, TRUE, (size_t)height * rowpitch);
+  return err;
+}
+
+static int _staged_read(const int devid, void *host, void *device, const int width, const int height,
+                        const int rowpitch, const int rows)
+{
+  dt_opencl_t *cl = darktable.opencl;
+  char *staging = (char *)cl->dev[devid].staging_host;
+  const size_t half = cl->dev[devid].staging_size / 2;
+  cl_event event[2] = { NULL, NULL };
+  cl_int err = CL_SUCCESS;
+
+  // the chunk before is copied out while the next one is read
+  int prev_y = -1, prev_n = 0;
+  for(int y = 0, i = 0; y < height && err == CL_SUCCESS; y += rows, i ^= 1)
+  {
+    const int n = MIN(rows, height - y);
+    const size_t origin[] = { 0, y, 0 };
+    const size_t region[] = { width, n, 1 };
+    err = (cl->dlocl->symbols->dt_clEnqueueReadImage)(cl->dev[devid].cmd_queue, device, CL_FALSE, origin, region,
+                                                      rowpitch, 0, staging + i * half, 0, NULL, &event[i]);
+    if(err != CL_SUCCESS) break;
+    (cl->dlocl->symbols->dt_clFlush)(cl->dev[devid].cmd_queue);
+    if(prev_y >= 0)
+    {
+      _staging_wait(devid, &event[i ^ 1]);
+      memcpy((char *)host + (size_t)prev_y * rowpitch, staging + (i ^ 1) * half, (size_t)prev_n * rowpitch);
+    }
+    prev_y = y;
+    prev_n = n;
+  }
+  if(err == CL_SUCCESS && prev_y >= 0)
+  {
+    const int i = (prev_y / rows) & 1;
+    _staging_wait(devid, &event[i]);
+    memcpy((char *)host + (size_t)prev_y * rowpitch, staging + i * half, (size_t)prev_n * rowpitch);
+  }
+  _staging_wait(devid, &event[0]);
+  _staging_wait(devid, &event[1]);
+  if(err == CL_SUCCESS) _transfer_stats_add(devid, FALSE, (size_t)height * rowpitch);
+  return err;
+}
+
 int dt_opencl_read_host_from_device_rowpitch(const int devid, void *host, void *device, const int width,
                                              const int height, const int rowpitch)
 {
   if(!darktable.opencl->inited || devid < 0) return -1;
+  const int rows = _staging_rows(devid, height, rowpitch);
+  if(rows > 0 && _staging_get(devid)) return _staged_read(devid, host, device, width, height, rowpitch, rows);
   const size_t origin[] = { 0, 0, 0 };
   const size_t region[] = { width, height, 1 };
   // blocking.
@@ -2039,6 +2626,7 @@ int dt_opencl_read_host_from_device_raw(const int devid, void *host, void *devic
   if(!darktable.opencl->inited) return -1;
 
   cl_event *eventp = dt_opencl_events_get_slot(devid, "[Read Image (from device to host)]");
+  _transfer_stats_add(devid, FALSE, (size_t)rowpitch * region[1] * region[2]);
 
   return (darktable.opencl->dlocl->symbols->dt_clEnqueueReadImage)(darktable.opencl->dev[devid].cmd_queue,
                                                                    device, blocking, origin, region, rowpitch,
@@ -2055,6 +2643,8 @@ int dt_opencl_write_host_to_device_rowpitch(const int devid, void *host, void *d
                                             const int height, const int rowpitch)
 {
   if(!darktable.opencl->inited || devid < 0) return -1;
+  const int rows = _staging_rows(devid, height, rowpitch);
+  if(rows > 0 && _staging_get(devid)) return _staged_write(devid, host, device, width, height, rowpitch, rows);
   const size_t origin[] = { 0, 0, 0 };
   const size_t region[] = { width, height, 1 };
   // blocking.
@@ -2084,12 +2674,79 @@ int dt_opencl_write_host_to_device_raw(const int devid, void *host, void *device
   if(!darktable.opencl->inited) return -1;
 
   cl_event *eventp = dt_opencl_events_get_slot(devid, "[Write Image (from host to device)]");
+  _transfer_stats_add(devid, TRUE, (size_t)rowpitch * region[1] * region[2]);
 
   return (darktable.opencl->dlocl->symbols->dt_clEnqueueWriteImage)(darktable.opencl->dev[devid].cmd_queue,
                                                                     device, blocking, origin, region,
                                                                     rowpitch, 0, host, 0, NULL, eventp);
 }
 
+int dt_opencl_has_transfer_queue(const int devid)
+{
+  if(!darktable.opencl->inited || devid < 0) return FALSE;
+  return darktable.opencl->dev[devid].transfer_queue != NULL;
+}
+
+int dt_opencl_write_host_to_device_overlapped(const int devid, void *host, void *device, const size_t *origin,
+                                              const size_t *region, const int rowpitch, const cl_event *wait,
+                                              cl_event *event)
+{
+  if(!dt_opencl_has_transfer_queue(devid)) return -1;
+  dt_opencl_t *cl = darktable.opencl;
+  _transfer_stats_add(devid, TRUE, (size_t)rowpitch * region[1] * region[2]);
+  const cl_int err = (cl->dlocl->symbols->dt_clEnqueueWriteImage)(
+      cl->dev[devid].transfer_queue, device, CL_FALSE, origin, region, rowpitch, 0, host, wait ? 1 : 0, wait,
+      event);
+  // the command queue may wait for this, so it has to be submitted
+  if(err == CL_SUCCESS) (cl->dlocl->symbols->dt_clFlush)(cl->dev[devid].transfer_queue);
+  return err;
+}
+
+int dt_opencl_read_host_from_device_overlapped(const int devid, void *host, void *device, const size_t *origin,
+                                               const size_t *region, const int rowpitch, const cl_event *wait,
+                                               cl_event *event)
+{
+  if(!dt_opencl_has_transfer_queue(devid)) return -1;
+  dt_opencl_t *cl = darktable.opencl;
+  _transfer_stats_add(devid, FALSE, (size_t)rowpitch * region[1] * region[2]);
+  const cl_int err = (cl->dlocl->symbols->dt_clEnqueueReadImage)(
+      cl->dev[devid].transfer_queue, device, CL_FALSE, origin, region, rowpitch, 0, host, wait ? 1 : 0, wait,
+      event);
+  if(err == CL_SUCCESS) (cl->dlocl->symbols->dt_clFlush)(cl->dev[devid].transfer_queue);
+  return err;
+}
+
+int dt_opencl_enqueue_wait_for_event(const int devid, const cl_event *event)
+{
+  if(!darktable.opencl->inited || devid < 0) return -1;
+  if(!event || !*event) return CL_SUCCESS;
+  return (darktable.opencl->dlocl->symbols->dt_clEnqueueWaitForEvents)(darktable.opencl->dev[devid].cmd_queue,
+                                                                       1, event);
+}
+
+int dt_opencl_enqueue_marker(const int devid, cl_event *event)
+{
+  if(!darktable.opencl->inited || devid < 0) return -1;
+  dt_opencl_t *cl = darktable.opencl;
+  const cl_int err = (cl->dlocl->symbols->dt_clEnqueueMarker)(cl->dev[devid].cmd_queue, event);
+  // the transfer queue may wait for this, so it has to be submitted
+  if(err == CL_SUCCESS) (cl->dlocl->symbols->dt_clFlush)(cl->dev[devid].cmd_queue);
+  return err;
+}
+
+void dt_opencl_release_event(cl_event *event)
+{
+  if(!event || !*event) return;
+  (darktable.opencl->dlocl->symbols->dt_clReleaseEvent)(*event);
+  *event = NULL;
+}
+
+int dt_opencl_finish_transfers(const int devid)
+{
+  if(!dt_opencl_has_transfer_queue(devid)) return -1;
+  return (darktable.opencl->dlocl->symbols->dt_clFinish)(darktable.opencl->dev[devid].transfer_queue);
+}
+
 int dt_opencl_enqueue_copy_image(const int devid, cl_mem src, cl_mem dst, size_t *orig_src, size_t *orig_dst,
                                  size_t *region)
 {
@@ -2148,6 +2805,7 @@ int dt_opencl_read_buffer_from_device(const int devid, void *host, void *device,
   if(!darktable.opencl->inited) return -1;
 
   cl_event *eventp = dt_opencl_events_get_slot(devid, "[Read Buffer (from device to host)]");
+  _transfer_stats_add(devid, FALSE, size);
 
   return (darktable.opencl->dlocl->symbols->dt_clEnqueueReadBuffer)(
       darktable.opencl->dev[devid].cmd_queue, device, blocking, offset, size, host, 0, NULL, eventp);
@@ -2159,6 +2817,7 @@ int dt_opencl_write_buffer_to_device(const int devid, void *host, void *device,
   if(!darktable.opencl->inited) return -1;
 
   cl_event *eventp = dt_opencl_events_get_slot(devid, "[Write Buffer (from host to device)]");
+  _transfer_stats_add(devid, TRUE, size);
 
   return (darktable.opencl->dlocl->symbols->dt_clEnqueueWriteBuffer)(
       darktable.opencl->dev[devid].cmd_queue, device, blocking, offset, size, host, 0, NULL, eventp);
@@ -2216,6 +2875,157 @@ void *dt_opencl_copy_host_to_device_rowpitch(const int devid, void *host, const
 }
 
 
+/* memory pool. creating images and buffers takes milliseconds with some drivers, so released ones are kept
+   per device and handed out again for the same format and size. images have to match exactly, as modules
+   take their dimensions from them; buffers are rounded up to size classes. the idle objects never exceed
+   opencl_memory_pool MB and are released first if the device runs out of memory. */
+typedef struct dt_opencl_pool_block_t
+{
+  cl_mem mem;
+  int bpp, width, height; // 0 for buffers
+  size_t size;
+} dt_opencl_pool_block_t;
+
+// quarter steps between powers of two, so a buffer is at most a quarter larger than asked for
+static size_t _pool_size_class(const size_t size)
+{
+  if(size <= 4096) return 4096;
+  size_t step = 1;
+  while((step << 3) <= size) step <<= 1;
+  return (size + step - 1) & ~(step - 1);
+}
+
+static cl_mem _pool_take(const int devid, const int bpp, const int width, const int height, const size_t size)
+{
+  dt_opencl_device_t *dev = &darktable.opencl->dev[devid];
+  if(!dev->pool_ceiling) return NULL;
+
+  cl_mem mem = NULL;
+  dt_pthread_mutex_lock(&dev->pool_lock);
+  for(GList *l = dev->pool_idle; l; l = g_list_next(l))
+  {
+    dt_opencl_pool_block_t *block = (dt_opencl_pool_block_t *)l->data;
+    if(block->bpp == bpp && block->width == width && block->height == height && block->size == size)
+    {
+      mem = block->mem;
+      dev->pool_idle_size -= block->size;
+      dev->pool_idle = g_list_delete_link(dev->pool_idle, l);
+      g_hash_table_insert(dev->pool_used, mem, block);
+      break;
+    }
+  }
+  dt_pthread_mutex_unlock(&dev->pool_lock);
+  return mem;
+}
+
+// remembers a new object, so it goes to the pool instead of the driver when released
+static void _pool_track(const int devid, cl_mem mem, const int bpp, const int width, const int height,
+                        const size_t size)
+{
+  dt_opencl_device_t *dev = &darktable.opencl->dev[devid];
+  if(!dev->pool_ceiling || !mem || size > dev->pool_ceiling) return;
+
+  dt_opencl_pool_block_t *block = (dt_opencl_pool_block_t *)malloc(sizeof(dt_opencl_pool_block_t));
+  if(!block) return;
+  *block = (dt_opencl_pool_block_t){ mem, bpp, width, height, size };
+  dt_pthread_mutex_lock(&dev->pool_lock);
+  if(!dev->pool_used) dev->pool_used = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, free);
+  g_hash_table_insert(dev->pool_used, mem, block);
+  dt_pthread_mutex_unlock(&dev->pool_lock);
+}
+
+// drops the objects which have been idle the longest until at most keep bytes are left, under pool_lock. the
+// dropped blocks are returned for _pool_release() once the lock is gone.
+static GList *_pool_trim(dt_opencl_device_t *dev, const size_t keep)
+{
+  GList *released = NULL;
+  while(dev->pool_idle && dev->pool_idle_size > keep)
+  {
+    GList *oldest = g_list_last(dev->pool_idle);
+    dev->pool_idle_size -= ((dt_opencl_pool_block_t *)oldest->data)->size;
+    dev->pool_idle = g_list_remove_link(dev->pool_idle, oldest);
+    released = g_list_concat(oldest, released);
+  }
+  return released;
+}
+
+static void _pool_release(GList *released)
+{
+  for(GList *l = released; l; l = g_list_next(l))
+  {
+    dt_opencl_pool_block_t *block = (dt_opencl_pool_block_t *)l->data;
+    (darktable.opencl->dlocl->symbols->dt_clReleaseMemObject)(block->mem);
+    free(block);
+  }
+  g_list_free(released);
+}
+
+// returns TRUE if the object now belongs to the pool. the device may still use it, but any later use of a
+// recycled object is enqueued behind that on the same in-order queue.
+static int _pool_give(cl_mem mem)
+{
+  const int devid = dt_opencl_get_mem_context_id(mem);
+  if(devid < 0) return FALSE;
+  dt_opencl_device_t *dev = &darktable.opencl->dev[devid];
+  if(!dev->pool_ceiling) return FALSE;
+
+  GList *released = NULL;
+  dt_pthread_mutex_lock(&dev->pool_lock);
+  dt_opencl_pool_block_t *block = dev->pool_used ? g_hash_table_lookup(dev->pool_used, mem) : NULL;
+  if(block)
+  {
+    g_hash_table_steal(dev->pool_used, mem);
+    released = _pool_trim(dev, dev->pool_ceiling - block->size);
+    dev->pool_idle = g_list_prepend(dev->pool_idle, block);
+    dev->pool_idle_size += block->size;
+  }
+  dt_pthread_mutex_unlock(&dev->pool_lock);
+
+  _pool_release(released);
+  return block != NULL;
+}
+
+// the idle objects are charged to the budget of the pixelpipe caches, whose intermediates they hold
+static size_t _pool_governor_usage(gpointer user_data)
+{
+  dt_opencl_device_t *dev = (dt_opencl_device_t *)user_data;
+  dt_pthread_mutex_lock(&dev->pool_lock);
+  const size_t usage = dev->pool_idle_size;
+  dt_pthread_mutex_unlock(&dev->pool_lock);
+  return usage;
+}
+
+static size_t _pool_governor_shrink(gpointer user_data, const size_t bytes)
+{
+  dt_opencl_device_t *dev = (dt_opencl_device_t *)user_data;
+  dt_pthread_mutex_lock(&dev->pool_lock);
+  const size_t before = dev->pool_idle_size;
+  GList *released = _pool_trim(dev, before > bytes ? before - bytes : 0);
+  const size_t freed = before - dev->pool_idle_size;
+  dt_pthread_mutex_unlock(&dev->pool_lock);
+
+  _pool_release(released);
+  return freed;
+}
+
+int dt_opencl_memory_pool_flush(const int devid)
+{
+  if(devid < 0 || devid >= darktable.opencl->num_devs) return FALSE;
+  dt_opencl_device_t *dev = &darktable.opencl->dev[devid];
+
+  dt_pthread_mutex_lock(&dev->pool_lock);
+  GList *released = dev->pool_idle;
+  dev->pool_idle = NULL;
+  dev->pool_idle_size = 0;
+  dt_pthread_mutex_unlock(&dev->pool_lock);
+
+  _pool_release(released);
+  if(released)
+    dt_print(DT_DEBUG_OPENCL | DT_DEBUG_MEMORY, "[opencl memory pool] released idle objects of device %d\n",
+             devid);
+  return released != NULL;
+}
+
 void dt_opencl_release_mem_object(cl_mem mem)
 {
   if(!darktable.opencl->inited) return;
@@ -2226,6 +3036,8 @@ void dt_opencl_release_mem_object(cl_mem mem)
 
   dt_opencl_memory_statistics(-1, mem, OPENCL_MEMORY_SUB);
 
+  if(_pool_give(mem)) return;
+
   (darktable.opencl->dlocl->symbols->dt_clReleaseMemObject)(mem);
 }
 
@@ -2269,11 +3081,22 @@ void *dt_opencl_alloc_device(const int devid, const int width, const int height,
   else
     return NULL;
 
-  cl_mem dev = (darktable.opencl->dlocl->symbols->dt_clCreateImage2D)(
-      darktable.opencl->dev[devid].context, CL_MEM_READ_WRITE, &fmt, width, height, 0, NULL, &err);
-  if(err != CL_SUCCESS)
-    dt_print(DT_DEBUG_OPENCL, "[opencl alloc_device] could not alloc img buffer on device %d: %d\n", devid,
-             err);
+  const size_t size = (size_t)width * height * bpp;
+  cl_mem dev = _pool_take(devid, bpp, width, height, size);
+  if(dev == NULL)
+  {
+    dev = (darktable.opencl->dlocl->symbols->dt_clCreateImage2D)(
+        darktable.opencl->dev[devid].context, CL_MEM_READ_WRITE, &fmt, width, height, 0, NULL, &err);
+    // idle pool objects are the first to go if memory gets short
+    if(err != CL_SUCCESS && dt_opencl_memory_pool_flush(devid))
+      dev = (darktable.opencl->dlocl->symbols->dt_clCreateImage2D)(
+          darktable.opencl->dev[devid].context, CL_MEM_READ_WRITE, &fmt, width, height, 0, NULL, &err);
+    if(err != CL_SUCCESS)
+      dt_print(DT_DEBUG_OPENCL, "[opencl alloc_device] could not alloc img buffer on device %d: %d\n", devid,
+               err);
+    else
+      _pool_track(devid, dev, bpp, width, height, size);
+  }
 
   dt_opencl_memory_statistics(devid, dev, OPENCL_MEMORY_ADD);
 
@@ -2315,13 +3138,25 @@ void *dt_opencl_alloc_device_use_host_pointer(const int devid, const int width,
 void *dt_opencl_alloc_device_buffer(const int devid, const size_t size)
 {
   if(!darktable.opencl->inited) return NULL;
-  cl_int err;
-
-  cl_mem buf = (darktable.opencl->dlocl->symbols->dt_clCreateBuffer)(darktable.opencl->dev[devid].context,
-                                                                     CL_MEM_READ_WRITE, size, NULL, &err);
-  if(err != CL_SUCCESS)
-    dt_print(DT_DEBUG_OPENCL, "[opencl alloc_device_buffer] could not alloc buffer on device %d: %d\n", devid,
-             err);
+  cl_int err = CL_SUCCESS;
+
+  const size_t pool_size = _pool_size_class(size);
+  cl_mem buf = _pool_take(devid, 0, 0, 0, pool_size);
+  if(buf == NULL)
+  {
+    // sizes only get rounded up for objects the pool may keep
+    const size_t alloc_size = pool_size <= darktable.opencl->dev[devid].pool_ceiling ? pool_size : size;
+    buf = (darktable.opencl->dlocl->symbols->dt_clCreateBuffer)(darktable.opencl->dev[devid].context,
+                                                                CL_MEM_READ_WRITE, alloc_size, NULL, &err);
+    if(err != CL_SUCCESS && dt_opencl_memory_pool_flush(devid))
+      buf = (darktable.opencl->dlocl->symbols->dt_clCreateBuffer)(darktable.opencl->dev[devid].context,
+                                                                  CL_MEM_READ_WRITE, alloc_size, NULL, &err);
+    if(err != CL_SUCCESS)
+      dt_print(DT_DEBUG_OPENCL, "[opencl alloc_device_buffer] could not alloc buffer on device %d: %d\n",
+               devid, err);
+    else if(alloc_size == pool_size)
+      _pool_track(devid, buf, 0, 0, 0, pool_size);
+  }
 
   dt_opencl_memory_statistics(devid, buf, OPENCL_MEMORY_ADD);
 
@@ -2413,7 +3248,8 @@ int dt_opencl_get_image_element_size(cl_mem mem)
 
 void dt_opencl_memory_statistics(int devid, cl_mem mem, dt_opencl_memory_t action)
 {
-  if(!((darktable.unmuted & DT_DEBUG_MEMORY) && (darktable.unmuted & DT_DEBUG_OPENCL)))
+  if(!((darktable.unmuted & DT_DEBUG_MEMORY) && (darktable.unmuted & DT_DEBUG_OPENCL))
+     && !darktable.opencl->track_memory && !dt_memory_accounting_enabled())
     return;
 
   if(devid < 0)
@@ -2422,13 +3258,17 @@ void dt_opencl_memory_statistics(int devid, cl_mem mem, dt_opencl_memory_t actio
   if(devid < 0)
     return;
 
+  const size_t size = dt_opencl_get_mem_object_size(mem);
   if(action == OPENCL_MEMORY_ADD)
-    darktable.opencl->dev[devid].memory_in_use += dt_opencl_get_mem_object_size(mem);
+    darktable.opencl->dev[devid].memory_in_use += size;
   else
-    darktable.opencl->dev[devid].memory_in_use -= dt_opencl_get_mem_object_size(mem);
+    darktable.opencl->dev[devid].memory_in_use -= size;
+  dt_memory_accounting_device(action == OPENCL_MEMORY_ADD ? (int64_t)size : -(int64_t)size);
 
   darktable.opencl->dev[devid].peak_memory = MAX(darktable.opencl->dev[devid].peak_memory,
                                                  darktable.opencl->dev[devid].memory_in_use);
+  darktable.opencl->dev[devid].peak_since_mark = MAX(darktable.opencl->dev[devid].peak_since_mark,
+                                                     darktable.opencl->dev[devid].memory_in_use);
 
   if(darktable.unmuted & DT_DEBUG_MEMORY)
     dt_print(DT_DEBUG_OPENCL,
@@ -2436,6 +3276,20 @@ void dt_opencl_memory_statistics(int devid, cl_mem mem, dt_opencl_memory_t actio
                                       (float)darktable.opencl->dev[devid].memory_in_use/(1024*1024));
 }
 
+void dt_opencl_memory_mark(const int devid)
+{
+  if(!darktable.opencl->inited || devid < 0) return;
+  darktable.opencl->dev[devid].mark_memory = darktable.opencl->dev[devid].peak_since_mark
+      = darktable.opencl->dev[devid].memory_in_use;
+}
+
+size_t dt_opencl_memory_peak_since_mark(const int devid)
+{
+  if(!darktable.opencl->inited || devid < 0) return 0;
+  const dt_opencl_device_t *dev = &darktable.opencl->dev[devid];
+  return dev->peak_since_mark > dev->mark_memory ? dev->peak_since_mark - dev->mark_memory : 0;
+}
+
 /** check if image size fit into limits given by OpenCL runtime */
 int dt_opencl_image_fits_device(const int devid, const size_t width, const size_t height, const unsigned bpp,
                                 const float factor, const size_t overhead)
@@ -2518,9 +3372,9 @@ void dt_opencl_disable(void)
 /** update enabled flag and profile with value from preferences, returns enabled flag */
 int dt_opencl_update_settings(void)
 {
-  // FIXME: This pulls in prefs every time the pixelpipe runs. Instead have a callback for DT_SIGNAL_PREFERENCES_CHANGE?
+  // this runs for every pipe, the preferences are read from their parsed values without locking
   if(!darktable.opencl->inited) return FALSE;
-  const int prefs = dt_conf_get_bool("opencl");
+  const int prefs = dt_conf_value_bool(darktable.opencl->conf_enabled);
 
   if(darktable.opencl->enabled != prefs)
   {
@@ -2534,30 +3388,38 @@ int dt_opencl_update_settings(void)
 
   if(darktable.opencl->scheduling_profile != profile)
   {
-    char *pstr = dt_conf_get_string("opencl_scheduling_profile");
-    dt_print(DT_DEBUG_OPENCL, "[opencl_update_scheduling_profile] scheduling profile set to %s\n", pstr);
-    g_free(pstr);
+    dt_print(DT_DEBUG_OPENCL, "[opencl_update_scheduling_profile] scheduling profile set to %s\n",
+             dt_conf_value_string(darktable.opencl->conf_scheduling_profile));
     dt_opencl_apply_scheduling_profile(profile);
   }
 
-  dt_opencl_sync_cache_t sync = dt_opencl_get_sync_cache();
+  dt_opencl_sync_cache_t sync = dt_opencl_get_sync_cache(darktable.opencl->conf_sync_cache);
 
   if(darktable.opencl->sync_cache != sync)
   {
-    char *pstr = dt_conf_get_string("opencl_synch_cache");
-    dt_print(DT_DEBUG_OPENCL, "[opencl_update_synch_cache] sync cache set to %s\n", pstr);
-    g_free(pstr);
+    dt_print(DT_DEBUG_OPENCL, "[opencl_update_synch_cache] sync cache set to %s\n",
+             dt_conf_value_string(darktable.opencl->conf_sync_cache));
     darktable.opencl->sync_cache = sync;
   }
 
+  sync = dt_opencl_get_sync_cache(darktable.opencl->conf_sync_cache_preview);
+
+  if(darktable.opencl->sync_cache_preview != sync)
+  {
+    dt_print(DT_DEBUG_OPENCL, "[opencl_update_synch_cache] sync cache of the preview set to %s\n",
+             dt_conf_value_string(darktable.opencl->conf_sync_cache_preview));
+    darktable.opencl->sync_cache_preview = sync;
+  }
+
+  darktable.opencl->sync_checkpoint = dt_conf_value_int(darktable.opencl->conf_sync_checkpoint) / 1000.0f;
+
   return (darktable.opencl->enabled && !darktable.opencl->stopped);
 }
 
 /** read scheduling profile for config variables */
 static dt_opencl_scheduling_profile_t dt_opencl_get_scheduling_profile(void)
 {
-  char *pstr = dt_conf_get_string("opencl_scheduling_profile");
-  if(!pstr) return OPENCL_PROFILE_DEFAULT;
+  const char *pstr = dt_conf_value_string(darktable.opencl->conf_scheduling_profile);
 
   dt_opencl_scheduling_profile_t profile = OPENCL_PROFILE_DEFAULT;
 
@@ -2566,26 +3428,23 @@ static dt_opencl_scheduling_profile_t dt_opencl_get_scheduling_profile(void)
   else if(!strcmp(pstr, "very fast GPU"))
     profile = OPENCL_PROFILE_VERYFAST_GPU;
 
-  g_free(pstr);
-
   return profile;
 }
 
 /** read config of when/if to synch to cache */
-static dt_opencl_sync_cache_t dt_opencl_get_sync_cache(void)
+static dt_opencl_sync_cache_t dt_opencl_get_sync_cache(const dt_conf_value_t *conf)
 {
-  char *pstr = dt_conf_get_string("opencl_synch_cache");
-  if(!pstr) return OPENCL_SYNC_ACTIVE_MODULE;
+  const char *pstr = dt_conf_value_string(conf);
 
   dt_opencl_sync_cache_t sync = OPENCL_SYNC_ACTIVE_MODULE;
 
   if(!strcmp(pstr, "true"))
     sync = OPENCL_SYNC_TRUE;
+  else if(!strcmp(pstr, "checkpoints"))
+    sync = OPENCL_SYNC_CHECKPOINTS;
   else if(!strcmp(pstr, "false"))
     sync = OPENCL_SYNC_FALSE;
 
-  g_free(pstr);
-
   return sync;
 }
 
@@ -2851,9 +3710,9 @@ cl_int dt_opencl_events_flush(const int devid, const int reset)
     else
       (*totalsuccess)++;
 
-    if(darktable.unmuted & DT_DEBUG_PERF)
+    if((darktable.unmuted & DT_DEBUG_PERF) || cl->kernel_statistics)
     {
-      // get profiling info of event (only if darktable was called with '-d perf')
+      // get profiling info of event (only if darktable was called with '-d perf' or statistics are kept)
       cl_ulong start;
       cl_ulong end;
       cl_int errs = (cl->dlocl->symbols->dt_clGetEventProfilingInfo)(
@@ -2863,6 +3722,7 @@ cl_int dt_opencl_events_flush(const int devid, const int reset)
       if(errs == CL_SUCCESS && erre == CL_SUCCESS)
       {
         (*eventtags)[k].timelapsed = end - start;
+        if(cl->kernel_statistics && *retval == CL_COMPLETE) _kernel_stats_record(devid, tag, end - start);
       }
       else
       {
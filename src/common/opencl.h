@@ -30,6 +30,7 @@
 #define DT_OPENCL_MAX_EVENTS 256
 #define DT_OPENCL_MAX_ERRORS 5
 #define DT_OPENCL_MAX_INCLUDES 5
+#define DT_OPENCL_STATS_BUCKETS 96
 
 #include "common/darktable.h"
 
@@ -66,7 +67,8 @@ typedef enum dt_opencl_sync_cache_t
 {
   OPENCL_SYNC_TRUE,
   OPENCL_SYNC_ACTIVE_MODULE,
-  OPENCL_SYNC_FALSE
+  OPENCL_SYNC_FALSE,
+  OPENCL_SYNC_CHECKPOINTS // as active module, and the output of the modules which took long
 } dt_opencl_sync_cache_t;
 
 /**
@@ -79,6 +81,17 @@ typedef struct dt_opencl_eventtag_t
   char tag[DT_OPENCL_EVENTNAMELENGTH];
 } dt_opencl_eventtag_t;
 
+/**
+ * run times of one kernel or transfer command on a device, see dt_opencl_get_kernel_stats().
+ */
+typedef struct dt_opencl_kernel_stats_t
+{
+  char name[DT_OPENCL_EVENTNAMELENGTH];
+  int count;
+  double total; // all in seconds
+  double p50;
+  double p99;
+} dt_opencl_kernel_stats_t;
 
 /**
  * to support multi-gpu and mixed systems with cpu support,
@@ -90,6 +103,8 @@ typedef struct dt_opencl_device_t
   cl_device_id devid;
   cl_context context;
   cl_command_queue cmd_queue;
+  // second queue to move tiles between host and device while the kernels run, NULL if not available
+  cl_command_queue transfer_queue;
   size_t max_image_width;
   size_t max_image_height;
   cl_ulong max_mem_alloc;
@@ -99,6 +114,14 @@ typedef struct dt_opencl_device_t
   cl_kernel kernel[DT_OPENCL_MAX_KERNELS];
   int program_used[DT_OPENCL_MAX_PROGRAMS];
   int kernel_used[DT_OPENCL_MAX_KERNELS];
+  // programs without a cached binary are built in the background. until then their kernels are NULL and
+  // the device is not handed out to pipes. kernels are remembered by name for that and for the statistics.
+  int program_ready[DT_OPENCL_MAX_PROGRAMS];
+  char *kernel_name[DT_OPENCL_MAX_KERNELS];
+  int kernel_program[DT_OPENCL_MAX_KERNELS];
+  GList *pending_programs;
+  int programs_pending;
+  int build_failed;
   cl_event *eventlist;
   dt_opencl_eventtag_t *eventtags;
   int numevents;
@@ -117,6 +140,25 @@ typedef struct dt_opencl_device_t
   float benchmark;
   size_t memory_in_use;
   size_t peak_memory;
+  // memory in use at the last dt_opencl_memory_mark() and the peak since then
+  size_t mark_memory;
+  size_t peak_since_mark;
+  // released images and buffers kept for the next allocation of the same kind
+  dt_pthread_mutex_t pool_lock;
+  GList *pool_idle;      // most recently released first
+  GHashTable *pool_used; // cl_mem -> block of the objects handed out
+  size_t pool_idle_size;
+  size_t pool_ceiling;
+  // run times of the kernels by name and bytes moved between host and device
+  dt_pthread_mutex_t stats_lock;
+  GHashTable *kernel_stats;
+  size_t bytes_to_device;
+  size_t bytes_from_device;
+  // pinned host memory full image transfers are staged through, two halves so copy and transfer overlap
+  cl_mem staging;
+  void *staging_host;
+  size_t staging_size;
+  int staging_failed;
 } dt_opencl_device_t;
 
 struct dt_bilateral_cl_global_t;
@@ -125,6 +167,7 @@ struct dt_dwt_cl_global_t; // wavelet decompose
 struct dt_heal_cl_global_t; // healing
 struct dt_colorspaces_cl_global_t; // colorspaces transform
 struct dt_guided_filter_cl_global_t;
+struct dt_histogram_cl_global_t;
 
 /**
  * main struct, stored in darktable.opencl.
@@ -137,9 +180,17 @@ typedef struct dt_opencl_t
   int avoid_atomics;
   int use_events;
   int async_pixelpipe;
+  int async_export;
   int number_event_handles;
   int print_statistics;
-  dt_opencl_sync_cache_t sync_cache;
+  int track_memory;
+  int kernel_statistics;
+  pthread_t build_thread;
+  int build_thread_started;
+  int build_shutdown;
+  int benchmark_pending;
+  dt_opencl_sync_cache_t sync_cache, sync_cache_preview;
+  float sync_checkpoint; // seconds a module has to take for OPENCL_SYNC_CHECKPOINTS to copy back its output
   int micro_nap;
   int enabled;
   int stopped;
@@ -147,6 +198,9 @@ typedef struct dt_opencl_t
   int error_count;
   int opencl_synchronization_timeout;
   dt_opencl_scheduling_profile_t scheduling_profile;
+  // opencl, opencl_scheduling_profile and opencl_synch_cache*, checked before every pipe run
+  const struct dt_conf_value_t *conf_enabled, *conf_scheduling_profile, *conf_sync_cache;
+  const struct dt_conf_value_t *conf_sync_cache_preview, *conf_sync_checkpoint;
   uint32_t crc;
   int mandatory[5];
   int *dev_priority_image;
@@ -183,6 +237,9 @@ typedef struct dt_opencl_t
 
   // global kernels for guided filter.
   struct dt_guided_filter_cl_global_t *guided_filter;
+
+  // global kernels for histogram collection.
+  struct dt_histogram_cl_global_t *histogram;
 } dt_opencl_t;
 
 /** description of memory requirements of local buffer
@@ -218,12 +275,23 @@ int dt_opencl_finish(const int devid);
 /** enqueues a synchronization point. */
 int dt_opencl_enqueue_barrier(const int devid);
 
+/** true if a pipe of the given type has to wait for the device after every module (or tile).
+ * otherwise work is only enqueued and the pipe waits once for its final output; errors are then
+ * detected late and the whole pipe is reprocessed on the cpu. */
+int dt_opencl_pipe_is_synchronous(const int pipe_type);
+
+/** number of devices a single export may be split across, 1 unless opencl_multi_device_export is set. */
+int dt_opencl_export_devices(void);
+
 /** locks a device for your thread's exclusive use */
 int dt_opencl_lock_device(const int pipetype);
 
 /** done with your command queue. */
 void dt_opencl_unlock_device(const int dev);
 
+/** true once all programs of the device are built, so pipes may use it. */
+int dt_opencl_device_ready(const int devid);
+
 /** calculates md5sums for a list of CL include files. */
 void dt_opencl_md5sum(const char **files, char **md5sums);
 
@@ -310,6 +378,30 @@ int dt_opencl_write_host_to_device_rowpitch_non_blocking(const int devid, void *
 int dt_opencl_write_host_to_device_raw(const int devid, void *host, void *device, const size_t *origin,
                                        const size_t *region, const int rowpitch, const int blocking);
 
+/** overlapped transfers: they go through the transfer queue of the device and don't block. each waits for
+ * the event in wait (may be NULL) and returns a new event the caller has to release. */
+int dt_opencl_has_transfer_queue(const int devid);
+
+int dt_opencl_write_host_to_device_overlapped(const int devid, void *host, void *device, const size_t *origin,
+                                              const size_t *region, const int rowpitch, const cl_event *wait,
+                                              cl_event *event);
+
+int dt_opencl_read_host_from_device_overlapped(const int devid, void *host, void *device, const size_t *origin,
+                                               const size_t *region, const int rowpitch, const cl_event *wait,
+                                               cl_event *event);
+
+/** makes everything enqueued on the command queue from now on wait for the event (may be NULL). */
+int dt_opencl_enqueue_wait_for_event(const int devid, const cl_event *event);
+
+/** returns an event completing with all work enqueued on the command queue so far. */
+int dt_opencl_enqueue_marker(const int devid, cl_event *event);
+
+/** releases an event returned by the functions above, NULL is fine. */
+void dt_opencl_release_event(cl_event *event);
+
+/** waits until all transfers of the device are done. */
+int dt_opencl_finish_transfers(const int devid);
+
 void *dt_opencl_copy_host_to_device(const int devid, void *host, const int width, const int height,
                                     const int bpp);
 
@@ -364,6 +456,16 @@ int dt_opencl_get_mem_context_id(cl_mem mem);
 
 void dt_opencl_memory_statistics(int devid, cl_mem mem, dt_opencl_memory_t action);
 
+/** starts a new interval for dt_opencl_memory_peak_since_mark(). memory_in_use is only kept up to date with
+    memory debugging or tiling calibration enabled. */
+void dt_opencl_memory_mark(const int devid);
+
+/** peak device memory allocated on top of what was in use at the last mark */
+size_t dt_opencl_memory_peak_since_mark(const int devid);
+
+/** releases the idle images and buffers kept for reuse, returns TRUE if there were any */
+int dt_opencl_memory_pool_flush(const int devid);
+
 /** check if image size fit into limits given by OpenCL runtime */
 int dt_opencl_image_fits_device(const int devid, const size_t width, const size_t height, const unsigned bpp,
                                 const float factor, const size_t overhead);
@@ -391,6 +493,13 @@ cl_int dt_opencl_events_flush(const int devid, const int reset);
 /** display OpenCL profiling information. If summary is not 0, try to generate summarized info for kernels */
 void dt_opencl_events_profiling(const int devid, const int aggregated);
 
+/** run times of the kernels and transfers on the device so far as a list of dt_opencl_kernel_stats_t, which
+    the caller frees with g_list_free_full(list, g_free). */
+GList *dt_opencl_get_kernel_stats(const int devid);
+
+/** bytes moved between host and device so far. */
+void dt_opencl_get_transfer_stats(const int devid, size_t *to_device, size_t *from_device);
+
 /** utility function to calculate optimal work group dimensions for a given kernel */
 int dt_opencl_local_buffer_opt(const int devid, const int kernel, dt_opencl_local_buffer_t *factors);
 
@@ -477,6 +586,10 @@ static inline int dt_opencl_is_inited(void)
 {
   return 0;
 }
+static inline int dt_opencl_export_devices(void)
+{
+  return 1;
+}
 static inline int dt_opencl_is_enabled(void)
 {
   return 0;
@@ -269,41 +269,141 @@ static size_t _pdf_stream_encoder_ASCIIHex(dt_pdf_t *pdf, const unsigned char *d
   return len * 2;
 }
 
-// using zlib we get quite small files, but it's slow
-static size_t _pdf_stream_encoder_Flate(dt_pdf_t *pdf, const unsigned char *data, size_t len)
+// using zlib we get quite small files, but it's slow. the data may come in pieces, Z_FINISH completes the
+// stream. returns FALSE on errors. for images this runs in a thread of its own, see _pdf_flate_t
+static gboolean _pdf_stream_encoder_Flate(dt_pdf_t *pdf, z_stream *stream, const unsigned char *data, size_t len,
+                                          const int flush, size_t *stream_size)
 {
-  int result;
-  uLongf destLen = compressBound(len);
-  unsigned char *buffer = (unsigned char *)malloc(destLen);
+  unsigned char buffer[1 << 16];
+  do
+  {
+    // avail_in is only 32 bits wide
+    const size_t chunk = MIN(len, (size_t)1 << 30);
+    stream->next_in = (Bytef *)data;
+    stream->avail_in = chunk;
+    if(data) data += chunk;
+    len -= chunk;
+    const int mode = len ? Z_NO_FLUSH : flush;
+    do
+    {
+      stream->next_out = buffer;
+      stream->avail_out = sizeof(buffer);
+      if(deflate(stream, mode) == Z_STREAM_ERROR) return FALSE;
+      const size_t n = sizeof(buffer) - stream->avail_out;
+      if(fwrite(buffer, 1, n, pdf->fd) != n) return FALSE;
+      *stream_size += n;
+    } while(stream->avail_out == 0);
+  } while(len);
+  return TRUE;
+}
+
+// the rows of an image are deflated and written in a thread next to the one handing them over, that only copies
+// them into a queue of at most DT_PDF_FLATE_QUEUE bands. whole images are handed over in bands of
+// DT_PDF_BAND_ROWS rows, so the copies stay small.
+#define DT_PDF_FLATE_QUEUE 2
+#define DT_PDF_BAND_ROWS 64
 
-  result = compress(buffer, &destLen, data, len);
+typedef struct _pdf_band_t
+{
+  size_t len; // 0 ends the stream
+  unsigned char data[];
+} _pdf_band_t;
 
-  if(result != Z_OK)
+typedef struct _pdf_flate_t
+{
+  z_stream stream;
+  dt_pdf_t *pdf;
+  GThread *thread;
+  GAsyncQueue *bands;
+  GMutex lock;
+  GCond cond;
+  int queued;       // bands waiting in the queue, guarded by lock
+  gboolean failed;  // guarded by lock
+  size_t stream_size;
+} _pdf_flate_t;
+
+static gpointer _pdf_flate_worker(gpointer data)
+{
+  _pdf_flate_t *flate = (_pdf_flate_t *)data;
+  gboolean failed = FALSE, last = FALSE;
+  while(!last)
   {
-    free(buffer);
-    return 0;
+    _pdf_band_t *band = g_async_queue_pop(flate->bands);
+    last = band->len == 0;
+    if(!failed)
+      failed = !_pdf_stream_encoder_Flate(flate->pdf, &flate->stream, last ? NULL : band->data, band->len,
+                                          last ? Z_FINISH : Z_NO_FLUSH, &flate->stream_size);
+    free(band);
+
+    g_mutex_lock(&flate->lock);
+    flate->queued--;
+    flate->failed = failed;
+    g_cond_signal(&flate->cond);
+    g_mutex_unlock(&flate->lock);
   }
+  return NULL;
+}
 
-  fwrite(buffer, 1, destLen, pdf->fd);
-
-  free(buffer);
-  return destLen;
+// returns FALSE if the stream is broken
+static gboolean _pdf_flate_push(_pdf_flate_t *flate, const unsigned char *data, size_t len)
+{
+  g_mutex_lock(&flate->lock);
+  while(flate->queued >= DT_PDF_FLATE_QUEUE && !flate->failed) g_cond_wait(&flate->cond, &flate->lock);
+  const gboolean failed = flate->failed;
+  if(!failed) flate->queued++;
+  g_mutex_unlock(&flate->lock);
+  if(failed) return FALSE;
+
+  _pdf_band_t *band = malloc(sizeof(_pdf_band_t) + len);
+  if(!band)
+  {
+    g_mutex_lock(&flate->lock);
+    flate->queued--;
+    g_mutex_unlock(&flate->lock);
+    return FALSE;
+  }
+  band->len = len;
+  if(len) memcpy(band->data, data, len);
+  g_async_queue_push(flate->bands, band);
+  return TRUE;
 }
 
-static size_t _pdf_write_stream(dt_pdf_t *pdf, dt_pdf_stream_encoder_t encoder, const unsigned char *data, size_t len)
+static _pdf_flate_t *_pdf_flate_new(dt_pdf_t *pdf)
 {
-  size_t stream_size = 0;
-  switch(encoder)
+  _pdf_flate_t *flate = calloc(1, sizeof(_pdf_flate_t));
+  if(!flate) return NULL;
+  if(deflateInit(&flate->stream, Z_DEFAULT_COMPRESSION) != Z_OK)
   {
-    case DT_PDF_STREAM_ENCODER_ASCII_HEX:
-      stream_size = _pdf_stream_encoder_ASCIIHex(pdf, data, len);
-      break;
-    case DT_PDF_STREAM_ENCODER_FLATE:
-      stream_size = _pdf_stream_encoder_Flate(pdf, data, len);
-      break;
+    free(flate);
+    return NULL;
   }
-  pdf->bytes_written += stream_size;
-  return stream_size;
+  flate->pdf = pdf;
+  flate->bands = g_async_queue_new();
+  g_mutex_init(&flate->lock);
+  g_cond_init(&flate->cond);
+  flate->thread = g_thread_new("pdf deflate", _pdf_flate_worker, flate);
+  return flate;
+}
+
+// finishes the stream, waits for the thread and frees it all. returns FALSE on errors
+static gboolean _pdf_flate_end(_pdf_flate_t *flate, size_t *stream_size)
+{
+  // the end marker has to go in even if the stream failed, it stops the thread
+  _pdf_band_t *band = calloc(1, sizeof(_pdf_band_t));
+  g_mutex_lock(&flate->lock);
+  flate->queued++;
+  g_mutex_unlock(&flate->lock);
+  g_async_queue_push(flate->bands, band);
+  g_thread_join(flate->thread);
+
+  const gboolean ok = !flate->failed;
+  *stream_size = flate->stream_size;
+  deflateEnd(&flate->stream);
+  g_async_queue_unref(flate->bands);
+  g_mutex_clear(&flate->lock);
+  g_cond_clear(&flate->cond);
+  free(flate);
+  return ok;
 }
 
 int dt_pdf_add_icc(dt_pdf_t *pdf, const char *filename)
@@ -383,7 +483,25 @@ int dt_pdf_add_icc_from_data(dt_pdf_t *pdf, const unsigned char *data, size_t si
 // if image == NULL only the outline can be shown later
 dt_pdf_image_t *dt_pdf_add_image(dt_pdf_t *pdf, const unsigned char *image, int width, int height, int bpp, int icc_id, float border)
 {
-  size_t stream_size = 0;
+  dt_pdf_image_t *pdf_image = dt_pdf_add_image_begin(pdf, image == NULL, width, height, bpp, icc_id, border);
+  if(!pdf_image || pdf_image->outline_mode) return pdf_image;
+
+  // the end also frees the encoder after an error
+  const size_t row_size = (size_t)width * 3 * (bpp / 8);
+  int err = 0;
+  for(int y = 0; y < height && !err; y += DT_PDF_BAND_ROWS)
+    err = dt_pdf_add_image_rows(pdf, pdf_image, image + y * row_size, MIN(DT_PDF_BAND_ROWS, height - y));
+  if(dt_pdf_add_image_end(pdf, pdf_image) || err)
+  {
+    free(pdf_image);
+    return NULL;
+  }
+  return pdf_image;
+}
+
+dt_pdf_image_t *dt_pdf_add_image_begin(dt_pdf_t *pdf, gboolean outline_mode, int width, int height, int bpp,
+                                       int icc_id, float border)
+{
   size_t bytes_written = 0;
 
   dt_pdf_image_t *pdf_image = calloc(1, sizeof(dt_pdf_image_t));
@@ -391,7 +509,8 @@ dt_pdf_image_t *dt_pdf_add_image(dt_pdf_t *pdf, const unsigned char *image, int
 
   pdf_image->width = width;
   pdf_image->height = height;
-  pdf_image->outline_mode = (image == NULL);
+  pdf_image->bpp = bpp;
+  pdf_image->outline_mode = outline_mode;
   // no need to do fancy math here:
   pdf_image->bb_x = border;
   pdf_image->bb_y = border;
@@ -404,7 +523,7 @@ dt_pdf_image_t *dt_pdf_add_image(dt_pdf_t *pdf, const unsigned char *image, int
   pdf_image->object_id = pdf->next_id++;
   pdf_image->name_id = pdf->next_image++;
 
-  int length_id = pdf->next_id++;
+  pdf_image->length_id = pdf->next_id++;
 
   // the image
   //start
@@ -431,17 +550,54 @@ dt_pdf_image_t *dt_pdf_add_image(dt_pdf_t *pdf, const unsigned char *image, int
     "/Length %d 0 R\n"
     ">>\n"
     "stream\n",
-    bpp, length_id
+    bpp, pdf_image->length_id
   );
 
-  // the stream
-  stream_size = _pdf_write_stream(pdf, pdf->default_encoder, image, width * height * 3 * (bpp / 8));
-  if(stream_size == 0)
+  pdf->bytes_written += bytes_written;
+  pdf_image->size = bytes_written;
+
+  if(pdf->default_encoder == DT_PDF_STREAM_ENCODER_FLATE)
   {
-    free(pdf_image);
-    return NULL;
+    pdf_image->encoder = _pdf_flate_new(pdf);
+    if(!pdf_image->encoder)
+    {
+      free(pdf_image);
+      return NULL;
+    }
   }
-  bytes_written += stream_size;
+
+  return pdf_image;
+}
+
+// the next n_rows rows of the image, from the top. deflated rows are only counted in dt_pdf_add_image_end()
+int dt_pdf_add_image_rows(dt_pdf_t *pdf, dt_pdf_image_t *pdf_image, const unsigned char *rows, int n_rows)
+{
+  const size_t len = (size_t)pdf_image->width * n_rows * 3 * (pdf_image->bpp / 8);
+  if(pdf_image->encoder) return !_pdf_flate_push(pdf_image->encoder, rows, len);
+
+  const size_t stream_size = _pdf_stream_encoder_ASCIIHex(pdf, rows, len);
+
+  pdf_image->stream_size += stream_size;
+  pdf_image->size += stream_size;
+  pdf->bytes_written += stream_size;
+  return 0;
+}
+
+int dt_pdf_add_image_end(dt_pdf_t *pdf, dt_pdf_image_t *pdf_image)
+{
+  size_t bytes_written = 0;
+
+  if(pdf_image->encoder)
+  {
+    size_t stream_size = 0;
+    const gboolean ok = _pdf_flate_end(pdf_image->encoder, &stream_size);
+    pdf_image->encoder = NULL;
+    pdf_image->stream_size += stream_size;
+    pdf->bytes_written += stream_size;
+    pdf_image->size += stream_size;
+    if(!ok) return 1;
+  }
+  if(pdf_image->stream_size == 0) return 1;
 
   //end
   bytes_written += fprintf(pdf->fd,
@@ -451,16 +607,16 @@ dt_pdf_image_t *dt_pdf_add_image(dt_pdf_t *pdf, const unsigned char *image, int
   );
 
   // length of the last stream
-  _pdf_set_offset(pdf, length_id, pdf->bytes_written + bytes_written);
+  _pdf_set_offset(pdf, pdf_image->length_id, pdf->bytes_written + bytes_written);
   bytes_written += fprintf(pdf->fd, "%d 0 obj\n"
                                     "%zu\n"
                                     "endobj\n",
-                           length_id, stream_size);
+                           pdf_image->length_id, pdf_image->stream_size);
 
   pdf->bytes_written += bytes_written;
-  pdf_image->size = bytes_written;
+  pdf_image->size += bytes_written;
 
-  return pdf_image;
+  return 0;
 }
 
 dt_pdf_page_t *dt_pdf_add_page(dt_pdf_t *pdf, dt_pdf_image_t **images, int n_images)
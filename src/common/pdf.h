@@ -71,6 +71,12 @@ typedef struct dt_pdf_image_t
 
   gboolean  outline_mode; // set to 1 to only draw a box instead of the image
   gboolean  show_bb; // set to 1 to draw the bounding box. useful for debugging
+
+  // while the pixels are added, see dt_pdf_add_image_begin()
+  int       bpp;
+  int       length_id;
+  size_t    stream_size;
+  void     *encoder;
 } dt_pdf_image_t;
 
 typedef struct dt_pdf_page_t
@@ -117,6 +123,11 @@ dt_pdf_t *dt_pdf_start(const char *filename, float width, float height, float dp
 int dt_pdf_add_icc(dt_pdf_t *pdf, const char *filename);
 int dt_pdf_add_icc_from_data(dt_pdf_t *pdf, const unsigned char *data, size_t size);
 dt_pdf_image_t *dt_pdf_add_image(dt_pdf_t *pdf, const unsigned char *image, int width, int height, int bpp, int icc_id, float border);
+// the same with the pixels handed over in bands of rows from the top, so the image never has to be in memory at
+// once. nothing else may be added to the pdf until dt_pdf_add_image_end(). those two return non-zero on errors.
+dt_pdf_image_t *dt_pdf_add_image_begin(dt_pdf_t *pdf, gboolean outline_mode, int width, int height, int bpp, int icc_id, float border);
+int dt_pdf_add_image_rows(dt_pdf_t *pdf, dt_pdf_image_t *image, const unsigned char *rows, int n_rows);
+int dt_pdf_add_image_end(dt_pdf_t *pdf, dt_pdf_image_t *image);
 dt_pdf_page_t *dt_pdf_add_page(dt_pdf_t *pdf, dt_pdf_image_t **images, int n_images);
 void dt_pdf_finish(dt_pdf_t *pdf, dt_pdf_page_t **pages, int n_pages);
 
@@ -38,57 +38,68 @@ static cmsUInt32Number ComputeFormatDescriptor (int OutColorSpace, int bps)
   return (FLOAT_SH(IsFlt)|COLORSPACE_SH(OutColorSpace)|PLANAR_SH(IsPlanar)|CHANNELS_SH(Channels)|BYTES_SH(bps));
 }
 
-int dt_apply_printer_profile(void **in, uint32_t width, uint32_t height, int bpp, cmsHPROFILE hInProfile,
-                             cmsHPROFILE hOutProfile, int intent, gboolean black_point_compensation)
+cmsHTRANSFORM dt_printer_profile_create_transform(cmsHPROFILE hInProfile, cmsHPROFILE hOutProfile, int bpp,
+                                                  int intent, gboolean black_point_compensation)
 {
-  cmsHTRANSFORM hTransform;
   cmsUInt32Number wInput, wOutput;
   int OutputColorSpace;
 
   if(!hOutProfile || !hInProfile)
-    return 1;
+    return NULL;
 
   wInput = ComputeFormatDescriptor (PT_RGB, (bpp==8?1:2));
 
   OutputColorSpace = _cmsLCMScolorSpace(cmsGetColorSpace(hOutProfile));
   wOutput = ComputeOutputFormatDescriptor(wInput, OutputColorSpace, 1);
 
-  hTransform = cmsCreateTransform
+  cmsHTRANSFORM hTransform = cmsCreateTransform
     (hInProfile,  wInput,
      hOutProfile, wOutput,
      intent,
      black_point_compensation ? cmsFLAGS_BLACKPOINTCOMPENSATION : 0);
 
   if (!hTransform)
-  {
     fprintf(stderr, "error printer profile may be corrupted\n");
-    return 1;
-  }
 
-  void *out = (void *)malloc(width*height*3);
+  return hTransform;
+}
 
+void dt_apply_printer_transform(cmsHTRANSFORM hTransform, const void *in, uint8_t *out, uint32_t width,
+                                uint32_t height, int bpp)
+{
   if (bpp == 8)
   {
-    const uint8_t *ptr_in = (uint8_t *)*in;
-    uint8_t *ptr_out = (uint8_t *)out;
+    const uint8_t *ptr_in = (const uint8_t *)in;
 
 #ifdef _OPENMP
-#pragma omp parallel for schedule(static) default(none) shared(ptr_in, ptr_out, hTransform, height, width)
+#pragma omp parallel for schedule(static) default(none) shared(ptr_in, out, hTransform, height, width)
 #endif
     for (int k=0; k<height; k++)
-      cmsDoTransform(hTransform, (const void *)&ptr_in[k*width*3], (void *)&ptr_out[k*width*3], width);
+      cmsDoTransform(hTransform, (const void *)&ptr_in[(size_t)k*width*3], (void *)&out[(size_t)k*width*3], width);
   }
   else
   {
-    const uint16_t *ptr_in = (uint16_t *)*in;
-    uint8_t *ptr_out = (uint8_t *)out;
+    const uint16_t *ptr_in = (const uint16_t *)in;
 
 #ifdef _OPENMP
-#pragma omp parallel for schedule(static) default(none) shared(ptr_in, ptr_out, hTransform, height, width)
+#pragma omp parallel for schedule(static) default(none) shared(ptr_in, out, hTransform, height, width)
 #endif
     for (int k=0; k<height; k++)
-      cmsDoTransform(hTransform, (const void *)&ptr_in[k*width*3], (void *)&ptr_out[k*width*3], width);
+      cmsDoTransform(hTransform, (const void *)&ptr_in[(size_t)k*width*3], (void *)&out[(size_t)k*width*3], width);
   }
+}
+
+int dt_apply_printer_profile(void **in, uint32_t width, uint32_t height, int bpp, cmsHPROFILE hInProfile,
+                             cmsHPROFILE hOutProfile, int intent, gboolean black_point_compensation)
+{
+  cmsHTRANSFORM hTransform
+      = dt_printer_profile_create_transform(hInProfile, hOutProfile, bpp, intent, black_point_compensation);
+  if (!hTransform)
+    return 1;
+
+  uint8_t *out = (uint8_t *)malloc((size_t)width*height*3);
+
+  dt_apply_printer_transform(hTransform, *in, out, width, height, bpp);
 
   cmsDeleteTransform(hTransform);
 
@@ -28,6 +28,14 @@ int dt_apply_printer_profile(void **in, uint32_t width, uint32_t height, int bpp
 // this routines takes as input an image of 8 or 16 bpp but always return a 8 bpp result. It is indeed better to
 // apply the profile to a 16bit input but we do not need this for printing.
 
+// the same in two steps, for images converted one band of rows at a time: the transform from an 8 or 16 bpp rgb
+// input to the 8 bpp printer space, NULL if it can't be created, and its application to height rows of width
+// pixels. the transform is freed with cmsDeleteTransform().
+cmsHTRANSFORM dt_printer_profile_create_transform(cmsHPROFILE hInProfile, cmsHPROFILE hOutProfile, int bpp,
+                                                  int intent, gboolean black_point_compensation);
+void dt_apply_printer_transform(cmsHTRANSFORM hTransform, const void *in, uint8_t *out, uint32_t width,
+                                uint32_t height, int bpp);
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
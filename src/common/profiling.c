@@ -17,6 +17,9 @@
 */
 
 #include "common/profiling.h"
+#include "common/darktable.h"
+#include "common/metrics.h"
+#include "common/trace.h"
 
 dt_timer_t *dt_timer_start_with_name(const char *file, const char *function, const char *description)
 {
@@ -25,6 +28,7 @@ dt_timer_t *dt_timer_start_with_name(const char *file, const char *function, con
   t->function = function;
   t->timer = g_timer_new();
   t->description = description;
+  t->start = dt_get_wtime();
   return t;
 }
 
@@ -33,8 +37,14 @@ void dt_timer_stop_with_name(dt_timer_t *t)
   g_assert(t != NULL);
   g_timer_stop(t->timer);
   gulong ms = 0;
+  const double seconds = g_timer_elapsed(t->timer, &ms);
   fprintf(stderr, "Timer %s in function %s took %.3f seconds to execute.\n", t->description, t->function,
-          g_timer_elapsed(t->timer, &ms));
+          seconds);
+  dt_trace_duration("timer", t->description, t->start, dt_get_wtime());
+  // the percentiles of every timer are in the metrics, printed with -d perf at exit
+  gchar *name = g_strdup_printf("timer.%s", t->description);
+  dt_metrics_time(name, seconds);
+  g_free(name);
   g_timer_destroy(t->timer);
   g_free(t);
 }
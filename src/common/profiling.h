@@ -45,6 +45,7 @@ typedef struct dt_timer_t
   const char *function;
   const char *description;
   GTimer *timer;
+  double start; // wall clock, for the trace
 } dt_timer_t;
 
 dt_timer_t *dt_timer_start_with_name(const char *file, const char *function, const char *description);
@@ -49,12 +49,19 @@ const int dt_ratings_get(const int imgid)
   return stars;
 }
 
-static void _ratings_apply_to_image(const int imgid, const int rating)
+// returns the rating the image had before
+static int _ratings_apply_to_image(const int imgid, const int rating)
 {
+  int before = 0;
   dt_image_t *image = dt_image_cache_get(darktable.image_cache, imgid, 'w');
 
   if(image)
   {
+    if(image->flags & DT_IMAGE_REJECTED)
+      before = DT_VIEW_REJECT;
+    else
+      before = DT_VIEW_RATINGS_MASK & image->flags;
+
     if(rating == DT_VIEW_REJECT)
     {
       // this is a toggle, we invert the DT_IMAGE_REJECTED flag
@@ -73,6 +80,7 @@ static void _ratings_apply_to_image(const int imgid, const int rating)
   {
     dt_image_cache_write_release(darktable.image_cache, image, DT_IMAGE_CACHE_RELAXED);
   }
+  return before;
 }
 
 static void _pop_undo(gpointer user_data, dt_undo_type_t type, dt_undo_data_t data, dt_undo_action_t action, GList **imgs)
@@ -81,6 +89,7 @@ static void _pop_undo(gpointer user_data, dt_undo_type_t type, dt_undo_data_t da
   {
     GList *list = (GList *)data;
 
+    dt_database_start_transaction(darktable.db);
     while(list)
     {
       dt_undo_ratings_t *ratings = (dt_undo_ratings_t *)list->data;
@@ -88,6 +97,7 @@ static void _pop_undo(gpointer user_data, dt_undo_type_t type, dt_undo_data_t da
       *imgs = g_list_prepend(*imgs, GINT_TO_POINTER(ratings->imgid));
       list = g_list_next(list);
     }
+    dt_database_release_transaction(darktable.db);
     dt_collection_hint_message(darktable.collection);
   }
 }
@@ -95,28 +105,36 @@ static void _pop_undo(gpointer user_data, dt_undo_type_t type, dt_undo_data_t da
 static void _ratings_undo_data_free(gpointer data)
 {
   GList *l = (GList *)data;
-  g_list_free(l);
+  g_list_free_full(l, free);
 }
 
 static void _ratings_apply(GList *imgs, const int rating, GList **undo, const gboolean undo_on)
 {
+  // the image cache writes every image through to the library, commit them all at once
+  dt_database_start_transaction(darktable.db);
+
+  GList *undoratings = NULL;
   GList *images = imgs;
   while(images)
   {
     const int image_id = GPOINTER_TO_INT(images->data);
+    const int before = _ratings_apply_to_image(image_id, rating);
+
     if(undo_on)
     {
-      dt_undo_ratings_t *undoratings = (dt_undo_ratings_t *)malloc(sizeof(dt_undo_ratings_t));
-      undoratings->imgid = image_id;
-      undoratings->before = dt_ratings_get(image_id);
-      undoratings->after = rating;
-      *undo = g_list_append(*undo, undoratings);
+      dt_undo_ratings_t *undorating = (dt_undo_ratings_t *)malloc(sizeof(dt_undo_ratings_t));
+      undorating->imgid = image_id;
+      undorating->before = before;
+      undorating->after = rating;
+      undoratings = g_list_prepend(undoratings, undorating);
     }
 
-    _ratings_apply_to_image(image_id, rating);
-
     images = g_list_next(images);
   }
+
+  dt_database_release_transaction(darktable.db);
+
+  *undo = g_list_concat(*undo, g_list_reverse(undoratings));
 }
 
 void dt_ratings_apply_on_list(const GList *img, const int rating, const gboolean undo_on)
@@ -148,6 +148,7 @@ void dt_selection_invert(dt_selection_t *selection)
   fullq = dt_util_dstrcat(fullq, "%s", "INSERT OR IGNORE INTO main.selected_images ");
   fullq = dt_util_dstrcat(fullq, "%s", dt_collection_get_query(selection->collection));
 
+  dt_database_start_transaction(darktable.db);
   DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db),
                         "INSERT INTO memory.tmp_selection SELECT imgid FROM main.selected_images", NULL, NULL,
                         NULL);
@@ -157,6 +158,7 @@ void dt_selection_invert(dt_selection_t *selection)
                         "DELETE FROM main.selected_images WHERE imgid IN (SELECT imgid FROM memory.tmp_selection)",
                         NULL, NULL, NULL);
   DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "DELETE FROM memory.tmp_selection", NULL, NULL, NULL);
+  dt_database_release_transaction(darktable.db);
 
   g_free(fullq);
 
@@ -337,6 +339,7 @@ void dt_selection_select_range(dt_selection_t *selection, uint32_t imgid)
 
 void dt_selection_select_filmroll(dt_selection_t *selection)
 {
+  dt_database_start_transaction(darktable.db);
   // clear at start, too, just to be sure:
   DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "DELETE FROM memory.tmp_selection", NULL, NULL, NULL);
   DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db),
@@ -349,6 +352,7 @@ void dt_selection_select_filmroll(dt_selection_t *selection)
                         "b ON a.id = b.imgid)",
                         NULL, NULL, NULL);
   DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "DELETE FROM memory.tmp_selection", NULL, NULL, NULL);
+  dt_database_release_transaction(darktable.db);
 
   dt_collection_update(selection->collection);
 
@@ -398,6 +402,7 @@ void dt_selection_select_unaltered(dt_selection_t *selection)
 void dt_selection_select_list(struct dt_selection_t *selection, GList *list)
 {
   if(!list) return;
+  dt_database_start_transaction(darktable.db);
   while(list)
   {
     int count = 1;
@@ -421,6 +426,7 @@ void dt_selection_select_list(struct dt_selection_t *selection, GList *list)
 
     g_free(query);
   }
+  dt_database_release_transaction(darktable.db);
 
   _selection_raise_signal();
 
@@ -594,6 +594,15 @@ gboolean dt_styles_create_from_image(const char *name, const char *description,
   return FALSE;
 }
 
+static void _styles_apply_to_images(const char *name, const gboolean duplicate, const GList *list);
+
+static void _styles_delete_history_on_list(const GList *list)
+{
+  dt_database_start_transaction(darktable.db);
+  for(const GList *l = list; l; l = g_list_next(l)) dt_history_delete_on_image_ext(GPOINTER_TO_INT(l->data), FALSE);
+  dt_database_release_transaction(darktable.db);
+}
+
 void dt_styles_apply_to_list(const char *name, const GList *list, gboolean duplicate)
 {
   gboolean selected = FALSE;
@@ -606,17 +615,11 @@ void dt_styles_apply_to_list(const char *name, const GList *list, gboolean dupli
 
   const int mode = dt_conf_get_int("plugins/lighttable/style/applymode");
 
-  /* for each selected image apply style */
+  /* apply style on all selected images */
   dt_undo_start_group(darktable.undo, DT_UNDO_LT_HISTORY);
-  GList *l = g_list_first((GList *)list);
-  while(l)
-  {
-    const int imgid = GPOINTER_TO_INT(l->data);
-    if(mode == DT_STYLE_HISTORY_OVERWRITE) dt_history_delete_on_image_ext(imgid, FALSE);
-    dt_styles_apply_to_image(name, duplicate, imgid);
-    selected = TRUE;
-    l = g_list_next(l);
-  }
+  if(mode == DT_STYLE_HISTORY_OVERWRITE) _styles_delete_history_on_list(list);
+  _styles_apply_to_images(name, duplicate, list);
+  selected = list != NULL;
   dt_undo_end_group(darktable.undo);
 
   dt_control_signal_raise(darktable.signals, DT_SIGNAL_TAG_CHANGED);
@@ -654,20 +657,11 @@ void dt_multiple_styles_apply_to_list(GList *styles, const GList *list, gboolean
 
   const int mode = dt_conf_get_int("plugins/lighttable/style/applymode");
 
-  /* for each selected image apply style */
+  /* apply the styles one after the other on all selected images */
   dt_undo_start_group(darktable.undo, DT_UNDO_LT_HISTORY);
-  GList *l = g_list_first((GList *)list);
-  while(l)
-  {
-    const int imgid = GPOINTER_TO_INT(l->data);
-    GList *style = NULL;
-    if(mode == DT_STYLE_HISTORY_OVERWRITE) dt_history_delete_on_image_ext(imgid, FALSE);
-    for (style = styles; style != NULL; style = style->next)
-    {
-      dt_styles_apply_to_image((char*)style->data, duplicate, imgid);
-    }
-    l = g_list_next(l);
-  }
+  if(mode == DT_STYLE_HISTORY_OVERWRITE) _styles_delete_history_on_list(list);
+  for(GList *style = styles; style != NULL; style = style->next)
+    _styles_apply_to_images((char *)style->data, duplicate, list);
   dt_undo_end_group(darktable.undo);
 
   dt_control_signal_raise(darktable.signals, DT_SIGNAL_TAG_CHANGED);
@@ -789,154 +783,233 @@ void dt_styles_apply_style_item(dt_develop_t *dev, dt_style_item_t *style_item,
   }
 }
 
-void dt_styles_apply_to_image(const char *name, const gboolean duplicate, const int32_t imgid)
+// the images a style is applied to at once. their histories are merged by all the workers, then written in
+// one transaction.
+#define DT_STYLES_APPLY_BATCH 32
+
+typedef struct dt_styles_apply_t
+{
+  const char *name;
+  GList *si_list; // the items of the style, every image merges a copy of its own
+  int count;
+  int32_t imgids[DT_STYLES_APPLY_BATCH];    // the images the style goes onto
+  int32_t sources[DT_STYLES_APPLY_BATCH];   // and the images they are duplicates of, if any
+  dt_develop_t devs[DT_STYLES_APPLY_BATCH]; // with their merged history
+} dt_styles_apply_t;
+
+static GList *_styles_get_items(const int id)
 {
-  int id = 0;
   sqlite3_stmt *stmt;
-
-  if((id = dt_styles_get_id_by_name(name)) != 0)
+  // go through all entries in style
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT num, module, operation, op_params, enabled,"
+                              "  blendop_params, blendop_version, multi_priority, multi_name"
+                              " FROM data.style_items WHERE styleid=?1 "
+                              " ORDER BY operation, multi_priority",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, id);
+  GList *si_list = NULL;
+  while(sqlite3_step(stmt) == SQLITE_ROW)
   {
-    int32_t newimgid;
-    /* check if we should make a duplicate before applying style */
-    if(duplicate)
-    {
-      newimgid = dt_image_duplicate(imgid);
-      if(newimgid != -1) dt_history_copy_and_paste_on_image(imgid, newimgid, FALSE, NULL, TRUE);
-    }
-    else
-      newimgid = imgid;
+    dt_style_item_t *style_item = (dt_style_item_t *)malloc(sizeof(dt_style_item_t));
+
+    style_item->num = sqlite3_column_int(stmt, 0);
+    style_item->selimg_num = 0;
+    style_item->enabled = sqlite3_column_int(stmt, 4);
+    style_item->multi_priority = sqlite3_column_int(stmt, 7);
+    style_item->name = NULL;
+    style_item->operation = g_strdup((char *)sqlite3_column_text(stmt, 2));
+    style_item->multi_name = g_strdup((char *)sqlite3_column_text(stmt, 8));
+    style_item->module_version = sqlite3_column_int(stmt, 1);
+    style_item->blendop_version = sqlite3_column_int(stmt, 6);
+    style_item->params_size = sqlite3_column_bytes(stmt, 3);
+    style_item->params = (void *)malloc(style_item->params_size);
+    memcpy(style_item->params, (void *)sqlite3_column_blob(stmt, 3), style_item->params_size);
+    style_item->blendop_params_size = sqlite3_column_bytes(stmt, 5);
+    style_item->blendop_params = (void *)malloc(style_item->blendop_params_size);
+    memcpy(style_item->blendop_params, (void *)sqlite3_column_blob(stmt, 5), style_item->blendop_params_size);
+    style_item->iop_order = 0;
+
+    si_list = g_list_append(si_list, style_item);
+  }
+  sqlite3_finalize(stmt);
+  return si_list;
+}
 
-    // now deal with the history
-    GList *modules_used = NULL;
+static gpointer _style_item_copy(gconstpointer src, gpointer data)
+{
+  const dt_style_item_t *si = (const dt_style_item_t *)src;
+  dt_style_item_t *style_item = (dt_style_item_t *)malloc(sizeof(dt_style_item_t));
+  memcpy(style_item, si, sizeof(dt_style_item_t));
+  style_item->name = g_strdup(si->name);
+  style_item->operation = g_strdup(si->operation);
+  style_item->multi_name = g_strdup(si->multi_name);
+  style_item->params = (void *)malloc(si->params_size);
+  memcpy(style_item->params, si->params, si->params_size);
+  style_item->blendop_params = (void *)malloc(si->blendop_params_size);
+  memcpy(style_item->blendop_params, si->blendop_params, si->blendop_params_size);
+  return style_item;
+}
 
-    dt_develop_t _dev_dest = { 0 };
+// merges the style into the history of an image of the batch, in memory. runs on any worker.
+static void _styles_apply_merge(const int index, void *data)
+{
+  dt_styles_apply_t *a = (dt_styles_apply_t *)data;
+  const int32_t newimgid = a->imgids[index];
 
-    dt_develop_t *dev_dest = &_dev_dest;
+  GList *modules_used = NULL;
 
-    dt_dev_init(dev_dest, FALSE);
+  dt_develop_t *dev_dest = &a->devs[index];
+  memset(dev_dest, 0, sizeof(dt_develop_t));
 
-    dev_dest->iop = dt_iop_load_modules_ext(dev_dest, TRUE);
+  dt_dev_init(dev_dest, FALSE);
 
-    GList *iop_list = dt_styles_module_order_list(name);
-    if(iop_list)
-    {
-      dt_ioppr_write_iop_order_list(iop_list, newimgid);
-      g_list_free_full(iop_list, g_free);
-    }
+  dev_dest->iop = dt_iop_load_modules_ext(dev_dest, TRUE);
 
-    dt_dev_read_history_ext(dev_dest, newimgid, TRUE);
+  dt_dev_read_history_ext(dev_dest, newimgid, TRUE);
 
-    dt_ioppr_check_iop_order(dev_dest, newimgid, "dt_styles_apply_to_image ");
+  dt_ioppr_check_iop_order(dev_dest, newimgid, "dt_styles_apply_to_image ");
 
-    dt_dev_pop_history_items_ext(dev_dest, dev_dest->history_end);
+  dt_dev_pop_history_items_ext(dev_dest, dev_dest->history_end);
 
-    dt_ioppr_check_iop_order(dev_dest, newimgid, "dt_styles_apply_to_image 1");
+  dt_ioppr_check_iop_order(dev_dest, newimgid, "dt_styles_apply_to_image 1");
 
-    if (DT_IOP_ORDER_INFO)
-      fprintf(stderr,"\n^^^^^ Apply style on image %i, history size %i",imgid,dev_dest->history_end);
+  if (DT_IOP_ORDER_INFO)
+    fprintf(stderr,"\n^^^^^ Apply style on image %i, history size %i",newimgid,dev_dest->history_end);
 
-    // go through all entries in style
-    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                                "SELECT num, module, operation, op_params, enabled,"
-                                "  blendop_params, blendop_version, multi_priority, multi_name"
-                                " FROM data.style_items WHERE styleid=?1 "
-                                " ORDER BY operation, multi_priority",
-                                -1, &stmt, NULL);
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, id);
-    GList *si_list = NULL;
-    while(sqlite3_step(stmt) == SQLITE_ROW)
-    {
-      dt_style_item_t *style_item = (dt_style_item_t *)malloc(sizeof(dt_style_item_t));
-
-      style_item->num = sqlite3_column_int(stmt, 0);
-      style_item->selimg_num = 0;
-      style_item->enabled = sqlite3_column_int(stmt, 4);
-      style_item->multi_priority = sqlite3_column_int(stmt, 7);
-      style_item->name = NULL;
-      style_item->operation = g_strdup((char *)sqlite3_column_text(stmt, 2));
-      style_item->multi_name = g_strdup((char *)sqlite3_column_text(stmt, 8));
-      style_item->module_version = sqlite3_column_int(stmt, 1);
-      style_item->blendop_version = sqlite3_column_int(stmt, 6);
-      style_item->params_size = sqlite3_column_bytes(stmt, 3);
-      style_item->params = (void *)malloc(style_item->params_size);
-      memcpy(style_item->params, (void *)sqlite3_column_blob(stmt, 3), style_item->params_size);
-      style_item->blendop_params_size = sqlite3_column_bytes(stmt, 5);
-      style_item->blendop_params = (void *)malloc(style_item->blendop_params_size);
-      memcpy(style_item->blendop_params, (void *)sqlite3_column_blob(stmt, 5), style_item->blendop_params_size);
-      style_item->iop_order = 0;
-
-      si_list = g_list_append(si_list, style_item);
-    }
-    sqlite3_finalize(stmt);
+  // the order of the items is set for this image
+  GList *si_list = g_list_copy_deep(a->si_list, _style_item_copy, NULL);
 
-    dt_ioppr_update_for_style_items(dev_dest, si_list, FALSE);
+  dt_ioppr_update_for_style_items(dev_dest, si_list, FALSE);
 
-    GList *l = si_list;
-    while(l)
-    {
-      dt_style_item_t *style_item = (dt_style_item_t *)l->data;
-      dt_styles_apply_style_item(dev_dest, style_item, &modules_used, FALSE);
-      l = g_list_next(l);
-    }
+  GList *l = si_list;
+  while(l)
+  {
+    dt_style_item_t *style_item = (dt_style_item_t *)l->data;
+    dt_styles_apply_style_item(dev_dest, style_item, &modules_used, FALSE);
+    l = g_list_next(l);
+  }
 
-    g_list_free_full(si_list, dt_style_item_free);
+  g_list_free_full(si_list, dt_style_item_free);
 
-    if (DT_IOP_ORDER_INFO) fprintf(stderr,"\nvvvvv --> look for written history below\n");
+  if (DT_IOP_ORDER_INFO) fprintf(stderr,"\nvvvvv --> look for written history below\n");
 
-    dt_ioppr_check_iop_order(dev_dest, newimgid, "dt_styles_apply_to_image 2");
+  dt_ioppr_check_iop_order(dev_dest, newimgid, "dt_styles_apply_to_image 2");
 
-    dt_undo_lt_history_t *hist = dt_history_snapshot_item_init();
-    hist->imgid = newimgid;
-    dt_history_snapshot_undo_create(hist->imgid, &hist->before, &hist->before_history_end);
+  g_list_free(modules_used);
+}
 
-    // write history and forms to db
-    dt_dev_write_history_ext(dev_dest, newimgid);
+// writes the merged history of an image of the batch and updates everything depending on it
+static void _styles_apply_write(dt_styles_apply_t *a, const int index)
+{
+  const int32_t newimgid = a->imgids[index];
+  dt_develop_t *dev_dest = &a->devs[index];
 
-    dt_history_snapshot_undo_create(hist->imgid, &hist->after, &hist->after_history_end);
-    dt_undo_start_group(darktable.undo, DT_UNDO_LT_HISTORY);
-    dt_undo_record(darktable.undo, NULL, DT_UNDO_LT_HISTORY, (dt_undo_data_t)hist,
-                   dt_history_snapshot_undo_pop, dt_history_snapshot_undo_lt_history_data_free);
-    dt_undo_end_group(darktable.undo);
+  dt_undo_lt_history_t *hist = dt_history_snapshot_item_init();
+  hist->imgid = newimgid;
+  dt_history_snapshot_undo_create(hist->imgid, &hist->before, &hist->before_history_end);
 
-    dt_dev_cleanup(dev_dest);
+  // write history and forms to db
+  dt_dev_write_history_ext(dev_dest, newimgid);
 
-    g_list_free(modules_used);
+  dt_history_snapshot_undo_create(hist->imgid, &hist->after, &hist->after_history_end);
+  dt_undo_start_group(darktable.undo, DT_UNDO_LT_HISTORY);
+  dt_undo_record(darktable.undo, NULL, DT_UNDO_LT_HISTORY, (dt_undo_data_t)hist,
+                 dt_history_snapshot_undo_pop, dt_history_snapshot_undo_lt_history_data_free);
+  dt_undo_end_group(darktable.undo);
 
-    /* add tag */
-    guint tagid = 0;
-    gchar ntag[512] = { 0 };
-    g_snprintf(ntag, sizeof(ntag), "darktable|style|%s", name);
-    if(dt_tag_new(ntag, &tagid)) dt_tag_attach(tagid, newimgid, FALSE, FALSE);
-    if(dt_tag_new("darktable|changed", &tagid))
-    {
-      dt_tag_attach(tagid, newimgid, FALSE, FALSE);
-      dt_image_cache_set_change_timestamp(darktable.image_cache, imgid);
-    }
+  dt_dev_cleanup(dev_dest);
+
+  /* add tag */
+  guint tagid = 0;
+  gchar ntag[512] = { 0 };
+  g_snprintf(ntag, sizeof(ntag), "darktable|style|%s", a->name);
+  if(dt_tag_new(ntag, &tagid)) dt_tag_attach(tagid, newimgid, FALSE, FALSE);
+  if(dt_tag_new("darktable|changed", &tagid))
+  {
+    dt_tag_attach(tagid, newimgid, FALSE, FALSE);
+    dt_image_cache_set_change_timestamp(darktable.image_cache, a->sources[index]);
+  }
+
+  /* if current image in develop reload history */
+  if(dt_dev_is_current_image(darktable.develop, newimgid))
+  {
+    dt_dev_reload_history_items(darktable.develop);
+    dt_dev_modulegroups_set(darktable.develop, dt_dev_modulegroups_get(darktable.develop));
+    dt_dev_modules_update_multishow(darktable.develop);
+  }
+
+  /* update xmp file */
+  dt_image_synch_xmp(newimgid);
+
+  /* remove old obsolete thumbnails, they are made again when they are shown */
+  dt_mipmap_cache_remove(darktable.mipmap_cache, newimgid);
+  dt_image_reset_final_size(newimgid);
+
+  /* update the aspect ratio. recompute only if really needed for performance reasons */
+  if(darktable.collection->params.sort == DT_COLLECTION_SORT_ASPECT_RATIO)
+    dt_image_set_aspect_ratio(newimgid, TRUE);
+  else
+    dt_image_reset_aspect_ratio(newimgid, TRUE);
+
+  /* redraw center view to update visible mipmaps */
+  dt_control_signal_raise(darktable.signals, DT_SIGNAL_DEVELOP_MIPMAP_UPDATED, newimgid);
+}
+
+static void _styles_apply_to_images(const char *name, const gboolean duplicate, const GList *list)
+{
+  const int id = dt_styles_get_id_by_name(name);
+  if(id == 0) return;
+
+  dt_styles_apply_t *a = (dt_styles_apply_t *)calloc(1, sizeof(dt_styles_apply_t));
+  if(!a) return;
+  a->name = name;
+  a->si_list = _styles_get_items(id);
+  GList *iop_list = dt_styles_module_order_list(name);
+
+  const GList *l = list;
+  while(l)
+  {
+    dt_database_start_transaction(darktable.db);
 
-    /* if current image in develop reload history */
-    if(dt_dev_is_current_image(darktable.develop, newimgid))
+    // make the duplicates and set the module order of the batch, which the merge reads
+    a->count = 0;
+    for(; l && a->count < DT_STYLES_APPLY_BATCH; l = g_list_next(l))
     {
-      dt_dev_reload_history_items(darktable.develop);
-      dt_dev_modulegroups_set(darktable.develop, dt_dev_modulegroups_get(darktable.develop));
-      dt_dev_modules_update_multishow(darktable.develop);
-    }
+      const int32_t imgid = GPOINTER_TO_INT(l->data);
+      int32_t newimgid = imgid;
+      /* check if we should make a duplicate before applying style */
+      if(duplicate)
+      {
+        newimgid = dt_image_duplicate(imgid);
+        if(newimgid == -1) continue;
+        dt_history_copy_and_paste_on_image(imgid, newimgid, FALSE, NULL, TRUE);
+      }
 
-    /* update xmp file */
-    dt_image_synch_xmp(newimgid);
+      if(iop_list) dt_ioppr_write_iop_order_list(iop_list, newimgid);
 
-    /* remove old obsolete thumbnails */
-    dt_mipmap_cache_remove(darktable.mipmap_cache, newimgid);
-    dt_image_reset_final_size(newimgid);
+      a->imgids[a->count] = newimgid;
+      a->sources[a->count] = imgid;
+      a->count++;
+    }
 
-    /* update the aspect ratio. recompute only if really needed for performance reasons */
-    if(darktable.collection->params.sort == DT_COLLECTION_SORT_ASPECT_RATIO)
-      dt_image_set_aspect_ratio(newimgid, TRUE);
-    else
-      dt_image_reset_aspect_ratio(newimgid, TRUE);
+    // merge the style into all the histories at once, then write them
+    dt_control_parallel_for(a->count, _styles_apply_merge, a);
+    for(int k = 0; k < a->count; k++) _styles_apply_write(a, k);
 
-    /* redraw center view to update visible mipmaps */
-    dt_control_signal_raise(darktable.signals, DT_SIGNAL_DEVELOP_MIPMAP_UPDATED, newimgid);
+    dt_database_release_transaction(darktable.db);
   }
+
+  g_list_free_full(iop_list, g_free);
+  g_list_free_full(a->si_list, dt_style_item_free);
+  free(a);
+}
+
+void dt_styles_apply_to_image(const char *name, const gboolean duplicate, const int32_t imgid)
+{
+  GList *list = g_list_append(NULL, GINT_TO_POINTER(imgid));
+  _styles_apply_to_images(name, duplicate, list);
+  g_list_free(list);
 }
 
 void dt_styles_delete_by_name(const char *name)
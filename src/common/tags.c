@@ -37,6 +37,206 @@ typedef struct dt_undo_tags_t
 
 static void dt_set_darktable_tags();
 
+// in-memory index of data.tags with the number of images of every tag, so that the tagging module doesn't have
+// to count all of main.tagged_images on every refresh. the counts follow the attaches and detaches done here,
+// any other change marks the index as outdated and it is read again on next use.
+typedef struct dt_tag_index_entry_t
+{
+  guint id;
+  gchar *name;
+  gchar *synonyms;
+  gint flags;
+  guint count;
+} dt_tag_index_entry_t;
+
+static struct
+{
+  GMutex lock;
+  gboolean valid;
+  GHashTable *ids;  // tagid -> dt_tag_index_entry_t
+  GPtrArray *names; // the entries sorted by name
+} _tag_index;
+
+static void _tag_index_entry_free(gpointer data)
+{
+  dt_tag_index_entry_t *e = (dt_tag_index_entry_t *)data;
+  g_free(e->name);
+  g_free(e->synonyms);
+  g_free(e);
+}
+
+// to be called with the lock held
+static void _tag_index_load()
+{
+  if(_tag_index.valid) return;
+
+  if(!_tag_index.ids)
+  {
+    _tag_index.ids = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, _tag_index_entry_free);
+    _tag_index.names = g_ptr_array_new();
+  }
+  g_ptr_array_set_size(_tag_index.names, 0);
+  g_hash_table_remove_all(_tag_index.ids);
+
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT T.id, T.name, T.synonyms, T.flags, IFNULL(TI.count, 0)"
+                              "  FROM data.tags AS T"
+                              "  LEFT JOIN (SELECT tagid, COUNT(*) AS count"
+                              "             FROM main.tagged_images"
+                              "             GROUP BY tagid) AS TI"
+                              "    ON TI.tagid = T.id"
+                              "  WHERE T.name IS NOT NULL"
+                              "  ORDER BY T.name",
+                              -1, &stmt, NULL);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    dt_tag_index_entry_t *e = g_malloc0(sizeof(dt_tag_index_entry_t));
+    e->id = sqlite3_column_int(stmt, 0);
+    e->name = g_strdup((char *)sqlite3_column_text(stmt, 1));
+    e->synonyms = g_strdup((char *)sqlite3_column_text(stmt, 2));
+    e->flags = sqlite3_column_int(stmt, 3);
+    e->count = sqlite3_column_int(stmt, 4);
+    g_hash_table_insert(_tag_index.ids, GUINT_TO_POINTER(e->id), e);
+    g_ptr_array_add(_tag_index.names, e);
+  }
+  sqlite3_finalize(stmt);
+
+  _tag_index.valid = TRUE;
+}
+
+void dt_tag_index_invalidate()
+{
+  g_mutex_lock(&_tag_index.lock);
+  _tag_index.valid = FALSE;
+  g_mutex_unlock(&_tag_index.lock);
+}
+
+void dt_tag_index_cleanup()
+{
+  g_mutex_lock(&_tag_index.lock);
+  if(_tag_index.ids)
+  {
+    g_ptr_array_free(_tag_index.names, TRUE);
+    g_hash_table_destroy(_tag_index.ids);
+    _tag_index.names = NULL;
+    _tag_index.ids = NULL;
+  }
+  _tag_index.valid = FALSE;
+  g_mutex_unlock(&_tag_index.lock);
+}
+
+// adds delta to the count of the tags of list not in other. returns FALSE if a tag isn't in the index.
+static gboolean _tag_index_add_count(GList *list, GList *other, const int delta)
+{
+  for(GList *l = list; l; l = g_list_next(l))
+  {
+    if(g_list_find(other, l->data)) continue;
+    dt_tag_index_entry_t *e = (dt_tag_index_entry_t *)g_hash_table_lookup(_tag_index.ids, l->data);
+    if(!e) return FALSE;
+    e->count += delta;
+  }
+  return TRUE;
+}
+
+// updates the counts after the tags of an image went from before to after. removed and added are the rows the
+// database has actually changed, if they don't match the lists the index is read again.
+static void _tag_index_update(GList *before, GList *after, const int removed, const int added)
+{
+  g_mutex_lock(&_tag_index.lock);
+  if(_tag_index.valid)
+  {
+    int nb_removed = 0, nb_added = 0;
+    for(GList *b = before; b; b = g_list_next(b))
+      if(!g_list_find(after, b->data)) nb_removed++;
+    for(GList *a = after; a; a = g_list_next(a))
+      if(!g_list_find(before, a->data)) nb_added++;
+
+    if(nb_removed != removed || nb_added != added
+       || !_tag_index_add_count(before, after, -1)
+       || !_tag_index_add_count(after, before, 1))
+      _tag_index.valid = FALSE;
+  }
+  g_mutex_unlock(&_tag_index.lock);
+}
+
+// the number of selected images per tag
+static GHashTable *_tag_get_selected_counts()
+{
+  GHashTable *selected = g_hash_table_new(g_direct_hash, g_direct_equal);
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT TI.tagid, COUNT(DISTINCT TI.imgid)"
+                              "  FROM main.selected_images AS S"
+                              "  JOIN main.tagged_images AS TI ON TI.imgid = S.imgid"
+                              "  GROUP BY TI.tagid",
+                              -1, &stmt, NULL);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+    g_hash_table_insert(selected, GUINT_TO_POINTER(sqlite3_column_int(stmt, 0)),
+                        GUINT_TO_POINTER(sqlite3_column_int(stmt, 1)));
+  sqlite3_finalize(stmt);
+  return selected;
+}
+
+static gboolean _tag_index_is_darktable(const dt_tag_index_entry_t *e)
+{
+  // as name LIKE 'darktable|%'
+  return !g_ascii_strncasecmp(e->name, "darktable|", strlen("darktable|"));
+}
+
+static dt_tag_t *_tag_from_index(const dt_tag_index_entry_t *e, const uint32_t nb_selected, GHashTable *selected)
+{
+  dt_tag_t *t = g_malloc0(sizeof(dt_tag_t));
+  t->tag = g_strdup(e->name);
+  t->leave = g_strrstr(t->tag, "|");
+  t->leave = t->leave ? t->leave + 1 : t->tag;
+  t->id = e->id;
+  t->count = e->count;
+  const uint32_t imgnb = GPOINTER_TO_UINT(g_hash_table_lookup(selected, GUINT_TO_POINTER(e->id)));
+  t->select = (nb_selected == 0) ? DT_TS_NO_IMAGE :
+              (imgnb == nb_selected) ? DT_TS_ALL_IMAGES :
+              (imgnb == 0) ? DT_TS_NO_IMAGE : DT_TS_SOME_IMAGES;
+  t->flags = e->flags;
+  t->synonym = g_strdup(e->synonyms);
+  return t;
+}
+
+// the tag keyword and the tags below it in the hierarchy, sorted by name. only id and tag are set.
+static GList *_tag_index_get_family(const gchar *keyword)
+{
+  GList *family = NULL;
+  const size_t len = strlen(keyword);
+
+  g_mutex_lock(&_tag_index.lock);
+  _tag_index_load();
+
+  // first name not before keyword
+  GPtrArray *names = _tag_index.names;
+  guint lo = 0, hi = names->len;
+  while(lo < hi)
+  {
+    const guint mid = lo + (hi - lo) / 2;
+    if(strcmp(((dt_tag_index_entry_t *)names->pdata[mid])->name, keyword) < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  for(guint i = lo; i < names->len; i++)
+  {
+    const dt_tag_index_entry_t *e = (dt_tag_index_entry_t *)names->pdata[i];
+    if(strncmp(e->name, keyword, len)) break;
+    if(e->name[len] != '\0' && e->name[len] != '|') continue;
+    dt_tag_t *t = g_malloc0(sizeof(dt_tag_t));
+    t->id = e->id;
+    t->tag = g_strdup(e->name);
+    family = g_list_prepend(family, t);
+  }
+  g_mutex_unlock(&_tag_index.lock);
+
+  return g_list_reverse(family);
+}
+
 static gchar *_get_tb_removed_tag_string_values(GList *before, GList *after)
 {
   GList *b = before;
@@ -77,8 +277,9 @@ static gchar *_get_tb_added_tag_string_values(const int img, GList *before, GLis
   return tag_list;
 }
 
-static void _bulk_remove_tags(const int img, const gchar *tag_list)
+static int _bulk_remove_tags(const int img, const gchar *tag_list)
 {
+  int changes = 0;
   if(img > 0 && tag_list)
   {
     char *query = NULL;
@@ -87,22 +288,26 @@ static void _bulk_remove_tags(const int img, const gchar *tag_list)
     DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
     sqlite3_step(stmt);
     sqlite3_finalize(stmt);
+    changes = sqlite3_changes(dt_database_get(darktable.db));
     g_free(query);
   }
+  return changes;
 }
 
-static void _bulk_add_tags(const gchar *tag_list)
+static int _bulk_add_tags(const gchar *tag_list)
 {
+  int changes = 0;
   if(tag_list)
   {
     char *query = NULL;
     sqlite3_stmt *stmt;
     query = dt_util_dstrcat(query, "INSERT INTO main.tagged_images (imgid, tagid, position) VALUES %s", tag_list);
     DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
-    sqlite3_step(stmt);
+    if(sqlite3_step(stmt) == SQLITE_DONE) changes = sqlite3_changes(dt_database_get(darktable.db));
     sqlite3_finalize(stmt);
     g_free(query);
   }
+  return changes;
 }
 
 static void _pop_undo_execute(const int imgid, GList *before, GList *after)
@@ -110,8 +315,9 @@ static void _pop_undo_execute(const int imgid, GList *before, GList *after)
   gchar *tobe_removed_list = _get_tb_removed_tag_string_values(before, after);
   gchar *tobe_added_list = _get_tb_added_tag_string_values(imgid, before, after);
 
-  _bulk_remove_tags(imgid, tobe_removed_list);
-  _bulk_add_tags(tobe_added_list);
+  const int removed = _bulk_remove_tags(imgid, tobe_removed_list);
+  const int added = _bulk_add_tags(tobe_added_list);
+  _tag_index_update(before, after, removed, added);
 
   g_free(tobe_removed_list);
   g_free(tobe_added_list);
@@ -183,6 +389,7 @@ gboolean dt_tag_new(const char *name, guint *tagid)
   DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 1, name, -1, SQLITE_TRANSIENT);
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
+  dt_tag_index_invalidate();
 
   if(tagid != NULL)
   {
@@ -231,6 +438,7 @@ guint dt_tag_remove(const guint tagid, gboolean final)
     DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, tagid);
     sqlite3_step(stmt);
     sqlite3_finalize(stmt);
+    dt_tag_index_invalidate();
   }
 
   return count;
@@ -253,6 +461,7 @@ void dt_tag_delete_tag_batch(const char *flatlist)
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
   g_free(query);
+  dt_tag_index_invalidate();
 }
 
 guint dt_tag_remove_list(GList *tag_list)
@@ -292,12 +501,11 @@ gchar *dt_tag_get_name(const guint tagid)
   int rt;
   char *name = NULL;
   sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT name FROM data.tags WHERE id= ?1", -1, &stmt,
-                              NULL);
+  DT_DEBUG_SQLITE3_PREPARE_CACHED(darktable.db, "SELECT name FROM data.tags WHERE id= ?1", &stmt);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, tagid);
   rt = sqlite3_step(stmt);
   if(rt == SQLITE_ROW) name = g_strdup((const char *)sqlite3_column_text(stmt, 0));
-  sqlite3_finalize(stmt);
+  DT_DEBUG_SQLITE3_RELEASE_CACHED(darktable.db, stmt);
 
   return name;
 }
@@ -315,27 +523,26 @@ void dt_tag_rename(const guint tagid, const gchar *new_tagname)
   DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 2, new_tagname, -1, SQLITE_TRANSIENT);
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
-
+  dt_tag_index_invalidate();
 }
 
 gboolean dt_tag_exists(const char *name, guint *tagid)
 {
   int rt;
   sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT id FROM data.tags WHERE name = ?1", -1, &stmt,
-                              NULL);
+  DT_DEBUG_SQLITE3_PREPARE_CACHED(darktable.db, "SELECT id FROM data.tags WHERE name = ?1", &stmt);
   DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 1, name, -1, SQLITE_TRANSIENT);
   rt = sqlite3_step(stmt);
 
   if(rt == SQLITE_ROW)
   {
     if(tagid != NULL) *tagid = sqlite3_column_int64(stmt, 0);
-    sqlite3_finalize(stmt);
+    DT_DEBUG_SQLITE3_RELEASE_CACHED(darktable.db, stmt);
     return TRUE;
   }
 
   if(tagid != NULL) *tagid = -1;
-  sqlite3_finalize(stmt);
+  DT_DEBUG_SQLITE3_RELEASE_CACHED(darktable.db, stmt);
   return FALSE;
 }
 
@@ -389,6 +596,7 @@ static gboolean _tag_execute(const GList *tags, const GList *imgs, GList **undo,
 {
   const GList *images = imgs;
   gboolean res = FALSE;
+  GList *undotags_list = NULL;
   while(images)
   {
     const int image_id = GPOINTER_TO_INT(images->data);
@@ -423,11 +631,12 @@ static gboolean _tag_execute(const GList *tags, const GList *imgs, GList **undo,
     }
     _pop_undo_execute(image_id, undotags->before, undotags->after);
     if(undo_on)
-      *undo = g_list_append(*undo, undotags);
+      undotags_list = g_list_prepend(undotags_list, undotags);
     else
       _undo_tags_free(undotags);
     images = g_list_next(images);
   }
+  if(undo_on) *undo = g_list_concat(*undo, g_list_reverse(undotags_list));
   return res;
 }
 
@@ -846,22 +1055,24 @@ static GList *_tag_get_tags(const gint imgid, const dt_tag_type_t type)
 
   sqlite3_stmt *stmt;
   dt_set_darktable_tags();
+  // the image is bound, so there are only three queries to keep prepared
   char query[256] = { 0 };
   snprintf(query, sizeof(query), "SELECT DISTINCT T.id"
                                  "  FROM main.tagged_images AS I"
                                  "  JOIN data.tags T on T.id = I.tagid"
-                                 "  WHERE I.imgid = %d %s",
-           imgid, type == DT_TAG_TYPE_ALL ? "" :
-                  type == DT_TAG_TYPE_DT ? "AND T.id IN memory.darktable_tags" :
-                                           "AND NOT T.id IN memory.darktable_tags");
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
+                                 "  WHERE I.imgid = ?1 %s",
+           type == DT_TAG_TYPE_ALL ? "" :
+           type == DT_TAG_TYPE_DT ? "AND T.id IN memory.darktable_tags" :
+                                    "AND NOT T.id IN memory.darktable_tags");
+  DT_DEBUG_SQLITE3_PREPARE_CACHED(darktable.db, query, &stmt);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
 
   while(sqlite3_step(stmt) == SQLITE_ROW)
   {
     tags = g_list_prepend(tags, GINT_TO_POINTER(sqlite3_column_int(stmt, 0)));
   }
 
-  sqlite3_finalize(stmt);
+  DT_DEBUG_SQLITE3_RELEASE_CACHED(darktable.db, stmt);
 
   return tags;
 }
@@ -988,15 +1199,15 @@ gboolean dt_is_tag_attached(const guint tagid, const gint imgid)
 {
   sqlite3_stmt *stmt;
 
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT imgid"
-                              " FROM main.tagged_images"
-                              " WHERE imgid = ?1 AND tagid = ?2", -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_PREPARE_CACHED(darktable.db,
+                                  "SELECT imgid"
+                                  " FROM main.tagged_images"
+                                  " WHERE imgid = ?1 AND tagid = ?2", &stmt);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, tagid);
 
   const gboolean ret = (sqlite3_step(stmt) == SQLITE_ROW);
-  sqlite3_finalize(stmt);
+  DT_DEBUG_SQLITE3_RELEASE_CACHED(darktable.db, stmt);
   return ret;
 }
 
@@ -1036,70 +1247,63 @@ GList *dt_tag_get_images_from_list(const GList *img, gint tagid)
   return result;
 }
 
+static gint _sort_index_by_count(gconstpointer a, gconstpointer b)
+{
+  const dt_tag_index_entry_t *ea = *(const dt_tag_index_entry_t **)a;
+  const dt_tag_index_entry_t *eb = *(const dt_tag_index_entry_t **)b;
+  if(ea->count != eb->count) return ea->count > eb->count ? -1 : 1;
+  return strcmp(ea->name, eb->name);
+}
+
 uint32_t dt_tag_get_suggestions(GList **result)
 {
-  sqlite3_stmt *stmt;
+  const uint32_t nb_selected = dt_selected_images_count();
+  GHashTable *selected = _tag_get_selected_counts();
 
-  dt_set_darktable_tags();
+  g_mutex_lock(&_tag_index.lock);
+  _tag_index_load();
 
-  /* list tags and count */
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "INSERT INTO memory.taglist (id, count)"
-                              " SELECT S.tagid, COUNT(*)"
-                              "  FROM main.tagged_images AS S"
-                              "  WHERE S.tagid NOT IN memory.darktable_tags"
-                              "  GROUP BY S.tagid",
-                              -1, &stmt, NULL);
-  sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
+  /* used tags which are neither categories nor attached to all selected images */
+  GPtrArray *used = g_ptr_array_new();
+  for(guint i = 0; i < _tag_index.names->len; i++)
+  {
+    dt_tag_index_entry_t *e = (dt_tag_index_entry_t *)_tag_index.names->pdata[i];
+    if(!e->count || (e->flags & DT_TF_CATEGORY) || _tag_index_is_darktable(e)) continue;
+    const uint32_t imgnb = GPOINTER_TO_UINT(g_hash_table_lookup(selected, GUINT_TO_POINTER(e->id)));
+    if(imgnb && imgnb == nb_selected) continue;
+    g_ptr_array_add(used, e);
+  }
+  g_ptr_array_sort(used, _sort_index_by_count);
 
-  const uint32_t nb_selected = dt_selected_images_count();
-  /* Now put all the bits together */
+  /* ... and create the result list to send upwards */
+  GList *tags = NULL;
+  const uint32_t count = MIN(used->len, 500);
+  for(uint32_t i = count; i > 0; i--)
+    tags = g_list_prepend(tags, _tag_from_index(used->pdata[i - 1], nb_selected, selected));
+
+  g_mutex_unlock(&_tag_index.lock);
+  g_ptr_array_free(used, TRUE);
+  g_hash_table_destroy(selected);
+
+  *result = g_list_concat(*result, tags);
+  return count;
+}
+
+// fills memory.similar_tags with the ids of the list of tags
+static void _tag_set_similar_tags(GList *tags)
+{
+  sqlite3_stmt *stmt;
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT T.name, T.id, MT.count, CT.imgnb, T.flags, T.synonyms"
-                              "  FROM memory.taglist MT"
-                              "  JOIN data.tags T ON MT.id = T.id"
-                              "  LEFT JOIN (SELECT tagid, COUNT(DISTINCT imgid) AS imgnb"
-                              "             FROM main.tagged_images"
-                              "             WHERE imgid IN (SELECT imgid FROM main.selected_images)"
-                              "             GROUP BY tagid) AS CT"
-                              "    ON CT.tagid = MT.id"
-                              "  WHERE T.id NOT IN (SELECT DISTINCT tagid"
-                              "                     FROM (SELECT TI.tagid, COUNT(DISTINCT SI.imgid) AS imgnb"
-                              "                           FROM main.selected_images AS SI"
-                              "                           JOIN main.tagged_images AS TI ON TI.imgid = SI.imgid"
-                              "                           GROUP BY TI.tagid)"
-                              "                           WHERE imgnb = ?1)"
-                              "  AND (T.flags IS NULL OR (T.flags & 1) = 0)"
-                              "  ORDER BY MT.count DESC"
-                              "  LIMIT 500",
+                              "INSERT INTO memory.similar_tags (tagid) VALUES (?1)",
                               -1, &stmt, NULL);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, nb_selected);
-
-  /* ... and create the result list to send upwards */
-  uint32_t count = 0;
-  while(sqlite3_step(stmt) == SQLITE_ROW)
+  for(GList *t = tags; t; t = g_list_next(t))
   {
-    dt_tag_t *t = g_malloc0(sizeof(dt_tag_t));
-    t->tag = g_strdup((char *)sqlite3_column_text(stmt, 0));
-    t->leave = g_strrstr(t->tag, "|");
-    t->leave = t->leave ? t->leave + 1 : t->tag;
-    t->id = sqlite3_column_int(stmt, 1);
-    t->count = sqlite3_column_int(stmt, 2);
-    uint32_t imgnb = sqlite3_column_int(stmt, 3);
-    t->select = (nb_selected == 0) ? DT_TS_NO_IMAGE :
-                (imgnb == nb_selected) ? DT_TS_ALL_IMAGES :
-                (imgnb == 0) ? DT_TS_NO_IMAGE : DT_TS_SOME_IMAGES;
-    t->flags = sqlite3_column_int(stmt, 4);
-    t->synonym = g_strdup((char *)sqlite3_column_text(stmt, 5));
-    *result = g_list_append(*result, t);
-    count++;
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, ((dt_tag_t *)t->data)->id);
+    sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
   }
-
   sqlite3_finalize(stmt);
-  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "DELETE FROM memory.taglist", NULL, NULL, NULL);
-
-  return count;
 }
 
 void dt_tag_count_tags_images(const gchar *keyword, int *tag_count, int *img_count)
@@ -1109,28 +1313,12 @@ void dt_tag_count_tags_images(const gchar *keyword, int *tag_count, int *img_cou
   *img_count = 0;
 
   if(!keyword) return;
-  gchar *keyword_expr = g_strdup_printf("%s|", keyword);
 
   /* Only select tags that are equal or child to the one we are looking for once. */
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "INSERT INTO memory.similar_tags (tagid)"
-                              "  SELECT id"
-                              "    FROM data.tags"
-                              "    WHERE name = ?1 OR SUBSTR(name, 1, LENGTH(?2)) = ?2",
-                              -1, &stmt, NULL);
-  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 1, keyword, -1, SQLITE_TRANSIENT);
-  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 2, keyword_expr, -1, SQLITE_TRANSIENT);
-  sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
-
-  g_free(keyword_expr);
-
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT COUNT(DISTINCT tagid) FROM memory.similar_tags",
-                              -1, &stmt, NULL);
-  sqlite3_step(stmt);
-  *tag_count = sqlite3_column_int(stmt, 0);
-  sqlite3_finalize(stmt);
+  GList *family = _tag_index_get_family(keyword);
+  *tag_count = g_list_length(family);
+  _tag_set_similar_tags(family);
+  dt_tag_free_result(&family);
 
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
                               "SELECT COUNT(DISTINCT ti.imgid)"
@@ -1144,45 +1332,20 @@ void dt_tag_count_tags_images(const gchar *keyword, int *tag_count, int *img_cou
   sqlite3_finalize(stmt);
 
   DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "DELETE FROM memory.similar_tags", NULL, NULL, NULL);
-  }
+}
 
 void dt_tag_get_tags_images(const gchar *keyword, GList **tag_list, GList **img_list)
 {
   sqlite3_stmt *stmt;
 
   if(!keyword) return;
-  gchar *keyword_expr = g_strdup_printf("%s|", keyword);
-
-/* Only select tags that are equal or child to the one we are looking for once. */
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "INSERT INTO memory.similar_tags (tagid)"
-                              "  SELECT id"
-                              "  FROM data.tags"
-                              "  WHERE name = ?1 OR SUBSTR(name, 1, LENGTH(?2)) = ?2",
-                              -1, &stmt, NULL);
-  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 1, keyword, -1, SQLITE_TRANSIENT);
-  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 2, keyword_expr, -1, SQLITE_TRANSIENT);
-  sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
 
-  g_free(keyword_expr);
-
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT ST.tagid, T.name"
-                              " FROM memory.similar_tags ST"
-                              " JOIN data.tags T"
-                              "   ON T.id = ST.tagid ",
-                              -1, &stmt, NULL);
-
-  while(sqlite3_step(stmt) == SQLITE_ROW)
-  {
-    dt_tag_t *t = g_malloc0(sizeof(dt_tag_t));
-    t->id = sqlite3_column_int(stmt, 0);
-    t->tag = g_strdup((char *)sqlite3_column_text(stmt, 1));
-    *tag_list = g_list_append((*tag_list), t);
-  }
-  sqlite3_finalize(stmt);
+  /* Only select tags that are equal or child to the one we are looking for once. */
+  GList *family = _tag_index_get_family(keyword);
+  _tag_set_similar_tags(family);
+  *tag_list = g_list_concat(*tag_list, family);
 
+  GList *imgs = NULL;
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
                               "SELECT DISTINCT ti.imgid"
                               " FROM main.tagged_images AS ti"
@@ -1191,9 +1354,10 @@ void dt_tag_get_tags_images(const gchar *keyword, GList **tag_list, GList **img_
                               -1, &stmt, NULL);
   while(sqlite3_step(stmt) == SQLITE_ROW)
   {
-    *img_list = g_list_append((*img_list), GINT_TO_POINTER(sqlite3_column_int(stmt, 0)));
+    imgs = g_list_prepend(imgs, GINT_TO_POINTER(sqlite3_column_int(stmt, 0)));
   }
   sqlite3_finalize(stmt);
+  *img_list = g_list_concat(*img_list, g_list_reverse(imgs));
 
   DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "DELETE FROM memory.similar_tags", NULL, NULL, NULL);
 }
@@ -1229,58 +1393,27 @@ uint32_t dt_tag_images_count(gint tagid)
 
 uint32_t dt_tag_get_with_usage(GList **result)
 {
-  sqlite3_stmt *stmt;
-
-  dt_set_darktable_tags();
-
-  /* Select tags that are similar to the keyword and are actually used to tag images*/
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "INSERT INTO memory.taglist (id, count)"
-                              "  SELECT tagid, COUNT(*)"
-                              "  FROM main.tagged_images"
-                              "  GROUP BY tagid",
-                              -1, &stmt, NULL);
-  sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
-
   const uint32_t nb_selected = dt_selected_images_count();
+  GHashTable *selected = _tag_get_selected_counts();
 
-  /* Now put all the bits together */
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT T.name, T.id, MT.count, CT.imgnb, T.flags, T.synonyms"
-                              "  FROM data.tags T "
-                              "  LEFT JOIN memory.taglist MT ON MT.id = T.id "
-                              "  LEFT JOIN (SELECT tagid, COUNT(DISTINCT imgid) AS imgnb"
-                              "             FROM main.tagged_images "
-                              "             WHERE imgid IN (SELECT imgid FROM main.selected_images) GROUP BY tagid) AS CT "
-                              "    ON CT.tagid = T.id"
-                              "  WHERE T.id NOT IN memory.darktable_tags "
-                              "  ORDER BY T.name ",
-                              -1, &stmt, NULL);
+  g_mutex_lock(&_tag_index.lock);
+  _tag_index_load();
 
-  /* ... and create the result list to send upwards */
+  /* all tags but the darktable ones, sorted by name */
+  GList *tags = NULL;
   uint32_t count = 0;
-  while(sqlite3_step(stmt) == SQLITE_ROW)
+  for(guint i = _tag_index.names->len; i > 0; i--)
   {
-    dt_tag_t *t = g_malloc0(sizeof(dt_tag_t));
-    t->tag = g_strdup((char *)sqlite3_column_text(stmt, 0));
-    t->leave = g_strrstr(t->tag, "|");
-    t->leave = t->leave ? t->leave + 1 : t->tag;
-    t->id = sqlite3_column_int(stmt, 1);
-    t->count = sqlite3_column_int(stmt, 2);
-    uint32_t imgnb = sqlite3_column_int(stmt, 3);
-    t->select = (nb_selected == 0) ? DT_TS_NO_IMAGE :
-                (imgnb == nb_selected) ? DT_TS_ALL_IMAGES :
-                (imgnb == 0) ? DT_TS_NO_IMAGE : DT_TS_SOME_IMAGES;
-    t->flags = sqlite3_column_int(stmt, 4);
-    t->synonym = g_strdup((char *)sqlite3_column_text(stmt, 5));
-    *result = g_list_append(*result, t);
+    const dt_tag_index_entry_t *e = (dt_tag_index_entry_t *)_tag_index.names->pdata[i - 1];
+    if(_tag_index_is_darktable(e)) continue;
+    tags = g_list_prepend(tags, _tag_from_index(e, nb_selected, selected));
     count++;
   }
 
-  sqlite3_finalize(stmt);
-  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "DELETE FROM memory.taglist", NULL, NULL, NULL);
+  g_mutex_unlock(&_tag_index.lock);
+  g_hash_table_destroy(selected);
 
+  *result = g_list_concat(*result, tags);
   return count;
 }
 
@@ -1352,15 +1485,14 @@ void dt_tag_set_synonyms(gint tagid, gchar *synonyms_entry)
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
   g_free(synonyms);
+  dt_tag_index_invalidate();
 }
 
 gint dt_tag_get_flags(gint tagid)
 {
   sqlite3_stmt *stmt;
 
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT flags FROM data.tags WHERE id = ?1 ",
-                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_PREPARE_CACHED(darktable.db, "SELECT flags FROM data.tags WHERE id = ?1 ", &stmt);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, tagid);
 
   gint flags = 0;
@@ -1368,7 +1500,7 @@ gint dt_tag_get_flags(gint tagid)
   {
     flags = sqlite3_column_int(stmt, 0);
   }
-  sqlite3_finalize(stmt);
+  DT_DEBUG_SQLITE3_RELEASE_CACHED(darktable.db, stmt);
   return flags;
 }
 
@@ -1383,6 +1515,7 @@ void dt_tag_set_flags(gint tagid, gint flags)
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, flags);
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
+  dt_tag_index_invalidate();
 }
 
 void dt_tag_add_synonym(gint tagid, gchar *synonym)
@@ -1405,6 +1538,7 @@ void dt_tag_add_synonym(gint tagid, gchar *synonym)
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
   g_free(synonyms);
+  dt_tag_index_invalidate();
 }
 
 static void _free_result_item(dt_tag_t *t, gpointer unused)
@@ -1733,6 +1867,7 @@ void dt_tag_set_tag_order_by_id(const uint32_t tagid, const uint32_t sort,
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 3, DT_TF_ALL);
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
+  dt_tag_index_invalidate();
 }
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
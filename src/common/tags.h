@@ -80,6 +80,13 @@ guint dt_tag_remove(const guint tagid, gboolean final);
 /** removes a list of tags from db and from assigned images. \return the number of tags deleted */
 guint dt_tag_remove_list(GList *tag_list);
 
+/** marks the in-memory index of tags as outdated, to be called after changing data.tags or
+ * main.tagged_images without the functions of this file */
+void dt_tag_index_invalidate();
+
+/** frees the in-memory index of tags */
+void dt_tag_index_cleanup();
+
 /** set the name of specified id */
 void dt_tag_rename(const guint tagid, const gchar *new_tagname);
 
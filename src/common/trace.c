@@ -0,0 +1,169 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/trace.h"
+#include "common/darktable.h"
+#include "develop/imageop.h"
+
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <unistd.h>
+
+static FILE *_trace_file = NULL;
+static gboolean _trace_first = TRUE;
+static dt_pthread_mutex_t _trace_mutex;
+
+static const char *_cache_to_str(const dt_trace_cache_t cache)
+{
+  switch(cache)
+  {
+    case DT_TRACE_CACHE_HIT:
+      return "hit";
+    case DT_TRACE_CACHE_SHARED:
+      return "shared";
+    case DT_TRACE_CACHE_DISK:
+      return "disk";
+    case DT_TRACE_CACHE_MISS:
+    default:
+      return "miss";
+  }
+}
+
+// module and instance names are user supplied, keep the json valid
+static void _write_string(FILE *f, const char *s)
+{
+  fputc('"', f);
+  for(const unsigned char *c = (const unsigned char *)(s ? s : ""); *c; c++)
+  {
+    if(*c == '"' || *c == '\\')
+      fprintf(f, "\\%c", *c);
+    else if(*c < 0x20)
+      fprintf(f, "\\u%04x", *c);
+    else
+      fputc(*c, f);
+  }
+  fputc('"', f);
+}
+
+// called with the mutex held
+static void _begin_event(const char *category, const char *name, const char phase, const int tid)
+{
+  fputs(_trace_first ? "\n" : ",\n", _trace_file);
+  _trace_first = FALSE;
+  fprintf(_trace_file, "{\"cat\":\"%s\",\"name\":", category);
+  _write_string(_trace_file, name);
+  fprintf(_trace_file, ",\"ph\":\"%c\",\"pid\":%d,\"tid\":%d", phase, (int)getpid(), tid);
+}
+
+static void _thread_name(const int tid, const char *name)
+{
+  _begin_event("__metadata", "thread_name", 'M', tid);
+  fprintf(_trace_file, ",\"args\":{\"name\":\"%s\"}}", name);
+}
+
+int dt_trace_init(const char *filename)
+{
+  _trace_file = g_fopen(filename, "wb");
+  if(!_trace_file)
+  {
+    fprintf(stderr, "[trace] can't open `%s' for writing\n", filename);
+    return 1;
+  }
+  dt_pthread_mutex_init(&_trace_mutex, NULL);
+  _trace_first = TRUE;
+
+  // chrome and perfetto both accept a plain array of events
+  fputs("[", _trace_file);
+  _thread_name(0, "timers");
+  _thread_name(DT_DEV_PIXELPIPE_EXPORT, "export");
+  _thread_name(DT_DEV_PIXELPIPE_FULL, "full");
+  _thread_name(DT_DEV_PIXELPIPE_PREVIEW, "preview");
+  _thread_name(DT_DEV_PIXELPIPE_THUMBNAIL, "thumbnail");
+  _thread_name(DT_DEV_PIXELPIPE_PREVIEW2, "preview2");
+  return 0;
+}
+
+void dt_trace_cleanup(void)
+{
+  if(!_trace_file) return;
+  dt_pthread_mutex_lock(&_trace_mutex);
+  fputs("\n]\n", _trace_file);
+  fclose(_trace_file);
+  _trace_file = NULL;
+  dt_pthread_mutex_unlock(&_trace_mutex);
+  dt_pthread_mutex_destroy(&_trace_mutex);
+}
+
+gboolean dt_trace_enabled(void)
+{
+  return _trace_file != NULL;
+}
+
+static void _write_roi(const char *key, const dt_iop_roi_t *roi)
+{
+  if(!roi) return;
+  fprintf(_trace_file, ",\"%s\":{\"x\":%d,\"y\":%d,\"width\":%d,\"height\":%d,\"scale\":%g}", key, roi->x,
+          roi->y, roi->width, roi->height, roi->scale);
+}
+
+void dt_trace_module(const dt_trace_module_event_t *event)
+{
+  if(!_trace_file) return;
+
+  dt_pthread_mutex_lock(&_trace_mutex);
+  if(_trace_file)
+  {
+    _begin_event("pixelpipe", event->module, 'X', event->pipe_type & DT_DEV_PIXELPIPE_ANY);
+    fprintf(_trace_file, ",\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"pipe\":", event->start * 1e6,
+            MAX(0.0, event->end - event->start) * 1e6);
+    _write_string(_trace_file, event->pipe);
+    fputs(",\"instance\":", _trace_file);
+    _write_string(_trace_file, event->instance);
+    _write_roi("roi_in", event->roi_in);
+    _write_roi("roi_out", event->roi_out);
+    if(event->device)
+    {
+      fputs(",\"device\":", _trace_file);
+      _write_string(_trace_file, event->device);
+      fprintf(_trace_file, ",\"devid\":%d,\"tiling\":%s", event->devid, event->tiling ? "true" : "false");
+    }
+    if(event->fused > 1) fprintf(_trace_file, ",\"fused\":%d", event->fused);
+    if(event->cache == DT_TRACE_CACHE_MISS)
+      fprintf(_trace_file, ",\"host_peak\":%zu,\"device_peak\":%zu", event->host_peak, event->device_peak);
+    fprintf(_trace_file, ",\"bytes\":%zu,\"mem_required\":%zu,\"cache\":\"%s\"}}", event->bytes,
+            event->mem_required, _cache_to_str(event->cache));
+  }
+  dt_pthread_mutex_unlock(&_trace_mutex);
+}
+
+void dt_trace_duration(const char *category, const char *name, const double start, const double end)
+{
+  if(!_trace_file) return;
+
+  dt_pthread_mutex_lock(&_trace_mutex);
+  if(_trace_file)
+  {
+    _begin_event(category, name, 'X', 0);
+    fprintf(_trace_file, ",\"ts\":%.3f,\"dur\":%.3f}", start * 1e6, MAX(0.0, end - start) * 1e6);
+  }
+  dt_pthread_mutex_unlock(&_trace_mutex);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
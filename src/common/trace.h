@@ -0,0 +1,76 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <glib.h>
+#include <stddef.h>
+
+struct dt_iop_roi_t;
+
+/**
+ * structured performance trace. started with --trace <file>, every module invocation of every pixelpipe
+ * is written as one event in chrome trace format, which can be loaded into chrome://tracing or
+ * ui.perfetto.dev. each pipe type gets its own track.
+ */
+
+/** where a module got its output from. */
+typedef enum dt_trace_cache_t
+{
+  DT_TRACE_CACHE_MISS = 0,   // the module was processed
+  DT_TRACE_CACHE_HIT = 1,    // found in the pipe's own cache
+  DT_TRACE_CACHE_SHARED = 2, // found in the cache shared between darkroom pipes
+  DT_TRACE_CACHE_DISK = 3    // read from an on-disk checkpoint
+} dt_trace_cache_t;
+
+/** one module invocation in a pixelpipe. */
+typedef struct dt_trace_module_event_t
+{
+  const char *pipe;     // pipe type, e.g. "export"
+  int pipe_type;        // used to put each pipe type on its own track
+  const char *module;   // operation name, e.g. "exposure"
+  const char *instance; // multi instance name, may be empty
+  const struct dt_iop_roi_t *roi_in;
+  const struct dt_iop_roi_t *roi_out;
+  const char *device;   // "CPU", "GPU" or NULL for cache hits
+  int devid;            // OpenCL device, -1 for CPU
+  gboolean tiling;
+  size_t bytes;         // size of the output buffer
+  size_t mem_required;  // memory estimate from the tiling callback, 0 if unknown
+  size_t host_peak;     // host memory the module allocated on top of its input and output, see memory_accounting.h
+  size_t device_peak;   // device memory the module allocated, including its input and output there
+  dt_trace_cache_t cache;
+  int fused;            // number of pointwise modules processed together, 0 or 1 if none
+  double start, end;    // wall clock as returned by dt_get_wtime()
+} dt_trace_module_event_t;
+
+/** opens the trace file. returns 0 on success. */
+int dt_trace_init(const char *filename);
+/** finishes the json and closes the file. */
+void dt_trace_cleanup(void);
+/** true if a trace file is open, so callers can skip gathering the data otherwise. */
+gboolean dt_trace_enabled(void);
+
+/** records one module invocation. */
+void dt_trace_module(const dt_trace_module_event_t *event);
+/** records a generic named duration, as used by the profiling timers. */
+void dt_trace_duration(const char *category, const char *name, const double start, const double end);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -20,6 +20,7 @@
 #include "common/collection.h"
 #include "common/darktable.h"
 #include "common/image.h"
+#include "control/conf.h"
 #include "control/control.h"
 #include <glib.h>   // for GList, gpointer, g_list_first, g_list_prepend
 #include <stdlib.h> // for NULL, malloc, free
@@ -75,6 +76,34 @@ static void _free_undo_data(void *p)
   free(item);
 }
 
+// drops the oldest steps beyond undo_max_steps, a group counts as one step. called with the lock held.
+static void _undo_trim(dt_undo_t *self)
+{
+  const int max_steps = dt_conf_get_int("undo_max_steps");
+  if(max_steps <= 0) return;
+
+  // from the most recent item, a group shows its end first
+  int steps = 0;
+  gboolean in_group = FALSE;
+  for(GList *l = self->undo_list; l; l = g_list_next(l))
+  {
+    const dt_undo_item_t *item = (dt_undo_item_t *)l->data;
+    if(item->is_group) in_group = !in_group;
+    if(in_group) continue;
+    if(++steps == max_steps)
+    {
+      GList *older = l->next;
+      if(older)
+      {
+        l->next = NULL;
+        older->prev = NULL;
+        g_list_free_full(older, _free_undo_data);
+      }
+      break;
+    }
+  }
+}
+
 static void _undo_record(dt_undo_t *self, gpointer user_data, dt_undo_type_t type, dt_undo_data_t data,
                          gboolean is_group,
                          void (*undo)(gpointer user_data, dt_undo_type_t type, dt_undo_data_t item, dt_undo_action_t action, GList **imgs),
@@ -112,6 +141,8 @@ static void _undo_record(dt_undo_t *self, gpointer user_data, dt_undo_type_t typ
       g_list_free_full(self->redo_list, _free_undo_data);
       self->redo_list = NULL;
 
+      if(self->group == DT_UNDO_NONE) _undo_trim(self);
+
       UNLOCK;
     }
   }
@@ -141,6 +172,13 @@ void dt_undo_end_group(dt_undo_t *self)
   {
     _undo_record(self, NULL, self->group, NULL, TRUE, NULL, NULL);
     self->group = DT_UNDO_NONE;
+
+    if(!self->locked)
+    {
+      LOCK;
+      _undo_trim(self);
+      UNLOCK;
+    }
   }
 }
 
@@ -327,6 +365,18 @@ void dt_undo_iterate_internal(dt_undo_t *self, uint32_t filter, gpointer user_da
 }
 
 
+gboolean dt_undo_is_last(dt_undo_t *self, dt_undo_type_t type, dt_undo_data_t data)
+{
+  if(!self || !data) return FALSE;
+
+  LOCK;
+  const dt_undo_item_t *item = self->undo_list ? (dt_undo_item_t *)self->undo_list->data : NULL;
+  const gboolean last = item && !item->is_group && item->type == type && item->data == data
+                        && self->group == DT_UNDO_NONE && !self->redo_list;
+  UNLOCK;
+  return last;
+}
+
 void dt_undo_iterate(dt_undo_t *self, uint32_t filter, gpointer user_data,
                      void (*apply)(gpointer user_data, dt_undo_type_t type, dt_undo_data_t item))
 {
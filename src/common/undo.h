@@ -89,6 +89,9 @@ void dt_undo_iterate(dt_undo_t *self, uint32_t filter, gpointer user_data,
 // disable the next record, this is to avoid recording when reverting a value (in undo callbacks)
 void dt_undo_disable_next(dt_undo_t *self);
 
+// whether data is the last item recorded and nothing has been undone since, so it can still be amended
+gboolean dt_undo_is_last(dt_undo_t *self, dt_undo_type_t type, dt_undo_data_t data);
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
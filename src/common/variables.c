@@ -69,21 +69,119 @@ typedef struct dt_variables_data_t
 
   int flags;
 
+  /** metadata and color labels of the image, read with one query each when the template uses them */
+  char *metadata[DT_METADATA_NUMBER];
+  GList *colorlabels;
+
+  /** the templates expanded so far and what they need, see _variables_compile() */
+  GHashTable *templates;
+
 } dt_variables_data_t;
 
+/** the data a template needs to be expanded */
+typedef enum dt_variables_needs_t
+{
+  DT_VARIABLES_NEEDS_IMAGE = 1 << 0,    // the fields of the image cache
+  DT_VARIABLES_NEEDS_FOLDERS = 1 << 1,  // the home and pictures folders
+  DT_VARIABLES_NEEDS_METADATA = 1 << 2, // the metadata of the image
+  DT_VARIABLES_NEEDS_LABELS = 1 << 3    // the color labels of the image
+} dt_variables_needs_t;
+
+static const struct
+{
+  const char *prefix;
+  dt_variables_needs_t needs;
+} _variables_needs[] = {
+  { "EXIF_", DT_VARIABLES_NEEDS_IMAGE },
+  { "MAKER", DT_VARIABLES_NEEDS_IMAGE },
+  { "MODEL", DT_VARIABLES_NEEDS_IMAGE },
+  { "LENS", DT_VARIABLES_NEEDS_IMAGE },
+  { "VERSION_NAME", DT_VARIABLES_NEEDS_METADATA },
+  { "VERSION", DT_VARIABLES_NEEDS_IMAGE },
+  { "STARS", DT_VARIABLES_NEEDS_IMAGE },
+  { "RATING_ICONS", DT_VARIABLES_NEEDS_IMAGE },
+  { "LONGITUDE", DT_VARIABLES_NEEDS_IMAGE },
+  { "LATITUDE", DT_VARIABLES_NEEDS_IMAGE },
+  { "ELEVATION", DT_VARIABLES_NEEDS_IMAGE },
+  { "SIDECAR_TXT", DT_VARIABLES_NEEDS_IMAGE },
+  { "HOME", DT_VARIABLES_NEEDS_FOLDERS },
+  { "PICTURES_FOLDER", DT_VARIABLES_NEEDS_FOLDERS },
+  { "TITLE", DT_VARIABLES_NEEDS_METADATA },
+  { "DESCRIPTION", DT_VARIABLES_NEEDS_METADATA },
+  { "CREATOR", DT_VARIABLES_NEEDS_METADATA },
+  { "PUBLISHER", DT_VARIABLES_NEEDS_METADATA },
+  { "RIGHTS", DT_VARIABLES_NEEDS_METADATA },
+  { "LABELS", DT_VARIABLES_NEEDS_LABELS },
+};
+
 static char *expand(dt_variables_params_t *params, char **source, char extra_stop);
 
+// finds the data the variables of a template need. that is done once per template, so that every image of an
+// export only reads what its name uses.
+static dt_variables_needs_t _variables_compile(dt_variables_params_t *params, const gchar *source)
+{
+  gpointer needs;
+  if(g_hash_table_lookup_extended(params->data->templates, source, NULL, &needs)) return GPOINTER_TO_INT(needs);
+
+  int found = 0;
+  for(const char *c = strstr(source, "$("); c; c = strstr(c + 2, "$("))
+    for(int i = 0; i < G_N_ELEMENTS(_variables_needs); i++)
+      if(g_str_has_prefix(c + 2, _variables_needs[i].prefix)) found |= _variables_needs[i].needs;
+
+  g_hash_table_insert(params->data->templates, g_strdup(source), GINT_TO_POINTER(found));
+  return found;
+}
+
+static void _variables_read_metadata(dt_variables_params_t *params)
+{
+  sqlite3_stmt *stmt;
+  // the first value of a key in the order of dt_metadata_get()
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT key, value FROM main.meta_data WHERE id = ?1 ORDER BY key, value",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, params->imgid);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    const int keyid = sqlite3_column_int(stmt, 0);
+    const char *value = (const char *)sqlite3_column_text(stmt, 1);
+    if(keyid >= 0 && keyid < DT_METADATA_NUMBER && !params->data->metadata[keyid])
+      params->data->metadata[keyid] = g_strdup(value ? value : "");
+  }
+  sqlite3_finalize(stmt);
+}
+
+static void _variables_read_colorlabels(dt_variables_params_t *params)
+{
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT color FROM main.color_labels WHERE imgid = ?1 ORDER BY color",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, params->imgid);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+    params->data->colorlabels = g_list_prepend(params->data->colorlabels,
+                                               GINT_TO_POINTER(sqlite3_column_int(stmt, 0)));
+  sqlite3_finalize(stmt);
+  params->data->colorlabels = g_list_reverse(params->data->colorlabels);
+}
+
 // gather some data that might be used for variable expansion
-static void init_expansion(dt_variables_params_t *params, gboolean iterate)
+static void init_expansion(dt_variables_params_t *params, const gchar *source, gboolean iterate)
 {
   if(iterate) params->data->sequence++;
 
-  params->data->homedir = dt_loc_get_home_dir(NULL);
+  const dt_variables_needs_t needs = _variables_compile(params, source);
 
-  if(g_get_user_special_dir(G_USER_DIRECTORY_PICTURES) == NULL)
-    params->data->pictures_folder = g_build_path(G_DIR_SEPARATOR_S, params->data->homedir, "Pictures", (char *)NULL);
-  else
-    params->data->pictures_folder = g_strdup(g_get_user_special_dir(G_USER_DIRECTORY_PICTURES));
+  params->data->homedir = NULL;
+  params->data->pictures_folder = NULL;
+  if(needs & DT_VARIABLES_NEEDS_FOLDERS)
+  {
+    params->data->homedir = dt_loc_get_home_dir(NULL);
+
+    if(g_get_user_special_dir(G_USER_DIRECTORY_PICTURES) == NULL)
+      params->data->pictures_folder = g_build_path(G_DIR_SEPARATOR_S, params->data->homedir, "Pictures", (char *)NULL);
+    else
+      params->data->pictures_folder = g_strdup(g_get_user_special_dir(G_USER_DIRECTORY_PICTURES));
+  }
 
   if(params->filename)
   {
@@ -109,37 +207,45 @@ static void init_expansion(dt_variables_params_t *params, gboolean iterate)
   params->data->longitude = 0.0f;
   params->data->latitude = 0.0f;
   params->data->elevation = 0.0f;
+  params->data->flags = 0;
+  params->data->colorlabels = NULL;
+  for(int k = 0; k < DT_METADATA_NUMBER; k++) params->data->metadata[k] = NULL;
   if(params->imgid)
   {
-    const dt_image_t *img = dt_image_cache_get(darktable.image_cache, params->imgid, 'r');
-    if(sscanf(img->exif_datetime_taken, "%d:%d:%d %d:%d:%d", &params->data->exif_tm.tm_year, &params->data->exif_tm.tm_mon,
-      &params->data->exif_tm.tm_mday, &params->data->exif_tm.tm_hour, &params->data->exif_tm.tm_min, &params->data->exif_tm.tm_sec) == 6)
+    if(needs & DT_VARIABLES_NEEDS_IMAGE)
     {
-      params->data->exif_tm.tm_year -= 1900;
-      params->data->exif_tm.tm_mon--;
-      params->data->have_exif_tm = TRUE;
+      const dt_image_t *img = dt_image_cache_get(darktable.image_cache, params->imgid, 'r');
+      if(sscanf(img->exif_datetime_taken, "%d:%d:%d %d:%d:%d", &params->data->exif_tm.tm_year, &params->data->exif_tm.tm_mon,
+        &params->data->exif_tm.tm_mday, &params->data->exif_tm.tm_hour, &params->data->exif_tm.tm_min, &params->data->exif_tm.tm_sec) == 6)
+      {
+        params->data->exif_tm.tm_year -= 1900;
+        params->data->exif_tm.tm_mon--;
+        params->data->have_exif_tm = TRUE;
+      }
+      params->data->exif_iso = img->exif_iso;
+      params->data->camera_maker = g_strdup(img->camera_maker);
+      params->data->camera_alias = g_strdup(img->camera_alias);
+      params->data->exif_lens = g_strdup(img->exif_lens);
+      params->data->version = img->version;
+      params->data->stars = (img->flags & 0x7);
+      if(params->data->stars == 6) params->data->stars = -1;
+
+      params->data->exif_exposure = img->exif_exposure;
+      params->data->exif_exposure_bias = img->exif_exposure_bias;
+      params->data->exif_aperture = img->exif_aperture;
+      params->data->exif_focal_length = img->exif_focal_length;
+      if(!isnan(img->exif_focus_distance) && fpclassify(img->exif_focus_distance) != FP_ZERO)
+        params->data->exif_focus_distance = img->exif_focus_distance;
+      if(!isnan(img->geoloc.longitude)) params->data->longitude = img->geoloc.longitude;
+      if(!isnan(img->geoloc.latitude)) params->data->latitude = img->geoloc.latitude;
+      if(!isnan(img->geoloc.elevation)) params->data->elevation = img->geoloc.elevation;
+
+      params->data->flags = img->flags;
+
+      dt_image_cache_read_release(darktable.image_cache, img);
     }
-    params->data->exif_iso = img->exif_iso;
-    params->data->camera_maker = g_strdup(img->camera_maker);
-    params->data->camera_alias = g_strdup(img->camera_alias);
-    params->data->exif_lens = g_strdup(img->exif_lens);
-    params->data->version = img->version;
-    params->data->stars = (img->flags & 0x7);
-    if(params->data->stars == 6) params->data->stars = -1;
-
-    params->data->exif_exposure = img->exif_exposure;
-    params->data->exif_exposure_bias = img->exif_exposure_bias;
-    params->data->exif_aperture = img->exif_aperture;
-    params->data->exif_focal_length = img->exif_focal_length;
-    if(!isnan(img->exif_focus_distance) && fpclassify(img->exif_focus_distance) != FP_ZERO)
-      params->data->exif_focus_distance = img->exif_focus_distance;
-    if(!isnan(img->geoloc.longitude)) params->data->longitude = img->geoloc.longitude;
-    if(!isnan(img->geoloc.latitude)) params->data->latitude = img->geoloc.latitude;
-    if(!isnan(img->geoloc.elevation)) params->data->elevation = img->geoloc.elevation;
-
-    params->data->flags = img->flags;
-
-    dt_image_cache_read_release(darktable.image_cache, img);
+    if(needs & DT_VARIABLES_NEEDS_METADATA) _variables_read_metadata(params);
+    if(needs & DT_VARIABLES_NEEDS_LABELS) _variables_read_colorlabels(params);
   }
   else if (params->data->exif_time) {
     localtime_r(&params->data->exif_time, &params->data->exif_tm);
@@ -153,6 +259,9 @@ static void cleanup_expansion(dt_variables_params_t *params)
   g_free(params->data->pictures_folder);
   g_free(params->data->camera_maker);
   g_free(params->data->camera_alias);
+  g_free(params->data->exif_lens);
+  for(int k = 0; k < DT_METADATA_NUMBER; k++) g_free(params->data->metadata[k]);
+  g_list_free(params->data->colorlabels);
 }
 
 static inline gboolean has_prefix(char **str, const char *prefix)
@@ -257,15 +366,7 @@ static char *get_base_value(dt_variables_params_t *params, char **variable)
   else if(has_prefix(variable, "ID"))
     result = g_strdup_printf("%d", params->imgid);
   else if(has_prefix(variable, "VERSION_NAME"))
-  {
-    GList *res = dt_metadata_get(params->imgid, "Xmp.darktable.version_name", NULL);
-    res = g_list_first(res);
-    if(res != NULL)
-    {
-      result = g_strdup((char *)res->data);
-    }
-    g_list_free_full(res, &g_free);
-  }
+    result = g_strdup(params->data->metadata[DT_METADATA_XMP_VERSION_NAME]);
   else if(has_prefix(variable, "VERSION_IF_MULTI"))
   {
     sqlite3_stmt *stmt;
@@ -379,8 +480,7 @@ static char *get_base_value(dt_variables_params_t *params, char **variable)
   else if(has_prefix(variable, "LABELS_ICONS") && g_strcmp0(params->jobcode, "infos") == 0)
   {
     escape = FALSE;
-    GList *res = dt_metadata_get(params->imgid, "Xmp.darktable.colorlabels", NULL);
-    res = g_list_first(res);
+    const GList *res = params->data->colorlabels;
     if(res != NULL)
     {
       do
@@ -408,13 +508,11 @@ static char *get_base_value(dt_variables_params_t *params, char **variable)
         }
       } while((res = g_list_next(res)) != NULL);
     }
-    g_list_free(res);
   }
   else if(has_prefix(variable, "LABELS_COLORICONS") && g_strcmp0(params->jobcode, "infos") == 0)
   {
     escape = FALSE;
-    GList *res = dt_metadata_get(params->imgid, "Xmp.darktable.colorlabels", NULL);
-    res = g_list_first(res);
+    const GList *res = params->data->colorlabels;
     if(res != NULL)
     {
       do
@@ -442,14 +540,12 @@ static char *get_base_value(dt_variables_params_t *params, char **variable)
         }
       } while((res = g_list_next(res)) != NULL);
     }
-    g_list_free(res);
   }
   else if(has_prefix(variable, "LABELS") || has_prefix(variable, "LABELS_ICONS") || has_prefix(variable, "LABELS_COLORICONS"))
   {
     // TODO: currently we concatenate all the color labels with a ',' as a separator. Maybe it's better to
     // only use the first/last label?
-    GList *res = dt_metadata_get(params->imgid, "Xmp.darktable.colorlabels", NULL);
-    res = g_list_first(res);
+    const GList *res = params->data->colorlabels;
     if(res != NULL)
     {
       GList *labels = NULL;
@@ -460,58 +556,17 @@ static char *get_base_value(dt_variables_params_t *params, char **variable)
       result = dt_util_glist_to_str(",", labels);
       g_list_free(labels);
     }
-    g_list_free(res);
   }
   else if(has_prefix(variable, "TITLE"))
-  {
-    GList *res = dt_metadata_get(params->imgid, "Xmp.dc.title", NULL);
-    res = g_list_first(res);
-    if(res != NULL)
-    {
-      result = g_strdup((char *)res->data);
-    }
-    g_list_free_full(res, &g_free);
-  }
+    result = g_strdup(params->data->metadata[DT_METADATA_XMP_DC_TITLE]);
   else if(has_prefix(variable, "DESCRIPTION"))
-  {
-    GList *res = dt_metadata_get(params->imgid, "Xmp.dc.description", NULL);
-    res = g_list_first(res);
-    if(res != NULL)
-    {
-      result = g_strdup((char *)res->data);
-    }
-    g_list_free_full(res, &g_free);
-  }
+    result = g_strdup(params->data->metadata[DT_METADATA_XMP_DC_DESCRIPTION]);
   else if(has_prefix(variable, "CREATOR"))
-  {
-    GList *res = dt_metadata_get(params->imgid, "Xmp.dc.creator", NULL);
-    res = g_list_first(res);
-    if(res != NULL)
-    {
-      result = g_strdup((char *)res->data);
-    }
-    g_list_free_full(res, &g_free);
-  }
+    result = g_strdup(params->data->metadata[DT_METADATA_XMP_DC_CREATOR]);
   else if(has_prefix(variable, "PUBLISHER"))
-  {
-    GList *res = dt_metadata_get(params->imgid, "Xmp.dc.publisher", NULL);
-    res = g_list_first(res);
-    if(res != NULL)
-    {
-      result = g_strdup((char *)res->data);
-    }
-    g_list_free_full(res, &g_free);
-  }
+    result = g_strdup(params->data->metadata[DT_METADATA_XMP_DC_PUBLISHER]);
   else if(has_prefix(variable, "RIGHTS"))
-  {
-    GList *res = dt_metadata_get(params->imgid, "Xmp.dc.rights", NULL);
-    res = g_list_first(res);
-    if(res != NULL)
-    {
-      result = g_strdup((char *)res->data);
-    }
-    g_list_free_full(res, &g_free);
-  }
+    result = g_strdup(params->data->metadata[DT_METADATA_XMP_DC_RIGHTS]);
   else if(has_prefix(variable, "OPENCL_ACTIVATED"))
   {
     if(dt_opencl_is_enabled())
@@ -925,7 +980,7 @@ static char *expand(dt_variables_params_t *params, char **source, char extra_sto
 
 char *dt_variables_expand(dt_variables_params_t *params, gchar *source, gboolean iterate)
 {
-  init_expansion(params, iterate);
+  init_expansion(params, source, iterate);
 
   char *result = expand(params, &source, '\0');
 
@@ -941,11 +996,13 @@ void dt_variables_params_init(dt_variables_params_t **params)
   time_t now = time(NULL);
   localtime_r(&now, &(*params)->data->time);
   (*params)->data->exif_time = 0;
+  (*params)->data->templates = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
   (*params)->sequence = -1;
 }
 
 void dt_variables_params_destroy(dt_variables_params_t *params)
 {
+  g_hash_table_destroy(params->data->templates);
   g_free(params->data);
   g_free(params);
 }
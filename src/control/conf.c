@@ -39,18 +39,21 @@ typedef struct dt_conf_dreggn_t
   const char *match;
 } dt_conf_dreggn_t;
 
-/** return slot for this variable or newly allocated slot. */
-static inline char *dt_conf_get_var(const char *name)
+typedef struct dt_conf_watch_t
 {
-  char *str;
+  char *name;
+  dt_conf_watch_callback_t callback;
+  gpointer user_data;
+} dt_conf_watch_t;
 
-  dt_pthread_mutex_lock(&darktable.conf->mutex);
-
-  str = (char *)g_hash_table_lookup(darktable.conf->override_entries, name);
-  if(str) goto fin;
+/** return slot for this variable or newly allocated slot. called with the mutex held. */
+static char *_conf_get_var_locked(const char *name)
+{
+  char *str = (char *)g_hash_table_lookup(darktable.conf->override_entries, name);
+  if(str) return str;
 
   str = (char *)g_hash_table_lookup(darktable.conf->table, name);
-  if(str) goto fin;
+  if(str) return str;
 
   // not found, try defaults
   str = (char *)g_hash_table_lookup(darktable.conf->defaults, name);
@@ -58,20 +61,91 @@ static inline char *dt_conf_get_var(const char *name)
   {
     char *str_new = g_strdup(str);
     g_hash_table_insert(darktable.conf->table, g_strdup(name), str_new);
-    str = str_new;
-    goto fin;
+    return str_new;
   }
 
   // FIXME: why insert garbage?
   // still no luck? insert garbage:
   str = (char *)g_malloc0(sizeof(int32_t));
   g_hash_table_insert(darktable.conf->table, g_strdup(name), str);
+  return str;
+}
 
-fin:
+/** return slot for this variable or newly allocated slot. */
+static inline char *dt_conf_get_var(const char *name)
+{
+  dt_pthread_mutex_lock(&darktable.conf->mutex);
+  char *str = _conf_get_var_locked(name);
   dt_pthread_mutex_unlock(&darktable.conf->mutex);
   return str;
 }
 
+static float _str_to_float(const char *str)
+{
+  const float val = dt_calculator_solve(1, str);
+  return isnan(val) ? 0.0f : val;
+}
+
+static int64_t _str_to_int64(const char *str)
+{
+  const float new_value = _str_to_float(str);
+  if(new_value > 0)
+    return new_value + 0.5;
+  else
+    return new_value - 0.5;
+}
+
+static int _str_to_bool(const char *str)
+{
+  return (str[0] == 'T') || (str[0] == 't');
+}
+
+/** parses the current value of its key into value if that changed, called with the mutex held. */
+static gboolean _value_update(dt_conf_value_t *value)
+{
+  const char *str = _conf_get_var_locked(value->name);
+  if(value->str && !strcmp(value->str, str)) return FALSE;
+
+  const float f = _str_to_float(str);
+  __atomic_store_n(&value->i, (int)_str_to_int64(str), __ATOMIC_RELAXED);
+  __atomic_store_n(&value->i64, _str_to_int64(str), __ATOMIC_RELAXED);
+  __atomic_store(&value->f, &f, __ATOMIC_RELAXED);
+  __atomic_store_n(&value->b, _str_to_bool(str), __ATOMIC_RELAXED);
+  // readers may still hold the old string
+  if(value->str) darktable.conf->retired = g_slist_prepend(darktable.conf->retired, (gpointer)value->str);
+  __atomic_store_n(&value->str, g_strdup(str), __ATOMIC_RELEASE);
+  __atomic_add_fetch(&value->version, 1, __ATOMIC_RELEASE);
+  return TRUE;
+}
+
+static dt_conf_value_t *_value_get_locked(const char *name)
+{
+  dt_conf_value_t *value = (dt_conf_value_t *)g_hash_table_lookup(darktable.conf->values, name);
+  if(!value)
+  {
+    value = (dt_conf_value_t *)g_malloc0(sizeof(dt_conf_value_t));
+    value->name = g_strdup(name);
+    _value_update(value);
+    g_hash_table_insert(darktable.conf->values, value->name, value);
+  }
+  return value;
+}
+
+static void _value_free(gpointer data)
+{
+  dt_conf_value_t *value = (dt_conf_value_t *)data;
+  g_free(value->name);
+  g_free((gpointer)value->str);
+  g_free(value);
+}
+
+static void _watch_free(gpointer data)
+{
+  dt_conf_watch_t *watch = (dt_conf_watch_t *)data;
+  g_free(watch->name);
+  g_free(watch);
+}
+
 /* set the value only if it hasn't been overridden from commandline
  * return 1 if key/value is still the one passed on commandline. */
 static int dt_conf_set_if_not_overridden(const char *name, char *str)
@@ -85,8 +159,28 @@ static int dt_conf_set_if_not_overridden(const char *name, char *str)
     g_hash_table_insert(darktable.conf->table, g_strdup(name), str);
   }
 
+  // the watches of the key are called without the lock, they may well read the configuration themselves
+  GSList *watches = NULL;
+  dt_conf_value_t *value = (dt_conf_value_t *)g_hash_table_lookup(darktable.conf->values, name);
+  if(value && _value_update(value))
+    for(GSList *w = darktable.conf->watches; w; w = g_slist_next(w))
+    {
+      const dt_conf_watch_t *watch = (dt_conf_watch_t *)w->data;
+      if(strcmp(watch->name, name)) continue;
+      dt_conf_watch_t *copy = g_malloc(sizeof(dt_conf_watch_t));
+      *copy = *watch;
+      watches = g_slist_prepend(watches, copy);
+    }
+
   dt_pthread_mutex_unlock(&darktable.conf->mutex);
 
+  for(GSList *w = watches; w; w = g_slist_next(w))
+  {
+    const dt_conf_watch_t *watch = (dt_conf_watch_t *)w->data;
+    watch->callback(name, watch->user_data);
+  }
+  g_slist_free_full(watches, g_free);
+
   return is_overridden;
 }
 
@@ -124,42 +218,25 @@ void dt_conf_set_string(const char *name, const char *val)
 int dt_conf_get_int(const char *name)
 {
   const char *str = dt_conf_get_var(name);
-  float new_value = dt_calculator_solve(1, str);
-  if(isnan(new_value)) new_value = 0.0;
-  int val;
-  if(new_value > 0)
-    val = new_value + 0.5;
-  else
-    val = new_value - 0.5;
-  return val;
+  return _str_to_int64(str);
 }
 
 int64_t dt_conf_get_int64(const char *name)
 {
   const char *str = dt_conf_get_var(name);
-  float new_value = dt_calculator_solve(1, str);
-  if(isnan(new_value)) new_value = 0.0;
-  int64_t val;
-  if(new_value > 0)
-    val = new_value + 0.5;
-  else
-    val = new_value - 0.5;
-  return val;
+  return _str_to_int64(str);
 }
 
 float dt_conf_get_float(const char *name)
 {
   const char *str = dt_conf_get_var(name);
-  float val = dt_calculator_solve(1, str);
-  if(isnan(val)) val = 0.0;
-  return val;
+  return _str_to_float(str);
 }
 
 int dt_conf_get_bool(const char *name)
 {
   const char *str = dt_conf_get_var(name);
-  const int val = (str[0] == 'T') || (str[0] == 't');
-  return val;
+  return _str_to_bool(str);
 }
 
 gchar *dt_conf_get_string(const char *name)
@@ -173,6 +250,9 @@ void dt_conf_init(dt_conf_t *cf, const char *filename, GSList *override_entries)
   cf->table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
   cf->defaults = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
   cf->override_entries = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  cf->values = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, _value_free);
+  cf->watches = NULL;
+  cf->retired = NULL;
   dt_pthread_mutex_init(&darktable.conf->mutex, NULL);
   FILE *f = 0;
 
@@ -273,6 +353,9 @@ void dt_conf_cleanup(dt_conf_t *cf)
   g_hash_table_unref(cf->table);
   g_hash_table_unref(cf->defaults);
   g_hash_table_unref(cf->override_entries);
+  g_hash_table_unref(cf->values);
+  g_slist_free_full(cf->watches, _watch_free);
+  g_slist_free_full(cf->retired, g_free);
   dt_pthread_mutex_destroy(&darktable.conf->mutex);
 }
 
@@ -309,6 +392,44 @@ GSList *dt_conf_all_string_entries(const char *dir)
   return d.result;
 }
 
+const dt_conf_value_t *dt_conf_value(const char *name)
+{
+  dt_pthread_mutex_lock(&darktable.conf->mutex);
+  const dt_conf_value_t *value = _value_get_locked(name);
+  dt_pthread_mutex_unlock(&darktable.conf->mutex);
+  return value;
+}
+
+void dt_conf_watch(const char *name, dt_conf_watch_callback_t callback, gpointer user_data)
+{
+  dt_conf_watch_t *watch = g_malloc(sizeof(dt_conf_watch_t));
+  watch->name = g_strdup(name);
+  watch->callback = callback;
+  watch->user_data = user_data;
+
+  dt_pthread_mutex_lock(&darktable.conf->mutex);
+  // changes are noticed through the value
+  _value_get_locked(name);
+  darktable.conf->watches = g_slist_prepend(darktable.conf->watches, watch);
+  dt_pthread_mutex_unlock(&darktable.conf->mutex);
+}
+
+void dt_conf_unwatch(const char *name, dt_conf_watch_callback_t callback, gpointer user_data)
+{
+  dt_pthread_mutex_lock(&darktable.conf->mutex);
+  for(GSList *w = darktable.conf->watches; w; w = g_slist_next(w))
+  {
+    dt_conf_watch_t *watch = (dt_conf_watch_t *)w->data;
+    if(watch->callback == callback && watch->user_data == user_data && !strcmp(watch->name, name))
+    {
+      darktable.conf->watches = g_slist_delete_link(darktable.conf->watches, w);
+      _watch_free(watch);
+      break;
+    }
+  }
+  dt_pthread_mutex_unlock(&darktable.conf->mutex);
+}
+
 void dt_conf_string_entry_free(gpointer data)
 {
   dt_conf_string_entry_t *nv = (dt_conf_string_entry_t *)data;
@@ -27,6 +27,26 @@
 #include <glib.h>
 #include <inttypes.h>
 
+/**
+ * the value of a key as of its last change, already parsed into every type. reading it takes no lock and
+ * allocates nothing, which the getters below do both of, so the hot paths of the pipe, tiling and caches get
+ * the handle of their key once with dt_conf_value() and read it with dt_conf_value_int() and friends. the
+ * version is bumped by every change, to tell if something derived from the value is stale.
+ */
+typedef struct dt_conf_value_t
+{
+  char *name;
+  uint32_t version;
+  int i;
+  int64_t i64;
+  float f;
+  int b;
+  const char *str; // never changed in place, the previous strings stay valid until dt_conf_cleanup()
+} dt_conf_value_t;
+
+/** called after the value of a key changed, see dt_conf_watch(). */
+typedef void (*dt_conf_watch_callback_t)(const char *name, gpointer user_data);
+
 typedef struct dt_conf_t
 {
   dt_pthread_mutex_t mutex;
@@ -34,6 +54,9 @@ typedef struct dt_conf_t
   GHashTable *table;
   GHashTable *defaults;
   GHashTable *override_entries;
+  GHashTable *values; // name -> dt_conf_value_t, of the keys asked for with dt_conf_value() or watched
+  GSList *watches;    // of all keys
+  GSList *retired;    // strings replaced in the values
 } dt_conf_t;
 
 typedef struct dt_conf_string_entry_t
@@ -58,6 +81,39 @@ int dt_conf_key_exists(const char *key);
 GSList *dt_conf_all_string_entries(const char *dir);
 void dt_conf_string_entry_free(gpointer data);
 
+/** the handle of a key, valid until dt_conf_cleanup(). the first call for a key takes the lock once. */
+const dt_conf_value_t *dt_conf_value(const char *name);
+static inline int dt_conf_value_int(const dt_conf_value_t *value)
+{
+  return __atomic_load_n(&value->i, __ATOMIC_RELAXED);
+}
+static inline int64_t dt_conf_value_int64(const dt_conf_value_t *value)
+{
+  return __atomic_load_n(&value->i64, __ATOMIC_RELAXED);
+}
+static inline float dt_conf_value_float(const dt_conf_value_t *value)
+{
+  float f;
+  __atomic_load(&value->f, &f, __ATOMIC_RELAXED);
+  return f;
+}
+static inline int dt_conf_value_bool(const dt_conf_value_t *value)
+{
+  return __atomic_load_n(&value->b, __ATOMIC_RELAXED);
+}
+static inline const char *dt_conf_value_string(const dt_conf_value_t *value)
+{
+  return __atomic_load_n(&value->str, __ATOMIC_ACQUIRE);
+}
+static inline uint32_t dt_conf_value_version(const dt_conf_value_t *value)
+{
+  return __atomic_load_n(&value->version, __ATOMIC_ACQUIRE);
+}
+
+/** has callback called on the thread which set the key whenever its value changes. */
+void dt_conf_watch(const char *name, dt_conf_watch_callback_t callback, gpointer user_data);
+void dt_conf_unwatch(const char *name, dt_conf_watch_callback_t callback, gpointer user_data);
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -64,6 +64,9 @@ void dt_control_init(dt_control_t *s)
   dt_pthread_mutex_init(&(s->toast_mutex), NULL);
 
   pthread_cond_init(&s->cond, NULL);
+  pthread_cond_init(&s->cond_res, NULL);
+  s->idle_workers = 0;
+  s->parallel = NULL;
   dt_pthread_mutex_init(&s->cond_mutex, NULL);
   dt_pthread_mutex_init(&s->queue_mutex, NULL);
   dt_pthread_mutex_init(&s->res_mutex, NULL);
@@ -156,6 +159,7 @@ void dt_control_shutdown(dt_control_t *s)
   dt_pthread_mutex_unlock(&s->run_mutex);
   dt_pthread_mutex_unlock(&s->cond_mutex);
   pthread_cond_broadcast(&s->cond);
+  pthread_cond_broadcast(&s->cond_res);
 
   /* first wait for kick_on_workers_thread */
   pthread_join(s->kick_on_workers_thread, NULL);
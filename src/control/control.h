@@ -202,13 +202,16 @@ typedef struct dt_control_t
   int32_t running;
   gboolean export_scheduled;
   dt_pthread_mutex_t queue_mutex, cond_mutex, run_mutex;
-  pthread_cond_t cond;
+  // workers wait on cond, the reserved ones on cond_res. idle_workers counts the former, under cond_mutex.
+  pthread_cond_t cond, cond_res;
+  int32_t idle_workers;
   int32_t num_threads;
   pthread_t *thread, kick_on_workers_thread;
   dt_job_t **job;
 
-  GList *queues[DT_JOB_QUEUE_MAX];
-  size_t queue_length[DT_JOB_QUEUE_MAX];
+  GQueue queues[DT_JOB_QUEUE_MAX];
+  // loops of dt_control_parallel_for() idle workers can help with, under queue_mutex
+  GList *parallel;
 
   dt_pthread_mutex_t res_mutex;
   dt_job_t *job_res[DT_CTL_WORKER_RESERVED];
@@ -16,6 +16,7 @@
     along with darktable.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <gio/gio.h>
 #include <glib.h>
 #include <glib/gstdio.h>
 #include <sqlite3.h>
@@ -26,7 +27,9 @@
 #include "common/database.h"
 #include "common/history.h"
 #include "common/image.h"
+#include "common/image_cache.h"
 #include "control/conf.h"
+#include "control/jobs.h"
 #include "crawler.h"
 #include "gui/gtk.h"
 #ifdef GDK_WINDOWING_QUARTZ
@@ -54,21 +57,80 @@ typedef struct dt_control_crawler_result_t
 } dt_control_crawler_result_t;
 
 
+// folders changed this many seconds before a run get checked again by the next one, their mtime might not be
+// final yet
+#define DT_CRAWLER_MTIME_SLACK 2
+// folders watched for changes while darktable runs, those of the most recently used film rolls
+#define DT_CRAWLER_MAX_MONITORS 256
+
+typedef struct dt_control_crawler_flags_t
+{
+  int id;
+  int set, clear;
+} dt_control_crawler_flags_t;
+
+static struct
+{
+  GList *monitors;   // GFileMonitor of film roll folders
+  GHashTable *dirty; // film ids which will be checked by the next run anyway
+} _crawler = { NULL, NULL };
+
+static time_t _folder_mtime(const char *folder)
+{
+  struct stat statbuf;
+  // on Windows the encoding might not be UTF8
+  gchar *folder_locale = g_locale_from_utf8(folder, -1, NULL, NULL, NULL);
+  const int stat_res = stat(folder_locale, &statbuf);
+  g_free(folder_locale);
+  return stat_res == -1 ? 0 : statbuf.st_mtime;
+}
+
 GList *dt_control_crawler_run()
 {
-  sqlite3_stmt *stmt, *inner_stmt;
+  sqlite3_stmt *stmt;
   GList *result = NULL;
-  gboolean look_for_xmp = dt_conf_get_bool("write_sidecar_files");
+  GList *flags_list = NULL;
+  const gboolean look_for_xmp = dt_conf_get_bool("write_sidecar_files");
+  const gboolean skip_unchanged = dt_conf_get_bool("crawler/skip_unchanged_folders");
+  const time_t now = time(NULL);
+  int folders = 0, checked = 0;
+
+  // step 0: find the folders changed since the last run. images in other folders haven't gained or lost any
+  // files. sidecars rewritten in place don't change their folder, the monitors catch these while darktable
+  // runs.
+  // film id -> mtime to remember for the folder, 0 if it has to be checked again next time
+  GHashTable *changed = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT f.id, f.folder, c.mtime FROM main.film_rolls AS f "
+                              "LEFT JOIN main.crawler_folders AS c ON c.film_id = f.id",
+                              -1, &stmt, NULL);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    const int film_id = sqlite3_column_int(stmt, 0);
+    const gchar *folder = (const gchar *)sqlite3_column_text(stmt, 1);
+    const time_t stored = sqlite3_column_type(stmt, 2) == SQLITE_NULL ? 0 : sqlite3_column_int64(stmt, 2);
+    folders++;
+
+    // a missing folder only has missing images, which we ignore
+    const time_t mtime = _folder_mtime(folder);
+    if(mtime == 0)
+    {
+      dt_print(DT_DEBUG_CONTROL, "[crawler] `%s' (film id: %d) is missing.\n", folder, film_id);
+      continue;
+    }
+    if(skip_unchanged && mtime == stored) continue;
 
-  sqlite3_prepare_v2(dt_database_get(darktable.db),
-                     "SELECT i.id, write_timestamp, version, folder || '" G_DIR_SEPARATOR_S "' || filename, flags "
-                     "FROM main.images i, main.film_rolls f ON i.film_id = f.id ORDER BY f.id, filename",
-                     -1, &stmt, NULL);
-  sqlite3_prepare_v2(dt_database_get(darktable.db), "UPDATE main.images SET flags = ?1 WHERE id = ?2", -1,
-                     &inner_stmt, NULL);
+    time_t *keep = g_malloc(sizeof(time_t));
+    *keep = mtime < now - DT_CRAWLER_MTIME_SLACK ? mtime : 0;
+    g_hash_table_insert(changed, GINT_TO_POINTER(film_id), keep);
+  }
+  sqlite3_finalize(stmt);
 
-  // let's wrap this into a transaction, it might make it a little faster.
-  sqlite3_exec(dt_database_get(darktable.db), "BEGIN TRANSACTION", NULL, NULL, NULL);
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT i.id, write_timestamp, version, "
+                              "folder || '" G_DIR_SEPARATOR_S "' || filename, flags, film_id "
+                              "FROM main.images i, main.film_rolls f ON i.film_id = f.id ORDER BY f.id, filename",
+                              -1, &stmt, NULL);
 
   while(sqlite3_step(stmt) == SQLITE_ROW)
   {
@@ -76,7 +138,12 @@ GList *dt_control_crawler_run()
     const time_t timestamp = sqlite3_column_int(stmt, 1);
     const int version = sqlite3_column_int(stmt, 2);
     const gchar *image_path = (char *)sqlite3_column_text(stmt, 3);
-    int flags = sqlite3_column_int(stmt, 4);
+    const int flags = sqlite3_column_int(stmt, 4);
+    const int film_id = sqlite3_column_int(stmt, 5);
+
+    time_t *keep = g_hash_table_lookup(changed, GINT_TO_POINTER(film_id));
+    if(!keep) continue;
+    checked++;
 
     // if the image is missing we ignore it.
     if(!g_file_test(image_path, G_FILE_TEST_EXISTS))
@@ -121,6 +188,9 @@ GList *dt_control_crawler_run()
 
         result = g_list_append(result, item);
         dt_print(DT_DEBUG_CONTROL, "[crawler] `%s' (id: %d) is a newer xmp file.\n", xmp_path, id);
+
+        // the user might keep the database version without overwriting the file, so look at it again next time
+        *keep = 0;
       }
       // older timestamps are the case for all images after the db upgrade. better not report these
       //       else if(timestamp > statbuf.st_mtime)
@@ -175,24 +245,125 @@ GList *dt_control_crawler_run()
       new_flags &= ~DT_IMAGE_HAS_WAV;
     if(flags != new_flags)
     {
-      sqlite3_bind_int(inner_stmt, 1, new_flags);
-      sqlite3_bind_int(inner_stmt, 2, id);
-      sqlite3_step(inner_stmt);
-      sqlite3_reset(inner_stmt);
-      sqlite3_clear_bindings(inner_stmt);
+      dt_control_crawler_flags_t *change = g_malloc(sizeof(dt_control_crawler_flags_t));
+      change->id = id;
+      change->set = new_flags & ~flags;
+      change->clear = flags & ~new_flags;
+      flags_list = g_list_prepend(flags_list, change);
     }
 
     free(extra_path);
   }
+  sqlite3_finalize(stmt);
 
-  sqlite3_exec(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
-
+  // the gui may be using the images meanwhile, so the flags go through the image cache. only the bits we looked
+  // at are changed.
+  for(GList *l = flags_list; l; l = g_list_next(l))
+  {
+    const dt_control_crawler_flags_t *change = (dt_control_crawler_flags_t *)l->data;
+    dt_image_t *img = dt_image_cache_get(darktable.image_cache, change->id, 'w');
+    if(!img) continue;
+    img->flags = (img->flags | change->set) & ~change->clear;
+    dt_image_cache_write_release(darktable.image_cache, img, DT_IMAGE_CACHE_RELAXED);
+  }
+  g_list_free_full(flags_list, g_free);
+
+  // remember the folders which don't need to be looked at next time
+  dt_database_start_transaction(darktable.db);
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "INSERT OR REPLACE INTO main.crawler_folders (film_id, mtime) VALUES (?1, ?2)", -1,
+                              &stmt, NULL);
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, changed);
+  while(g_hash_table_iter_next(&iter, &key, &value))
+  {
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, GPOINTER_TO_INT(key));
+    DT_DEBUG_SQLITE3_BIND_INT64(stmt, 2, *(time_t *)value);
+    sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+  }
   sqlite3_finalize(stmt);
-  sqlite3_finalize(inner_stmt);
+  dt_database_release_transaction(darktable.db);
+
+  dt_print(DT_DEBUG_CONTROL | DT_DEBUG_PERF, "[crawler] checked %d of %d folders, %d images\n",
+           g_hash_table_size(changed), folders, checked);
+  g_hash_table_destroy(changed);
 
   return result;
 }
 
+// forget the mtime of a folder once something changes in it, the next run has to look at it
+static void _folder_changed_callback(GFileMonitor *monitor, GFile *file, GFile *other_file,
+                                     GFileMonitorEvent event_type, gpointer user_data)
+{
+  const int film_id = GPOINTER_TO_INT(user_data);
+  if(event_type == G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED
+     || g_hash_table_contains(_crawler.dirty, GINT_TO_POINTER(film_id)))
+    return;
+
+  g_hash_table_add(_crawler.dirty, GINT_TO_POINTER(film_id));
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "DELETE FROM main.crawler_folders WHERE film_id = ?1",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, film_id);
+  sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
+}
+
+static void _watch_folders()
+{
+  _crawler.dirty = g_hash_table_new(NULL, NULL);
+
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT f.id, f.folder FROM main.film_rolls AS f "
+                              "JOIN main.crawler_folders AS c ON c.film_id = f.id "
+                              "ORDER BY f.access_timestamp DESC LIMIT ?1",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, DT_CRAWLER_MAX_MONITORS);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    const int film_id = sqlite3_column_int(stmt, 0);
+    GFile *folder = g_file_new_for_path((const char *)sqlite3_column_text(stmt, 1));
+    GFileMonitor *monitor = g_file_monitor_directory(folder, G_FILE_MONITOR_NONE, NULL, NULL);
+    g_object_unref(folder);
+    if(!monitor) continue;
+    g_signal_connect(G_OBJECT(monitor), "changed", G_CALLBACK(_folder_changed_callback), GINT_TO_POINTER(film_id));
+    _crawler.monitors = g_list_prepend(_crawler.monitors, monitor);
+  }
+  sqlite3_finalize(stmt);
+}
+
+static gboolean _crawler_done_gui_thread(gpointer user_data)
+{
+  _watch_folders();
+  dt_control_crawler_show_image_list((GList *)user_data);
+  return FALSE;
+}
+
+static int32_t _crawler_job_run(dt_job_t *job)
+{
+  GList *images = dt_control_crawler_run();
+  g_main_context_invoke(NULL, _crawler_done_gui_thread, images);
+  return 0;
+}
+
+void dt_control_crawler_start()
+{
+  dt_job_t *job = dt_control_job_create(&_crawler_job_run, "look for updated xmp files");
+  if(job) dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_BG, job);
+}
+
+void dt_control_crawler_cleanup()
+{
+  for(GList *l = _crawler.monitors; l; l = g_list_next(l)) g_file_monitor_cancel(G_FILE_MONITOR(l->data));
+  g_list_free_full(_crawler.monitors, g_object_unref);
+  _crawler.monitors = NULL;
+  if(_crawler.dirty) g_hash_table_destroy(_crawler.dirty);
+  _crawler.dirty = NULL;
+}
+
 
 /********************* the gui stuff *********************/
 
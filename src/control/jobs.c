@@ -17,6 +17,7 @@
 */
 
 #include "control/jobs.h"
+#include "common/metrics.h"
 #include "control/control.h"
 
 #define DT_CONTROL_FG_PRIORITY 4
@@ -48,6 +49,9 @@ typedef struct _dt_job_t
   dt_job_queue_t queue;
 
   dt_job_state_change_callback state_changed_cb;
+  dt_job_urgency_callback urgency_cb;
+  int urgency;
+  double queued; // when it was added, for the wait time metrics
 
   dt_progress_t *progress;
 
@@ -155,6 +159,68 @@ void dt_control_job_set_state_callback(_dt_job_t *job, dt_job_state_change_callb
   job->state_changed_cb = cb;
 }
 
+void dt_control_job_set_urgency_callback(_dt_job_t *job, dt_job_urgency_callback cb)
+{
+  if(dt_control_job_get_state(job) != DT_JOB_STATE_INITIALIZED) return;
+  job->urgency_cb = cb;
+}
+
+static inline int dt_control_job_urgency(_dt_job_t *job)
+{
+  return job->urgency_cb ? job->urgency_cb(job) : 0;
+}
+
+// more urgent first, g_queue_sort() keeps the order of equally urgent jobs
+static gint dt_control_job_compare_urgency(gconstpointer a, gconstpointer b, gpointer user_data)
+{
+  return ((const _dt_job_t *)b)->urgency - ((const _dt_job_t *)a)->urgency;
+}
+
+
+static const char *dt_control_queue_names[DT_JOB_QUEUE_MAX]
+    = { "user_fg", "system_fg", "user_bg", "user_export", "system_bg" };
+
+// jobs.<queue>.<what>
+static void dt_control_queue_metric(const dt_job_queue_t queue, const char *what, char *name, const size_t size)
+{
+  snprintf(name, size, "jobs.%s.%s", ((unsigned int)queue) < DT_JOB_QUEUE_MAX ? dt_control_queue_names[queue]
+                                                                               : "reserved", what);
+}
+
+static void dt_control_queue_count(const dt_job_queue_t queue, const char *what)
+{
+  char name[64];
+  dt_control_queue_metric(queue, what, name, sizeof(name));
+  dt_metrics_count(name, 1);
+}
+
+static void dt_control_queue_time(const dt_job_queue_t queue, const char *what, const double seconds)
+{
+  char name[64];
+  dt_control_queue_metric(queue, what, name, sizeof(name));
+  dt_metrics_time(name, seconds);
+}
+
+// queue depths and workers, read whenever the metrics are
+static void dt_control_jobs_collect_metrics(gpointer user_data)
+{
+  dt_control_t *control = (dt_control_t *)user_data;
+  int64_t depth[DT_JOB_QUEUE_MAX];
+  int64_t busy = 0;
+  dt_pthread_mutex_lock(&control->queue_mutex);
+  for(int i = 0; i < DT_JOB_QUEUE_MAX; i++) depth[i] = control->queues[i].length;
+  for(int k = 0; k < control->num_threads; k++) busy += control->job[k] != NULL;
+  dt_pthread_mutex_unlock(&control->queue_mutex);
+
+  char name[64];
+  for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
+  {
+    dt_control_queue_metric(i, "depth", name, sizeof(name));
+    dt_metrics_set(dt_metrics_get(name, DT_METRIC_GAUGE), depth[i]);
+  }
+  dt_metrics_set(dt_metrics_get("jobs.workers", DT_METRIC_GAUGE), control->num_threads);
+  dt_metrics_set(dt_metrics_get("jobs.workers_busy", DT_METRIC_GAUGE), busy);
+}
 
 static void dt_control_job_print(_dt_job_t *job)
 {
@@ -210,9 +276,12 @@ static int32_t dt_control_run_job_res(dt_control_t *control, int32_t res)
     dt_print(DT_DEBUG_CONTROL, "\n");
 
     dt_control_job_set_state(job, DT_JOB_STATE_RUNNING);
+    dt_control_queue_time(DT_JOB_QUEUE_MAX, "wait", dt_get_wtime() - job->queued);
 
     /* execute job */
+    const double start = dt_get_wtime();
     job->result = job->execute(job);
+    dt_control_queue_time(DT_JOB_QUEUE_MAX, "run", dt_get_wtime() - start);
 
     dt_control_job_set_state(job, DT_JOB_STATE_FINISHED);
     dt_print(DT_DEBUG_CONTROL, "[run_job-] %02d %f ", res, dt_get_wtime());
@@ -245,9 +314,9 @@ static _dt_job_t *dt_control_schedule_job(dt_control_t *control)
   int max_priority = -1;
   for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
   {
-    if(control->queues[i] == NULL) continue;
+    if(g_queue_is_empty(&control->queues[i])) continue;
     if(control->export_scheduled && i == DT_JOB_QUEUE_USER_EXPORT) continue;
-    _dt_job_t *_job = (_dt_job_t *)control->queues[i]->data;
+    _dt_job_t *_job = (_dt_job_t *)g_queue_peek_head(&control->queues[i]);
     if(_job->priority > max_priority)
     {
       max_priority = _job->priority;
@@ -267,9 +336,8 @@ static _dt_job_t *dt_control_schedule_job(dt_control_t *control)
   // invariant -> job is the one we are looking for
 
   // remove the to be scheduled job from its queue
-  GList **queue = &control->queues[winner_queue];
-  *queue = g_list_delete_link(*queue, *queue);
-  control->queue_length[winner_queue]--;
+  g_queue_pop_head(&control->queues[winner_queue]);
+  const double wait = dt_get_wtime() - job->queued;
   if(winner_queue == DT_JOB_QUEUE_USER_EXPORT) control->export_scheduled = TRUE;
 
   // and place it in scheduled job array (for job deduping)
@@ -278,12 +346,14 @@ static _dt_job_t *dt_control_schedule_job(dt_control_t *control)
   // increment the priorities of the others
   for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
   {
-    if(i == winner_queue || control->queues[i] == NULL) continue;
-    ((_dt_job_t *)control->queues[i]->data)->priority++;
+    if(i == winner_queue || g_queue_is_empty(&control->queues[i])) continue;
+    ((_dt_job_t *)g_queue_peek_head(&control->queues[i]))->priority++;
   }
 
   dt_pthread_mutex_unlock(&control->queue_mutex);
 
+  dt_control_queue_time(winner_queue, "wait", wait);
+
   return job;
 }
 
@@ -297,7 +367,12 @@ static void dt_control_job_execute(_dt_job_t *job)
   dt_control_job_set_state(job, DT_JOB_STATE_RUNNING);
 
   /* execute job */
+  const double start = dt_get_wtime();
   job->result = job->execute(job);
+  const double run = dt_get_wtime() - start;
+  dt_control_queue_time(job->queue, "run", run);
+  // worker utilisation is this over uptime_ms times jobs.workers
+  dt_metrics_count("jobs.busy_ms", (int64_t)(run * 1e3));
 
   dt_control_job_set_state(job, DT_JOB_STATE_FINISHED);
 
@@ -332,6 +407,113 @@ static int32_t dt_control_run_job(dt_control_t *control)
   return 0;
 }
 
+static void dt_control_wake_worker(dt_control_t *control)
+{
+  dt_pthread_mutex_lock(&control->cond_mutex);
+  if(control->idle_workers > 0) pthread_cond_signal(&control->cond);
+  dt_pthread_mutex_unlock(&control->cond_mutex);
+}
+
+typedef struct dt_control_parallel_t
+{
+  dt_control_parallel_callback body;
+  void *data;
+  int count;
+  gint next; // next index to claim
+  int helpers; // workers running parts of it, under mutex
+  dt_pthread_mutex_t mutex;
+  pthread_cond_t cond;
+} dt_control_parallel_t;
+
+static void dt_control_parallel_run(dt_control_parallel_t *parallel)
+{
+  int index;
+  while((index = g_atomic_int_add(&parallel->next, 1)) < parallel->count) parallel->body(index, parallel->data);
+}
+
+// called with queue_mutex held
+static gboolean dt_control_work_available(dt_control_t *control)
+{
+  for(int i = 0; i < DT_JOB_QUEUE_MAX; i++)
+  {
+    if(g_queue_is_empty(&control->queues[i])) continue;
+    if(control->export_scheduled && i == DT_JOB_QUEUE_USER_EXPORT) continue;
+    return TRUE;
+  }
+  for(GList *iter = control->parallel; iter; iter = g_list_next(iter))
+  {
+    dt_control_parallel_t *parallel = (dt_control_parallel_t *)iter->data;
+    if(g_atomic_int_get(&parallel->next) < parallel->count) return TRUE;
+  }
+  return FALSE;
+}
+
+// runs parts of a dt_control_parallel_for() loop, returns FALSE if there was none to help with
+static gboolean dt_control_help_parallel(dt_control_t *control)
+{
+  dt_control_parallel_t *parallel = NULL;
+  dt_pthread_mutex_lock(&control->queue_mutex);
+  for(GList *iter = control->parallel; iter; iter = g_list_next(iter))
+  {
+    dt_control_parallel_t *candidate = (dt_control_parallel_t *)iter->data;
+    if(g_atomic_int_get(&candidate->next) < candidate->count)
+    {
+      parallel = candidate;
+      dt_pthread_mutex_lock(&parallel->mutex);
+      parallel->helpers++;
+      dt_pthread_mutex_unlock(&parallel->mutex);
+      break;
+    }
+  }
+  dt_pthread_mutex_unlock(&control->queue_mutex);
+  if(!parallel) return FALSE;
+
+  dt_control_parallel_run(parallel);
+
+  dt_pthread_mutex_lock(&parallel->mutex);
+  if(--parallel->helpers == 0) pthread_cond_signal(&parallel->cond);
+  dt_pthread_mutex_unlock(&parallel->mutex);
+  return TRUE;
+}
+
+void dt_control_parallel_for(const int count, dt_control_parallel_callback body, void *data)
+{
+  dt_control_t *control = darktable.control;
+  if(count <= 0) return;
+  if(count == 1 || !control || control->num_threads < 2 || !dt_control_running())
+  {
+    for(int index = 0; index < count; index++) body(index, data);
+    return;
+  }
+
+  dt_control_parallel_t parallel = { .body = body, .data = data, .count = count, .next = 0, .helpers = 0 };
+  dt_pthread_mutex_init(&parallel.mutex, NULL);
+  pthread_cond_init(&parallel.cond, NULL);
+
+  dt_pthread_mutex_lock(&control->queue_mutex);
+  control->parallel = g_list_append(control->parallel, &parallel);
+  dt_pthread_mutex_unlock(&control->queue_mutex);
+
+  dt_pthread_mutex_lock(&control->cond_mutex);
+  const int wake = MIN(control->idle_workers, count - 1);
+  for(int k = 0; k < wake; k++) pthread_cond_signal(&control->cond);
+  dt_pthread_mutex_unlock(&control->cond_mutex);
+
+  dt_control_parallel_run(&parallel);
+
+  // off the list no worker starts helping any more, then wait for the ones still running a part
+  dt_pthread_mutex_lock(&control->queue_mutex);
+  control->parallel = g_list_remove(control->parallel, &parallel);
+  dt_pthread_mutex_unlock(&control->queue_mutex);
+
+  dt_pthread_mutex_lock(&parallel.mutex);
+  while(parallel.helpers > 0) dt_pthread_cond_wait(&parallel.cond, &parallel.mutex);
+  dt_pthread_mutex_unlock(&parallel.mutex);
+
+  pthread_cond_destroy(&parallel.cond);
+  dt_pthread_mutex_destroy(&parallel.mutex);
+}
+
 int32_t dt_control_add_job_res(dt_control_t *control, _dt_job_t *job, int32_t res)
 {
   if(((unsigned int)res) >= DT_CTL_WORKER_RESERVED || !job)
@@ -355,13 +537,14 @@ int32_t dt_control_add_job_res(dt_control_t *control, _dt_job_t *job, int32_t re
   dt_print(DT_DEBUG_CONTROL, "\n");
 
   dt_control_job_set_state(job, DT_JOB_STATE_QUEUED);
+  job->queued = dt_get_wtime();
   control->job_res[res] = job;
   control->new_res[res] = 1;
 
   dt_pthread_mutex_unlock(&control->res_mutex);
 
   dt_pthread_mutex_lock(&control->cond_mutex);
-  pthread_cond_broadcast(&control->cond);
+  pthread_cond_broadcast(&control->cond_res);
   dt_pthread_mutex_unlock(&control->cond_mutex);
 
   return 0;
@@ -375,6 +558,8 @@ int dt_control_add_job(dt_control_t *control, dt_job_queue_t queue_id, _dt_job_t
     return 1;
   }
 
+  job->queue = queue_id;
+
   if(!control->running)
   {
     // whatever we are adding here won't be scheduled as the system isn't running. execute it synchronous instead.
@@ -386,16 +571,13 @@ int dt_control_add_job(dt_control_t *control, dt_job_queue_t queue_id, _dt_job_t
     return 0;
   }
 
-  job->queue = queue_id;
-
   _dt_job_t *job_for_disposal = NULL;
 
   dt_pthread_mutex_lock(&control->queue_mutex);
 
-  GList **queue = &control->queues[queue_id];
-  size_t length = control->queue_length[queue_id];
+  GQueue *queue = &control->queues[queue_id];
 
-  dt_print(DT_DEBUG_CONTROL, "[add_job] %zu | ", length);
+  dt_print(DT_DEBUG_CONTROL, "[add_job] %u | ", queue->length);
   dt_control_job_print(job);
   dt_print(DT_DEBUG_CONTROL, "\n");
 
@@ -418,13 +600,14 @@ int dt_control_add_job(dt_control_t *control, dt_job_queue_t queue_id, _dt_job_t
 
         dt_control_job_set_state(job, DT_JOB_STATE_DISCARDED);
         dt_control_job_dispose(job);
+        dt_control_queue_count(queue_id, "merged");
 
         return 0; // there can't be any further copy
       }
     }
 
     // if the job is already in the queue -> move it to the top
-    for(GList *iter = *queue; iter; iter = g_list_next(iter))
+    for(GList *iter = queue->head; iter; iter = g_list_next(iter))
     {
       _dt_job_t *other_job = (_dt_job_t *)iter->data;
       if(dt_control_job_equal(job, other_job))
@@ -433,8 +616,7 @@ int dt_control_add_job(dt_control_t *control, dt_job_queue_t queue_id, _dt_job_t
         dt_control_job_print(other_job);
         dt_print(DT_DEBUG_CONTROL, "\n");
 
-        *queue = g_list_delete_link(*queue, iter);
-        length--;
+        g_queue_delete_link(queue, iter);
 
         job_for_disposal = job;
 
@@ -443,21 +625,24 @@ int dt_control_add_job(dt_control_t *control, dt_job_queue_t queue_id, _dt_job_t
       }
     }
 
-    // now we can add the new job to the list
-    *queue = g_list_prepend(*queue, job);
-    length++;
+    // now we can add the new job to the list, in front of the jobs which are not more urgent
+    job->urgency = dt_control_job_urgency(job);
+    GList *before = queue->head;
+    while(before && ((_dt_job_t *)before->data)->urgency > job->urgency) before = g_list_next(before);
+    g_queue_insert_before(queue, before, job);
 
-    // and take care of the maximal queue size
-    if(length > DT_CONTROL_MAX_JOBS)
+    // and take care of the maximal queue size by dropping the oldest of the least urgent jobs
+    if(queue->length > DT_CONTROL_MAX_JOBS)
     {
-      GList *last = g_list_last(*queue);
-      dt_control_job_set_state((_dt_job_t *)last->data, DT_JOB_STATE_DISCARDED);
-      dt_control_job_dispose((_dt_job_t *)last->data);
-      *queue = g_list_delete_link(*queue, last);
-      length--;
+      GList *last = queue->tail;
+      for(GList *iter = queue->tail; iter; iter = g_list_previous(iter))
+        if(((_dt_job_t *)iter->data)->urgency < ((_dt_job_t *)last->data)->urgency) last = iter;
+      _dt_job_t *dropped = (_dt_job_t *)last->data;
+      g_queue_delete_link(queue, last);
+      dt_control_job_set_state(dropped, DT_JOB_STATE_DISCARDED);
+      dt_control_job_dispose(dropped);
+      dt_control_queue_count(queue_id, "dropped");
     }
-
-    control->queue_length[queue_id] = length;
   }
   else
   {
@@ -468,24 +653,62 @@ int dt_control_add_job(dt_control_t *control, dt_job_queue_t queue_id, _dt_job_t
       job->priority = 0;
     else
       job->priority = DT_CONTROL_FG_PRIORITY;
-    *queue = g_list_append(*queue, job);
-    control->queue_length[queue_id]++;
+    g_queue_push_tail(queue, job);
   }
+  // a merged job keeps waiting since it was first requested
+  if(!job_for_disposal) job->queued = dt_get_wtime();
   dt_control_job_set_state(job, DT_JOB_STATE_QUEUED);
   dt_pthread_mutex_unlock(&control->queue_mutex);
 
-  // notify workers
-  dt_pthread_mutex_lock(&control->cond_mutex);
-  pthread_cond_broadcast(&control->cond);
-  dt_pthread_mutex_unlock(&control->cond_mutex);
+  dt_control_queue_count(queue_id, "queued");
+
+  // one job needs one worker, waking all of them only has the others go back to sleep
+  dt_control_wake_worker(control);
 
   // dispose of dropped job, if any
+  if(job_for_disposal) dt_control_queue_count(queue_id, "merged");
   dt_control_job_set_state(job_for_disposal, DT_JOB_STATE_DISCARDED);
   dt_control_job_dispose(job_for_disposal);
 
   return 0;
 }
 
+void dt_control_queue_reprioritize(dt_control_t *control, dt_job_queue_t queue_id)
+{
+  if(((unsigned int)queue_id) >= DT_JOB_QUEUE_MAX || !control->running) return;
+
+  GList *dropped = NULL;
+  dt_pthread_mutex_lock(&control->queue_mutex);
+  GQueue *queue = &control->queues[queue_id];
+  GList *iter = queue->head;
+  while(iter)
+  {
+    GList *next = g_list_next(iter);
+    _dt_job_t *job = (_dt_job_t *)iter->data;
+    job->urgency = dt_control_job_urgency(job);
+    if(job->urgency < 0)
+    {
+      g_queue_delete_link(queue, iter);
+      dropped = g_list_prepend(dropped, job);
+    }
+    iter = next;
+  }
+  g_queue_sort(queue, dt_control_job_compare_urgency, NULL);
+  dt_pthread_mutex_unlock(&control->queue_mutex);
+
+  for(GList *l = dropped; l; l = g_list_next(l))
+  {
+    _dt_job_t *job = (_dt_job_t *)l->data;
+    dt_print(DT_DEBUG_CONTROL, "[reprioritize] dropping ");
+    dt_control_job_print(job);
+    dt_print(DT_DEBUG_CONTROL, "\n");
+    dt_control_job_set_state(job, DT_JOB_STATE_DISCARDED);
+    dt_control_job_dispose(job);
+    dt_control_queue_count(queue_id, "dropped");
+  }
+  g_list_free(dropped);
+}
+
 static __thread int threadid = -1;
 
 int32_t dt_control_get_threadid()
@@ -522,7 +745,7 @@ static void *dt_control_work_res(void *ptr)
       int old;
       pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old);
       dt_pthread_mutex_lock(&s->cond_mutex);
-      dt_pthread_cond_wait(&s->cond, &s->cond_mutex);
+      dt_pthread_cond_wait(&s->cond_res, &s->cond_mutex);
       dt_pthread_mutex_unlock(&s->cond_mutex);
       int tmp;
       pthread_setcancelstate(old, &tmp);
@@ -540,19 +763,38 @@ static void *dt_control_worker_kicker(void *ptr)
     sleep(2);
     dt_pthread_mutex_lock(&control->cond_mutex);
     pthread_cond_broadcast(&control->cond);
+    pthread_cond_broadcast(&control->cond_res);
     dt_pthread_mutex_unlock(&control->cond_mutex);
   }
   return NULL;
 }
 
+// in numa mode the workers are spread over the nodes. every worker stays on its node with the openmp team it
+// starts, so that the buffers of the pipe it runs are first touched, and allocated, there.
+static int _control_work_bind_node(const int threadid)
+{
+  if(!dt_conf_get_bool("numa_workers")) return 0;
+  const int nodes = dt_pthread_numa_nodes();
+  if(nodes < 2) return 0;
+  const int node = threadid % nodes;
+  const int cpus = dt_pthread_bind_numa_node(node);
+  if(cpus)
+    dt_print(DT_DEBUG_CONTROL, "[control_work] worker %d bound to numa node %d (%d cpus)\n", threadid, node,
+             cpus);
+  return cpus;
+}
+
 static void *dt_control_work(void *ptr)
 {
-#ifdef _OPENMP // need to do this in every thread
-  omp_set_num_threads(darktable.num_openmp_threads);
-#endif
   worker_thread_parameters_t *params = (worker_thread_parameters_t *)ptr;
   dt_control_t *control = params->self;
   threadid = params->threadid;
+  const int node_cpus = _control_work_bind_node(threadid);
+#ifdef _OPENMP // need to do this in every thread
+  omp_set_num_threads(node_cpus ? MIN(darktable.num_openmp_threads, node_cpus) : darktable.num_openmp_threads);
+#else
+  (void)node_cpus;
+#endif
   char name[16] = {0};
   snprintf(name, sizeof(name), "worker %d", threadid);
   dt_pthread_setname(name);
@@ -561,11 +803,20 @@ static void *dt_control_work(void *ptr)
   while(dt_control_running())
   {
     // dt_print(DT_DEBUG_CONTROL, "[control_work] %d\n", threadid);
-    if(dt_control_run_job(control) < 0)
+    if(dt_control_run_job(control) < 0 && !dt_control_help_parallel(control))
     {
-      // wait for a new job.
+      // wait for a new job, unless one has been added since we looked. adding a job takes cond_mutex to wake
+      // a worker, so it either sees us waiting or we see the job.
       dt_pthread_mutex_lock(&control->cond_mutex);
-      dt_pthread_cond_wait(&control->cond, &control->cond_mutex);
+      dt_pthread_mutex_lock(&control->queue_mutex);
+      const gboolean available = dt_control_work_available(control);
+      dt_pthread_mutex_unlock(&control->queue_mutex);
+      if(!available && control->running)
+      {
+        control->idle_workers++;
+        dt_pthread_cond_wait(&control->cond, &control->cond_mutex);
+        control->idle_workers--;
+      }
       dt_pthread_mutex_unlock(&control->cond_mutex);
     }
   }
@@ -608,6 +859,8 @@ void dt_control_jobs_init(dt_control_t *control)
   control->num_threads = CLAMP(dt_conf_get_int("worker_threads"), 1, 8);
   control->thread = (pthread_t *)calloc(control->num_threads, sizeof(pthread_t));
   control->job = (dt_job_t **)calloc(control->num_threads, sizeof(dt_job_t *));
+  for(int k = 0; k < DT_JOB_QUEUE_MAX; k++) g_queue_init(&control->queues[k]);
+  dt_metrics_add_collector(dt_control_jobs_collect_metrics, control);
   dt_pthread_mutex_lock(&control->run_mutex);
   control->running = 1;
   dt_pthread_mutex_unlock(&control->run_mutex);
@@ -55,6 +55,8 @@ typedef struct _dt_job_t dt_job_t;
 typedef int32_t (*dt_job_execute_callback)(dt_job_t *);
 typedef void (*dt_job_state_change_callback)(dt_job_t *, dt_job_state_t state);
 typedef void (*dt_job_destroy_callback)(void *data);
+/** how urgent a queued job is, jobs with a higher urgency run first, below 0 they are dropped. */
+typedef int (*dt_job_urgency_callback)(dt_job_t *);
 
 /** create a new initialized job */
 dt_job_t *dt_control_job_create(dt_job_execute_callback execute, const char *msg, ...) __attribute__((format(printf, 2, 3)));
@@ -62,6 +64,9 @@ dt_job_t *dt_control_job_create(dt_job_execute_callback execute, const char *msg
 void dt_control_job_dispose(dt_job_t *job);
 /** setup a state callback for job. */
 void dt_control_job_set_state_callback(dt_job_t *job, dt_job_state_change_callback cb);
+/** setup an urgency callback for a job in DT_JOB_QUEUE_SYSTEM_FG. it is asked when the job is queued and by
+    dt_control_queue_reprioritize() and must not add jobs itself. */
+void dt_control_job_set_urgency_callback(dt_job_t *job, dt_job_urgency_callback cb);
 /** cancel a job, running or in queue. */
 void dt_control_job_cancel(dt_job_t *job);
 dt_job_state_t dt_control_job_get_state(dt_job_t *job);
@@ -87,9 +92,18 @@ void dt_control_jobs_cleanup(struct dt_control_t *control);
 
 int dt_control_add_job(struct dt_control_t *control, dt_job_queue_t queue_id, dt_job_t *job);
 int32_t dt_control_add_job_res(struct dt_control_t *s, dt_job_t *job, int32_t res);
+/** asks the queued jobs how urgent they are now, sorts the queue by that and drops the ones no longer needed.
+    jobs without an urgency callback keep their place among the others of urgency 0. */
+void dt_control_queue_reprioritize(struct dt_control_t *control, dt_job_queue_t queue_id);
 
 int32_t dt_control_get_threadid();
 
+typedef void (*dt_control_parallel_callback)(const int index, void *data);
+/** calls body for every index in 0..count-1 and returns when all calls are done. the calling thread does
+    part of the work itself, so a job can use this for its parts without waiting for free workers, and
+    workers without a job to run take the other parts. */
+void dt_control_parallel_for(const int count, dt_control_parallel_callback body, void *data);
+
 #ifdef HAVE_GPHOTO2
 #include "control/jobs/camera_jobs.h"
 #endif
@@ -18,6 +18,7 @@
 #include "control/jobs/camera_jobs.h"
 #include "common/darktable.h"
 #include "common/import_session.h"
+#include "common/mipmap_cache.h"
 #include "common/utility.h"
 #include "control/conf.h"
 #include "control/jobs/image_jobs.h"
@@ -30,6 +31,8 @@
 typedef struct dt_camera_shared_t
 {
   struct dt_import_session_t *session;
+  // the camera the files are imported from
+  const struct dt_camera_t *camera;
 } dt_camera_shared_t;
 
 typedef struct dt_camera_capture_t
@@ -56,6 +59,9 @@ typedef struct dt_camera_get_previews_t
   void *data;
 } dt_camera_get_previews_t;
 
+// downloaded files the registration thread has not got to yet, the download waits for it beyond that
+#define DT_CAMERA_IMPORT_QUEUE 8
+
 typedef struct dt_camera_import_t
 {
   dt_camera_shared_t shared;
@@ -65,6 +71,12 @@ typedef struct dt_camera_import_t
   dt_job_t *job;
   double fraction;
   uint32_t import_count;
+
+  // downloaded files, "" ends the import
+  GAsyncQueue *downloaded;
+  int queued;
+  GMutex lock;
+  GCond cond;
 } dt_camera_import_t;
 
 void *dt_camera_previews_job_get_data(const dt_job_t *job)
@@ -273,29 +285,51 @@ dt_job_t *dt_camera_get_previews_job_create(dt_camera_t *camera, dt_camctl_liste
 /** Listener interface for import job */
 void _camera_import_image_downloaded(const dt_camera_t *camera, const char *filename, void *data)
 {
-  // Import downloaded image to import filmroll
   dt_camera_import_t *t = (dt_camera_import_t *)data;
-  dt_image_import(dt_import_session_film_id(t->shared.session), filename, FALSE);
-  dt_control_queue_redraw_center();
-  gchar *basename = g_path_get_basename(filename);
-  dt_control_log(ngettext("%d/%d imported to %s", "%d/%d imported to %s", t->import_count + 1),
-                 t->import_count + 1, g_list_length(t->images), basename);
-  g_free(basename);
-
-  t->fraction += 1.0 / g_list_length(t->images);
+  if(camera != t->camera) return;
+
+  // the registration thread takes it from here, so that the next file downloads meanwhile
+  g_mutex_lock(&t->lock);
+  while(t->queued >= DT_CAMERA_IMPORT_QUEUE) g_cond_wait(&t->cond, &t->lock);
+  t->queued++;
+  g_mutex_unlock(&t->lock);
+  g_async_queue_push(t->downloaded, g_strdup(filename));
+}
 
-  dt_control_job_set_progress(t->job, t->fraction);
+// adds the downloaded files to the film roll and reads their embedded thumbnails, one behind the download
+static gpointer _camera_import_register(gpointer data)
+{
+  dt_camera_import_t *t = (dt_camera_import_t *)data;
+  const guint total = g_list_length(t->images);
 
-  if(t->import_count + 1 == g_list_length(t->images))
+  gchar *filename;
+  while(*(filename = g_async_queue_pop(t->downloaded)))
   {
-    // only redraw at the end, to not spam the cpu with exposure events
+    const uint32_t id = dt_image_import(dt_import_session_film_id(t->shared.session), filename, FALSE);
+    if(id)
+    {
+      dt_mipmap_buffer_t buf;
+      dt_mipmap_cache_get(darktable.mipmap_cache, &buf, id, DT_MIPMAP_0, DT_MIPMAP_BLOCKING, 'r');
+      dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+    }
     dt_control_queue_redraw_center();
-    dt_control_signal_raise(darktable.signals, DT_SIGNAL_TAG_CHANGED);
-
-    dt_control_signal_raise(darktable.signals, DT_SIGNAL_FILMROLLS_IMPORTED,
-                            dt_import_session_film_id(t->shared.session));
+    gchar *basename = g_path_get_basename(filename);
+    dt_control_log(ngettext("%d/%d imported to %s", "%d/%d imported to %s", t->import_count + 1),
+                   t->import_count + 1, total, basename);
+    g_free(basename);
+    g_free(filename);
+
+    t->import_count++;
+    t->fraction += 1.0 / total;
+    dt_control_job_set_progress(t->job, t->fraction);
+
+    g_mutex_lock(&t->lock);
+    t->queued--;
+    g_cond_signal(&t->cond);
+    g_mutex_unlock(&t->lock);
   }
-  t->import_count++;
+  g_free(filename);
+  return NULL;
 }
 
 static const char *_camera_request_image_filename(const dt_camera_t *camera, const char *filename,
@@ -304,6 +338,8 @@ static const char *_camera_request_image_filename(const dt_camera_t *camera, con
   const gchar *file;
   struct dt_camera_shared_t *shared;
   shared = (dt_camera_shared_t *)data;
+  // several cards can be imported at once, each job names the files of its own camera
+  if(camera != shared->camera) return NULL;
   const gboolean use_filename = dt_conf_get_bool("session/use_filename");
 
   dt_import_session_set_filename(shared->session, filename);
@@ -316,13 +352,21 @@ static const char *_camera_request_image_filename(const dt_camera_t *camera, con
   return g_strdup(file);
 }
 
-static const char *_camera_request_image_path(const dt_camera_t *camera, time_t *exif_time, void *data)
+static const char *_camera_import_request_image_path(const dt_camera_t *camera, time_t *exif_time, void *data)
 {
-  struct dt_camera_shared_t *shared;
-  shared = (struct dt_camera_shared_t *)data;
-  if(exif_time)
-    dt_import_session_set_exif_time(shared->session, *exif_time);
-  return dt_import_session_path(shared->session, FALSE);
+  dt_camera_import_t *t = (dt_camera_import_t *)data;
+  if(camera != t->camera) return NULL;
+  if(exif_time) dt_import_session_set_exif_time(t->shared.session, *exif_time);
+
+  // the session drops the film roll it leaves if that is empty, which it may only seem to be while files
+  // still wait for registration
+  if(dt_import_session_path_changed(t->shared.session))
+  {
+    g_mutex_lock(&t->lock);
+    while(t->queued) g_cond_wait(&t->cond, &t->lock);
+    g_mutex_unlock(&t->lock);
+  }
+  return dt_import_session_path(t->shared.session, FALSE);
 }
 
 static int32_t dt_camera_import_job_run(dt_job_t *job)
@@ -350,13 +394,22 @@ static int32_t dt_camera_import_job_run(dt_job_t *job)
   dt_camctl_listener_t listener = { 0 };
   listener.data = params;
   listener.image_downloaded = _camera_import_image_downloaded;
-  listener.request_image_path = _camera_request_image_path;
+  listener.request_image_path = _camera_import_request_image_path;
   listener.request_image_filename = _camera_request_image_filename;
 
   // start download of images
+  GThread *registrar = g_thread_new("camera import", _camera_import_register, params);
   dt_camctl_register_listener(darktable.camctl, &listener);
   dt_camctl_import(darktable.camctl, params->camera, params->images);
   dt_camctl_unregister_listener(darktable.camctl, &listener);
+  g_async_queue_push(params->downloaded, g_strdup(""));
+  g_thread_join(registrar);
+
+  // only redraw at the end, to not spam the cpu with exposure events
+  dt_control_queue_redraw_center();
+  dt_control_signal_raise(darktable.signals, DT_SIGNAL_TAG_CHANGED);
+  dt_control_signal_raise(darktable.signals, DT_SIGNAL_FILMROLLS_IMPORTED,
+                          dt_import_session_film_id(params->shared.session));
 
   // notify the user via the window manager
   dt_ui_notify_user();
@@ -370,6 +423,9 @@ static dt_camera_import_t *dt_camera_import_alloc()
   if(!params) return NULL;
 
   params->shared.session = dt_import_session_new();
+  params->downloaded = g_async_queue_new_full(g_free);
+  g_mutex_init(&params->lock);
+  g_cond_init(&params->cond);
 
   return params;
 }
@@ -379,6 +435,9 @@ static void dt_camera_import_cleanup(void *p)
   dt_camera_import_t *params = p;
 
   g_list_free(params->images);
+  g_async_queue_unref(params->downloaded);
+  g_mutex_clear(&params->lock);
+  g_cond_clear(&params->cond);
 
   dt_import_session_destroy(params->shared.session);
 
@@ -406,6 +465,7 @@ dt_job_t *dt_camera_import_job_create(const char *jobcode, GList *images, struct
   params->fraction = 0;
   params->images = g_list_copy(images);
   params->camera = camera;
+  params->shared.camera = camera;
   params->import_count = 0;
   params->job = job;
   return job;
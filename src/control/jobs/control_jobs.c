@@ -20,8 +20,10 @@
 #include "common/darktable.h"
 #include "common/debug.h"
 #include "common/exif.h"
+#include "common/fileop.h"
 #include "common/film.h"
 #include "common/gpx.h"
+#include "common/grouping.h"
 #include "common/history.h"
 #include "common/image.h"
 #include "common/image_cache.h"
@@ -29,10 +31,13 @@
 #include "common/imageio_dng.h"
 #include "common/imageio_module.h"
 #include "common/mipmap_cache.h"
+#include "common/opencl.h"
 #include "common/tags.h"
 #include "common/undo.h"
 #include "control/conf.h"
 #include "develop/imageop_math.h"
+#include "develop/lightroom.h"
+#include "develop/tiling.h"
 
 #include "gui/gtk.h"
 
@@ -98,7 +103,15 @@ static void dt_control_image_enumerator_job_film_init(dt_control_image_enumerato
   sqlite3_finalize(stmt);
 }
 
-static int32_t _generic_dt_control_fileop_images_job_run(dt_job_t *job,
+static gboolean _fileop_progress(double fraction, void *data)
+{
+  dt_job_t *job = (dt_job_t *)data;
+  // the files are most of the work, the database gets the rest
+  dt_control_job_set_progress(job, 0.9 * fraction);
+  return dt_control_job_get_state(job) != DT_JOB_STATE_CANCELLED;
+}
+
+static int32_t _generic_dt_control_fileop_images_job_run(dt_job_t *job, const dt_fileop_mode_t mode,
                                                          int32_t (*fileop_callback)(const int32_t,
                                                                                     const int32_t),
                                                          const char *desc, const char *desc_pl)
@@ -107,7 +120,7 @@ static int32_t _generic_dt_control_fileop_images_job_run(dt_job_t *job,
   GList *t = params->index;
   const guint total = g_list_length(t);
   char message[512] = { 0 };
-  double fraction = 0;
+  double fraction = 0.9;
   gchar *newdir = (gchar *)params->data;
 
   g_snprintf(message, sizeof(message), ngettext(desc, desc_pl, total), total);
@@ -124,14 +137,64 @@ static int32_t _generic_dt_control_fileop_images_job_run(dt_job_t *job,
     return -1;
   }
 
+  // transfer the files first, all at once. duplicates share theirs, files from different folders with the same
+  // name would end up on top of each other and only the first of them is transferred
+  dt_fileop_t **img_op = g_malloc0_n(total, sizeof(dt_fileop_t *));
+  GHashTable *sources = g_hash_table_new(g_str_hash, g_str_equal);
+  GHashTable *dests = g_hash_table_new(g_str_hash, g_str_equal);
+  GList *ops = NULL;
+  int conflicts = 0;
+  int i = 0;
+  for(GList *l = t; l; l = g_list_next(l), i++)
+  {
+    char srcpath[PATH_MAX] = { 0 };
+    gboolean from_cache = FALSE;
+    dt_image_full_path(GPOINTER_TO_INT(l->data), srcpath, sizeof(srcpath), &from_cache);
+    if(!*srcpath) continue;
+    img_op[i] = g_hash_table_lookup(sources, srcpath);
+    if(img_op[i]) continue;
+    gchar *basename = g_path_get_basename(srcpath);
+    gchar *destpath = g_build_filename(new_film.dirname, basename, NULL);
+    if(g_hash_table_contains(dests, destpath))
+      conflicts++;
+    else
+    {
+      ops = dt_fileop_list_append(ops, srcpath, destpath);
+      img_op[i] = (dt_fileop_t *)ops->data;
+      g_hash_table_insert(sources, img_op[i]->src, img_op[i]);
+      g_hash_table_add(dests, img_op[i]->dest);
+    }
+    g_free(basename);
+    g_free(destpath);
+  }
+  g_hash_table_destroy(dests);
+  if(conflicts)
+    dt_control_log(ngettext("%d file has the same name as another one and was skipped",
+                            "%d files have the same name as another one and were skipped", conflicts),
+                   conflicts);
+  const int failed = dt_fileop_run(ops, mode, _fileop_progress, job);
+  if(failed && dt_control_job_get_state(job) != DT_JOB_STATE_CANCELLED)
+    dt_control_log(ngettext("failed to transfer %d file", "failed to transfer %d files", failed), failed);
+
+  // then the database in one go. every file which made it is recorded, even if the job got cancelled
   gboolean completeSuccess = TRUE;
-  while(t && dt_control_job_get_state(job) != DT_JOB_STATE_CANCELLED)
+  dt_database_start_transaction(darktable.db);
+  i = 0;
+  for(GList *l = t; l; l = g_list_next(l), i++)
   {
-    completeSuccess &= (fileop_callback(GPOINTER_TO_INT(t->data), film_id) != -1);
-    t = g_list_next(t);
-    fraction += 1.0 / total;
+    dt_fileop_t *op = img_op[i];
+    if(!op || op->error)
+      completeSuccess = FALSE;
+    // moving the first image of a file takes its duplicates along
+    else if(mode == DT_FILEOP_COPY || g_hash_table_remove(sources, op->src))
+      completeSuccess &= (fileop_callback(GPOINTER_TO_INT(l->data), film_id) != -1);
+    fraction += 0.1 / total;
     dt_control_job_set_progress(job, fraction);
   }
+  dt_database_release_transaction(darktable.db);
+  g_hash_table_destroy(sources);
+  dt_fileop_list_free(ops);
+  g_free(img_op);
 
   if(completeSuccess)
   {
@@ -365,78 +428,117 @@ static int dt_control_merge_hdr_process(dt_imageio_module_data_t *datai, const c
   const float cal = 100.0f / (aperture * exp * iso);
   // about proportional to how many photons we can expect from this shot:
   const float photoncnt = 100.0f * aperture * exp / iso;
-  float saturation = 1.0f;
+  const float saturation = 1.0f;
   d->whitelevel = fmaxf(d->whitelevel, saturation * cal);
+
+  // need some safety margin due to upsampling and 16-bit quantization + dithering?
+  const float offset = 3000.0f / (float)UINT16_MAX;
+
+  const float *const in = (const float *)ivoid;
+  float *const pixels = d->pixels;
+  float *const weight = d->weight;
+  const int wd = d->wd;
+  const int ht = d->ht;
+  const float whitelevel = d->whitelevel;
+  const float epsw = d->epsw;
+
+  // the envelope is the same for the 2x2 block of a pixel, so it is found once per block
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(ivoid, cal, photoncnt) \
-  shared(d, saturation) \
+  dt_omp_firstprivate(in, pixels, weight, wd, ht, whitelevel, epsw, cal, photoncnt, saturation, offset) \
   schedule(static)
 #endif
-  for(int y = 0; y < d->ht; y++)
-    for(int x = 0; x < d->wd; x++)
+  for(int yy = 0; yy < ht; yy += 2)
+    for(int xx = 0; xx < wd; xx += 2)
     {
-      // read unclamped raw value with subtracted black and rescaled to 1.0 saturation.
-      // this is the output of the rawprepare iop.
-      const float in = ((float *)ivoid)[x + d->wd * y];
       // weights based on siggraph 12 poster
       // zijian zhu, zhengguo li, susanto rahardja, pasi fraenti
       // 2d denoising factor for high dynamic range imaging
       float w = photoncnt;
 
-      // need some safety margin due to upsampling and 16-bit quantization + dithering?
-      float offset = 3000.0f / (float)UINT16_MAX;
-
       // cannot do an envelope based on single pixel values here, need to get
       // maximum value of all color channels. to find that, go through the
       // pattern block (we conservatively do a 3x3 for bayer or xtrans):
-      int xx = x & ~1, yy = y & ~1;
       float M = 0.0f, m = FLT_MAX;
-      if(xx < d->wd - 2 && yy < d->ht - 2)
+      if(xx < wd - 2 && yy < ht - 2)
       {
         for(int i = 0; i < 3; i++)
           for(int j = 0; j < 3; j++)
           {
-            M = MAX(M, ((float *)ivoid)[xx + i + d->wd * (yy + j)]);
-            m = MIN(m, ((float *)ivoid)[xx + i + d->wd * (yy + j)]);
+            M = MAX(M, in[xx + i + (size_t)wd * (yy + j)]);
+            m = MIN(m, in[xx + i + (size_t)wd * (yy + j)]);
           }
         // move envelope a little to allow non-zero weight even for clipped regions.
         // this is because even if the 2x2 block is clipped somewhere, the other channels
         // might still prove useful. we'll check for individual channel saturation below.
-        w *= d->epsw + envelope((M + offset) / saturation);
+        w *= epsw + envelope((M + offset) / saturation);
       }
 
-      if(M + offset >= saturation)
-      {
-        if(d->weight[x + d->wd * y] <= 0.0f)
-        { // only consider saturated pixels in case we have nothing better:
-          if(d->weight[x + d->wd * y] == 0 || m < -d->weight[x + d->wd * y])
+      for(int y = yy; y < MIN(yy + 2, ht); y++)
+        for(int x = xx; x < MIN(xx + 2, wd); x++)
+        {
+          const size_t k = x + (size_t)wd * y;
+          // read unclamped raw value with subtracted black and rescaled to 1.0 saturation.
+          // this is the output of the rawprepare iop.
+          const float v = in[k];
+
+          if(M + offset >= saturation)
           {
-            if(m + offset >= saturation)
-              d->pixels[x + d->wd * y] = 1.0f; // let's admit we were completely clipped, too
-            else
-              d->pixels[x + d->wd * y] = in * cal / d->whitelevel;
-            d->weight[x + d->wd * y]
-                = -m; // could use -cal here, but m is per pixel and safer for varying illumination conditions
+            if(weight[k] <= 0.0f)
+            { // only consider saturated pixels in case we have nothing better:
+              if(weight[k] == 0 || m < -weight[k])
+              {
+                if(m + offset >= saturation)
+                  pixels[k] = 1.0f; // let's admit we were completely clipped, too
+                else
+                  pixels[k] = v * cal / whitelevel;
+                weight[k] = -m; // could use -cal here, but m is per pixel and safer for varying illumination conditions
+              }
+            }
+            // else silently ignore, others have filled in a better color here already
+          }
+          else
+          {
+            if(weight[k] <= 0.0)
+            { // cleanup potentially blown highlights from earlier images
+              pixels[k] = 0.0f;
+              weight[k] = 0.0f;
+            }
+            pixels[k] += w * v * cal;
+            weight[k] += w;
           }
         }
-        // else silently ignore, others have filled in a better color here already
-      }
-      else
-      {
-        if(d->weight[x + d->wd * y] <= 0.0)
-        { // cleanup potentially blown highlights from earlier images
-          d->pixels[x + d->wd * y] = 0.0f;
-          d->weight[x + d->wd * y] = 0.0f;
-        }
-        d->pixels[x + d->wd * y] += w * in * cal;
-        d->weight[x + d->wd * y] += w;
-      }
     }
 
   return 0;
 }
 
+// the raw buffers of the next brackets loaded ahead of the merge, at most
+#define DT_CONTROL_MERGE_HDR_PREFETCH_SIZE ((size_t)512 << 20)
+
+// lets the image loading jobs decode the brackets after the one being merged, in parallel, as long as their raw
+// buffers fit into DT_CONTROL_MERGE_HDR_PREFETCH_SIZE. next is the first image not asked for so far, the one
+// following the last image asked for is returned.
+static GList *_merge_hdr_prefetch(GList *current, GList *next)
+{
+  size_t size = 0;
+  for(GList *t = g_list_next(current); t; t = g_list_next(t))
+  {
+    const dt_image_t *img = dt_image_cache_get(darktable.image_cache, GPOINTER_TO_INT(t->data), 'r');
+    size += (size_t)img->width * img->height * sizeof(uint16_t);
+    dt_image_cache_read_release(darktable.image_cache, img);
+    if(size > DT_CONTROL_MERGE_HDR_PREFETCH_SIZE) break;
+
+    if(t == next)
+    {
+      dt_mipmap_cache_get(darktable.mipmap_cache, NULL, GPOINTER_TO_INT(t->data), DT_MIPMAP_FULL,
+                          DT_MIPMAP_PREFETCH, 'r');
+      next = g_list_next(t);
+    }
+  }
+  return next;
+}
+
 static int32_t dt_control_merge_hdr_job_run(dt_job_t *job)
 {
   dt_control_image_enumerator_t *params = dt_control_job_get_params(job);
@@ -458,11 +560,13 @@ static int32_t dt_control_merge_hdr_job_run(dt_job_t *job)
   dt_control_merge_hdr_format_t dat = (dt_control_merge_hdr_format_t){.parent = { 0 }, .d = &d };
 
   int num = 1;
+  GList *prefetch = g_list_next(t);
   while(t)
   {
     if(d.abort) goto end;
 
     const uint32_t imgid = GPOINTER_TO_INT(t->data);
+    if(prefetch) prefetch = _merge_hdr_prefetch(t, prefetch);
 
     dt_imageio_export_with_flags(imgid, "unused", &buf, (dt_imageio_module_data_t *)&dat, TRUE, FALSE, FALSE, TRUE,
                                  FALSE, "pre:rawprepare", FALSE, FALSE, DT_COLORSPACE_NONE, NULL, DT_INTENT_LAST, NULL,
@@ -552,6 +656,79 @@ static int32_t dt_control_duplicate_images_job_run(dt_job_t *job)
   return 0;
 }
 
+// the images compressed in one transaction, between two checks for cancellation
+#define DT_CONTROL_COMPRESS_HISTORY_BATCH 64
+
+static int32_t dt_control_compress_history_job_run(dt_job_t *job)
+{
+  dt_control_image_enumerator_t *params = dt_control_job_get_params(job);
+  GList *t = params->index;
+  const guint total = g_list_length(t);
+  char message[512] = { 0 };
+  snprintf(message, sizeof(message),
+           ngettext("compressing history of %d image", "compressing history of %d images", total), total);
+  dt_control_job_set_progress_message(job, message);
+
+  int missing = 0;
+  guint done = 0;
+  while(t && dt_control_job_get_state(job) != DT_JOB_STATE_CANCELLED)
+  {
+    GList *batch = NULL;
+    for(int k = 0; t && k < DT_CONTROL_COMPRESS_HISTORY_BATCH; k++, t = g_list_next(t))
+      batch = g_list_prepend(batch, t->data);
+    batch = g_list_reverse(batch);
+    done += g_list_length(batch);
+    missing += dt_history_compress_on_list(batch);
+    g_list_free(batch);
+    dt_control_job_set_progress(job, (double)done / total);
+  }
+
+  if(missing)
+    dt_control_log(ngettext("no history compression of %d image, see tag: darktable|problem|history-compress",
+                            "no history compression of %d images, see tag: darktable|problem|history-compress",
+                            missing),
+                   missing);
+
+  dt_collection_update_query(darktable.collection, DT_COLLECTION_CHANGE_RELOAD, g_list_copy(params->index));
+  dt_control_queue_redraw_center();
+  return 0;
+}
+
+// the images imported in one transaction, between two checks for cancellation
+#define DT_CONTROL_LIGHTROOM_IMPORT_BATCH 256
+
+static int32_t dt_control_lightroom_import_job_run(dt_job_t *job)
+{
+  dt_control_image_enumerator_t *params = dt_control_job_get_params(job);
+  GList *t = params->index;
+  const guint total = g_list_length(t);
+  char message[512] = { 0 };
+  snprintf(message, sizeof(message),
+           ngettext("importing lightroom develop data of %d image",
+                    "importing lightroom develop data of %d images", total), total);
+  dt_control_job_set_progress_message(job, message);
+
+  int imported = 0;
+  guint done = 0;
+  while(t && dt_control_job_get_state(job) != DT_JOB_STATE_CANCELLED)
+  {
+    GList *batch = NULL;
+    for(int k = 0; t && k < DT_CONTROL_LIGHTROOM_IMPORT_BATCH; k++, t = g_list_next(t))
+      batch = g_list_prepend(batch, t->data);
+    batch = g_list_reverse(batch);
+    done += g_list_length(batch);
+    imported += dt_lightroom_import_batch(batch);
+    g_list_free(batch);
+    dt_control_job_set_progress(job, (double)done / total);
+  }
+
+  dt_control_log(ngettext("lightroom develop data imported for %d image",
+                          "lightroom develop data imported for %d images", imported), imported);
+  dt_collection_update_query(darktable.collection, DT_COLLECTION_CHANGE_RELOAD, g_list_copy(params->index));
+  dt_control_queue_redraw_center();
+  return 0;
+}
+
 static int32_t dt_control_flip_images_job_run(dt_job_t *job)
 {
   dt_control_image_enumerator_t *params = dt_control_job_get_params(job);
@@ -676,14 +853,8 @@ static int32_t dt_control_remove_images_job_run(dt_job_t *job)
 
   free(imgs);
 
-  while(t)
-  {
-    int imgid = GPOINTER_TO_INT(t->data);
-    dt_image_remove(imgid);
-    t = g_list_next(t);
-    const double fraction = 1.0 / total;
-    dt_control_job_set_progress(job, fraction);
-  }
+  g_list_free(dt_image_remove_list(t));
+  dt_control_job_set_progress(job, 1.0);
 
   while(list)
   {
@@ -892,14 +1063,34 @@ static enum _dt_delete_status delete_file_from_disk(const char *filename, gboole
 }
 
 
+static void _set_remove_flag_list(GList *imgs, const gboolean on)
+{
+  sqlite3_stmt *stmt = NULL;
+  dt_database_start_transaction(darktable.db);
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              on ? "UPDATE main.images SET flags = (flags|?1) WHERE id = ?2"
+                                 : "UPDATE main.images SET flags = (flags&~?1) WHERE id = ?2",
+                              -1, &stmt, NULL);
+  for(GList *l = imgs; l; l = g_list_next(l))
+  {
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, DT_IMAGE_REMOVE);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, GPOINTER_TO_INT(l->data));
+    sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+  }
+  sqlite3_finalize(stmt);
+  dt_database_release_transaction(darktable.db);
+}
+
 static int32_t dt_control_delete_images_job_run(dt_job_t *job)
 {
   dt_control_image_enumerator_t *params = dt_control_job_get_params(job);
   GList *t = params->index;
   char *imgs = _get_image_list(t);
-  char imgidstr[25] = { 0 };
   guint total = g_list_length(t);
   char message[512] = { 0 };
+  double fraction = 0;
   gboolean delete_on_trash_error = FALSE;
   if (dt_conf_get_bool("send_to_trash"))
     snprintf(message, sizeof(message), ngettext("trashing %d image", "trashing %d images", total), total);
@@ -916,11 +1107,23 @@ static int32_t dt_control_delete_images_job_run(dt_job_t *job)
 
   free(imgs);
 
+  // first check for local copies, never delete a file whose original file is not accessible. this also writes
+  // their sidecars back, so it has to happen before these are deleted
+  GList *todo = NULL;
+  for(; t; t = g_list_next(t))
+    if(!dt_image_local_copy_reset(GPOINTER_TO_INT(t->data))) todo = g_list_prepend(todo, t->data);
+  todo = g_list_reverse(todo);
+  _set_remove_flag_list(todo, TRUE);
+
+  // then the files, one after the other as errors may need to ask what to do. the database is only updated
+  // once at the end, for all images handled, so the duplicates still in use are counted here
+  GHashTable *users = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  GList *done = NULL;
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
                               "SELECT COUNT(*) FROM main.images WHERE filename IN (SELECT filename FROM "
                               "main.images WHERE id = ?1) AND film_id IN (SELECT film_id FROM main.images WHERE "
                               "id = ?1)", -1, &stmt, NULL);
-  while(t)
+  for(t = todo; t; t = g_list_next(t))
   {
     enum _dt_delete_status delete_status = _DT_DELETE_STATUS_UNKNOWN;
     const int imgid = GPOINTER_TO_INT(t->data);
@@ -928,48 +1131,44 @@ static int32_t dt_control_delete_images_job_run(dt_job_t *job)
     gboolean from_cache = FALSE;
     dt_image_full_path(imgid, filename, sizeof(filename), &from_cache);
 
-#ifdef _WIN32
-    char *dirname = g_path_get_dirname(filename);
-#endif
-
     int duplicates = 0;
-    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
-    if(sqlite3_step(stmt) == SQLITE_ROW) duplicates = sqlite3_column_int(stmt, 0);
-    sqlite3_reset(stmt);
-    sqlite3_clear_bindings(stmt);
+    gpointer count = NULL;
+    if(g_hash_table_lookup_extended(users, filename, NULL, &count))
+      duplicates = GPOINTER_TO_INT(count);
+    else
+    {
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+      if(sqlite3_step(stmt) == SQLITE_ROW) duplicates = sqlite3_column_int(stmt, 0);
+      sqlite3_reset(stmt);
+      sqlite3_clear_bindings(stmt);
+    }
+    g_hash_table_insert(users, g_strdup(filename), GINT_TO_POINTER(duplicates - 1));
+    done = g_list_prepend(done, t->data);
 
     // remove from disk:
-    if(duplicates == 1)
+    if(duplicates <= 1)
     {
-      // first check for local copies, never delete a file whose original file is not accessible
-      if (dt_image_local_copy_reset(imgid))
-        goto delete_next_file;
-
-      snprintf(imgidstr, sizeof(imgidstr), "%d", imgid);
-      _set_remove_flag(imgidstr);
-      dt_image_remove(imgid);
-
       // there are no further duplicates so we can remove the source data file
       delete_status = delete_file_from_disk(filename, &delete_on_trash_error);
-      if (delete_status != _DT_DELETE_STATUS_OK_TO_REMOVE)
-        goto delete_next_file;
-
-      // all sidecar files - including left-overs - can be deleted;
-      // left-overs can result when previously duplicates have been REMOVED;
-      // no need to keep them as the source data file is gone.
-
-      GList *files = dt_image_find_duplicates(filename);
-
-      GList *file_iter = g_list_first(files);
-      while(file_iter != NULL)
+      if (delete_status == _DT_DELETE_STATUS_OK_TO_REMOVE)
       {
-        delete_status = delete_file_from_disk(file_iter->data, &delete_on_trash_error);
-        if (delete_status != _DT_DELETE_STATUS_OK_TO_REMOVE)
-          break;
-        file_iter = g_list_next(file_iter);
-      }
+        // all sidecar files - including left-overs - can be deleted;
+        // left-overs can result when previously duplicates have been REMOVED;
+        // no need to keep them as the source data file is gone.
+
+        GList *files = dt_image_find_duplicates(filename);
+
+        GList *file_iter = g_list_first(files);
+        while(file_iter != NULL)
+        {
+          delete_status = delete_file_from_disk(file_iter->data, &delete_on_trash_error);
+          if (delete_status != _DT_DELETE_STATUS_OK_TO_REMOVE)
+            break;
+          file_iter = g_list_next(file_iter);
+        }
 
-      g_list_free_full(files, g_free);
+        g_list_free_full(files, g_free);
+      }
     }
     else
     {
@@ -978,28 +1177,22 @@ static int32_t dt_control_delete_images_job_run(dt_job_t *job)
 
       dt_image_path_append_version(imgid, filename, sizeof(filename));
       g_strlcat(filename, ".xmp", sizeof(filename));
-
-      // remove image from db first ...
-      snprintf(imgidstr, sizeof(imgidstr), "%d", imgid);
-      _set_remove_flag(imgidstr);
-      dt_image_remove(imgid);
-
-      // ... and delete afterwards because removing will re-write the XMP
       delete_status = delete_file_from_disk(filename, &delete_on_trash_error);
     }
 
-delete_next_file:
-#ifdef _WIN32
-    g_free(dirname);
-#endif
-    t = g_list_next(t);
-    const double fraction = 1.0 / total;
+    fraction += 1.0 / total;
     dt_control_job_set_progress(job, fraction);
     if (delete_status == _DT_DELETE_STATUS_STOP_PROCESSING)
       break;
   }
-
   sqlite3_finalize(stmt);
+  g_hash_table_destroy(users);
+
+  // the ones left after a stop stay
+  if(t) _set_remove_flag_list(g_list_next(t), FALSE);
+  g_list_free(dt_image_remove_list(done));
+  g_list_free(done);
+  g_list_free(todo);
 
   while(list)
   {
@@ -1015,6 +1208,61 @@ delete_next_file:
   return 0;
 }
 
+typedef struct dt_control_gpx_match_t
+{
+  struct dt_gpx_t *gpx;
+  GTimeZone *tz_camera, *tz_utc;
+  int32_t *imgids;
+  dt_image_geoloc_t *geolocs;
+  gboolean *matched;
+} dt_control_gpx_match_t;
+
+static void _gpx_match(const int index, void *data)
+{
+  dt_control_gpx_match_t *m = (dt_control_gpx_match_t *)data;
+  const int imgid = m->imgids[index];
+  m->matched[index] = FALSE;
+
+  /* get image */
+  const dt_image_t *cimg = dt_image_cache_get(darktable.image_cache, imgid, 'r');
+  if(!cimg) return;
+
+  /* convert exif datetime
+     TODO: exiv2 dates should be iso8601 and we are probably doing some ugly
+     conversion before inserting into database.
+   */
+  gint year;
+  gint month;
+  gint day;
+  gint hour;
+  gint minute;
+  gint seconds;
+
+  if(sscanf(cimg->exif_datetime_taken, "%d:%d:%d %d:%d:%d", (int *)&year, (int *)&month, (int *)&day,
+            (int *)&hour, (int *)&minute, (int *)&seconds) != 6)
+  {
+    fprintf(stderr, "broken exif time in db, '%s'\n", cimg->exif_datetime_taken);
+    dt_image_cache_read_release(darktable.image_cache, cimg);
+    return;
+  }
+
+  /* release the lock */
+  dt_image_cache_read_release(darktable.image_cache, cimg);
+
+  GTimeVal timestamp;
+  GDateTime *exif_time = g_date_time_new(m->tz_camera, year, month, day, hour, minute, seconds);
+  if(!exif_time) return;
+  GDateTime *utc_time = g_date_time_to_timezone(exif_time, m->tz_utc);
+  g_date_time_unref(exif_time);
+  if(!utc_time) return;
+  gboolean res = g_date_time_to_timeval(utc_time, &timestamp);
+  g_date_time_unref(utc_time);
+  if(!res) return;
+
+  /* only update image location if time is within gpx tack range */
+  m->matched[index] = dt_gpx_get_location(m->gpx, &timestamp, &m->geolocs[index]);
+}
+
 static int32_t dt_control_gpx_apply_job_run(dt_job_t *job)
 {
   dt_control_image_enumerator_t *params = dt_control_job_get_params(job);
@@ -1039,62 +1287,39 @@ static int32_t dt_control_gpx_apply_job_run(dt_job_t *job)
   if(!tz_camera) goto bail_out;
   GTimeZone *tz_utc = g_time_zone_new_utc();
 
-  dt_undo_start_group(darktable.undo, DT_UNDO_GEOTAG);
-
-  /* go thru each selected image and lookup location in gpx */
-  do
+  /* lookup the location of all selected images in gpx at once */
+  const int count = g_list_length(t);
+  dt_control_gpx_match_t m = { .gpx = gpx, .tz_camera = tz_camera, .tz_utc = tz_utc };
+  m.imgids = g_malloc_n(count, sizeof(int32_t));
+  m.geolocs = g_malloc_n(count, sizeof(dt_image_geoloc_t));
+  m.matched = g_malloc_n(count, sizeof(gboolean));
+  for(int k = 0; t; t = g_list_next(t), k++) m.imgids[k] = GPOINTER_TO_INT(t->data);
+  dt_control_parallel_for(count, _gpx_match, &m);
+
+  // set location to images and their groups, in one go
+  GList *imgs = NULL;
+  GArray *geolocs = g_array_new(FALSE, FALSE, sizeof(dt_image_geoloc_t));
+  for(int k = 0; k < count; k++)
   {
-    GTimeVal timestamp;
-    GDateTime *exif_time, *utc_time;
-    dt_image_geoloc_t geoloc;
-    int imgid = GPOINTER_TO_INT(t->data);
-
-    /* get image */
-    const dt_image_t *cimg = dt_image_cache_get(darktable.image_cache, imgid, 'r');
-    if(!cimg) continue;
-
-    /* convert exif datetime
-       TODO: exiv2 dates should be iso8601 and we are probably doing some ugly
-       conversion before inserting into database.
-     */
-    gint year;
-    gint month;
-    gint day;
-    gint hour;
-    gint minute;
-    gint seconds;
-
-    if(sscanf(cimg->exif_datetime_taken, "%d:%d:%d %d:%d:%d", (int *)&year, (int *)&month, (int *)&day,
-              (int *)&hour, (int *)&minute, (int *)&seconds) != 6)
-    {
-      fprintf(stderr, "broken exif time in db, '%s'\n", cimg->exif_datetime_taken);
-      dt_image_cache_read_release(darktable.image_cache, cimg);
-      continue;
-    }
-
-    /* release the lock */
-    dt_image_cache_read_release(darktable.image_cache, cimg);
-
-    exif_time = g_date_time_new(tz_camera, year, month, day, hour, minute, seconds);
-    if(!exif_time) continue;
-    utc_time = g_date_time_to_timezone(exif_time, tz_utc);
-    g_date_time_unref(exif_time);
-    if(!utc_time) continue;
-    gboolean res = g_date_time_to_timeval(utc_time, &timestamp);
-    g_date_time_unref(utc_time);
-    if(!res) continue;
-
-    /* only update image location if time is within gpx tack range */
-    if(dt_gpx_get_location(gpx, &timestamp, &geoloc))
+    if(!m.matched[k]) continue;
+    GList *group = g_list_append(NULL, GINT_TO_POINTER(m.imgids[k]));
+    dt_grouping_add_grouped_images(&group);
+    for(GList *g = group; g; g = g_list_next(g))
     {
-      // set location to image and its group
-      dt_image_set_location(imgid, &geoloc, TRUE, TRUE);
-      cntr++;
+      imgs = g_list_prepend(imgs, g->data);
+      g_array_append_val(geolocs, m.geolocs[k]);
     }
-
-  } while((t = g_list_next(t)) != NULL);
-
-  dt_undo_end_group(darktable.undo);
+    g_list_free(group);
+    cntr++;
+  }
+  // prepended, back into the order of the locations
+  imgs = g_list_reverse(imgs);
+  dt_image_set_location_list(imgs, (dt_image_geoloc_t *)geolocs->data, TRUE);
+  g_list_free(imgs);
+  g_array_free(geolocs, TRUE);
+  g_free(m.imgids);
+  g_free(m.geolocs);
+  g_free(m.matched);
 
   dt_control_log(ngettext("applied matched GPX location onto %d image", "applied matched GPX location onto %d images", cntr), cntr);
 
@@ -1111,14 +1336,14 @@ bail_out:
 
 static int32_t dt_control_move_images_job_run(dt_job_t *job)
 {
-  return _generic_dt_control_fileop_images_job_run(job, &dt_image_move, _("moving %d image"),
-                                                   _("moving %d images"));
+  return _generic_dt_control_fileop_images_job_run(job, DT_FILEOP_MOVE, &dt_image_move_transferred,
+                                                   _("moving %d image"), _("moving %d images"));
 }
 
 static int32_t dt_control_copy_images_job_run(dt_job_t *job)
 {
-  return _generic_dt_control_fileop_images_job_run(job, &dt_image_copy, _("copying %d image"),
-                                                   _("copying %d images"));
+  return _generic_dt_control_fileop_images_job_run(job, DT_FILEOP_COPY, &dt_image_copy_transferred,
+                                                   _("copying %d image"), _("copying %d images"));
 }
 
 static int32_t dt_control_local_copy_images_job_run(dt_job_t *job)
@@ -1144,27 +1369,65 @@ static int32_t dt_control_local_copy_images_job_run(dt_job_t *job)
   dt_tag_new("darktable|local-copy", &tagid);
 
   gboolean tag_change = FALSE;
-  while(t && dt_control_job_get_state(job) != DT_JOB_STATE_CANCELLED)
+  if(is_copy)
   {
-    const int imgid = GPOINTER_TO_INT(t->data);
-    if(is_copy)
+    // copy the files all at once, dt_image_local_copy_set() then finds them in place
+    dt_fileop_t **img_op = g_malloc0_n(total, sizeof(dt_fileop_t *));
+    GHashTable *dests = g_hash_table_new(g_str_hash, g_str_equal);
+    GList *ops = NULL;
+    int i = 0;
+    for(GList *l = t; l; l = g_list_next(l), i++)
     {
-      if(dt_image_local_copy_set(imgid) == 0)
+      const int imgid = GPOINTER_TO_INT(l->data);
+      char srcpath[PATH_MAX] = { 0 };
+      char destpath[PATH_MAX] = { 0 };
+      gboolean from_cache = FALSE;
+      dt_image_full_path(imgid, srcpath, sizeof(srcpath), &from_cache);
+      dt_image_local_copy_path(imgid, destpath, sizeof(destpath));
+      if(!*destpath || !g_file_test(srcpath, G_FILE_TEST_IS_REGULAR) || g_file_test(destpath, G_FILE_TEST_EXISTS))
+        continue;
+      img_op[i] = g_hash_table_lookup(dests, destpath);
+      if(img_op[i]) continue;
+      ops = dt_fileop_list_append(ops, srcpath, destpath);
+      img_op[i] = (dt_fileop_t *)ops->data;
+      g_hash_table_insert(dests, img_op[i]->dest, img_op[i]);
+    }
+    dt_fileop_run(ops, DT_FILEOP_COPY, _fileop_progress, job);
+
+    // flag every copy which made it, even if the job got cancelled, so none is left behind unknown
+    dt_database_start_transaction(darktable.db);
+    fraction = 0.9;
+    i = 0;
+    for(GList *l = t; l; l = g_list_next(l), i++)
+    {
+      const int imgid = GPOINTER_TO_INT(l->data);
+      const gboolean cancelled = dt_control_job_get_state(job) == DT_JOB_STATE_CANCELLED;
+      if((img_op[i] ? !img_op[i]->error : !cancelled) && dt_image_local_copy_set(imgid) == 0)
       {
         if(dt_tag_attach(tagid, imgid, FALSE, FALSE)) tag_change = TRUE;
       }
+      fraction += 0.1 / total;
+      dt_control_job_set_progress(job, fraction);
     }
-    else
+    dt_database_release_transaction(darktable.db);
+    g_hash_table_destroy(dests);
+    dt_fileop_list_free(ops);
+    g_free(img_op);
+  }
+  else
+  {
+    while(t && dt_control_job_get_state(job) != DT_JOB_STATE_CANCELLED)
     {
+      const int imgid = GPOINTER_TO_INT(t->data);
       if(dt_image_local_copy_reset(imgid) == 0)
       {
         if(dt_tag_detach(tagid, imgid, FALSE, FALSE)) tag_change = TRUE;
       }
-    }
-    t = g_list_next(t);
+      t = g_list_next(t);
 
-    fraction += 1.0 / total;
-    dt_control_job_set_progress(job, fraction);
+      fraction += 1.0 / total;
+      dt_control_job_set_progress(job, fraction);
+    }
   }
 
   dt_collection_update_query(darktable.collection, DT_COLLECTION_CHANGE_RELOAD, g_list_copy(params->index));
@@ -1174,6 +1437,69 @@ static int32_t dt_control_local_copy_images_job_run(dt_job_t *job)
   return 0;
 }
 
+// the images read in parallel and then written in one transaction, between two checks for cancellation
+#define DT_CONTROL_REFRESH_EXIF_BATCH 32
+
+typedef struct dt_control_refresh_exif_t
+{
+  int count;
+  int32_t imgids[DT_CONTROL_REFRESH_EXIF_BATCH];
+  dt_image_t orig[DT_CONTROL_REFRESH_EXIF_BATCH]; // the images as they were read from the cache
+  dt_image_t imgs[DT_CONTROL_REFRESH_EXIF_BATCH]; // the same with the exif data read
+} dt_control_refresh_exif_t;
+
+static void _refresh_exif_read(const int index, void *data)
+{
+  dt_control_refresh_exif_t *r = (dt_control_refresh_exif_t *)data;
+  const int imgid = r->imgids[index];
+  gboolean from_cache = TRUE;
+  char sourcefile[PATH_MAX];
+  dt_image_full_path(imgid, sourcefile, sizeof(sourcefile), &from_cache);
+
+  // read into a copy, the cache entry is only locked to put the result in
+  const dt_image_t *img = dt_image_cache_get(darktable.image_cache, imgid, 'r');
+  r->orig[index] = *img;
+  dt_image_cache_read_release(darktable.image_cache, img);
+  r->imgs[index] = r->orig[index];
+  dt_exif_read(&r->imgs[index], sourcefile);
+}
+
+// puts what dt_exif_read() changed into the cache entry img. the rest may have been edited meanwhile, by the
+// gui or some other job, and stays as it is now
+static void _refresh_exif_merge(dt_image_t *img, const dt_image_t *orig, const dt_image_t *read)
+{
+#define MERGE(field)                                                                                          \
+  if(memcmp(&orig->field, &read->field, sizeof(read->field))) memcpy(&img->field, &read->field, sizeof(read->field))
+  MERGE(exif_inited);
+  MERGE(orientation);
+  MERGE(exif_exposure);
+  MERGE(exif_exposure_bias);
+  MERGE(exif_aperture);
+  MERGE(exif_iso);
+  MERGE(exif_focal_length);
+  MERGE(exif_focus_distance);
+  MERGE(exif_crop);
+  MERGE(exif_maker);
+  MERGE(exif_model);
+  MERGE(exif_lens);
+  MERGE(exif_datetime_taken);
+  MERGE(camera_maker);
+  MERGE(camera_model);
+  MERGE(camera_alias);
+  MERGE(camera_makermodel);
+  MERGE(camera_legacy_makermodel);
+  MERGE(width);
+  MERGE(height);
+  MERGE(d65_color_matrix);
+  MERGE(colorspace);
+  MERGE(geoloc);
+  MERGE(usercrop);
+#undef MERGE
+  // the rating of embedded xmp data and the user crop flag, bit by bit
+  const int32_t changed = orig->flags ^ read->flags;
+  img->flags = (img->flags & ~changed) | (read->flags & changed);
+}
+
 static int32_t dt_control_refresh_exif_run(dt_job_t *job)
 {
   dt_control_image_enumerator_t *params = (dt_control_image_enumerator_t *)dt_control_job_get_params(job);
@@ -1182,27 +1508,150 @@ static int32_t dt_control_refresh_exif_run(dt_job_t *job)
   char message[512] = { 0 };
   snprintf(message, sizeof(message), ngettext("refreshing info for %d image", "refreshing info for %d images", total), total);
   dt_control_job_set_progress_message(job, message);
-  while(t)
+
+  dt_control_refresh_exif_t *r = g_malloc(sizeof(dt_control_refresh_exif_t));
+  guint done = 0;
+  while(t && dt_control_job_get_state(job) != DT_JOB_STATE_CANCELLED)
   {
-    const int imgid = GPOINTER_TO_INT(t->data);
-    gboolean from_cache = TRUE;
-    char sourcefile[PATH_MAX];
-    dt_image_full_path(imgid, sourcefile, sizeof(sourcefile), &from_cache);
+    for(r->count = 0; t && r->count < DT_CONTROL_REFRESH_EXIF_BATCH; t = g_list_next(t))
+      r->imgids[r->count++] = GPOINTER_TO_INT(t->data);
 
-    dt_image_t *img = dt_image_cache_get(darktable.image_cache, imgid, 'r');
-    dt_exif_read(img, sourcefile);
-    dt_image_cache_write_release(darktable.image_cache, img, DT_IMAGE_CACHE_SAFE);
+    dt_control_parallel_for(r->count, _refresh_exif_read, r);
+
+    // the xmp files go through the sidecar queue
+    dt_database_start_transaction(darktable.db);
+    for(int k = 0; k < r->count; k++)
+    {
+      dt_image_t *img = dt_image_cache_get(darktable.image_cache, r->imgids[k], 'w');
+      _refresh_exif_merge(img, &r->orig[k], &r->imgs[k]);
+      dt_image_cache_write_release(darktable.image_cache, img, DT_IMAGE_CACHE_SAFE);
+    }
+    dt_database_release_transaction(darktable.db);
 
     dt_control_signal_raise(darktable.signals, DT_SIGNAL_DEVELOP_IMAGE_CHANGED);
 
-    t = g_list_next(t);
-    const double fraction = 1.0 / total;
-    dt_control_job_set_progress(job, fraction);
+    done += r->count;
+    dt_control_job_set_progress(job, (double)done / total);
   }
+  g_free(r);
   return 0;
 }
 
 
+// what the images of one export share, see dt_control_export_job_run()
+typedef struct dt_control_export_run_t
+{
+  dt_job_t *job;
+  dt_control_export_t *settings;
+  dt_imageio_module_format_t *mformat;
+  dt_imageio_module_storage_t *mstorage;
+  dt_imageio_module_data_t *sdata;
+  dt_imageio_module_data_t **fdata; // one per image exported at the same time
+  dt_export_metadata_t *metadata;
+  int *images;
+  guint total;
+  guint tagid, etagid;
+  gint next;    // next image to export
+  gint done;    // images done, for the progress
+  gint tag_change;
+} dt_control_export_run_t;
+
+// images need about this many full size float buffers each while they are exported
+#define DT_CONTROL_EXPORT_BUFFERS 4
+
+static int _export_concurrency(const dt_control_export_run_t *run, dt_imageio_module_data_t *fdata,
+                               const uint32_t width, const uint32_t height)
+{
+  if(run->total < 2 || !run->mstorage->parallel_store || !run->mstorage->parallel_store(run->mstorage)
+     || !(run->mformat->flags(fdata) & FORMAT_FLAGS_PARALLEL))
+    return 1;
+
+  int count = dt_conf_get_int("export_concurrency");
+  if(count <= 0)
+  {
+    // one image per OpenCL device and one more, so neither the devices nor the CPU wait while an image is
+    // loaded or written. on the CPU alone the pipe already keeps all cores busy.
+    count = 1;
+#ifdef HAVE_OPENCL
+    if(dt_opencl_is_enabled()) count = darktable.opencl->num_devs + 1;
+#endif
+  }
+  // the other images are taken by idle workers, see dt_control_parallel_for()
+  count = MIN(count, MIN((int)run->total, darktable.control->num_threads));
+
+  // without a size limit assume a large sensor
+  const size_t wd = width ? width : 8000;
+  const size_t ht = height ? height : 6000;
+  while(count > 1
+        && !dt_tiling_piece_fits_host_memory(wd, ht, 4 * sizeof(float), count * DT_CONTROL_EXPORT_BUFFERS, 0))
+    count--;
+  return MAX(count, 1);
+}
+
+static void _export_image(dt_control_export_run_t *run, dt_imageio_module_data_t *fdata, const guint index)
+{
+  const int imgid = run->images[index];
+  const guint num = index + 1;
+  const guint total = run->total;
+  dt_control_export_t *settings = run->settings;
+
+  // progress message
+  char message[512] = { 0 };
+  snprintf(message, sizeof(message), _("exporting %d / %d to %s"), num, total, run->mstorage->name(run->mstorage));
+  // update the message. initialize_store() might have changed the number of images
+  dt_control_job_set_progress_message(run->job, message);
+
+  // remove 'changed' tag from image
+  if(dt_tag_detach(run->tagid, imgid, FALSE, FALSE)) g_atomic_int_set(&run->tag_change, TRUE);
+  // make sure the 'exported' tag is set on the image
+  if(dt_tag_attach(run->etagid, imgid, FALSE, FALSE)) g_atomic_int_set(&run->tag_change, TRUE);
+
+  /* register export timestamp in cache */
+  dt_image_cache_set_export_timestamp(darktable.image_cache, imgid);
+
+  // check if image still exists:
+  const dt_image_t *image = dt_image_cache_get(darktable.image_cache, (int32_t)imgid, 'r');
+  if(image)
+  {
+    char imgfilename[PATH_MAX] = { 0 };
+    gboolean from_cache = TRUE;
+    dt_image_full_path(image->id, imgfilename, sizeof(imgfilename), &from_cache);
+    if(!g_file_test(imgfilename, G_FILE_TEST_IS_REGULAR))
+    {
+      dt_control_log(_("image `%s' is currently unavailable"), image->filename);
+      fprintf(stderr, "image `%s' is currently unavailable\n", imgfilename);
+      // dt_image_remove(imgid);
+      dt_image_cache_read_release(darktable.image_cache, image);
+    }
+    else
+    {
+      dt_image_cache_read_release(darktable.image_cache, image);
+      // the sequence number is the position in the list, whichever image gets done first
+      if(run->mstorage->store(run->mstorage, run->sdata, imgid, run->mformat, fdata, num, total,
+                              settings->high_quality, settings->upscale, settings->export_masks,
+                              settings->icc_type, settings->icc_filename, settings->icc_intent, run->metadata)
+         != 0)
+        dt_control_job_cancel(run->job);
+    }
+  }
+
+  const guint done = g_atomic_int_add(&run->done, 1) + 1;
+  dt_control_job_set_progress(run->job, MIN(1.0, (double)done / total));
+}
+
+static void _export_images(const int slot, void *data)
+{
+  dt_control_export_run_t *run = (dt_control_export_run_t *)data;
+  dt_imageio_export_batch_begin();
+  while(dt_control_job_get_state(run->job) != DT_JOB_STATE_CANCELLED)
+  {
+    const guint index = g_atomic_int_add(&run->next, 1);
+    if(index >= run->total) break;
+    _export_image(run, run->fdata[slot], index);
+  }
+  dt_imageio_export_batch_end();
+}
+
 static int32_t dt_control_export_job_run(dt_job_t *job)
 {
   dt_control_image_enumerator_t *params = (dt_control_image_enumerator_t *)dt_control_job_get_params(job);
@@ -1214,7 +1663,8 @@ static int32_t dt_control_export_job_run(dt_job_t *job)
   g_assert(mstorage);
   dt_imageio_module_data_t *sdata = settings->sdata;
 
-  gboolean tag_change = FALSE;
+  dt_control_export_run_t run = { .job = job, .settings = settings, .sdata = sdata };
+  int concurrency = 1;
 
   // get a thread-safe fdata struct (one jpeg struct per thread etc):
   dt_imageio_module_data_t *fdata = mformat->get_params(mformat);
@@ -1249,8 +1699,6 @@ static int32_t dt_control_export_job_run(dt_job_t *job)
   const guint total = g_list_length(t);
   dt_control_log(ngettext("exporting %d image..", "exporting %d images..", total), total);
 
-  double fraction = 0;
-
   // set up the fdata struct
   fdata->max_width = (settings->max_width != 0 && w != 0) ? MIN(w, settings->max_width) : MAX(w, settings->max_width);
   fdata->max_height = (settings->max_height != 0 && h != 0) ? MIN(h, settings->max_height) : MAX(h, settings->max_height);
@@ -1258,9 +1706,8 @@ static int32_t dt_control_export_job_run(dt_job_t *job)
   fdata->style_append = settings->style_append;
   // Invariant: the tagid for 'darktable|changed' will not change while this function runs. Is this a
   // sensible assumption?
-  guint tagid = 0, etagid = 0;
-  dt_tag_new("darktable|changed", &tagid);
-  dt_tag_new("darktable|exported", &etagid);
+  dt_tag_new("darktable|changed", &run.tagid);
+  dt_tag_new("darktable|exported", &run.etagid);
 
   dt_export_metadata_t metadata;
   metadata.flags = 0;
@@ -1271,58 +1718,48 @@ static int32_t dt_control_export_job_run(dt_job_t *job)
     metadata.list = g_list_remove(metadata.list, metadata.list->data);
   }
 
-  while(t && dt_control_job_get_state(job) != DT_JOB_STATE_CANCELLED)
+  run.mformat = mformat;
+  run.mstorage = mstorage;
+  run.metadata = &metadata;
+  run.total = total;
+  run.images = (int *)malloc(sizeof(int) * MAX(total, 1));
+  guint n = 0;
+  for(GList *iter = t; iter; iter = g_list_next(iter)) run.images[n++] = GPOINTER_TO_INT(iter->data);
+
+  // storages which can be called from several threads, with a format which can write several images at once,
+  // get several images exported at the same time, each with its own pipe and format data
+  concurrency = _export_concurrency(&run, fdata, fdata->max_width, fdata->max_height);
+  run.fdata = (dt_imageio_module_data_t **)calloc(concurrency, sizeof(dt_imageio_module_data_t *));
+  run.fdata[0] = fdata;
+  for(int k = 1; k < concurrency; k++)
   {
-    const int imgid = GPOINTER_TO_INT(t->data);
-    t = g_list_next(t);
-    const guint num = total - g_list_length(t);
-
-    // progress message
-    char message[512] = { 0 };
-    snprintf(message, sizeof(message), _("exporting %d / %d to %s"), num, total, mstorage->name(mstorage));
-    // update the message. initialize_store() might have changed the number of images
-    dt_control_job_set_progress_message(job, message);
-
-    // remove 'changed' tag from image
-    if(dt_tag_detach(tagid, imgid, FALSE, FALSE)) tag_change = TRUE;
-    // make sure the 'exported' tag is set on the image
-    if(dt_tag_attach(etagid, imgid, FALSE, FALSE)) tag_change = TRUE;
-
-    /* register export timestamp in cache */
-    dt_image_cache_set_export_timestamp(darktable.image_cache, imgid);
-
-    // check if image still exists:
-    const dt_image_t *image = dt_image_cache_get(darktable.image_cache, (int32_t)imgid, 'r');
-    if(image)
+    dt_imageio_module_data_t *slot = mformat->get_params(mformat);
+    if(!slot)
     {
-      char imgfilename[PATH_MAX] = { 0 };
-      gboolean from_cache = TRUE;
-      dt_image_full_path(image->id, imgfilename, sizeof(imgfilename), &from_cache);
-      if(!g_file_test(imgfilename, G_FILE_TEST_IS_REGULAR))
-      {
-        dt_control_log(_("image `%s' is currently unavailable"), image->filename);
-        fprintf(stderr, "image `%s' is currently unavailable\n", imgfilename);
-        // dt_image_remove(imgid);
-        dt_image_cache_read_release(darktable.image_cache, image);
-      }
-      else
-      {
-        dt_image_cache_read_release(darktable.image_cache, image);
-        if(mstorage->store(mstorage, sdata, imgid, mformat, fdata, num, total, settings->high_quality, settings->upscale,
-                           settings->export_masks, settings->icc_type, settings->icc_filename, settings->icc_intent,
-                           &metadata) != 0)
-          dt_control_job_cancel(job);
-      }
+      concurrency = k;
+      break;
     }
-
-    fraction += 1.0 / total;
-    if(fraction > 1.0) fraction = 1.0;
-    dt_control_job_set_progress(job, fraction);
+    slot->max_width = fdata->max_width;
+    slot->max_height = fdata->max_height;
+    g_strlcpy(slot->style, fdata->style, sizeof(slot->style));
+    slot->style_append = fdata->style_append;
+    run.fdata[k] = slot;
   }
-  g_list_free_full(metadata.list, g_free);
+  dt_print(DT_DEBUG_CONTROL, "[export_job] exporting %u images, %d at a time\n", total, concurrency);
+
+  if(concurrency > 1)
+    dt_control_parallel_for(concurrency, _export_images, &run);
+  else
+    _export_images(0, &run);
 
+  // the storage may still hand the format params of the slots to the scripts while it finishes
   if(mstorage->finalize_store) mstorage->finalize_store(mstorage, sdata);
 
+  g_list_free_full(metadata.list, g_free);
+  for(int k = 1; k < concurrency; k++) mformat->free_params(mformat, run.fdata[k]);
+  free(run.fdata);
+  free(run.images);
+
 end:
   // all threads free their fdata
   mformat->free_params(mformat, fdata);
@@ -1330,7 +1767,7 @@ end:
   // notify the user via the window manager
   dt_ui_notify_user();
 
-  if(tag_change) dt_control_signal_raise(darktable.signals, DT_SIGNAL_TAG_CHANGED);
+  if(g_atomic_int_get(&run.tag_change)) dt_control_signal_raise(darktable.signals, DT_SIGNAL_TAG_CHANGED);
   return 0;
 }
 
@@ -1406,6 +1843,22 @@ void dt_control_duplicate_images()
                                                           N_("duplicate images"), 0, NULL, PROGRESS_SIMPLE, TRUE));
 }
 
+void dt_control_compress_history()
+{
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_FG,
+                     dt_control_generic_images_job_create(&dt_control_compress_history_job_run,
+                                                          N_("compress history"), 0, NULL, PROGRESS_CANCELLABLE,
+                                                          TRUE));
+}
+
+void dt_control_lightroom_import()
+{
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_FG,
+                     dt_control_generic_images_job_create(&dt_control_lightroom_import_job_run,
+                                                          N_("import lightroom"), 0, NULL, PROGRESS_CANCELLABLE,
+                                                          TRUE));
+}
+
 void dt_control_flip_images(const int32_t cw)
 {
   dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_FG,
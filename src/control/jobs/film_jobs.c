@@ -18,6 +18,10 @@
 #include "control/jobs/film_jobs.h"
 #include "common/darktable.h"
 #include "common/film.h"
+#include "common/mipmap_cache.h"
+#include "control/conf.h"
+#include <glib/gstdio.h>
+#include <stdio.h>
 #include <stdlib.h>
 
 typedef struct dt_film_import1_t
@@ -133,6 +137,80 @@ int _film_filename_cmp(gchar *a, gchar *b)
   return ret;
 }
 
+// images imported in one transaction, and read ahead together before
+#define DT_FILM_IMPORT_BATCH 100
+// enough for the metadata of most formats
+#define DT_FILM_IMPORT_READAHEAD (256 * 1024)
+
+static size_t _film_read_file_head(const char *filename, char *buf)
+{
+  FILE *f = g_fopen(filename, "rb");
+  if(!f) return 0;
+  const size_t length = fread(buf, 1, DT_FILM_IMPORT_READAHEAD, f);
+  fclose(f);
+  return length;
+}
+
+static void _film_read_ahead_one(const int index, void *data)
+{
+  const char *filename = ((const char **)data)[index];
+  char *buf = g_try_malloc(DT_FILM_IMPORT_READAHEAD);
+  if(!buf) return;
+  _film_read_file_head(filename, buf);
+  gchar *xmp = g_strconcat(filename, ".xmp", NULL);
+  _film_read_file_head(xmp, buf);
+  g_free(xmp);
+  g_free(buf);
+}
+
+// exiv2 only parses one file at a time, under a lock which also covers the reads. so the file heads and
+// the sidecars are pulled into the page cache by all workers beforehand, which is what takes the time on
+// spinning disks and network shares.
+static void _film_read_ahead(GList *images, const int count)
+{
+  const char **filenames = malloc(sizeof(char *) * count);
+  if(!filenames) return;
+  int n = 0;
+  for(GList *l = images; l && n < count; l = g_list_next(l)) filenames[n++] = (const char *)l->data;
+  dt_control_parallel_for(n, _film_read_ahead_one, filenames);
+  free(filenames);
+}
+
+typedef struct dt_film_previews_t
+{
+  const uint32_t *imgids;
+  dt_mipmap_size_t mip;
+} dt_film_previews_t;
+
+static void _film_extract_preview(const int index, void *data)
+{
+  const dt_film_previews_t *previews = (dt_film_previews_t *)data;
+  // images imported before may have been edited, those would need the pixelpipe
+  if(!dt_image_basic(previews->imgids[index])) return;
+
+  // without history this decodes the embedded preview and fills the smaller sizes from it
+  dt_mipmap_buffer_t buf;
+  dt_mipmap_cache_get(darktable.mipmap_cache, &buf, previews->imgids[index], previews->mip, DT_MIPMAP_BLOCKING,
+                      'r');
+  dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+}
+
+// thumbnails of freshly imported images at the size of the lighttable, from the embedded previews which are
+// cheap enough to do for all of them at once. the cache writes them to the disk backend when it drops them.
+static void _film_extract_previews(dt_job_t *job, const uint32_t *imgids, const int count)
+{
+  if(count <= 0 || !dt_conf_get_bool("import_extract_previews") || dt_conf_get_bool("never_use_embedded_thumb"))
+    return;
+
+  const int per_row = MAX(1, dt_conf_get_int("plugins/lighttable/images_in_row"));
+  const int size = MAX(1, dt_conf_get_int("ui_last/window_w") / per_row);
+  dt_film_previews_t previews = { .imgids = imgids,
+                                  .mip = dt_mipmap_cache_get_matching_size(darktable.mipmap_cache, size, size) };
+
+  dt_control_job_set_progress_message(job, _("extracting previews"));
+  dt_control_parallel_for(count, _film_extract_preview, &previews);
+}
+
 static void dt_film_import1(dt_job_t *job, dt_film_t *film)
 {
   gboolean recursive = dt_conf_get_bool("ui_last/import_recursive");
@@ -201,10 +279,22 @@ static void dt_film_import1(dt_job_t *job, dt_film_t *film)
 
 
   /* loop thru the images and import to current film roll */
+  uint32_t *imported = malloc(sizeof(uint32_t) * total);
+  int nb_imported = 0;
   dt_film_t *cfr = film;
   GList *image = g_list_first(images);
+  int done = 0;
   do
   {
+    // one transaction per batch instead of one per row written
+    if(done % DT_FILM_IMPORT_BATCH == 0)
+    {
+      if(done) dt_database_release_transaction(darktable.db);
+      _film_read_ahead(image, DT_FILM_IMPORT_BATCH);
+      dt_database_start_transaction(darktable.db);
+    }
+    done++;
+
     gchar *cdn = g_path_get_dirname((const gchar *)image->data);
 
     /* check if we need to initialize a new filmroll */
@@ -253,7 +343,8 @@ static void dt_film_import1(dt_job_t *job, dt_film_t *film)
     g_free(cdn);
 
     /* import image */
-    dt_image_import(cfr->id, (const gchar *)image->data, FALSE);
+    const uint32_t imgid = dt_image_import(cfr->id, (const gchar *)image->data, FALSE);
+    if(imgid && imported) imported[nb_imported++] = imgid;
 
     fraction += 1.0 / total;
     dt_control_job_set_progress(job, fraction);
@@ -261,8 +352,12 @@ static void dt_film_import1(dt_job_t *job, dt_film_t *film)
 
   } while((image = g_list_next(image)) != NULL);
 
+  dt_database_release_transaction(darktable.db);
   g_list_free_full(images, g_free);
 
+  _film_extract_previews(job, imported, nb_imported);
+  free(imported);
+
   // only redraw at the end, to not spam the cpu with exposure events
   dt_control_queue_redraw_center();
   dt_control_signal_raise(darktable.signals, DT_SIGNAL_TAG_CHANGED);
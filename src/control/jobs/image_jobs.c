@@ -24,12 +24,73 @@ typedef struct dt_image_load_t
 {
   int32_t imgid;
   dt_mipmap_size_t mip;
+  // the image was on screen when the job was created. not part of the params the queue compares, a second
+  // request for the same image and size is merged into the queued one whatever its flag
+  gboolean in_view;
 } dt_image_load_t;
 
+// the images on screen followed by the ones expected next, imgid -> 1 + position in reading order
+static struct
+{
+  dt_pthread_mutex_t lock;
+  GHashTable *images;
+  int count;
+} _view = { .images = NULL };
+
+// images shown first get loaded first, then the ones ahead. images scrolled away or no longer ahead, because
+// the scrolling turned around, aren't loaded any more. the position is looked up for every job, so a merged
+// job of an image which came on screen later is ranked as well
+static int dt_image_load_job_urgency(dt_job_t *job)
+{
+  const dt_image_load_t *params = dt_control_job_get_params(job);
+  if(!_view.images) return 0;
+
+  dt_pthread_mutex_lock(&_view.lock);
+  const int pos = GPOINTER_TO_INT(g_hash_table_lookup(_view.images, GINT_TO_POINTER(params->imgid)));
+  const int count = _view.count;
+  dt_pthread_mutex_unlock(&_view.lock);
+  if(pos) return 1 + count - pos;
+  return params->in_view ? -1 : 0;
+}
+
+static gboolean dt_image_load_in_view(const int32_t imgid)
+{
+  if(!_view.images) return FALSE;
+  dt_pthread_mutex_lock(&_view.lock);
+  const gboolean in_view = g_hash_table_contains(_view.images, GINT_TO_POINTER(imgid));
+  dt_pthread_mutex_unlock(&_view.lock);
+  return in_view;
+}
+
+void dt_image_load_jobs_set_view(const GList *imgids, const GList *ahead)
+{
+  if(!_view.images)
+  {
+    dt_pthread_mutex_init(&_view.lock, NULL);
+    _view.images = g_hash_table_new(g_direct_hash, g_direct_equal);
+  }
+
+  dt_pthread_mutex_lock(&_view.lock);
+  g_hash_table_remove_all(_view.images);
+  _view.count = 0;
+  for(const GList *l = imgids; l; l = g_list_next(l))
+    if(!g_hash_table_contains(_view.images, l->data))
+      g_hash_table_insert(_view.images, l->data, GINT_TO_POINTER(++_view.count));
+  for(const GList *l = ahead; l; l = g_list_next(l))
+    if(!g_hash_table_contains(_view.images, l->data))
+      g_hash_table_insert(_view.images, l->data, GINT_TO_POINTER(++_view.count));
+  dt_pthread_mutex_unlock(&_view.lock);
+
+  dt_control_queue_reprioritize(darktable.control, DT_JOB_QUEUE_SYSTEM_FG);
+}
+
 static int32_t dt_image_load_job_run(dt_job_t *job)
 {
   dt_image_load_t *params = dt_control_job_get_params(job);
 
+  // the cell may have been scrolled away while the job waited for a worker
+  if(dt_image_load_job_urgency(job) < 0) return 0;
+
   // hook back into mipmap_cache:
   dt_mipmap_buffer_t buf;
   dt_mipmap_cache_get(darktable.mipmap_cache, &buf, params->imgid, params->mip, DT_MIPMAP_BLOCKING, 'r');
@@ -56,12 +117,88 @@ dt_job_t *dt_image_load_job_create(int32_t id, dt_mipmap_size_t mip)
     dt_control_job_dispose(job);
     return NULL;
   }
-  dt_control_job_set_params_with_size(job, params, sizeof(dt_image_load_t), free);
+  dt_control_job_set_params_with_size(job, params, offsetof(dt_image_load_t, in_view), free);
   params->imgid = id;
   params->mip = mip;
+  params->in_view = dt_image_load_in_view(id);
+  dt_control_job_set_urgency_callback(job, dt_image_load_job_urgency);
   return job;
 }
 
+typedef struct dt_image_prefetch_t
+{
+  int32_t imgid;
+} dt_image_prefetch_t;
+
+// the images the darkroom expects to switch to next, imgid -> 1
+static struct
+{
+  dt_pthread_mutex_t lock;
+  GHashTable *images;
+} _prefetch = { .images = NULL };
+
+static gboolean _prefetch_wanted(const int32_t imgid)
+{
+  if(!_prefetch.images) return FALSE;
+  dt_pthread_mutex_lock(&_prefetch.lock);
+  const gboolean wanted = g_hash_table_contains(_prefetch.images, GINT_TO_POINTER(imgid));
+  dt_pthread_mutex_unlock(&_prefetch.lock);
+  return wanted;
+}
+
+// queued prefetches of images the darkroom moved away from get dropped
+static int _prefetch_job_urgency(dt_job_t *job)
+{
+  const dt_image_prefetch_t *params = dt_control_job_get_params(job);
+  return _prefetch_wanted(params->imgid) ? 0 : -1;
+}
+
+static int32_t _prefetch_job_run(dt_job_t *job)
+{
+  const dt_image_prefetch_t *params = dt_control_job_get_params(job);
+  if(!_prefetch_wanted(params->imgid)) return 0;
+
+  dt_mipmap_buffer_t buf;
+  dt_mipmap_cache_get(darktable.mipmap_cache, &buf, params->imgid, DT_MIPMAP_FULL, DT_MIPMAP_BLOCKING, 'r');
+  dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+  return 0;
+}
+
+void dt_image_prefetch_full(const GList *imgids)
+{
+  if(!_prefetch.images)
+  {
+    dt_pthread_mutex_init(&_prefetch.lock, NULL);
+    _prefetch.images = g_hash_table_new(g_direct_hash, g_direct_equal);
+  }
+
+  dt_pthread_mutex_lock(&_prefetch.lock);
+  g_hash_table_remove_all(_prefetch.images);
+  for(const GList *l = imgids; l; l = g_list_next(l)) g_hash_table_add(_prefetch.images, l->data);
+  dt_pthread_mutex_unlock(&_prefetch.lock);
+
+  dt_control_queue_reprioritize(darktable.control, DT_JOB_QUEUE_SYSTEM_FG);
+  // without workers the decode would block the caller
+  if(!dt_control_running()) return;
+
+  for(const GList *l = imgids; l; l = g_list_next(l))
+  {
+    dt_job_t *job = dt_control_job_create(&_prefetch_job_run, "prefetch full image %d", GPOINTER_TO_INT(l->data));
+    if(!job) continue;
+    dt_image_prefetch_t *params = (dt_image_prefetch_t *)calloc(1, sizeof(dt_image_prefetch_t));
+    if(!params)
+    {
+      dt_control_job_dispose(job);
+      continue;
+    }
+    params->imgid = GPOINTER_TO_INT(l->data);
+    // same size and params as a queued prefetch of the image, so they get merged
+    dt_control_job_set_params_with_size(job, params, sizeof(dt_image_prefetch_t), free);
+    dt_control_job_set_urgency_callback(job, _prefetch_job_urgency);
+    dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_FG, job);
+  }
+}
+
 typedef struct dt_image_import_t
 {
   uint32_t film_id;
@@ -76,7 +213,10 @@ static int32_t dt_image_import_job_run(dt_job_t *job)
   snprintf(message, sizeof(message), _("importing image %s"), params->filename);
   dt_control_job_set_progress_message(job, message);
 
+  // one commit for all the rows the import writes
+  dt_database_start_transaction(darktable.db);
   const int id = dt_image_import(params->film_id, params->filename, TRUE);
+  dt_database_release_transaction(darktable.db);
   if(id)
   {
     dt_control_signal_raise(darktable.signals, DT_SIGNAL_VIEWMANAGER_THUMBTABLE_ACTIVATE, id);
@@ -24,6 +24,13 @@
 #include <inttypes.h>
 
 dt_job_t *dt_image_load_job_create(int32_t imgid, dt_mipmap_size_t mip);
+/** tells which images are on screen, in the order they should be loaded, and which are expected to come up
+    next. queued loads of images which were in either list when requested and no longer are get dropped, the
+    others are ordered by the lists, the images ahead after all of those on screen. */
+void dt_image_load_jobs_set_view(const GList *imgids, const GList *ahead);
+/** loads the full buffers of the images expected to be opened next, in that order. queued loads of images passed
+    to an earlier call and not to this one get dropped, pass NULL to drop all of them. */
+void dt_image_prefetch_full(const GList *imgids);
 
 dt_job_t *dt_image_import_job_create(uint32_t filmid, const char *filename);
 
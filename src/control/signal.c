@@ -17,6 +17,7 @@
 */
 #include "control/signal.h"
 #include "control/control.h"
+#include "gui/watchdog.h"
 #include <glib.h>
 #include <string.h>
 
@@ -90,6 +91,8 @@ static dt_signal_description _signal_description[DT_SIGNAL_COUNT] = {
     FALSE }, // DT_SIGNAL_VIEWMANAGER_VIEW_CHANGED
   { "dt-viewmanager-thumbtable-activate", NULL, NULL, G_TYPE_NONE, g_cclosure_marshal_VOID__UINT, 1, uint_arg,
     NULL, FALSE }, // DT_SIGNAL_VIEWMANAGER_THUMBTABLE_ACTIVATE
+  { "dt-viewmanager-surface-ready", NULL, NULL, G_TYPE_NONE, g_cclosure_marshal_VOID__UINT, 1, uint_arg, NULL,
+    FALSE }, // DT_SIGNAL_VIEWMANAGER_SURFACE_READY
 
   { "dt-collection-changed", NULL, NULL, G_TYPE_NONE, g_cclosure_marshal_generic, 3, collection_args,
     G_CALLBACK(_collection_changed_destroy_callback), FALSE }, // DT_SIGNAL_COLLECTION_CHANGED
@@ -326,7 +329,15 @@ void dt_control_signal_raise(const dt_control_signal_t *ctlsig, dt_signal_t sign
 void dt_control_signal_connect(const dt_control_signal_t *ctlsig, dt_signal_t signal, GCallback cb,
                                gpointer user_data)
 {
-  g_signal_connect(G_OBJECT(ctlsig->sink), _signal_description[signal].name, G_CALLBACK(cb), user_data);
+  if(dt_gui_watchdog_enabled())
+  {
+    // the same closure g_signal_connect() would make, so the handler can still be found by its function
+    GClosure *closure = g_cclosure_new(G_CALLBACK(cb), user_data, NULL);
+    dt_gui_watchdog_guard_signal(closure, _signal_description[signal].name, G_CALLBACK(cb));
+    g_signal_connect_closure(G_OBJECT(ctlsig->sink), _signal_description[signal].name, closure, FALSE);
+  }
+  else
+    g_signal_connect(G_OBJECT(ctlsig->sink), _signal_description[signal].name, G_CALLBACK(cb), user_data);
 }
 
 void dt_control_signal_disconnect(const struct dt_control_signal_t *ctlsig, GCallback cb, gpointer user_data)
@@ -62,6 +62,12 @@ typedef enum dt_signal_t
    */
   DT_SIGNAL_VIEWMANAGER_THUMBTABLE_ACTIVATE,
 
+  /** \brief This signal is raised when a surface asked with dt_view_image_get_surface_async() is ready
+    1 : int the imageid of the surface
+    no returned value
+   */
+  DT_SIGNAL_VIEWMANAGER_SURFACE_READY,
+
   /** \brief This signal is raised when collection changed. To avoid leaking the list,
     dt_collection_t is connected to this event and responsible of that.
     1 : dt_collection_change_t the reason why the collection has changed
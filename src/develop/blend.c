@@ -23,10 +23,14 @@
 #include "common/opencl.h"
 #include "control/control.h"
 #include "develop/imageop.h"
+#include "develop/imageop_math.h"
 #include "develop/masks.h"
 #include "develop/tiling.h"
 #include <math.h>
 
+#define DT_BLEND_ROWS dt_develop_blend_rows_plain
+#include "develop/blend_rows.h"
+
 
 typedef struct _blend_buffer_desc_t
 {
@@ -38,6 +42,14 @@ typedef struct _blend_buffer_desc_t
 
 typedef void(_blend_row_func)(const _blend_buffer_desc_t *bd, const float *a, float *b, const float *mask);
 
+// the vector loops of blend_rows.h
+typedef int(_blend_rows_func)(const unsigned int blend_mode, const dt_iop_colorspace_type_t cst, const float *a,
+                              float *b, const float *mask, const size_t n);
+
+#ifdef HAVE_AVX2_CODEPATH
+_blend_rows_func dt_develop_blend_rows_avx2;
+#endif
+
 static inline float _Hue_2_RGB(float v1, float v2, float vH)
 {
   if(vH < 0.0f) vH += 1.0f;
@@ -365,13 +377,14 @@ static inline void _blend_noop(const _blend_buffer_desc_t *bd, const float *a, f
 }
 
 
-/* generate blend mask */
-static void _blend_make_mask(const _blend_buffer_desc_t *bd, const unsigned int blendif,
-                             const float *blendif_parameters, const unsigned int mask_mode,
-                             const unsigned int mask_combine, const float gopacity, const float *a, const float *b,
-                             float *mask, const dt_iop_order_iccprofile_info_t *const work_profile)
+/* generate blend mask, ch is bd->ch as a constant, see DT_IOP_CHANNELS_DISPATCH */
+DT_IOP_CHANNELS_INLINE void _blend_make_mask(const int ch, const _blend_buffer_desc_t *bd,
+                                             const unsigned int blendif, const float *blendif_parameters,
+                                             const unsigned int mask_mode, const unsigned int mask_combine,
+                                             const float gopacity, const float *a, const float *b, float *mask,
+                                             const dt_iop_order_iccprofile_info_t *const work_profile)
 {
-  for(size_t i = 0, j = 0; j < bd->stride; i++, j += bd->ch)
+  for(size_t i = 0, j = 0; j < bd->stride; i++, j += ch)
   {
     float form = mask[i];
     float conditional = _blendif_factor(bd->cst, &a[j], &b[j], blendif, blendif_parameters, mask_mode,
@@ -2577,6 +2590,24 @@ _blend_row_func *dt_develop_choose_blend_func(const unsigned int blend_mode)
   return blend;
 }
 
+// the key of the blend mask kept on the piece: the input of the module, its params and masks without the blend
+// mode, and the region. 0 on pipes which only run once, they don't keep the mask.
+static uint64_t _blend_mask_hash(const dt_dev_pixelpipe_iop_t *const piece, const dt_iop_roi_t *const roi_in,
+                                 const dt_iop_roi_t *const roi_out)
+{
+  dt_dev_pixelpipe_t *const pipe = piece->pipe;
+  if(pipe->type & (DT_DEV_PIXELPIPE_EXPORT | DT_DEV_PIXELPIPE_THUMBNAIL)) return 0;
+
+  const int pos = g_list_index(pipe->nodes, piece);
+  uint64_t hash = dt_dev_pixelpipe_cache_hash(pipe->image.id, roi_in, pipe, pos);
+  hash = ((hash << 5) + hash) ^ piece->mask_hash;
+  const char *str = (const char *)roi_out;
+  for(size_t i = 0; i < sizeof(dt_iop_roi_t); i++) hash = ((hash << 5) + hash) ^ str[i];
+  str = (const char *)&piece->iscale;
+  for(size_t i = 0; i < sizeof(float); i++) hash = ((hash << 5) + hash) ^ str[i];
+  return hash ? hash : 1;
+}
+
 void dt_develop_blend_process(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                               const void *const ivoid, void *const ovoid, const struct dt_iop_roi_t *const roi_in,
                               const struct dt_iop_roi_t *const roi_out)
@@ -2700,157 +2731,179 @@ void dt_develop_blend_process(struct dt_iop_module_t *self, struct dt_dev_pixelp
   }
   else
   {
-    // we blend with a drawn and/or parametric mask
-
-    // get the drawn mask if there is one
-    dt_masks_form_t *form = dt_masks_get_from_id_ext(piece->pipe->forms, d->mask_id);
+    // we blend with a drawn and/or parametric mask. it is kept on the piece, so that changing nothing but the
+    // blend mode of the module doesn't build it again. the opacity goes in before the feathering, blur and tone
+    // curve, which clamp the mask and are not linear in it.
+    const uint64_t mask_hash = _blend_mask_hash(piece, roi_in, roi_out);
+    if(mask_hash && piece->blend_mask_size != buffsize)
+    {
+      dt_free_align(piece->blend_mask);
+      piece->blend_mask = dt_alloc_align(64, buffsize * sizeof(float));
+      piece->blend_mask_size = piece->blend_mask ? buffsize : 0;
+      piece->blend_mask_hash = 0;
+    }
+    float *const base = (mask_hash && piece->blend_mask) ? piece->blend_mask : mask;
 
-    if(form && (!(self->flags() & IOP_FLAGS_NO_MASKS)) && (d->mask_mode & DEVELOP_MASK_MASK))
+    if(base == mask || piece->blend_mask_hash != mask_hash)
     {
-      dt_masks_group_render_roi(self, piece, form, roi_out, mask);
+      // get the drawn mask if there is one
+      dt_masks_form_t *form = dt_masks_get_from_id_ext(piece->pipe->forms, d->mask_id);
 
-      if(d->mask_combine & DEVELOP_COMBINE_MASKS_POS)
+      if(form && (!(self->flags() & IOP_FLAGS_NO_MASKS)) && (d->mask_mode & DEVELOP_MASK_MASK))
       {
-        // if we have a mask and this flag is set -> invert the mask
+        dt_masks_group_render_roi(self, piece, form, roi_out, base);
+
+        if(d->mask_combine & DEVELOP_COMBINE_MASKS_POS)
+        {
+          // if we have a mask and this flag is set -> invert the mask
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-        dt_omp_firstprivate(buffsize, mask)
+          dt_omp_firstprivate(buffsize, base)
 #endif
-        for(size_t i = 0; i < buffsize; i++) mask[i] = 1.0f - mask[i];
+          for(size_t i = 0; i < buffsize; i++) base[i] = 1.0f - base[i];
+        }
       }
-    }
-    else if((!(self->flags() & IOP_FLAGS_NO_MASKS)) && (d->mask_mode & DEVELOP_MASK_MASK))
-    {
-      // no form defined but drawn mask active
-      // we fill the buffer with 1.0f or 0.0f depending on mask_combine
-      const float fill = (d->mask_combine & DEVELOP_COMBINE_MASKS_POS) ? 0.0f : 1.0f;
+      else if((!(self->flags() & IOP_FLAGS_NO_MASKS)) && (d->mask_mode & DEVELOP_MASK_MASK))
+      {
+        // no form defined but drawn mask active
+        // we fill the buffer with 1.0f or 0.0f depending on mask_combine
+        const float fill = (d->mask_combine & DEVELOP_COMBINE_MASKS_POS) ? 0.0f : 1.0f;
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-      dt_omp_firstprivate(buffsize, mask, fill)
+        dt_omp_firstprivate(buffsize, base, fill)
 #endif
-      for(size_t i = 0; i < buffsize; i++) mask[i] = fill;
-    }
-    else
-    {
-      // we fill the buffer with 1.0f or 0.0f depending on mask_combine
-      const float fill = (d->mask_combine & DEVELOP_COMBINE_INCL) ? 0.0f : 1.0f;
+        for(size_t i = 0; i < buffsize; i++) base[i] = fill;
+      }
+      else
+      {
+        // we fill the buffer with 1.0f or 0.0f depending on mask_combine
+        const float fill = (d->mask_combine & DEVELOP_COMBINE_INCL) ? 0.0f : 1.0f;
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-      dt_omp_firstprivate(buffsize, mask, fill)
+        dt_omp_firstprivate(buffsize, base, fill)
 #endif
-      for(size_t i = 0; i < buffsize; i++) mask[i] = fill;
-    }
+        for(size_t i = 0; i < buffsize; i++) base[i] = fill;
+      }
 
-    // get parametric mask (if any) and apply global opacity
+      // get parametric mask (if any)
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-    dt_omp_firstprivate(bch, ch, cst, d, oheight, opacity, ivoid, iwidth, \
-                        mask, owidth, ovoid, work_profile, xoffs, yoffs)
+      dt_omp_firstprivate(bch, ch, cst, d, oheight, opacity, ivoid, iwidth, \
+                          base, owidth, ovoid, work_profile, xoffs, yoffs)
 #endif
-    for(size_t y = 0; y < oheight; y++)
-    {
-      size_t iindex = ((y + yoffs) * iwidth + xoffs) * ch;
-      size_t oindex = y * owidth * ch;
-      _blend_buffer_desc_t bd = { .cst = cst, .stride = (size_t)owidth * ch, .ch = ch, .bch = bch };
-      float *in = (float *)ivoid + iindex;
-      float *out = (float *)ovoid + oindex;
-      float *m = mask + y * owidth;
-      _blend_make_mask(&bd, d->blendif, d->blendif_parameters, d->mask_mode, d->mask_combine, opacity, in, out, m,
-                       work_profile);
-    }
-
-    if(mask_feather)
-    {
-      int w = (int)(2 * d->feathering_radius * roi_out->scale / piece->iscale + 0.5f);
-      if(w < 1) w = 1;
-      float sqrt_eps = 1.f;
-      float guide_weight = 1.f;
-      switch(cst)
+      for(size_t y = 0; y < oheight; y++)
       {
-        case iop_cs_rgb:
-          guide_weight = 100.f;
-          break;
-        case iop_cs_Lab:
-          guide_weight = 1.f;
-          break;
-        case iop_cs_RAW:
-        default:
-          assert(0);
-      }
-      float *mask_bak = dt_alloc_align(64, sizeof(*mask_bak) * buffsize);
-      memcpy(mask_bak, mask, sizeof(*mask_bak) * buffsize);
-      float *guide = d->feathering_guide == DEVELOP_MASK_GUIDE_IN ? (float *)ivoid : (float *)ovoid;
-      if(!rois_equal && d->feathering_guide == DEVELOP_MASK_GUIDE_IN)
+        size_t iindex = ((y + yoffs) * iwidth + xoffs) * ch;
+        size_t oindex = y * owidth * ch;
+        _blend_buffer_desc_t bd = { .cst = cst, .stride = (size_t)owidth * ch, .ch = ch, .bch = bch };
+        float *in = (float *)ivoid + iindex;
+        float *out = (float *)ovoid + oindex;
+        float *m = base + y * owidth;
+        DT_IOP_CHANNELS_DISPATCH(ch, _blend_make_mask, &bd, d->blendif, d->blendif_parameters, d->mask_mode,
+                                 d->mask_combine, opacity, in, out, m, work_profile);
+      }
+
+      if(mask_feather)
       {
-        float *const guide_tmp = dt_alloc_align(64, sizeof(*guide_tmp) * buffsize * ch);
+        int w = (int)(2 * d->feathering_radius * roi_out->scale / piece->iscale + 0.5f);
+        if(w < 1) w = 1;
+        float sqrt_eps = 1.f;
+        float guide_weight = 1.f;
+        switch(cst)
+        {
+          case iop_cs_rgb:
+            guide_weight = 100.f;
+            break;
+          case iop_cs_Lab:
+            guide_weight = 1.f;
+            break;
+          case iop_cs_RAW:
+          default:
+            assert(0);
+        }
+        float *mask_bak = dt_alloc_align(64, sizeof(*mask_bak) * buffsize);
+        memcpy(mask_bak, base, sizeof(*mask_bak) * buffsize);
+        float *guide = d->feathering_guide == DEVELOP_MASK_GUIDE_IN ? (float *)ivoid : (float *)ovoid;
+        if(!rois_equal && d->feathering_guide == DEVELOP_MASK_GUIDE_IN)
+        {
+          float *const guide_tmp = dt_alloc_align(64, sizeof(*guide_tmp) * buffsize * ch);
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-        dt_omp_firstprivate(ch, guide_tmp, ivoid, iwidth, oheight, owidth, xoffs, yoffs)
+          dt_omp_firstprivate(ch, guide_tmp, ivoid, iwidth, oheight, owidth, xoffs, yoffs)
 #endif
-        for(size_t y = 0; y < oheight; y++)
-        {
-          size_t iindex = ((size_t)(y + yoffs) * iwidth + xoffs) * ch;
-          size_t oindex = (size_t)y * owidth * ch;
-          memcpy(guide_tmp + oindex, (float *)ivoid + iindex, sizeof(*guide_tmp) * owidth * ch);
+          for(size_t y = 0; y < oheight; y++)
+          {
+            size_t iindex = ((size_t)(y + yoffs) * iwidth + xoffs) * ch;
+            size_t oindex = (size_t)y * owidth * ch;
+            memcpy(guide_tmp + oindex, (float *)ivoid + iindex, sizeof(*guide_tmp) * owidth * ch);
+          }
+          guide = guide_tmp;
         }
-        guide = guide_tmp;
+        guided_filter(guide, mask_bak, base, owidth, oheight, ch, w, sqrt_eps, guide_weight, 0.f, 1.f);
+        if(!rois_equal && d->feathering_guide == DEVELOP_MASK_GUIDE_IN) dt_free_align(guide);
+        dt_free_align(mask_bak);
       }
-      guided_filter(guide, mask_bak, mask, owidth, oheight, ch, w, sqrt_eps, guide_weight, 0.f, 1.f);
-      if(!rois_equal && d->feathering_guide == DEVELOP_MASK_GUIDE_IN) dt_free_align(guide);
-      dt_free_align(mask_bak);
-    }
-    if(mask_blur)
-    {
-      const float sigma = d->blur_radius * roi_out->scale / piece->iscale;
-      const float mmax[] = { 1.0f };
-      const float mmin[] = { 0.0f };
-
-      dt_gaussian_t *g = dt_gaussian_init(owidth, oheight, 1, mmax, mmin, sigma, 0);
-      if(g)
+      if(mask_blur)
       {
-        dt_gaussian_blur(g, mask, mask);
-        dt_gaussian_free(g);
+        const float sigma = d->blur_radius * roi_out->scale / piece->iscale;
+        const float mmax[] = { 1.0f };
+        const float mmin[] = { 0.0f };
+
+        dt_gaussian_t *g = dt_gaussian_init(owidth, oheight, 1, mmax, mmin, sigma, 0);
+        if(g)
+        {
+          dt_gaussian_blur(g, base, base);
+          dt_gaussian_free(g);
+        }
       }
-    }
 
-    if(mask_tone_curve && opacity > 1e-4f)
-    {
-      const float mask_epsilon = 16 * FLT_EPSILON;  // empirical mask threshold for fully transparent masks
-      const float e = expf(3.f * d->contrast);
-      const float brightness = d->brightness;
+      if(mask_tone_curve)
+      {
+        const float mask_epsilon = 16 * FLT_EPSILON;  // empirical mask threshold for fully transparent masks
+        const float e = expf(3.f * d->contrast);
+        const float brightness = d->brightness;
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-      dt_omp_firstprivate(brightness, buffsize, e, mask, mask_epsilon, opacity)
+        dt_omp_firstprivate(brightness, buffsize, e, base, mask_epsilon)
 #endif
-      for(size_t k = 0; k < buffsize; k++)
-      {
-        float x = mask[k] / opacity;
-        x = 2.f * x - 1.f;
-        if (1.f - brightness <= 0.f)
-          x = mask[k] <= mask_epsilon ? -1.f : 1.f;
-        else if (1.f + brightness <= 0.f)
-          x = mask[k] >= 1.f - mask_epsilon ? 1.f : -1.f;
-        else if (brightness > 0.f)
+        for(size_t k = 0; k < buffsize; k++)
         {
-          x = (x + brightness) / (1.f - brightness);
-          x = fminf(x, 1.f);
+          float x = 2.f * base[k] - 1.f;
+          if (1.f - brightness <= 0.f)
+            x = base[k] <= mask_epsilon ? -1.f : 1.f;
+          else if (1.f + brightness <= 0.f)
+            x = base[k] >= 1.f - mask_epsilon ? 1.f : -1.f;
+          else if (brightness > 0.f)
+          {
+            x = (x + brightness) / (1.f - brightness);
+            x = fminf(x, 1.f);
+          }
+          else
+          {
+            x = (x + brightness) / (1.f + brightness);
+            x = fmaxf(x, -1.f);
+          }
+          base[k] = (x * e / (1.f + (e - 1.f) * fabsf(x))) / 2.f + 0.5f;
         }
-        else
-        {
-          x = (x + brightness) / (1.f + brightness);
-          x = fmaxf(x, -1.f);
-        }
-        mask[k] = ((x * e / (1.f + (e - 1.f) * fabsf(x))) / 2.f + 0.5f) * opacity;
       }
+      if(base != mask) piece->blend_mask_hash = mask_hash;
     }
+
+    if(base != mask) memcpy(mask, base, buffsize * sizeof(float));
   }
 
   // now apply blending with per-pixel opacity value as defined in mask
   // select the blend operator
   _blend_row_func *const blend = dt_develop_choose_blend_func(d->blend_mode);
+  // the common modes of 4 channel buffers go through the vector loops, which tell if they took the mode
+  _blend_rows_func *blend_rows = dt_develop_blend_rows_plain;
+#ifdef HAVE_AVX2_CODEPATH
+  if(darktable.codepath.AVX2) blend_rows = dt_develop_blend_rows_avx2;
+#endif
+  const unsigned int blend_mode = d->blend_mode;
 #ifdef _OPENMP
 #pragma omp parallel for default(none)                                                                            \
-  dt_omp_firstprivate(bch, blend, ch, cst, ivoid, iwidth, mask, \
+  dt_omp_firstprivate(bch, blend, blend_mode, blend_rows, ch, cst, ivoid, iwidth, mask, \
                       mask_display, oheight, ovoid, owidth, \
                         request_mask_display, work_profile, xoffs, yoffs)
 #endif
@@ -2865,7 +2918,7 @@ void dt_develop_blend_process(struct dt_iop_module_t *self, struct dt_dev_pixelp
 
     if(request_mask_display & DT_DEV_PIXELPIPE_DISPLAY_ANY)
       display_channel(&bd, in, out, m, request_mask_display, work_profile);
-    else
+    else if(ch != 4 || !blend_rows(blend_mode, cst, in, out, m, owidth))
       blend(&bd, in, out, m);
 
     if((mask_display & DT_DEV_PIXELPIPE_DISPLAY_MASK) && cst != iop_cs_RAW)
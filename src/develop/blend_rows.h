@@ -0,0 +1,131 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// the common blend modes of rgb and Lab buffers as vector loops over a row. included by blend.c and by
+// blend_avx2.c, which is built with the AVX2 flags. the results are those of the row functions in blend.c,
+// with the clamping done by selects. define DT_BLEND_ROWS to the name of the function before including.
+
+#include "common/darktable.h"
+#include "common/math.h"
+#include "develop/blend.h"
+#include "develop/imageop.h"
+
+#include <stddef.h>
+
+#ifdef _OPENMP
+#define BLEND_ROWS_SIMD _Pragma("omp simd")
+#else
+#define BLEND_ROWS_SIMD
+#endif
+
+// a loop over the n pixels of a row, o is the opacity of the pixel
+#define BLEND_ROWS_LOOP(...)                                                                                 \
+  {                                                                                                          \
+    BLEND_ROWS_SIMD                                                                                          \
+    for(size_t i = 0; i < n; i++)                                                                            \
+    {                                                                                                        \
+      const float o = mask[i];                                                                               \
+      for(int k = 0; k < 3; k++)                                                                             \
+      {                                                                                                      \
+        const float x = a[4 * i + k], y = b[4 * i + k];                                                      \
+        __VA_ARGS__                                                                                          \
+      }                                                                                                      \
+      b[4 * i + 3] = o;                                                                                      \
+    }                                                                                                        \
+  }
+
+// blends the n pixels of 4 channels of a into b and writes the opacity of mask to the alpha channel. returns
+// FALSE for the blend modes and color spaces that are left to the row functions of blend.c.
+int DT_BLEND_ROWS(const unsigned int blend_mode, const dt_iop_colorspace_type_t cst, const float *const a,
+                  float *const b, const float *const mask, const size_t n)
+{
+  if(cst == iop_cs_rgb)
+  {
+    // all channels are in [0, 1]
+    switch(blend_mode)
+    {
+      case DEVELOP_BLEND_NORMAL:
+      case DEVELOP_BLEND_BOUNDED:
+        BLEND_ROWS_LOOP(b[4 * i + k] = clamp_range_f(x * (1.0f - o) + y * o, 0.0f, 1.0f);)
+        return TRUE;
+      case DEVELOP_BLEND_NORMAL2:
+      case DEVELOP_BLEND_UNBOUNDED:
+        BLEND_ROWS_LOOP(b[4 * i + k] = x * (1.0f - o) + y * o;)
+        return TRUE;
+      case DEVELOP_BLEND_LIGHTEN:
+        BLEND_ROWS_LOOP(b[4 * i + k] = clamp_range_f(x * (1.0f - o) + (x > y ? x : y) * o, 0.0f, 1.0f);)
+        return TRUE;
+      case DEVELOP_BLEND_DARKEN:
+        BLEND_ROWS_LOOP(b[4 * i + k] = clamp_range_f(x * (1.0f - o) + (x < y ? x : y) * o, 0.0f, 1.0f);)
+        return TRUE;
+      case DEVELOP_BLEND_MULTIPLY:
+        BLEND_ROWS_LOOP(b[4 * i + k] = clamp_range_f(x * (1.0f - o) + (x * y) * o, 0.0f, 1.0f);)
+        return TRUE;
+      case DEVELOP_BLEND_AVERAGE:
+        BLEND_ROWS_LOOP(b[4 * i + k] = clamp_range_f(x * (1.0f - o) + (x + y) / 2.0f * o, 0.0f, 1.0f);)
+        return TRUE;
+      case DEVELOP_BLEND_ADD:
+        BLEND_ROWS_LOOP(b[4 * i + k] = clamp_range_f(x * (1.0f - o) + (x + y) * o, 0.0f, 1.0f);)
+        return TRUE;
+      case DEVELOP_BLEND_SUBSTRACT:
+        BLEND_ROWS_LOOP(b[4 * i + k] = clamp_range_f(x * (1.0f - o) + ((y + x) - 1.0f) * o, 0.0f, 1.0f);)
+        return TRUE;
+      case DEVELOP_BLEND_DIFFERENCE:
+      case DEVELOP_BLEND_DIFFERENCE2:
+        BLEND_ROWS_LOOP(b[4 * i + k] = clamp_range_f(x * (1.0f - o) + fabsf(x - y) * o, 0.0f, 1.0f);)
+        return TRUE;
+      case DEVELOP_BLEND_SCREEN:
+        BLEND_ROWS_LOOP(const float la = clamp_range_f(x, 0.0f, 1.0f);
+                        const float lb = clamp_range_f(y, 0.0f, 1.0f);
+                        b[4 * i + k] = clamp_range_f(la * (1.0f - o) + (1.0f - (1.0f - la) * (1.0f - lb)) * o,
+                                                     0.0f, 1.0f);)
+        return TRUE;
+      default:
+        return FALSE;
+    }
+  }
+  else if(cst == iop_cs_Lab)
+  {
+    // in the scale of _blend_Lab_scale(), L is in [0, 1], a and b in [-1, 1]
+    switch(blend_mode)
+    {
+      case DEVELOP_BLEND_NORMAL:
+      case DEVELOP_BLEND_BOUNDED:
+        BLEND_ROWS_LOOP(const float s = k ? 128.0f : 100.0f;
+                        const float lo = k ? -1.0f : 0.0f;
+                        b[4 * i + k] = clamp_range_f(x / s * (1.0f - o) + y / s * o, lo, 1.0f) * s;)
+        return TRUE;
+      case DEVELOP_BLEND_NORMAL2:
+      case DEVELOP_BLEND_UNBOUNDED:
+        BLEND_ROWS_LOOP(const float s = k ? 128.0f : 100.0f;
+                        b[4 * i + k] = (x / s * (1.0f - o) + y / s * o) * s;)
+        return TRUE;
+      default:
+        return FALSE;
+    }
+  }
+  return FALSE;
+}
+
+#undef BLEND_ROWS_LOOP
+#undef BLEND_ROWS_SIMD
+#undef DT_BLEND_ROWS
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
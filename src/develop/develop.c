@@ -39,12 +39,16 @@
 #include "develop/imageop.h"
 #include "develop/lightroom.h"
 #include "develop/masks.h"
+#include "develop/record.h"
 #include "gui/gtk.h"
 #include "gui/presets.h"
 
 #define DT_DEV_AVERAGE_DELAY_START 250
 #define DT_DEV_PREVIEW_AVERAGE_DELAY_START 50
 #define DT_DEV_AVERAGE_DELAY_COUNT 5
+// progressive updates of the center view: below this delay (ms) the full render is quick enough anyway
+#define DT_DEV_PROGRESSIVE_MIN_DELAY 150
+#define DT_DEV_PROGRESSIVE_FACTOR 4
 #define DT_IOP_ORDER_INFO (darktable.unmuted & DT_DEBUG_IOPORDER)
 
 const gchar *dt_dev_scope_type_names[DT_DEV_SCOPE_N] = { "histogram", "waveform" };
@@ -60,6 +64,7 @@ void dt_dev_init(dt_develop_t *dev, int32_t gui_attached)
   dev->preview2_average_delay = DT_DEV_PREVIEW_AVERAGE_DELAY_START;
   dev->gui_leaving = 0;
   dev->gui_synch = 0;
+  dev->gui_lazy = 0;
   dt_pthread_mutex_init(&dev->history_mutex, NULL);
   dev->history_end = 0;
   dev->history = NULL; // empty list
@@ -78,6 +83,7 @@ void dt_dev_init(dt_develop_t *dev, int32_t gui_attached)
   dt_pthread_mutex_init(&dev->preview_pipe_mutex, NULL);
   dt_pthread_mutex_init(&dev->preview2_pipe_mutex, NULL);
   dev->histogram = NULL;
+  dev->scope_hash = 0;
   dev->histogram_pre_tonecurve = NULL;
   dev->histogram_pre_levels = NULL;
   gchar *mode = dt_conf_get_string("plugins/darkroom/histogram/mode");
@@ -208,6 +214,7 @@ void dt_dev_cleanup(dt_develop_t *dev)
     dt_dev_pixelpipe_cleanup(dev->preview_pipe);
     free(dev->preview_pipe);
   }
+  dt_free_align(dev->preview_thumb.buf);
   if(dev->preview2_pipe)
   {
     dt_dev_pixelpipe_cleanup(dev->preview2_pipe);
@@ -262,6 +269,7 @@ void dt_dev_cleanup(dt_develop_t *dev)
 void dt_dev_process_image(dt_develop_t *dev)
 {
   if(!dev->gui_attached || dev->pipe->processing) return;
+  dt_dev_record_view(dev);
   int err
       = dt_control_add_job_res(darktable.control, dt_dev_process_image_job_create(dev), DT_CTL_WORKER_ZOOM_1);
   if(err) fprintf(stderr, "[dev_process_image] job queue exceeded!\n");
@@ -298,6 +306,67 @@ void dt_dev_invalidate_all(dt_develop_t *dev)
   dev->timestamp++;
 }
 
+// downscales the output of the preview pipe to the size asked for by the navigation, on the worker of the
+// preview so that the gui thread only has to copy it
+static void _dev_update_preview_thumb(dt_develop_t *dev)
+{
+  dt_dev_pixelpipe_t *pipe = dev->preview_pipe;
+  dt_pthread_mutex_lock(&pipe->backbuf_mutex);
+  const int iw = pipe->output_backbuf_width, ih = pipe->output_backbuf_height;
+  const int max_wd = dev->preview_thumb.max_width, max_ht = dev->preview_thumb.max_height;
+  if(!pipe->output_backbuf || iw <= 0 || ih <= 0 || max_wd <= 0 || max_ht <= 0)
+  {
+    dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
+    return;
+  }
+
+  const float scale = fminf(1.0f, fminf(max_wd / (float)iw, max_ht / (float)ih));
+  const int wd = MAX(1, (int)(iw * scale)), ht = MAX(1, (int)(ih * scale));
+  if(dev->preview_thumb.hash == pipe->backbuf_hash && dev->preview_thumb.imgid == pipe->output_imgid
+     && dev->preview_thumb.width == wd && dev->preview_thumb.height == ht)
+  {
+    dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
+    return;
+  }
+
+  if(!dev->preview_thumb.buf || dev->preview_thumb.width * dev->preview_thumb.height != wd * ht)
+  {
+    dt_free_align(dev->preview_thumb.buf);
+    dev->preview_thumb.buf = dt_alloc_align(64, (size_t)wd * ht * 4);
+  }
+  uint8_t *const out = dev->preview_thumb.buf;
+  const uint8_t *const in = pipe->output_backbuf;
+  if(out)
+  {
+    // average the box of input pixels under every output pixel, the scale can be a large one
+    const float sx = iw / (float)wd, sy = ih / (float)ht;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+    dt_omp_firstprivate(ht, in, iw, ih, out, sx, sy, wd) \
+    schedule(static)
+#endif
+    for(int j = 0; j < ht; j++)
+    {
+      const int y0 = (int)(j * sy), y1 = MIN(ih, MAX(y0 + 1, (int)((j + 1) * sy)));
+      for(int i = 0; i < wd; i++)
+      {
+        const int x0 = (int)(i * sx), x1 = MIN(iw, MAX(x0 + 1, (int)((i + 1) * sx)));
+        uint32_t sum[4] = { 0 };
+        for(int y = y0; y < y1; y++)
+          for(int x = x0; x < x1; x++)
+            for(int c = 0; c < 4; c++) sum[c] += in[4 * ((size_t)y * iw + x) + c];
+        const uint32_t n = (uint32_t)(y1 - y0) * (x1 - x0);
+        for(int c = 0; c < 4; c++) out[4 * ((size_t)j * wd + i) + c] = (sum[c] + n / 2) / n;
+      }
+    }
+  }
+  dev->preview_thumb.width = out ? wd : 0;
+  dev->preview_thumb.height = out ? ht : 0;
+  dev->preview_thumb.hash = pipe->backbuf_hash;
+  dev->preview_thumb.imgid = pipe->output_imgid;
+  dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
+}
+
 void dt_dev_process_preview_job(dt_develop_t *dev)
 {
   if(dev->image_loading)
@@ -394,6 +463,9 @@ restart:
   dt_pthread_mutex_unlock(&dev->preview_pipe_mutex);
   dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
 
+  if(dev->gui_attached) _dev_update_preview_thumb(dev);
+
+  dt_dev_record_finished(DT_DEV_RECORD_PREVIEW);
   dt_control_signal_raise(darktable.signals, DT_SIGNAL_DEVELOP_PREVIEW_PIPE_FINISHED);
 }
 
@@ -533,6 +605,20 @@ restart:
   dt_control_signal_raise(darktable.signals, DT_SIGNAL_DEVELOP_PREVIEW2_PIPE_FINISHED);
 }
 
+// a quick render at a fraction of the resolution is shown first if only the history changed and the
+// full one takes noticeably long. it is aborted like any other pipe run when the history changes again.
+static int _dev_progressive_factor(const dt_develop_t *dev, const dt_dev_pixelpipe_change_t pipe_changed)
+{
+  if(!dev->gui_attached || dev->image_loading) return 1;
+  // zooming and panning don't make the old image any less right
+  if(!(pipe_changed & (DT_DEV_PIPE_TOP_CHANGED | DT_DEV_PIPE_REMOVE | DT_DEV_PIPE_SYNCH))) return 1;
+  if(dev->average_delay < DT_DEV_PROGRESSIVE_MIN_DELAY) return 1;
+  // while shapes are edited the full pipe recomputes only their area, which is fast already
+  if(dev->form_visible && dev->pipe->output_valid) return 1;
+  if(!dt_conf_get_bool("darkroom/ui/progressive_rendering")) return 1;
+  return DT_DEV_PROGRESSIVE_FACTOR;
+}
+
 void dt_dev_process_image_job(dt_develop_t *dev)
 {
   dt_pthread_mutex_lock(&dev->pipe_mutex);
@@ -638,8 +724,28 @@ restart:
   x = MAX(0, scale * dev->pipe->processed_width  * (.5 + zoom_x) - wd / 2);
   y = MAX(0, scale * dev->pipe->processed_height * (.5 + zoom_y) - ht / 2);
 
+  int err = 0;
+  const int coarse = _dev_progressive_factor(dev, pipe_changed);
+  if(coarse > 1)
+  {
+    dev->pipe->coarse = coarse;
+    err = dt_dev_pixelpipe_process(dev->pipe, dev, x / coarse, y / coarse, MAX(wd / coarse, 1),
+                                   MAX(ht / coarse, 1), scale / coarse);
+    dev->pipe->coarse = 1;
+    // no point in refining an image that is outdated already
+    if(dev->pipe->changed != DT_DEV_PIPE_UNCHANGED) err = 1;
+    if(!err)
+    {
+      // the view upscales it until the full render replaces it
+      dev->pipe->backbuf_scale = scale;
+      dev->pipe->backbuf_zoom_x = zoom_x;
+      dev->pipe->backbuf_zoom_y = zoom_y;
+      dt_control_queue_redraw_center();
+    }
+  }
+
   dt_get_times(&start);
-  if(dt_dev_pixelpipe_process(dev->pipe, dev, x, y, wd, ht, scale))
+  if(err || dt_dev_pixelpipe_process(dev->pipe, dev, x, y, wd, ht, scale))
   {
     // interrupted because image changed?
     if(dev->image_force_reload)
@@ -676,7 +782,10 @@ restart:
   dt_pthread_mutex_unlock(&dev->pipe_mutex);
 
   if(dev->gui_attached && !dev->gui_leaving)
+  {
+    dt_dev_record_finished(DT_DEV_RECORD_FULL);
     dt_control_signal_raise(darktable.signals, DT_SIGNAL_DEVELOP_UI_PIPE_FINISHED);
+  }
 }
 
 // load the raw and get the new image struct, blocking in gui thread
@@ -759,6 +868,7 @@ void dt_dev_load_image(dt_develop_t *dev, const uint32_t imgid)
   dt_pthread_mutex_unlock(&darktable.dev_threadsafe);
 
   dev->first_load = FALSE;
+  dt_dev_record_load(dev);
 
   // Loading an image means we do some developing and so remove the darktable|problem|history-compress tag
   dt_history_set_compress_problem(imgid, FALSE);
@@ -982,6 +1092,7 @@ void dt_dev_add_history_item(dt_develop_t *dev, dt_iop_module_t *module, gboolea
   if(dev->gui_attached)
   {
     _dev_add_history_item_ext(dev, module, enable, FALSE, FALSE);
+    dt_dev_record_history(dev, module);
   }
 #if 0
   {
@@ -1066,6 +1177,7 @@ void dt_dev_add_masks_history_item(dt_develop_t *dev, dt_iop_module_t *module, g
   if(dev->gui_attached)
   {
     dt_dev_add_masks_history_item_ext(dev, module, enable, FALSE);
+    dt_dev_record_history(dev, module);
   }
 
   // invalidate buffers and force redraw of darkroom
@@ -1247,6 +1359,7 @@ void dt_dev_pop_history_items(dt_develop_t *dev, int32_t cnt)
   GList *dev_iop = g_list_copy(dev->iop);
 
   dt_dev_pop_history_items_ext(dev, cnt);
+  dt_dev_record_pop(dev, cnt);
 
   darktable.develop->history_updating = TRUE;
 
@@ -1402,6 +1515,144 @@ void _dev_insert_module(dt_develop_t *dev, dt_iop_module_t *module, const int im
   sqlite3_finalize(stmt);
 }
 
+// the auto-applied presets, by the camera and lens they apply to. the query matching these patterns is the slow
+// part and the same for a whole shoot, the ranges of the exif values are checked per image from the cache.
+typedef struct dt_dev_auto_preset_t
+{
+  gchar *operation, *multi_name;
+  int op_version, enabled, blendop_version, multi_priority, format;
+  void *op_params, *blendop_params;
+  int op_params_size, blendop_params_size;
+  double iso_min, iso_max, exposure_min, exposure_max, aperture_min, aperture_max, focal_length_min,
+      focal_length_max;
+} dt_dev_auto_preset_t;
+
+// cameras and lenses of a session, dropped all at once beyond this
+#define DT_DEV_AUTO_PRESETS_CACHE_SIZE 64
+
+static struct
+{
+  GMutex lock;
+  GHashTable *matches; // key of the camera and lens -> GPtrArray of dt_dev_auto_preset_t in the order to apply
+  int version;         // of memory.presets_version the matches were read at
+} _auto_presets;
+
+static void _auto_preset_free(gpointer data)
+{
+  dt_dev_auto_preset_t *p = (dt_dev_auto_preset_t *)data;
+  g_free(p->operation);
+  g_free(p->multi_name);
+  g_free(p->op_params);
+  g_free(p->blendop_params);
+  g_free(p);
+}
+
+// a NULL bound matches nothing, as in the query
+static inline double _auto_preset_bound(sqlite3_stmt *stmt, const int column)
+{
+  return sqlite3_column_type(stmt, column) == SQLITE_NULL ? NAN : sqlite3_column_double(stmt, column);
+}
+
+static GPtrArray *_auto_presets_read(const char *table, const dt_image_t *image)
+{
+  GPtrArray *presets = g_ptr_array_new_with_free_func(_auto_preset_free);
+  char query[1024];
+  snprintf(query, sizeof(query),
+           "SELECT operation, op_version, op_params, enabled, blendop_params, blendop_version, multi_priority,"
+           "       multi_name, format, iso_min, iso_max, exposure_min, exposure_max, aperture_min, aperture_max,"
+           "       focal_length_min, focal_length_max"
+           " FROM %s"
+           " WHERE autoapply=1 AND ((?1 LIKE model AND ?2 LIKE maker) OR (?3 LIKE model AND ?4 LIKE maker))"
+           "       AND ?5 LIKE lens"
+           "       AND operation NOT IN ('modulelist', 'metadata', 'export', 'tagging', 'collect')"
+           " ORDER BY writeprotect DESC, LENGTH(model), LENGTH(maker), LENGTH(lens)",
+           table);
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 1, image->exif_model, -1, SQLITE_TRANSIENT);
+  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 2, image->exif_maker, -1, SQLITE_TRANSIENT);
+  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 3, image->camera_alias, -1, SQLITE_TRANSIENT);
+  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 4, image->camera_maker, -1, SQLITE_TRANSIENT);
+  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 5, image->exif_lens, -1, SQLITE_TRANSIENT);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    dt_dev_auto_preset_t *p = g_malloc0(sizeof(dt_dev_auto_preset_t));
+    p->operation = g_strdup((const char *)sqlite3_column_text(stmt, 0));
+    p->op_version = sqlite3_column_int(stmt, 1);
+    p->op_params_size = sqlite3_column_bytes(stmt, 2);
+    p->op_params = g_memdup(sqlite3_column_blob(stmt, 2), p->op_params_size);
+    p->enabled = sqlite3_column_int(stmt, 3);
+    p->blendop_params_size = sqlite3_column_bytes(stmt, 4);
+    p->blendop_params = g_memdup(sqlite3_column_blob(stmt, 4), p->blendop_params_size);
+    p->blendop_version = sqlite3_column_int(stmt, 5);
+    p->multi_priority = sqlite3_column_int(stmt, 6);
+    p->multi_name = g_strdup((const char *)sqlite3_column_text(stmt, 7));
+    p->format = sqlite3_column_int(stmt, 8);
+    p->iso_min = _auto_preset_bound(stmt, 9);
+    p->iso_max = _auto_preset_bound(stmt, 10);
+    p->exposure_min = _auto_preset_bound(stmt, 11);
+    p->exposure_max = _auto_preset_bound(stmt, 12);
+    p->aperture_min = _auto_preset_bound(stmt, 13);
+    p->aperture_max = _auto_preset_bound(stmt, 14);
+    p->focal_length_min = _auto_preset_bound(stmt, 15);
+    p->focal_length_max = _auto_preset_bound(stmt, 16);
+    g_ptr_array_add(presets, p);
+  }
+  sqlite3_finalize(stmt);
+  return presets;
+}
+
+/** the auto-applied presets of table whose camera and lens match image, to be unref'ed. */
+static GPtrArray *_auto_presets_get(const char *table, const dt_image_t *image)
+{
+  int version = 0;
+  sqlite3_stmt *stmt;
+  dt_database_prepare_cached(darktable.db, "SELECT version FROM memory.presets_version", &stmt);
+  if(sqlite3_step(stmt) == SQLITE_ROW) version = sqlite3_column_int(stmt, 0);
+  dt_database_release_cached(darktable.db, stmt);
+
+  gchar *key = g_strjoin("\x1f", table, image->exif_model, image->exif_maker, image->camera_alias,
+                         image->camera_maker, image->exif_lens, NULL);
+
+  g_mutex_lock(&_auto_presets.lock);
+  if(!_auto_presets.matches)
+    _auto_presets.matches
+        = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)g_ptr_array_unref);
+  if(version != _auto_presets.version
+     || g_hash_table_size(_auto_presets.matches) >= DT_DEV_AUTO_PRESETS_CACHE_SIZE)
+  {
+    g_hash_table_remove_all(_auto_presets.matches);
+    _auto_presets.version = version;
+  }
+  GPtrArray *presets = g_hash_table_lookup(_auto_presets.matches, key);
+  if(presets)
+  {
+    g_ptr_array_ref(presets);
+    g_free(key);
+  }
+  else
+  {
+    presets = _auto_presets_read(table, image);
+    g_hash_table_insert(_auto_presets.matches, key, g_ptr_array_ref(presets));
+  }
+  g_mutex_unlock(&_auto_presets.lock);
+  return presets;
+}
+
+static gboolean _auto_preset_matches(const dt_dev_auto_preset_t *p, const dt_image_t *image, const int format)
+{
+  // as bound to the query before
+  const double iso = fmaxf(0.0f, fminf(FLT_MAX, image->exif_iso));
+  const double exposure = fmaxf(0.0f, fminf(1000000, image->exif_exposure));
+  const double aperture = fmaxf(0.0f, fminf(1000000, image->exif_aperture));
+  const double focal_length = fmaxf(0.0f, fminf(1000000, image->exif_focal_length));
+  return iso >= p->iso_min && iso <= p->iso_max
+         && exposure >= p->exposure_min && exposure <= p->exposure_max
+         && aperture >= p->aperture_min && aperture <= p->aperture_max
+         && focal_length >= p->focal_length_min && focal_length <= p->focal_length_max
+         && (p->format == 0 || (p->format & format) != 0);
+}
+
 static gboolean _dev_auto_apply_presets(dt_develop_t *dev)
 {
   // NOTE: the presets/default iops will be *prepended* into the history.
@@ -1443,79 +1694,47 @@ static gboolean _dev_auto_apply_presets(dt_develop_t *dev)
   // this is appended to possibly already present default modules.
   const char *preset_table[2] = { "data.presets", "main.legacy_presets" };
   const int legacy = (image->flags & DT_IMAGE_NO_LEGACY_PRESETS) ? 0 : 1;
-  char query[1024];
-  snprintf(query, sizeof(query),
-           "INSERT INTO memory.history"
-           " SELECT ?1, 0, op_version, operation, op_params,"
-           "       enabled, blendop_params, blendop_version, multi_priority, multi_name"
-           " FROM %s"
-           " WHERE autoapply=1 AND ((?2 LIKE model AND ?3 LIKE maker) OR (?4 LIKE model AND ?5 LIKE maker))"
-           "       AND ?6 LIKE lens AND ?7 BETWEEN iso_min AND iso_max"
-           "       AND ?8 BETWEEN exposure_min AND exposure_max"
-           "       AND ?9 BETWEEN aperture_min AND aperture_max"
-           "       AND ?10 BETWEEN focal_length_min AND focal_length_max"
-           "       AND (format = 0 OR format&?11!=0)"
-           "       AND operation NOT IN ('ioporder', 'modulelist', 'metadata', 'export', 'tagging', 'collect')"
-           " ORDER BY writeprotect DESC, LENGTH(model), LENGTH(maker), LENGTH(lens)",
-           preset_table[legacy]);
-  // query for all modules at once:
-  sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
-  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 2, image->exif_model, -1, SQLITE_TRANSIENT);
-  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 3, image->exif_maker, -1, SQLITE_TRANSIENT);
-  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 4, image->camera_alias, -1, SQLITE_TRANSIENT);
-  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 5, image->camera_maker, -1, SQLITE_TRANSIENT);
-  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 6, image->exif_lens, -1, SQLITE_TRANSIENT);
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 7, fmaxf(0.0f, fminf(FLT_MAX, image->exif_iso)));
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 8, fmaxf(0.0f, fminf(1000000, image->exif_exposure)));
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 9, fmaxf(0.0f, fminf(1000000, image->exif_aperture)));
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 10, fmaxf(0.0f, fminf(1000000, image->exif_focal_length)));
   // 0: dontcare, 1: ldr, 2: raw
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 11,
-                               dt_image_is_ldr(image) ? FOR_LDR : (dt_image_is_raw(image) ? FOR_RAW : FOR_HDR));
-  sqlite3_step(stmt);
+  const int format = dt_image_is_ldr(image) ? FOR_LDR : (dt_image_is_raw(image) ? FOR_RAW : FOR_HDR);
+  GPtrArray *presets = _auto_presets_get(preset_table[legacy], image);
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "INSERT INTO memory.history"
+                              " VALUES (?1, 0, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9)",
+                              -1, &stmt, NULL);
+  for(guint k = 0; k < presets->len; k++)
+  {
+    const dt_dev_auto_preset_t *p = (dt_dev_auto_preset_t *)g_ptr_array_index(presets, k);
+    if(!strcmp(p->operation, "ioporder") || !_auto_preset_matches(p, image, format)) continue;
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, p->op_version);
+    DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 3, p->operation, -1, SQLITE_STATIC);
+    DT_DEBUG_SQLITE3_BIND_BLOB(stmt, 4, p->op_params, p->op_params_size, SQLITE_STATIC);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 5, p->enabled);
+    DT_DEBUG_SQLITE3_BIND_BLOB(stmt, 6, p->blendop_params, p->blendop_params_size, SQLITE_STATIC);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 7, p->blendop_version);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 8, p->multi_priority);
+    DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 9, p->multi_name, -1, SQLITE_STATIC);
+    sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+  }
   sqlite3_finalize(stmt);
+  g_ptr_array_unref(presets);
 
   // now we want to auto-apply the iop-order list if one corresponds
-
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT op_params"
-                              " FROM data.presets"
-                              " WHERE autoapply=1"
-                              "       AND ((?2 LIKE model AND ?3 LIKE maker) OR (?4 LIKE model AND ?5 LIKE maker))"
-                              "       AND ?6 LIKE lens AND ?7 BETWEEN iso_min AND iso_max"
-                              "       AND ?8 BETWEEN exposure_min AND exposure_max"
-                              "       AND ?9 BETWEEN aperture_min AND aperture_max"
-                              "       AND ?10 BETWEEN focal_length_min AND focal_length_max"
-                              "       AND (format = 0 OR format&?11!=0)"
-                              "       AND operation = 'ioporder'"
-                              " ORDER BY writeprotect DESC, LENGTH(model), LENGTH(maker), LENGTH(lens)",
-                              -1, &stmt, NULL);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
-  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 2, image->exif_model, -1, SQLITE_TRANSIENT);
-  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 3, image->exif_maker, -1, SQLITE_TRANSIENT);
-  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 4, image->camera_alias, -1, SQLITE_TRANSIENT);
-  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 5, image->camera_maker, -1, SQLITE_TRANSIENT);
-  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 6, image->exif_lens, -1, SQLITE_TRANSIENT);
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 7, fmaxf(0.0f, fminf(FLT_MAX, image->exif_iso)));
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 8, fmaxf(0.0f, fminf(1000000, image->exif_exposure)));
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 9, fmaxf(0.0f, fminf(1000000, image->exif_aperture)));
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 10, fmaxf(0.0f, fminf(1000000, image->exif_focal_length)));
-  // 0: dontcare, 1: ldr, 2: raw
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(stmt, 11,
-                               dt_image_is_ldr(image) ? FOR_LDR : (dt_image_is_raw(image) ? FOR_RAW : FOR_HDR));
-  if(sqlite3_step(stmt) == SQLITE_ROW)
+  presets = _auto_presets_get(preset_table[0], image);
+  for(guint k = 0; k < presets->len; k++)
   {
-    const char *params = (char *)sqlite3_column_blob(stmt, 0);
-    const int32_t params_len = sqlite3_column_bytes(stmt, 0);
-    GList *iop_list = dt_ioppr_deserialize_iop_order_list(params, params_len);
+    const dt_dev_auto_preset_t *p = (dt_dev_auto_preset_t *)g_ptr_array_index(presets, k);
+    if(strcmp(p->operation, "ioporder") || !_auto_preset_matches(p, image, format)) continue;
+    GList *iop_list = dt_ioppr_deserialize_iop_order_list(p->op_params, p->op_params_size);
     dt_ioppr_write_iop_order_list(iop_list, imgid);
     g_list_free_full(iop_list, free);
     dt_ioppr_set_default_iop_order(dev, imgid);
+    break;
   }
-
-  sqlite3_finalize(stmt);
+  g_ptr_array_unref(presets);
 
   image->flags |= DT_IMAGE_AUTO_PRESETS_APPLIED | DT_IMAGE_NO_LEGACY_PRESETS;
 
@@ -1591,7 +1810,7 @@ static void _dev_merge_history(dt_develop_t *dev, const int imgid)
                                   "UPDATE memory.history SET num=?1 WHERE rowid=?2", -1, &stmt, NULL);
 
       // let's wrap this into a transaction, it might make it a little faster.
-      sqlite3_exec(dt_database_get(darktable.db), "BEGIN TRANSACTION", NULL, NULL, NULL);
+      dt_database_start_transaction(darktable.db);
       for(GList *r = rowids; r; r = g_list_next(r))
       {
         DT_DEBUG_SQLITE3_CLEAR_BINDINGS(stmt);
@@ -1604,7 +1823,7 @@ static void _dev_merge_history(dt_develop_t *dev, const int imgid)
         v++;
       }
 
-      sqlite3_exec(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+      dt_database_release_transaction(darktable.db);
 
       g_list_free(rowids);
     }
@@ -1676,6 +1895,12 @@ void dt_dev_read_history_ext(dt_develop_t *dev, const int imgid, gboolean no_ima
   gboolean first_run = FALSE;
   if(!no_image)
   {
+    // a history written without darkroom, e.g. by dt_lightroom_import_batch(), is not imported over again
+    DT_DEBUG_SQLITE3_PREPARE_CACHED(darktable.db, "SELECT 1 FROM main.history WHERE imgid = ?1 LIMIT 1", &stmt);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+    const gboolean had_history = sqlite3_step(stmt) == SQLITE_ROW;
+    DT_DEBUG_SQLITE3_RELEASE_CACHED(darktable.db, stmt);
+
     // cleanup
     DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "DELETE FROM memory.history", NULL, NULL, NULL);
 
@@ -1690,28 +1915,27 @@ void dt_dev_read_history_ext(dt_develop_t *dev, const int imgid, gboolean no_ima
     _dev_merge_history(dev, imgid);
 
     //  first time we are loading the image, try to import lightroom .xmp if any
-    if(dev->image_loading && first_run) dt_lightroom_import(dev->image_storage.id, dev, TRUE);
+    if(dev->image_loading && first_run && !had_history) dt_lightroom_import(dev->image_storage.id, dev, TRUE);
   }
 
   gboolean legacy_params = FALSE;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT history_end FROM main.images WHERE id = ?1",
-                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_PREPARE_CACHED(darktable.db, "SELECT history_end FROM main.images WHERE id = ?1", &stmt);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
   if(sqlite3_step(stmt) == SQLITE_ROW) // seriously, this should never fail
   {
     if(sqlite3_column_type(stmt, 0) != SQLITE_NULL)
       history_end_current = sqlite3_column_int(stmt, 0);
   }
-  sqlite3_finalize(stmt);
+  DT_DEBUG_SQLITE3_RELEASE_CACHED(darktable.db, stmt);
 
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT imgid, num, module, operation,"
-                              "       op_params, enabled, blendop_params,"
-                              "       blendop_version, multi_priority, multi_name"
-                              " FROM main.history"
-                              " WHERE imgid = ?1"
-                              " ORDER BY num",
-                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_PREPARE_CACHED(darktable.db,
+                                  "SELECT imgid, num, module, operation,"
+                                  "       op_params, enabled, blendop_params,"
+                                  "       blendop_version, multi_priority, multi_name"
+                                  " FROM main.history"
+                                  " WHERE imgid = ?1"
+                                  " ORDER BY num",
+                                  &stmt);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
   dev->history_end = 0;
   while(sqlite3_step(stmt) == SQLITE_ROW)
@@ -1878,19 +2102,18 @@ void dt_dev_read_history_ext(dt_develop_t *dev, const int imgid, gboolean no_ima
     dev->history = g_list_append(dev->history, hist);
     dev->history_end++;
   }
-  sqlite3_finalize(stmt);
+  DT_DEBUG_SQLITE3_RELEASE_CACHED(darktable.db, stmt);
 
   dt_ioppr_resync_modules_order(dev);
 
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), "SELECT history_end FROM main.images WHERE id = ?1",
-                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_PREPARE_CACHED(darktable.db, "SELECT history_end FROM main.images WHERE id = ?1", &stmt);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
   if(sqlite3_step(stmt) == SQLITE_ROW) // seriously, this should never fail
   {
     if(sqlite3_column_type(stmt, 0) != SQLITE_NULL)
       dev->history_end = sqlite3_column_int(stmt, 0);
   }
-  sqlite3_finalize(stmt);
+  DT_DEBUG_SQLITE3_RELEASE_CACHED(darktable.db, stmt);
 
   dt_ioppr_check_iop_order(dev, imgid, "dt_dev_read_history_no_image end");
 
@@ -1983,6 +2206,18 @@ void dt_dev_reprocess_center(dt_develop_t *dev)
   }
 }
 
+void dt_dev_reprocess_display(dt_develop_t *dev)
+{
+  if(darktable.gui->reset) return;
+  if(dev && dev->gui_attached)
+  {
+    // the indicators are drawn by the display encoding, the cached output of the modules before it stays valid
+    dev->pipe->changed |= DT_DEV_PIPE_SYNCH;
+    dt_dev_invalidate(dev);
+    dt_control_queue_redraw_center();
+  }
+}
+
 
 void dt_dev_check_zoom_bounds(dt_develop_t *dev, float *zoom_x, float *zoom_y, dt_dev_zoom_t zoom,
                               int closeup, float *boxww, float *boxhh)
@@ -2211,30 +2446,103 @@ void dt_dev_modulegroups_search_text_focus(dt_develop_t *dev)
     dev->proxy.modulegroups.search_text_focus(dev->proxy.modulegroups.module);
 }
 
+static void _dev_masks_list_pending(dt_develop_t *dev)
+{
+  if(!dev->masks_list_pending) return;
+  dev->masks_list_pending = FALSE;
+  if(dev->proxy.masks.module && dev->proxy.masks.list_change)
+    dev->proxy.masks.list_change(dev->proxy.masks.module);
+}
+
+static gboolean _dev_gui_lazy_idle(gpointer user_data)
+{
+  dt_develop_t *dev = (dt_develop_t *)user_data;
+
+  _dev_masks_list_pending(dev);
+
+  // one module per call, so that the gui stays responsive meanwhile
+  for(GList *modules = dev->iop; modules; modules = g_list_next(modules))
+    if(dt_iop_gui_update_pending((dt_iop_module_t *)modules->data)) return G_SOURCE_CONTINUE;
+
+  dev->gui_lazy_source = 0;
+  return G_SOURCE_REMOVE;
+}
+
+void dt_dev_gui_lazy_begin(dt_develop_t *dev)
+{
+  dev->gui_lazy = 1;
+}
+
+void dt_dev_gui_lazy_end(dt_develop_t *dev)
+{
+  dev->gui_lazy = 0;
+  // below the priority of redraws, the expose of the center view starts the pipes
+  if(!dev->gui_lazy_source)
+    dev->gui_lazy_source = g_idle_add_full(G_PRIORITY_LOW, _dev_gui_lazy_idle, dev, NULL);
+}
+
+void dt_dev_gui_lazy_flush(dt_develop_t *dev, gboolean drop)
+{
+  if(dev->gui_lazy_source)
+  {
+    g_source_remove(dev->gui_lazy_source);
+    dev->gui_lazy_source = 0;
+  }
+  if(drop)
+  {
+    for(GList *modules = dev->iop; modules; modules = g_list_next(modules))
+      ((dt_iop_module_t *)modules->data)->gui_pending = FALSE;
+    dev->masks_list_pending = FALSE;
+    return;
+  }
+  while(_dev_gui_lazy_idle(dev) == G_SOURCE_CONTINUE)
+    ;
+}
+
 void dt_dev_masks_list_change(dt_develop_t *dev)
 {
+  // the mask manager is rebuilt a few times while the darkroom changes images, once afterwards is enough
+  if(dev->gui_lazy)
+  {
+    dev->masks_list_pending = TRUE;
+    return;
+  }
+  dev->masks_list_pending = FALSE;
   if(dev->proxy.masks.module && dev->proxy.masks.list_change)
     dev->proxy.masks.list_change(dev->proxy.masks.module);
 }
 void dt_dev_masks_list_update(dt_develop_t *dev)
 {
+  // a list which is still to be rebuilt shows the current forms once it is
+  if(dev->masks_list_pending)
+  {
+    if(!dev->gui_lazy) _dev_masks_list_pending(dev);
+    return;
+  }
   if(dev->proxy.masks.module && dev->proxy.masks.list_update)
     dev->proxy.masks.list_update(dev->proxy.masks.module);
 }
 void dt_dev_masks_list_remove(dt_develop_t *dev, int formid, int parentid)
 {
+  if(dev->masks_list_pending)
+  {
+    if(!dev->gui_lazy) _dev_masks_list_pending(dev);
+    return;
+  }
   if(dev->proxy.masks.module && dev->proxy.masks.list_remove)
     dev->proxy.masks.list_remove(dev->proxy.masks.module, formid, parentid);
 }
 void dt_dev_masks_selection_change(dt_develop_t *dev, int selectid, int throw_event)
 {
+  if(dev->gui_lazy && dev->masks_list_pending) return;
+  _dev_masks_list_pending(dev);
   if(dev->proxy.masks.module && dev->proxy.masks.selection_change)
     dev->proxy.masks.selection_change(dev->proxy.masks.module, selectid, throw_event);
 }
 
-void dt_dev_snapshot_request(dt_develop_t *dev, const char *filename)
+void dt_dev_snapshot_request(dt_develop_t *dev, cairo_surface_t **surface)
 {
-  dev->proxy.snapshot.filename = filename;
+  dev->proxy.snapshot.surface = surface;
   dev->proxy.snapshot.request = TRUE;
   dt_control_queue_redraw_center();
 }
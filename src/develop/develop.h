@@ -147,6 +147,9 @@ typedef struct dt_develop_t
                         // gui_init'ed.
   int32_t gui_leaving;  // set if everything is scheduled to shut down.
   int32_t gui_synch;    // set by the render threads if gui_update should be called in the modules.
+  int32_t gui_lazy;     // set while the darkroom changes images, see dt_dev_gui_lazy_end().
+  guint gui_lazy_source;
+  gboolean masks_list_pending;
   int32_t focus_hash;   // determines whether to start a new history item or to merge down.
   gboolean preview_loading, preview2_loading, image_loading, history_updating, image_force_reload, first_load;
   gboolean preview_input_changed, preview2_input_changed;
@@ -201,6 +204,8 @@ typedef struct dt_develop_t
   uint32_t histogram_waveform_width, histogram_waveform_height, histogram_waveform_stride;
   dt_dev_scope_type_t scope_type;
   dt_dev_histogram_type_t histogram_type;
+  // what the scopes were last computed from, see _pixelpipe_scopes_hash()
+  uint64_t scope_hash;
 
   // list of forms iop can use for masks or whatever
   GList *forms;
@@ -249,9 +254,9 @@ typedef struct dt_develop_t
     struct
     {
       // this flag is set by snapshot plugin to signal that expose of darkroom
-      // should store cairo surface as snapshot to disk using filename.
+      // should keep a copy of its cairo surface as snapshot in surface.
       gboolean request;
-      const gchar *filename;
+      cairo_surface_t **surface;
     } snapshot;
 
     // masks plugin hooks
@@ -335,6 +340,17 @@ typedef struct dt_develop_t
     double button_y;
   } second_window;
 
+  // the output of the preview pipe downscaled by its worker for the navigation, which asks for the size.
+  // guarded by the backbuf_mutex of the preview pipe.
+  struct
+  {
+    uint8_t *buf;               // cairo RGB24
+    int width, height;
+    int max_width, max_height;  // size asked for, in pixels
+    uint64_t hash;              // backbuf_hash of the preview output it was made from
+    int imgid;
+  } preview_thumb;
+
   int mask_form_selected_id; // select a mask inside an iop
   gboolean darkroom_skip_mouse_events; // skip mouse events for masks
 } dt_develop_t;
@@ -376,6 +392,8 @@ void dt_dev_set_histogram_pre(dt_develop_t *dev);
 void dt_dev_get_history_item_label(dt_dev_history_item_t *hist, char *label, const int cnt);
 void dt_dev_reprocess_all(dt_develop_t *dev);
 void dt_dev_reprocess_center(dt_develop_t *dev);
+// for a change of the overexposure indicators, which only the last module of the center view depends on
+void dt_dev_reprocess_display(dt_develop_t *dev);
 
 void dt_dev_get_processed_size(const dt_develop_t *dev, int *procw, int *proch);
 void dt_dev_check_zoom_bounds(dt_develop_t *dev, float *zoom_x, float *zoom_y, dt_dev_zoom_t zoom,
@@ -427,12 +445,20 @@ gboolean dt_dev_modulegroups_test(dt_develop_t *dev, uint32_t group, uint32_t io
 /** reorder the module list */
 void dt_dev_reorder_gui_module_list(dt_develop_t *dev);
 
-/** request snapshot */
-void dt_dev_snapshot_request(dt_develop_t *dev, const char *filename);
+/** request snapshot, a copy of the next drawn center view replaces *surface */
+void dt_dev_snapshot_request(dt_develop_t *dev, cairo_surface_t **surface);
 
 /** update gliding average for pixelpipe delay */
 void dt_dev_average_delay_update(const dt_times_t *start, uint32_t *average_delay);
 
+/** the darkroom is about to change images: widgets which are not visible are left alone from now on. */
+void dt_dev_gui_lazy_begin(dt_develop_t *dev);
+/** the new image is set up, the widgets left alone are updated from an idle callback, which runs after the
+ * center view has been exposed and the pipes are processing. */
+void dt_dev_gui_lazy_end(dt_develop_t *dev);
+/** updates whatever is left right away, or drops it when the darkroom is left. */
+void dt_dev_gui_lazy_flush(dt_develop_t *dev, gboolean drop);
+
 /*
  * masks plugin hooks
  */
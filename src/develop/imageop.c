@@ -50,6 +50,7 @@
 #include <assert.h>
 #include <gmodule.h>
 #include <math.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
@@ -179,6 +180,11 @@ static void default_process(struct dt_iop_module_t *self, struct dt_dev_pixelpip
 {
   if(darktable.codepath.OPENMP_SIMD && self->process_plain)
     self->process_plain(self, piece, i, o, roi_in, roi_out);
+  // only loaded when the cpu has them
+  else if(self->process_avx512)
+    self->process_avx512(self, piece, i, o, roi_in, roi_out);
+  else if(self->process_avx2)
+    self->process_avx2(self, piece, i, o, roi_in, roi_out);
 #if defined(__SSE__)
   else if(darktable.codepath.SSE2 && self->process_sse2)
     self->process_sse2(self, piece, i, o, roi_in, roi_out);
@@ -382,6 +388,23 @@ int dt_iop_load_module_so(void *m, const char *libname, const char *op)
 
   if(!g_module_symbol(module->module, "process_sse2", (gpointer) & (module->process_sse2)))
     module->process_sse2 = NULL;
+  // the wider kernels are picked once here, the cpu won't change
+  if(!darktable.codepath.AVX2 || !g_module_symbol(module->module, "process_avx2", (gpointer) & (module->process_avx2)))
+    module->process_avx2 = NULL;
+  if(!darktable.codepath.AVX512
+     || !g_module_symbol(module->module, "process_avx512", (gpointer) & (module->process_avx512)))
+    module->process_avx512 = NULL;
+  if(!g_module_symbol(module->module, "process_pointwise", (gpointer) & (module->process_pointwise)))
+    module->process_pointwise = NULL;
+  if(!g_module_symbol(module->module, "process_pointwise_prepare",
+                      (gpointer) & (module->process_pointwise_prepare)))
+    module->process_pointwise_prepare = NULL;
+  if(!g_module_symbol(module->module, "process_rows", (gpointer) & (module->process_rows)))
+    module->process_rows = NULL;
+  if(!g_module_symbol(module->module, "process_rows_border", (gpointer) & (module->process_rows_border)))
+    module->process_rows_border = NULL;
+  if(!g_module_symbol(module->module, "process_rows_prepare", (gpointer) & (module->process_rows_prepare)))
+    module->process_rows_prepare = NULL;
 
   if(!g_module_symbol(module->module, "process", (gpointer) & (module->process_plain))) goto error;
 
@@ -401,6 +424,8 @@ int dt_iop_load_module_so(void *m, const char *libname, const char *op)
     module->modify_roi_in = dt_iop_modify_roi_in;
   if(!g_module_symbol(module->module, "modify_roi_out", (gpointer) & (module->modify_roi_out)))
     module->modify_roi_out = dt_iop_modify_roi_out;
+  if(!g_module_symbol(module->module, "invert_roi_in", (gpointer) & (module->invert_roi_in)))
+    module->invert_roi_in = NULL;
   if(!g_module_symbol(module->module, "legacy_params", (gpointer) & (module->legacy_params)))
     module->legacy_params = NULL;
   // allow to select a shape inside an iop
@@ -433,7 +458,8 @@ int dt_iop_load_module_so(void *m, const char *libname, const char *op)
       fprintf(stderr, "[iop_load_module] failed to initialize introspection for operation `%s'\n", op);
   }
 
-  if(module->init_global) module->init_global(module);
+  // init_global() waits until the module is first used, many of them create OpenCL kernels there
+  module->global_inited = 0;
   return 0;
 error:
   fprintf(stderr, "[iop_load_module] failed to open operation `%s': %s\n", op, g_module_error());
@@ -441,6 +467,15 @@ error:
   return 1;
 }
 
+void dt_iop_init_global(dt_iop_module_so_t *module)
+{
+  if(g_once_init_enter(&module->global_inited))
+  {
+    if(module->init_global) module->init_global(module);
+    g_once_init_leave(&module->global_inited, 1);
+  }
+}
+
 int dt_iop_load_module_by_so(dt_iop_module_t *module, dt_iop_module_so_t *so, dt_develop_t *dev)
 {
   module->dt = &darktable;
@@ -525,6 +560,13 @@ int dt_iop_load_module_by_so(dt_iop_module_t *module, dt_iop_module_so_t *so, dt
   module->process_tiling = so->process_tiling;
   module->process_plain = so->process_plain;
   module->process_sse2 = so->process_sse2;
+  module->process_avx2 = so->process_avx2;
+  module->process_avx512 = so->process_avx512;
+  module->process_pointwise = so->process_pointwise;
+  module->process_pointwise_prepare = so->process_pointwise_prepare;
+  module->process_rows = so->process_rows;
+  module->process_rows_border = so->process_rows_border;
+  module->process_rows_prepare = so->process_rows_prepare;
   module->process_cl = so->process_cl;
   module->process_tiling_cl = so->process_tiling_cl;
   module->distort_transform = so->distort_transform;
@@ -532,6 +574,7 @@ int dt_iop_load_module_by_so(dt_iop_module_t *module, dt_iop_module_so_t *so, dt
   module->distort_mask = so->distort_mask;
   module->modify_roi_in = so->modify_roi_in;
   module->modify_roi_out = so->modify_roi_out;
+  module->invert_roi_in = so->invert_roi_in;
   module->legacy_params = so->legacy_params;
   // allow to select a shape inside an iop
   module->masks_selection_changed = so->masks_selection_changed;
@@ -568,6 +611,8 @@ int dt_iop_load_module_by_so(dt_iop_module_t *module, dt_iop_module_so_t *so, dt
     dt_iop_gui_set_state(module, state);
   }
 
+  // the gui may use the global data anywhere, pipes only once a piece is enabled
+  if(dev && dev->gui_attached) dt_iop_init_global(so);
   module->global_data = so->data;
 
   // now init the instance:
@@ -1620,7 +1665,7 @@ void dt_iop_unload_modules_so()
   while(darktable.iop)
   {
     dt_iop_module_so_t *module = (dt_iop_module_so_t *)darktable.iop->data;
-    if(module->cleanup_global) module->cleanup_global(module);
+    if(module->cleanup_global && module->global_inited) module->cleanup_global(module);
     if(module->module) g_module_close(module->module);
     free(darktable.iop->data);
     darktable.iop = g_list_delete_link(darktable.iop, darktable.iop);
@@ -1673,14 +1718,38 @@ void dt_iop_commit_blend_params(dt_iop_module_t *module, const dt_develop_blend_
   module->raster_mask.sink.id = 0;
 }
 
+// the params handed to commit_params() together with the blend params, the masks and the state of the pipe it
+// may look at. piece->hash has the params of the module, which a synch of the history may not pass on
+static uint64_t _iop_commit_hash(const dt_iop_module_t *module, const dt_iop_params_t *params,
+                                 const dt_dev_pixelpipe_t *pipe, const dt_dev_pixelpipe_iop_t *piece)
+{
+  const int32_t context[] = { pipe->type,
+                              pipe->image.id,
+                              pipe->iwidth,
+                              pipe->iheight,
+                              pipe->dsc.filters,
+                              pipe->dsc.channels,
+                              pipe->dsc.datatype,
+                              module->request_histogram,
+                              module->dev->gui_attached };
+  uint64_t hash = dt_dev_pixelpipe_cache_hash_data(piece->hash, params, module->params_size);
+  hash = dt_dev_pixelpipe_cache_hash_data(hash, context, sizeof(context));
+  return dt_dev_pixelpipe_cache_hash_data(hash, &pipe->iscale, sizeof(pipe->iscale));
+}
+
 void dt_iop_commit_params(dt_iop_module_t *module, dt_iop_params_t *params,
                           dt_develop_blend_params_t *blendop_params, dt_dev_pixelpipe_t *pipe,
                           dt_dev_pixelpipe_iop_t *piece)
 {
   piece->hash = 0;
+  piece->params_hash = 0;
+  piece->mask_hash = 0;
 
   if(piece->enabled)
   {
+    dt_iop_init_global(module->so);
+    module->global_data = module->so->data;
+
     /* construct module params data for hash calc */
     int length = module->params_size;
     if(module->flags() & IOP_FLAGS_SUPPORTS_BLENDING) length += sizeof(dt_develop_blend_params_t);
@@ -1703,16 +1772,36 @@ void dt_iop_commit_params(dt_iop_module_t *module, dt_iop_params_t *params,
     /* and we add masks */
     dt_masks_group_get_hash_buffer(grp, str + pos);
 
-    // assume process_cl is ready, commit_params can overwrite this.
-    if(module->process_cl) piece->process_cl_ready = 1;
+    piece->params_hash = dt_dev_pixelpipe_cache_hash_data(0, str, pos);
+    piece->hash = dt_dev_pixelpipe_cache_hash_data(piece->params_hash, str + pos, length - pos);
+
+    // the same params in the same pipe give the same data, which is still there from the last commit
+    // unless the last commit asked for another one
+    const uint64_t commit_hash = _iop_commit_hash(module, params, pipe, piece);
+    if(commit_hash != piece->commit_hash || piece->commit_again || (module->flags() & IOP_FLAGS_VOLATILE_COMMIT))
+    {
+      piece->commit_again = 0;
+
+      // assume process_cl is ready, commit_params can overwrite this.
+      if(module->process_cl) piece->process_cl_ready = 1;
 
-    // register if module allows tiling, commit_params can overwrite this.
-    if(module->flags() & IOP_FLAGS_ALLOW_TILING) piece->process_tiling_ready = 1;
+      // register if module allows tiling, commit_params can overwrite this.
+      if(module->flags() & IOP_FLAGS_ALLOW_TILING) piece->process_tiling_ready = 1;
 
-    module->commit_params(module, params, pipe, piece);
-    uint64_t hash = 5381;
-    for(int i = 0; i < length; i++) hash = ((hash << 5) + hash) ^ str[i];
-    piece->hash = hash;
+      module->commit_params(module, params, pipe, piece);
+      piece->commit_hash = commit_hash;
+      piece->commit_enabled = piece->enabled;
+    }
+    else
+      piece->enabled = piece->commit_enabled;
+
+    /* the blend mask doesn't depend on the blend mode, see dt_develop_blend_process() */
+    if(module->flags() & IOP_FLAGS_SUPPORTS_BLENDING)
+    {
+      char *blend = str + module->params_size;
+      memset(blend + offsetof(dt_develop_blend_params_t, blend_mode), 0, sizeof(uint32_t));
+    }
+    piece->mask_hash = dt_dev_pixelpipe_cache_hash_data(0, str, length);
 
     free(str);
   }
@@ -1733,8 +1822,13 @@ void dt_iop_gui_update(dt_iop_module_t *module)
     ++darktable.gui->reset;
     if(!dt_iop_is_hidden(module))
     {
-      if(module->params) module->gui_update(module);
-      dt_iop_gui_update_blending(module);
+      // nobody sees the widgets of a collapsed module, they can wait until the new image is on screen
+      module->gui_pending = module->dev->gui_lazy && !module->expanded && module->dev->gui_module != module;
+      if(!module->gui_pending)
+      {
+        if(module->params) module->gui_update(module);
+        dt_iop_gui_update_blending(module);
+      }
       dt_iop_gui_update_expanded(module);
       _iop_gui_update_label(module);
       dt_iop_gui_set_enable_button(module);
@@ -1743,6 +1837,19 @@ void dt_iop_gui_update(dt_iop_module_t *module)
   }
 }
 
+gboolean dt_iop_gui_update_pending(dt_iop_module_t *module)
+{
+  if(!module->gui_pending) return FALSE;
+  module->gui_pending = FALSE;
+  if(!module->gui_data || dt_iop_is_hidden(module)) return FALSE;
+
+  ++darktable.gui->reset;
+  if(module->params) module->gui_update(module);
+  dt_iop_gui_update_blending(module);
+  --darktable.gui->reset;
+  return TRUE;
+}
+
 void dt_iop_gui_reset(dt_iop_module_t *module)
 {
   ++darktable.gui->reset;
@@ -1856,6 +1963,8 @@ void dt_iop_request_focus(dt_iop_module_t *module)
   /* set the focus on module */
   if(module)
   {
+    dt_iop_gui_update_pending(module);
+
     gtk_widget_set_state_flags(dt_iop_gui_get_pluginui(module), GTK_STATE_FLAG_SELECTED, TRUE);
 
     if(module->operation_tags_filter()) dt_dev_invalidate_from_gui(darktable.develop);
@@ -1900,6 +2009,8 @@ static void dt_iop_gui_set_single_expanded(dt_iop_module_t *module, gboolean exp
   /* show / hide plugin widget */
   if(expanded)
   {
+    dt_iop_gui_update_pending(module);
+
     /* set this module to receive focus / draw events*/
     dt_iop_request_focus(module);
 
@@ -2524,6 +2635,11 @@ gboolean dt_iop_is_raster_mask_used(dt_iop_module_t *module, int id)
   return FALSE;
 }
 
+gboolean dt_iop_is_distorting(const dt_iop_module_t *module)
+{
+  return module->distort_transform != default_distort_transform;
+}
+
 dt_iop_module_t *dt_iop_get_module_by_op_priority(GList *modules, const char *operation, const int multi_priority)
 {
   dt_iop_module_t *mod_ret = NULL;
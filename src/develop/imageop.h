@@ -99,7 +99,12 @@ typedef enum dt_iop_flags_t
   IOP_FLAGS_NO_HISTORY_STACK   = 1 << 9,  // This iop will never show up in the history stack
   IOP_FLAGS_NO_MASKS           = 1 << 10, // The module doesn't support masks (used with SUPPORT_BLENDING)
   IOP_FLAGS_FENCE              = 1 << 11, // No module can be moved pass this one
-  IOP_FLAGS_ALLOW_FAST_PIPE    = 1 << 12  // Module can work with a fast pipe
+  IOP_FLAGS_ALLOW_FAST_PIPE    = 1 << 12, // Module can work with a fast pipe
+  IOP_FLAGS_PIPE_INDEPENDENT   = 1 << 13, // Output does not depend on the pipe type, may be shared between pipes
+  IOP_FLAGS_LOCAL_PARAMS       = 1 << 14, // Params only describe what happens inside the module's shapes
+  IOP_FLAGS_HALF_INPUT         = 1 << 15, // Input may be cached as half floats in the preview pipes
+  IOP_FLAGS_PARALLEL_TILING    = 1 << 16, // process() is reentrant, several tiles may be processed at once
+  IOP_FLAGS_VOLATILE_COMMIT    = 1 << 17  // commit_params() reads more than params and pipe, it runs on every synch
 } dt_iop_flags_t;
 
 /** status of a module*/
@@ -246,6 +251,8 @@ typedef struct dt_iop_module_so_t
                         const struct dt_iop_roi_t *roi_out, struct dt_iop_roi_t *roi_in);
   void (*modify_roi_out)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                          struct dt_iop_roi_t *roi_out, const struct dt_iop_roi_t *roi_in);
+  int (*invert_roi_in)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                       const struct dt_iop_roi_t *roi_in, struct dt_iop_roi_t *roi_out);
   int (*legacy_params)(struct dt_iop_module_t *self, const void *const old_params, const int old_version,
                        void *new_params, const int new_version);
   // allow to select a shape inside an iop
@@ -263,6 +270,20 @@ typedef struct dt_iop_module_so_t
   void (*process_sse2)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                        const void *const i, void *const o, const struct dt_iop_roi_t *const roi_in,
                        const struct dt_iop_roi_t *const roi_out);
+  void (*process_avx2)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                       const void *const i, void *const o, const struct dt_iop_roi_t *const roi_in,
+                       const struct dt_iop_roi_t *const roi_out);
+  void (*process_avx512)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                         const void *const i, void *const o, const struct dt_iop_roi_t *const roi_in,
+                         const struct dt_iop_roi_t *const roi_out);
+  void (*process_pointwise)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                            const float *const in, float *const out, const size_t npixels);
+  void (*process_pointwise_prepare)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece);
+  void (*process_rows)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, const void *const in,
+                       float *const out, const struct dt_iop_roi_t *const roi_in,
+                       const struct dt_iop_roi_t *const roi_out, const int y, const int rows);
+  int (*process_rows_border)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece);
+  void (*process_rows_prepare)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece);
   int (*process_cl)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, const void *const i,
                     void *const o, const struct dt_iop_roi_t *const roi_in,
                     const struct dt_iop_roi_t *const roi_out);
@@ -284,6 +305,9 @@ typedef struct dt_iop_module_so_t
   void *(*get_p)(const void *param, const char *name);
   dt_introspection_field_t *(*get_f)(const char *name);
 
+  /** non-zero once init_global() has run, see dt_iop_init_global(). */
+  gsize global_inited;
+
 } dt_iop_module_so_t;
 
 typedef struct dt_iop_module_t
@@ -374,6 +398,8 @@ typedef struct dt_iop_module_t
   /** expander containing the widget and flag to store expanded state */
   GtkWidget *expander;
   gboolean expanded;
+  /** the widgets of the collapsed module still show older params, see dt_iop_gui_update_pending() */
+  gboolean gui_pending;
   /** reset parameters button */
   GtkWidget *reset_button;
   /** show preset menu button */
@@ -487,6 +513,8 @@ typedef struct dt_iop_module_t
                         const struct dt_iop_roi_t *roi_out, struct dt_iop_roi_t *roi_in);
   void (*modify_roi_out)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                          struct dt_iop_roi_t *roi_out, const struct dt_iop_roi_t *roi_in);
+  int (*invert_roi_in)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                       const struct dt_iop_roi_t *roi_in, struct dt_iop_roi_t *roi_out);
   int (*legacy_params)(struct dt_iop_module_t *self, const void *const old_params, const int old_version,
                        void *new_params, const int new_version);
   // allow to select a shape inside an iop
@@ -513,6 +541,26 @@ typedef struct dt_iop_module_t
   void (*process_sse2)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                        const void *const i, void *const o, const struct dt_iop_roi_t *const roi_in,
                        const struct dt_iop_roi_t *const roi_out);
+  /** variants of process() with AVX2 / AVX-512 kernels. NULL unless the cpu has the instructions. */
+  void (*process_avx2)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                       const void *const i, void *const o, const struct dt_iop_roi_t *const roi_in,
+                       const struct dt_iop_roi_t *const roi_out);
+  void (*process_avx512)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                         const void *const i, void *const o, const struct dt_iop_roi_t *const roi_in,
+                         const struct dt_iop_roi_t *const roi_out);
+  /** optional per pixel variant of process(), lets the pipe fuse runs of pointwise modules. */
+  void (*process_pointwise)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                            const float *const in, float *const out, const size_t npixels);
+  /** optional setup for process_pointwise(), called once before the pixels are processed. */
+  void (*process_pointwise_prepare)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece);
+  /** optional band variant of process() for the raw mosaic, lets the pipe fuse runs of raw modules. */
+  void (*process_rows)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, const void *const in,
+                       float *const out, const struct dt_iop_roi_t *const roi_in,
+                       const struct dt_iop_roi_t *const roi_out, const int y, const int rows);
+  /** optional, rows around a band process_rows() reads, -1 if it can't be used. */
+  int (*process_rows_border)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece);
+  /** optional setup for process_rows(), called once before the bands are processed. */
+  void (*process_rows_prepare)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece);
   /** the opencl equivalent of process(). */
   int (*process_cl)(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, const void *const i,
                     void *const o, const struct dt_iop_roi_t *const roi_in,
@@ -554,6 +602,8 @@ typedef struct dt_iop_module_t
 void dt_iop_load_modules_so(void);
 /** cleans up the dlopen refs. */
 void dt_iop_unload_modules_so(void);
+/** runs init_global() of the module unless that happened already. thread safe. */
+void dt_iop_init_global(dt_iop_module_so_t *module);
 /** load a module for a given .so */
 int dt_iop_load_module_by_so(dt_iop_module_t *module, dt_iop_module_so_t *so, struct dt_develop_t *dev);
 /** returns a list of instances referencing stuff loaded in load_modules_so. */
@@ -574,8 +624,11 @@ gboolean dt_iop_shown_in_group(dt_iop_module_t *module, uint32_t group);
 void dt_iop_gui_cleanup_module(dt_iop_module_t *module);
 /** updates the enable button state. (take into account module->enabled and module->hide_enable_button  */
 void dt_iop_gui_set_enable_button(dt_iop_module_t *module);
-/** updates the gui params and the enabled switch. */
+/** updates the gui params and the enabled switch. while the darkroom changes images only the header of
+ * collapsed modules is updated and their widgets are left for dt_iop_gui_update_pending(). */
 void dt_iop_gui_update(dt_iop_module_t *module);
+/** brings the widgets of a module up to date if dt_iop_gui_update() skipped them, returns TRUE if it did. */
+gboolean dt_iop_gui_update_pending(dt_iop_module_t *module);
 /** reset the ui to its defaults */
 void dt_iop_gui_reset(dt_iop_module_t *module);
 /** set expanded state of iop */
@@ -653,6 +706,9 @@ void dt_iop_update_multi_priority(dt_iop_module_t *module, int new_priority);
 /** iterates over the users hash table and checks if a specific mask is being used */
 gboolean dt_iop_is_raster_mask_used(dt_iop_module_t *module, int id);
 
+/** checks if the module moves points, i.e. has its own distort_transform() */
+gboolean dt_iop_is_distorting(const dt_iop_module_t *module);
+
 /** returns the previous visible module on the module list */
 dt_iop_module_t *dt_iop_gui_get_previous_visible_module(dt_iop_module_t *module);
 /** returns the next visible module on the module list */
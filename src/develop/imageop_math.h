@@ -197,6 +197,52 @@ static inline void dt_iop_alpha_copy(const void *const ivoid,
     out[k] = in[k];
 }
 
+/** the pixel loops over buffers of piece->colors channels, which is 4 or 1 in nearly all pipes. a row function
+ *  declared DT_IOP_CHANNELS_INLINE takes the number of channels as its first argument, and DT_IOP_CHANNELS_DISPATCH
+ *  inlines it with a constant 4 or 1, where the compiler can unroll and vectorise the loop over the channels, or
+ *  with the count of the buffer for anything else. dispatch in the loop over the rows: the body of an omp
+ *  parallel region is outlined before it is inlined and wouldn't see the constant. */
+#define DT_IOP_CHANNELS_INLINE static inline __attribute__((always_inline))
+#define DT_IOP_CHANNELS_DISPATCH(ch, func, ...)                                                               \
+  do                                                                                                         \
+  {                                                                                                          \
+    if((ch) == 4)                                                                                            \
+      func(4, __VA_ARGS__);                                                                                  \
+    else if((ch) == 1)                                                                                       \
+      func(1, __VA_ARGS__);                                                                                  \
+    else                                                                                                     \
+      func((ch), __VA_ARGS__);                                                                               \
+  } while(0)
+
+/** mixes n pixels of src into dest with the weights of mask times opacity. the alpha channel of 4 channel
+ *  buffers is left alone. */
+DT_IOP_CHANNELS_INLINE void dt_iop_mix_masked_row(const int ch, float *const __restrict__ dest,
+                                                  const float *const __restrict__ src,
+                                                  const float *const __restrict__ mask, const float opacity,
+                                                  const size_t n)
+{
+  const int bch = (ch == 4) ? 3 : ch;
+  for(size_t i = 0; i < n; i++)
+  {
+    const float f = mask[i] * opacity;
+    for(int c = 0; c < bch; c++) dest[ch * i + c] = dest[ch * i + c] * (1.0f - f) + src[ch * i + c] * f;
+  }
+}
+
+/** mixes n pixels of dest with a constant color, as dt_iop_mix_masked_row(). */
+DT_IOP_CHANNELS_INLINE void dt_iop_mix_color_masked_row(const int ch, float *const __restrict__ dest,
+                                                        const float *const __restrict__ color,
+                                                        const float *const __restrict__ mask, const float opacity,
+                                                        const size_t n)
+{
+  const int bch = (ch == 4) ? 3 : ch;
+  for(size_t i = 0; i < n; i++)
+  {
+    const float f = mask[i] * opacity;
+    for(int c = 0; c < bch; c++) dest[ch * i + c] = dest[ch * i + c] * (1.0f - f) + color[c] * f;
+  }
+}
+
 /** Calculate the bayer pattern color from the row and column **/
 static inline int FC(const size_t row, const size_t col, const uint32_t filters)
 {
@@ -21,8 +21,12 @@
 #include "common/colorspaces.h"
 #include "common/curve_tools.h"
 #include "common/darktable.h"
+#include "common/database.h"
 #include "common/debug.h"
+#include "common/history.h"
+#include "common/image_cache.h"
 #include "common/iop_order.h"
+#include "common/mipmap_cache.h"
 #include "common/ratings.h"
 #include "common/tags.h"
 #include "common/metadata.h"
@@ -324,55 +328,81 @@ static float lr2dt_clarity(float value)
   return get_interpolate(lr2dt_clarity_table, value);
 }
 
-static void dt_add_hist(int imgid, char *operation, dt_iop_params_t *params, int params_size, char *imported,
-                        size_t imported_len, int version, int *import_count)
+typedef struct lr_hist_t
+{
+  const char *operation;
+  void *params;
+  int params_size;
+  int version;
+} lr_hist_t;
+
+static GList *_lr_add_hist(GList *hist, const char *operation, const void *params, const int params_size,
+                           const int version)
+{
+  lr_hist_t *h = (lr_hist_t *)g_malloc(sizeof(lr_hist_t));
+  h->operation = operation;
+  h->params = g_memdup(params, params_size);
+  h->params_size = params_size;
+  h->version = version;
+  return g_list_prepend(hist, h);
+}
+
+static void _lr_free_hist(gpointer data)
+{
+  lr_hist_t *h = (lr_hist_t *)data;
+  g_free(h->params);
+  g_free(h);
+}
+
+/* appends the entries to the history of the image. the statements are kept for the next image of a batch. */
+static void _lr_write_history(const int imgid, const GList *hist)
 {
   int32_t num = 0;
-  dt_develop_blend_params_t blend_params = { 0 };
+  const dt_develop_blend_params_t blend_params = { 0 };
 
   //  get current num if any
   sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT COUNT(*) FROM main.history WHERE imgid = ?1", -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_PREPARE_CACHED(darktable.db, "SELECT COUNT(*) FROM main.history WHERE imgid = ?1", &stmt);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
   if(sqlite3_step(stmt) == SQLITE_ROW)
   {
     num = sqlite3_column_int(stmt, 0);
   }
-  sqlite3_finalize(stmt);
+  DT_DEBUG_SQLITE3_RELEASE_CACHED(darktable.db, stmt);
 
   // add new history info
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "INSERT INTO main.history"
-                              "  (imgid, num, module, operation, op_params, enabled,"
-                              "   blendop_params, blendop_version, multi_priority, multi_name)"
-                              " VALUES (?1, ?2, ?3, ?4, ?5, 1, ?6, ?7, 0, ' ')",
-                              -1, &stmt, NULL);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, num);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 3, version);
-  DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 4, operation, -1, SQLITE_TRANSIENT);
-  DT_DEBUG_SQLITE3_BIND_BLOB(stmt, 5, params, params_size, SQLITE_TRANSIENT);
-  DT_DEBUG_SQLITE3_BIND_BLOB(stmt, 6, &blend_params, sizeof(dt_develop_blend_params_t), SQLITE_TRANSIENT);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 7, LRDT_BLEND_VERSION);
-
-  sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
+  DT_DEBUG_SQLITE3_PREPARE_CACHED(darktable.db,
+                                  "INSERT INTO main.history"
+                                  "  (imgid, num, module, operation, op_params, enabled,"
+                                  "   blendop_params, blendop_version, multi_priority, multi_name)"
+                                  " VALUES (?1, ?2, ?3, ?4, ?5, 1, ?6, ?7, 0, ' ')",
+                                  &stmt);
+  for(const GList *l = hist; l; l = g_list_next(l))
+  {
+    const lr_hist_t *h = (lr_hist_t *)l->data;
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, num++);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 3, h->version);
+    DT_DEBUG_SQLITE3_BIND_TEXT(stmt, 4, h->operation, -1, SQLITE_TRANSIENT);
+    DT_DEBUG_SQLITE3_BIND_BLOB(stmt, 5, h->params, h->params_size, SQLITE_TRANSIENT);
+    DT_DEBUG_SQLITE3_BIND_BLOB(stmt, 6, &blend_params, sizeof(dt_develop_blend_params_t), SQLITE_TRANSIENT);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 7, LRDT_BLEND_VERSION);
+    sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+  }
+  DT_DEBUG_SQLITE3_RELEASE_CACHED(darktable.db, stmt);
 
   // also bump history_end
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "UPDATE main.images"
-                              " SET history_end = (SELECT IFNULL(MAX(num) + 1, 0)"
-                              "                    FROM main.history"
-                              "                    WHERE imgid = ?1)"
-                              " WHERE id = ?1", -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_PREPARE_CACHED(darktable.db,
+                                  "UPDATE main.images"
+                                  " SET history_end = (SELECT IFNULL(MAX(num) + 1, 0)"
+                                  "                    FROM main.history"
+                                  "                    WHERE imgid = ?1)"
+                                  " WHERE id = ?1",
+                                  &stmt);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
   sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
-
-  if(imported[0]) g_strlcat(imported, ", ", imported_len);
-  g_strlcat(imported, dt_iop_get_localized_name(operation), imported_len);
-  (*import_count)++;
+  DT_DEBUG_SQLITE3_RELEASE_CACHED(darktable.db, stmt);
 }
 
 #define MAX_PTS 20
@@ -476,7 +506,7 @@ static gboolean _skip_comma(const char **startptr)
 }
 
 /* lrop handle the Lr operation and convert it as a dt iop */
-static void _lrop(const dt_develop_t *dev, const xmlDocPtr doc, const int imgid,
+static void _lrop(const dt_image_t *img, const xmlDocPtr doc, const int imgid,
                   const xmlChar *name, const xmlChar *value, const xmlNodePtr node, lr_data_t *data)
 {
   const float hfactor = 3.0 / 9.0; // hue factor adjustment (use 3 out of 9 boxes in colorzones)
@@ -501,9 +531,9 @@ static void _lrop(const dt_develop_t *dev, const xmlDocPtr doc, const int imgid,
     else if(!xmlStrcmp(name, (const xmlChar *)"Orientation"))
     {
       data->orientation = atoi((char *)value);
-      if(dev != NULL && ((dev->image_storage.orientation == ORIENTATION_NONE && data->orientation != EXIF_ORIENTATION_NONE)
-                        || (dev->image_storage.orientation == ORIENTATION_ROTATE_CW_90_DEG && data->orientation != EXIF_ORIENTATION_ROTATE_CW_90_DEG)
-                        || (dev->image_storage.orientation == ORIENTATION_ROTATE_CCW_90_DEG && data->orientation != EXIF_ORIENTATION_ROTATE_CCW_90_DEG)))
+      if(img != NULL && ((img->orientation == ORIENTATION_NONE && data->orientation != EXIF_ORIENTATION_NONE)
+                        || (img->orientation == ORIENTATION_ROTATE_CW_90_DEG && data->orientation != EXIF_ORIENTATION_ROTATE_CW_90_DEG)
+                        || (img->orientation == ORIENTATION_ROTATE_CCW_90_DEG && data->orientation != EXIF_ORIENTATION_ROTATE_CCW_90_DEG)))
         data->has_flip = TRUE;
     }
     else if(!xmlStrcmp(name, (const xmlChar *)"HasCrop"))
@@ -843,7 +873,7 @@ static void _lrop(const dt_develop_t *dev, const xmlDocPtr doc, const int imgid,
       g_free(v);
     }
   }
-  if(dev == NULL && (!xmlStrcmp(name, (const xmlChar *)"subject")
+  if(img == NULL && (!xmlStrcmp(name, (const xmlChar *)"subject")
                      || !xmlStrcmp(name, (const xmlChar *)"hierarchicalSubject")))
   {
     xmlNodePtr tagNode = node;
@@ -865,7 +895,7 @@ static void _lrop(const dt_develop_t *dev, const xmlDocPtr doc, const int imgid,
     }
     if(tag_change) dt_control_signal_raise(darktable.signals, DT_SIGNAL_TAG_CHANGED);
   }
-  else if(dev != NULL && !xmlStrcmp(name, (const xmlChar *)"RetouchInfo"))
+  else if(img != NULL && !xmlStrcmp(name, (const xmlChar *)"RetouchInfo"))
   {
     xmlNodePtr riNode = node;
 
@@ -903,7 +933,7 @@ static void _lrop(const dt_develop_t *dev, const xmlDocPtr doc, const int imgid,
       riNode = riNode->next;
     }
   }
-  else if(dev != NULL && !xmlStrcmp(name, (const xmlChar *)"ToneCurvePV2012"))
+  else if(img != NULL && !xmlStrcmp(name, (const xmlChar *)"ToneCurvePV2012"))
   {
     xmlNodePtr tcNode = node;
 
@@ -921,7 +951,7 @@ static void _lrop(const dt_develop_t *dev, const xmlDocPtr doc, const int imgid,
       tcNode = tcNode->next;
     }
   }
-  else if(dev == NULL && !xmlStrcmp(name, (const xmlChar *)"title"))
+  else if(img == NULL && !xmlStrcmp(name, (const xmlChar *)"title"))
   {
     xmlNodePtr ttlNode = node;
     while(ttlNode)
@@ -935,7 +965,7 @@ static void _lrop(const dt_develop_t *dev, const xmlDocPtr doc, const int imgid,
       ttlNode = ttlNode->next;
     }
   }
-  else if(dev == NULL && !xmlStrcmp(name, (const xmlChar *)"description"))
+  else if(img == NULL && !xmlStrcmp(name, (const xmlChar *)"description"))
   {
     xmlNodePtr desNode = node;
     while(desNode)
@@ -949,7 +979,7 @@ static void _lrop(const dt_develop_t *dev, const xmlDocPtr doc, const int imgid,
       desNode = desNode->next;
     }
   }
-  else if(dev == NULL && !xmlStrcmp(name, (const xmlChar *)"creator"))
+  else if(img == NULL && !xmlStrcmp(name, (const xmlChar *)"creator"))
   {
     xmlNodePtr creNode = node;
     while(creNode)
@@ -963,7 +993,7 @@ static void _lrop(const dt_develop_t *dev, const xmlDocPtr doc, const int imgid,
       creNode = creNode->next;
     }
   }
-  else if(dev == NULL && !xmlStrcmp(name, (const xmlChar *)"rights"))
+  else if(img == NULL && !xmlStrcmp(name, (const xmlChar *)"rights"))
   {
     xmlNodePtr rigNode = node;
     while(rigNode)
@@ -994,7 +1024,7 @@ static int _has_list(char *name)
 };
 
 /* handle a specific xpath */
-static void _handle_xpath(dt_develop_t *dev, xmlDoc *doc, int imgid, xmlXPathContext *ctx, const xmlChar *xpath, lr_data_t *data)
+static void _handle_xpath(const dt_image_t *img, xmlDoc *doc, int imgid, xmlXPathContext *ctx, const xmlChar *xpath, lr_data_t *data)
 {
   xmlXPathObject *xpathObj = xmlXPathEvalExpression(xpath, ctx);
 
@@ -1013,12 +1043,12 @@ static void _handle_xpath(dt_develop_t *dev, xmlDoc *doc, int imgid, xmlXPathCon
               if (listnode) listnode = listnode->next;
               if (listnode) listnode = listnode->xmlChildrenNode;
               if (listnode) listnode = listnode->next;
-              if (listnode) _lrop(dev, doc, imgid, node->name, NULL, listnode, data);
+              if (listnode) _lrop(img, doc, imgid, node->name, NULL, listnode, data);
             }
           else
             {
               const xmlChar *value = xmlNodeListGetString(doc, node->children, 1);
-              _lrop(dev, doc, imgid, node->name, value, NULL, data);
+              _lrop(img, doc, imgid, node->name, value, NULL, data);
             }
         }
 
@@ -1063,21 +1093,11 @@ static inline float round5(double x)
   return round(x * 100000.f) / 100000.f;
 }
 
-void dt_lightroom_import(int imgid, dt_develop_t *dev, gboolean iauto)
+/* parses the sidecar into data. with img, the develop data for that image are read. without, tags and metadata
+   are attached to the image right away, and rating, location and color label are left in data. */
+static gboolean _lr_parse(const char *pathname, const int imgid, const dt_image_t *img, const gboolean iauto,
+                          lr_data_t *data)
 {
-  gboolean refresh_needed = FALSE;
-  char imported[256] = { 0 };
-  int n_import = 0;                // number of iop imported
-
-  // Get full pathname
-  char *pathname = dt_get_lightroom_xmp(imgid);
-
-  if(!pathname)
-  {
-    if(!iauto) dt_control_log(_("cannot find lightroom XMP!"));
-    return;
-  }
-
   // Load LR xmp
 
   xmlDocPtr doc;
@@ -1087,11 +1107,7 @@ void dt_lightroom_import(int imgid, dt_develop_t *dev, gboolean iauto)
 
   doc = xmlParseEntity(pathname);
 
-  if(doc == NULL)
-  {
-    g_free(pathname);
-    return;
-  }
+  if(doc == NULL) return FALSE;
 
   // Enter first node, xmpmeta
 
@@ -1099,16 +1115,15 @@ void dt_lightroom_import(int imgid, dt_develop_t *dev, gboolean iauto)
 
   if(entryNode == NULL)
   {
-    g_free(pathname);
     xmlFreeDoc(doc);
-    return;
+    return FALSE;
   }
 
   if(xmlStrcmp(entryNode->name, (const xmlChar *)"xmpmeta"))
   {
     if(!iauto) dt_control_log(_("`%s' not a lightroom XMP!"), pathname);
-    g_free(pathname);
-    return;
+    xmlFreeDoc(doc);
+    return FALSE;
   }
 
   // Check that this is really a Lightroom document
@@ -1117,9 +1132,8 @@ void dt_lightroom_import(int imgid, dt_develop_t *dev, gboolean iauto)
 
   if(xpathCtx == NULL)
   {
-    g_free(pathname);
     xmlFreeDoc(doc);
-    return;
+    return FALSE;
   }
 
   xmlXPathRegisterNs(xpathCtx, BAD_CAST "stEvt", BAD_CAST "http://ns.adobe.com/xap/1.0/sType/ResourceEvent#");
@@ -1130,9 +1144,8 @@ void dt_lightroom_import(int imgid, dt_develop_t *dev, gboolean iauto)
   {
     if(!iauto) dt_control_log(_("`%s' not a lightroom XMP!"), pathname);
     xmlXPathFreeContext(xpathCtx);
-    g_free(pathname);
     xmlFreeDoc(doc);
-    return;
+    return FALSE;
   }
 
   xmlNodeSetPtr xnodes = xpathObj->nodesetval;
@@ -1149,8 +1162,7 @@ void dt_lightroom_import(int imgid, dt_develop_t *dev, gboolean iauto)
       xmlFreeDoc(doc);
       xmlFree(value);
       if(!iauto) dt_control_log(_("`%s' not a lightroom XMP!"), pathname);
-      g_free(pathname);
-      return;
+      return FALSE;
     }
     xmlFree(value);
   }
@@ -1161,40 +1173,37 @@ void dt_lightroom_import(int imgid, dt_develop_t *dev, gboolean iauto)
 //     xmlXPathFreeObject(xpathObj);
 //     xmlXPathFreeContext(xpathCtx);
 //     if(!iauto) dt_control_log(_("`%s' not a lightroom XMP!"), pathname);
-//     g_free(pathname);
-//     return;
+//     return FALSE;
 //   }
 
   // let's now parse the needed data
 
-  lr_data_t data;
-
-  memset(&data, 0, sizeof(data));
-
-  data.has_crop = FALSE;
-  data.has_flip = FALSE;
-  data.has_exposure = FALSE;
-  data.has_vignette = FALSE;
-  data.has_grain = FALSE;
-  data.has_spots = FALSE;
-  data.curve_kind = linear;
-  data.n_pts = 0;
-  data.has_colorzones = FALSE;
-  data.has_splittoning = FALSE;
-  data.has_bilat = FALSE;
-  data.has_tags = FALSE;
-  data.rating = 0;
-  data.has_rating = FALSE;
-  data.lat = NAN;
-  data.lon = NAN;
-  data.has_gps = FALSE;
-  data.color = 0;
-  data.has_colorlabel = FALSE;
-  data.fratio = NAN;                // factor ratio image
-  data.crop_roundness = NAN;        // from lightroom
-  data.iwidth = 0;
-  data.iheight = 0;                 // image width / height
-  data.orientation = EXIF_ORIENTATION_NONE;
+  memset(data, 0, sizeof(lr_data_t));
+
+  data->has_crop = FALSE;
+  data->has_flip = FALSE;
+  data->has_exposure = FALSE;
+  data->has_vignette = FALSE;
+  data->has_grain = FALSE;
+  data->has_spots = FALSE;
+  data->curve_kind = linear;
+  data->n_pts = 0;
+  data->has_colorzones = FALSE;
+  data->has_splittoning = FALSE;
+  data->has_bilat = FALSE;
+  data->has_tags = FALSE;
+  data->rating = 0;
+  data->has_rating = FALSE;
+  data->lat = NAN;
+  data->lon = NAN;
+  data->has_gps = FALSE;
+  data->color = 0;
+  data->has_colorlabel = FALSE;
+  data->fratio = NAN;                // factor ratio image
+  data->crop_roundness = NAN;        // from lightroom
+  data->iwidth = 0;
+  data->iheight = 0;                 // image width / height
+  data->orientation = EXIF_ORIENTATION_NONE;
 
   // record the name-spaces needed for the parsing
   xmlXPathRegisterNs
@@ -1235,79 +1244,83 @@ void dt_lightroom_import(int imgid, dt_develop_t *dev, gboolean iauto)
 
       /* Lr 7.0 CC (nodes) */
       snprintf(expr, sizeof(expr), "//%s:*", names[i]);
-      _handle_xpath(dev, doc, imgid, xpathCtx, (const xmlChar *)expr, &data);
+      _handle_xpath(img, doc, imgid, xpathCtx, (const xmlChar *)expr, data);
 
       /* Lr up to 6.0 (attributes) */
       snprintf(expr, sizeof(expr), "//@%s:*", names[i]);
-      _handle_xpath(dev, doc, imgid, xpathCtx, (const xmlChar *)expr, &data);
+      _handle_xpath(img, doc, imgid, xpathCtx, (const xmlChar *)expr, data);
     }
 
   xmlXPathFreeObject(xpathObj);
   xmlXPathFreeContext(xpathCtx);
   xmlFreeDoc(doc);
 
-  //  Integrates into the history all the imported iop
+  return TRUE;
+}
 
-  if(dev != NULL && dt_image_is_raw(&dev->image_storage))
+/* maps the develop data of img to history entries, in the order they are to be applied. */
+static GList *_lr_history(const dt_image_t *img, lr_data_t *data)
+{
+  GList *hist = NULL;
+
+  if(dt_image_is_raw(img))
   {
     // set colorin to cmatrix which is the default from Adobe (so closer to what Lightroom does)
     dt_iop_colorin_params_t pci = (dt_iop_colorin_params_t){ "cmatrix", DT_INTENT_PERCEPTUAL };
 
-    dt_add_hist(imgid, "colorin", (dt_iop_params_t *)&pci, sizeof(dt_iop_colorin_params_t), imported,
-                sizeof(imported), LRDT_COLORIN_VERSION, &n_import);
-    refresh_needed = TRUE;
+    hist = _lr_add_hist(hist, "colorin", &pci, sizeof(dt_iop_colorin_params_t), LRDT_COLORIN_VERSION);
   }
 
-  if(dev != NULL && data.has_crop)
+  if(data->has_crop)
   {
     double rangle;
     double cx, cw, cy, ch;
     double new_width, new_height;
-    dt_image_orientation_t orientation = dt_image_orientation_to_flip_bits(data.orientation);
-
-    data.pc.k_sym = 0;
-    data.pc.k_apply = 0;
-    data.pc.crop_auto = 0;  // Cannot use crop-auto=1 (the default at clipping GUI), as it does not allow to cover all cropping cases.
-    data.pc.ratio_n = data.pc.ratio_d = -2;
-    data.pc.k_h = data.pc.k_v = 0;
-    data.pc.k_type = 0;
-    data.pc.kxa = data.pc.kxd = 0.2f;
-    data.pc.kxc = data.pc.kxb = 0.8f;
-    data.pc.kya = data.pc.kyb = 0.2f;
-    data.pc.kyc = data.pc.kyd = 0.8f;
+    dt_image_orientation_t orientation = dt_image_orientation_to_flip_bits(data->orientation);
+
+    data->pc.k_sym = 0;
+    data->pc.k_apply = 0;
+    data->pc.crop_auto = 0;  // Cannot use crop-auto=1 (the default at clipping GUI), as it does not allow to cover all cropping cases.
+    data->pc.ratio_n = data->pc.ratio_d = -2;
+    data->pc.k_h = data->pc.k_v = 0;
+    data->pc.k_type = 0;
+    data->pc.kxa = data->pc.kxd = 0.2f;
+    data->pc.kxc = data->pc.kxb = 0.8f;
+    data->pc.kya = data->pc.kyb = 0.2f;
+    data->pc.kyc = data->pc.kyd = 0.8f;
 
     // Convert image in image-centered coordinate system, [-image_size / 2; + image_size / 2]
-    cx = (data.pc.cx - 0.5f) * data.iwidth;
-    cw = (data.pc.cw - 0.5f) * data.iwidth;
-    cy = (data.pc.cy - 0.5f) * data.iheight;
-    ch = (data.pc.ch - 0.5f) * data.iheight;
+    cx = (data->pc.cx - 0.5f) * data->iwidth;
+    cw = (data->pc.cw - 0.5f) * data->iwidth;
+    cy = (data->pc.cy - 0.5f) * data->iheight;
+    ch = (data->pc.ch - 0.5f) * data->iheight;
 
     // Rotate the cropped zone according to rotation angle
     // All rotations done using center of the image
-    rangle = data.pc.angle * (M_PI / 180.0f);
+    rangle = data->pc.angle * (M_PI / 180.0f);
     rotate_xy(&cx, &cy, -rangle);
     rotate_xy(&cw, &ch, -rangle);
 
     // Calculate the new overall image size (black zone included) after rotation
     // rangle is limited to -45°;+45° by LR
-    new_width  = rotate_x(+data.iwidth, -data.iheight, -fabs(rangle));
-    new_height = rotate_y(+data.iwidth, +data.iheight, -fabs(rangle));
+    new_width  = rotate_x(+data->iwidth, -data->iheight, -fabs(rangle));
+    new_height = rotate_y(+data->iwidth, +data->iheight, -fabs(rangle));
 
     // apply new size & convert image back in initial coordinate system [0.0 ; +1.0]
-    data.pc.cx = round5((cx / new_width)  + 0.5f);
-    data.pc.cw = round5((cw / new_width)  + 0.5f);
-    data.pc.cy = round5((cy / new_height) + 0.5f);
-    data.pc.ch = round5((ch / new_height) + 0.5f);
+    data->pc.cx = round5((cx / new_width)  + 0.5f);
+    data->pc.cw = round5((cw / new_width)  + 0.5f);
+    data->pc.cy = round5((cy / new_height) + 0.5f);
+    data->pc.ch = round5((ch / new_height) + 0.5f);
 
     // adjust crop data according to the orientation - Must be done after rotation
     if(orientation & ORIENTATION_FLIP_X)
-      flip(&data.pc.cx, &data.pc.cw);
+      flip(&data->pc.cx, &data->pc.cw);
     if(orientation & ORIENTATION_FLIP_Y)
-      flip(&data.pc.cy, &data.pc.ch);
+      flip(&data->pc.cy, &data->pc.ch);
     if(orientation & ORIENTATION_SWAP_XY)
     {
-      swap(&data.pc.cx, &data.pc.cy);
-      swap(&data.pc.cw, &data.pc.ch);
+      swap(&data->pc.cx, &data->pc.cy);
+      swap(&data->pc.cw, &data->pc.ch);
     }
 
     // Invert angle when orientation is flipped
@@ -1315,193 +1328,215 @@ void dt_lightroom_import(int imgid, dt_develop_t *dev, gboolean iauto)
     || orientation == ORIENTATION_FLIP_VERTICALLY
     || orientation == ORIENTATION_TRANSPOSE
     || orientation == ORIENTATION_TRANSVERSE)
-      data.pc.angle = -data.pc.angle;
+      data->pc.angle = -data->pc.angle;
 
-    data.fratio = (data.pc.cw - data.pc.cx) / (data.pc.ch - data.pc.cy);
+    data->fratio = (data->pc.cw - data->pc.cx) / (data->pc.ch - data->pc.cy);
 
-    dt_add_hist(imgid, "clipping", (dt_iop_params_t *)&data.pc, sizeof(dt_iop_clipping_params_t), imported,
-                sizeof(imported), LRDT_CLIPPING_VERSION, &n_import);
-    refresh_needed = TRUE;
+    hist = _lr_add_hist(hist, "clipping", &data->pc, sizeof(dt_iop_clipping_params_t), LRDT_CLIPPING_VERSION);
   }
 
-  if(dev != NULL && data.has_flip)
+  if(data->has_flip)
   {
-    data.pf.orientation = dt_image_orientation_to_flip_bits(data.orientation);
+    data->pf.orientation = dt_image_orientation_to_flip_bits(data->orientation);
 
-    dt_add_hist(imgid, "flip", (dt_iop_params_t *)&data.pf, sizeof(dt_iop_flip_params_t), imported,
-                sizeof(imported), LRDT_FLIP_VERSION, &n_import);
-    refresh_needed = TRUE;
+    hist = _lr_add_hist(hist, "flip", &data->pf, sizeof(dt_iop_flip_params_t), LRDT_FLIP_VERSION);
   }
 
-  if(dev != NULL && data.has_exposure)
+  if(data->has_exposure)
   {
-    dt_add_hist(imgid, "exposure", (dt_iop_params_t *)&data.pe, sizeof(dt_iop_exposure_params_t), imported,
-                sizeof(imported), LRDT_EXPOSURE_VERSION, &n_import);
-    refresh_needed = TRUE;
+    hist = _lr_add_hist(hist, "exposure", &data->pe, sizeof(dt_iop_exposure_params_t), LRDT_EXPOSURE_VERSION);
   }
 
-  if(dev != NULL && data.has_grain)
+  if(data->has_grain)
   {
-    data.pg.channel = 0;
+    data->pg.channel = 0;
 
-    dt_add_hist(imgid, "grain", (dt_iop_params_t *)&data.pg, sizeof(dt_iop_grain_params_t), imported,
-                sizeof(imported), LRDT_GRAIN_VERSION, &n_import);
-    refresh_needed = TRUE;
+    hist = _lr_add_hist(hist, "grain", &data->pg, sizeof(dt_iop_grain_params_t), LRDT_GRAIN_VERSION);
   }
 
-  if(dev != NULL && data.has_vignette)
+  if(data->has_vignette)
   {
     const float base_ratio = 1.325 / 1.5;
 
-    data.pv.autoratio = FALSE;
-    data.pv.dithering = DITHER_8BIT;
-    data.pv.center.x = 0.0;
-    data.pv.center.y = 0.0;
-    data.pv.shape = 1.0;
+    data->pv.autoratio = FALSE;
+    data->pv.dithering = DITHER_8BIT;
+    data->pv.center.x = 0.0;
+    data->pv.center.y = 0.0;
+    data->pv.shape = 1.0;
 
     // defensive code, should not happen, but just in case future Lr version
     // has not ImageWidth/ImageLength XML tag.
-    if(data.iwidth == 0 || data.iheight == 0)
-      data.pv.whratio = base_ratio;
+    if(data->iwidth == 0 || data->iheight == 0)
+      data->pv.whratio = base_ratio;
     else
-      data.pv.whratio = base_ratio * ((float)data.iwidth / (float)data.iheight);
+      data->pv.whratio = base_ratio * ((float)data->iwidth / (float)data->iheight);
 
-    if(data.has_crop) data.pv.whratio = data.pv.whratio * data.fratio;
+    if(data->has_crop) data->pv.whratio = data->pv.whratio * data->fratio;
 
     //  Adjust scale and ratio based on the roundness. On Lightroom changing
     //  the roundness change the width and the height of the vignette.
 
-    if(data.crop_roundness > 0)
+    if(data->crop_roundness > 0)
     {
-      float newratio = data.pv.whratio - (data.pv.whratio - 1) * (data.crop_roundness / 100.0);
-      float dscale = (1 - (newratio / data.pv.whratio)) / 2.0;
+      float newratio = data->pv.whratio - (data->pv.whratio - 1) * (data->crop_roundness / 100.0);
+      float dscale = (1 - (newratio / data->pv.whratio)) / 2.0;
 
-      data.pv.scale -= dscale * 100.0;
-      data.pv.whratio = newratio;
+      data->pv.scale -= dscale * 100.0;
+      data->pv.whratio = newratio;
     }
 
-    dt_add_hist(imgid, "vignette", (dt_iop_params_t *)&data.pv, sizeof(dt_iop_vignette_params_t), imported,
-                sizeof(imported), LRDT_VIGNETTE_VERSION, &n_import);
-    refresh_needed = TRUE;
+    hist = _lr_add_hist(hist, "vignette", &data->pv, sizeof(dt_iop_vignette_params_t), LRDT_VIGNETTE_VERSION);
   }
 
-  if(dev != NULL && data.has_spots)
+  if(data->has_spots)
   {
     // Check for orientation, rotate when in portrait mode
-    if(data.orientation > 4)
-      for(int k = 0; k < data.ps.num_spots; k++)
+    if(data->orientation > 4)
+      for(int k = 0; k < data->ps.num_spots; k++)
       {
-        float tmp = data.ps.spot[k].y;
-        data.ps.spot[k].y = 1.0 - data.ps.spot[k].x;
-        data.ps.spot[k].x = tmp;
-        tmp = data.ps.spot[k].yc;
-        data.ps.spot[k].yc = 1.0 - data.ps.spot[k].xc;
-        data.ps.spot[k].xc = tmp;
+        float tmp = data->ps.spot[k].y;
+        data->ps.spot[k].y = 1.0 - data->ps.spot[k].x;
+        data->ps.spot[k].x = tmp;
+        tmp = data->ps.spot[k].yc;
+        data->ps.spot[k].yc = 1.0 - data->ps.spot[k].xc;
+        data->ps.spot[k].xc = tmp;
       }
 
-    dt_add_hist(imgid, "spots", (dt_iop_params_t *)&data.ps, sizeof(dt_iop_spots_params_t), imported,
-                sizeof(imported), LRDT_SPOTS_VERSION, &n_import);
-    refresh_needed = TRUE;
+    hist = _lr_add_hist(hist, "spots", &data->ps, sizeof(dt_iop_spots_params_t), LRDT_SPOTS_VERSION);
   }
 
-  if(dev != NULL &&
-     (data.curve_kind != linear
-      || data.ptc_value[0] != 0 || data.ptc_value[1] != 0 || data.ptc_value[2] != 0 || data.ptc_value[3] != 0))
+  if(data->curve_kind != linear
+     || data->ptc_value[0] != 0 || data->ptc_value[1] != 0 || data->ptc_value[2] != 0 || data->ptc_value[3] != 0)
   {
-    const int total_pts = (data.curve_kind == custom) ? data.n_pts : 6;
-    data.ptc.tonecurve_nodes[ch_L] = total_pts;
-    data.ptc.tonecurve_nodes[ch_a] = 7;
-    data.ptc.tonecurve_nodes[ch_b] = 7;
-    data.ptc.tonecurve_type[ch_L] = CUBIC_SPLINE;
-    data.ptc.tonecurve_type[ch_a] = CUBIC_SPLINE;
-    data.ptc.tonecurve_type[ch_b] = CUBIC_SPLINE;
-    data.ptc.tonecurve_autoscale_ab = 1;
-    data.ptc.tonecurve_preset = 0;
+    const int total_pts = (data->curve_kind == custom) ? data->n_pts : 6;
+    data->ptc.tonecurve_nodes[ch_L] = total_pts;
+    data->ptc.tonecurve_nodes[ch_a] = 7;
+    data->ptc.tonecurve_nodes[ch_b] = 7;
+    data->ptc.tonecurve_type[ch_L] = CUBIC_SPLINE;
+    data->ptc.tonecurve_type[ch_a] = CUBIC_SPLINE;
+    data->ptc.tonecurve_type[ch_b] = CUBIC_SPLINE;
+    data->ptc.tonecurve_autoscale_ab = 1;
+    data->ptc.tonecurve_preset = 0;
 
     float linear_ab[7] = { 0.0, 0.08, 0.3, 0.5, 0.7, 0.92, 1.0 };
 
     // linear a, b curves
-    for(int k = 0; k < 7; k++) data.ptc.tonecurve[ch_a][k].x = linear_ab[k];
-    for(int k = 0; k < 7; k++) data.ptc.tonecurve[ch_a][k].y = linear_ab[k];
-    for(int k = 0; k < 7; k++) data.ptc.tonecurve[ch_b][k].x = linear_ab[k];
-    for(int k = 0; k < 7; k++) data.ptc.tonecurve[ch_b][k].y = linear_ab[k];
+    for(int k = 0; k < 7; k++) data->ptc.tonecurve[ch_a][k].x = linear_ab[k];
+    for(int k = 0; k < 7; k++) data->ptc.tonecurve[ch_a][k].y = linear_ab[k];
+    for(int k = 0; k < 7; k++) data->ptc.tonecurve[ch_b][k].x = linear_ab[k];
+    for(int k = 0; k < 7; k++) data->ptc.tonecurve[ch_b][k].y = linear_ab[k];
 
     // Set the base tonecurve
 
-    if(data.curve_kind == linear)
-    {
-      data.ptc.tonecurve[ch_L][0].x = 0.0;
-      data.ptc.tonecurve[ch_L][0].y = 0.0;
-      data.ptc.tonecurve[ch_L][1].x = data.ptc_split[0] / 2.0;
-      data.ptc.tonecurve[ch_L][1].y = data.ptc_split[0] / 2.0;
-      data.ptc.tonecurve[ch_L][2].x = data.ptc_split[1] - (data.ptc_split[1] - data.ptc_split[0]) / 2.0;
-      data.ptc.tonecurve[ch_L][2].y = data.ptc_split[1] - (data.ptc_split[1] - data.ptc_split[0]) / 2.0;
-      data.ptc.tonecurve[ch_L][3].x = data.ptc_split[1] + (data.ptc_split[2] - data.ptc_split[1]) / 2.0;
-      data.ptc.tonecurve[ch_L][3].y = data.ptc_split[1] + (data.ptc_split[2] - data.ptc_split[1]) / 2.0;
-      data.ptc.tonecurve[ch_L][4].x = data.ptc_split[2] + (1.0 - data.ptc_split[2]) / 2.0;
-      data.ptc.tonecurve[ch_L][4].y = data.ptc_split[2] + (1.0 - data.ptc_split[2]) / 2.0;
-      data.ptc.tonecurve[ch_L][5].x = 1.0;
-      data.ptc.tonecurve[ch_L][5].y = 1.0;
+    if(data->curve_kind == linear)
+    {
+      data->ptc.tonecurve[ch_L][0].x = 0.0;
+      data->ptc.tonecurve[ch_L][0].y = 0.0;
+      data->ptc.tonecurve[ch_L][1].x = data->ptc_split[0] / 2.0;
+      data->ptc.tonecurve[ch_L][1].y = data->ptc_split[0] / 2.0;
+      data->ptc.tonecurve[ch_L][2].x = data->ptc_split[1] - (data->ptc_split[1] - data->ptc_split[0]) / 2.0;
+      data->ptc.tonecurve[ch_L][2].y = data->ptc_split[1] - (data->ptc_split[1] - data->ptc_split[0]) / 2.0;
+      data->ptc.tonecurve[ch_L][3].x = data->ptc_split[1] + (data->ptc_split[2] - data->ptc_split[1]) / 2.0;
+      data->ptc.tonecurve[ch_L][3].y = data->ptc_split[1] + (data->ptc_split[2] - data->ptc_split[1]) / 2.0;
+      data->ptc.tonecurve[ch_L][4].x = data->ptc_split[2] + (1.0 - data->ptc_split[2]) / 2.0;
+      data->ptc.tonecurve[ch_L][4].y = data->ptc_split[2] + (1.0 - data->ptc_split[2]) / 2.0;
+      data->ptc.tonecurve[ch_L][5].x = 1.0;
+      data->ptc.tonecurve[ch_L][5].y = 1.0;
     }
     else
     {
       for(int k = 0; k < total_pts; k++)
       {
-        data.ptc.tonecurve[ch_L][k].x = data.curve_pts[k][0] / 255.0;
-        data.ptc.tonecurve[ch_L][k].y = data.curve_pts[k][1] / 255.0;
+        data->ptc.tonecurve[ch_L][k].x = data->curve_pts[k][0] / 255.0;
+        data->ptc.tonecurve[ch_L][k].y = data->curve_pts[k][1] / 255.0;
       }
     }
 
-    if(data.curve_kind != custom)
+    if(data->curve_kind != custom)
     {
       // set shadows/darks/lights/highlight adjustments
 
-      data.ptc.tonecurve[ch_L][1].y += data.ptc.tonecurve[ch_L][1].y * ((float)data.ptc_value[0] / 100.0);
-      data.ptc.tonecurve[ch_L][2].y += data.ptc.tonecurve[ch_L][2].y * ((float)data.ptc_value[1] / 100.0);
-      data.ptc.tonecurve[ch_L][3].y += data.ptc.tonecurve[ch_L][3].y * ((float)data.ptc_value[2] / 100.0);
-      data.ptc.tonecurve[ch_L][4].y += data.ptc.tonecurve[ch_L][4].y * ((float)data.ptc_value[3] / 100.0);
+      data->ptc.tonecurve[ch_L][1].y += data->ptc.tonecurve[ch_L][1].y * ((float)data->ptc_value[0] / 100.0);
+      data->ptc.tonecurve[ch_L][2].y += data->ptc.tonecurve[ch_L][2].y * ((float)data->ptc_value[1] / 100.0);
+      data->ptc.tonecurve[ch_L][3].y += data->ptc.tonecurve[ch_L][3].y * ((float)data->ptc_value[2] / 100.0);
+      data->ptc.tonecurve[ch_L][4].y += data->ptc.tonecurve[ch_L][4].y * ((float)data->ptc_value[3] / 100.0);
 
-      if(data.ptc.tonecurve[ch_L][1].y > data.ptc.tonecurve[ch_L][2].y)
-        data.ptc.tonecurve[ch_L][1].y = data.ptc.tonecurve[ch_L][2].y;
-      if(data.ptc.tonecurve[ch_L][3].y > data.ptc.tonecurve[ch_L][4].y)
-        data.ptc.tonecurve[ch_L][4].y = data.ptc.tonecurve[ch_L][3].y;
+      if(data->ptc.tonecurve[ch_L][1].y > data->ptc.tonecurve[ch_L][2].y)
+        data->ptc.tonecurve[ch_L][1].y = data->ptc.tonecurve[ch_L][2].y;
+      if(data->ptc.tonecurve[ch_L][3].y > data->ptc.tonecurve[ch_L][4].y)
+        data->ptc.tonecurve[ch_L][4].y = data->ptc.tonecurve[ch_L][3].y;
     }
 
-    dt_add_hist(imgid, "tonecurve", (dt_iop_params_t *)&data.ptc, sizeof(dt_iop_tonecurve_params_t), imported,
-                sizeof(imported), LRDT_TONECURVE_VERSION, &n_import);
-    refresh_needed = TRUE;
+    hist = _lr_add_hist(hist, "tonecurve", &data->ptc, sizeof(dt_iop_tonecurve_params_t), LRDT_TONECURVE_VERSION);
   }
 
-  if(dev != NULL && data.has_colorzones)
+  if(data->has_colorzones)
   {
-    data.pcz.channel = DT_IOP_COLORZONES_h;
+    data->pcz.channel = DT_IOP_COLORZONES_h;
 
     for(int i = 0; i < 3; i++)
       for(int k = 0; k < 8; k++)
-        data.pcz.equalizer_x[i][k] = k / (DT_IOP_COLORZONES_BANDS - 1.0);
+        data->pcz.equalizer_x[i][k] = k / (DT_IOP_COLORZONES_BANDS - 1.0);
+
+    hist = _lr_add_hist(hist, "colorzones", &data->pcz, sizeof(dt_iop_colorzones_params_t), LRDT_COLORZONES_VERSION);
+  }
+
+  if(data->has_splittoning)
+  {
+    data->pst.compress = 50.0;
 
-    dt_add_hist(imgid, "colorzones", (dt_iop_params_t *)&data.pcz, sizeof(dt_iop_colorzones_params_t), imported,
-                sizeof(imported), LRDT_COLORZONES_VERSION, &n_import);
-    refresh_needed = TRUE;
+    hist = _lr_add_hist(hist, "splittoning", &data->pst, sizeof(dt_iop_splittoning_params_t),
+                        LRDT_SPLITTONING_VERSION);
   }
 
-  if(dev != NULL && data.has_splittoning)
+  if(data->has_bilat)
   {
-    data.pst.compress = 50.0;
+    data->pbl.sigma_r = 100.0;
+    data->pbl.sigma_s = 100.0;
 
-    dt_add_hist(imgid, "splittoning", (dt_iop_params_t *)&data.pst, sizeof(dt_iop_splittoning_params_t), imported,
-                sizeof(imported), LRDT_SPLITTONING_VERSION, &n_import);
-    refresh_needed = TRUE;
+    hist = _lr_add_hist(hist, "bilat", &data->pbl, sizeof(dt_iop_bilat_params_t), LRDT_BILAT_VERSION);
   }
 
-  if(dev != NULL && data.has_bilat)
+  return g_list_reverse(hist);
+}
+
+void dt_lightroom_import(int imgid, dt_develop_t *dev, gboolean iauto)
+{
+  gboolean refresh_needed = FALSE;
+  char imported[256] = { 0 };
+  int n_import = 0;                // number of iop imported
+
+  // Get full pathname
+  char *pathname = dt_get_lightroom_xmp(imgid);
+
+  if(!pathname)
   {
-    data.pbl.sigma_r = 100.0;
-    data.pbl.sigma_s = 100.0;
+    if(!iauto) dt_control_log(_("cannot find lightroom XMP!"));
+    return;
+  }
 
-    dt_add_hist(imgid, "bilat", (dt_iop_params_t *)&data.pbl, sizeof(dt_iop_bilat_params_t), imported,
-                sizeof(imported), LRDT_BILAT_VERSION, &n_import);
-    refresh_needed = TRUE;
+  // with a develop we import the develop data, otherwise tags and the like
+  const dt_image_t *img = dev ? &dev->image_storage : NULL;
+
+  lr_data_t data;
+  const gboolean parsed = _lr_parse(pathname, imgid, img, iauto, &data);
+  g_free(pathname);
+  if(!parsed) return;
+
+  //  Integrates into the history all the imported iop
+
+  if(img != NULL)
+  {
+    GList *hist = _lr_history(img, &data);
+    _lr_write_history(imgid, hist);
+    for(const GList *l = hist; l; l = g_list_next(l))
+    {
+      if(imported[0]) g_strlcat(imported, ", ", sizeof(imported));
+      g_strlcat(imported, dt_iop_get_localized_name(((lr_hist_t *)l->data)->operation), sizeof(imported));
+      n_import++;
+      refresh_needed = TRUE;
+    }
+    g_list_free_full(hist, _lr_free_hist);
   }
 
   if(data.has_tags)
@@ -1557,6 +1592,91 @@ void dt_lightroom_import(int imgid, dt_develop_t *dev, gboolean iauto)
     }
   }
 }
+
+typedef struct lr_batch_item_t
+{
+  int imgid;
+  dt_image_t img; // a copy, the workers do not hold the image cache
+  GList *hist;
+} lr_batch_item_t;
+
+static void _lr_batch_worker(gpointer data, gpointer user_data)
+{
+  lr_batch_item_t *item = (lr_batch_item_t *)data;
+  char *pathname = dt_get_lightroom_xmp(item->imgid);
+  if(!pathname) return;
+
+  lr_data_t lr_data;
+  if(_lr_parse(pathname, item->imgid, &item->img, TRUE, &lr_data)) item->hist = _lr_history(&item->img, &lr_data);
+  g_free(pathname);
+}
+
+static void _lr_batch_item_free(gpointer data)
+{
+  lr_batch_item_t *item = (lr_batch_item_t *)data;
+  g_list_free_full(item->hist, _lr_free_hist);
+  g_free(item);
+}
+
+int dt_lightroom_import_batch(const GList *imgs)
+{
+  // as on the first load in darkroom, only images without a history get one from the sidecar
+  GList *items = NULL;
+  for(const GList *l = imgs; l; l = g_list_next(l))
+  {
+    const int imgid = GPOINTER_TO_INT(l->data);
+    sqlite3_stmt *stmt;
+    DT_DEBUG_SQLITE3_PREPARE_CACHED(darktable.db, "SELECT 1 FROM main.history WHERE imgid = ?1 LIMIT 1", &stmt);
+    DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+    const gboolean has_history = sqlite3_step(stmt) == SQLITE_ROW;
+    DT_DEBUG_SQLITE3_RELEASE_CACHED(darktable.db, stmt);
+    if(has_history) continue;
+
+    const dt_image_t *cimg = dt_image_cache_get(darktable.image_cache, imgid, 'r');
+    if(!cimg) continue;
+    lr_batch_item_t *item = (lr_batch_item_t *)g_malloc0(sizeof(lr_batch_item_t));
+    item->imgid = imgid;
+    item->img = *cimg;
+    dt_image_cache_read_release(darktable.image_cache, cimg);
+    items = g_list_prepend(items, item);
+  }
+  items = g_list_reverse(items);
+
+  // the sidecars are parsed and mapped by a few threads, libxml2 wants to be set up once before
+  xmlInitParser();
+  GThreadPool *pool = g_thread_pool_new(_lr_batch_worker, NULL, dt_get_num_threads(), FALSE, NULL);
+  for(GList *l = items; l; l = g_list_next(l)) g_thread_pool_push(pool, l->data, NULL);
+  g_thread_pool_free(pool, FALSE, TRUE);
+
+  // and the histories are written in one transaction
+  int count = 0;
+  dt_database_start_transaction(darktable.db);
+  for(GList *l = items; l; l = g_list_next(l))
+  {
+    const lr_batch_item_t *item = (lr_batch_item_t *)l->data;
+    if(!item->hist) continue;
+    dt_lock_image(item->imgid);
+    _lr_write_history(item->imgid, item->hist);
+    dt_unlock_image(item->imgid);
+    dt_history_hash_write_from_history(item->imgid, DT_HISTORY_HASH_CURRENT);
+    count++;
+  }
+  dt_database_release_transaction(darktable.db);
+
+  for(GList *l = items; l; l = g_list_next(l))
+  {
+    const lr_batch_item_t *item = (lr_batch_item_t *)l->data;
+    if(!item->hist) continue;
+    dt_image_write_sidecar_file(item->imgid);
+    dt_mipmap_cache_remove(darktable.mipmap_cache, item->imgid);
+    dt_image_reset_final_size(item->imgid);
+    dt_control_signal_raise(darktable.signals, DT_SIGNAL_DEVELOP_MIPMAP_UPDATED, item->imgid);
+  }
+
+  g_list_free_full(items, _lr_batch_item_free);
+  return count;
+}
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -26,6 +26,11 @@
 */
 void dt_lightroom_import(int imgid, dt_develop_t *dev, gboolean iauto);
 
+/* imports the develop data of the lightroom sidecars of the images which have no history yet, without loading
+   them in darkroom. the sidecars are parsed by a few threads and the histories written in one transaction.
+   returns the number of images which got a history. */
+int dt_lightroom_import_batch(const GList *imgs);
+
 /* returns NULL if not found, or g_strdup'ed pathname, the caller should g_free it. */
 char *dt_get_lightroom_xmp(int imgid);
 
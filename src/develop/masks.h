@@ -259,11 +259,21 @@ int dt_masks_get_area(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt
                       int *width, int *height, int *posx, int *posy);
 int dt_masks_get_source_area(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form,
                              int *width, int *height, int *posx, int *posy);
+/** get the rectangle {x0, y0, x1, y1} which includes every shape of the module's mask group that differs
+ * between the two lists of forms, in the same space as dt_masks_get_area(). returns 1 if the change can't be
+ * narrowed down like that, e.g. if nothing changed or a shape was inverted. */
+int dt_masks_get_changed_area(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, GList *old_forms,
+                              GList *new_forms, float *box);
+/** get the rectangle {x0, y0, x1, y1} outside of which the drawn mask of the module is zero, in the same space
+ * as dt_masks_get_area(). returns 1 if there is no such bound, e.g. without shapes or with an inverted one. */
+int dt_masks_get_group_area(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, float *box);
 /** get the transparency mask of the form and his border */
 int dt_masks_get_mask(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form,
                       float **buffer, int *width, int *height, int *posx, int *posy);
 int dt_masks_get_mask_roi(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form,
                           const dt_iop_roi_t *roi, float *buffer);
+/** frees the shapes rasterised by dt_masks_get_mask_roi() for the modules of pipe */
+void dt_masks_raster_cache_cleanup(dt_dev_pixelpipe_t *pipe);
 int dt_masks_group_render(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form,
                           float **buffer, int *roi, float scale);
 int dt_masks_group_render_roi(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form,
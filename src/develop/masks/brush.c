@@ -2599,30 +2599,144 @@ static int dt_brush_get_area(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *pi
 }
 
 /** we write a falloff segment */
-static void _brush_falloff(float **buffer, int *p0, int *p1, int posx, int posy, int bw, float hardness,
-                           float density)
+// the stroke is rendered as a chain of capsules along the centre points, every capsule blends the radius
+// between its ends. pixels get the largest opacity of the capsules covering them, which follows the falloff of
+// the brush: density up to hardness * radius, then a linear ramp down to zero at the radius.
+typedef struct _brush_segment_t
 {
-  // segment length
-  const int l = sqrt((p1[0] - p0[0]) * (p1[0] - p0[0]) + (p1[1] - p0[1]) * (p1[1] - p0[1])) + 1;
-  const int solid = (int)l * hardness;
-  const int soft = l - solid;
+  float x0, y0, dx, dy, inv_len2;
+  float r0, dr, hardness, density;
+  int xmin, xmax, ymin, ymax;
+} _brush_segment_t;
 
-  const float lx = p1[0] - p0[0];
-  const float ly = p1[1] - p0[1];
+#define BRUSH_TILE 64
 
-  for(int i = 0; i < l; i++)
+static inline float _brush_radius(const float *points, const float *border, const int i)
+{
+  const float dx = border[2 * i] - points[2 * i];
+  const float dy = border[2 * i + 1] - points[2 * i + 1];
+  return sqrtf(dx * dx + dy * dy);
+}
+
+// sets the capsule from centre point a to centre point b with the falloff of a. FALSE if it is outside of the
+// bw x bh buffer.
+static gboolean _brush_segment_set(_brush_segment_t *sg, const float ax, const float ay, const float ar,
+                                   const float bx, const float by, const float br, const float *ap, const int bw,
+                                   const int bh)
+{
+  const float len2 = (bx - ax) * (bx - ax) + (by - ay) * (by - ay);
+  const float rmax = MAX(ar, br) + 1.0f;
+  sg->x0 = ax;
+  sg->y0 = ay;
+  sg->dx = bx - ax;
+  sg->dy = by - ay;
+  sg->inv_len2 = len2 > 0.0f ? 1.0f / len2 : 0.0f;
+  sg->r0 = ar;
+  sg->dr = br - ar;
+  sg->hardness = ap[0];
+  sg->density = ap[1];
+  sg->xmin = MAX((int)floorf(MIN(ax, bx) - rmax), 0);
+  sg->xmax = MIN((int)ceilf(MAX(ax, bx) + rmax), bw - 1);
+  sg->ymin = MAX((int)floorf(MIN(ay, by) - rmax), 0);
+  sg->ymax = MIN((int)ceilf(MAX(ay, by) + rmax), bh - 1);
+  return sg->xmin <= sg->xmax && sg->ymin <= sg->ymax && ar + br > 0.0f;
+}
+
+// builds the capsules from the centre points and their border points first..count-1, shifted by (-posx, -posy).
+// the points are about a pixel apart, so only those a quarter radius apart are kept, and every point where the
+// hardness or density changes. returns the number of capsules, -1 if out of memory.
+static int _brush_segments(const float *points, const float *border, const float *payload, const int first,
+                           const int count, const int posx, const int posy, const int bw, const int bh,
+                           _brush_segment_t **segments)
+{
+  *segments = NULL;
+  if(count <= first) return 0;
+  _brush_segment_t *segs = malloc(sizeof(_brush_segment_t) * (count - first));
+  if(!segs) return -1;
+
+  int nsegs = 0;
+  int last = -1;
+  float lx = 0.0f, ly = 0.0f, lr = 0.0f;
+  for(int i = first; i < count; i++)
+  {
+    const float x = points[2 * i] - posx, y = points[2 * i + 1] - posy;
+    const float r = _brush_radius(points, border, i);
+    if(!isfinite(x) || !isfinite(y) || !isfinite(r)) continue;
+
+    if(last >= 0)
+    {
+      const float step = MAX(1.0f, 0.25f * MIN(r, lr));
+      const float dist2 = (x - lx) * (x - lx) + (y - ly) * (y - ly);
+      const gboolean changed = fabsf(payload[2 * i] - payload[2 * last]) > 0.01f
+                               || fabsf(payload[2 * i + 1] - payload[2 * last + 1]) > 0.01f;
+      if(dist2 < step * step && !changed && i < count - 1) continue;
+
+      if(_brush_segment_set(segs + nsegs, lx, ly, lr, x, y, r, payload + 2 * last, bw, bh)) nsegs++;
+    }
+    last = i;
+    lx = x;
+    ly = y;
+    lr = r;
+  }
+
+  // a single point is a disc
+  if(nsegs == 0 && last >= 0 && _brush_segment_set(segs, lx, ly, lr, lx, ly, lr, payload + 2 * last, bw, bh))
+    nsegs = 1;
+
+  *segments = segs;
+  return nsegs;
+}
+
+// renders the capsules into the bw x bh buffer, which has to be zeroed. every tile of the buffer is done by one
+// thread, which goes through the capsules reaching into it.
+static void _brush_render(float *const buffer, const int bw, const int bh, const _brush_segment_t *const segs,
+                          const int nsegs)
+{
+  const int tiles_x = (bw + BRUSH_TILE - 1) / BRUSH_TILE;
+  const int tiles_y = (bh + BRUSH_TILE - 1) / BRUSH_TILE;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(buffer, bw, bh, segs, nsegs, tiles_x, tiles_y) \
+  schedule(dynamic)
+#endif
+  for(int t = 0; t < tiles_x * tiles_y; t++)
   {
-    // position
-    const int x = (int)((float)i * lx / (float)l) + p0[0] - posx;
-    const int y = (int)((float)i * ly / (float)l) + p0[1] - posy;
-    const float op = density * ((i <= solid) ? 1.0f : 1.0 - (float)(i - solid) / (float)soft);
-    (*buffer)[y * bw + x] = MAX((*buffer)[y * bw + x], op);
-    if(x > 0)
-      (*buffer)[y * bw + x - 1]
-          = MAX((*buffer)[y * bw + x - 1], op); // this one is to avoid gap due to int rounding
-    if(y > 0)
-      (*buffer)[(y - 1) * bw + x]
-          = MAX((*buffer)[(y - 1) * bw + x], op); // this one is to avoid gap due to int rounding
+    const int tx0 = (t % tiles_x) * BRUSH_TILE;
+    const int ty0 = (t / tiles_x) * BRUSH_TILE;
+    const int tx1 = MIN(tx0 + BRUSH_TILE, bw) - 1;
+    const int ty1 = MIN(ty0 + BRUSH_TILE, bh) - 1;
+
+    for(int k = 0; k < nsegs; k++)
+    {
+      const _brush_segment_t sg = segs[k];
+      const int x0 = MAX(sg.xmin, tx0), x1 = MIN(sg.xmax, tx1);
+      const int y0 = MAX(sg.ymin, ty0), y1 = MIN(sg.ymax, ty1);
+      if(x0 > x1 || y0 > y1) continue;
+
+      const float soft = MAX(1.0f - sg.hardness, 1e-6f);
+      for(int y = y0; y <= y1; y++)
+      {
+        float *const row = buffer + (size_t)y * bw;
+        const float py = y - sg.y0;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+        for(int x = x0; x <= x1; x++)
+        {
+          const float px = x - sg.x0;
+          // the nearest point of the centre line and the radius there
+          float c = (px * sg.dx + py * sg.dy) * sg.inv_len2;
+          c = c < 0.0f ? 0.0f : (c > 1.0f ? 1.0f : c);
+          const float ex = px - c * sg.dx, ey = py - c * sg.dy;
+          const float r = sg.r0 + c * sg.dr;
+          const float u = sqrtf(ex * ex + ey * ey) / (r > 1e-6f ? r : 1e-6f);
+          const float ramp = (1.0f - u) / soft;
+          const float op = sg.density * (u <= sg.hardness ? 1.0f : (ramp > 0.0f ? ramp : 0.0f));
+          row[x] = row[x] > op ? row[x] : op;
+        }
+      }
+    }
   }
 }
 
@@ -2698,17 +2812,11 @@ static int dt_brush_get_mask(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *pi
   memset(*buffer, 0, bufsize);
 
   // now we fill the falloff
-  int p0[2], p1[2];
-
-  for(int i = nb_corner * 3; i < border_count; i++)
-  {
-    p0[0] = points[i * 2];
-    p0[1] = points[i * 2 + 1];
-    p1[0] = border[i * 2];
-    p1[1] = border[i * 2 + 1];
-
-    _brush_falloff(buffer, p0, p1, *posx, *posy, *width, payload[i * 2], payload[i * 2 + 1]);
-  }
+  _brush_segment_t *segs = NULL;
+  const int nsegs = _brush_segments(points, border, payload, nb_corner * 3, border_count, *posx, *posy, *width,
+                                    *height, &segs);
+  if(nsegs > 0) _brush_render(*buffer, *width, *height, segs, nsegs);
+  free(segs);
 
   dt_free_align(points);
   dt_free_align(border);
@@ -2721,49 +2829,6 @@ static int dt_brush_get_mask(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *pi
   return 1;
 }
 
-/** we write a falloff segment respecting limits of buffer */
-static inline void _brush_falloff_roi(float *buffer, const int *p0, const int *p1, int bw, int bh, float hardness,
-                                      float density)
-{
-  // segment length (increase by 1 to avoid division-by-zero special case handling)
-  const int l = sqrt((p1[0] - p0[0]) * (p1[0] - p0[0]) + (p1[1] - p0[1]) * (p1[1] - p0[1])) + 1;
-  const int solid = hardness * l;
-
-  const float lx = (float)(p1[0] - p0[0]) / (float)l;
-  const float ly = (float)(p1[1] - p0[1]) / (float)l;
-
-  const int dx = lx <= 0 ? -1 : 1;
-  const int dy = ly <= 0 ? -1 : 1;
-  const int dpx = dx;
-  const int dpy = dy * bw;
-
-  float fx = p0[0];
-  float fy = p0[1];
-
-  float op = density;
-  float dop = density / (float)(l - solid);
-
-  for(int i = 0; i < l; i++)
-  {
-    const int x = fx;
-    const int y = fy;
-
-    fx += lx;
-    fy += ly;
-    if(i > solid) op -= dop;
-
-    if(x < 0 || x >= bw || y < 0 || y >= bh) continue;
-
-    float *buf = buffer + (size_t)y * bw + x;
-
-    *buf = MAX(*buf, op);
-    if(x + dx >= 0 && x + dx < bw)
-      buf[dpx] = MAX(buf[dpx], op); // this one is to avoid gaps due to int rounding
-    if(y + dy >= 0 && y + dy < bh)
-      buf[dpy] = MAX(buf[dpy], op); // this one is to avoid gaps due to int rounding
-  }
-}
-
 static int dt_brush_get_mask_roi(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece,
                                  dt_masks_form_t *form, const dt_iop_roi_t *roi, float *buffer)
 {
@@ -2858,26 +2923,11 @@ static int dt_brush_get_mask_roi(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t
   }
 
   // now we fill the falloff
-#ifdef _OPENMP
-#if !defined(__SUNOS__) && !defined(__NetBSD__)
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(nb_corner, border_count, width, height) \
-  shared(buffer, points, border, payload)
-#else
-#pragma omp parallel for shared(buffer)
-#endif
-#endif
-  for(int i = nb_corner * 3; i < border_count; i++)
-  {
-    const int p0[] = { points[i * 2], points[i * 2 + 1] };
-    const int p1[] = { border[i * 2], border[i * 2 + 1] };
-
-    if(MAX(p0[0], p1[0]) < 0 || MIN(p0[0], p1[0]) >= width || MAX(p0[1], p1[1]) < 0
-       || MIN(p0[1], p1[1]) >= height)
-      continue;
-
-    _brush_falloff_roi(buffer, p0, p1, width, height, payload[i * 2], payload[i * 2 + 1]);
-  }
+  _brush_segment_t *segs = NULL;
+  const int nsegs = _brush_segments(points, border, payload, nb_corner * 3, border_count, 0, 0, width, height,
+                                    &segs);
+  if(nsegs > 0) _brush_render(buffer, width, height, segs, nsegs);
+  free(segs);
 
   dt_free_align(points);
   dt_free_align(border);
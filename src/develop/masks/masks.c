@@ -860,8 +860,68 @@ int dt_masks_get_mask(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt
   return 0;
 }
 
-int dt_masks_get_mask_roi(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form,
-                          const dt_iop_roi_t *roi, float *buffer)
+// how many rasterised shapes a pipe keeps, the least recently used one goes first
+#define DT_MASKS_RASTER_CACHE_ENTRIES 16
+
+typedef struct dt_masks_raster_t
+{
+  uint64_t hash;
+  size_t size;
+  uint64_t used;
+  float *buffer;
+} dt_masks_raster_t;
+
+static void _masks_raster_free(dt_masks_raster_t *raster)
+{
+  dt_free_align(raster->buffer);
+  free(raster);
+}
+
+void dt_masks_raster_cache_cleanup(dt_dev_pixelpipe_t *pipe)
+{
+  g_list_free_full(pipe->mask_rasters, (void (*)(void *))_masks_raster_free);
+  pipe->mask_rasters = NULL;
+}
+
+// what the raster of a single shape depends on: the shape, the region, the size of the pipe input and the
+// distortions of the modules up to the one it is rendered for. the other modules of the pipe don't matter,
+// so a shape used by several modules is rasterised once and moving a shape only misses that shape.
+static uint64_t _masks_raster_hash(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece,
+                                   dt_masks_form_t *form, const dt_iop_roi_t *roi)
+{
+  dt_dev_pixelpipe_t *pipe = piece->pipe;
+  dt_develop_t *dev = module->dev;
+  uint64_t hash = 5381;
+
+  const int length = dt_masks_group_get_hash_buffer_length(form);
+  char *str = malloc(length);
+  if(!str) return 0;
+  dt_masks_group_get_hash_buffer(form, str);
+  for(int i = 0; i < length; i++) hash = ((hash << 5) + hash) ^ str[i];
+  free(str);
+
+  const char *r = (const char *)roi;
+  for(size_t i = 0; i < sizeof(dt_iop_roi_t); i++) hash = ((hash << 5) + hash) ^ r[i];
+  const float dims[] = { pipe->iwidth, pipe->iheight, pipe->iscale, dev->preview_downsampling };
+  r = (const char *)dims;
+  for(size_t i = 0; i < sizeof(dims); i++) hash = ((hash << 5) + hash) ^ r[i];
+
+  // the same modules as dt_dev_distort_backtransform_plus() with DT_DEV_TRANSFORM_DIR_BACK_INCL
+  GList *pieces = pipe->nodes;
+  for(GList *modules = pipe->iop; modules && pieces; modules = g_list_next(modules), pieces = g_list_next(pieces))
+  {
+    dt_iop_module_t *m = (dt_iop_module_t *)modules->data;
+    dt_dev_pixelpipe_iop_t *p = (dt_dev_pixelpipe_iop_t *)pieces->data;
+    if(m->iop_order > module->iop_order) continue;
+    if(!p->enabled || !dt_iop_is_distorting(m)) continue;
+    if(dev->gui_module && (dev->gui_module->operation_tags_filter() & m->operation_tags())) continue;
+    hash = ((hash << 5) + hash) ^ p->hash;
+  }
+  return hash;
+}
+
+static int _masks_get_shape_mask_roi(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece,
+                                     dt_masks_form_t *form, const dt_iop_roi_t *roi, float *buffer)
 {
   if(form->type & DT_MASKS_CIRCLE)
   {
@@ -871,10 +931,6 @@ int dt_masks_get_mask_roi(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece
   {
     return dt_path_get_mask_roi(module, piece, form, roi, buffer);
   }
-  else if(form->type & DT_MASKS_GROUP)
-  {
-    return dt_group_get_mask_roi(module, piece, form, roi, buffer);
-  }
   else if(form->type & DT_MASKS_GRADIENT)
   {
     return dt_gradient_get_mask_roi(module, piece, form, roi, buffer);
@@ -890,6 +946,59 @@ int dt_masks_get_mask_roi(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece
   return 0;
 }
 
+int dt_masks_get_mask_roi(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, dt_masks_form_t *form,
+                          const dt_iop_roi_t *roi, float *buffer)
+{
+  // groups are combined from the cached rasters of their shapes
+  if(form->type & DT_MASKS_GROUP) return dt_group_get_mask_roi(module, piece, form, roi, buffer);
+  if(!module || !piece) return _masks_get_shape_mask_roi(module, piece, form, roi, buffer);
+
+  dt_dev_pixelpipe_t *pipe = piece->pipe;
+  const size_t size = (size_t)roi->width * roi->height;
+  const uint64_t hash = _masks_raster_hash(module, piece, form, roi);
+  pipe->mask_rasters_clock++;
+
+  dt_masks_raster_t *oldest = NULL;
+  for(GList *l = pipe->mask_rasters; l; l = g_list_next(l))
+  {
+    dt_masks_raster_t *raster = (dt_masks_raster_t *)l->data;
+    if(raster->hash == hash && raster->size == size)
+    {
+      raster->used = pipe->mask_rasters_clock;
+      memcpy(buffer, raster->buffer, size * sizeof(float));
+      return 1;
+    }
+    if(!oldest || raster->used < oldest->used) oldest = raster;
+  }
+
+  const int ok = _masks_get_shape_mask_roi(module, piece, form, roi, buffer);
+  if(!ok || !hash) return ok;
+
+  // keep a copy, in place of the least recently used raster once there are enough
+  dt_masks_raster_t *raster = NULL;
+  if(g_list_length(pipe->mask_rasters) >= DT_MASKS_RASTER_CACHE_ENTRIES)
+  {
+    raster = oldest;
+    if(raster->size != size)
+    {
+      dt_free_align(raster->buffer);
+      raster->buffer = dt_alloc_align(64, size * sizeof(float));
+    }
+  }
+  else
+  {
+    raster = (dt_masks_raster_t *)calloc(1, sizeof(dt_masks_raster_t));
+    if(!raster) return ok;
+    raster->buffer = dt_alloc_align(64, size * sizeof(float));
+    pipe->mask_rasters = g_list_prepend(pipe->mask_rasters, raster);
+  }
+  raster->hash = raster->buffer ? hash : 0;
+  raster->size = raster->buffer ? size : 0;
+  raster->used = pipe->mask_rasters_clock;
+  if(raster->buffer) memcpy(raster->buffer, buffer, size * sizeof(float));
+  return ok;
+}
+
 int dt_masks_version(void)
 {
   return DEVELOP_MASKS_VERSION;
@@ -1286,6 +1395,118 @@ void dt_masks_replace_current_forms(dt_develop_t *dev, GList *forms)
   dev->forms = forms_tmp;
 }
 
+// true if both shapes have the same geometry. groups can't be compared on their own.
+static gboolean _masks_form_equal(dt_masks_form_t *a, dt_masks_form_t *b)
+{
+  if(!a || !b) return a == b;
+  const int len = dt_masks_group_get_hash_buffer_length(a);
+  if(len != dt_masks_group_get_hash_buffer_length(b)) return FALSE;
+  char *sa = malloc(len);
+  char *sb = malloc(len);
+  gboolean equal = FALSE;
+  if(sa && sb)
+  {
+    dt_masks_group_get_hash_buffer(a, sa);
+    dt_masks_group_get_hash_buffer(b, sb);
+    equal = !memcmp(sa, sb, len);
+  }
+  free(sa);
+  free(sb);
+  return equal;
+}
+
+static dt_masks_point_group_t *_masks_group_find(dt_masks_form_t *grp, const int formid)
+{
+  if(!grp) return NULL;
+  for(GList *pts = grp->points; pts; pts = g_list_next(pts))
+  {
+    dt_masks_point_group_t *pt = (dt_masks_point_group_t *)pts->data;
+    if(pt->formid == formid) return pt;
+  }
+  return NULL;
+}
+
+// adds the area of every shape of grp which isn't the same in other_grp to box
+static int _masks_group_changed_area(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece,
+                                     dt_masks_form_t *grp, GList *forms, dt_masks_form_t *other_grp,
+                                     GList *other_forms, float *box, gboolean *changed)
+{
+  if(!grp) return 0;
+  for(GList *pts = grp->points; pts; pts = g_list_next(pts))
+  {
+    dt_masks_point_group_t *pt = (dt_masks_point_group_t *)pts->data;
+    dt_masks_form_t *form = dt_masks_get_from_id_ext(forms, pt->formid);
+    if(!form) continue;
+    if(form->type & DT_MASKS_GROUP) return 1;
+
+    dt_masks_point_group_t *other_pt = _masks_group_find(other_grp, pt->formid);
+    if(other_pt)
+    {
+      // inverting a shape changes everything outside of it
+      if((pt->state ^ other_pt->state) & DT_MASKS_STATE_INVERSE) return 1;
+      if(pt->state == other_pt->state && pt->opacity == other_pt->opacity
+         && _masks_form_equal(form, dt_masks_get_from_id_ext(other_forms, pt->formid)))
+        continue;
+    }
+
+    int width, height, posx, posy;
+    if(!dt_masks_get_area(module, piece, form, &width, &height, &posx, &posy)) return 1;
+    box[0] = fminf(box[0], posx);
+    box[1] = fminf(box[1], posy);
+    box[2] = fmaxf(box[2], posx + width);
+    box[3] = fmaxf(box[3], posy + height);
+    *changed = TRUE;
+  }
+  return 0;
+}
+
+int dt_masks_get_changed_area(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, GList *old_forms,
+                              GList *new_forms, float *box)
+{
+  const dt_develop_blend_params_t *const bp = (const dt_develop_blend_params_t *)piece->blendop_data;
+  if(!bp) return 1;
+  dt_masks_form_t *old_grp = dt_masks_get_from_id_ext(old_forms, bp->mask_id);
+  dt_masks_form_t *new_grp = dt_masks_get_from_id_ext(new_forms, bp->mask_id);
+
+  box[0] = box[1] = FLT_MAX;
+  box[2] = box[3] = -FLT_MAX;
+  gboolean changed = FALSE;
+  // shapes which were removed or moved away, and the ones which were added or moved there
+  if(_masks_group_changed_area(module, piece, old_grp, old_forms, new_grp, new_forms, box, &changed)
+     || _masks_group_changed_area(module, piece, new_grp, new_forms, old_grp, old_forms, box, &changed))
+    return 1;
+  return changed ? 0 : 1;
+}
+
+int dt_masks_get_group_area(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, float *box)
+{
+  const dt_develop_blend_params_t *const bp = (const dt_develop_blend_params_t *)piece->blendop_data;
+  if(!bp) return 1;
+  dt_masks_form_t *grp = dt_masks_get_from_id_ext(piece->pipe->forms, bp->mask_id);
+  if(!grp || !(grp->type & DT_MASKS_GROUP) || !grp->points) return 1;
+
+  box[0] = box[1] = FLT_MAX;
+  box[2] = box[3] = -FLT_MAX;
+  for(GList *pts = grp->points; pts; pts = g_list_next(pts))
+  {
+    dt_masks_point_group_t *pt = (dt_masks_point_group_t *)pts->data;
+    // an inverted shape covers everything outside of it
+    if(pt->state & DT_MASKS_STATE_INVERSE) return 1;
+    dt_masks_form_t *form = dt_masks_get_from_id_ext(piece->pipe->forms, pt->formid);
+    if(!form) continue;
+    if(form->type & DT_MASKS_GROUP) return 1;
+
+    // every way of combining the shapes stays within their union
+    int width, height, posx, posy;
+    if(!dt_masks_get_area(module, piece, form, &width, &height, &posx, &posy)) return 1;
+    box[0] = fminf(box[0], posx);
+    box[1] = fminf(box[1], posy);
+    box[2] = fmaxf(box[2], posx + width);
+    box[3] = fmaxf(box[3], posy + height);
+  }
+  return 0;
+}
+
 dt_masks_form_t *dt_masks_get_from_id_ext(GList *forms, int id)
 {
   while(forms)
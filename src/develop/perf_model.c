@@ -0,0 +1,291 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "develop/perf_model.h"
+#include "common/darktable.h"
+#include "common/file_location.h"
+#include "common/opencl.h"
+#include "control/conf.h"
+
+#include <glib/gstdio.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+// sums for a least squares fit of seconds = a * size + b, size in megapixels or megabytes
+typedef struct dt_perf_model_fit_t
+{
+  double n, sx, sy, sxx, sxy;
+  int declined; // runs kept off this device since it was last measured, not stored
+} dt_perf_model_fit_t;
+
+static struct
+{
+  dt_pthread_mutex_t lock;
+  GHashTable *fits; // "<op>@<device>" or "@transfer@<device>" -> dt_perf_model_fit_t
+  gboolean enabled;
+  gboolean dirty;
+} _model = { .fits = NULL };
+
+// runs needed before a prediction is made
+#define DT_PERF_MODEL_MIN_RUNS 3
+// older runs count less, so the model follows driver updates and changed settings
+#define DT_PERF_MODEL_MAX_RUNS 50.0
+// only move a module off the device if the CPU is clearly faster
+#define DT_PERF_MODEL_HYSTERESIS 0.8
+// a module kept on the CPU runs on the device again after this many runs, so a device which got faster, or
+// whose single slow run was an outlier, gets measured again
+#define DT_PERF_MODEL_RESAMPLE 32
+
+static void _get_filename(char *filename, const size_t size)
+{
+  char configdir[PATH_MAX] = { 0 };
+  dt_loc_get_user_config_dir(configdir, sizeof(configdir));
+  snprintf(filename, size, "%s/performance-%s.txt", configdir, darktable_package_version);
+}
+
+static const char *_device_name(const int devid)
+{
+#ifdef HAVE_OPENCL
+  if(devid >= 0 && darktable.opencl->inited && devid < darktable.opencl->num_devs
+     && darktable.opencl->dev[devid].cname)
+    return darktable.opencl->dev[devid].cname;
+#endif
+  return "cpu";
+}
+
+static void _key(char *key, const size_t size, const char *op, const int devid)
+{
+  snprintf(key, size, "%s@%s", op, _device_name(devid));
+}
+
+void dt_perf_model_init(void)
+{
+  dt_pthread_mutex_init(&_model.lock, NULL);
+  _model.fits = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  _model.enabled = dt_conf_get_bool("opencl_scheduling_model");
+  _model.dirty = FALSE;
+
+  char filename[PATH_MAX] = { 0 };
+  _get_filename(filename, sizeof(filename));
+  FILE *f = g_fopen(filename, "rb");
+  if(!f) return;
+
+  // one line per module and device: <op>@<device> n sx sy sxx sxy
+  char line[512];
+  while(fgets(line, sizeof(line), f))
+  {
+    char key[256];
+    dt_perf_model_fit_t fit = { 0 };
+    if(sscanf(line, "%255s %lf %lf %lf %lf %lf", key, &fit.n, &fit.sx, &fit.sy, &fit.sxx, &fit.sxy) != 6
+       || fit.n <= 0.0)
+      continue;
+    g_hash_table_insert(_model.fits, g_strdup(key), g_memdup(&fit, sizeof(fit)));
+  }
+  fclose(f);
+}
+
+void dt_perf_model_cleanup(void)
+{
+  if(!_model.fits) return;
+
+  if(_model.dirty)
+  {
+    char filename[PATH_MAX] = { 0 };
+    _get_filename(filename, sizeof(filename));
+    FILE *f = g_fopen(filename, "wb");
+    if(f)
+    {
+      GHashTableIter iter;
+      gpointer key, value;
+      g_hash_table_iter_init(&iter, _model.fits);
+      while(g_hash_table_iter_next(&iter, &key, &value))
+      {
+        const dt_perf_model_fit_t *fit = (dt_perf_model_fit_t *)value;
+        fprintf(f, "%s %.17g %.17g %.17g %.17g %.17g\n", (const char *)key, fit->n, fit->sx, fit->sy, fit->sxx,
+                fit->sxy);
+      }
+      fclose(f);
+    }
+    else
+      fprintf(stderr, "[perf_model] can't write `%s'\n", filename);
+  }
+
+  g_hash_table_destroy(_model.fits);
+  _model.fits = NULL;
+  dt_pthread_mutex_destroy(&_model.lock);
+}
+
+gboolean dt_perf_model_enabled(void)
+{
+  return _model.enabled;
+}
+
+static void _record(const char *key, const double x, const double y)
+{
+  if(!_model.fits || x <= 0.0 || y <= 0.0) return;
+
+  dt_pthread_mutex_lock(&_model.lock);
+  dt_perf_model_fit_t *fit = g_hash_table_lookup(_model.fits, key);
+  if(!fit)
+  {
+    fit = g_malloc0(sizeof(dt_perf_model_fit_t));
+    g_hash_table_insert(_model.fits, g_strdup(key), fit);
+  }
+  else if(fit->n >= DT_PERF_MODEL_MAX_RUNS)
+  {
+    // scale down instead of keeping a window, this keeps the mean and the slope
+    const double w = (DT_PERF_MODEL_MAX_RUNS - 1.0) / fit->n;
+    fit->n *= w;
+    fit->sx *= w;
+    fit->sy *= w;
+    fit->sxx *= w;
+    fit->sxy *= w;
+  }
+  fit->n += 1.0;
+  fit->sx += x;
+  fit->sy += y;
+  fit->sxx += x * x;
+  fit->sxy += x * y;
+  _model.dirty = TRUE;
+  dt_pthread_mutex_unlock(&_model.lock);
+}
+
+static double _predict(const char *key, const double x)
+{
+  if(!_model.fits) return -1.0;
+
+  double y = -1.0;
+  dt_pthread_mutex_lock(&_model.lock);
+  const dt_perf_model_fit_t *fit = g_hash_table_lookup(_model.fits, key);
+  if(fit && fit->n >= DT_PERF_MODEL_MIN_RUNS)
+  {
+    const double mx = fit->sx / fit->n, my = fit->sy / fit->n;
+    const double var = fit->sxx / fit->n - mx * mx;
+    // runs of about the same size only tell the time per pixel
+    if(var > 0.01 * mx * mx)
+    {
+      const double slope = (fit->sxy / fit->n - mx * my) / var;
+      y = fmax(my + slope * (x - mx), 0.0);
+    }
+    else if(mx > 0.0)
+      y = my * x / mx;
+  }
+  dt_pthread_mutex_unlock(&_model.lock);
+  return y;
+}
+
+void dt_perf_model_record(const char *op, const int devid, const size_t pixels, const double seconds)
+{
+  char key[256];
+  _key(key, sizeof(key), op, devid);
+  _record(key, pixels / 1.0e6, seconds);
+}
+
+void dt_perf_model_record_transfer(const int devid, const size_t bytes, const double seconds)
+{
+  char key[256];
+  _key(key, sizeof(key), "@transfer", devid);
+  _record(key, bytes / (1024.0 * 1024.0), seconds);
+}
+
+double dt_perf_model_predict(const char *op, const int devid, const size_t pixels)
+{
+  char key[256];
+  _key(key, sizeof(key), op, devid);
+  return _predict(key, pixels / 1.0e6);
+}
+
+double dt_perf_model_predict_transfer(const int devid, const size_t bytes)
+{
+  char key[256];
+  _key(key, sizeof(key), "@transfer", devid);
+  return _predict(key, bytes / (1024.0 * 1024.0));
+}
+
+gboolean dt_perf_model_prefer_cpu(const char *op, const int devid, const size_t pixels, const size_t in_bytes,
+                                  const gboolean input_on_device, const gboolean resample)
+{
+  const double cpu = dt_perf_model_predict(op, -1, pixels);
+  const double gpu = dt_perf_model_predict(op, devid, pixels);
+  const double transfer = dt_perf_model_predict_transfer(devid, in_bytes);
+  if(cpu < 0.0 || gpu < 0.0 || transfer < 0.0) return FALSE;
+
+  const double t_cpu = cpu + (input_on_device ? transfer : 0.0);
+  const double t_gpu = gpu + (input_on_device ? 0.0 : transfer);
+  if(t_cpu >= DT_PERF_MODEL_HYSTERESIS * t_gpu) return FALSE;
+  if(!resample) return TRUE;
+
+  char key[256];
+  _key(key, sizeof(key), op, devid);
+  gboolean prefer = TRUE;
+  dt_pthread_mutex_lock(&_model.lock);
+  dt_perf_model_fit_t *fit = g_hash_table_lookup(_model.fits, key);
+  if(fit && ++fit->declined >= DT_PERF_MODEL_RESAMPLE)
+  {
+    fit->declined = 0;
+    prefer = FALSE;
+  }
+  dt_pthread_mutex_unlock(&_model.lock);
+  return prefer;
+}
+
+float dt_perf_model_device_score(const int devid)
+{
+  if(!_model.fits || devid < 0) return 0.0f;
+
+  char suffix[128];
+  snprintf(suffix, sizeof(suffix), "@%s", _device_name(devid));
+
+  // collect the modules first, predicting takes the lock
+  GList *ops = NULL;
+  dt_pthread_mutex_lock(&_model.lock);
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init(&iter, _model.fits);
+  while(g_hash_table_iter_next(&iter, &key, &value))
+  {
+    const char *k = (const char *)key;
+    const dt_perf_model_fit_t *fit = (dt_perf_model_fit_t *)value;
+    if(k[0] != '@' && g_str_has_suffix(k, suffix) && fit->n > 0.0)
+      ops = g_list_prepend(ops, g_strndup(k, strlen(k) - strlen(suffix)));
+  }
+  dt_pthread_mutex_unlock(&_model.lock);
+
+  // geometric mean of the time ratios at a full hd image
+  const size_t pixels = 1920 * 1080;
+  double sum = 0.0;
+  int count = 0;
+  for(GList *l = ops; l; l = g_list_next(l))
+  {
+    const double gpu = dt_perf_model_predict((const char *)l->data, devid, pixels);
+    const double cpu = dt_perf_model_predict((const char *)l->data, -1, pixels);
+    if(gpu > 0.0 && cpu > 0.0)
+    {
+      sum += log(gpu / cpu);
+      count++;
+    }
+  }
+  g_list_free_full(ops, g_free);
+  return count ? (float)exp(sum / count) : 0.0f;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
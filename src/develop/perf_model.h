@@ -0,0 +1,63 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <glib.h>
+#include <stddef.h>
+
+/**
+ * performance model for OpenCL scheduling. the pixelpipe records how long every module takes on the CPU and
+ * on each OpenCL device for the number of pixels it processed, and how fast host/device transfers are. a
+ * linear fit over these runs predicts the time of the next run, so the pipe can keep a module on the CPU
+ * if that is faster including transfers, and dt_opencl_lock_device() can try the devices that have been
+ * fastest so far first. the runs are kept in performance-<version>.txt in the user config directory,
+ * devices are told apart by their canonical name.
+ *
+ * devid -1 stands for the CPU.
+ */
+
+void dt_perf_model_init(void);
+/** writes back the runs if there are new ones. */
+void dt_perf_model_cleanup(void);
+/** true if predictions are used for scheduling, set by the opencl_scheduling_model conf key. */
+gboolean dt_perf_model_enabled(void);
+
+/** records a module run which processed the given number of output pixels. */
+void dt_perf_model_record(const char *op, const int devid, const size_t pixels, const double seconds);
+/** records a blocking transfer between host and device. */
+void dt_perf_model_record_transfer(const int devid, const size_t bytes, const double seconds);
+
+/** predicted seconds of a module run, negative if there are not enough runs to tell. */
+double dt_perf_model_predict(const char *op, const int devid, const size_t pixels);
+/** predicted seconds of a host/device transfer, negative if unknown. */
+double dt_perf_model_predict_transfer(const int devid, const size_t bytes);
+
+/** true if the module is predicted to finish sooner on the CPU than on the device, counting the transfer
+    of its input to wherever it is not yet. with resample, every so often it is false anyway, so the run on the
+    device is measured again. only pipes whose device runs get recorded should ask for that. */
+gboolean dt_perf_model_prefer_cpu(const char *op, const int devid, const size_t pixels, const size_t in_bytes,
+                                  const gboolean input_on_device, const gboolean resample);
+
+/** time of the device relative to the CPU over the modules measured on both, lower is faster. 0 if
+    unknown. */
+float dt_perf_model_device_score(const int devid);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -17,10 +17,14 @@
 */
 
 #include "develop/pixelpipe_cache.h"
+#include "common/image_compression.h"
+#include "common/memory_governor.h"
 #include "develop/format.h"
 #include "develop/pixelpipe_hb.h"
 #include "libs/lib.h"
+#include <float.h>
 #include <stdlib.h>
+#include <string.h>
 
 
 // TODO: make cache global (needs to be thread safe then)
@@ -32,34 +36,129 @@
 //   ping, pong, and priority buffer (focused plugin)
 // - drop read by the time another is requested (with priority, drop that, or alternating ping and pong?)
 
-int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, size_t size)
+#define DT_PIXELPIPE_CACHE_INVALID ((uint64_t)-1)
+
+static inline gpointer _cache_key(const uint64_t hash)
+{
+  // we only support 64-bit platforms, so the hash fits into a pointer
+  return GSIZE_TO_POINTER(hash);
+}
+
+static void _cache_line_init(dt_dev_pixelpipe_cache_t *cache, const int32_t k)
 {
-  cache->entries = entries;
-  cache->data = (void **)calloc(entries, sizeof(void *));
-  cache->size = (size_t *)calloc(entries, sizeof(size_t));
-  cache->dsc = (dt_iop_buffer_dsc_t *)calloc(entries, sizeof(dt_iop_buffer_dsc_t));
+  cache->data[k] = NULL;
+  cache->size[k] = 0;
+  cache->hash[k] = DT_PIXELPIPE_CACHE_INVALID;
+  cache->used[k] = 0;
+  cache->cost[k] = 0.0f;
+  cache->priority[k] = 0.0;
+  cache->half[k] = FALSE;
 #ifdef _DEBUG
-  memset(cache->dsc, 0x2c, sizeof(dt_iop_buffer_dsc_t) * entries);
+  memset(&cache->dsc[k], 0x2c, sizeof(dt_iop_buffer_dsc_t));
+#else
+  memset(&cache->dsc[k], 0, sizeof(dt_iop_buffer_dsc_t));
 #endif
-  cache->hash = (uint64_t *)calloc(entries, sizeof(uint64_t));
-  cache->used = (int32_t *)calloc(entries, sizeof(int32_t));
+}
+
+// make room in the line arrays for at least n lines
+static int _cache_reserve(dt_dev_pixelpipe_cache_t *cache, const int32_t n)
+{
+  if(n <= cache->allocated) return 1;
+  const int32_t alloc = MAX(n, 2 * cache->allocated);
+
+  void **data = (void **)realloc(cache->data, alloc * sizeof(void *));
+  if(!data) return 0;
+  cache->data = data;
+  size_t *size = (size_t *)realloc(cache->size, alloc * sizeof(size_t));
+  if(!size) return 0;
+  cache->size = size;
+  dt_iop_buffer_dsc_t *dsc = (dt_iop_buffer_dsc_t *)realloc(cache->dsc, alloc * sizeof(dt_iop_buffer_dsc_t));
+  if(!dsc) return 0;
+  cache->dsc = dsc;
+  uint64_t *hash = (uint64_t *)realloc(cache->hash, alloc * sizeof(uint64_t));
+  if(!hash) return 0;
+  cache->hash = hash;
+  uint64_t *used = (uint64_t *)realloc(cache->used, alloc * sizeof(uint64_t));
+  if(!used) return 0;
+  cache->used = used;
+  float *cost = (float *)realloc(cache->cost, alloc * sizeof(float));
+  if(!cost) return 0;
+  cache->cost = cost;
+  double *priority = (double *)realloc(cache->priority, alloc * sizeof(double));
+  if(!priority) return 0;
+  cache->priority = priority;
+  gboolean *half = (gboolean *)realloc(cache->half, alloc * sizeof(gboolean));
+  if(!half) return 0;
+  cache->half = half;
+
+  // note that the dsc pointers handed out to the pipe stay valid only until the next query,
+  // exactly as before, so moving the arrays around is fine.
+  cache->allocated = alloc;
+  return 1;
+}
+
+static size_t _governor_usage(gpointer user_data)
+{
+  return ((dt_dev_pixelpipe_cache_t *)user_data)->allocmem;
+}
+
+// the lines belong to the thread running the pipe, they are dropped by its next query against the lower limit
+static size_t _governor_shrink(gpointer user_data, const size_t bytes)
+{
+  dt_dev_pixelpipe_cache_t *cache = (dt_dev_pixelpipe_cache_t *)user_data;
+  const size_t allocmem = cache->allocmem;
+  const size_t limit = allocmem > bytes ? allocmem - bytes : 0;
+  if(limit >= cache->memlimit) return 0;
+  cache->memlimit = limit;
+  return allocmem - limit;
+}
+
+static void _governor_relax(gpointer user_data)
+{
+  dt_dev_pixelpipe_cache_t *cache = (dt_dev_pixelpipe_cache_t *)user_data;
+  cache->memlimit = cache->budget;
+}
+
+int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, size_t size, size_t memlimit)
+{
+  cache->entries = 0;
+  cache->min_entries = entries;
+  cache->allocated = 0;
+  cache->data = NULL;
+  cache->size = NULL;
+  cache->dsc = NULL;
+  cache->hash = NULL;
+  cache->used = NULL;
+  cache->cost = NULL;
+  cache->priority = NULL;
+  cache->half = NULL;
+  cache->lines = g_hash_table_new(g_direct_hash, g_direct_equal);
+  cache->last_line = -1;
+  cache->memlimit = cache->budget = dt_memory_governor_limit("pixelpipe", memlimit);
+  cache->allocmem = 0;
+  cache->inflation = 0.0;
+  cache->queries = cache->misses = 0;
+
+  if(!_cache_reserve(cache, MAX(entries, 1))) return 0;
+  if(cache->budget)
+    dt_memory_governor_register("pixelpipe", _governor_usage, _governor_shrink, _governor_relax, cache);
+
   for(int k = 0; k < entries; k++)
   {
-    cache->size[k] = size;
+    _cache_line_init(cache, k);
+    cache->entries++;
     if(size)
     { // allow 0 initial buffer size (yet unknown dimensions)
       cache->data[k] = (void *)dt_alloc_align(64, size);
       if(!cache->data[k]) goto alloc_memory_fail;
+      cache->size[k] = size;
+      cache->allocmem += size;
 #ifdef _DEBUG
       memset(cache->data[k], 0x5d, size);
 #endif
       ASAN_POISON_MEMORY_REGION(cache->data[k], cache->size[k]);
     }
-    else cache->data[k] = 0;
-    cache->hash[k] = -1;
-    cache->used[k] = 0;
   }
-  cache->queries = cache->misses = 0;
   return 1;
 
 alloc_memory_fail:
@@ -74,67 +173,287 @@ alloc_memory_fail:
     cache->size[k] = 0;
     cache->data[k] = NULL;
   }
+  cache->allocmem = 0;
   return 0;
 }
 
 void dt_dev_pixelpipe_cache_cleanup(dt_dev_pixelpipe_cache_t *cache)
 {
+  dt_memory_governor_unregister(cache);
   for(int k = 0; k < cache->entries; k++) dt_free_align(cache->data[k]);
   free(cache->data);
   free(cache->dsc);
   free(cache->hash);
   free(cache->used);
   free(cache->size);
+  free(cache->cost);
+  free(cache->priority);
+  free(cache->half);
+  if(cache->lines) g_hash_table_destroy(cache->lines);
+  cache->lines = NULL;
+  cache->data = NULL;
+  cache->entries = cache->allocated = 0;
+  cache->allocmem = 0;
 }
 
-uint64_t dt_dev_pixelpipe_cache_hash(int imgid, const dt_iop_roi_t *roi, dt_dev_pixelpipe_t *pipe, int module)
+// the rounds of xxhash64, on 8 bytes at a time
+#define DT_HASH_PRIME1 0x9E3779B185EBCA87ULL
+#define DT_HASH_PRIME2 0xC2B2AE3D27D4EB4FULL
+#define DT_HASH_PRIME3 0x165667B19E3779F9ULL
+#define DT_HASH_PRIME4 0x85EBCA77C2B2AE63ULL
+
+static inline uint64_t _hash_rotl(const uint64_t x, const int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t _hash_round(uint64_t hash, const uint64_t v)
+{
+  hash ^= _hash_rotl(v * DT_HASH_PRIME2, 31) * DT_HASH_PRIME1;
+  return _hash_rotl(hash, 27) * DT_HASH_PRIME1 + DT_HASH_PRIME4;
+}
+
+static inline uint64_t _hash_avalanche(uint64_t hash)
+{
+  hash ^= hash >> 33;
+  hash *= DT_HASH_PRIME2;
+  hash ^= hash >> 29;
+  hash *= DT_HASH_PRIME3;
+  return hash ^ (hash >> 32);
+}
+
+uint64_t dt_dev_pixelpipe_cache_hash_data(uint64_t hash, const void *data, const size_t size)
+{
+  const uint8_t *const bytes = (const uint8_t *)data;
+  size_t i = 0;
+  for(; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+  {
+    uint64_t v;
+    memcpy(&v, bytes + i, sizeof(uint64_t));
+    hash = _hash_round(hash, v);
+  }
+  if(i < size)
+  {
+    uint64_t v = 0;
+    memcpy(&v, bytes + i, size - i);
+    hash = _hash_round(hash, v);
+  }
+  return _hash_avalanche(hash ^ size);
+}
+
+static inline uint64_t _stack_hash_seed(const int imgid, const dt_dev_pixelpipe_t *pipe)
 {
-  // bernstein hash (djb2)
   // the hash is made of imgid and the actual fast-pipe mode if activated
-  uint64_t hash = 5381 + imgid + (pipe->type & DT_DEV_PIXELPIPE_FAST);
-  // go through all modules up to module and compute a weird hash using the operation and params.
-  GList *pieces = pipe->nodes;
-  for(int k = 0; k < module && pieces; k++)
-  {
-    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)pieces->data;
-    dt_develop_t *dev = piece->module->dev;
-    if(!(dev->gui_module && (dev->gui_module->operation_tags_filter() & piece->module->operation_tags())))
+  return _hash_round(_hash_round(DT_HASH_PRIME3, (uint64_t)imgid), pipe->type & DT_DEV_PIXELPIPE_FAST);
+}
+
+// adds a node to the hash of the stack before it, using the operation and params.
+static inline uint64_t _stack_hash_piece(uint64_t hash, const dt_dev_pixelpipe_iop_t *piece)
+{
+  const dt_develop_t *dev = piece->module->dev;
+  if(dev->gui_module && (dev->gui_module->operation_tags_filter() & piece->module->operation_tags()))
+    return hash;
+
+  hash = _hash_round(hash, piece->hash);
+  if(piece->module->request_color_pick != DT_REQUEST_COLORPICK_OFF)
+  {
+    if(darktable.lib->proxy.colorpicker.size)
+      hash = dt_dev_pixelpipe_cache_hash_data(hash, piece->module->color_picker_box, sizeof(float) * 4);
+    else
+      hash = dt_dev_pixelpipe_cache_hash_data(hash, piece->module->color_picker_point, sizeof(float) * 2);
+  }
+  return hash;
+}
+
+void dt_dev_pixelpipe_cache_update_hashes(dt_dev_pixelpipe_t *pipe)
+{
+  const int count = g_list_length(pipe->nodes) + 1;
+  if(pipe->stack_hash_count != count)
+  {
+    free(pipe->stack_hash);
+    pipe->stack_hash = (uint64_t *)malloc(sizeof(uint64_t) * count);
+    pipe->stack_hash_count = pipe->stack_hash ? count : 0;
+    if(!pipe->stack_hash) return;
+  }
+
+  uint64_t hash = pipe->stack_hash[0] = _stack_hash_seed(pipe->image.id, pipe);
+  int k = 1;
+  for(const GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes), k++)
+    pipe->stack_hash[k] = hash = _stack_hash_piece(hash, (const dt_dev_pixelpipe_iop_t *)nodes->data);
+}
+
+uint64_t dt_dev_pixelpipe_cache_hash(int imgid, const dt_iop_roi_t *roi, dt_dev_pixelpipe_t *pipe, int module)
+{
+  const uint64_t seed = _stack_hash_seed(imgid, pipe);
+  uint64_t hash = seed;
+  if(pipe->stack_hash && pipe->stack_hash[0] == seed && module >= 0 && module < pipe->stack_hash_count)
+    hash = pipe->stack_hash[module];
+  else
+  {
+    // go through all modules up to module
+    GList *pieces = pipe->nodes;
+    for(int k = 0; k < module && pieces; k++, pieces = g_list_next(pieces))
+      hash = _stack_hash_piece(hash, (const dt_dev_pixelpipe_iop_t *)pieces->data);
+  }
+  // also add scale, x and y:
+  return dt_dev_pixelpipe_cache_hash_data(hash, roi, sizeof(dt_iop_roi_t));
+}
+
+static inline int32_t _cache_lookup(const dt_dev_pixelpipe_cache_t *cache, const uint64_t hash)
+{
+  if(hash == DT_PIXELPIPE_CACHE_INVALID) return -1;
+  return GPOINTER_TO_INT(g_hash_table_lookup(cache->lines, _cache_key(hash))) - 1;
+}
+
+static inline void _cache_unindex(dt_dev_pixelpipe_cache_t *cache, const int32_t k)
+{
+  if(cache->hash[k] != DT_PIXELPIPE_CACHE_INVALID
+     && _cache_lookup(cache, cache->hash[k]) == k)
+    g_hash_table_remove(cache->lines, _cache_key(cache->hash[k]));
+}
+
+static inline void _cache_index(dt_dev_pixelpipe_cache_t *cache, const int32_t k)
+{
+  if(cache->hash[k] != DT_PIXELPIPE_CACHE_INVALID)
+    g_hash_table_insert(cache->lines, _cache_key(cache->hash[k]), GINT_TO_POINTER(k + 1));
+}
+
+// greedy-dual-size: the value of a line is its cost to recompute per megabyte it occupies.
+static inline double _cache_value(const dt_dev_pixelpipe_cache_t *cache, const int32_t k)
+{
+  return cache->cost[k] * (double)(1 << 20) / MAX(cache->size[k], (size_t)1);
+}
+
+// expands a packed line back to floats. returns 1 if we are out of memory.
+static int _cache_expand(dt_dev_pixelpipe_cache_t *cache, const int32_t k)
+{
+  const size_t n = cache->size[k] / sizeof(uint16_t);
+  float *const out = (float *)dt_alloc_align(64, n * sizeof(float));
+  if(!out) return 1;
+  const uint16_t *const in = (const uint16_t *)cache->data[k];
+  ASAN_UNPOISON_MEMORY_REGION(cache->data[k], cache->size[k]);
+#ifdef _OPENMP
+#pragma omp parallel for simd default(none) \
+    dt_omp_firstprivate(in, out, n) \
+    schedule(static)
+#endif
+  for(size_t i = 0; i < n; i++) out[i] = dt_image_half_to_float(in[i]);
+
+  dt_free_align(cache->data[k]);
+  cache->allocmem += n * sizeof(float) - cache->size[k];
+  cache->data[k] = out;
+  cache->size[k] = n * sizeof(float);
+  cache->half[k] = FALSE;
+  return 0;
+}
+
+static inline void _cache_touch(dt_dev_pixelpipe_cache_t *cache, const int32_t k, const int weight)
+{
+  // negative weights protect the line from eviction for that many queries
+  cache->used[k] = weight < 0 ? cache->queries - weight : 0;
+  cache->priority[k] = cache->inflation + _cache_value(cache, k);
+  cache->last_line = k;
+}
+
+// find the line with the lowest priority. the line returned by the previous query is never chosen,
+// it is most likely the input of the module asking for an output buffer. protected lines are only
+// considered if allowed and there is nothing else left.
+static int32_t _cache_victim(const dt_dev_pixelpipe_cache_t *cache, const int32_t exclude,
+                             const gboolean allow_protected)
+{
+  int32_t victim = -1, fallback = -1;
+  double min = DBL_MAX, min_fallback = DBL_MAX;
+  for(int32_t k = 0; k < cache->entries; k++)
+  {
+    if(k == cache->last_line || k == exclude) continue;
+    // invalid lines go first
+    const double prio = cache->hash[k] == DT_PIXELPIPE_CACHE_INVALID ? -DBL_MAX : cache->priority[k];
+    if(cache->used[k] > cache->queries)
     {
-      hash = ((hash << 5) + hash) ^ piece->hash;
-      if(piece->module->request_color_pick != DT_REQUEST_COLORPICK_OFF)
+      if(prio < min_fallback || fallback < 0)
       {
-        if(darktable.lib->proxy.colorpicker.size)
-        {
-          const char *str = (const char *)piece->module->color_picker_box;
-          for(size_t i = 0; i < sizeof(float) * 4; i++) hash = ((hash << 5) + hash) ^ str[i];
-        }
-        else
-        {
-          const char *str = (const char *)piece->module->color_picker_point;
-          for(size_t i = 0; i < sizeof(float) * 2; i++) hash = ((hash << 5) + hash) ^ str[i];
-        }
+        min_fallback = prio;
+        fallback = k;
       }
     }
-    pieces = g_list_next(pieces);
+    else if(prio < min || victim < 0)
+    {
+      min = prio;
+      victim = k;
+    }
   }
-  // also add scale, x and y:
-  const char *str = (const char *)roi;
-  for(size_t i = 0; i < sizeof(dt_iop_roi_t); i++) hash = ((hash << 5) + hash) ^ str[i];
-  return hash;
+  return (victim < 0 && allow_protected) ? fallback : victim;
+}
+
+// remove a line completely, the last line takes its place
+static void _cache_drop(dt_dev_pixelpipe_cache_t *cache, const int32_t k)
+{
+  _cache_unindex(cache, k);
+  dt_free_align(cache->data[k]);
+  cache->allocmem -= cache->size[k];
+
+  const int32_t last = cache->entries - 1;
+  if(k != last)
+  {
+    cache->data[k] = cache->data[last];
+    cache->size[k] = cache->size[last];
+    cache->dsc[k] = cache->dsc[last];
+    cache->hash[k] = cache->hash[last];
+    cache->used[k] = cache->used[last];
+    cache->cost[k] = cache->cost[last];
+    cache->priority[k] = cache->priority[last];
+    cache->half[k] = cache->half[last];
+    _cache_index(cache, k);
+  }
+  if(cache->last_line == last) cache->last_line = k;
+  else if(cache->last_line == k) cache->last_line = -1;
+  cache->entries--;
+}
+
+// returns a line to store a new buffer of the given size in, or -1 if we are out of memory.
+static int32_t _cache_get_line(dt_dev_pixelpipe_cache_t *cache, const size_t size, const gboolean allow_protected)
+{
+  int32_t k = -1;
+  // grow the cache as long as we stay within budget
+  if(cache->entries >= cache->min_entries && cache->allocmem + size > cache->memlimit)
+    k = _cache_victim(cache, -1, allow_protected);
+
+  if(k < 0)
+  {
+    if(!_cache_reserve(cache, cache->entries + 1)) return _cache_victim(cache, -1, allow_protected);
+    k = cache->entries++;
+    _cache_line_init(cache, k);
+    return k;
+  }
+
+  if(cache->hash[k] != DT_PIXELPIPE_CACHE_INVALID) cache->inflation = MAX(cache->inflation, cache->priority[k]);
+
+  // drop more lines until the reused one fits into the budget
+  size_t needed = cache->allocmem + (size > cache->size[k] ? size - cache->size[k] : 0);
+  while(cache->entries > cache->min_entries && needed > cache->memlimit)
+  {
+    const int32_t v = _cache_victim(cache, k, FALSE);
+    if(v < 0) break;
+    if(cache->hash[v] != DT_PIXELPIPE_CACHE_INVALID)
+      cache->inflation = MAX(cache->inflation, cache->priority[v]);
+    needed -= cache->size[v];
+    const int32_t last = cache->entries - 1;
+    _cache_drop(cache, v);
+    if(k == last) k = v;
+  }
+  return k;
 }
 
 int dt_dev_pixelpipe_cache_available(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash)
 {
   // search for hash in cache
-  for(int32_t k = 0; k < cache->entries; k++)
-    if(cache->hash[k] == hash) return 1;
-  return 0;
+  return _cache_lookup(cache, hash) >= 0;
 }
 
 int dt_dev_pixelpipe_cache_get_important(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash, const size_t size,
                                          void **data, dt_iop_buffer_dsc_t **dsc)
 {
-  return dt_dev_pixelpipe_cache_get_weighted(cache, hash, size, data, dsc, -cache->entries);
+  return dt_dev_pixelpipe_cache_get_weighted(cache, hash, size, data, dsc, -MAX(cache->entries, cache->min_entries));
 }
 
 int dt_dev_pixelpipe_cache_get(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash, const size_t size,
@@ -143,72 +462,178 @@ int dt_dev_pixelpipe_cache_get(dt_dev_pixelpipe_cache_t *cache, const uint64_t h
   return dt_dev_pixelpipe_cache_get_weighted(cache, hash, size, data, dsc, 0);
 }
 
-int dt_dev_pixelpipe_cache_get_weighted(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash, const size_t size,
-                                        void **data, dt_iop_buffer_dsc_t **dsc, int weight)
+static int _cache_get(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash, const size_t size, void **data,
+                      dt_iop_buffer_dsc_t **dsc, const int weight, const gboolean allow_protected)
 {
   cache->queries++;
   *data = NULL;
-  int max_used = -1, max = 0;
-  size_t sz = 0;
-  for(int k = 0; k < cache->entries; k++)
-  {
-    // search for hash in cache
-    if(cache->used[k] > max_used)
-    {
-      max_used = cache->used[k];
-      max = k;
-    }
-    cache->used[k]++; // age all entries
-    if(cache->hash[k] == hash)
-    {
-      *data = cache->data[k];
-      *dsc = &cache->dsc[k];
-      sz = cache->size[k];
-      cache->used[k] = weight; // this is the MRU entry
 
-      ASAN_POISON_MEMORY_REGION(*data, sz);
-      ASAN_UNPOISON_MEMORY_REGION(*data, size);
-    }
-  }
-
-  if(!*data || sz < size)
+  const int32_t found = _cache_lookup(cache, hash);
+  const size_t found_size = found < 0 ? 0 : cache->half[found] ? 2 * cache->size[found] : cache->size[found];
+  // if a packed line can't be expanded, it is recomputed like a miss
+  if(found >= 0 && found_size >= size && (!cache->half[found] || !_cache_expand(cache, found)))
   {
-    // kill LRU entry
-    // printf("[pixelpipe_cache_get] hash not found, returning slot %d/%d age %d\n", max, cache->entries,
-    // weight);
-    if(cache->size[max] < size)
-    {
-      dt_free_align(cache->data[max]);
-      cache->data[max] = (void *)dt_alloc_align(64, size);
-      cache->size[max] = size;
-    }
-    *data = cache->data[max];
-    sz = cache->size[max];
+    *data = cache->data[found];
+    *dsc = &cache->dsc[found];
+    _cache_touch(cache, found, weight); // this is the MRU entry
 
-    ASAN_POISON_MEMORY_REGION(*data, sz);
+    ASAN_POISON_MEMORY_REGION(*data, cache->size[found]);
     ASAN_UNPOISON_MEMORY_REGION(*data, size);
+    return 0;
+  }
 
-    // first, update our copy, then update the pointer to point at our copy
-    cache->dsc[max] = **dsc;
-    *dsc = &cache->dsc[max];
-
-    cache->hash[max] = hash;
-    cache->used[max] = weight;
+  // hash not found (or the line is too small): reuse that line, or get a new one
+  const int32_t k = found >= 0 ? found : _cache_get_line(cache, size, allow_protected);
+  if(k < 0)
+  {
     cache->misses++;
     return 1;
   }
-  else
-    return 0;
+  // printf("[pixelpipe_cache_get] hash not found, returning slot %d/%d age %d\n", k, cache->entries,
+  // weight);
+  _cache_unindex(cache, k);
+
+  if(cache->size[k] < size)
+  {
+    dt_free_align(cache->data[k]);
+    cache->allocmem -= cache->size[k];
+    cache->data[k] = (void *)dt_alloc_align(64, size);
+    cache->size[k] = cache->data[k] ? size : 0;
+    cache->allocmem += cache->size[k];
+  }
+  cache->half[k] = FALSE;
+  *data = cache->data[k];
+
+  ASAN_POISON_MEMORY_REGION(*data, cache->size[k]);
+  ASAN_UNPOISON_MEMORY_REGION(*data, size);
+
+  // first, update our copy, then update the pointer to point at our copy
+  cache->dsc[k] = **dsc;
+  *dsc = &cache->dsc[k];
+
+  cache->hash[k] = hash;
+  cache->cost[k] = 0.0f; // not known yet, see dt_dev_pixelpipe_cache_set_cost()
+  _cache_index(cache, k);
+  _cache_touch(cache, k, weight);
+  cache->misses++;
+  return 1;
+}
+
+int dt_dev_pixelpipe_cache_get_weighted(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash, const size_t size,
+                                        void **data, dt_iop_buffer_dsc_t **dsc, int weight)
+{
+  return _cache_get(cache, hash, size, data, dsc, weight, TRUE);
+}
+
+static inline int32_t _cache_find(const dt_dev_pixelpipe_cache_t *cache, const void *data)
+{
+  if(!data) return -1;
+  for(int32_t k = 0; k < cache->entries; k++)
+    if(cache->data[k] == data) return k;
+  return -1;
+}
+
+int dt_dev_pixelpipe_cache_get_derived(dt_dev_pixelpipe_cache_t *cache, const void *source, const uint64_t key,
+                                       const void *keep, const size_t size, void **data,
+                                       dt_iop_buffer_dsc_t **dsc)
+{
+  *data = NULL;
+  const int32_t s = _cache_find(cache, source);
+  if(s < 0 || cache->hash[s] == DT_PIXELPIPE_CACHE_INVALID || cache->half[s]) return 1;
+
+  const uint64_t hash = dt_dev_pixelpipe_cache_hash_data(cache->hash[s], &key, sizeof(key));
+  // our copy, the line of the source may move while we look for room
+  dt_iop_buffer_dsc_t source_dsc = cache->dsc[s];
+  dt_iop_buffer_dsc_t *line_dsc = &source_dsc;
+
+  // the caller still reads source and keep, and the latest line has to stay the latest one for the next
+  // module of the pipe. protect them for this query only.
+  const int32_t k = _cache_find(cache, keep);
+  const uint64_t used_s = cache->used[s];
+  const uint64_t used_k = k >= 0 ? cache->used[k] : 0;
+  const void *const last = cache->last_line >= 0 ? cache->data[cache->last_line] : NULL;
+  cache->used[s] = UINT64_MAX;
+  if(k >= 0) cache->used[k] = UINT64_MAX;
+
+  const int ret = _cache_get(cache, hash, size, data, &line_dsc, 0, FALSE);
+  *dsc = *data ? line_dsc : NULL;
+
+  // lines are moved around when others are dropped
+  const int32_t ns = _cache_find(cache, source);
+  if(ns >= 0) cache->used[ns] = used_s;
+  const int32_t nk = _cache_find(cache, keep);
+  if(nk >= 0) cache->used[nk] = used_k;
+  const int32_t nl = _cache_find(cache, last);
+  if(nl >= 0) cache->last_line = nl;
+  return ret;
+}
+
+dt_iop_buffer_dsc_t *dt_dev_pixelpipe_cache_get_dsc(dt_dev_pixelpipe_cache_t *cache, const void *data)
+{
+  const int32_t k = _cache_find(cache, data);
+  return (k < 0 || cache->hash[k] == DT_PIXELPIPE_CACHE_INVALID) ? NULL : &cache->dsc[k];
+}
+
+void dt_dev_pixelpipe_cache_set_cost(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash, const float cost)
+{
+  const int32_t k = _cache_lookup(cache, hash);
+  if(k < 0) return;
+  cache->cost[k] = cost;
+  cache->priority[k] = cache->inflation + _cache_value(cache, k);
+}
+
+float dt_dev_pixelpipe_cache_get_cost(const dt_dev_pixelpipe_cache_t *cache, const void *data)
+{
+  const int32_t k = _cache_find(cache, data);
+  return k < 0 ? 0.0f : cache->cost[k];
 }
 
 void dt_dev_pixelpipe_cache_flush(dt_dev_pixelpipe_cache_t *cache)
 {
+  g_hash_table_remove_all(cache->lines);
   for(int k = 0; k < cache->entries; k++)
   {
-    cache->hash[k] = -1;
+    cache->hash[k] = DT_PIXELPIPE_CACHE_INVALID;
     cache->used[k] = 0;
+    cache->cost[k] = 0.0f;
+    cache->priority[k] = 0.0;
     ASAN_POISON_MEMORY_REGION(cache->data[k], cache->size[k]);
   }
+  cache->inflation = 0.0;
+  cache->last_line = -1;
+}
+
+void dt_dev_pixelpipe_cache_pack(dt_dev_pixelpipe_cache_t *cache, void *data)
+{
+  for(int k = 0; k < cache->entries; k++)
+  {
+    if(cache->data[k] != data) continue;
+    if(cache->half[k] || cache->hash[k] == DT_PIXELPIPE_CACHE_INVALID || k == cache->last_line) return;
+    if(cache->dsc[k].datatype != TYPE_FLOAT || cache->dsc[k].channels != 4) return;
+    if(cache->size[k] % (4 * sizeof(float))) return;
+
+    const size_t n = cache->size[k] / sizeof(float);
+    uint16_t *const out = (uint16_t *)dt_alloc_align(64, n * sizeof(uint16_t));
+    if(!out) return;
+    const float *const in = (const float *)cache->data[k];
+    ASAN_UNPOISON_MEMORY_REGION(cache->data[k], cache->size[k]);
+#ifdef _OPENMP
+#pragma omp parallel for simd default(none) \
+    dt_omp_firstprivate(in, out, n) \
+    schedule(static)
+#endif
+    for(size_t i = 0; i < n; i++) out[i] = dt_image_float_to_half(in[i]);
+
+    // the line costs the same to recompute but takes half the memory, so it is worth keeping longer
+    const double value = _cache_value(cache, k);
+    dt_free_align(cache->data[k]);
+    cache->allocmem -= cache->size[k] - n * sizeof(uint16_t);
+    cache->data[k] = out;
+    cache->size[k] = n * sizeof(uint16_t);
+    cache->half[k] = TRUE;
+    cache->priority[k] += _cache_value(cache, k) - value;
+    return;
+  }
 }
 
 void dt_dev_pixelpipe_cache_reweight(dt_dev_pixelpipe_cache_t *cache, void *data)
@@ -217,7 +642,7 @@ void dt_dev_pixelpipe_cache_reweight(dt_dev_pixelpipe_cache_t *cache, void *data
   {
     if(cache->data[k] == data)
     {
-      cache->used[k] = -cache->entries;
+      cache->used[k] = cache->queries + MAX(cache->entries, cache->min_entries);
     }
   }
 }
@@ -228,7 +653,8 @@ void dt_dev_pixelpipe_cache_invalidate(dt_dev_pixelpipe_cache_t *cache, void *da
   {
     if(cache->data[k] == data)
     {
-      cache->hash[k] = -1;
+      _cache_unindex(cache, k);
+      cache->hash[k] = DT_PIXELPIPE_CACHE_INVALID;
       ASAN_POISON_MEMORY_REGION(cache->data[k], cache->size[k]);
     }
   }
@@ -239,9 +665,11 @@ void dt_dev_pixelpipe_cache_print(dt_dev_pixelpipe_cache_t *cache)
   for(int k = 0; k < cache->entries; k++)
   {
     printf("pixelpipe cacheline %d ", k);
-    printf("used %d by %" PRIu64 "", cache->used[k], cache->hash[k]);
+    printf("used %" PRIu64 " by %" PRIu64 ", %zu bytes%s, cost %.3fs, priority %.3f", cache->used[k],
+           cache->hash[k], cache->size[k], cache->half[k] ? " (half)" : "", cache->cost[k], cache->priority[k]);
     printf("\n");
   }
+  printf("cache memory %zu of %zu bytes\n", cache->allocmem, cache->memlimit);
   printf("cache hit rate so far: %.3f\n", (cache->queries - cache->misses) / (float)cache->queries);
 }
 
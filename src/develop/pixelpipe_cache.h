@@ -18,6 +18,7 @@
 
 #pragma once
 
+#include <glib.h>
 #include <inttypes.h>
 
 struct dt_dev_pixelpipe_t;
@@ -25,19 +26,35 @@ struct dt_iop_buffer_dsc_t;
 struct dt_iop_roi_t;
 
 /**
- * implements a simple pixel cache suitable for caching float images
+ * implements a pixel cache suitable for caching float images
  * corresponding to history items and zoom/pan settings in the develop module.
- * it is optimized for very few entries (~5), so most operations are O(N).
+ * cache lines are looked up through a hash table indexed by the pipeline hash.
+ * the cache keeps at least `min_entries' lines (needed for ping-pong processing)
+ * and grows beyond that as long as the allocated memory stays below `memlimit'.
+ * eviction is cost aware (greedy-dual-size): lines which took long to compute
+ * relative to their size are kept longer than cheap ones.
+ * lines can be packed into half floats to save memory, they are expanded again when they are hit.
  */
 
 typedef struct dt_dev_pixelpipe_cache_t
 {
-  int32_t entries;
+  int32_t entries;     // number of cache lines currently present
+  int32_t min_entries; // the cache never shrinks below this number of lines
+  int32_t allocated;   // number of lines the arrays below have room for
   void **data;
   size_t *size;
   struct dt_iop_buffer_dsc_t *dsc;
   uint64_t *hash;
-  int32_t *used;
+  uint64_t *used;      // query count until which this line is protected from eviction
+  float *cost;         // time in seconds it took to compute this line
+  double *priority;    // eviction priority, lowest goes first
+  gboolean *half;      // the line holds half floats, size is the packed size
+  GHashTable *lines;   // hash -> line index + 1
+  int32_t last_line;   // line returned by the latest query, never evicted by the next one
+  size_t memlimit;     // memory budget in bytes for lines beyond min_entries
+  size_t budget;       // memlimit as asked for, the memory governor lowers memlimit under pressure
+  size_t allocmem;     // memory currently allocated for all lines
+  double inflation;    // priority of the last evicted line
 #ifdef HAVE_OPENCL
   void **gpu_mem;
 #endif
@@ -46,19 +63,28 @@ typedef struct dt_dev_pixelpipe_cache_t
   uint64_t misses;
 } dt_dev_pixelpipe_cache_t;
 
-/** constructs a new cache with given cache line count (entries) and float buffer entry size in bytes.
+/** constructs a new cache with given minimum cache line count (entries), float buffer entry size in bytes
+  and memory budget in bytes which allows the cache to hold more than `entries' lines.
   \param[out] returns 0 if fail to allocate mem cache.
 */
-int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, size_t size);
+int dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_cache_t *cache, int entries, size_t size, size_t memlimit);
 void dt_dev_pixelpipe_cache_cleanup(dt_dev_pixelpipe_cache_t *cache);
 
-/** creates a hopefully unique hash from the complete module stack up to the module-th. */
+/** creates a hopefully unique hash from the complete module stack up to the module-th. takes the stack from
+  the hashes of dt_dev_pixelpipe_cache_update_hashes() if they are up to date. */
 uint64_t dt_dev_pixelpipe_cache_hash(int imgid, const struct dt_iop_roi_t *roi,
                                      struct dt_dev_pixelpipe_t *pipe, int module);
 
+/** computes the hashes of the module stack up to every node of the pipe once, after the params or the
+  nodes have changed and before a run. */
+void dt_dev_pixelpipe_cache_update_hashes(struct dt_dev_pixelpipe_t *pipe);
+
+/** a 64 bit hash of size bytes of data, continuing hash. */
+uint64_t dt_dev_pixelpipe_cache_hash_data(uint64_t hash, const void *data, const size_t size);
+
 /** returns the float data buffer for the given hash from the cache. if the hash does not match any
-  * cache line, the least recently used cache line will be cleared and an empty buffer is returned
-  * together with a non-zero return value. */
+  * cache line, a new line is allocated within the memory budget or the line with the lowest eviction
+  * priority is cleared, and an empty buffer is returned together with a non-zero return value. */
 int dt_dev_pixelpipe_cache_get(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash, const size_t size,
                                void **data, struct dt_iop_buffer_dsc_t **dsc);
 int dt_dev_pixelpipe_cache_get_important(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash, const size_t size,
@@ -66,12 +92,33 @@ int dt_dev_pixelpipe_cache_get_important(dt_dev_pixelpipe_cache_t *cache, const
 int dt_dev_pixelpipe_cache_get_weighted(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash, const size_t size,
                                         void **data, struct dt_iop_buffer_dsc_t **dsc, int weight);
 
+/** returns the line for a buffer derived from the cache line holding source, such as a copy of it in another
+  * colorspace, like dt_dev_pixelpipe_cache_get(). the line is looked up by the hash of source together with key.
+  * the lines holding source and keep are never cleared to make room and the latest line stays the latest one,
+  * so that the caller can go on reading them. if source is not cached or there is no room, *data is NULL. */
+int dt_dev_pixelpipe_cache_get_derived(dt_dev_pixelpipe_cache_t *cache, const void *source, const uint64_t key,
+                                       const void *keep, const size_t size, void **data,
+                                       struct dt_iop_buffer_dsc_t **dsc);
+
+/** the description of the valid cache line holding data, NULL if there is none. valid until the next query. */
+struct dt_iop_buffer_dsc_t *dt_dev_pixelpipe_cache_get_dsc(dt_dev_pixelpipe_cache_t *cache, const void *data);
+
 /** test availability of a cache line without destroying another, if it is not found. */
 int dt_dev_pixelpipe_cache_available(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash);
 
 /** invalidates all cachelines. */
 void dt_dev_pixelpipe_cache_flush(dt_dev_pixelpipe_cache_t *cache);
 
+/** records the time in seconds it took to compute the cache line with this hash, used for eviction. */
+void dt_dev_pixelpipe_cache_set_cost(dt_dev_pixelpipe_cache_t *cache, const uint64_t hash, const float cost);
+
+/** the time in seconds it took to compute the cache line holding data, 0 if it is not known. */
+float dt_dev_pixelpipe_cache_get_cost(const dt_dev_pixelpipe_cache_t *cache, const void *data);
+
+/** stores the 4-channel float buffer of this cache line as half floats until it is requested again.
+  * the pointer is not valid anymore afterwards. */
+void dt_dev_pixelpipe_cache_pack(dt_dev_pixelpipe_cache_t *cache, void *data);
+
 /** makes this buffer very important after it has been pulled from the cache. */
 void dt_dev_pixelpipe_cache_reweight(dt_dev_pixelpipe_cache_t *cache, void *data);
 
@@ -0,0 +1,295 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "develop/pixelpipe_cache_disk.h"
+#include "common/darktable.h"
+#include "common/file_location.h"
+#include "control/conf.h"
+#include "control/control.h"
+#include "control/jobs.h"
+#include "develop/format.h"
+#include "develop/imageop.h"
+#include "develop/pixelpipe.h"
+
+#include <glib/gstdio.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#define DT_PIXELPIPE_CACHE_DISK_VERSION 1
+
+typedef struct dt_pixelpipe_cache_disk_header_t
+{
+  char magic[4];
+  int32_t version;
+  uint64_t hash;
+  uint64_t size;
+  uint64_t compressed_size;
+  dt_iop_buffer_dsc_t dsc;
+  // module implementations change between versions, so do the buffers they produce
+  char package_version[64];
+} dt_pixelpipe_cache_disk_header_t;
+
+typedef struct dt_pixelpipe_cache_disk_job_t
+{
+  int imgid;
+  dt_dev_pixelpipe_type_t type;
+  uint64_t hash;
+  size_t size;
+  dt_iop_buffer_dsc_t dsc;
+  void *data;
+} dt_pixelpipe_cache_disk_job_t;
+
+static void _get_dirname(const int imgid, char *dirname, const size_t size)
+{
+  char cachedir[PATH_MAX] = { 0 };
+  dt_loc_get_user_cache_dir(cachedir, sizeof(cachedir));
+  snprintf(dirname, size, "%s/pixelpipe/%d", cachedir, imgid);
+}
+
+static void _get_filename(const int imgid, const dt_dev_pixelpipe_type_t type, const uint64_t hash,
+                          char *filename, const size_t size)
+{
+  char dirname[PATH_MAX] = { 0 };
+  _get_dirname(imgid, dirname, sizeof(dirname));
+  snprintf(filename, size, "%s/%s-%016" PRIx64 ".dtpc", dirname, dt_pixelpipe_name(type), hash);
+}
+
+// floats compress a lot better when their bytes are grouped into planes (exponents together etc.)
+static void _shuffle(const uint8_t *const in, uint8_t *const out, const size_t size)
+{
+  const size_t n = size / 4;
+  for(size_t i = 0; i < n; i++)
+    for(int b = 0; b < 4; b++) out[b * n + i] = in[4 * i + b];
+  memcpy(out + 4 * n, in + 4 * n, size - 4 * n);
+}
+
+static void _unshuffle(const uint8_t *const in, uint8_t *const out, const size_t size)
+{
+  const size_t n = size / 4;
+  for(size_t i = 0; i < n; i++)
+    for(int b = 0; b < 4; b++) out[4 * i + b] = in[b * n + i];
+  memcpy(out + 4 * n, in + 4 * n, size - 4 * n);
+}
+
+gboolean dt_dev_pixelpipe_cache_disk_enabled(const dt_dev_pixelpipe_t *pipe, const dt_iop_module_t *module)
+{
+  if(!module) return FALSE;
+  // the darkroom pipes are the ones which are run again and again for the same image
+  const dt_dev_pixelpipe_type_t type = pipe->type & DT_DEV_PIXELPIPE_ANY;
+  if(type != DT_DEV_PIXELPIPE_FULL && type != DT_DEV_PIXELPIPE_PREVIEW) return FALSE;
+  if(pipe->mask_display != DT_DEV_PIXELPIPE_DISPLAY_NONE) return FALSE;
+  if(!dt_conf_get_bool("pixelpipe_cache_disk")) return FALSE;
+
+  gchar *checkpoint = dt_conf_get_string("pixelpipe_cache_disk_checkpoint");
+  const gboolean match = checkpoint && !strcmp(checkpoint, module->op);
+  g_free(checkpoint);
+  return match;
+}
+
+int dt_dev_pixelpipe_cache_disk_read(const dt_dev_pixelpipe_t *pipe, const uint64_t hash, void *data,
+                                     const size_t size, dt_iop_buffer_dsc_t *dsc)
+{
+  char filename[PATH_MAX] = { 0 };
+  _get_filename(pipe->image.id, pipe->type & DT_DEV_PIXELPIPE_ANY, hash, filename, sizeof(filename));
+
+  FILE *f = g_fopen(filename, "rb");
+  if(!f) return 1;
+
+  int res = 1;
+  uint8_t *compressed = NULL, *shuffled = NULL;
+  dt_pixelpipe_cache_disk_header_t header;
+  if(fread(&header, sizeof(header), 1, f) != 1) goto error;
+  header.package_version[sizeof(header.package_version) - 1] = '\0';
+  if(memcmp(header.magic, "dtpc", 4) || header.version != DT_PIXELPIPE_CACHE_DISK_VERSION
+     || header.hash != hash || header.size != size
+     || strcmp(header.package_version, darktable_package_version))
+    goto error;
+
+  compressed = (uint8_t *)dt_alloc_align(64, header.compressed_size);
+  shuffled = (uint8_t *)dt_alloc_align(64, size);
+  if(!compressed || !shuffled) goto error;
+  if(fread(compressed, header.compressed_size, 1, f) != 1) goto error;
+
+  uLongf destlen = size;
+  if(uncompress(shuffled, &destlen, compressed, header.compressed_size) != Z_OK || destlen != size) goto error;
+  _unshuffle(shuffled, (uint8_t *)data, size);
+
+  // the profile pointer is only meaningful in the pipe that wrote the file
+  struct dt_iop_order_iccprofile_info_t *work_profile_info = dsc->work_profile_info;
+  *dsc = header.dsc;
+  dsc->work_profile_info = work_profile_info;
+  res = 0;
+  dt_print(DT_DEBUG_DEV, "[pixelpipe_cache_disk] read checkpoint `%s'\n", filename);
+
+error:
+  if(res) dt_print(DT_DEBUG_DEV, "[pixelpipe_cache_disk] can't use checkpoint `%s'\n", filename);
+  dt_free_align(compressed);
+  dt_free_align(shuffled);
+  fclose(f);
+  return res;
+}
+
+// only keep the latest checkpoint per image and pipe type
+static void _remove_other_checkpoints(const int imgid, const dt_dev_pixelpipe_type_t type, const char *keep)
+{
+  char dirname[PATH_MAX] = { 0 };
+  _get_dirname(imgid, dirname, sizeof(dirname));
+  GDir *dir = g_dir_open(dirname, 0, NULL);
+  if(!dir) return;
+
+  gchar *prefix = g_strdup_printf("%s-", dt_pixelpipe_name(type));
+  const gchar *name;
+  while((name = g_dir_read_name(dir)))
+  {
+    if(!g_str_has_prefix(name, prefix)) continue;
+    gchar *path = g_build_filename(dirname, name, NULL);
+    if(strcmp(path, keep)) g_unlink(path);
+    g_free(path);
+  }
+  g_free(prefix);
+  g_dir_close(dir);
+}
+
+static int32_t _write_job_run(dt_job_t *job)
+{
+  dt_pixelpipe_cache_disk_job_t *params = dt_control_job_get_params(job);
+
+  char dirname[PATH_MAX] = { 0 };
+  char filename[PATH_MAX] = { 0 };
+  _get_dirname(params->imgid, dirname, sizeof(dirname));
+  _get_filename(params->imgid, params->type, params->hash, filename, sizeof(filename));
+  if(g_mkdir_with_parents(dirname, 0750)) return 1;
+
+  uint8_t *shuffled = (uint8_t *)dt_alloc_align(64, params->size);
+  uLongf compressed_size = compressBound(params->size);
+  uint8_t *compressed = (uint8_t *)dt_alloc_align(64, compressed_size);
+  if(!shuffled || !compressed)
+  {
+    dt_free_align(shuffled);
+    dt_free_align(compressed);
+    return 1;
+  }
+
+  _shuffle((const uint8_t *)params->data, shuffled, params->size);
+  const int err = compress2(compressed, &compressed_size, shuffled, params->size, Z_BEST_SPEED);
+  dt_free_align(shuffled);
+  if(err != Z_OK)
+  {
+    dt_free_align(compressed);
+    return 1;
+  }
+
+  dt_pixelpipe_cache_disk_header_t header = { { 0 } };
+  memcpy(header.magic, "dtpc", 4);
+  header.version = DT_PIXELPIPE_CACHE_DISK_VERSION;
+  header.hash = params->hash;
+  header.size = params->size;
+  header.compressed_size = compressed_size;
+  header.dsc = params->dsc;
+  header.dsc.work_profile_info = NULL;
+  g_strlcpy(header.package_version, darktable_package_version, sizeof(header.package_version));
+
+  // write to a temporary file first, so readers never see half a checkpoint
+  gchar *tmpname = g_strdup_printf("%s.tmp", filename);
+  FILE *f = g_fopen(tmpname, "wb");
+  gboolean ok = FALSE;
+  if(f)
+  {
+    ok = fwrite(&header, sizeof(header), 1, f) == 1 && fwrite(compressed, compressed_size, 1, f) == 1;
+    ok = (fclose(f) == 0) && ok;
+  }
+  dt_free_align(compressed);
+
+  if(ok && !g_rename(tmpname, filename))
+  {
+    _remove_other_checkpoints(params->imgid, params->type, filename);
+    dt_print(DT_DEBUG_DEV, "[pixelpipe_cache_disk] wrote checkpoint `%s' (%zu -> %lu bytes)\n", filename,
+             params->size, (unsigned long)compressed_size);
+  }
+  else
+    g_unlink(tmpname);
+  g_free(tmpname);
+  return 0;
+}
+
+static void _write_job_free(void *data)
+{
+  dt_pixelpipe_cache_disk_job_t *params = (dt_pixelpipe_cache_disk_job_t *)data;
+  dt_free_align(params->data);
+  free(params);
+}
+
+void dt_dev_pixelpipe_cache_disk_write(const dt_dev_pixelpipe_t *pipe, const uint64_t hash, const void *data,
+                                       const size_t size, const dt_iop_buffer_dsc_t *dsc)
+{
+  if(!data || !size) return;
+
+  const dt_dev_pixelpipe_type_t type = pipe->type & DT_DEV_PIXELPIPE_ANY;
+  char filename[PATH_MAX] = { 0 };
+  _get_filename(pipe->image.id, type, hash, filename, sizeof(filename));
+  if(g_file_test(filename, G_FILE_TEST_EXISTS)) return;
+
+  dt_pixelpipe_cache_disk_job_t *params = (dt_pixelpipe_cache_disk_job_t *)calloc(1, sizeof(dt_pixelpipe_cache_disk_job_t));
+  if(!params) return;
+  params->data = dt_alloc_align(64, size);
+  if(!params->data)
+  {
+    free(params);
+    return;
+  }
+  memcpy(params->data, data, size);
+  params->imgid = pipe->image.id;
+  params->type = type;
+  params->hash = hash;
+  params->size = size;
+  params->dsc = *dsc;
+
+  dt_job_t *job = dt_control_job_create(&_write_job_run, "write pixelpipe checkpoint");
+  if(!job)
+  {
+    _write_job_free(params);
+    return;
+  }
+  dt_control_job_set_params(job, params, _write_job_free);
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_BG, job);
+}
+
+void dt_dev_pixelpipe_cache_disk_remove(const int imgid)
+{
+  char dirname[PATH_MAX] = { 0 };
+  _get_dirname(imgid, dirname, sizeof(dirname));
+  GDir *dir = g_dir_open(dirname, 0, NULL);
+  if(!dir) return;
+
+  const gchar *name;
+  while((name = g_dir_read_name(dir)))
+  {
+    gchar *path = g_build_filename(dirname, name, NULL);
+    g_unlink(path);
+    g_free(path);
+  }
+  g_dir_close(dir);
+  g_rmdir(dirname);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,54 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <glib.h>
+#include <inttypes.h>
+#include <stddef.h>
+
+struct dt_dev_pixelpipe_t;
+struct dt_iop_buffer_dsc_t;
+struct dt_iop_module_t;
+
+/**
+ * persistent disk tier of the pixelpipe cache. the output of one expensive checkpoint module
+ * (demosaic by default) is written compressed to ~/.cache/darktable/pixelpipe/<imgid>/, keyed by the
+ * pipeline hash up to that module. reopening the image with an unchanged history then starts from
+ * the checkpoint. only one file per image and pipe type is kept.
+ */
+
+/** true if the output of this module in this pipe should go through the disk tier. */
+gboolean dt_dev_pixelpipe_cache_disk_enabled(const struct dt_dev_pixelpipe_t *pipe,
+                                             const struct dt_iop_module_t *module);
+
+/** reads the buffer with the given hash into data, which holds size bytes. returns 0 on success. */
+int dt_dev_pixelpipe_cache_disk_read(const struct dt_dev_pixelpipe_t *pipe, const uint64_t hash, void *data,
+                                     const size_t size, struct dt_iop_buffer_dsc_t *dsc);
+
+/** queues a copy of the buffer to be written in the background. */
+void dt_dev_pixelpipe_cache_disk_write(const struct dt_dev_pixelpipe_t *pipe, const uint64_t hash,
+                                       const void *data, const size_t size,
+                                       const struct dt_iop_buffer_dsc_t *dsc);
+
+/** removes all checkpoints of an image, e.g. when it is removed from the library. */
+void dt_dev_pixelpipe_cache_disk_remove(const int imgid);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -21,13 +21,20 @@
 #include "common/imageio.h"
 #include "common/opencl.h"
 #include "common/iop_order.h"
+#include "common/memory_accounting.h"
+#include "common/memory_governor.h"
+#include "common/metrics.h"
+#include "common/trace.h"
 #include "control/control.h"
 #include "control/signal.h"
 #include "develop/blend.h"
 #include "develop/format.h"
 #include "develop/imageop_math.h"
 #include "develop/pixelpipe.h"
+#include "develop/pixelpipe_cache_disk.h"
+#include "develop/perf_model.h"
 #include "develop/tiling.h"
+#include "develop/tiling_calibration.h"
 #include "develop/masks.h"
 #include "gui/gtk.h"
 #include "libs/colorpicker.h"
@@ -108,10 +115,239 @@ static char *_pipe_type_to_str(int pipe_type)
   return r;
 }
 
+// pixelpipe.<type>.<what>, fast pipes count with their type
+static void _pipe_metric(const dt_dev_pixelpipe_t *pipe, const char *what, char *name, const size_t size)
+{
+  const char *type = "unknown";
+  switch(pipe->type & DT_DEV_PIXELPIPE_ANY)
+  {
+    case DT_DEV_PIXELPIPE_PREVIEW:
+      type = "preview";
+      break;
+    case DT_DEV_PIXELPIPE_PREVIEW2:
+      type = "preview2";
+      break;
+    case DT_DEV_PIXELPIPE_FULL:
+      type = "full";
+      break;
+    case DT_DEV_PIXELPIPE_THUMBNAIL:
+      type = "thumbnail";
+      break;
+    case DT_DEV_PIXELPIPE_EXPORT:
+      type = "export";
+      break;
+    default:
+      break;
+  }
+  snprintf(name, size, "pixelpipe.%s.%s", type, what);
+}
+
+static void _pipe_count(const dt_dev_pixelpipe_t *pipe, const char *what)
+{
+  char name[64];
+  _pipe_metric(pipe, what, name, sizeof(name));
+  dt_metrics_count(name, 1);
+}
+
+#ifdef HAVE_OPENCL
+// why a module whose input is on the gpu has to run on the cpu, every such module costs two copies of the
+// buffer between host and device
+static const char *_cpu_fallback_reason(const dt_dev_pixelpipe_t *pipe, const dt_iop_module_t *module,
+                                        const dt_dev_pixelpipe_iop_t *piece, const gboolean prefer_cpu,
+                                        const gboolean fits_on_device)
+{
+  if(!module->process_cl) return "no opencl code";
+  if(!piece->process_cl_ready) return "no opencl code for these parameters";
+  if(prefer_cpu) return "faster on cpu";
+  if(!fits_on_device && !piece->process_tiling_ready) return "too large for device";
+  if(((pipe->type & DT_DEV_PIXELPIPE_PREVIEW) == DT_DEV_PIXELPIPE_PREVIEW
+      || (pipe->type & DT_DEV_PIXELPIPE_PREVIEW2) == DT_DEV_PIXELPIPE_PREVIEW2)
+     && (module->flags() & IOP_FLAGS_PREVIEW_NON_OPENCL))
+    return "cpu only in preview";
+  return "unknown";
+}
+
+static void _report_cpu_fallbacks(dt_dev_pixelpipe_t *pipe)
+{
+  if(!pipe->cpu_fallbacks) return;
+
+  if(darktable.unmuted & (DT_DEBUG_OPENCL | DT_DEBUG_PERF))
+  {
+    GString *list = g_string_new(NULL);
+    for(const GList *l = pipe->cpu_fallbacks; l; l = g_list_next(l))
+      g_string_append_printf(list, "%s%s", list->len ? ", " : "", (const char *)l->data);
+    dt_print(DT_DEBUG_OPENCL | DT_DEBUG_PERF,
+             "[pixelpipe_process] [%s] %d module(s) moved the buffer off the gpu: %s\n",
+             _pipe_type_to_str(pipe->type), g_list_length(pipe->cpu_fallbacks), list->str);
+    g_string_free(list, TRUE);
+  }
+  g_list_free_full(pipe->cpu_fallbacks, g_free);
+  pipe->cpu_fallbacks = NULL;
+}
+
+// whether the input of module, which is on the device only, is copied back into the cache after the module ran
+// on the gpu, see opencl_synch_cache. the copy saves running the modules before it again when a later one
+// changes, but costs a transfer per module on a fast gpu.
+static gboolean _opencl_sync_input(const dt_dev_pixelpipe_t *pipe, const dt_iop_module_t *module,
+                                   const void *const input)
+{
+  // these pipes run once
+  if(pipe->type & (DT_DEV_PIXELPIPE_EXPORT | DT_DEV_PIXELPIPE_THUMBNAIL)) return FALSE;
+
+  const dt_opencl_sync_cache_t sync = (pipe->type & (DT_DEV_PIXELPIPE_PREVIEW | DT_DEV_PIXELPIPE_PREVIEW2))
+                                          ? darktable.opencl->sync_cache_preview
+                                          : darktable.opencl->sync_cache;
+  switch(sync)
+  {
+    case OPENCL_SYNC_TRUE:
+      return TRUE;
+    case OPENCL_SYNC_FALSE:
+      return FALSE;
+    case OPENCL_SYNC_CHECKPOINTS:
+      // the output of an expensive module like demosaic or denoising is worth the copy
+      if(dt_dev_pixelpipe_cache_get_cost(&pipe->cache, input) >= darktable.opencl->sync_checkpoint) return TRUE;
+      // fall through
+    case OPENCL_SYNC_ACTIVE_MODULE:
+    default:
+      return module == darktable.develop->gui_module;
+  }
+}
+#endif
+
+static void _trace_module(const dt_dev_pixelpipe_t *pipe, const dt_iop_module_t *module,
+                          const dt_iop_roi_t *roi_in, const dt_iop_roi_t *roi_out,
+                          const dt_pixelpipe_flow_t flow, const size_t bytes, const size_t mem_required,
+                          const size_t host_peak, const size_t device_peak, const dt_trace_cache_t cache,
+                          const double start)
+{
+  const gboolean processed = (cache == DT_TRACE_CACHE_MISS);
+  const gboolean gpu = processed && (flow & PIXELPIPE_FLOW_PROCESSED_ON_GPU);
+  const dt_trace_module_event_t event = { .pipe = _pipe_type_to_str(pipe->type),
+                                          .pipe_type = pipe->type,
+                                          .module = module->op,
+                                          .instance = module->multi_name,
+                                          .roi_in = roi_in,
+                                          .roi_out = roi_out,
+                                          .device = processed ? (gpu ? "GPU" : "CPU") : NULL,
+                                          .devid = gpu ? pipe->devid : -1,
+                                          .tiling = processed && (flow & PIXELPIPE_FLOW_PROCESSED_WITH_TILING),
+                                          .bytes = bytes,
+                                          .mem_required = mem_required,
+                                          .host_peak = host_peak,
+                                          .device_peak = device_peak,
+                                          .cache = cache,
+                                          .start = start,
+                                          .end = dt_get_wtime() };
+  dt_trace_module(&event);
+}
+
+// memory budget for the darkroom pipes, these may keep more than the minimum number of cache lines
+static size_t _pixelpipe_cache_memlimit()
+{
+  return (size_t)MAX(dt_conf_get_int64("pixelpipe_cache_memory"), 0);
+}
+
+// the shared cache tier only serves the interactive darkroom pipes, and only holds buffers
+// of pipe prefixes whose modules all produce the same output regardless of the pipe type.
+static gboolean _pixelpipe_shared_cache_usable(const dt_dev_pixelpipe_t *pipe, const int pos)
+{
+  if(!darktable.pixelpipe_cache || !darktable.pixelpipe_cache->budget) return FALSE;
+  if(!(pipe->type & (DT_DEV_PIXELPIPE_FULL | DT_DEV_PIXELPIPE_PREVIEW | DT_DEV_PIXELPIPE_PREVIEW2))) return FALSE;
+  if(pipe->mask_display != DT_DEV_PIXELPIPE_DISPLAY_NONE) return FALSE;
+
+  GList *pieces = pipe->nodes;
+  for(int k = 0; k < pos && pieces; k++)
+  {
+    const dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)pieces->data;
+    if(piece->enabled && !(piece->module->flags() & IOP_FLAGS_PIPE_INDEPENDENT)) return FALSE;
+    pieces = g_list_next(pieces);
+  }
+  return TRUE;
+}
+
+// pipes may run the same module stack on different input buffers (mip f vs. full), so
+// the keys of the shared and disk tiers also cover input dimensions and scale.
+static uint64_t _pixelpipe_cache_input_hash(const dt_dev_pixelpipe_t *pipe, const uint64_t hash)
+{
+  uint32_t iscale;
+  memcpy(&iscale, &pipe->iscale, sizeof(iscale));
+  uint64_t h = hash;
+  h = ((h << 5) + h) ^ (uint64_t)pipe->iwidth;
+  h = ((h << 5) + h) ^ (uint64_t)pipe->iheight;
+  h = ((h << 5) + h) ^ (uint64_t)iscale;
+  return h;
+}
+
+// copy a buffer some other darkroom pipe already computed into our cache. returns 1 on success.
+static int _pixelpipe_shared_cache_fetch(dt_dev_pixelpipe_t *pipe, const uint64_t hash, const size_t bufsize,
+                                         void **output, dt_iop_buffer_dsc_t **out_format)
+{
+  const uint64_t shared_hash = _pixelpipe_cache_input_hash(pipe, hash);
+  int found = 0;
+  dt_pthread_mutex_lock(&darktable.pixelpipe_cache_threadsafe);
+  if(dt_dev_pixelpipe_cache_available(darktable.pixelpipe_cache, shared_hash))
+  {
+    void *shared = NULL;
+    dt_iop_buffer_dsc_t *shared_dsc = *out_format;
+    if(!dt_dev_pixelpipe_cache_get(darktable.pixelpipe_cache, shared_hash, bufsize, &shared, &shared_dsc)
+       && shared)
+    {
+      (void)dt_dev_pixelpipe_cache_get(&(pipe->cache), hash, bufsize, output, out_format);
+      if(*output)
+      {
+        memcpy(*output, shared, bufsize);
+        **out_format = *shared_dsc;
+        found = 1;
+      }
+    }
+  }
+  dt_pthread_mutex_unlock(&darktable.pixelpipe_cache_threadsafe);
+  return found;
+}
+
+// offer a freshly computed buffer to the other darkroom pipes
+static void _pixelpipe_shared_cache_put(dt_dev_pixelpipe_t *pipe, const uint64_t hash, const void *output,
+                                        const size_t bufsize, const dt_iop_buffer_dsc_t *out_format,
+                                        const float cost)
+{
+  const uint64_t shared_hash = _pixelpipe_cache_input_hash(pipe, hash);
+  dt_pthread_mutex_lock(&darktable.pixelpipe_cache_threadsafe);
+  void *shared = NULL;
+  dt_iop_buffer_dsc_t dsc = *out_format;
+  dt_iop_buffer_dsc_t *shared_dsc = &dsc;
+  if(dt_dev_pixelpipe_cache_get(darktable.pixelpipe_cache, shared_hash, bufsize, &shared, &shared_dsc))
+  {
+    if(shared)
+    {
+      memcpy(shared, output, bufsize);
+      dt_dev_pixelpipe_cache_set_cost(darktable.pixelpipe_cache, shared_hash, cost);
+    }
+  }
+  dt_pthread_mutex_unlock(&darktable.pixelpipe_cache_threadsafe);
+}
+
+// load a checkpoint written by an earlier session into our cache. returns 1 on success.
+static int _pixelpipe_disk_cache_fetch(dt_dev_pixelpipe_t *pipe, const uint64_t hash, const size_t bufsize,
+                                       void **output, dt_iop_buffer_dsc_t **out_format)
+{
+  const uint64_t disk_hash = _pixelpipe_cache_input_hash(pipe, hash);
+  (void)dt_dev_pixelpipe_cache_get(&(pipe->cache), hash, bufsize, output, out_format);
+  if(*output && !dt_dev_pixelpipe_cache_disk_read(pipe, disk_hash, *output, bufsize, *out_format)) return 1;
+  dt_dev_pixelpipe_cache_invalidate(&(pipe->cache), *output);
+  return 0;
+}
+
+// checkpoints are only written for the whole image, panning around would just churn the disk
+static gboolean _pixelpipe_roi_is_full(const dt_dev_pixelpipe_iop_t *piece, const dt_iop_roi_t *roi)
+{
+  return roi->x == 0 && roi->y == 0 && abs(roi->width - (int)(piece->buf_out.width * roi->scale)) <= 2
+         && abs(roi->height - (int)(piece->buf_out.height * roi->scale)) <= 2;
+}
+
 int dt_dev_pixelpipe_init_export(dt_dev_pixelpipe_t *pipe, int32_t width, int32_t height, int levels,
                                  gboolean store_masks)
 {
-  const int res = dt_dev_pixelpipe_init_cached(pipe, 4 * sizeof(float) * width * height, 2);
+  const int res = dt_dev_pixelpipe_init_cached(pipe, 4 * sizeof(float) * width * height, 2, 0);
   pipe->type = DT_DEV_PIXELPIPE_EXPORT;
   pipe->levels = levels;
   pipe->store_all_raster_masks = store_masks;
@@ -120,14 +356,14 @@ int dt_dev_pixelpipe_init_export(dt_dev_pixelpipe_t *pipe, int32_t width, int32_
 
 int dt_dev_pixelpipe_init_thumbnail(dt_dev_pixelpipe_t *pipe, int32_t width, int32_t height)
 {
-  const int res = dt_dev_pixelpipe_init_cached(pipe, 4 * sizeof(float) * width * height, 2);
+  const int res = dt_dev_pixelpipe_init_cached(pipe, 4 * sizeof(float) * width * height, 2, 0);
   pipe->type = DT_DEV_PIXELPIPE_THUMBNAIL;
   return res;
 }
 
 int dt_dev_pixelpipe_init_dummy(dt_dev_pixelpipe_t *pipe, int32_t width, int32_t height)
 {
-  const int res = dt_dev_pixelpipe_init_cached(pipe, 4 * sizeof(float) * width * height, 0);
+  const int res = dt_dev_pixelpipe_init_cached(pipe, 4 * sizeof(float) * width * height, 0, 0);
   pipe->type = DT_DEV_PIXELPIPE_THUMBNAIL;
   return res;
 }
@@ -135,36 +371,83 @@ int dt_dev_pixelpipe_init_dummy(dt_dev_pixelpipe_t *pipe, int32_t width, int32_t
 int dt_dev_pixelpipe_init_preview(dt_dev_pixelpipe_t *pipe)
 {
   // don't know which buffer size we're going to need, set to 0 (will be alloced on demand)
-  const int res = dt_dev_pixelpipe_init_cached(pipe, 0, 5);
+  const int res = dt_dev_pixelpipe_init_cached(pipe, 0, 5, _pixelpipe_cache_memlimit());
   pipe->type = DT_DEV_PIXELPIPE_PREVIEW;
+  pipe->half_cache = dt_conf_get_bool("pixelpipe_half_cache");
   return res;
 }
 
 int dt_dev_pixelpipe_init_preview2(dt_dev_pixelpipe_t *pipe)
 {
   // don't know which buffer size we're going to need, set to 0 (will be alloced on demand)
-  const int res = dt_dev_pixelpipe_init_cached(pipe, 0, 5);
+  const int res = dt_dev_pixelpipe_init_cached(pipe, 0, 5, _pixelpipe_cache_memlimit());
   pipe->type = DT_DEV_PIXELPIPE_PREVIEW2;
+  pipe->half_cache = dt_conf_get_bool("pixelpipe_half_cache");
   return res;
 }
 
+// the output of the full pipe in tiles of DT_DEV_PIXELPIPE_TILE pixels, at the position of the tile in the
+// whole image at the scale of the output
+#define DT_DEV_PIXELPIPE_TILE 256
+// the memory the tiles may take
+#define DT_DEV_PIXELPIPE_TILES_MAX_SIZE ((size_t)192 << 20)
+
+typedef struct dt_dev_pixelpipe_tile_t
+{
+  uint64_t hash; // of the pipe and the scale the tile was rendered with
+  int tx, ty;
+  dt_iop_roi_t roi; // the pixels of the tile, smaller at the right and bottom end of the image
+  uint8_t *buf;
+  GList link;
+} dt_dev_pixelpipe_tile_t;
+
+static guint _tile_hash(gconstpointer key)
+{
+  const dt_dev_pixelpipe_tile_t *t = (const dt_dev_pixelpipe_tile_t *)key;
+  return (guint)(t->hash ^ (t->hash >> 32)) ^ ((guint)t->tx * 73856093u) ^ ((guint)t->ty * 19349663u);
+}
+
+static gboolean _tile_equal(gconstpointer a, gconstpointer b)
+{
+  const dt_dev_pixelpipe_tile_t *ta = (const dt_dev_pixelpipe_tile_t *)a;
+  const dt_dev_pixelpipe_tile_t *tb = (const dt_dev_pixelpipe_tile_t *)b;
+  return ta->hash == tb->hash && ta->tx == tb->tx && ta->ty == tb->ty;
+}
+
+static void _tile_free(gpointer data)
+{
+  dt_dev_pixelpipe_tile_t *t = (dt_dev_pixelpipe_tile_t *)data;
+  dt_free_align(t->buf);
+  free(t);
+}
+
+static void _tiles_flush(dt_dev_pixelpipe_t *pipe)
+{
+  if(!pipe->tiles) return;
+  g_hash_table_remove_all(pipe->tiles);
+  g_queue_init(&pipe->tiles_lru);
+  pipe->tiles_size = 0;
+}
+
 int dt_dev_pixelpipe_init(dt_dev_pixelpipe_t *pipe)
 {
   // don't know which buffer size we're going to need, set to 0 (will be alloced on demand)
-  const int res = dt_dev_pixelpipe_init_cached(pipe, 0, 5);
+  const int res = dt_dev_pixelpipe_init_cached(pipe, 0, 5, _pixelpipe_cache_memlimit());
   pipe->type = DT_DEV_PIXELPIPE_FULL;
   return res;
 }
 
-int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t entries)
+int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t entries, size_t memlimit)
 {
   pipe->devid = -1;
   pipe->changed = DT_DEV_PIPE_UNCHANGED;
   pipe->processed_width = pipe->backbuf_width = pipe->iwidth = 0;
   pipe->processed_height = pipe->backbuf_height = pipe->iheight = 0;
   pipe->nodes = NULL;
+  pipe->stack_hash = NULL;
+  pipe->stack_hash_count = 0;
   pipe->backbuf_size = size;
-  if(!dt_dev_pixelpipe_cache_init(&(pipe->cache), entries, pipe->backbuf_size)) return 0;
+  if(!dt_dev_pixelpipe_cache_init(&(pipe->cache), entries, pipe->backbuf_size, memlimit)) return 0;
   pipe->cache_obsolete = 0;
   pipe->backbuf = NULL;
   pipe->backbuf_scale = 0.0f;
@@ -174,12 +457,21 @@ int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t
   pipe->output_backbuf = NULL;
   pipe->output_backbuf_width = 0;
   pipe->output_backbuf_height = 0;
+  pipe->output_backbuf_coarse = 1;
+  pipe->coarse = 1;
   pipe->output_imgid = 0;
 
   pipe->processing = 0;
   pipe->shutdown = 0;
   pipe->opencl_error = 0;
+  pipe->cpu_fallbacks = NULL;
   pipe->tiling = 0;
+  pipe->streaming = 0;
+  pipe->stream_padded_pos = -1;
+  pipe->stream_buf = NULL;
+  pipe->pool = dt_dev_pixelpipe_pool_init();
+  pipe->half_cache = 0;
+  pipe->backbuf_bpp = 0;
   pipe->mask_display = DT_DEV_PIXELPIPE_DISPLAY_NONE;
   pipe->bypass_blendif = 0;
   pipe->input_timestamp = 0;
@@ -192,7 +484,15 @@ int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t
   pipe->iop = NULL;
   pipe->iop_order_list = NULL;
   pipe->forms = NULL;
+  pipe->mask_rasters = NULL;
+  pipe->mask_rasters_clock = 0;
+  pipe->output_valid = FALSE;
+  pipe->output_forms = NULL;
+  pipe->dirty_pass = 0;
   pipe->store_all_raster_masks = FALSE;
+  pipe->tiles = g_hash_table_new_full(_tile_hash, _tile_equal, NULL, _tile_free);
+  g_queue_init(&pipe->tiles_lru);
+  pipe->tiles_size = 0;
 
   return 1;
 }
@@ -236,13 +536,30 @@ void dt_dev_pixelpipe_cleanup(dt_dev_pixelpipe_t *pipe)
   pipe->output_backbuf = NULL;
   pipe->output_backbuf_width = 0;
   pipe->output_backbuf_height = 0;
+  pipe->output_backbuf_coarse = 1;
+  pipe->coarse = 1;
   pipe->output_imgid = 0;
 
+  dt_free_align(pipe->stream_buf);
+  pipe->stream_buf = NULL;
+  dt_dev_pixelpipe_pool_cleanup(pipe->pool);
+  pipe->pool = NULL;
+
+  _tiles_flush(pipe);
+  g_hash_table_destroy(pipe->tiles);
+  pipe->tiles = NULL;
+
   if(pipe->forms)
   {
     g_list_free_full(pipe->forms, (void (*)(void *))dt_masks_free_form);
     pipe->forms = NULL;
   }
+  dt_masks_raster_cache_cleanup(pipe);
+  pipe->output_valid = FALSE;
+  g_list_free_full(pipe->output_forms, (void (*)(void *))dt_masks_free_form);
+  pipe->output_forms = NULL;
+  g_list_free_full(pipe->cpu_fallbacks, g_free);
+  pipe->cpu_fallbacks = NULL;
 }
 
 void dt_dev_pixelpipe_cleanup_nodes(dt_dev_pixelpipe_t *pipe)
@@ -251,6 +568,7 @@ void dt_dev_pixelpipe_cleanup_nodes(dt_dev_pixelpipe_t *pipe)
   //        (this is a circular dependency on busy_mutex and the gdk mutex)
   dt_pthread_mutex_lock(&pipe->busy_mutex);
   pipe->shutdown = 1;
+  pipe->output_valid = FALSE;
   // destroy all nodes
   GList *nodes = pipe->nodes;
   while(nodes)
@@ -264,11 +582,18 @@ void dt_dev_pixelpipe_cleanup_nodes(dt_dev_pixelpipe_t *pipe)
     piece->histogram = NULL;
     g_hash_table_destroy(piece->raster_masks);
     piece->raster_masks = NULL;
+    dt_free_align(piece->blend_mask);
+    piece->blend_mask = NULL;
+    if(piece->roi_fit_memo) g_hash_table_destroy(piece->roi_fit_memo);
+    piece->roi_fit_memo = NULL;
     free(piece);
     nodes = g_list_next(nodes);
   }
   g_list_free(pipe->nodes);
   pipe->nodes = NULL;
+  free(pipe->stack_hash);
+  pipe->stack_hash = NULL;
+  pipe->stack_hash_count = 0;
   // also cleanup iop here
   if(pipe->iop)
   {
@@ -313,9 +638,17 @@ void dt_dev_pixelpipe_create_nodes(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev)
     piece->pipe = pipe;
     piece->data = NULL;
     piece->hash = 0;
+    piece->params_hash = 0;
+    piece->mask_hash = 0;
+    piece->output_hash = piece->output_params_hash = 0;
+    piece->output_enabled = 0;
     piece->process_cl_ready = 0;
     piece->process_tiling_ready = 0;
     piece->raster_masks = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, dt_free_align_ptr);
+    piece->blend_mask = NULL;
+    piece->blend_mask_hash = 0;
+    piece->blend_mask_size = 0;
+    piece->roi_fit_memo = NULL;
     memset(&piece->processed_roi_in, 0, sizeof(piece->processed_roi_in));
     memset(&piece->processed_roi_out, 0, sizeof(piece->processed_roi_out));
     dt_iop_init_pipe(piece->module, pipe, piece);
@@ -347,24 +680,34 @@ void dt_dev_pixelpipe_synch(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, GList *
 void dt_dev_pixelpipe_synch_all(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev)
 {
   dt_pthread_mutex_lock(&pipe->busy_mutex);
-  // call reset_params on all pieces first.
+  // every piece is committed once, with the last history item of its module or with the defaults, so that
+  // unchanged pieces keep their data. see dt_iop_commit_params().
   GList *nodes = pipe->nodes;
   while(nodes)
   {
     dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    dt_dev_history_item_t *last = NULL;
+    GList *history = dev->history;
+    for(int k = 0; k < dev->history_end && history; k++, history = g_list_next(history))
+    {
+      dt_dev_history_item_t *hist = (dt_dev_history_item_t *)history->data;
+      if(hist->module == piece->module) last = hist;
+    }
     piece->hash = 0;
-    piece->enabled = piece->module->default_enabled;
-    dt_iop_commit_params(piece->module, piece->module->default_params, piece->module->default_blendop_params,
-                         pipe, piece);
+    if(last)
+    {
+      piece->enabled = last->enabled;
+      dt_iop_commit_params(piece->module, last->params, last->blend_params, pipe, piece);
+    }
+    else
+    {
+      piece->enabled = piece->module->default_enabled;
+      dt_iop_commit_params(piece->module, piece->module->default_params, piece->module->default_blendop_params,
+                           pipe, piece);
+    }
     nodes = g_list_next(nodes);
   }
-  // go through all history items and adjust params
-  GList *history = dev->history;
-  for(int k = 0; k < dev->history_end && history; k++)
-  {
-    dt_dev_pixelpipe_synch(pipe, dev, history);
-    history = g_list_next(history);
-  }
+  dt_dev_pixelpipe_cache_update_hashes(pipe);
   dt_pthread_mutex_unlock(&pipe->busy_mutex);
 }
 
@@ -373,6 +716,7 @@ void dt_dev_pixelpipe_synch_top(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev)
   dt_pthread_mutex_lock(&pipe->busy_mutex);
   GList *history = g_list_nth(dev->history, dev->history_end - 1);
   if(history) dt_dev_pixelpipe_synch(pipe, dev, history);
+  dt_dev_pixelpipe_cache_update_hashes(pipe);
   dt_pthread_mutex_unlock(&pipe->busy_mutex);
 }
 
@@ -428,11 +772,23 @@ static void get_output_format(dt_iop_module_t *module, dt_dev_pixelpipe_t *pipe,
 }
 
 
+// the histograms of the preview pipe are only drawn, every other row and column of them is enough
+#define DT_PIXELPIPE_PREVIEW_HISTOGRAM_STEP 2
+
+static int _histogram_step(const dt_dev_pixelpipe_iop_t *piece)
+{
+  if(piece->histogram_params.step > 0) return piece->histogram_params.step;
+  return (piece->pipe->type & DT_DEV_PIXELPIPE_PREVIEW) == DT_DEV_PIXELPIPE_PREVIEW
+             ? DT_PIXELPIPE_PREVIEW_HISTOGRAM_STEP
+             : 1;
+}
+
 // helper to get per module histogram
 static void histogram_collect(dt_dev_pixelpipe_iop_t *piece, const void *pixel, const dt_iop_roi_t *roi,
                               uint32_t **histogram, uint32_t *histogram_max)
 {
   dt_dev_histogram_collection_params_t histogram_params = piece->histogram_params;
+  histogram_params.step = _histogram_step(piece);
 
   dt_histogram_roi_t histogram_roi;
 
@@ -456,31 +812,14 @@ static void histogram_collect(dt_dev_pixelpipe_iop_t *piece, const void *pixel,
 #ifdef HAVE_OPENCL
 // helper to get per module histogram for OpenCL
 //
-// this algorithm is inefficient as hell when it comes to larger images. it's only acceptable
-// as long as we work on small image sizes like in image preview
+// the histogram is reduced on the device and only its bins are copied back. if the device can't, the image
+// is copied to the host, which is only acceptable as long as we work on small image sizes like in image preview
 static void histogram_collect_cl(int devid, dt_dev_pixelpipe_iop_t *piece, cl_mem img,
                                  const dt_iop_roi_t *roi, uint32_t **histogram, uint32_t *histogram_max,
                                  float *buffer, size_t bufsize)
 {
-  float *tmpbuf = NULL;
-  float *pixel = NULL;
-
-  // if buffer is supplied and if size fits let's use it
-  if(buffer && bufsize >= (size_t)roi->width * roi->height * 4 * sizeof(float))
-    pixel = buffer;
-  else
-    pixel = tmpbuf = dt_alloc_align(64, (size_t)roi->width * roi->height * 4 * sizeof(float));
-
-  if(!pixel) return;
-
-  cl_int err = dt_opencl_copy_device_to_host(devid, pixel, img, roi->width, roi->height, 4 * sizeof(float));
-  if(err != CL_SUCCESS)
-  {
-    if(tmpbuf) dt_free_align(tmpbuf);
-    return;
-  }
-
   dt_dev_histogram_collection_params_t histogram_params = piece->histogram_params;
+  histogram_params.step = _histogram_step(piece);
 
   dt_histogram_roi_t histogram_roi;
 
@@ -496,6 +835,34 @@ static void histogram_collect_cl(int devid, dt_dev_pixelpipe_iop_t *piece, cl_me
 
   const dt_iop_colorspace_type_t cst = piece->module->input_colorspace(piece->module, piece->pipe, piece);
 
+  if(dt_histogram_helper_cl(devid, &histogram_params, &piece->histogram_stats, cst, piece->module->histogram_cst,
+                            img, histogram, piece->module->histogram_middle_grey,
+                            dt_ioppr_get_pipe_work_profile_info(piece->pipe)))
+  {
+    dt_histogram_max_helper(&piece->histogram_stats, cst, piece->module->histogram_cst, histogram, histogram_max);
+    return;
+  }
+
+  float *tmpbuf = NULL;
+  float *pixel = NULL;
+  const size_t bpp = dt_opencl_get_image_element_size(img);
+  if(bpp == 0) return;
+
+  // if buffer is supplied and if size fits let's use it
+  if(buffer && bufsize >= (size_t)roi->width * roi->height * bpp)
+    pixel = buffer;
+  else
+    pixel = tmpbuf = dt_alloc_align(64, (size_t)roi->width * roi->height * bpp);
+
+  if(!pixel) return;
+
+  cl_int err = dt_opencl_copy_device_to_host(devid, pixel, img, roi->width, roi->height, bpp);
+  if(err != CL_SUCCESS)
+  {
+    if(tmpbuf) dt_free_align(tmpbuf);
+    return;
+  }
+
   dt_histogram_helper(&histogram_params, &piece->histogram_stats, cst, piece->module->histogram_cst, pixel, histogram,
       piece->module->histogram_middle_grey, dt_ioppr_get_pipe_work_profile_info(piece->pipe));
   dt_histogram_max_helper(&piece->histogram_stats, cst, piece->module->histogram_cst, histogram, histogram_max);
@@ -696,7 +1063,141 @@ error:
 }
 #endif
 
+// the boxes of many live samples on one buffer: a summed-area table of the sums of tiles of DT_PICK_TILE x
+// DT_PICK_TILE pixels gives the sum of the whole tiles in a box at once, and their minima and maxima leave only
+// the pixels on the border of the box to scan. built in one pass over the buffer, see _pick_tiles_init().
+#define DT_PICK_TILE 16
+
+typedef struct _pick_tiles_t
+{
+  int width;        // of the buffer in pixels
+  int tw, th;       // number of whole tiles along x and y
+  double *sum;      // (tw + 1) x (th + 1) x 3, the sum of all tiles above and left of, row and column 0 are 0
+  float *min, *max; // tw x th x 3
+} _pick_tiles_t;
+
+static void _pick_tiles_cleanup(_pick_tiles_t *t)
+{
+  dt_free_align(t->sum);
+  dt_free_align(t->min);
+  dt_free_align(t->max);
+  t->sum = NULL;
+  t->min = t->max = NULL;
+}
+
+static gboolean _pick_tiles_init(_pick_tiles_t *t, const float *const pixel, const int width, const int height)
+{
+  const int tw = width / DT_PICK_TILE, th = height / DT_PICK_TILE;
+  *t = (_pick_tiles_t){ .width = width, .tw = tw, .th = th };
+  if(tw < 1 || th < 1) return FALSE;
+
+  t->sum = dt_alloc_align(64, sizeof(double) * 3 * (tw + 1) * (th + 1));
+  t->min = dt_alloc_align(64, sizeof(float) * 3 * tw * th);
+  t->max = dt_alloc_align(64, sizeof(float) * 3 * tw * th);
+  if(!t->sum || !t->min || !t->max)
+  {
+    _pick_tiles_cleanup(t);
+    return FALSE;
+  }
+  memset(t->sum, 0, sizeof(double) * 3 * (tw + 1) * (th + 1));
+
+  double *const sum = t->sum;
+  float *const tmin = t->min, *const tmax = t->max;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(pixel, sum, th, tmax, tmin, tw, width) \
+  schedule(static)
+#endif
+  for(int ty = 0; ty < th; ty++)
+    for(int tx = 0; tx < tw; tx++)
+    {
+      double s[3] = { 0.0 };
+      float mn[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, mx[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+      for(int j = ty * DT_PICK_TILE; j < (ty + 1) * DT_PICK_TILE; j++)
+        for(int i = tx * DT_PICK_TILE; i < (tx + 1) * DT_PICK_TILE; i++)
+          for(int k = 0; k < 3; k++)
+          {
+            const float v = pixel[4 * ((size_t)width * j + i) + k];
+            s[k] += v;
+            mn[k] = fminf(mn[k], v);
+            mx[k] = fmaxf(mx[k], v);
+          }
+      for(int k = 0; k < 3; k++)
+      {
+        sum[3 * ((size_t)(ty + 1) * (tw + 1) + tx + 1) + k] = s[k];
+        tmin[3 * ((size_t)ty * tw + tx) + k] = mn[k];
+        tmax[3 * ((size_t)ty * tw + tx) + k] = mx[k];
+      }
+    }
+
+  for(int ty = 1; ty <= th; ty++)
+    for(int tx = 1; tx <= tw; tx++)
+      for(int k = 0; k < 3; k++)
+        sum[3 * ((size_t)ty * (tw + 1) + tx) + k] += sum[3 * ((size_t)(ty - 1) * (tw + 1) + tx) + k]
+                                                    + sum[3 * ((size_t)ty * (tw + 1) + tx - 1) + k]
+                                                    - sum[3 * ((size_t)(ty - 1) * (tw + 1) + tx - 1) + k];
+  return TRUE;
+}
+
+static inline void _pick_scan(const float *const pixel, const int width, const int x0, const int x1, const int y0,
+                              const int y1, double *sum, float *min, float *max)
+{
+  for(int j = y0; j < y1; j++)
+    for(int i = x0; i < x1; i++)
+      for(int k = 0; k < 3; k++)
+      {
+        const float v = pixel[4 * ((size_t)width * j + i) + k];
+        sum[k] += v;
+        min[k] = MIN(min[k], v);
+        max[k] = MAX(max[k], v);
+      }
+}
+
+// min, max and mean of the pixels in box, inclusive. min and max come in with the values to start from.
+static void _pick_box(const float *const pixel, const int width, const int *const box,
+                      const _pick_tiles_t *const tiles, float *min, float *max, float *mean)
+{
+  double sum[3] = { 0.0 };
+  const int x0 = box[0], y0 = box[1], x1 = box[2] + 1, y1 = box[3] + 1;
+
+  // the whole tiles within the box
+  const int tx0 = tiles ? (x0 + DT_PICK_TILE - 1) / DT_PICK_TILE : 0;
+  const int ty0 = tiles ? (y0 + DT_PICK_TILE - 1) / DT_PICK_TILE : 0;
+  const int tx1 = tiles ? MIN(tiles->tw, x1 / DT_PICK_TILE) : 0;
+  const int ty1 = tiles ? MIN(tiles->th, y1 / DT_PICK_TILE) : 0;
+
+  if(tx0 >= tx1 || ty0 >= ty1)
+    _pick_scan(pixel, width, x0, x1, y0, y1, sum, min, max);
+  else
+  {
+    const int tw = tiles->tw;
+    const double *const s = tiles->sum;
+    for(int k = 0; k < 3; k++)
+      sum[k] = s[3 * ((size_t)ty1 * (tw + 1) + tx1) + k] - s[3 * ((size_t)ty0 * (tw + 1) + tx1) + k]
+               - s[3 * ((size_t)ty1 * (tw + 1) + tx0) + k] + s[3 * ((size_t)ty0 * (tw + 1) + tx0) + k];
+    for(int ty = ty0; ty < ty1; ty++)
+      for(int tx = tx0; tx < tx1; tx++)
+        for(int k = 0; k < 3; k++)
+        {
+          min[k] = MIN(min[k], tiles->min[3 * ((size_t)ty * tw + tx) + k]);
+          max[k] = MAX(max[k], tiles->max[3 * ((size_t)ty * tw + tx) + k]);
+        }
+
+    // the border around the tiles
+    const int ix0 = tx0 * DT_PICK_TILE, ix1 = tx1 * DT_PICK_TILE;
+    const int iy0 = ty0 * DT_PICK_TILE, iy1 = ty1 * DT_PICK_TILE;
+    _pick_scan(pixel, width, x0, x1, y0, iy0, sum, min, max);
+    _pick_scan(pixel, width, x0, x1, iy1, y1, sum, min, max);
+    _pick_scan(pixel, width, x0, ix0, iy0, iy1, sum, min, max);
+    _pick_scan(pixel, width, ix1, x1, iy0, iy1, sum, min, max);
+  }
+
+  const double n = (double)(x1 - x0) * (y1 - y0);
+  for(int k = 0; k < 3; k++) mean[k] = sum[k] / n;
+}
+
 static void _pixelpipe_pick_from_image(const float *const pixel, const dt_iop_roi_t *roi_in,
+                                       const _pick_tiles_t *const tiles,
                                        cmsHTRANSFORM xform_rgb2lab, cmsHTRANSFORM xform_rgb2rgb,
                                        const float *const pick_box, const float *const pick_point,
                                        const int pick_size, float *pick_color_rgb_min, float *pick_color_rgb_max,
@@ -720,25 +1221,10 @@ static void _pixelpipe_pick_from_image(const float *const pixel, const dt_iop_ro
   point[0] = MIN(roi_in->width - 1, MAX(0, pick_point[0] * roi_in->width));
   point[1] = MIN(roi_in->height - 1, MAX(0, pick_point[1] * roi_in->height));
 
-  float rgb[3] = { 0.0f };
-
-  const float w = 1.0 / ((box[3] - box[1] + 1) * (box[2] - box[0] + 1));
-
   if(pick_size == DT_COLORPICKER_SIZE_BOX)
   {
-    for(int j = box[1]; j <= box[3]; j++)
-      for(int i = box[0]; i <= box[2]; i++)
-      {
-        for(int k = 0; k < 3; k++)
-        {
-          picked_color_rgb_min[k]
-              = MIN(picked_color_rgb_min[k], pixel[4 * (roi_in->width * j + i) + k]);
-          picked_color_rgb_max[k]
-              = MAX(picked_color_rgb_max[k], pixel[4 * (roi_in->width * j + i) + k]);
-          rgb[k] += w * pixel[4 * (roi_in->width * j + i) + k];
-        }
-      }
-    for(int k = 0; k < 3; k++) picked_color_rgb_mean[k] = rgb[k];
+    _pick_box(pixel, roi_in->width, box, tiles, picked_color_rgb_min, picked_color_rgb_max,
+              picked_color_rgb_mean);
   }
   else
   {
@@ -839,11 +1325,13 @@ static void _pixelpipe_pick_live_samples(const float *const input, const dt_iop_
 
   // display rgb --> lab
   if(display_profile && lab_profile)
-    xform_rgb2lab = cmsCreateTransform(display_profile, TYPE_RGB_FLT, lab_profile, TYPE_Lab_FLT, INTENT_PERCEPTUAL, 0);
+    xform_rgb2lab = dt_colorspaces_get_transform(display_profile, TYPE_RGB_FLT, lab_profile, TYPE_Lab_FLT,
+                                                 INTENT_PERCEPTUAL);
 
   // display rgb --> histogram rgb
   if(display_profile && histogram_profile)
-    xform_rgb2rgb = cmsCreateTransform(display_profile, TYPE_RGB_FLT, histogram_profile, TYPE_RGB_FLT, INTENT_PERCEPTUAL, 0);
+    xform_rgb2rgb = dt_colorspaces_get_transform(display_profile, TYPE_RGB_FLT, histogram_profile, TYPE_RGB_FLT,
+                                                 INTENT_PERCEPTUAL);
 
   if(darktable.color_profiles->display_type == DT_COLORSPACE_DISPLAY || histogram_type == DT_COLORSPACE_DISPLAY)
     pthread_rwlock_unlock(&darktable.color_profiles->xprofile_lock);
@@ -851,6 +1339,20 @@ static void _pixelpipe_pick_live_samples(const float *const input, const dt_iop_
   dt_colorpicker_sample_t *sample = NULL;
   GSList *samples = darktable.lib->proxy.colorpicker.live_samples;
 
+  // once the boxes cover more than half of the buffer, going over it once for the tiles is cheaper
+  size_t area = 0;
+  for(GSList *l = samples; l; l = g_slist_next(l))
+  {
+    const dt_colorpicker_sample_t *const smp = l->data;
+    if(smp->locked || smp->size != DT_COLORPICKER_SIZE_BOX) continue;
+    area += (size_t)(MAX(0.0f, smp->box[2] - smp->box[0]) * roi_in->width + 1)
+            * (size_t)(MAX(0.0f, smp->box[3] - smp->box[1]) * roi_in->height + 1);
+  }
+  _pick_tiles_t tiles = { 0 };
+  const gboolean have_tiles
+      = 2 * area > (size_t)roi_in->width * roi_in->height
+        && _pick_tiles_init(&tiles, input, roi_in->width, roi_in->height);
+
   while(samples)
   {
     sample = samples->data;
@@ -861,7 +1363,7 @@ static void _pixelpipe_pick_live_samples(const float *const input, const dt_iop_
       continue;
     }
 
-    _pixelpipe_pick_from_image(input, roi_in, xform_rgb2lab, xform_rgb2rgb,
+    _pixelpipe_pick_from_image(input, roi_in, have_tiles ? &tiles : NULL, xform_rgb2lab, xform_rgb2rgb,
         sample->box, sample->point, sample->size,
         sample->picked_color_rgb_min, sample->picked_color_rgb_max, sample->picked_color_rgb_mean,
         sample->picked_color_lab_min, sample->picked_color_lab_max, sample->picked_color_lab_mean);
@@ -869,8 +1371,9 @@ static void _pixelpipe_pick_live_samples(const float *const input, const dt_iop_
     samples = g_slist_next(samples);
   }
 
-  if(xform_rgb2lab) cmsDeleteTransform(xform_rgb2lab);
-  if(xform_rgb2rgb) cmsDeleteTransform(xform_rgb2rgb);
+  if(have_tiles) _pick_tiles_cleanup(&tiles);
+  dt_colorspaces_release_transform(xform_rgb2lab);
+  dt_colorspaces_release_transform(xform_rgb2rgb);
 }
 
 static void _pixelpipe_pick_primary_colorpicker(dt_develop_t *dev, const float *const input, const dt_iop_roi_t *roi_in)
@@ -909,66 +1412,107 @@ static void _pixelpipe_pick_primary_colorpicker(dt_develop_t *dev, const float *
 
   // display rgb --> lab
   if(display_profile && lab_profile)
-    xform_rgb2lab = cmsCreateTransform(display_profile, TYPE_RGB_FLT, lab_profile, TYPE_Lab_FLT, INTENT_PERCEPTUAL, 0);
+    xform_rgb2lab = dt_colorspaces_get_transform(display_profile, TYPE_RGB_FLT, lab_profile, TYPE_Lab_FLT,
+                                                 INTENT_PERCEPTUAL);
 
   // display rgb --> histogram rgb
   if(display_profile && histogram_profile)
-    xform_rgb2rgb = cmsCreateTransform(display_profile, TYPE_RGB_FLT, histogram_profile, TYPE_RGB_FLT, INTENT_PERCEPTUAL, 0);
+    xform_rgb2rgb = dt_colorspaces_get_transform(display_profile, TYPE_RGB_FLT, histogram_profile, TYPE_RGB_FLT,
+                                                 INTENT_PERCEPTUAL);
 
   if(darktable.color_profiles->display_type == DT_COLORSPACE_DISPLAY || histogram_type == DT_COLORSPACE_DISPLAY)
     pthread_rwlock_unlock(&darktable.color_profiles->xprofile_lock);
 
-  _pixelpipe_pick_from_image(input, roi_in, xform_rgb2lab, xform_rgb2rgb,
+  _pixelpipe_pick_from_image(input, roi_in, NULL, xform_rgb2lab, xform_rgb2rgb,
       dev->gui_module->color_picker_box, dev->gui_module->color_picker_point, darktable.lib->proxy.colorpicker.size,
       darktable.lib->proxy.colorpicker.picked_color_rgb_min, darktable.lib->proxy.colorpicker.picked_color_rgb_max, darktable.lib->proxy.colorpicker.picked_color_rgb_mean,
       darktable.lib->proxy.colorpicker.picked_color_lab_min, darktable.lib->proxy.colorpicker.picked_color_lab_max, darktable.lib->proxy.colorpicker.picked_color_lab_mean);
 
-  if(xform_rgb2lab) cmsDeleteTransform(xform_rgb2lab);
-  if(xform_rgb2rgb) cmsDeleteTransform(xform_rgb2rgb);
+  dt_colorspaces_release_transform(xform_rgb2lab);
+  dt_colorspaces_release_transform(xform_rgb2rgb);
 }
 
-static void _pixelpipe_final_histogram(dt_develop_t *dev, const float *const input, const dt_iop_roi_t *roi_in)
+// the area of the final histogram, constrained to the colorpicker if it is active in area mode
+static void _pixelpipe_final_histogram_roi(dt_develop_t *dev, const dt_iop_roi_t *roi_in,
+                                           dt_histogram_roi_t *histogram_roi)
 {
-  float *img_tmp = NULL;
+  *histogram_roi = (dt_histogram_roi_t){ .width = roi_in->width, .height = roi_in->height,
+                                         .crop_x = 0, .crop_y = 0, .crop_width = 0, .crop_height = 0 };
 
-  dt_dev_histogram_collection_params_t histogram_params = { 0 };
-  const dt_iop_colorspace_type_t cst = iop_cs_rgb;
-  dt_dev_histogram_stats_t histogram_stats = { .bins_count = 256, .ch = 4, .pixels = 0 };
-  uint32_t histogram_max[4] = { 0 };
-  dt_histogram_roi_t histogram_roi = { .width = roi_in->width, .height = roi_in->height,
-                                      .crop_x = 0, .crop_y = 0, .crop_width = 0, .crop_height = 0 };
-
-  // Constraining the area if the colorpicker is active in area mode
   if(dev->gui_module && !strcmp(dev->gui_module->op, "colorout")
      && dev->gui_module->request_color_pick != DT_REQUEST_COLORPICK_OFF
      && darktable.lib->proxy.colorpicker.restrict_histogram)
   {
     if(darktable.lib->proxy.colorpicker.size == DT_COLORPICKER_SIZE_BOX)
     {
-      histogram_roi.crop_x = MIN(roi_in->width, MAX(0, dev->gui_module->color_picker_box[0] * roi_in->width));
-      histogram_roi.crop_y = MIN(roi_in->height, MAX(0, dev->gui_module->color_picker_box[1] * roi_in->height));
-      histogram_roi.crop_width = roi_in->width - MIN(roi_in->width, MAX(0, dev->gui_module->color_picker_box[2] * roi_in->width));
-      histogram_roi.crop_height = roi_in->height - MIN(roi_in->height, MAX(0, dev->gui_module->color_picker_box[3] * roi_in->height));
+      histogram_roi->crop_x = MIN(roi_in->width, MAX(0, dev->gui_module->color_picker_box[0] * roi_in->width));
+      histogram_roi->crop_y = MIN(roi_in->height, MAX(0, dev->gui_module->color_picker_box[1] * roi_in->height));
+      histogram_roi->crop_width = roi_in->width - MIN(roi_in->width, MAX(0, dev->gui_module->color_picker_box[2] * roi_in->width));
+      histogram_roi->crop_height = roi_in->height - MIN(roi_in->height, MAX(0, dev->gui_module->color_picker_box[3] * roi_in->height));
     }
     else
     {
-      histogram_roi.crop_x = MIN(roi_in->width, MAX(0, dev->gui_module->color_picker_point[0] * roi_in->width));
-      histogram_roi.crop_y = MIN(roi_in->height, MAX(0, dev->gui_module->color_picker_point[1] * roi_in->height));
-      histogram_roi.crop_width = roi_in->width - MIN(roi_in->width, MAX(0, dev->gui_module->color_picker_point[0] * roi_in->width));
-      histogram_roi.crop_height = roi_in->height - MIN(roi_in->height, MAX(0, dev->gui_module->color_picker_point[1] * roi_in->height));
+      histogram_roi->crop_x = MIN(roi_in->width, MAX(0, dev->gui_module->color_picker_point[0] * roi_in->width));
+      histogram_roi->crop_y = MIN(roi_in->height, MAX(0, dev->gui_module->color_picker_point[1] * roi_in->height));
+      histogram_roi->crop_width = roi_in->width - MIN(roi_in->width, MAX(0, dev->gui_module->color_picker_point[0] * roi_in->width));
+      histogram_roi->crop_height = roi_in->height - MIN(roi_in->height, MAX(0, dev->gui_module->color_picker_point[1] * roi_in->height));
     }
   }
+}
 
-  dt_colorspaces_color_profile_type_t histogram_type = DT_COLORSPACE_SRGB;
-  gchar *histogram_filename = NULL;
-  gchar _histogram_filename[1] = { 0 };
+// the histogram is drawn in its own profile, returns TRUE if the display rgb has to be converted to it first
+static gboolean _pixelpipe_final_histogram_profile(dt_colorspaces_color_profile_type_t *histogram_type,
+                                                   const gchar **histogram_filename)
+{
+  gchar *filename = NULL;
+  *histogram_type = DT_COLORSPACE_SRGB;
+  dt_ioppr_get_histogram_profile_type(histogram_type, &filename);
+  *histogram_filename = filename ? filename : "";
+
+  return (*histogram_type != darktable.color_profiles->display_type)
+         || (*histogram_type == DT_COLORSPACE_FILE
+             && strcmp(*histogram_filename, darktable.color_profiles->display_filename));
+}
 
-  dt_ioppr_get_histogram_profile_type(&histogram_type, &histogram_filename);
-  if(histogram_filename == NULL) histogram_filename = _histogram_filename;
+// identifies what the scopes of the preview would show: the output of gamma, the area and profile of the
+// histogram and the scope on screen. as gamma is always run on the preview pipe, the scopes are only
+// computed again when this changes.
+static uint64_t _pixelpipe_scopes_hash(dt_develop_t *dev, dt_dev_pixelpipe_t *pipe, const dt_iop_roi_t *roi_in,
+                                       const dt_iop_roi_t *roi_out, const int pos)
+{
+  uint64_t hash = dt_dev_pixelpipe_cache_hash(pipe->image.id, roi_out, pipe, pos);
 
-  if((histogram_type != darktable.color_profiles->display_type)
-     || (histogram_type == DT_COLORSPACE_FILE
-         && strcmp(histogram_filename, darktable.color_profiles->display_filename)))
+  dt_histogram_roi_t histogram_roi;
+  _pixelpipe_final_histogram_roi(dev, roi_in, &histogram_roi);
+  dt_colorspaces_color_profile_type_t histogram_type;
+  const gchar *histogram_filename;
+  _pixelpipe_final_histogram_profile(&histogram_type, &histogram_filename);
+
+  const int state[] = { dev->scope_type, histogram_type, darktable.color_profiles->display_type,
+                        histogram_roi.width, histogram_roi.height, histogram_roi.crop_x, histogram_roi.crop_y,
+                        histogram_roi.crop_width, histogram_roi.crop_height };
+  const char *str = (const char *)state;
+  for(size_t i = 0; i < sizeof(state); i++) hash = ((hash << 5) + hash) ^ str[i];
+  for(const char *c = histogram_filename; *c; c++) hash = ((hash << 5) + hash) ^ *c;
+  for(const char *c = darktable.color_profiles->display_filename; *c; c++) hash = ((hash << 5) + hash) ^ *c;
+  return hash;
+}
+
+static void _pixelpipe_final_histogram(dt_develop_t *dev, const float *const input, const dt_iop_roi_t *roi_in)
+{
+  float *img_tmp = NULL;
+
+  dt_dev_histogram_collection_params_t histogram_params = { 0 };
+  const dt_iop_colorspace_type_t cst = iop_cs_rgb;
+  dt_dev_histogram_stats_t histogram_stats = { .bins_count = 256, .ch = 4, .pixels = 0 };
+  uint32_t histogram_max[4] = { 0 };
+  dt_histogram_roi_t histogram_roi;
+  _pixelpipe_final_histogram_roi(dev, roi_in, &histogram_roi);
+
+  dt_colorspaces_color_profile_type_t histogram_type;
+  const gchar *histogram_filename;
+
+  if(_pixelpipe_final_histogram_profile(&histogram_type, &histogram_filename))
   {
     img_tmp = dt_alloc_align(64, roi_in->width * roi_in->height * 4 * sizeof(float));
 
@@ -1011,110 +1555,128 @@ static void _pixelpipe_final_histogram_waveform(dt_develop_t *dev, const float *
   dt_times_t start_time = { 0 };
   if(darktable.unmuted & DT_DEBUG_PERF) dt_get_times(&start_time);
 
-  const int waveform_height = dev->histogram_waveform_height;
-  const int waveform_stride = dev->histogram_waveform_stride;
-  uint8_t *const waveform = dev->histogram_waveform;
-  // Use integral sized bins for columns, as otherwise they will be
-  // unequal and have banding. Rely on GUI to smoothly do horizontal
-  // scaling.
   // Note that histogram_waveform_stride is pre-initialized/hardcoded,
   // but histogram_waveform_width varies, depending on preview image
   // width and # of bins.
-  const int bin_width = ceilf(roi_in->width / (float)waveform_stride);
-  const int waveform_width = ceilf(roi_in->width / (float)bin_width);
-  dev->histogram_waveform_width = waveform_width;
+  dt_histogram_waveform(input, roi_in->width, roi_in->height, dev->histogram_waveform,
+                        dev->histogram_waveform_height, dev->histogram_waveform_stride,
+                        &dev->histogram_waveform_width);
 
-  // max input size should be 1440x900, and with a bin_width of 1,
-  // that makes a maximum possible count of 900 in buf, while even if
-  // waveform buffer is 128 (about smallest possible), bin_width is
-  // 12, making max count of 10,800, still much smaller than uint16_t
-  uint16_t *buf = calloc(waveform_width * waveform_height * 3, sizeof(uint16_t));
+  if(darktable.unmuted & DT_DEBUG_PERF)
+  {
+    dt_times_t end_time = { 0 };
+    dt_get_times(&end_time);
+    fprintf(stderr, "final histogram waveform took %.3f secs (%.3f CPU)\n", end_time.clock - start_time.clock, end_time.user - start_time.user);
+  }
+}
 
-  // 1.0 is at 8/9 of the height!
-  const float _height = (float)(waveform_height - 1);
+#ifdef HAVE_OPENCL
+// the final histogram and the waveform of the preview from the input of gamma, while it is still on the device.
+// only the bins come back to the host. returns FALSE if the scopes have to be computed on the cpu after all.
+static gboolean _pixelpipe_final_scopes_cl(dt_develop_t *dev, dt_dev_pixelpipe_t *pipe, cl_mem img,
+                                           const dt_iop_roi_t *roi_in)
+{
+  const int devid = pipe->devid;
+  cl_mem img_tmp = NULL;
 
-  // count the colors into buf ...
-#ifdef _OPENMP
-#pragma omp parallel for SIMD() default(none) \
-  dt_omp_firstprivate(roi_in, bin_width, _height, waveform_width, input, buf) \
-  schedule(static)
-#endif
-  for(int in_y = 0; in_y < roi_in->height; in_y++)
+  dt_dev_histogram_collection_params_t histogram_params = { 0 };
+  dt_dev_histogram_stats_t histogram_stats = { .bins_count = 256, .ch = 4, .pixels = 0 };
+  uint32_t histogram_max[4] = { 0 };
+  dt_histogram_roi_t histogram_roi;
+  _pixelpipe_final_histogram_roi(dev, roi_in, &histogram_roi);
+
+  dt_colorspaces_color_profile_type_t histogram_type;
+  const gchar *histogram_filename;
+
+  if(_pixelpipe_final_histogram_profile(&histogram_type, &histogram_filename))
   {
-    for(int in_x = 0; in_x < roi_in->width; in_x++)
+    const dt_iop_order_iccprofile_info_t *const profile_info_from
+        = dt_ioppr_add_profile_info_to_list(dev, darktable.color_profiles->display_type,
+                                            darktable.color_profiles->display_filename, INTENT_PERCEPTUAL);
+    const dt_iop_order_iccprofile_info_t *const profile_info_to
+        = dt_ioppr_add_profile_info_to_list(dev, histogram_type, histogram_filename, INTENT_PERCEPTUAL);
+
+    img_tmp = dt_opencl_alloc_device(devid, roi_in->width, roi_in->height, 4 * sizeof(float));
+    if(img_tmp == NULL
+       || !dt_ioppr_transform_image_colorspace_rgb_cl(devid, img, img_tmp, roi_in->width, roi_in->height,
+                                                      profile_info_from, profile_info_to, "final histogram"))
     {
-      const float *const in = input + 4 * (in_y*roi_in->width + in_x);
-      const int out_x = in_x / bin_width;
-      for(int k = 0; k < 3; k++)
-      {
-        const float v = 1.0f - (8.0f / 9.0f) * in[2 - k];
-        // flipped from dt's CLAMPS so as to treat NaN's as 0 (NaN compares false)
-        const int out_y = (v < 1.0f ? (v > 0.0f ? v : 0.0f) : 1.0f) * _height;
-        __sync_add_and_fetch(buf + (out_x + waveform_width * out_y) * 3 + k, 1);
-      }
+      dt_opencl_release_mem_object(img_tmp);
+      return FALSE;
     }
   }
 
-  // TODO: Find a nicer function to map buf -> image than just clipping
-  //         float factor[3];
-  //         for(int k = 0; k < 3; k++)
-  //           factor[k] = 255.0 / (float)(maxcol[k] - mincol[k]); // leave some clipping
+  histogram_params.roi = &histogram_roi;
+  histogram_params.bins_count = 256;
+  histogram_params.mul = histogram_params.bins_count - 1;
 
-  // ... and scale that into a nice image. putting the pixels into the image directly gets too
-  // saturated/clips.
+  const gboolean histogram_done
+      = dt_histogram_helper_cl(devid, &histogram_params, &histogram_stats, iop_cs_rgb, iop_cs_NONE,
+                               img_tmp ? img_tmp : img, &dev->histogram, FALSE, NULL);
+  dt_opencl_release_mem_object(img_tmp);
+  if(!histogram_done) return FALSE;
 
-  // new scale factor to do about the same as the old one for 1MP views, but scale to hidpi
-  const float scale = 0.5 * 1e6f/(roi_in->height*roi_in->width) *
-    (waveform_width*waveform_height) / (350.0f*233.)
-    / 255.0f; // normalization to 0..1 for gamma correction
-  const float gamma = 1.0 / 1.5; // TODO make this settable from the gui?
-  //uint32_t mincol[3] = {UINT32_MAX,UINT32_MAX,UINT32_MAX}, maxcol[3] = {0,0,0};
-  // even bin_width 12 and height 900 image gives 10,800 byte cache, more normal will ~1K
-  const int cache_size = (roi_in->height * bin_width) + 1;
-  uint8_t *cache = (uint8_t *)calloc(cache_size, sizeof(uint8_t));
+  dt_histogram_max_helper(&histogram_stats, iop_cs_rgb, iop_cs_NONE, &dev->histogram, histogram_max);
+  dev->histogram_max = MAX(MAX(histogram_max[0], histogram_max[1]), histogram_max[2]);
 
-#ifdef _OPENMP
-#pragma omp parallel for SIMD() default(none) \
-  dt_omp_firstprivate(waveform_width, waveform_height, waveform_stride, buf, waveform, cache, scale, gamma) \
-  schedule(static) collapse(2)
+  if(dev->scope_type == DT_DEV_SCOPE_WAVEFORM)
+    return dt_histogram_waveform_cl(devid, img, roi_in->width, roi_in->height, dev->histogram_waveform,
+                                    dev->histogram_waveform_height, dev->histogram_waveform_stride,
+                                    &dev->histogram_waveform_width);
+  return TRUE;
+}
 #endif
-  for(int k = 0; k < 3; k++)
+
+// brings the input of a module into colorspace cst. the converted copy goes into a cache line of its own, derived
+// from the line of the input which stays as it is. so a module processing in one colorspace and blending in
+// another one, and its next runs while only its own params change, pay the conversion of the input only once.
+// input and input_format point at the copy afterwards, or at the input itself if it can't be kept in the cache.
+static void _pixelpipe_input_colorspace(dt_dev_pixelpipe_t *pipe, dt_iop_module_t *module, void *source,
+                                        const void *output, const dt_iop_roi_t *roi_in, const int cst,
+                                        void **input, dt_iop_buffer_dsc_t **input_format)
+{
+  const dt_iop_order_iccprofile_info_t *const profile = dt_ioppr_get_pipe_work_profile_info(pipe);
+  dt_iop_buffer_dsc_t *source_format = dt_dev_pixelpipe_cache_get_dsc(&pipe->cache, source);
+  if(!source_format || source_format->datatype != TYPE_FLOAT || source_format->channels != 4)
   {
-    for(int out_y = 0; out_y < waveform_height; out_y++)
-    {
-      const uint16_t *const in = buf + (waveform_width * out_y) * 3 + k;
-      uint8_t *const out = waveform + (waveform_stride * (waveform_height * k + out_y));
-      for(int out_x = 0; out_x < waveform_width; out_x++)
-      {
-        //mincol[k] = MIN(mincol[k], in[k]);
-        //maxcol[k] = MAX(maxcol[k], in[k]);
-        const uint16_t v = in[out_x * 3];
-        // cache XORd result so common casees cached and cache misses are quick to find
-        if(!cache[v])
-        {
-          // multiple threads may be writing to cache[v], but as
-          // they're writing the same value, don't declare omp atomic
-          cache[v] = (uint8_t)(CLAMP(powf(v * scale, gamma) * 255.0, 0, 255)) ^ 1;
-        }
-        out[out_x] = cache[v] ^ 1;
-        //               if(in[k] == 0)
-        //                 out[k] = 0;
-        //               else
-        //                 out[k] = (float)(in[k] - mincol[k]) * factor[k];
-      }
-    }
+    // convert in place
+    dt_ioppr_transform_image_colorspace(module, *input, *input, roi_in->width, roi_in->height,
+                                        (*input_format)->cst, cst, &(*input_format)->cst, profile);
+    return;
   }
-  //printf("mincol %d,%d,%d maxcol %d,%d,%d\n", mincol[0], mincol[1], mincol[2], maxcol[0], maxcol[1], maxcol[2]);
 
-  free(cache);
-  free(buf);
+  *input = source;
+  *input_format = source_format;
+  const int source_cst = source_format->cst;
+  if(source_cst == cst) return;
 
-  if(darktable.unmuted & DT_DEBUG_PERF)
+  void *data = NULL;
+  dt_iop_buffer_dsc_t *dsc = NULL;
+  const size_t size = sizeof(float) * 4 * roi_in->width * roi_in->height;
+  const int miss = dt_dev_pixelpipe_cache_get_derived(&pipe->cache, source, cst, output, size, &data, &dsc);
+  if(data)
   {
-    dt_times_t end_time = { 0 };
-    dt_get_times(&end_time);
-    fprintf(stderr, "final histogram waveform took %.3f secs (%.3f CPU)\n", end_time.clock - start_time.clock, end_time.user - start_time.user);
+    if(miss)
+      dt_ioppr_transform_image_colorspace(module, source, data, roi_in->width, roi_in->height, source_cst, cst,
+                                          &dsc->cst, profile);
+    if(dsc->cst == cst)
+    {
+      *input = data;
+      *input_format = dsc;
+      return;
+    }
+    // no conversion for this one, the input stays as it is
+    dt_dev_pixelpipe_cache_invalidate(&pipe->cache, data);
+    *input_format = dt_dev_pixelpipe_cache_get_dsc(&pipe->cache, source);
+    return;
   }
+
+  // no room for a copy: convert in place. the line does not hold the output of the previous module any more.
+  source_format = dt_dev_pixelpipe_cache_get_dsc(&pipe->cache, source);
+  *input_format = source_format;
+  dt_ioppr_transform_image_colorspace(module, source, source, roi_in->width, roi_in->height, source_cst, cst,
+                                      &source_format->cst, profile);
+  if(source_format->cst != source_cst) dt_dev_pixelpipe_cache_invalidate(&pipe->cache, source);
 }
 
 // returns 1 if blend process need the module default colorspace
@@ -1134,6 +1696,605 @@ static int _transform_for_blend(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *p
   return ret;
 }
 
+static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void **output,
+                                        void **cl_mem_output, dt_iop_buffer_dsc_t **out_format,
+                                        const dt_iop_roi_t *roi_out, GList *modules, GList *pieces, int pos);
+
+// in a tile-streamed run every module has to produce a bit more than asked for, so the neighbourhood
+// operations further down the pipe see real pixels at the strip borders instead of the edge.
+// how far around an output pixel the module looks into its input
+static int _pixelpipe_piece_overlap(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece,
+                                    const dt_iop_roi_t *roi_out)
+{
+  dt_iop_roi_t roi_in = *roi_out;
+  module->modify_roi_in(module, piece, roi_out, &roi_in);
+  dt_develop_tiling_t tiling = { 0 };
+  module->tiling_callback(module, piece, &roi_in, roi_out, &tiling);
+  int overlap = tiling.overlap;
+
+  const dt_develop_blend_params_t *const d = (const dt_develop_blend_params_t *)piece->blendop_data;
+  if(d && d->mask_mode != DEVELOP_MASK_DISABLED)
+  {
+    // mask feathering and blurring look at the neighbourhood, too
+    const float feather = 2.0f * d->feathering_radius * roi_out->scale / piece->iscale;
+    const float blur = 4.0f * d->blur_radius * roi_out->scale / piece->iscale;
+    overlap = MAX(overlap, (int)ceilf(feather + blur));
+  }
+  return overlap;
+}
+
+static gboolean _pixelpipe_stream_pad(dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece,
+                                      const dt_iop_roi_t *roi_out, dt_iop_roi_t *roi_pad)
+{
+  const int overlap = _pixelpipe_piece_overlap(module, piece, roi_out);
+  if(overlap <= 0) return FALSE;
+
+  const int max_width = piece->buf_out.width * roi_out->scale;
+  const int max_height = piece->buf_out.height * roi_out->scale;
+  const int x0 = MAX(0, roi_out->x - overlap);
+  const int y0 = MAX(0, roi_out->y - overlap);
+  const int x1 = MAX(roi_out->x + roi_out->width, MIN(max_width, roi_out->x + roi_out->width + overlap));
+  const int y1 = MAX(roi_out->y + roi_out->height, MIN(max_height, roi_out->y + roi_out->height + overlap));
+
+  *roi_pad = *roi_out;
+  roi_pad->x = MIN(x0, roi_out->x);
+  roi_pad->y = MIN(y0, roi_out->y);
+  roi_pad->width = x1 - roi_pad->x;
+  roi_pad->height = y1 - roi_pad->y;
+  return memcmp(roi_pad, roi_out, sizeof(dt_iop_roi_t)) != 0;
+}
+
+// processes the module for the padded roi and crops the result to what was asked for
+static int _pixelpipe_process_padded(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void **output,
+                                     dt_iop_buffer_dsc_t **out_format, const dt_iop_roi_t *roi_out,
+                                     const dt_iop_roi_t *roi_pad, GList *modules, GList *pieces, const int pos,
+                                     const uint64_t hash)
+{
+  void *padded = NULL;
+  void *cl_mem_padded = NULL;
+  dt_iop_buffer_dsc_t _padded_format = **out_format;
+  dt_iop_buffer_dsc_t *padded_format = &_padded_format;
+
+  const int padded_pos = pipe->stream_padded_pos;
+  pipe->stream_padded_pos = pos;
+  const int err = dt_dev_pixelpipe_process_rec(pipe, dev, &padded, &cl_mem_padded, &padded_format, roi_pad,
+                                               modules, pieces, pos);
+  pipe->stream_padded_pos = padded_pos;
+  if(err) return 1;
+
+  const size_t bpp = dt_iop_buffer_dsc_to_bpp(padded_format);
+
+  dt_pthread_mutex_lock(&pipe->busy_mutex);
+  if(pipe->shutdown)
+  {
+    dt_pthread_mutex_unlock(&pipe->busy_mutex);
+#ifdef HAVE_OPENCL
+    dt_opencl_release_mem_object(cl_mem_padded);
+#endif
+    return 1;
+  }
+
+#ifdef HAVE_OPENCL
+  if(cl_mem_padded != NULL)
+  {
+    const cl_int clerr = dt_opencl_copy_device_to_host(pipe->devid, padded, cl_mem_padded, roi_pad->width,
+                                                       roi_pad->height, bpp);
+    dt_opencl_release_mem_object(cl_mem_padded);
+    if(clerr != CL_SUCCESS)
+    {
+      pipe->opencl_error = 1;
+      dt_pthread_mutex_unlock(&pipe->busy_mutex);
+      return 1;
+    }
+  }
+#endif
+
+  (void)dt_dev_pixelpipe_cache_get(&(pipe->cache), hash, bpp * roi_out->width * roi_out->height, output,
+                                   out_format);
+  **out_format = *padded_format;
+
+  const int dx = roi_out->x - roi_pad->x;
+  const int dy = roi_out->y - roi_pad->y;
+  for(int j = 0; j < roi_out->height; j++)
+    memcpy((char *)*output + bpp * j * roi_out->width,
+           (const char *)padded + bpp * ((size_t)(j + dy) * roi_pad->width + dx), bpp * roi_out->width);
+
+  dt_pthread_mutex_unlock(&pipe->busy_mutex);
+  return 0;
+}
+
+// 16k pixels of 4 floats, small enough to stay in L2 while all modules of a run work on it
+#define DT_PIXELPIPE_POINTWISE_BLOCK 16384
+
+// whether the blend mask of the module is zero everywhere in roi, so that its output is its input
+static gboolean _pixelpipe_mask_empty(dt_dev_pixelpipe_t *pipe, dt_iop_module_t *module,
+                                      dt_dev_pixelpipe_iop_t *piece, const dt_iop_roi_t *roi)
+{
+  const dt_develop_blend_params_t *const d = (const dt_develop_blend_params_t *)piece->blendop_data;
+  if(!d || d->mask_mode == DEVELOP_MASK_DISABLED || !(module->flags() & IOP_FLAGS_SUPPORTS_BLENDING)) return FALSE;
+
+  // the mask is still wanted for display, as a raster mask of later modules or the histogram of the module
+  if(module->request_mask_display != DT_DEV_PIXELPIPE_DISPLAY_NONE || pipe->store_all_raster_masks
+     || dt_iop_is_raster_mask_used(module, 0) || (piece->request_histogram & DT_REQUEST_ON))
+    return FALSE;
+
+  // the opacity scales whatever mask there is, last
+  if(d->opacity / 100.0f < 1e-4f) return TRUE;
+
+  // otherwise only a drawn mask, without inversion or tone curve, is known to be zero away from its shapes
+  if(d->mask_mode != (DEVELOP_MASK_ENABLED | DEVELOP_MASK_MASK) || (module->flags() & IOP_FLAGS_NO_MASKS)
+     || (d->mask_combine & (DEVELOP_COMBINE_INV | DEVELOP_COMBINE_MASKS_POS))
+     || fabsf(d->contrast) >= 0.01f || fabsf(d->brightness) >= 0.01f)
+    return FALSE;
+
+  float box[4];
+  if(dt_masks_get_group_area(module, piece, box)) return FALSE;
+
+  // blurring and feathering spread the mask beyond its shapes
+  const float pad = (3.0f * fmaxf(d->blur_radius, 0.0f) + 2.0f * fmaxf(d->feathering_radius, 0.0f)) * roi->scale
+                        / piece->iscale
+                    + 2.0f;
+  return box[2] * roi->scale + pad < roi->x || box[0] * roi->scale - pad > roi->x + roi->width
+         || box[3] * roi->scale + pad < roi->y || box[1] * roi->scale - pad > roi->y + roi->height;
+}
+
+static inline gboolean _pixelpipe_piece_skipped(dt_develop_t *dev, dt_iop_module_t *module,
+                                                dt_dev_pixelpipe_iop_t *piece)
+{
+  return !piece->enabled
+         || (dev->gui_module && dev->gui_module->operation_tags_filter() & module->operation_tags());
+}
+
+// modules providing process_pointwise() which need nothing else from the pipe for this run
+static gboolean _pixelpipe_pointwise_usable(dt_dev_pixelpipe_t *pipe, dt_iop_module_t *module,
+                                            dt_dev_pixelpipe_iop_t *piece, const dt_iop_roi_t *roi)
+{
+  if(!module->process_pointwise) return FALSE;
+  // the intermediate buffers of a fused run never end up in the cache. that's only fine
+  // for the pipes nobody is editing in.
+  if(!(pipe->type & (DT_DEV_PIXELPIPE_EXPORT | DT_DEV_PIXELPIPE_THUMBNAIL))) return FALSE;
+  if(pipe->mask_display != DT_DEV_PIXELPIPE_DISPLAY_NONE) return FALSE;
+#ifdef HAVE_OPENCL
+  if(dt_opencl_is_inited() && pipe->opencl_enabled && pipe->devid >= 0) return FALSE;
+#endif
+  if(piece->blendop_data
+     && ((dt_develop_blend_params_t *)piece->blendop_data)->mask_mode != DEVELOP_MASK_DISABLED)
+    return FALSE;
+  if(piece->request_histogram & DT_REQUEST_ON) return FALSE;
+
+  dt_iop_roi_t roi_in = *roi;
+  module->modify_roi_in(module, piece, roi, &roi_in);
+  return !memcmp(&roi_in, roi, sizeof(dt_iop_roi_t));
+}
+
+// walks back over the run of pointwise modules ending at the given one. returns the number of
+// modules in the run, and leaves the first of them in modules, pieces and pos. nothing converts the
+// colorspace between the modules of a run, so each one has to put out what the next one takes.
+static int _pixelpipe_pointwise_run(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, const dt_iop_roi_t *roi,
+                                    GList **modules, GList **pieces, int *pos)
+{
+  if(!_pixelpipe_pointwise_usable(pipe, (*modules)->data, (*pieces)->data, roi)) return 0;
+
+  int run = 1;
+  int k = *pos - 1;
+  dt_iop_module_t *next = (dt_iop_module_t *)(*modules)->data;
+  dt_dev_pixelpipe_iop_t *next_piece = (dt_dev_pixelpipe_iop_t *)(*pieces)->data;
+  for(GList *m = g_list_previous(*modules), *p = g_list_previous(*pieces); m && p;
+      m = g_list_previous(m), p = g_list_previous(p), k--)
+  {
+    dt_iop_module_t *module = (dt_iop_module_t *)m->data;
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)p->data;
+    if(_pixelpipe_piece_skipped(dev, module, piece)) continue;
+    if(!_pixelpipe_pointwise_usable(pipe, module, piece, roi)
+       || module->output_colorspace(module, pipe, piece) != next->input_colorspace(next, pipe, next_piece))
+      break;
+    next = module;
+    next_piece = piece;
+    *modules = m;
+    *pieces = p;
+    *pos = k;
+    run++;
+  }
+  return run;
+}
+
+// processes the run of pointwise modules from first_module up to the last one in modules in one pass of
+// small blocks, instead of every module reading and writing a full buffer.
+static int _pixelpipe_process_pointwise(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void **output,
+                                        dt_iop_buffer_dsc_t **out_format, const dt_iop_roi_t *roi_out,
+                                        GList *modules, GList *first_module, GList *first_piece,
+                                        const int first_pos, const int run, const uint64_t hash,
+                                        const size_t bufsize)
+{
+  void *input = NULL;
+  void *cl_mem_input = NULL;
+  dt_iop_buffer_dsc_t _input_format = { 0 };
+  dt_iop_buffer_dsc_t *input_format = &_input_format;
+  if(dt_dev_pixelpipe_process_rec(pipe, dev, &input, &cl_mem_input, &input_format, roi_out,
+                                  g_list_previous(first_module), g_list_previous(first_piece), first_pos - 1))
+    return 1;
+
+  dt_iop_module_t **run_modules = malloc(sizeof(dt_iop_module_t *) * run);
+  dt_dev_pixelpipe_iop_t **run_pieces = malloc(sizeof(dt_dev_pixelpipe_iop_t *) * run);
+  int n = 0;
+  for(GList *m = first_module, *p = first_piece; m && n < run; m = g_list_next(m), p = g_list_next(p))
+  {
+    if(_pixelpipe_piece_skipped(dev, (dt_iop_module_t *)m->data, (dt_dev_pixelpipe_iop_t *)p->data)) continue;
+    run_modules[n] = (dt_iop_module_t *)m->data;
+    run_pieces[n] = (dt_dev_pixelpipe_iop_t *)p->data;
+    n++;
+    if(m == modules) break;
+  }
+
+  // the kernels only deal with 4 floats per pixel. a module in the run might still want something else.
+  gboolean fused = (n == run) && input_format->datatype == TYPE_FLOAT && input_format->channels == 4;
+  dt_iop_buffer_dsc_t dsc = *input_format;
+  for(int k = 0; k < n && fused; k++)
+  {
+    run_modules[k]->output_format(run_modules[k], pipe, run_pieces[k], &dsc);
+    fused = dsc.datatype == TYPE_FLOAT && dsc.channels == 4;
+  }
+
+  dt_pthread_mutex_lock(&pipe->busy_mutex);
+  if(pipe->shutdown)
+  {
+    dt_pthread_mutex_unlock(&pipe->busy_mutex);
+    free(run_modules);
+    free(run_pieces);
+    return 1;
+  }
+
+  // without fusing, ping-pong between the output and a temporary buffer so the last module ends in output
+  void *tmp = fused ? NULL : dt_alloc_align(64, bufsize);
+  if(!fused && !tmp)
+  {
+    dt_pthread_mutex_unlock(&pipe->busy_mutex);
+    free(run_modules);
+    free(run_pieces);
+    return 1;
+  }
+
+  (void)dt_dev_pixelpipe_cache_get(&(pipe->cache), hash, bufsize, output, out_format);
+
+  dt_times_t start;
+  dt_get_times(&start);
+  dt_memory_accounting_begin();
+
+  // the input comes in whatever colorspace the previous module left it in, the first module of the run
+  // takes it in its own
+  _pixelpipe_input_colorspace(pipe, run_modules[0], input, *output, roi_out,
+                              run_modules[0]->input_colorspace(run_modules[0], pipe, run_pieces[0]), &input,
+                              &input_format);
+
+  pipe->dsc = *input_format;
+  for(int k = 0; k < n; k++)
+  {
+    dt_iop_module_t *module = run_modules[k];
+    dt_dev_pixelpipe_iop_t *piece = run_pieces[k];
+    piece->processed_roi_in = piece->processed_roi_out = *roi_out;
+    piece->dsc_out = piece->dsc_in = pipe->dsc;
+    module->output_format(module, pipe, piece, &piece->dsc_out);
+    pipe->dsc = piece->dsc_out;
+
+    if(fused)
+    {
+      if(module->process_pointwise_prepare) module->process_pointwise_prepare(module, piece);
+    }
+    else
+    {
+      void *in = k == 0 ? input : (((n - k) & 1) ? tmp : *output);
+      void *out = ((n - 1 - k) & 1) ? tmp : *output;
+      module->process(module, piece, in, out, roi_out, roi_out);
+    }
+    piece->dsc_out = pipe->dsc;
+  }
+  dt_free_align(tmp);
+
+  if(fused)
+  {
+    const float *const in = (const float *)input;
+    float *const out = (float *)*output;
+    const size_t npixels = (size_t)roi_out->width * roi_out->height;
+    const size_t nblocks = (npixels + DT_PIXELPIPE_POINTWISE_BLOCK - 1) / DT_PIXELPIPE_POINTWISE_BLOCK;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+    dt_omp_firstprivate(in, out, npixels, nblocks, n, run_modules, run_pieces) \
+    schedule(static)
+#endif
+    for(size_t b = 0; b < nblocks; b++)
+    {
+      const size_t offset = b * DT_PIXELPIPE_POINTWISE_BLOCK;
+      const size_t count = MIN(DT_PIXELPIPE_POINTWISE_BLOCK, npixels - offset);
+      for(int k = 0; k < n; k++)
+        run_modules[k]->process_pointwise(run_modules[k], run_pieces[k], (k == 0 ? in : out) + 4 * offset,
+                                          out + 4 * offset, count);
+    }
+  }
+
+  **out_format = pipe->dsc;
+
+  dt_show_times_f(&start, "[dev_pixelpipe]", "processed %d modules up to `%s' on CPU%s [%s]", n,
+                  run_modules[n - 1]->op, fused ? " in one pointwise pass" : "", _pipe_type_to_str(pipe->type));
+
+  dt_times_t end;
+  dt_get_times(&end);
+  dt_dev_pixelpipe_cache_set_cost(&(pipe->cache), hash, end.clock - start.clock);
+  size_t host_peak, device_peak;
+  dt_memory_accounting_end(&host_peak, &device_peak);
+
+  if(dt_trace_enabled())
+  {
+    const dt_trace_module_event_t event = { .pipe = _pipe_type_to_str(pipe->type),
+                                            .pipe_type = pipe->type,
+                                            .module = run_modules[n - 1]->op,
+                                            .instance = run_modules[n - 1]->multi_name,
+                                            .roi_in = roi_out,
+                                            .roi_out = roi_out,
+                                            .device = "CPU",
+                                            .devid = -1,
+                                            .bytes = bufsize,
+                                            .host_peak = host_peak,
+                                            .cache = DT_TRACE_CACHE_MISS,
+                                            .fused = n,
+                                            .start = start.clock,
+                                            .end = end.clock };
+    dt_trace_module(&event);
+  }
+  dt_print(DT_DEBUG_MEMORY, "[memory] %d modules up to %s [%s] on CPU: peak %.1f MB host\n", n,
+           run_modules[n - 1]->op, _pipe_type_to_str(pipe->type), host_peak / (1024.0 * 1024.0));
+
+  dt_pthread_mutex_unlock(&pipe->busy_mutex);
+  free(run_modules);
+  free(run_pieces);
+  return 0;
+}
+
+// rows of the raw mosaic processed together are chosen to give bands of about 64k floats
+#define DT_PIXELPIPE_ROWS_BAND 65536
+
+// modules providing process_rows() which need nothing else from the pipe for this run. the first module of a
+// run may crop, all later ones have to keep the roi.
+static gboolean _pixelpipe_rows_usable(dt_dev_pixelpipe_t *pipe, dt_iop_module_t *module,
+                                       dt_dev_pixelpipe_iop_t *piece, const dt_iop_roi_t *roi,
+                                       gboolean *keeps_roi)
+{
+  if(!module->process_rows) return FALSE;
+  // same as for the pointwise runs, the intermediate buffers never end up in the cache
+  if(!(pipe->type & (DT_DEV_PIXELPIPE_EXPORT | DT_DEV_PIXELPIPE_THUMBNAIL))) return FALSE;
+  if(pipe->mask_display != DT_DEV_PIXELPIPE_DISPLAY_NONE) return FALSE;
+#ifdef HAVE_OPENCL
+  if(dt_opencl_is_inited() && pipe->opencl_enabled && pipe->devid >= 0) return FALSE;
+#endif
+  if(piece->blendop_data
+     && ((dt_develop_blend_params_t *)piece->blendop_data)->mask_mode != DEVELOP_MASK_DISABLED)
+    return FALSE;
+  if(piece->request_histogram & DT_REQUEST_ON) return FALSE;
+  if(module->process_rows_border && module->process_rows_border(module, piece) < 0) return FALSE;
+
+  dt_iop_roi_t roi_in = *roi;
+  module->modify_roi_in(module, piece, roi, &roi_in);
+  *keeps_roi = !memcmp(&roi_in, roi, sizeof(dt_iop_roi_t));
+  return TRUE;
+}
+
+// walks back over the run of raw modules ending at the given one, see _pixelpipe_pointwise_run()
+static int _pixelpipe_rows_run(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, const dt_iop_roi_t *roi,
+                               GList **modules, GList **pieces, int *pos)
+{
+  gboolean keeps_roi = FALSE;
+  if(!_pixelpipe_rows_usable(pipe, (*modules)->data, (*pieces)->data, roi, &keeps_roi)) return 0;
+
+  int run = 1;
+  int k = *pos - 1;
+  for(GList *m = g_list_previous(*modules), *p = g_list_previous(*pieces); m && p && keeps_roi;
+      m = g_list_previous(m), p = g_list_previous(p), k--)
+  {
+    dt_iop_module_t *module = (dt_iop_module_t *)m->data;
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)p->data;
+    if(_pixelpipe_piece_skipped(dev, module, piece)) continue;
+    if(!_pixelpipe_rows_usable(pipe, module, piece, roi, &keeps_roi)) break;
+    *modules = m;
+    *pieces = p;
+    *pos = k;
+    run++;
+  }
+  return run;
+}
+
+// processes the run of raw modules from first_module up to the last one in modules in bands of rows. every
+// module of the run computes its rows of the band, plus the rows the modules after it need around it, into
+// a small buffer per thread. only the input of the first and the output of the last module are full buffers.
+static int _pixelpipe_process_rows(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void **output,
+                                   dt_iop_buffer_dsc_t **out_format, const dt_iop_roi_t *roi_out,
+                                   GList *modules, GList *first_module, GList *first_piece, const int first_pos,
+                                   const int run, const uint64_t hash, const size_t bufsize)
+{
+  // only the first module of the run may have a different roi_in
+  dt_iop_roi_t roi_in = *roi_out;
+  {
+    dt_iop_module_t *first = (dt_iop_module_t *)first_module->data;
+    first->modify_roi_in(first, (dt_dev_pixelpipe_iop_t *)first_piece->data, roi_out, &roi_in);
+  }
+
+  void *input = NULL;
+  void *cl_mem_input = NULL;
+  dt_iop_buffer_dsc_t _input_format = { 0 };
+  dt_iop_buffer_dsc_t *input_format = &_input_format;
+  if(dt_dev_pixelpipe_process_rec(pipe, dev, &input, &cl_mem_input, &input_format, &roi_in,
+                                  g_list_previous(first_module), g_list_previous(first_piece), first_pos - 1))
+    return 1;
+
+  dt_iop_module_t **run_modules = malloc(sizeof(dt_iop_module_t *) * run);
+  dt_dev_pixelpipe_iop_t **run_pieces = malloc(sizeof(dt_dev_pixelpipe_iop_t *) * run);
+  // rows around the band each module has to compute for the ones after it
+  int *extra = malloc(sizeof(int) * run);
+  int n = 0;
+  for(GList *m = first_module, *p = first_piece; m && n < run; m = g_list_next(m), p = g_list_next(p))
+  {
+    if(_pixelpipe_piece_skipped(dev, (dt_iop_module_t *)m->data, (dt_dev_pixelpipe_iop_t *)p->data)) continue;
+    run_modules[n] = (dt_iop_module_t *)m->data;
+    run_pieces[n] = (dt_dev_pixelpipe_iop_t *)p->data;
+    n++;
+    if(m == modules) break;
+  }
+
+  // bands of the mosaic only. a pre-downsampled input or a module changing the format goes the usual way.
+  gboolean fused = (n == run) && input_format->channels == 1
+                   && (input_format->datatype == TYPE_FLOAT || input_format->datatype == TYPE_UINT16);
+  dt_iop_buffer_dsc_t dsc = *input_format;
+  for(int k = 0; k < n && fused; k++)
+  {
+    run_modules[k]->output_format(run_modules[k], pipe, run_pieces[k], &dsc);
+    fused = dsc.datatype == TYPE_FLOAT && dsc.channels == 1;
+  }
+  if(fused)
+  {
+    extra[n - 1] = 0;
+    for(int k = n - 1; k > 0; k--)
+      extra[k - 1] = extra[k]
+                     + (run_modules[k]->process_rows_border
+                            ? MAX(run_modules[k]->process_rows_border(run_modules[k], run_pieces[k]), 0)
+                            : 0);
+  }
+
+  dt_pthread_mutex_lock(&pipe->busy_mutex);
+  if(pipe->shutdown)
+  {
+    dt_pthread_mutex_unlock(&pipe->busy_mutex);
+    free(run_modules);
+    free(run_pieces);
+    free(extra);
+    return 1;
+  }
+
+  // without fusing, ping-pong between the output and a temporary buffer so the last module ends in output
+  void *tmp = fused ? NULL : dt_alloc_align(64, bufsize);
+  if(!fused && !tmp)
+  {
+    dt_pthread_mutex_unlock(&pipe->busy_mutex);
+    free(run_modules);
+    free(run_pieces);
+    free(extra);
+    return 1;
+  }
+
+  (void)dt_dev_pixelpipe_cache_get(&(pipe->cache), hash, bufsize, output, out_format);
+
+  dt_times_t start;
+  dt_get_times(&start);
+  dt_memory_accounting_begin();
+
+  pipe->dsc = *input_format;
+  for(int k = 0; k < n; k++)
+  {
+    dt_iop_module_t *module = run_modules[k];
+    dt_dev_pixelpipe_iop_t *piece = run_pieces[k];
+    piece->processed_roi_in = k == 0 ? roi_in : *roi_out;
+    piece->processed_roi_out = *roi_out;
+    piece->dsc_out = piece->dsc_in = pipe->dsc;
+    module->output_format(module, pipe, piece, &piece->dsc_out);
+    pipe->dsc = piece->dsc_out;
+
+    if(fused)
+    {
+      if(module->process_rows_prepare) module->process_rows_prepare(module, piece);
+    }
+    else
+    {
+      void *in = k == 0 ? input : (((n - k) & 1) ? tmp : *output);
+      void *out = ((n - 1 - k) & 1) ? tmp : *output;
+      module->process(module, piece, in, out, k == 0 ? &roi_in : roi_out, roi_out);
+    }
+    piece->dsc_out = pipe->dsc;
+  }
+  dt_free_align(tmp);
+
+  if(fused)
+  {
+    const int width = roi_out->width;
+    const int height = roi_out->height;
+    const int band = MIN(height, MAX(8, DT_PIXELPIPE_ROWS_BAND / MAX(width, 1)));
+    const int nbands = (height + band - 1) / band;
+    // two buffers per thread for the band and the extra rows of the first module
+    const size_t scratch_size = (size_t)(band + 2 * extra[0]) * width;
+    float *scratch = n > 1 ? dt_alloc_align(64, sizeof(float) * 2 * scratch_size * dt_get_num_threads()) : NULL;
+    if(n > 1 && !scratch)
+    {
+      dt_pthread_mutex_unlock(&pipe->busy_mutex);
+      free(run_modules);
+      free(run_pieces);
+      free(extra);
+      return 1;
+    }
+    const void *const in = input;
+    float *const out = (float *)*output;
+    const dt_iop_roi_t *const first_roi_in = &roi_in;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+    dt_omp_firstprivate(band, extra, first_roi_in, height, in, n, nbands, out, roi_out, run_modules, \
+                        run_pieces, scratch, scratch_size, width) \
+    schedule(static)
+#endif
+    for(int b = 0; b < nbands; b++)
+    {
+      const int y0 = b * band;
+      const int y1 = MIN(y0 + band, height);
+      float *const own = scratch + 2 * scratch_size * dt_get_thread_num();
+      const void *prev = in;
+      for(int k = 0; k < n; k++)
+      {
+        const int ya = MAX(y0 - extra[k], 0);
+        const int yb = MIN(y1 + extra[k], height);
+        // the scratch buffers are addressed like full buffers, their first row is y0 - extra[0]
+        float *const dest = (k == n - 1) ? out : own + (k & 1) * scratch_size - ((ptrdiff_t)y0 - extra[0]) * width;
+        run_modules[k]->process_rows(run_modules[k], run_pieces[k], prev, dest, k == 0 ? first_roi_in : roi_out,
+                                     roi_out, ya, yb - ya);
+        prev = dest;
+      }
+    }
+    dt_free_align(scratch);
+  }
+
+  **out_format = pipe->dsc;
+
+  dt_show_times_f(&start, "[dev_pixelpipe]", "processed %d modules up to `%s' on CPU%s [%s]", n,
+                  run_modules[n - 1]->op, fused ? " in one pass over bands of rows" : "",
+                  _pipe_type_to_str(pipe->type));
+
+  dt_times_t end;
+  dt_get_times(&end);
+  dt_dev_pixelpipe_cache_set_cost(&(pipe->cache), hash, end.clock - start.clock);
+  size_t host_peak, device_peak;
+  dt_memory_accounting_end(&host_peak, &device_peak);
+
+  if(dt_trace_enabled())
+  {
+    const dt_trace_module_event_t event = { .pipe = _pipe_type_to_str(pipe->type),
+                                            .pipe_type = pipe->type,
+                                            .module = run_modules[n - 1]->op,
+                                            .instance = run_modules[n - 1]->multi_name,
+                                            .roi_in = &roi_in,
+                                            .roi_out = roi_out,
+                                            .device = "CPU",
+                                            .devid = -1,
+                                            .bytes = bufsize,
+                                            .host_peak = host_peak,
+                                            .cache = DT_TRACE_CACHE_MISS,
+                                            .fused = n,
+                                            .start = start.clock,
+                                            .end = end.clock };
+    dt_trace_module(&event);
+  }
+  dt_print(DT_DEBUG_MEMORY, "[memory] %d modules up to %s [%s] on CPU: peak %.1f MB host\n", n,
+           run_modules[n - 1]->op, _pipe_type_to_str(pipe->type), host_peak / (1024.0 * 1024.0));
+
+  dt_pthread_mutex_unlock(&pipe->busy_mutex);
+  free(run_modules);
+  free(run_pieces);
+  free(extra);
+  return 0;
+}
+
 // recursive helper for process:
 static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, void **output,
                                         void **cl_mem_output, dt_iop_buffer_dsc_t **out_format,
@@ -1171,6 +2332,8 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
   const size_t bpp = dt_iop_buffer_dsc_to_bpp(*out_format);
   const size_t bufsize = (size_t)bpp * roi_out->width * roi_out->height;
 
+  const double lookup_start = dt_trace_enabled() ? dt_get_wtime() : 0.0;
+
   // 1) if cached buffer is still available, return data
   dt_pthread_mutex_lock(&pipe->busy_mutex);
   if(pipe->shutdown)
@@ -1195,11 +2358,42 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
 
     dt_pthread_mutex_unlock(&pipe->busy_mutex);
     if(!modules) return 0;
+    _pipe_count(pipe, "cache_hit");
+    if(dt_trace_enabled())
+      _trace_module(pipe, module, NULL, roi_out, PIXELPIPE_FLOW_NONE, bufsize, 0, 0, 0, DT_TRACE_CACHE_HIT,
+                    lookup_start);
     // go to post-collect directly:
     goto post_process_collect_info;
   }
+  else if(modules && hash && _pixelpipe_shared_cache_usable(pipe, pos)
+          && _pixelpipe_shared_cache_fetch(pipe, hash, bufsize, output, out_format))
+  {
+    // another darkroom pipe already did the work for us
+    dt_print(DT_DEBUG_DEV, "[dev_pixelpipe] took `%s' from the shared cache [%s]\n", module->op,
+             _pipe_type_to_str(pipe->type));
+    dt_pthread_mutex_unlock(&pipe->busy_mutex);
+    _pipe_count(pipe, "shared_cache_hit");
+    if(dt_trace_enabled())
+      _trace_module(pipe, module, NULL, roi_out, PIXELPIPE_FLOW_NONE, bufsize, 0, 0, 0, DT_TRACE_CACHE_SHARED,
+                    lookup_start);
+    goto post_process_collect_info;
+  }
+  else if(modules && hash && dt_dev_pixelpipe_cache_disk_enabled(pipe, module)
+          && _pixelpipe_disk_cache_fetch(pipe, hash, bufsize, output, out_format))
+  {
+    // an earlier session left us a checkpoint, no need to run the pipe up to here
+    dt_pthread_mutex_unlock(&pipe->busy_mutex);
+    _pipe_count(pipe, "disk_cache_hit");
+    if(dt_trace_enabled())
+      _trace_module(pipe, module, NULL, roi_out, PIXELPIPE_FLOW_NONE, bufsize, 0, 0, 0, DT_TRACE_CACHE_DISK,
+                    lookup_start);
+    goto post_process_collect_info;
+  }
   else
+  {
     dt_pthread_mutex_unlock(&pipe->busy_mutex);
+    if(modules) _pipe_count(pipe, "cache_miss");
+  }
 
   // 2) if history changed or exit event, abort processing?
   // preview pipe: abort on all but zoom events (same buffer anyways)
@@ -1211,6 +2405,15 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
   if(dev->gui_leaving) return 1;
 
 
+  // 2b) tile streaming: produce a padded region and crop it
+  if(modules && pipe->streaming && pipe->stream_padded_pos != pos)
+  {
+    dt_iop_roi_t roi_pad;
+    if(_pixelpipe_stream_pad(module, piece, roi_out, &roi_pad))
+      return _pixelpipe_process_padded(pipe, dev, output, out_format, roi_out, &roi_pad, modules, pieces, pos,
+                                       hash);
+  }
+
   // 3) input -> output
   if(!modules)
   {
@@ -1275,6 +2478,23 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
   {
     // 3b) recurse and obtain output array in &input
 
+    // a run of pointwise modules ending here gets processed in one go
+    GList *first_module = modules, *first_piece = pieces;
+    int first_pos = pos;
+    const int run = _pixelpipe_pointwise_run(pipe, dev, roi_out, &first_module, &first_piece, &first_pos);
+    if(run > 1)
+      return _pixelpipe_process_pointwise(pipe, dev, output, out_format, roi_out, modules, first_module,
+                                          first_piece, first_pos, run, hash, bufsize);
+
+    // and so does a run of modules on the raw mosaic
+    first_module = modules;
+    first_piece = pieces;
+    first_pos = pos;
+    const int raw_run = _pixelpipe_rows_run(pipe, dev, roi_out, &first_module, &first_piece, &first_pos);
+    if(raw_run > 1)
+      return _pixelpipe_process_rows(pipe, dev, output, out_format, roi_out, modules, first_module, first_piece,
+                                     first_pos, raw_run, hash, bufsize);
+
     // get region of interest which is needed in input
     dt_pthread_mutex_lock(&pipe->busy_mutex);
     if(pipe->shutdown)
@@ -1299,6 +2519,9 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
                                     g_list_previous(modules), g_list_previous(pieces), pos - 1))
       return 1;
 
+    // the output of the previous module, input may point at a copy of it in another colorspace later on
+    void *const source_input = input;
+
     const size_t in_bpp = dt_iop_buffer_dsc_to_bpp(input_format);
 
     piece->dsc_out = piece->dsc_in = *input_format;
@@ -1341,14 +2564,31 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
 
     dt_times_t start;
     dt_get_times(&start);
+    dt_memory_accounting_begin();
+
+    // measure what the module really needs, the input may already wait on the device
+    dt_tiling_calibration_run_t calibration_run;
+    const gboolean calibrate = dt_tiling_calibration_enabled();
+    if(calibrate) dt_tiling_calibration_begin(pipe, &calibration_run);
+#ifdef HAVE_OPENCL
+    const gboolean calibration_input_on_device = cl_mem_input != NULL;
+#else
+    const gboolean calibration_input_on_device = FALSE;
+#endif
+    // host/device copies are recorded on their own, they depend on where the previous module ran
+    double transfer_time = 0.0;
 
     dt_pixelpipe_flow_t pixelpipe_flow = (PIXELPIPE_FLOW_NONE | PIXELPIPE_FLOW_HISTOGRAM_NONE);
 
     // special case: user requests to see channel data in the parametric mask of a module. In that case
     // we skip all modules manipulating pixel content and only process image distorting modules. Finally
     // "gamma" is responsible to display channel data accordingly.
-    if(strcmp(module->op, "gamma") && (pipe->mask_display & DT_DEV_PIXELPIPE_DISPLAY_ANY) && !(module->operation_tags() & IOP_TAG_DISTORT) &&
-      (in_bpp == out_bpp) && !memcmp(&roi_in, roi_out, sizeof(struct dt_iop_roi_t)))
+    // modules whose mask is zero all over the roi are skipped the same way, they would only blend their
+    // output away again. that spares most of the work of instances stacked with masks on different parts.
+    if(strcmp(module->op, "gamma") && !(module->operation_tags() & IOP_TAG_DISTORT) && (in_bpp == out_bpp)
+       && !memcmp(&roi_in, roi_out, sizeof(struct dt_iop_roi_t))
+       && ((pipe->mask_display & DT_DEV_PIXELPIPE_DISPLAY_ANY)
+           || _pixelpipe_mask_empty(pipe, module, piece, roi_out)))
     {
 #ifdef HAVE_OPENCL
       if(dt_opencl_is_inited() && pipe->opencl_enabled && pipe->devid >= 0 && (cl_mem_input != NULL))
@@ -1381,6 +2621,10 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
                    (size_t)in_bpp * roi_in.width);
 #endif
 
+      // the output is the input as it came, it is not in the colorspace the module would have produced
+      piece->dsc_out = piece->dsc_in;
+      **out_format = pipe->dsc = piece->dsc_out;
+
       dt_pthread_mutex_unlock(&pipe->busy_mutex);
       return 0;
     }
@@ -1408,6 +2652,13 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
        step is anyhow done on cpu. we assume that blending itself will never require tiling in cpu path,
        because memory requirements will still be low enough. */
 
+    /* what has been measured for this module beats what it claims, see tiling_calibration.h */
+#ifdef HAVE_OPENCL
+    dt_develop_tiling_t tiling_cl = tiling;
+    dt_tiling_calibration_apply(module, TRUE, &tiling_cl);
+#endif
+    dt_tiling_calibration_apply(module, FALSE, &tiling);
+
     assert(tiling.factor > 0.0f);
 
     if(pipe->shutdown)
@@ -1429,7 +2680,7 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
       /* pre-check if there is enough space on device for non-tiled processing */
       const int fits_on_device = dt_opencl_image_fits_device(pipe->devid, MAX(roi_in.width, roi_out->width),
                                                              MAX(roi_in.height, roi_out->height), MAX(in_bpp, bpp),
-                                                             tiling.factor, tiling.overhead);
+                                                             tiling_cl.factor, tiling_cl.overhead);
 
       /* general remark: in case of opencl errors within modules or out-of-memory on GPU, we transparently
          fall back to the respective cpu module and continue in pixelpipe. If we encounter errors we set
@@ -1438,8 +2689,15 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
          Late errors are sometimes detected when trying to get back data from device into host memory and
          are treated in the same manner. */
 
+      /* modules which have been faster on the CPU so far, transfers included, stay there */
+      const gboolean prefer_cpu
+          = dt_perf_model_enabled() && fits_on_device
+            && dt_perf_model_prefer_cpu(module->op, pipe->devid, (size_t)roi_out->width * roi_out->height,
+                                        (size_t)roi_in.width * roi_in.height * in_bpp, cl_mem_input != NULL,
+                                        dt_opencl_pipe_is_synchronous(pipe->type));
+
       /* try to enter opencl path after checking some module specific pre-requisites */
-      if(module->process_cl && piece->process_cl_ready
+      if(module->process_cl && piece->process_cl_ready && !prefer_cpu
          && !(((pipe->type & DT_DEV_PIXELPIPE_PREVIEW) == DT_DEV_PIXELPIPE_PREVIEW
                || (pipe->type & DT_DEV_PIXELPIPE_PREVIEW2) == DT_DEV_PIXELPIPE_PREVIEW2)
               && (module->flags() & IOP_FLAGS_PREVIEW_NON_OPENCL))
@@ -1473,8 +2731,13 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
 
             if(success_opencl)
             {
+              const double transfer_start = dt_get_wtime();
               cl_int err = dt_opencl_write_host_to_device(pipe->devid, input, cl_mem_input,
                                                                        roi_in.width, roi_in.height, in_bpp);
+              transfer_time = dt_get_wtime() - transfer_start;
+              if(err == CL_SUCCESS)
+                dt_perf_model_record_transfer(pipe->devid, (size_t)roi_in.width * roi_in.height * in_bpp,
+                                              transfer_time);
               if(err != CL_SUCCESS)
               {
                 dt_print(DT_DEBUG_OPENCL,
@@ -1631,8 +2894,7 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
           }
 
           /* synchronization point for opencl pipe */
-          if(success_opencl && (!darktable.opencl->async_pixelpipe
-                                || (pipe->type & DT_DEV_PIXELPIPE_EXPORT) == DT_DEV_PIXELPIPE_EXPORT))
+          if(success_opencl && dt_opencl_pipe_is_synchronous(pipe->type))
             success_opencl = dt_opencl_finish(pipe->devid);
 
 
@@ -1688,9 +2950,8 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
           // transform to module input colorspace
           if(success_opencl)
           {
-            dt_ioppr_transform_image_colorspace(module, input, input, roi_in.width, roi_in.height,
-                                                input_format->cst, module->input_colorspace(module, pipe, piece),
-                                                &input_format->cst, dt_ioppr_get_pipe_work_profile_info(pipe));
+            _pixelpipe_input_colorspace(pipe, module, source_input, *output, &roi_in,
+                                        module->input_colorspace(module, pipe, piece), &input, &input_format);
           }
 
           // histogram collection for module
@@ -1772,9 +3033,8 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
           {
             if(_transform_for_blend(module, piece, input_format->cst, pipe->dsc.cst))
             {
-              dt_ioppr_transform_image_colorspace(module, input, input, roi_in.width, roi_in.height,
-                                                  input_format->cst, module->blend_colorspace(module, pipe, piece),
-                                                  &input_format->cst, dt_ioppr_get_pipe_work_profile_info(pipe));
+              _pixelpipe_input_colorspace(pipe, module, source_input, *output, &roi_in,
+                                          module->blend_colorspace(module, pipe, piece), &input, &input_format);
 
               dt_ioppr_transform_image_colorspace(module, *output, *output, roi_out->width, roi_out->height,
                                                   pipe->dsc.cst, module->blend_colorspace(module, pipe, piece),
@@ -1791,8 +3051,7 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
           }
 
           /* synchronization point for opencl pipe */
-          if(success_opencl && (!darktable.opencl->async_pixelpipe
-                                || (pipe->type & DT_DEV_PIXELPIPE_EXPORT) == DT_DEV_PIXELPIPE_EXPORT))
+          if(success_opencl && dt_opencl_pipe_is_synchronous(pipe->type))
             success_opencl = dt_opencl_finish(pipe->devid);
 
           if(pipe->shutdown)
@@ -1828,13 +3087,10 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
              But it is worth copying data back from the GPU which is the input to the currently focused iop,
              as that is the iop which is most likely to change next.
           */
-          if((darktable.opencl->sync_cache == OPENCL_SYNC_TRUE) ||
-             ((darktable.opencl->sync_cache == OPENCL_SYNC_ACTIVE_MODULE) && (module == darktable.develop->gui_module)))
+          if(_opencl_sync_input(pipe, module, input))
           {
-            /* write back input into cache for faster re-usal (not for export or thumbnails) */
-            if(cl_mem_input != NULL
-               && (pipe->type & DT_DEV_PIXELPIPE_EXPORT) != DT_DEV_PIXELPIPE_EXPORT
-               && (pipe->type & DT_DEV_PIXELPIPE_THUMBNAIL) != DT_DEV_PIXELPIPE_THUMBNAIL)
+            /* write back input into cache for faster re-usal */
+            if(cl_mem_input != NULL)
             {
               cl_int err;
 
@@ -1927,9 +3183,8 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
           }
 
           // transform to module input colorspace
-          dt_ioppr_transform_image_colorspace(module, input, input, roi_in.width, roi_in.height, input_format->cst,
-                                              module->input_colorspace(module, pipe, piece), &input_format->cst,
-                                              dt_ioppr_get_pipe_work_profile_info(pipe));
+          _pixelpipe_input_colorspace(pipe, module, source_input, *output, &roi_in,
+                                      module->input_colorspace(module, pipe, piece), &input, &input_format);
 
           // histogram collection for module
           if((dev->gui_attached || !(piece->request_histogram & DT_REQUEST_ONLY_IN_GUI))
@@ -2016,9 +3271,8 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
           // blend needs input/output images with default colorspace
           if(_transform_for_blend(module, piece, input_format->cst, pipe->dsc.cst))
           {
-            dt_ioppr_transform_image_colorspace(module, input, input, roi_in.width, roi_in.height,
-                                                input_format->cst, module->blend_colorspace(module, pipe, piece),
-                                                &input_format->cst, dt_ioppr_get_pipe_work_profile_info(pipe));
+            _pixelpipe_input_colorspace(pipe, module, source_input, *output, &roi_in,
+                                        module->blend_colorspace(module, pipe, piece), &input, &input_format);
 
             dt_ioppr_transform_image_colorspace(module, *output, *output, roi_out->width, roi_out->height,
                                                 pipe->dsc.cst, module->blend_colorspace(module, pipe, piece),
@@ -2051,8 +3305,28 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
         {
           cl_int err;
 
+          // the scopes of the preview are taken from the input of gamma while it is still on the device
+          if(dev->gui_attached && pipe == dev->preview_pipe && !strcmp(module->op, "gamma")
+             && input_cst_cl == iop_cs_rgb)
+          {
+            const uint64_t scopes_hash = _pixelpipe_scopes_hash(dev, pipe, &roi_in, roi_out, pos);
+            if(scopes_hash != dev->scope_hash && _pixelpipe_final_scopes_cl(dev, pipe, cl_mem_input, &roi_in))
+              dev->scope_hash = scopes_hash;
+          }
+
+          const char *reason = _cpu_fallback_reason(pipe, module, piece, prefer_cpu, fits_on_device);
+          pipe->cpu_fallbacks = g_list_append(pipe->cpu_fallbacks, g_strdup_printf("%s (%s)", module->op, reason));
+          _pipe_count(pipe, "cpu_fallback");
+          dt_print(DT_DEBUG_OPENCL, "[opencl_pixelpipe] [%s] module '%s' leaves the gpu: %s\n",
+                   _pipe_type_to_str(pipe->type), module->op, reason);
+
+          const double transfer_start = dt_get_wtime();
           err = dt_opencl_copy_device_to_host(pipe->devid, input, cl_mem_input, roi_in.width, roi_in.height,
                                               in_bpp);
+          transfer_time = dt_get_wtime() - transfer_start;
+          if(err == CL_SUCCESS)
+            dt_perf_model_record_transfer(pipe->devid, (size_t)roi_in.width * roi_in.height * in_bpp,
+                                          transfer_time);
           // if (rand() % 5 == 0) err = !CL_SUCCESS; // Test code: simulate spurious failures
           if(err != CL_SUCCESS)
           {
@@ -2082,9 +3356,8 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
         }
 
         // transform to module input colorspace
-        dt_ioppr_transform_image_colorspace(module, input, input, roi_in.width, roi_in.height, input_format->cst,
-                                            module->input_colorspace(module, pipe, piece), &input_format->cst,
-                                            dt_ioppr_get_pipe_work_profile_info(pipe));
+        _pixelpipe_input_colorspace(pipe, module, source_input, *output, &roi_in,
+                                    module->input_colorspace(module, pipe, piece), &input, &input_format);
 
         // histogram collection for module
         if((dev->gui_attached || !(piece->request_histogram & DT_REQUEST_ONLY_IN_GUI))
@@ -2171,9 +3444,8 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
         // blend needs input/output images with default colorspace
         if(_transform_for_blend(module, piece, input_format->cst, pipe->dsc.cst))
         {
-          dt_ioppr_transform_image_colorspace(module, input, input, roi_in.width, roi_in.height, input_format->cst,
-                                              module->blend_colorspace(module, pipe, piece), &input_format->cst,
-                                              dt_ioppr_get_pipe_work_profile_info(pipe));
+          _pixelpipe_input_colorspace(pipe, module, source_input, *output, &roi_in,
+                                      module->blend_colorspace(module, pipe, piece), &input, &input_format);
 
           dt_ioppr_transform_image_colorspace(module, *output, *output, roi_out->width, roi_out->height,
                                               pipe->dsc.cst, module->blend_colorspace(module, pipe, piece),
@@ -2200,9 +3472,8 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
       /* opencl is not inited or not enabled or we got no resource/device -> everything runs on cpu */
 
       // transform to module input colorspace
-      dt_ioppr_transform_image_colorspace(module, input, input, roi_in.width, roi_in.height, input_format->cst,
-                                          module->input_colorspace(module, pipe, piece), &input_format->cst,
-                                          dt_ioppr_get_pipe_work_profile_info(pipe));
+      _pixelpipe_input_colorspace(pipe, module, source_input, *output, &roi_in,
+                                  module->input_colorspace(module, pipe, piece), &input, &input_format);
 
       // histogram collection for module
       if((dev->gui_attached || !(piece->request_histogram & DT_REQUEST_ONLY_IN_GUI))
@@ -2290,9 +3561,8 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
       // blend needs input/output images with default colorspace
       if(_transform_for_blend(module, piece, input_format->cst, pipe->dsc.cst))
       {
-        dt_ioppr_transform_image_colorspace(module, input, input, roi_in.width, roi_in.height, input_format->cst,
-                                            module->blend_colorspace(module, pipe, piece), &input_format->cst,
-                                            dt_ioppr_get_pipe_work_profile_info(pipe));
+        _pixelpipe_input_colorspace(pipe, module, source_input, *output, &roi_in,
+                                    module->blend_colorspace(module, pipe, piece), &input, &input_format);
 
         dt_ioppr_transform_image_colorspace(module, *output, *output, roi_out->width, roi_out->height,
                                             pipe->dsc.cst, module->blend_colorspace(module, pipe, piece),
@@ -2306,9 +3576,8 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
     }
 #else // HAVE_OPENCL
     // transform to module input colorspace
-    dt_ioppr_transform_image_colorspace(module, input, input, roi_in.width, roi_in.height, input_format->cst,
-                                        module->input_colorspace(module, pipe, piece), &input_format->cst,
-                                        dt_ioppr_get_pipe_work_profile_info(pipe));
+    _pixelpipe_input_colorspace(pipe, module, source_input, *output, &roi_in,
+                                module->input_colorspace(module, pipe, piece), &input, &input_format);
 
     // histogram collection for module
     if((dev->gui_attached || !(piece->request_histogram & DT_REQUEST_ONLY_IN_GUI))
@@ -2394,9 +3663,8 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
     // blend needs input/output images with default colorspace
     if(_transform_for_blend(module, piece, input_format->cst, pipe->dsc.cst))
     {
-      dt_ioppr_transform_image_colorspace(module, input, input, roi_in.width, roi_in.height, input_format->cst,
-                                          module->blend_colorspace(module, pipe, piece), &input_format->cst,
-                                          dt_ioppr_get_pipe_work_profile_info(pipe));
+      _pixelpipe_input_colorspace(pipe, module, source_input, *output, &roi_in,
+                                  module->blend_colorspace(module, pipe, piece), &input, &input_format);
 
       dt_ioppr_transform_image_colorspace(module, *output, *output, roi_out->width, roi_out->height, pipe->dsc.cst,
                                           module->blend_colorspace(module, pipe, piece), &pipe->dsc.cst,
@@ -2438,12 +3706,75 @@ static int dt_dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe, dt_develop_t *
     // in case we get this buffer from the cache in the future, cache some stuff:
     **out_format = piece->dsc_out = pipe->dsc;
 
+    // remember how expensive this cache line was, so we can keep it longer
+    dt_times_t end;
+    dt_get_times(&end);
+    dt_dev_pixelpipe_cache_set_cost(&(pipe->cache), hash, end.clock - start.clock);
+    size_t host_peak, device_peak;
+    dt_memory_accounting_end(&host_peak, &device_peak);
+
+    // tiled runs only ever see a part of the image at once
+    if(calibrate && !(pixelpipe_flow & PIXELPIPE_FLOW_PROCESSED_WITH_TILING)
+       && (pixelpipe_flow & (PIXELPIPE_FLOW_PROCESSED_ON_GPU | PIXELPIPE_FLOW_PROCESSED_ON_CPU)))
+    {
+      const size_t in_size = (size_t)roi_in.width * roi_in.height * in_bpp;
+      const size_t base = (size_t)MAX(roi_in.width, roi_out->width) * MAX(roi_in.height, roi_out->height)
+                          * MAX(in_bpp, out_bpp);
+      dt_tiling_calibration_end(pipe, module, &calibration_run, pixelpipe_flow & PIXELPIPE_FLOW_PROCESSED_ON_GPU,
+                                base, in_size + bufsize, calibration_input_on_device ? in_size : 0);
+    }
+
+    // device runs are only finished when the module returns in synchronous pipes
+    if(!(pixelpipe_flow & PIXELPIPE_FLOW_PROCESSED_WITH_TILING))
+    {
+      const double seconds = end.clock - start.clock - transfer_time;
+      const size_t pixels = (size_t)roi_out->width * roi_out->height;
+      if(pixelpipe_flow & PIXELPIPE_FLOW_PROCESSED_ON_CPU)
+        dt_perf_model_record(module->op, -1, pixels, seconds);
+#ifdef HAVE_OPENCL
+      else if((pixelpipe_flow & PIXELPIPE_FLOW_PROCESSED_ON_GPU) && dt_opencl_pipe_is_synchronous(pipe->type))
+        dt_perf_model_record(module->op, pipe->devid, pixels, seconds);
+#endif
+    }
+
+    if(dt_trace_enabled() || (darktable.unmuted & DT_DEBUG_MEMORY))
+    {
+      const size_t mem_required
+          = tiling.factor * MAX((size_t)roi_in.width * roi_in.height * in_bpp, bufsize) + tiling.overhead;
+      _trace_module(pipe, module, &roi_in, roi_out, pixelpipe_flow, bufsize, mem_required, host_peak, device_peak,
+                    DT_TRACE_CACHE_MISS, start.clock);
+      dt_print(DT_DEBUG_MEMORY,
+               "[memory] module %s%s%s [%s] on %s%s: peak %.1f MB host, %.1f MB device, estimate %.1f MB\n",
+               module->op, module->multi_name[0] ? " " : "", module->multi_name, _pipe_type_to_str(pipe->type),
+               pixelpipe_flow & PIXELPIPE_FLOW_PROCESSED_ON_GPU ? "GPU" : "CPU",
+               pixelpipe_flow & PIXELPIPE_FLOW_PROCESSED_WITH_TILING ? " with tiling" : "",
+               host_peak / (1024.0 * 1024.0), device_peak / (1024.0 * 1024.0), mem_required / (1024.0 * 1024.0));
+    }
+
+    // results still living on the device only can't be shared
+    if(*cl_mem_output == NULL && hash && _pixelpipe_shared_cache_usable(pipe, pos))
+      _pixelpipe_shared_cache_put(pipe, hash, *output, bufsize, *out_format, end.clock - start.clock);
+
+    if(hash && dt_dev_pixelpipe_cache_disk_enabled(pipe, module) && _pixelpipe_roi_is_full(piece, roi_out))
+    {
+      gboolean valid = TRUE;
+#ifdef HAVE_OPENCL
+      if(*cl_mem_output != NULL)
+        valid = dt_opencl_copy_device_to_host(pipe->devid, *output, *cl_mem_output, roi_out->width,
+                                              roi_out->height, bpp) == CL_SUCCESS;
+#endif
+      if(valid)
+        dt_dev_pixelpipe_cache_disk_write(pipe, _pixelpipe_cache_input_hash(pipe, hash), *output, bufsize,
+                                          *out_format);
+    }
+
     dt_pthread_mutex_unlock(&pipe->busy_mutex);
     if(module == darktable.develop->gui_module)
     {
       // give the input buffer to the currently focused plugin more weight.
       // the user is likely to change that one soon, so keep it in cache.
-      dt_dev_pixelpipe_cache_reweight(&(pipe->cache), input);
+      dt_dev_pixelpipe_cache_reweight(&(pipe->cache), source_input);
+      if(input != source_input) dt_dev_pixelpipe_cache_reweight(&(pipe->cache), input);
     }
 #ifndef _DEBUG
     if(darktable.unmuted & DT_DEBUG_NAN)
@@ -2573,33 +3904,39 @@ post_process_collect_info:
     }
     if(dev->gui_attached && !dev->gui_leaving && pipe == dev->preview_pipe && (strcmp(module->op, "gamma") == 0))
     {
-      // FIXME: input may not be available, so we use the output from gamma
-      // this may lead to some rounding errors
-      if(input == NULL)
+      // the scopes are left alone if they still show this image, or were already taken on the device
+      const uint64_t scopes_hash = _pixelpipe_scopes_hash(dev, pipe, &roi_in, roi_out, pos);
+      if(scopes_hash != dev->scope_hash)
       {
-        float *input_tmp = (float *)dt_alloc_align(64, roi_out->width * roi_out->height * 4 * sizeof(float));
-        const uint8_t *const pixel = (uint8_t *)*output;
-
-        const int imgsize = roi_out->height * roi_out->width * 4;
-        for(int i = 0; i < imgsize; i += 4)
+        // FIXME: input may not be available, so we use the output from gamma
+        // this may lead to some rounding errors
+        if(input == NULL)
         {
-          for(int c = 0; c < 3; c++) input_tmp[i + c] = ((float)pixel[i + (2 - c)]) * (1.0f / 255.0f);
-          input_tmp[i + 3] = 0.0f;
-        }
+          float *input_tmp = (float *)dt_alloc_align(64, roi_out->width * roi_out->height * 4 * sizeof(float));
+          const uint8_t *const pixel = (uint8_t *)*output;
+
+          const int imgsize = roi_out->height * roi_out->width * 4;
+          for(int i = 0; i < imgsize; i += 4)
+          {
+            for(int c = 0; c < 3; c++) input_tmp[i + c] = ((float)pixel[i + (2 - c)]) * (1.0f / 255.0f);
+            input_tmp[i + 3] = 0.0f;
+          }
 
-        _pixelpipe_final_histogram(dev, (const float *const)input_tmp, roi_out);
+          _pixelpipe_final_histogram(dev, (const float *const)input_tmp, roi_out);
 
-        dt_free_align(input_tmp);
-      }
-      else
-        _pixelpipe_final_histogram(dev, (const float *const)input, &roi_in);
+          dt_free_align(input_tmp);
+        }
+        else
+          _pixelpipe_final_histogram(dev, (const float *const)input, &roi_in);
 
-      // this HAS to be done on the float input data, otherwise we get really ugly artifacts due to rounding
-      // issues when putting colors into the bins.
-      // FIXME: is above comment true now that waveform is scaled via Cairo?
-      if(input && dev->scope_type == DT_DEV_SCOPE_WAVEFORM)
-      {
-        _pixelpipe_final_histogram_waveform(dev, (const float *const )input, &roi_in);
+        // this HAS to be done on the float input data, otherwise we get really ugly artifacts due to rounding
+        // issues when putting colors into the bins.
+        // FIXME: is above comment true now that waveform is scaled via Cairo?
+        if(input && dev->scope_type == DT_DEV_SCOPE_WAVEFORM)
+        {
+          _pixelpipe_final_histogram_waveform(dev, (const float *const )input, &roi_in);
+        }
+        dev->scope_hash = input ? scopes_hash : 0;
       }
 
       dt_pthread_mutex_unlock(&pipe->busy_mutex);
@@ -2608,6 +3945,11 @@ post_process_collect_info:
     {
       dt_pthread_mutex_unlock(&pipe->busy_mutex);
     }
+
+    // we are done with the input. the module being edited gets it again soon, keep that one as it is.
+    if(pipe->half_cache && input && (module->flags() & IOP_FLAGS_HALF_INPUT)
+       && module != darktable.develop->gui_module)
+      dt_dev_pixelpipe_cache_pack(&(pipe->cache), input);
   }
 
   return 0;
@@ -2633,6 +3975,239 @@ int dt_dev_pixelpipe_process_no_gamma(dt_dev_pixelpipe_t *pipe, dt_develop_t *de
   return ret;
 }
 
+// all modules have to cope with seeing only a part of the image
+static gboolean _pixelpipe_streamable(dt_dev_pixelpipe_t *pipe)
+{
+  for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    if(!piece->enabled || !strcmp(piece->module->op, "gamma")) continue;
+    if(!(piece->module->flags() & IOP_FLAGS_ALLOW_TILING))
+    {
+      dt_print(DT_DEBUG_DEV, "[pixelpipe_process_streamed] `%s' needs the full image, not streaming\n",
+               piece->module->op);
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+// shared between the pipes of a streamed run, one pipe per device
+typedef struct _pixelpipe_stream_t
+{
+  dt_pthread_mutex_t lock;
+  dt_develop_t *dev;
+  int width, height, strip_height;
+  float scale;
+  gboolean gamma;
+  int next_y; // first row no pipe has claimed yet
+  int err;
+  size_t bpp;
+  uint8_t *buf;
+  dt_dev_pixelpipe_strip_sink_t sink;
+  void *sink_data;
+  int next_out;          // first row not handed to the sink yet
+  pthread_cond_t handed; // signalled when next_out moved on or a pipe failed
+} _pixelpipe_stream_t;
+
+typedef struct _pixelpipe_stream_worker_t
+{
+  dt_dev_pixelpipe_t *pipe;
+  _pixelpipe_stream_t *stream;
+  pthread_t thread;
+} _pixelpipe_stream_worker_t;
+
+static int _pixelpipe_stream_strip(dt_dev_pixelpipe_t *pipe, _pixelpipe_stream_t *stream, const int y)
+{
+  const int h = MIN(stream->strip_height, stream->height - y);
+  dt_develop_t *dev = stream->dev;
+  const int err = stream->gamma ? dt_dev_pixelpipe_process(pipe, dev, 0, y, stream->width, h, stream->scale)
+                                : dt_dev_pixelpipe_process_no_gamma(pipe, dev, 0, y, stream->width, h,
+                                                                    stream->scale);
+  if(err) return 1;
+
+  if(stream->sink)
+  {
+    // strips are claimed in order, so the pipe with the next one never waits for another
+    dt_pthread_mutex_lock(&stream->lock);
+    while(stream->next_out != y && !stream->err) dt_pthread_cond_wait(&stream->handed, &stream->lock);
+    int failed = stream->err;
+    dt_pthread_mutex_unlock(&stream->lock);
+    if(failed) return 1;
+
+    // nobody else gets to the sink before next_out moves on
+    dt_pthread_mutex_lock(&pipe->backbuf_mutex);
+    failed = stream->sink(pipe->backbuf, pipe->backbuf_bpp, y, h, stream->sink_data);
+    dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
+
+    dt_pthread_mutex_lock(&stream->lock);
+    stream->next_out = y + h;
+    pthread_cond_broadcast(&stream->handed);
+    dt_pthread_mutex_unlock(&stream->lock);
+    dt_print(DT_DEBUG_DEV, "[pixelpipe_process_streamed] [%s] strip %d-%d of %d handed over from device %d\n",
+             _pipe_type_to_str(pipe->type), y, y + h, stream->height, pipe->devid);
+    return failed;
+  }
+
+  // the first strip done tells us the output format, so the final buffer can be allocated
+  dt_pthread_mutex_lock(&stream->lock);
+  if(!stream->buf)
+  {
+    stream->bpp = pipe->backbuf_bpp;
+    stream->buf = dt_alloc_align(64, stream->bpp * stream->width * stream->height);
+  }
+  // all pipes are set up alike, but better be sure they agree on the output format
+  const gboolean ok = stream->buf && pipe->backbuf_bpp == stream->bpp;
+  dt_pthread_mutex_unlock(&stream->lock);
+  if(!ok) return 1;
+
+  // strips are disjoint, no need to lock the shared buffer
+  dt_pthread_mutex_lock(&pipe->backbuf_mutex);
+  memcpy(stream->buf + stream->bpp * stream->width * y, pipe->backbuf, stream->bpp * stream->width * h);
+  dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
+  dt_print(DT_DEBUG_DEV, "[pixelpipe_process_streamed] [%s] strip %d-%d of %d done on device %d\n",
+           _pipe_type_to_str(pipe->type), y, y + h, stream->height, pipe->devid);
+  return 0;
+}
+
+// claims the next strip until all are done, or some pipe failed
+static void *_pixelpipe_stream_work(void *data)
+{
+  _pixelpipe_stream_worker_t *worker = (_pixelpipe_stream_worker_t *)data;
+  _pixelpipe_stream_t *stream = worker->stream;
+  worker->pipe->streaming = 1;
+  worker->pipe->stream_padded_pos = -1;
+  while(TRUE)
+  {
+    dt_pthread_mutex_lock(&stream->lock);
+    const int y = stream->err ? stream->height : stream->next_y;
+    stream->next_y += stream->strip_height;
+    dt_pthread_mutex_unlock(&stream->lock);
+    if(y >= stream->height) break;
+
+    if(_pixelpipe_stream_strip(worker->pipe, stream, y))
+    {
+      dt_pthread_mutex_lock(&stream->lock);
+      stream->err = 1;
+      pthread_cond_broadcast(&stream->handed);
+      dt_pthread_mutex_unlock(&stream->lock);
+      break;
+    }
+  }
+  worker->pipe->streaming = 0;
+  return NULL;
+}
+
+// sets up another export pipe which processes exactly like the given one. only fails if the pipe
+// couldn't be initialized, i.e. there is nothing to clean up then.
+static int _pixelpipe_stream_clone(dt_dev_pixelpipe_t *clone, dt_dev_pixelpipe_t *pipe, dt_develop_t *dev)
+{
+  if(!dt_dev_pixelpipe_init_export(clone, pipe->iwidth, pipe->iheight, pipe->levels,
+                                   pipe->store_all_raster_masks))
+    return 1;
+  dt_dev_pixelpipe_set_icc(clone, pipe->icc_type, pipe->icc_filename, pipe->icc_intent);
+  dt_dev_pixelpipe_set_input(clone, dev, pipe->input, pipe->iwidth, pipe->iheight, pipe->iscale);
+  dt_dev_pixelpipe_create_nodes(clone, dev);
+  dt_dev_pixelpipe_synch_all(clone, dev);
+  int w, h;
+  dt_dev_pixelpipe_get_dimensions(clone, dev, pipe->iwidth, pipe->iheight, &w, &h);
+
+  // the caller may have switched modules on or off after synching, e.g. finalscale
+  GList *cn = clone->nodes;
+  for(GList *nodes = pipe->nodes; nodes && cn; nodes = g_list_next(nodes), cn = g_list_next(cn))
+    ((dt_dev_pixelpipe_iop_t *)cn->data)->enabled = ((dt_dev_pixelpipe_iop_t *)nodes->data)->enabled;
+  return 0;
+}
+
+int dt_dev_pixelpipe_process_streamed(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, int width, int height,
+                                      float scale, const gboolean gamma, int strip_height, int devices,
+                                      dt_dev_pixelpipe_strip_sink_t sink, void *sink_data)
+{
+  devices = (pipe->type & DT_DEV_PIXELPIPE_EXPORT) ? MAX(devices, 1) : 1;
+  // one band per device unless strips were asked for anyway
+  if(devices > 1 && strip_height <= 0) strip_height = (height + devices - 1) / devices;
+  devices = strip_height > 0 ? MIN(devices, (height + strip_height - 1) / strip_height) : 1;
+
+  if(strip_height <= 0 || strip_height >= height || !_pixelpipe_streamable(pipe))
+  {
+    if(gamma ? dt_dev_pixelpipe_process(pipe, dev, 0, 0, width, height, scale)
+             : dt_dev_pixelpipe_process_no_gamma(pipe, dev, 0, 0, width, height, scale))
+      return 1;
+    if(!sink) return 0;
+    dt_pthread_mutex_lock(&pipe->backbuf_mutex);
+    const int err = sink(pipe->backbuf, pipe->backbuf_bpp, 0, height, sink_data);
+    dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
+    return err;
+  }
+
+  dt_free_align(pipe->stream_buf);
+  pipe->stream_buf = NULL;
+  dt_dev_pixelpipe_cache_update_hashes(pipe);
+
+  _pixelpipe_stream_t stream = { .dev = dev,
+                                 .width = width,
+                                 .height = height,
+                                 .strip_height = strip_height,
+                                 .scale = scale,
+                                 .gamma = gamma,
+                                 .sink = sink,
+                                 .sink_data = sink_data };
+  dt_pthread_mutex_init(&stream.lock, NULL);
+  pthread_cond_init(&stream.handed, NULL);
+
+  // every further pipe locks a device of its own in dt_dev_pixelpipe_process()
+  _pixelpipe_stream_worker_t *workers
+      = (_pixelpipe_stream_worker_t *)calloc(devices, sizeof(_pixelpipe_stream_worker_t));
+  dt_dev_pixelpipe_t *clones = (dt_dev_pixelpipe_t *)calloc(devices, sizeof(dt_dev_pixelpipe_t));
+  int started = 0;
+  if(workers && clones)
+  {
+    for(int k = 1; k < devices; k++)
+    {
+      if(_pixelpipe_stream_clone(&clones[k], pipe, dev)) break;
+      workers[k].pipe = &clones[k];
+      workers[k].stream = &stream;
+      if(dt_pthread_create(&workers[k].thread, _pixelpipe_stream_work, &workers[k]))
+      {
+        dt_dev_pixelpipe_cleanup(&clones[k]);
+        break;
+      }
+      started = k;
+    }
+    if(started)
+      dt_print(DT_DEBUG_DEV, "[pixelpipe_process_streamed] [%s] processing on %d pipes\n",
+               _pipe_type_to_str(pipe->type), started + 1);
+  }
+
+  // this thread takes its share as well, and everything if no other pipe could be set up
+  _pixelpipe_stream_worker_t self = { .pipe = pipe, .stream = &stream };
+  _pixelpipe_stream_work(&self);
+
+  for(int k = 1; k <= started; k++)
+  {
+    pthread_join(workers[k].thread, NULL);
+    dt_dev_pixelpipe_cleanup(&clones[k]);
+  }
+  free(clones);
+  free(workers);
+
+  // the pipe owns the stitched image from now on
+  pipe->stream_buf = stream.buf;
+  const int err = stream.err || (!sink && !stream.buf);
+  pthread_cond_destroy(&stream.handed);
+  dt_pthread_mutex_destroy(&stream.lock);
+  if(err) return 1;
+  if(sink) return 0;
+
+  dt_pthread_mutex_lock(&pipe->backbuf_mutex);
+  pipe->backbuf = pipe->stream_buf;
+  pipe->backbuf_width = width;
+  pipe->backbuf_height = height;
+  pipe->backbuf_bpp = stream.bpp;
+  dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
+  return 0;
+}
+
 void dt_dev_pixelpipe_disable_after(dt_dev_pixelpipe_t *pipe, const char *op)
 {
   GList *nodes = g_list_last(pipe->nodes);
@@ -2708,10 +4283,395 @@ static int dt_dev_pixelpipe_process_rec_and_backcopy(dt_dev_pixelpipe_t *pipe, d
 }
 
 
+// remembers what the output of the full pipe was rendered from, see _pixelpipe_dirty_area(). takes the forms.
+static void _pixelpipe_output_snapshot(dt_dev_pixelpipe_t *pipe, const dt_iop_roi_t *roi, GList *forms)
+{
+  g_list_free_full(pipe->output_forms, (void (*)(void *))dt_masks_free_form);
+  pipe->output_forms = forms;
+  pipe->output_roi = *roi;
+  pipe->output_input = pipe->input;
+  pipe->output_mask_display = pipe->mask_display;
+  // a quick progressive render can't be patched
+  pipe->output_valid = pipe->coarse == 1;
+  for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    piece->output_hash = piece->hash;
+    piece->output_params_hash = piece->params_hash;
+    piece->output_enabled = piece->enabled;
+  }
+}
+
+// if the only difference to the last output of the full pipe are shapes of one module, finds the part of the
+// output they can have changed. with forms being the current masks.
+static gboolean _pixelpipe_dirty_area(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, const dt_iop_roi_t *roi,
+                                      GList *forms, dt_iop_roi_t *dirty)
+{
+  if(!pipe->output_valid || pipe->coarse != 1 || memcmp(roi, &pipe->output_roi, sizeof(dt_iop_roi_t))
+     || pipe->output_input != pipe->input || pipe->output_mask_display != pipe->mask_display
+     || pipe->output_imgid != pipe->image.id)
+    return FALSE;
+
+  dt_pthread_mutex_lock(&pipe->backbuf_mutex);
+  const gboolean have_output = pipe->output_backbuf && pipe->output_backbuf_coarse == 1
+                               && pipe->output_backbuf_width == roi->width
+                               && pipe->output_backbuf_height == roi->height;
+  dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
+  if(!have_output) return FALSE;
+
+  // exactly one module may have changed, and only its masks unless its params are about them, too
+  dt_dev_pixelpipe_iop_t *changed = NULL;
+  for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    if(piece->enabled != piece->output_enabled) return FALSE;
+    if(!piece->enabled) continue;
+    // the changed part is recomputed with padding, which only gives the same result for modules that can be tiled
+    const int flags = piece->module->flags();
+    if(!(flags & (IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_LOCAL_PARAMS)) && strcmp(piece->module->op, "gamma"))
+      return FALSE;
+    if(piece->hash == piece->output_hash) continue;
+    if(changed) return FALSE;
+    changed = piece;
+  }
+  if(!changed) return FALSE;
+  dt_iop_module_t *module = changed->module;
+  if(changed->params_hash != changed->output_params_hash && !(module->flags() & IOP_FLAGS_LOCAL_PARAMS))
+    return FALSE;
+
+  float box[4];
+  if(dt_masks_get_changed_area(module, changed, pipe->output_forms, forms, box)) return FALSE;
+
+  // the box is at the output of the module, follow its edges through the distortions of the rest of the pipe
+  float points[32];
+  for(int k = 0; k < 4; k++)
+  {
+    const float t = k / 3.0f;
+    const float bx = box[0] + t * (box[2] - box[0]);
+    const float by = box[1] + t * (box[3] - box[1]);
+    const float p[8] = { bx, box[1], bx, box[3], box[0], by, box[2], by };
+    memcpy(points + 8 * k, p, sizeof(p));
+  }
+  if(!dt_dev_distort_transform_plus(dev, pipe, module->iop_order, DT_DEV_TRANSFORM_DIR_FORW_EXCL, points, 16))
+    return FALSE;
+
+  float x0 = FLT_MAX, y0 = FLT_MAX, x1 = -FLT_MAX, y1 = -FLT_MAX;
+  for(int k = 0; k < 16; k++)
+  {
+    x0 = fminf(x0, points[2 * k]);
+    x1 = fmaxf(x1, points[2 * k]);
+    y0 = fminf(y0, points[2 * k + 1]);
+    y1 = fmaxf(y1, points[2 * k + 1]);
+  }
+
+  // the change spreads by the neighbourhood every following module looks at
+  int overlap = 2;
+  for(GList *nodes = g_list_find(pipe->nodes, changed); nodes; nodes = g_list_next(nodes))
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    if(piece->enabled) overlap += _pixelpipe_piece_overlap(piece->module, piece, &piece->processed_roi_out);
+  }
+
+  const int dx0 = CLAMP((int)floorf(x0 * roi->scale) - roi->x - overlap, 0, roi->width);
+  const int dy0 = CLAMP((int)floorf(y0 * roi->scale) - roi->y - overlap, 0, roi->height);
+  const int dx1 = CLAMP((int)ceilf(x1 * roi->scale) - roi->x + overlap, dx0, roi->width);
+  const int dy1 = CLAMP((int)ceilf(y1 * roi->scale) - roi->y + overlap, dy0, roi->height);
+
+  // not worth it for large changes
+  if((size_t)(dx1 - dx0) * (dy1 - dy0) * 2 > (size_t)roi->width * roi->height) return FALSE;
+
+  *dirty = (dt_iop_roi_t){ roi->x + dx0, roi->y + dy0, dx1 - dx0, dy1 - dy0, roi->scale };
+  dt_print(DT_DEBUG_DEV, "[pixelpipe_process] [%s] `%s' changed %dx%d at %d,%d of %dx%d\n",
+           _pipe_type_to_str(pipe->type), module->op, dirty->width, dirty->height, dx0, dy0, roi->width,
+           roi->height);
+  return TRUE;
+}
+
+// recomputes the dirty part of the last output and patches it in. takes the forms.
+static int _pixelpipe_process_dirty(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, const dt_iop_roi_t *roi,
+                                    const dt_iop_roi_t *dirty, GList *forms)
+{
+  if(dirty->width > 0 && dirty->height > 0)
+  {
+    // modules get their input padded as for tile streaming, so the patch matches its surroundings
+    pipe->dirty_pass = 1;
+    pipe->streaming = 1;
+    pipe->stream_padded_pos = -1;
+    const int err = dt_dev_pixelpipe_process(pipe, dev, dirty->x, dirty->y, dirty->width, dirty->height,
+                                             dirty->scale);
+    pipe->streaming = 0;
+    pipe->dirty_pass = 0;
+    if(err)
+    {
+      g_list_free_full(forms, (void (*)(void *))dt_masks_free_form);
+      return 1;
+    }
+  }
+
+  const size_t size = (size_t)roi->width * roi->height * 4 * sizeof(uint8_t);
+  dt_pthread_mutex_lock(&pipe->backbuf_mutex);
+  if(dirty->width > 0 && dirty->height > 0)
+  {
+    const size_t stride = (size_t)dirty->width * 4;
+    for(int j = 0; j < dirty->height; j++)
+      memcpy(pipe->output_backbuf
+                 + 4 * ((size_t)(dirty->y - roi->y + j) * roi->width + (dirty->x - roi->x)),
+             pipe->backbuf + stride * j, stride);
+  }
+  // the backbuf has to show the whole image, too
+  dt_free_align(pipe->stream_buf);
+  pipe->stream_buf = dt_alloc_align(64, size);
+  if(pipe->stream_buf) memcpy(pipe->stream_buf, pipe->output_backbuf, size);
+  pipe->backbuf = pipe->stream_buf;
+  pipe->backbuf_width = roi->width;
+  pipe->backbuf_height = roi->height;
+  pipe->backbuf_hash = dt_dev_pixelpipe_cache_hash(pipe->image.id, roi, pipe, 0);
+  pipe->output_backbuf_coarse = 1;
+  dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
+
+  const uint64_t tiles_key = _tiles_key(pipe, roi->scale);
+  if(tiles_key && pipe->output_backbuf) _tiles_store(pipe, tiles_key, roi, pipe->output_backbuf);
+
+  _pixelpipe_output_snapshot(pipe, roi, forms);
+  return 0;
+}
+
+// the key of the tiles rendered by the pipe in its current state at scale, or 0 if its output can't be put
+// together from tiles: masks shown, or modules which don't give the same pixels for a part of the image.
+static uint64_t _tiles_key(dt_dev_pixelpipe_t *pipe, const float scale)
+{
+  if(!(pipe->type & DT_DEV_PIXELPIPE_FULL) || !pipe->tiles || pipe->coarse != 1 || pipe->dirty_pass
+     || pipe->streaming || !pipe->input)
+    return 0;
+
+  for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
+  {
+    dt_dev_pixelpipe_iop_t *piece = (dt_dev_pixelpipe_iop_t *)nodes->data;
+    if(!piece->enabled) continue;
+    if(piece->module->request_mask_display != DT_DEV_PIXELPIPE_DISPLAY_NONE) return 0;
+    const int flags = piece->module->flags();
+    if(!(flags & (IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_LOCAL_PARAMS)) && strcmp(piece->module->op, "gamma"))
+      return 0;
+  }
+
+  const dt_iop_roi_t roi = { 0, 0, pipe->processed_width, pipe->processed_height, scale };
+  uint64_t hash = dt_dev_pixelpipe_cache_hash(pipe->image.id, &roi, pipe, g_list_length(pipe->nodes));
+  hash = ((hash << 5) + hash) ^ (uint64_t)(uintptr_t)pipe->input;
+  return hash ? hash : 1;
+}
+
+// the pixels of tile tx, ty at the scale of roi, clipped to the image
+static dt_iop_roi_t _tile_roi(const dt_dev_pixelpipe_t *pipe, const dt_iop_roi_t *roi, const int tx,
+                              const int ty)
+{
+  const int width = pipe->processed_width * roi->scale;
+  const int height = pipe->processed_height * roi->scale;
+  const int x = tx * DT_DEV_PIXELPIPE_TILE;
+  const int y = ty * DT_DEV_PIXELPIPE_TILE;
+  return (dt_iop_roi_t){ x, y, MAX(0, MIN(DT_DEV_PIXELPIPE_TILE, width - x)),
+                         MAX(0, MIN(DT_DEV_PIXELPIPE_TILE, height - y)), roi->scale };
+}
+
+// keeps the tiles which the output buf of roi covers entirely
+static void _tiles_store(dt_dev_pixelpipe_t *pipe, const uint64_t key, const dt_iop_roi_t *roi,
+                         const uint8_t *const buf)
+{
+  const int T = DT_DEV_PIXELPIPE_TILE;
+  for(int ty = roi->y / T; ty <= (roi->y + roi->height - 1) / T; ty++)
+    for(int tx = roi->x / T; tx <= (roi->x + roi->width - 1) / T; tx++)
+    {
+      const dt_iop_roi_t t = _tile_roi(pipe, roi, tx, ty);
+      if(t.width <= 0 || t.height <= 0 || t.x < roi->x || t.y < roi->y || t.x + t.width > roi->x + roi->width
+         || t.y + t.height > roi->y + roi->height)
+        continue;
+
+      dt_dev_pixelpipe_tile_t lookup = { .hash = key, .tx = tx, .ty = ty };
+      dt_dev_pixelpipe_tile_t *tile = g_hash_table_lookup(pipe->tiles, &lookup);
+      if(!tile)
+      {
+        tile = (dt_dev_pixelpipe_tile_t *)calloc(1, sizeof(dt_dev_pixelpipe_tile_t));
+        if(!tile) return;
+        tile->buf = dt_alloc_align(64, (size_t)t.width * t.height * 4);
+        if(!tile->buf)
+        {
+          free(tile);
+          return;
+        }
+        *tile = (dt_dev_pixelpipe_tile_t){ .hash = key, .tx = tx, .ty = ty, .roi = t, .buf = tile->buf };
+        tile->link.data = tile;
+        g_hash_table_add(pipe->tiles, tile);
+        pipe->tiles_size += (size_t)t.width * t.height * 4;
+      }
+      else
+        g_queue_unlink(&pipe->tiles_lru, &tile->link);
+      g_queue_push_head_link(&pipe->tiles_lru, &tile->link);
+
+      for(int j = 0; j < t.height; j++)
+        memcpy(tile->buf + (size_t)4 * j * t.width,
+               buf + 4 * ((size_t)(t.y - roi->y + j) * roi->width + (t.x - roi->x)), (size_t)4 * t.width);
+    }
+
+  // the least recently used ones go
+  while(pipe->tiles_size > DT_DEV_PIXELPIPE_TILES_MAX_SIZE && pipe->tiles_lru.tail)
+  {
+    dt_dev_pixelpipe_tile_t *tile = (dt_dev_pixelpipe_tile_t *)pipe->tiles_lru.tail->data;
+    g_queue_unlink(&pipe->tiles_lru, &tile->link);
+    pipe->tiles_size -= (size_t)tile->roi.width * tile->roi.height * 4;
+    g_hash_table_remove(pipe->tiles, tile);
+  }
+}
+
+// shows the output of roi put together from the tiles, only the part missing from them gets processed.
+// returns -1 if too much is missing, the output is processed as a whole then.
+static int _pixelpipe_process_tiles(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, const uint64_t key,
+                                    const dt_iop_roi_t *roi)
+{
+  const int T = DT_DEV_PIXELPIPE_TILE;
+  const int tx0 = roi->x / T, tx1 = (roi->x + roi->width - 1) / T;
+  const int ty0 = roi->y / T, ty1 = (roi->y + roi->height - 1) / T;
+
+  // the tiles we have, and the box of the ones we miss
+  const int ntx = tx1 - tx0 + 1;
+  const int nty = ty1 - ty0 + 1;
+  dt_dev_pixelpipe_tile_t **tiles = calloc((size_t)ntx * nty, sizeof(dt_dev_pixelpipe_tile_t *));
+  if(!tiles) return -1;
+  int mx0 = G_MAXINT, mx1 = -1, my0 = G_MAXINT, my1 = -1;
+  for(int ty = ty0; ty <= ty1; ty++)
+    for(int tx = tx0; tx <= tx1; tx++)
+    {
+      dt_dev_pixelpipe_tile_t lookup = { .hash = key, .tx = tx, .ty = ty };
+      dt_dev_pixelpipe_tile_t *tile = g_hash_table_lookup(pipe->tiles, &lookup);
+      // the tile has to have all the pixels of roi in it
+      const dt_iop_roi_t t = _tile_roi(pipe, roi, tx, ty);
+      if(tile
+         && (MIN(tx * T + T, roi->x + roi->width) > t.x + t.width
+             || MIN(ty * T + T, roi->y + roi->height) > t.y + t.height))
+        tile = NULL;
+      tiles[(ty - ty0) * ntx + tx - tx0] = tile;
+      if(tile) continue;
+      mx0 = MIN(mx0, tx);
+      mx1 = MAX(mx1, tx);
+      my0 = MIN(my0, ty);
+      my1 = MAX(my1, ty);
+    }
+
+  dt_iop_roi_t missing = { 0, 0, 0, 0, roi->scale };
+  if(mx1 >= 0)
+  {
+    missing.x = MAX(roi->x, mx0 * T);
+    missing.y = MAX(roi->y, my0 * T);
+    missing.width = MIN(roi->x + roi->width, (mx1 + 1) * T) - missing.x;
+    missing.height = MIN(roi->y + roi->height, (my1 + 1) * T) - missing.y;
+    // not worth it if most of it is missing
+    if((size_t)missing.width * missing.height * 2 > (size_t)roi->width * roi->height)
+    {
+      free(tiles);
+      return -1;
+    }
+
+    // processed with padding as the strips of a tile-streamed run, so it matches the tiles around
+    pipe->dirty_pass = 1;
+    pipe->streaming = 1;
+    pipe->stream_padded_pos = -1;
+    const int err = dt_dev_pixelpipe_process(pipe, dev, missing.x, missing.y, missing.width, missing.height,
+                                             missing.scale);
+    pipe->streaming = 0;
+    pipe->dirty_pass = 0;
+    if(err)
+    {
+      free(tiles);
+      return 1;
+    }
+  }
+
+  const size_t size = (size_t)roi->width * roi->height * 4 * sizeof(uint8_t);
+  uint8_t *out = dt_alloc_align(64, size);
+  if(!out)
+  {
+    free(tiles);
+    return -1;
+  }
+  for(int ty = ty0; ty <= ty1; ty++)
+    for(int tx = tx0; tx <= tx1; tx++)
+    {
+      dt_dev_pixelpipe_tile_t *tile = tiles[(ty - ty0) * ntx + tx - tx0];
+      if(!tile) continue;
+      g_queue_unlink(&pipe->tiles_lru, &tile->link);
+      g_queue_push_head_link(&pipe->tiles_lru, &tile->link);
+      const dt_iop_roi_t *t = &tile->roi;
+      const int x0 = MAX(roi->x, t->x), x1 = MIN(roi->x + roi->width, t->x + t->width);
+      const int y0 = MAX(roi->y, t->y), y1 = MIN(roi->y + roi->height, t->y + t->height);
+      for(int j = y0; j < y1; j++)
+        memcpy(out + 4 * ((size_t)(j - roi->y) * roi->width + (x0 - roi->x)),
+               tile->buf + 4 * ((size_t)(j - t->y) * t->width + (x0 - t->x)), (size_t)4 * (x1 - x0));
+    }
+  free(tiles);
+
+  dt_pthread_mutex_lock(&pipe->backbuf_mutex);
+  if(missing.width > 0 && missing.height > 0)
+  {
+    const size_t stride = (size_t)missing.width * 4;
+    for(int j = 0; j < missing.height; j++)
+      memcpy(out + 4 * ((size_t)(missing.y - roi->y + j) * roi->width + (missing.x - roi->x)),
+             pipe->backbuf + stride * j, stride);
+  }
+  dt_free_align(pipe->stream_buf);
+  pipe->stream_buf = out;
+  pipe->backbuf = pipe->stream_buf;
+  pipe->backbuf_width = roi->width;
+  pipe->backbuf_height = roi->height;
+  pipe->backbuf_hash = dt_dev_pixelpipe_cache_hash(pipe->image.id, roi, pipe, 0);
+  if(pipe->output_backbuf == NULL || pipe->output_backbuf_width != roi->width
+     || pipe->output_backbuf_height != roi->height)
+  {
+    g_free(pipe->output_backbuf);
+    pipe->output_backbuf_width = roi->width;
+    pipe->output_backbuf_height = roi->height;
+    pipe->output_backbuf = g_malloc0(size);
+  }
+  if(pipe->output_backbuf) memcpy(pipe->output_backbuf, out, size);
+  pipe->output_backbuf_coarse = 1;
+  pipe->output_imgid = pipe->image.id;
+  dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
+
+  if(missing.width > 0) _tiles_store(pipe, key, roi, out);
+  dt_print(DT_DEBUG_DEV, "[pixelpipe_process] [%s] %dx%d of %dx%d at %d,%d processed, the rest from tiles\n",
+           _pipe_type_to_str(pipe->type), missing.width, missing.height, roi->width, roi->height, roi->x,
+           roi->y);
+
+  pipe->mask_display = DT_DEV_PIXELPIPE_DISPLAY_NONE;
+  _pixelpipe_output_snapshot(pipe, roi, dt_masks_dup_forms_deep(dev->forms, NULL));
+  return 0;
+}
+
 int dt_dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, int x, int y, int width, int height,
                              float scale)
 {
+  // the stack up to every node is hashed once per run, the focused module or a picker might have changed
+  dt_dev_pixelpipe_cache_update_hashes(pipe);
+
+  // after a change of some shapes, only recompute where they are
+  if((pipe->type & DT_DEV_PIXELPIPE_FULL) && pipe->output_valid && !pipe->dirty_pass)
+  {
+    const dt_iop_roi_t full = { x, y, width, height, scale };
+    dt_iop_roi_t dirty;
+    GList *forms = dt_masks_dup_forms_deep(dev->forms, NULL);
+    if(_pixelpipe_dirty_area(pipe, dev, &full, forms, &dirty))
+      return _pixelpipe_process_dirty(pipe, dev, &full, &dirty, forms);
+    g_list_free_full(forms, (void (*)(void *))dt_masks_free_form);
+  }
+
+  // a part of the image seen before is put together from its tiles
+  const uint64_t tiles_key = _tiles_key(pipe, scale);
+  if(tiles_key && pipe->tiles_size > 0)
+  {
+    const dt_iop_roi_t full = { x, y, width, height, scale };
+    const int err = _pixelpipe_process_tiles(pipe, dev, tiles_key, &full);
+    if(err >= 0) return err;
+  }
+
   pipe->processing = 1;
+  const double process_start = dt_get_wtime();
   pipe->opencl_enabled = dt_opencl_update_settings(); // update enabled flag and profile from preferences
   pipe->devid = (pipe->opencl_enabled) ? dt_opencl_lock_device(pipe->type)
                                        : -1; // try to get/lock opencl resource
@@ -2743,8 +4703,16 @@ int dt_dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, dt_develop_t *dev, int x,
 // re-entry point: in case of late opencl errors we start all over again with opencl-support disabled
 restart:
 
+  g_list_free_full(pipe->cpu_fallbacks, g_free);
+  pipe->cpu_fallbacks = NULL;
+
   // check if we should obsolete caches
-  if(pipe->cache_obsolete) dt_dev_pixelpipe_cache_flush(&(pipe->cache));
+  if(pipe->cache_obsolete)
+  {
+    dt_dev_pixelpipe_cache_flush(&(pipe->cache));
+    _tiles_flush(pipe);
+    pipe->output_valid = FALSE;
+  }
   pipe->cache_obsolete = 0;
 
   // mask display off as a starting point
@@ -2800,12 +4768,10 @@ restart:
     goto restart; // try again (this time without opencl)
   }
 
-  // release resources:
-  if (pipe->forms)
-  {
-    g_list_free_full(pipe->forms, (void (*)(void *))dt_masks_free_form);
-    pipe->forms = NULL;
-  }
+  // release resources, but keep the masks the output was rendered with:
+  GList *forms = pipe->forms;
+  pipe->forms = NULL;
+  dt_dev_pixelpipe_pool_flush(pipe->pool);
   if(pipe->devid >= 0)
   {
     dt_opencl_unlock_device(pipe->devid);
@@ -2814,7 +4780,9 @@ restart:
   // ... and in case of other errors ...
   if(err)
   {
+    g_list_free_full(forms, (void (*)(void *))dt_masks_free_form);
     pipe->processing = 0;
+    _pipe_count(pipe, "aborted");
     return 1;
   }
 
@@ -2824,10 +4792,13 @@ restart:
   pipe->backbuf = buf;
   pipe->backbuf_width = width;
   pipe->backbuf_height = height;
+  pipe->backbuf_bpp = dt_iop_buffer_dsc_to_bpp(out_format);
 
-  if((pipe->type & DT_DEV_PIXELPIPE_PREVIEW) == DT_DEV_PIXELPIPE_PREVIEW
-     || (pipe->type & DT_DEV_PIXELPIPE_FULL) == DT_DEV_PIXELPIPE_FULL
-     || (pipe->type & DT_DEV_PIXELPIPE_PREVIEW2) == DT_DEV_PIXELPIPE_PREVIEW2)
+  // the patch of a dirty pass is copied into the output by _pixelpipe_process_dirty()
+  if(((pipe->type & DT_DEV_PIXELPIPE_PREVIEW) == DT_DEV_PIXELPIPE_PREVIEW
+      || (pipe->type & DT_DEV_PIXELPIPE_FULL) == DT_DEV_PIXELPIPE_FULL
+      || (pipe->type & DT_DEV_PIXELPIPE_PREVIEW2) == DT_DEV_PIXELPIPE_PREVIEW2)
+     && !pipe->dirty_pass)
   {
     if(pipe->output_backbuf == NULL || pipe->output_backbuf_width != pipe->backbuf_width || pipe->output_backbuf_height != pipe->backbuf_height)
     {
@@ -2839,18 +4810,47 @@ restart:
 
     if(pipe->output_backbuf)
       memcpy(pipe->output_backbuf, pipe->backbuf, (size_t)pipe->output_backbuf_width * pipe->output_backbuf_height * 4 * sizeof(uint8_t));
+    pipe->output_backbuf_coarse = pipe->coarse;
     pipe->output_imgid = pipe->image.id;
   }
   dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
 
+  if((pipe->type & DT_DEV_PIXELPIPE_FULL) == DT_DEV_PIXELPIPE_FULL && !pipe->dirty_pass)
+    _pixelpipe_output_snapshot(pipe, &roi, forms);
+  else
+    g_list_free_full(forms, (void (*)(void *))dt_masks_free_form);
+
+  if(tiles_key && pipe->output_backbuf && pipe->mask_display == DT_DEV_PIXELPIPE_DISPLAY_NONE)
+    _tiles_store(pipe, tiles_key, &roi, pipe->output_backbuf);
+
+  char metric[64];
+  _pipe_metric(pipe, "process", metric, sizeof(metric));
+  dt_metrics_time(metric, dt_get_wtime() - process_start);
+
+#ifdef HAVE_OPENCL
+  _report_cpu_fallbacks(pipe);
+#endif
+
   // printf("pixelpipe homebrew process end\n");
   pipe->processing = 0;
+  dt_memory_governor_check();
   return 0;
 }
 
 void dt_dev_pixelpipe_flush_caches(dt_dev_pixelpipe_t *pipe)
 {
   dt_dev_pixelpipe_cache_flush(&pipe->cache);
+  pipe->output_valid = FALSE;
+  _tiles_flush(pipe);
+
+  // input pixels changed, so whatever the other pipes shared might be stale too
+  if(darktable.pixelpipe_cache
+     && (pipe->type & (DT_DEV_PIXELPIPE_FULL | DT_DEV_PIXELPIPE_PREVIEW | DT_DEV_PIXELPIPE_PREVIEW2)))
+  {
+    dt_pthread_mutex_lock(&darktable.pixelpipe_cache_threadsafe);
+    dt_dev_pixelpipe_cache_flush(darktable.pixelpipe_cache);
+    dt_pthread_mutex_unlock(&darktable.pixelpipe_cache_threadsafe);
+  }
 }
 
 void dt_dev_pixelpipe_get_dimensions(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, int width_in,
@@ -25,6 +25,7 @@
 #include "develop/develop.h"
 #include "develop/imageop.h"
 #include "develop/pixelpipe_cache.h"
+#include "develop/pixelpipe_pool.h"
 
 /**
  * struct used by iop modules to connect to pixelpipe.
@@ -58,6 +59,15 @@ typedef struct dt_dev_pixelpipe_iop_t
   float iscale;        // input actually just downscaled buffer? iscale*iwidth = actual width
   int iwidth, iheight; // width and height of input buffer
   uint64_t hash;       // hash of params and enabled.
+  uint64_t params_hash; // the same without the module's masks
+  uint64_t mask_hash;   // the same with the masks but without the blend mode
+  // what the last commit_params() saw and the enabled state it left, see dt_iop_commit_params()
+  uint64_t commit_hash;
+  int commit_enabled;
+  int commit_again; // commit_params() sets this while its data is provisional, the next synch commits again
+  // state the last displayed output of the pipe was rendered with, see _pixelpipe_dirty_area()
+  uint64_t output_hash, output_params_hash;
+  int output_enabled;
   int bpc;             // bits per channel, 32 means float
   int colors;          // how many colors per pixel
   dt_iop_roi_t buf_in,
@@ -70,6 +80,10 @@ typedef struct dt_dev_pixelpipe_iop_t
   dt_iop_buffer_dsc_t dsc_in, dsc_out;
 
   GHashTable *raster_masks; // GList* of dt_dev_pixelpipe_raster_mask_t
+  float *blend_mask;        // the drawn and parametric mask before the opacity, see dt_develop_blend_process()
+  uint64_t blend_mask_hash; // what it was built from, 0 while it is not valid
+  size_t blend_mask_size;
+  GHashTable *roi_fit_memo; // tile rois fitted by the tiling code, created on demand
 } dt_dev_pixelpipe_iop_t;
 
 typedef enum dt_dev_pixelpipe_change_t
@@ -109,12 +123,17 @@ typedef struct dt_dev_pixelpipe_t
 
   // instances of pixelpipe, stored in GList of dt_dev_pixelpipe_iop_t
   GList *nodes;
+  // the hashes of the stack before every node and of the whole stack, see dt_dev_pixelpipe_cache_update_hashes()
+  uint64_t *stack_hash;
+  int stack_hash_count;
   // event flag
   dt_dev_pixelpipe_change_t changed;
   // backbuffer (output)
   uint8_t *backbuf;
   size_t backbuf_size;
   int backbuf_width, backbuf_height;
+  // bytes per pixel of the backbuffer
+  size_t backbuf_bpp;
   float backbuf_scale;
   float backbuf_zoom_x, backbuf_zoom_y;
   uint64_t backbuf_hash;
@@ -122,6 +141,10 @@ typedef struct dt_dev_pixelpipe_t
   // output buffer (for display)
   uint8_t *output_backbuf;
   int output_backbuf_width, output_backbuf_height;
+  // the output buffer was rendered at 1/output_backbuf_coarse of the backbuf scale and has to be upscaled
+  int output_backbuf_coarse;
+  // set while rendering the quick first pass of a progressive update, see dt_dev_process_image_job()
+  int coarse;
   int output_imgid;
   // working?
   int processing;
@@ -131,8 +154,20 @@ typedef struct dt_dev_pixelpipe_t
   int opencl_enabled;
   // opencl error detected?
   int opencl_error;
+  // "module (reason)" of every module which moved the buffer from the gpu back to the cpu in the current run
+  GList *cpu_fallbacks;
   // running in a tiling context?
   int tiling;
+  // processing one strip of a tile-streamed run? modules then get their input padded by their overlap.
+  int streaming;
+  // position of the module whose padded output is being processed right now
+  int stream_padded_pos;
+  // output assembled from the strips of a tile-streamed run
+  uint8_t *stream_buf;
+  // scratch memory of modules and tiling, released after every run
+  struct dt_dev_pixelpipe_pool_t *pool;
+  // keep the input of modules with IOP_FLAGS_HALF_INPUT as half floats in the cache?
+  int half_cache;
   // should this pixelpipe display a mask in the end?
   int mask_display;
   // should this pixelpipe completely suppressed the blendif module?
@@ -156,6 +191,23 @@ typedef struct dt_dev_pixelpipe_t
   GList *iop_order_list;
   // snapshot of mask list
   GList *forms;
+  // the shapes rasterised for the modules of the pipe, see dt_masks_get_mask_roi()
+  GList *mask_rasters;
+  uint64_t mask_rasters_clock;
+  // the last displayed output: its roi, input buffer and masks. lets a change of a module's masks be
+  // recomputed only where they differ.
+  gboolean output_valid;
+  dt_iop_roi_t output_roi;
+  float *output_input;
+  int output_mask_display;
+  GList *output_forms;
+  // recomputing the changed part of the last output
+  int dirty_pass;
+  // tiles of the outputs of the full pipe, so panning back to a part of the image doesn't process it again.
+  // dt_dev_pixelpipe_tile_t, the most recently used first in the queue.
+  GHashTable *tiles;
+  GQueue tiles_lru;
+  size_t tiles_size;
   // the masks generated in the pipe for later reusal are inside dt_dev_pixelpipe_iop_t
   gboolean store_all_raster_masks;
 } dt_dev_pixelpipe_t;
@@ -176,8 +228,8 @@ int dt_dev_pixelpipe_init_thumbnail(dt_dev_pixelpipe_t *pipe, int32_t width, int
 // inits all but the pixel caches, so you can't actually process an image (just get dimensions and
 // distortions)
 int dt_dev_pixelpipe_init_dummy(dt_dev_pixelpipe_t *pipe, int32_t width, int32_t height);
-// inits the pixelpipe with given cacheline size and number of entries.
-int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t entries);
+// inits the pixelpipe with given cacheline size, minimum number of entries and memory budget for more entries.
+int dt_dev_pixelpipe_init_cached(dt_dev_pixelpipe_t *pipe, size_t size, int32_t entries, size_t memlimit);
 // constructs a new input buffer from given RGB float array.
 void dt_dev_pixelpipe_set_input(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, float *input, int width,
                                 int height, float iscale);
@@ -207,12 +259,24 @@ void dt_dev_pixelpipe_synch_all(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *d
 // adjust output node according to history stack (history pop event)
 void dt_dev_pixelpipe_synch_top(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev);
 
+// receives rows [y, y + height) of a streamed run, bpp bytes per pixel. returns != 0 to stop the run.
+typedef int (*dt_dev_pixelpipe_strip_sink_t)(const uint8_t *buf, size_t bpp, int y, int height, void *data);
+
 // process region of interest of pixels. returns 1 if pipe was altered during processing.
 int dt_dev_pixelpipe_process(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, int x, int y, int width,
                              int height, float scale);
 // convenience method that does not gamma-compress the image.
 int dt_dev_pixelpipe_process_no_gamma(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, int x, int y,
                                       int width, int height, float scale);
+// processes the full image in horizontal strips of strip_height rows, so intermediate buffers only need
+// to hold one strip. falls back to dt_dev_pixelpipe_process() if a module needs to see the whole image.
+// export pipes may spread the strips over up to `devices' pipes running at the same time, each on an opencl
+// device of its own. without strip_height the image is then cut into one band per device.
+// with a sink the strips are handed to it in order from top to bottom instead of being assembled in
+// pipe->backbuf. an image that can't be streamed reaches the sink in one piece.
+int dt_dev_pixelpipe_process_streamed(dt_dev_pixelpipe_t *pipe, struct dt_develop_t *dev, int width,
+                                      int height, float scale, const gboolean gamma, int strip_height,
+                                      int devices, dt_dev_pixelpipe_strip_sink_t sink, void *sink_data);
 
 // disable given op and all that comes after it in the pipe:
 void dt_dev_pixelpipe_disable_after(dt_dev_pixelpipe_t *pipe, const char *op);
@@ -0,0 +1,178 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "develop/pixelpipe_pool.h"
+#include "common/darktable.h"
+#include "common/memory_accounting.h"
+#include "develop/pixelpipe.h"
+
+#include <stdlib.h>
+
+typedef struct dt_dev_pixelpipe_pool_block_t
+{
+  void *mem;
+  size_t size;
+} dt_dev_pixelpipe_pool_block_t;
+
+struct dt_dev_pixelpipe_pool_t
+{
+  dt_pthread_mutex_t lock;
+  GList *idle;      // dt_dev_pixelpipe_pool_block_t given back and ready for reuse
+  GHashTable *used; // mem -> size of the blocks handed out
+  size_t in_use;    // sum of the blocks handed out
+  size_t mark, peak_since_mark;
+};
+
+dt_dev_pixelpipe_pool_t *dt_dev_pixelpipe_pool_init(void)
+{
+  dt_dev_pixelpipe_pool_t *pool = (dt_dev_pixelpipe_pool_t *)calloc(1, sizeof(dt_dev_pixelpipe_pool_t));
+  if(!pool) return NULL;
+  dt_pthread_mutex_init(&pool->lock, NULL);
+  pool->used = g_hash_table_new(g_direct_hash, g_direct_equal);
+  return pool;
+}
+
+static void _free_block(gpointer data)
+{
+  dt_dev_pixelpipe_pool_block_t *block = (dt_dev_pixelpipe_pool_block_t *)data;
+  dt_free_align(block->mem);
+  free(block);
+}
+
+// called with the lock held
+static void _flush_locked(dt_dev_pixelpipe_pool_t *pool)
+{
+  g_list_free_full(pool->idle, _free_block);
+  pool->idle = NULL;
+}
+
+void dt_dev_pixelpipe_pool_flush(dt_dev_pixelpipe_pool_t *pool)
+{
+  if(!pool) return;
+  dt_pthread_mutex_lock(&pool->lock);
+  _flush_locked(pool);
+  dt_pthread_mutex_unlock(&pool->lock);
+}
+
+void dt_dev_pixelpipe_pool_cleanup(dt_dev_pixelpipe_pool_t *pool)
+{
+  if(!pool) return;
+  dt_dev_pixelpipe_pool_flush(pool);
+  // blocks still out belong to whoever took them, they are freed through dt_dev_pixelpipe_free_align()
+  // which falls back to dt_free_align() without a pool
+  g_hash_table_destroy(pool->used);
+  dt_pthread_mutex_destroy(&pool->lock);
+  free(pool);
+}
+
+void *dt_dev_pixelpipe_alloc_align(dt_dev_pixelpipe_t *pipe, const size_t size)
+{
+  dt_dev_pixelpipe_pool_t *pool = pipe ? pipe->pool : NULL;
+  if(!pool) return dt_alloc_align(64, size);
+
+  dt_pthread_mutex_lock(&pool->lock);
+  // the smallest idle block that fits without wasting more than the request itself
+  GList *best = NULL;
+  for(GList *l = pool->idle; l; l = g_list_next(l))
+  {
+    const dt_dev_pixelpipe_pool_block_t *block = (dt_dev_pixelpipe_pool_block_t *)l->data;
+    if(block->size >= size && block->size / 2 <= size
+       && (!best || block->size < ((dt_dev_pixelpipe_pool_block_t *)best->data)->size))
+      best = l;
+  }
+
+  void *mem = NULL;
+  size_t mem_size = size;
+  if(best)
+  {
+    dt_dev_pixelpipe_pool_block_t *block = (dt_dev_pixelpipe_pool_block_t *)best->data;
+    mem = block->mem;
+    mem_size = block->size;
+    pool->idle = g_list_delete_link(pool->idle, best);
+    free(block);
+    // fresh ones are already accounted for by dt_alloc_align()
+    dt_memory_accounting_host_alloc(mem, mem_size);
+  }
+  else
+  {
+    // nothing fits, so don't keep memory around which won't be of use for a while anyway
+    _flush_locked(pool);
+    mem = dt_alloc_align(64, size);
+  }
+  if(mem)
+  {
+    g_hash_table_insert(pool->used, mem, GSIZE_TO_POINTER(mem_size));
+    pool->in_use += mem_size;
+    pool->peak_since_mark = MAX(pool->peak_since_mark, pool->in_use);
+  }
+  dt_pthread_mutex_unlock(&pool->lock);
+  return mem;
+}
+
+void dt_dev_pixelpipe_free_align(dt_dev_pixelpipe_t *pipe, void *mem)
+{
+  if(!mem) return;
+  dt_dev_pixelpipe_pool_t *pool = pipe ? pipe->pool : NULL;
+  if(!pool)
+  {
+    dt_free_align(mem);
+    return;
+  }
+
+  dt_pthread_mutex_lock(&pool->lock);
+  gpointer size;
+  if(g_hash_table_lookup_extended(pool->used, mem, NULL, &size))
+  {
+    g_hash_table_remove(pool->used, mem);
+    pool->in_use -= GPOINTER_TO_SIZE(size);
+    dt_dev_pixelpipe_pool_block_t *block
+        = (dt_dev_pixelpipe_pool_block_t *)malloc(sizeof(dt_dev_pixelpipe_pool_block_t));
+    if(block)
+    {
+      block->mem = mem;
+      block->size = GPOINTER_TO_SIZE(size);
+      pool->idle = g_list_prepend(pool->idle, block);
+      dt_memory_accounting_host_free(mem);
+      mem = NULL;
+    }
+  }
+  dt_pthread_mutex_unlock(&pool->lock);
+  // not from the pool, or no memory to keep track of it
+  if(mem) dt_free_align(mem);
+}
+
+void dt_dev_pixelpipe_pool_mark(dt_dev_pixelpipe_pool_t *pool)
+{
+  if(!pool) return;
+  dt_pthread_mutex_lock(&pool->lock);
+  pool->mark = pool->peak_since_mark = pool->in_use;
+  dt_pthread_mutex_unlock(&pool->lock);
+}
+
+size_t dt_dev_pixelpipe_pool_peak_since_mark(dt_dev_pixelpipe_pool_t *pool)
+{
+  if(!pool) return 0;
+  dt_pthread_mutex_lock(&pool->lock);
+  const size_t peak = pool->peak_since_mark > pool->mark ? pool->peak_since_mark - pool->mark : 0;
+  dt_pthread_mutex_unlock(&pool->lock);
+  return peak;
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
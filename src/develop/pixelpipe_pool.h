@@ -0,0 +1,52 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stddef.h>
+
+struct dt_dev_pixelpipe_t;
+
+/**
+ * scratch memory for one run of a pixelpipe. blocks given back are kept and handed out again for requests of
+ * about the same size, so modules and tiles allocating the same temporaries over and over don't pay for
+ * fresh pages every time. everything left is released when dt_dev_pixelpipe_process() returns.
+ *
+ * blocks are 64 byte aligned, the pipe may be NULL to get plain dt_alloc_align() memory.
+ */
+
+typedef struct dt_dev_pixelpipe_pool_t dt_dev_pixelpipe_pool_t;
+
+dt_dev_pixelpipe_pool_t *dt_dev_pixelpipe_pool_init(void);
+void dt_dev_pixelpipe_pool_cleanup(dt_dev_pixelpipe_pool_t *pool);
+/** releases all blocks not in use. */
+void dt_dev_pixelpipe_pool_flush(dt_dev_pixelpipe_pool_t *pool);
+
+/** gets a block of at least size bytes. */
+void *dt_dev_pixelpipe_alloc_align(struct dt_dev_pixelpipe_t *pipe, const size_t size);
+/** gives a block back, mem may be NULL. */
+void dt_dev_pixelpipe_free_align(struct dt_dev_pixelpipe_t *pipe, void *mem);
+
+/** starts a new interval for dt_dev_pixelpipe_pool_peak_since_mark(). */
+void dt_dev_pixelpipe_pool_mark(dt_dev_pixelpipe_pool_t *pool);
+/** peak of the memory handed out on top of what was out at the last mark. */
+size_t dt_dev_pixelpipe_pool_peak_since_mark(dt_dev_pixelpipe_pool_t *pool);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
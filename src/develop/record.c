@@ -0,0 +1,313 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "develop/record.h"
+#include "common/darktable.h"
+#include "common/image.h"
+#include "control/control.h"
+#include "develop/blend.h"
+#include "develop/develop.h"
+#include "develop/imageop.h"
+#include "gui/gtk.h"
+
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DT_DEV_RECORD_HEADER "# darktable darkroom recording 1"
+
+static FILE *_record_file = NULL;
+static double _record_start = 0.0;
+static dt_pthread_mutex_t _record_mutex;
+// the last viewport written, to leave out the ones which didn't change
+static dt_dev_record_event_t _record_view = { 0 };
+
+static const char *_type_names[] = { "load", "base", "history", "pop", "view", "preview", "full" };
+
+int dt_dev_record_init(const char *filename)
+{
+  _record_file = g_fopen(filename, "wb");
+  if(!_record_file)
+  {
+    fprintf(stderr, "[record] can't open `%s' for writing\n", filename);
+    return 1;
+  }
+  dt_pthread_mutex_init(&_record_mutex, NULL);
+  _record_start = dt_get_wtime();
+  fputs(DT_DEV_RECORD_HEADER "\n", _record_file);
+  return 0;
+}
+
+void dt_dev_record_cleanup(void)
+{
+  if(!_record_file) return;
+  dt_pthread_mutex_lock(&_record_mutex);
+  fclose(_record_file);
+  _record_file = NULL;
+  dt_pthread_mutex_unlock(&_record_mutex);
+  dt_pthread_mutex_destroy(&_record_mutex);
+}
+
+gboolean dt_dev_record_enabled(void)
+{
+  return _record_file != NULL;
+}
+
+// called with the mutex held
+static void _begin_event(const dt_dev_record_type_t type)
+{
+  fprintf(_record_file, "%.6f\t%s", dt_get_wtime() - _record_start, _type_names[type]);
+}
+
+static void _write_hex(const void *data, const size_t size)
+{
+  fputc('\t', _record_file);
+  for(size_t k = 0; k < size; k++) fprintf(_record_file, "%02x", ((const uint8_t *)data)[k]);
+  if(!size) fputc('-', _record_file);
+}
+
+static void _write_item(const dt_dev_record_type_t type, const char *op, const int multi_priority,
+                        const int enabled, const void *params, const size_t params_size,
+                        const void *blend_params)
+{
+  _begin_event(type);
+  fprintf(_record_file, "\t%s\t%d\t%d", op, multi_priority, enabled);
+  _write_hex(params, params_size);
+  _write_hex(blend_params, blend_params ? sizeof(dt_develop_blend_params_t) : 0);
+  fputc('\n', _record_file);
+}
+
+void dt_dev_record_load(dt_develop_t *dev)
+{
+  if(!_record_file || !dev->gui_attached) return;
+
+  char filename[PATH_MAX] = { 0 };
+  gboolean from_cache = FALSE;
+  dt_image_full_path(dev->image_storage.id, filename, sizeof(filename), &from_cache);
+
+  dt_pthread_mutex_lock(&_record_mutex);
+  _begin_event(DT_DEV_RECORD_LOAD);
+  fprintf(_record_file, "\t%s\n", filename);
+  int num = 0;
+  for(GList *history = dev->history; history && num < dev->history_end; history = g_list_next(history), num++)
+  {
+    const dt_dev_history_item_t *hist = (dt_dev_history_item_t *)history->data;
+    _write_item(DT_DEV_RECORD_BASE, hist->op_name, hist->multi_priority, hist->enabled, hist->params,
+                hist->module->params_size, hist->blend_params);
+  }
+  // the new image needs all of the viewport again
+  memset(&_record_view, 0, sizeof(_record_view));
+  fflush(_record_file);
+  dt_pthread_mutex_unlock(&_record_mutex);
+}
+
+void dt_dev_record_history(dt_develop_t *dev, dt_iop_module_t *module)
+{
+  if(!_record_file || !dev->gui_attached || !module) return;
+
+  dt_pthread_mutex_lock(&_record_mutex);
+  _write_item(DT_DEV_RECORD_HISTORY, module->op, module->multi_priority, module->enabled, module->params,
+              module->params_size, module->blend_params);
+  fflush(_record_file);
+  dt_pthread_mutex_unlock(&_record_mutex);
+}
+
+void dt_dev_record_pop(dt_develop_t *dev, const int history_end)
+{
+  if(!_record_file || !dev->gui_attached) return;
+
+  dt_pthread_mutex_lock(&_record_mutex);
+  _begin_event(DT_DEV_RECORD_POP);
+  fprintf(_record_file, "\t%d\n", history_end);
+  fflush(_record_file);
+  dt_pthread_mutex_unlock(&_record_mutex);
+}
+
+void dt_dev_record_view(dt_develop_t *dev)
+{
+  if(!_record_file || !dev->gui_attached) return;
+
+  dt_dev_record_event_t view = { 0 };
+  view.width = dev->width;
+  view.height = dev->height;
+  view.ppd = darktable.gui->ppd;
+  view.zoom = dt_control_get_dev_zoom();
+  view.closeup = dt_control_get_dev_closeup();
+  view.zoom_x = dt_control_get_dev_zoom_x();
+  view.zoom_y = dt_control_get_dev_zoom_y();
+  view.zoom_scale = dt_control_get_dev_zoom_scale();
+
+  dt_pthread_mutex_lock(&_record_mutex);
+  if(view.width != _record_view.width || view.height != _record_view.height || view.ppd != _record_view.ppd
+     || view.zoom != _record_view.zoom || view.closeup != _record_view.closeup
+     || view.zoom_x != _record_view.zoom_x || view.zoom_y != _record_view.zoom_y
+     || view.zoom_scale != _record_view.zoom_scale)
+  {
+    _record_view = view;
+    _begin_event(DT_DEV_RECORD_VIEW);
+    fprintf(_record_file, "\t%d\t%d\t%g\t%d\t%d\t%.9g\t%.9g\t%.9g\n", view.width, view.height, view.ppd,
+            view.zoom, view.closeup, view.zoom_x, view.zoom_y, view.zoom_scale);
+    fflush(_record_file);
+  }
+  dt_pthread_mutex_unlock(&_record_mutex);
+}
+
+void dt_dev_record_finished(const dt_dev_record_type_t type)
+{
+  if(!_record_file) return;
+
+  dt_pthread_mutex_lock(&_record_mutex);
+  _begin_event(type);
+  fputc('\n', _record_file);
+  fflush(_record_file);
+  dt_pthread_mutex_unlock(&_record_mutex);
+}
+
+static void *_read_hex(const char *hex, size_t *size)
+{
+  const size_t len = strlen(hex);
+  *size = 0;
+  if(!strcmp(hex, "-") || len % 2) return NULL;
+  uint8_t *data = malloc(len / 2);
+  for(size_t k = 0; k < len / 2; k++)
+  {
+    const gint hi = g_ascii_xdigit_value(hex[2 * k]);
+    const gint lo = g_ascii_xdigit_value(hex[2 * k + 1]);
+    if(hi < 0 || lo < 0)
+    {
+      free(data);
+      return NULL;
+    }
+    data[k] = (hi << 4) | lo;
+  }
+  *size = len / 2;
+  return data;
+}
+
+static void _free_event(gpointer data)
+{
+  dt_dev_record_event_t *event = (dt_dev_record_event_t *)data;
+  g_free(event->filename);
+  free(event->params);
+  free(event->blend_params);
+  free(event);
+}
+
+// the event of one line, NULL if it can't be read
+static dt_dev_record_event_t *_read_event(const char *line)
+{
+  gchar **tokens = g_strsplit(line, "\t", -1);
+  const int n = g_strv_length(tokens);
+  dt_dev_record_event_t *event = NULL;
+  int type = -1;
+  for(int k = 0; n >= 2 && k < (int)G_N_ELEMENTS(_type_names); k++)
+    if(!strcmp(tokens[1], _type_names[k])) type = k;
+
+  if(type >= 0)
+  {
+    event = calloc(1, sizeof(dt_dev_record_event_t));
+    event->time = g_ascii_strtod(tokens[0], NULL);
+    event->type = type;
+    gboolean ok = TRUE;
+    switch(event->type)
+    {
+      case DT_DEV_RECORD_LOAD:
+        ok = n == 3;
+        if(ok) event->filename = g_strdup(tokens[2]);
+        break;
+      case DT_DEV_RECORD_BASE:
+      case DT_DEV_RECORD_HISTORY:
+        ok = n == 7;
+        if(ok)
+        {
+          g_strlcpy(event->op, tokens[2], sizeof(event->op));
+          event->multi_priority = atoi(tokens[3]);
+          event->enabled = atoi(tokens[4]);
+          event->params = _read_hex(tokens[5], &event->params_size);
+          event->blend_params = _read_hex(tokens[6], &event->blend_params_size);
+        }
+        break;
+      case DT_DEV_RECORD_POP:
+        ok = n == 3;
+        if(ok) event->history_end = atoi(tokens[2]);
+        break;
+      case DT_DEV_RECORD_VIEW:
+        ok = n == 10;
+        if(ok)
+        {
+          event->width = atoi(tokens[2]);
+          event->height = atoi(tokens[3]);
+          event->ppd = g_ascii_strtod(tokens[4], NULL);
+          event->zoom = atoi(tokens[5]);
+          event->closeup = atoi(tokens[6]);
+          event->zoom_x = g_ascii_strtod(tokens[7], NULL);
+          event->zoom_y = g_ascii_strtod(tokens[8], NULL);
+          event->zoom_scale = g_ascii_strtod(tokens[9], NULL);
+        }
+        break;
+      case DT_DEV_RECORD_PREVIEW:
+      case DT_DEV_RECORD_FULL:
+        break;
+    }
+    if(!ok)
+    {
+      _free_event(event);
+      event = NULL;
+    }
+  }
+  g_strfreev(tokens);
+  return event;
+}
+
+GList *dt_dev_record_read(const char *filename)
+{
+  gchar *contents = NULL;
+  if(!g_file_get_contents(filename, &contents, NULL, NULL)) return NULL;
+
+  GList *events = NULL;
+  gchar **lines = g_strsplit(contents, "\n", -1);
+  g_free(contents);
+  if(!lines[0] || strcmp(lines[0], DT_DEV_RECORD_HEADER))
+  {
+    fprintf(stderr, "[record] `%s' is not a darkroom recording\n", filename);
+    g_strfreev(lines);
+    return NULL;
+  }
+
+  for(int k = 1; lines[k]; k++)
+  {
+    if(!lines[k][0]) continue;
+    dt_dev_record_event_t *event = _read_event(lines[k]);
+    if(event)
+      events = g_list_prepend(events, event);
+    else
+      fprintf(stderr, "[record] skipping line %d of `%s'\n", k + 1, filename);
+  }
+  g_strfreev(lines);
+  return g_list_reverse(events);
+}
+
+void dt_dev_record_free(GList *events)
+{
+  g_list_free_full(events, _free_event);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
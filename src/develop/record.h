@@ -0,0 +1,96 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "control/settings.h"
+
+#include <glib.h>
+#include <stddef.h>
+
+struct dt_develop_t;
+struct dt_iop_module_t;
+
+/**
+ * recording of a darkroom session, to replay it with darktable-bench --replay and measure how long the
+ * preview and the full pipe take to catch up with every change. the image, the history changes, undo/redo and
+ * the viewport (size, zoom and position) are written with the seconds since the recording started, and so is
+ * every finished preview and full pipe run, which gives the latency of the session that was recorded.
+ *
+ * one event per line, tab separated, after a "# darktable darkroom recording 1" header:
+ *   <time> load <filename>
+ *   <time> base|history <op> <multi_priority> <enabled> <params as hex> <blend params as hex>
+ *   <time> pop <history_end>
+ *   <time> view <width> <height> <ppd> <zoom> <closeup> <zoom_x> <zoom_y> <zoom_scale>
+ *   <time> preview|full
+ * base are the history items of the image when it was loaded. the shapes of masks are not recorded.
+ */
+
+typedef enum dt_dev_record_type_t
+{
+  DT_DEV_RECORD_LOAD = 0,
+  DT_DEV_RECORD_BASE = 1,
+  DT_DEV_RECORD_HISTORY = 2,
+  DT_DEV_RECORD_POP = 3,
+  DT_DEV_RECORD_VIEW = 4,
+  DT_DEV_RECORD_PREVIEW = 5,
+  DT_DEV_RECORD_FULL = 6,
+} dt_dev_record_type_t;
+
+typedef struct dt_dev_record_event_t
+{
+  double time;
+  dt_dev_record_type_t type;
+  // load
+  char *filename;
+  // base, history
+  char op[20];
+  int multi_priority;
+  int enabled;
+  void *params, *blend_params;
+  size_t params_size, blend_params_size;
+  // pop
+  int history_end;
+  // view
+  int width, height;
+  float ppd;
+  dt_dev_zoom_t zoom;
+  int closeup;
+  float zoom_x, zoom_y, zoom_scale;
+} dt_dev_record_event_t;
+
+/** starts recording to the file, returns non zero if it can't be written. */
+int dt_dev_record_init(const char *filename);
+void dt_dev_record_cleanup(void);
+gboolean dt_dev_record_enabled(void);
+
+/** the events, called by the darkroom. they do nothing unless recording. */
+void dt_dev_record_load(struct dt_develop_t *dev);
+void dt_dev_record_history(struct dt_develop_t *dev, struct dt_iop_module_t *module);
+void dt_dev_record_pop(struct dt_develop_t *dev, const int history_end);
+/** the viewport as the full pipe will use it, written if it changed. */
+void dt_dev_record_view(struct dt_develop_t *dev);
+void dt_dev_record_finished(const dt_dev_record_type_t type);
+
+/** reads a recording into a list of dt_dev_record_event_t. NULL if it can't be read. */
+GList *dt_dev_record_read(const char *filename);
+void dt_dev_record_free(GList *events);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
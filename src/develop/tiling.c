@@ -18,6 +18,8 @@
 
 
 #include "develop/tiling.h"
+#include "develop/tiling_calibration.h"
+#include "common/memory_governor.h"
 #include "common/opencl.h"
 #include "control/control.h"
 #include "develop/blend.h"
@@ -25,6 +27,7 @@
 
 #include <assert.h>
 #include <math.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
@@ -43,6 +46,9 @@
    Needs to be increased if tiling fails due to insufficient buffer sizes. */
 #define RESERVE 5
 
+/* maximum number of fitted tile rois remembered per piece */
+#define ROI_FIT_MEMO_SIZE 256
+
 
 /* greatest common divisor */
 static unsigned _gcd(unsigned a, unsigned b)
@@ -64,6 +70,28 @@ static unsigned _lcm(unsigned a, unsigned b)
 }
 
 
+// the settings read for every tiled module of every pipe run, parsed once per change instead of every time
+static struct
+{
+  const dt_conf_value_t *host_memory_limit, *tiling_parallel, *singlebuffer_limit, *maximum_number_tiles,
+      *use_pinned_memory, *memory_headroom;
+} _conf;
+
+static void _conf_init(void)
+{
+  static gsize inited = 0;
+  if(g_once_init_enter(&inited))
+  {
+    _conf.host_memory_limit = dt_conf_value("host_memory_limit");
+    _conf.tiling_parallel = dt_conf_value("tiling_parallel");
+    _conf.singlebuffer_limit = dt_conf_value("singlebuffer_limit");
+    _conf.maximum_number_tiles = dt_conf_value("maximum_number_tiles");
+    _conf.use_pinned_memory = dt_conf_value("opencl_use_pinned_memory");
+    _conf.memory_headroom = dt_conf_value("opencl_memory_headroom");
+    g_once_init_leave(&inited, 1);
+  }
+}
+
 static inline int _min(int a, int b)
 {
   return a < b ? a : b;
@@ -536,8 +564,73 @@ static int _nm_fit_output_to_input_roi(struct dt_iop_module_t *self, struct dt_d
 
 
 
+/* a fitted tile roi, remembered per piece. everything from hash to delta is the lookup key */
+typedef struct _roi_fit_t
+{
+  uint64_t key; // hash of the lookup key, must be the first member
+  uint64_t hash;
+  dt_iop_roi_t buf_in, buf_out, iroi, oroi_start;
+  int delta;
+  dt_iop_roi_t oroi;
+} _roi_fit_t;
+
+#define ROI_FIT_KEY_BEGIN offsetof(_roi_fit_t, hash)
+#define ROI_FIT_KEY_END offsetof(_roi_fit_t, oroi)
+
+static void _roi_fit_key(_roi_fit_t *fit, struct dt_dev_pixelpipe_iop_t *piece, const dt_iop_roi_t *iroi,
+                         const dt_iop_roi_t *oroi, const int delta)
+{
+  memset(fit, 0, sizeof(_roi_fit_t));
+  fit->hash = piece->hash;
+  fit->buf_in = piece->buf_in;
+  fit->buf_out = piece->buf_out;
+  fit->iroi = *iroi;
+  fit->oroi_start = *oroi;
+  fit->delta = delta;
+
+  // bernstein hash (djb2)
+  uint64_t key = 5381;
+  const uint8_t *str = (const uint8_t *)fit;
+  for(size_t i = ROI_FIT_KEY_BEGIN; i < ROI_FIT_KEY_END; i++) key = ((key << 5) + key) ^ str[i];
+  fit->key = key;
+}
+
+static gboolean _roi_fit_lookup(struct dt_dev_pixelpipe_iop_t *piece, const _roi_fit_t *fit, dt_iop_roi_t *oroi)
+{
+  if(!piece->roi_fit_memo) return FALSE;
+  const _roi_fit_t *found = (const _roi_fit_t *)g_hash_table_lookup(piece->roi_fit_memo, &fit->key);
+  if(!found
+     || memcmp((const uint8_t *)found + ROI_FIT_KEY_BEGIN, (const uint8_t *)fit + ROI_FIT_KEY_BEGIN,
+               ROI_FIT_KEY_END - ROI_FIT_KEY_BEGIN))
+    return FALSE;
+  *oroi = found->oroi;
+  return TRUE;
+}
+
+static void _roi_fit_remember(struct dt_dev_pixelpipe_iop_t *piece, const _roi_fit_t *fit,
+                              const dt_iop_roi_t *oroi)
+{
+  if(!piece->roi_fit_memo)
+    piece->roi_fit_memo = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL, g_free);
+  else if(g_hash_table_size(piece->roi_fit_memo) >= ROI_FIT_MEMO_SIZE)
+    g_hash_table_remove_all(piece->roi_fit_memo);
+
+  _roi_fit_t *entry = (_roi_fit_t *)g_malloc(sizeof(_roi_fit_t));
+  *entry = *fit;
+  entry->oroi = *oroi;
+  // the key lives inside the value, so the old key has to go together with the old value
+  g_hash_table_replace(piece->roi_fit_memo, &entry->key, entry);
+}
+
+static inline gboolean _roi_fits(const dt_iop_roi_t *probe, const dt_iop_roi_t *iroi, const int delta)
+{
+  return abs(probe->x - iroi->x) <= delta && abs(probe->y - iroi->y) <= delta
+         && abs(probe->width - iroi->width) <= delta && abs(probe->height - iroi->height) <= delta;
+}
+
 /* find a matching oroi_full by probing start value of oroi and get corresponding input roi into iroi_probe.
-   We search in two steps. first by a simplicistic iterative search which will succeed in most cases.
+   modules which can invert modify_roi_in() are asked first, results are remembered per piece. otherwise
+   we search in two steps. first by a simplicistic iterative search which will succeed in most cases.
    If this does not converge, we do a downhill simplex (nelder-mead) fitting */
 static int _fit_output_to_input_roi(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                                     const dt_iop_roi_t *iroi, dt_iop_roi_t *oroi, int delta, int iter)
@@ -545,6 +638,24 @@ static int _fit_output_to_input_roi(struct dt_iop_module_t *self, struct dt_dev_
   dt_iop_roi_t iroi_probe = *iroi;
   dt_iop_roi_t save_oroi = *oroi;
 
+  if(self->invert_roi_in)
+  {
+    dt_iop_roi_t oroi_exact = *oroi;
+    if(!self->invert_roi_in(self, piece, iroi, &oroi_exact))
+    {
+      self->modify_roi_in(self, piece, &oroi_exact, &iroi_probe);
+      if(_roi_fits(&iroi_probe, iroi, delta))
+      {
+        *oroi = oroi_exact;
+        return TRUE;
+      }
+    }
+  }
+
+  _roi_fit_t fit;
+  _roi_fit_key(&fit, piece, iroi, oroi, delta);
+  if(_roi_fit_lookup(piece, &fit, oroi)) return TRUE;
+
   // try to go the easy way. this works in many cases where output is
   // just like input, only scaled down
   self->modify_roi_in(self, piece, oroi, &iroi_probe);
@@ -566,7 +677,11 @@ static int _fit_output_to_input_roi(struct dt_iop_module_t *self, struct dt_dev_
     iter--;
   }
 
-  if(iter > 0) return TRUE;
+  if(iter > 0)
+  {
+    _roi_fit_remember(piece, &fit, oroi);
+    return TRUE;
+  }
 
   *oroi = save_oroi;
 
@@ -574,30 +689,147 @@ static int _fit_output_to_input_roi(struct dt_iop_module_t *self, struct dt_dev_
   // try simplex downhill fitting now.
   // it's crucial that we have a good starting point in oroi, else this
   // will not converge as well.
-  int fit = _nm_fit_output_to_input_roi(self, piece, iroi, oroi, delta);
-  return fit;
+  if(!_nm_fit_output_to_input_roi(self, piece, iroi, oroi, delta)) return FALSE;
+  _roi_fit_remember(piece, &fit, oroi);
+  return TRUE;
 }
 
 
-/* simple tiling algorithm for roi_in == roi_out, i.e. for pixel to pixel modules/operations */
+/* can several tiles of this module be processed at once? */
+// the memory a tiled module may use in bytes: host_memory_limit, capped by the budget of the memory governor.
+// tiling needs at least 500 MB to work with.
+static float _tiling_host_memory(void)
+{
+  _conf_init();
+  const size_t limit
+      = dt_memory_governor_limit("tiling", (size_t)MAX(dt_conf_value_int(_conf.host_memory_limit), 0) << 20);
+  return fmaxf(limit, 500.0f * 1024.0f * 1024.0f);
+}
+
+static gboolean _parallel_tiling(struct dt_iop_module_t *self)
+{
+#ifdef _OPENMP
+  _conf_init();
+  return (self->flags() & IOP_FLAGS_PARALLEL_TILING) && dt_get_num_threads() > 1
+         && dt_conf_value_bool(_conf.tiling_parallel);
+#else
+  return FALSE;
+#endif
+}
+
+/* number of tiles of the given size to process at once, as many as there are cores and host memory allows */
+static int _parallel_tiles(struct dt_iop_module_t *self, const int tiles, const int width, const int height,
+                           const int max_bpp, const dt_develop_tiling_t *tiling, const size_t fullbuffers)
+{
+  if(!_parallel_tiling(self)) return 1;
+  int count = _min(dt_get_num_threads(), tiles);
+  while(count > 1
+        && !dt_tiling_piece_fits_host_memory(width, (size_t)height * count, max_bpp, tiling->factor,
+                                             count * tiling->overhead + fullbuffers))
+    count--;
+  return count;
+}
+
+static void _free_tile_buffers(struct dt_dev_pixelpipe_iop_t *piece, void **input, void **output, const int count)
+{
+  for(int k = 0; k < count; k++)
+  {
+    if(input) dt_dev_pixelpipe_free_align(piece->pipe, input[k]);
+    if(output) dt_dev_pixelpipe_free_align(piece->pipe, output[k]);
+  }
+  free(input);
+  free(output);
+}
+
+/* processes tile (tx, ty) of _default_process_tiling_ptp() in the given tile buffers */
+static void _process_tile_ptp(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                              const void *const ivoid, void *const ovoid, const dt_iop_roi_t *const roi_in,
+                              const dt_iop_roi_t *const roi_out, const int in_bpp, const int out_bpp,
+                              const int width, const int height, const int tile_wd, const int tile_ht,
+                              const int overlap, const size_t tx, const size_t ty, void *input, void *output)
+{
+  const int ipitch = roi_in->width * in_bpp;
+  const int opitch = roi_out->width * out_bpp;
+  const size_t wd = tx * tile_wd + width > roi_in->width ? roi_in->width - tx * tile_wd : width;
+  const size_t ht = ty * tile_ht + height > roi_in->height ? roi_in->height - ty * tile_ht : height;
+
+  /* origin and region of effective part of tile, which we want to store later */
+  size_t origin[] = { 0, 0, 0 };
+  size_t region[] = { wd, ht, 1 };
+
+  /* roi_in and roi_out for process_cl on subbuffer */
+  dt_iop_roi_t iroi = { roi_in->x + tx * tile_wd, roi_in->y + ty * tile_ht, wd, ht, roi_in->scale };
+  dt_iop_roi_t oroi = { roi_out->x + tx * tile_wd, roi_out->y + ty * tile_ht, wd, ht, roi_out->scale };
+
+  /* offsets of tile into ivoid and ovoid */
+  size_t ioffs = (ty * tile_ht) * ipitch + (tx * tile_wd) * in_bpp;
+  size_t ooffs = (ty * tile_ht) * opitch + (tx * tile_wd) * out_bpp;
+
+
+  dt_print(DT_DEBUG_DEV, "[default_process_tiling_ptp] tile (%zu, %zu) with %zu x %zu at origin [%zu, %zu]\n",
+           tx, ty, wd, ht, tx * tile_wd, ty * tile_ht);
+
+/* prepare input tile buffer */
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(ht, in_bpp, ipitch, ivoid, wd) \
+  shared(input, ioffs) \
+  schedule(static)
+#endif
+  for(size_t j = 0; j < ht; j++)
+    memcpy((char *)input + j * wd * in_bpp, (char *)ivoid + ioffs + j * ipitch, (size_t)wd * in_bpp);
+
+  /* call process() of module */
+  self->process(self, piece, input, output, &iroi, &oroi);
+
+  /* correct origin and region of tile for overlap.
+     make sure that we only copy back the "good" part. */
+  if(tx > 0)
+  {
+    origin[0] += overlap;
+    region[0] -= overlap;
+    ooffs += overlap * out_bpp;
+  }
+  if(ty > 0)
+  {
+    origin[1] += overlap;
+    region[1] -= overlap;
+    ooffs += overlap * opitch;
+  }
+
+/* copy "good" part of tile to output buffer */
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(opitch, out_bpp, ovoid, wd) \
+  shared(ooffs, output, origin, region) \
+  schedule(static)
+#endif
+  for(size_t j = 0; j < region[1]; j++)
+    memcpy((char *)ovoid + ooffs + j * opitch,
+           (char *)output + ((j + origin[1]) * wd + origin[0]) * out_bpp, (size_t)region[0] * out_bpp);
+}
+
+/* simple tiling algorithm for roi_in == roi_out, i.e. for pixel to pixel modules/operations.
+   modules flagged with IOP_FLAGS_PARALLEL_TILING get smaller tiles which are processed several at once */
 static void _default_process_tiling_ptp(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                                         const void *const ivoid, void *const ovoid,
                                         const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out,
                                         const int in_bpp)
 {
-  void *input = NULL;
-  void *output = NULL;
+  _conf_init();
+  void **input = NULL;
+  void **output = NULL;
+  int buffers = 0;
   dt_iop_buffer_dsc_t dsc;
   self->output_format(self, piece->pipe, piece, &dsc);
   const int out_bpp = dt_iop_buffer_dsc_to_bpp(&dsc);
 
-  const int ipitch = roi_in->width * in_bpp;
-  const int opitch = roi_out->width * out_bpp;
   const int max_bpp = _max(in_bpp, out_bpp);
 
   /* get tiling requirements of module */
   dt_develop_tiling_t tiling = { 0 };
   self->tiling_callback(self, piece, roi_in, roi_out, &tiling);
+  dt_tiling_calibration_apply(self, FALSE, &tiling);
 
   /* tiling really does not make sense in these cases. standard process() is not better or worse than we are
    */
@@ -610,7 +842,7 @@ static void _default_process_tiling_ptp(struct dt_iop_module_t *self, struct dt_
   }
 
   /* calculate optimal size of tiles */
-  float available = dt_conf_get_float("host_memory_limit") * 1024.0f * 1024.0f;
+  float available = _tiling_host_memory();
   assert(available >= 500.0f * 1024.0f * 1024.0f);
   /* correct for size of ivoid and ovoid which are needed on top of tiling */
   available = fmax(available - ((float)roi_out->width * roi_out->height * out_bpp)
@@ -620,12 +852,20 @@ static void _default_process_tiling_ptp(struct dt_iop_module_t *self, struct dt_
   /* we ignore the above value if singlebuffer_limit (is defined and) is higher than available/tiling.factor.
      this will mainly allow tiling for modules with high and "unpredictable" memory demand which is
      reflected in high values of tiling.factor (take bilateral noise reduction as an example). */
-  float singlebuffer = dt_conf_get_float("singlebuffer_limit") * 1024.0f * 1024.0f;
+  float singlebuffer = dt_conf_value_float(_conf.singlebuffer_limit) * 1024.0f * 1024.0f;
   singlebuffer = fmax(singlebuffer, 2.0f * 1024.0f * 1024.0f);
   float factor = fmax(tiling.factor, 1.0f);
   float maxbuf = fmax(tiling.maxbuf, 1.0f);
   singlebuffer = fmax(available / factor, singlebuffer);
 
+  /* share the budget between the tiles processed at once, as long as the tiles stay large compared to
+     their overlap. the memory check below decides how many of them really go in parallel. */
+  if(_parallel_tiling(self))
+  {
+    const float min_tile = _max(8 * tiling.overlap, 256);
+    singlebuffer = fmax(singlebuffer / dt_get_num_threads(), min_tile * min_tile * max_bpp * maxbuf);
+  }
+
   int width = roi_in->width;
   int height = roi_in->height;
 
@@ -684,7 +924,7 @@ static void _default_process_tiling_ptp(struct dt_iop_module_t *self, struct dt_
   const int tiles_y = height < roi_in->height ? ceilf(roi_in->height / (float)tile_ht) : 1;
 
   /* sanity check: don't run wild on too many tiles */
-  if(tiles_x * tiles_y > dt_conf_get_int("maximum_number_tiles"))
+  if(tiles_x * tiles_y > dt_conf_value_int(_conf.maximum_number_tiles))
   {
     dt_print(DT_DEBUG_DEV,
              "[default_process_tiling_ptp] gave up tiling for module '%s'. too many tiles: %d x %d\n",
@@ -700,20 +940,34 @@ static void _default_process_tiling_ptp(struct dt_iop_module_t *self, struct dt_
            "[default_process_tiling_ptp] (%d x %d) tiles with max dimensions %d x %d and overlap %d\n",
            tiles_x, tiles_y, width, height, overlap);
 
-  /* reserve input and output buffers for tiles */
-  input = dt_alloc_align(64, (size_t)width * height * in_bpp);
-  if(input == NULL)
+  /* full input and output buffers are needed on top of the tiles */
+  const size_t fullbuffers = (size_t)roi_in->width * roi_in->height * in_bpp
+                             + (size_t)roi_out->width * roi_out->height * out_bpp;
+  const int parallel = _parallel_tiles(self, tiles_x * tiles_y, width, height, max_bpp, &tiling, fullbuffers);
+  if(parallel > 1)
+    dt_print(DT_DEBUG_DEV, "[default_process_tiling_ptp] processing %d tiles at once\n", parallel);
+
+  /* reserve input and output buffers for tiles, one pair for each tile processed at once */
+  input = (void **)calloc(parallel, sizeof(void *));
+  output = (void **)calloc(parallel, sizeof(void *));
+  if(input == NULL || output == NULL) goto error;
+  for(; buffers < parallel; buffers++)
   {
-    dt_print(DT_DEBUG_DEV, "[default_process_tiling_ptp] could not alloc input buffer for module '%s'\n",
-             self->op);
-    goto error;
-  }
-  output = dt_alloc_align(64, (size_t)width * height * out_bpp);
-  if(output == NULL)
-  {
-    dt_print(DT_DEBUG_DEV, "[default_process_tiling_ptp] could not alloc output buffer for module '%s'\n",
-             self->op);
-    goto error;
+    input[buffers] = dt_dev_pixelpipe_alloc_align(piece->pipe, (size_t)width * height * in_bpp);
+    if(input[buffers] == NULL)
+    {
+      dt_print(DT_DEBUG_DEV, "[default_process_tiling_ptp] could not alloc input buffer for module '%s'\n",
+               self->op);
+      goto error;
+    }
+    output[buffers] = dt_dev_pixelpipe_alloc_align(piece->pipe, (size_t)width * height * out_bpp);
+    if(output[buffers] == NULL)
+    {
+      dt_print(DT_DEBUG_DEV, "[default_process_tiling_ptp] could not alloc output buffer for module '%s'\n",
+               self->op);
+      buffers++;
+      goto error;
+    }
   }
 
   /* store processed_maximum to be re-used and aggregated */
@@ -721,98 +975,74 @@ static void _default_process_tiling_ptp(struct dt_iop_module_t *self, struct dt_
   float processed_maximum_new[4] = { 1.0f };
   for(int k = 0; k < 4; k++) processed_maximum_saved[k] = piece->pipe->dsc.processed_maximum[k];
 
+  piece->pipe->tiling = 1;
 
-  /* iterate over tiles */
-  for(size_t tx = 0; tx < tiles_x; tx++)
+  if(parallel > 1)
   {
-    const size_t wd = tx * tile_wd + width > roi_in->width ? roi_in->width - tx * tile_wd : width;
-    for(size_t ty = 0; ty < tiles_y; ty++)
+    /* modules flagged for parallel tiling don't change processed_maximum. the nested parallel loops in
+       process() run single threaded, so every tile gets one core. */
+    const int tiles = tiles_x * tiles_y;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) num_threads(parallel) \
+    dt_omp_firstprivate(self, piece, ivoid, ovoid, roi_in, roi_out, in_bpp, out_bpp, width, height, tile_wd, \
+                        tile_ht, overlap, tiles, tiles_y, input, output) \
+    schedule(dynamic)
+#endif
+    for(int t = 0; t < tiles; t++)
     {
-      piece->pipe->tiling = 1;
-
+      const size_t tx = t / tiles_y;
+      const size_t ty = t % tiles_y;
+      const size_t wd = tx * tile_wd + width > roi_in->width ? roi_in->width - tx * tile_wd : width;
       const size_t ht = ty * tile_ht + height > roi_in->height ? roi_in->height - ty * tile_ht : height;
 
       /* no need to process end-tiles that are smaller than the total overlap area */
       if((wd <= 2 * overlap && tx > 0) || (ht <= 2 * overlap && ty > 0)) continue;
 
-      /* origin and region of effective part of tile, which we want to store later */
-      size_t origin[] = { 0, 0, 0 };
-      size_t region[] = { wd, ht, 1 };
-
-      /* roi_in and roi_out for process_cl on subbuffer */
-      dt_iop_roi_t iroi = { roi_in->x + tx * tile_wd, roi_in->y + ty * tile_ht, wd, ht, roi_in->scale };
-      dt_iop_roi_t oroi = { roi_out->x + tx * tile_wd, roi_out->y + ty * tile_ht, wd, ht, roi_out->scale };
-
-      /* offsets of tile into ivoid and ovoid */
-      size_t ioffs = (ty * tile_ht) * ipitch + (tx * tile_wd) * in_bpp;
-      size_t ooffs = (ty * tile_ht) * opitch + (tx * tile_wd) * out_bpp;
-
-
-      dt_print(DT_DEBUG_DEV, "[default_process_tiling_ptp] tile (%zu, %zu) with %zu x %zu at origin [%zu, %zu]\n",
-               tx, ty, wd, ht, tx * tile_wd, ty * tile_ht);
-
-/* prepare input tile buffer */
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-      dt_omp_firstprivate(ht, in_bpp, ipitch, ivoid, wd) \
-      shared(input, width, ioffs) \
-      schedule(static)
-#endif
-      for(size_t j = 0; j < ht; j++)
-        memcpy((char *)input + j * wd * in_bpp, (char *)ivoid + ioffs + j * ipitch, (size_t)wd * in_bpp);
+      const int thread = dt_get_thread_num();
+      _process_tile_ptp(self, piece, ivoid, ovoid, roi_in, roi_out, in_bpp, out_bpp, width, height, tile_wd,
+                        tile_ht, overlap, tx, ty, input[thread], output[thread]);
+    }
+    for(int k = 0; k < 4; k++) processed_maximum_new[k] = piece->pipe->dsc.processed_maximum[k];
+  }
+  else
+  {
+    /* iterate over tiles */
+    for(size_t tx = 0; tx < tiles_x; tx++)
+    {
+      const size_t wd = tx * tile_wd + width > roi_in->width ? roi_in->width - tx * tile_wd : width;
+      for(size_t ty = 0; ty < tiles_y; ty++)
+      {
+        const size_t ht = ty * tile_ht + height > roi_in->height ? roi_in->height - ty * tile_ht : height;
 
-      /* take original processed_maximum as starting point */
-      for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = processed_maximum_saved[k];
+        /* no need to process end-tiles that are smaller than the total overlap area */
+        if((wd <= 2 * overlap && tx > 0) || (ht <= 2 * overlap && ty > 0)) continue;
 
-      /* call process() of module */
-      self->process(self, piece, input, output, &iroi, &oroi);
+        /* take original processed_maximum as starting point */
+        for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = processed_maximum_saved[k];
 
-      /* aggregate resulting processed_maximum */
-      /* TODO: check if there really can be differences between tiles and take
-               appropriate action (calculate minimum, maximum, average, ...?) */
-      for(int k = 0; k < 4; k++)
-      {
-        if(tx + ty > 0 && fabs(processed_maximum_new[k] - piece->pipe->dsc.processed_maximum[k]) > 1.0e-6f)
-          dt_print(
-              DT_DEBUG_DEV,
-              "[default_process_tiling_ptp] processed_maximum[%d] differs between tiles in module '%s'\n", k,
-              self->op);
-        processed_maximum_new[k] = piece->pipe->dsc.processed_maximum[k];
-      }
+        _process_tile_ptp(self, piece, ivoid, ovoid, roi_in, roi_out, in_bpp, out_bpp, width, height, tile_wd,
+                          tile_ht, overlap, tx, ty, input[0], output[0]);
 
-      /* correct origin and region of tile for overlap.
-         make sure that we only copy back the "good" part. */
-      if(tx > 0)
-      {
-        origin[0] += overlap;
-        region[0] -= overlap;
-        ooffs += overlap * out_bpp;
-      }
-      if(ty > 0)
-      {
-        origin[1] += overlap;
-        region[1] -= overlap;
-        ooffs += overlap * opitch;
+        /* aggregate resulting processed_maximum */
+        /* TODO: check if there really can be differences between tiles and take
+                 appropriate action (calculate minimum, maximum, average, ...?) */
+        for(int k = 0; k < 4; k++)
+        {
+          if(tx + ty > 0 && fabs(processed_maximum_new[k] - piece->pipe->dsc.processed_maximum[k]) > 1.0e-6f)
+            dt_print(
+                DT_DEBUG_DEV,
+                "[default_process_tiling_ptp] processed_maximum[%d] differs between tiles in module '%s'\n", k,
+                self->op);
+          processed_maximum_new[k] = piece->pipe->dsc.processed_maximum[k];
+        }
       }
-
-/* copy "good" part of tile to output buffer */
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-      dt_omp_firstprivate(opitch, out_bpp, ovoid, wd) \
-      shared(ooffs, output, width, origin, region) \
-      schedule(static)
-#endif
-      for(size_t j = 0; j < region[1]; j++)
-        memcpy((char *)ovoid + ooffs + j * opitch,
-               (char *)output + ((j + origin[1]) * wd + origin[0]) * out_bpp, (size_t)region[0] * out_bpp);
     }
   }
 
   /* copy back final processed_maximum */
   for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = processed_maximum_new[k];
 
-  if(input != NULL) dt_free_align(input);
-  if(output != NULL) dt_free_align(output);
+  _free_tile_buffers(piece, input, output, buffers);
   piece->pipe->tiling = 0;
   return;
 
@@ -821,8 +1051,7 @@ error:
 // fall through
 
 fallback:
-  if(input != NULL) dt_free_align(input);
-  if(output != NULL) dt_free_align(output);
+  _free_tile_buffers(piece, input, output, buffers);
   piece->pipe->tiling = 0;
   dt_print(DT_DEBUG_DEV, "[default_process_tiling_ptp] fall back to standard processing for module '%s'\n",
            self->op);
@@ -839,6 +1068,7 @@ static void _default_process_tiling_roi(struct dt_iop_module_t *self, struct dt_
                                         const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out,
                                         const int in_bpp)
 {
+  _conf_init();
   void *input = NULL;
   void *output = NULL;
 
@@ -865,6 +1095,7 @@ static void _default_process_tiling_roi(struct dt_iop_module_t *self, struct dt_
   /* get tiling requirements of module */
   dt_develop_tiling_t tiling = { 0 };
   self->tiling_callback(self, piece, roi_in, roi_out, &tiling);
+  dt_tiling_calibration_apply(self, FALSE, &tiling);
 
   /* tiling really does not make sense in these cases. standard process() is not better or worse than we are
    */
@@ -877,7 +1108,7 @@ static void _default_process_tiling_roi(struct dt_iop_module_t *self, struct dt_
   }
 
   /* calculate optimal size of tiles */
-  float available = dt_conf_get_float("host_memory_limit") * 1024.0f * 1024.0f;
+  float available = _tiling_host_memory();
   assert(available >= 500.0f * 1024.0f * 1024.0f);
   /* correct for size of ivoid and ovoid which are needed on top of tiling */
   available = fmax(available - ((float)roi_out->width * roi_out->height * out_bpp)
@@ -887,7 +1118,7 @@ static void _default_process_tiling_roi(struct dt_iop_module_t *self, struct dt_
   /* we ignore the above value if singlebuffer_limit (is defined and) is higher than available/tiling.factor.
      this will mainly allow tiling for modules with high and "unpredictable" memory demand which is
      reflected in high values of tiling.factor (take bilateral noise reduction as an example). */
-  float singlebuffer = dt_conf_get_float("singlebuffer_limit") * 1024.0f * 1024.0f;
+  float singlebuffer = dt_conf_value_float(_conf.singlebuffer_limit) * 1024.0f * 1024.0f;
   singlebuffer = fmax(singlebuffer, 2.0f * 1024.0f * 1024.0f);
   float factor = fmax(tiling.factor, 1.0f);
   float maxbuf = fmax(tiling.maxbuf, 1.0f);
@@ -960,7 +1191,7 @@ static void _default_process_tiling_roi(struct dt_iop_module_t *self, struct dt_
                   : 1;
 
   /* sanity check: don't run wild on too many tiles */
-  if(tiles_x * tiles_y > dt_conf_get_int("maximum_number_tiles"))
+  if(tiles_x * tiles_y > dt_conf_value_int(_conf.maximum_number_tiles))
   {
     dt_print(DT_DEBUG_DEV,
              "[default_process_tiling_roi] gave up tiling for module '%s'. too many tiles: %d x %d\n",
@@ -1086,14 +1317,14 @@ static void _default_process_tiling_roi(struct dt_iop_module_t *self, struct dt_
 
 
       /* prepare input tile buffer */
-      input = dt_alloc_align(64, (size_t)iroi_full.width * iroi_full.height * in_bpp);
+      input = dt_dev_pixelpipe_alloc_align(piece->pipe, (size_t)iroi_full.width * iroi_full.height * in_bpp);
       if(input == NULL)
       {
         dt_print(DT_DEBUG_DEV, "[default_process_tiling_roi] could not alloc input buffer for module '%s'\n",
                  self->op);
         goto error;
       }
-      output = dt_alloc_align(64, (size_t)oroi_full.width * oroi_full.height * out_bpp);
+      output = dt_dev_pixelpipe_alloc_align(piece->pipe, (size_t)oroi_full.width * oroi_full.height * out_bpp);
       if(output == NULL)
       {
         dt_print(DT_DEBUG_DEV, "[default_process_tiling_roi] could not alloc output buffer for module '%s'\n",
@@ -1144,16 +1375,16 @@ static void _default_process_tiling_roi(struct dt_iop_module_t *self, struct dt_
                (char *)output + ((j + origin_y) * oroi_full.width + origin_x) * out_bpp,
                (size_t)oroi_good.width * out_bpp);
 
-      dt_free_align(input);
-      dt_free_align(output);
+      dt_dev_pixelpipe_free_align(piece->pipe, input);
+      dt_dev_pixelpipe_free_align(piece->pipe, output);
       input = output = NULL;
     }
 
   /* copy back final processed_maximum */
   for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = processed_maximum_new[k];
 
-  if(input != NULL) dt_free_align(input);
-  if(output != NULL) dt_free_align(output);
+  dt_dev_pixelpipe_free_align(piece->pipe, input);
+  dt_dev_pixelpipe_free_align(piece->pipe, output);
   piece->pipe->tiling = 0;
   return;
 
@@ -1162,8 +1393,8 @@ error:
 // fall through
 
 fallback:
-  if(input != NULL) dt_free_align(input);
-  if(output != NULL) dt_free_align(output);
+  dt_dev_pixelpipe_free_align(piece->pipe, input);
+  dt_dev_pixelpipe_free_align(piece->pipe, output);
   piece->pipe->tiling = 0;
   dt_print(DT_DEBUG_DEV, "[default_process_tiling_roi] fall back to standard processing for module '%s'\n",
            self->op);
@@ -1192,12 +1423,161 @@ void default_process_tiling(struct dt_iop_module_t *self, struct dt_dev_pixelpip
 
 
 #ifdef HAVE_OPENCL
+/* tile loop of _default_process_tiling_cl_ptp() for asynchronous pipes. the transfer queue uploads the next
+   tile and downloads the previous one while the kernels of the current tile run on the command queue. at
+   most two tiles have device buffers at any time. */
+static int _process_tiles_cl_ptp_overlapped(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                                            const void *const ivoid, void *const ovoid,
+                                            const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out,
+                                            const int in_bpp, const int out_bpp, const int width,
+                                            const int height, const int tile_wd, const int tile_ht,
+                                            const int overlap, const int tiles_x, const int tiles_y,
+                                            const float *processed_maximum_saved, float *processed_maximum_new)
+{
+  const int devid = piece->pipe->devid;
+  const int ipitch = roi_in->width * in_bpp;
+  const int opitch = roi_out->width * out_bpp;
+  cl_int err = CL_SUCCESS;
+  int success = FALSE;
+
+  /* the tiles worth processing, so we know which one comes next */
+  size_t *tiles = (size_t *)malloc(sizeof(size_t) * 2 * tiles_x * tiles_y);
+  if(!tiles) return FALSE;
+  int count = 0;
+  for(size_t tx = 0; tx < tiles_x; tx++)
+    for(size_t ty = 0; ty < tiles_y; ty++)
+    {
+      const size_t wd = tx * tile_wd + width > roi_in->width ? roi_in->width - tx * tile_wd : width;
+      const size_t ht = ty * tile_ht + height > roi_in->height ? roi_in->height - ty * tile_ht : height;
+      if((wd <= 2 * overlap && tx > 0) || (ht <= 2 * overlap && ty > 0)) continue;
+      tiles[2 * count] = tx;
+      tiles[2 * count + 1] = ty;
+      count++;
+    }
+
+  cl_mem input[2] = { NULL, NULL }, output[2] = { NULL, NULL };
+  cl_event uploaded[2] = { NULL, NULL }, processed = NULL, downloaded[2] = { NULL, NULL };
+
+  for(int i = 0; i <= count; i++)
+  {
+    const int cur = i & 1, nxt = cur ^ 1;
+
+    /* upload tile i into fresh buffers. released buffers of earlier tiles stay alive until the device is done
+       with them, the download of tile i - 2 was enqueued before and has to finish first to stay in budget */
+    if(i < count)
+    {
+      const size_t tx = tiles[2 * i], ty = tiles[2 * i + 1];
+      const size_t wd = tx * tile_wd + width > roi_in->width ? roi_in->width - tx * tile_wd : width;
+      const size_t ht = ty * tile_ht + height > roi_in->height ? roi_in->height - ty * tile_ht : height;
+      const size_t origin[] = { 0, 0, 0 };
+      const size_t region[] = { wd, ht, 1 };
+      const size_t ioffs = (ty * tile_ht) * ipitch + (tx * tile_wd) * in_bpp;
+
+      if(downloaded[cur])
+      {
+        (darktable.opencl->dlocl->symbols->dt_clWaitForEvents)(1, &downloaded[cur]);
+        dt_opencl_release_event(&downloaded[cur]);
+      }
+
+      dt_print(DT_DEBUG_OPENCL,
+               "[default_process_tiling_cl_ptp] tile (%zu, %zu) with %zu x %zu at origin [%zu, %zu]\n", tx, ty, wd,
+               ht, tx * tile_wd, ty * tile_ht);
+
+      input[cur] = dt_opencl_alloc_device(devid, wd, ht, in_bpp);
+      if(input[cur] == NULL) goto error;
+      output[cur] = dt_opencl_alloc_device(devid, wd, ht, out_bpp);
+      if(output[cur] == NULL) goto error;
+      err = dt_opencl_write_host_to_device_overlapped(devid, (char *)ivoid + ioffs, input[cur], origin, region,
+                                                      ipitch, NULL, &uploaded[cur]);
+      if(err != CL_SUCCESS) goto error;
+    }
+
+    /* process tile i - 1, then download its good part once the kernels are done */
+    if(i > 0)
+    {
+      const size_t tx = tiles[2 * (i - 1)], ty = tiles[2 * (i - 1) + 1];
+      const size_t wd = tx * tile_wd + width > roi_in->width ? roi_in->width - tx * tile_wd : width;
+      const size_t ht = ty * tile_ht + height > roi_in->height ? roi_in->height - ty * tile_ht : height;
+      size_t origin[] = { 0, 0, 0 };
+      size_t region[] = { wd, ht, 1 };
+      size_t ooffs = (ty * tile_ht) * opitch + (tx * tile_wd) * out_bpp;
+      dt_iop_roi_t iroi = { roi_in->x + tx * tile_wd, roi_in->y + ty * tile_ht, wd, ht, roi_in->scale };
+      dt_iop_roi_t oroi = { roi_out->x + tx * tile_wd, roi_out->y + ty * tile_ht, wd, ht, roi_out->scale };
+
+      err = dt_opencl_enqueue_wait_for_event(devid, &uploaded[nxt]);
+      if(err != CL_SUCCESS) goto error;
+
+      for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = processed_maximum_saved[k];
+      if(!self->process_cl(self, piece, input[nxt], output[nxt], &iroi, &oroi)) goto error;
+      for(int k = 0; k < 4; k++)
+      {
+        if(i > 1 && fabs(processed_maximum_new[k] - piece->pipe->dsc.processed_maximum[k]) > 1.0e-6f)
+          dt_print(
+              DT_DEBUG_OPENCL,
+              "[default_process_tiling_cl_ptp] processed_maximum[%d] differs between tiles in module '%s'\n",
+              k, self->op);
+        processed_maximum_new[k] = piece->pipe->dsc.processed_maximum[k];
+      }
+
+      err = dt_opencl_enqueue_marker(devid, &processed);
+      if(err != CL_SUCCESS) goto error;
+
+      if(tx > 0)
+      {
+        origin[0] += overlap;
+        region[0] -= overlap;
+        ooffs += overlap * out_bpp;
+      }
+      if(ty > 0)
+      {
+        origin[1] += overlap;
+        region[1] -= overlap;
+        ooffs += overlap * opitch;
+      }
+      err = dt_opencl_read_host_from_device_overlapped(devid, (char *)ovoid + ooffs, output[nxt], origin, region,
+                                                       opitch, &processed, &downloaded[nxt]);
+      if(err != CL_SUCCESS) goto error;
+
+      dt_opencl_release_event(&uploaded[nxt]);
+      dt_opencl_release_event(&processed);
+      dt_opencl_release_mem_object(input[nxt]);
+      dt_opencl_release_mem_object(output[nxt]);
+      input[nxt] = output[nxt] = NULL;
+    }
+  }
+
+  err = dt_opencl_finish_transfers(devid);
+  success = err == CL_SUCCESS;
+
+error:
+  if(!success)
+  {
+    /* nothing may still be in flight when the buffers go away */
+    dt_opencl_finish_transfers(devid);
+    dt_opencl_finish(devid);
+  }
+  for(int k = 0; k < 2; k++)
+  {
+    dt_opencl_release_event(&uploaded[k]);
+    dt_opencl_release_event(&downloaded[k]);
+    dt_opencl_release_mem_object(input[k]);
+    dt_opencl_release_mem_object(output[k]);
+  }
+  dt_opencl_release_event(&processed);
+  free(tiles);
+  if(!success)
+    dt_print(DT_DEBUG_OPENCL, "[default_process_tiling_cl_ptp] overlapped transfers failed for module '%s': %d\n",
+             self->op, err);
+  return success;
+}
+
 /* simple tiling algorithm for roi_in == roi_out, i.e. for pixel to pixel modules/operations */
 static int _default_process_tiling_cl_ptp(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                                           const void *const ivoid, void *const ovoid,
                                           const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out,
                                           const int in_bpp)
 {
+  _conf_init();
   cl_int err = -999;
   cl_mem input = NULL;
   cl_mem output = NULL;
@@ -1211,6 +1591,7 @@ static int _default_process_tiling_cl_ptp(struct dt_iop_module_t *self, struct d
   const int out_bpp = dt_iop_buffer_dsc_to_bpp(&dsc);
 
   const int devid = piece->pipe->devid;
+  const int blocking = dt_opencl_pipe_is_synchronous(piece->pipe->type);
   const int ipitch = roi_in->width * in_bpp;
   const int opitch = roi_out->width * out_bpp;
   const int max_bpp = _max(in_bpp, out_bpp);
@@ -1218,9 +1599,10 @@ static int _default_process_tiling_cl_ptp(struct dt_iop_module_t *self, struct d
   /* get tiling requirements of module */
   dt_develop_tiling_t tiling = { 0 };
   self->tiling_callback(self, piece, roi_in, roi_out, &tiling);
+  dt_tiling_calibration_apply(self, TRUE, &tiling);
 
   /* shall we use pinned memory transfers? */
-  int use_pinned_memory = dt_conf_get_bool("opencl_use_pinned_memory");
+  int use_pinned_memory = dt_conf_value_bool(_conf.use_pinned_memory);
   const int pinned_buffer_overhead = use_pinned_memory ? 2 : 0; // add two additional pinned memory buffers
                                                                 // which seemingly get allocated not only on
                                                                 // host but also on device (why???)
@@ -1229,11 +1611,15 @@ static int _default_process_tiling_cl_ptp(struct dt_iop_module_t *self, struct d
             ? 0.85f
             : 1.0f; // avoid problems when pinned buffer size gets too close to max_mem_alloc size
 
+  /* asynchronous pipes overlap transfers and kernels, which needs device buffers for a second tile */
+  const int overlapped = !blocking && !use_pinned_memory && dt_opencl_has_transfer_queue(devid);
+  const int overlapped_buffer_overhead = overlapped ? 2 : 0;
+
   /* calculate optimal size of tiles */
-  float headroom = dt_conf_get_float("opencl_memory_headroom") * 1024.0f * 1024.0f;
+  float headroom = dt_conf_value_float(_conf.memory_headroom) * 1024.0f * 1024.0f;
   headroom = fmin(fmax(headroom, 0.0f), (float)darktable.opencl->dev[devid].max_global_mem);
   const float available = darktable.opencl->dev[devid].max_global_mem - headroom;
-  float factor = fmax(tiling.factor + pinned_buffer_overhead, 1.0f);
+  float factor = fmax(tiling.factor + pinned_buffer_overhead + overlapped_buffer_overhead, 1.0f);
   const float singlebuffer = fmin(fmax((available - tiling.overhead) / factor, 0.0f),
                                   pinned_buffer_slack * darktable.opencl->dev[devid].max_mem_alloc);
   float maxbuf = fmax(tiling.maxbuf, 1.0f);
@@ -1303,7 +1689,7 @@ static int _default_process_tiling_cl_ptp(struct dt_iop_module_t *self, struct d
   const int tiles_y = height < roi_in->height ? ceilf(roi_in->height / (float)tile_ht) : 1;
 
   /* sanity check: don't run wild on too many tiles */
-  if(tiles_x * tiles_y > dt_conf_get_int("maximum_number_tiles"))
+  if(tiles_x * tiles_y > dt_conf_value_int(_conf.maximum_number_tiles))
   {
     dt_print(DT_DEBUG_OPENCL,
              "[default_process_tiling_cl_ptp] aborted tiling for module '%s'. too many tiles: %d x %d\n",
@@ -1324,6 +1710,18 @@ static int _default_process_tiling_cl_ptp(struct dt_iop_module_t *self, struct d
   float processed_maximum_new[4] = { 1.0f };
   for(int k = 0; k < 4; k++) processed_maximum_saved[k] = piece->pipe->dsc.processed_maximum[k];
 
+  if(overlapped && tiles_x * tiles_y > 1)
+  {
+    piece->pipe->tiling = 1;
+    if(!_process_tiles_cl_ptp_overlapped(self, piece, ivoid, ovoid, roi_in, roi_out, in_bpp, out_bpp, width,
+                                         height, tile_wd, tile_ht, overlap, tiles_x, tiles_y,
+                                         processed_maximum_saved, processed_maximum_new))
+      goto error;
+    for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = processed_maximum_new[k];
+    piece->pipe->tiling = 0;
+    return TRUE;
+  }
+
   /* reserve pinned input and output memory for host<->device data transfer */
   if(use_pinned_memory)
   {
@@ -1436,9 +1834,10 @@ static int _default_process_tiling_cl_ptp(struct dt_iop_module_t *self, struct d
       }
       else
       {
-        /* blocking direct memory transfer: host input image -> opencl/device tile */
+        /* direct memory transfer: host input image -> opencl/device tile. the image stays valid until we are
+           done, so in an asynchronous pipe there is no need to wait for it */
         err = dt_opencl_write_host_to_device_raw(devid, (char *)ivoid + ioffs, input, origin, region, ipitch,
-                                                 CL_TRUE);
+                                                 blocking);
         if(err != CL_SUCCESS) goto error;
       }
 
@@ -1498,9 +1897,10 @@ static int _default_process_tiling_cl_ptp(struct dt_iop_module_t *self, struct d
       }
       else
       {
-        /* blocking direct memory transfer: good part of opencl/device tile -> host output image */
+        /* direct memory transfer: good part of opencl/device tile -> host output image. tiles don't overlap
+           in the output, so in an asynchronous pipe we only wait once after the last tile */
         err = dt_opencl_read_host_from_device_raw(devid, (char *)ovoid + ooffs, output, origin, region,
-                                                  opitch, CL_TRUE);
+                                                  opitch, blocking);
         if(err != CL_SUCCESS) goto error;
       }
 
@@ -1511,10 +1911,12 @@ static int _default_process_tiling_cl_ptp(struct dt_iop_module_t *self, struct d
       output = NULL;
 
       /* block until opencl queue has finished to free all used event handlers */
-      if(!darktable.opencl->async_pixelpipe || piece->pipe->type == DT_DEV_PIXELPIPE_EXPORT)
-        dt_opencl_finish(devid);
+      if(blocking) dt_opencl_finish(devid);
     }
 
+  /* wait for the outstanding transfers of an asynchronous pipe */
+  if(!blocking && !dt_opencl_finish(devid)) goto error;
+
   /* copy back final processed_maximum */
   for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = processed_maximum_new[k];
 
@@ -1552,6 +1954,7 @@ static int _default_process_tiling_cl_roi(struct dt_iop_module_t *self, struct d
                                           const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out,
                                           const int in_bpp)
 {
+  _conf_init();
   cl_int err = -999;
   cl_mem input = NULL;
   cl_mem output = NULL;
@@ -1569,6 +1972,7 @@ static int _default_process_tiling_cl_roi(struct dt_iop_module_t *self, struct d
   const int out_bpp = dt_iop_buffer_dsc_to_bpp(&dsc);
 
   const int devid = piece->pipe->devid;
+  const int blocking = dt_opencl_pipe_is_synchronous(piece->pipe->type);
   const int ipitch = roi_in->width * in_bpp;
   const int opitch = roi_out->width * out_bpp;
   const int max_bpp = _max(in_bpp, out_bpp);
@@ -1585,9 +1989,10 @@ static int _default_process_tiling_cl_roi(struct dt_iop_module_t *self, struct d
   /* get tiling requirements of module */
   dt_develop_tiling_t tiling = { 0 };
   self->tiling_callback(self, piece, roi_in, roi_out, &tiling);
+  dt_tiling_calibration_apply(self, TRUE, &tiling);
 
   /* shall we use pinned memory transfers? */
-  int use_pinned_memory = dt_conf_get_bool("opencl_use_pinned_memory");
+  int use_pinned_memory = dt_conf_value_bool(_conf.use_pinned_memory);
   const int pinned_buffer_overhead = use_pinned_memory ? 2 : 0; // add two additional pinned memory buffers
                                                                 // which seemingly get allocated not only on
                                                                 // host but also on device (why???)
@@ -1597,7 +2002,7 @@ static int _default_process_tiling_cl_roi(struct dt_iop_module_t *self, struct d
             : 1.0f; // avoid problems when pinned buffer size gets too close to max_mem_alloc size
 
   /* calculate optimal size of tiles */
-  float headroom = dt_conf_get_float("opencl_memory_headroom") * 1024.0f * 1024.0f;
+  float headroom = dt_conf_value_float(_conf.memory_headroom) * 1024.0f * 1024.0f;
   headroom = fmin(fmax(headroom, 0.0f), (float)darktable.opencl->dev[devid].max_global_mem);
   const float available = darktable.opencl->dev[devid].max_global_mem - headroom;
   float factor = fmax(tiling.factor + pinned_buffer_overhead, 1.0f);
@@ -1673,7 +2078,7 @@ static int _default_process_tiling_cl_roi(struct dt_iop_module_t *self, struct d
                   : 1;
 
   /* sanity check: don't run wild on too many tiles */
-  if(tiles_x * tiles_y > dt_conf_get_int("maximum_number_tiles"))
+  if(tiles_x * tiles_y > dt_conf_value_int(_conf.maximum_number_tiles))
   {
     dt_print(DT_DEBUG_OPENCL,
              "[default_process_tiling_cl_roi] aborted tiling for module '%s'. too many tiles: %d x %d\n",
@@ -1893,9 +2298,9 @@ static int _default_process_tiling_cl_roi(struct dt_iop_module_t *self, struct d
       }
       else
       {
-        /* blocking direct memory transfer: host input image -> opencl/device tile */
+        /* direct memory transfer: host input image -> opencl/device tile, see above */
         err = dt_opencl_write_host_to_device_raw(devid, (char *)ivoid + ioffs, input, iorigin, iregion,
-                                                 ipitch, CL_TRUE);
+                                                 ipitch, blocking);
         if(err != CL_SUCCESS) goto error;
       }
 
@@ -1939,9 +2344,9 @@ static int _default_process_tiling_cl_roi(struct dt_iop_module_t *self, struct d
       }
       else
       {
-        /* blocking direct memory transfer: good part of opencl/device tile -> host output image */
+        /* direct memory transfer: good part of opencl/device tile -> host output image, see above */
         err = dt_opencl_read_host_from_device_raw(devid, (char *)ovoid + ooffs, output, oorigin, oregion,
-                                                  opitch, CL_TRUE);
+                                                  opitch, blocking);
         if(err != CL_SUCCESS) goto error;
       }
 
@@ -1952,10 +2357,12 @@ static int _default_process_tiling_cl_roi(struct dt_iop_module_t *self, struct d
       output = NULL;
 
       /* block until opencl queue has finished to free all used event handlers */
-      if(!darktable.opencl->async_pixelpipe || piece->pipe->type == DT_DEV_PIXELPIPE_EXPORT)
-        dt_opencl_finish(devid);
+      if(blocking) dt_opencl_finish(devid);
     }
 
+  /* wait for the outstanding transfers of an asynchronous pipe */
+  if(!blocking && !dt_opencl_finish(devid)) goto error;
+
   /* copy back final processed_maximum */
   for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = processed_maximum_new[k];
   if(input_buffer != NULL) dt_opencl_unmap_mem_object(devid, pinned_input, input_buffer);
@@ -2070,7 +2477,10 @@ int dt_tiling_piece_fits_host_memory(const size_t width, const size_t height, co
 
   float requirement = factor * width * height * bpp + overhead;
 
-  if(host_memory_limit == 0 || requirement <= host_memory_limit * 1024.0f * 1024.0f) return TRUE;
+  // with a memory ceiling there is always a limit
+  const size_t limit = dt_memory_governor_limit("tiling", host_memory_limit == 0 ? SIZE_MAX
+                                                                                  : (size_t)host_memory_limit << 20);
+  if(limit == SIZE_MAX || requirement <= limit) return TRUE;
 
   return FALSE;
 }
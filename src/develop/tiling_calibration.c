@@ -0,0 +1,236 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "develop/tiling_calibration.h"
+#include "common/darktable.h"
+#include "common/file_location.h"
+#include "common/opencl.h"
+#include "control/conf.h"
+#include "develop/imageop.h"
+#include "develop/pixelpipe.h"
+#include "develop/tiling.h"
+
+#include <glib/gstdio.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+// sums for a least squares fit of peak = factor * in_size + overhead, sizes in MiB
+typedef struct dt_tiling_calibration_fit_t
+{
+  double n, sx, sy, sxx, sxy;
+} dt_tiling_calibration_fit_t;
+
+typedef struct dt_tiling_calibration_entry_t
+{
+  dt_tiling_calibration_fit_t fit[2]; // host, device
+} dt_tiling_calibration_entry_t;
+
+static struct
+{
+  dt_pthread_mutex_t lock;
+  GHashTable *entries; // op -> dt_tiling_calibration_entry_t
+  gboolean enabled;
+  gboolean dirty;
+} _calibration = { .entries = NULL };
+
+// a fit over sizes closer together than this can't tell factor from overhead
+#define DT_TILING_CALIBRATION_MIN_SPREAD 0.25
+// measured peaks vary a bit between runs of the same size
+#define DT_TILING_CALIBRATION_MARGIN 1.05
+
+static void _get_filename(char *filename, const size_t size)
+{
+  char configdir[PATH_MAX] = { 0 };
+  dt_loc_get_user_config_dir(configdir, sizeof(configdir));
+  snprintf(filename, size, "%s/tiling-%s.txt", configdir, darktable_package_version);
+}
+
+static dt_tiling_calibration_entry_t *_get_entry(const char *op)
+{
+  dt_tiling_calibration_entry_t *entry = g_hash_table_lookup(_calibration.entries, op);
+  if(!entry)
+  {
+    entry = g_malloc0(sizeof(dt_tiling_calibration_entry_t));
+    g_hash_table_insert(_calibration.entries, g_strdup(op), entry);
+  }
+  return entry;
+}
+
+void dt_tiling_calibration_init(void)
+{
+  dt_pthread_mutex_init(&_calibration.lock, NULL);
+  _calibration.entries = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  _calibration.enabled = dt_conf_get_bool("tiling_calibrate");
+  _calibration.dirty = FALSE;
+
+  char filename[PATH_MAX] = { 0 };
+  _get_filename(filename, sizeof(filename));
+  FILE *f = g_fopen(filename, "rb");
+  if(!f) return;
+
+  // one line per module and target: <op> host|device n sx sy sxx sxy
+  char line[512];
+  while(fgets(line, sizeof(line), f))
+  {
+    char op[64], target[16];
+    dt_tiling_calibration_fit_t fit;
+    if(sscanf(line, "%63s %15s %lf %lf %lf %lf %lf", op, target, &fit.n, &fit.sx, &fit.sy, &fit.sxx, &fit.sxy)
+       != 7)
+      continue;
+    const int device = !strcmp(target, "device");
+    if(!device && strcmp(target, "host")) continue;
+    _get_entry(op)->fit[device] = fit;
+  }
+  fclose(f);
+  dt_print(DT_DEBUG_MEMORY, "[tiling_calibration] read %u modules from `%s'\n",
+           g_hash_table_size(_calibration.entries), filename);
+}
+
+void dt_tiling_calibration_cleanup(void)
+{
+  if(!_calibration.entries) return;
+
+  if(_calibration.dirty)
+  {
+    char filename[PATH_MAX] = { 0 };
+    _get_filename(filename, sizeof(filename));
+    FILE *f = g_fopen(filename, "wb");
+    if(f)
+    {
+      GHashTableIter iter;
+      gpointer key, value;
+      g_hash_table_iter_init(&iter, _calibration.entries);
+      while(g_hash_table_iter_next(&iter, &key, &value))
+      {
+        const dt_tiling_calibration_entry_t *entry = (dt_tiling_calibration_entry_t *)value;
+        for(int device = 0; device < 2; device++)
+        {
+          const dt_tiling_calibration_fit_t *fit = &entry->fit[device];
+          if(fit->n <= 0.0) continue;
+          fprintf(f, "%s %s %.17g %.17g %.17g %.17g %.17g\n", (const char *)key, device ? "device" : "host",
+                  fit->n, fit->sx, fit->sy, fit->sxx, fit->sxy);
+        }
+      }
+      fclose(f);
+    }
+    else
+      fprintf(stderr, "[tiling_calibration] can't write `%s'\n", filename);
+  }
+
+  g_hash_table_destroy(_calibration.entries);
+  _calibration.entries = NULL;
+  dt_pthread_mutex_destroy(&_calibration.lock);
+}
+
+gboolean dt_tiling_calibration_enabled(void)
+{
+  return _calibration.enabled;
+}
+
+void dt_tiling_calibration_begin(dt_dev_pixelpipe_t *pipe, dt_tiling_calibration_run_t *run)
+{
+  dt_dev_pixelpipe_pool_mark(pipe->pool);
+  run->devid = -1;
+#ifdef HAVE_OPENCL
+  if(pipe->opencl_enabled && pipe->devid >= 0)
+  {
+    dt_opencl_memory_mark(pipe->devid);
+    run->devid = pipe->devid;
+  }
+#endif
+}
+
+void dt_tiling_calibration_end(dt_dev_pixelpipe_t *pipe, const dt_iop_module_t *module,
+                               const dt_tiling_calibration_run_t *run, const gboolean device,
+                               const size_t in_size, const size_t carried_host, const size_t carried_device)
+{
+  if(!in_size || (device && run->devid < 0)) return;
+
+  size_t peak = device ? carried_device : carried_host;
+  if(device)
+  {
+#ifdef HAVE_OPENCL
+    peak += dt_opencl_memory_peak_since_mark(run->devid);
+#endif
+  }
+  else
+    peak += dt_dev_pixelpipe_pool_peak_since_mark(pipe->pool);
+
+  const double x = in_size / (1024.0 * 1024.0);
+  const double y = peak / (1024.0 * 1024.0);
+
+  dt_pthread_mutex_lock(&_calibration.lock);
+  dt_tiling_calibration_fit_t *fit = &_get_entry(module->op)->fit[device ? 1 : 0];
+  fit->n += 1.0;
+  fit->sx += x;
+  fit->sy += y;
+  fit->sxx += x * x;
+  fit->sxy += x * y;
+  _calibration.dirty = TRUE;
+  dt_pthread_mutex_unlock(&_calibration.lock);
+
+  dt_print(DT_DEBUG_MEMORY, "[tiling_calibration] `%s' on %s: %.1f MB for %.1f MB input (factor %.2f)\n",
+           module->op, device ? "device" : "host", y, x, y / x);
+}
+
+// returns FALSE while the runs don't tell enough
+static gboolean _fit(const dt_tiling_calibration_fit_t *fit, float *factor, size_t *overhead)
+{
+  if(fit->n < 2.0) return FALSE;
+  const double mx = fit->sx / fit->n, my = fit->sy / fit->n;
+  const double var = fit->sxx / fit->n - mx * mx;
+  if(var <= 0.0 || sqrt(var) < DT_TILING_CALIBRATION_MIN_SPREAD * mx) return FALSE;
+
+  const double slope = (fit->sxy / fit->n - mx * my) / var;
+  const double intercept = my - slope * mx;
+  // at least input and output, and never less than the fixed part of a run
+  *factor = fmax(slope * DT_TILING_CALIBRATION_MARGIN, 1.0);
+  *overhead = intercept > 0.0 ? (size_t)(intercept * DT_TILING_CALIBRATION_MARGIN * 1024.0 * 1024.0) : 0;
+  return TRUE;
+}
+
+void dt_tiling_calibration_apply(const dt_iop_module_t *module, const gboolean device,
+                                 dt_develop_tiling_t *tiling)
+{
+  if(!_calibration.entries) return;
+
+  float factor = 0.0f;
+  size_t overhead = 0;
+  dt_pthread_mutex_lock(&_calibration.lock);
+  const dt_tiling_calibration_entry_t *entry = g_hash_table_lookup(_calibration.entries, module->op);
+  const gboolean valid = entry && _fit(&entry->fit[device ? 1 : 0], &factor, &overhead);
+  dt_pthread_mutex_unlock(&_calibration.lock);
+  if(!valid) return;
+
+  if(device)
+  {
+    tiling->factor = factor;
+    tiling->overhead = overhead;
+  }
+  else
+  {
+    tiling->factor = fmaxf(tiling->factor, factor);
+    tiling->overhead = MAX(tiling->overhead, overhead);
+  }
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
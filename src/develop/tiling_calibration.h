@@ -0,0 +1,65 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <glib.h>
+#include <stddef.h>
+
+struct dt_dev_pixelpipe_t;
+struct dt_develop_tiling_t;
+struct dt_iop_module_t;
+
+/**
+ * measured memory requirements of modules. with tiling_calibrate set, the peak host and device memory of
+ * every untiled module run is recorded together with the size of its input. a linear fit over the runs of
+ * a module gives factor and overhead as in dt_develop_tiling_t, which then take the place of the numbers
+ * the module's tiling_callback() claims. the runs are kept in tiling-<version>.txt in the user config
+ * directory, as module implementations and with them their needs change between versions.
+ *
+ * on the device every allocation is seen, so measured numbers replace the claimed ones. on the host only
+ * the pixelpipe's scratch pool is seen, so measured numbers can only raise the claimed ones.
+ */
+
+/** the measurement of one module run. */
+typedef struct dt_tiling_calibration_run_t
+{
+  int devid; // -1 if the run can't use a device
+} dt_tiling_calibration_run_t;
+
+void dt_tiling_calibration_init(void);
+/** writes back the runs if there are new ones. */
+void dt_tiling_calibration_cleanup(void);
+/** true if module runs are measured. */
+gboolean dt_tiling_calibration_enabled(void);
+
+/** starts measuring a module run in this pipe. */
+void dt_tiling_calibration_begin(struct dt_dev_pixelpipe_t *pipe, dt_tiling_calibration_run_t *run);
+/** records the run. in_size is the input buffer the tiling factor refers to, carried_host and carried_device
+    is memory the run needs which was allocated before it began, like input and output buffers. */
+void dt_tiling_calibration_end(struct dt_dev_pixelpipe_t *pipe, const struct dt_iop_module_t *module,
+                               const dt_tiling_calibration_run_t *run, const gboolean device,
+                               const size_t in_size, const size_t carried_host, const size_t carried_device);
+
+/** applies what has been measured for the module to the requirements from its tiling_callback(). */
+void dt_tiling_calibration_apply(const struct dt_iop_module_t *module, const gboolean device,
+                                 struct dt_develop_tiling_t *tiling);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -25,6 +25,10 @@
 #include "views/view.h"
 
 #define FULL_PREVIEW_IN_MEMORY_LIMIT 9
+// the moves of the table prepared ahead, in each direction
+#define CULLING_PREFETCH_STEPS 2
+// the memory the surfaces prepared ahead may take
+#define CULLING_PREFETCH_MAX_SIZE ((size_t)128 << 20)
 
 static inline float _absmul(float a, float b)
 {
@@ -977,90 +981,59 @@ void dt_culling_init(dt_culling_t *table, int offset)
   table->offset_imgid = first_id;
 }
 
-static void _thumbs_prefetch(dt_culling_t *table)
+// prepares the surfaces of the images before or after the ones shown (next > 0: after), in the size of the
+// place they take once the table moved to them. size accumulates the bytes of those surfaces.
+static void _thumbs_prefetch_side(dt_culling_t *table, const int *const sizes, const int count,
+                                  const gboolean next, size_t *size)
 {
-  if(!table || g_list_length(table->list) < 1) return;
-
-  // get the mip level by using the max image size actually shown
-  int maxw = 0;
-  int maxh = 0;
-  GList *l = table->list;
-  while(l)
-  {
-    dt_thumbnail_t *th = (dt_thumbnail_t *)l->data;
-    maxw = MAX(maxw, th->width);
-    maxh = MAX(maxh, th->height);
-    l = g_list_next(l);
-  }
-  dt_mipmap_size_t mip = dt_mipmap_cache_get_matching_size(darktable.mipmap_cache, maxw, maxh);
-
-  // prefetch next image
-  gchar *query;
+  const dt_thumbnail_t *th = (dt_thumbnail_t *)(next ? g_list_last(table->list) : g_list_first(table->list))->data;
+  gchar *query = dt_util_dstrcat(NULL,
+                                 "SELECT m.imgid "
+                                 "FROM memory.collected_images AS m%s "
+                                 "WHERE %s m.rowid %s (SELECT mm.rowid FROM memory.collected_images AS mm "
+                                 "WHERE mm.imgid=%d) "
+                                 "ORDER BY m.rowid%s "
+                                 "LIMIT %d",
+                                 table->navigate_inside_selection ? ", main.selected_images AS s" : "",
+                                 table->navigate_inside_selection ? "m.imgid = s.imgid AND" : "",
+                                 next ? ">" : "<", th->imgid, next ? "" : " DESC", CULLING_PREFETCH_STEPS * count);
   sqlite3_stmt *stmt;
-  dt_thumbnail_t *last = (dt_thumbnail_t *)g_list_last(table->list)->data;
-  if(table->navigate_inside_selection)
-  {
-    query
-        = dt_util_dstrcat(NULL,
-                          "SELECT m.imgid "
-                          "FROM memory.collected_images AS m, main.selected_images AS s "
-                          "WHERE m.imgid = s.imgid"
-                          " AND m.rowid > (SELECT mm.rowid FROM memory.collected_images AS mm WHERE mm.imgid=%d) "
-                          "ORDER BY m.rowid "
-                          "LIMIT 1",
-                          last->imgid);
-  }
-  else
-  {
-    query
-        = dt_util_dstrcat(NULL,
-                          "SELECT m.imgid "
-                          "FROM memory.collected_images AS m "
-                          "WHERE m.rowid > (SELECT mm.rowid FROM memory.collected_images AS mm WHERE mm.imgid=%d) "
-                          "ORDER BY m.rowid "
-                          "LIMIT 1",
-                          last->imgid);
-  }
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
-  if(sqlite3_step(stmt) == SQLITE_ROW)
+  for(int k = 0; sqlite3_step(stmt) == SQLITE_ROW; k++)
   {
+    // the k-th image takes the place of the k-th shown one, counted from the side we move to
+    const int slot = next ? k % count : count - 1 - k % count;
+    const int w = sizes[2 * slot];
+    const int h = sizes[2 * slot + 1];
+    *size += (size_t)4 * w * h;
+    if(*size > CULLING_PREFETCH_MAX_SIZE) break;
+
     const int id = sqlite3_column_int(stmt, 0);
-    if(id > 0) dt_mipmap_cache_get(darktable.mipmap_cache, NULL, id, mip, DT_MIPMAP_PREFETCH, 'r');
+    cairo_surface_t *surf = NULL;
+    if(id > 0 && !dt_view_image_get_surface_async(id, w, h, &surf)) cairo_surface_destroy(surf);
   }
   sqlite3_finalize(stmt);
   g_free(query);
+}
 
-  // prefetch previous image
-  dt_thumbnail_t *prev = (dt_thumbnail_t *)g_list_first(table->list)->data;
-  if(table->navigate_inside_selection)
-  {
-    query
-        = dt_util_dstrcat(NULL,
-                          "SELECT m.imgid "
-                          "FROM memory.collected_images AS m, main.selected_images AS s "
-                          "WHERE m.imgid = s.imgid"
-                          " AND m.rowid < (SELECT mm.rowid FROM memory.collected_images AS mm WHERE mm.imgid=%d) "
-                          "ORDER BY m.rowid DESC "
-                          "LIMIT 1",
-                          prev->imgid);
-  }
-  else
-  {
-    query
-        = dt_util_dstrcat(NULL,
-                          "SELECT m.imgid "
-                          "FROM memory.collected_images AS m "
-                          "WHERE m.rowid < (SELECT mm.rowid FROM memory.collected_images AS mm WHERE mm.imgid=%d) "
-                          "ORDER BY m.rowid DESC "
-                          "LIMIT 1",
-                          prev->imgid);
-  }
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
-  if(sqlite3_step(stmt) == SQLITE_ROW)
-  {
-    const int id = sqlite3_column_int(stmt, 0);
-    if(id > 0) dt_mipmap_cache_get(darktable.mipmap_cache, NULL, id, mip, DT_MIPMAP_PREFETCH, 'r');
-  }
+static void _thumbs_prefetch(dt_culling_t *table)
+{
+  // without workers the surfaces would be prepared here
+  if(!table || g_list_length(table->list) < 1 || !dt_control_running()) return;
+
+  // the image sizes of the shown thumbs
+  const int count = g_list_length(table->list);
+  int *sizes = malloc(sizeof(int) * 2 * count);
+  if(!sizes) return;
+  int i = 0;
+  for(GList *l = table->list; l; l = g_list_next(l), i++)
+    dt_thumbnail_get_image_size((dt_thumbnail_t *)l->data, &sizes[2 * i], &sizes[2 * i + 1]);
+
+  // next images first, then the previous ones, in the same budget
+  size_t size = 0;
+  _thumbs_prefetch_side(table, sizes, count, TRUE, &size);
+  _thumbs_prefetch_side(table, sizes, count, FALSE, &size);
+  free(sizes);
 }
 
 static gboolean _thumbs_recreate_list_at(dt_culling_t *table, const int offset)
@@ -141,17 +141,15 @@ static void _image_get_infos(dt_thumbnail_t *thumb)
   // we only get here infos that might change, others(exif, ...) are cached on widget creation
 
   thumb->rating = 0;
-  const dt_image_t *img = dt_image_cache_get(darktable.image_cache, thumb->imgid, 'r');
-  if(img)
+  dt_image_snapshot_t img;
+  if(dt_image_cache_get_snapshot(darktable.image_cache, thumb->imgid, &img))
   {
-    thumb->has_localcopy = (img->flags & DT_IMAGE_LOCAL_COPY);
-    thumb->rating = img->flags & DT_IMAGE_REJECTED ? DT_VIEW_REJECT : (img->flags & DT_VIEW_RATINGS_MASK);
-    thumb->is_bw = dt_image_is_monochrome(img);
-    thumb->is_hdr = dt_image_is_hdr(img);
-
-    thumb->groupid = img->group_id;
+    thumb->has_localcopy = (img.flags & DT_IMAGE_LOCAL_COPY);
+    thumb->rating = img.flags & DT_IMAGE_REJECTED ? DT_VIEW_REJECT : (img.flags & DT_VIEW_RATINGS_MASK);
+    thumb->is_bw = (img.flags & DT_IMAGE_MONOCHROME);
+    thumb->is_hdr = img.is_hdr;
 
-    dt_image_cache_read_release(darktable.image_cache, img);
+    thumb->groupid = img.group_id;
   }
 
   // colorlabels
@@ -272,6 +270,42 @@ static gboolean _event_cursor_draw(GtkWidget *widget, cairo_t *cr, gpointer user
   return TRUE;
 }
 
+void dt_thumbnail_get_image_size(dt_thumbnail_t *thumb, int *width, int *height)
+{
+  // let's ensure we have the right margins
+  _thumb_retrieve_margins(thumb);
+
+  if(thumb->over == DT_THUMBNAIL_OVERLAYS_ALWAYS_NORMAL || thumb->over == DT_THUMBNAIL_OVERLAYS_ALWAYS_EXTENDED)
+  {
+    *width = thumb->width - thumb->img_margin->left - thumb->img_margin->right;
+    int w = 0;
+    int h = 0;
+    gtk_widget_get_size_request(thumb->w_bottom_eb, &w, &h);
+    *height = thumb->height - h;
+    gtk_widget_get_size_request(thumb->w_altered, &w, &h);
+    if (!thumb->zoomable) *height -= h + gtk_widget_get_margin_top(thumb->w_altered);
+    else
+      *height -= thumb->img_margin->bottom;
+    *height -= thumb->img_margin->top;
+  }
+  else if(thumb->over == DT_THUMBNAIL_OVERLAYS_MIXED)
+  {
+    *width = thumb->width - thumb->img_margin->left - thumb->img_margin->right;
+    int w = 0;
+    int h = 0;
+    gtk_widget_get_size_request(thumb->w_reject, &w, &h);
+    *height = thumb->height - (h + gtk_widget_get_margin_bottom(thumb->w_reject));
+    gtk_widget_get_size_request(thumb->w_altered, &w, &h);
+    *height -= h + gtk_widget_get_margin_top(thumb->w_altered);
+    *height -= thumb->img_margin->top + thumb->img_margin->bottom;
+  }
+  else
+  {
+    *width = thumb->width - thumb->img_margin->left - thumb->img_margin->right;
+    *height = thumb->height - thumb->img_margin->top - thumb->img_margin->bottom;
+  }
+}
+
 static gboolean _event_image_draw(GtkWidget *widget, cairo_t *cr, gpointer user_data)
 {
   if(!user_data) return TRUE;
@@ -302,40 +336,8 @@ static gboolean _event_image_draw(GtkWidget *widget, cairo_t *cr, gpointer user_
   // if we don't have it in memory, we want the image surface
   if(!thumb->img_surf || thumb->img_surf_dirty)
   {
-    // let's ensure we have the right margins
-    _thumb_retrieve_margins(thumb);
-
     int image_w, image_h;
-    if(thumb->over == DT_THUMBNAIL_OVERLAYS_ALWAYS_NORMAL || thumb->over == DT_THUMBNAIL_OVERLAYS_ALWAYS_EXTENDED)
-    {
-      image_w = thumb->width - thumb->img_margin->left - thumb->img_margin->right;
-      int w = 0;
-      int h = 0;
-      gtk_widget_get_size_request(thumb->w_bottom_eb, &w, &h);
-      image_h = thumb->height - h;
-      gtk_widget_get_size_request(thumb->w_altered, &w, &h);
-      if (!thumb->zoomable) image_h -= h + gtk_widget_get_margin_top(thumb->w_altered);
-      else
-        image_h -= thumb->img_margin->bottom;
-      image_h -= thumb->img_margin->top;
-    }
-    else if(thumb->over == DT_THUMBNAIL_OVERLAYS_MIXED)
-    {
-      image_w = thumb->width - thumb->img_margin->left - thumb->img_margin->right;
-      int w = 0;
-      int h = 0;
-      gtk_widget_get_size_request(thumb->w_reject, &w, &h);
-      image_h = thumb->height - (h + gtk_widget_get_margin_bottom(thumb->w_reject));
-      gtk_widget_get_size_request(thumb->w_altered, &w, &h);
-      image_h -= h + gtk_widget_get_margin_top(thumb->w_altered);
-      image_h -= thumb->img_margin->top + thumb->img_margin->bottom;
-    }
-    else
-    {
-      image_w = thumb->width - thumb->img_margin->left - thumb->img_margin->right;
-      image_h = thumb->height - thumb->img_margin->top - thumb->img_margin->bottom;
-      ;
-    }
+    dt_thumbnail_get_image_size(thumb, &image_w, &image_h);
 
     if(v->view(v) == DT_VIEW_DARKROOM && dev->preview_pipe->output_imgid == thumb->imgid
        && dev->preview_pipe->output_backbuf)
@@ -385,7 +387,7 @@ static gboolean _event_image_draw(GtkWidget *widget, cairo_t *cr, gpointer user_
         if(darktable.gui->show_focus_peaking)
           dt_focuspeaking(cr2, img_width, img_height, cairo_image_surface_get_data(thumb->img_surf),
                           cairo_image_surface_get_width(thumb->img_surf),
-                          cairo_image_surface_get_height(thumb->img_surf));
+                          cairo_image_surface_get_height(thumb->img_surf), thumb->imgid, DT_MIPMAP_NONE);
 
         cairo_surface_destroy(tmp_surface);
         cairo_destroy(cr2);
@@ -396,14 +398,13 @@ static gboolean _event_image_draw(GtkWidget *widget, cairo_t *cr, gpointer user_
     {
       gboolean res;
       cairo_surface_t *img_surf = NULL;
-      if(thumb->zoomable)
-      {
-        res = dt_view_image_get_surface(thumb->imgid, image_w * thumb->zoom, image_h * thumb->zoom, &img_surf, FALSE);
-      }
+      const int surf_w = thumb->zoomable ? image_w * thumb->zoom : image_w;
+      const int surf_h = thumb->zoomable ? image_h * thumb->zoom : image_h;
+      // the focus areas get drawn on the surface, so it can't be a shared one
+      if(thumb->display_focus)
+        res = dt_view_image_get_surface(thumb->imgid, surf_w, surf_h, &img_surf, FALSE);
       else
-      {
-        res = dt_view_image_get_surface(thumb->imgid, image_w, image_h, &img_surf, FALSE);
-      }
+        res = dt_view_image_get_surface_async(thumb->imgid, surf_w, surf_h, &img_surf);
 
       if(res)
       {
@@ -865,6 +866,16 @@ static void _dt_active_images_callback(gpointer instance, gpointer user_data)
   }
 }
 
+static void _dt_surface_ready_callback(gpointer instance, int imgid, gpointer user_data)
+{
+  if(!user_data) return;
+  dt_thumbnail_t *thumb = (dt_thumbnail_t *)user_data;
+  if(!thumb || thumb->imgid != imgid) return;
+
+  // the surface we wait for may be that one
+  if(!thumb->img_surf || thumb->img_surf_dirty) gtk_widget_queue_draw(thumb->w_main);
+}
+
 static void _dt_preview_updated_callback(gpointer instance, gpointer user_data)
 {
   if(!user_data) return;
@@ -985,6 +996,36 @@ static gboolean _event_main_drag_motion(GtkWidget *widget, GdkDragContext *dc, g
   return TRUE;
 }
 
+// the darktable signals a thumb listens to while it shows an image
+static void _thumb_connect_signals(dt_thumbnail_t *thumb)
+{
+  dt_control_signal_connect(darktable.signals, DT_SIGNAL_ACTIVE_IMAGES_CHANGE,
+                            G_CALLBACK(_dt_active_images_callback), thumb);
+  dt_control_signal_connect(darktable.signals, DT_SIGNAL_SELECTION_CHANGED,
+                            G_CALLBACK(_dt_selection_changed_callback), thumb);
+  dt_control_signal_connect(darktable.signals, DT_SIGNAL_DEVELOP_MIPMAP_UPDATED,
+                            G_CALLBACK(_dt_mipmaps_updated_callback), thumb);
+  dt_control_signal_connect(darktable.signals, DT_SIGNAL_VIEWMANAGER_SURFACE_READY,
+                            G_CALLBACK(_dt_surface_ready_callback), thumb);
+  dt_control_signal_connect(darktable.signals, DT_SIGNAL_DEVELOP_PREVIEW_PIPE_FINISHED,
+                            G_CALLBACK(_dt_preview_updated_callback), thumb);
+  dt_control_signal_connect(darktable.signals, DT_SIGNAL_IMAGE_INFO_CHANGED,
+                            G_CALLBACK(_dt_image_info_changed_callback), thumb);
+  dt_control_signal_connect(darktable.signals, DT_SIGNAL_COLLECTION_CHANGED,
+                            G_CALLBACK(_dt_collection_changed_callback), thumb);
+}
+
+static void _thumb_disconnect_signals(dt_thumbnail_t *thumb)
+{
+  dt_control_signal_disconnect(darktable.signals, G_CALLBACK(_dt_selection_changed_callback), thumb);
+  dt_control_signal_disconnect(darktable.signals, G_CALLBACK(_dt_active_images_callback), thumb);
+  dt_control_signal_disconnect(darktable.signals, G_CALLBACK(_dt_mipmaps_updated_callback), thumb);
+  dt_control_signal_disconnect(darktable.signals, G_CALLBACK(_dt_surface_ready_callback), thumb);
+  dt_control_signal_disconnect(darktable.signals, G_CALLBACK(_dt_preview_updated_callback), thumb);
+  dt_control_signal_disconnect(darktable.signals, G_CALLBACK(_dt_image_info_changed_callback), thumb);
+  dt_control_signal_disconnect(darktable.signals, G_CALLBACK(_dt_collection_changed_callback), thumb);
+}
+
 GtkWidget *dt_thumbnail_create_widget(dt_thumbnail_t *thumb)
 {
   // main widget (overlay)
@@ -1002,18 +1043,7 @@ GtkWidget *dt_thumbnail_create_widget(dt_thumbnail_t *thumb)
     g_signal_connect(G_OBJECT(thumb->w_main), "button-release-event", G_CALLBACK(_event_main_release), thumb);
 
     g_object_set_data(G_OBJECT(thumb->w_main), "thumb", thumb);
-    dt_control_signal_connect(darktable.signals, DT_SIGNAL_ACTIVE_IMAGES_CHANGE,
-                              G_CALLBACK(_dt_active_images_callback), thumb);
-    dt_control_signal_connect(darktable.signals, DT_SIGNAL_SELECTION_CHANGED,
-                              G_CALLBACK(_dt_selection_changed_callback), thumb);
-    dt_control_signal_connect(darktable.signals, DT_SIGNAL_DEVELOP_MIPMAP_UPDATED,
-                              G_CALLBACK(_dt_mipmaps_updated_callback), thumb);
-    dt_control_signal_connect(darktable.signals, DT_SIGNAL_DEVELOP_PREVIEW_PIPE_FINISHED,
-                              G_CALLBACK(_dt_preview_updated_callback), thumb);
-    dt_control_signal_connect(darktable.signals, DT_SIGNAL_IMAGE_INFO_CHANGED,
-                              G_CALLBACK(_dt_image_info_changed_callback), thumb);
-    dt_control_signal_connect(darktable.signals, DT_SIGNAL_COLLECTION_CHANGED,
-                              G_CALLBACK(_dt_collection_changed_callback), thumb);
+    _thumb_connect_signals(thumb);
 
     // the background
     thumb->w_back = gtk_event_box_new();
@@ -1269,12 +1299,7 @@ dt_thumbnail_t *dt_thumbnail_new(int width, int height, int imgid, int rowid, dt
 void dt_thumbnail_destroy(dt_thumbnail_t *thumb)
 {
   if(thumb->overlay_timeout_id > 0) g_source_remove(thumb->overlay_timeout_id);
-  dt_control_signal_disconnect(darktable.signals, G_CALLBACK(_dt_selection_changed_callback), thumb);
-  dt_control_signal_disconnect(darktable.signals, G_CALLBACK(_dt_active_images_callback), thumb);
-  dt_control_signal_disconnect(darktable.signals, G_CALLBACK(_dt_mipmaps_updated_callback), thumb);
-  dt_control_signal_disconnect(darktable.signals, G_CALLBACK(_dt_preview_updated_callback), thumb);
-  dt_control_signal_disconnect(darktable.signals, G_CALLBACK(_dt_image_info_changed_callback), thumb);
-  dt_control_signal_disconnect(darktable.signals, G_CALLBACK(_dt_collection_changed_callback), thumb);
+  _thumb_disconnect_signals(thumb);
   if(thumb->img_surf && cairo_surface_get_reference_count(thumb->img_surf) > 0)
     cairo_surface_destroy(thumb->img_surf);
   thumb->img_surf = NULL;
@@ -1285,6 +1310,101 @@ void dt_thumbnail_destroy(dt_thumbnail_t *thumb)
   free(thumb);
 }
 
+void dt_thumbnail_recycle(dt_thumbnail_t *thumb)
+{
+  if(thumb->overlay_timeout_id > 0) g_source_remove(thumb->overlay_timeout_id);
+  thumb->overlay_timeout_id = 0;
+  _thumb_disconnect_signals(thumb);
+  if(thumb->img_surf && cairo_surface_get_reference_count(thumb->img_surf) > 0)
+    cairo_surface_destroy(thumb->img_surf);
+  thumb->img_surf = NULL;
+  gtk_widget_hide(thumb->w_main);
+}
+
+void dt_thumbnail_reuse(dt_thumbnail_t *thumb, int width, int height, int imgid, int rowid)
+{
+  thumb->imgid = imgid;
+  thumb->rowid = rowid;
+  thumb->mouse_over = FALSE;
+  thumb->selected = FALSE;
+  thumb->active = FALSE;
+  thumb->moved = FALSE;
+  thumb->zoom = 1.0f;
+  thumb->zoomx = thumb->zoomy = 0;
+  thumb->current_zx = thumb->current_zy = 0;
+  thumb->zoom_100 = 0.0f;
+  thumb->img_width = thumb->img_height = 0;
+  thumb->img_surf_preview = FALSE;
+  thumb->rating = 0;
+  thumb->colorlabels = 0;
+  thumb->has_audio = FALSE;
+  thumb->has_localcopy = FALSE;
+  thumb->is_grouped = FALSE;
+
+  // the same infos as dt_thumbnail_new() reads
+  g_free(thumb->filename);
+  thumb->filename = NULL;
+  const dt_image_t *img = dt_image_cache_get(darktable.image_cache, thumb->imgid, 'r');
+  if(img)
+  {
+    thumb->filename = g_strdup(img->filename);
+    if(thumb->over != DT_THUMBNAIL_OVERLAYS_NONE)
+    {
+      thumb->has_audio = (img->flags & DT_IMAGE_HAS_WAV);
+      thumb->has_localcopy = (img->flags & DT_IMAGE_LOCAL_COPY);
+    }
+    dt_image_cache_read_release(darktable.image_cache, img);
+  }
+  gchar *lb = NULL;
+  if(thumb->over == DT_THUMBNAIL_OVERLAYS_ALWAYS_EXTENDED || thumb->over == DT_THUMBNAIL_OVERLAYS_HOVER_EXTENDED
+     || thumb->over == DT_THUMBNAIL_OVERLAYS_MIXED || thumb->over == DT_THUMBNAIL_OVERLAYS_HOVER_BLOCK)
+  {
+    _thumb_update_extended_infos_line(thumb);
+    lb = dt_util_dstrcat(NULL, "%s", thumb->info_line);
+  }
+  gtk_label_set_markup(GTK_LABEL(thumb->w_bottom), lb ? lb : "");
+  g_free(lb);
+  _image_get_infos(thumb);
+
+  // drop the states of the former image
+  dt_thumbnail_set_group_border(thumb, DT_THUMBNAIL_BORDER_NONE);
+  _set_flag(thumb->w_bottom_eb, GTK_STATE_FLAG_PRELIGHT, FALSE);
+  gtk_widget_set_margin_start(thumb->w_image_box, 0);
+  gtk_widget_set_margin_top(thumb->w_image_box, 0);
+
+  _thumb_connect_signals(thumb);
+  gtk_widget_show(thumb->w_main);
+
+  // let's see if the images are selected or active or mouse_overed
+  _dt_active_images_callback(NULL, thumb);
+  _dt_selection_changed_callback(NULL, thumb);
+  if(dt_control_get_mouse_over_id() == thumb->imgid) dt_thumbnail_set_mouseover(thumb, TRUE);
+
+  gtk_widget_set_tooltip_text(thumb->w_altered, NULL);
+  if(thumb->is_altered)
+  {
+    char *tooltip_txt = dt_history_get_items_as_string(thumb->imgid);
+    if(tooltip_txt)
+    {
+      gtk_widget_set_tooltip_text(thumb->w_altered, tooltip_txt);
+      g_free(tooltip_txt);
+    }
+  }
+  _image_update_group_tooltip(thumb);
+
+  _thumb_write_extension(thumb);
+  _thumb_update_icons(thumb);
+
+  // resizing refreshes the image, else we do it here
+  int w = 0;
+  int h = 0;
+  gtk_widget_get_size_request(thumb->w_main, &w, &h);
+  if(w != width || h != height)
+    dt_thumbnail_resize(thumb, width, height, TRUE);
+  else
+    dt_thumbnail_image_refresh(thumb);
+}
+
 void dt_thumbnail_update_infos(dt_thumbnail_t *thumb)
 {
   if(!thumb) return;
@@ -135,8 +135,14 @@ typedef struct
 dt_thumbnail_t *dt_thumbnail_new(int width, int height, int imgid, int rowid, dt_thumbnail_overlay_t over,
                                  gboolean zoomable, gboolean tooltip);
 void dt_thumbnail_destroy(dt_thumbnail_t *thumb);
+// detach the thumb from its image and hide it, its widgets are kept for dt_thumbnail_reuse()
+void dt_thumbnail_recycle(dt_thumbnail_t *thumb);
+// show another image in a recycled thumb, as dt_thumbnail_new() would but without building the widgets again
+void dt_thumbnail_reuse(dt_thumbnail_t *thumb, int width, int height, int imgid, int rowid);
 GtkWidget *dt_thumbnail_create_widget(dt_thumbnail_t *thumb);
 void dt_thumbnail_resize(dt_thumbnail_t *thumb, int width, int height, gboolean force);
+// the size of the image area of the thumb, without zoom
+void dt_thumbnail_get_image_size(dt_thumbnail_t *thumb, int *width, int *height);
 void dt_thumbnail_set_group_border(dt_thumbnail_t *thumb, dt_thumbnail_border_t border);
 void dt_thumbnail_set_mouseover(dt_thumbnail_t *thumb, gboolean over);
 
@@ -36,12 +36,6 @@ static gint _list_compare_by_imgid(gconstpointer a, gconstpointer b)
   if(th->imgid < 0 || b < 0) return 1;
   return (th->imgid != imgid);
 }
-static void _list_remove_thumb(gpointer user_data)
-{
-  dt_thumbnail_t *thumb = (dt_thumbnail_t *)user_data;
-  gtk_container_remove(GTK_CONTAINER(gtk_widget_get_parent(thumb->w_main)), thumb->w_main);
-  dt_thumbnail_destroy(thumb);
-}
 
 // get the class name associated with the overlays mode
 static gchar *_thumbs_get_overlays_class(dt_thumbnail_overlay_t over)
@@ -65,6 +59,51 @@ static gchar *_thumbs_get_overlays_class(dt_thumbnail_overlay_t over)
   }
 }
 
+// put a thumb no longer shown in the pool of the table. its widgets stay hidden in the layout until reused
+static void _thumb_recycle(dt_thumbtable_t *table, dt_thumbnail_t *thumb)
+{
+  dt_thumbnail_recycle(thumb);
+  table->recycled = g_list_prepend(table->recycled, thumb);
+}
+
+// get a thumb for imgid at position x,y, a recycled one if any. it has to be added to table->list afterward
+static dt_thumbnail_t *_thumb_create(dt_thumbtable_t *table, const int imgid, const int rowid, const int x,
+                                     const int y)
+{
+  dt_thumbnail_t *thumb = NULL;
+  if(table->recycled)
+  {
+    thumb = (dt_thumbnail_t *)table->recycled->data;
+    table->recycled = g_list_delete_link(table->recycled, table->recycled);
+    GtkStyleContext *context = gtk_widget_get_style_context(thumb->w_main);
+    gtk_style_context_remove_class(context, "dt_last_active");
+    gtk_layout_move(GTK_LAYOUT(table->widget), thumb->w_main, x, y);
+    thumb->tooltip = table->show_tooltips;
+    dt_thumbnail_set_overlay(thumb, table->overlays, table->overlays_block_timeout);
+    dt_thumbnail_reuse(thumb, table->thumb_size, table->thumb_size, imgid, rowid);
+  }
+  else
+  {
+    thumb = dt_thumbnail_new(table->thumb_size, table->thumb_size, imgid, rowid, table->overlays, FALSE,
+                             table->show_tooltips);
+    gtk_layout_put(GTK_LAYOUT(table->widget), thumb->w_main, x, y);
+  }
+
+  if(table->mode == DT_THUMBTABLE_MODE_FILMSTRIP)
+  {
+    thumb->single_click = TRUE;
+    thumb->sel_mode = DT_THUMBNAIL_SEL_MODE_MOD_ONLY;
+  }
+  else
+  {
+    thumb->single_click = FALSE;
+    thumb->sel_mode = DT_THUMBNAIL_SEL_MODE_NORMAL;
+  }
+  thumb->x = x;
+  thumb->y = y;
+  return thumb;
+}
+
 // get the size categorie, depending on the thumb size
 static int _thumbs_get_prefs_size(dt_thumbtable_t *table)
 {
@@ -463,8 +502,7 @@ static int _thumbs_remove_unneeded(dt_thumbtable_t *table)
            && (th->x + table->thumb_size <= 0 || th->x > table->view_width)))
     {
       table->list = g_list_remove_link(table->list, l);
-      gtk_container_remove(GTK_CONTAINER(gtk_widget_get_parent(th->w_main)), th->w_main);
-      dt_thumbnail_destroy(th);
+      _thumb_recycle(table, th);
       g_list_free(l);
       changed++;
     }
@@ -504,18 +542,9 @@ static int _thumbs_load_needed(dt_thumbtable_t *table)
     {
       if(posy < table->view_height) // we don't load invisible thumbs
       {
-        dt_thumbnail_t *thumb
-            = dt_thumbnail_new(table->thumb_size, table->thumb_size, sqlite3_column_int(stmt, 1),
-                               sqlite3_column_int(stmt, 0), table->overlays, FALSE, table->show_tooltips);
-        if(table->mode == DT_THUMBTABLE_MODE_FILMSTRIP)
-        {
-          thumb->single_click = TRUE;
-          thumb->sel_mode = DT_THUMBNAIL_SEL_MODE_MOD_ONLY;
-        }
-        thumb->x = posx;
-        thumb->y = posy;
+        dt_thumbnail_t *thumb = _thumb_create(table, sqlite3_column_int(stmt, 1), sqlite3_column_int(stmt, 0),
+                                              posx, posy);
         table->list = g_list_prepend(table->list, thumb);
-        gtk_layout_put(GTK_LAYOUT(table->widget), thumb->w_main, posx, posy);
         changed++;
       }
       _pos_get_previous(table, &posx, &posy);
@@ -547,18 +576,9 @@ static int _thumbs_load_needed(dt_thumbtable_t *table)
     {
       if(posy + table->thumb_size >= 0) // we don't load invisible thumbs
       {
-        dt_thumbnail_t *thumb
-            = dt_thumbnail_new(table->thumb_size, table->thumb_size, sqlite3_column_int(stmt, 1),
-                               sqlite3_column_int(stmt, 0), table->overlays, FALSE, table->show_tooltips);
-        if(table->mode == DT_THUMBTABLE_MODE_FILMSTRIP)
-        {
-          thumb->single_click = TRUE;
-          thumb->sel_mode = DT_THUMBNAIL_SEL_MODE_MOD_ONLY;
-        }
-        thumb->x = posx;
-        thumb->y = posy;
+        dt_thumbnail_t *thumb = _thumb_create(table, sqlite3_column_int(stmt, 1), sqlite3_column_int(stmt, 0),
+                                              posx, posy);
         table->list = g_list_append(table->list, thumb);
-        gtk_layout_put(GTK_LAYOUT(table->widget), thumb->w_main, posx, posy);
         changed++;
       }
       _pos_get_next(table, &posx, &posy);
@@ -570,6 +590,81 @@ static int _thumbs_load_needed(dt_thumbtable_t *table)
   return changed;
 }
 
+// how far ahead of the scrolling thumbs get loaded, in seconds of scrolling at the current speed
+#define DT_THUMBTABLE_PREFETCH_TIME 1.5
+// scrolling which paused longer than that starts over with unknown speed
+#define DT_THUMBTABLE_PREFETCH_PAUSE 0.5
+
+// follows the direction and the speed of the scrolling. delta is the move of the thumbs in rows (filmstrip:
+// images), so negative when going toward the end of the collection.
+static void _thumbs_update_scroll(dt_thumbtable_t *table, const float delta)
+{
+  if(table->mode == DT_THUMBTABLE_MODE_ZOOM || delta == 0.0f) return;
+
+  const double now = dt_get_wtime();
+  const double dt = now - table->scroll_time;
+  const int dir = delta < 0.0f ? 1 : -1;
+  table->scroll_time = now;
+
+  if(dir != table->scroll_dir || dt > DT_THUMBTABLE_PREFETCH_PAUSE)
+  {
+    table->scroll_dir = dir;
+    table->scroll_speed = 0.0f;
+    return;
+  }
+  const float speed = fabsf(delta) / fmax(dt, 1e-3);
+  table->scroll_speed = table->scroll_speed > 0.0f ? 0.7f * table->scroll_speed + 0.3f * speed : speed;
+}
+
+// the images coming up next in the direction of the scrolling, nearest first
+static GList *_thumbs_get_ahead(dt_thumbtable_t *table)
+{
+  if(!table->list || table->scroll_dir == 0 || table->mode == DT_THUMBTABLE_MODE_ZOOM) return NULL;
+
+  // at least one page, more the faster it goes
+  const int page = MAX(1, table->rows);
+  const int rows = CLAMP((int)(table->scroll_speed * DT_THUMBTABLE_PREFETCH_TIME), page, 4 * page);
+  const int per_row = table->mode == DT_THUMBTABLE_MODE_FILMSTRIP ? 1 : MAX(1, table->thumbs_per_row);
+
+  const dt_thumbnail_t *edge = table->scroll_dir > 0 ? (dt_thumbnail_t *)g_list_last(table->list)->data
+                                                     : (dt_thumbnail_t *)table->list->data;
+  gchar *query = g_strdup_printf(table->scroll_dir > 0 ? "SELECT imgid FROM memory.collected_images"
+                                                         " WHERE rowid>%d ORDER BY rowid LIMIT %d"
+                                                       : "SELECT imgid FROM memory.collected_images"
+                                                         " WHERE rowid<%d ORDER BY rowid DESC LIMIT %d",
+                                 edge->rowid, rows * per_row);
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
+  GList *imgids = NULL;
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+    imgids = g_list_prepend(imgids, GINT_TO_POINTER(sqlite3_column_int(stmt, 0)));
+  sqlite3_finalize(stmt);
+  g_free(query);
+  return g_list_reverse(imgids);
+}
+
+// tell the thumbnail jobs which images are on screen now, so they load them first and drop the others. the
+// images ahead of the scrolling are prefetched after those, so they are there when they show up.
+static void _thumbs_update_view(dt_thumbtable_t *table)
+{
+  GList *imgids = NULL;
+  for(GList *l = g_list_last(table->list); l; l = g_list_previous(l))
+    imgids = g_list_prepend(imgids, GINT_TO_POINTER(((dt_thumbnail_t *)l->data)->imgid));
+  GList *ahead = _thumbs_get_ahead(table);
+  dt_image_load_jobs_set_view(imgids, ahead);
+
+  // the jobs look up their place in the view when they are created, so this has to come after it is set
+  if(ahead)
+  {
+    const dt_mipmap_size_t mip = dt_mipmap_cache_get_matching_size(
+        darktable.mipmap_cache, table->thumb_size * darktable.gui->ppd, table->thumb_size * darktable.gui->ppd);
+    for(GList *l = ahead; l; l = g_list_next(l))
+      dt_mipmap_cache_get(darktable.mipmap_cache, NULL, GPOINTER_TO_INT(l->data), mip, DT_MIPMAP_PREFETCH, 'r');
+  }
+  g_list_free(ahead);
+  g_list_free(imgids);
+}
+
 // move all thumbs from the table.
 // if clamp, we verify that the move is allowed (collection bounds, etc...)
 static gboolean _move(dt_thumbtable_t *table, const int x, const int y, gboolean clamp)
@@ -664,6 +759,10 @@ static gboolean _move(dt_thumbtable_t *table, const int x, const int y, gboolean
   table->thumbs_area.x += posx;
   table->thumbs_area.y += posy;
 
+  if(table->thumb_size > 0)
+    _thumbs_update_scroll(table, table->mode == DT_THUMBTABLE_MODE_FILMSTRIP ? (float)posx / table->thumb_size
+                                                                             : (float)posy / table->thumb_size);
+
   // we load all needed thumbs
   int changed = _thumbs_load_needed(table);
 
@@ -671,7 +770,11 @@ static gboolean _move(dt_thumbtable_t *table, const int x, const int y, gboolean
   changed += _thumbs_remove_unneeded(table);
 
   // if there has been changed, we recompute thumbs area
-  if(changed > 0) _pos_compute_area(table);
+  if(changed > 0)
+  {
+    _pos_compute_area(table);
+    _thumbs_update_view(table);
+  }
 
   // we update the offset
   if(table->mode == DT_THUMBTABLE_MODE_FILEMANAGER)
@@ -1728,18 +1831,9 @@ void dt_thumbtable_full_redraw(dt_thumbtable_t *table, gboolean force)
       }
       else
       {
-        // we create a completly new thumb
-        dt_thumbnail_t *thumb = dt_thumbnail_new(table->thumb_size, table->thumb_size, nid, nrow, table->overlays,
-                                                 FALSE, table->show_tooltips);
-        if(table->mode == DT_THUMBTABLE_MODE_FILMSTRIP)
-        {
-          thumb->single_click = TRUE;
-          thumb->sel_mode = DT_THUMBNAIL_SEL_MODE_MOD_ONLY;
-        }
-        thumb->x = posx;
-        thumb->y = posy;
+        // we create a new thumb, or take one back from the pool
+        dt_thumbnail_t *thumb = _thumb_create(table, nid, nrow, posx, posy);
         newlist = g_list_append(newlist, thumb);
-        gtk_layout_put(GTK_LAYOUT(table->widget), thumb->w_main, posx, posy);
         nbnew++;
       }
       _pos_get_next(table, &posx, &posy);
@@ -1747,11 +1841,13 @@ void dt_thumbtable_full_redraw(dt_thumbtable_t *table, gboolean force)
       if(nrow == table->offset) table->offset_imgid = nid;
     }
 
-    // now we cleanup all remaining thumbs from old table->list and set it again
-    g_list_free_full(table->list, _list_remove_thumb);
+    // now we recycle all remaining thumbs from old table->list and set it again
+    for(GList *l = table->list; l; l = g_list_next(l)) _thumb_recycle(table, (dt_thumbnail_t *)l->data);
+    g_list_free(table->list);
     table->list = newlist;
 
     _pos_compute_area(table);
+    _thumbs_update_view(table);
 
     if(g_slist_length(darktable.view_manager->active_images) > 0
        && (table->mode == DT_THUMBTABLE_MODE_ZOOM || table->mode == DT_THUMBTABLE_MODE_FILEMANAGER))
@@ -54,6 +54,9 @@ typedef struct dt_thumbtable_t
   // for filmstrip and filemanager, this is all the images drawn at screen (even partially)
   // for zoommable, this is all the images in the row drawn at screen. We don't load laterals images on fly.
   GList *list;
+  // thumbs no longer shown, hidden inside main widget and waiting to be reused for another image
+  // this avoid to build and destroy all the widgets of a thumb each time the table scrolls
+  GList *recycled;
 
   // rowid of the main shown image inside 'memory.collected_images'
   // for filmstrip this is the image in the center.
@@ -95,6 +98,11 @@ typedef struct dt_thumbtable_t
 
   // in lighttable preview or culling, we can navigate inside selection or inside full collection
   gboolean navigate_inside_selection;
+
+  // where the scrolling goes, to load the thumbs coming up before they are shown
+  int scroll_dir;        // 1 toward the end of the collection, -1 toward its start, 0 unknown
+  float scroll_speed;    // in rows (filmstrip: images) per second
+  double scroll_time;    // of the last move
 } dt_thumbtable_t;
 
 dt_thumbtable_t *dt_thumbtable_new();
@@ -44,7 +44,105 @@
 #include "win/main_wrapper.h"
 #endif
 
-static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip, const dt_mipmap_size_t max_mip, const int32_t min_imgid, const int32_t max_imgid)
+// shared by the threads generating thumbnails, they take the images in the order of their ids
+typedef struct dt_generate_cache_t
+{
+  dt_mipmap_size_t min_mip, max_mip;
+  gboolean incremental;
+  const int32_t *imgids;
+  size_t count;
+  const char *progress_file;
+
+  dt_pthread_mutex_t lock;
+  size_t next;      // next image to hand out
+  size_t finished;  // number of images done
+  size_t done_upto; // all images before this one are done
+  gboolean *done;
+  double last_save;
+} dt_generate_cache_t;
+
+// the history has changed since the thumbnails were generated, see dt_history_hash_set_mipmap()
+static gboolean thumbnails_are_stale(const int32_t imgid)
+{
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT 1 FROM main.history_hash"
+                              " WHERE imgid = ?1 AND current_hash IS NOT NULL"
+                              "   AND (mipmap_hash IS NULL OR mipmap_hash != current_hash)",
+                              -1, &stmt, NULL);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+  const gboolean stale = sqlite3_step(stmt) == SQLITE_ROW;
+  sqlite3_finalize(stmt);
+  return stale;
+}
+
+static void generate_thumbnails(const int32_t imgid, const dt_mipmap_size_t min_mip,
+                                const dt_mipmap_size_t max_mip, const gboolean incremental)
+{
+  // the ones on disk show an older history, drop them to have them generated again
+  if(incremental && thumbnails_are_stale(imgid))
+  {
+    fprintf(stderr, _("thumbnails of image %d are out of date\n"), imgid);
+    dt_mipmap_cache_remove(darktable.mipmap_cache, imgid);
+  }
+
+  for(int k = max_mip; k >= min_mip && k >= 0; k--)
+  {
+    // if the thumbnail is already on disc - do nothing
+    if(dt_mipmap_cache_has_ondisk_thumbnail(darktable.mipmap_cache, imgid, k)) continue;
+
+    // else, generate thumbnail and store in mipmap cache.
+    dt_mipmap_buffer_t buf;
+    dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, k, DT_MIPMAP_BLOCKING, 'r');
+    dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+  }
+
+  // and immediately write thumbs to disc and remove from mipmap cache.
+  dt_mimap_cache_evict(darktable.mipmap_cache, imgid);
+  // thumbnail in sync with image
+  dt_history_hash_set_mipmap(imgid);
+}
+
+// the highest id up to which everything is done, so a run started again can go on after it
+static void save_progress(dt_generate_cache_t *gen)
+{
+  if(!gen->progress_file || gen->done_upto == 0) return;
+  gchar *marker = g_strdup_printf("%d\n", gen->imgids[gen->done_upto - 1]);
+  if(!g_file_set_contents(gen->progress_file, marker, -1, NULL))
+    fprintf(stderr, _("warning: could not write progress to '%s'\n"), gen->progress_file);
+  g_free(marker);
+  gen->last_save = dt_get_wtime();
+}
+
+static void *generate_worker(void *data)
+{
+  dt_generate_cache_t *gen = (dt_generate_cache_t *)data;
+  while(TRUE)
+  {
+    dt_pthread_mutex_lock(&gen->lock);
+    const size_t index = gen->next;
+    if(index < gen->count) gen->next++;
+    dt_pthread_mutex_unlock(&gen->lock);
+    if(index >= gen->count) break;
+
+    const int32_t imgid = gen->imgids[index];
+    generate_thumbnails(imgid, gen->min_mip, gen->max_mip, gen->incremental);
+
+    dt_pthread_mutex_lock(&gen->lock);
+    gen->done[index] = TRUE;
+    gen->finished++;
+    while(gen->done_upto < gen->count && gen->done[gen->done_upto]) gen->done_upto++;
+    fprintf(stderr, "image %zu/%zu (%.02f%%) (id:%d)\n", gen->finished, gen->count,
+            100.0 * gen->finished / (float)gen->count, imgid);
+    if(dt_get_wtime() - gen->last_save > 10.0) save_progress(gen);
+    dt_pthread_mutex_unlock(&gen->lock);
+  }
+  return NULL;
+}
+
+static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip, const dt_mipmap_size_t max_mip,
+                                    int32_t min_imgid, const int32_t max_imgid, const int threads,
+                                    const char *progress_file, const gboolean incremental)
 {
   fprintf(stderr, _("creating cache directories\n"));
   for(dt_mipmap_size_t k = min_mip; k <= max_mip; k++)
@@ -60,65 +158,70 @@ static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip, const dt_mip
     }
   }
 
-  // some progress counter
-  sqlite3_stmt *stmt;
-  size_t image_count = 0, counter = 0;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT COUNT(*) FROM main.images WHERE id >= ?1 AND id <= ?2", -1, &stmt, 0);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, min_imgid);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, max_imgid);
-  if(sqlite3_step(stmt) == SQLITE_ROW)
-  {
-    image_count = sqlite3_column_int(stmt, 0);
-    sqlite3_finalize(stmt);
-  }
-  else
-  {
-    return 1;
-  }
-
-  if(!image_count)
+  // go on where an earlier run stopped
+  gchar *marker = NULL;
+  if(progress_file && g_file_get_contents(progress_file, &marker, NULL, NULL))
   {
-    fprintf(stderr, _("warning: no images are matching the requested image id range\n"));
-    if(min_imgid > max_imgid)
+    const int32_t resume = atoi(marker);
+    if(resume >= min_imgid && resume < INT32_MAX)
     {
-      fprintf(stderr, _("warning: did you want to swap these boundaries?\n"));
+      fprintf(stderr, _("resuming after image id %d\n"), resume);
+      min_imgid = resume + 1;
     }
   }
+  g_free(marker);
 
-  // go through all images:
+  // collect the images first, the workers take them in this order
+  sqlite3_stmt *stmt;
+  GArray *imgids = g_array_new(FALSE, FALSE, sizeof(int32_t));
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT id FROM main.images WHERE id >= ?1 AND id <= ?2", -1, &stmt, 0);
+                              "SELECT id FROM main.images WHERE id >= ?1 AND id <= ?2 ORDER BY id", -1, &stmt, 0);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, min_imgid);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, max_imgid);
   while(sqlite3_step(stmt) == SQLITE_ROW)
   {
     const int32_t imgid = sqlite3_column_int(stmt, 0);
+    g_array_append_val(imgids, imgid);
+  }
+  sqlite3_finalize(stmt);
 
-    counter++;
-    fprintf(stderr, "image %zu/%zu (%.02f%%) (id:%d)\n", counter, image_count, 100.0 * counter / (float)image_count, imgid);
-
-    for(int k = max_mip; k >= min_mip && k >= 0; k--)
+  if(!imgids->len)
+  {
+    fprintf(stderr, _("warning: no images are matching the requested image id range\n"));
+    if(min_imgid > max_imgid)
     {
-      char filename[PATH_MAX] = { 0 };
-      snprintf(filename, sizeof(filename), "%s.d/%d/%d.jpg", darktable.mipmap_cache->cachedir, k, imgid);
-
-      // if the thumbnail is already on disc - do nothing
-      if(!access(filename, R_OK)) continue;
-
-      // else, generate thumbnail and store in mipmap cache.
-      dt_mipmap_buffer_t buf;
-      dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, k, DT_MIPMAP_BLOCKING, 'r');
-      dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+      fprintf(stderr, _("warning: did you want to swap these boundaries?\n"));
     }
-
-    // and immediately write thumbs to disc and remove from mipmap cache.
-    dt_mimap_cache_evict(darktable.mipmap_cache, imgid);
-    // thumbnail in sync with image
-    dt_history_hash_set_mipmap(imgid);
   }
 
-  sqlite3_finalize(stmt);
+  dt_generate_cache_t gen = { .min_mip = min_mip,
+                              .max_mip = max_mip,
+                              .incremental = incremental,
+                              .imgids = (const int32_t *)imgids->data,
+                              .count = imgids->len,
+                              .progress_file = progress_file,
+                              .next = 0,
+                              .finished = 0,
+                              .done_upto = 0,
+                              .done = g_malloc0_n(MAX(imgids->len, 1), sizeof(gboolean)),
+                              .last_save = dt_get_wtime() };
+  dt_pthread_mutex_init(&gen.lock, NULL);
+
+  // the pixelpipes take the opencl devices as they become free and run on the cpu meanwhile, so more
+  // threads than devices keep both busy
+  const int nthreads = CLAMP(threads, 1, MAX((int)imgids->len, 1));
+  pthread_t *workers = g_malloc0_n(nthreads, sizeof(pthread_t));
+  int started = 0;
+  for(int k = 1; k < nthreads; k++)
+    if(!dt_pthread_create(&workers[started], generate_worker, &gen)) started++;
+  generate_worker(&gen);
+  for(int k = 0; k < started; k++) pthread_join(workers[k], NULL);
+  g_free(workers);
+
+  save_progress(&gen);
+  dt_pthread_mutex_destroy(&gen.lock);
+  g_free(gen.done);
+  g_array_free(imgids, TRUE);
   fprintf(stderr, "done\n");
 
   return 0;
@@ -130,13 +233,23 @@ static void usage(const char *progname)
           "usage: %s [-h, --help; --version]\n"
           "  [--min-mip <0-8> (default = 0)] [-m, --max-mip <0-8> (default = 2)]\n"
           "  [--min-imgid <N>] [--max-imgid <N>]\n"
+          "  [-j, --jobs <N> (default = 1)] [--progress-file <file>] [--incremental]\n"
           "  [--core <darktable options>]\n"
           "\n"
           "When multiple mipmap sizes are requested, the biggest one is computed\n"
           "while the rest are quickly downsampled.\n"
           "\n"
           "The --min-imgid and --max-imgid specify the range of internal image ID\n"
-          "numbers to work on.\n",
+          "numbers to work on, so several machines can share a library.\n"
+          "\n"
+          "The --jobs option processes that many images at once. Their pixelpipes\n"
+          "use the OpenCL devices when free and the CPU otherwise.\n"
+          "\n"
+          "The --progress-file keeps the image ID up to which all thumbnails are\n"
+          "done. A run given the same file goes on after it.\n"
+          "\n"
+          "With --incremental the thumbnails of images edited since they were\n"
+          "generated are replaced, otherwise only missing ones are generated.\n",
           progname);
 }
 
@@ -156,6 +269,9 @@ int main(int argc, char *arg[])
   dt_mipmap_size_t max_mip = DT_MIPMAP_2;
   int32_t min_imgid = 0;
   int32_t max_imgid = INT32_MAX;
+  int threads = 1;
+  const char *progress_file = NULL;
+  gboolean incremental = FALSE;
 
   int k;
   for(k = 1; k < argc; k++)
@@ -190,6 +306,20 @@ int main(int argc, char *arg[])
       k++;
       max_imgid = (int32_t)MIN(MAX(atoi(arg[k]), 0), INT32_MAX);
     }
+    else if((!strcmp(arg[k], "-j") || !strcmp(arg[k], "--jobs")) && argc > k + 1)
+    {
+      k++;
+      threads = MAX(atoi(arg[k]), 1);
+    }
+    else if(!strcmp(arg[k], "--progress-file") && argc > k + 1)
+    {
+      k++;
+      progress_file = arg[k];
+    }
+    else if(!strcmp(arg[k], "--incremental"))
+    {
+      incremental = TRUE;
+    }
     else if(!strcmp(arg[k], "--core"))
     {
       // everything from here on should be passed to the core
@@ -243,7 +373,7 @@ int main(int argc, char *arg[])
 
   fprintf(stderr, _("creating complete lighttable thumbnail cache\n"));
 
-  if(generate_thumbnail_cache(min_mip, max_mip, min_imgid, max_imgid))
+  if(generate_thumbnail_cache(min_mip, max_mip, min_imgid, max_imgid, threads, progress_file, incremental))
   {
     free(m_arg);
     exit(EXIT_FAILURE);
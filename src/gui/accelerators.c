@@ -607,10 +607,18 @@ void dt_accel_connect_button_lib_as_global(dt_lib_module_t *module, const gchar
     g_signal_connect(G_OBJECT(button), "query-tooltip", G_CALLBACK(_tooltip_callback), NULL);
 }
 
+// accels change widgets of collapsed modules, which may not have been updated for this image yet
+static void _widget_update_pending(GtkWidget *widget)
+{
+  dt_bauhaus_widget_t *w = (dt_bauhaus_widget_t *)DT_BAUHAUS_WIDGET(widget);
+  if(w->module) dt_iop_gui_update_pending(w->module);
+}
+
 static gboolean bauhaus_slider_edit_callback(GtkAccelGroup *accel_group, GObject *acceleratable, guint keyval,
                                              GdkModifierType modifier, gpointer data)
 {
   GtkWidget *slider = GTK_WIDGET(data);
+  _widget_update_pending(slider);
 
   dt_bauhaus_show_popup(DT_BAUHAUS_WIDGET(slider));
 
@@ -689,6 +697,7 @@ static gboolean bauhaus_slider_increase_callback(GtkAccelGroup *accel_group, GOb
                                                  guint keyval, GdkModifierType modifier, gpointer data)
 {
   GtkWidget *slider = GTK_WIDGET(data);
+  _widget_update_pending(slider);
 
   float value = dt_bauhaus_slider_get(slider);
   float step = dt_bauhaus_slider_get_step(slider);
@@ -710,6 +719,7 @@ static gboolean bauhaus_slider_decrease_callback(GtkAccelGroup *accel_group, GOb
                                                  guint keyval, GdkModifierType modifier, gpointer data)
 {
   GtkWidget *slider = GTK_WIDGET(data);
+  _widget_update_pending(slider);
 
   float value = dt_bauhaus_slider_get(slider);
   float step = dt_bauhaus_slider_get_step(slider);
@@ -731,6 +741,7 @@ static gboolean bauhaus_slider_reset_callback(GtkAccelGroup *accel_group, GObjec
                                               guint keyval, GdkModifierType modifier, gpointer data)
 {
   GtkWidget *slider = GTK_WIDGET(data);
+  _widget_update_pending(slider);
 
   dt_bauhaus_slider_reset(slider);
 
@@ -744,6 +755,7 @@ static gboolean bauhaus_combobox_next_callback(GtkAccelGroup *accel_group, GObje
                                                  guint keyval, GdkModifierType modifier, gpointer data)
 {
   GtkWidget *combobox = GTK_WIDGET(data);
+  _widget_update_pending(combobox);
 
   const int currentval = dt_bauhaus_combobox_get(combobox);
   const int nextval = currentval + 1 >= dt_bauhaus_combobox_length(combobox) ? 0 : currentval + 1;
@@ -758,6 +770,7 @@ static gboolean bauhaus_combobox_prev_callback(GtkAccelGroup *accel_group, GObje
                                                  guint keyval, GdkModifierType modifier, gpointer data)
 {
   GtkWidget *combobox = GTK_WIDGET(data);
+  _widget_update_pending(combobox);
 
   const int currentval = dt_bauhaus_combobox_get(combobox);
   const int prevval = currentval - 1 < 0 ? dt_bauhaus_combobox_length(combobox) : currentval - 1;
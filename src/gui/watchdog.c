@@ -0,0 +1,255 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gui/watchdog.h"
+#include "common/darktable.h"
+#include "common/metrics.h"
+#include "control/conf.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __GLIBC__
+#define DT_WATCHDOG_BACKTRACE
+#include <execinfo.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+// handlers can emit signals themselves
+#define DT_WATCHDOG_MAX_DEPTH 32
+
+typedef struct dt_gui_watchdog_signal_t
+{
+  const char *name;
+  uint64_t count;
+  double total, max;
+  dt_metric_t *metric;
+} dt_gui_watchdog_signal_t;
+
+typedef struct dt_gui_watchdog_guard_t
+{
+  dt_gui_watchdog_signal_t *signal;
+  GCallback cb;
+} dt_gui_watchdog_guard_t;
+
+static struct
+{
+  gboolean enabled;
+  int64_t threshold; // us
+  GPollFunc poll;
+  // when the poll of the current iteration returned, 0 while the main loop waits. written by the gui thread,
+  // read by the sampler
+  int64_t busy_since;
+  dt_metric_t *main_loop;
+  GHashTable *signals; // name -> dt_gui_watchdog_signal_t, gui thread only
+#ifdef DT_WATCHDOG_BACKTRACE
+  pthread_t gui_thread, sampler;
+  int stop;
+#endif
+} _watchdog = { .enabled = FALSE };
+
+// start of the handlers running on this thread, innermost last
+static __thread int64_t _handler_start[DT_WATCHDOG_MAX_DEPTH];
+static __thread int _handler_depth = 0;
+
+#ifdef DT_WATCHDOG_BACKTRACE
+static void _print_backtrace(int signo)
+{
+  // only async signal safe calls in here, backtrace() has been called once before to load what it needs
+  static const char message[] = "[watchdog] main loop still busy, backtrace:\n";
+  void *frames[64];
+  const int n = backtrace(frames, G_N_ELEMENTS(frames));
+  if(write(STDERR_FILENO, message, sizeof(message) - 1) < 0) return;
+  backtrace_symbols_fd(frames, n, STDERR_FILENO);
+}
+
+static void *_sampler(void *arg)
+{
+  dt_pthread_setname("watchdog");
+  int64_t sampled = 0;
+  while(!__sync_fetch_and_add(&_watchdog.stop, 0))
+  {
+    g_usleep(MAX(_watchdog.threshold / 2, 1000));
+    const int64_t since = __sync_fetch_and_add(&_watchdog.busy_since, 0);
+    // one backtrace per blocked iteration is enough
+    if(since && since != sampled && g_get_monotonic_time() - since > _watchdog.threshold)
+    {
+      sampled = since;
+      pthread_kill(_watchdog.gui_thread, SIGPROF);
+    }
+  }
+  return NULL;
+}
+#endif
+
+static gint _poll(GPollFD *fds, guint nfds, gint timeout)
+{
+  // everything since the last poll returned has been dispatching callbacks
+  const int64_t since = __sync_lock_test_and_set(&_watchdog.busy_since, 0);
+  if(since)
+  {
+    const int64_t busy = g_get_monotonic_time() - since;
+    dt_metrics_observe(_watchdog.main_loop, busy * 1e-6);
+    if(busy > _watchdog.threshold)
+      fprintf(stderr, "[watchdog] main loop blocked for %.1f ms\n", busy * 1e-3);
+  }
+
+  const gint ret = _watchdog.poll(fds, nfds, timeout);
+  __sync_lock_test_and_set(&_watchdog.busy_since, g_get_monotonic_time());
+  return ret;
+}
+
+void dt_gui_watchdog_init(void)
+{
+  const int threshold = dt_conf_get_int("ui_watchdog_threshold");
+  if(threshold <= 0 || _watchdog.enabled) return;
+
+  _watchdog.threshold = (int64_t)threshold * 1000;
+  _watchdog.busy_since = 0;
+  _watchdog.main_loop = dt_metrics_get("ui.main_loop", DT_METRIC_HISTOGRAM);
+  _watchdog.signals = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, g_free);
+  _watchdog.poll = g_main_context_get_poll_func(NULL);
+  g_main_context_set_poll_func(NULL, _poll);
+  _watchdog.enabled = TRUE;
+
+#ifdef DT_WATCHDOG_BACKTRACE
+  // backtrace() loads libgcc on its first call, which mustn't happen in the signal handler
+  void *frame;
+  backtrace(&frame, 1);
+  struct sigaction action = { 0 };
+  action.sa_handler = _print_backtrace;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGPROF, &action, NULL);
+  _watchdog.gui_thread = pthread_self();
+  _watchdog.stop = 0;
+  dt_pthread_create(&_watchdog.sampler, _sampler, NULL);
+#endif
+
+  fprintf(stderr, "[watchdog] logging main loop iterations and signal handlers above %d ms\n", threshold);
+}
+
+static gint _compare_by_total(gconstpointer a, gconstpointer b)
+{
+  const double ta = ((const dt_gui_watchdog_signal_t *)a)->total;
+  const double tb = ((const dt_gui_watchdog_signal_t *)b)->total;
+  return (ta < tb) - (ta > tb);
+}
+
+void dt_gui_watchdog_cleanup(void)
+{
+  if(!_watchdog.enabled) return;
+
+#ifdef DT_WATCHDOG_BACKTRACE
+  __sync_lock_test_and_set(&_watchdog.stop, 1);
+  pthread_join(_watchdog.sampler, NULL);
+  signal(SIGPROF, SIG_DFL);
+#endif
+  g_main_context_set_poll_func(NULL, _watchdog.poll);
+
+  GList *signals = g_list_sort(g_hash_table_get_values(_watchdog.signals), _compare_by_total);
+  fprintf(stderr, "[watchdog] time spent in the handlers of each signal:\n");
+  for(GList *l = signals; l; l = g_list_next(l))
+  {
+    const dt_gui_watchdog_signal_t *s = (dt_gui_watchdog_signal_t *)l->data;
+    fprintf(stderr, "  %-40s %8" PRIu64 " runs %10.3fs total %9.3fms mean %9.3fms max\n", s->name, s->count,
+            s->total, s->total / MAX(s->count, 1) * 1e3, s->max * 1e3);
+  }
+  g_list_free(signals);
+
+  // the entries stay, the guards of handlers connected until the end still point to them
+  _watchdog.enabled = FALSE;
+}
+
+gboolean dt_gui_watchdog_enabled(void)
+{
+  return _watchdog.enabled;
+}
+
+static void _handler_begin(gpointer data, GClosure *closure)
+{
+  if(_handler_depth < DT_WATCHDOG_MAX_DEPTH) _handler_start[_handler_depth] = g_get_monotonic_time();
+  _handler_depth++;
+}
+
+static void _handler_end(gpointer data, GClosure *closure)
+{
+  _handler_depth--;
+  if(!_watchdog.enabled || _handler_depth >= DT_WATCHDOG_MAX_DEPTH || _handler_depth < 0) return;
+
+  const dt_gui_watchdog_guard_t *guard = (dt_gui_watchdog_guard_t *)data;
+  dt_gui_watchdog_signal_t *signal = guard->signal;
+  const double seconds = (g_get_monotonic_time() - _handler_start[_handler_depth]) * 1e-6;
+  signal->count++;
+  signal->total += seconds;
+  signal->max = MAX(signal->max, seconds);
+  dt_metrics_observe(signal->metric, seconds);
+
+  if(seconds * 1e6 > _watchdog.threshold)
+  {
+    gchar *handler = NULL;
+#ifdef DT_WATCHDOG_BACKTRACE
+    // gives the library and, for exported functions, the name of the handler
+    void *address = (void *)guard->cb;
+    char **symbols = backtrace_symbols(&address, 1);
+    if(symbols) handler = g_strdup(symbols[0]);
+    free(symbols);
+#endif
+    if(!handler) handler = g_strdup_printf("%p", (void *)guard->cb);
+    fprintf(stderr, "[watchdog] handler %s of signal `%s' took %.1f ms\n", handler, signal->name, seconds * 1e3);
+    g_free(handler);
+#ifdef DT_WATCHDOG_BACKTRACE
+    // for signals raised on the gui thread this shows where they were raised
+    void *frames[32];
+    backtrace_symbols_fd(frames, backtrace(frames, G_N_ELEMENTS(frames)), STDERR_FILENO);
+#endif
+  }
+}
+
+static void _guard_free(gpointer data, GClosure *closure)
+{
+  g_free(data);
+}
+
+void dt_gui_watchdog_guard_signal(GClosure *closure, const char *signal_name, GCallback cb)
+{
+  if(!_watchdog.enabled) return;
+
+  dt_gui_watchdog_signal_t *signal = g_hash_table_lookup(_watchdog.signals, signal_name);
+  if(!signal)
+  {
+    signal = g_malloc0(sizeof(dt_gui_watchdog_signal_t));
+    signal->name = signal_name;
+    gchar *metric = g_strdup_printf("ui.signal.%s", signal_name);
+    signal->metric = dt_metrics_get(metric, DT_METRIC_HISTOGRAM);
+    g_free(metric);
+    g_hash_table_insert(_watchdog.signals, (gpointer)signal_name, signal);
+  }
+
+  dt_gui_watchdog_guard_t *guard = g_malloc(sizeof(dt_gui_watchdog_guard_t));
+  guard->signal = signal;
+  guard->cb = cb;
+  g_closure_add_marshal_guards(closure, guard, _handler_begin, guard, _handler_end);
+  g_closure_add_finalize_notifier(closure, guard, _guard_free);
+}
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,49 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <glib-object.h>
+
+/**
+ * watchdog of the gtk main loop, to find what makes the ui stutter. off unless ui_watchdog_threshold (in ms)
+ * is set, e.g. with --conf ui_watchdog_threshold=50.
+ *
+ * - every iteration of the main loop is timed from the moment its poll returns to the next poll, which is all
+ *   the callbacks it dispatched. iterations above the threshold are logged.
+ * - a thread samples the main loop and, where the platform allows, has it print its backtrace once an
+ *   iteration has been busy for longer than the threshold, which shows the code that blocks while it still
+ *   does.
+ * - every handler of a darktable signal is timed. slow ones are logged with the signal and the handler, and a
+ *   table of the time spent per signal is printed at exit.
+ *
+ * the times also go to the metrics as ui.main_loop and ui.signal.<name>.
+ */
+
+/** reads the threshold and installs the hooks, called on the gui thread before signals are connected. */
+void dt_gui_watchdog_init(void);
+/** stops the sampling thread and prints the table of the signals. */
+void dt_gui_watchdog_cleanup(void);
+gboolean dt_gui_watchdog_enabled(void);
+
+/** has the handler cb of the closure timed as one of signal_name, see dt_control_signal_connect(). */
+void dt_gui_watchdog_guard_signal(GClosure *closure, const char *signal_name, GCallback cb);
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
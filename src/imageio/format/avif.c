@@ -40,7 +40,7 @@
 #define AVIF_MAX_TILE_SIZE 3072
 #define AVIF_DEFAULT_TILE_SIZE AVIF_MIN_TILE_SIZE * 4
 
-DT_MODULE(1)
+DT_MODULE(2)
 
 enum avif_compression_type_e {
   AVIF_COMP_LOSSLESS = 0,
@@ -52,12 +52,21 @@ enum avif_tiling_e {
   AVIF_TILING_OFF
 };
 
+enum avif_speed_preset_e {
+  AVIF_SPEED_PRESET_AUTO = 0, /* slowest for lossless, the encoder's default for lossy */
+  AVIF_SPEED_PRESET_SLOW,
+  AVIF_SPEED_PRESET_MEDIUM,
+  AVIF_SPEED_PRESET_FAST,
+  AVIF_SPEED_PRESET_FASTEST,
+};
+
 typedef struct dt_imageio_avif_t {
   dt_imageio_module_data_t global;
   uint32_t bit_depth;
   uint32_t compression_type;
   uint32_t quality;
   uint32_t tiling;
+  uint32_t speed;
 } dt_imageio_avif_t;
 
 typedef struct dt_imageio_avif_gui_t {
@@ -65,6 +74,7 @@ typedef struct dt_imageio_avif_gui_t {
   GtkWidget *compression_type;
   GtkWidget *quality;
   GtkWidget *tiling;
+  GtkWidget *speed;
 } dt_imageio_avif_gui_t;
 
 static const struct {
@@ -101,23 +111,35 @@ static const char *avif_get_compression_string(enum avif_compression_type_e comp
 }
 
 /* Lookup table for tiling choices */
-static int flp2(int i)
+/* floor(log2(i)), at most 6 as libavif doesn't take more */
+static int floor_log2(size_t i)
 {
-                                  /* 0   1,  2,  3,  4,  5,  6,  7,  8,  9 */
-  static const int flp2_table[] = {  0,  0,  2,  2,  4,  4,  4,  4,  8,  8,
-                                     8,  8,  8,  8,  8,  8, 16, 16, 16, 16,
-                                    16, 16, 16, 16, 16, 16, 16, 16, 16, 16,
-                                    16, 16, 32, 32, 32, 32, 32, 32, 32, 32,
-                                    32, 32, 32, 32, 32, 32, 32, 32, 32, 32,
-                                    32, 32, 32, 32, 32, 32, 32, 32, 32, 32,
-                                    32, 32, 32, 32 };
-                                  /* 0   1,  2,  3,  4,  5,  6,  7,  8,  9 */
-
-  if (i >= 64) {
-    return 64;
+  int log2 = 0;
+  while (i > 1 && log2 < 6) {
+    i >>= 1;
+    log2++;
   }
 
-  return flp2_table[i];
+  return log2;
+}
+
+static int avif_speed(enum avif_speed_preset_e speed, enum avif_compression_type_e comp)
+{
+  switch (speed) {
+  case AVIF_SPEED_PRESET_SLOW:
+    return 2;
+  case AVIF_SPEED_PRESET_MEDIUM:
+    return 5;
+  case AVIF_SPEED_PRESET_FAST:
+    return 8;
+  case AVIF_SPEED_PRESET_FASTEST:
+    return AVIF_SPEED_FASTEST;
+  case AVIF_SPEED_PRESET_AUTO:
+    break;
+  }
+
+  /* It isn't recommend to use the extremities */
+  return comp == AVIF_COMP_LOSSLESS ? AVIF_SPEED_SLOWEST + 1 : AVIF_SPEED_DEFAULT;
 }
 
 void init(dt_imageio_module_format_t *self)
@@ -161,6 +183,31 @@ void init(dt_imageio_module_format_t *self)
                                 dt_imageio_avif_t,
                                 quality,
                                 int);
+
+  /* encoder speed */
+  luaA_enum(darktable.lua_state.state,
+            enum avif_speed_preset_e);
+  luaA_enum_value(darktable.lua_state.state,
+                  enum avif_speed_preset_e,
+                  AVIF_SPEED_PRESET_AUTO);
+  luaA_enum_value(darktable.lua_state.state,
+                  enum avif_speed_preset_e,
+                  AVIF_SPEED_PRESET_SLOW);
+  luaA_enum_value(darktable.lua_state.state,
+                  enum avif_speed_preset_e,
+                  AVIF_SPEED_PRESET_MEDIUM);
+  luaA_enum_value(darktable.lua_state.state,
+                  enum avif_speed_preset_e,
+                  AVIF_SPEED_PRESET_FAST);
+  luaA_enum_value(darktable.lua_state.state,
+                  enum avif_speed_preset_e,
+                  AVIF_SPEED_PRESET_FASTEST);
+
+  dt_lua_register_module_member(darktable.lua_state.state,
+                                self,
+                                dt_imageio_avif_t,
+                                speed,
+                                enum avif_speed_preset_e);
 #endif
 }
 
@@ -500,18 +547,15 @@ int write_image(struct dt_imageio_module_data_t *data,
     goto out;
   }
 
+  encoder->speed = avif_speed(d->speed, d->compression_type);
+
   switch (d->compression_type) {
   case AVIF_COMP_LOSSLESS:
-    /* It isn't recommend to use the extremities */
-    encoder->speed = AVIF_SPEED_SLOWEST + 1;
-
     encoder->minQuantizer = AVIF_QUANTIZER_LOSSLESS;
     encoder->maxQuantizer = AVIF_QUANTIZER_LOSSLESS;
 
     break;
   case AVIF_COMP_LOSSY:
-    encoder->speed = AVIF_SPEED_DEFAULT;
-
     encoder->maxQuantizer = 100 - d->quality;
     encoder->maxQuantizer = CLAMP(encoder->maxQuantizer, 0, 63);
 
@@ -521,11 +565,13 @@ int write_image(struct dt_imageio_module_data_t *data,
     break;
   }
 
-  encoder->maxThreads = dt_get_num_threads();
+  /* images exported at the same time share the cores */
+  encoder->maxThreads = dt_imageio_export_threads(dt_get_num_threads());
 
   /*
    * Tiling reduces the image quality but it has a negligible impact on
-   * still images.
+   * still images. The tiles are encoded in parallel, so there should be
+   * one for every thread.
    *
    * The minmum suggested size for a tile is 512x512.
    */
@@ -541,8 +587,28 @@ int write_image(struct dt_imageio_module_data_t *data,
         height_tile_size = AVIF_MAX_TILE_SIZE;
     }
 
-    encoder->tileColsLog2 = flp2(width / width_tile_size);
-    encoder->tileRowsLog2 = flp2(height / height_tile_size);
+    int cols_log2 = floor_log2(width / width_tile_size);
+    int rows_log2 = floor_log2(height / height_tile_size);
+
+    /* split the larger tiles until every thread has one */
+    while ((1 << (cols_log2 + rows_log2)) < encoder->maxThreads) {
+      const size_t tile_width = width >> cols_log2;
+      const size_t tile_height = height >> rows_log2;
+
+      if (tile_width >= tile_height && tile_width >= 2 * AVIF_MIN_TILE_SIZE && cols_log2 < 6) {
+        cols_log2++;
+      } else if (tile_height >= 2 * AVIF_MIN_TILE_SIZE && rows_log2 < 6) {
+        rows_log2++;
+      } else if (tile_width >= 2 * AVIF_MIN_TILE_SIZE && cols_log2 < 6) {
+        cols_log2++;
+      } else {
+        break;
+      }
+    }
+
+    encoder->tileColsLog2 = cols_log2;
+    encoder->tileRowsLog2 = rows_log2;
+    break;
   }
   case AVIF_TILING_OFF:
     break;
@@ -550,13 +616,14 @@ int write_image(struct dt_imageio_module_data_t *data,
 
   dt_print(DT_DEBUG_IMAGEIO,
            "[avif quality: %u => maxQuantizer: %u, minQuantizer: %u, "
-           "tileColsLog2: %u, tileRowsLog2: %u, threads: %u]\n",
+           "tileColsLog2: %u, tileRowsLog2: %u, threads: %u, speed: %d]\n",
            d->quality,
            encoder->maxQuantizer,
            encoder->minQuantizer,
            encoder->tileColsLog2,
            encoder->tileRowsLog2,
-           encoder->maxThreads);
+           encoder->maxThreads,
+           encoder->speed);
 
   avifRWData output = AVIF_DATA_EMPTY;
 
@@ -614,6 +681,41 @@ size_t params_size(dt_imageio_module_format_t *self)
   return sizeof(dt_imageio_avif_t);
 }
 
+void *legacy_params(dt_imageio_module_format_t *self,
+                    const void *const old_params,
+                    const size_t old_params_size,
+                    const int old_version,
+                    const int new_version,
+                    size_t *new_size)
+{
+  if (old_version == 1 && new_version == 2) {
+    typedef struct dt_imageio_avif_v1_t {
+      dt_imageio_module_data_t global;
+      uint32_t bit_depth;
+      uint32_t compression_type;
+      uint32_t quality;
+      uint32_t tiling;
+    } dt_imageio_avif_v1_t;
+
+    const dt_imageio_avif_v1_t *o = (dt_imageio_avif_v1_t *)old_params;
+    dt_imageio_avif_t *n = (dt_imageio_avif_t *)calloc(1, sizeof(dt_imageio_avif_t));
+
+    if (n == NULL) {
+      return NULL;
+    }
+
+    n->global = o->global;
+    n->bit_depth = o->bit_depth;
+    n->compression_type = o->compression_type;
+    n->quality = o->quality;
+    n->tiling = o->tiling;
+    n->speed = AVIF_SPEED_PRESET_AUTO;
+    *new_size = self->params_size(self);
+    return n;
+  }
+  return NULL;
+}
+
 void *get_params(dt_imageio_module_format_t *self)
 {
   dt_imageio_avif_t *d = (dt_imageio_avif_t *)calloc(1, sizeof(dt_imageio_avif_t));
@@ -643,6 +745,11 @@ void *get_params(dt_imageio_module_format_t *self)
 
   d->tiling = dt_conf_get_int("plugins/imageio/format/avif/tiling");
 
+  d->speed = dt_conf_get_int("plugins/imageio/format/avif/speed");
+  if (d->speed > AVIF_SPEED_PRESET_FASTEST) {
+      d->speed = AVIF_SPEED_PRESET_AUTO;
+  }
+
   return d;
 }
 
@@ -660,6 +767,7 @@ int set_params(dt_imageio_module_format_t *self,
   dt_bauhaus_combobox_set(g->tiling, d->tiling);
   dt_bauhaus_combobox_set(g->compression_type, d->compression_type);
   dt_bauhaus_slider_set(g->quality, d->quality);
+  dt_bauhaus_combobox_set(g->speed, d->speed);
 
   return 0;
 }
@@ -698,7 +806,7 @@ const char *name()
 
 int flags(struct dt_imageio_module_data_t *data)
 {
-  return FORMAT_FLAGS_SUPPORT_XMP;
+  return FORMAT_FLAGS_SUPPORT_XMP | FORMAT_FLAGS_PARALLEL;
 }
 
 static void bit_depth_changed(GtkWidget *widget, gpointer user_data)
@@ -715,6 +823,13 @@ static void tiling_changed(GtkWidget *widget, gpointer user_data)
   dt_conf_set_int("plugins/imageio/format/avif/tiling", tiling);
 }
 
+static void speed_changed(GtkWidget *widget, gpointer user_data)
+{
+  const enum avif_speed_preset_e speed = dt_bauhaus_combobox_get(widget);
+
+  dt_conf_set_int("plugins/imageio/format/avif/speed", speed);
+}
+
 static void compression_type_changed(GtkWidget *widget, gpointer user_data)
 {
   const enum avif_compression_type_e compression_type = dt_bauhaus_combobox_get(widget);
@@ -747,6 +862,7 @@ void gui_init(dt_imageio_module_format_t *self)
   const enum avif_tiling_e tiling = dt_conf_get_int("plugins/imageio/format/avif/tiling");
   const enum avif_compression_type_e compression_type = dt_conf_get_int("plugins/imageio/format/avif/compression_type");
   const uint32_t quality = dt_conf_get_int("plugins/imageio/format/avif/quality");
+  const enum avif_speed_preset_e speed = dt_conf_get_int("plugins/imageio/format/avif/speed");
 
   self->gui_data = (void *)gui;
 
@@ -856,6 +972,37 @@ void gui_init(dt_imageio_module_format_t *self)
     break;
   }
 
+  /*
+   * Encoder speed combo box
+   */
+  gui->speed = dt_bauhaus_combobox_new(NULL);
+  dt_bauhaus_widget_set_label(gui->speed,
+                              NULL,
+                              _("encoding speed"));
+  dt_bauhaus_combobox_add(gui->speed,
+                          _("auto"));
+  dt_bauhaus_combobox_add(gui->speed,
+                          _("slow"));
+  dt_bauhaus_combobox_add(gui->speed,
+                          _("medium"));
+  dt_bauhaus_combobox_add(gui->speed,
+                          _("fast"));
+  dt_bauhaus_combobox_add(gui->speed,
+                          _("fastest"));
+  dt_bauhaus_combobox_set(gui->speed, speed);
+
+  gtk_widget_set_tooltip_text(gui->speed,
+          _("how much effort the encoder spends on compressing.\n"
+            "\n"
+            "faster settings give larger files at the same quality. "
+            "auto is slow for lossless images and the encoder default for lossy ones."));
+
+  gtk_box_pack_start(GTK_BOX(self->widget),
+                     gui->speed,
+                     TRUE,
+                     TRUE,
+                     0);
+
   g_signal_connect(G_OBJECT(gui->bit_depth),
                    "value-changed",
                    G_CALLBACK(bit_depth_changed),
@@ -872,6 +1019,10 @@ void gui_init(dt_imageio_module_format_t *self)
                    "value-changed",
                    G_CALLBACK(quality_changed),
                    NULL);
+  g_signal_connect(G_OBJECT(gui->speed),
+                   "value-changed",
+                   G_CALLBACK(speed_changed),
+                   NULL);
 }
 
 void gui_cleanup(dt_imageio_module_format_t *self)
@@ -25,6 +25,7 @@
 
 #include <OpenEXR/ImfChannelList.h>
 #include <OpenEXR/ImfFrameBuffer.h>
+#include <OpenEXR/ImfOutputFile.h>
 #include <OpenEXR/ImfStandardAttributes.h>
 #include <OpenEXR/ImfThreading.h>
 #include <OpenEXR/ImfTiledOutputFile.h>
@@ -46,7 +47,7 @@ extern "C" {
 extern "C" {
 #endif
 
-DT_MODULE(4)
+DT_MODULE(5)
 
 enum dt_imageio_exr_compression_t
 {
@@ -63,15 +64,23 @@ enum dt_imageio_exr_compression_t
   NUM_COMPRESSION_METHODS // number of different compression methods
 };                        // copy of Imf::Compression
 
+typedef enum dt_imageio_exr_layout_t
+{
+  EXR_LAYOUT_TILES = 0,    // tiles of 100x100 pixels
+  EXR_LAYOUT_SCANLINES = 1
+} dt_imageio_exr_layout_t;
+
 typedef struct dt_imageio_exr_t
 {
   dt_imageio_module_data_t global;
   dt_imageio_exr_compression_t compression;
+  dt_imageio_exr_layout_t layout;
 } dt_imageio_exr_t;
 
 typedef struct dt_imageio_exr_gui_t
 {
   GtkWidget *compression;
+  GtkWidget *layout;
 } dt_imageio_exr_gui_t;
 
 void init(dt_imageio_module_format_t *self)
@@ -89,6 +98,11 @@ void init(dt_imageio_module_format_t *self)
 
   dt_lua_register_module_member(darktable.lua_state.state, self, dt_imageio_exr_t, compression,
                                 dt_imageio_exr_compression_t);
+  luaA_enum(darktable.lua_state.state, dt_imageio_exr_layout_t);
+  luaA_enum_value_name(darktable.lua_state.state, dt_imageio_exr_layout_t, EXR_LAYOUT_TILES, "tiles");
+  luaA_enum_value_name(darktable.lua_state.state, dt_imageio_exr_layout_t, EXR_LAYOUT_SCANLINES, "scanlines");
+  dt_lua_register_module_member(darktable.lua_state.state, self, dt_imageio_exr_t, layout,
+                                dt_imageio_exr_layout_t);
 #endif
   Imf::BlobAttribute::registerAttributeType();
 }
@@ -97,20 +111,12 @@ void cleanup(dt_imageio_module_format_t *self)
 {
 }
 
-int write_image(dt_imageio_module_data_t *tmp, const char *filename, const void *in_tmp,
-                dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
-                void *exif, int exif_len, int imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
-                const gboolean export_masks)
+// fills in everything but the pixels
+static void _set_header(Imf::Header &header, void *exif, int exif_len, int imgid,
+                        dt_colorspaces_color_profile_type_t over_type, const char *over_filename)
 {
-  const dt_imageio_exr_t *exr = (dt_imageio_exr_t *)tmp;
-
-  Imf::setGlobalThreadCount(dt_get_num_threads());
-
   Imf::Blob exif_blob(exif_len, (uint8_t *)exif);
 
-  Imf::Header header(exr->global.width, exr->global.height, 1, Imath::V2f(0, 0), 1, Imf::INCREASING_Y,
-                     (Imf::Compression)exr->compression);
-
   char comment[1024];
   snprintf(comment, sizeof(comment), "Developed using %s", darktable_package_string);
 
@@ -190,35 +196,195 @@ icc_error:
     fprintf(stderr, "[exr export] warning: exporting with anything but linear matrix profiles might lead to wrong results when opening the image\n");
   }
 icc_end:
+  return;
+}
+
+#define DT_EXR_TILE_SIZE 100
 
+// sizes the global pool of OpenEXR, which all files being written share, and returns the share of one file.
+// several exports at the same time then don't each ask for all cores.
+static int _file_threads()
+{
+  const int threads = dt_conf_get_int("plugins/imageio/format/exr/threads");
+  const int pool = threads > 0 ? threads : dt_get_num_threads();
+  if(Imf::globalThreadCount() != pool) Imf::setGlobalThreadCount(pool);
+  return dt_imageio_export_threads(pool);
+}
 
+static void _set_layout(Imf::Header &header, const gboolean tiled)
+{
   header.channels().insert("R", Imf::Channel(Imf::PixelType::FLOAT));
   header.channels().insert("G", Imf::Channel(Imf::PixelType::FLOAT));
   header.channels().insert("B", Imf::Channel(Imf::PixelType::FLOAT));
 
-  header.setTileDescription(Imf::TileDescription(100, 100, Imf::ONE_LEVEL));
-
-  Imf::TiledOutputFile file(filename, header);
+  if(tiled) header.setTileDescription(Imf::TileDescription(DT_EXR_TILE_SIZE, DT_EXR_TILE_SIZE, Imf::ONE_LEVEL));
+}
 
+// origin is where pixel (0, 0) of the image would be
+static Imf::FrameBuffer _frame_buffer(const float *origin, const size_t width)
+{
   Imf::FrameBuffer data;
 
-  const float *in = (const float *)in_tmp;
+  data.insert("R", Imf::Slice(Imf::PixelType::FLOAT, (char *)(origin + 0), 4 * sizeof(float),
+                              4 * sizeof(float) * width));
 
-  data.insert("R", Imf::Slice(Imf::PixelType::FLOAT, (char *)(in + 0), 4 * sizeof(float),
-                              4 * sizeof(float) * exr->global.width));
+  data.insert("G", Imf::Slice(Imf::PixelType::FLOAT, (char *)(origin + 1), 4 * sizeof(float),
+                              4 * sizeof(float) * width));
 
-  data.insert("G", Imf::Slice(Imf::PixelType::FLOAT, (char *)(in + 1), 4 * sizeof(float),
-                              4 * sizeof(float) * exr->global.width));
+  data.insert("B", Imf::Slice(Imf::PixelType::FLOAT, (char *)(origin + 2), 4 * sizeof(float),
+                              4 * sizeof(float) * width));
+  return data;
+}
 
-  data.insert("B", Imf::Slice(Imf::PixelType::FLOAT, (char *)(in + 2), 4 * sizeof(float),
-                              4 * sizeof(float) * exr->global.width));
+int write_image(dt_imageio_module_data_t *tmp, const char *filename, const void *in_tmp,
+                dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                void *exif, int exif_len, int imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
+                const gboolean export_masks)
+{
+  const dt_imageio_exr_t *exr = (dt_imageio_exr_t *)tmp;
+  const gboolean tiled = exr->layout == EXR_LAYOUT_TILES;
+  const int threads = _file_threads();
+
+  Imf::Header header(exr->global.width, exr->global.height, 1, Imath::V2f(0, 0), 1, Imf::INCREASING_Y,
+                     (Imf::Compression)exr->compression);
+  _set_header(header, exif, exif_len, imgid, over_type, over_filename);
+  _set_layout(header, tiled);
+
+  const Imf::FrameBuffer data = _frame_buffer((const float *)in_tmp, exr->global.width);
 
-  file.setFrameBuffer(data);
-  file.writeTiles(0, file.numXTiles() - 1, 0, file.numYTiles() - 1);
+  if(tiled)
+  {
+    Imf::TiledOutputFile file(filename, header, threads);
+    file.setFrameBuffer(data);
+    file.writeTiles(0, file.numXTiles() - 1, 0, file.numYTiles() - 1);
+  }
+  else
+  {
+    Imf::OutputFile file(filename, header, threads);
+    file.setFrameBuffer(data);
+    file.writePixels(exr->global.height);
+  }
 
   return 0;
 }
 
+// an exr written row by row as the pipe finishes them. scanline files take the rows right away, for tiled ones
+// they are collected until a whole row of tiles can be written.
+typedef struct dt_imageio_exr_stream_t
+{
+  Imf::TiledOutputFile *tiles;
+  Imf::OutputFile *lines;
+  float *band; // one row of tiles
+  int tile_row; // the one being collected
+} dt_imageio_exr_stream_t;
+
+static void _write_band(const dt_imageio_exr_t *exr, dt_imageio_exr_stream_t *stream)
+{
+  // the slices are addressed in image coordinates
+  const size_t stride = (size_t)4 * exr->global.width;
+  const float *origin = stream->band - (size_t)stream->tile_row * DT_EXR_TILE_SIZE * stride;
+  stream->tiles->setFrameBuffer(_frame_buffer(origin, exr->global.width));
+  stream->tiles->writeTiles(0, stream->tiles->numXTiles() - 1, stream->tile_row, stream->tile_row);
+  stream->tile_row++;
+}
+
+void *write_image_begin(dt_imageio_module_data_t *tmp, const char *filename,
+                        dt_colorspaces_color_profile_type_t over_type, const char *over_filename, void *exif,
+                        int exif_len, int imgid, int num, int total)
+{
+  const dt_imageio_exr_t *exr = (dt_imageio_exr_t *)tmp;
+  const gboolean tiled = exr->layout == EXR_LAYOUT_TILES;
+  const int threads = _file_threads();
+
+  Imf::Header header(exr->global.width, exr->global.height, 1, Imath::V2f(0, 0), 1, Imf::INCREASING_Y,
+                     (Imf::Compression)exr->compression);
+  _set_header(header, exif, exif_len, imgid, over_type, over_filename);
+  _set_layout(header, tiled);
+
+  dt_imageio_exr_stream_t *stream = (dt_imageio_exr_stream_t *)calloc(1, sizeof(dt_imageio_exr_stream_t));
+  if(tiled)
+  {
+    stream->band = (float *)dt_alloc_align(64, sizeof(float) * 4 * exr->global.width * DT_EXR_TILE_SIZE);
+    if(!stream->band)
+    {
+      free(stream);
+      return NULL;
+    }
+  }
+  try
+  {
+    if(tiled)
+      stream->tiles = new Imf::TiledOutputFile(filename, header, threads);
+    else
+      stream->lines = new Imf::OutputFile(filename, header, threads);
+  }
+  catch(const std::exception &e)
+  {
+    fprintf(stderr, "[exr export] can't write `%s': %s\n", filename, e.what());
+    dt_free_align(stream->band);
+    free(stream);
+    return NULL;
+  }
+  return stream;
+}
+
+int write_rows(dt_imageio_module_data_t *tmp, void *state, const void *in_tmp, int y, int height)
+{
+  const dt_imageio_exr_t *exr = (dt_imageio_exr_t *)tmp;
+  dt_imageio_exr_stream_t *stream = (dt_imageio_exr_stream_t *)state;
+  const size_t stride = (size_t)4 * exr->global.width;
+  const float *in = (const float *)in_tmp;
+
+  try
+  {
+    if(stream->lines)
+    {
+      stream->lines->setFrameBuffer(_frame_buffer(in - y * stride, exr->global.width));
+      stream->lines->writePixels(height);
+      return 0;
+    }
+
+    while(height > 0)
+    {
+      const int band_y = y - stream->tile_row * DT_EXR_TILE_SIZE;
+      const int band_height = MIN(DT_EXR_TILE_SIZE, exr->global.height - stream->tile_row * DT_EXR_TILE_SIZE);
+      const int rows = MIN(height, band_height - band_y);
+      memcpy(stream->band + band_y * stride, in, sizeof(float) * stride * rows);
+      if(band_y + rows == band_height) _write_band(exr, stream);
+      in += rows * stride;
+      y += rows;
+      height -= rows;
+    }
+  }
+  catch(const std::exception &e)
+  {
+    fprintf(stderr, "[exr export] error writing rows: %s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
+
+int write_image_end(dt_imageio_module_data_t *tmp, void *state, const gboolean failed)
+{
+  dt_imageio_exr_stream_t *stream = (dt_imageio_exr_stream_t *)state;
+  int rc = failed;
+  try
+  {
+    // closes the file
+    delete stream->tiles;
+    delete stream->lines;
+  }
+  catch(...)
+  {
+    rc = 1;
+  }
+  dt_free_align(stream->band);
+  free(stream);
+  return rc;
+}
+
+#undef DT_EXR_TILE_SIZE
+
 size_t params_size(dt_imageio_module_format_t *self)
 {
   return sizeof(dt_imageio_exr_t);
@@ -228,7 +394,7 @@ void *legacy_params(dt_imageio_module_format_t *self, const void *const old_para
                     const size_t old_params_size, const int old_version, const int new_version,
                     size_t *new_size)
 {
-  if(old_version == 1 && new_version == 4)
+  if(old_version == 1 && new_version == 5)
   {
     struct dt_imageio_exr_v1_t
     {
@@ -247,10 +413,11 @@ void *legacy_params(dt_imageio_module_format_t *self, const void *const old_para
     g_strlcpy(n->global.style, o->style, sizeof(o->style));
     n->global.style_append = FALSE;
     n->compression = (dt_imageio_exr_compression_t)PIZ_COMPRESSION;
+    n->layout = EXR_LAYOUT_TILES;
     *new_size = self->params_size(self);
     return n;
   }
-  if(old_version == 2 && new_version == 4)
+  if(old_version == 2 && new_version == 5)
   {
     enum dt_imageio_exr_pixeltype_t
     {
@@ -280,10 +447,11 @@ void *legacy_params(dt_imageio_module_format_t *self, const void *const old_para
     g_strlcpy(n->global.style, o->style, sizeof(o->style));
     n->global.style_append = FALSE;
     n->compression = o->compression;
+    n->layout = EXR_LAYOUT_TILES;
     *new_size = self->params_size(self);
     return n;
   }
-  if(old_version == 3 && new_version == 4)
+  if(old_version == 3 && new_version == 5)
   {
     struct dt_imageio_exr_v3_t
     {
@@ -303,6 +471,24 @@ void *legacy_params(dt_imageio_module_format_t *self, const void *const old_para
     g_strlcpy(n->global.style, o->style, sizeof(o->style));
     n->global.style_append = FALSE;
     n->compression = o->compression;
+    n->layout = EXR_LAYOUT_TILES;
+    *new_size = self->params_size(self);
+    return n;
+  }
+  if(old_version == 4 && new_version == 5)
+  {
+    struct dt_imageio_exr_v4_t
+    {
+      dt_imageio_module_data_t global;
+      dt_imageio_exr_compression_t compression;
+    };
+
+    const dt_imageio_exr_v4_t *o = (dt_imageio_exr_v4_t *)old_params;
+    dt_imageio_exr_t *n = (dt_imageio_exr_t *)malloc(sizeof(dt_imageio_exr_t));
+
+    n->global = o->global;
+    n->compression = o->compression;
+    n->layout = EXR_LAYOUT_TILES;
     *new_size = self->params_size(self);
     return n;
   }
@@ -313,6 +499,7 @@ void *get_params(dt_imageio_module_format_t *self)
 {
   dt_imageio_exr_t *d = (dt_imageio_exr_t *)calloc(1, sizeof(dt_imageio_exr_t));
   d->compression = (dt_imageio_exr_compression_t)dt_conf_get_int("plugins/imageio/format/exr/compression");
+  d->layout = dt_conf_get_bool("plugins/imageio/format/exr/tiled") ? EXR_LAYOUT_TILES : EXR_LAYOUT_SCANLINES;
   return d;
 }
 
@@ -327,6 +514,7 @@ int set_params(dt_imageio_module_format_t *self, const void *params, const int s
   dt_imageio_exr_t *d = (dt_imageio_exr_t *)params;
   dt_imageio_exr_gui_t *g = (dt_imageio_exr_gui_t *)self->gui_data;
   dt_bauhaus_combobox_set(g->compression, d->compression);
+  dt_bauhaus_combobox_set(g->layout, d->layout);
   return 0;
 }
 
@@ -361,6 +549,11 @@ static void combobox_changed(GtkWidget *widget, gpointer user_data)
   dt_conf_set_int("plugins/imageio/format/exr/compression", compression);
 }
 
+static void layout_changed(GtkWidget *widget, gpointer user_data)
+{
+  dt_conf_set_bool("plugins/imageio/format/exr/tiled", dt_bauhaus_combobox_get(widget) == EXR_LAYOUT_TILES);
+}
+
 void gui_init(dt_imageio_module_format_t *self)
 {
   self->gui_data = malloc(sizeof(dt_imageio_exr_gui_t));
@@ -384,6 +577,17 @@ void gui_init(dt_imageio_module_format_t *self)
   dt_bauhaus_combobox_set(gui->compression, compression_last);
   gtk_box_pack_start(GTK_BOX(self->widget), gui->compression, TRUE, TRUE, 0);
   g_signal_connect(G_OBJECT(gui->compression), "value-changed", G_CALLBACK(combobox_changed), NULL);
+
+  gui->layout = dt_bauhaus_combobox_new(NULL);
+  dt_bauhaus_widget_set_label(gui->layout, NULL, _("layout"));
+  dt_bauhaus_combobox_add(gui->layout, _("tiles"));
+  dt_bauhaus_combobox_add(gui->layout, _("scanlines"));
+  dt_bauhaus_combobox_set(gui->layout, dt_conf_get_bool("plugins/imageio/format/exr/tiled") ? EXR_LAYOUT_TILES
+                                                                                            : EXR_LAYOUT_SCANLINES);
+  gtk_widget_set_tooltip_text(gui->layout, _("tiled files load faster in parts, many compositing applications "
+                                             "prefer scanlines"));
+  gtk_box_pack_start(GTK_BOX(self->widget), gui->layout, TRUE, TRUE, 0);
+  g_signal_connect(G_OBJECT(gui->layout), "value-changed", G_CALLBACK(layout_changed), NULL);
 }
 
 void gui_cleanup(dt_imageio_module_format_t *self)
@@ -80,6 +80,15 @@ int write_image(struct dt_imageio_module_data_t *data, const char *filename, con
                 dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
                 void *exif, int exif_len, int imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
                 const gboolean export_masks);
+/* optional: write the image while the pipe is still processing it. write_image_begin() opens the file and
+   returns the state handed to the other two, or NULL on failure. exif has to stay valid until the end.
+   write_rows() takes rows [y, y + height) in order from top to bottom, in the same layout as write_image().
+   write_image_end() finishes the file, or just cleans up if failed is set. both return != 0 on failure. */
+void *write_image_begin(struct dt_imageio_module_data_t *data, const char *filename,
+                        dt_colorspaces_color_profile_type_t over_type, const char *over_filename, void *exif,
+                        int exif_len, int imgid, int num, int total);
+int write_rows(struct dt_imageio_module_data_t *data, void *state, const void *in, int y, int height);
+int write_image_end(struct dt_imageio_module_data_t *data, void *state, const gboolean failed);
 /* flag that describes the available precision/levels of output format. mainly used for dithering. */
 int levels(struct dt_imageio_module_data_t *data);
 
@@ -681,7 +681,7 @@ void gui_reset(dt_imageio_module_format_t *self)
 int flags(dt_imageio_module_data_t *data)
 {
   dt_imageio_j2k_t *j = (dt_imageio_j2k_t *)data;
-  return ((j && j->format == JP2_CFMT) ? FORMAT_FLAGS_SUPPORT_XMP : 0);
+  return ((j && j->format == JP2_CFMT) ? FORMAT_FLAGS_SUPPORT_XMP : 0) | FORMAT_FLAGS_PARALLEL;
 }
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
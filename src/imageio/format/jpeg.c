@@ -307,41 +307,32 @@ read_icc_profile (j_decompress_ptr cinfo,
 #undef MAX_SEQ_NO
 
 
-int write_image(dt_imageio_module_data_t *jpg_tmp, const char *filename, const void *in_tmp,
-                dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
-                void *exif, int exif_len, int imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
-                const gboolean export_masks)
-{
-  dt_imageio_jpeg_t *jpg = (dt_imageio_jpeg_t *)jpg_tmp;
-  const uint8_t *in = (const uint8_t *)in_tmp;
-  struct dt_imageio_jpeg_error_mgr jerr;
+// images smaller than this are encoded in one piece
+#define DT_JPEG_PARALLEL_MIN_PIXELS (4 * 1024 * 1024)
+// stripes per thread, so that a slow one doesn't hold up the others for long
+#define DT_JPEG_STRIPES_PER_THREAD 4
 
-  jpg->cinfo.err = jpeg_std_error(&jerr.pub);
-  jerr.pub.error_exit = dt_imageio_jpeg_error_exit;
-  if(setjmp(jerr.setjmp_buffer))
-  {
-    jpeg_destroy_compress(&(jpg->cinfo));
-    return 1;
-  }
-  jpeg_create_compress(&(jpg->cinfo));
-  FILE *f = g_fopen(filename, "wb");
-  if(!f) return 1;
-  jpeg_stdio_dest(&(jpg->cinfo), f);
+static void _samp_factors(const int quality, int *h, int *v)
+{
+  *v = quality > 90 ? 1 : 2;
+  *h = quality > 92 ? 1 : 2;
+}
 
-  jpg->cinfo.image_width = jpg->global.width;
-  jpg->cinfo.image_height = jpg->global.height;
-  jpg->cinfo.input_components = 3;
-  jpg->cinfo.in_color_space = JCS_RGB;
-  jpeg_set_defaults(&(jpg->cinfo));
-  jpeg_set_quality(&(jpg->cinfo), jpg->quality, TRUE);
-  if(jpg->quality > 90) jpg->cinfo.comp_info[0].v_samp_factor = 1;
-  if(jpg->quality > 92) jpg->cinfo.comp_info[0].h_samp_factor = 1;
-  if(jpg->quality > 95) jpg->cinfo.dct_method = JDCT_FLOAT;
-  if(jpg->quality < 50) jpg->cinfo.dct_method = JDCT_IFAST;
-  if(jpg->quality < 80) jpg->cinfo.smoothing_factor = 20;
-  if(jpg->quality < 60) jpg->cinfo.smoothing_factor = 40;
-  if(jpg->quality < 40) jpg->cinfo.smoothing_factor = 60;
-  jpg->cinfo.optimize_coding = 1;
+static void _setup_compress(const dt_imageio_jpeg_t *jpg, j_compress_ptr cinfo, const int height)
+{
+  cinfo->image_width = jpg->global.width;
+  cinfo->image_height = height;
+  cinfo->input_components = 3;
+  cinfo->in_color_space = JCS_RGB;
+  jpeg_set_defaults(cinfo);
+  jpeg_set_quality(cinfo, jpg->quality, TRUE);
+  _samp_factors(jpg->quality, &cinfo->comp_info[0].h_samp_factor, &cinfo->comp_info[0].v_samp_factor);
+  if(jpg->quality > 95) cinfo->dct_method = JDCT_FLOAT;
+  if(jpg->quality < 50) cinfo->dct_method = JDCT_IFAST;
+  if(jpg->quality < 80) cinfo->smoothing_factor = 20;
+  if(jpg->quality < 60) cinfo->smoothing_factor = 40;
+  if(jpg->quality < 40) cinfo->smoothing_factor = 60;
+  cinfo->optimize_coding = 1;
 
   // according to specs density_unit = 0, X_density = 1, Y_density = 1 should be fine and valid since it
   // describes an image with unknown unit and square pixels.
@@ -350,46 +341,269 @@ int write_image(dt_imageio_module_data_t *jpg_tmp, const char *filename, const v
   const int resolution = dt_conf_get_int("metadata/resolution");
   if(resolution > 0)
   {
-    jpg->cinfo.density_unit = 1;
-    jpg->cinfo.X_density = resolution;
-    jpg->cinfo.Y_density = resolution;
+    cinfo->density_unit = 1;
+    cinfo->X_density = resolution;
+    cinfo->Y_density = resolution;
   }
   else
   {
-    jpg->cinfo.density_unit = 0;
-    jpg->cinfo.X_density = 1;
-    jpg->cinfo.Y_density = 1;
+    cinfo->density_unit = 0;
+    cinfo->X_density = 1;
+    cinfo->Y_density = 1;
   }
+}
 
-  jpeg_start_compress(&(jpg->cinfo), TRUE);
+static void _write_rows(j_compress_ptr cinfo, const uint8_t *in, const int width)
+{
+  uint8_t *row = dt_alloc_align(64, (size_t)3 * width * sizeof(uint8_t));
+  while(cinfo->next_scanline < cinfo->image_height)
+  {
+    JSAMPROW tmp[1];
+    const uint8_t *buf = in + (size_t)cinfo->next_scanline * width * 4;
+    for(int i = 0; i < width; i++)
+      for(int k = 0; k < 3; k++) row[3 * i + k] = buf[4 * i + k];
+    tmp[0] = row;
+    jpeg_write_scanlines(cinfo, tmp, 1);
+  }
+  dt_free_align(row);
+}
+
+// growing memory destination for the stripes
+typedef struct dt_imageio_jpeg_memory_dest_t
+{
+  struct jpeg_destination_mgr pub;
+  uint8_t *data;
+  size_t size, allocated;
+} dt_imageio_jpeg_memory_dest_t;
+
+static void _memory_init_destination(j_compress_ptr cinfo)
+{
+  dt_imageio_jpeg_memory_dest_t *dest = (dt_imageio_jpeg_memory_dest_t *)cinfo->dest;
+  dest->allocated = 1 << 16;
+  dest->data = g_malloc(dest->allocated);
+  dest->pub.next_output_byte = dest->data;
+  dest->pub.free_in_buffer = dest->allocated;
+}
 
+static boolean _memory_empty_output_buffer(j_compress_ptr cinfo)
+{
+  dt_imageio_jpeg_memory_dest_t *dest = (dt_imageio_jpeg_memory_dest_t *)cinfo->dest;
+  const size_t used = dest->allocated;
+  dest->allocated *= 2;
+  dest->data = g_realloc(dest->data, dest->allocated);
+  dest->pub.next_output_byte = dest->data + used;
+  dest->pub.free_in_buffer = dest->allocated - used;
+  return TRUE;
+}
+
+static void _memory_term_destination(j_compress_ptr cinfo)
+{
+  dt_imageio_jpeg_memory_dest_t *dest = (dt_imageio_jpeg_memory_dest_t *)cinfo->dest;
+  dest->size = dest->allocated - dest->pub.free_in_buffer;
+}
+
+// encodes rows [y, y + height) as a jpeg of their own with the standard huffman tables, so that the scans of all
+// stripes can be joined. only the first one carries the icc profile.
+static int _encode_stripe(const dt_imageio_jpeg_t *jpg, const uint8_t *in, const int y, const int height,
+                          const uint8_t *icc, const unsigned int icc_len, dt_imageio_jpeg_memory_dest_t *dest)
+{
+  struct jpeg_compress_struct cinfo;
+  struct dt_imageio_jpeg_error_mgr jerr;
+  dest->data = NULL;
+  cinfo.err = jpeg_std_error(&jerr.pub);
+  jerr.pub.error_exit = dt_imageio_jpeg_error_exit;
+  if(setjmp(jerr.setjmp_buffer))
+  {
+    jpeg_destroy_compress(&cinfo);
+    g_free(dest->data);
+    dest->data = NULL;
+    return 1;
+  }
+  jpeg_create_compress(&cinfo);
+  dest->pub.init_destination = _memory_init_destination;
+  dest->pub.empty_output_buffer = _memory_empty_output_buffer;
+  dest->pub.term_destination = _memory_term_destination;
+  cinfo.dest = &dest->pub;
+
+  _setup_compress(jpg, &cinfo, height);
+  cinfo.optimize_coding = 0;
+  jpeg_start_compress(&cinfo, TRUE);
+  if(icc_len) write_icc_profile(&cinfo, icc, icc_len);
+  _write_rows(&cinfo, in + (size_t)y * jpg->global.width * 4, jpg->global.width);
+  jpeg_finish_compress(&cinfo);
+  jpeg_destroy_compress(&cinfo);
+  return 0;
+}
+
+// finds the frame header and the scan header of a jpeg written by libjpeg, returns where the scan data starts
+static size_t _find_scan(const uint8_t *data, const size_t size, size_t *sof, size_t *sos)
+{
+  *sof = *sos = 0;
+  size_t i = 2; // SOI
+  while(i + 4 <= size && data[i] == 0xff)
+  {
+    const int marker = data[i + 1];
+    const size_t len = (data[i + 2] << 8) | data[i + 3];
+    if(marker == 0xc0 || marker == 0xc1) *sof = i;
+    if(marker == 0xda)
+    {
+      *sos = i;
+      return *sof ? i + 2 + len : 0;
+    }
+    i += 2 + len;
+  }
+  return 0;
+}
+
+// the image is cut into stripes of whole mcu rows which get encoded at the same time. their scans are joined with
+// restart markers between them, a restart interval of one stripe resets the dc prediction just like a new
+// encoder does. the result is a single baseline jpeg. returns -1 if the image doesn't suit this.
+static int _write_image_parallel(const dt_imageio_jpeg_t *jpg, FILE *f, const uint8_t *in, const uint8_t *icc,
+                                 const unsigned int icc_len)
+{
+  const int width = jpg->global.width, height = jpg->global.height;
+  // concurrent exports share the cores
+  const int threads = dt_imageio_export_threads(dt_get_num_threads());
+  if(threads < 2 || (size_t)width * height < DT_JPEG_PARALLEL_MIN_PIXELS) return -1;
+  // smoothing would look across the stripe borders
+  if(jpg->quality < 80) return -1;
+
+  int h, v;
+  _samp_factors(jpg->quality, &h, &v);
+  const int mcus_per_row = (width + 8 * h - 1) / (8 * h);
+  const int mcu_rows = (height + 8 * v - 1) / (8 * v);
+  // a restart interval has at most 65535 mcus
+  const int max_stripe_mcu_rows = 65535 / mcus_per_row;
+  const int stripe_mcu_rows
+      = MIN(max_stripe_mcu_rows, (mcu_rows + threads * DT_JPEG_STRIPES_PER_THREAD - 1)
+                                     / (threads * DT_JPEG_STRIPES_PER_THREAD));
+  if(stripe_mcu_rows < 1) return -1;
+  const int stripe_height = stripe_mcu_rows * 8 * v;
+  const int stripes = (height + stripe_height - 1) / stripe_height;
+  if(stripes < 2) return -1;
+
+  dt_imageio_jpeg_memory_dest_t *dest = calloc(stripes, sizeof(dt_imageio_jpeg_memory_dest_t));
+  int err = 0;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) num_threads(threads) \
+  dt_omp_firstprivate(jpg, in, icc, icc_len, dest, stripes, stripe_height, height) reduction(| : err) \
+  schedule(dynamic)
+#endif
+  for(int k = 0; k < stripes; k++)
+  {
+    const int y = k * stripe_height;
+    err |= _encode_stripe(jpg, in, y, MIN(stripe_height, height - y), k == 0 ? icc : NULL, k == 0 ? icc_len : 0,
+                          dest + k);
+  }
+
+  size_t sof = 0, sos = 0, scan = 0;
+  if(!err)
+  {
+    scan = _find_scan(dest[0].data, dest[0].size, &sof, &sos);
+    err = scan == 0;
+  }
+  if(!err)
+  {
+    // the headers of the first stripe with the height of the whole image and the restart interval
+    uint8_t *header = dest[0].data;
+    header[sof + 5] = height >> 8;
+    header[sof + 6] = height & 0xff;
+    const int interval = stripe_mcu_rows * mcus_per_row;
+    const uint8_t dri[6] = { 0xff, 0xdd, 0x00, 0x04, interval >> 8, interval & 0xff };
+    err |= fwrite(header, 1, sos, f) != sos;
+    err |= fwrite(dri, 1, sizeof(dri), f) != sizeof(dri);
+    err |= fwrite(header + sos, 1, scan - sos, f) != scan - sos;
+
+    for(int k = 0; k < stripes && !err; k++)
+    {
+      size_t start = scan;
+      if(k > 0)
+      {
+        const uint8_t rst[2] = { 0xff, 0xd0 + ((k - 1) & 7) };
+        err |= fwrite(rst, 1, sizeof(rst), f) != sizeof(rst);
+        size_t stripe_sof, stripe_sos;
+        start = _find_scan(dest[k].data, dest[k].size, &stripe_sof, &stripe_sos);
+        if(!start)
+        {
+          err = 1;
+          break;
+        }
+      }
+      // without the EOI
+      const size_t len = dest[k].size - 2 - start;
+      err |= fwrite(dest[k].data + start, 1, len, f) != len;
+    }
+    const uint8_t eoi[2] = { 0xff, 0xd9 };
+    err |= fwrite(eoi, 1, sizeof(eoi), f) != sizeof(eoi);
+  }
+
+  for(int k = 0; k < stripes; k++) g_free(dest[k].data);
+  free(dest);
+  return err ? 1 : 0;
+}
+
+int write_image(dt_imageio_module_data_t *jpg_tmp, const char *filename, const void *in_tmp,
+                dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                void *exif, int exif_len, int imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
+                const gboolean export_masks)
+{
+  dt_imageio_jpeg_t *jpg = (dt_imageio_jpeg_t *)jpg_tmp;
+  const uint8_t *in = (const uint8_t *)in_tmp;
+
+  unsigned char *icc = NULL;
+  uint32_t icc_len = 0;
   if(imgid > 0)
   {
     cmsHPROFILE out_profile = dt_colorspaces_get_output_profile(imgid, over_type, over_filename)->profile;
-    uint32_t len = 0;
-    cmsSaveProfileToMem(out_profile, 0, &len);
-    if(len > 0)
+    cmsSaveProfileToMem(out_profile, 0, &icc_len);
+    if(icc_len > 0)
     {
-      unsigned char *buf = malloc(len * sizeof(unsigned char));
-      cmsSaveProfileToMem(out_profile, buf, &len);
-      write_icc_profile(&(jpg->cinfo), buf, len);
-      free(buf);
+      icc = malloc(icc_len * sizeof(unsigned char));
+      cmsSaveProfileToMem(out_profile, icc, &icc_len);
     }
   }
 
-  uint8_t *row = dt_alloc_align(64, (size_t)3 * jpg->global.width * sizeof(uint8_t));
-  const uint8_t *buf;
-  while(jpg->cinfo.next_scanline < jpg->cinfo.image_height)
+  FILE *f = g_fopen(filename, "wb");
+  if(!f)
   {
-    JSAMPROW tmp[1];
-    buf = in + (size_t)jpg->cinfo.next_scanline * jpg->cinfo.image_width * 4;
-    for(int i = 0; i < jpg->global.width; i++)
-      for(int k = 0; k < 3; k++) row[3 * i + k] = buf[4 * i + k];
-    tmp[0] = row;
-    jpeg_write_scanlines(&(jpg->cinfo), tmp, 1);
+    free(icc);
+    return 1;
   }
+
+  // large images are encoded in parallel stripes, at the cost of the standard huffman tables
+  const int parallel = dt_conf_get_bool("plugins/imageio/format/jpeg/parallel")
+                           ? _write_image_parallel(jpg, f, in, icc, icc_len)
+                           : -1;
+  if(parallel >= 0)
+  {
+    free(icc);
+    fclose(f);
+    if(parallel) return 1;
+    dt_exif_write_blob(exif, exif_len, filename, 1);
+    return 0;
+  }
+
+  struct dt_imageio_jpeg_error_mgr jerr;
+  jpg->cinfo.err = jpeg_std_error(&jerr.pub);
+  jerr.pub.error_exit = dt_imageio_jpeg_error_exit;
+  if(setjmp(jerr.setjmp_buffer))
+  {
+    jpeg_destroy_compress(&(jpg->cinfo));
+    free(icc);
+    fclose(f);
+    return 1;
+  }
+  jpeg_create_compress(&(jpg->cinfo));
+  jpeg_stdio_dest(&(jpg->cinfo), f);
+
+  _setup_compress(jpg, &(jpg->cinfo), jpg->global.height);
+  jpeg_start_compress(&(jpg->cinfo), TRUE);
+  if(icc_len > 0) write_icc_profile(&(jpg->cinfo), icc, icc_len);
+  free(icc);
+  icc = NULL;
+
+  _write_rows(&(jpg->cinfo), in, jpg->global.width);
   jpeg_finish_compress(&(jpg->cinfo));
-  dt_free_align(row);
   jpeg_destroy_compress(&(jpg->cinfo));
   fclose(f);
 
@@ -552,7 +766,7 @@ const char *extension(dt_imageio_module_data_t *data)
 
 int flags(dt_imageio_module_data_t *data)
 {
-  return FORMAT_FLAGS_SUPPORT_XMP;
+  return FORMAT_FLAGS_SUPPORT_XMP | FORMAT_FLAGS_PARALLEL;
 }
 
 void init(dt_imageio_module_format_t *self)
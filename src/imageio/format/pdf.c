@@ -113,7 +113,7 @@ typedef struct dt_imageio_pdf_t
   dt_imageio_pdf_params_t  params;
   char                    *actual_filename;
   dt_pdf_t                *pdf;
-  GList                   *images;
+  GList                   *pages; // the newest first
   GList                   *icc_profiles;
   float                    page_border;
 } dt_imageio_pdf_t;
@@ -232,43 +232,40 @@ static int _paper_size(dt_imageio_pdf_params_t *d, float *page_width, float *pag
 }
 
 
-int write_image(dt_imageio_module_data_t *data, const char *filename, const void *in,
-                dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
-                void *exif, int exif_len, int imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
-                const gboolean export_masks)
+// the pdf is opened with the first image of the export, all the others go into it as well
+static int _pdf_open(dt_imageio_pdf_t *d, const char *filename)
 {
-  dt_imageio_pdf_t *d = (dt_imageio_pdf_t *)data;
+  float page_width, page_height, page_border;
+  float page_dpi = d->params.dpi;
 
-  // init the pdf. we start counting with 1.
-  if(num == 1)
-  {
-    float page_width, page_height, page_border;
-    float page_dpi = d->params.dpi;
-
-    if(_paper_size(&d->params, &page_width, &page_height, &page_border))
-      return 1;
+  if(_paper_size(&d->params, &page_width, &page_height, &page_border))
+    return 1;
 
-    unsigned int compression = d->params.compression;
-    compression = MIN(compression, DT_PDF_STREAM_ENCODER_FLATE);
+  unsigned int compression = d->params.compression;
+  compression = MIN(compression, DT_PDF_STREAM_ENCODER_FLATE);
 
 
-    dt_pdf_t *pdf = dt_pdf_start(filename, page_width, page_height, page_dpi, compression);
-    if(!pdf)
-    {
-      fprintf(stderr, "[imageio_format_pdf] could not export to file: `%s'!\n", filename);
-      dt_control_log(_("could not export to file `%s'!"), filename);
-      return 1;
-    }
+  dt_pdf_t *pdf = dt_pdf_start(filename, page_width, page_height, page_dpi, compression);
+  if(!pdf)
+  {
+    fprintf(stderr, "[imageio_format_pdf] could not export to file: `%s'!\n", filename);
+    dt_control_log(_("could not export to file `%s'!"), filename);
+    return 1;
+  }
 
-    // TODO: escape ')' and maybe also '('
-    pdf->title = *d->params.title ? d->params.title : NULL;
+  // TODO: escape ')' and maybe also '('
+  pdf->title = *d->params.title ? d->params.title : NULL;
 
-    d->pdf = pdf;
-    d->actual_filename = g_strdup(filename);
-    d->page_border = page_border;
-  } // init the pdf
+  d->pdf = pdf;
+  d->actual_filename = g_strdup(filename);
+  d->page_border = page_border;
+  return 0;
+}
 
-  // add the icc profile
+// the id of the icc profile object of the image, 0 for none. every profile is written once.
+static int _pdf_icc(dt_imageio_pdf_t *d, const int imgid, dt_colorspaces_color_profile_type_t over_type,
+                    const char *over_filename)
+{
   int icc_id = 0;
   if(imgid > 0 && d->params.icc && d->params.mode == MODE_NORMAL)
   {
@@ -302,90 +299,163 @@ int write_image(dt_imageio_module_data_t *data, const char *filename, const void
       }
     }
   }
+  return icc_id;
+}
 
-  void *image_data = NULL;
+// the page of an image follows it right away, only the page object is remembered for the pages dictionary
+static void _pdf_add_page(dt_imageio_pdf_t *d, dt_pdf_image_t *image)
+{
+  if(!image) return;
+  image->outline_mode = image->outline_mode || d->params.mode != MODE_NORMAL;
+  image->show_bb = d->params.mode == MODE_DEBUG;
+  image->rotate_to_fit = d->params.rotate;
+  dt_pdf_page_t *page = dt_pdf_add_page(d->pdf, &image, 1);
+  if(page) d->pages = g_list_prepend(d->pages, page);
+  free(image);
+}
 
+static void _pdf_finish(dt_imageio_pdf_t *d)
+{
+  // add the contact sheet(s)
   // TODO
-  // decide if we want to push that conversion step into the pdf lib and maybe do it on the fly while writing.
-  // that would get rid of one buffer in the case of ASCII_HEX
-  if(d->params.mode == MODE_NORMAL)
+
+  const int n_pages = g_list_length(d->pages);
+  dt_pdf_page_t **pages = malloc(n_pages * sizeof(dt_pdf_page_t *));
+  int i = n_pages;
+  for(GList *iter = d->pages; iter; iter = g_list_next(iter)) pages[--i] = (dt_pdf_page_t *)iter->data;
+
+  dt_pdf_finish(d->pdf, pages, n_pages);
+
+  // we allocated the pages. the main pdf object gets free'ed in dt_pdf_finish().
+  free(pages);
+  g_list_free_full(d->pages, free);
+  g_free(d->actual_filename);
+  g_list_free_full(d->icc_profiles, free);
+
+  d->pdf = NULL;
+  d->pages = NULL;
+  d->actual_filename = NULL;
+  d->icc_profiles = NULL;
+}
+
+// the rgb part of n pixels of the export, with 16 bit values in big endian as the pdf wants them
+static void _pdf_pack(const void *in, uint8_t *out, const size_t n, const int bpp)
+{
+  if(bpp == 8)
   {
-    if(d->params.bpp == 8)
-    {
-      image_data = dt_alloc_align(64, data->width * data->height * 3);
-      const uint8_t *in_ptr = (const uint8_t *)in;
-      uint8_t *out_ptr = (uint8_t *)image_data;
-      for(int y = 0; y < data->height; y++)
-      {
-        for(int x = 0; x < data->width; x++, in_ptr += 4, out_ptr += 3)
-          memcpy(out_ptr, in_ptr, 3);
-      }
-    }
-    else
+    const uint8_t *in_ptr = (const uint8_t *)in;
+    for(size_t k = 0; k < n; k++, in_ptr += 4, out += 3) memcpy(out, in_ptr, 3);
+  }
+  else
+  {
+    const uint16_t *in_ptr = (const uint16_t *)in;
+    uint16_t *out_ptr = (uint16_t *)out;
+    for(size_t k = 0; k < n; k++, in_ptr += 4, out_ptr += 3)
     {
-      image_data = dt_alloc_align(64, data->width * data->height * 3 * sizeof(uint16_t));
-      const uint16_t *in_ptr = (const uint16_t *)in;
-      uint16_t *out_ptr = (uint16_t *)image_data;
-      for(int y = 0; y < data->height; y++)
-      {
-        for(int x = 0; x < data->width; x++, in_ptr += 4, out_ptr += 3)
-        {
-          for(int c = 0; c < 3; c++)
-            out_ptr[c] = (0xff00 & (in_ptr[c] << 8)) | (in_ptr[c] >> 8);
-        }
-      }
+      for(int c = 0; c < 3; c++)
+        out_ptr[c] = (0xff00 & (in_ptr[c] << 8)) | (in_ptr[c] >> 8);
     }
   }
+}
 
-  dt_pdf_image_t *image = dt_pdf_add_image(d->pdf, image_data, d->params.global.width, d->params.global.height, d->params.bpp, icc_id, d->page_border);
+// an image being written in strips, see write_image_begin()
+typedef struct _pdf_stream_t
+{
+  dt_pdf_image_t *image;
+  uint8_t *rows; // the packed strip
+  size_t rows_size;
+  int num, total;
+} _pdf_stream_t;
 
-  dt_free_align(image_data);
+void *write_image_begin(dt_imageio_module_data_t *data, const char *filename,
+                        dt_colorspaces_color_profile_type_t over_type, const char *over_filename, void *exif,
+                        int exif_len, int imgid, int num, int total)
+{
+  dt_imageio_pdf_t *d = (dt_imageio_pdf_t *)data;
 
-  d->images = g_list_append(d->images, image);
+  // init the pdf. we start counting with 1. an image the strips failed for comes again through write_image().
+  if(num == 1 && !d->pdf && _pdf_open(d, filename)) return NULL;
+  if(!d->pdf) return NULL;
 
+  const int icc_id = _pdf_icc(d, imgid, over_type, over_filename);
 
-  // finish the pdf
-  if(num == total)
+  _pdf_stream_t *stream = calloc(1, sizeof(_pdf_stream_t));
+  if(!stream) return NULL;
+  stream->image = dt_pdf_add_image_begin(d->pdf, d->params.mode != MODE_NORMAL, d->params.global.width,
+                                         d->params.global.height, d->params.bpp, icc_id, d->page_border);
+  if(!stream->image)
   {
-    int n_images = g_list_length(d->images);
-    dt_pdf_page_t **pages = malloc(n_images * sizeof(dt_pdf_page_t *));
+    free(stream);
+    return NULL;
+  }
+  stream->num = num;
+  stream->total = total;
+  return stream;
+}
 
-    gboolean outline_mode = d->params.mode != MODE_NORMAL;
-    gboolean show_bb = d->params.mode == MODE_DEBUG;
+int write_rows(dt_imageio_module_data_t *data, void *state, const void *in, int y, int height)
+{
+  dt_imageio_pdf_t *d = (dt_imageio_pdf_t *)data;
+  _pdf_stream_t *stream = (_pdf_stream_t *)state;
+  if(stream->image->outline_mode) return 0;
 
-    // add a page for every image
-    GList *iter = d->images;
-    int i = 0;
-    while(iter)
-    {
-      dt_pdf_image_t *page = (dt_pdf_image_t *)iter->data;
-      page->outline_mode = outline_mode;
-      page->show_bb = show_bb;
-      page->rotate_to_fit = d->params.rotate;
-      pages[i] = dt_pdf_add_page(d->pdf, &page, 1);
-      iter = g_list_next(iter);
-      i++;
-    }
+  const size_t n = (size_t)d->params.global.width * height;
+  const size_t size = n * 3 * (d->params.bpp / 8);
+  if(size > stream->rows_size)
+  {
+    dt_free_align(stream->rows);
+    stream->rows = dt_alloc_align(64, size);
+    stream->rows_size = stream->rows ? size : 0;
+    if(!stream->rows) return 1;
+  }
+  _pdf_pack(in, stream->rows, n, d->params.bpp);
+  return dt_pdf_add_image_rows(d->pdf, stream->image, stream->rows, height);
+}
 
-    // add the contact sheet(s)
-    // TODO
+int write_image_end(dt_imageio_module_data_t *data, void *state, const gboolean failed)
+{
+  dt_imageio_pdf_t *d = (dt_imageio_pdf_t *)data;
+  _pdf_stream_t *stream = (_pdf_stream_t *)state;
+  dt_free_align(stream->rows);
+
+  // a broken image is closed so that the file stays sound, but gets no page
+  int err = failed;
+  if(!stream->image->outline_mode && dt_pdf_add_image_end(d->pdf, stream->image)) err = 1;
+  if(err)
+    free(stream->image);
+  else
+    _pdf_add_page(d, stream->image);
 
-    dt_pdf_finish(d->pdf, pages, n_images);
+  // finish the pdf
+  if(stream->num == stream->total) _pdf_finish(d);
 
-    // we allocated the images and pages. the main pdf object gets free'ed in dt_pdf_finish().
-    g_list_free_full(d->images, free);
-    for(i = 0; i < n_images; i++) free(pages[i]);
-    free(pages);
-    g_free(d->actual_filename);
-    g_list_free_full(d->icc_profiles, free);
+  free(stream);
+  return err;
+}
 
-    d->pdf = NULL;
-    d->images = NULL;
-    d->actual_filename = NULL;
-    d->icc_profiles = NULL;
-  } // finish the pdf
+int write_image(dt_imageio_module_data_t *data, const char *filename, const void *in,
+                dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                void *exif, int exif_len, int imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
+                const gboolean export_masks)
+{
+  dt_imageio_pdf_t *d = (dt_imageio_pdf_t *)data;
 
-  return 0;
+  // the rows of the whole image go through the same strips as a streamed export, so the packed copy stays small
+  _pdf_stream_t *stream = write_image_begin(data, filename, over_type, over_filename, exif, exif_len, imgid,
+                                            num, total);
+  if(!stream)
+  {
+    if(num == total && d->pdf) _pdf_finish(d);
+    return 1;
+  }
+
+  const int height = d->params.global.height;
+  const size_t row = (size_t)d->params.global.width * 4 * (d->params.bpp / 8);
+  int err = 0;
+  for(int y = 0; y < height && !err; y += 64)
+    err = write_rows(data, stream, (const uint8_t *)in + y * row, y, MIN(64, height - y));
+
+  return write_image_end(data, stream, err) || err;
 }
 
 int bpp(dt_imageio_module_data_t *p)
@@ -415,7 +485,8 @@ const char *name()
 
 int flags(dt_imageio_module_data_t *data)
 {
-  return FORMAT_FLAGS_NO_TMPFILE;
+  // a pdf can take hundreds of images, none of them needs to be in memory at once
+  return FORMAT_FLAGS_NO_TMPFILE | FORMAT_FLAGS_STREAMED;
 }
 
 int dimension(struct dt_imageio_module_format_t *self, dt_imageio_module_data_t *data, uint32_t *width, uint32_t *height)
@@ -117,52 +117,31 @@ static void PNGwriteRawProfile(png_struct *ping, png_info *ping_info, char *prof
   png_free(ping, text);
 }
 
-int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const void *ivoid,
-                dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
-                void *exif, int exif_len, int imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
-                const gboolean export_masks)
+// the row filters tried at a compression level. the fast levels stick to a single filter, the slow ones pick
+// the best of all of them just like libpng does.
+static int _filter_mask(const int level)
 {
-  dt_imageio_png_t *p = (dt_imageio_png_t *)p_tmp;
-  const int width = p->global.width, height = p->global.height;
-  FILE *f = g_fopen(filename, "wb");
-  if(!f) return 1;
-
-  png_structp png_ptr;
-  png_infop info_ptr;
-
-  png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-  if(!png_ptr)
-  {
-    fclose(f);
-    return 1;
-  }
-
-  info_ptr = png_create_info_struct(png_ptr);
-  if(!info_ptr)
-  {
-    fclose(f);
-    png_destroy_write_struct(&png_ptr, NULL);
-    return 1;
-  }
-
-  if(setjmp(png_jmpbuf(png_ptr)))
-  {
-    fclose(f);
-    png_destroy_write_struct(&png_ptr, &info_ptr);
-    return 1;
-  }
-
-  png_init_io(png_ptr, f);
+  if(level == 0) return PNG_FILTER_NONE;
+  if(level <= 3) return PNG_FILTER_SUB;
+  if(level <= 6) return PNG_FILTER_SUB | PNG_FILTER_UP | PNG_FILTER_PAETH;
+  return PNG_ALL_FILTERS;
+}
 
+// sets up compression and writes everything up to the pixels. errors longjmp to the caller.
+static void _write_header(const dt_imageio_png_t *p, png_structp png_ptr, png_infop info_ptr,
+                          dt_colorspaces_color_profile_type_t over_type, const char *over_filename, void *exif,
+                          int exif_len, int imgid)
+{
   png_set_compression_level(png_ptr, p->compression);
   png_set_compression_mem_level(png_ptr, 8);
   png_set_compression_strategy(png_ptr, Z_DEFAULT_STRATEGY);
   png_set_compression_window_bits(png_ptr, 15);
   png_set_compression_method(png_ptr, 8);
   png_set_compression_buffer_size(png_ptr, 8192);
+  png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, _filter_mask(p->compression));
 
-  png_set_IHDR(png_ptr, info_ptr, width, height, p->bpp, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
-               PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+  png_set_IHDR(png_ptr, info_ptr, p->global.width, p->global.height, p->bpp, PNG_COLOR_TYPE_RGB,
+               PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
 
   // metadata has to be written before the pixels
 
@@ -201,30 +180,373 @@ int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const voi
    */
   png_set_filler(png_ptr, 0, PNG_FILLER_AFTER);
 
-  png_bytep *row_pointers = dt_alloc_align(64, (size_t)height * sizeof(png_bytep));
+  /* swap bytes of 16 bit files to most significant bit first */
+  if(p->bpp > 8) png_set_swap(png_ptr);
+}
 
-  if(p->bpp > 8)
+// a png written row by row as the pipe finishes them. libpng reports errors with a longjmp, so every call sets
+// up its own jump target.
+typedef struct dt_imageio_png_stream_t
+{
+  FILE *f;
+  png_structp png_ptr;
+  png_infop info_ptr;
+  // parallel deflate. when raw is NULL libpng compresses the rows itself.
+  int chunks, chunk_rows, band_rows;
+  uint8_t *raw;      // the last row of the previous band followed by the rows of this one
+  uint8_t *filtered; // the history window followed by the filtered rows of the band
+  size_t window;     // valid history bytes right before the band
+  uint8_t **out;     // compressed chunks, with room for the zlib header and trailer
+  size_t *out_len;
+  uLong *adler;
+  size_t out_size;
+  uLong stream_adler;
+  int rows_done;
+} dt_imageio_png_stream_t;
+
+// bytes of deflate history, the window of a zlib stream with 15 window bits
+#define DT_PNG_WINDOW 32768
+// filtered bytes compressed by one thread at a time
+#define DT_PNG_CHUNK_SIZE (256 * 1024)
+
+static inline uint8_t _paeth(const int a, const int b, const int c)
+{
+  const int p = a + b - c;
+  const int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+  if(pa <= pb && pa <= pc) return a;
+  return pb <= pc ? b : c;
+}
+
+// filters a row with one filter type and returns the sum of the absolute signed bytes. rows are padded in front
+// by one pixel of zeros, so row[-pixel_bytes] and prev[-pixel_bytes] are always there.
+static uint64_t _apply_filter(const int type, const uint8_t *row, const uint8_t *prev, const size_t len,
+                              const int pixel_bytes, uint8_t *out)
+{
+  switch(type)
   {
-    /* swap bytes of 16 bit files to most significant bit first */
-    png_set_swap(png_ptr);
+    case PNG_FILTER_VALUE_SUB:
+      for(size_t i = 0; i < len; i++) out[i] = row[i] - row[i - pixel_bytes];
+      break;
+    case PNG_FILTER_VALUE_UP:
+      for(size_t i = 0; i < len; i++) out[i] = row[i] - prev[i];
+      break;
+    case PNG_FILTER_VALUE_AVG:
+      for(size_t i = 0; i < len; i++) out[i] = row[i] - ((row[i - pixel_bytes] + prev[i]) >> 1);
+      break;
+    case PNG_FILTER_VALUE_PAETH:
+      for(size_t i = 0; i < len; i++) out[i] = row[i] - _paeth(row[i - pixel_bytes], prev[i], prev[i - pixel_bytes]);
+      break;
+    default:
+      memcpy(out, row, len);
+      break;
+  }
+  uint64_t sum = 0;
+  for(size_t i = 0; i < len; i++) sum += out[i] < 128 ? out[i] : 256 - out[i];
+  return sum;
+}
 
-    for(unsigned i = 0; i < height; i++) row_pointers[i] = (png_bytep)((uint16_t *)ivoid + (size_t)4 * i * width);
+// writes the filter type byte and the filtered row to out, scratch holds len bytes
+static void _filter_row(const uint8_t *row, const uint8_t *prev, const size_t len, const int pixel_bytes, const int mask,
+                        uint8_t *out, uint8_t *scratch)
+{
+  uint64_t best_sum = UINT64_MAX;
+  for(int type = PNG_FILTER_VALUE_NONE; type <= PNG_FILTER_VALUE_PAETH; type++)
+  {
+    if(!(mask & (PNG_FILTER_NONE << type))) continue;
+    const uint64_t sum = _apply_filter(type, row, prev, len, pixel_bytes, scratch);
+    if(sum < best_sum)
+    {
+      best_sum = sum;
+      out[0] = type;
+      memcpy(out + 1, scratch, len);
+    }
   }
-  else
+}
+
+// compresses a chunk into a raw deflate stream. the data before it is set as dictionary so matches can reach back
+// into the previous chunk. all but the last chunk end on a byte boundary with a sync flush, so the chunks simply
+// concatenate into one stream.
+static int _deflate_chunk(const int level, const uint8_t *in, const size_t len, const size_t dict_len,
+                          const gboolean last, uint8_t *out, size_t *out_len)
+{
+  z_stream zs = { 0 };
+  if(deflateInit2(&zs, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) return 1;
+
+  int err = dict_len > 0 && deflateSetDictionary(&zs, in - dict_len, dict_len) != Z_OK;
+  if(!err)
+  {
+    zs.next_in = (Bytef *)in;
+    zs.avail_in = len;
+    zs.next_out = out;
+    zs.avail_out = *out_len;
+    const int ret = deflate(&zs, last ? Z_FINISH : Z_SYNC_FLUSH);
+    err = last ? ret != Z_STREAM_END : (ret != Z_OK || zs.avail_in != 0 || zs.avail_out == 0);
+  }
+  *out_len = zs.total_out;
+  deflateEnd(&zs);
+  return err;
+}
+
+// packs, filters and compresses a band of rows on all threads and writes the chunks as IDAT. errors in libpng
+// longjmp to the caller.
+static int _deflate_band(const dt_imageio_png_t *p, dt_imageio_png_stream_t *s, const void *in, const int rows)
+{
+  const int width = p->global.width;
+  const int pixel_bytes = p->bpp > 8 ? 6 : 3;
+  const size_t len = (size_t)width * pixel_bytes;
+  const size_t raw_stride = pixel_bytes + len;
+  const size_t filtered_stride = len + 1;
+  const int mask = _filter_mask(p->compression);
+  const int chunk_rows = s->chunk_rows;
+  const int chunks = (rows + chunk_rows - 1) / chunk_rows;
+  uint8_t *const raw = s->raw;
+  uint8_t *const filtered = s->filtered + DT_PNG_WINDOW;
+
+  // packed rgb, most significant byte first, after the last row of the previous band
+#ifdef _OPENMP
+#pragma omp parallel for default(none) dt_omp_firstprivate(p, in, rows, width, pixel_bytes, raw, raw_stride) \
+    schedule(static)
+#endif
+  for(int r = 0; r < rows; r++)
+  {
+    uint8_t *row = raw + (r + 1) * raw_stride + pixel_bytes;
+    if(p->bpp > 8)
+    {
+      const uint16_t *pix = (const uint16_t *)in + (size_t)4 * r * width;
+      for(int x = 0; x < width; x++, pix += 4)
+        for(int c = 0; c < 3; c++)
+        {
+          *row++ = pix[c] >> 8;
+          *row++ = pix[c] & 0xff;
+        }
+    }
+    else
+    {
+      const uint8_t *pix = (const uint8_t *)in + (size_t)4 * r * width;
+      for(int x = 0; x < width; x++, pix += 4)
+        for(int c = 0; c < 3; c++) *row++ = pix[c];
+    }
+  }
+
+  int err = 0;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) dt_omp_firstprivate(rows, chunks, chunk_rows, len, pixel_bytes, mask, raw, \
+                                                           raw_stride, filtered, filtered_stride) \
+    reduction(| : err) schedule(static)
+#endif
+  for(int k = 0; k < chunks; k++)
+  {
+    uint8_t *scratch = malloc(len);
+    if(!scratch)
+    {
+      err = 1;
+      continue;
+    }
+    for(int r = k * chunk_rows; r < MIN(rows, (k + 1) * chunk_rows); r++)
+      _filter_row(raw + (r + 1) * raw_stride + pixel_bytes, raw + r * raw_stride + pixel_bytes, len, pixel_bytes, mask,
+                  filtered + r * filtered_stride, scratch);
+    free(scratch);
+  }
+  if(err) return 1;
+
+  const gboolean finish = s->rows_done + rows == p->global.height;
+  const size_t window = s->window;
+  const int level = p->compression;
+  uint8_t **const out = s->out;
+  size_t *const out_len = s->out_len;
+  uLong *const adler = s->adler;
+  const size_t out_size = s->out_size;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) dt_omp_firstprivate(rows, chunks, chunk_rows, filtered, filtered_stride, \
+                                                           window, level, out, out_len, adler, out_size, finish) \
+    reduction(| : err) schedule(static)
+#endif
+  for(int k = 0; k < chunks; k++)
+  {
+    const size_t start = (size_t)k * chunk_rows * filtered_stride;
+    const size_t size = (size_t)(MIN(rows, (k + 1) * chunk_rows) - k * chunk_rows) * filtered_stride;
+    // room for the zlib header in front and the checksum behind
+    out_len[k] = out_size - 6;
+    err |= _deflate_chunk(level, filtered + start, size, MIN(DT_PNG_WINDOW, window + start),
+                          finish && k == chunks - 1, out[k] + 2, out_len + k);
+    adler[k] = adler32(adler32(0L, Z_NULL, 0), filtered + start, size);
+  }
+  if(err) return 1;
+
+  for(int k = 0; k < chunks; k++)
   {
-    for(unsigned i = 0; i < height; i++) row_pointers[i] = (uint8_t *)ivoid + (size_t)4 * i * width;
+    uint8_t *data = out[k] + 2;
+    size_t size = out_len[k];
+    const size_t chunk_size = (size_t)(MIN(rows, (k + 1) * chunk_rows) - k * chunk_rows) * filtered_stride;
+    if(s->rows_done == 0 && k == 0)
+    {
+      // zlib header for a 32k window, the level only goes into the informational bits
+      const int flevel = level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3;
+      data -= 2;
+      size += 2;
+      data[0] = 0x78;
+      data[1] = flevel << 6;
+      data[1] += 31 - (data[0] * 256 + data[1]) % 31;
+      s->stream_adler = adler[k];
+    }
+    else
+      s->stream_adler = adler32_combine(s->stream_adler, adler[k], chunk_size);
+    if(finish && k == chunks - 1)
+    {
+      const uLong a = s->stream_adler;
+      uint8_t *trailer = data + size;
+      trailer[0] = a >> 24;
+      trailer[1] = (a >> 16) & 0xff;
+      trailer[2] = (a >> 8) & 0xff;
+      trailer[3] = a & 0xff;
+      size += 4;
+    }
+    png_write_chunk(s->png_ptr, (png_bytep) "IDAT", data, size);
   }
 
-  png_write_image(png_ptr, row_pointers);
+  // keep the history for the next band and its last row for the filters
+  const size_t total = window + (size_t)rows * filtered_stride;
+  const size_t keep = MIN(DT_PNG_WINDOW, total);
+  memmove(filtered - keep, filtered + (size_t)rows * filtered_stride - keep, keep);
+  s->window = keep;
+  memcpy(raw, raw + (size_t)rows * raw_stride, raw_stride);
+  s->rows_done += rows;
+  return 0;
+}
+
+static void _stream_destroy(dt_imageio_png_stream_t *stream)
+{
+  png_destroy_write_struct(&stream->png_ptr, &stream->info_ptr);
+  fclose(stream->f);
+  if(stream->out)
+    for(int k = 0; k < stream->chunks; k++) free(stream->out[k]);
+  free(stream->out);
+  free(stream->out_len);
+  free(stream->adler);
+  dt_free_align(stream->raw);
+  dt_free_align(stream->filtered);
+  free(stream);
+}
 
-  dt_free_align(row_pointers);
+// sets up the buffers of the parallel deflate. returns FALSE if libpng should compress the rows.
+static gboolean _stream_init_parallel(const dt_imageio_png_t *p, dt_imageio_png_stream_t *s)
+{
+  const int threads = dt_imageio_export_threads(dt_get_num_threads());
+  if(!dt_conf_get_bool("plugins/imageio/format/png/parallel") || threads < 2) return FALSE;
+
+  const int pixel_bytes = p->bpp > 8 ? 6 : 3;
+  const size_t len = (size_t)p->global.width * pixel_bytes;
+  s->chunk_rows = MAX(1, DT_PNG_CHUNK_SIZE / (len + 1));
+  s->chunks = threads;
+  s->band_rows = threads * s->chunk_rows;
+  s->out_size = compressBound(s->chunk_rows * (len + 1)) + 64;
+  // the padding pixel in front of every row stays zero
+  s->raw = dt_alloc_align(64, (s->band_rows + 1) * (pixel_bytes + len));
+  s->filtered = dt_alloc_align(64, DT_PNG_WINDOW + s->band_rows * (len + 1));
+  s->out = calloc(threads, sizeof(uint8_t *));
+  s->out_len = calloc(threads, sizeof(size_t));
+  s->adler = calloc(threads, sizeof(uLong));
+  int err = !s->raw || !s->filtered || !s->out || !s->out_len || !s->adler;
+  for(int k = 0; k < threads && !err; k++) err = !(s->out[k] = malloc(s->out_size));
+  if(err) return FALSE;
+  memset(s->raw, 0, (s->band_rows + 1) * (pixel_bytes + len));
+  return TRUE;
+}
+
+void *write_image_begin(dt_imageio_module_data_t *p_tmp, const char *filename,
+                        dt_colorspaces_color_profile_type_t over_type, const char *over_filename, void *exif,
+                        int exif_len, int imgid, int num, int total)
+{
+  dt_imageio_png_t *p = (dt_imageio_png_t *)p_tmp;
+  FILE *f = g_fopen(filename, "wb");
+  if(!f) return NULL;
+
+  dt_imageio_png_stream_t *stream = calloc(1, sizeof(dt_imageio_png_stream_t));
+  stream->f = f;
+  stream->png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  if(stream->png_ptr) stream->info_ptr = png_create_info_struct(stream->png_ptr);
+  if(!stream->info_ptr)
+  {
+    _stream_destroy(stream);
+    return NULL;
+  }
+
+  if(setjmp(png_jmpbuf(stream->png_ptr)))
+  {
+    _stream_destroy(stream);
+    return NULL;
+  }
+
+  png_init_io(stream->png_ptr, f);
+  _write_header(p, stream->png_ptr, stream->info_ptr, over_type, over_filename, exif, exif_len, imgid);
+
+  if(!_stream_init_parallel(p, stream))
+  {
+    dt_free_align(stream->raw);
+    stream->raw = NULL;
+  }
+  return stream;
+}
 
-  png_write_end(png_ptr, info_ptr);
-  png_destroy_write_struct(&png_ptr, &info_ptr);
-  fclose(f);
+int write_rows(dt_imageio_module_data_t *p_tmp, void *state, const void *in, int y, int height)
+{
+  dt_imageio_png_t *p = (dt_imageio_png_t *)p_tmp;
+  dt_imageio_png_stream_t *stream = (dt_imageio_png_stream_t *)state;
+  const size_t stride = (size_t)4 * p->global.width * (p->bpp > 8 ? sizeof(uint16_t) : sizeof(uint8_t));
+
+  if(setjmp(png_jmpbuf(stream->png_ptr))) return 1;
+
+  if(stream->raw)
+  {
+    for(int i = 0; i < height; i += stream->band_rows)
+      if(_deflate_band(p, stream, (const uint8_t *)in + i * stride, MIN(stream->band_rows, height - i))) return 1;
+    return 0;
+  }
+
+  for(int i = 0; i < height; i++) png_write_row(stream->png_ptr, (png_bytep)in + i * stride);
+  return 0;
+}
+
+int write_image_end(dt_imageio_module_data_t *p_tmp, void *state, const gboolean failed)
+{
+  dt_imageio_png_t *p = (dt_imageio_png_t *)p_tmp;
+  dt_imageio_png_stream_t *stream = (dt_imageio_png_stream_t *)state;
+
+  if(failed || setjmp(png_jmpbuf(stream->png_ptr)))
+  {
+    _stream_destroy(stream);
+    return 1;
+  }
+
+  if(stream->raw)
+  {
+    // libpng never saw the IDAT chunks, so it is told nothing and just writes the end marker
+    if(stream->rows_done != p->global.height)
+    {
+      _stream_destroy(stream);
+      return 1;
+    }
+    png_write_chunk(stream->png_ptr, (png_bytep) "IEND", NULL, 0);
+  }
+  else
+    png_write_end(stream->png_ptr, stream->info_ptr);
+  _stream_destroy(stream);
   return 0;
 }
 
+int write_image(dt_imageio_module_data_t *p_tmp, const char *filename, const void *ivoid,
+                dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                void *exif, int exif_len, int imgid, int num, int total, struct dt_dev_pixelpipe_t *pipe,
+                const gboolean export_masks)
+{
+  void *stream
+      = write_image_begin(p_tmp, filename, over_type, over_filename, exif, exif_len, imgid, num, total);
+  if(!stream) return 1;
+
+  const int err = write_rows(p_tmp, stream, ivoid, 0, p_tmp->height);
+  return write_image_end(p_tmp, stream, err);
+}
+
 static int __attribute__((__unused__)) read_header(const char *filename, dt_imageio_module_data_t *p_tmp)
 {
   dt_imageio_png_t *png = (dt_imageio_png_t *)p_tmp;
@@ -553,7 +875,7 @@ void gui_reset(dt_imageio_module_format_t *self)
 
 int flags(dt_imageio_module_data_t *data)
 {
-  return FORMAT_FLAGS_SUPPORT_XMP;
+  return FORMAT_FLAGS_SUPPORT_XMP | FORMAT_FLAGS_PARALLEL;
 }
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
@@ -58,6 +58,164 @@ typedef struct dt_imageio_tiff_gui_t
 } dt_imageio_tiff_gui_t;
 
 
+static void _set_compression(TIFF *tif, const dt_imageio_tiff_t *d)
+{
+  // http://partners.adobe.com/public/developer/en/tiff/TIFFphotoshop.pdf (dated 2002)
+  // "A proprietary ZIP/Flate compression code (0x80b2) has been used by some"
+  // "software vendors. This code should be considered obsolete. We recommend"
+  // "that TIFF implementations recognize and read the obsolete code but only"
+  // "write the official compression code (0x0008)."
+  // http://www.awaresystems.be/imaging/tiff/tifftags/compression.html
+  // http://www.awaresystems.be/imaging/tiff/tifftags/predictor.html
+  if(d->compress == 1)
+  {
+    TIFFSetField(tif, TIFFTAG_COMPRESSION, (uint16_t)COMPRESSION_ADOBE_DEFLATE);
+    TIFFSetField(tif, TIFFTAG_PREDICTOR, (uint16_t)PREDICTOR_NONE);
+    TIFFSetField(tif, TIFFTAG_ZIPQUALITY, (uint16_t)d->compresslevel);
+  }
+  else if(d->compress == 2)
+  {
+    TIFFSetField(tif, TIFFTAG_COMPRESSION, (uint16_t)COMPRESSION_ADOBE_DEFLATE);
+    TIFFSetField(tif, TIFFTAG_PREDICTOR, (uint16_t)PREDICTOR_HORIZONTAL);
+    TIFFSetField(tif, TIFFTAG_ZIPQUALITY, (uint16_t)d->compresslevel);
+  }
+  else if(d->compress == 3)
+  {
+    TIFFSetField(tif, TIFFTAG_COMPRESSION, (uint16_t)COMPRESSION_ADOBE_DEFLATE);
+    if(d->bpp == 32)
+      TIFFSetField(tif, TIFFTAG_PREDICTOR, (uint16_t)PREDICTOR_FLOATINGPOINT);
+    else
+      TIFFSetField(tif, TIFFTAG_PREDICTOR, (uint16_t)PREDICTOR_HORIZONTAL);
+    TIFFSetField(tif, TIFFTAG_ZIPQUALITY, (uint16_t)d->compresslevel);
+  }
+  else // (d->compress == 0)
+  {
+    TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_NONE);
+  }
+}
+
+// sets up the first page, holding the image
+static void _set_fields(TIFF *tif, const dt_imageio_tiff_t *d, const char *filename, uint8_t *profile,
+                        const uint32_t profile_len, const int layers)
+{
+  TIFFSetField(tif, TIFFTAG_DOCUMENTNAME, filename);
+  _set_compression(tif, d);
+
+  TIFFSetField(tif, TIFFTAG_FILLORDER, (uint16_t)FILLORDER_MSB2LSB);
+  if(profile != NULL)
+  {
+    TIFFSetField(tif, TIFFTAG_ICCPROFILE, (uint32_t)profile_len, profile);
+  }
+
+  TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, (uint16_t)layers);
+  TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, (uint16_t)d->bpp);
+  TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT, (uint16_t)(d->bpp == 32 ? SAMPLEFORMAT_IEEEFP : SAMPLEFORMAT_UINT));
+  TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, (uint32_t)d->global.width);
+  TIFFSetField(tif, TIFFTAG_IMAGELENGTH, (uint32_t)d->global.height);
+  if(layers == 3)
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, (uint16_t)PHOTOMETRIC_RGB);
+  else
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, (uint16_t)PHOTOMETRIC_MINISBLACK);
+
+  TIFFSetField(tif, TIFFTAG_PLANARCONFIG, (uint16_t)PLANARCONFIG_CONTIG);
+  TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, (uint32_t)1);
+  TIFFSetField(tif, TIFFTAG_ORIENTATION, (uint16_t)ORIENTATION_TOPLEFT);
+
+  const int resolution = dt_conf_get_int("metadata/resolution");
+  if(resolution > 0)
+  {
+    TIFFSetField(tif, TIFFTAG_XRESOLUTION, (float)resolution);
+    TIFFSetField(tif, TIFFTAG_YRESOLUTION, (float)resolution);
+    TIFFSetField(tif, TIFFTAG_RESOLUTIONUNIT, (uint16_t)RESUNIT_INCH);
+  }
+}
+
+// writes rows [y0, y0 + height) of the image, in_void points to row y0
+static int _write_scanlines(TIFF *tif, const dt_imageio_tiff_t *d, const void *in_void, const int y0,
+                            const int height, const int layers, void *rowdata)
+{
+  if(d->bpp == 32)
+  {
+    for(int y = 0; y < height; y++)
+    {
+      const float *in = (const float *)in_void + (size_t)4 * y * d->global.width;
+      float *out = (float *)rowdata;
+
+      for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
+      {
+        memcpy(out, in, layers * sizeof(float));
+      }
+
+      if(TIFFWriteScanline(tif, rowdata, y0 + y, 0) == -1) return 1;
+    }
+  }
+  else if(d->bpp == 16)
+  {
+    for(int y = 0; y < height; y++)
+    {
+      const uint16_t *in = (const uint16_t *)in_void + (size_t)4 * y * d->global.width;
+      uint16_t *out = (uint16_t *)rowdata;
+
+      for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
+      {
+        memcpy(out, in, layers * sizeof(uint16_t));
+      }
+
+      if(TIFFWriteScanline(tif, rowdata, y0 + y, 0) == -1) return 1;
+    }
+  }
+  else
+  {
+    for(int y = 0; y < height; y++)
+    {
+      const uint8_t *in = (const uint8_t *)in_void + (size_t)4 * y * d->global.width;
+      uint8_t *out = (uint8_t *)rowdata;
+
+      for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
+      {
+        memcpy(out, in, layers * sizeof(uint8_t));
+      }
+
+      if(TIFFWriteScanline(tif, rowdata, y0 + y, 0) == -1) return 1;
+    }
+  }
+  return 0;
+}
+
+// closes the image page and adds the exif data
+static int _close_page(TIFF *tif, const dt_imageio_tiff_t *d, const char *filename, const int n_pages,
+                       void *exif, const int exif_len)
+{
+  int rc = 0;
+
+  // close the file before adding exif data
+  TIFFSetField(tif, TIFFTAG_PAGENAME, _("image"));
+  TIFFSetField(tif, TIFFTAG_SUBFILETYPE, FILETYPE_PAGE);
+  TIFFSetField(tif, TIFFTAG_PAGENUMBER, 0, n_pages);
+  TIFFClose(tif);
+
+  if(exif)
+  {
+    rc = dt_exif_write_blob(exif, exif_len, filename, d->compress > 0);
+    // Until we get symbolic error status codes, if rc is 1, return 0
+    rc = (rc == 1) ? 0 : 1;
+  }
+  return rc;
+}
+
+static uint8_t *_output_profile(const int imgid, dt_colorspaces_color_profile_type_t over_type,
+                                const char *over_filename, uint32_t *profile_len)
+{
+  *profile_len = 0;
+  if(imgid <= 0) return NULL;
+  cmsHPROFILE out_profile = dt_colorspaces_get_output_profile(imgid, over_type, over_filename)->profile;
+  cmsSaveProfileToMem(out_profile, 0, profile_len);
+  if(*profile_len == 0) return NULL;
+  uint8_t *profile = malloc(*profile_len);
+  if(profile) cmsSaveProfileToMem(out_profile, profile, profile_len);
+  return profile;
+}
+
 int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const void *in_void,
                 dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
                 void *exif, int exif_len, int imgid, int num, int total, dt_dev_pixelpipe_t *pipe,
@@ -79,20 +237,11 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
 #endif
   int rc = 1; // default to error
 
-  if(imgid > 0)
+  profile = _output_profile(imgid, over_type, over_filename, &profile_len);
+  if(profile_len > 0 && !profile)
   {
-    cmsHPROFILE out_profile = dt_colorspaces_get_output_profile(imgid, over_type, over_filename)->profile;
-    cmsSaveProfileToMem(out_profile, 0, &profile_len);
-    if(profile_len > 0)
-    {
-      profile = malloc(profile_len);
-      if(!profile)
-      {
-        rc = 1;
-        goto exit;
-      }
-      cmsSaveProfileToMem(out_profile, profile, &profile_len);
-    }
+    rc = 1;
+    goto exit;
   }
 
   int n_pages = 1;
@@ -116,47 +265,6 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
     goto exit;
   }
 
-  TIFFSetField(tif, TIFFTAG_DOCUMENTNAME, filename);
-
-  // http://partners.adobe.com/public/developer/en/tiff/TIFFphotoshop.pdf (dated 2002)
-  // "A proprietary ZIP/Flate compression code (0x80b2) has been used by some"
-  // "software vendors. This code should be considered obsolete. We recommend"
-  // "that TIFF implementations recognize and read the obsolete code but only"
-  // "write the official compression code (0x0008)."
-  // http://www.awaresystems.be/imaging/tiff/tifftags/compression.html
-  // http://www.awaresystems.be/imaging/tiff/tifftags/predictor.html
-  if(d->compress == 1)
-  {
-    TIFFSetField(tif, TIFFTAG_COMPRESSION, (uint16_t)COMPRESSION_ADOBE_DEFLATE);
-    TIFFSetField(tif, TIFFTAG_PREDICTOR, (uint16_t)PREDICTOR_NONE);
-    TIFFSetField(tif, TIFFTAG_ZIPQUALITY, (uint16_t)d->compresslevel);
-  }
-  else if(d->compress == 2)
-  {
-    TIFFSetField(tif, TIFFTAG_COMPRESSION, (uint16_t)COMPRESSION_ADOBE_DEFLATE);
-    TIFFSetField(tif, TIFFTAG_PREDICTOR, (uint16_t)PREDICTOR_HORIZONTAL);
-    TIFFSetField(tif, TIFFTAG_ZIPQUALITY, (uint16_t)d->compresslevel);
-  }
-  else if(d->compress == 3)
-  {
-    TIFFSetField(tif, TIFFTAG_COMPRESSION, (uint16_t)COMPRESSION_ADOBE_DEFLATE);
-    if(d->bpp == 32)
-      TIFFSetField(tif, TIFFTAG_PREDICTOR, (uint16_t)PREDICTOR_FLOATINGPOINT);
-    else
-      TIFFSetField(tif, TIFFTAG_PREDICTOR, (uint16_t)PREDICTOR_HORIZONTAL);
-    TIFFSetField(tif, TIFFTAG_ZIPQUALITY, (uint16_t)d->compresslevel);
-  }
-  else // (d->compress == 0)
-  {
-    TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_NONE);
-  }
-
-  TIFFSetField(tif, TIFFTAG_FILLORDER, (uint16_t)FILLORDER_MSB2LSB);
-  if(profile != NULL)
-  {
-    TIFFSetField(tif, TIFFTAG_ICCPROFILE, (uint32_t)profile_len, profile);
-  }
-
 /* Howto check for a grayscale image?
    We test every pixel for differences between the rgb channels using specific thresholds
    for every precision. If there is such a pixel we keep it as an rgb image, otherwise
@@ -231,27 +339,8 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
   if(layers == 1)
     dt_control_log(_("will export as a grayscale image"));
 
-  TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, (uint16_t)layers);
-  TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, (uint16_t)d->bpp);
-  TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT, (uint16_t)(d->bpp == 32 ? SAMPLEFORMAT_IEEEFP : SAMPLEFORMAT_UINT));
-  TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, (uint32_t)d->global.width);
-  TIFFSetField(tif, TIFFTAG_IMAGELENGTH, (uint32_t)d->global.height);
-  if(layers == 3)
-    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, (uint16_t)PHOTOMETRIC_RGB);
-  else
-    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, (uint16_t)PHOTOMETRIC_MINISBLACK);
-
-  TIFFSetField(tif, TIFFTAG_PLANARCONFIG, (uint16_t)PLANARCONFIG_CONTIG);
-  TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, (uint32_t)1);
-  TIFFSetField(tif, TIFFTAG_ORIENTATION, (uint16_t)ORIENTATION_TOPLEFT);
-
-  int resolution = dt_conf_get_int("metadata/resolution");
-  if(resolution > 0)
-  {
-    TIFFSetField(tif, TIFFTAG_XRESOLUTION, (float)resolution);
-    TIFFSetField(tif, TIFFTAG_YRESOLUTION, (float)resolution);
-    TIFFSetField(tif, TIFFTAG_RESOLUTIONUNIT, (uint16_t)RESUNIT_INCH);
-  }
+  _set_fields(tif, d, filename, profile, profile_len, layers);
+  const int resolution = dt_conf_get_int("metadata/resolution");
 
   const size_t rowsize = (d->global.width * layers) * d->bpp / 8;
   if((rowdata = malloc(rowsize)) == NULL)
@@ -260,82 +349,14 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
     goto exit;
   }
 
-  if(d->bpp == 32)
+  if(_write_scanlines(tif, d, in_void, 0, d->global.height, layers, rowdata))
   {
-    for(int y = 0; y < d->global.height; y++)
-    {
-      float *in = (float *)in_void + (size_t)4 * y * d->global.width;
-      float *out = (float *)rowdata;
-
-      for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
-      {
-        memcpy(out, in, layers * sizeof(float));
-      }
-
-      if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
-      {
-        rc = 1;
-        goto exit;
-      }
-    }
-  }
-  else if(d->bpp == 16)
-  {
-    for(int y = 0; y < d->global.height; y++)
-    {
-      uint16_t *in = (uint16_t *)in_void + (size_t)4 * y * d->global.width;
-      uint16_t *out = (uint16_t *)rowdata;
-
-      for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
-      {
-        memcpy(out, in, layers * sizeof(uint16_t));
-      }
-
-      if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
-      {
-        rc = 1;
-        goto exit;
-      }
-    }
-  }
-  else
-  {
-    for(int y = 0; y < d->global.height; y++)
-    {
-      uint8_t *in = (uint8_t *)in_void + (size_t)4 * y * d->global.width;
-      uint8_t *out = (uint8_t *)rowdata;
-
-      for(int x = 0; x < d->global.width; x++, in += 4, out += layers)
-      {
-        memcpy(out, in, layers * sizeof(uint8_t));
-      }
-
-      if(TIFFWriteScanline(tif, rowdata, y, 0) == -1)
-      {
-        rc = 1;
-        goto exit;
-      }
-    }
+    rc = 1;
+    goto exit;
   }
 
-  rc = 0;
-
-  // close the file before adding exif data
-  TIFFSetField(tif, TIFFTAG_PAGENAME, _("image"));
-  TIFFSetField(tif, TIFFTAG_SUBFILETYPE, FILETYPE_PAGE);
-  TIFFSetField(tif, TIFFTAG_PAGENUMBER, 0, n_pages);
-
-  if(tif)
-  {
-    TIFFClose(tif);
-    tif = NULL;
-  }
-  if(!rc && exif)
-  {
-    rc = dt_exif_write_blob(exif, exif_len, filename, d->compress > 0);
-    // Until we get symbolic error status codes, if rc is 1, return 0
-    rc = (rc == 1) ? 0 : 1;
-  }
+  rc = _close_page(tif, d, filename, n_pages, exif, exif_len);
+  tif = NULL;
 
   // exiv2 doesn't support multi page tiffs. so we have to write in two steps. :-(
 
@@ -397,31 +418,7 @@ int write_image(dt_imageio_module_data_t *d_tmp, const char *filename, const voi
         else
           TIFFSetField(tif, TIFFTAG_PAGENAME, piece->module->name());
 
-        if(d->compress == 1)
-        {
-          TIFFSetField(tif, TIFFTAG_COMPRESSION, (uint16_t)COMPRESSION_ADOBE_DEFLATE);
-          TIFFSetField(tif, TIFFTAG_PREDICTOR, (uint16_t)PREDICTOR_NONE);
-          TIFFSetField(tif, TIFFTAG_ZIPQUALITY, (uint16_t)d->compresslevel);
-        }
-        else if(d->compress == 2)
-        {
-          TIFFSetField(tif, TIFFTAG_COMPRESSION, (uint16_t)COMPRESSION_ADOBE_DEFLATE);
-          TIFFSetField(tif, TIFFTAG_PREDICTOR, (uint16_t)PREDICTOR_HORIZONTAL);
-          TIFFSetField(tif, TIFFTAG_ZIPQUALITY, (uint16_t)d->compresslevel);
-        }
-        else if(d->compress == 3)
-        {
-          TIFFSetField(tif, TIFFTAG_COMPRESSION, (uint16_t)COMPRESSION_ADOBE_DEFLATE);
-          if(d->bpp == 32)
-            TIFFSetField(tif, TIFFTAG_PREDICTOR, (uint16_t)PREDICTOR_FLOATINGPOINT);
-          else
-            TIFFSetField(tif, TIFFTAG_PREDICTOR, (uint16_t)PREDICTOR_HORIZONTAL);
-          TIFFSetField(tif, TIFFTAG_ZIPQUALITY, (uint16_t)d->compresslevel);
-        }
-        else // (d->compress == 0)
-        {
-          TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_NONE);
-        }
+        _set_compression(tif, d);
 
         TIFFSetField(tif, TIFFTAG_FILLORDER, (uint16_t)FILLORDER_MSB2LSB);
 
@@ -555,6 +552,74 @@ exit:
   return rc;
 }
 
+// a tiff written row by row as the pipe finishes them. it is always rgb, as the grayscale check would need to
+// see the whole image first.
+typedef struct dt_imageio_tiff_stream_t
+{
+  TIFF *tif;
+  char *filename;
+  void *exif;
+  int exif_len;
+  void *rowdata;
+} dt_imageio_tiff_stream_t;
+
+void *write_image_begin(dt_imageio_module_data_t *d_tmp, const char *filename,
+                        dt_colorspaces_color_profile_type_t over_type, const char *over_filename, void *exif,
+                        int exif_len, int imgid, int num, int total)
+{
+  const dt_imageio_tiff_t *d = (dt_imageio_tiff_t *)d_tmp;
+
+  uint32_t profile_len = 0;
+  uint8_t *profile = _output_profile(imgid, over_type, over_filename, &profile_len);
+  if(profile_len > 0 && !profile) return NULL;
+
+  dt_imageio_tiff_stream_t *stream = calloc(1, sizeof(dt_imageio_tiff_stream_t));
+  stream->rowdata = malloc((size_t)d->global.width * 3 * d->bpp / 8);
+#ifdef _WIN32
+  wchar_t *wfilename = g_utf8_to_utf16(filename, -1, NULL, NULL, NULL);
+  stream->tif = TIFFOpenW(wfilename, "wl");
+  g_free(wfilename);
+#else
+  stream->tif = TIFFOpen(filename, "wl");
+#endif
+  if(!stream->tif || !stream->rowdata)
+  {
+    if(stream->tif) TIFFClose(stream->tif);
+    free(stream->rowdata);
+    free(stream);
+    free(profile);
+    return NULL;
+  }
+
+  _set_fields(stream->tif, d, filename, profile, profile_len, 3);
+  free(profile);
+  stream->filename = g_strdup(filename);
+  stream->exif = exif;
+  stream->exif_len = exif_len;
+  return stream;
+}
+
+int write_rows(dt_imageio_module_data_t *d_tmp, void *state, const void *in, int y, int height)
+{
+  dt_imageio_tiff_stream_t *stream = (dt_imageio_tiff_stream_t *)state;
+  return _write_scanlines(stream->tif, (dt_imageio_tiff_t *)d_tmp, in, y, height, 3, stream->rowdata);
+}
+
+int write_image_end(dt_imageio_module_data_t *d_tmp, void *state, const gboolean failed)
+{
+  dt_imageio_tiff_stream_t *stream = (dt_imageio_tiff_stream_t *)state;
+  int rc = 1;
+  if(failed)
+    TIFFClose(stream->tif);
+  else
+    rc = _close_page(stream->tif, (dt_imageio_tiff_t *)d_tmp, stream->filename, 1, stream->exif,
+                     stream->exif_len);
+  g_free(stream->filename);
+  free(stream->rowdata);
+  free(stream);
+  return rc;
+}
+
 #if 0
 int dt_imageio_tiff_read_header(const char *filename, dt_imageio_tiff_t *tiff)
 {
@@ -860,7 +925,7 @@ void gui_reset(dt_imageio_module_format_t *self)
 
 int flags(dt_imageio_module_data_t *data)
 {
-  return FORMAT_FLAGS_SUPPORT_XMP | FORMAT_FLAGS_SUPPORT_LAYERS;
+  return FORMAT_FLAGS_SUPPORT_XMP | FORMAT_FLAGS_SUPPORT_LAYERS | FORMAT_FLAGS_PARALLEL;
 }
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
@@ -260,7 +260,7 @@ int set_params(dt_imageio_module_format_t *self, const void *params, int size)
 
 int flags(dt_imageio_module_data_t *data)
 {
-  return FORMAT_FLAGS_SUPPORT_LAYERS;
+  return FORMAT_FLAGS_SUPPORT_LAYERS | FORMAT_FLAGS_PARALLEL;
 }
 
 int bpp(dt_imageio_module_data_t *p)
@@ -19,6 +19,7 @@
 #include "bauhaus/bauhaus.h"
 #include "common/darktable.h"
 #include "common/exif.h"
+#include "common/file_location.h"
 #include "common/image.h"
 #include "common/image_cache.h"
 #include "common/imageio.h"
@@ -37,11 +38,15 @@
 #endif
 #include <glib.h>
 #include <glib/gstdio.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 DT_MODULE(3)
 
+// exported files waiting to be moved to their destination
+#define DT_DISK_WRITER_QUEUE 4
+
 typedef enum dt_disk_onconflict_actions_t
 {
   DT_EXPORT_ONCONFLICT_UNIQUEFILENAME = 0,
@@ -56,12 +61,39 @@ typedef struct disk_t
   GtkWidget *onsave_action;
 } disk_t;
 
+// an exported file in the temporary directory and where it goes, with what the scripts are told once it is there
+typedef struct dt_imageio_disk_move_t
+{
+  gchar *from, *to;
+  int num, total;
+  uint32_t imgid;
+  dt_imageio_module_format_t *format;
+  dt_imageio_module_data_t *fdata;
+  dt_imageio_module_storage_t *storage;
+  dt_imageio_module_data_t *sdata;
+} dt_imageio_disk_move_t;
+
+// images are exported to the temporary directory and moved to their destination by a writer thread, so the
+// pipe goes on with the next image while the last one is written to a slow disk or a network share. the
+// written files are synced all together when the export is done.
+typedef struct dt_imageio_disk_writer_t
+{
+  dt_pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  GQueue *pending;
+  gboolean finishing;
+  pthread_t thread;
+  GList *written; // only used by the writer thread
+  int failed;
+} dt_imageio_disk_writer_t;
+
 // saved params
 typedef struct dt_imageio_disk_t
 {
   char filename[DT_MAX_PATH_FOR_PARAMS];
   dt_disk_onconflict_actions_t onsave_action;
   dt_variables_params_t *vp;
+  dt_imageio_disk_writer_t *writer;
 } dt_imageio_disk_t;
 
 
@@ -224,6 +256,140 @@ void gui_reset(dt_imageio_module_storage_t *self)
   dt_conf_set_int("plugins/imageio/storage/disk/overwrite", dt_bauhaus_combobox_get(d->onsave_action));
 }
 
+static int _writer_copy(const char *from, const char *to)
+{
+  FILE *in = g_fopen(from, "rb");
+  if(!in) return 1;
+  FILE *out = g_fopen(to, "wb");
+  if(!out)
+  {
+    fclose(in);
+    return 1;
+  }
+
+  const size_t size = 1 << 20;
+  char *buf = g_malloc(size);
+  int err = 0;
+  size_t len;
+  while(!err && (len = fread(buf, 1, size, in)) > 0) err = fwrite(buf, 1, len, out) != len;
+  err |= ferror(in);
+  g_free(buf);
+  fclose(in);
+  err |= fclose(out) != 0;
+  return err;
+}
+
+static void _writer_move(dt_imageio_disk_writer_t *w, dt_imageio_disk_move_t *m)
+{
+  // a rename only works on the same file system, otherwise the file is copied over
+  const int fail = g_rename(m->from, m->to) != 0 && _writer_copy(m->from, m->to);
+  g_unlink(m->from);
+
+  if(fail)
+  {
+    fprintf(stderr, "[imageio_storage_disk] could not write to file: `%s'!\n", m->to);
+    dt_control_log(_("could not export to file `%s'!"), m->to);
+    g_unlink(m->to);
+    w->failed++;
+  }
+  else
+  {
+    fprintf(stderr, "[export_job] exported to `%s'\n", m->to);
+    dt_control_log(ngettext("%d/%d exported to `%s'", "%d/%d exported to `%s'", m->num),
+                   m->num, m->total, m->to);
+    dt_imageio_export_tmpfile_event(m->imgid, m->to, m->format, m->fdata, m->storage, m->sdata);
+    w->written = g_list_prepend(w->written, m->to);
+    m->to = NULL;
+  }
+  g_free(m->from);
+  g_free(m->to);
+  free(m);
+}
+
+// the durability barrier at the end of the export, one sync per file instead of one per write
+static void _writer_sync(dt_imageio_disk_writer_t *w)
+{
+  for(GList *f = w->written; f; f = g_list_next(f))
+  {
+    const int fd = g_open((const char *)f->data, O_WRONLY, 0);
+    if(fd < 0) continue;
+    if(g_fsync(fd))
+    {
+      fprintf(stderr, "[imageio_storage_disk] could not sync file: `%s'!\n", (const char *)f->data);
+      w->failed++;
+    }
+    g_close(fd, NULL);
+  }
+  g_list_free_full(w->written, g_free);
+  w->written = NULL;
+}
+
+static void *_writer_thread(void *data)
+{
+  dt_imageio_disk_writer_t *w = (dt_imageio_disk_writer_t *)data;
+
+  dt_pthread_mutex_lock(&w->mutex);
+  while(TRUE)
+  {
+    dt_imageio_disk_move_t *m = (dt_imageio_disk_move_t *)g_queue_pop_head(w->pending);
+    if(m)
+    {
+      // room for the next export
+      pthread_cond_broadcast(&w->cond);
+      dt_pthread_mutex_unlock(&w->mutex);
+      _writer_move(w, m);
+      dt_pthread_mutex_lock(&w->mutex);
+    }
+    else if(w->finishing)
+      break;
+    else
+      dt_pthread_cond_wait(&w->cond, &w->mutex);
+  }
+  dt_pthread_mutex_unlock(&w->mutex);
+
+  _writer_sync(w);
+  return NULL;
+}
+
+static dt_imageio_disk_writer_t *_writer_new(void)
+{
+  dt_imageio_disk_writer_t *w = calloc(1, sizeof(dt_imageio_disk_writer_t));
+  dt_pthread_mutex_init(&w->mutex, NULL);
+  pthread_cond_init(&w->cond, NULL);
+  w->pending = g_queue_new();
+  dt_pthread_create(&w->thread, _writer_thread, w);
+  return w;
+}
+
+static void _writer_push(dt_imageio_disk_writer_t *w, dt_imageio_disk_move_t *m)
+{
+  dt_pthread_mutex_lock(&w->mutex);
+  while(g_queue_get_length(w->pending) >= DT_DISK_WRITER_QUEUE) dt_pthread_cond_wait(&w->cond, &w->mutex);
+  g_queue_push_tail(w->pending, m);
+  pthread_cond_broadcast(&w->cond);
+  dt_pthread_mutex_unlock(&w->mutex);
+}
+
+// waits until all files are written and synced, returns how many failed
+static int _writer_finish(dt_imageio_disk_writer_t **w)
+{
+  if(!*w) return 0;
+
+  dt_pthread_mutex_lock(&(*w)->mutex);
+  (*w)->finishing = TRUE;
+  pthread_cond_broadcast(&(*w)->cond);
+  dt_pthread_mutex_unlock(&(*w)->mutex);
+  pthread_join((*w)->thread, NULL);
+
+  const int failed = (*w)->failed;
+  g_queue_free((*w)->pending);
+  pthread_cond_destroy(&(*w)->cond);
+  dt_pthread_mutex_destroy(&(*w)->mutex);
+  free(*w);
+  *w = NULL;
+  return failed;
+}
+
 int store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata, const int imgid,
           dt_imageio_module_format_t *format, dt_imageio_module_data_t *fdata, const int num, const int total,
           const gboolean high_quality, const gboolean upscale, const gboolean export_masks,
@@ -238,12 +404,13 @@ int store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata, co
   g_strlcpy(pattern, d->filename, sizeof(pattern));
   gboolean from_cache = FALSE;
   dt_image_full_path(imgid, input_dir, sizeof(input_dir), &from_cache);
-  // set max_width and max_height values to expand them afterwards in darktable variables
-  dt_variables_set_max_width_height(d->vp, fdata->max_width, fdata->max_height);
   int fail = 0;
+  gboolean reserved = FALSE;
   // we're potentially called in parallel. have sequence number synchronized:
   dt_pthread_mutex_lock(&darktable.plugin_threadsafe);
   {
+    // set max_width and max_height values to expand them afterwards in darktable variables
+    dt_variables_set_max_width_height(d->vp, fdata->max_width, fdata->max_height);
 try_again:
     // avoid braindead export which is bound to overwrite at random:
     if(total > 1 && !g_strrstr(pattern, "$"))
@@ -309,6 +476,13 @@ try_again:
         snprintf(c, filename_free_space, "_%.2d.%s", seq, ext);
         seq++;
       }
+      // images may be exported at the same time, claim the name before leaving the critical block
+      FILE *f = g_fopen(filename, "wb");
+      if(f)
+      {
+        fclose(f);
+        reserved = TRUE;
+      }
     }
 
     if(!fail && d->onsave_action == DT_EXPORT_ONCONFLICT_SKIP)
@@ -322,28 +496,82 @@ try_again:
         return 0;
       }
     }
+
+    if(!fail && !d->writer && dt_conf_get_bool("plugins/imageio/storage/disk/async")) d->writer = _writer_new();
   } // end of critical block
   dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
   if(fail) return 1;
 
-  /* export image to file */
-  if(dt_imageio_export(imgid, filename, format, fdata, high_quality, upscale, TRUE, export_masks, icc_type,
-                       icc_filename, icc_intent, self, sdata, num, total, metadata) != 0)
+  // stage the file in the temporary directory for the writer thread
+  char staged[PATH_MAX] = { 0 };
+  if(d->writer)
+  {
+    dt_loc_get_tmp_dir(staged, sizeof(staged));
+    g_strlcat(staged, "/darktable.XXXXXX.", sizeof(staged));
+    g_strlcat(staged, format->extension(fdata), sizeof(staged));
+    const gint fd = g_mkstemp_full(staged, O_RDWR, 0666);
+    if(fd == -1)
+      staged[0] = '\0';
+    else
+      g_close(fd, NULL);
+  }
+  const char *target = staged[0] ? staged : filename;
+
+  /* export image to file, a staged one is announced to the scripts by the writer thread */
+  const int export_fail
+      = staged[0] ? dt_imageio_export_staged(imgid, target, format, fdata, high_quality, upscale, TRUE, export_masks,
+                                             icc_type, icc_filename, icc_intent, self, sdata, num, total, metadata)
+                  : dt_imageio_export(imgid, target, format, fdata, high_quality, upscale, TRUE, export_masks,
+                                      icc_type, icc_filename, icc_intent, self, sdata, num, total, metadata);
+  if(export_fail)
   {
     fprintf(stderr, "[imageio_storage_disk] could not export to file: `%s'!\n", filename);
+    if(staged[0]) g_unlink(staged);
+    if(reserved) g_unlink(filename);
     dt_control_log(_("could not export to file `%s'!"), filename);
     return 1;
   }
 
+  if(staged[0])
+  {
+    dt_imageio_disk_move_t *m = malloc(sizeof(dt_imageio_disk_move_t));
+    m->from = g_strdup(staged);
+    m->to = g_strdup(filename);
+    m->num = num;
+    m->total = total;
+    m->imgid = imgid;
+    m->format = format;
+    m->fdata = fdata;
+    m->storage = self;
+    m->sdata = sdata;
+    _writer_push(d->writer, m);
+    return 0;
+  }
+
   fprintf(stderr, "[export_job] exported to `%s'\n", filename);
   dt_control_log(ngettext("%d/%d exported to `%s'", "%d/%d exported to `%s'", num),
                  num, total, filename);
   return 0;
 }
 
+int parallel_store(dt_imageio_module_storage_t *self)
+{
+  // the file name is built under plugin_threadsafe
+  return 1;
+}
+
+void finalize_store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *params)
+{
+  dt_imageio_disk_t *d = (dt_imageio_disk_t *)params;
+  const int failed = _writer_finish(&d->writer);
+  if(failed)
+    dt_control_log(ngettext("%d file could not be written", "%d files could not be written", failed), failed);
+}
+
 size_t params_size(dt_imageio_module_storage_t *self)
 {
-  return sizeof(dt_imageio_disk_t) - sizeof(void *);
+  // without vp and writer
+  return sizeof(dt_imageio_disk_t) - 2 * sizeof(void *);
 }
 
 void init(dt_imageio_module_storage_t *self)
@@ -374,6 +602,7 @@ void free_params(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *pa
 {
   if(!params) return;
   dt_imageio_disk_t *d = (dt_imageio_disk_t *)params;
+  _writer_finish(&d->writer);
   dt_variables_params_destroy(d->vp);
   free(params);
 }
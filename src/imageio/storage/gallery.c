@@ -219,6 +219,99 @@ static gint sort_pos(pair_t *a, pair_t *b)
   return a->pos - b->pos;
 }
 
+// size of the thumbnails on the index page
+#define DT_GALLERY_THUMB_SIZE 200
+
+// the thumbnail written along with the image by _write_image_and_thumb(). the format module has no room for it,
+// so it is handed over per thread.
+typedef struct dt_gallery_thumb_t
+{
+  dt_imageio_module_format_t *format;
+  const char *filename;
+  int failed;
+} dt_gallery_thumb_t;
+
+static __thread dt_gallery_thumb_t *_thumb = NULL;
+
+static inline float _get_channel(const void *in, const int bpp, const size_t k)
+{
+  if(bpp == 8) return ((const uint8_t *)in)[k];
+  if(bpp == 16) return ((const uint16_t *)in)[k];
+  return ((const float *)in)[k];
+}
+
+// box filter of the 4 channel output buffer, in whatever precision the format asked for
+static void *_downscale(const void *in, const int width, const int height, const int bpp, const int tw,
+                        const int th)
+{
+  void *out = dt_alloc_align(64, (size_t)tw * th * 4 * (bpp / 8));
+  if(!out) return NULL;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) dt_omp_firstprivate(in, out, width, height, bpp, tw, th) schedule(static)
+#endif
+  for(int j = 0; j < th; j++)
+  {
+    const int y0 = (int64_t)j * height / th;
+    const int y1 = MAX(y0 + 1, (int64_t)(j + 1) * height / th);
+    for(int i = 0; i < tw; i++)
+    {
+      const int x0 = (int64_t)i * width / tw;
+      const int x1 = MAX(x0 + 1, (int64_t)(i + 1) * width / tw);
+      float sum[4] = { 0.0f };
+      for(int y = y0; y < y1; y++)
+        for(int x = x0; x < x1; x++)
+          for(int c = 0; c < 4; c++) sum[c] += _get_channel(in, bpp, ((size_t)y * width + x) * 4 + c);
+
+      const float norm = 1.0f / ((y1 - y0) * (x1 - x0));
+      const size_t k = ((size_t)j * tw + i) * 4;
+      for(int c = 0; c < 4; c++)
+      {
+        if(bpp == 8)
+          ((uint8_t *)out)[k + c] = sum[c] * norm + 0.5f;
+        else if(bpp == 16)
+          ((uint16_t *)out)[k + c] = sum[c] * norm + 0.5f;
+        else
+          ((float *)out)[k + c] = sum[c] * norm;
+      }
+    }
+  }
+  return out;
+}
+
+// writes the image with the real format and then a thumbnail scaled down from the same pixels, instead of
+// running the pipe a second time for it
+static int _write_image_and_thumb(dt_imageio_module_data_t *data, const char *filename, const void *in,
+                                  dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                                  void *exif, int exif_len, int imgid, int num, int total,
+                                  struct dt_dev_pixelpipe_t *pipe, const gboolean export_masks)
+{
+  dt_gallery_thumb_t *t = _thumb;
+  const int res = t->format->write_image(data, filename, in, over_type, over_filename, exif, exif_len, imgid, num,
+                                         total, pipe, export_masks);
+  if(res) return res;
+
+  const int width = data->width, height = data->height;
+  const float scale = fminf(1.0f, fminf((float)DT_GALLERY_THUMB_SIZE / width, (float)DT_GALLERY_THUMB_SIZE / height));
+  const int tw = MAX(1, (int)(scale * width + 0.5f));
+  const int th = MAX(1, (int)(scale * height + 0.5f));
+
+  void *thumb = _downscale(in, width, height, t->format->bpp(data), tw, th);
+  if(!thumb)
+  {
+    t->failed = 1;
+    return 0;
+  }
+  data->width = tw;
+  data->height = th;
+  t->failed = t->format->write_image(data, t->filename, thumb, over_type, over_filename, NULL, 0, imgid, num, total,
+                                     NULL, FALSE);
+  data->width = width;
+  data->height = height;
+  dt_free_align(thumb);
+  return 0;
+}
+
 int store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata, const int imgid,
           dt_imageio_module_format_t *format, dt_imageio_module_data_t *fdata, const int num, const int total,
           const gboolean high_quality, const gboolean upscale, const gboolean export_masks,
@@ -342,10 +435,31 @@ int store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata, co
            esc_relthumbfilename,
            num, num-1, title ? title : "&nbsp;", description ? description : "&nbsp;");
 
+  // the thumbnail goes next to the image, with -thumb:
+  char thumbfilename[PATH_MAX] = { 0 };
+  g_strlcpy(thumbfilename, filename, sizeof(thumbfilename));
+  c = thumbfilename + strlen(thumbfilename);
+  for(; c > thumbfilename && *c != '.' && *c != '/'; c--)
+    ;
+  if(c <= thumbfilename || *c == '/') c = thumbfilename + strlen(thumbfilename);
+  sprintf(c, "-thumb.%s", ext);
+
+  // the format writes the thumbnail along with the image, from the whole buffer
+  dt_imageio_module_format_t thumb_format = *format;
+  thumb_format.write_image = _write_image_and_thumb;
+  thumb_format.write_image_begin = NULL;
+  thumb_format.write_rows = NULL;
+  thumb_format.write_image_end = NULL;
+  dt_gallery_thumb_t thumb = { .format = format, .filename = thumbfilename, .failed = 0 };
+  _thumb = &thumb;
+
   // export image to file. need this to be able to access meaningful
   // fdata->width and height below.
-  if(dt_imageio_export(imgid, filename, format, fdata, high_quality, upscale, TRUE, export_masks, icc_type,
-                       icc_filename, icc_intent, self, sdata, num, total, metadata) != 0)
+  const int export_failed
+      = dt_imageio_export(imgid, filename, &thumb_format, fdata, high_quality, upscale, TRUE, export_masks,
+                          icc_type, icc_filename, icc_intent, self, sdata, num, total, metadata);
+  _thumb = NULL;
+  if(export_failed)
   {
     fprintf(stderr, "[imageio_storage_gallery] could not export to file: `%s'!\n", filename);
     dt_control_log(_("could not export to file `%s'!"), filename);
@@ -370,31 +484,15 @@ int store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata, co
   pair->pos = num;
   if(res_title) g_list_free_full(res_title, &g_free);
   if(res_desc) g_list_free_full(res_desc, &g_free);
-  d->l = g_list_insert_sorted(d->l, pair, (GCompareFunc)sort_pos);
-
-  /* also export thumbnail: */
-  // write with reduced resolution:
-  const int save_max_width = fdata->max_width;
-  const int save_max_height = fdata->max_height;
-  fdata->max_width = 200;
-  fdata->max_height = 200;
-  // alter filename with -thumb:
-  c = filename + strlen(filename);
-  for(; c > filename && *c != '.' && *c != '/'; c--)
-    ;
-  if(c <= filename || *c == '/') c = filename + strlen(filename);
-  ext = format->extension(fdata);
-  sprintf(c, "-thumb.%s", ext);
-  if(dt_imageio_export(imgid, filename, format, fdata, FALSE, TRUE, FALSE, export_masks, icc_type, icc_filename,
-                       icc_intent, self, sdata, num, total, NULL) != 0)
+  // sorted once when the index is written
+  d->l = g_list_prepend(d->l, pair);
+
+  if(thumb.failed)
   {
-    fprintf(stderr, "[imageio_storage_gallery] could not export to file: `%s'!\n", filename);
-    dt_control_log(_("could not export to file `%s'!"), filename);
+    fprintf(stderr, "[imageio_storage_gallery] could not export to file: `%s'!\n", thumbfilename);
+    dt_control_log(_("could not export to file `%s'!"), thumbfilename);
     return 1;
   }
-  // restore for next image:
-  fdata->max_width = save_max_width;
-  fdata->max_height = save_max_height;
 
   printf("[export_job] exported to `%s'\n", filename);
   dt_control_log(ngettext("%d/%d exported to `%s'", "%d/%d exported to `%s'", num),
@@ -433,6 +531,7 @@ END:
 void finalize_store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *dd)
 {
   dt_imageio_gallery_t *d = (dt_imageio_gallery_t *)dd;
+  d->l = g_list_sort(d->l, (GCompareFunc)sort_pos);
   char filename[PATH_MAX] = { 0 };
   g_strlcpy(filename, d->cached_dirname, sizeof(filename));
   char *c = filename + strlen(filename);
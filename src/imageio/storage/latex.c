@@ -394,6 +394,12 @@ END:
   g_free(sourcefile);
 }
 
+int parallel_store(dt_imageio_module_storage_t *self)
+{
+  // the file name and the sorted image list are built under plugin_threadsafe
+  return 1;
+}
+
 void finalize_store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *dd)
 {
   dt_imageio_latex_t *d = (dt_imageio_latex_t *)dd;
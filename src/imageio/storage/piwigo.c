@@ -99,6 +99,37 @@ typedef struct _curl_args_t
   char value[512];
 } _curl_args_t;
 
+// an exported image waiting for its upload or being uploaded
+typedef struct _piwigo_upload_t
+{
+  gchar *filename;
+  GList *args;
+  int num, total;
+  curl_mime *form;
+  GString *response;
+} _piwigo_upload_t;
+
+// the uploads run on their own thread, several at a time over the kept-alive connections of a multi handle. the
+// export goes on with the next images meanwhile and only waits when too many files are queued.
+typedef struct _piwigo_upload_queue_t
+{
+  dt_pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  GQueue *pending;
+  int max_pending, max_running;
+  gboolean finishing;
+  pthread_t thread;
+
+  // only used by the upload thread
+  CURLM *multi;
+  GList *idle;                 // easy handles of finished uploads, kept for their session
+  struct curl_slist *cookies;  // the session cookies of the authentication
+  JsonParser *json_parser;
+  gchar *url;
+  _piwigo_api_context_t *api;  // shared with store(), only used under plugin_threadsafe
+  int failed;
+} _piwigo_upload_queue_t;
+
 typedef struct dt_storage_piwigo_params_t
 {
   _piwigo_api_context_t *api;
@@ -109,6 +140,7 @@ typedef struct dt_storage_piwigo_params_t
   int privacy;
   gboolean export_tags; // deprecated - let here not to change params size. to be removed on next version change
   gchar *tags;
+  _piwigo_upload_queue_t *uploads;
 } dt_storage_piwigo_params_t;
 
 /* low-level routine doing the HTTP POST request */
@@ -270,45 +302,25 @@ static void _piwigo_set_status(dt_storage_piwigo_gui_data_t *ui, gchar *message,
   gtk_label_set_markup(ui->status_label, mup);
 }
 
-static int _piwigo_api_post_internal(_piwigo_api_context_t *ctx, GList *args, char *filename, gboolean isauth)
+// sets up a POST of the arguments, as multipart form with the image when there is a filename. the form has to be
+// freed after the transfer.
+static curl_mime *_piwigo_request_setup(CURL *curl, const char *url, GList *args, const char *filename,
+                                        GString *response)
 {
   curl_mime *form = NULL;
 
-  GString *url = g_string_new(ctx->url);
-
-  // send the requests
-  GString *response = g_string_new("");
-
-  dt_curl_init(ctx->curl_ctx, piwigo_EXTRA_VERBOSE);
-
-  curl_easy_setopt(ctx->curl_ctx, CURLOPT_URL, url->str);
-  curl_easy_setopt(ctx->curl_ctx, CURLOPT_POST, 1);
-  curl_easy_setopt(ctx->curl_ctx, CURLOPT_WRITEFUNCTION, curl_write_data_cb);
-  curl_easy_setopt(ctx->curl_ctx, CURLOPT_WRITEDATA, response);
-
-  if(isauth)
-  {
-    /* construct a temporary file name */
-    char cookie_fmt[PATH_MAX] = { 0 };
-    dt_loc_get_tmp_dir(cookie_fmt, sizeof(cookie_fmt));
-    g_strlcat(cookie_fmt, "/cookies.%.4lf.txt", sizeof(cookie_fmt));
-
-    ctx->cookie_file = g_strdup_printf(cookie_fmt, dt_get_wtime());
+  dt_curl_init(curl, piwigo_EXTRA_VERBOSE);
 
-    // not that this is safe as the cookie file is written only when the curl context is finalized.
-    // At this stage we unlink the file.
-    curl_easy_setopt(ctx->curl_ctx, CURLOPT_COOKIEJAR, ctx->cookie_file);
-  }
-  else
-  {
-    curl_easy_setopt(ctx->curl_ctx, CURLOPT_COOKIEFILE, ctx->cookie_file);
-  }
+  curl_easy_setopt(curl, CURLOPT_URL, url);
+  curl_easy_setopt(curl, CURLOPT_POST, 1);
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curl_write_data_cb);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, response);
 
   if(filename)
   {
     curl_mimepart *field = NULL;
 
-    form = curl_mime_init(ctx->curl_ctx);
+    form = curl_mime_init(curl);
 
     GList *a = args;
 
@@ -325,7 +337,7 @@ static int _piwigo_api_post_internal(_piwigo_api_context_t *ctx, GList *args, ch
     curl_mime_name(field, "image");
     curl_mime_filedata(field, filename);
 
-    curl_easy_setopt(ctx->curl_ctx, CURLOPT_MIMEPOST, form);
+    curl_easy_setopt(curl, CURLOPT_MIMEPOST, form);
   }
   else
   {
@@ -344,38 +356,77 @@ static int _piwigo_api_post_internal(_piwigo_api_context_t *ctx, GList *args, ch
       a = g_list_next(a);
     }
 
-    curl_easy_setopt(ctx->curl_ctx, CURLOPT_COPYPOSTFIELDS, gargs->str);
+    curl_easy_setopt(curl, CURLOPT_COPYPOSTFIELDS, gargs->str);
     g_string_free(gargs, TRUE);
   }
 
+  return form;
+}
+
+static JsonObject *_piwigo_parse_response(JsonParser *parser, const GString *response)
+{
+  GError *error = NULL;
+  gboolean ret = json_parser_load_from_data(parser, response->str, response->len, &error);
+  if(!ret)
+  {
+    g_error_free(error);
+    return NULL;
+  }
+  JsonNode *root = json_parser_get_root(parser);
+  // we should always have a dict
+  if(json_node_get_node_type(root) != JSON_NODE_OBJECT) return NULL;
+  return json_node_get_object(root);
+}
+
+static gboolean _piwigo_response_failed(JsonObject *response)
+{
+  const char *status = json_object_get_string_member(response, "stat");
+  return status && (strcmp(status,"fail")==0);
+}
+
+static int _piwigo_api_post_internal(_piwigo_api_context_t *ctx, GList *args, char *filename, gboolean isauth)
+{
+  // send the requests
+  GString *response = g_string_new("");
+
+  curl_mime *form = _piwigo_request_setup(ctx->curl_ctx, ctx->url, args, filename, response);
+
+  if(isauth)
+  {
+    /* construct a temporary file name */
+    char cookie_fmt[PATH_MAX] = { 0 };
+    dt_loc_get_tmp_dir(cookie_fmt, sizeof(cookie_fmt));
+    g_strlcat(cookie_fmt, "/cookies.%.4lf.txt", sizeof(cookie_fmt));
+
+    ctx->cookie_file = g_strdup_printf(cookie_fmt, dt_get_wtime());
+
+    // not that this is safe as the cookie file is written only when the curl context is finalized.
+    // At this stage we unlink the file.
+    curl_easy_setopt(ctx->curl_ctx, CURLOPT_COOKIEJAR, ctx->cookie_file);
+  }
+  else
+  {
+    curl_easy_setopt(ctx->curl_ctx, CURLOPT_COOKIEFILE, ctx->cookie_file);
+  }
+
   int res = curl_easy_perform(ctx->curl_ctx);
 
 #if piwigo_EXTRA_VERBOSE == TRUE
   g_printf("curl_easy_perform status %d\n", res);
 #endif
 
-  if(filename) curl_mime_free(form);
-
-  g_string_free(url, TRUE);
+  if(form) curl_mime_free(form);
 
   ctx->response = NULL;
 
   if(res == CURLE_OK)
   {
-    GError *error = NULL;
-    gboolean ret = json_parser_load_from_data(ctx->json_parser, response->str, response->len, &error);
-    if(!ret) goto cleanup;
-    JsonNode *root = json_parser_get_root(ctx->json_parser);
-    // we should always have a dict
-    if(json_node_get_node_type(root) != JSON_NODE_OBJECT) goto cleanup;
-    ctx->response = json_node_get_object(root);
-    const char *status = json_object_get_string_member(ctx->response, "stat");
-    ctx->error_occured = (status && (strcmp(status,"fail")==0));
+    ctx->response = _piwigo_parse_response(ctx->json_parser, response);
+    if(ctx->response) ctx->error_occured = _piwigo_response_failed(ctx->response);
   }
   else
     ctx->error_occured = TRUE;
 
- cleanup:
   g_string_free(response, TRUE);
   return res;
 }
@@ -670,8 +721,8 @@ static gboolean _piwigo_api_create_new_album(dt_storage_piwigo_params_t *p)
   return TRUE;
 }
 
-static gboolean _piwigo_api_upload_photo(dt_storage_piwigo_params_t *p, gchar *fname,
-                                         gchar *author, gchar *caption, gchar *description)
+static GList *_piwigo_api_upload_args(dt_storage_piwigo_params_t *p, gchar *fname,
+                                      gchar *author, gchar *caption, gchar *description)
 {
   GList *args = NULL;
   char cat[10];
@@ -696,11 +747,179 @@ static gboolean _piwigo_api_upload_photo(dt_storage_piwigo_params_t *p, gchar *f
 
   if(p->tags && strlen(p->tags)>0)
     args = _piwigo_query_add_arguments(args, "tags", p->tags);
-  _piwigo_api_post(p->api, args, fname, FALSE);
 
-  g_list_free(args);
+  return args;
+}
 
-  return !p->api->error_occured;
+static void _piwigo_upload_free(_piwigo_upload_t *u)
+{
+  g_free(u->filename);
+  g_list_free_full(u->args, free);
+  if(u->response) g_string_free(u->response, TRUE);
+  free(u);
+}
+
+static void _piwigo_upload_start(_piwigo_upload_queue_t *q, _piwigo_upload_t *u)
+{
+  CURL *curl = NULL;
+  if(q->idle)
+  {
+    curl = (CURL *)q->idle->data;
+    q->idle = g_list_delete_link(q->idle, q->idle);
+  }
+  else
+    curl = curl_easy_init();
+
+  u->response = g_string_new("");
+  u->form = _piwigo_request_setup(curl, q->url, u->args, u->filename, u->response);
+  for(struct curl_slist *c = q->cookies; c; c = c->next) curl_easy_setopt(curl, CURLOPT_COOKIELIST, c->data);
+  curl_easy_setopt(curl, CURLOPT_PRIVATE, u);
+  curl_multi_add_handle(q->multi, curl);
+}
+
+static void _piwigo_upload_done(_piwigo_upload_queue_t *q, CURL *curl, const CURLcode res)
+{
+  _piwigo_upload_t *u = NULL;
+  curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char **)&u);
+  curl_multi_remove_handle(q->multi, curl);
+  curl_mime_free(u->form);
+  q->idle = g_list_prepend(q->idle, curl);
+
+  gboolean status = TRUE;
+  if(res == CURLE_COULDNT_CONNECT || res == CURLE_SSL_CONNECT_ERROR)
+  {
+    // the session might be gone, the api context authenticates again before it sends the image once more. the
+    // context is the one store() creates albums with, so both take turns
+    dt_pthread_mutex_lock(&darktable.plugin_threadsafe);
+    _piwigo_api_post(q->api, u->args, u->filename, FALSE);
+    status = !q->api->error_occured;
+    curl_slist_free_all(q->cookies);
+    q->cookies = NULL;
+    curl_easy_getinfo(q->api->curl_ctx, CURLINFO_COOKIELIST, &q->cookies);
+    dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
+  }
+  else if(res != CURLE_OK)
+    status = FALSE;
+  else
+  {
+    JsonObject *response = _piwigo_parse_response(q->json_parser, u->response);
+    status = !response || !_piwigo_response_failed(response);
+  }
+
+  if(!status)
+  {
+    fprintf(stderr, "[imageio_storage_piwigo] could not upload to piwigo!\n");
+    dt_control_log(_("could not upload to piwigo!"));
+    q->failed++;
+  }
+  else
+    dt_control_log(ngettext("%d/%d exported to piwigo webalbum", "%d/%d exported to piwigo webalbum", u->num),
+                   u->num, u->total);
+
+  // And remove from filesystem..
+  g_unlink(u->filename);
+  _piwigo_upload_free(u);
+}
+
+static void *_piwigo_upload_thread(void *data)
+{
+  _piwigo_upload_queue_t *q = (_piwigo_upload_queue_t *)data;
+  int running = 0;
+
+  dt_pthread_mutex_lock(&q->mutex);
+  while(TRUE)
+  {
+    while(running < q->max_running && !g_queue_is_empty(q->pending))
+    {
+      _piwigo_upload_start(q, (_piwigo_upload_t *)g_queue_pop_head(q->pending));
+      running++;
+      // room for the next export
+      pthread_cond_broadcast(&q->cond);
+    }
+    if(running == 0)
+    {
+      if(q->finishing) break;
+      dt_pthread_cond_wait(&q->cond, &q->mutex);
+      continue;
+    }
+    dt_pthread_mutex_unlock(&q->mutex);
+
+    int still_running = 0;
+    curl_multi_perform(q->multi, &still_running);
+
+    CURLMsg *msg = NULL;
+    int left = 0;
+    while((msg = curl_multi_info_read(q->multi, &left)))
+    {
+      if(msg->msg != CURLMSG_DONE) continue;
+      // msg is gone once the handle is removed
+      CURL *curl = msg->easy_handle;
+      const CURLcode res = msg->data.result;
+      _piwigo_upload_done(q, curl, res);
+      running--;
+    }
+
+    // wake up now and then to start the uploads queued meanwhile
+    if(running > 0) curl_multi_wait(q->multi, NULL, 0, 100, NULL);
+    dt_pthread_mutex_lock(&q->mutex);
+  }
+  dt_pthread_mutex_unlock(&q->mutex);
+  return NULL;
+}
+
+static _piwigo_upload_queue_t *_piwigo_upload_queue_new(_piwigo_api_context_t *api)
+{
+  _piwigo_upload_queue_t *q = calloc(1, sizeof(_piwigo_upload_queue_t));
+  dt_pthread_mutex_init(&q->mutex, NULL);
+  pthread_cond_init(&q->cond, NULL);
+  q->pending = g_queue_new();
+  q->max_running = CLAMP(dt_conf_get_int("plugins/imageio/storage/piwigo/uploads"), 1, 16);
+  // bounds the exported files waiting on disk
+  q->max_pending = 2 * q->max_running;
+  q->multi = curl_multi_init();
+#ifdef CURLPIPE_MULTIPLEX
+  curl_multi_setopt(q->multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+#endif
+  q->json_parser = json_parser_new();
+  q->api = api;
+  q->url = g_strdup(api->url);
+  curl_easy_getinfo(api->curl_ctx, CURLINFO_COOKIELIST, &q->cookies);
+  dt_pthread_create(&q->thread, _piwigo_upload_thread, q);
+  return q;
+}
+
+static void _piwigo_upload_queue_push(_piwigo_upload_queue_t *q, _piwigo_upload_t *u)
+{
+  dt_pthread_mutex_lock(&q->mutex);
+  while(g_queue_get_length(q->pending) >= q->max_pending) dt_pthread_cond_wait(&q->cond, &q->mutex);
+  g_queue_push_tail(q->pending, u);
+  pthread_cond_broadcast(&q->cond);
+  dt_pthread_mutex_unlock(&q->mutex);
+}
+
+// waits for the queued uploads and returns how many of them failed
+static int _piwigo_upload_queue_finish(_piwigo_upload_queue_t **q)
+{
+  if(!*q) return 0;
+
+  dt_pthread_mutex_lock(&(*q)->mutex);
+  (*q)->finishing = TRUE;
+  pthread_cond_broadcast(&(*q)->cond);
+  dt_pthread_mutex_unlock(&(*q)->mutex);
+  pthread_join((*q)->thread, NULL);
+
+  const int failed = (*q)->failed;
+  g_list_free_full((*q)->idle, (GDestroyNotify)curl_easy_cleanup);
+  curl_multi_cleanup((*q)->multi);
+  curl_slist_free_all((*q)->cookies);
+  g_object_unref((*q)->json_parser);
+  g_free((*q)->url);
+  g_queue_free((*q)->pending);
+  pthread_cond_destroy(&(*q)->cond);
+  dt_pthread_mutex_destroy(&(*q)->mutex);
+  free(*q);
+  *q = NULL;
+  return failed;
 }
 
 // Login button pressed...
@@ -896,9 +1115,21 @@ static gboolean _finalize_store(gpointer user_data)
 
 void finalize_store(struct dt_imageio_module_storage_t *self, dt_imageio_module_data_t *data)
 {
+  dt_storage_piwigo_params_t *p = (dt_storage_piwigo_params_t *)data;
+  const int failed = _piwigo_upload_queue_finish(&p->uploads);
+  if(failed)
+    dt_control_log(ngettext("%d image could not be uploaded to piwigo", "%d images could not be uploaded to piwigo",
+                            failed),
+                   failed);
   g_main_context_invoke(NULL, _finalize_store, self->gui_data);
 }
 
+int parallel_store(dt_imageio_module_storage_t *self)
+{
+  // albums are created under plugin_threadsafe, the uploads are queued
+  return 1;
+}
+
 int store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata, const int imgid,
           dt_imageio_module_format_t *format, dt_imageio_module_data_t *fdata, const int num, const int total,
           const gboolean high_quality, const gboolean upscale, const gboolean export_masks,
@@ -908,6 +1139,7 @@ int store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata, co
   dt_storage_piwigo_gui_data_t *ui = self->gui_data;
 
   gint result = 0;
+  _piwigo_upload_t *upload = NULL;
 
   const char *ext = format->extension(fdata);
 
@@ -986,25 +1218,25 @@ int store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata, co
     if(p->new_album)
     {
       status = _piwigo_api_create_new_album(p);
-      if(!status) dt_control_log(_("cannot create a new piwigo album!"));
-    }
-
-    if(status)
-    {
-      status = _piwigo_api_upload_photo(p, fname, author, caption, description);
       if(!status)
-      {
-        fprintf(stderr, "[imageio_storage_piwigo] could not upload to piwigo!\n");
-        dt_control_log(_("could not upload to piwigo!"));
-        result = 1;
-      }
-      else if (p->new_album)
+        dt_control_log(_("cannot create a new piwigo album!"));
+      else
       {
         // we do not want to create more albums when multiple upload
         p->new_album = FALSE;
         _piwigo_refresh_albums(ui, p->album);
       }
     }
+
+    if(status)
+    {
+      if(!p->uploads) p->uploads = _piwigo_upload_queue_new(p->api);
+      upload = calloc(1, sizeof(_piwigo_upload_t));
+      upload->filename = g_strdup(fname);
+      upload->args = _piwigo_api_upload_args(p, fname, author, caption, description);
+      upload->num = num;
+      upload->total = total;
+    }
     if (p->tags)
     {
       g_free(p->tags);
@@ -1013,20 +1245,17 @@ int store(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *sdata, co
   }
   dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
 
+  // outside of the lock, other exports can go on while this one waits for room in the queue
+  if(upload) _piwigo_upload_queue_push(((dt_storage_piwigo_params_t *)sdata)->uploads, upload);
+
 cleanup:
 
-  // And remove from filesystem..
-  g_unlink(fname);
+  // And remove from filesystem.. once uploaded
+  if(!upload) g_unlink(fname);
   g_free(caption);
   g_free(description);
   g_free(author);
 
-  if(!result)
-  {
-    // this makes sense only if the export was successful
-    dt_control_log(ngettext("%d/%d exported to piwigo webalbum", "%d/%d exported to piwigo webalbum", num),
-                   num, total);
-  }
   return result;
 }
 
@@ -1169,6 +1398,7 @@ void free_params(dt_imageio_module_storage_t *self, dt_imageio_module_data_t *pa
 
   if(p)
   {
+    _piwigo_upload_queue_finish(&p->uploads);
     g_free(p->album);
     g_free(p->tags);
     _piwigo_ctx_destroy(&p->api);
@@ -142,6 +142,22 @@ public:
     delete[] values;
   }
 
+  /* Drops all entries and returns the memory to the initial capacity, for tables that have
+   * been merged into another one.
+   */
+  void reset()
+  {
+    delete[] entries;
+    delete[] keys;
+    delete[] values;
+    capacity = 1 << 15;
+    capacity_bits = 0x7fff;
+    filled = 0;
+    entries = new Entry[capacity];
+    keys = new Key[maxFill()];
+    values = new Value[maxFill()] { 0 };
+  }
+
   // Returns the number of vectors stored.
   int size() const
   {
@@ -181,10 +197,12 @@ public:
       if(e.keyIdx == -1)
       {
         if(!create) return -1; // Return not found.
-	// Double hash table size if necessary
+	// Double hash table size if necessary, the key then has to be placed by the new capacity
 	if(filled >= maxFill())
 	   {
 	   grow();
+	   h = key.hash & capacity_bits;
+	   continue;
 	   }
         // need to create an entry. Store the given key.
 	keys[filled] = key;
@@ -221,8 +239,8 @@ public:
       capacity_bits = (capacity_bits << 1) | 1;
     }
 
-    // Migrate the value vectors.
-    Value *newValues = new Value[maxFill()];
+    // Migrate the value vectors, the new ones have to start from zero like the initial ones.
+    Value *newValues = new Value[maxFill()]();
     std::copy(values, values + filled, newValues);
     delete[] values;
     values = newValues;
@@ -285,17 +303,15 @@ public:
   /* Constructor
    *     d_ : dimensionality of key vectors
    *    vd_ : dimensionality of value vectors
-   * nData_ : number of points in the input
+   * nThreads_ : number of threads splatting at the same time
    */
-  PermutohedralLattice(size_t nData_, int nThreads_ = 1) : nData(nData_), nThreads(nThreads_)
+  PermutohedralLattice(int nThreads_ = 1) : nThreads(nThreads_)
   {
 
     // Allocate storage for various arrays
     float *scaleFactorTmp = new float[D];
     int *canonicalTmp = new int[(D + 1) * (D + 1)];
 
-    replay = new ReplayEntry[nData];
-
     // compute the coordinates of the canonical simplex, in which
     // the difference between a contained point and the zero
     // remainder vertex is always in ascending order. (See pg.4 of paper.)
@@ -335,20 +351,39 @@ public:
   ~PermutohedralLattice()
   {
     delete[] scaleFactor;
-    delete[] replay;
     delete[] canonical;
     delete[] hashTables;
   }
 
 
   /* Performs splatting with given position and value vectors */
-  void splat(float *position, float *value, size_t replay_index, int thread_index = 0)
+  void splat(const float *position, const float *value, int thread_index = 0)
+  {
+    Key keys[D + 1];
+    float barycentric[D + 2];
+    locate(position, keys, barycentric);
+
+    // Splat the value into each vertex of the simplex, with barycentric weights.
+    for(int remainder = 0; remainder <= D; remainder++)
+    {
+      // Retrieve pointer to the value at this vertex.
+      Value *val = hashTables[thread_index].lookup(keys[remainder], true);
+
+      // Accumulate values with barycentric weight.
+      val->add(value,barycentric[remainder]);
+    }
+  }
+
+  /* Finds the vertices of the simplex enclosing the given position and its barycentric weights in it.
+   * Splatting and slicing the same position give the same vertices, so slicing doesn't need to
+   * keep a record of the splat around (the replay of the original code), which cost more memory
+   * per pixel than the image itself.
+   */
+  void locate(const float *position, Key *keys, float *barycentric) const
   {
     float elevated[D + 1];
     int greedy[D + 1];
     int rank[D + 1];
-    float barycentric[D + 2];
-    Key key;
 
     // first rotate position into the (d+1)-dimensional hyperplane
     elevated[D] = -D * position[D - 1] * scaleFactor[D - 1];
@@ -419,7 +454,7 @@ public:
     }
 
     // Compute barycentric coordinates (See pg.10 of paper.)
-    memset(barycentric, 0, sizeof barycentric);
+    memset(barycentric, 0, sizeof(float) * (D + 2));
     for(int i = 0; i <= D; i++)
     {
       barycentric[D - rank[i]] += (elevated[i] - greedy[i]) * scale;
@@ -427,24 +462,12 @@ public:
     }
     barycentric[0] += 1.0f + barycentric[D + 1];
 
-    // Splat the value into each vertex of the simplex, with barycentric weights.
-    replay[replay_index].table = thread_index;
     for(int remainder = 0; remainder <= D; remainder++)
     {
       // Compute the location of the lattice point explicitly (all but the last coordinate - it's redundant
       // because they sum to zero)
-      for(int i = 0; i < D; i++) key.key[i] = greedy[i] + canonical[remainder * (D + 1) + rank[i]];
-      key.setHash();
-
-      // Retrieve pointer to the value at this vertex.
-      Value *val = hashTables[thread_index].lookup(key, true);
-
-      // Accumulate values with barycentric weight.
-      val->add(value,barycentric[remainder]);
-
-      // Record this interaction to use later when slicing
-      replay[replay_index].offset[remainder] = val - hashTables[thread_index].getValues();
-      replay[replay_index].weight[remainder] = barycentric[remainder];
+      for(int i = 0; i < D; i++) keys[remainder].key[i] = greedy[i] + canonical[remainder * (D + 1) + rank[i]];
+      keys[remainder].setHash();
     }
   }
 
@@ -469,48 +492,36 @@ public:
     }
     if (order > 0)
        hashTables[0].grow(order);
-    /* Merge the multiple hash tables into one, creating an offset remap table. */
-    int **offset_remap = new int *[nThreads];
+    /* Merge the multiple hash tables into one and give back the memory of the merged ones. */
     for(int i = 1; i < nThreads; i++)
     {
       const Key *oldKeys = hashTables[i].getKeys();
       const Value *oldVals = hashTables[i].getValues();
       const int filled = hashTables[i].size();
-      offset_remap[i] = new int[filled];
       for(int j = 0; j < filled; j++)
       {
         Value *val = hashTables[0].lookup(oldKeys[j], true);
 	val->add(oldVals[j]);
-        offset_remap[i][j] = val - hashTables[0].getValues();
-      }
-    }
-
-    /* Rewrite the offsets in the replay structure from the above generated table. */
-    for(int i = 0; i < nData; i++)
-    {
-      if(replay[i].table > 0)
-      {
-        for (int dim = 0; dim <= D; dim++)
-	  replay[i].offset[dim] = offset_remap[replay[i].table][replay[i].offset[dim]];
       }
+      hashTables[i].reset();
     }
-
-    for(int i = 1; i < nThreads; i++) delete[] offset_remap[i];
-    delete[] offset_remap;
   }
 
-  /* Performs slicing out of position vectors. Note that the barycentric weights and the simplex
-   * containing each position vector were calculated and stored in the splatting step.
-   * We may reuse this to accelerate the algorithm. (See pg. 6 in paper.)
+  /* Performs slicing out of position vectors. The simplex containing each position vector and the
+   * barycentric weights are found again like in the splatting step, every vertex of it exists in the
+   * merged table. Slicing is safe to run from several threads at once.
    */
-  void slice(float *col, size_t replay_index)
+  void slice(float *col, const float *position)
   {
-    const Value *base = hashTables[0].getValues();
+    Key keys[D + 1];
+    float barycentric[D + 2];
+    locate(position, keys, barycentric);
+
     Value::clear(col);
-    ReplayEntry &r = replay[replay_index];
     for(int i = 0; i <= D; i++)
     {
-      base[r.offset[i]].addTo(col,r.weight[i]);
+      const Value *val = hashTables[0].lookup(keys[i], false);
+      if(val) val->addTo(col,barycentric[i]);
     }
   }
 
@@ -567,21 +578,10 @@ public:
   }
 
 private:
-  int nData;
   int nThreads;
   const float *scaleFactor;
   const int *canonical;
 
-  // slicing is done by replaying splatting (ie storing the sparse matrix)
-  struct ReplayEntry
-  {
-    // since every dimension of a lattice point gets handled by the same thread,
-    // we only need to store the id of the hash table once, instead of for each dimension
-    int table;
-    int offset[D+1];
-    float weight[D+1];
-  } *replay;
-
   HashTable *hashTables;
 };
 
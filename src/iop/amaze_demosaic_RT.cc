@@ -37,6 +37,7 @@ void amaze_demosaic_RT(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *pie
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <unistd.h>
 
 static __inline float clampnan(const float x, const float m, const float M)
 {
@@ -317,10 +318,15 @@ template <typename _Tp> static inline const _Tp ULIM(const _Tp a, const _Tp b, c
 // {
 
 // SSEFUNCTION void RawImageSource::amaze_demosaic_RT(int winx, int winy, int winw, int winh)
-void amaze_demosaic_RT(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const float *const in,
-                       float *out, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out,
-                       const int filters)
+// ts is the tile size; the image is processed in square tiles to lower memory requirements and facilitate
+// multi-threading. it has to be a multiple of 32 in the range [96;992], see amaze_tile_size()
+template <int ts>
+static void amaze_demosaic_RT_tiled(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
+                                    const float *const in, float *out, const dt_iop_roi_t *const roi_in,
+                                    const dt_iop_roi_t *const roi_out, const int filters)
 {
+  static_assert(ts % 32 == 0 && ts >= 96 && ts <= 992, "amaze tile size has to be a multiple of 32 in [96;992]");
+
   //   BENCHFUN
 
   //   volatile double progress = 0.0;
@@ -345,15 +351,6 @@ void amaze_demosaic_RT(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *pie
                               fminf(piece->pipe->dsc.processed_maximum[1], piece->pipe->dsc.processed_maximum[2]));
   const float clip_pt8 = 0.8f * clip_pt;
 
-// this allows to pass AMAZETS to the code. On some machines larger AMAZETS is faster
-// If AMAZETS is undefined it will be set to 160, which is the fastest on modern x86/64 machines
-#ifndef AMAZETS
-#define AMAZETS 160
-#endif
-  // Tile size; the image is processed in square tiles to lower memory requirements and facilitate
-  // multi-threading
-  // We assure that Tile size is a multiple of 32 in the range [96;992]
-  constexpr int ts = (AMAZETS & 992) < 96 ? 96 : (AMAZETS & 992);
   constexpr int tsh = ts / 2; // half of Tile size
 
   // offset of R pixel within a Bayer quartet
@@ -481,9 +478,11 @@ void amaze_demosaic_RT(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *pie
     float *nyqutest = (float(*))((char *)nyquist + sizeof(unsigned char) * ts * tsh + cldf * 64); // 1
 
 // Main algorithm: Tile loop
-// use collapse(2) to collapse the 2 loops to one large loop, so there is better scaling
+// use collapse(2) to collapse the 2 loops to one large loop, so there is better scaling.
+// tiles at the right and bottom edges are smaller, hand them out dynamically so no thread ends up
+// waiting for the others on machines with many cores
 #ifdef _OPENMP
-#pragma omp for SIMD() schedule(static) collapse(2) nowait
+#pragma omp for SIMD() schedule(dynamic) collapse(2) nowait
 #endif
 
     for(int top = winy - 16; top < winy + height; top += ts - 32)
@@ -2421,6 +2420,68 @@ void amaze_demosaic_RT(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *pie
 }
 // }
 
+// bytes of working space each thread needs for a tile of size ts, see the buffer in amaze_demosaic_RT_tiled()
+static constexpr size_t amaze_tile_bytes(const int ts)
+{
+  return 14 * sizeof(float) * ts * ts + sizeof(char) * ts * (ts / 2);
+}
+
+// larger tiles waste less time on the 16 pixel borders they share with their neighbours, but the working
+// space of a tile should stay in the L2 cache of the core. only about half of the buffers are used at a
+// time, so allow twice the cache size. AMAZETS can be passed to the build to force a size.
+static int amaze_tile_size()
+{
+#ifdef AMAZETS
+  return (AMAZETS & 992) < 96 ? 96 : (AMAZETS & 992);
+#else
+  static int tile_size = 0;
+  if(tile_size) return tile_size;
+
+  long l2 = 0;
+#ifdef _SC_LEVEL2_CACHE_SIZE
+  l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+  int ts = 160; // the fastest on most x86/64 machines if we don't know better
+  if(l2 > 0)
+  {
+    ts = 96;
+    for(int candidate = 128; candidate <= 192; candidate += 32)
+      if(amaze_tile_bytes(candidate) <= 2 * (size_t)l2) ts = candidate;
+  }
+  dt_print(DT_DEBUG_PERF, "[amaze_demosaic_RT] L2 cache %ld bytes, using tiles of %d pixels\n", l2, ts);
+  tile_size = ts;
+  return ts;
+#endif
+}
+
+void amaze_demosaic_RT(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const float *const in,
+                       float *out, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out,
+                       const int filters)
+{
+  switch(amaze_tile_size())
+  {
+    case 96:
+      amaze_demosaic_RT_tiled<96>(self, piece, in, out, roi_in, roi_out, filters);
+      break;
+    case 128:
+      amaze_demosaic_RT_tiled<128>(self, piece, in, out, roi_in, roi_out, filters);
+      break;
+    case 192:
+      amaze_demosaic_RT_tiled<192>(self, piece, in, out, roi_in, roi_out, filters);
+      break;
+#ifdef AMAZETS
+    default:
+      amaze_demosaic_RT_tiled<(AMAZETS & 992) < 96 ? 96 : (AMAZETS & 992)>(self, piece, in, out, roi_in, roi_out,
+                                                                            filters);
+      break;
+#else
+    default:
+      amaze_demosaic_RT_tiled<160>(self, piece, in, out, roi_in, roi_out, filters);
+      break;
+#endif
+  }
+}
+
 /*==================================================================================
  * end of raw therapee code
  *==================================================================================*/
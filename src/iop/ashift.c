@@ -60,7 +60,6 @@
 #define SHEAR_RANGE_SOFT 0.5                // allowed min/max range for shear parameter with manual adjustment
 #define MIN_LINE_LENGTH 5                   // the minimum length of a line in pixels to be regarded as relevant
 #define MAX_TANGENTIAL_DEVIATION 30         // by how many degrees a line may deviate from the +/-180 and +/-90 to be regarded as relevant
-#define LSD_SCALE 0.99                      // LSD: scaling factor for line detection
 #define LSD_SIGMA_SCALE 0.6                 // LSD: sigma for Gaussian filter is computed as sigma = sigma_scale/scale
 #define LSD_QUANT 2.0                       // LSD: bound to the quantization error on the gradient norm
 #define LSD_ANG_TH 22.5                     // LSD: gradient angle tolerance in degrees
@@ -68,6 +67,8 @@
 #define LSD_DENSITY_TH 0.7                  // LSD: minimal density of region points in rectangle
 #define LSD_N_BINS 1024                     // LSD: number of bins in pseudo-ordering of gradient modulus
 #define LSD_GAMMA 0.45                      // gamma correction to apply on raw images prior to line detection
+#define LSD_TILE 512                        // LSD: size of the tiles the lines are detected in, in parallel
+#define LSD_TILE_BORDER 32                  // LSD: overlap of the tiles, a line belongs to the tile holding its center
 #define RANSAC_RUNS 400                     // how many iterations to run in ransac
 #define RANSAC_EPSILON 2                    // starting value for ransac epsilon (in -log10 units)
 #define RANSAC_EPSILON_STEP 1               // step size of epsilon optimization (log10 units)
@@ -248,6 +249,14 @@ typedef enum dt_iop_ashift_jobcode_t
   ASHIFT_JOBCODE_FIT = 2
 } dt_iop_ashift_jobcode_t;
 
+typedef enum dt_iop_ashift_structure_result_t
+{
+  ASHIFT_STRUCTURE_CANCELLED = 0,
+  ASHIFT_STRUCTURE_OK = 1,
+  ASHIFT_STRUCTURE_NOT_FOUND = 2,
+  ASHIFT_STRUCTURE_NO_OUTLIER_REMOVAL = 3
+} dt_iop_ashift_structure_result_t;
+
 typedef struct dt_iop_ashift_params1_t
 {
   float rotation;
@@ -428,6 +437,7 @@ typedef struct dt_iop_ashift_gui_data_t
   float crop_cy;
   dt_iop_ashift_jobcode_t jobcode;
   int jobparams;
+  struct dt_iop_ashift_structure_t *structure; // the structure detection running in the background, if any
   dt_pthread_mutex_t lock;
   gboolean adjust_crop;
   float cl;	// shadow copy of dt_iop_ashift_data_t.cl
@@ -436,6 +446,31 @@ typedef struct dt_iop_ashift_gui_data_t
   float cb;	// shadow copy of dt_iop_ashift_data_t.cb
 } dt_iop_ashift_gui_data_t;
 
+// a structure detection, run in a background job on a copy of the preview buffer. the job only works on this
+// struct, structure_done() hands the lines over to the gui data in the gui thread.
+typedef struct dt_iop_ashift_structure_t
+{
+  dt_iop_module_t *self;          // NULL once the gui is gone, only accessed in the gui thread
+  dt_iop_ashift_fitaxis_t fit;    // the fit to run once the lines are there, if any
+  dt_iop_ashift_enhance_t enhance;
+  int is_raw;
+  float lsd_scale;
+  gint cancelled;
+  float *buf;
+  int width;
+  int height;
+  int x_off;
+  int y_off;
+  float scale;
+  dt_iop_ashift_structure_result_t result;
+  dt_iop_ashift_line_t *lines;
+  int lines_count;
+  int vertical_count;
+  int horizontal_count;
+  float vertical_weight;
+  float horizontal_weight;
+} dt_iop_ashift_structure_t;
+
 typedef struct dt_iop_ashift_data_t
 {
   float rotation;
@@ -1428,9 +1463,110 @@ static void gamma_correct(const float *in, float *out, const int width, const in
 
 // do actual line_detection based on LSD algorithm and return results according
 // to this module's conventions
+// the logarithm of the number of tests LSD makes on an image of width x height scaled by scale
+static inline double lsd_log_nt(const int width, const int height, const double scale)
+{
+  return 2.5 * (log10(ceil(width * scale)) + log10(ceil(height * scale))) + log10(11.0);
+}
+
+// run LSD on tiles of the image in parallel. every tile is taken with its border and keeps the lines whose
+// center lies in it. the detection threshold of a tile is raised by the number of tests it makes less than LSD
+// on the whole image, so a line is as meaningful as before to be taken. returns the lines in the format of
+// LineSegmentDetection(), in coordinates of the whole image.
+static double *lsd_tiled(int *n_out, double *img, const int width, const int height, const double scale)
+{
+  const int tiles_x = (width + LSD_TILE - 1) / LSD_TILE;
+  const int tiles_y = (height + LSD_TILE - 1) / LSD_TILE;
+  const int tiles = tiles_x * tiles_y;
+
+  if(tiles == 1)
+    return LineSegmentDetection(n_out, img, width, height, scale, LSD_SIGMA_SCALE, LSD_QUANT, LSD_ANG_TH,
+                                LSD_LOG_EPS, LSD_DENSITY_TH, LSD_N_BINS, NULL, NULL, NULL);
+
+  const double log_nt = lsd_log_nt(width, height, scale);
+  double **tile_lines = calloc(tiles, sizeof(double *));
+  int *tile_count = calloc(tiles, sizeof(int));
+  if(tile_lines == NULL || tile_count == NULL)
+  {
+    free(tile_lines);
+    free(tile_count);
+    *n_out = 0;
+    return NULL;
+  }
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(img, width, height, scale, tiles, tiles_x, tiles_y, log_nt, tile_lines, tile_count) \
+  schedule(dynamic)
+#endif
+  for(int t = 0; t < tiles; t++)
+  {
+    const int tx = t % tiles_x;
+    const int ty = t / tiles_x;
+    const int x0 = MAX(tx * LSD_TILE - LSD_TILE_BORDER, 0);
+    const int y0 = MAX(ty * LSD_TILE - LSD_TILE_BORDER, 0);
+    const int x1 = MIN((tx + 1) * LSD_TILE + LSD_TILE_BORDER, width);
+    const int y1 = MIN((ty + 1) * LSD_TILE + LSD_TILE_BORDER, height);
+    const int w = x1 - x0;
+    const int h = y1 - y0;
+
+    double *tile = malloc(sizeof(double) * w * h);
+    if(tile == NULL) continue;
+    for(int j = 0; j < h; j++)
+      memcpy(tile + (size_t)j * w, img + (size_t)(y0 + j) * width + x0, sizeof(double) * w);
+
+    const double log_eps_offset = log_nt - lsd_log_nt(w, h, scale);
+    int count = 0;
+    double *lines = LineSegmentDetection(&count, tile, w, h, scale, LSD_SIGMA_SCALE, LSD_QUANT, LSD_ANG_TH,
+                                         LSD_LOG_EPS + log_eps_offset, LSD_DENSITY_TH, LSD_N_BINS, NULL, NULL,
+                                         NULL);
+    free(tile);
+
+    int kept = 0;
+    for(int n = 0; n < count; n++)
+    {
+      const double *const l = lines + n * 7;
+      const double cx = x0 + 0.5 * (l[0] + l[2]);
+      const double cy = y0 + 0.5 * (l[1] + l[3]);
+      if(CLAMP((int)floor(cx / LSD_TILE), 0, tiles_x - 1) != tx
+         || CLAMP((int)floor(cy / LSD_TILE), 0, tiles_y - 1) != ty)
+        continue;
+
+      double *const k = lines + kept * 7;
+      memmove(k, l, sizeof(double) * 7);
+      k[0] += x0;
+      k[1] += y0;
+      k[2] += x0;
+      k[3] += y0;
+      k[6] -= log_eps_offset; // -log10(NFA) as on the whole image
+      kept++;
+    }
+    tile_lines[t] = lines;
+    tile_count[t] = kept;
+  }
+
+  int lines_count = 0;
+  for(int t = 0; t < tiles; t++) lines_count += tile_count[t];
+
+  double *lines = malloc(sizeof(double) * 7 * MAX(lines_count, 1));
+  int n = 0;
+  for(int t = 0; t < tiles; t++)
+  {
+    if(lines && tile_count[t]) memcpy(lines + n * 7, tile_lines[t], sizeof(double) * 7 * tile_count[t]);
+    n += tile_count[t];
+    free(tile_lines[t]);
+  }
+  free(tile_lines);
+  free(tile_count);
+
+  *n_out = lines ? lines_count : 0;
+  return lines;
+}
+
 static int line_detect(float *in, const int width, const int height, const int x_off, const int y_off,
                        const float scale, dt_iop_ashift_line_t **alines, int *lcount, int *vcount, int *hcount,
-                       float *vweight, float *hweight, dt_iop_ashift_enhance_t enhance, const int is_raw)
+                       float *vweight, float *hweight, dt_iop_ashift_enhance_t enhance, const int is_raw,
+                       const float lsd_scale)
 {
   double *greyscale = NULL;
   double *lsd_lines = NULL;
@@ -1466,15 +1602,12 @@ static int line_detect(float *in, const int width, const int height, const int x
     (void)edge_enhance(greyscale, greyscale, width, height);
   }
 
-  // call the line segment detector LSD;
+  // call the line segment detector LSD, tile by tile;
   // LSD stores the number of found lines in lines_count.
   // it returns structural details as vector 'double lines[7 * lines_count]'
   int lines_count;
 
-  lsd_lines = LineSegmentDetection(&lines_count, greyscale, width, height,
-                                   LSD_SCALE, LSD_SIGMA_SCALE, LSD_QUANT,
-                                   LSD_ANG_TH, LSD_LOG_EPS, LSD_DENSITY_TH,
-                                   LSD_N_BINS, NULL, NULL, NULL);
+  lsd_lines = lsd_tiled(&lines_count, greyscale, width, height, lsd_scale);
 
   // we count the lines that we really want to use
   int lct = 0;
@@ -1601,80 +1734,6 @@ error:
   return FALSE;
 }
 
-// get image from buffer, analyze for structure and save results
-static int get_structure(dt_iop_module_t *module, dt_iop_ashift_enhance_t enhance)
-{
-  dt_iop_ashift_gui_data_t *g = (dt_iop_ashift_gui_data_t *)module->gui_data;
-
-  float *buffer = NULL;
-  int width = 0;
-  int height = 0;
-  int x_off = 0;
-  int y_off = 0;
-  float scale = 0.0f;
-
-  dt_pthread_mutex_lock(&g->lock);
-  // read buffer data if they are available
-  if(g->buf != NULL)
-  {
-    width = g->buf_width;
-    height = g->buf_height;
-    x_off = g->buf_x_off;
-    y_off = g->buf_y_off;
-    scale = g->buf_scale;
-
-    // create a temporary buffer to hold image data
-    buffer = malloc((size_t)width * height * 4 * sizeof(float));
-    if(buffer != NULL)
-      memcpy(buffer, g->buf, (size_t)width * height * 4 * sizeof(float));
-  }
-  dt_pthread_mutex_unlock(&g->lock);
-
-  if(buffer == NULL) goto error;
-
-  // get rid of old structural data
-  g->lines_count = 0;
-  g->vertical_count = 0;
-  g->horizontal_count = 0;
-  free(g->lines);
-  g->lines = NULL;
-
-  dt_iop_ashift_line_t *lines;
-  int lines_count;
-  int vertical_count;
-  int horizontal_count;
-  float vertical_weight;
-  float horizontal_weight;
-
-  // get new structural data
-  if(!line_detect(buffer, width, height, x_off, y_off, scale, &lines, &lines_count,
-                  &vertical_count, &horizontal_count, &vertical_weight, &horizontal_weight,
-                  enhance, dt_image_is_raw(&module->dev->image_storage)))
-    goto error;
-
-  // save new structural data
-  g->lines_in_width = width;
-  g->lines_in_height = height;
-  g->lines_x_off = x_off;
-  g->lines_y_off = y_off;
-  g->lines_count = lines_count;
-  g->vertical_count = vertical_count;
-  g->horizontal_count = horizontal_count;
-  g->vertical_weight = vertical_weight;
-  g->horizontal_weight = horizontal_weight;
-  g->lines_version++;
-  g->lines_suppressed = 0;
-  g->lines = lines;
-
-  free(buffer);
-  return TRUE;
-
-error:
-  free(buffer);
-  return FALSE;
-}
-
-
 // swap two integer values
 static inline void swap(int *a, int *b)
 {
@@ -1905,34 +1964,32 @@ static void ransac(const dt_iop_ashift_line_t *lines, int *index_set, int *inout
 
 // try to clean up structural data by eliminating outliers and thereby increasing
 // the chance of a convergent fitting
-static int remove_outliers(dt_iop_module_t *module)
+static int remove_outliers(dt_iop_ashift_structure_t *s)
 {
-  dt_iop_ashift_gui_data_t *g = (dt_iop_ashift_gui_data_t *)module->gui_data;
+  dt_iop_ashift_line_t *lines = s->lines;
 
-  const int width = g->lines_in_width;
-  const int height = g->lines_in_height;
-  const int xmin = g->lines_x_off;
-  const int ymin = g->lines_y_off;
-  const int xmax = xmin + width;
-  const int ymax = ymin + height;
+  const int xmin = s->x_off;
+  const int ymin = s->y_off;
+  const int xmax = xmin + s->width;
+  const int ymax = ymin + s->height;
 
   // holds the index set of lines we want to work on
-  int *lines_set = malloc(g->lines_count * sizeof(int));
+  int *lines_set = malloc(s->lines_count * sizeof(int));
   // holds the result of ransac
-  int *inout_set = malloc(g->lines_count * sizeof(int));
+  int *inout_set = malloc(s->lines_count * sizeof(int));
 
   // some accounting variables
   int vnb = 0, vcount = 0;
   int hnb = 0, hcount = 0;
 
   // just to be on the safe side
-  if(g->lines == NULL) goto error;
+  if(lines == NULL) goto error;
 
   // generate index list for the vertical lines
-  for(int n = 0; n < g->lines_count; n++)
+  for(int n = 0; n < s->lines_count; n++)
   {
     // is this a selected vertical line?
-    if((g->lines[n].type & ASHIFT_LINE_MASK) != ASHIFT_LINE_VERTICAL_SELECTED)
+    if((lines[n].type & ASHIFT_LINE_MASK) != ASHIFT_LINE_VERTICAL_SELECTED)
       continue;
 
     lines_set[vnb] = n;
@@ -1942,7 +1999,7 @@ static int remove_outliers(dt_iop_module_t *module)
 
   // it only makes sense to call ransac if we have more than two lines
   if(vnb > 2)
-    ransac(g->lines, lines_set, inout_set, vnb, g->vertical_weight,
+    ransac(lines, lines_set, inout_set, vnb, s->vertical_weight,
            xmin, xmax, ymin, ymax);
 
   // adjust line selected flag according to the ransac results
@@ -1951,21 +2008,20 @@ static int remove_outliers(dt_iop_module_t *module)
     const int m = lines_set[n];
     if(inout_set[n] == 1)
     {
-      g->lines[m].type |= ASHIFT_LINE_SELECTED;
+      lines[m].type |= ASHIFT_LINE_SELECTED;
       vcount++;
     }
     else
-      g->lines[m].type &= ~ASHIFT_LINE_SELECTED;
+      lines[m].type &= ~ASHIFT_LINE_SELECTED;
   }
   // update number of vertical lines
-  g->vertical_count = vcount;
-  g->lines_version++;
+  s->vertical_count = vcount;
 
   // now generate index list for the horizontal lines
-  for(int n = 0; n < g->lines_count; n++)
+  for(int n = 0; n < s->lines_count; n++)
   {
     // is this a selected horizontal line?
-    if((g->lines[n].type & ASHIFT_LINE_MASK) != ASHIFT_LINE_HORIZONTAL_SELECTED)
+    if((lines[n].type & ASHIFT_LINE_MASK) != ASHIFT_LINE_HORIZONTAL_SELECTED)
       continue;
 
     lines_set[hnb] = n;
@@ -1975,7 +2031,7 @@ static int remove_outliers(dt_iop_module_t *module)
 
   // it only makes sense to call ransac if we have more than two lines
   if(hnb > 2)
-    ransac(g->lines, lines_set, inout_set, hnb, g->horizontal_weight,
+    ransac(lines, lines_set, inout_set, hnb, s->horizontal_weight,
            xmin, xmax, ymin, ymax);
 
   // adjust line selected flag according to the ransac results
@@ -1984,15 +2040,14 @@ static int remove_outliers(dt_iop_module_t *module)
     const int m = lines_set[n];
     if(inout_set[n] == 1)
     {
-      g->lines[m].type |= ASHIFT_LINE_SELECTED;
+      lines[m].type |= ASHIFT_LINE_SELECTED;
       hcount++;
     }
     else
-      g->lines[m].type &= ~ASHIFT_LINE_SELECTED;
+      lines[m].type &= ~ASHIFT_LINE_SELECTED;
   }
   // update number of horizontal lines
-  g->horizontal_count = hcount;
-  g->lines_version++;
+  s->horizontal_count = hcount;
 
   free(inout_set);
   free(lines_set);
@@ -2785,54 +2840,105 @@ static void crop_adjust(dt_iop_module_t *module, const dt_iop_ashift_params_t *c
   return;
 }
 
-// helper function to start analysis for structural data and report about errors
+static gboolean structure_done(gpointer user_data);
+
+static inline int structure_cancelled(dt_job_t *job, dt_iop_ashift_structure_t *s)
+{
+  return g_atomic_int_get(&s->cancelled) || dt_control_job_get_state(job) == DT_JOB_STATE_CANCELLED;
+}
+
+// detect the lines and remove the outliers in a background job
+static int32_t structure_job_run(dt_job_t *job)
+{
+  dt_iop_ashift_structure_t *s = (dt_iop_ashift_structure_t *)dt_control_job_get_params(job);
+
+  if(structure_cancelled(job, s)) return 0;
+
+  if(!line_detect(s->buf, s->width, s->height, s->x_off, s->y_off, s->scale, &s->lines, &s->lines_count,
+                  &s->vertical_count, &s->horizontal_count, &s->vertical_weight, &s->horizontal_weight,
+                  s->enhance, s->is_raw, s->lsd_scale))
+  {
+    s->result = ASHIFT_STRUCTURE_NOT_FOUND;
+    return 0;
+  }
+
+  dt_control_job_set_progress(job, 0.5);
+  if(structure_cancelled(job, s)) return 0;
+
+  s->result = remove_outliers(s) ? ASHIFT_STRUCTURE_OK : ASHIFT_STRUCTURE_NO_OUTLIER_REMOVAL;
+  dt_control_job_set_progress(job, 1.0);
+  return 0;
+}
+
+// called once for every job, also if it never ran. the results go to the gui thread.
+static void structure_job_destroy(void *data)
+{
+  g_idle_add(structure_done, data);
+}
+
+// start the structure detection in the background. the lines replace the current ones once it is done, then
+// the fit in direction fit is run on them, if any. returns FALSE if the detection could not be started.
 static int do_get_structure(dt_iop_module_t *module, dt_iop_ashift_params_t *p,
-                            dt_iop_ashift_enhance_t enhance)
+                            dt_iop_ashift_enhance_t enhance, dt_iop_ashift_fitaxis_t fit)
 {
   dt_iop_ashift_gui_data_t *g = (dt_iop_ashift_gui_data_t *)module->gui_data;
 
   if(g->fitting) return FALSE;
 
-  g->fitting = 1;
+  dt_iop_ashift_structure_t *s = (dt_iop_ashift_structure_t *)calloc(1, sizeof(dt_iop_ashift_structure_t));
+  if(s == NULL) return FALSE;
 
   dt_pthread_mutex_lock(&g->lock);
-  float *b = g->buf;
-  dt_pthread_mutex_unlock(&g->lock);
-
-  if(b == NULL)
+  // read buffer data if they are available
+  if(g->buf != NULL)
   {
-    dt_control_log(_("data pending - please repeat"));
-    goto error;
+    s->width = g->buf_width;
+    s->height = g->buf_height;
+    s->x_off = g->buf_x_off;
+    s->y_off = g->buf_y_off;
+    s->scale = g->buf_scale;
+
+    // the job works on a copy of the image data
+    s->buf = malloc((size_t)s->width * s->height * 4 * sizeof(float));
+    if(s->buf != NULL)
+      memcpy(s->buf, g->buf, (size_t)s->width * s->height * 4 * sizeof(float));
   }
+  dt_pthread_mutex_unlock(&g->lock);
 
-  if(!get_structure(module, enhance))
+  if(s->buf == NULL)
   {
-    dt_control_log(_("could not detect structural data in image"));
+    dt_control_log(_("data pending - please repeat"));
 #ifdef ASHIFT_DEBUG
     // find out more
     printf("do_get_structure: buf %p, buf_hash %lu, buf_width %d, buf_height %d, lines %p, lines_count %d\n",
            g->buf, g->buf_hash, g->buf_width, g->buf_height, g->lines, g->lines_count);
 #endif
-    goto error;
+    free(s);
+    return FALSE;
   }
 
-  if(!remove_outliers(module))
+  dt_job_t *job = dt_control_job_create(structure_job_run, "perspective correction structure");
+  if(job == NULL)
   {
-    dt_control_log(_("could not run outlier removal"));
-#ifdef ASHIFT_DEBUG
-    // find out more
-    printf("remove_outliers: buf %p, buf_hash %lu, buf_width %d, buf_height %d, lines %p, lines_count %d\n",
-           g->buf, g->buf_hash, g->buf_width, g->buf_height, g->lines, g->lines_count);
-#endif
-    goto error;
+    free(s->buf);
+    free(s);
+    return FALSE;
   }
 
-  g->fitting = 0;
-  return TRUE;
+  s->self = module;
+  s->fit = fit;
+  s->enhance = enhance;
+  s->is_raw = dt_image_is_raw(&module->dev->image_storage);
+  s->lsd_scale = CLAMP(dt_conf_get_float("plugins/darkroom/ashift/lsd_scale"), 0.1f, 1.0f);
+  s->result = ASHIFT_STRUCTURE_CANCELLED;
 
-error:
-  g->fitting = 0;
-  return FALSE;
+  g->fitting = 1;
+  g->structure = s;
+
+  dt_control_job_set_params(job, s, structure_job_destroy);
+  dt_control_job_add_progress(job, _("detecting structure"), TRUE);
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_FG, job);
+  return TRUE;
 }
 
 // helper function to clean structural data
@@ -2861,9 +2967,12 @@ static int do_fit(dt_iop_module_t *module, dt_iop_ashift_params_t *p, dt_iop_ash
 
   if(g->fitting) return FALSE;
 
-  // if no structure available get it
+  // if no structure available get it, the fit follows once it is there
   if(g->lines == NULL)
-    if(!do_get_structure(module, p, ASHIFT_ENHANCE_NONE)) goto error;
+  {
+    (void)do_get_structure(module, p, ASHIFT_ENHANCE_NONE, dir);
+    return FALSE;
+  }
 
   g->fitting = 1;
 
@@ -2896,6 +3005,71 @@ error:
   return FALSE;
 }
 
+// take the results of a structure detection in the gui thread
+static gboolean structure_done(gpointer user_data)
+{
+  dt_iop_ashift_structure_t *s = (dt_iop_ashift_structure_t *)user_data;
+  dt_iop_module_t *self = s->self;
+
+  if(self)
+  {
+    dt_iop_ashift_params_t *p = (dt_iop_ashift_params_t *)self->params;
+    dt_iop_ashift_gui_data_t *g = (dt_iop_ashift_gui_data_t *)self->gui_data;
+
+    g->structure = NULL;
+    g->fitting = 0;
+
+    if(s->result != ASHIFT_STRUCTURE_CANCELLED)
+    {
+      // get rid of old structural data
+      (void)do_clean_structure(self, p);
+    }
+
+    if(s->result == ASHIFT_STRUCTURE_OK || s->result == ASHIFT_STRUCTURE_NO_OUTLIER_REMOVAL)
+    {
+      // save new structural data
+      g->lines_in_width = s->width;
+      g->lines_in_height = s->height;
+      g->lines_x_off = s->x_off;
+      g->lines_y_off = s->y_off;
+      g->lines_count = s->lines_count;
+      g->vertical_count = s->vertical_count;
+      g->horizontal_count = s->horizontal_count;
+      g->vertical_weight = s->vertical_weight;
+      g->horizontal_weight = s->horizontal_weight;
+      g->lines_version++;
+      g->lines_suppressed = 0;
+      g->lines = s->lines;
+      s->lines = NULL;
+    }
+
+    if(s->result == ASHIFT_STRUCTURE_NOT_FOUND)
+      dt_control_log(_("could not detect structural data in image"));
+    else if(s->result == ASHIFT_STRUCTURE_NO_OUTLIER_REMOVAL)
+      dt_control_log(_("could not run outlier removal"));
+    else if(s->result == ASHIFT_STRUCTURE_OK && s->fit != ASHIFT_FIT_NONE)
+    {
+      if(do_fit(self, p, s->fit))
+      {
+        ++darktable.gui->reset;
+        dt_bauhaus_slider_set_soft(g->rotation, p->rotation);
+        dt_bauhaus_slider_set_soft(g->lensshift_v, p->lensshift_v);
+        dt_bauhaus_slider_set_soft(g->lensshift_h, p->lensshift_h);
+        dt_bauhaus_slider_set_soft(g->shear, p->shear);
+        --darktable.gui->reset;
+      }
+      dt_dev_add_history_item(darktable.develop, self, TRUE);
+    }
+
+    dt_control_queue_redraw_center();
+  }
+
+  free(s->lines);
+  free(s->buf);
+  free(s);
+  return FALSE;
+}
+
 void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
              void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
@@ -4357,7 +4531,7 @@ static int structure_button_clicked(GtkWidget *widget, GdkEventButton *event, gp
     if(self->enabled)
     {
       // module is enabled -> process directly
-      (void)do_get_structure(self, p, enhance);
+      (void)do_get_structure(self, p, enhance, ASHIFT_FIT_NONE);
     }
     else
     {
@@ -4423,7 +4597,7 @@ static void process_after_preview_callback(gpointer instance, gpointer user_data
   switch(jobcode)
   {
     case ASHIFT_JOBCODE_GET_STRUCTURE:
-      (void)do_get_structure(self, p, (dt_iop_ashift_enhance_t)jobparams);
+      (void)do_get_structure(self, p, (dt_iop_ashift_enhance_t)jobparams, ASHIFT_FIT_NONE);
       break;
 
     case ASHIFT_JOBCODE_FIT:
@@ -4737,6 +4911,7 @@ void gui_init(struct dt_iop_module_t *self)
   dt_pthread_mutex_unlock(&g->lock);
 
   g->fitting = 0;
+  g->structure = NULL;
   g->lines = NULL;
   g->lines_count = 0;
   g->vertical_count = 0;
@@ -4913,6 +5088,14 @@ void gui_cleanup(struct dt_iop_module_t *self)
   dt_control_signal_disconnect(darktable.signals, G_CALLBACK(process_after_preview_callback), self);
 
   dt_iop_ashift_gui_data_t *g = (dt_iop_ashift_gui_data_t *)self->gui_data;
+
+  // a running structure detection stops and leaves its results alone
+  if(g->structure)
+  {
+    g->structure->self = NULL;
+    g_atomic_int_set(&g->structure->cancelled, TRUE);
+  }
+
   dt_pthread_mutex_destroy(&g->lock);
   free(g->lines);
   free(g->buf);
@@ -364,7 +364,7 @@ int default_group()
 
 int flags()
 {
-  return IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_ALLOW_TILING;
+  return IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_HALF_INPUT;
 }
 
 int default_colorspace(dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
@@ -413,13 +413,13 @@ static void set_presets(dt_iop_module_so_t *self, const basecurve_preset_t *pres
 void init_presets(dt_iop_module_so_t *self)
 {
   // sql begin
-  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "BEGIN", NULL, NULL, NULL);
+  dt_database_start_transaction(darktable.db);
 
   set_presets(self, basecurve_presets, basecurve_presets_cnt, FALSE);
   set_presets(self, basecurve_camera_presets, basecurve_camera_presets_cnt, TRUE);
 
   // sql commit
-  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+  dt_database_release_transaction(darktable.db);
 }
 
 static float exposure_increment(float stops, int e, float fusion, float bias)
@@ -1061,86 +1061,79 @@ static inline void compute_features(
   }
 }
 
-static inline void gauss_blur(
-    const float *const input,
-    float *const output,
-    const size_t wd,
+// mirrors x into [0, n) the way the 1 4 6 4 1 kernel of the pyramids reads beyond the borders
+static inline int fusion_mirror(const int x, const int n)
+{
+  return x < 0 ? -x : (x >= n ? 2 * n - 1 - x : x);
+}
+
+static inline void gauss_expand(
+    const float *const input, // coarse input
+    float *const fine,        // upsampled, blurry output
+    const size_t wd,          // fine res
     const size_t ht)
 {
+  // the coarse pixels are the even fine pixels, times 4, with zeros in between. the separable blur only adds
+  // up the even taps, the horizontal pass only runs on the even rows.
+  const size_t cw = (wd-1)/2+1, ch = (ht-1)/2+1;
   const float w[5] = { 1.f / 16.f, 4.f / 16.f, 6.f / 16.f, 4.f / 16.f, 1.f / 16.f };
-  float *tmp = dt_alloc_align(64, (size_t)wd*ht*4*sizeof(float));
-  memset(tmp, 0, 4*wd*ht*sizeof(float));
+  float *const tmp = dt_alloc_align(64, sizeof(float) * 4 * wd * ch);
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(ht, input, w, wd) \
-  shared(tmp) \
+  dt_omp_firstprivate(ch, cw, input, tmp, w, wd) \
   schedule(static)
 #endif
-  for(int j=0;j<ht;j++)
+  for(int j = 0; j < ch; j++)
   { // horizontal pass
-    // left borders
-    for(int i=0;i<2;i++) for(int c=0;c<4;c++)
-      for(int ii=-2;ii<=2;ii++)
-        tmp[4*(j*wd+i)+c] += input[4*(j*wd+MAX(-i-ii,i+ii))+c] * w[ii+2];
-    // most pixels
-    for(int i=2;i<wd-2;i++) for(int c=0;c<4;c++)
-      for(int ii=-2;ii<=2;ii++)
-        tmp[4*(j*wd+i)+c] += input[4*(j*wd+i+ii)+c] * w[ii+2];
-    // right borders
-    for(int i=wd-2;i<wd;i++) for(int c=0;c<4;c++)
-      for(int ii=-2;ii<=2;ii++)
-        tmp[4*(j*wd+i)+c] += input[4*(j*wd+MIN(i+ii, wd-(i+ii-wd+1) ))+c] * w[ii+2];
+    const float *const row = input + (size_t)4 * cw * j;
+    float *const t = tmp + (size_t)4 * wd * j;
+    for(int i = 0; i < wd; i++)
+    {
+      float sum[4] = { 0.f, 0.f, 0.f, 0.f };
+      for(int ii = -2; ii <= 2; ii++)
+      {
+        const int x = fusion_mirror(i + ii, wd);
+        if(x & 1) continue;
+        const float *const px = row + 4 * (x / 2);
+        const float wi = w[ii + 2];
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+        for(int c = 0; c < 4; c++) sum[c] += 4.0f * px[c] * wi;
+      }
+      for(int c = 0; c < 4; c++) t[4 * i + c] = sum[c];
+    }
   }
-  memset(output, 0, 4*wd*ht*sizeof(float));
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(ht, output, w, wd) \
-  shared(tmp) \
+  dt_omp_firstprivate(fine, ht, tmp, w, wd) \
   schedule(static)
 #endif
-  for(int i=0;i<wd;i++)
-  { // vertical pass
-    for(int j=0;j<2;j++) for(int c=0;c<4;c++)
-      for(int jj=-2;jj<=2;jj++)
-        output[4*(j*wd+i)+c] += tmp[4*(MAX(-j-jj,j+jj)*wd+i)+c] * w[jj+2];
-    for(int j=2;j<ht-2;j++) for(int c=0;c<4;c++)
-      for(int jj=-2;jj<=2;jj++)
-        output[4*(j*wd+i)+c] += tmp[4*((j+jj)*wd+i)+c] * w[jj+2];
-    for(int j=ht-2;j<ht;j++) for(int c=0;c<4;c++)
-      for(int jj=-2;jj<=2;jj++)
-        output[4*(j*wd+i)+c] += tmp[4*(MIN(j+jj, ht-(j+jj-ht+1))*wd+i)+c] * w[jj+2];
-  }
-  dt_free_align(tmp);
-}
-
-static inline void gauss_expand(
-    const float *const input, // coarse input
-    float *const fine,        // upsampled, blurry output
-    const size_t wd,          // fine res
-    const size_t ht)
-{
-  const size_t cw = (wd-1)/2+1;
-  // fill numbers in even pixels, zero odd ones
-  memset(fine, 0, 4*wd*ht*sizeof(float));
+  for(int j = 0; j < ht; j++)
+  { // vertical pass, along the rows
+    float *const out = fine + (size_t)4 * wd * j;
 #ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(cw, fine, ht, input, wd) \
-  schedule(static) \
-  collapse(2)
+#pragma omp simd
 #endif
-  for(int j=0;j<ht;j+=2)
-    for(int i=0;i<wd;i+=2)
-      for(int c=0;c<4;c++)
-        fine[4*(j*wd+i)+c] = 4.0f * input[4*(j/2*cw + i/2)+c];
-
-  // convolve with same kernel weights mul by 4:
-  gauss_blur(fine, fine, wd, ht);
+    for(size_t k = 0; k < 4 * wd; k++) out[k] = 0.0f;
+    for(int jj = -2; jj <= 2; jj++)
+    {
+      const int y = fusion_mirror(j + jj, ht);
+      if(y & 1) continue;
+      const float *const t = tmp + (size_t)4 * wd * (y / 2);
+      const float wj = w[jj + 2];
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+      for(size_t k = 0; k < 4 * wd; k++) out[k] += t[k] * wj;
+    }
+  }
+  dt_free_align(tmp);
 }
 
 // XXX FIXME: we'll need to pad up the image to get a good boundary condition!
 // XXX FIXME: downsampling will not result in an energy conserving pattern (every 4 pixels one sample)
 // XXX FIXME: neither will a mirror boundary condition (mirrors in subsampled values at random density)
-// TODO: copy laplacian code from local laplacian filters, it's faster.
 static inline void gauss_reduce(
     const float *const input, // fine input buffer
     float *const coarse,      // coarse scale, blurred input buf
@@ -1148,21 +1141,70 @@ static inline void gauss_reduce(
     const size_t wd,
     const size_t ht)
 {
-  // blur, store only coarse res
+  // blur, store only coarse res: the horizontal pass only runs on the even columns, the vertical one only
+  // on the even rows.
   const size_t cw = (wd-1)/2+1, ch = (ht-1)/2+1;
-
-  float *blurred = dt_alloc_align(64, (size_t)wd*ht*4*sizeof(float));
-  gauss_blur(input, blurred, wd, ht);
-  for(size_t j=0;j<ch;j++) for(size_t i=0;i<cw;i++)
-    for(int c=0;c<4;c++) coarse[4*(j*cw+i)+c] = blurred[4*(2*j*wd+2*i)+c];
-  dt_free_align(blurred);
+  const float w[5] = { 1.f / 16.f, 4.f / 16.f, 6.f / 16.f, 4.f / 16.f, 1.f / 16.f };
+  float *const tmp = dt_alloc_align(64, sizeof(float) * 4 * cw * ht);
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(cw, ht, input, tmp, w, wd) \
+  schedule(static)
+#endif
+  for(int j = 0; j < ht; j++)
+  { // horizontal pass
+    const float *const row = input + (size_t)4 * wd * j;
+    float *const t = tmp + (size_t)4 * cw * j;
+    for(int i = 0; i < cw; i++)
+    {
+      float sum[4] = { 0.f, 0.f, 0.f, 0.f };
+      for(int ii = -2; ii <= 2; ii++)
+      {
+        const float *const px = row + 4 * fusion_mirror(2 * i + ii, wd);
+        const float wi = w[ii + 2];
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+        for(int c = 0; c < 4; c++) sum[c] += px[c] * wi;
+      }
+      for(int c = 0; c < 4; c++) t[4 * i + c] = sum[c];
+    }
+  }
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(ch, coarse, cw, ht, tmp, w) \
+  schedule(static)
+#endif
+  for(int j = 0; j < ch; j++)
+  { // vertical pass, along the rows
+    float *const out = coarse + (size_t)4 * cw * j;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for(size_t k = 0; k < 4 * cw; k++) out[k] = 0.0f;
+    for(int jj = -2; jj <= 2; jj++)
+    {
+      const float *const t = tmp + (size_t)4 * cw * fusion_mirror(2 * j + jj, ht);
+      const float wj = w[jj + 2];
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+      for(size_t k = 0; k < 4 * cw; k++) out[k] += t[k] * wj;
+    }
+  }
+  dt_free_align(tmp);
 
   if(detail)
   {
     // compute laplacian/details: expand coarse buffer into detail
     // buffer subtract expanded buffer from input in place
     gauss_expand(coarse, detail, wd, ht);
-    for(size_t k=0;k<wd*ht*4;k++)
+#ifdef _OPENMP
+#pragma omp parallel for simd default(none) \
+    dt_omp_firstprivate(detail, ht, input, wd) \
+    schedule(static)
+#endif
+    for(size_t k = 0; k < 4 * wd * ht; k++)
       detail[k] = input[k] - detail[k];
   }
 }
@@ -1178,7 +1220,6 @@ void process_fusion(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
   // allocate temporary buffer for wavelet transform + blending
   const int wd = roi_in->width, ht = roi_in->height;
   int num_levels = 8;
-  float **col = malloc(num_levels * sizeof(float *));
   float **comb = malloc(num_levels * sizeof(float *));
   int w = wd, h = ht;
   const int rad = MIN(wd, (int)ceilf(256 * roi_in->scale / piece->iscale));
@@ -1186,7 +1227,6 @@ void process_fusion(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
   for(int k = 0; k < num_levels; k++)
   {
     // coarsest step is some % of image width.
-    col[k] = dt_alloc_align(64, sizeof(float) * 4 * w * h);
     comb[k] = dt_alloc_align(64, sizeof(float) * 4 * w * h);
     memset(comb[k], 0, sizeof(float) * 4 * w * h);
     w = (w - 1) / 2 + 1;
@@ -1199,6 +1239,12 @@ void process_fusion(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
     }
   }
 
+  // the gaussian pyramid of an exposure is blended into comb[] level by level while it is built, so only
+  // two of its levels are live at a time. level k is in col[k & 1]: the full size buffer takes the even
+  // levels, the quarter size one the odd levels. the output buffer holds the laplacian of the level.
+  float *col[2] = { dt_alloc_align(64, sizeof(float) * 4 * wd * ht),
+                    dt_alloc_align(64, sizeof(float) * 4 * ((wd - 1) / 2 + 1) * ((ht - 1) / 2 + 1)) };
+
   for(int e = 0; e < d->exposure_fusion + 1; e++)
   {
     // for every exposure fusion image:
@@ -1213,10 +1259,8 @@ void process_fusion(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
     // compute features
     compute_features(col[0], wd, ht);
 
-    // create gaussian pyramid of colour buffer
-    w = wd;
-    h = ht;
-    gauss_reduce(col[0], col[1], out, w, h);
+    // local contrast from the laplacian of the finest level
+    gauss_reduce(col[0], col[1], out, wd, ht);
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
     dt_omp_firstprivate(ht, out, wd) \
@@ -1228,55 +1272,47 @@ void process_fusion(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
 
 // #define DEBUG_VIS2
 #ifdef DEBUG_VIS2 // transform weights in channels
-    for(size_t k = 0; k < 4ul * w * h; k += 4) col[0][k + e] = col[0][k + 3];
+    for(size_t k = 0; k < 4ul * wd * ht; k += 4) col[0][k + e] = col[0][k + 3];
 #endif
 
 // #define DEBUG_VIS
 #ifdef DEBUG_VIS // DEBUG visualise weight buffer
-    for(size_t k = 0; k < 4ul * w * h; k += 4) comb[0][k + e] = col[0][k + 3];
+    for(size_t k = 0; k < 4ul * wd * ht; k += 4) comb[0][k + e] = col[0][k + 3];
     continue;
 #endif
 
-    for(int k = 1; k < num_levels; k++)
-    {
-      gauss_reduce(col[k - 1], col[k], 0, w, h);
-      w = (w - 1) / 2 + 1;
-      h = (h - 1) / 2 + 1;
-    }
-
-    // update pyramid coarse to fine
-    for(int k = num_levels - 1; k >= 0; k--)
+    // update pyramid fine to coarse
+    w = wd;
+    h = ht;
+    for(int k = 0; k < num_levels; k++)
     {
-      w = wd;
-      h = ht;
-      for(int i = 0; i < k; i++)
-      {
-        w = (w - 1) / 2 + 1;
-        h = (h - 1) / 2 + 1;
-      }
-      // abuse output buffer as temporary memory:
-      if(k != num_levels - 1) gauss_expand(col[k + 1], out, w, h);
+      const float *const fine = col[k & 1];
+      float *const blend = comb[k];
+      const int base = k == num_levels - 1;
+      // the weights of the finest level changed, its colour channels and thus the laplacian in the output
+      // buffer did not.
+      if(!base) gauss_reduce(fine, col[(k + 1) & 1], k ? out : NULL, w, h);
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-      dt_omp_firstprivate(out) \
-      shared(col, comb, w, h, num_levels, k) \
+      dt_omp_firstprivate(base, blend, fine, h, out, w) \
       schedule(static)
 #endif
-      for(int j = 0; j < h; j++)
-        for(int i = 0; i < w; i++)
-        {
-          const size_t x = 4 * ((size_t)w * j + i);
-          // blend images into output pyramid
-          if(k == num_levels - 1) // blend gaussian base
+      for(size_t x = 0; x < 4ul * w * h; x += 4)
+      {
+        // blend images into output pyramid
+        const float weight = fine[x + 3];
+        if(base) // blend gaussian base
 #ifdef DEBUG_VIS2
-            ;
+          ;
 #else
-            for(int c = 0; c < 3; c++) comb[k][x + c] += col[k][x + 3] * col[k][x + c];
+          for(int c = 0; c < 3; c++) blend[x + c] += weight * fine[x + c];
 #endif
-          else // laplacian
-            for(int c = 0; c < 3; c++) comb[k][x + c] += col[k][x + 3] * (col[k][x + c] - out[x + c]);
-          comb[k][x + 3] += col[k][x + 3];
-        }
+        else // laplacian
+          for(int c = 0; c < 3; c++) blend[x + c] += weight * out[x + c];
+        blend[x + 3] += weight;
+      }
+      w = (w - 1) / 2 + 1;
+      h = (h - 1) / 2 + 1;
     }
   }
 
@@ -1321,7 +1357,7 @@ void process_fusion(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
   // copy output buffer
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(col, in, ht, out, wd) \
+  dt_omp_firstprivate(in, ht, out, wd) \
   shared(comb) \
   schedule(static)
 #endif
@@ -1334,12 +1370,9 @@ void process_fusion(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
   }
 
   // free temp buffers
-  for(int k = 0; k < num_levels; k++)
-  {
-    dt_free_align(col[k]);
-    dt_free_align(comb[k]);
-  }
-  free(col);
+  for(int k = 0; k < num_levels; k++) dt_free_align(comb[k]);
+  dt_free_align(col[0]);
+  dt_free_align(col[1]);
   free(comb);
 }
 
@@ -209,7 +209,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   else
   {
     for(int k = 0; k < 5; k++) sigma[k] = 1.0f / sigma[k];
-    PermutohedralLattice<5, 4> lattice((size_t)roi_in->width * roi_in->height, omp_get_max_threads());
+    PermutohedralLattice<5, 4> lattice(omp_get_max_threads());
 
 // splat into the lattice
 #ifdef _OPENMP
@@ -219,12 +219,11 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
     {
       const float *in = (const float *)ivoid + (size_t)j * roi_in->width * ch;
       const int thread = omp_get_thread_num();
-      size_t index = (size_t)j * roi_in->width;
-      for(int i = 0; i < roi_in->width; i++, index++)
+      for(int i = 0; i < roi_in->width; i++)
       {
         float pos[5] = { i * sigma[0], j * sigma[1], in[0] * sigma[2], in[1] * sigma[3], in[2] * sigma[4] };
         float val[4] = { in[0], in[1], in[2], 1.0 };
-        lattice.splat(pos, val, index, thread);
+        lattice.splat(pos, val, thread);
         in += ch;
       }
     }
@@ -240,13 +239,15 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
 #endif
     for(int j = 0; j < roi_in->height; j++)
     {
+      const float *in = (const float *)ivoid + (size_t)j * roi_in->width * ch;
       float *out = (float *)ovoid + (size_t)j * roi_in->width * ch;
-      size_t index = (size_t)j * roi_in->width;
-      for(int i = 0; i < roi_in->width; i++, index++)
+      for(int i = 0; i < roi_in->width; i++)
       {
+        float pos[5] = { i * sigma[0], j * sigma[1], in[0] * sigma[2], in[1] * sigma[3], in[2] * sigma[4] };
         float val[4];
-        lattice.slice(val, index);
+        lattice.slice(val, pos);
         for(int k = 0; k < 3; k++) out[k] = val[k] / val[3];
+        in += ch;
         out += ch;
       }
     }
@@ -300,7 +301,7 @@ void tiling_callback(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t
   sigma[0] = data->sigma[0] * roi_in->scale / piece->iscale;
   sigma[1] = data->sigma[1] * roi_in->scale / piece->iscale;
   const int rad = (int)(3.0 * fmaxf(sigma[0], sigma[1]) + 1.0);
-  tiling->factor = 2 + 50;
+  tiling->factor = 2 + 37;
   tiling->overhead = 0;
   tiling->overlap = rad;
   tiling->xalign = 1;
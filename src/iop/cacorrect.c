@@ -304,7 +304,6 @@ static void CA_correct(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *pie
   const int width = roi_in->width;
   const int height = roi_in->height;
   const uint32_t filters = piece->pipe->dsc.filters;
-  memcpy(out, in2, width * height * sizeof(float));
   const float *const in = out;
   const double cared = 0, cablue = 0;
   const double caautostrength = 4;
@@ -322,6 +321,7 @@ static void CA_correct(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *pie
       if(FC(i, j, filters) == 3)
       {
         printf("CA correction supports only RGB Colour filter arrays\n");
+        memcpy(out, in2, sizeof(float) * width * height);
         return;
       }
 
@@ -422,11 +422,20 @@ static void CA_correct(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *pie
     float *gshift = rbhpfv; // there is no overlap in buffer usage => share
 
 
+    // the tiles read the copy, which is corrected in place at the very end. copied by all threads, a
+    // single memcpy of the mosaic is a serial part that limits the scaling
+#ifdef _OPENMP
+#pragma omp for schedule(static)
+#endif
+    for(int row = 0; row < height; row++)
+      memcpy(out + (size_t)row * width, in2 + (size_t)row * width, sizeof(float) * width);
+
     if(autoCA)
     {
 // Main algorithm: Tile loop calculating correction parameters per tile
+// the tiles along the borders are cheaper, a static split leaves threads idle
 #ifdef _OPENMP
-#pragma omp for collapse(2) schedule(static) nowait
+#pragma omp for collapse(2) schedule(dynamic) nowait
 #endif
       for(int top = -border; top < height; top += ts - border2)
         for(int left = -border; left < width; left += ts - border2)
@@ -1074,7 +1083,7 @@ static void CA_correct(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *pie
     if(processpasstwo)
     {
 #ifdef _OPENMP
-#pragma omp for schedule(static) collapse(2) nowait
+#pragma omp for schedule(dynamic) collapse(2) nowait
 #endif
 
       for(int top = -border; top < height; top += ts - border2)
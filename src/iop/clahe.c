@@ -21,6 +21,7 @@
 #include "bauhaus/bauhaus.h"
 #include "common/colorspaces.h"
 #include "common/darktable.h"
+#include "common/opencl.h"
 #include "control/control.h"
 #include "develop/develop.h"
 #include "develop/imageop.h"
@@ -35,16 +36,21 @@
 #include <stdlib.h>
 #include <string.h>
 
-#define CLIP(x) ((x < 0) ? 0.0 : (x > 1.0) ? 1.0 : x)
-
 #define ROUND_POSISTIVE(f) ((unsigned int)((f)+0.5))
 
-DT_MODULE(1)
+DT_MODULE(2)
+
+typedef struct dt_iop_rlce_params1_t
+{
+  double radius;
+  double slope;
+} dt_iop_rlce_params1_t;
 
 typedef struct dt_iop_rlce_params_t
 {
   double radius;
   double slope;
+  int tiled; // equalize around tile centers, version 1 slid the window along every row
 } dt_iop_rlce_params_t;
 
 typedef struct dt_iop_rlce_gui_data_t
@@ -58,8 +64,16 @@ typedef struct dt_iop_rlce_data_t
 {
   double radius;
   double slope;
+  int tiled;
 } dt_iop_rlce_data_t;
 
+typedef struct dt_iop_rlce_global_data_t
+{
+  int kernel_clahe_luminance;
+  int kernel_clahe_tile_mapping;
+  int kernel_clahe_apply;
+} dt_iop_rlce_global_data_t;
+
 
 const char *name()
 {
@@ -81,8 +95,126 @@ int default_colorspace(dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_p
   return iop_cs_rgb;
 }
 
-void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
-             void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+int legacy_params(dt_iop_module_t *self, const void *const old_params, const int old_version,
+                  void *new_params, const int new_version)
+{
+  if(old_version == 1 && new_version == 2)
+  {
+    const dt_iop_rlce_params1_t *old = old_params;
+    dt_iop_rlce_params_t *new = new_params;
+    new->radius = old->radius;
+    new->slope = old->slope;
+    // edits keep the look they were made with
+    new->tiled = FALSE;
+    return 0;
+  }
+  return 1;
+}
+
+// number of histogram bins minus one, the luminance is quantized to [0, BINS]
+#define BINS (256)
+// smallest spacing of the tile centers, so tiny radii don't end up with a mapping per pixel
+#define MIN_STEP (8)
+
+// the histogram is equalized in windows of 2 * rad + 1 pixels around tile centers step pixels apart, and the
+// mappings of the four surrounding centers are interpolated bilinearly. at a center this is the sliding
+// window of the original implementation.
+typedef struct dt_iop_rlce_tiles_t
+{
+  int rad, step;
+  int nx, ny; // number of tile centers
+} dt_iop_rlce_tiles_t;
+
+static dt_iop_rlce_tiles_t _tiles(const int rad, const int width, const int height)
+{
+  dt_iop_rlce_tiles_t t;
+  t.rad = rad;
+  t.step = MAX(rad, MIN_STEP);
+  t.nx = (width - 1 + t.step - 1) / t.step + 1;
+  t.ny = (height - 1 + t.step - 1) / t.step + 1;
+  return t;
+}
+
+// the clipped and redistributed cumulative histogram of the window of one tile, normalized to [0, 1]
+static void _tile_mapping(const uint16_t *const bins, const int width, const int height, const int cx,
+                          const int cy, const int rad, const float slope, float *const map)
+{
+  const int xMin = MAX(0, cx - rad), xMax = MIN(width, cx + rad + 1);
+  const int yMin = MAX(0, cy - rad), yMax = MIN(height, cy + rad + 1);
+
+  int hist[BINS + 1] = { 0 };
+  for(int yi = yMin; yi < yMax; ++yi)
+  {
+    const uint16_t *const row = bins + (size_t)yi * width;
+    for(int xi = xMin; xi < xMax; ++xi) ++hist[row[xi]];
+  }
+
+  const int n = (yMax - yMin) * (xMax - xMin);
+  const int limit = (int)(slope * n / BINS + 0.5f);
+
+  /* clip histogram and redistribute clipped entries */
+  int ce = 0, ceb = 0;
+  do
+  {
+    ceb = ce;
+    ce = 0;
+    for(int b = 0; b <= BINS; b++)
+    {
+      const int d = hist[b] - limit;
+      if(d > 0)
+      {
+        ce += d;
+        hist[b] = limit;
+      }
+    }
+
+    const int d = (ce / (float)(BINS + 1));
+    const int m = ce % (BINS + 1);
+    for(int b = 0; b <= BINS; b++) hist[b] += d;
+
+    if(m != 0)
+    {
+      const int s = BINS / (float)m;
+      for(int b = 0; b <= BINS; b += s) ++hist[b];
+    }
+  } while(ce != ceb);
+
+  /* build cdf of clipped histogram */
+  int hMin = BINS;
+  for(int b = 0; b < hMin; b++)
+    if(hist[b] != 0) hMin = b;
+
+  int cdfMax = 0;
+  for(int b = hMin; b <= BINS; b++) cdfMax += hist[b];
+  const int cdfMin = hist[hMin];
+  const float norm = 1.0f / MAX(cdfMax - cdfMin, 1);
+
+  int cdf = 0;
+  for(int b = 0; b <= BINS; b++)
+  {
+    if(b >= hMin) cdf += hist[b];
+    map[b] = (cdf - cdfMin) * norm;
+  }
+}
+
+// tile index and interpolation weight along one axis for every pixel
+static void _tile_weights(const int n, const dt_iop_rlce_tiles_t *const t, const int tiles, int *const index,
+                          float *const weight)
+{
+  for(int i = 0; i < n; i++)
+  {
+    const int k = MIN(i / t->step, tiles - 1);
+    const int k1 = MIN(k + 1, tiles - 1);
+    const int c = MIN(k * t->step, n - 1);
+    const int c1 = MIN(k1 * t->step, n - 1);
+    index[i] = k;
+    weight[i] = (c1 > c) ? (i - c) / (float)(c1 - c) : 0.0f;
+  }
+}
+
+// the sliding window of version 1, which clips the histogram and builds a cdf for every pixel
+static void _process_sliding(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
+                             void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
   dt_iop_rlce_data_t *data = (dt_iop_rlce_data_t *)piece->data;
   const int ch = piece->colors;
@@ -114,8 +246,6 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   // Params
   const int rad = data->radius * roi_in->scale / piece->iscale;
 
-#define BINS (256)
-
   const float slope = data->slope;
 
   const size_t destbuf_size = roi_out->width;
@@ -246,10 +376,211 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
 
   // Cleanup
   free(luminance);
+}
 
-#undef BINS
+void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
+             void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+  dt_iop_rlce_data_t *data = (dt_iop_rlce_data_t *)piece->data;
+  if(!data->tiled)
+  {
+    _process_sliding(self, piece, ivoid, ovoid, roi_in, roi_out);
+    return;
+  }
+
+  const int ch = piece->colors;
+  const int width = roi_out->width;
+  const int height = roi_out->height;
+
+  // Params
+  const int rad = data->radius * roi_in->scale / piece->iscale;
+  const float slope = data->slope;
+  const dt_iop_rlce_tiles_t t = _tiles(rad, width, height);
+
+  uint16_t *const bins = dt_alloc_align(64, sizeof(uint16_t) * width * height);
+  float *const maps = dt_alloc_align(64, sizeof(float) * (BINS + 1) * t.nx * t.ny);
+  int *const xindex = dt_alloc_align(64, sizeof(int) * width);
+  float *const xweight = dt_alloc_align(64, sizeof(float) * width);
+  float *const dest_buf = dt_alloc_align(64, sizeof(float) * width * dt_get_num_threads());
+  if(!bins || !maps || !xindex || !xweight || !dest_buf)
+  {
+    fprintf(stderr, "[clahe] out of memory, skipping\n");
+    memcpy(ovoid, ivoid, sizeof(float) * ch * width * height);
+    goto cleanup;
+  }
+
+  // PASS1: Get a luminance map of image, quantized to the histogram bins
+  const float *const in = (const float *const)ivoid;
+#ifdef _OPENMP
+#pragma omp parallel for simd default(none) \
+  dt_omp_firstprivate(bins, ch, height, in, width) \
+  schedule(static)
+#endif
+  for(size_t k = 0; k < (size_t)width * height; k++)
+  {
+    const float *const pixel = in + k * ch;
+    // max and min value in RGB set, clipped to [0, 1]
+    float pmax = pixel[0] > pixel[1] ? pixel[0] : pixel[1];
+    pmax = pmax > pixel[2] ? pmax : pixel[2];
+    float pmin = pixel[0] < pixel[1] ? pixel[0] : pixel[1];
+    pmin = pmin < pixel[2] ? pmin : pixel[2];
+    pmax = pmax > 0.0f ? (pmax < 1.0f ? pmax : 1.0f) : 0.0f;
+    pmin = pmin > 0.0f ? (pmin < 1.0f ? pmin : 1.0f) : 0.0f;
+    // pixel luminosity
+    bins[k] = ROUND_POSISTIVE((pmax + pmin) * 0.5f * (float)BINS);
+  }
+
+  // PASS2: the mappings of all tiles
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(bins, height, maps, slope, t, width) \
+  schedule(dynamic)
+#endif
+  for(int k = 0; k < t.nx * t.ny; k++)
+  {
+    const int cx = MIN((k % t.nx) * t.step, width - 1);
+    const int cy = MIN((k / t.nx) * t.step, height - 1);
+    _tile_mapping(bins, width, height, cx, cy, t.rad, slope, maps + (size_t)k * (BINS + 1));
+  }
+
+  // PASS3: interpolate the mappings and apply them to the lightness
+  _tile_weights(width, &t, t.nx, xindex, xweight);
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(bins, ch, dest_buf, height, ivoid, maps, ovoid, t, width, xindex, xweight) \
+  schedule(static)
+#endif
+  for(int j = 0; j < height; j++)
+  {
+    const int ty = MIN(j / t.step, t.ny - 1);
+    const int ty1 = MIN(ty + 1, t.ny - 1);
+    const int cy = MIN(ty * t.step, height - 1);
+    const int cy1 = MIN(ty1 * t.step, height - 1);
+    const float wy = (cy1 > cy) ? (j - cy) / (float)(cy1 - cy) : 0.0f;
+    const float *const row0 = maps + (size_t)ty * t.nx * (BINS + 1);
+    const float *const row1 = maps + (size_t)ty1 * t.nx * (BINS + 1);
+    const uint16_t *const b = bins + (size_t)j * width;
+    const int last = t.nx - 1;
+
+    // Destination row
+    float *const dest = dest_buf + (size_t)width * dt_get_thread_num();
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for(int i = 0; i < width; i++)
+    {
+      const int tx = xindex[i];
+      const int tx1 = tx < last ? tx + 1 : last;
+      const float wx = xweight[i];
+      const int v = b[i];
+      const float top = row0[tx * (BINS + 1) + v] * (1.0f - wx) + row0[tx1 * (BINS + 1) + v] * wx;
+      const float bottom = row1[tx * (BINS + 1) + v] * (1.0f - wx) + row1[tx1 * (BINS + 1) + v] * wx;
+      dest[i] = top * (1.0f - wy) + bottom * wy;
+    }
+
+    // Apply row
+    const float *inp = ((const float *)ivoid) + (size_t)j * width * ch;
+    float *out = ((float *)ovoid) + (size_t)j * width * ch;
+    for(int r = 0; r < width; r++)
+    {
+      float H, S, L;
+      rgb2hsl(inp, &H, &S, &L);
+      hsl2rgb(out, H, S, dest[r]);
+      out[3] = inp[3];
+      out += ch;
+      inp += ch;
+    }
+  }
+
+cleanup:
+  dt_free_align(bins);
+  dt_free_align(maps);
+  dt_free_align(xindex);
+  dt_free_align(xweight);
+  dt_free_align(dest_buf);
 }
 
+#ifdef HAVE_OPENCL
+int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem dev_in, cl_mem dev_out,
+               const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+  dt_iop_rlce_data_t *data = (dt_iop_rlce_data_t *)piece->data;
+  dt_iop_rlce_global_data_t *gd = (dt_iop_rlce_global_data_t *)self->global_data;
+
+  cl_int err = -999;
+  cl_mem dev_lum = NULL;
+  cl_mem dev_maps = NULL;
+
+  const int devid = piece->pipe->devid;
+  const int width = roi_out->width;
+  const int height = roi_out->height;
+
+  const int rad = data->radius * roi_in->scale / piece->iscale;
+  const float slope = data->slope;
+  const dt_iop_rlce_tiles_t t = _tiles(rad, width, height);
+  const int tiles = t.nx * t.ny;
+
+  // one work group per tile builds the histogram of its window in local memory
+  size_t groupsize = 0;
+  if(dt_opencl_get_kernel_work_group_size(devid, gd->kernel_clahe_tile_mapping, &groupsize) != CL_SUCCESS
+     || groupsize == 0)
+    goto error;
+  groupsize = MIN(groupsize, 256);
+
+  dev_lum = dt_opencl_alloc_device(devid, width, height, sizeof(float));
+  if(dev_lum == NULL) goto error;
+  dev_maps = dt_opencl_alloc_device_buffer(devid, sizeof(float) * (BINS + 1) * tiles);
+  if(dev_maps == NULL) goto error;
+
+  size_t sizes[3] = { ROUNDUPWD(width), ROUNDUPHT(height), 1 };
+  dt_opencl_set_kernel_arg(devid, gd->kernel_clahe_luminance, 0, sizeof(cl_mem), (void *)&dev_in);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_clahe_luminance, 1, sizeof(cl_mem), (void *)&dev_lum);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_clahe_luminance, 2, sizeof(int), (void *)&width);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_clahe_luminance, 3, sizeof(int), (void *)&height);
+  err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_clahe_luminance, sizes);
+  if(err != CL_SUCCESS) goto error;
+
+  size_t tsizes[3] = { groupsize * tiles, 1, 1 };
+  size_t tlocal[3] = { groupsize, 1, 1 };
+  dt_opencl_set_kernel_arg(devid, gd->kernel_clahe_tile_mapping, 0, sizeof(cl_mem), (void *)&dev_lum);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_clahe_tile_mapping, 1, sizeof(cl_mem), (void *)&dev_maps);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_clahe_tile_mapping, 2, sizeof(int), (void *)&width);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_clahe_tile_mapping, 3, sizeof(int), (void *)&height);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_clahe_tile_mapping, 4, sizeof(int), (void *)&t.nx);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_clahe_tile_mapping, 5, sizeof(int), (void *)&t.step);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_clahe_tile_mapping, 6, sizeof(int), (void *)&t.rad);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_clahe_tile_mapping, 7, sizeof(float), (void *)&slope);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_clahe_tile_mapping, 8, (BINS + 1) * sizeof(int), NULL);
+  err = dt_opencl_enqueue_kernel_2d_with_local(devid, gd->kernel_clahe_tile_mapping, tsizes, tlocal);
+  if(err != CL_SUCCESS) goto error;
+
+  dt_opencl_set_kernel_arg(devid, gd->kernel_clahe_apply, 0, sizeof(cl_mem), (void *)&dev_in);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_clahe_apply, 1, sizeof(cl_mem), (void *)&dev_lum);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_clahe_apply, 2, sizeof(cl_mem), (void *)&dev_maps);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_clahe_apply, 3, sizeof(cl_mem), (void *)&dev_out);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_clahe_apply, 4, sizeof(int), (void *)&width);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_clahe_apply, 5, sizeof(int), (void *)&height);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_clahe_apply, 6, sizeof(int), (void *)&t.nx);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_clahe_apply, 7, sizeof(int), (void *)&t.ny);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_clahe_apply, 8, sizeof(int), (void *)&t.step);
+  err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_clahe_apply, sizes);
+  if(err != CL_SUCCESS) goto error;
+
+  dt_opencl_release_mem_object(dev_lum);
+  dt_opencl_release_mem_object(dev_maps);
+  return TRUE;
+
+error:
+  dt_opencl_release_mem_object(dev_lum);
+  dt_opencl_release_mem_object(dev_maps);
+  dt_print(DT_DEBUG_OPENCL, "[opencl_clahe] couldn't enqueue kernel! %d\n", err);
+  return FALSE;
+}
+#endif
+
+#undef MIN_STEP
+#undef BINS
+
 static void radius_callback(GtkWidget *slider, gpointer user_data)
 {
   dt_iop_module_t *self = (dt_iop_module_t *)user_data;
@@ -278,6 +609,30 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
 
   d->radius = p->radius;
   d->slope = p->slope;
+  d->tiled = p->tiled;
+
+  // the kernels only do tiles
+  if(!d->tiled) piece->process_cl_ready = 0;
+}
+
+void init_global(dt_iop_module_so_t *module)
+{
+  const int program = 32; // clahe.cl, from programs.conf
+  dt_iop_rlce_global_data_t *gd = (dt_iop_rlce_global_data_t *)malloc(sizeof(dt_iop_rlce_global_data_t));
+  module->data = gd;
+  gd->kernel_clahe_luminance = dt_opencl_create_kernel(program, "clahe_luminance");
+  gd->kernel_clahe_tile_mapping = dt_opencl_create_kernel(program, "clahe_tile_mapping");
+  gd->kernel_clahe_apply = dt_opencl_create_kernel(program, "clahe_apply");
+}
+
+void cleanup_global(dt_iop_module_so_t *module)
+{
+  dt_iop_rlce_global_data_t *gd = (dt_iop_rlce_global_data_t *)module->data;
+  dt_opencl_free_kernel(gd->kernel_clahe_luminance);
+  dt_opencl_free_kernel(gd->kernel_clahe_tile_mapping);
+  dt_opencl_free_kernel(gd->kernel_clahe_apply);
+  free(module->data);
+  module->data = NULL;
 }
 
 void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
@@ -308,7 +663,7 @@ void init(dt_iop_module_t *module)
   module->default_enabled = 0;
   module->params_size = sizeof(dt_iop_rlce_params_t);
   module->gui_data = NULL;
-  dt_iop_rlce_params_t tmp = (dt_iop_rlce_params_t){ 64, 1.25 };
+  dt_iop_rlce_params_t tmp = (dt_iop_rlce_params_t){ 64, 1.25, TRUE };
   memcpy(module->params, &tmp, sizeof(dt_iop_rlce_params_t));
   memcpy(module->default_params, &tmp, sizeof(dt_iop_rlce_params_t));
 }
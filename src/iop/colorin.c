@@ -99,6 +99,18 @@ typedef struct dt_iop_colorin_global_data_t
   int kernel_colorin_clipping;
 } dt_iop_colorin_global_data_t;
 
+// in colorin_avx2.c / colorin_avx512.c, see colorin_cmatrix.h
+#ifdef HAVE_AVX2_CODEPATH
+void colorin_cmatrix_avx2(const float *const in, float *const out, const size_t npixels,
+                          const float *const cmatrix, const float *const lmatrix, const float *const lut[3],
+                          const float *const unbounded_coeffs, const int lutsize);
+#endif
+#ifdef HAVE_AVX512_CODEPATH
+void colorin_cmatrix_avx512(const float *const in, float *const out, const size_t npixels,
+                            const float *const cmatrix, const float *const lmatrix, const float *const lut[3],
+                            const float *const unbounded_coeffs, const int lutsize);
+#endif
+
 typedef struct dt_iop_colorin_data_t
 {
   int clear_input;
@@ -1448,6 +1460,66 @@ void process_sse2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, c
 }
 #endif
 
+#if defined(HAVE_AVX2_CODEPATH) || defined(HAVE_AVX512_CODEPATH)
+// the wide kernels cover the matrix paths with shaper curves and gamut clipping, blue mapping and the lcms2
+// fallback stay on the narrower code
+static gboolean _use_wide_cmatrix(const dt_iop_colorin_data_t *const d, dt_dev_pixelpipe_iop_t *piece)
+{
+  const int blue_mapping = d->blue_mapping && dt_image_is_matrix_correction_supported(&piece->pipe->image);
+  return d->type != DT_COLORSPACE_LAB && !isnan(d->cmatrix[0]) && !blue_mapping && piece->colors == 4;
+}
+
+typedef void(colorin_cmatrix_t)(const float *const in, float *const out, const size_t npixels,
+                                const float *const cmatrix, const float *const lmatrix, const float *const lut[3],
+                                const float *const unbounded_coeffs, const int lutsize);
+
+static void _process_wide(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
+                          void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out,
+                          colorin_cmatrix_t *kernel)
+{
+  const dt_iop_colorin_data_t *const d = (dt_iop_colorin_data_t *)piece->data;
+
+  if(!_use_wide_cmatrix(d, piece))
+  {
+#if defined(__SSE2__)
+    process_sse2(self, piece, ivoid, ovoid, roi_in, roi_out);
+#else
+    process(self, piece, ivoid, ovoid, roi_in, roi_out);
+#endif
+    return;
+  }
+
+  // luts marked as linear (negative as marker) are skipped
+  const float *const lut[3] = { d->lut[0][0] >= 0.0f ? d->lut[0] : NULL, d->lut[1][0] >= 0.0f ? d->lut[1] : NULL,
+                                d->lut[2][0] >= 0.0f ? d->lut[2] : NULL };
+  const int clipping = (d->nrgb != NULL);
+
+  kernel((const float *)ivoid, (float *)ovoid, (size_t)roi_out->width * roi_out->height,
+         clipping ? d->nmatrix : d->cmatrix, clipping ? d->lmatrix : NULL, lut, &d->unbounded_coeffs[0][0],
+         LUT_SAMPLES);
+
+  dt_ioppr_set_pipe_work_profile_info(self->dev, piece->pipe, d->type_work, d->filename_work, DT_INTENT_PERCEPTUAL);
+
+  if(piece->pipe->mask_display & DT_DEV_PIXELPIPE_DISPLAY_MASK) dt_iop_alpha_copy(ivoid, ovoid, roi_out->width, roi_out->height);
+}
+#endif
+
+#ifdef HAVE_AVX2_CODEPATH
+void process_avx2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
+                  void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+  _process_wide(self, piece, ivoid, ovoid, roi_in, roi_out, colorin_cmatrix_avx2);
+}
+#endif
+
+#ifdef HAVE_AVX512_CODEPATH
+void process_avx512(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
+                    void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+  _process_wide(self, piece, ivoid, ovoid, roi_in, roi_out, colorin_cmatrix_avx512);
+}
+#endif
+
 static void mat3mul(float *dst, const float *const m1, const float *const m2)
 {
   for(int k = 0; k < 3; k++)
@@ -1501,17 +1573,17 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
 
   if(d->xform_cam_Lab)
   {
-    cmsDeleteTransform(d->xform_cam_Lab);
+    dt_colorspaces_release_transform(d->xform_cam_Lab);
     d->xform_cam_Lab = NULL;
   }
   if(d->xform_cam_nrgb)
   {
-    cmsDeleteTransform(d->xform_cam_nrgb);
+    dt_colorspaces_release_transform(d->xform_cam_nrgb);
     d->xform_cam_nrgb = NULL;
   }
   if(d->xform_nrgb_Lab)
   {
-    cmsDeleteTransform(d->xform_nrgb_Lab);
+    dt_colorspaces_release_transform(d->xform_nrgb_Lab);
     d->xform_nrgb_Lab = NULL;
   }
 
@@ -1660,9 +1732,9 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
     {
       piece->process_cl_ready = 0;
       d->cmatrix[0] = NAN;
-      d->xform_cam_Lab = cmsCreateTransform(d->input, input_format, Lab, TYPE_LabA_FLT, p->intent, 0);
-      d->xform_cam_nrgb = cmsCreateTransform(d->input, input_format, d->nrgb, TYPE_RGBA_FLT, p->intent, 0);
-      d->xform_nrgb_Lab = cmsCreateTransform(d->nrgb, TYPE_RGBA_FLT, Lab, TYPE_LabA_FLT, p->intent, 0);
+      d->xform_cam_Lab = dt_colorspaces_get_transform(d->input, input_format, Lab, TYPE_LabA_FLT, p->intent);
+      d->xform_cam_nrgb = dt_colorspaces_get_transform(d->input, input_format, d->nrgb, TYPE_RGBA_FLT, p->intent);
+      d->xform_nrgb_Lab = dt_colorspaces_get_transform(d->nrgb, TYPE_RGBA_FLT, Lab, TYPE_LabA_FLT, p->intent);
     }
     else
     {
@@ -1681,7 +1753,7 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
     {
       piece->process_cl_ready = 0;
       d->cmatrix[0] = NAN;
-      d->xform_cam_Lab = cmsCreateTransform(d->input, input_format, Lab, TYPE_LabA_FLT, p->intent, 0);
+      d->xform_cam_Lab = dt_colorspaces_get_transform(d->input, input_format, Lab, TYPE_LabA_FLT, p->intent);
     }
   }
 
@@ -1690,12 +1762,12 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
   {
     if(d->xform_cam_nrgb)
     {
-      cmsDeleteTransform(d->xform_cam_nrgb);
+      dt_colorspaces_release_transform(d->xform_cam_nrgb);
       d->xform_cam_nrgb = NULL;
     }
     if(d->xform_nrgb_Lab)
     {
-      cmsDeleteTransform(d->xform_nrgb_Lab);
+      dt_colorspaces_release_transform(d->xform_nrgb_Lab);
       d->xform_nrgb_Lab = NULL;
     }
     d->nrgb = NULL;
@@ -1718,7 +1790,7 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
     {
       piece->process_cl_ready = 0;
       d->cmatrix[0] = NAN;
-      d->xform_cam_Lab = cmsCreateTransform(d->input, TYPE_RGBA_FLT, Lab, TYPE_LabA_FLT, p->intent, 0);
+      d->xform_cam_Lab = dt_colorspaces_get_transform(d->input, TYPE_RGBA_FLT, Lab, TYPE_LabA_FLT, p->intent);
     }
   }
 
@@ -1763,17 +1835,17 @@ void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev
   if(d->input && d->clear_input) dt_colorspaces_cleanup_profile(d->input);
   if(d->xform_cam_Lab)
   {
-    cmsDeleteTransform(d->xform_cam_Lab);
+    dt_colorspaces_release_transform(d->xform_cam_Lab);
     d->xform_cam_Lab = NULL;
   }
   if(d->xform_cam_nrgb)
   {
-    cmsDeleteTransform(d->xform_cam_nrgb);
+    dt_colorspaces_release_transform(d->xform_cam_nrgb);
     d->xform_cam_nrgb = NULL;
   }
   if(d->xform_nrgb_Lab)
   {
-    cmsDeleteTransform(d->xform_nrgb_Lab);
+    dt_colorspaces_release_transform(d->xform_nrgb_Lab);
     d->xform_nrgb_Lab = NULL;
   }
 
@@ -0,0 +1,153 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// camera rgb -> shaper curves -> XYZ matrix -> Lab, the matrix paths of colorin with or without gamut clipping.
+// included by colorin_avx2.c and colorin_avx512.c, which are built with the flags of their instruction
+// set, so the compiler can run the curves, the matrices and lab_f() over a full vector of pixels.
+// define COLORIN_CMATRIX_KERNEL to the name of the function before including.
+
+#include "common/darktable.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// pixels per block, the curves of a block go through a small buffer on the stack
+#define COLORIN_CMATRIX_BLOCK 256
+
+// lab_f() without branches or stores, so the whole loop below turns into vector code
+static inline float _colorin_lab_f(const float x)
+{
+  union { float f; uint32_t i; } u = { .f = x };
+  u.i = u.i / 3 + 709921077;
+  const float a = u.f;
+  const float a3 = a * a * a;
+  const float cube = a * (a3 + x + x) / (a3 + a3 + x);
+  const float linear = (24389.0f / 27.0f * x + 16.0f) / 116.0f;
+  return (x > 216.0f / 24389.0f) ? cube : linear;
+}
+
+// XYZ -> Lab with the D50 white point, as in dt_XYZ_to_Lab()
+static inline void _colorin_XYZ_to_Lab(const float X, const float Y, const float Z, float *const out)
+{
+  const float fx = _colorin_lab_f(X / 0.9642f);
+  const float fy = _colorin_lab_f(Y);
+  const float fz = _colorin_lab_f(Z / 0.8249f);
+
+  out[0] = 116.0f * fy - 16.0f;
+  out[1] = 500.0f * (fx - fy);
+  out[2] = 200.0f * (fy - fz);
+}
+
+// converts npixels of 4 channels. lut[c] holds the lutsize samples of the shaper curve of channel c, NULL if it
+// is linear. values from 1 on are extrapolated with unbounded_coeffs[3 * c], as lerp_lut() and dt_iop_eval_exp()
+// do in colorin.c. without lmatrix, cmatrix goes to XYZ. with lmatrix, cmatrix goes to the rgb of the gamut
+// clipping, the result is clamped to [0, 1] and lmatrix takes it to XYZ.
+void COLORIN_CMATRIX_KERNEL(const float *const in, float *const out, const size_t npixels,
+                            const float *const cmatrix, const float *const lmatrix, const float *const lut[3],
+                            const float *const unbounded_coeffs, const int lutsize)
+{
+  const size_t nblocks = (npixels + COLORIN_CMATRIX_BLOCK - 1) / COLORIN_CMATRIX_BLOCK;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(in, out, npixels, nblocks, cmatrix, lmatrix, lut, unbounded_coeffs, lutsize) \
+  schedule(static)
+#endif
+  for(size_t b = 0; b < nblocks; b++)
+  {
+    const size_t k0 = b * COLORIN_CMATRIX_BLOCK;
+    const int n = MIN(COLORIN_CMATRIX_BLOCK, npixels - k0);
+    const float *const i0 = in + 4 * k0;
+    float *const o0 = out + 4 * k0;
+    float cam[3][COLORIN_CMATRIX_BLOCK] __attribute__((aligned(64)));
+
+    for(int c = 0; c < 3; c++)
+    {
+      const float *const l = lut[c];
+      if(l)
+      {
+#ifdef _OPENMP
+#pragma omp simd aligned(cam:64)
+#endif
+        for(int k = 0; k < n; k++)
+        {
+          const float v = i0[4 * k + c];
+          const float ft = CLAMPS(v * (lutsize - 1), 0, lutsize - 1);
+          const int t = ft < lutsize - 2 ? ft : lutsize - 2;
+          const float f = ft - t;
+          cam[c][k] = l[t] * (1.0f - f) + l[t + 1] * f;
+        }
+        // the extrapolation is rare, leave it out of the vector loop
+        const float *const coeffs = unbounded_coeffs + 3 * c;
+        for(int k = 0; k < n; k++)
+        {
+          const float v = i0[4 * k + c];
+          if(v >= 1.0f) cam[c][k] = coeffs[1] * powf(v * coeffs[0], coeffs[2]);
+        }
+      }
+      else
+      {
+#ifdef _OPENMP
+#pragma omp simd aligned(cam:64)
+#endif
+        for(int k = 0; k < n; k++) cam[c][k] = i0[4 * k + c];
+      }
+    }
+
+    const float m0 = cmatrix[0], m1 = cmatrix[1], m2 = cmatrix[2];
+    const float m3 = cmatrix[3], m4 = cmatrix[4], m5 = cmatrix[5];
+    const float m6 = cmatrix[6], m7 = cmatrix[7], m8 = cmatrix[8];
+
+    if(!lmatrix)
+    {
+#ifdef _OPENMP
+#pragma omp simd aligned(cam:64)
+#endif
+      for(int k = 0; k < n; k++)
+      {
+        const float r = cam[0][k], g = cam[1][k], bl = cam[2][k];
+        _colorin_XYZ_to_Lab(m0 * r + m1 * g + m2 * bl, m3 * r + m4 * g + m5 * bl, m6 * r + m7 * g + m8 * bl,
+                            o0 + 4 * k);
+      }
+    }
+    else
+    {
+      const float l0 = lmatrix[0], l1 = lmatrix[1], l2 = lmatrix[2];
+      const float l3 = lmatrix[3], l4 = lmatrix[4], l5 = lmatrix[5];
+      const float l6 = lmatrix[6], l7 = lmatrix[7], l8 = lmatrix[8];
+#ifdef _OPENMP
+#pragma omp simd aligned(cam:64)
+#endif
+      for(int k = 0; k < n; k++)
+      {
+        const float r = cam[0][k], g = cam[1][k], bl = cam[2][k];
+        const float cr = CLAMP(m0 * r + m1 * g + m2 * bl, 0.0f, 1.0f);
+        const float cg = CLAMP(m3 * r + m4 * g + m5 * bl, 0.0f, 1.0f);
+        const float cb = CLAMP(m6 * r + m7 * g + m8 * bl, 0.0f, 1.0f);
+        _colorin_XYZ_to_Lab(l0 * cr + l1 * cg + l2 * cb, l3 * cr + l4 * cg + l5 * cb, l6 * cr + l7 * cg + l8 * cb,
+                            o0 + 4 * k);
+      }
+    }
+  }
+}
+
+#undef COLORIN_CMATRIX_BLOCK
+#undef COLORIN_CMATRIX_KERNEL
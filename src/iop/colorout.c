@@ -87,7 +87,7 @@ int default_group()
 
 int flags()
 {
-  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_ONE_INSTANCE;
+  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_ONE_INSTANCE | IOP_FLAGS_HALF_INPUT | IOP_FLAGS_VOLATILE_COMMIT;
 }
 
 int default_colorspace(dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
@@ -343,55 +343,20 @@ error:
 }
 #endif
 
-static void process_fastpath_apply_tonecurves(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
-                                              const void *const ivoid, void *const ovoid,
-                                              const dt_iop_roi_t *const roi_in,
-                                              const dt_iop_roi_t *const roi_out)
+// applies the tone curves of the matrix profile to a row of width pixels right after the matrix, while the row
+// is still in the cache
+static inline void _apply_tonecurves_row(const dt_iop_colorout_data_t *const d, float *const out, const int width,
+                                         const int ch)
 {
-  const dt_iop_colorout_data_t *const d = (dt_iop_colorout_data_t *)piece->data;
-  const int ch = piece->colors;
-
-  if(!isnan(d->cmatrix[0]))
+  for(int c = 0; c < 3; c++)
   {
-    // out is already converted to RGB from Lab.
+    // omit luts marked as linear (negative as marker)
+    if(d->lut[c][0] < 0.0f) continue;
 
-    // do we have any lut to apply, or is this a linear profile?
-    if((d->lut[0][0] >= 0.0f) && (d->lut[1][0] >= 0.0f) && (d->lut[2][0] >= 0.0f))
-    { // apply profile
-      float *const out = (float *const)ovoid;
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-      dt_omp_firstprivate(ch, d, out, roi_out) \
-      schedule(static)
-#endif
-      for(size_t k = 0; k < (size_t)ch * roi_out->width * roi_out->height; k += ch)
-      {
-        for(int c = 0; c < 3; c++)
-        {
-          out[k + c] = (out[k + c] < 1.0f) ? lerp_lut(d->lut[c], out[k + c])
-                                           : dt_iop_eval_exp(d->unbounded_coeffs[c], out[k + c]);
-        }
-      }
-    }
-    else if((d->lut[0][0] >= 0.0f) || (d->lut[1][0] >= 0.0f) || (d->lut[2][0] >= 0.0f))
-    { // apply profile
-      float *const out = (float *const)ovoid;
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-      dt_omp_firstprivate(ch, d, out, roi_out) \
-      schedule(static)
-#endif
-      for(size_t k = 0; k < (size_t)ch * roi_out->width * roi_out->height; k += ch)
-      {
-        for(int c = 0; c < 3; c++)
-        {
-          if(d->lut[c][0] >= 0.0f)
-          {
-            out[k + c] = (out[k + c] < 1.0f) ? lerp_lut(d->lut[c], out[k + c])
-                                             : dt_iop_eval_exp(d->unbounded_coeffs[c], out[k + c]);
-          }
-        }
-      }
+    for(int i = 0; i < width; i++)
+    {
+      const float v = out[(size_t)ch * i + c];
+      out[(size_t)ch * i + c] = (v < 1.0f) ? lerp_lut(d->lut[c], v) : dt_iop_eval_exp(d->unbounded_coeffs[c], v);
     }
   }
 }
@@ -416,25 +381,29 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
     dt_omp_firstprivate(d, ch, ivoid, ovoid, roi_out) \
     schedule(static)
 #endif
-    for(size_t k = 0; k < (size_t)ch * roi_out->width * roi_out->height; k += ch)
+    for(int j = 0; j < roi_out->height; j++)
     {
-      const float *const in = (const float *const)ivoid + (size_t)k;
-      float *out = (float *)ovoid + (size_t)k;
-
-      float xyz[3];
-      dt_Lab_to_XYZ(in, xyz);
+      const float *in = (const float *)ivoid + (size_t)ch * roi_out->width * j;
+      float *const row = (float *)ovoid + (size_t)ch * roi_out->width * j;
+      float *out = row;
 
-      for(int c = 0; c < 3; c++)
+      for(int i = 0; i < roi_out->width; i++, in += ch, out += ch)
       {
-        out[c] = 0.0f;
-        for(int i = 0; i < 3; i++)
+        float xyz[3];
+        dt_Lab_to_XYZ(in, xyz);
+
+        for(int c = 0; c < 3; c++)
         {
-          out[c] += d->cmatrix[3 * c + i] * xyz[i];
+          out[c] = 0.0f;
+          for(int k = 0; k < 3; k++)
+          {
+            out[c] += d->cmatrix[3 * c + k] * xyz[k];
+          }
         }
       }
-    }
 
-    process_fastpath_apply_tonecurves(self, piece, ivoid, ovoid, roi_in, roi_out);
+      _apply_tonecurves_row(d, row, roi_out->width, ch);
+    }
   }
   else
   {
@@ -497,7 +466,8 @@ void process_sse2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, c
     {
 
       float *in = (float *)ivoid + (size_t)ch * roi_in->width * j;
-      float *out = (float *)ovoid + (size_t)ch * roi_out->width * j;
+      float *const row = (float *)ovoid + (size_t)ch * roi_out->width * j;
+      float *out = row;
       const __m128 m0 = _mm_set_ps(0.0f, d->cmatrix[6], d->cmatrix[3], d->cmatrix[0]);
       const __m128 m1 = _mm_set_ps(0.0f, d->cmatrix[7], d->cmatrix[4], d->cmatrix[1]);
       const __m128 m2 = _mm_set_ps(0.0f, d->cmatrix[8], d->cmatrix[5], d->cmatrix[2]);
@@ -510,12 +480,12 @@ void process_sse2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, c
                          _mm_add_ps(_mm_mul_ps(m1, _mm_shuffle_ps(xyz, xyz, _MM_SHUFFLE(1, 1, 1, 1))),
                                     _mm_mul_ps(m2, _mm_shuffle_ps(xyz, xyz, _MM_SHUFFLE(2, 2, 2, 2)))));
 
-        _mm_stream_ps(out, t);
+        // the row is read back by the tone curves, keep it in the cache
+        _mm_store_ps(out, t);
       }
-    }
-    _mm_sfence();
 
-    process_fastpath_apply_tonecurves(self, piece, ivoid, ovoid, roi_in, roi_out);
+      _apply_tonecurves_row(d, row, roi_out->width, ch);
+    }
   }
   else
   {
@@ -602,7 +572,7 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
 
   if(d->xform)
   {
-    cmsDeleteTransform(d->xform);
+    dt_colorspaces_release_transform(d->xform);
     d->xform = NULL;
   }
   d->cmatrix[0] = NAN;
@@ -730,8 +700,14 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
   {
     d->cmatrix[0] = NAN;
     piece->process_cl_ready = 0;
-    d->xform = cmsCreateProofingTransform(Lab, TYPE_LabA_FLT, output, output_format, softproof,
-                                          out_intent, INTENT_RELATIVE_COLORIMETRIC, transformFlags);
+    if(softproof)
+      if(softproof)
+        d->xform = cmsCreateProofingTransform(Lab, TYPE_LabA_FLT, output, output_format, softproof,
+                                              out_intent, INTENT_RELATIVE_COLORIMETRIC, transformFlags);
+      else
+        d->xform = dt_colorspaces_get_transform(Lab, TYPE_LabA_FLT, output, output_format, out_intent);
+    else
+      d->xform = dt_colorspaces_get_transform(Lab, TYPE_LabA_FLT, output, output_format, out_intent);
   }
 
   // user selected a non-supported output profile, check that:
@@ -747,8 +723,11 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
       d->cmatrix[0] = NAN;
       piece->process_cl_ready = 0;
 
-      d->xform = cmsCreateProofingTransform(Lab, TYPE_LabA_FLT, output, output_format, softproof,
-                                            out_intent, INTENT_RELATIVE_COLORIMETRIC, transformFlags);
+      if(softproof)
+        d->xform = cmsCreateProofingTransform(Lab, TYPE_LabA_FLT, output, output_format, softproof,
+                                              out_intent, INTENT_RELATIVE_COLORIMETRIC, transformFlags);
+      else
+        d->xform = dt_colorspaces_get_transform(Lab, TYPE_LabA_FLT, output, output_format, out_intent);
     }
   }
 
@@ -791,7 +770,7 @@ void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev
   dt_iop_colorout_data_t *d = (dt_iop_colorout_data_t *)piece->data;
   if(d->xform)
   {
-    cmsDeleteTransform(d->xform);
+    dt_colorspaces_release_transform(d->xform);
     d->xform = NULL;
   }
 
@@ -567,6 +567,85 @@ static inline const short * hexmap(const int row, const int col, short (*const a
   return allhex[irow % 3][icol % 3];
 }
 
+// the derivatives of the yuv tile in the direction f, from the second differences of its three channels
+static inline void _xtrans_derivatives(const float *const yuv, float *const drv, const int f, const int pad,
+                                       const int mrow, const int mcol)
+{
+  for(int row = pad; row < mrow - pad; row++)
+  {
+    const float *const y = yuv + (size_t)row * TS;
+    const float *const u = y + TS * TS;
+    const float *const v = u + TS * TS;
+    float *const dr = drv + (size_t)row * TS;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for(int col = pad; col < mcol - pad; col++)
+      dr[col] = SQR(2 * y[col] - y[col + f] - y[col - f]) + SQR(2 * u[col] - u[col + f] - u[col - f])
+                + SQR(2 * v[col] - v[col + f] - v[col - f]);
+  }
+}
+
+// the homogeneity maps from the derivatives: for every direction, how many of the 3x3 neighbours of a pixel
+// are within 8 times its smallest derivative. runs along the rows, so that the columns vectorise.
+static inline void _xtrans_homogeneity(const float *const drv, uint8_t *const homo, const int ndir,
+                                       const int pad, const int mrow, const int mcol)
+{
+  memset(homo, 0, (size_t)ndir * TS * TS * sizeof(uint8_t));
+  for(int row = pad; row < mrow - pad; row++)
+  {
+    float tr[TS];
+    for(int col = pad; col < mcol - pad; col++) tr[col] = FLT_MAX;
+    for(int d = 0; d < ndir; d++)
+    {
+      const float *const dr = drv + ((size_t)d * TS + row) * TS;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+      for(int col = pad; col < mcol - pad; col++) tr[col] = (tr[col] > dr[col]) ? dr[col] : tr[col];
+    }
+    for(int col = pad; col < mcol - pad; col++) tr[col] *= 8;
+
+    for(int d = 0; d < ndir; d++)
+    {
+      uint8_t *const hr = homo + ((size_t)d * TS + row) * TS;
+      for(int v = -1; v <= 1; v++)
+        for(int h = -1; h <= 1; h++)
+        {
+          const float *const dr = drv + ((size_t)d * TS + row + v) * TS + h;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+          for(int col = pad; col < mcol - pad; col++) hr[col] += (dr[col] <= tr[col]) ? 1 : 0;
+        }
+    }
+  }
+}
+
+// the 5x5 sums of the homogeneity maps for each pixel and direction. the maps are 0 outside of where they
+// were built, and a sum is at most 25 * 9, so it fits the bytes.
+static inline void _xtrans_homogeneity_sum(const uint8_t *const homo, uint8_t *const homosum, const int ndir,
+                                           const int pad, const int mrow, const int mcol)
+{
+  for(int d = 0; d < ndir; d++)
+    for(int row = pad; row < mrow - pad; row++)
+    {
+      uint8_t colsum[TS];
+      const uint8_t *const hr = homo + ((size_t)d * TS + row) * TS;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+      for(int col = pad - 2; col < mcol - pad + 2; col++)
+        colsum[col] = hr[col - 2 * TS] + hr[col - TS] + hr[col] + hr[col + TS] + hr[col + 2 * TS];
+      uint8_t *const sr = homosum + ((size_t)d * TS + row) * TS;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+      for(int col = pad; col < mcol - pad; col++)
+        sr[col] = colsum[col - 2] + colsum[col - 1] + colsum[col] + colsum[col + 1] + colsum[col + 2];
+    }
+}
+
 /*
    Frank Markesteijn's algorithm for Fuji X-Trans sensors
  */
@@ -952,56 +1031,17 @@ static void xtrans_markesteijn_interpolate(float *out, const float *const in,
             yuv[1][row][col] = (rx[2] - y) * 0.56433f;
             yuv[2][row][col] = (rx[0] - y) * 0.67815f;
           }
-        // Note that f can offset by a column (-1 or +1) and by a row
-        // (-TS or TS). The row-wise offsets cause the undefined
-        // behavior sanitizer to warn of an out of bounds index, but
-        // as yfx is multi-dimensional and there is sufficient
-        // padding, that is not actually so.
-        const int f = dir[d & 3];
+        // f offsets by a column (-1 or +1) or by a row (-TS or TS)
         const int pad_drv = (passes == 1) ? 9 : 14;
-        for(int row = pad_drv; row < mrow - pad_drv; row++)
-          for(int col = pad_drv; col < mcol - pad_drv; col++)
-          {
-            float(*yfx)[TS][TS] = (float(*)[TS][TS]) & yuv[0][row][col];
-            drv[d][row][col] = SQR(2 * yfx[0][0][0] - yfx[0][0][f] - yfx[0][0][-f])
-                               + SQR(2 * yfx[1][0][0] - yfx[1][0][f] - yfx[1][0][-f])
-                               + SQR(2 * yfx[2][0][0] - yfx[2][0][f] - yfx[2][0][-f]);
-          }
+        _xtrans_derivatives(&yuv[0][0][0], &drv[d][0][0], dir[d & 3], pad_drv, mrow, mcol);
       }
 
       /* Build homogeneity maps from the derivatives:                   */
-      memset(homo, 0, (size_t)ndir * TS * TS * sizeof(uint8_t));
       const int pad_homo = (passes == 1) ? 10 : 15;
-      for(int row = pad_homo; row < mrow - pad_homo; row++)
-        for(int col = pad_homo; col < mcol - pad_homo; col++)
-        {
-          float tr = FLT_MAX;
-          for(int d = 0; d < ndir; d++)
-            if(tr > drv[d][row][col]) tr = drv[d][row][col];
-          tr *= 8;
-          for(int d = 0; d < ndir; d++)
-            for(int v = -1; v <= 1; v++)
-              for(int h = -1; h <= 1; h++) homo[d][row][col] += ((drv[d][row + v][col + h] <= tr) ? 1 : 0);
-        }
+      _xtrans_homogeneity(&drv[0][0][0], &homo[0][0][0], ndir, pad_homo, mrow, mcol);
 
       /* Build 5x5 sum of homogeneity maps for each pixel & direction */
-      for(int d = 0; d < ndir; d++)
-        for(int row = pad_tile; row < mrow - pad_tile; row++)
-        {
-          // start before first column where homo[d][row][col+2] != 0,
-          // so can know v5sum and homosum[d][row][col] will be 0
-          int col = pad_tile-5;
-          uint8_t v5sum[5] = { 0 };
-          homosum[d][row][col] = 0;
-          // calculate by rolling through column sums
-          for(col++; col < mcol - pad_tile; col++)
-          {
-            uint8_t colsum = 0;
-            for(int v = -2; v <= 2; v++) colsum += homo[d][row + v][col + 2];
-            homosum[d][row][col] = homosum[d][row][col - 1] - v5sum[col % 5] + colsum;
-            v5sum[col % 5] = colsum;
-          }
-        }
+      _xtrans_homogeneity_sum(&homo[0][0][0], &homosum[0][0][0], ndir, pad_tile, mrow, mcol);
 
       /* Average the most homogeneous pixels for the final result:       */
       for(int row = pad_tile; row < mrow - pad_tile; row++)
@@ -1039,6 +1079,42 @@ static void xtrans_markesteijn_interpolate(float *out, const float *const in,
 #undef TS
 
 #define TS 122
+static inline float complex _xtrans_complex(const float re, const float im)
+{
+  float complex z;
+  ((float *)&z)[0] = re;
+  ((float *)&z)[1] = im;
+  return z;
+}
+
+// convolves the columns [c0, c1) of a row of the tile with the four 13x13 filters of harr. the taps go one
+// after the other for the whole row, so that the columns vectorise and every sum is taken in the same order
+// as for a single pixel.
+static inline void _xtrans_fdc_filter_row(const float *const i_src, const float complex harr[4][13][13],
+                                          const int row, const int c0, const int c1, float re[4][TS],
+                                          float im[4][TS])
+{
+  for(int k = 0; k < 4; k++)
+  {
+    for(int col = c0; col < c1; col++) re[k][col] = im[k][col] = 0.0f;
+    for(int fdc_row = 0; fdc_row < 13; fdc_row++)
+      for(int fdc_col = 0; fdc_col < 13; fdc_col++)
+      {
+        const float complex h = harr[k][12 - fdc_row][12 - fdc_col];
+        const float hre = crealf(h), him = cimagf(h);
+        const float *const src = i_src + (size_t)TS * (row - 6 + fdc_row) + fdc_col - 6;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+        for(int col = c0; col < c1; col++)
+        {
+          re[k][col] += hre * src[col];
+          im[k][col] += him * src[col];
+        }
+      }
+  }
+}
+
 static void xtrans_fdc_interpolate(struct dt_iop_module_t *self, float *out, const float *const in,
                                    const dt_iop_roi_t *const roi_out, const dt_iop_roi_t *const roi_in,
                                    const uint8_t (*const xtrans)[6])
@@ -1947,60 +2023,24 @@ static void xtrans_fdc_interpolate(struct dt_iop_module_t *self, float *out, con
             yuv[1][row][col] = (rx[2] - y) * 0.56433f;
             yuv[2][row][col] = (rx[0] - y) * 0.67815f;
           }
-        // Note that f can offset by a column (-1 or +1) and by a row
-        // (-TS or TS). The row-wise offsets cause the undefined
-        // behavior sanitizer to warn of an out of bounds index, but
-        // as yfx is multi-dimensional and there is sufficient
-        // padding, that is not actually so.
-        const int f = dir[d & 3];
+        // f offsets by a column (-1 or +1) or by a row (-TS or TS)
         const int pad_drv = 9;
-        for(int row = pad_drv; row < mrow - pad_drv; row++)
-          for(int col = pad_drv; col < mcol - pad_drv; col++)
-          {
-            float(*yfx)[TS][TS] = (float(*)[TS][TS]) & yuv[0][row][col];
-            drv[d][row][col] = SQR(2 * yfx[0][0][0] - yfx[0][0][f] - yfx[0][0][-f])
-                               + SQR(2 * yfx[1][0][0] - yfx[1][0][f] - yfx[1][0][-f])
-                               + SQR(2 * yfx[2][0][0] - yfx[2][0][f] - yfx[2][0][-f]);
-          }
+        _xtrans_derivatives(&yuv[0][0][0], &drv[d][0][0], dir[d & 3], pad_drv, mrow, mcol);
       }
 
       /* Build homogeneity maps from the derivatives:                   */
-      memset(homo, 0, (size_t)ndir * TS * TS * sizeof(uint8_t));
       const int pad_homo = 10;
-      for(int row = pad_homo; row < mrow - pad_homo; row++)
-        for(int col = pad_homo; col < mcol - pad_homo; col++)
-        {
-          float tr = FLT_MAX;
-          for(int d = 0; d < ndir; d++)
-            if(tr > drv[d][row][col]) tr = drv[d][row][col];
-          tr *= 8;
-          for(int d = 0; d < ndir; d++)
-            for(int v = -1; v <= 1; v++)
-              for(int h = -1; h <= 1; h++) homo[d][row][col] += ((drv[d][row + v][col + h] <= tr) ? 1 : 0);
-        }
+      _xtrans_homogeneity(&drv[0][0][0], &homo[0][0][0], ndir, pad_homo, mrow, mcol);
 
       /* Build 5x5 sum of homogeneity maps for each pixel & direction */
-      for(int d = 0; d < ndir; d++)
-        for(int row = pad_tile; row < mrow - pad_tile; row++)
-        {
-          // start before first column where homo[d][row][col+2] != 0,
-          // so can know v5sum and homosum[d][row][col] will be 0
-          int col = pad_tile - 5;
-          uint8_t v5sum[5] = { 0 };
-          homosum[d][row][col] = 0;
-          // calculate by rolling through column sums
-          for(col++; col < mcol - pad_tile; col++)
-          {
-            uint8_t colsum = 0;
-            for(int v = -2; v <= 2; v++) colsum += homo[d][row + v][col + 2];
-            homosum[d][row][col] = homosum[d][row][col - 1] - v5sum[col % 5] + colsum;
-            v5sum[col % 5] = colsum;
-          }
-        }
+      _xtrans_homogeneity_sum(&homo[0][0][0], &homosum[0][0][0], ndir, pad_tile, mrow, mcol);
 
       /* Calculate chroma values in fdc:       */
       const int pad_fdc = 6;
       for(int row = pad_fdc; row < mrow - pad_fdc; row++)
+      {
+        float filt_re[4][TS], filt_im[4][TS];
+        _xtrans_fdc_filter_row(i_src, harr, row, pad_fdc, mcol - pad_fdc, filt_re, filt_im);
         for(int col = pad_fdc; col < mcol - pad_fdc; col++)
         {
           int myrow, mycol;
@@ -2021,18 +2061,10 @@ static void xtrans_fdc_interpolate(struct dt_iop_module_t *self, float *out, con
               dirsum += directionality[d];
             }
           float w = dirsum / (float)dircount;
-          int fdc_row, fdc_col;
-          float complex C2m, C5m, C7m, C10m;
-#define CONV_FILT(VAR, FILT)                                                                                      \
-  VAR = 0.0f + 0.0f * _Complex_I;                                                                                 \
-  for(fdc_row = 0, myrow = row - 6; fdc_row < 13; fdc_row++, myrow++)                                             \
-    for(fdc_col = 0, mycol = col - 6; fdc_col < 13; fdc_col++, mycol++)                                           \
-      VAR += FILT[12 - fdc_row][12 - fdc_col] * *(i_src + TS * myrow + mycol);
-          CONV_FILT(C2m, harr[0])
-          CONV_FILT(C5m, harr[1])
-          CONV_FILT(C7m, harr[2])
-          CONV_FILT(C10m, harr[3])
-#undef CONV_FILT
+          float complex C2m = _xtrans_complex(filt_re[0][col], filt_im[0][col]);
+          const float complex C5m = _xtrans_complex(filt_re[1][col], filt_im[1][col]);
+          const float complex C7m = _xtrans_complex(filt_re[2][col], filt_im[2][col]);
+          const float complex C10m = _xtrans_complex(filt_re[3][col], filt_im[3][col]);
           // build the q vector components
           myrow = (row + rowoffset) % 6;
           mycol = (col + coloffset) % 6;
@@ -2070,6 +2102,7 @@ static void xtrans_fdc_interpolate(struct dt_iop_module_t *self, float *out, con
           uv[1] = (rgbpix[0] - y) * 0.67815f;
           for(int c = 0; c < 2; c++) *(fdc_chroma + c * TS * TS + row * TS + col) = uv[c];
         }
+      }
 
       /* Average the most homogeneous pixels for the final result:       */
       for(int row = pad_tile; row < mrow - pad_tile; row++)
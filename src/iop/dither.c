@@ -61,7 +61,8 @@ typedef enum dt_iop_dither_type_t
   DITHER_FS4BIT_GRAY, // $DESCRIPTION: "floyd-steinberg 4-bit gray")
   DITHER_FS8BIT,      // $DESCRIPTION: "floyd-steinberg 8-bit RGB"
   DITHER_FS16BIT,     // $DESCRIPTION: "floyd-steinberg 16-bit RGB"
-  DITHER_FSAUTO       // $DESCRIPTION: "floyd-steinberg auto"
+  DITHER_FSAUTO,      // $DESCRIPTION: "floyd-steinberg auto"
+  DITHER_ORDERED      // $DESCRIPTION: "ordered auto"
 } dt_iop_dither_type_t;
 
 
@@ -98,6 +99,22 @@ typedef struct dt_iop_dither_data_t
   } random;
 } dt_iop_dither_data_t;
 
+typedef struct dt_iop_dither_global_data_t
+{
+  int kernel_dither_random;
+  int kernel_dither_ordered;
+} dt_iop_dither_global_data_t;
+
+// 8x8 bayer matrix, the thresholds are (m + 0.5) / 64. dither.cl has a copy
+static const int _bayer8[8][8] = { {  0, 32,  8, 40,  2, 34, 10, 42 },
+                                   { 48, 16, 56, 24, 50, 18, 58, 26 },
+                                   { 12, 44,  4, 36, 14, 46,  6, 38 },
+                                   { 60, 28, 52, 20, 62, 30, 54, 22 },
+                                   {  3, 35, 11, 43,  1, 33,  9, 41 },
+                                   { 51, 19, 59, 27, 49, 17, 57, 25 },
+                                   { 15, 47,  7, 39, 13, 45,  5, 37 },
+                                   { 63, 31, 55, 23, 61, 29, 53, 21 } };
+
 
 const char *name()
 {
@@ -133,7 +150,7 @@ void connect_key_accels(dt_iop_module_t *self)
 
 void init_presets(dt_iop_module_so_t *self)
 {
-  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "BEGIN", NULL, NULL, NULL);
+  dt_database_start_transaction(darktable.db);
 
   dt_iop_dither_params_t tmp
       = (dt_iop_dither_params_t){ DITHER_FSAUTO, 0, { 0.0f, { 0.0f, 0.0f, 1.0f, 1.0f }, -200.0f } };
@@ -142,7 +159,7 @@ void init_presets(dt_iop_module_so_t *self)
   // make it auto-apply for all images:
   // dt_gui_presets_update_autoapply(_("dither"), self->op, self->version(), 1);
 
-  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+  dt_database_release_transaction(darktable.db);
 }
 
 
@@ -317,8 +334,9 @@ static void process_floyd_steinberg(struct dt_iop_module_t *self, dt_dev_pixelpi
         nearest_color = NULL;
       break;
     case DITHER_RANDOM:
-      // this function won't ever be called for that type
-      // instead, process_random() will be called
+    case DITHER_ORDERED:
+      // this function won't ever be called for these types
+      // instead, process_random() or process_ordered() will be called
       __builtin_unreachable();
       break;
   }
@@ -485,8 +503,9 @@ static void process_floyd_steinberg_sse2(struct dt_iop_module_t *self, dt_dev_pi
         nearest_color = NULL;
       break;
     case DITHER_RANDOM:
-      // this function won't ever be called for that type
-      // instead, process_random() will be called
+    case DITHER_ORDERED:
+      // this function won't ever be called for these types
+      // instead, process_random() or process_ordered() will be called
       __builtin_unreachable();
       break;
   }
@@ -651,6 +670,90 @@ static void process_random(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t
 }
 
 
+// levels and gray or rgb of the output format as for DITHER_FSAUTO, FALSE if it needs no dithering
+static gboolean _auto_levels(const dt_dev_pixelpipe_iop_t *piece, int *gray, unsigned int *levels)
+{
+  // no automatic dithering for preview and thumbnail
+  if((piece->pipe->type & DT_DEV_PIXELPIPE_PREVIEW) == DT_DEV_PIXELPIPE_PREVIEW
+     || (piece->pipe->type & DT_DEV_PIXELPIPE_THUMBNAIL) == DT_DEV_PIXELPIPE_THUMBNAIL)
+    return FALSE;
+
+  switch(piece->pipe->levels & IMAGEIO_CHANNEL_MASK)
+  {
+    case IMAGEIO_RGB:
+      *gray = 0;
+      break;
+    case IMAGEIO_GRAY:
+      *gray = 1;
+      break;
+    default:
+      return FALSE;
+  }
+
+  switch(piece->pipe->levels & IMAGEIO_PREC_MASK)
+  {
+    case IMAGEIO_INT8:
+      *levels = 256;
+      return TRUE;
+    case IMAGEIO_INT12:
+      *levels = 4096;
+      return TRUE;
+    case IMAGEIO_INT16:
+      *levels = 65536;
+      return TRUE;
+    case IMAGEIO_BW:
+      *levels = 2;
+      return TRUE;
+    default:
+      return FALSE;
+  }
+}
+
+// unlike floyd-steinberg every pixel only depends on its own value and position, so this runs in parallel
+static void process_ordered(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
+                            const void *const ivoid, void *const ovoid, const dt_iop_roi_t *const roi_in,
+                            const dt_iop_roi_t *const roi_out)
+{
+  const int width = roi_out->width;
+  const int height = roi_out->height;
+  const int ch = piece->colors;
+  const int roi_x = roi_out->x;
+  const int roi_y = roi_out->y;
+
+  int gray = 0;
+  unsigned int levels = 0;
+  const gboolean dither = _auto_levels(piece, &gray, &levels);
+  const float f = dither ? levels - 1 : 0.0f;
+  const float rf = dither ? 1.0 / f : 0.0f;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(ch, dither, f, gray, height, ivoid, ovoid, rf, roi_x, roi_y, width) \
+  schedule(static)
+#endif
+  for(int j = 0; j < height; j++)
+  {
+    const float *in = (const float *)ivoid + (size_t)ch * width * j;
+    float *out = (float *)ovoid + (size_t)ch * width * j;
+    const int *bayer = _bayer8[(roi_y + j) & 7];
+    for(int i = 0; i < width; i++, in += ch, out += ch)
+    {
+      float val[3] = { clipnan(in[0]), clipnan(in[1]), clipnan(in[2]) };
+      if(dither)
+      {
+        if(gray) val[0] = val[1] = val[2] = 0.30f * val[0] + 0.59f * val[1] + 0.11f * val[2];
+        const float t = (bayer[(roi_x + i) & 7] + 0.5f) / 64.0f;
+        for(int c = 0; c < 3; c++) val[c] = CLIP(floorf(val[c] * f + t) * rf);
+      }
+      out[0] = val[0];
+      out[1] = val[1];
+      out[2] = val[2];
+    }
+  }
+
+  if(piece->pipe->mask_display & DT_DEV_PIXELPIPE_DISPLAY_MASK) dt_iop_alpha_copy(ivoid, ovoid, width, height);
+}
+
 void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
              void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
@@ -658,6 +761,8 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
 
   if(data->dither_type == DITHER_RANDOM)
     process_random(self, piece, ivoid, ovoid, roi_in, roi_out);
+  else if(data->dither_type == DITHER_ORDERED)
+    process_ordered(self, piece, ivoid, ovoid, roi_in, roi_out);
   else
     process_floyd_steinberg(self, piece, ivoid, ovoid, roi_in, roi_out);
 }
@@ -670,11 +775,67 @@ void process_sse2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, c
 
   if(data->dither_type == DITHER_RANDOM)
     process_random(self, piece, ivoid, ovoid, roi_in, roi_out);
+  else if(data->dither_type == DITHER_ORDERED)
+    process_ordered(self, piece, ivoid, ovoid, roi_in, roi_out);
   else
     process_floyd_steinberg_sse2(self, piece, ivoid, ovoid, roi_in, roi_out);
 }
 #endif
 
+#ifdef HAVE_OPENCL
+int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem dev_in, cl_mem dev_out,
+               const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+  dt_iop_dither_data_t *data = (dt_iop_dither_data_t *)piece->data;
+  dt_iop_dither_global_data_t *gd = (dt_iop_dither_global_data_t *)self->global_data;
+
+  cl_int err = -999;
+  const int devid = piece->pipe->devid;
+  const int width = roi_out->width;
+  const int height = roi_out->height;
+  size_t sizes[3] = { ROUNDUPWD(width), ROUNDUPHT(height), 1 };
+
+  // floyd-steinberg is sequential, commit_params() keeps those types on the cpu
+  if(data->dither_type == DITHER_RANDOM)
+  {
+    const float dither = powf(2.0f, data->random.damping / 10.0f);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_dither_random, 0, sizeof(cl_mem), (void *)&dev_in);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_dither_random, 1, sizeof(cl_mem), (void *)&dev_out);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_dither_random, 2, sizeof(int), (void *)&width);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_dither_random, 3, sizeof(int), (void *)&height);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_dither_random, 4, sizeof(float), (void *)&dither);
+    err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_dither_random, sizes);
+  }
+  else
+  {
+    int gray = 0;
+    unsigned int levels = 0;
+    // f = 0 only clips, as process_ordered() does for outputs which need no dithering
+    const gboolean dither = _auto_levels(piece, &gray, &levels);
+    const float f = dither ? levels - 1 : 0.0f;
+    const float rf = dither ? 1.0f / f : 0.0f;
+    const int roi_x = roi_out->x;
+    const int roi_y = roi_out->y;
+    dt_opencl_set_kernel_arg(devid, gd->kernel_dither_ordered, 0, sizeof(cl_mem), (void *)&dev_in);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_dither_ordered, 1, sizeof(cl_mem), (void *)&dev_out);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_dither_ordered, 2, sizeof(int), (void *)&width);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_dither_ordered, 3, sizeof(int), (void *)&height);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_dither_ordered, 4, sizeof(int), (void *)&roi_x);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_dither_ordered, 5, sizeof(int), (void *)&roi_y);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_dither_ordered, 6, sizeof(float), (void *)&f);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_dither_ordered, 7, sizeof(float), (void *)&rf);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_dither_ordered, 8, sizeof(int), (void *)&gray);
+    err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_dither_ordered, sizes);
+  }
+  if(err != CL_SUCCESS) goto error;
+  return TRUE;
+
+error:
+  dt_print(DT_DEBUG_OPENCL, "[opencl_dither] couldn't enqueue kernel! %d\n", err);
+  return FALSE;
+}
+#endif
+
 void gui_changed(dt_iop_module_t *self, GtkWidget *w, void *previous)
 {
   dt_iop_dither_params_t *p = (dt_iop_dither_params_t *)self->params;
@@ -723,6 +884,8 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
   memcpy(&(d->random.range), &(p->random.range), sizeof(p->random.range));
   d->random.radius = p->random.radius;
   d->random.damping = p->random.damping;
+
+  if(d->dither_type != DITHER_RANDOM && d->dither_type != DITHER_ORDERED) piece->process_cl_ready = 0;
 }
 
 void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
@@ -737,6 +900,24 @@ void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev
   piece->data = NULL;
 }
 
+void init_global(dt_iop_module_so_t *module)
+{
+  const int program = 35; // dither.cl, from programs.conf
+  dt_iop_dither_global_data_t *gd = (dt_iop_dither_global_data_t *)malloc(sizeof(dt_iop_dither_global_data_t));
+  module->data = gd;
+  gd->kernel_dither_random = dt_opencl_create_kernel(program, "dither_random");
+  gd->kernel_dither_ordered = dt_opencl_create_kernel(program, "dither_ordered");
+}
+
+void cleanup_global(dt_iop_module_so_t *module)
+{
+  dt_iop_dither_global_data_t *gd = (dt_iop_dither_global_data_t *)module->data;
+  dt_opencl_free_kernel(gd->kernel_dither_random);
+  dt_opencl_free_kernel(gd->kernel_dither_ordered);
+  free(module->data);
+  module->data = NULL;
+}
+
 
 void gui_update(struct dt_iop_module_t *self)
 {
@@ -52,6 +52,9 @@
 
 #define NORM_MIN 1.52587890625e-05f // norm can't be < to 2^(-16)
 
+// intervals of the lut of the curve over the log encoded [0, 1]
+#define FILMIC_CURVE_LUT_SIZE 0x10000
+
 #define DT_GUI_CURVE_EDITOR_INSET DT_PIXEL_APPLY_DPI(1)
 
 
@@ -227,6 +230,7 @@ typedef struct dt_iop_filmicrgb_data_t
   int high_quality_reconstruction;
   struct dt_iop_filmic_rgb_spline_t spline DT_ALIGNED_ARRAY;
   dt_noise_distribution_t noise_distribution;
+  float curve[FILMIC_CURVE_LUT_SIZE + 1]; // the spline, clamped and raised to output_power, over [0, 1]
 } dt_iop_filmicrgb_data_t;
 
 
@@ -249,7 +253,8 @@ int default_group()
 
 int flags()
 {
-  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_INCLUDE_IN_STYLES | IOP_FLAGS_SUPPORTS_BLENDING;
+  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_INCLUDE_IN_STYLES | IOP_FLAGS_SUPPORTS_BLENDING
+         | IOP_FLAGS_HALF_INPUT;
 }
 
 int default_colorspace(dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
@@ -569,6 +574,32 @@ static inline float linear_saturation(const float x, const float luminance, cons
   return luminance + saturation * (x - luminance);
 }
 
+// the spline clamped to [0, 1] and raised to the output power, what the lut filled by commit_params() holds
+#ifdef _OPENMP
+#pragma omp declare simd uniform(data)
+#endif
+static inline float filmic_curve_exact(const float x, const dt_iop_filmicrgb_data_t *const data)
+{
+  const dt_iop_filmic_rgb_spline_t *const spline = &data->spline;
+  return powf(clamp_simd(filmic_spline(x, spline->M1, spline->M2, spline->M3, spline->M4, spline->M5,
+                                       spline->latitude_min, spline->latitude_max)),
+              data->output_power);
+}
+
+
+// filmic_curve_exact() interpolated in the lut, for x in [0, 1]. the log tone-mapping keeps the norms there,
+// only the desaturated channels of the split modes can land outside.
+#ifdef _OPENMP
+#pragma omp declare simd uniform(curve)
+#endif
+static inline float filmic_curve(const float x, const float *const curve)
+{
+  const float f = clamp_simd(x) * (float)FILMIC_CURVE_LUT_SIZE;
+  const int i = MIN((int)f, FILMIC_CURVE_LUT_SIZE - 1);
+  const float r = f - (float)i;
+  return curve[i] + r * (curve[i + 1] - curve[i]);
+}
+
 
 #ifdef _OPENMP
 #pragma omp declare simd
@@ -1131,220 +1162,328 @@ error:
 }
 
 
+// pixels per block. the norms and luminances of a block are taken in loops of their own, so that the branches
+// on the method and the work profile stay out of the per pixel loops, which then turn into vector code. all
+// buffers hold 4 channels per pixel.
+#define FILMIC_BLOCK 256
+
+// the luminance of n pixels
+static inline void filmic_luminance(const float *const restrict in, float *const restrict lum, const size_t n,
+                                    const dt_iop_order_iccprofile_info_t *const work_profile)
+{
+  if(!work_profile)
+  {
 #ifdef _OPENMP
-#pragma omp declare simd aligned(in, out:64) \
-  uniform(ch, width, height, work_profile, data, spline)
+#ifdef _OPENMP
+#pragma omp simd aligned(lum:64)
 #endif
-static inline void filmic_split_v1(const float *const restrict in, float *const restrict out,
-                                   const dt_iop_order_iccprofile_info_t *const work_profile,
-                                   const dt_iop_filmicrgb_data_t *const data, const dt_iop_filmic_rgb_spline_t spline,
-                                   const size_t width, const size_t height, const size_t ch)
-{
+#endif
+    for(size_t i = 0; i < n; i++) lum[i] = dt_camera_rgb_luminance(in + 4 * i);
+  }
+  else if(!work_profile->nonlinearlut)
+  {
+    // dt_ioppr_get_rgb_matrix_luminance() without the trc
+    const float m3 = work_profile->matrix_in[3], m4 = work_profile->matrix_in[4], m5 = work_profile->matrix_in[5];
 #ifdef _OPENMP
-#pragma omp parallel for simd default(none) \
-  dt_omp_firstprivate(width, height, ch, data, in, out, work_profile, spline) \
-  schedule(simd:static) aligned(in, out:64)
+#ifdef _OPENMP
+#pragma omp simd aligned(lum:64)
 #endif
-  for(size_t k = 0; k < height * width * ch; k += ch)
+#endif
+    for(size_t i = 0; i < n; i++) lum[i] = m3 * in[4 * i] + m4 * in[4 * i + 1] + m5 * in[4 * i + 2];
+  }
+  else
   {
-    const float *const restrict pix_in = in + k;
-    float *const restrict pix_out = out + k;
-    float DT_ALIGNED_PIXEL temp[4];
-
-    // Log tone-mapping
-    for(int c = 0; c < 3; c++)
-      temp[c] = log_tonemapping_v1(fmaxf(pix_in[c], NORM_MIN), data->grey_source, data->black_source, data->dynamic_range);
-
-    // Get the desaturation coeff based on the log value
-    const float lum = (work_profile) ? dt_ioppr_get_rgb_matrix_luminance(temp,
-                                                                         work_profile->matrix_in,
-                                                                         work_profile->lut_in,
-                                                                         work_profile->unbounded_coeffs_in,
-                                                                         work_profile->lutsize,
-                                                                         work_profile->nonlinearlut)
-                                      : dt_camera_rgb_luminance(temp);
-    const float desaturation = filmic_desaturate_v1(lum, data->sigma_toe, data->sigma_shoulder, data->saturation);
-
-    // Desaturate on the non-linear parts of the curve
-    // Filmic S curve on the max RGB
-    // Apply the transfer function of the display
-    for(int c = 0; c < 3; c++)
-      pix_out[c] = powf(clamp_simd(filmic_spline(linear_saturation(temp[c], lum, desaturation), spline.M1, spline.M2, spline.M3, spline.M4, spline.M5, spline.latitude_min, spline.latitude_max)), data->output_power);
+    for(size_t i = 0; i < n; i++)
+      lum[i] = dt_ioppr_get_rgb_matrix_luminance(in + 4 * i, work_profile->matrix_in, work_profile->lut_in,
+                                                 work_profile->unbounded_coeffs_in, work_profile->lutsize,
+                                                 work_profile->nonlinearlut);
   }
 }
 
+// get_pixel_norm() of n pixels, clamped to NORM_MIN
+static inline void filmic_norms(const float *const restrict in, float *const restrict norms, const size_t n,
+                                const int variant, const dt_iop_order_iccprofile_info_t *const work_profile)
+{
+  switch(variant)
+  {
+    case(DT_FILMIC_METHOD_MAX_RGB):
+#ifdef _OPENMP
+#pragma omp simd aligned(norms:64)
+#endif
+      for(size_t i = 0; i < n; i++) norms[i] = fmaxf(fmaxf(in[4 * i], in[4 * i + 1]), in[4 * i + 2]);
+      break;
+
+    case(DT_FILMIC_METHOD_POWER_NORM):
+#ifdef _OPENMP
+#pragma omp simd aligned(norms:64)
+#endif
+      for(size_t i = 0; i < n; i++) norms[i] = pixel_rgb_norm_power(in + 4 * i);
+      break;
 
+    case(DT_FILMIC_METHOD_EUCLIDEAN_NORM):
 #ifdef _OPENMP
-#pragma omp declare simd aligned(in, out:64) \
-  uniform(ch, width, height, work_profile, data, spline)
+#pragma omp simd aligned(norms:64)
 #endif
-static inline void filmic_split_v2(const float *const restrict in, float *const restrict out,
-                                   const dt_iop_order_iccprofile_info_t *const work_profile,
-                                   const dt_iop_filmicrgb_data_t *const data, const dt_iop_filmic_rgb_spline_t spline,
-                                   const size_t width, const size_t height, const size_t ch)
+      for(size_t i = 0; i < n; i++) norms[i] = sqrtf(sqf(in[4 * i]) + sqf(in[4 * i + 1]) + sqf(in[4 * i + 2]));
+      break;
+
+    default: // luminance
+      filmic_luminance(in, norms, n, work_profile);
+      break;
+  }
+
+#ifdef _OPENMP
+#pragma omp simd aligned(norms:64)
+#endif
+  for(size_t i = 0; i < n; i++) norms[i] = fmaxf(norms[i], NORM_MIN);
+}
+
+// the split modes: log tone-mapping per channel, desaturation on the luminance of the log values
+static inline void filmic_split(const float *const restrict in, float *const restrict out,
+                                const dt_iop_order_iccprofile_info_t *const work_profile,
+                                const dt_iop_filmicrgb_data_t *const data, const size_t npixels)
 {
+  const size_t nblocks = (npixels + FILMIC_BLOCK - 1) / FILMIC_BLOCK;
 #ifdef _OPENMP
-#pragma omp parallel for simd default(none) \
-  dt_omp_firstprivate(width, height, ch, data, in, out, work_profile, spline) \
-  schedule(simd:static) aligned(in, out:64)
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(in, nblocks, npixels, out, data, work_profile) \
+  schedule(static)
 #endif
-  for(size_t k = 0; k < height * width * ch; k += ch)
+  for(size_t b = 0; b < nblocks; b++)
   {
-    const float *const restrict pix_in = in + k;
-    float *const restrict pix_out = out + k;
-    float DT_ALIGNED_PIXEL temp[4];
+    const float *const curve = data->curve;
+    const size_t k0 = b * FILMIC_BLOCK;
+    const size_t n = MIN(FILMIC_BLOCK, npixels - k0);
+    const float *const restrict block_in = in + 4 * k0;
+    float *const restrict block_out = out + 4 * k0;
+    float DT_ALIGNED_ARRAY temp[4 * FILMIC_BLOCK];
+    float DT_ALIGNED_ARRAY lum[FILMIC_BLOCK];
 
     // Log tone-mapping
-    for(int c = 0; c < 3; c++)
-      temp[c] = log_tonemapping_v2(fmaxf(pix_in[c], NORM_MIN), data->grey_source, data->black_source, data->dynamic_range);
+    if(data->version == DT_FILMIC_COLORSCIENCE_V1)
+    {
+#ifdef _OPENMP
+#pragma omp simd aligned(temp:64)
+#endif
+      for(size_t k = 0; k < 4 * n; k++)
+        temp[k] = log_tonemapping_v1(fmaxf(block_in[k], NORM_MIN), data->grey_source, data->black_source, data->dynamic_range);
+    }
+    else
+    {
+#ifdef _OPENMP
+#pragma omp simd aligned(temp:64)
+#endif
+      for(size_t k = 0; k < 4 * n; k++)
+        temp[k] = log_tonemapping_v2(fmaxf(block_in[k], NORM_MIN), data->grey_source, data->black_source, data->dynamic_range);
+    }
 
     // Get the desaturation coeff based on the log value
-    const float lum = (work_profile) ? dt_ioppr_get_rgb_matrix_luminance(temp,
-                                                                         work_profile->matrix_in,
-                                                                         work_profile->lut_in,
-                                                                         work_profile->unbounded_coeffs_in,
-                                                                         work_profile->lutsize,
-                                                                         work_profile->nonlinearlut)
-                                      : dt_camera_rgb_luminance(temp);
-    const float desaturation = filmic_desaturate_v2(lum, data->sigma_toe, data->sigma_shoulder, data->saturation);
-
-    // Desaturate on the non-linear parts of the curve
+    filmic_luminance(temp, lum, n, work_profile);
+
+    // Desaturate on the non-linear parts of the curve, the desaturated values go back to temp
+    if(data->version == DT_FILMIC_COLORSCIENCE_V1)
+    {
+#ifdef _OPENMP
+#pragma omp simd aligned(temp, lum:64)
+#endif
+      for(size_t i = 0; i < n; i++)
+      {
+        const float desaturation = filmic_desaturate_v1(lum[i], data->sigma_toe, data->sigma_shoulder, data->saturation);
+        for(int c = 0; c < 3; c++) temp[4 * i + c] = linear_saturation(temp[4 * i + c], lum[i], desaturation);
+      }
+    }
+    else
+    {
+#ifdef _OPENMP
+#pragma omp simd aligned(temp, lum:64)
+#endif
+      for(size_t i = 0; i < n; i++)
+      {
+        const float desaturation = filmic_desaturate_v2(lum[i], data->sigma_toe, data->sigma_shoulder, data->saturation);
+        for(int c = 0; c < 3; c++) temp[4 * i + c] = linear_saturation(temp[4 * i + c], lum[i], desaturation);
+      }
+    }
+
     // Filmic S curve on the max RGB
     // Apply the transfer function of the display
-    for(int c = 0; c < 3; c++)
-      pix_out[c] = powf(clamp_simd(filmic_spline(linear_saturation(temp[c], lum, desaturation), spline.M1, spline.M2, spline.M3, spline.M4, spline.M5, spline.latitude_min, spline.latitude_max)), data->output_power);
+#ifdef _OPENMP
+#pragma omp simd aligned(temp:64)
+#endif
+    for(size_t i = 0; i < n; i++)
+      for(int c = 0; c < 3; c++) block_out[4 * i + c] = filmic_curve(temp[4 * i + c], curve);
+
+    // the few values the desaturation pushed out of the lut
+    for(size_t i = 0; i < n; i++)
+      for(int c = 0; c < 3; c++)
+        if(temp[4 * i + c] < 0.0f || temp[4 * i + c] > 1.0f)
+          block_out[4 * i + c] = filmic_curve_exact(temp[4 * i + c], data);
   }
 }
 
 
-#ifdef _OPENMP
-#pragma omp declare simd aligned(in, out:64) \
-  uniform(ch, width, height, work_profile, data, spline, variant)
-#endif
 static inline void filmic_chroma_v1(const float *const restrict in, float *const restrict out,
                                     const dt_iop_order_iccprofile_info_t *const work_profile,
-                                    const dt_iop_filmicrgb_data_t *const data, const dt_iop_filmic_rgb_spline_t spline,
-                                    const int variant,
-                                    const size_t width, const size_t height, const size_t ch)
+                                    const dt_iop_filmicrgb_data_t *const data, const size_t npixels)
 {
+  const size_t nblocks = (npixels + FILMIC_BLOCK - 1) / FILMIC_BLOCK;
 #ifdef _OPENMP
-#pragma omp parallel for simd default(none) \
-  dt_omp_firstprivate(width, height, ch, data, in, out, work_profile, variant, spline) \
-  schedule(simd:static) aligned(in, out:64)
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(in, nblocks, npixels, out, data, work_profile) \
+  schedule(static)
 #endif
-  for(size_t k = 0; k < height * width * ch; k += ch)
+  for(size_t b = 0; b < nblocks; b++)
   {
-    const float *const restrict pix_in = in + k;
-    float *const restrict pix_out = out + k;
+    const float *const curve = data->curve;
+    const size_t k0 = b * FILMIC_BLOCK;
+    const size_t n = MIN(FILMIC_BLOCK, npixels - k0);
+    const float *const restrict block_in = in + 4 * k0;
+    float *const restrict block_out = out + 4 * k0;
+    float DT_ALIGNED_ARRAY norms[FILMIC_BLOCK];
+    float DT_ALIGNED_ARRAY desaturation[FILMIC_BLOCK];
+    float DT_ALIGNED_ARRAY ratios[4 * FILMIC_BLOCK];
+    float DT_ALIGNED_ARRAY lum[FILMIC_BLOCK];
+
+    filmic_norms(block_in, norms, n, data->preserve_color, work_profile);
 
-    float DT_ALIGNED_PIXEL ratios[4] = { 0.0f };
-    float norm = fmaxf(get_pixel_norm(pix_in, variant, work_profile), NORM_MIN);
-
-    // Save the ratios
-    for(int c = 0; c < 3; c++) ratios[c] = pix_in[c] / norm;
+#ifdef _OPENMP
+#pragma omp simd aligned(norms, desaturation, ratios:64)
+#endif
+    for(size_t i = 0; i < n; i++)
+    {
+      float *const ratio = ratios + 4 * i;
 
-    // Sanitize the ratios
-    const float min_ratios = fminf(fminf(ratios[0], ratios[1]), ratios[2]);
-    if(min_ratios < 0.0f) for(int c = 0; c < 3; c++) ratios[c] -= min_ratios;
+      // Save the ratios
+      for(int c = 0; c < 3; c++) ratio[c] = block_in[4 * i + c] / norms[i];
 
-    // Log tone-mapping
-    norm = log_tonemapping_v1(norm, data->grey_source, data->black_source, data->dynamic_range);
+      // Sanitize the ratios
+      const float min_ratios = fminf(fminf(ratio[0], ratio[1]), ratio[2]);
+      const float offset = (min_ratios < 0.0f) ? min_ratios : 0.0f;
+      for(int c = 0; c < 3; c++) ratio[c] -= offset;
 
-    // Get the desaturation value based on the log value
-    const float desaturation = filmic_desaturate_v1(norm, data->sigma_toe, data->sigma_shoulder, data->saturation);
+      // Log tone-mapping
+      norms[i] = log_tonemapping_v1(norms[i], data->grey_source, data->black_source, data->dynamic_range);
 
-    for(int c = 0; c < 3; c++) ratios[c] *= norm;
+      // Get the desaturation value based on the log value
+      desaturation[i] = filmic_desaturate_v1(norms[i], data->sigma_toe, data->sigma_shoulder, data->saturation);
 
-    const float lum = (work_profile) ? dt_ioppr_get_rgb_matrix_luminance(ratios,
-                                                                         work_profile->matrix_in,
-                                                                         work_profile->lut_in,
-                                                                         work_profile->unbounded_coeffs_in,
-                                                                         work_profile->lutsize,
-                                                                         work_profile->nonlinearlut)
-                                      : dt_camera_rgb_luminance(ratios);
+      for(int c = 0; c < 3; c++) ratio[c] *= norms[i];
+    }
 
-    // Desaturate on the non-linear parts of the curve and save ratios
-    for(int c = 0; c < 3; c++) ratios[c] = linear_saturation(ratios[c], lum, desaturation) / norm;
+    filmic_luminance(ratios, lum, n, work_profile);
 
-    // Filmic S curve on the max RGB
-    // Apply the transfer function of the display
-    norm = powf(clamp_simd(filmic_spline(norm, spline.M1, spline.M2, spline.M3, spline.M4, spline.M5, spline.latitude_min, spline.latitude_max)), data->output_power);
+#ifdef _OPENMP
+#pragma omp simd aligned(norms, desaturation, ratios, lum:64)
+#endif
+    for(size_t i = 0; i < n; i++)
+    {
+      // Filmic S curve on the max RGB
+      // Apply the transfer function of the display
+      const float norm = filmic_curve(norms[i], curve);
 
-    // Re-apply ratios
-    for(int c = 0; c < 3; c++) pix_out[c] = ratios[c] * norm;
+      // Desaturate on the non-linear parts of the curve and re-apply ratios
+      for(int c = 0; c < 3; c++)
+        block_out[4 * i + c] = linear_saturation(ratios[4 * i + c], lum[i], desaturation[i]) / norms[i] * norm;
+    }
   }
 }
 
 
-#ifdef _OPENMP
-#pragma omp declare simd aligned(in, out:64) \
-  uniform(ch, width, height, work_profile, data, spline, variant)
-#endif
 static inline void filmic_chroma_v2(const float *const restrict in, float *const restrict out,
                                     const dt_iop_order_iccprofile_info_t *const work_profile,
-                                    const dt_iop_filmicrgb_data_t *const data, const dt_iop_filmic_rgb_spline_t spline,
-                                    const int variant,
-                                    const size_t width, const size_t height, const size_t ch)
+                                    const dt_iop_filmicrgb_data_t *const data, const size_t npixels)
 {
-
-  #ifdef _OPENMP
-  #pragma omp parallel for simd default(none) \
-    dt_omp_firstprivate(width, height, ch, data, in, out, work_profile, variant, spline) \
-    schedule(simd:static) aligned(in, out:64)
-  #endif
-  for(size_t k = 0; k < height * width * ch; k += ch)
+  const size_t nblocks = (npixels + FILMIC_BLOCK - 1) / FILMIC_BLOCK;
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(in, nblocks, npixels, out, data, work_profile) \
+  schedule(static)
+#endif
+  for(size_t b = 0; b < nblocks; b++)
   {
-    const float *const restrict pix_in = in + k;
-    float *const restrict pix_out = out + k;
-
-    float norm = fmaxf(get_pixel_norm(pix_in, variant, work_profile), NORM_MIN);
+    const float *const curve = data->curve;
+    const size_t k0 = b * FILMIC_BLOCK;
+    const size_t n = MIN(FILMIC_BLOCK, npixels - k0);
+    const float *const restrict block_in = in + 4 * k0;
+    float *const restrict block_out = out + 4 * k0;
+    float DT_ALIGNED_ARRAY norms[FILMIC_BLOCK];
+    float DT_ALIGNED_ARRAY desaturation[FILMIC_BLOCK];
+    float DT_ALIGNED_ARRAY ratios[4 * FILMIC_BLOCK];
 
-    // Save the ratios
-    float DT_ALIGNED_PIXEL ratios[4] = { 0.0f };
-    for(int c = 0; c < 3; c++) ratios[c] = pix_in[c] / norm;
+    filmic_norms(block_in, norms, n, data->preserve_color, work_profile);
 
-    // Sanitize the ratios
-    const float min_ratios = fminf(fminf(ratios[0], ratios[1]), ratios[2]);
-    const int sanitize = (min_ratios < 0.0f);
+#ifdef _OPENMP
+#pragma omp simd aligned(norms, ratios:64)
+#endif
+    for(size_t i = 0; i < n; i++)
+    {
+      float *const ratio = ratios + 4 * i;
 
-    if(sanitize)
-      for(int c = 0; c < 3; c++)
-        ratios[c] -= min_ratios;
+      // Save the ratios
+      for(int c = 0; c < 3; c++) ratio[c] = block_in[4 * i + c] / norms[i];
 
-    // Log tone-mapping
-    norm = log_tonemapping_v2(norm, data->grey_source, data->black_source, data->dynamic_range);
+      // Sanitize the ratios
+      const float min_ratios = fminf(fminf(ratio[0], ratio[1]), ratio[2]);
+      const float offset = (min_ratios < 0.0f) ? min_ratios : 0.0f;
+      for(int c = 0; c < 3; c++) ratio[c] -= offset;
+    }
 
-    // Get the desaturation value based on the log value
-    const float desaturation = filmic_desaturate_v2(norm, data->sigma_toe, data->sigma_shoulder, data->saturation);
+#ifdef _OPENMP
+#pragma omp simd aligned(norms, desaturation:64)
+#endif
+    for(size_t i = 0; i < n; i++)
+    {
+      // Log tone-mapping
+      norms[i] = log_tonemapping_v2(norms[i], data->grey_source, data->black_source, data->dynamic_range);
 
-    // Filmic S curve on the max RGB
-    // Apply the transfer function of the display
-    norm = powf(clamp_simd(filmic_spline(norm, spline.M1, spline.M2, spline.M3, spline.M4, spline.M5, spline.latitude_min, spline.latitude_max)), data->output_power);
+      // Get the desaturation value based on the log value
+      desaturation[i] = filmic_desaturate_v2(norms[i], data->sigma_toe, data->sigma_shoulder, data->saturation);
+    }
 
-    // Re-apply ratios with saturation change
-    for(int c = 0; c < 3; c++)
+#ifdef _OPENMP
+#pragma omp simd aligned(norms, desaturation, ratios:64)
+#endif
+    for(size_t i = 0; i < n; i++)
     {
-      ratios[c] = fmaxf(ratios[c] + (1.0f - ratios[c]) * (1.0f - desaturation), 0.0f);
-      pix_out[c] = ratios[c] * norm;
-    }
+      const float *const ratio = ratios + 4 * i;
+      float *const pix_out = block_out + 4 * i;
 
-    // Gamut mapping
-    const float max_pix = fmaxf(fmaxf(pix_out[0], pix_out[1]), pix_out[2]);
-    const int penalize = (max_pix > 1.0f);
+      // Filmic S curve on the max RGB
+      // Apply the transfer function of the display
+      const float norm = filmic_curve(norms[i], curve);
 
-    // Penalize the ratios by the amount of clipping
-    if(penalize)
-    {
+      // Re-apply ratios with saturation change
+      float sat_ratio[3];
       for(int c = 0; c < 3; c++)
       {
-        ratios[c] = fmaxf(ratios[c] + (1.0f - max_pix), 0.0f);
-        pix_out[c] = clamp_simd(ratios[c] * norm);
+        sat_ratio[c] = fmaxf(ratio[c] + (1.0f - ratio[c]) * (1.0f - desaturation[i]), 0.0f);
+        pix_out[c] = sat_ratio[c] * norm;
       }
+
+      // Gamut mapping: penalize the ratios by the amount of clipping
+      const float max_pix = fmaxf(fmaxf(pix_out[0], pix_out[1]), pix_out[2]);
+      const float penalty = (max_pix > 1.0f) ? 1.0f - max_pix : 0.0f;
+      for(int c = 0; c < 3; c++)
+        pix_out[c] = (penalty < 0.0f) ? clamp_simd(fmaxf(sat_ratio[c] + penalty, 0.0f) * norm) : pix_out[c];
     }
   }
 }
 
 
+// tone maps npixels of 4 channels from in to out, the 4th channel of out is left alone
+static inline void filmic_tonemap(const float *const in, float *const out,
+                                  const dt_iop_order_iccprofile_info_t *const work_profile,
+                                  const dt_iop_filmicrgb_data_t *const data, const size_t npixels)
+{
+  if(data->preserve_color == DT_FILMIC_METHOD_NONE)
+    // no chroma preservation
+    filmic_split(in, out, work_profile, data, npixels);
+  else if(data->version == DT_FILMIC_COLORSCIENCE_V1)
+    filmic_chroma_v1(in, out, work_profile, data, npixels);
+  else if(data->version == DT_FILMIC_COLORSCIENCE_V2)
+    filmic_chroma_v2(in, out, work_profile, data, npixels);
+}
+
+
 #ifdef _OPENMP
 #pragma omp declare simd aligned(mask, out:64) \
   uniform(ch, width, height)
@@ -1493,22 +1632,7 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
 
   if(mask) dt_free_align(mask);
 
-  if(data->preserve_color == DT_FILMIC_METHOD_NONE)
-  {
-    // no chroma preservation
-    if(data->version == DT_FILMIC_COLORSCIENCE_V1)
-      filmic_split_v1(in, out, work_profile, data, data->spline, roi_out->width, roi_in->height, ch);
-    else if(data->version == DT_FILMIC_COLORSCIENCE_V2)
-      filmic_split_v2(in, out, work_profile, data, data->spline, roi_out->width, roi_in->height, ch);
-  }
-  else
-  {
-    // chroma preservation
-    if(data->version == DT_FILMIC_COLORSCIENCE_V1)
-      filmic_chroma_v1(in, out, work_profile, data, data->spline, data->preserve_color, roi_out->width, roi_out->height, ch);
-    else if(data->version == DT_FILMIC_COLORSCIENCE_V2)
-      filmic_chroma_v2(in, out, work_profile, data, data->spline, data->preserve_color, roi_out->width, roi_out->height, ch);
-  }
+  filmic_tonemap(in, out, work_profile, data, (size_t)roi_out->width * roi_out->height);
 
   if(reconstructed) dt_free_align(reconstructed);
 
@@ -2002,6 +2126,15 @@ void commit_params(dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pixelpipe_
   d->sigma_toe = powf(d->spline.latitude_min / 3.0f, 2.0f);
   d->sigma_shoulder = powf((1.0f - d->spline.latitude_max) / 3.0f, 2.0f);
 
+  // sample the curve, see filmic_curve()
+  for(int k = 0; k <= FILMIC_CURVE_LUT_SIZE; k++)
+  {
+    const float x = (float)k / (float)FILMIC_CURVE_LUT_SIZE;
+    d->curve[k] = powf(clamp_simd(filmic_spline(x, d->spline.M1, d->spline.M2, d->spline.M3, d->spline.M4,
+                                                d->spline.M5, d->spline.latitude_min, d->spline.latitude_max)),
+                       d->output_power);
+  }
+
   d->reconstruct_threshold = powf(2.0f, white_source + p->reconstruct_threshold) * grey_source;
   d->reconstruct_feather = exp2f(12.f / p->reconstruct_feather);
 
@@ -67,6 +67,21 @@ void modify_roi_in(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const d
   roi_in->scale = 1.0f;
 }
 
+int invert_roi_in(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const dt_iop_roi_t *const roi_in,
+                  dt_iop_roi_t *roi_out)
+{
+  // the output scale can't be derived from the input, it has to come with the first guess
+  const float scale = roi_out->scale;
+  if(scale <= 0.0f) return 1;
+
+  // smallest values which modify_roi_in() truncates back to the input
+  roi_out->x = ceilf(roi_in->x * scale);
+  roi_out->y = ceilf(roi_in->y * scale);
+  roi_out->width = ceilf(roi_in->width * scale + .5f);
+  roi_out->height = ceilf(roi_in->height * scale + .5f);
+  return 0;
+}
+
 void distort_mask(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, const float *const in,
                   float *const out, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
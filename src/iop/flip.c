@@ -180,6 +180,34 @@ static void backtransform(const int32_t *x, int32_t *o, const dt_image_orientati
   }
 }
 
+// inverse of backtransform(), iw and ih are the output dimensions as well
+static void transform(const int32_t *x, int32_t *o, const dt_image_orientation_t orientation, int32_t iw,
+                      int32_t ih)
+{
+  if(orientation & ORIENTATION_SWAP_XY)
+  {
+    const int32_t tmp = iw;
+    iw = ih;
+    ih = tmp;
+  }
+  o[0] = x[0];
+  o[1] = x[1];
+  if(orientation & ORIENTATION_FLIP_X)
+  {
+    o[0] = iw - o[0] - 1;
+  }
+  if(orientation & ORIENTATION_FLIP_Y)
+  {
+    o[1] = ih - o[1] - 1;
+  }
+  if(orientation & ORIENTATION_SWAP_XY)
+  {
+    const int32_t tmp = o[0];
+    o[0] = o[1];
+    o[1] = tmp;
+  }
+}
+
 int distort_transform(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, float *points, size_t points_count)
 {
   // if (!self->enabled) return 2;
@@ -301,6 +329,30 @@ void modify_roi_in(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *
   roi_in->height = CLAMP(roi_in->height, 1, (int)ceilf(h) - roi_in->y);
 }
 
+// flipping maps pixels one to one, so the output region of a tile is found exactly
+int invert_roi_in(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, const dt_iop_roi_t *roi_in,
+                  dt_iop_roi_t *roi_out)
+{
+  const dt_iop_flip_data_t *d = (dt_iop_flip_data_t *)piece->data;
+  roi_out->scale = roi_in->scale;
+
+  int32_t p[2], o[2],
+      aabb[4] = { roi_in->x, roi_in->y, roi_in->x + roi_in->width - 1, roi_in->y + roi_in->height - 1 };
+  int32_t aabb_out[4] = { INT_MAX, INT_MAX, INT_MIN, INT_MIN };
+  for(int c = 0; c < 4; c++)
+  {
+    get_corner(aabb, c, p);
+    transform(p, o, d->orientation, piece->buf_out.width * roi_in->scale, piece->buf_out.height * roi_in->scale);
+    adjust_aabb(o, aabb_out);
+  }
+
+  roi_out->x = aabb_out[0];
+  roi_out->y = aabb_out[1];
+  roi_out->width = aabb_out[2] - aabb_out[0] + 1;
+  roi_out->height = aabb_out[3] - aabb_out[1] + 1;
+  return 0;
+}
+
 // 3rd (final) pass: you get this input region (may be different from what was requested above),
 // do your best to fill the output region!
 void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
@@ -391,7 +443,7 @@ void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev
 void init_presets(dt_iop_module_so_t *self)
 {
   dt_iop_flip_params_t p = (dt_iop_flip_params_t){ ORIENTATION_NONE };
-  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "BEGIN", NULL, NULL, NULL);
+  dt_database_start_transaction(darktable.db);
 
   p.orientation = ORIENTATION_NULL;
   dt_gui_presets_add_generic(_("autodetect"), self->op, self->version(), &p, sizeof(p), 1);
@@ -411,7 +463,7 @@ void init_presets(dt_iop_module_so_t *self)
   p.orientation = ORIENTATION_ROTATE_180_DEG;
   dt_gui_presets_add_generic(_("rotate by 180 degrees"), self->op, self->version(), &p, sizeof(p), 1);
 
-  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+  dt_database_release_transaction(darktable.db);
 }
 
 void reload_defaults(dt_iop_module_t *self)
@@ -19,13 +19,18 @@
 #include "config.h"
 #endif
 #include <assert.h>
+#include <float.h>
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "common/colorspaces_inline_conversions.h"
+#include "common/iop_profile.h"
+#include "common/mipmap_cache.h"
 #include "control/control.h"
 #include "develop/develop.h"
+#include "develop/imageop_math.h"
+#include "develop/pixelpipe_cache.h"
 #include "gui/accelerators.h"
 #include "gui/gtk.h"
 #include "iop/iop_api.h"
@@ -38,6 +43,40 @@ typedef struct dt_iop_gamma_params_t
   float gamma, linear;
 } dt_iop_gamma_params_t;
 
+// the over- and raw overexposure indicators of the darkroom, drawn while converting to 8 bit. they are part
+// of the hash of this piece only, so toggling them reuses the cached output of the rest of the pipe.
+typedef struct dt_iop_gamma_data_t
+{
+  int overexposed;
+  dt_dev_overexposed_colorscheme_t colorscheme;
+  float lower, upper;
+  int rawoverexposed;
+  dt_dev_rawoverexposed_mode_t raw_mode;
+  dt_dev_rawoverexposed_colorscheme_t raw_colorscheme;
+  float raw_threshold;
+} dt_iop_gamma_data_t;
+
+static const float _overexposed_colors[][2][3]
+    = { {
+          { 0.0f, 0.0f, 0.0f }, // black
+          { 1.0f, 1.0f, 1.0f }  // white
+        },
+        {
+          { 1.0f, 0.0f, 0.0f }, // red
+          { 0.0f, 0.0f, 1.0f }  // blue
+        },
+        {
+          { 0.371f, 0.434f, 0.934f }, // purple (#5f6fef)
+          { 0.512f, 0.934f, 0.371f }  // green  (#83ef5f)
+        } };
+
+static const float _rawoverexposed_colors[][3] = {
+  { 1.0f, 0.0f, 0.0f }, // red
+  { 0.0f, 1.0f, 0.0f }, // green
+  { 0.0f, 0.0f, 1.0f }, // blue
+  { 0.0f, 0.0f, 0.0f }  // black
+};
+
 const char *name()
 {
   return C_("modulename", "display encoding");
@@ -50,7 +89,7 @@ int default_group()
 
 int flags()
 {
-  return IOP_FLAGS_HIDDEN | IOP_FLAGS_ONE_INSTANCE | IOP_FLAGS_FENCE;
+  return IOP_FLAGS_HIDDEN | IOP_FLAGS_ONE_INSTANCE | IOP_FLAGS_FENCE | IOP_FLAGS_VOLATILE_COMMIT;
 }
 
 int default_colorspace(dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
@@ -190,9 +229,211 @@ static inline void false_color(float val, dt_dev_pixelpipe_display_mask_t channe
   }
 }
 
+static void _get_histogram_profile_type(dt_colorspaces_color_profile_type_t *out_type, gchar **out_filename)
+{
+  // if in gamut check use soft proof
+  if(darktable.color_profiles->histogram_type == DT_COLORSPACE_SOFTPROOF)
+  {
+    *out_type = darktable.color_profiles->softproof_type;
+    *out_filename = darktable.color_profiles->softproof_filename;
+  }
+  else if(darktable.color_profiles->histogram_type == DT_COLORSPACE_WORK)
+  {
+    dt_ioppr_get_work_profile_type(darktable.develop, out_type, out_filename);
+  }
+  else if(darktable.color_profiles->histogram_type == DT_COLORSPACE_EXPORT)
+  {
+    dt_ioppr_get_export_profile_type(darktable.develop, out_type, out_filename);
+  }
+  else
+  {
+    *out_type = darktable.color_profiles->histogram_type;
+    *out_filename = darktable.color_profiles->histogram_filename;
+  }
+}
+
+// the overexposure thresholds are meant in the histogram profile. returns the input in that profile, or NULL
+// if it is the display profile and the input can be checked as it is.
+static float *_histogram_profile_image(dt_iop_module_t *self, const float *const in,
+                                       const dt_iop_roi_t *const roi)
+{
+  dt_colorspaces_color_profile_type_t histogram_type = DT_COLORSPACE_SRGB;
+  gchar *histogram_filename = NULL;
+
+  _get_histogram_profile_type(&histogram_type, &histogram_filename);
+
+  const dt_iop_order_iccprofile_info_t *const profile_info_from
+      = dt_ioppr_add_profile_info_to_list(self->dev, darktable.color_profiles->display_type,
+                                          darktable.color_profiles->display_filename, INTENT_PERCEPTUAL);
+  const dt_iop_order_iccprofile_info_t *const profile_info_to
+      = dt_ioppr_add_profile_info_to_list(self->dev, histogram_type, histogram_filename, INTENT_PERCEPTUAL);
+
+  if(!profile_info_from || !profile_info_to)
+  {
+    fprintf(stderr, "[gamma] can't create transform profile\n");
+    return NULL;
+  }
+  if(profile_info_from == profile_info_to) return NULL;
+
+  float *const img = dt_alloc_align(64, sizeof(float) * 4 * roi->width * roi->height);
+  if(img == NULL)
+  {
+    fprintf(stderr, "[gamma] can't alloc temp image\n");
+    return NULL;
+  }
+  dt_ioppr_transform_image_colorspace_rgb(in, img, roi->width, roi->height, profile_info_from, profile_info_to,
+                                          self->op);
+  return img;
+}
+
+// the raw values at which the raw overexposure indicator marks a pixel, per cfa color
+static void _raw_thresholds(const dt_iop_gamma_data_t *const d, const dt_dev_pixelpipe_t *const pipe,
+                            unsigned int threshold[3])
+{
+  // the clipping is detected as >1.0 after white level normalization. not technical sensor clipping, but
+  // with white balance applied, so that the magenta highlights of a clipped channel are marked, too.
+  float thr = 1.0f;
+  if(pipe->dsc.temperature.enabled)
+  {
+    thr = FLT_MAX;
+    for(int k = 0; k < 3; k++) thr = fminf(thr, pipe->dsc.temperature.coeffs[k]);
+  }
+  thr *= d->raw_threshold;
+
+  for(int k = 0; k < 3; k++)
+  {
+    // it is checked on the raw input buffer, undo temperature and rawprepare
+    float chthr = thr;
+    if(pipe->dsc.temperature.enabled) chthr /= pipe->dsc.temperature.coeffs[k];
+    chthr *= pipe->dsc.rawprepare.raw_white_point - pipe->dsc.rawprepare.raw_black_level;
+    chthr += pipe->dsc.rawprepare.raw_black_level;
+    threshold[k] = (unsigned int)chthr;
+  }
+}
+
+// converts to 8 bit like the plain case of process() and marks the over- and raw overexposed pixels on the way
+static void _process_indicators(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const float *const i,
+                                uint8_t *const o, const dt_iop_roi_t *const roi_in,
+                                const dt_iop_roi_t *const roi_out)
+{
+  const dt_iop_gamma_data_t *const d = (dt_iop_gamma_data_t *)piece->data;
+  const dt_image_t *const image = &self->dev->image_storage;
+  const int ch = piece->colors;
+
+  const float lower = MAX(d->lower / 100.0f, 1e-6f);
+  const float upper = d->upper / 100.0f;
+  const float *const upper_color = _overexposed_colors[d->colorscheme][0];
+  const float *const lower_color = _overexposed_colors[d->colorscheme][1];
+  float *const hist = d->overexposed ? _histogram_profile_image(self, i, roi_out) : NULL;
+  const float *const check = hist ? hist : i;
+
+  int rawoverexposed = d->rawoverexposed;
+  const dt_dev_rawoverexposed_mode_t raw_mode = d->raw_mode;
+  const float *const raw_color = _rawoverexposed_colors[d->raw_colorscheme];
+  const float(*const cfa_colors)[3] = _rawoverexposed_colors;
+  unsigned int threshold[3] = { 0 };
+  dt_mipmap_buffer_t buf = { 0 };
+  if(rawoverexposed)
+  {
+    _raw_thresholds(d, piece->pipe, threshold);
+    dt_mipmap_cache_get(darktable.mipmap_cache, &buf, image->id, DT_MIPMAP_FULL, DT_MIPMAP_BLOCKING, 'r');
+    if(!buf.buf)
+    {
+      dt_control_log(_("failed to get raw buffer from image `%s'"), image->filename);
+      rawoverexposed = FALSE;
+    }
+  }
+  const uint16_t *const raw = (const uint16_t *)buf.buf;
+  const int raw_width = buf.width, raw_height = buf.height;
+
+  // NOT FROM THE PIPE !!!
+  const uint32_t filters = image->buf_dsc.filters;
+  const uint8_t(*const xtrans)[6] = (const uint8_t(*const)[6])image->buf_dsc.xtrans;
+  const double iop_order = self->iop_order;
+
+  // the coordinates in the raw of one row per thread
+  const size_t coordbufsize = (size_t)roi_out->width * 2;
+  float *const coordbuf
+      = rawoverexposed ? dt_alloc_align(64, coordbufsize * sizeof(float) * dt_get_num_threads()) : NULL;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(cfa_colors, ch, check, coordbuf, coordbufsize, d, filters, i, iop_order, lower, \
+                      lower_color, o, raw, raw_color, raw_height, raw_mode, raw_width, rawoverexposed, roi_in, \
+                      roi_out, threshold, upper, upper_color, xtrans) \
+  shared(self) \
+  schedule(static)
+#endif
+  for(int k = 0; k < roi_out->height; k++)
+  {
+    float *const coords = coordbuf ? coordbuf + coordbufsize * dt_get_thread_num() : NULL;
+    if(rawoverexposed)
+    {
+      for(int j = 0; j < roi_out->width; j++)
+      {
+        coords[2 * j] = (float)(roi_out->x + j) / roi_in->scale;
+        coords[2 * j + 1] = (float)(roi_out->y + k) / roi_in->scale;
+      }
+      // where did they come from?
+      dt_dev_distort_backtransform_plus(self->dev, self->dev->pipe, iop_order, DT_DEV_TRANSFORM_DIR_BACK_INCL,
+                                        coords, roi_out->width);
+    }
+
+    const size_t row = (size_t)ch * k * roi_out->width;
+    const float *in = i + row;
+    const float *hin = check + row;
+    uint8_t *out = o + row;
+    for(int j = 0; j < roi_out->width; j++, in += ch, hin += ch, out += ch)
+    {
+      float pixel[3] = { in[0], in[1], in[2] };
+
+      if(d->overexposed)
+      {
+        if(hin[0] >= upper || hin[1] >= upper || hin[2] >= upper)
+          for(int c = 0; c < 3; c++) pixel[c] = upper_color[c];
+        else if(hin[0] <= lower && hin[1] <= lower && hin[2] <= lower)
+          for(int c = 0; c < 3; c++) pixel[c] = lower_color[c];
+      }
+
+      if(rawoverexposed)
+      {
+        const int i_raw = (int)coords[2 * j];
+        const int j_raw = (int)coords[2 * j + 1];
+        if(i_raw >= 0 && j_raw >= 0 && i_raw < raw_width && j_raw < raw_height)
+        {
+          const int c = (filters == 9u) ? FCxtrans(j_raw, i_raw, NULL, xtrans) : FC(j_raw, i_raw, filters);
+          // was the raw pixel clipped?
+          if(raw[(size_t)j_raw * raw_width + i_raw] >= threshold[c])
+          {
+            switch(raw_mode)
+            {
+              case DT_DEV_RAWOVEREXPOSED_MODE_MARK_CFA:
+                for(int cc = 0; cc < 3; cc++) pixel[cc] = cfa_colors[c][cc];
+                break;
+              case DT_DEV_RAWOVEREXPOSED_MODE_MARK_SOLID:
+                for(int cc = 0; cc < 3; cc++) pixel[cc] = raw_color[cc];
+                break;
+              case DT_DEV_RAWOVEREXPOSED_MODE_FALSECOLOR:
+                pixel[c] = 0.0f;
+                break;
+            }
+          }
+        }
+      }
+
+      for(int c = 0; c < 3; c++) out[2 - c] = ((uint8_t)(CLAMP(round(255.0f * pixel[c]), 0x0, 0xff)));
+    }
+  }
+
+  dt_free_align(coordbuf);
+  dt_free_align(hist);
+  if(buf.buf) dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+}
+
 void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const i, void *const o,
              const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
+  const dt_iop_gamma_data_t *const d = (dt_iop_gamma_data_t *)piece->data;
   const int ch = piece->colors;
 
   const dt_dev_pixelpipe_display_mask_t mask_display = piece->pipe->mask_display;
@@ -272,6 +513,10 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
       }
     }
   }
+  else if(d->overexposed || d->rawoverexposed)
+  {
+    _process_indicators(self, piece, (const float *)i, (uint8_t *)o, roi_in, roi_out);
+  }
   else
   {
 #ifdef _OPENMP
@@ -291,6 +536,50 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   }
 }
 
+void commit_params(dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pixelpipe_t *pipe,
+                   dt_dev_pixelpipe_iop_t *piece)
+{
+  dt_iop_gamma_data_t *d = (dt_iop_gamma_data_t *)piece->data;
+  const dt_develop_t *dev = self->dev;
+  const dt_image_t *const image = &dev->image_storage;
+
+  // zeroed, the padding goes into the hash
+  memset(d, 0, sizeof(dt_iop_gamma_data_t));
+  if(pipe->type != DT_DEV_PIXELPIPE_FULL || !dev->gui_attached) return;
+
+  if(dev->overexposed.enabled)
+  {
+    d->overexposed = TRUE;
+    d->colorscheme = dev->overexposed.colorscheme;
+    d->lower = dev->overexposed.lower;
+    d->upper = dev->overexposed.upper;
+  }
+  // 4BAYER is not supported yet
+  if(dev->rawoverexposed.enabled && !(image->flags & DT_IMAGE_4BAYER)
+     && image->buf_dsc.datatype == TYPE_UINT16 && image->buf_dsc.filters)
+  {
+    d->rawoverexposed = TRUE;
+    d->raw_mode = dev->rawoverexposed.mode;
+    d->raw_colorscheme = dev->rawoverexposed.colorscheme;
+    d->raw_threshold = dev->rawoverexposed.threshold;
+  }
+
+  // only this piece and the output are recomputed if the indicators change, see dt_dev_reprocess_display()
+  piece->params_hash = dt_dev_pixelpipe_cache_hash_data(piece->params_hash, d, sizeof(dt_iop_gamma_data_t));
+  piece->hash = dt_dev_pixelpipe_cache_hash_data(piece->hash, d, sizeof(dt_iop_gamma_data_t));
+}
+
+void init_pipe(dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
+{
+  piece->data = calloc(1, sizeof(dt_iop_gamma_data_t));
+}
+
+void cleanup_pipe(dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
+{
+  free(piece->data);
+  piece->data = NULL;
+}
+
 void init(dt_iop_module_t *module)
 {
   // module->data = malloc(sizeof(dt_iop_gamma_data_t));
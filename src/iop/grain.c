@@ -24,6 +24,7 @@
 #include <string.h>
 
 #include "bauhaus/bauhaus.h"
+#include "common/opencl.h"
 #include "control/control.h"
 #include "develop/develop.h"
 #include "develop/imageop.h"
@@ -85,6 +86,11 @@ typedef struct dt_iop_grain_data_t
   float grain_lut[GRAIN_LUT_SIZE * GRAIN_LUT_SIZE];
 } dt_iop_grain_data_t;
 
+typedef struct dt_iop_grain_global_data_t
+{
+  int kernel_grain;
+} dt_iop_grain_global_data_t;
+
 
 int legacy_params(dt_iop_module_t *self, const void *const old_params, const int old_version, void *new_params,
                   const int new_version)
@@ -348,13 +354,15 @@ static double _perlin_2d_noise(double x,double y,uint32_t octaves,double persist
   return total;
 }*/
 
+// parametrization of octaves to match power spectrum of real grain scans, grain.cl has a copy of the amplitudes
+static const double _octave_freq[] = {0.4910, 0.9441, 1.7280};
+static const double _octave_amp[] = {0.2340, 0.7850, 1.2150};
+
 static double _simplex_2d_noise(double x, double y, uint32_t octaves, double persistance, double z)
 {
   double total = 0;
-
-  // parametrization of octaves to match power spectrum of real grain scans
-  static double f[] = {0.4910, 0.9441, 1.7280};
-  static double a[] = {0.2340, 0.7850, 1.2150};
+  const double *f = _octave_freq;
+  const double *a = _octave_amp;
 
   for(uint32_t o = 0; o < octaves; o++)
   {
@@ -422,7 +430,7 @@ const char *name()
 
 int flags()
 {
-  return IOP_FLAGS_INCLUDE_IN_STYLES | IOP_FLAGS_SUPPORTS_BLENDING;
+  return IOP_FLAGS_INCLUDE_IN_STYLES | IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_HALF_INPUT;
 }
 
 int default_group()
@@ -535,6 +543,77 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   }
 }
 
+#ifdef HAVE_OPENCL
+int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem dev_in, cl_mem dev_out,
+               const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+  dt_iop_grain_data_t *data = (dt_iop_grain_data_t *)piece->data;
+  dt_iop_grain_global_data_t *gd = (dt_iop_grain_global_data_t *)self->global_data;
+
+  cl_int err = -999;
+  cl_mem dev_perm = NULL;
+  cl_mem dev_lut = NULL;
+
+  const int devid = piece->pipe->devid;
+  const int width = roi_out->width;
+  const int height = roi_out->height;
+
+  // same set up as process(), only the grain is computed in float on the device
+  const unsigned int hash = _hash_string(piece->pipe->image.filename) % (int)fmax(roi_out->width * 0.3, 1.0);
+  const gboolean fastmode = (piece->pipe->type & DT_DEV_PIXELPIPE_FAST) == DT_DEV_PIXELPIPE_FAST;
+  const float strength = data->strength / 100.0f;
+  const double wd = fminf(piece->buf_in.width, piece->buf_in.height);
+  const double zoom = (1.0 + 8 * data->scale / 100) / 800.0;
+  const int filter = !fastmode && fabsf(roi_out->scale - 1.0f) > 0.01;
+  const float filtermul = piece->iscale / (roi_out->scale * wd);
+  const float norm = 1.0 / (roi_out->scale * wd);
+  const int roi_x = roi_out->x;
+  const int roi_y = roi_out->y;
+
+  // the image offset is large in noise space, it is wrapped by the period of the noise along x (3 * 256) in
+  // double here so that the coordinates stay precise enough in float
+  float freq[4] = { 0.0f }, offset[4] = { 0.0f };
+  for(int o = 0; o < 3; o++)
+  {
+    freq[o] = _octave_freq[o] / zoom;
+    offset[o] = fmod(hash * _octave_freq[o] / zoom, 768.0);
+  }
+
+  dev_perm = dt_opencl_copy_host_to_device_constant(devid, sizeof(perm), perm);
+  if(dev_perm == NULL) goto error;
+  dev_lut = dt_opencl_copy_host_to_device(devid, data->grain_lut, GRAIN_LUT_SIZE, GRAIN_LUT_SIZE, sizeof(float));
+  if(dev_lut == NULL) goto error;
+
+  size_t sizes[3] = { ROUNDUPWD(width), ROUNDUPHT(height), 1 };
+  dt_opencl_set_kernel_arg(devid, gd->kernel_grain, 0, sizeof(cl_mem), (void *)&dev_in);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_grain, 1, sizeof(cl_mem), (void *)&dev_out);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_grain, 2, sizeof(int), (void *)&width);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_grain, 3, sizeof(int), (void *)&height);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_grain, 4, sizeof(int), (void *)&roi_x);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_grain, 5, sizeof(int), (void *)&roi_y);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_grain, 6, sizeof(float), (void *)&norm);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_grain, 7, sizeof(cl_mem), (void *)&dev_perm);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_grain, 8, sizeof(cl_mem), (void *)&dev_lut);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_grain, 9, 4 * sizeof(float), (void *)freq);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_grain, 10, 4 * sizeof(float), (void *)offset);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_grain, 11, sizeof(float), (void *)&strength);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_grain, 12, sizeof(float), (void *)&filtermul);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_grain, 13, sizeof(int), (void *)&filter);
+  err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_grain, sizes);
+  if(err != CL_SUCCESS) goto error;
+
+  dt_opencl_release_mem_object(dev_perm);
+  dt_opencl_release_mem_object(dev_lut);
+  return TRUE;
+
+error:
+  dt_opencl_release_mem_object(dev_perm);
+  dt_opencl_release_mem_object(dev_lut);
+  dt_print(DT_DEBUG_OPENCL, "[opencl_grain] couldn't enqueue kernel! %d\n", err);
+  return FALSE;
+}
+#endif
+
 void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pixelpipe_t *pipe,
                    dt_dev_pixelpipe_iop_t *piece)
 {
@@ -574,6 +653,19 @@ void gui_update(struct dt_iop_module_t *self)
 void init_global(struct dt_iop_module_so_t *self)
 {
   _simplex_noise_init();
+
+  const int program = 34; // grain.cl, from programs.conf
+  dt_iop_grain_global_data_t *gd = (dt_iop_grain_global_data_t *)malloc(sizeof(dt_iop_grain_global_data_t));
+  self->data = gd;
+  gd->kernel_grain = dt_opencl_create_kernel(program, "grain");
+}
+
+void cleanup_global(struct dt_iop_module_so_t *self)
+{
+  dt_iop_grain_global_data_t *gd = (dt_iop_grain_global_data_t *)self->data;
+  dt_opencl_free_kernel(gd->kernel_grain);
+  free(self->data);
+  self->data = NULL;
 }
 
 void gui_init(struct dt_iop_module_t *self)
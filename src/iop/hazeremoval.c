@@ -69,9 +69,20 @@ typedef struct dt_iop_hazeremoval_params_t
   float distance; // $MIN:  0.0 $MAX: 1.0 $DEFAULT: 0.2
 } dt_iop_hazeremoval_params_t;
 
-// types  dt_iop_hazeremoval_params_t and dt_iop_hazeremoval_data_t are
-// equal, thus no commit_params function needs to be implemented
-typedef dt_iop_hazeremoval_params_t dt_iop_hazeremoval_data_t;
+// the estimation of the haze only depends on the input, so it is kept for the
+// next run and moving the sliders only redoes the final compositing
+typedef struct dt_iop_hazeremoval_data_t
+{
+  dt_iop_hazeremoval_params_t params;
+  // ambient light and maximal depth of the input with hash ambient_hash
+  uint64_t ambient_hash;
+  rgb_pixel A0;
+  float distance_max;
+  // guided-filtered haze map for positive [0] and negative [1] strengths, see transmission_estimate()
+  uint64_t map_hash[2];
+  float *map[2];
+  size_t map_size[2];
+} dt_iop_hazeremoval_data_t;
 
 typedef struct dt_iop_hazeremoval_gui_data_t
 {
@@ -140,11 +151,22 @@ void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pi
 
 void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
+  dt_iop_hazeremoval_data_t *d = piece->data;
+  dt_free_align(d->map[0]);
+  dt_free_align(d->map[1]);
   free(piece->data);
   piece->data = NULL;
 }
 
 
+void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pixelpipe_t *pipe,
+                   dt_dev_pixelpipe_iop_t *piece)
+{
+  dt_iop_hazeremoval_data_t *d = piece->data;
+  memcpy(&d->params, p1, sizeof(dt_iop_hazeremoval_params_t));
+}
+
+
 void init_global(dt_iop_module_so_t *self)
 {
   dt_iop_hazeremoval_global_data_t *gd = malloc(sizeof(*gd));
@@ -475,25 +497,102 @@ static void dark_channel(const const_rgb_image img1, const gray_image img2, cons
 }
 
 
-// calculate the transition map
-static void transition_map(const const_rgb_image img1, const gray_image img2, const int w, const float *const A0,
-                           const float strength)
+// calculate the haze map the transition map is made of. the transition map is
+//   guided_filter(box_min(box_max(1 - strength * m)))
+// with m the dark channel of the image relative to the ambient light. the box filters turn around with the
+// sign of strength and the guided filter is linear, so this is 1 - strength * img2 with
+//   img2 = guided_filter(box_max(box_min(m))) for strength >= 0,
+//   img2 = guided_filter(box_min(box_max(m))) for strength < 0,
+// which does not depend on strength.
+static void transmission_estimate(const const_rgb_image img1, const gray_image img2, const int w1, const int w2,
+                                  const float eps, const float *const A0, const int negative)
 {
   const size_t size = (size_t)img1.height * img1.width;
+  gray_image m = new_gray_image(img1.width, img1.height);
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(A0, img1, img2, size, strength) \
+  dt_omp_firstprivate(A0, img1, m, size) \
   schedule(static)
 #endif
   for(size_t i = 0; i < size; i++)
   {
     const float *pixel = img1.data + i * img1.stride;
-    float m = pixel[0] / A0[0];
-    m = fminf(pixel[1] / A0[1], m);
-    m = fminf(pixel[2] / A0[2], m);
-    img2.data[i] = 1.f - m * strength;
+    float v = pixel[0] / A0[0];
+    v = fminf(pixel[1] / A0[1], v);
+    v = fminf(pixel[2] / A0[2], v);
+    m.data[i] = v;
+  }
+  if(negative)
+  {
+    box_max(m, m, w1);
+    box_min(m, m, w1);
+  }
+  else
+  {
+    box_min(m, m, w1);
+    box_max(m, m, w1);
+  }
+  // apply guided filter with no clipping
+  guided_filter(img1.data, m.data, img2.data, img1.width, img1.height, img1.stride, w2, eps, 1.f, -FLT_MAX,
+                FLT_MAX);
+  free_gray_image(&m);
+}
+
+
+// average over 2x2 pixels, for the estimation on preview pipes
+static rgb_image downsample_2x(const const_rgb_image img)
+{
+  const int width = (img.width + 1) / 2;
+  const int height = (img.height + 1) / 2;
+  const int stride = img.stride;
+  rgb_image out = { dt_alloc_align(64, sizeof(float) * stride * width * height), width, height, stride };
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(img, out, width, height, stride) \
+  schedule(static)
+#endif
+  for(int j = 0; j < height; j++)
+    for(int i = 0; i < width; i++)
+    {
+      const int j1 = min_i(2 * j + 1, img.height - 1);
+      const int i1 = min_i(2 * i + 1, img.width - 1);
+      const float *p00 = img.data + ((size_t)2 * j * img.width + 2 * i) * stride;
+      const float *p01 = img.data + ((size_t)2 * j * img.width + i1) * stride;
+      const float *p10 = img.data + ((size_t)j1 * img.width + 2 * i) * stride;
+      const float *p11 = img.data + ((size_t)j1 * img.width + i1) * stride;
+      float *o = out.data + ((size_t)j * width + i) * stride;
+      for(int c = 0; c < stride; c++) o[c] = 0.25f * (p00[c] + p01[c] + p10[c] + p11[c]);
+    }
+  return out;
+}
+
+
+// bilinear upsampling of a map computed by downsample_2x() sized images
+static void upsample_2x(const gray_image img1, const gray_image img2)
+{
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(img1, img2) \
+  schedule(static)
+#endif
+  for(int j = 0; j < img2.height; j++)
+  {
+    const float fy = CLAMPS(0.5f * j - 0.25f, 0.f, img1.height - 1);
+    const int y0 = min_i((int)fy, max_i(img1.height - 2, 0));
+    const int y1 = min_i(y0 + 1, img1.height - 1);
+    const float wy = fy - y0;
+    for(int i = 0; i < img2.width; i++)
+    {
+      const float fx = CLAMPS(0.5f * i - 0.25f, 0.f, img1.width - 1);
+      const int x0 = min_i((int)fx, max_i(img1.width - 2, 0));
+      const int x1 = min_i(x0 + 1, img1.width - 1);
+      const float wx = fx - x0;
+      const float *r0 = img1.data + (size_t)y0 * img1.width;
+      const float *r1 = img1.data + (size_t)y1 * img1.width;
+      img2.data[(size_t)j * img2.width + i]
+          = (1.f - wy) * ((1.f - wx) * r0[x0] + wx * r0[x1]) + wy * ((1.f - wx) * r1[x0] + wx * r1[x1]);
+    }
   }
-  box_max(img2, img2, w);
 }
 
 
@@ -626,26 +725,58 @@ static float ambient_light(const const_rgb_image img, int w1, rgb_pixel *pA0)
 }
 
 
+// hash of the input of the module, the haze estimate is kept as long as it does not change
+static uint64_t input_hash(dt_dev_pixelpipe_iop_t *piece, const dt_iop_roi_t *const roi_in)
+{
+  return dt_dev_pixelpipe_cache_hash(piece->pipe->image.id, roi_in, piece->pipe,
+                                     g_list_index(piece->pipe->nodes, piece));
+}
+
+
+// the haze map depends on the ambient light as well, mix it into the hash of the input (djb2)
+static uint64_t map_hash(uint64_t hash, const float *const A0, const int negative)
+{
+  const char *str = (const char *)A0;
+  for(size_t i = 0; i < 3 * sizeof(float); i++) hash = ((hash << 5) + hash) ^ str[i];
+  return ((hash << 5) + hash) ^ negative;
+}
+
+
+// preview pipes estimate the haze on the input downsampled by 2, with half the window sizes
+static const_rgb_image estimation_image(const const_rgb_image img_in, const int downsample, rgb_image *small)
+{
+  if(!downsample) return img_in;
+  if(!small->data) *small = downsample_2x(img_in);
+  return (const_rgb_image){ small->data, small->width, small->height, small->stride };
+}
+
+
 void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
              void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
   dt_iop_hazeremoval_gui_data_t *g = self->gui_data;
-  dt_iop_hazeremoval_params_t *d = piece->data;
+  dt_iop_hazeremoval_data_t *d = piece->data;
 
   const int ch = piece->colors;
   const int width = roi_in->width;
   const int height = roi_in->height;
   const size_t size = (size_t)width * height;
-  const int w1 = 6; // window size (positive integer) for determining the dark channel and the transition map
-  const int w2 = 9; // window size (positive integer) for the guided filter
+  const int downsample = (piece->pipe->type & DT_DEV_PIXELPIPE_PREVIEW) == DT_DEV_PIXELPIPE_PREVIEW
+                         && width > 1 && height > 1;
+  // window size (positive integer) for determining the dark channel and the transition map
+  const int w1 = downsample ? 3 : 6;
+  // window size (positive integer) for the guided filter
+  const int w2 = downsample ? 5 : 9;
 
   // module parameters
-  const float strength = d->strength; // strength of haze removal
-  const float distance = d->distance; // maximal distance from camera to remove haze
-  const float eps = sqrtf(0.025f);    // regularization parameter for guided filter
+  const float strength = d->params.strength; // strength of haze removal
+  const float distance = d->params.distance; // maximal distance from camera to remove haze
+  const float eps = sqrtf(0.025f);           // regularization parameter for guided filter
 
   const const_rgb_image img_in = (const_rgb_image){ ivoid, width, height, ch };
   const rgb_image img_out = (rgb_image){ ovoid, width, height, ch };
+  rgb_image img_small = (rgb_image){ NULL, 0, 0, ch };
+  const uint64_t in_hash = input_hash(piece, roi_in);
 
   // estimate diffusive ambient light and image depth
   rgb_pixel A0;
@@ -682,8 +813,19 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
     distance_max = g->distance_max;
     dt_pthread_mutex_unlock(&g->lock);
   }
-  // In all other cases we calculate distance_max and A0 here.
-  if(isnan(distance_max)) distance_max = ambient_light(img_in, w1, &A0);
+  // In all other cases we calculate distance_max and A0 here, unless the input did not change since the last run.
+  if(isnan(distance_max))
+  {
+    if(in_hash == 0 || in_hash != d->ambient_hash)
+    {
+      d->distance_max = ambient_light(estimation_image(img_in, downsample, &img_small), w1, &d->A0);
+      d->ambient_hash = in_hash;
+    }
+    A0[0] = d->A0[0];
+    A0[1] = d->A0[1];
+    A0[2] = d->A0[2];
+    distance_max = d->distance_max;
+  }
   // PREVIEW pixelpipe stores values.
   if(self->dev->gui_attached && g && (piece->pipe->type & DT_DEV_PIXELPIPE_PREVIEW) == DT_DEV_PIXELPIPE_PREVIEW)
   {
@@ -697,30 +839,45 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
     dt_pthread_mutex_unlock(&g->lock);
   }
 
-  // calculate the transition map
-  gray_image trans_map = new_gray_image(width, height);
-  transition_map(img_in, trans_map, w1, A0, strength);
-
-  // refine the transition map
-  box_min(trans_map, trans_map, w1);
-  gray_image trans_map_filtered = new_gray_image(width, height);
-  // apply guided filter with no clipping
-  guided_filter(img_in.data, trans_map.data, trans_map_filtered.data, width, height, ch, w2, eps, 1.f, -FLT_MAX,
-                FLT_MAX);
+  // the haze map of the sign of strength, redone only for a new input or ambient light
+  const int negative = strength < 0.f;
+  const uint64_t mhash = map_hash(in_hash, A0, negative);
+  if(strength != 0.f && (in_hash == 0 || mhash != d->map_hash[negative] || d->map_size[negative] != size))
+  {
+    if(d->map_size[negative] != size)
+    {
+      dt_free_align(d->map[negative]);
+      d->map[negative] = dt_alloc_align(64, sizeof(float) * size);
+      d->map_size[negative] = size;
+    }
+    const gray_image map = (gray_image){ d->map[negative], width, height };
+    if(downsample)
+    {
+      const const_rgb_image img_est = estimation_image(img_in, downsample, &img_small);
+      gray_image map_small = new_gray_image(img_est.width, img_est.height);
+      transmission_estimate(img_est, map_small, w1, w2, eps, A0, negative);
+      upsample_2x(map_small, map);
+      free_gray_image(&map_small);
+    }
+    else
+      transmission_estimate(img_in, map, w1, w2, eps, A0, negative);
+    d->map_hash[negative] = mhash;
+  }
+  dt_free_align(img_small.data);
 
   // finally, calculate the haze-free image
   const float t_min
       = fminf(fmaxf(expf(-distance * distance_max), 1.f / 1024), 1.f); // minimum allowed value for transition map
   const float *const c_A0 = A0;
-  const gray_image c_trans_map_filtered = trans_map_filtered;
+  const float *const c_map = d->map[negative];
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(c_A0, c_trans_map_filtered, img_in, img_out, size, t_min) \
+  dt_omp_firstprivate(c_A0, c_map, img_in, img_out, size, strength, t_min) \
   schedule(static)
 #endif
   for(size_t i = 0; i < size; i++)
   {
-    float t = fmaxf(c_trans_map_filtered.data[i], t_min);
+    const float t = strength == 0.f ? 1.f : fmaxf(1.f - strength * c_map[i], t_min);
     const float *pixel_in = img_in.data + i * img_in.stride;
     float *pixel_out = img_out.data + i * img_out.stride;
     pixel_out[0] = (pixel_in[0] - c_A0[0]) / t + c_A0[0];
@@ -728,9 +885,6 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
     pixel_out[2] = (pixel_in[2] - c_A0[2]) / t + c_A0[2];
   }
 
-  free_gray_image(&trans_map);
-  free_gray_image(&trans_map_filtered);
-
   if(piece->pipe->mask_display & DT_DEV_PIXELPIPE_DISPLAY_MASK)
     dt_iop_alpha_copy(ivoid, ovoid, roi_out->width, roi_out->height);
 }
@@ -885,7 +1039,7 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
                const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
   dt_iop_hazeremoval_gui_data_t *g = self->gui_data;
-  dt_iop_hazeremoval_params_t *d = piece->data;
+  dt_iop_hazeremoval_data_t *d = piece->data;
 
   const int ch = piece->colors;
   const int devid = piece->pipe->devid;
@@ -895,9 +1049,10 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
   const int w2 = 9; // window size (positive integer) for the guided filter
 
   // module parameters
-  const float strength = d->strength; // strength of haze removal
-  const float distance = d->distance; // maximal distance from camera to remove haze
-  const float eps = sqrtf(0.025f);    // regularization parameter for guided filter
+  const float strength = d->params.strength; // strength of haze removal
+  const float distance = d->params.distance; // maximal distance from camera to remove haze
+  const float eps = sqrtf(0.025f);           // regularization parameter for guided filter
+  const uint64_t in_hash = input_hash(piece, roi_in);
 
   // estimate diffusive ambient light and image depth
   rgb_pixel A0;
@@ -934,8 +1089,19 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
     distance_max = g->distance_max;
     dt_pthread_mutex_unlock(&g->lock);
   }
-  // In all other cases we calculate distance_max and A0 here.
-  if(isnan(distance_max)) distance_max = ambient_light_cl(self, devid, img_in, w1, &A0);
+  // In all other cases we calculate distance_max and A0 here, unless the input did not change since the last run.
+  if(isnan(distance_max))
+  {
+    if(in_hash == 0 || in_hash != d->ambient_hash)
+    {
+      d->distance_max = ambient_light_cl(self, devid, img_in, w1, &d->A0);
+      d->ambient_hash = in_hash;
+    }
+    A0[0] = d->A0[0];
+    A0[1] = d->A0[1];
+    A0[2] = d->A0[2];
+    distance_max = d->distance_max;
+  }
   // PREVIEW pixelpipe stores values.
   if(self->dev->gui_attached && g && (piece->pipe->type & DT_DEV_PIXELPIPE_PREVIEW) == DT_DEV_PIXELPIPE_PREVIEW)
   {
@@ -88,7 +88,7 @@ int default_group()
 
 int flags()
 {
-  return IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_ONE_INSTANCE;
+  return IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_ONE_INSTANCE | IOP_FLAGS_PIPE_INDEPENDENT;
 }
 
 int default_colorspace(dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
@@ -972,6 +972,36 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   if(piece->pipe->mask_display & DT_DEV_PIXELPIPE_DISPLAY_MASK) dt_iop_alpha_copy(ivoid, ovoid, roi_out->width, roi_out->height);
 }
 
+// the raw mosaic is processed in bands of rows only when clipping
+int process_rows_border(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece)
+{
+  const dt_iop_highlights_data_t *const data = (dt_iop_highlights_data_t *)piece->data;
+  return data->mode == DT_IOP_HIGHLIGHTS_CLIP ? 0 : -1;
+}
+
+void process_rows_prepare(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece)
+{
+  const float m = fmaxf(fmaxf(piece->pipe->dsc.processed_maximum[0], piece->pipe->dsc.processed_maximum[1]),
+                        piece->pipe->dsc.processed_maximum[2]);
+  for(int k = 0; k < 3; k++) piece->pipe->dsc.processed_maximum[k] = m;
+}
+
+void process_rows(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
+                  float *const out, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out,
+                  const int y, const int rows)
+{
+  const dt_iop_highlights_data_t *const data = (dt_iop_highlights_data_t *)piece->data;
+  const float *const in = (const float *const)ivoid;
+  const float clip = data->clip * fminf(piece->dsc_in.processed_maximum[0],
+                                        fminf(piece->dsc_in.processed_maximum[1], piece->dsc_in.processed_maximum[2]));
+
+  const size_t end = (size_t)(y + rows) * roi_out->width;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+  for(size_t k = (size_t)y * roi_out->width; k < end; k++) out[k] = MIN(clip, in[k]);
+}
+
 void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pixelpipe_t *pipe,
                    dt_dev_pixelpipe_iop_t *piece)
 {
@@ -62,6 +62,11 @@ typedef struct dt_iop_hotpixels_data_t
   gboolean markfixed;
 } dt_iop_hotpixels_data_t;
 
+typedef struct dt_iop_hotpixels_global_data_t
+{
+  int kernel_hotpixels_bayer;
+} dt_iop_hotpixels_global_data_t;
+
 
 const char *name()
 {
@@ -97,17 +102,9 @@ void connect_key_accels(dt_iop_module_t *self)
   dt_accel_connect_slider_iop(self, "strength", GTK_WIDGET(g->strength));
 }
 
-/* Detect hot sensor pixels based on the 4 surrounding sites. Pixels
- * having 3 or 4 (depending on permissive setting) surrounding pixels that
- * than value*multiplier are considered "hot", and are replaced by the maximum of
- * the neighbour pixels. The permissive variant allows for
- * correcting pairs of hot pixels in adjacent sites. Replacement using
- * the maximum produces fewer artifacts when inadvertently replacing
- * non-hot pixels.
- * This is the Bayer sensor variant. */
-static int process_bayer(const dt_iop_hotpixels_data_t *data,
-                         const void *const ivoid, void *const ovoid,
-                         const dt_iop_roi_t *const roi_out)
+static int process_bayer_rows(const dt_iop_hotpixels_data_t *data,
+                              const void *const ivoid, void *const ovoid,
+                              const dt_iop_roi_t *const roi_out, const int row0, const int row1)
 {
   const float threshold = data->threshold;
   const float multiplier = data->multiplier;
@@ -117,14 +114,7 @@ static int process_bayer(const dt_iop_hotpixels_data_t *data,
   const int widthx2 = width * 2;
   int fixed = 0;
 
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(ivoid, markfixed, min_neighbours, multiplier, ovoid, \
-                      roi_out, threshold, width, widthx2) \
-  reduction(+ : fixed) \
-  schedule(static)
-#endif
-  for(int row = 2; row < roi_out->height - 2; row++)
+  for(int row = MAX(row0, 2); row < MIN(row1, roi_out->height - 2); row++)
   {
     const float *in = (float *)ivoid + (size_t)width * row + 2;
     float *out = (float *)ovoid + (size_t)width * row + 2;
@@ -165,14 +155,39 @@ static int process_bayer(const dt_iop_hotpixels_data_t *data,
   return fixed;
 }
 
-/* X-Trans sensor equivalent of process_bayer(). */
-static int process_xtrans(const dt_iop_hotpixels_data_t *data,
-                          const void *const ivoid, void *const ovoid,
-                          const dt_iop_roi_t *const roi_out, const uint8_t (*const xtrans)[6])
+/* Detect hot sensor pixels based on the 4 surrounding sites. Pixels
+ * having 3 or 4 (depending on permissive setting) surrounding pixels that
+ * than value*multiplier are considered "hot", and are replaced by the maximum of
+ * the neighbour pixels. The permissive variant allows for
+ * correcting pairs of hot pixels in adjacent sites. Replacement using
+ * the maximum produces fewer artifacts when inadvertently replacing
+ * non-hot pixels.
+ * This is the Bayer sensor variant. */
+static int process_bayer(const dt_iop_hotpixels_data_t *data,
+                         const void *const ivoid, void *const ovoid,
+                         const dt_iop_roi_t *const roi_out)
+{
+  int fixed = 0;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(data, ivoid, ovoid, roi_out) \
+  reduction(+ : fixed) \
+  schedule(static)
+#endif
+  for(int row = 2; row < roi_out->height - 2; row++)
+  {
+    fixed += process_bayer_rows(data, ivoid, ovoid, roi_out, row, row + 1);
+  }
+
+  return fixed;
+}
+
+// for each cell of sensor array, pre-calculate, a list of the x/y
+// offsets of the four radially nearest pixels of the same color
+static void xtrans_offsets(int offsets[6][6][4][2], const dt_iop_roi_t *const roi_out,
+                           const uint8_t (*const xtrans)[6])
 {
-  // for each cell of sensor array, pre-calculate, a list of the x/y
-  // offsets of the four radially nearest pixels of the same color
-  int offsets[6][6][4][2];
   // increasing offsets from pixel to find nearest like-colored pixels
   const int search[20][2] = { { -1, 0 },
                               { 1, 0 },
@@ -210,7 +225,13 @@ static int process_xtrans(const dt_iop_hotpixels_data_t *data,
       }
     }
   }
+}
 
+static int process_xtrans_rows(const dt_iop_hotpixels_data_t *data,
+                               const void *const ivoid, void *const ovoid,
+                               const dt_iop_roi_t *const roi_out, const uint8_t (*const xtrans)[6],
+                               const int (*const offsets)[6][4][2], const int row0, const int row1)
+{
   const float threshold = data->threshold;
   const float multiplier = data->multiplier;
   const gboolean markfixed = data->markfixed;
@@ -218,15 +239,7 @@ static int process_xtrans(const dt_iop_hotpixels_data_t *data,
   const int width = roi_out->width;
   int fixed = 0;
 
-#ifdef _OPENMP
-#pragma omp parallel for default(none) \
-  dt_omp_firstprivate(ivoid, markfixed, min_neighbours, multiplier, ovoid, \
-                      roi_out, threshold, xtrans, width) \
-  shared(offsets) \
-  reduction(+ : fixed) \
-  schedule(static)
-#endif
-  for(int row = 2; row < roi_out->height - 2; row++)
+  for(int row = MAX(row0, 2); row < MIN(row1, roi_out->height - 2); row++)
   {
     const float *in = (float *)ivoid + (size_t)width * row + 2;
     float *out = (float *)ovoid + (size_t)width * row + 2;
@@ -279,6 +292,30 @@ static int process_xtrans(const dt_iop_hotpixels_data_t *data,
   return fixed;
 }
 
+/* X-Trans sensor equivalent of process_bayer(). */
+static int process_xtrans(const dt_iop_hotpixels_data_t *data,
+                          const void *const ivoid, void *const ovoid,
+                          const dt_iop_roi_t *const roi_out, const uint8_t (*const xtrans)[6])
+{
+  int offsets[6][6][4][2];
+  xtrans_offsets(offsets, roi_out, xtrans);
+  const int (*const c_offsets)[6][4][2] = (const int (*const)[6][4][2])offsets;
+  int fixed = 0;
+
+#ifdef _OPENMP
+#pragma omp parallel for default(none) \
+  dt_omp_firstprivate(c_offsets, data, ivoid, ovoid, roi_out, xtrans) \
+  reduction(+ : fixed) \
+  schedule(static)
+#endif
+  for(int row = 2; row < roi_out->height - 2; row++)
+  {
+    fixed += process_xtrans_rows(data, ivoid, ovoid, roi_out, xtrans, c_offsets, row, row + 1);
+  }
+
+  return fixed;
+}
+
 void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
              void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
@@ -304,6 +341,85 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   }
 }
 
+// hot pixels are detected from the pixels two rows above and below
+int process_rows_border(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece)
+{
+  return 2;
+}
+
+void process_rows(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
+                  float *const out, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out,
+                  const int y, const int rows)
+{
+  const dt_iop_hotpixels_data_t *data = (dt_iop_hotpixels_data_t *)piece->data;
+  const size_t offset = (size_t)y * roi_out->width;
+  memcpy(out + offset, (const float *)ivoid + offset, sizeof(float) * roi_out->width * rows);
+
+  // the fixed pixels are only counted for the darkroom, which never runs bands
+  if(piece->dsc_in.filters == 9u)
+  {
+    const uint8_t(*const xtrans)[6] = (const uint8_t(*const)[6])piece->dsc_in.xtrans;
+    int offsets[6][6][4][2];
+    xtrans_offsets(offsets, roi_out, xtrans);
+    process_xtrans_rows(data, ivoid, out, roi_out, xtrans, (const int (*const)[6][4][2])offsets, y, y + rows);
+  }
+  else
+    process_bayer_rows(data, ivoid, out, roi_out, y, y + rows);
+}
+
+#ifdef HAVE_OPENCL
+int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem dev_in, cl_mem dev_out,
+               const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+  dt_iop_hotpixels_gui_data_t *g = (dt_iop_hotpixels_gui_data_t *)self->gui_data;
+  const dt_iop_hotpixels_data_t *data = (dt_iop_hotpixels_data_t *)piece->data;
+  const dt_iop_hotpixels_global_data_t *gd = (dt_iop_hotpixels_global_data_t *)self->global_data;
+
+  const int devid = piece->pipe->devid;
+  const int width = roi_out->width;
+  const int height = roi_out->height;
+  const int min_neighbours = data->permissive ? 3 : 4;
+  // the number of fixed pixels is only shown in the darkroom
+  const int count = (g != NULL && self->dev->gui_attached
+                     && (piece->pipe->type & DT_DEV_PIXELPIPE_FULL) == DT_DEV_PIXELPIPE_FULL);
+  int fixed = 0;
+  cl_int err = -999;
+
+  cl_mem dev_fixed = dt_opencl_alloc_device_buffer(devid, sizeof(int));
+  if(dev_fixed == NULL) goto error;
+  err = dt_opencl_write_buffer_to_device(devid, &fixed, dev_fixed, 0, sizeof(int), CL_TRUE);
+  if(err != CL_SUCCESS) goto error;
+
+  size_t sizes[] = { ROUNDUPWD(width), ROUNDUPHT(height), 1 };
+  dt_opencl_set_kernel_arg(devid, gd->kernel_hotpixels_bayer, 0, sizeof(cl_mem), (void *)&dev_in);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_hotpixels_bayer, 1, sizeof(cl_mem), (void *)&dev_out);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_hotpixels_bayer, 2, sizeof(int), (void *)&width);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_hotpixels_bayer, 3, sizeof(int), (void *)&height);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_hotpixels_bayer, 4, sizeof(float), (void *)&data->threshold);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_hotpixels_bayer, 5, sizeof(float), (void *)&data->multiplier);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_hotpixels_bayer, 6, sizeof(int), (void *)&min_neighbours);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_hotpixels_bayer, 7, sizeof(cl_mem), (void *)&dev_fixed);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_hotpixels_bayer, 8, sizeof(int), (void *)&count);
+  err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_hotpixels_bayer, sizes);
+  if(err != CL_SUCCESS) goto error;
+
+  if(count)
+  {
+    err = dt_opencl_read_buffer_from_device(devid, &fixed, dev_fixed, 0, sizeof(int), CL_TRUE);
+    if(err != CL_SUCCESS) goto error;
+    g->pixels_fixed = fixed;
+  }
+
+  dt_opencl_release_mem_object(dev_fixed);
+  return TRUE;
+
+error:
+  dt_opencl_release_mem_object(dev_fixed);
+  dt_print(DT_DEBUG_OPENCL, "[opencl_hotpixels] couldn't enqueue kernel! %d\n", err);
+  return FALSE;
+}
+#endif
+
 void reload_defaults(dt_iop_module_t *module)
 {
   // we might be called from presets update infrastructure => there is no image
@@ -325,6 +441,29 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *params, dt_dev
   d->markfixed = p->markfixed && ((pipe->type & DT_DEV_PIXELPIPE_EXPORT) != DT_DEV_PIXELPIPE_EXPORT)
     && ((pipe->type & DT_DEV_PIXELPIPE_THUMBNAIL) != DT_DEV_PIXELPIPE_THUMBNAIL);
   if(!(dt_image_is_raw(&pipe->image)) || p->strength == 0.0) piece->enabled = 0;
+
+  // marking fixed pixels and x-trans sensors are only done on the cpu
+  piece->process_cl_ready = (piece->process_cl_ready && d->filters != 9u && !d->markfixed);
+#ifdef HAVE_OPENCL
+  piece->process_cl_ready = (piece->process_cl_ready && !(darktable.opencl->avoid_atomics));
+#endif
+}
+
+void init_global(dt_iop_module_so_t *self)
+{
+  const int program = 2; // basic.cl, from programs.conf
+  dt_iop_hotpixels_global_data_t *gd
+      = (dt_iop_hotpixels_global_data_t *)malloc(sizeof(dt_iop_hotpixels_global_data_t));
+  self->data = gd;
+  gd->kernel_hotpixels_bayer = dt_opencl_create_kernel(program, "hotpixels_bayer");
+}
+
+void cleanup_global(dt_iop_module_so_t *self)
+{
+  dt_iop_hotpixels_global_data_t *gd = (dt_iop_hotpixels_global_data_t *)self->data;
+  dt_opencl_free_kernel(gd->kernel_hotpixels_bayer);
+  free(self->data);
+  self->data = NULL;
 }
 
 void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
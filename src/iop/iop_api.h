@@ -167,6 +167,10 @@ void modify_roi_in(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *
                    const struct dt_iop_roi_t *roi_out, struct dt_iop_roi_t *roi_in);
 void modify_roi_out(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                     struct dt_iop_roi_t *roi_out, const struct dt_iop_roi_t *roi_in);
+/** optional: the inverse of modify_roi_in(), used by tiling to find the output region of a tile.
+  * roi_out comes in with the scale and a first guess. returns non-zero if it can't be inverted. */
+int invert_roi_in(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                  const struct dt_iop_roi_t *roi_in, struct dt_iop_roi_t *roi_out);
 int legacy_params(struct dt_iop_module_t *self, const void *const old_params, const int old_version,
                   void *new_params, const int new_version);
 // allow to select a shape inside an iop
@@ -186,6 +190,29 @@ void process_tiling(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t
                     void *const o, const struct dt_iop_roi_t *const roi_in,
                     const struct dt_iop_roi_t *const roi_out, const int bpp);
 
+/** optional pointwise variant of process(), for modules where each output pixel only depends on the same
+ * input pixel. processes npixels pixels of 4 floats, in and out may be the same buffer. the pipe calls it
+ * for small blocks from several threads at once, to run adjacent pointwise modules in one pass. */
+void process_pointwise(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
+                       const float *const in, float *const out, const size_t npixels);
+/** optional setup for process_pointwise(), called once per run before the blocks are processed.
+ * does what process() would do besides touching pixels, e.g. updating piece->pipe->dsc. */
+void process_pointwise_prepare(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece);
+
+/** optional band variant of process() for the modules working on the raw mosaic. computes the rows
+ * [y, y + rows) of roi_out, in and out are addressed like full buffers of roi_in and roi_out but only the
+ * rows of the band plus process_rows_border() rows above and below it are there to be read. the input is
+ * described by piece->dsc_in. the pipe calls it for bands from several threads at once, to run adjacent raw
+ * modules in one pass. */
+void process_rows(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, const void *const in,
+                  float *const out, const struct dt_iop_roi_t *const roi_in,
+                  const struct dt_iop_roi_t *const roi_out, const int y, const int rows);
+/** optional, number of input rows around a band process_rows() reads, 0 if not provided.
+ * -1 if process_rows() can't be used with the current parameters. */
+int process_rows_border(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece);
+/** optional setup for process_rows(), same as process_pointwise_prepare(). */
+void process_rows_prepare(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece);
+
 #if defined(__SSE__)
 /** a variant process(), that can contain SSE2 intrinsics. */
 /** can be provided by each IOP. */
@@ -194,6 +221,20 @@ void process_sse2(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *p
                   const struct dt_iop_roi_t *const roi_out);
 #endif
 
+/** variants of process() with kernels for wider vector units, built from <name>_avx2.c / <name>_avx512.c with
+ * their own instruction set flags, see iop_isa_sources() in src/iop/CMakeLists.txt. only called when the cpu has
+ * the instructions, so the rest of the module has to stay at the baseline. */
+#ifdef HAVE_AVX2_CODEPATH
+void process_avx2(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, const void *const i,
+                  void *const o, const struct dt_iop_roi_t *const roi_in,
+                  const struct dt_iop_roi_t *const roi_out);
+#endif
+#ifdef HAVE_AVX512_CODEPATH
+void process_avx512(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, const void *const i,
+                    void *const o, const struct dt_iop_roi_t *const roi_in,
+                    const struct dt_iop_roi_t *const roi_out);
+#endif
+
 #ifdef HAVE_OPENCL
 /** the opencl equivalent of process(). */
 int process_cl(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, cl_mem dev_in,
@@ -126,8 +126,29 @@ typedef struct dt_iop_lensfun_global_data_t
   int kernel_lens_vignette;
 } dt_iop_lensfun_global_data_t;
 
+// side of the square tiles of the coordinate map cached on the piece
+#define LENS_MAP_TILE 128
+// at most ~100 MB of coordinates per piece, larger regions are computed row by row as before
+#define LENS_MAP_MAX_TILES 256
+
+// lensfun coordinates of the interactive pipes, kept until the parameters or the scale change. panning and
+// changes to later modules then don't recompute the distortion.
+typedef struct dt_iop_lensfun_map_t
+{
+  dt_pthread_mutex_t lock;
+  // tile index -> 6 floats (x, y for r, g, b) per pixel of a LENS_MAP_TILE square, see _lens_map_key()
+  GHashTable *tiles;
+  // size of the image the tiles were computed for
+  float orig_w, orig_h;
+  // full size modifier for distort_transform() and distort_backtransform()
+  lfModifier *points;
+  int points_flags;
+  float points_w, points_h;
+} dt_iop_lensfun_map_t;
+
 typedef struct dt_iop_lensfun_data_t
 {
+  dt_iop_lensfun_map_t *map;
   lfLens *lens;
   int modify_flags;
   int inverse;
@@ -387,6 +408,103 @@ static lfModifier * get_modifier(int *mods_done, int w, int h, const dt_iop_lens
   return mod;
 }
 
+static gpointer _lens_map_key(const int tx, const int ty)
+{
+  return GUINT_TO_POINTER(((guint)(ty + 32768) << 16) | (guint)(tx + 32768));
+}
+
+static void _lens_map_flush(dt_iop_lensfun_map_t *map)
+{
+  g_hash_table_remove_all(map->tiles);
+  map->orig_w = map->orig_h = 0.0f;
+  delete map->points;
+  map->points = NULL;
+}
+
+static inline int _lens_map_floor(const int v)
+{
+  return (v >= 0) ? v / LENS_MAP_TILE : -((-v + LENS_MAP_TILE - 1) / LENS_MAP_TILE);
+}
+
+// the map to use for roi at the given image size, or NULL to compute the coordinates of each row directly.
+// only interactive pipes get one, an export sees every coordinate once.
+static dt_iop_lensfun_map_t *_lens_map(const dt_dev_pixelpipe_iop_t *piece, const dt_iop_roi_t *const roi,
+                                       const float orig_w, const float orig_h)
+{
+  const dt_iop_lensfun_data_t *const d = (dt_iop_lensfun_data_t *)piece->data;
+  dt_iop_lensfun_map_t *map = d->map;
+  if(!map) return NULL;
+  if(!(piece->pipe->type & (DT_DEV_PIXELPIPE_FULL | DT_DEV_PIXELPIPE_PREVIEW | DT_DEV_PIXELPIPE_PREVIEW2)))
+    return NULL;
+
+  const size_t tiles = (size_t)(_lens_map_floor(roi->x + roi->width - 1) - _lens_map_floor(roi->x) + 1)
+                       * (_lens_map_floor(roi->y + roi->height - 1) - _lens_map_floor(roi->y) + 1);
+  if(tiles > LENS_MAP_MAX_TILES) return NULL;
+
+  dt_pthread_mutex_lock(&map->lock);
+  if(map->orig_w != orig_w || map->orig_h != orig_h)
+  {
+    g_hash_table_remove_all(map->tiles);
+    map->orig_w = orig_w;
+    map->orig_h = orig_h;
+  }
+  dt_pthread_mutex_unlock(&map->lock);
+  return map;
+}
+
+// ApplySubpixelGeometryDistortion() for one row, served from the tiles of map if there is one
+static void _lens_distortion_row(dt_iop_lensfun_map_t *map, const lfModifier *modifier, const int x, const int y,
+                                 const int width, float *const out)
+{
+  if(!map)
+  {
+    modifier->ApplySubpixelGeometryDistortion(x, y, width, 1, out);
+    return;
+  }
+
+  const int ty = _lens_map_floor(y);
+  const int oy = y - ty * LENS_MAP_TILE;
+  for(int i = 0; i < width;)
+  {
+    const int tx = _lens_map_floor(x + i);
+    const int ox = x + i - tx * LENS_MAP_TILE;
+    const int n = MIN(width - i, LENS_MAP_TILE - ox);
+    const size_t offset = (size_t)6 * (oy * LENS_MAP_TILE + ox);
+    const gpointer key = _lens_map_key(tx, ty);
+
+    dt_pthread_mutex_lock(&map->lock);
+    const float *tile = (const float *)g_hash_table_lookup(map->tiles, key);
+    if(tile) memcpy(out + 6 * i, tile + offset, sizeof(float) * 6 * n);
+    dt_pthread_mutex_unlock(&map->lock);
+
+    if(!tile)
+    {
+      // compute outside of the lock, another thread might have been quicker then
+      float *fresh = (float *)dt_alloc_align(64, sizeof(float) * 6 * LENS_MAP_TILE * LENS_MAP_TILE);
+      if(!fresh)
+      {
+        modifier->ApplySubpixelGeometryDistortion(x + i, y, n, 1, out + 6 * i);
+        i += n;
+        continue;
+      }
+      modifier->ApplySubpixelGeometryDistortion(tx * LENS_MAP_TILE, ty * LENS_MAP_TILE, LENS_MAP_TILE,
+                                                LENS_MAP_TILE, fresh);
+      memcpy(out + 6 * i, fresh + offset, sizeof(float) * 6 * n);
+
+      dt_pthread_mutex_lock(&map->lock);
+      if(g_hash_table_contains(map->tiles, key))
+        dt_free_align(fresh);
+      else
+      {
+        if(g_hash_table_size(map->tiles) >= LENS_MAP_MAX_TILES) g_hash_table_remove_all(map->tiles);
+        g_hash_table_insert(map->tiles, key, fresh);
+      }
+      dt_pthread_mutex_unlock(&map->lock);
+    }
+    i += n;
+  }
+}
+
 void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid, void *const ovoid,
              const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
@@ -424,18 +542,19 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
       // acquire temp memory for distorted pixel coords
       const size_t bufsize = (size_t)roi_out->width * 2 * 3;
       void *buf = dt_alloc_align(64, bufsize * dt_get_num_threads() * sizeof(float));
+      dt_iop_lensfun_map_t *map = _lens_map(piece, roi_out, orig_w, orig_h);
 
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
       dt_omp_firstprivate(bufsize, ch, ch_width, d, interpolation, ivoid, \
-                          mask_display, ovoid, roi_in, roi_out) \
+                          map, mask_display, ovoid, roi_in, roi_out) \
       shared(buf, modifier) \
       schedule(static)
 #endif
       for(int y = 0; y < roi_out->height; y++)
       {
         float *bufptr = ((float *)buf) + (size_t)bufsize * dt_get_thread_num();
-        modifier->ApplySubpixelGeometryDistortion(roi_out->x, roi_out->y + y, roi_out->width, 1, bufptr);
+        _lens_distortion_row(map, modifier, roi_out->x, roi_out->y + y, roi_out->width, bufptr);
 
         // reverse transform the global coords from lf to our buffer
         float *out = ((float *)ovoid) + (size_t)y * roi_out->width * ch;
@@ -528,18 +647,18 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
       // acquire temp memory for distorted pixel coords
       const size_t buf2size = (size_t)roi_out->width * 2 * 3;
       void *buf2 = dt_alloc_align(64, buf2size * sizeof(float) * dt_get_num_threads());
+      dt_iop_lensfun_map_t *map = _lens_map(piece, roi_out, orig_w, orig_h);
 
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-      dt_omp_firstprivate(buf2size, ch, ch_width, d, interpolation, mask_display, ovoid, roi_in, roi_out) \
+      dt_omp_firstprivate(buf2size, ch, ch_width, d, interpolation, map, mask_display, ovoid, roi_in, roi_out) \
       shared(buf2, buf, modifier) \
       schedule(static)
 #endif
       for(int y = 0; y < roi_out->height; y++)
       {
         float *buf2ptr = ((float *)buf2) + (size_t)buf2size * dt_get_thread_num();
-        modifier->ApplySubpixelGeometryDistortion(roi_out->x, roi_out->y + y, roi_out->width,
-                                                  1, buf2ptr);
+        _lens_distortion_row(map, modifier, roi_out->x, roi_out->y + y, roi_out->width, buf2ptr);
         // reverse transform the global coords from lf to our buffer
         float *out = ((float *)ovoid) + (size_t)y * roi_out->width * ch;
         for(int x = 0; x < roi_out->width; x++, buf2ptr += 6, out += ch)
@@ -680,16 +799,17 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
     // reverse direction (useful for renderings)
     if(modflags & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE))
     {
+      dt_iop_lensfun_map_t *map = _lens_map(piece, roi_out, orig_w, orig_h);
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-      dt_omp_firstprivate(tmpbufwidth, roi_out) \
+      dt_omp_firstprivate(map, tmpbufwidth, roi_out) \
       shared(tmpbuf, d, modifier) \
       schedule(static)
 #endif
       for(int y = 0; y < roi_out->height; y++)
       {
         float *pi = tmpbuf + (size_t)y * tmpbufwidth;
-        modifier->ApplySubpixelGeometryDistortion(roi_out->x, roi_out->y + y, roi_out->width, 1, pi);
+        _lens_distortion_row(map, modifier, roi_out->x, roi_out->y + y, roi_out->width, pi);
       }
 
       /* _blocking_ memory transfer: host tmpbuf buffer -> opencl dev_tmpbuf */
@@ -797,16 +917,17 @@ int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_m
 
     if(modflags & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE))
     {
+      dt_iop_lensfun_map_t *map = _lens_map(piece, roi_out, orig_w, orig_h);
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-      dt_omp_firstprivate(tmpbufwidth, roi_out) \
+      dt_omp_firstprivate(map, tmpbufwidth, roi_out) \
       shared(tmpbuf, d, modifier) \
       schedule(static)
 #endif
       for(int y = 0; y < roi_out->height; y++)
       {
         float *pi = tmpbuf + (size_t)y * tmpbufwidth;
-        modifier->ApplySubpixelGeometryDistortion(roi_out->x, roi_out->y + y, roi_out->width, 1, pi);
+        _lens_distortion_row(map, modifier, roi_out->x, roi_out->y + y, roi_out->width, pi);
       }
 
       /* _blocking_ memory transfer: host tmpbuf buffer -> opencl dev_tmpbuf */
@@ -876,6 +997,29 @@ void tiling_callback(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t
 // the back transformed points are when transformed very close to the original point.
 //
 // Again, not perfect but better than having back-transform be equivalent to the transform routine above.
+// the full size modifier for the point transforms, kept with the map. these are called under the history
+// lock, like commit_params(), so it can't go away under them.
+static const lfModifier *_points_modifier(dt_iop_lensfun_data_t *d, const float orig_w, const float orig_h,
+                                          int *modflags, gboolean *owned)
+{
+  dt_iop_lensfun_map_t *map = d->map;
+  *owned = (map == NULL);
+  if(!map) return get_modifier(modflags, orig_w, orig_h, d, LF_MODIFY_ALL);
+
+  dt_pthread_mutex_lock(&map->lock);
+  if(!map->points || map->points_w != orig_w || map->points_h != orig_h)
+  {
+    delete map->points;
+    map->points = get_modifier(&map->points_flags, orig_w, orig_h, d, LF_MODIFY_ALL);
+    map->points_w = orig_w;
+    map->points_h = orig_h;
+  }
+  const lfModifier *modifier = map->points;
+  *modflags = map->points_flags;
+  dt_pthread_mutex_unlock(&map->lock);
+  return modifier;
+}
+
 int distort_transform(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, float *points, size_t points_count)
 {
   dt_iop_lensfun_data_t *d = (dt_iop_lensfun_data_t *)piece->data;
@@ -883,7 +1027,8 @@ int distort_transform(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, floa
 
   const float orig_w = piece->buf_in.width, orig_h = piece->buf_in.height;
   int modflags;
-  const lfModifier *modifier = get_modifier(&modflags, orig_w, orig_h, d, LF_MODIFY_ALL);
+  gboolean owned;
+  const lfModifier *modifier = _points_modifier(d, orig_w, orig_h, &modflags, &owned);
 
   if(modflags & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE))
   {
@@ -910,7 +1055,7 @@ int distort_transform(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, floa
     free(buf);
   }
 
-  delete modifier;
+  if(owned) delete modifier;
   return 1;
 }
 
@@ -923,7 +1068,8 @@ int distort_backtransform(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
 
   const float orig_w = piece->buf_in.width, orig_h = piece->buf_in.height;
   int modflags;
-  const lfModifier *modifier = get_modifier(&modflags, orig_w, orig_h, d, LF_MODIFY_ALL);
+  gboolean owned;
+  const lfModifier *modifier = _points_modifier(d, orig_w, orig_h, &modflags, &owned);
 
   if(modflags & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE))
   {
@@ -937,11 +1083,12 @@ int distort_backtransform(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
     free(buf);
   }
 
-  delete modifier;
+  if(owned) delete modifier;
   return 1;
 }
 
-// TODO: Shall we keep LF_MODIFY_TCA in the modifiers?
+// masks follow the green channel, which lensfun's TCA correction leaves alone. so the full modifier gives the
+// same coordinates as one without TCA, and the masks share the cached map with the image.
 void distort_mask(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece, const float *const in,
                   float *const out, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
@@ -956,11 +1103,11 @@ void distort_mask(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *p
   const float orig_w = roi_in->scale * piece->buf_in.width, orig_h = roi_in->scale * piece->buf_in.height;
   dt_pthread_mutex_lock(&darktable.plugin_threadsafe);
   int modflags;
-  lfModifier *modifier = get_modifier(&modflags, orig_w, orig_h, d, /*LF_MODIFY_TCA |*/ LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE);
+  lfModifier *modifier = get_modifier(&modflags, orig_w, orig_h, d, LF_MODIFY_ALL);
 
   dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
 
-  if(!(modflags & (LF_MODIFY_TCA | LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE)))
+  if(!(modflags & (LF_MODIFY_DISTORTION | LF_MODIFY_GEOMETRY | LF_MODIFY_SCALE)))
   {
     memcpy(out, in, sizeof(float) * roi_out->width * roi_out->height);
     delete modifier;
@@ -972,17 +1119,18 @@ void distort_mask(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *p
   // acquire temp memory for distorted pixel coords
   const size_t bufsize = (size_t)roi_out->width * 2 * 3;
   float *buf = (float *)dt_alloc_align(64, bufsize * sizeof(float) * dt_get_num_threads());
+  dt_iop_lensfun_map_t *map = _lens_map(piece, roi_out, orig_w, orig_h);
 
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(bufsize, d, in, interpolation, out, roi_in, roi_out) \
+  dt_omp_firstprivate(bufsize, d, in, interpolation, map, out, roi_in, roi_out) \
   shared(buf, modifier) \
   schedule(static)
 #endif
   for(int y = 0; y < roi_out->height; y++)
   {
     float *bufptr = buf + bufsize * dt_get_thread_num();
-    modifier->ApplySubpixelGeometryDistortion(roi_out->x, roi_out->y + y, roi_out->width, 1, bufptr);
+    _lens_distortion_row(map, modifier, roi_out->x, roi_out->y + y, roi_out->width, bufptr);
 
     // reverse transform the global coords from lf to our buffer
     float *_out = out + (size_t)y * roi_out->width;
@@ -1130,6 +1278,14 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
 
   dt_iop_lensfun_global_data_t *gd = (dt_iop_lensfun_global_data_t *)self->global_data;
   lfDatabase *dt_iop_lensfun_db = (lfDatabase *)gd->db;
+
+  // the cached coordinates are for the old parameters
+  if(d->map)
+  {
+    dt_pthread_mutex_lock(&d->map->lock);
+    _lens_map_flush(d->map);
+    dt_pthread_mutex_unlock(&d->map->lock);
+  }
   const lfCamera *camera = NULL;
   const lfCamera **cam = NULL;
 
@@ -1219,7 +1375,14 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
 
 void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
-  piece->data = calloc(1, sizeof(dt_iop_lensfun_data_t));
+  dt_iop_lensfun_data_t *d = (dt_iop_lensfun_data_t *)calloc(1, sizeof(dt_iop_lensfun_data_t));
+  piece->data = d;
+  if(pipe->type & (DT_DEV_PIXELPIPE_FULL | DT_DEV_PIXELPIPE_PREVIEW | DT_DEV_PIXELPIPE_PREVIEW2))
+  {
+    d->map = (dt_iop_lensfun_map_t *)calloc(1, sizeof(dt_iop_lensfun_map_t));
+    dt_pthread_mutex_init(&d->map->lock, NULL);
+    d->map->tiles = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, dt_free_align_ptr);
+  }
   self->commit_params(self, self->default_params, pipe, piece);
 }
 
@@ -1232,6 +1395,13 @@ void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev
     delete d->lens;
     d->lens = NULL;
   }
+  if(d->map)
+  {
+    _lens_map_flush(d->map);
+    g_hash_table_destroy(d->map->tiles);
+    dt_pthread_mutex_destroy(&d->map->lock);
+    free(d->map);
+  }
   free(piece->data);
   piece->data = NULL;
 }
@@ -259,6 +259,36 @@ typedef struct
   int warp_kernel;
 } dt_iop_liquify_global_data_t;
 
+// the distortion map of the last set of warps, kept on the piece so that tiles, distort_mask() and
+// the next runs of the pipe do not stamp all warps again. the map is the sum of the stamps, so when
+// only a few of the warps changed their old stamps are taken out and the new ones added.
+typedef struct
+{
+  dt_liquify_warp_t *warps;          ///< the warps the map was built from, in map coordinates
+  int num_warps;
+  int factor;                        ///< the map is built at 1/factor of the resolution
+  gboolean inverted;
+  cairo_rectangle_int_t extent;      ///< extent of out, in piece coordinates
+  cairo_rectangle_int_t map_extent;  ///< extent of map, at 1/factor
+  float complex *map;
+  float complex *out;                ///< map upsampled and/or inverted, or map itself
+} dt_liquify_map_cache_t;
+
+typedef enum
+{
+  DT_LIQUIFY_MAP_PROCESS,
+  DT_LIQUIFY_MAP_TRANSFORM,
+  DT_LIQUIFY_MAP_BACKTRANSFORM,
+  DT_LIQUIFY_MAP_LAST
+} dt_liquify_map_cache_enum_t;
+
+typedef struct
+{
+  dt_iop_liquify_params_t params;
+  dt_pthread_mutex_t lock;           ///< protects the caches, distort_transform() may come from another thread
+  dt_liquify_map_cache_t cache[DT_LIQUIFY_MAP_LAST];
+} dt_iop_liquify_data_t;
+
 typedef struct
 {
   dt_pthread_mutex_t lock;
@@ -1037,8 +1067,10 @@ static void add_to_global_distortion_map(float complex *global_map,
                                           const cairo_rectangle_int_t *global_map_extent,
                                           const dt_liquify_warp_t *warp,
                                           const float complex *stamp,
-                                          const cairo_rectangle_int_t *stamp_extent)
+                                          const cairo_rectangle_int_t *stamp_extent,
+                                          const gboolean remove)
 {
+  const float sign = remove ? -1.0f : 1.0f;
   cairo_rectangle_int_t mmext = *stamp_extent;
   mmext.x += (int) round(creal(warp->point));
   mmext.y += (int) round(cimag(warp->point));
@@ -1061,7 +1093,7 @@ static void add_to_global_distortion_map(float complex *global_map,
 
     for(int x = cmmext.x; x < cmmext.x + cmmext.width; x++)
     {
-      destrow[x - global_map_extent->x] -= srcrow[x - mmext.x];
+      destrow[x - global_map_extent->x] -= sign * srcrow[x - mmext.x];
     }
   }
 }
@@ -1163,104 +1195,289 @@ static void _get_map_extent(const dt_iop_roi_t *roi_out,
   cairo_region_destroy(roi_out_region);
 }
 
+static void _stamp_warps(float complex *map,
+                         const cairo_rectangle_int_t *map_extent,
+                         const dt_liquify_warp_t *warps,
+                         const int num_warps,
+                         const gboolean remove)
+{
+  for(int i = 0; i < num_warps; i++)
+  {
+    float complex *stamp = NULL;
+    cairo_rectangle_int_t r;
+    build_round_stamp(&stamp, &r, &warps[i]);
+    add_to_global_distortion_map(map, map_extent, &warps[i], stamp, &r, remove);
+    free((void *) stamp);
+  }
+}
+
 static float complex *create_global_distortion_map(const cairo_rectangle_int_t *map_extent,
-                                                    GList *interpolated,
-                                                    gboolean inverted)
+                                                    const dt_liquify_warp_t *warps,
+                                                    const int num_warps)
 {
   // allocate distortion map big enough to contain all paths
-  const int mapsize = map_extent->width * map_extent->height;
+  const size_t mapsize = (size_t)map_extent->width * map_extent->height;
   float complex *map = dt_alloc_align(64, mapsize * sizeof(float complex));
   memset(map, 0, mapsize * sizeof(float complex));
 
   // build map
-  for(GList *i = interpolated; i != NULL; i = i->next)
-  {
-    const dt_liquify_warp_t *warp = ((dt_liquify_warp_t *) i->data);
-    float complex *stamp = NULL;
-    cairo_rectangle_int_t r;
-    build_round_stamp(&stamp, &r, warp);
-    add_to_global_distortion_map(map, map_extent, warp, stamp, &r);
-    free((void *) stamp);
-  }
+  _stamp_warps(map, map_extent, warps, num_warps, FALSE);
+
+  return map;
+}
+
+static float complex *invert_global_distortion_map(const float complex *map,
+                                                    const cairo_rectangle_int_t *map_extent)
+{
+  const size_t mapsize = (size_t)map_extent->width * map_extent->height;
+  float complex * const imap = dt_alloc_align(64, mapsize * sizeof(float complex));
+  memset(imap, 0, mapsize * sizeof(float complex));
 
-  if(inverted)
+  // copy map into imap(inverted map).
+  // imap [ n + dx(map[n]) , n + dy(map[n]) ] = -map[n]
+
+  #ifdef _OPENMP
+  #pragma omp parallel for schedule (static) default (shared)
+  #endif
+
+  for(int y = 0; y <  map_extent->height; y++)
   {
-    float complex * const imap = dt_alloc_align(64, mapsize * sizeof(float complex));
-    memset(imap, 0, mapsize * sizeof(float complex));
+    const float complex *row = map + (size_t)y * map_extent->width;
+    for(int x = 0; x < map_extent->width; x++)
+    {
+      const float complex d = * (row + x);
+      // compute new position (nx,ny) given the displacement d
+      const int nx = x + (int)creal(d);
+      const int ny = y + (int)cimag(d);
+
+      // if the point falls into the extent, set it
+      if(nx>0 && nx<map_extent->width && ny>0 && ny<map_extent->height)
+        imap[nx + ny * map_extent->width] = -d;
+    }
+  }
 
-    // copy map into imap(inverted map).
-    // imap [ n + dx(map[n]) , n + dy(map[n]) ] = -map[n]
+  // now just do a pass to avoid gap with a displacement of zero, note that we do not need high
+  // precision here as the inverted distortion mask is only used to compute a final displacement
+  // of points.
 
-    #ifdef _OPENMP
-    #pragma omp parallel for schedule (static) default (shared)
-    #endif
+  #ifdef _OPENMP
+  #pragma omp parallel for schedule (static) default (shared)
+  #endif
 
-    for(int y = 0; y <  map_extent->height; y++)
+  for(int y = 0; y <  map_extent->height; y++)
+  {
+    float complex *row = imap + (size_t)y * map_extent->width;
+    float complex last[2] = { 0, 0 };
+    for(int x = 0; x < map_extent->width / 2 + 1; x++)
     {
-      const float complex *row = map + y * map_extent->width;
-      for(int x = 0; x < map_extent->width; x++)
+      float complex *cl = row + x;
+      float complex *cr = row + map_extent->width - x;
+      if(x!=0)
       {
-        const float complex d = * (row + x);
-        // compute new position (nx,ny) given the displacement d
-        const int nx = x + (int)creal(d);
-        const int ny = y + (int)cimag(d);
-
-        // if the point falls into the extent, set it
-        if(nx>0 && nx<map_extent->width && ny>0 && ny<map_extent->height)
-          imap[nx + ny * map_extent->width] = -d;
+        if(*cl == 0) *cl = last[0];
+        if(*cr == 0) *cr = last[1];
       }
+      last[0] = *cl; last[1] = *cr;
+    }
+  }
+
+  return imap;
+}
+
+// bilinear upsampling of a map built at 1/factor of the resolution to extent. the displacements
+// are scaled up with the coordinates.
+
+static float complex *upsample_global_distortion_map(const float complex *map,
+                                                      const cairo_rectangle_int_t *map_extent,
+                                                      const cairo_rectangle_int_t *extent,
+                                                      const int factor)
+{
+  float complex *const umap = dt_alloc_align(64, (size_t)extent->width * extent->height * sizeof(float complex));
+  const float inv = 1.0f / factor;
+  const int w = map_extent->width, h = map_extent->height;
+
+  #ifdef _OPENMP
+  #pragma omp parallel for schedule (static) default (shared)
+  #endif
+
+  for(int y = 0; y < extent->height; y++)
+  {
+    const float fy = CLAMPS((y + extent->y) * inv - map_extent->y, 0.0f, h - 1);
+    const int y0 = MIN((int)fy, h - 2 < 0 ? 0 : h - 2);
+    const int y1 = MIN(y0 + 1, h - 1);
+    const float dy = fy - y0;
+    float complex *row = umap + (size_t)y * extent->width;
+    for(int x = 0; x < extent->width; x++)
+    {
+      const float fx = CLAMPS((x + extent->x) * inv - map_extent->x, 0.0f, w - 1);
+      const int x0 = MIN((int)fx, w - 2 < 0 ? 0 : w - 2);
+      const int x1 = MIN(x0 + 1, w - 1);
+      const float dx = fx - x0;
+      const float complex top = map[(size_t)y0 * w + x0] * (1.0f - dx) + map[(size_t)y0 * w + x1] * dx;
+      const float complex bot = map[(size_t)y1 * w + x0] * (1.0f - dx) + map[(size_t)y1 * w + x1] * dx;
+      row[x] = factor * (top * (1.0f - dy) + bot * dy);
     }
+  }
+  return umap;
+}
+
+static void _map_cache_free(dt_liquify_map_cache_t *c)
+{
+  if(c->out != c->map) dt_free_align((void *) c->out);
+  dt_free_align((void *) c->map);
+  free(c->warps);
+  memset(c, 0, sizeof(dt_liquify_map_cache_t));
+}
 
-    dt_free_align((void *) map);
+static void _map_cache_finish(dt_liquify_map_cache_t *c)
+{
+  if(c->out != c->map) dt_free_align((void *) c->out);
+  c->out = c->map;
+  if(c->factor > 1)
+    c->out = upsample_global_distortion_map(c->map, &c->map_extent, &c->extent, c->factor);
+  if(c->inverted)
+  {
+    float complex *imap = invert_global_distortion_map(c->out, &c->extent);
+    if(c->out != c->map) dt_free_align((void *) c->out);
+    c->out = imap;
+  }
+}
 
-    // now just do a pass to avoid gap with a displacement of zero, note that we do not need high
-    // precision here as the inverted distortion mask is only used to compute a final displacement
-    // of points.
+static gboolean _rect_contains(const cairo_rectangle_int_t *outer, const cairo_rectangle_int_t *inner)
+{
+  return inner->x >= outer->x && inner->y >= outer->y
+    && inner->x + inner->width <= outer->x + outer->width
+    && inner->y + inner->height <= outer->y + outer->height;
+}
 
-    #ifdef _OPENMP
-    #pragma omp parallel for schedule (static) default (shared)
-    #endif
+/*
+  Returns the distortion map of the interpolated warps over extent,
+  which is written back with the extent the map actually covers. The
+  map belongs to the cache, which must be locked by the caller. It is
+  only built again when the warps or the extent changed; when the
+  changed warps are a run in the middle of the list (the usual case
+  when editing one path) only their stamps are redone.
+*/
+
+static const float complex *get_global_distortion_map(dt_liquify_map_cache_t *c,
+                                                      GList *interpolated,
+                                                      cairo_rectangle_int_t *extent,
+                                                      const int factor,
+                                                      const gboolean inverted)
+{
+  // the warps in map coordinates, stamps smaller than a pixel of a reduced map are left out
+  const int len = g_list_length(interpolated);
+  dt_liquify_warp_t *warps = malloc(sizeof(dt_liquify_warp_t) * MAX(len, 1));
+  int n = 0;
+  for(GList *i = interpolated; i != NULL; i = i->next)
+  {
+    dt_liquify_warp_t w = *((dt_liquify_warp_t *) i->data);
+    if(factor > 1)
+    {
+      w.point /= factor;
+      w.strength /= factor;
+      w.radius /= factor;
+      if(round(cabs(w.radius - w.point)) < 1) continue;
+    }
+    warps[n++] = w;
+  }
 
-    for(int y = 0; y <  map_extent->height; y++)
+  if(c->map && c->factor == factor && c->inverted == inverted && _rect_contains(&c->extent, extent))
+  {
+    // the common head and tail of the old and new warps
+    const int m = MIN(n, c->num_warps);
+    int head = 0, tail = 0;
+    while(head < m && !memcmp(&warps[head], &c->warps[head], sizeof(dt_liquify_warp_t))) head++;
+    while(tail < m - head
+          && !memcmp(&warps[n - 1 - tail], &c->warps[c->num_warps - 1 - tail], sizeof(dt_liquify_warp_t)))
+      tail++;
+    const int removed = c->num_warps - head - tail;
+    const int added = n - head - tail;
+
+    if(removed + added < n)
     {
-      float complex *row = imap + y * map_extent->width;
-      float complex last[2] = { 0, 0 };
-      for(int x = 0; x < map_extent->width / 2 + 1; x++)
+      if(removed + added > 0)
       {
-        float complex *cl = row + x;
-        float complex *cr = row + map_extent->width - x;
-        if(x!=0)
-        {
-          if(*cl == 0) *cl = last[0];
-          if(*cr == 0) *cr = last[1];
-        }
-        last[0] = *cl; last[1] = *cr;
+        _stamp_warps(c->map, &c->map_extent, c->warps + head, removed, TRUE);
+        _stamp_warps(c->map, &c->map_extent, warps + head, added, FALSE);
+        free(c->warps);
+        c->warps = warps;
+        c->num_warps = n;
+        _map_cache_finish(c);
       }
+      else
+        free(warps);
+      *extent = c->extent;
+      return c->out;
     }
+  }
 
-    map = imap;
+  _map_cache_free(c);
+  c->warps = warps;
+  c->num_warps = n;
+  c->factor = factor;
+  c->inverted = inverted;
+  c->extent = *extent;
+  c->map_extent = *extent;
+  if(factor > 1)
+  {
+    c->map_extent.x = floorf((float)extent->x / factor);
+    c->map_extent.y = floorf((float)extent->y / factor);
+    c->map_extent.width = (extent->x + extent->width + factor - 1) / factor - c->map_extent.x + 1;
+    c->map_extent.height = (extent->y + extent->height + factor - 1) / factor - c->map_extent.y + 1;
   }
+  c->map = create_global_distortion_map(&c->map_extent, warps, n);
+  _map_cache_finish(c);
+  return c->out;
+}
 
-  return map;
+// the extent of all warps, clipped to clip if not NULL.
+
+static void _get_warps_extent(GList *interpolated,
+                              const cairo_rectangle_int_t *clip,
+                              cairo_rectangle_int_t *extent)
+{
+  cairo_region_t *region = cairo_region_create();
+  for(GList *i = interpolated; i != NULL; i = i->next)
+  {
+    cairo_rectangle_int_t r;
+    compute_round_stamp_extent(&r, (dt_liquify_warp_t *) i->data);
+    cairo_region_union_rectangle(region, &r);
+  }
+  if(clip) cairo_region_intersect_rectangle(region, clip);
+  cairo_region_get_extents(region, extent);
+  cairo_region_destroy(region);
 }
 
-static float complex *build_global_distortion_map(struct dt_iop_module_t *module,
-                                                   const dt_dev_pixelpipe_iop_t *piece,
-                                                   const dt_iop_roi_t *roi_in,
-                                                   const dt_iop_roi_t *roi_out,
-                                                   cairo_rectangle_int_t *map_extent)
+// the map for the pipe at the scale of roi_in, covering all warps inside the image. tiles and
+// distort_mask() at the same scale share it. preview pipes build it at half the resolution.
+// the caller must hold d->lock.
+
+static const float complex *build_global_distortion_map(struct dt_iop_module_t *module,
+                                                         const dt_dev_pixelpipe_iop_t *piece,
+                                                         const dt_iop_roi_t *roi_in,
+                                                         cairo_rectangle_int_t *map_extent)
 {
+  dt_iop_liquify_data_t *d = (dt_iop_liquify_data_t *)piece->data;
+
   // copy params
   dt_iop_liquify_params_t copy_params;
-  memcpy(&copy_params, (dt_iop_liquify_params_t *)piece->data, sizeof(dt_iop_liquify_params_t));
+  memcpy(&copy_params, &d->params, sizeof(dt_iop_liquify_params_t));
 
   distort_paths_raw_to_piece(module, piece->pipe, roi_in->scale, &copy_params, FALSE);
 
   GList *interpolated = interpolate_paths(&copy_params);
 
-  _get_map_extent(roi_out, interpolated, map_extent);
+  const cairo_rectangle_int_t pipe_rect = { 0, 0, lroundf((double)piece->buf_in.width * roi_in->scale),
+                                            lroundf((double)piece->buf_in.height * roi_in->scale) };
+  _get_warps_extent(interpolated, &pipe_rect, map_extent);
 
-  float complex *map = create_global_distortion_map(map_extent, interpolated, FALSE);
+  const float complex *map = NULL;
+  if(map_extent->width != 0 && map_extent->height != 0)
+  {
+    const int factor = (piece->pipe->type & DT_DEV_PIXELPIPE_PREVIEW) == DT_DEV_PIXELPIPE_PREVIEW ? 2 : 1;
+    map = get_global_distortion_map(&d->cache[DT_LIQUIFY_MAP_PROCESS], interpolated, map_extent, factor, FALSE);
+  }
 
   g_list_free_full(interpolated, free);
   return map;
@@ -1291,7 +1508,7 @@ void modify_roi_in(struct dt_iop_module_t *module,
 
   // copy params
   dt_iop_liquify_params_t copy_params;
-  memcpy(&copy_params, (dt_iop_liquify_params_t*)piece->data, sizeof(dt_iop_liquify_params_t));
+  memcpy(&copy_params, &((dt_iop_liquify_data_t *)piece->data)->params, sizeof(dt_iop_liquify_params_t));
 
   distort_paths_raw_to_piece(module, piece->pipe, roi_in->scale, &copy_params, FALSE);
 
@@ -1336,46 +1553,27 @@ void modify_roi_in(struct dt_iop_module_t *module,
 
 static int _distort_xtransform(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, float *points, size_t points_count, gboolean inverted)
 {
+  dt_iop_liquify_data_t *d = (dt_iop_liquify_data_t *)piece->data;
   const float scale = piece->iscale;
 
-  // compute the extent of all points (all computations are done in RAW coordinate)
-  float xmin = FLT_MAX, xmax = FLT_MIN, ymin = FLT_MAX, ymax = FLT_MIN;
+  // copy params
+  dt_iop_liquify_params_t copy_params;
+  memcpy(&copy_params, &d->params, sizeof(dt_iop_liquify_params_t));
 
-  for(size_t i = 0; i < points_count * 2; i += 2)
-  {
-    const float x = points[i] * scale;
-    const float y = points[i + 1] * scale;
-    xmin = fmin(xmin, x);
-    xmax = fmax(xmax, x);
-    ymin = fmin(ymin, y);
-    ymax = fmax(ymax, y);
-  }
+  distort_paths_raw_to_piece(self, piece->pipe, scale, &copy_params, TRUE);
 
-  cairo_rectangle_int_t extent = { .x = (int)(xmin - .5), .y = (int)(ymin - .5),
-                                   .width = (int)(xmax - xmin + 2.5), .height = (int)(ymax - ymin + 2.5) };
+  // the distortion map covers all warps (all computations are done in RAW coordinate), so that it does
+  // not depend on the points and can be kept for the next call
+
+  GList *interpolated = interpolate_paths(&copy_params);
+  cairo_rectangle_int_t extent;
+  _get_warps_extent(interpolated, NULL, &extent);
 
   if(extent.width != 0 && extent.height != 0)
   {
-    // copy params
-    dt_iop_liquify_params_t copy_params;
-    memcpy(&copy_params, (dt_iop_liquify_params_t *)piece->data, sizeof(dt_iop_liquify_params_t));
-
-    distort_paths_raw_to_piece(self, piece->pipe, scale, &copy_params, TRUE);
-
-    // create the distortion map for this extent
-
-    GList *interpolated = interpolate_paths(&copy_params);
-
-    // we need to adjust the extent to be the union enclosing all the points (currently in extent) and
-    // the warps that are in (possibly partly) in this same region.
-
-    dt_iop_roi_t roi_in = { .x = extent.x, .y = extent.y, .width = extent.width, .height = extent.height };
-    _get_map_extent(&roi_in, interpolated, &extent);
-
-    float complex *map = create_global_distortion_map(&extent, interpolated, inverted);
-    g_list_free_full(interpolated, free);
-
-    if(map == NULL) return 0;
+    dt_pthread_mutex_lock(&d->lock);
+    dt_liquify_map_cache_t *cache = &d->cache[inverted ? DT_LIQUIFY_MAP_TRANSFORM : DT_LIQUIFY_MAP_BACKTRANSFORM];
+    const float complex *map = get_global_distortion_map(cache, interpolated, &extent, 1, inverted);
 
     const int map_size =  extent.width * extent.height;
     const int x_last = extent.x + extent.width;
@@ -1397,10 +1595,10 @@ static int _distort_xtransform(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *pi
         *py += cimag(dist);
       }
     }
-
-    dt_free_align((void *) map);
+    dt_pthread_mutex_unlock(&d->lock);
   }
 
+  g_list_free_full(interpolated, free);
   return 1;
 }
 
@@ -1434,23 +1632,21 @@ void distort_mask(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *p
 
   // 2. build the distortion map
 
+  dt_iop_liquify_data_t *d = (dt_iop_liquify_data_t *)piece->data;
+  dt_pthread_mutex_lock(&d->lock);
   cairo_rectangle_int_t map_extent;
-  float complex *map = build_global_distortion_map(self, piece, roi_in, roi_out, &map_extent);
-  if(map == NULL)
-    return;
+  const float complex *map = build_global_distortion_map(self, piece, roi_in, &map_extent);
 
   // 3. apply the map
 
-  if(map_extent.width != 0 && map_extent.height != 0)
+  if(map)
   {
     int ch = piece->colors;
     piece->colors = 1;
     apply_global_distortion_map(self, piece, in, out, roi_in, roi_out, map, &map_extent);
     piece->colors = ch;
   }
-
-  dt_free_align((void *) map);
-
+  dt_pthread_mutex_unlock(&d->lock);
 }
 
 void process(struct dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, const void *const in,
@@ -1480,17 +1676,16 @@ void process(struct dt_iop_module_t *module, dt_dev_pixelpipe_iop_t *piece, cons
 
   // 2. build the distortion map
 
+  dt_iop_liquify_data_t *d = (dt_iop_liquify_data_t *)piece->data;
+  dt_pthread_mutex_lock(&d->lock);
   cairo_rectangle_int_t map_extent;
-  float complex *map = build_global_distortion_map(module, piece, roi_in, roi_out, &map_extent);
-  if(map == NULL)
-    return;
+  const float complex *map = build_global_distortion_map(module, piece, roi_in, &map_extent);
 
   // 3. apply the map
 
-  if(map_extent.width != 0 && map_extent.height != 0)
+  if(map)
     apply_global_distortion_map(module, piece, in, out, roi_in, roi_out, map, &map_extent);
-
-  dt_free_align((void *)map);
+  dt_pthread_mutex_unlock(&d->lock);
 }
 
 #ifdef HAVE_OPENCL
@@ -1643,15 +1838,27 @@ int process_cl(struct dt_iop_module_t *module,
   }
 
   // 2. build the distortion map
+  dt_iop_liquify_data_t *d = (dt_iop_liquify_data_t *)piece->data;
+  dt_pthread_mutex_lock(&d->lock);
   cairo_rectangle_int_t map_extent;
-  const float complex *map = build_global_distortion_map(module, piece, roi_in, roi_out, &map_extent);
-  if(map == NULL)
-    return TRUE;
+  const float complex *map = build_global_distortion_map(module, piece, roi_in, &map_extent);
 
-  // 3. apply the map
-  if(map_extent.width != 0 && map_extent.height != 0)
-    err = apply_global_distortion_map_cl(module, piece, dev_in, dev_out, roi_in, roi_out, map, &map_extent);
-  dt_free_align((void *) map);
+  // 3. apply the map, only the part of it inside roi_out goes to the device
+  if(map)
+  {
+    cairo_rectangle_int_t crop = { roi_out->x, roi_out->y, roi_out->width, roi_out->height };
+    if(gdk_rectangle_intersect(&map_extent, &crop, &crop))
+    {
+      float complex *cmap = dt_alloc_align(64, (size_t)crop.width * crop.height * sizeof(float complex));
+      for(int y = 0; y < crop.height; y++)
+        memcpy(cmap + (size_t)y * crop.width,
+               map + (size_t)(y + crop.y - map_extent.y) * map_extent.width + crop.x - map_extent.x,
+               sizeof(float complex) * crop.width);
+      err = apply_global_distortion_map_cl(module, piece, dev_in, dev_out, roi_in, roi_out, cmap, &crop);
+      dt_free_align((void *) cmap);
+    }
+  }
+  dt_pthread_mutex_unlock(&d->lock);
   if(err != CL_SUCCESS) goto error;
 
   return TRUE;
@@ -1703,24 +1910,33 @@ void cleanup(dt_iop_module_t *module)
 
 void init_pipe(struct dt_iop_module_t *module, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
-  piece->data = malloc(module->params_size);
+  dt_iop_liquify_data_t *d = calloc(1, sizeof(dt_iop_liquify_data_t));
+  dt_pthread_mutex_init(&d->lock, NULL);
+  piece->data = d;
   module->commit_params(module, module->default_params, pipe, piece);
 }
 
 void cleanup_pipe(struct dt_iop_module_t *module, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
+  dt_iop_liquify_data_t *d = (dt_iop_liquify_data_t *)piece->data;
+  for(int k = 0; k < DT_LIQUIFY_MAP_LAST; k++) _map_cache_free(&d->cache[k]);
+  dt_pthread_mutex_destroy(&d->lock);
   free(piece->data);
   piece->data = NULL;
 }
 
-/* commit is the synch point between core and gui, so it copies params to pipe data. */
+/* commit is the synch point between core and gui, so it copies params to pipe data.
+   the cached maps stay, they are checked against the warps when used. */
 
 void commit_params(struct dt_iop_module_t *module,
                     dt_iop_params_t *params,
                     dt_dev_pixelpipe_t *pipe,
                     dt_dev_pixelpipe_iop_t *piece)
 {
-  memcpy(piece->data, params, module->params_size);
+  dt_iop_liquify_data_t *d = (dt_iop_liquify_data_t *)piece->data;
+  dt_pthread_mutex_lock(&d->lock);
+  memcpy(&d->params, params, module->params_size);
+  dt_pthread_mutex_unlock(&d->lock);
 }
 
 // calculate the dot product of 2 vectors.
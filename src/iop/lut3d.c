@@ -25,6 +25,8 @@
 #include "common/colorspaces_inline_conversions.h"
 #include "common/file_location.h"
 #include "common/iop_profile.h"
+#include "control/control.h"
+#include "develop/develop.h"
 #include "develop/imageop.h"
 #include "develop/imageop_gui.h"
 #include "dtgtk/button.h"
@@ -48,6 +50,7 @@ DT_MODULE_INTROSPECTION(3, dt_iop_lut3d_params_t)
 #define DT_IOP_LUT3D_MAX_PATHNAME 512
 #define DT_IOP_LUT3D_MAX_LUTNAME 128
 #define DT_IOP_LUT3D_CLUT_LEVEL 48
+#define DT_IOP_LUT3D_CLUT_COARSE_LEVEL 16
 #define DT_IOP_LUT3D_MAX_KEYPOINTS 2048
 
 typedef enum dt_iop_lut3d_colorspace_t
@@ -104,6 +107,7 @@ typedef struct dt_iop_lut3d_data_t
   dt_iop_lut3d_params_t params;
   float *clut;  // cube lut pointer
   uint16_t level; // cube_size
+  gboolean coarse; // clut is the coarse one of a gmz lut, waiting for the full one
 } dt_iop_lut3d_data_t;
 
 typedef struct dt_iop_lut3d_global_data_t
@@ -115,16 +119,14 @@ typedef struct dt_iop_lut3d_global_data_t
 } dt_iop_lut3d_global_data_t;
 
 #ifdef HAVE_GMIC
-void lut3d_decompress_clut(const unsigned char *const input_keypoints, const unsigned int nb_input_keypoints,
-                    const unsigned int output_resolution, float *const output_clut_data,
-                    const char *const filename);
-
-unsigned int lut3d_get_cached_clut(float *const output_clut_data, const unsigned int output_resolution,
-                    const char *const filename);
+gboolean lut3d_decompress_clut(const unsigned char *const input_keypoints, const unsigned int nb_input_keypoints,
+                    const unsigned int output_resolution, float *const output_clut_data);
 
 gboolean lut3d_read_gmz(int *const nb_keypoints, unsigned char *const keypoints, const char *const filename,
               int *const nb_lut, void *g, const char *const lutname, const gboolean newlutname);
 
+int lut3d_read_gmz_pack(const char *const filename, unsigned char **keypoints, int **nb_keypoints);
+
 #endif // HAVE_GMIC
 
 const char *name()
@@ -204,288 +206,18 @@ int legacy_params(dt_iop_module_t *self, const void *const old_params, const int
 
   return 1;
 }
-// From `HaldCLUT_correct.c' by Eskil Steenberg (http://www.quelsolaar.com) (BSD licensed)
-void correct_pixel_trilinear(const float *const in, float *const out,
-                             const size_t pixel_nb, const float *const restrict clut, const uint16_t level)
-{
-  const int level2 = level * level;
-#ifdef _OPENMP
-#pragma omp parallel for SIMD() default(none) \
-  dt_omp_firstprivate(clut, in, level, level2, out, pixel_nb) \
-  schedule(static)
-#endif
-  for(size_t k = 0; k < (size_t)(pixel_nb * 4); k+=4)
-  {
-    float *const input = ((float *const)in) + k;
-    float *const output = ((float *const)out) + k;
-
-    int rgbi[3], i, j;
-    float tmp[6];
-    float rgbd[3];
-
-    for(int c = 0; c < 3; ++c) input[c] = fminf(fmaxf(input[c], 0.0f), 1.0f);
-
-    rgbd[0] = input[0] * (float)(level - 1);
-    rgbd[1] = input[1] * (float)(level - 1);
-    rgbd[2] = input[2] * (float)(level - 1);
-
-    rgbi[0] = CLAMP((int)rgbd[0], 0, level - 2);
-    rgbi[1] = CLAMP((int)rgbd[1], 0, level - 2);
-    rgbi[2] = CLAMP((int)rgbd[2], 0, level - 2);
-
-    rgbd[0] = rgbd[0] - rgbi[0]; // delta red
-    rgbd[1] = rgbd[1] - rgbi[1]; // delta green
-    rgbd[2] = rgbd[2] - rgbi[2]; // delta blue
-
-  // indexes of P000 to P111 in clut
-    const int color = rgbi[0] + rgbi[1] * level + rgbi[2] * level * level;
-    i = color * 3;  // P000
-    j = (color + 1) * 3;  // P100
-
-    tmp[0] = clut[i] * (1 - rgbd[0]) + clut[j] * rgbd[0];
-    tmp[1] = clut[i+1] * (1 - rgbd[0]) + clut[j+1] * rgbd[0];
-    tmp[2] = clut[i+2] * (1 - rgbd[0]) + clut[j+2] * rgbd[0];
-
-    i = (color + level) * 3;  // P010
-    j = (color + level + 1) * 3;  //P110
+#define LUT3D_INTERPOLATE lut3d_interpolate_plain
+#include "iop/lut3d_interpolate.h"
 
-    tmp[3] = clut[i] * (1 - rgbd[0]) + clut[j] * rgbd[0];
-    tmp[4] = clut[i+1] * (1 - rgbd[0]) + clut[j+1] * rgbd[0];
-    tmp[5] = clut[i+2] * (1 - rgbd[0]) + clut[j+2] * rgbd[0];
-
-    output[0] = tmp[0] * (1 - rgbd[1]) + tmp[3] * rgbd[1];
-    output[1] = tmp[1] * (1 - rgbd[1]) + tmp[4] * rgbd[1];
-    output[2] = tmp[2] * (1 - rgbd[1]) + tmp[5] * rgbd[1];
-
-    i = (color + level2) * 3;  // P001
-    j = (color + level2 + 1) * 3;  // P101
-
-    tmp[0] = clut[i] * (1 - rgbd[0]) + clut[j] * rgbd[0];
-    tmp[1] = clut[i+1] * (1 - rgbd[0]) + clut[j+1] * rgbd[0];
-    tmp[2] = clut[i+2] * (1 - rgbd[0]) + clut[j+2] * rgbd[0];
-
-    i = (color + level + level2) * 3;  // P011
-    j = (color + level + level2 + 1) * 3;  // P111
-
-    tmp[3] = clut[i] * (1 - rgbd[0]) + clut[j] * rgbd[0];
-    tmp[4] = clut[i+1] * (1 - rgbd[0]) + clut[j+1] * rgbd[0];
-    tmp[5] = clut[i+2] * (1 - rgbd[0]) + clut[j+2] * rgbd[0];
-
-    tmp[0] = tmp[0] * (1 - rgbd[1]) + tmp[3] * rgbd[1];
-    tmp[1] = tmp[1] * (1 - rgbd[1]) + tmp[4] * rgbd[1];
-    tmp[2] = tmp[2] * (1 - rgbd[1]) + tmp[5] * rgbd[1];
-
-    output[0] = output[0] * (1 - rgbd[2]) + tmp[0] * rgbd[2];
-    output[1] = output[1] * (1 - rgbd[2]) + tmp[1] * rgbd[2];
-    output[2] = output[2] * (1 - rgbd[2]) + tmp[2] * rgbd[2];
- }
-}
-
-// from OpenColorIO
-// https://github.com/imageworks/OpenColorIO/blob/master/src/OpenColorIO/ops/Lut3D/Lut3DOp.cpp
-void correct_pixel_tetrahedral(const float *const in, float *const out,
-                               const size_t pixel_nb, const float *const restrict clut, const uint16_t level)
-{
-  const int level2 = level * level;
-#ifdef _OPENMP
-#pragma omp parallel for SIMD() default(none) \
-  dt_omp_firstprivate(clut, in, level, level2, out, pixel_nb) \
-  schedule(static)
+// in lut3d_avx2.c / lut3d_avx512.c, see lut3d_interpolate.h
+#ifdef HAVE_AVX2_CODEPATH
+void lut3d_interpolate_avx2(const float *const in, float *const out, const size_t npixels, const float *const clut,
+                            const int level, const int interpolation);
 #endif
-  for(size_t k = 0; k < (size_t)(pixel_nb * 4); k+=4)
-  {
-    float *const input = ((float *const)in) + k;
-    float *const output = ((float *const)out) + k;
-
-    int rgbi[3];
-    float rgbd[3];
-    for(int c = 0; c < 3; ++c) input[c] = fminf(fmaxf(input[c], 0.0f), 1.0f);
-
-    rgbd[0] = input[0] * (float)(level - 1);
-    rgbd[1] = input[1] * (float)(level - 1);
-    rgbd[2] = input[2] * (float)(level - 1);
-
-    rgbi[0] = CLAMP((int)rgbd[0], 0, level - 2);
-    rgbi[1] = CLAMP((int)rgbd[1], 0, level - 2);
-    rgbi[2] = CLAMP((int)rgbd[2], 0, level - 2);
-
-    rgbd[0] = rgbd[0] - rgbi[0]; // delta red
-    rgbd[1] = rgbd[1] - rgbi[1]; // delta green
-    rgbd[2] = rgbd[2] - rgbi[2]; // delta blue
-
-  // indexes of P000 to P111 in clut
-    const int color = rgbi[0] + rgbi[1] * level + rgbi[2] * level * level;
-    const int i000 = color * 3;                     // P000
-    const int i100 = i000 + 3;                      // P100
-    const int i010 = (color + level) * 3;           // P010
-    const int i110 = i010 + 3;                      // P110
-    const int i001 = (color + level2) * 3;          // P001
-    const int i101 = i001 + 3;                      // P101
-    const int i011 = (color + level + level2) * 3;  // P011
-    const int i111 = i011 + 3;                      // P111
-
-    if (rgbd[0] > rgbd[1])
-    {
-      if (rgbd[1] > rgbd[2])
-      {
-        output[0] = (1-rgbd[0])*clut[i000] + (rgbd[0]-rgbd[1])*clut[i100] + (rgbd[1]-rgbd[2])*clut[i110] + rgbd[2]*clut[i111];
-        output[1] = (1-rgbd[0])*clut[i000+1] + (rgbd[0]-rgbd[1])*clut[i100+1] + (rgbd[1]-rgbd[2])*clut[i110+1] + rgbd[2]*clut[i111+1];
-        output[2] = (1-rgbd[0])*clut[i000+2] + (rgbd[0]-rgbd[1])*clut[i100+2] + (rgbd[1]-rgbd[2])*clut[i110+2] + rgbd[2]*clut[i111+2];
-      }
-      else if (rgbd[0] > rgbd[2])
-      {
-        output[0] = (1-rgbd[0])*clut[i000] + (rgbd[0]-rgbd[2])*clut[i100] + (rgbd[2]-rgbd[1])*clut[i101] + rgbd[1]*clut[i111];
-        output[1] = (1-rgbd[0])*clut[i000+1] + (rgbd[0]-rgbd[2])*clut[i100+1] + (rgbd[2]-rgbd[1])*clut[i101+1] + rgbd[1]*clut[i111+1];
-        output[2] = (1-rgbd[0])*clut[i000+2] + (rgbd[0]-rgbd[2])*clut[i100+2] + (rgbd[2]-rgbd[1])*clut[i101+2] + rgbd[1]*clut[i111+2];
-      }
-      else
-      {
-        output[0] = (1-rgbd[2])*clut[i000] + (rgbd[2]-rgbd[0])*clut[i001] + (rgbd[0]-rgbd[1])*clut[i101] + rgbd[1]*clut[i111];
-        output[1] = (1-rgbd[2])*clut[i000+1] + (rgbd[2]-rgbd[0])*clut[i001+1] + (rgbd[0]-rgbd[1])*clut[i101+1] + rgbd[1]*clut[i111+1];
-        output[2] = (1-rgbd[2])*clut[i000+2] + (rgbd[2]-rgbd[0])*clut[i001+2] + (rgbd[0]-rgbd[1])*clut[i101+2] + rgbd[1]*clut[i111+2];
-      }
-    }
-    else
-    {
-      if (rgbd[2] > rgbd[1])
-      {
-        output[0] = (1-rgbd[2])*clut[i000] + (rgbd[2]-rgbd[1])*clut[i001] + (rgbd[1]-rgbd[0])*clut[i011] + rgbd[0]*clut[i111];
-        output[1] = (1-rgbd[2])*clut[i000+1] + (rgbd[2]-rgbd[1])*clut[i001+1] + (rgbd[1]-rgbd[0])*clut[i011+1] + rgbd[0]*clut[i111+1];
-        output[2] = (1-rgbd[2])*clut[i000+2] + (rgbd[2]-rgbd[1])*clut[i001+2] + (rgbd[1]-rgbd[0])*clut[i011+2] + rgbd[0]*clut[i111+2];
-      }
-      else if (rgbd[2] > rgbd[0])
-      {
-        output[0] = (1-rgbd[1])*clut[i000] + (rgbd[1]-rgbd[2])*clut[i010] + (rgbd[2]-rgbd[0])*clut[i011] + rgbd[0]*clut[i111];
-        output[1] = (1-rgbd[1])*clut[i000+1] + (rgbd[1]-rgbd[2])*clut[i010+1] + (rgbd[2]-rgbd[0])*clut[i011+1] + rgbd[0]*clut[i111+1];
-        output[2] = (1-rgbd[1])*clut[i000+2] + (rgbd[1]-rgbd[2])*clut[i010+2] + (rgbd[2]-rgbd[0])*clut[i011+2] + rgbd[0]*clut[i111+2];
-      }
-      else
-      {
-        output[0] = (1-rgbd[1])*clut[i000] + (rgbd[1]-rgbd[0])*clut[i010] + (rgbd[0]-rgbd[2])*clut[i110] + rgbd[2]*clut[i111];
-        output[1] = (1-rgbd[1])*clut[i000+1] + (rgbd[1]-rgbd[0])*clut[i010+1] + (rgbd[0]-rgbd[2])*clut[i110+1] + rgbd[2]*clut[i111+1];
-        output[2] = (1-rgbd[1])*clut[i000+2] + (rgbd[1]-rgbd[0])*clut[i010+2] + (rgbd[0]-rgbd[2])*clut[i110+2] + rgbd[2]*clut[i111+2];
-      }
-    }
-  }
-}
-
-// from Study on the 3D Interpolation Models Used in Color Conversion
-// http://ijetch.org/papers/318-T860.pdf
-void correct_pixel_pyramid(const float *const in, float *const out,
-                           const size_t pixel_nb, const float *const restrict clut, const uint16_t level)
-{
-  const int level2 = level * level;
-#ifdef _OPENMP
-#pragma omp parallel for SIMD() default(none) \
-  dt_omp_firstprivate(clut, in, level, level2, out, pixel_nb) \
-  schedule(static)
+#ifdef HAVE_AVX512_CODEPATH
+void lut3d_interpolate_avx512(const float *const in, float *const out, const size_t npixels,
+                              const float *const clut, const int level, const int interpolation);
 #endif
-  for(size_t k = 0; k < (size_t)(pixel_nb * 4); k+=4)
-  {
-    float *const input = ((float *const)in) + k;
-    float *const output = ((float *const)out) + k;
-
-    int rgbi[3];
-    float rgbd[3];
-    for(int c = 0; c < 3; ++c) input[c] = fminf(fmaxf(input[c], 0.0f), 1.0f);
-
-    rgbd[0] = input[0] * (float)(level - 1);
-    rgbd[1] = input[1] * (float)(level - 1);
-    rgbd[2] = input[2] * (float)(level - 1);
-
-    rgbi[0] = CLAMP((int)rgbd[0], 0, level - 2);
-    rgbi[1] = CLAMP((int)rgbd[1], 0, level - 2);
-    rgbi[2] = CLAMP((int)rgbd[2], 0, level - 2);
-
-    rgbd[0] = rgbd[0] - rgbi[0]; // delta red
-    rgbd[1] = rgbd[1] - rgbi[1]; // delta green
-    rgbd[2] = rgbd[2] - rgbi[2]; // delta blue
-
-  // indexes of P000 to P111 in clut
-    const int color = rgbi[0] + rgbi[1] * level + rgbi[2] * level * level;
-    const int i000 = color * 3;                     // P000
-    const int i100 = i000 + 3;                      // P100
-    const int i010 = (color + level) * 3;           // P010
-    const int i110 = i010 + 3;                      // P110
-    const int i001 = (color + level2) * 3;          // P001
-    const int i101 = i001 + 3;                      // P101
-    const int i011 = (color + level + level2) * 3;  // P011
-    const int i111 = i011 + 3;                      // P111
-
-    if (rgbd[1] > rgbd[0] && rgbd[2] > rgbd[0])
-    {
-      output[0] = clut[i000] + (clut[i111]-clut[i011])*rgbd[0] + (clut[i010]-clut[i000])*rgbd[1] + (clut[i001]-clut[i000])*rgbd[2]
-        + (clut[i011]-clut[i001]-clut[i010]+clut[i000])*rgbd[1]*rgbd[2];
-      output[1] = clut[i000+1] + (clut[i111+1]-clut[i011+1])*rgbd[0] + (clut[i010+1]-clut[i000+1])*rgbd[1] + (clut[i001+1]-clut[i000+1])*rgbd[2]
-        + (clut[i011+1]-clut[i001+1]-clut[i010+1]+clut[i000+1])*rgbd[1]*rgbd[2];
-      output[2] = clut[i000+2] + (clut[i111+2]-clut[i011+2])*rgbd[0] + (clut[i010+2]-clut[i000+2])*rgbd[1] + (clut[i001+2]-clut[i000+2])*rgbd[2]
-        + (clut[i011+2]-clut[i001+2]-clut[i010+2]+clut[i000+2])*rgbd[1]*rgbd[2];
-    }
-    else if (rgbd[0] > rgbd[1] && rgbd[2] > rgbd[1])
-    {
-      output[0] = clut[i000] + (clut[i100]-clut[i000])*rgbd[0] + (clut[i111]-clut[i101])*rgbd[1] + (clut[i001]-clut[i000])*rgbd[2]
-        + (clut[i101]-clut[i001]-clut[i100]+clut[i000])*rgbd[0]*rgbd[2];
-      output[1] = clut[i000+1] + (clut[i100+1]-clut[i000+1])*rgbd[0] + (clut[i111+1]-clut[i101+1])*rgbd[1] + (clut[i001+1]-clut[i000+1])*rgbd[2]
-        + (clut[i101+1]-clut[i001+1]-clut[i100+1]+clut[i000+1])*rgbd[0]*rgbd[2];
-      output[2] = clut[i000+2] + (clut[i100+2]-clut[i000+2])*rgbd[0] + (clut[i111]-clut[i101+2])*rgbd[1] + (clut[i001+2]-clut[i000+2])*rgbd[2]
-        + (clut[i101+2]-clut[i001+2]-clut[i100+2]+clut[i000+2])*rgbd[0]*rgbd[2];
-    }
-    else
-    {
-      output[0] = clut[i000] + (clut[i100]-clut[i000])*rgbd[0] + (clut[i010]-clut[i000])*rgbd[1] + (clut[i111]-clut[i110])*rgbd[2]
-        + (clut[i110]-clut[i100]-clut[i010]+clut[i000])*rgbd[0]*rgbd[1];
-      output[1] = clut[i000+1] + (clut[i100+1]-clut[i000+1])*rgbd[0] + (clut[i010+1]-clut[i000+1])*rgbd[1] + (clut[i111+1]-clut[i110+1])*rgbd[2]
-        + (clut[i110+1]-clut[i100+1]-clut[i010+1]+clut[i000+1])*rgbd[0]*rgbd[1];
-      output[2] = clut[i000+2] + (clut[i100+2]-clut[i000+2])*rgbd[0] + (clut[i010+2]-clut[i000+2])*rgbd[1] + (clut[i111+2]-clut[i110+2])*rgbd[2]
-        + (clut[i110+2]-clut[i100+2]-clut[i010+2]+clut[i000+2])*rgbd[0]*rgbd[1];
-    }
-  }
-}
-
-void get_cache_filename(const char *const lutname, char *const cache_filename)
-{
-  char *cache_dir = g_build_filename(g_get_user_cache_dir(), "gmic", NULL);
-  char *cache_file = g_build_filename(cache_dir, lutname, NULL);
-  g_strlcpy(cache_filename, cache_file, DT_IOP_LUT3D_MAX_PATHNAME);
-  g_strlcpy(&cache_filename[strlen(cache_filename)], ".cimgz", DT_IOP_LUT3D_MAX_PATHNAME-strlen(cache_file));
-  g_free(cache_dir);
-  g_free(cache_file);
-}
-
-#ifdef HAVE_GMIC
-uint8_t calculate_clut_compressed(dt_iop_lut3d_params_t *const p, const char *const filepath, float **clut)
-{
-  uint8_t level = DT_IOP_LUT3D_CLUT_LEVEL;
-  float *lclut;
-  lclut = NULL;
-  char cache_filename[DT_IOP_LUT3D_MAX_PATHNAME];
-  size_t buf_size_lut;
-
-  get_cache_filename(p->lutname, cache_filename);
-  buf_size_lut = (size_t)(level * level * level * 3);
-  lclut = dt_alloc_align(16, buf_size_lut * sizeof(float));
-  if(!lclut)
-  {
-    fprintf(stderr, "[lut3d] error allocating buffer for gmz lut\n");
-    dt_control_log(_("error allocating buffer for gmz lut"));
-    level = 0;
-  }
-  else
-  {
-    level = lut3d_get_cached_clut(lclut, level, cache_filename);
-    if (!level)
-    {  //clut not in cache
-      char *c_clut = p->c_clut;
-      level = DT_IOP_LUT3D_CLUT_LEVEL;
-      lut3d_decompress_clut((const unsigned char *const)c_clut, p->nb_keypoints,
-        level, lclut, cache_filename);
-    }
-  }
-  *clut = lclut;
-  return level;
-}
-#endif // HAVE_GMIC
-
 
 uint16_t calculate_clut_haldclut(dt_iop_lut3d_params_t *const p, const char *const filepath, float **clut)
 {
@@ -1059,8 +791,10 @@ cleanup:
 }
 #endif
 
-void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ibuf, void *const obuf,
-             const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+static void _process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ibuf,
+                     void *const obuf, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out,
+                     void (*interpolate)(const float *const in, float *const out, const size_t npixels,
+                                         const float *const clut, const int level, const int interpolation))
 {
   dt_iop_lut3d_data_t *d = (dt_iop_lut3d_data_t *)piece->data;
   const int width = roi_in->width;
@@ -1086,23 +820,13 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
     {
       dt_ioppr_transform_image_colorspace_rgb(ibuf, obuf, width, height,
         work_profile, lut_profile, "work profile to LUT profile");
-      if (interpolation == DT_IOP_TETRAHEDRAL)
-        correct_pixel_tetrahedral(obuf, obuf, width * height, clut, level);
-      else if (interpolation == DT_IOP_TRILINEAR)
-        correct_pixel_trilinear(obuf, obuf, width * height, clut, level);
-      else
-        correct_pixel_pyramid(obuf, obuf, width * height, clut, level);
+      interpolate(obuf, obuf, (size_t)width * height, clut, level, interpolation);
       dt_ioppr_transform_image_colorspace_rgb(obuf, obuf, width, height,
         lut_profile, work_profile, "LUT profile to work profile");
     }
     else
     {
-      if (interpolation == DT_IOP_TETRAHEDRAL)
-        correct_pixel_tetrahedral(ibuf, obuf, width * height, clut, level);
-      else if (interpolation == DT_IOP_TRILINEAR)
-        correct_pixel_trilinear(ibuf, obuf, width * height, clut, level);
-      else
-        correct_pixel_pyramid(ibuf, obuf, width * height, clut, level);
+      interpolate(ibuf, obuf, (size_t)width * height, clut, level, interpolation);
     }
   }
   else  // no clut
@@ -1111,6 +835,28 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   }
 }
 
+void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ibuf, void *const obuf,
+             const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+  _process(self, piece, ibuf, obuf, roi_in, roi_out, lut3d_interpolate_plain);
+}
+
+#ifdef HAVE_AVX2_CODEPATH
+void process_avx2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ibuf,
+                  void *const obuf, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+  _process(self, piece, ibuf, obuf, roi_in, roi_out, lut3d_interpolate_avx2);
+}
+#endif
+
+#ifdef HAVE_AVX512_CODEPATH
+void process_avx512(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ibuf,
+                    void *const obuf, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+  _process(self, piece, ibuf, obuf, roi_in, roi_out, lut3d_interpolate_avx512);
+}
+#endif
+
 void filepath_set_unix_separator(char *filepath)
 { // use the unix separator as it works also on windows
   const int len = strlen(filepath);
@@ -1129,13 +875,12 @@ void init_global(dt_iop_module_so_t *module)
   gd->kernel_lut3d_pyramid = dt_opencl_create_kernel(program, "lut3d_pyramid");
   gd->kernel_lut3d_none = dt_opencl_create_kernel(program, "lut3d_none");
 
-#ifdef HAVE_GMIC
-  // make sure the cache dir exists
-  char *cache_dir = g_build_filename(g_get_user_cache_dir(), "gmic", NULL);
-  char *cache_gmic_dir = dt_loc_init_generic(cache_dir, NULL);
-  g_free(cache_dir);
-  g_free(cache_gmic_dir);
-#endif // HAVE_GMIC
+  // make sure the cache dir of the parsed and decompressed luts exists
+  char cachedir[PATH_MAX] = { 0 };
+  dt_loc_get_user_cache_dir(cachedir, sizeof(cachedir));
+  char *lut_cache_dir = g_build_filename(cachedir, "lut3d", NULL);
+  g_mkdir_with_parents(lut_cache_dir, 0750);
+  g_free(lut_cache_dir);
 }
 
 void cleanup_global(dt_iop_module_so_t *module)
@@ -1149,7 +894,361 @@ void cleanup_global(dt_iop_module_so_t *module)
   module->data = NULL;
 }
 
-static int calculate_clut(dt_iop_lut3d_params_t *const p, float **clut)
+// parsed cube, 3dl and png luts are kept in the cache dir as raw floats, the big cube files take far longer
+// to parse than to read back. the file name is the checksum of the lut path, the header has the path too
+// and the mtime and size of the lut file, so an edited or replaced lut is parsed again.
+#define DT_IOP_LUT3D_CACHE_MAGIC 0x4433554cu // "LU3D"
+#define DT_IOP_LUT3D_CACHE_VERSION 1
+
+typedef struct dt_iop_lut3d_cache_header_t
+{
+  uint32_t magic;
+  uint32_t version;
+  int64_t mtime;
+  int64_t size;
+  uint32_t level;
+  uint32_t path_len;
+} dt_iop_lut3d_cache_header_t;
+
+static gchar *_lut_cache_filename(const char *const fullpath)
+{
+  char cachedir[PATH_MAX] = { 0 };
+  dt_loc_get_user_cache_dir(cachedir, sizeof(cachedir));
+  gchar *checksum = g_compute_checksum_for_string(G_CHECKSUM_MD5, fullpath, -1);
+  gchar *name = g_strconcat(checksum, ".bin", NULL);
+  gchar *filename = g_build_filename(cachedir, "lut3d", name, NULL);
+  g_free(name);
+  g_free(checksum);
+  return filename;
+}
+
+static gboolean _lut_cache_stat(const char *const fullpath, dt_iop_lut3d_cache_header_t *const h)
+{
+  GStatBuf st;
+  if(g_stat(fullpath, &st)) return FALSE;
+  h->magic = DT_IOP_LUT3D_CACHE_MAGIC;
+  h->version = DT_IOP_LUT3D_CACHE_VERSION;
+  h->mtime = (int64_t)st.st_mtime;
+  h->size = (int64_t)st.st_size;
+  h->level = 0;
+  h->path_len = strlen(fullpath);
+  return TRUE;
+}
+
+// reads the lut of cache file filename if its header matches expected, and path, of expected->path_len bytes.
+// any level goes if expected->level is 0. returns the level, 0 if the file is missing or does not match
+static uint16_t _cache_file_read(const char *const filename, const dt_iop_lut3d_cache_header_t *const expected,
+                                 const char *const path, float **clut)
+{
+  FILE *f = g_fopen(filename, "rb");
+  if(!f) return 0;
+
+  dt_iop_lut3d_cache_header_t h;
+  uint16_t level = 0;
+  char *path_read = NULL;
+  float *lclut = NULL;
+  if(fread(&h, sizeof(h), 1, f) != 1 || h.magic != expected->magic || h.version != expected->version
+     || h.mtime != expected->mtime || h.size != expected->size || h.path_len != expected->path_len
+     || h.level < 2 || h.level > 256 || (expected->level && h.level != expected->level))
+    goto end;
+  path_read = g_malloc(h.path_len + 1);
+  if(fread(path_read, 1, h.path_len, f) != h.path_len || memcmp(path_read, path, h.path_len)) goto end;
+  const size_t buf_size = (size_t)h.level * h.level * h.level * 3;
+  lclut = dt_alloc_align(16, buf_size * sizeof(float));
+  if(!lclut || fread(lclut, sizeof(float), buf_size, f) != buf_size) goto end;
+  *clut = lclut;
+  lclut = NULL;
+  level = h.level;
+end:
+  dt_free_align(lclut);
+  g_free(path_read);
+  fclose(f);
+  return level;
+}
+
+static void _cache_file_write(const char *const filename, const dt_iop_lut3d_cache_header_t *const h,
+                              const char *const path, const float *const clut)
+{
+  // written aside and renamed, so that a concurrent reader never sees half a file. the background jobs may
+  // write the same lut at the same time, each thread has its own temporary file
+  gchar *tmpname = g_strdup_printf("%s.%p.tmp", filename, (void *)g_thread_self());
+  FILE *f = g_fopen(tmpname, "wb");
+  if(f)
+  {
+    const size_t buf_size = (size_t)h->level * h->level * h->level * 3;
+    const gboolean ok = fwrite(h, sizeof(*h), 1, f) == 1 && fwrite(path, 1, h->path_len, f) == h->path_len
+                        && fwrite(clut, sizeof(float), buf_size, f) == buf_size;
+    if(fclose(f) || !ok || g_rename(tmpname, filename))
+    {
+      fprintf(stderr, "[lut3d] could not write the lut cache file %s\n", filename);
+      g_unlink(tmpname);
+    }
+  }
+  g_free(tmpname);
+}
+
+// returns the level of the cached lut of fullpath, 0 if there is none or it is stale
+static uint16_t _lut_cache_read(const char *const fullpath, float **clut)
+{
+  dt_iop_lut3d_cache_header_t expected;
+  if(!_lut_cache_stat(fullpath, &expected)) return 0;
+  gchar *filename = _lut_cache_filename(fullpath);
+  const uint16_t level = _cache_file_read(filename, &expected, fullpath, clut);
+  g_free(filename);
+  if(level) dt_print(DT_DEBUG_DEV, "[lut3d] read cached lut of %s, level %d\n", fullpath, level);
+  return level;
+}
+
+static void _lut_cache_write(const char *const fullpath, const float *const clut, const uint16_t level)
+{
+  dt_iop_lut3d_cache_header_t h;
+  if(!_lut_cache_stat(fullpath, &h)) return;
+  h.level = level;
+  gchar *filename = _lut_cache_filename(fullpath);
+  _cache_file_write(filename, &h, fullpath, clut);
+  g_free(filename);
+}
+
+#ifdef HAVE_GMIC
+// g'mic needs seconds to decompress a gmz lut at the full level. the decompressed luts are cached as well,
+// per level, under the checksum of the keypoints which the params embed, so a lut is found again whichever
+// pack and history it comes from. a darkroom pipe missing the full lut gets the coarse one at once and a
+// background job decompresses the full one, and the luts of a pack are all decompressed once it is opened.
+static GMutex _gmz_lock;
+static GHashTable *_gmz_pending = NULL; // cache files being decompressed, and whether a pipe waits for them
+static gchar *_gmz_pack = NULL;         // the last pack queued for decompression
+
+static gchar *_gmz_cache_filename(const unsigned char *const keypoints, const int nb_keypoints, const int level)
+{
+  char cachedir[PATH_MAX] = { 0 };
+  dt_loc_get_user_cache_dir(cachedir, sizeof(cachedir));
+  gchar *checksum = g_compute_checksum_for_data(G_CHECKSUM_MD5, keypoints, (gsize)nb_keypoints * 6);
+  gchar *name = g_strdup_printf("%s-%d.bin", checksum, level);
+  gchar *filename = g_build_filename(cachedir, "lut3d", name, NULL);
+  g_free(name);
+  g_free(checksum);
+  return filename;
+}
+
+static void _gmz_cache_header(const int nb_keypoints, const int level, dt_iop_lut3d_cache_header_t *const h)
+{
+  h->magic = DT_IOP_LUT3D_CACHE_MAGIC;
+  h->version = DT_IOP_LUT3D_CACHE_VERSION;
+  h->mtime = 0;
+  h->size = nb_keypoints;
+  h->level = level;
+  h->path_len = 0;
+}
+
+static uint16_t _gmz_cache_read(const unsigned char *const keypoints, const int nb_keypoints, const int level,
+                                float **clut)
+{
+  dt_iop_lut3d_cache_header_t expected;
+  _gmz_cache_header(nb_keypoints, level, &expected);
+  gchar *filename = _gmz_cache_filename(keypoints, nb_keypoints, level);
+  const uint16_t read = _cache_file_read(filename, &expected, "", clut);
+  g_free(filename);
+  return read;
+}
+
+static gboolean _gmz_cache_exists(const unsigned char *const keypoints, const int nb_keypoints, const int level)
+{
+  gchar *filename = _gmz_cache_filename(keypoints, nb_keypoints, level);
+  const gboolean exists = g_file_test(filename, G_FILE_TEST_IS_REGULAR);
+  g_free(filename);
+  return exists;
+}
+
+// decompresses the lut at level and caches it. returns the level, 0 on failure
+static uint16_t _gmz_decompress(const unsigned char *const keypoints, const int nb_keypoints, const int level,
+                                float **clut)
+{
+  const size_t buf_size = (size_t)level * level * level * 3;
+  float *lclut = dt_alloc_align(16, buf_size * sizeof(float));
+  if(!lclut)
+  {
+    fprintf(stderr, "[lut3d] error allocating buffer for gmz lut\n");
+    dt_control_log(_("error allocating buffer for gmz lut"));
+    return 0;
+  }
+  if(!lut3d_decompress_clut(keypoints, nb_keypoints, level, lclut))
+  {
+    dt_free_align(lclut);
+    return 0;
+  }
+  dt_iop_lut3d_cache_header_t h;
+  _gmz_cache_header(nb_keypoints, level, &h);
+  gchar *filename = _gmz_cache_filename(keypoints, nb_keypoints, level);
+  _cache_file_write(filename, &h, "", lclut);
+  g_free(filename);
+  *clut = lclut;
+  return level;
+}
+
+// the darkroom pipes which run with the coarse lut pick up the full one in commit_params
+static gboolean _gmz_reprocess(gpointer user_data)
+{
+  dt_dev_reprocess_all(darktable.develop);
+  return FALSE;
+}
+
+// marks filename as being decompressed, FALSE if that is under way already. with wait, the darkroom is
+// reprocessed once it is done, whoever does it
+static gboolean _gmz_claim(const char *const filename, const gboolean wait)
+{
+  g_mutex_lock(&_gmz_lock);
+  if(!_gmz_pending) _gmz_pending = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  const gboolean claimed = !g_hash_table_contains(_gmz_pending, filename);
+  if(claimed || wait) g_hash_table_insert(_gmz_pending, g_strdup(filename), GINT_TO_POINTER(wait));
+  g_mutex_unlock(&_gmz_lock);
+  return claimed;
+}
+
+static void _gmz_release(const char *const filename, const gboolean done)
+{
+  g_mutex_lock(&_gmz_lock);
+  const gboolean waited = GPOINTER_TO_INT(g_hash_table_lookup(_gmz_pending, filename));
+  g_hash_table_remove(_gmz_pending, filename);
+  g_mutex_unlock(&_gmz_lock);
+  if(done && waited) g_idle_add(_gmz_reprocess, NULL);
+}
+
+typedef struct dt_iop_lut3d_gmz_job_t
+{
+  unsigned char keypoints[DT_IOP_LUT3D_MAX_KEYPOINTS * 2 * 3];
+  int nb_keypoints;
+  gchar *filename; // of the full lut in the cache, claimed
+  gboolean done;
+} dt_iop_lut3d_gmz_job_t;
+
+static int32_t _gmz_job_run(dt_job_t *job)
+{
+  dt_iop_lut3d_gmz_job_t *j = (dt_iop_lut3d_gmz_job_t *)dt_control_job_get_params(job);
+  float *clut = NULL;
+  j->done = _gmz_cache_exists(j->keypoints, j->nb_keypoints, DT_IOP_LUT3D_CLUT_LEVEL)
+            || _gmz_decompress(j->keypoints, j->nb_keypoints, DT_IOP_LUT3D_CLUT_LEVEL, &clut);
+  dt_free_align(clut);
+  return j->done ? 0 : 1;
+}
+
+// called also if the job never ran
+static void _gmz_job_destroy(void *data)
+{
+  dt_iop_lut3d_gmz_job_t *j = (dt_iop_lut3d_gmz_job_t *)data;
+  _gmz_release(j->filename, j->done);
+  g_free(j->filename);
+  free(j);
+}
+
+// decompresses the full lut in the background, unless that is under way already
+static void _gmz_queue(const unsigned char *const keypoints, const int nb_keypoints)
+{
+  gchar *filename = _gmz_cache_filename(keypoints, nb_keypoints, DT_IOP_LUT3D_CLUT_LEVEL);
+  if(!_gmz_claim(filename, TRUE))
+  {
+    g_free(filename);
+    return;
+  }
+  dt_iop_lut3d_gmz_job_t *j = (dt_iop_lut3d_gmz_job_t *)malloc(sizeof(dt_iop_lut3d_gmz_job_t));
+  dt_job_t *job = dt_control_job_create(_gmz_job_run, "lut3d decompress");
+  if(!j || !job)
+  {
+    _gmz_release(filename, FALSE);
+    g_free(filename);
+    free(j);
+    dt_control_job_dispose(job);
+    return;
+  }
+  memcpy(j->keypoints, keypoints, (size_t)nb_keypoints * 6);
+  j->nb_keypoints = nb_keypoints;
+  j->filename = filename;
+  j->done = FALSE;
+  dt_control_job_set_params(job, j, _gmz_job_destroy);
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_BG, job);
+}
+
+static int32_t _gmz_pack_job_run(dt_job_t *job)
+{
+  const char *const fullpath = (const char *)dt_control_job_get_params(job);
+  unsigned char *keypoints = NULL;
+  int *nb_keypoints = NULL;
+  const int nb_lut = lut3d_read_gmz_pack(fullpath, &keypoints, &nb_keypoints);
+  int done = 0;
+
+  // every lut is decompressed by its own g'mic instance, the luts are independent. half of the cores are left
+  // to the pipes
+#ifdef _OPENMP
+  const int nthreads = MAX(1, dt_get_num_threads() / 2);
+#pragma omp parallel for default(none) dt_omp_firstprivate(nb_lut, keypoints, nb_keypoints, job) \
+  shared(done) num_threads(nthreads) schedule(dynamic)
+#endif
+  for(int l = 0; l < nb_lut; l++)
+  {
+    if(dt_control_job_get_state(job) == DT_JOB_STATE_CANCELLED) continue;
+    const unsigned char *const kp = keypoints + (size_t)l * DT_IOP_LUT3D_MAX_KEYPOINTS * 6;
+    const int nb = nb_keypoints[l];
+    if(nb && !_gmz_cache_exists(kp, nb, DT_IOP_LUT3D_CLUT_LEVEL))
+    {
+      gchar *filename = _gmz_cache_filename(kp, nb, DT_IOP_LUT3D_CLUT_LEVEL);
+      if(_gmz_claim(filename, FALSE))
+      {
+        float *clut = NULL;
+        const gboolean decompressed = _gmz_decompress(kp, nb, DT_IOP_LUT3D_CLUT_LEVEL, &clut);
+        dt_free_align(clut);
+        _gmz_release(filename, decompressed);
+      }
+      g_free(filename);
+    }
+    dt_control_job_set_progress(job, (double)__sync_add_and_fetch(&done, 1) / nb_lut);
+  }
+
+  free(keypoints);
+  free(nb_keypoints);
+  return 0;
+}
+
+// decompresses all the luts of the pack at fullpath in the background, once per pack and session
+static void _gmz_queue_pack(const char *const fullpath)
+{
+  if(!dt_conf_get_bool("plugins/darkroom/lut3d/gmz_decompress_pack")) return;
+  g_mutex_lock(&_gmz_lock);
+  const gboolean queued = !g_strcmp0(_gmz_pack, fullpath);
+  if(!queued)
+  {
+    g_free(_gmz_pack);
+    _gmz_pack = g_strdup(fullpath);
+  }
+  g_mutex_unlock(&_gmz_lock);
+  if(queued) return;
+
+  dt_job_t *job = dt_control_job_create(_gmz_pack_job_run, "lut3d decompress pack");
+  if(!job) return;
+  dt_control_job_set_params(job, g_strdup(fullpath), g_free);
+  dt_control_job_add_progress(job, _("decompressing 3D luts"), TRUE);
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_BG, job);
+}
+
+// the full lut from the cache, or else decompressed. in an interactive pipe the coarse lut stands in while the
+// full one is decompressed in the background
+static uint16_t calculate_clut_compressed(dt_iop_lut3d_params_t *const p, const gboolean interactive,
+                                          float **clut)
+{
+  const unsigned char *const keypoints = (const unsigned char *)p->c_clut;
+  uint16_t level = _gmz_cache_read(keypoints, p->nb_keypoints, DT_IOP_LUT3D_CLUT_LEVEL, clut);
+  if(level) return level;
+
+  if(interactive)
+  {
+    _gmz_queue(keypoints, p->nb_keypoints);
+    level = _gmz_cache_read(keypoints, p->nb_keypoints, DT_IOP_LUT3D_CLUT_COARSE_LEVEL, clut);
+    if(!level) level = _gmz_decompress(keypoints, p->nb_keypoints, DT_IOP_LUT3D_CLUT_COARSE_LEVEL, clut);
+    if(level) return level;
+  }
+  return _gmz_decompress(keypoints, p->nb_keypoints, DT_IOP_LUT3D_CLUT_LEVEL, clut);
+}
+#endif // HAVE_GMIC
+
+static int calculate_clut(dt_iop_lut3d_params_t *const p, const gboolean interactive, float **clut)
 {
   uint16_t level = 0;
   const char *filepath = p->filepath;
@@ -1157,7 +1256,7 @@ static int calculate_clut(dt_iop_lut3d_params_t *const p, float **clut)
   if (p->nb_keypoints && filepath[0])
   {
     // compressed in params. no need to read the file
-    level = calculate_clut_compressed(p, filepath, clut);
+    level = calculate_clut_compressed(p, interactive, clut);
   }
   else
   { // read the file
@@ -1166,7 +1265,12 @@ static int calculate_clut(dt_iop_lut3d_params_t *const p, float **clut)
     if (filepath[0] && lutfolder[0])
     {
       char *fullpath = g_build_filename(lutfolder, filepath, NULL);
-      if (g_str_has_suffix (filepath, ".png") || g_str_has_suffix (filepath, ".PNG"))
+      const uint16_t cached = _lut_cache_read(fullpath, clut);
+      if (cached)
+      {
+        level = cached;
+      }
+      else if (g_str_has_suffix (filepath, ".png") || g_str_has_suffix (filepath, ".PNG"))
       {
         level = calculate_clut_haldclut(p, fullpath, clut);
       }
@@ -1178,6 +1282,7 @@ static int calculate_clut(dt_iop_lut3d_params_t *const p, float **clut)
       {
         level = calculate_clut_3dl(fullpath, clut);
       }
+      if (level && !cached) _lut_cache_write(fullpath, *clut, level);
       g_free(fullpath);
     }
     g_free(lutfolder);
@@ -1300,6 +1405,7 @@ static void get_compressed_clut(dt_iop_module_t *self, gboolean newlutname)
     if (g_str_has_suffix (p->filepath, ".gmz") || g_str_has_suffix (p->filepath, ".GMZ"))
     {
       char *fullpath = g_build_filename(lutfolder, p->filepath, NULL);
+      if (!newlutname) _gmz_queue_pack(fullpath);
       gboolean lut_found = lut3d_read_gmz(&p->nb_keypoints, (unsigned char *const)p->c_clut, fullpath,
               &nb_lut, (void *)g, p->lutname, newlutname);
       // to be able to fix evolution issue, keep the gmic version with the compressed lut
@@ -1357,7 +1463,13 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
   dt_iop_lut3d_params_t *p = (dt_iop_lut3d_params_t *)p1;
   dt_iop_lut3d_data_t *d = (dt_iop_lut3d_data_t *)piece->data;
 
-  if (strcmp(p->filepath, d->params.filepath) != 0 || strcmp(p->lutname, d->params.lutname) != 0 )
+  gboolean reload = strcmp(p->filepath, d->params.filepath) != 0 || strcmp(p->lutname, d->params.lutname) != 0;
+#ifdef HAVE_GMIC
+  // the full lut may be decompressed by now
+  if (!reload && d->coarse)
+    reload = _gmz_cache_exists((const unsigned char *)p->c_clut, p->nb_keypoints, DT_IOP_LUT3D_CLUT_LEVEL);
+#endif // HAVE_GMIC
+  if (reload)
   { // new clut file
     if (d->clut)
     { // reset current clut if any
@@ -1365,9 +1477,15 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
       d->clut = NULL;
       d->level = 0;
     }
-    d->level = calculate_clut(p, &d->clut);
+    // the darkroom pipes must not wait for a gmz lut to be decompressed
+    const gboolean interactive = self->dev->gui_attached
+      && (pipe->type & (DT_DEV_PIXELPIPE_FULL | DT_DEV_PIXELPIPE_PREVIEW | DT_DEV_PIXELPIPE_PREVIEW2));
+    d->level = calculate_clut(p, interactive, &d->clut);
+    d->coarse = p->nb_keypoints && d->level == DT_IOP_LUT3D_CLUT_COARSE_LEVEL;
   }
   memcpy(&d->params, p, sizeof(dt_iop_lut3d_params_t));
+  // same params, same pipe, but the synch of _gmz_reprocess() must get here again to swap the luts
+  piece->commit_again = d->coarse;
 }
 
 void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
@@ -1377,6 +1495,7 @@ void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pi
   memcpy(&d->params, self->default_params, sizeof(dt_iop_lut3d_params_t));
   d->clut = NULL;
   d->level = 0;
+  d->coarse = FALSE;
   d->params.filepath[0] = '\0';
   self->commit_params(self, self->default_params, pipe, piece);
 }
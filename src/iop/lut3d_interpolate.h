@@ -0,0 +1,160 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// tetrahedral, trilinear and pyramid interpolation in a 3D lut. included by lut3d.c and by lut3d_avx2.c /
+// lut3d_avx512.c, which are built with the flags of their instruction set. the corners of the cell are
+// picked with selects instead of branches, so the loops turn into vector code where the lut reads are
+// gathers. define LUT3D_INTERPOLATE to the name of the function before including.
+
+#include "common/darktable.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// clamps to [0, top] with plain selects, NaN goes to 0. fminf() / fmaxf() keep the loops from being vectorized
+// without -ffinite-math-only.
+static inline float _lut3d_clip(const float x, const float top)
+{
+  const float p = x > 0.0f ? x : 0.0f;
+  return p < top ? p : top;
+}
+
+static inline float _lut3d_max(const float a, const float b)
+{
+  return a > b ? a : b;
+}
+
+static inline float _lut3d_min(const float a, const float b)
+{
+  return a < b ? a : b;
+}
+
+// the cell of the pixel: offset of its P000 corner in clut and the position inside it
+#define LUT3D_CELL                                                                                           \
+  const float r = _lut3d_clip(in[4 * k + 0] * (float)(level - 1), (float)(level - 1));                      \
+  const float g = _lut3d_clip(in[4 * k + 1] * (float)(level - 1), (float)(level - 1));                      \
+  const float b = _lut3d_clip(in[4 * k + 2] * (float)(level - 1), (float)(level - 1));                      \
+  const int ri = MIN((int)r, level - 2);                                                                     \
+  const int gi = MIN((int)g, level - 2);                                                                     \
+  const int bi = MIN((int)b, level - 2);                                                                     \
+  const float dr = r - ri;                                                                                   \
+  const float dg = g - gi;                                                                                   \
+  const float db = b - bi;                                                                                   \
+  const int i000 = (ri + gi * level + bi * level2) * 3;
+
+// interpolation is one of the DT_IOP_TETRAHEDRAL, DT_IOP_TRILINEAR, DT_IOP_PYRAMID values of lut3d.c
+void LUT3D_INTERPOLATE(const float *const in, float *const out, const size_t npixels, const float *const clut,
+                       const int level, const int interpolation)
+{
+  const int level2 = level * level;
+  // clut offsets of a step along r, g and b
+  const int sr = 3, sg = 3 * level, sb = 3 * level2;
+
+  if(interpolation == 0)
+  {
+    // from OpenColorIO: the cell is cut in 6 tetrahedra along its diagonal. walking from P000 to P111 along
+    // the axes in decreasing order of the deltas gives the 4 corners, weighted by the differences of the deltas.
+#ifdef _OPENMP
+#pragma omp parallel for simd default(none) \
+  dt_omp_firstprivate(in, out, npixels, clut, level, level2, sr, sg, sb) \
+  schedule(static)
+#endif
+    for(size_t k = 0; k < npixels; k++)
+    {
+      LUT3D_CELL
+      const float hi = _lut3d_max(_lut3d_max(dr, dg), db);
+      const float lo = _lut3d_min(_lut3d_min(dr, dg), db);
+      const float mid = _lut3d_max(_lut3d_min(dr, dg), _lut3d_min(_lut3d_max(dr, dg), db));
+      // ties go to r for the largest and to b for the smallest delta, so both are always different axes
+      const int s_hi = (dr >= dg && dr >= db) ? sr : ((dg >= db) ? sg : sb);
+      const int s_lo = (db <= dr && db <= dg) ? sb : ((dg <= dr) ? sg : sr);
+      const int i1 = i000 + s_hi;
+      const int i2 = i000 + (sr + sg + sb - s_lo);
+      const int i111 = i000 + sr + sg + sb;
+      const float w0 = 1.0f - hi, w1 = hi - mid, w2 = mid - lo, w3 = lo;
+      for(int c = 0; c < 3; c++)
+        out[4 * k + c] = w0 * clut[i000 + c] + w1 * clut[i1 + c] + w2 * clut[i2 + c] + w3 * clut[i111 + c];
+    }
+  }
+  else if(interpolation == 1)
+  {
+    // from `HaldCLUT_correct.c' by Eskil Steenberg (http://www.quelsolaar.com) (BSD licensed)
+#ifdef _OPENMP
+#pragma omp parallel for simd default(none) \
+  dt_omp_firstprivate(in, out, npixels, clut, level, level2, sr, sg, sb) \
+  schedule(static)
+#endif
+    for(size_t k = 0; k < npixels; k++)
+    {
+      LUT3D_CELL
+      for(int c = 0; c < 3; c++)
+      {
+        const int i = i000 + c;
+        const float c00 = clut[i] * (1.0f - dr) + clut[i + sr] * dr;
+        const float c10 = clut[i + sg] * (1.0f - dr) + clut[i + sg + sr] * dr;
+        const float c01 = clut[i + sb] * (1.0f - dr) + clut[i + sb + sr] * dr;
+        const float c11 = clut[i + sb + sg] * (1.0f - dr) + clut[i + sb + sg + sr] * dr;
+        const float c0 = c00 * (1.0f - dg) + c10 * dg;
+        const float c1 = c01 * (1.0f - dg) + c11 * dg;
+        out[4 * k + c] = c0 * (1.0f - db) + c1 * db;
+      }
+    }
+  }
+  else
+  {
+    // from Study on the 3D Interpolation Models Used in Color Conversion
+    // http://ijetch.org/papers/318-T860.pdf
+    // the cell is cut in 3 pyramids with their apex in P111, the base is on the face of the smallest delta.
+    // along the two other axes (u, v) the base is bilinear, along the smallest one (w) it is linear.
+#ifdef _OPENMP
+#pragma omp parallel for simd default(none) \
+  dt_omp_firstprivate(in, out, npixels, clut, level, level2, sr, sg, sb) \
+  schedule(static)
+#endif
+    for(size_t k = 0; k < npixels; k++)
+    {
+      LUT3D_CELL
+      const int r_lo = (dg > dr && db > dr);
+      const int g_lo = !r_lo && (dr > dg && db > dg);
+      // the smallest axis w and the base axes u, v
+      const float w = r_lo ? dr : (g_lo ? dg : db);
+      const float u = r_lo ? dg : dr;
+      const float v = (r_lo || g_lo) ? db : dg;
+      const int s_u = r_lo ? sg : sr;
+      const int s_v = (r_lo || g_lo) ? sb : sg;
+      for(int c = 0; c < 3; c++)
+      {
+        const int i = i000 + c;
+        const float p000 = clut[i];
+        const float pu = clut[i + s_u], pv = clut[i + s_v], puv = clut[i + s_u + s_v];
+        const float p111 = clut[i + sr + sg + sb];
+        out[4 * k + c] = p000 + (pu - p000) * u + (pv - p000) * v + (p111 - puv) * w
+                         + (puv - pu - pv + p000) * u * v;
+      }
+    }
+  }
+}
+
+#undef LUT3D_CELL
+#undef LUT3D_INTERPOLATE
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -17,30 +17,57 @@
 
 #define cimg_verbosity 0
 #include <gmic.h>
+#include <cstdlib>
 #include <iostream>
 #include <string>
 
 extern "C" {
 
 // otherwise the name will be mangled and the linker won't be able to see the function ...
-void lut3d_decompress_clut(const unsigned char *const input_keypoints, const unsigned int nb_input_keypoints,
-                    const unsigned int output_resolution, float *const output_clut_data,
-                    const char *const filename);
-
-unsigned int lut3d_get_cached_clut(float *const output_clut_data, const unsigned int output_resolution,
-                    const char *const filename);
+gboolean lut3d_decompress_clut(const unsigned char *const input_keypoints, const unsigned int nb_input_keypoints,
+                    const unsigned int output_resolution, float *const output_clut_data);
 
 gboolean lut3d_read_gmz(int *const nb_keypoints, unsigned char *const keypoints, const char *const filename,
               int *const nb_lut, void *widget, const char *const lutname, const gboolean newlutname);
 
+int lut3d_read_gmz_pack(const char *const filename, unsigned char **keypoints, int **nb_keypoints);
+
 void lut3d_add_lutname_to_list(void *g, const char *const lutname);
 
 void lut3d_clear_lutname_list(void *g);
 }
 
-void lut3d_decompress_clut(const unsigned char *const input_keypoints, const unsigned int nb_input_keypoints,
-                     const unsigned int output_resolution, float *const output_clut_data,
-                     const char *const filename)
+#define LUT3D_GMZ_MAX_KEYPOINTS 2048
+
+// the keypoints of lut l of the pack as the rgb + 3 channels of the params. returns their number, 0 if this lut
+// cannot be used
+static int _gmz_keypoints(gmic_list<float> &image_list, gmic_list<char> &image_names, const unsigned int l,
+                          unsigned char *const keypoints)
+{
+  gmic_image<float>& img = image_list[l];
+  const int nb_kp = (int)img._height;
+  if (img._width == 1 && img._height <= LUT3D_GMZ_MAX_KEYPOINTS && img._depth == 1 && img._spectrum == 6)
+  { // color lut
+    for (int i = 0; i < nb_kp * 6; ++i)
+      keypoints[i] = (unsigned char)img[i];
+  }
+  else if (img._width == 1 && img._height <= LUT3D_GMZ_MAX_KEYPOINTS && img._depth == 1 && img._spectrum == 4)
+  { // black & white lut
+    for (int i = 0; i < nb_kp * 3; ++i)
+      keypoints[i] = (unsigned char)img[i];
+    for (int i = 0; i < nb_kp; ++i)
+      keypoints[nb_kp*3+i] = keypoints[nb_kp*4+i] = keypoints[nb_kp*5+i] = (unsigned char)img[nb_kp*3+i];
+  }
+  else
+  {
+    std::printf("[lut3d gmic] error: incompatible compressed LUT [%d] %s\n", l, image_names[l]._data);
+    return 0;
+  }
+  return nb_kp;
+}
+
+gboolean lut3d_decompress_clut(const unsigned char *const input_keypoints, const unsigned int nb_input_keypoints,
+                     const unsigned int output_resolution, float *const output_clut_data)
 {
   gmic_list<float> image_list;
   gmic_list<char> image_names;
@@ -67,17 +94,7 @@ void lut3d_decompress_clut(const unsigned char *const input_keypoints, const uns
   {
     std::printf("[lut3d gmic] error: \"%s\"\n", e.what());
     image_list.assign(0);
-    return;
-  }
-  // save in cache if possible - compatible G'MIC
-  try
-  {
-    std::snprintf(gmic_cmd, sizeof(gmic_cmd), "-o \"%s\",uchar", filename);
-    g_instance.run(gmic_cmd, image_list, image_names);
-  }
-  catch (...)
-  {
-    std::fprintf(stderr, "[lut3d gmic] error - saving cache lut (does the cache folder exist ?)\n");
+    return FALSE;
   }
   // format for dt
   try
@@ -88,69 +105,12 @@ void lut3d_decompress_clut(const unsigned char *const input_keypoints, const uns
   {
     std::printf("[lut3d gmic] error: \"%s\"\n", e.what());
     image_list.assign(0);
-    return;
+    return FALSE;
   }
   const size_t img_size = image_list[0]._width*image_list[0]._height*image_list[0]._depth*image_list[0]._spectrum;
   std::memcpy( output_clut_data, image_list[0]._data, img_size*sizeof(float));
   image_list.assign(0);
-}
-
-unsigned int lut3d_get_cached_clut(float *const output_clut_data, const unsigned int output_resolution,
-                  const char *const filename)
-{
-  gmic_list<float> image_list;
-  gmic_list<char> image_names;
-  char gmic_cmd[512];
-  gmic g_instance;
-  g_instance.verbosity = -1;
-  // get the cache file
-  try
-  {
-    std::snprintf(gmic_cmd, sizeof(gmic_cmd), "-i \"%s\"", filename);
-    g_instance.run(gmic_cmd, image_list, image_names);
-  }
-  catch (...)
-  { // no cached lut
-    image_list.assign(0);
-    return 0;
-  }
-  // expected LUT size ?
-  const unsigned int output_size = 3 * output_resolution * output_resolution * output_resolution;
-  unsigned int output_res = output_resolution;
-  size_t img_size = image_list[0]._width*image_list[0]._height*image_list[0]._depth*image_list[0]._spectrum;
-  if (output_size < img_size)  //downsize the cached lut
-  {
-    std::snprintf(gmic_cmd, sizeof(gmic_cmd), "-r %d,%d,%d,3,3", output_resolution, output_resolution, output_resolution);
-    try
-    {
-      g_instance.run(gmic_cmd, image_list, image_names);
-    }
-    catch(gmic_exception &e) // In case something went wrong.
-    {
-      std::printf("[lut3d gmic] error: \"%s\"\n", e.what());
-      image_list.assign(0);
-      return 0;
-    }
-    img_size = image_list[0]._width*image_list[0]._height*image_list[0]._depth*image_list[0]._spectrum;
-  }
-  else if (output_size > img_size) // reduce the expected lut size
-  {
-    output_res = image_list[0]._width;
-  }
-  // format for dt
-  try
-  {
-    g_instance.run("-div 255.0 -permute cxyz", image_list, image_names); // scale to [0,1]
-  }
-  catch(gmic_exception &e) // In case something went wrong.
-  {
-    std::printf("[lut3d gmic] error: \"%s\"\n", e.what());
-    image_list.assign(0);
-    return 0;
-  }
-  std::memcpy(output_clut_data, image_list[0]._data, img_size*sizeof(float));
-  image_list.assign(0);
-  return output_res;
+  return TRUE;
 }
 
 gboolean lut3d_read_gmz(int *const nb_keypoints, unsigned char *const keypoints, const char *const filename,
@@ -199,31 +159,57 @@ gboolean lut3d_read_gmz(int *const nb_keypoints, unsigned char *const keypoints,
     }
   }
 
-  int nb_kp = *nb_keypoints = (int)image_list[l]._height;
-  if (image_list[l]._width == 1 && image_list[l]._height <= 2048
-    && image_list[l]._depth == 1 && image_list[l]._spectrum == 6)
-  { // color lut
-    gmic_image<float>& img = image_list[l];
-    for (int i = 0; i < nb_kp * 6; ++i)
-      keypoints[i] = (unsigned char)img[i];
-  }
-  else if (image_list[l]._width == 1 && image_list[l]._height <= 2048
-    && image_list[l]._depth == 1 && image_list[l]._spectrum == 4)
-  { // black & white lut
-    gmic_image<float>& img = image_list[l];
-    for (int i = 0; i < nb_kp * 3; ++i)
-      keypoints[i] = (unsigned char)img[i];
-    for (int i = 0; i < nb_kp; ++i)
-      keypoints[nb_kp*3+i] = keypoints[nb_kp*4+i] = keypoints[nb_kp*5+i] = (unsigned char)img[nb_kp*3+i];
-  }
-  else
-    std::printf("[lut3d gmic] error: incompatible compressed LUT [%d] %s\n", l, image_names[l]._data);
+  *nb_keypoints = _gmz_keypoints(image_list, image_names, l, keypoints);
 
   image_list.assign(0);
   image_names.assign(0);
   return lut_found;
 }
 
+// the keypoints of all the luts of the pack, LUT3D_GMZ_MAX_KEYPOINTS * 6 bytes apart, and their numbers, 0 for
+// those which cannot be used. returns the number of luts, the caller frees both arrays
+int lut3d_read_gmz_pack(const char *const filename, unsigned char **keypoints, int **nb_keypoints)
+{
+  gmic_list<float> image_list;
+  gmic_list<char> image_names;
+  char gmic_cmd[512];
+  gmic g_instance;
+  g_instance.verbosity = -1;
+  *keypoints = NULL;
+  *nb_keypoints = NULL;
+  try
+  {
+    std::snprintf(gmic_cmd, sizeof(gmic_cmd), "-i \"%s\"", filename);
+    g_instance.run(gmic_cmd, image_list, image_names);
+  }
+  catch(gmic_exception &e) // In case something went wrong.
+  {
+    std::printf("[lut3d gmic] error: \"%s\"\n", e.what());
+    image_list.assign(0);
+    image_names.assign(0);
+    return 0;
+  }
+  const unsigned int nb_lut = image_list._width;
+  *keypoints = (unsigned char *)std::malloc((size_t)nb_lut * LUT3D_GMZ_MAX_KEYPOINTS * 6);
+  *nb_keypoints = (int *)std::malloc(sizeof(int) * nb_lut);
+  if (!*keypoints || !*nb_keypoints)
+  {
+    std::free(*keypoints);
+    std::free(*nb_keypoints);
+    *keypoints = NULL;
+    *nb_keypoints = NULL;
+    image_list.assign(0);
+    image_names.assign(0);
+    return 0;
+  }
+  for (unsigned int l = 0; l < nb_lut; ++l)
+    (*nb_keypoints)[l]
+        = _gmz_keypoints(image_list, image_names, l, *keypoints + (size_t)l * LUT3D_GMZ_MAX_KEYPOINTS * 6);
+  image_list.assign(0);
+  image_names.assign(0);
+  return (int)nb_lut;
+}
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -21,6 +21,7 @@
 #endif
 #include "bauhaus/bauhaus.h"
 #include "common/darktable.h"
+#include "common/opencl.h"
 #include "control/control.h"
 #include "develop/imageop.h"
 #include "develop/imageop_math.h"
@@ -88,6 +89,10 @@ typedef struct dt_iop_rawdenoise_data_t
 
 typedef struct dt_iop_rawdenoise_global_data_t
 {
+  int kernel_rawdenoise_extract;
+  int kernel_rawdenoise_hat_h;
+  int kernel_rawdenoise_hat_v;
+  int kernel_rawdenoise_insert;
 } dt_iop_rawdenoise_global_data_t;
 
 int legacy_params(dt_iop_module_t *self, const void *const old_params, const int old_version, void *new_params,
@@ -180,11 +185,10 @@ static void hat_transform(float *temp, const float *const base, int stride, int
 
 #define BIT16 65536.0
 
-static void wavelet_denoise(const float *const in, float *const out, const dt_iop_roi_t *const roi,
-                            dt_iop_rawdenoise_data_t *data, uint32_t filters)
+// noise of the wavelet bands of a cfa plane with the given color, as set by the curves
+static void _plane_noise(const dt_iop_rawdenoise_data_t *const data, const int color,
+                         float noise[DT_IOP_RAWDENOISE_BANDS])
 {
-  float threshold = data->threshold;
-  int lev;
   float noise_all[] = { 0.8002, 0.2735, 0.1202, 0.0585, 0.0291, 0.0152, 0.0080, 0.0044 };
   for(int i = 0; i < DT_IOP_RAWDENOISE_BANDS; i++)
   {
@@ -196,6 +200,33 @@ static void wavelet_denoise(const float *const in, float *const out, const dt_io
     noise_all[i] = noise_all[i] * threshold_exp_4 * 16.0;
   }
 
+  for(int i = 0; i < DT_IOP_RAWDENOISE_BANDS; i++)
+  {
+    float threshold_exp_4;
+    switch(color)
+    {
+      case 0:
+        threshold_exp_4 = data->force[DT_RAWDENOISE_R][DT_IOP_RAWDENOISE_BANDS - i - 1];
+        break;
+      case 2:
+        threshold_exp_4 = data->force[DT_RAWDENOISE_B][DT_IOP_RAWDENOISE_BANDS - i - 1];
+        break;
+      default:
+        threshold_exp_4 = data->force[DT_RAWDENOISE_G][DT_IOP_RAWDENOISE_BANDS - i - 1];
+        break;
+    }
+    threshold_exp_4 *= threshold_exp_4;
+    threshold_exp_4 *= threshold_exp_4;
+    noise[i] = noise_all[i] * threshold_exp_4 * 16.0;
+  }
+}
+
+static void wavelet_denoise(const float *const in, float *const out, const dt_iop_roi_t *const roi,
+                            dt_iop_rawdenoise_data_t *data, uint32_t filters)
+{
+  float threshold = data->threshold;
+  int lev;
+
   const size_t size = (size_t)(roi->width / 2 + 1) * (roi->height / 2 + 1);
 #if 0
   float maximum = 1.0;		/* FIXME */
@@ -213,25 +244,7 @@ static void wavelet_denoise(const float *const in, float *const out, const dt_io
   {
     int color = FC(c % 2, c / 2, filters);
     float noise[DT_IOP_RAWDENOISE_BANDS];
-    for(int i = 0; i < DT_IOP_RAWDENOISE_BANDS; i++)
-    {
-      float threshold_exp_4;
-      switch(color)
-      {
-        case 0:
-          threshold_exp_4 = data->force[DT_RAWDENOISE_R][DT_IOP_RAWDENOISE_BANDS - i - 1];
-          break;
-        case 2:
-          threshold_exp_4 = data->force[DT_RAWDENOISE_B][DT_IOP_RAWDENOISE_BANDS - i - 1];
-          break;
-        default:
-          threshold_exp_4 = data->force[DT_RAWDENOISE_G][DT_IOP_RAWDENOISE_BANDS - i - 1];
-          break;
-      }
-      threshold_exp_4 *= threshold_exp_4;
-      threshold_exp_4 *= threshold_exp_4;
-      noise[i] = noise_all[i] * threshold_exp_4 * 16.0;
-    }
+    _plane_noise(data, color, noise);
 
     // zero lowest quarter part
     memset(fimg, 0, size * sizeof(float));
@@ -366,19 +379,6 @@ static void wavelet_denoise_xtrans(const float *const in, float *out, const dt_i
                                    dt_iop_rawdenoise_data_t *data, const uint8_t (*const xtrans)[6])
 {
   float threshold = data->threshold;
-  // note that these constants are the same for X-Trans and Bayer, as
-  // they are proportional to image detail on each channel, not the
-  // sensor pattern
-  float noise_all[] = { 0.8002, 0.2735, 0.1202, 0.0585, 0.0291, 0.0152, 0.0080, 0.0044 };
-  for(int i = 0; i < DT_IOP_RAWDENOISE_BANDS; i++)
-  {
-    // scale the value from [0,1] to [0,16],
-    // and makes the "0.5" neutral value become 1
-    float threshold_exp_4 = data->force[DT_RAWDENOISE_ALL][DT_IOP_RAWDENOISE_BANDS - i - 1];
-    threshold_exp_4 *= threshold_exp_4;
-    threshold_exp_4 *= threshold_exp_4;
-    noise_all[i] = noise_all[i] * threshold_exp_4 * 16.0;
-  }
 
   const int width = roi->width;
   const int height = roi->height;
@@ -387,26 +387,11 @@ static void wavelet_denoise_xtrans(const float *const in, float *out, const dt_i
 
   for(int c = 0; c < 3; c++)
   {
+    // note that the band constants are the same for X-Trans and Bayer, as
+    // they are proportional to image detail on each channel, not the
+    // sensor pattern
     float noise[DT_IOP_RAWDENOISE_BANDS];
-    for(int i = 0; i < DT_IOP_RAWDENOISE_BANDS; i++)
-    {
-      float threshold_exp_4;
-      switch(c)
-      {
-        case 0:
-          threshold_exp_4 = data->force[DT_RAWDENOISE_R][DT_IOP_RAWDENOISE_BANDS - i - 1];
-          break;
-        case 2:
-          threshold_exp_4 = data->force[DT_RAWDENOISE_B][DT_IOP_RAWDENOISE_BANDS - i - 1];
-          break;
-        default:
-          threshold_exp_4 = data->force[DT_RAWDENOISE_G][DT_IOP_RAWDENOISE_BANDS - i - 1];
-          break;
-      }
-      threshold_exp_4 *= threshold_exp_4;
-      threshold_exp_4 *= threshold_exp_4;
-      noise[i] = noise_all[i] * threshold_exp_4 * 16.0;
-    }
+    _plane_noise(data, c, noise);
     memset(fimg, 0, size * sizeof(float));
 
 #ifdef _OPENMP
@@ -524,6 +509,116 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   }
 }
 
+#ifdef HAVE_OPENCL
+int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem dev_in, cl_mem dev_out,
+               const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+  dt_iop_rawdenoise_data_t *d = (dt_iop_rawdenoise_data_t *)piece->data;
+  dt_iop_rawdenoise_global_data_t *gd = (dt_iop_rawdenoise_global_data_t *)self->global_data;
+
+  cl_int err = -999;
+  cl_mem dev_low[2] = { NULL, NULL };
+  cl_mem dev_tmp = NULL;
+  cl_mem dev_acc = NULL;
+
+  const int devid = piece->pipe->devid;
+  const int width = roi_in->width;
+  const int height = roi_in->height;
+  const uint32_t filters = piece->pipe->dsc.filters;
+
+  if(!(d->threshold > 0.0f))
+  {
+    size_t origin[] = { 0, 0, 0 };
+    size_t region[] = { width, height, 1 };
+    err = dt_opencl_enqueue_copy_image(devid, dev_in, dev_out, origin, origin, region);
+    if(err != CL_SUCCESS) goto error;
+    return TRUE;
+  }
+
+  // the planes of the 2x2 cfa block, denoised one after the other as in wavelet_denoise()
+  const size_t plane = (size_t)((width + 1) / 2) * ((height + 1) / 2) * sizeof(float);
+  dev_low[0] = dt_opencl_alloc_device_buffer(devid, plane);
+  dev_low[1] = dt_opencl_alloc_device_buffer(devid, plane);
+  dev_tmp = dt_opencl_alloc_device_buffer(devid, plane);
+  dev_acc = dt_opencl_alloc_device_buffer(devid, plane);
+  if(dev_low[0] == NULL || dev_low[1] == NULL || dev_tmp == NULL || dev_acc == NULL) goto error;
+
+  for(int c = 0; c < 4; c++)
+  {
+    float noise[DT_IOP_RAWDENOISE_BANDS];
+    _plane_noise(d, FC(c % 2, c / 2, filters), noise);
+
+    const int offx = (c & 2) >> 1;
+    const int offy = c & 1;
+    const int hwidth = width / 2 + (width & (~(c >> 1)) & 1);
+    const int hheight = height / 2 + (height & (~c) & 1);
+    size_t sizes[3] = { ROUNDUPWD(hwidth), ROUNDUPHT(hheight), 1 };
+
+    dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_extract, 0, sizeof(cl_mem), (void *)&dev_in);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_extract, 1, sizeof(cl_mem), (void *)&dev_low[0]);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_extract, 2, sizeof(cl_mem), (void *)&dev_acc);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_extract, 3, sizeof(int), (void *)&hwidth);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_extract, 4, sizeof(int), (void *)&hheight);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_extract, 5, sizeof(int), (void *)&offx);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_extract, 6, sizeof(int), (void *)&offy);
+    err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_rawdenoise_extract, sizes);
+    if(err != CL_SUCCESS) goto error;
+
+    for(int lev = 0; lev < 5; lev++)
+    {
+      const int scale = 1 << lev;
+      const float thold = d->threshold * noise[lev];
+      cl_mem dev_prev = dev_low[lev & 1];
+      cl_mem dev_next = dev_low[(lev + 1) & 1];
+
+      dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_hat_h, 0, sizeof(cl_mem), (void *)&dev_prev);
+      dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_hat_h, 1, sizeof(cl_mem), (void *)&dev_tmp);
+      dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_hat_h, 2, sizeof(int), (void *)&hwidth);
+      dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_hat_h, 3, sizeof(int), (void *)&hheight);
+      dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_hat_h, 4, sizeof(int), (void *)&scale);
+      err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_rawdenoise_hat_h, sizes);
+      if(err != CL_SUCCESS) goto error;
+
+      dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_hat_v, 0, sizeof(cl_mem), (void *)&dev_tmp);
+      dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_hat_v, 1, sizeof(cl_mem), (void *)&dev_prev);
+      dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_hat_v, 2, sizeof(cl_mem), (void *)&dev_next);
+      dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_hat_v, 3, sizeof(cl_mem), (void *)&dev_acc);
+      dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_hat_v, 4, sizeof(int), (void *)&hwidth);
+      dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_hat_v, 5, sizeof(int), (void *)&hheight);
+      dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_hat_v, 6, sizeof(int), (void *)&scale);
+      dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_hat_v, 7, sizeof(float), (void *)&thold);
+      err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_rawdenoise_hat_v, sizes);
+      if(err != CL_SUCCESS) goto error;
+    }
+
+    // after the odd number of levels the coarsest one is in dev_low[1]
+    dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_insert, 0, sizeof(cl_mem), (void *)&dev_acc);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_insert, 1, sizeof(cl_mem), (void *)&dev_low[1]);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_insert, 2, sizeof(cl_mem), (void *)&dev_out);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_insert, 3, sizeof(int), (void *)&hwidth);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_insert, 4, sizeof(int), (void *)&hheight);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_insert, 5, sizeof(int), (void *)&offx);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_rawdenoise_insert, 6, sizeof(int), (void *)&offy);
+    err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_rawdenoise_insert, sizes);
+    if(err != CL_SUCCESS) goto error;
+  }
+
+  dt_opencl_release_mem_object(dev_low[0]);
+  dt_opencl_release_mem_object(dev_low[1]);
+  dt_opencl_release_mem_object(dev_tmp);
+  dt_opencl_release_mem_object(dev_acc);
+  return TRUE;
+
+error:
+  dt_opencl_release_mem_object(dev_low[0]);
+  dt_opencl_release_mem_object(dev_low[1]);
+  dt_opencl_release_mem_object(dev_tmp);
+  dt_opencl_release_mem_object(dev_acc);
+  dt_print(DT_DEBUG_OPENCL, "[opencl_rawdenoise] couldn't enqueue kernel! %d\n", err);
+  return FALSE;
+}
+#endif
+
 void reload_defaults(dt_iop_module_t *module)
 {
   dt_iop_rawdenoise_params_t *d = module->default_params;
@@ -569,6 +664,32 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *params, dt_dev
 
   if (!(dt_image_is_raw(&pipe->image)))
     piece->enabled = 0;
+
+  // the opencl path only knows the 2x2 bayer planes
+  if(pipe->dsc.filters == 9u) piece->process_cl_ready = 0;
+}
+
+void init_global(dt_iop_module_so_t *module)
+{
+  const int program = 36; // rawdenoise.cl, from programs.conf
+  dt_iop_rawdenoise_global_data_t *gd
+      = (dt_iop_rawdenoise_global_data_t *)malloc(sizeof(dt_iop_rawdenoise_global_data_t));
+  module->data = gd;
+  gd->kernel_rawdenoise_extract = dt_opencl_create_kernel(program, "rawdenoise_extract");
+  gd->kernel_rawdenoise_hat_h = dt_opencl_create_kernel(program, "rawdenoise_hat_h");
+  gd->kernel_rawdenoise_hat_v = dt_opencl_create_kernel(program, "rawdenoise_hat_v");
+  gd->kernel_rawdenoise_insert = dt_opencl_create_kernel(program, "rawdenoise_insert");
+}
+
+void cleanup_global(dt_iop_module_so_t *module)
+{
+  dt_iop_rawdenoise_global_data_t *gd = (dt_iop_rawdenoise_global_data_t *)module->data;
+  dt_opencl_free_kernel(gd->kernel_rawdenoise_extract);
+  dt_opencl_free_kernel(gd->kernel_rawdenoise_hat_h);
+  dt_opencl_free_kernel(gd->kernel_rawdenoise_hat_v);
+  dt_opencl_free_kernel(gd->kernel_rawdenoise_insert);
+  free(module->data);
+  module->data = NULL;
 }
 
 void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
@@ -106,7 +106,7 @@ int operation_tags()
 
 int flags()
 {
-  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_TILING_FULL_ROI | IOP_FLAGS_ONE_INSTANCE;
+  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_TILING_FULL_ROI | IOP_FLAGS_ONE_INSTANCE | IOP_FLAGS_PIPE_INDEPENDENT;
 }
 
 int default_group()
@@ -121,7 +121,7 @@ int default_colorspace(dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_p
 
 void init_presets(dt_iop_module_so_t *self)
 {
-  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "BEGIN", NULL, NULL, NULL);
+  dt_database_start_transaction(darktable.db);
 
   dt_gui_presets_add_generic(_("passthrough"), self->op, self->version(),
                              &(dt_iop_rawprepare_params_t){.crop.array = { 0, 0, 0, 0 },
@@ -132,7 +132,7 @@ void init_presets(dt_iop_module_so_t *self)
                                                            .raw_white_point = UINT16_MAX },
                              sizeof(dt_iop_rawprepare_params_t), 1);
 
-  DT_DEBUG_SQLITE3_EXEC(dt_database_get(darktable.db), "COMMIT", NULL, NULL, NULL);
+  dt_database_release_transaction(darktable.db);
 }
 
 void init_key_accels(dt_iop_module_so_t *self)
@@ -551,6 +551,53 @@ void process_sse2(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const vo
 }
 #endif
 
+void process_rows_prepare(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece)
+{
+  const dt_iop_rawprepare_data_t *const d = (dt_iop_rawprepare_data_t *)piece->data;
+  const int csx = compute_proper_crop(piece, &piece->processed_roi_in, d->x);
+  const int csy = compute_proper_crop(piece, &piece->processed_roi_in, d->y);
+
+  piece->pipe->dsc.filters = dt_rawspeed_crop_dcraw_filters(self->dev->image_storage.buf_dsc.filters, csx, csy);
+  adjust_xtrans_filters(piece->pipe, csx, csy);
+  for(int k = 0; k < 4; k++) piece->pipe->dsc.processed_maximum[k] = 1.0f;
+}
+
+// the raw mosaic branches of process(), for the rows [y, y + rows)
+void process_rows(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
+                  float *const out, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out,
+                  const int y, const int rows)
+{
+  const dt_iop_rawprepare_data_t *const d = (dt_iop_rawprepare_data_t *)piece->data;
+  const int csx = compute_proper_crop(piece, roi_in, d->x), csy = compute_proper_crop(piece, roi_in, d->y);
+
+  for(int j = y; j < y + rows; j++)
+  {
+    const size_t pin = (size_t)roi_in->width * (j + csy) + csx;
+    float *const o = out + (size_t)j * roi_out->width;
+    // the black level and white point of a pixel only depend on the parity of its column
+    const int id0 = BL(roi_out, d, j, 0), id1 = BL(roi_out, d, j, 1);
+    const float sub[2] = { d->sub[id0], d->sub[id1] };
+    const float div[2] = { d->div[id0], d->div[id1] };
+
+    if(piece->dsc_in.datatype == TYPE_UINT16)
+    {
+      const uint16_t *const in = (const uint16_t *const)ivoid + pin;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+      for(int i = 0; i < roi_out->width; i++) o[i] = (in[i] - sub[i & 1]) / div[i & 1];
+    }
+    else
+    {
+      const float *const in = (const float *const)ivoid + pin;
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+      for(int i = 0; i < roi_out->width; i++) o[i] = (in[i] - sub[i & 1]) / div[i & 1];
+    }
+  }
+}
+
 #ifdef HAVE_OPENCL
 int process_cl(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem dev_in, cl_mem dev_out,
                const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
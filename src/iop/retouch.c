@@ -166,7 +166,11 @@ typedef struct dt_iop_retouch_gui_data_t
   GtkWidget *sl_mask_opacity; // draw mask opacity
 } dt_iop_retouch_gui_data_t;
 
-typedef struct dt_iop_retouch_params_t dt_iop_retouch_data_t;
+typedef struct dt_iop_retouch_data_t
+{
+  dt_iop_retouch_params_t params;
+  dwt_cache_t dwt_cache; // scales of the last decomposition, interactive pipes only
+} dt_iop_retouch_data_t;
 
 typedef struct dt_iop_retouch_global_data_t
 {
@@ -196,7 +200,7 @@ int default_group()
 
 int flags()
 {
-  return IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_NO_MASKS;
+  return IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_NO_MASKS | IOP_FLAGS_LOCAL_PARAMS;
 }
 
 int default_colorspace(dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
@@ -2254,17 +2258,20 @@ void gui_focus(struct dt_iop_module_t *self, gboolean in)
 void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *params, dt_dev_pixelpipe_t *pipe,
                    dt_dev_pixelpipe_iop_t *piece)
 {
-  memcpy(piece->data, params, sizeof(dt_iop_retouch_params_t));
+  dt_iop_retouch_data_t *d = (dt_iop_retouch_data_t *)piece->data;
+  memcpy(&d->params, params, sizeof(dt_iop_retouch_params_t));
 }
 
 void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
-  piece->data = malloc(sizeof(dt_iop_retouch_data_t));
+  piece->data = calloc(1, sizeof(dt_iop_retouch_data_t));
   self->commit_params(self, self->default_params, pipe, piece);
 }
 
 void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
+  dt_iop_retouch_data_t *d = (dt_iop_retouch_data_t *)piece->data;
+  dt_dwt_free_cache(&d->dwt_cache);
   free(piece->data);
   piece->data = NULL;
 }
@@ -2769,7 +2776,7 @@ void modify_roi_out(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t
 static void rt_compute_roi_in(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                               dt_iop_roi_t *roi_in, int *_roir, int *_roib, int *_roix, int *_roiy)
 {
-  dt_iop_retouch_params_t *p = (dt_iop_retouch_params_t *)piece->data;
+  dt_iop_retouch_params_t *p = &((dt_iop_retouch_data_t *)piece->data)->params;
   dt_develop_blend_params_t *bp = self->blend_params;
 
   int roir = *_roir;
@@ -2871,7 +2878,7 @@ static void rt_extend_roi_in_from_source_clones(struct dt_iop_module_t *self, st
                                                 const int ft_src, const int fw_src, const int fh_src, int *_roir,
                                                 int *_roib, int *_roix, int *_roiy)
 {
-  dt_iop_retouch_params_t *p = (dt_iop_retouch_params_t *)piece->data;
+  dt_iop_retouch_params_t *p = &((dt_iop_retouch_data_t *)piece->data)->params;
   dt_develop_blend_params_t *bp = self->blend_params;
 
   int roir = *_roir;
@@ -2963,7 +2970,7 @@ static void rt_extend_roi_in_from_source_clones(struct dt_iop_module_t *self, st
 static void rt_extend_roi_in_for_clone(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                                        dt_iop_roi_t *roi_in, int *_roir, int *_roib, int *_roix, int *_roiy)
 {
-  dt_iop_retouch_params_t *p = (dt_iop_retouch_params_t *)piece->data;
+  dt_iop_retouch_params_t *p = &((dt_iop_retouch_data_t *)piece->data)->params;
   dt_develop_blend_params_t *bp = self->blend_params;
 
   int roir = *_roir;
@@ -3709,11 +3716,9 @@ static void rt_copy_image_masked(float *const img_src, float *img_dest, dt_iop_r
   else
 #endif
   {
-    const int ch1 = (ch == 4) ? ch - 1 : ch;
-
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-    dt_omp_firstprivate(ch, ch1, img_src, mask_scaled, opacity, roi_dest, roi_mask_scaled) \
+    dt_omp_firstprivate(ch, img_src, mask_scaled, opacity, roi_dest, roi_mask_scaled) \
     shared(img_dest) \
     schedule(static)
 #endif
@@ -3725,19 +3730,8 @@ static void rt_copy_image_masked(float *const img_src, float *img_dest, dt_iop_r
           = (((yy + roi_mask_scaled->y - roi_dest->y) * roi_dest->width) + (roi_mask_scaled->x - roi_dest->x))
             * ch;
 
-      const float *s = img_src + src_index;
-      const float *m = mask_scaled + mask_index;
-      float *d = img_dest + dest_index;
-
-      for(int xx = 0; xx < roi_mask_scaled->width; xx++, s += ch, d += ch, m++)
-      {
-        const float f = (*m) * opacity;
-
-        for(int c = 0; c < ch1; c++)
-        {
-          d[c] = d[c] * (1.0f - f) + s[c] * f;
-        }
-      }
+      DT_IOP_CHANNELS_DISPATCH(ch, dt_iop_mix_masked_row, img_dest + dest_index, img_src + src_index,
+                               mask_scaled + mask_index, opacity, roi_mask_scaled->width);
     }
   }
 }
@@ -3816,11 +3810,9 @@ static void retouch_fill(float *const in, dt_iop_roi_t *const roi_in, const int
     return;
   }
 #endif
-  const int ch1 = (ch == 4) ? ch - 1 : ch;
-
 #ifdef _OPENMP
 #pragma omp parallel for default(none) \
-  dt_omp_firstprivate(ch, ch1, fill_color, in, mask_scaled, opacity, roi_in, roi_mask_scaled) \
+  dt_omp_firstprivate(ch, fill_color, in, mask_scaled, opacity, roi_in, roi_mask_scaled) \
   schedule(static)
 #endif
   for(int yy = 0; yy < roi_mask_scaled->height; yy++)
@@ -3829,15 +3821,8 @@ static void retouch_fill(float *const in, dt_iop_roi_t *const roi_in, const int
     const int dest_index
         = (((yy + roi_mask_scaled->y - roi_in->y) * roi_in->width) + (roi_mask_scaled->x - roi_in->x)) * ch;
 
-    float *d = in + dest_index;
-    const float *m = mask_scaled + mask_index;
-
-    for(int xx = 0; xx < roi_mask_scaled->width; xx++, d += ch, m++)
-    {
-      const float f = (*m) * opacity;
-
-      for(int c = 0; c < ch1; c++) d[c] = d[c] * (1.0f - f) + fill_color[c] * f;
-    }
+    DT_IOP_CHANNELS_DISPATCH(ch, dt_iop_mix_color_masked_row, in + dest_index, fill_color,
+                             mask_scaled + mask_index, opacity, roi_mask_scaled->width);
   }
 }
 
@@ -3985,7 +3970,7 @@ static void rt_process_forms(float *layer, dwt_params_t *const wt_p, const int s
   if(scale > wt_p->scales + 1) return;
 
   dt_develop_blend_params_t *bp = (dt_develop_blend_params_t *)piece->blendop_data;
-  dt_iop_retouch_params_t *p = (dt_iop_retouch_params_t *)piece->data;
+  dt_iop_retouch_params_t *p = &((dt_iop_retouch_data_t *)piece->data)->params;
   dt_iop_roi_t *roi_layer = &usr_d->roi;
   const int mask_display = usr_d->mask_display && (scale == usr_d->display_scale);
 
@@ -4155,7 +4140,7 @@ static void process_internal(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_
                              void *const ovoid, const dt_iop_roi_t *const roi_in,
                              const dt_iop_roi_t *const roi_out, const int use_sse)
 {
-  dt_iop_retouch_params_t *p = (dt_iop_retouch_params_t *)piece->data;
+  dt_iop_retouch_params_t *p = &((dt_iop_retouch_data_t *)piece->data)->params;
   dt_iop_retouch_gui_data_t *g = (dt_iop_retouch_gui_data_t *)self->gui_data;
 
   float *in_retouch = NULL;
@@ -4193,6 +4178,10 @@ static void process_internal(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_
                       roi_in->scale / piece->iscale, use_sse);
   if(dwt_p == NULL) goto cleanup;
 
+  // the darkroom pipes run again with the same input for every edit of a shape, keep their scales
+  if(piece->pipe->type & (DT_DEV_PIXELPIPE_FULL | DT_DEV_PIXELPIPE_PREVIEW))
+    dwt_p->cache = &((dt_iop_retouch_data_t *)piece->data)->dwt_cache;
+
   // check if this module should expose mask.
   if((piece->pipe->type & DT_DEV_PIXELPIPE_FULL) == DT_DEV_PIXELPIPE_FULL && g && g->mask_display && self->dev->gui_attached
      && (self == self->dev->gui_module) && (piece->pipe == self->dev->pipe))
@@ -4797,7 +4786,7 @@ static cl_int rt_process_forms_cl(cl_mem dev_layer, dwt_params_cl_t *const wt_p,
   if(scale > wt_p->scales + 1) return err;
 
   dt_develop_blend_params_t *bp = (dt_develop_blend_params_t *)piece->blendop_data;
-  dt_iop_retouch_params_t *p = (dt_iop_retouch_params_t *)piece->data;
+  dt_iop_retouch_params_t *p = &((dt_iop_retouch_data_t *)piece->data)->params;
   dt_iop_retouch_global_data_t *gd = (dt_iop_retouch_global_data_t *)self->global_data;
   const int devid = piece->pipe->devid;
   dt_iop_roi_t *roi_layer = &usr_d->roi;
@@ -4986,7 +4975,7 @@ static cl_int rt_process_forms_cl(cl_mem dev_layer, dwt_params_cl_t *const wt_p,
 int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem dev_in, cl_mem dev_out,
                const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
-  dt_iop_retouch_params_t *p = (dt_iop_retouch_params_t *)piece->data;
+  dt_iop_retouch_params_t *p = &((dt_iop_retouch_data_t *)piece->data)->params;
   dt_iop_retouch_global_data_t *gd = (dt_iop_retouch_global_data_t *)self->global_data;
   dt_iop_retouch_gui_data_t *g = (dt_iop_retouch_gui_data_t *)self->gui_data;
 
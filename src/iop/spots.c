@@ -22,6 +22,7 @@
 #include "control/control.h"
 #include "develop/blend.h"
 #include "develop/imageop.h"
+#include "develop/imageop_math.h"
 #include "develop/masks.h"
 #include "gui/accelerators.h"
 #include "gui/gtk.h"
@@ -62,7 +63,7 @@ int default_group()
 
 int flags()
 {
-  return IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_NO_MASKS;
+  return IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_NO_MASKS | IOP_FLAGS_LOCAL_PARAMS;
 }
 
 int default_colorspace(dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
@@ -473,8 +474,10 @@ static int masks_get_delta(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
   return res;
 }
 
-void _process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const float *const in,
-              float *const out, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out, const int ch)
+// the channel loops of the clones see ch as a constant, see DT_IOP_CHANNELS_DISPATCH
+DT_IOP_CHANNELS_INLINE void _process(const int ch, struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
+                                     const float *const in, float *const out, const dt_iop_roi_t *const roi_in,
+                                     const dt_iop_roi_t *const roi_out)
 {
   dt_iop_spots_params_t *d = (dt_iop_spots_params_t *)piece->data;
   dt_develop_blend_params_t *bp = self->blend_params;
@@ -646,13 +649,13 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
 {
   const float *in = (float *)i;
   float *out = (float *)o;
-  _process(self, piece, in, out, roi_in, roi_out, piece->colors);
+  DT_IOP_CHANNELS_DISPATCH(piece->colors, _process, self, piece, in, out, roi_in, roi_out);
 }
 
 void distort_mask(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const float *const in,
                   float *const out, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
-  _process(self, piece, in, out, roi_in, roi_out, 1);
+  _process(1, self, piece, in, out, roi_in, roi_out);
 }
 
 /** init, cleanup, commit to pipeline */
@@ -168,7 +168,7 @@ int default_group()
 
 int flags()
 {
-  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_ONE_INSTANCE;
+  return IOP_FLAGS_ALLOW_TILING | IOP_FLAGS_ONE_INSTANCE | IOP_FLAGS_PIPE_INDEPENDENT;
 }
 
 int default_colorspace(dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
@@ -650,6 +650,43 @@ void process_sse2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, c
 }
 #endif
 
+void process_rows_prepare(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece)
+{
+  const dt_iop_temperature_data_t *const d = (dt_iop_temperature_data_t *)piece->data;
+
+  piece->pipe->dsc.temperature.enabled = 1;
+  for(int k = 0; k < 4; k++)
+  {
+    piece->pipe->dsc.temperature.coeffs[k] = d->coeffs[k];
+    piece->pipe->dsc.processed_maximum[k] = d->coeffs[k] * piece->pipe->dsc.processed_maximum[k];
+  }
+}
+
+// the mosaiced branches of process(), for the rows [y, y + rows)
+void process_rows(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
+                  float *const out, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out,
+                  const int y, const int rows)
+{
+  const uint32_t filters = piece->dsc_in.filters;
+  const uint8_t(*const xtrans)[6] = (const uint8_t(*const)[6])piece->dsc_in.xtrans;
+  const dt_iop_temperature_data_t *const d = (dt_iop_temperature_data_t *)piece->data;
+  const float *const in = (const float *const)ivoid;
+
+  for(int j = y; j < y + rows; j++)
+  {
+    const size_t p = (size_t)j * roi_out->width;
+    // the coefficients of a row repeat after 6 pixels for x-trans and after 2 for bayer
+    float coeffs[6];
+    for(int i = 0; i < 6; i++)
+      coeffs[i] = d->coeffs[filters == 9u ? FCxtrans(j, i, roi_out, xtrans)
+                                          : FC(j + roi_out->y, i + roi_out->x, filters)];
+#ifdef _OPENMP
+#pragma omp simd
+#endif
+    for(int i = 0; i < roi_out->width; i++) out[p + i] = in[p + i] * coeffs[i % 6];
+  }
+}
+
 #ifdef HAVE_OPENCL
 int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem dev_in, cl_mem dev_out,
                const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
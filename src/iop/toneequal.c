@@ -184,12 +184,24 @@ typedef struct dt_iop_toneequalizer_data_t
   int iterations;
   dt_iop_luminance_mask_method_t method;
   dt_iop_toneequalizer_filter_t details;
+
+  // luminance mask of the last run of the interactive full pipe, see mask_hash()
+  float *mask;
+  size_t mask_width, mask_height;
+  uint64_t mask_hash;
 } dt_iop_toneequalizer_data_t;
 
 
 typedef struct dt_iop_toneequalizer_global_data_t
 {
-  // TODO: put OpenCL kernels here at some point
+  int kernel_toneeq_luminance_mask;
+  int kernel_toneeq_resample;
+  int kernel_toneeq_moments;
+  int kernel_toneeq_box_vertical;
+  int kernel_toneeq_box_horizontal;
+  int kernel_toneeq_linear_model;
+  int kernel_toneeq_blend;
+  int kernel_toneeq_apply;
 } dt_iop_toneequalizer_global_data_t;
 
 
@@ -213,10 +225,8 @@ typedef struct dt_iop_toneequalizer_gui_data_t
   int cursor_pos_y;
   int pipe_order;
 
-  // 6 uint64 to pack - contiguous-ish memory
-  uint64_t ui_preview_hash;
+  // 3 uint64 to pack - contiguous-ish memory
   uint64_t thumb_preview_hash;
-  size_t full_preview_buf_width, full_preview_buf_height;
   size_t thumb_preview_buf_width, thumb_preview_buf_height;
 
   // Misc stuff, contiguity, length and alignment unknown
@@ -229,7 +239,6 @@ typedef struct dt_iop_toneequalizer_gui_data_t
 
   // Heap arrays, 64 bits-aligned, unknown length
   float *thumb_preview_buf;
-  float *full_preview_buf;
 
   // GTK garbage, nobody cares, no SIMD here
   GtkWidget *noise, *ultra_deep_blacks, *deep_blacks, *blacks, *shadows, *midtones, *highlights, *whites, *speculars;
@@ -301,7 +310,7 @@ int default_group()
 
 int flags()
 {
-  return IOP_FLAGS_INCLUDE_IN_STYLES | IOP_FLAGS_SUPPORTS_BLENDING;
+  return IOP_FLAGS_INCLUDE_IN_STYLES | IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_VOLATILE_COMMIT;
 }
 
 int default_colorspace(dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
@@ -522,15 +531,6 @@ static gboolean in_mask_editing(dt_iop_module_t *self)
   return dev->form_gui && dev->form_visible;
 }
 
-static void hash_set_get(uint64_t *hash_in, uint64_t *hash_out, dt_pthread_mutex_t *lock)
-{
-  // Set or get a hash in a struct the thread-safe way
-  dt_pthread_mutex_lock(lock);
-  *hash_out = *hash_in;
-  dt_pthread_mutex_unlock(lock);
-}
-
-
 static void invalidate_luminance_cache(dt_iop_module_t *self)
 {
   // Invalidate the private luminance cache and histogram when
@@ -542,7 +542,6 @@ static void invalidate_luminance_cache(dt_iop_module_t *self)
   //g->luminance_valid = 0;
   g->histogram_valid = 0;
   g->thumb_preview_hash = 0;
-  g->ui_preview_hash = 0;
   dt_pthread_mutex_unlock(&g->lock);
 }
 
@@ -840,13 +839,70 @@ static inline void apply_toneequalizer(const float *const restrict in,
 }
 
 
+/***
+ * Luminance mask caches
+ *
+ * The mask only depends on the output of the modules before this one and on the parameters
+ * of its extraction, not on the curve. Both interactive pipes keep it between runs, so moving
+ * the nodes of the curve only applies the correction again.
+ **/
+
+static uint64_t mask_hash(dt_dev_pixelpipe_iop_t *piece, const dt_iop_roi_t *const roi_in)
+{
+  const dt_iop_toneequalizer_data_t *const d = (const dt_iop_toneequalizer_data_t *const)piece->data;
+
+  // hash of the input of the module, then the mask params (djb2 as well)
+  uint64_t hash = dt_dev_pixelpipe_cache_hash(piece->pipe->image.id, roi_in, piece->pipe,
+                                              g_list_index(piece->pipe->nodes, piece));
+
+  const float fparams[] = { d->blending, d->feathering, d->contrast_boost, d->exposure_boost, d->quantization };
+  const int iparams[] = { d->radius, d->iterations, d->method, d->details };
+  const char *str = (const char *)fparams;
+  for(size_t i = 0; i < sizeof(fparams); i++) hash = ((hash << 5) + hash) ^ str[i];
+  str = (const char *)iparams;
+  for(size_t i = 0; i < sizeof(iparams); i++) hash = ((hash << 5) + hash) ^ str[i];
+
+  return hash;
+}
+
+
+static float *full_mask_cache(dt_iop_toneequalizer_data_t *const d, const size_t width, const size_t height)
+{
+  // Re-allocate a new buffer if the full preview size has changed
+  if(d->mask_width != width || d->mask_height != height || !d->mask)
+  {
+    if(d->mask) dt_free_align(d->mask);
+    d->mask = dt_alloc_sse_ps(width * height);
+    d->mask_width = width;
+    d->mask_height = height;
+    d->mask_hash = 0;
+  }
+  return d->mask;
+}
+
+
+static float *thumb_mask_cache(dt_iop_toneequalizer_gui_data_t *const g, const size_t width, const size_t height)
+{
+  // Re-allocate a new buffer if the thumb preview size has changed. call with g->lock held
+  if(g->thumb_preview_buf_width != width || g->thumb_preview_buf_height != height)
+  {
+    if(g->thumb_preview_buf) dt_free_align(g->thumb_preview_buf);
+    g->thumb_preview_buf = dt_alloc_sse_ps(width * height);
+    g->thumb_preview_buf_width = width;
+    g->thumb_preview_buf_height = height;
+    g->luminance_valid = FALSE;
+  }
+  return g->thumb_preview_buf;
+}
+
+
 __DT_CLONE_TARGETS__
 static
 void toneeq_process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
              const void *const restrict ivoid, void *const restrict ovoid,
              const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
-  const dt_iop_toneequalizer_data_t *const d = (const dt_iop_toneequalizer_data_t *const)piece->data;
+  dt_iop_toneequalizer_data_t *const d = (dt_iop_toneequalizer_data_t *const)piece->data;
   dt_iop_toneequalizer_gui_data_t *const g = (dt_iop_toneequalizer_gui_data_t *)self->gui_data;
 
   const float *const restrict in = dt_check_sse_aligned((float *const)ivoid);
@@ -866,9 +922,9 @@ void toneeq_process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
   const size_t num_elem = width * height;
   const size_t ch = 4;
 
-  // Get the hash of the upstream pipe to track changes
-  int position = self->iop_order;
-  uint64_t hash = dt_dev_pixelpipe_cache_hash(piece->pipe->image.id, roi_out, piece->pipe, position);
+  // Get the hash of the upstream pipe and of the mask parameters to track changes
+  const int position = self->iop_order;
+  const uint64_t hash = mask_hash(piece, roi_in);
 
   // Sanity checks
   if(width < 1 || height < 1) return;
@@ -891,7 +947,6 @@ void toneeq_process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
     if(g->pipe_order != position)
     {
       dt_pthread_mutex_lock(&g->lock);
-      g->ui_preview_hash = 0;
       g->thumb_preview_hash = 0;
       g->pipe_order = position;
       g->luminance_valid = 0;
@@ -901,20 +956,9 @@ void toneeq_process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
 
     if((piece->pipe->type & DT_DEV_PIXELPIPE_FULL) == DT_DEV_PIXELPIPE_FULL)
     {
-      // For DT_DEV_PIXELPIPE_FULL, we cache the luminance mask for performance
+      // For DT_DEV_PIXELPIPE_FULL, we cache the luminance mask on the piece for performance
       // but it's not accessed from GUI
-      // no need for threads lock since no other function is writing/reading that buffer
-
-      // Re-allocate a new buffer if the full preview size has changed
-      if(g->full_preview_buf_width != width || g->full_preview_buf_height != height)
-      {
-        if(g->full_preview_buf) dt_free_align(g->full_preview_buf);
-        g->full_preview_buf = dt_alloc_sse_ps(num_elem);
-        g->full_preview_buf_width = width;
-        g->full_preview_buf_height = height;
-      }
-
-      luminance = g->full_preview_buf;
+      luminance = full_mask_cache(d, width, height);
       cached = TRUE;
     }
 
@@ -923,21 +967,9 @@ void toneeq_process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
       // For DT_DEV_PIXELPIPE_PREVIEW, we need to cache is too to compute the full image stats
       // upon user request in GUI
       // threads locks are required since GUI reads and writes on that buffer.
-
-      // Re-allocate a new buffer if the thumb preview size has changed
       dt_pthread_mutex_lock(&g->lock);
-      if(g->thumb_preview_buf_width != width || g->thumb_preview_buf_height != height)
-      {
-        if(g->thumb_preview_buf) dt_free_align(g->thumb_preview_buf);
-        g->thumb_preview_buf = dt_alloc_sse_ps(num_elem);
-        g->thumb_preview_buf_width = width;
-        g->thumb_preview_buf_height = height;
-        g->luminance_valid = FALSE;
-      }
-
-      luminance = g->thumb_preview_buf;
+      luminance = thumb_mask_cache(g, width, height);
       cached = TRUE;
-
       dt_pthread_mutex_unlock(&g->lock);
     }
     else // just to please GCC
@@ -948,7 +980,7 @@ void toneeq_process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
   }
   else
   {
-    // no interactive editing/caching : just allocate a local temp buffer
+    // no interactive editing/caching : just allocate a local temp buffer
     luminance = dt_alloc_sse_ps(num_elem);
   }
 
@@ -962,44 +994,31 @@ void toneeq_process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
   // Compute the luminance mask
   if(cached)
   {
-    // caching path : store the luminance mask for GUI access
+    // caching path : store the luminance mask for GUI access
 
     if((piece->pipe->type & DT_DEV_PIXELPIPE_FULL) == DT_DEV_PIXELPIPE_FULL)
     {
-      uint64_t saved_hash;
-      hash_set_get(&g->ui_preview_hash, &saved_hash, &g->lock);
-
-      dt_pthread_mutex_lock(&g->lock);
-      const int luminance_valid = g->luminance_valid;
-      dt_pthread_mutex_unlock(&g->lock);
-
-      if(hash != saved_hash || !luminance_valid)
+      // no need for threads lock since no other function is writing/reading that buffer
+      if(hash != d->mask_hash)
       {
-        /* compute only if upstream pipe state has changed */
+        /* compute only if upstream pipe state or the mask parameters have changed */
         compute_luminance_mask(in, luminance, width, height, ch, d);
-        hash_set_get(&hash, &g->ui_preview_hash, &g->lock);
+        d->mask_hash = hash;
       }
     }
 
     else if((piece->pipe->type & DT_DEV_PIXELPIPE_PREVIEW) == DT_DEV_PIXELPIPE_PREVIEW)
     {
-      uint64_t saved_hash;
-      hash_set_get(&g->thumb_preview_hash, &saved_hash, &g->lock);
-
       dt_pthread_mutex_lock(&g->lock);
-      const int luminance_valid = g->luminance_valid;
-      dt_pthread_mutex_unlock(&g->lock);
-
-      if(saved_hash != hash || !luminance_valid)
+      if(g->thumb_preview_hash != hash || !g->luminance_valid)
       {
-        /* compute only if upstream pipe state has changed */
-        dt_pthread_mutex_lock(&g->lock);
+        /* compute only if upstream pipe state or the mask parameters have changed */
         g->thumb_preview_hash = hash;
         g->histogram_valid = FALSE;
         compute_luminance_mask(in, luminance, width, height, ch, d);
         g->luminance_valid = TRUE;
-        dt_pthread_mutex_unlock(&g->lock);
       }
+      dt_pthread_mutex_unlock(&g->lock);
     }
 
     else // make it dummy-proof
@@ -1038,6 +1057,288 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece,
 }
 
 
+#ifdef HAVE_OPENCL
+static cl_int box_average_cl(const int devid, const dt_iop_toneequalizer_global_data_t *const gd,
+                             cl_mem dev_image, cl_mem dev_tmp, const int width, const int height, const int radius)
+{
+  // in-place on dev_image, separable as box_average()
+  size_t sizes[] = { ROUNDUPWD(width), ROUNDUPHT(height), 1 };
+
+  dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_box_vertical, 0, sizeof(cl_mem), (void *)&dev_image);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_box_vertical, 1, sizeof(cl_mem), (void *)&dev_tmp);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_box_vertical, 2, sizeof(int), (void *)&width);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_box_vertical, 3, sizeof(int), (void *)&height);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_box_vertical, 4, sizeof(int), (void *)&radius);
+  cl_int err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_toneeq_box_vertical, sizes);
+  if(err != CL_SUCCESS) return err;
+
+  dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_box_horizontal, 0, sizeof(cl_mem), (void *)&dev_tmp);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_box_horizontal, 1, sizeof(cl_mem), (void *)&dev_image);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_box_horizontal, 2, sizeof(int), (void *)&width);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_box_horizontal, 3, sizeof(int), (void *)&height);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_box_horizontal, 4, sizeof(int), (void *)&radius);
+  return dt_opencl_enqueue_kernel_2d(devid, gd->kernel_toneeq_box_horizontal, sizes);
+}
+
+
+static cl_int blend_cl(const int devid, const dt_iop_toneequalizer_global_data_t *const gd,
+                       cl_mem dev_image, cl_mem dev_ab, cl_mem dev_out, const int width, const int height,
+                       const int ab_width, const int ab_height, const int geomean)
+{
+  size_t sizes[] = { ROUNDUPWD(width), ROUNDUPHT(height), 1 };
+  dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_blend, 0, sizeof(cl_mem), (void *)&dev_image);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_blend, 1, sizeof(cl_mem), (void *)&dev_ab);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_blend, 2, sizeof(cl_mem), (void *)&dev_out);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_blend, 3, sizeof(int), (void *)&width);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_blend, 4, sizeof(int), (void *)&height);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_blend, 5, sizeof(int), (void *)&ab_width);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_blend, 6, sizeof(int), (void *)&ab_height);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_blend, 7, sizeof(int), (void *)&geomean);
+  return dt_opencl_enqueue_kernel_2d(devid, gd->kernel_toneeq_blend, sizes);
+}
+
+
+static cl_int fast_surface_blur_cl(const int devid, const dt_iop_toneequalizer_global_data_t *const gd,
+                                   cl_mem dev_image, cl_mem dev_out, const int width, const int height,
+                                   const int radius, const float feathering, const int iterations,
+                                   const dt_iop_guided_filter_blending_t filter, const float quantization,
+                                   const float quantize_min, const float quantize_max)
+{
+  // same steps as fast_surface_blur(), from the grey dev_image to dev_out
+  cl_int err = -999;
+  const int ds_radius = (radius < 4) ? 1 : radius / 4;
+  const int ds_width = width / 4;
+  const int ds_height = height / 4;
+  if(ds_width < 1 || ds_height < 1) return err;
+
+  cl_mem dev_ds_image = dt_opencl_alloc_device(devid, ds_width, ds_height, sizeof(float));
+  cl_mem dev_ds_tmp = dt_opencl_alloc_device(devid, ds_width, ds_height, sizeof(float));
+  cl_mem dev_moments = dt_opencl_alloc_device(devid, ds_width, ds_height, 4 * sizeof(float));
+  cl_mem dev_ab = dt_opencl_alloc_device(devid, ds_width, ds_height, 4 * sizeof(float));
+  cl_mem dev_tmp = dt_opencl_alloc_device(devid, ds_width, ds_height, 4 * sizeof(float));
+  if(!dev_ds_image || !dev_ds_tmp || !dev_moments || !dev_ab || !dev_tmp) goto cleanup;
+
+  size_t sizes[] = { ROUNDUPWD(ds_width), ROUNDUPHT(ds_height), 1 };
+
+  // Downsample the image for speed-up
+  dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_resample, 0, sizeof(cl_mem), (void *)&dev_image);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_resample, 1, sizeof(cl_mem), (void *)&dev_ds_image);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_resample, 2, sizeof(int), (void *)&width);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_resample, 3, sizeof(int), (void *)&height);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_resample, 4, sizeof(int), (void *)&ds_width);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_resample, 5, sizeof(int), (void *)&ds_height);
+  err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_toneeq_resample, sizes);
+  if(err != CL_SUCCESS) goto cleanup;
+
+  for(int i = 0; i < iterations; ++i)
+  {
+    // quantized guide and the moments of the variance analyse
+    dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_moments, 0, sizeof(cl_mem), (void *)&dev_ds_image);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_moments, 1, sizeof(cl_mem), (void *)&dev_moments);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_moments, 2, sizeof(int), (void *)&ds_width);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_moments, 3, sizeof(int), (void *)&ds_height);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_moments, 4, sizeof(float), (void *)&quantization);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_moments, 5, sizeof(float), (void *)&quantize_min);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_moments, 6, sizeof(float), (void *)&quantize_max);
+    err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_toneeq_moments, sizes);
+    if(err != CL_SUCCESS) goto cleanup;
+
+    err = box_average_cl(devid, gd, dev_moments, dev_tmp, ds_width, ds_height, ds_radius);
+    if(err != CL_SUCCESS) goto cleanup;
+
+    dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_linear_model, 0, sizeof(cl_mem), (void *)&dev_moments);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_linear_model, 1, sizeof(cl_mem), (void *)&dev_ab);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_linear_model, 2, sizeof(int), (void *)&ds_width);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_linear_model, 3, sizeof(int), (void *)&ds_height);
+    dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_linear_model, 4, sizeof(float), (void *)&feathering);
+    err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_toneeq_linear_model, sizes);
+    if(err != CL_SUCCESS) goto cleanup;
+
+    // Compute the patch-wise average of parameters a and b
+    err = box_average_cl(devid, gd, dev_ab, dev_tmp, ds_width, ds_height, ds_radius);
+    if(err != CL_SUCCESS) goto cleanup;
+
+    if(i != iterations - 1)
+    {
+      // Process the intermediate filtered image
+      err = blend_cl(devid, gd, dev_ds_image, dev_ab, dev_ds_tmp, ds_width, ds_height, ds_width, ds_height, FALSE);
+      if(err != CL_SUCCESS) goto cleanup;
+      cl_mem swap = dev_ds_image;
+      dev_ds_image = dev_ds_tmp;
+      dev_ds_tmp = swap;
+    }
+  }
+
+  // Upsample a and b on the fly and blend the guided image
+  err = blend_cl(devid, gd, dev_image, dev_ab, dev_out, width, height, ds_width, ds_height,
+                 filter == DT_GF_BLENDING_GEOMEAN);
+
+cleanup:
+  dt_opencl_release_mem_object(dev_tmp);
+  dt_opencl_release_mem_object(dev_ab);
+  dt_opencl_release_mem_object(dev_moments);
+  dt_opencl_release_mem_object(dev_ds_tmp);
+  dt_opencl_release_mem_object(dev_ds_image);
+  return err;
+}
+
+
+static cl_int compute_luminance_mask_cl(const int devid, const dt_iop_toneequalizer_global_data_t *const gd,
+                                        cl_mem dev_in, cl_mem dev_luminance, const int width, const int height,
+                                        const dt_iop_toneequalizer_data_t *const d)
+{
+  // same as compute_luminance_mask()
+  const int guided = (d->details == DT_TONEEQ_AVG_GUIDED || d->details == DT_TONEEQ_GUIDED);
+  const int method = d->method;
+  const float fulcrum = (d->details == DT_TONEEQ_GUIDED) ? CONTRAST_FULCRUM : 0.0f;
+  const float contrast_boost = (d->details == DT_TONEEQ_GUIDED) ? d->contrast_boost : 1.0f;
+  cl_int err = -999;
+
+  cl_mem dev_mask = guided ? dt_opencl_alloc_device(devid, width, height, sizeof(float)) : dev_luminance;
+  if(dev_mask == NULL) return err;
+
+  size_t sizes[] = { ROUNDUPWD(width), ROUNDUPHT(height), 1 };
+  dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_luminance_mask, 0, sizeof(cl_mem), (void *)&dev_in);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_luminance_mask, 1, sizeof(cl_mem), (void *)&dev_mask);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_luminance_mask, 2, sizeof(int), (void *)&width);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_luminance_mask, 3, sizeof(int), (void *)&height);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_luminance_mask, 4, sizeof(int), (void *)&method);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_luminance_mask, 5, sizeof(float), (void *)&d->exposure_boost);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_luminance_mask, 6, sizeof(float), (void *)&fulcrum);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_luminance_mask, 7, sizeof(float), (void *)&contrast_boost);
+  err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_toneeq_luminance_mask, sizes);
+
+  if(err == CL_SUCCESS && guided)
+    err = fast_surface_blur_cl(devid, gd, dev_mask, dev_luminance, width, height, d->radius, d->feathering,
+                               d->iterations,
+                               (d->details == DT_TONEEQ_GUIDED) ? DT_GF_BLENDING_LINEAR : DT_GF_BLENDING_GEOMEAN,
+                               d->quantization, exp2f(-14.0f), 4.0f);
+
+  if(guided) dt_opencl_release_mem_object(dev_mask);
+  return err;
+}
+
+
+int process_cl(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, cl_mem dev_in, cl_mem dev_out,
+               const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
+{
+  dt_iop_toneequalizer_data_t *const d = (dt_iop_toneequalizer_data_t *const)piece->data;
+  dt_iop_toneequalizer_gui_data_t *const g = (dt_iop_toneequalizer_gui_data_t *)self->gui_data;
+  const dt_iop_toneequalizer_global_data_t *const gd = (dt_iop_toneequalizer_global_data_t *)self->global_data;
+
+  cl_int err = -999;
+  cl_mem dev_luminance = NULL;
+  cl_mem dev_factors = NULL;
+
+  const int devid = piece->pipe->devid;
+  const int width = roi_in->width;
+  const int height = roi_in->height;
+
+  // the cpu path passes the image through in these cases
+  if(roi_in->width < roi_out->width || roi_in->height < roi_out->height || !sanity_check(self)) return FALSE;
+
+  const int position = self->iop_order;
+  const uint64_t hash = mask_hash(piece, roi_in);
+  const int full = self->dev->gui_attached && (piece->pipe->type & DT_DEV_PIXELPIPE_FULL) == DT_DEV_PIXELPIPE_FULL;
+  const int preview
+      = self->dev->gui_attached && (piece->pipe->type & DT_DEV_PIXELPIPE_PREVIEW) == DT_DEV_PIXELPIPE_PREVIEW;
+
+  dev_luminance = dt_opencl_alloc_device(devid, width, height, sizeof(float));
+  if(dev_luminance == NULL) goto error;
+
+  // the masks of the interactive pipes are cached on the host, like on the cpu path, the gui needs
+  // the one of the preview anyway
+  if(full)
+  {
+    float *const luminance = full_mask_cache(d, width, height);
+    if(luminance == NULL) goto error;
+
+    if(hash == d->mask_hash)
+      err = dt_opencl_write_host_to_device(devid, luminance, dev_luminance, width, height, sizeof(float));
+    else
+    {
+      err = compute_luminance_mask_cl(devid, gd, dev_in, dev_luminance, width, height, d);
+      if(err == CL_SUCCESS)
+        err = dt_opencl_read_host_from_device(devid, luminance, dev_luminance, width, height, sizeof(float));
+      d->mask_hash = (err == CL_SUCCESS) ? hash : 0;
+    }
+    if(err != CL_SUCCESS) goto error;
+  }
+  else if(preview)
+  {
+    dt_pthread_mutex_lock(&g->lock);
+    if(g->pipe_order != position)
+    {
+      g->thumb_preview_hash = 0;
+      g->pipe_order = position;
+      g->luminance_valid = 0;
+      g->histogram_valid = 0;
+    }
+
+    float *const luminance = thumb_mask_cache(g, width, height);
+    if(luminance == NULL)
+      err = -999;
+    else if(g->thumb_preview_hash == hash && g->luminance_valid)
+      err = dt_opencl_write_host_to_device(devid, luminance, dev_luminance, width, height, sizeof(float));
+    else
+    {
+      g->histogram_valid = FALSE;
+      g->luminance_valid = FALSE;
+      err = compute_luminance_mask_cl(devid, gd, dev_in, dev_luminance, width, height, d);
+      if(err == CL_SUCCESS)
+        err = dt_opencl_read_host_from_device(devid, luminance, dev_luminance, width, height, sizeof(float));
+      if(err == CL_SUCCESS)
+      {
+        g->thumb_preview_hash = hash;
+        g->luminance_valid = TRUE;
+      }
+    }
+    dt_pthread_mutex_unlock(&g->lock);
+    if(err != CL_SUCCESS) goto error;
+  }
+  else
+  {
+    err = compute_luminance_mask_cl(devid, gd, dev_in, dev_luminance, width, height, d);
+    if(err != CL_SUCCESS) goto error;
+  }
+
+  dev_factors = dt_opencl_copy_host_to_device_constant(devid, sizeof(float) * PIXEL_CHAN, (void *)d->factors);
+  if(dev_factors == NULL) goto error;
+
+  const int out_width = roi_out->width;
+  const int out_height = roi_out->height;
+  const int offset_x = (roi_in->x < roi_out->x) ? -roi_in->x + roi_out->x : 0;
+  const int offset_y = (roi_in->y < roi_out->y) ? -roi_in->y + roi_out->y : 0;
+  const float gauss_denom = gaussian_denom(d->smoothing);
+  const int mask_display = full && g->mask_display;
+
+  size_t sizes[] = { ROUNDUPWD(out_width), ROUNDUPHT(out_height), 1 };
+  dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_apply, 0, sizeof(cl_mem), (void *)&dev_in);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_apply, 1, sizeof(cl_mem), (void *)&dev_luminance);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_apply, 2, sizeof(cl_mem), (void *)&dev_out);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_apply, 3, sizeof(int), (void *)&out_width);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_apply, 4, sizeof(int), (void *)&out_height);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_apply, 5, sizeof(int), (void *)&offset_x);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_apply, 6, sizeof(int), (void *)&offset_y);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_apply, 7, sizeof(cl_mem), (void *)&dev_factors);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_apply, 8, sizeof(float), (void *)&gauss_denom);
+  dt_opencl_set_kernel_arg(devid, gd->kernel_toneeq_apply, 9, sizeof(int), (void *)&mask_display);
+  err = dt_opencl_enqueue_kernel_2d(devid, gd->kernel_toneeq_apply, sizes);
+  if(err != CL_SUCCESS) goto error;
+
+  dt_opencl_release_mem_object(dev_factors);
+  dt_opencl_release_mem_object(dev_luminance);
+  return TRUE;
+
+error:
+  dt_opencl_release_mem_object(dev_factors);
+  dt_opencl_release_mem_object(dev_luminance);
+  dt_print(DT_DEBUG_OPENCL, "[opencl_toneequal] couldn't enqueue kernel! %d\n", err);
+  return FALSE;
+}
+#endif
+
+
 void modify_roi_in(struct dt_iop_module_t *self, struct dt_dev_pixelpipe_iop_t *piece,
                    const dt_iop_roi_t *roi_out, dt_iop_roi_t *roi_in)
 {
@@ -1195,7 +1496,6 @@ static void gui_cache_init(struct dt_iop_module_t *self)
   if(g == NULL) return;
 
   dt_pthread_mutex_lock(&g->lock);
-  g->ui_preview_hash = 0;
   g->thumb_preview_hash = 0;
   g->max_histogram = 1;
   g->scale = 1.0f;
@@ -1217,10 +1517,6 @@ static void gui_cache_init(struct dt_iop_module_t *self)
   g->cursor_valid = FALSE;         // TRUE if mouse cursor is over the preview image
   g->has_focus = FALSE;            // TRUE if module has focus from GTK
 
-  g->full_preview_buf = NULL;
-  g->full_preview_buf_width = 0;
-  g->full_preview_buf_height = 0;
-
   g->thumb_preview_buf = NULL;
   g->thumb_preview_buf_width = 0;
   g->thumb_preview_buf_height = 0;
@@ -1417,11 +1713,29 @@ void init_global(dt_iop_module_so_t *module)
       = (dt_iop_toneequalizer_global_data_t *)malloc(sizeof(dt_iop_toneequalizer_global_data_t));
 
   module->data = gd;
+  const int program = 31; // toneequal.cl, from programs.conf
+  gd->kernel_toneeq_luminance_mask = dt_opencl_create_kernel(program, "toneeq_luminance_mask");
+  gd->kernel_toneeq_resample = dt_opencl_create_kernel(program, "toneeq_resample");
+  gd->kernel_toneeq_moments = dt_opencl_create_kernel(program, "toneeq_moments");
+  gd->kernel_toneeq_box_vertical = dt_opencl_create_kernel(program, "toneeq_box_vertical");
+  gd->kernel_toneeq_box_horizontal = dt_opencl_create_kernel(program, "toneeq_box_horizontal");
+  gd->kernel_toneeq_linear_model = dt_opencl_create_kernel(program, "toneeq_linear_model");
+  gd->kernel_toneeq_blend = dt_opencl_create_kernel(program, "toneeq_blend");
+  gd->kernel_toneeq_apply = dt_opencl_create_kernel(program, "toneeq_apply");
 }
 
 
 void cleanup_global(dt_iop_module_so_t *module)
 {
+  dt_iop_toneequalizer_global_data_t *gd = (dt_iop_toneequalizer_global_data_t *)module->data;
+  dt_opencl_free_kernel(gd->kernel_toneeq_luminance_mask);
+  dt_opencl_free_kernel(gd->kernel_toneeq_resample);
+  dt_opencl_free_kernel(gd->kernel_toneeq_moments);
+  dt_opencl_free_kernel(gd->kernel_toneeq_box_vertical);
+  dt_opencl_free_kernel(gd->kernel_toneeq_box_horizontal);
+  dt_opencl_free_kernel(gd->kernel_toneeq_linear_model);
+  dt_opencl_free_kernel(gd->kernel_toneeq_blend);
+  dt_opencl_free_kernel(gd->kernel_toneeq_apply);
   free(module->data);
   module->data = NULL;
 }
@@ -1492,6 +1806,8 @@ void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pi
 
 void cleanup_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
+  dt_iop_toneequalizer_data_t *d = (dt_iop_toneequalizer_data_t *)piece->data;
+  if(d->mask) dt_free_align(d->mask);
   free(piece->data);
   piece->data = NULL;
 }
@@ -3191,6 +3507,7 @@ void gui_cleanup(struct dt_iop_module_t *self)
   if(g->layout) g_object_unref(g->layout);
   if(g->cr) cairo_destroy(g->cr);
   if(g->cst) cairo_surface_destroy(g->cst);
+  if(g->thumb_preview_buf) dt_free_align(g->thumb_preview_buf);
 
   dt_pthread_mutex_destroy(&g->lock);
   free(self->gui_data);
@@ -116,7 +116,6 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
 
   width = roi_in->width;
   height = roi_in->height;
-  const size_t size = (size_t)width * height;
   const float iw = piece->buf_in.width * roi_out->scale;
   const float ih = piece->buf_in.height * roi_out->scale;
 
@@ -124,7 +123,7 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   if(inv_sigma_s < 3.0) inv_sigma_s = 3.0;
   inv_sigma_s = 1.0 / inv_sigma_s;
 
-  PermutohedralLattice<3, 2> lattice(size, omp_get_max_threads());
+  PermutohedralLattice<3, 2> lattice(omp_get_max_threads());
 
 // Build I=log(L)
 // and splat into the lattice
@@ -133,17 +132,16 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
 #endif
   for(int j = 0; j < height; j++)
   {
-    size_t index = (size_t)j * width;
     const int thread = omp_get_thread_num();
     const float *in = (const float *)ivoid + (size_t)j * width * ch;
-    for(int i = 0; i < width; i++, index++, in += ch)
+    for(int i = 0; i < width; i++, in += ch)
     {
       float L = 0.2126 * in[0] + 0.7152 * in[1] + 0.0722 * in[2];
       if(L <= 0.0) L = 1e-6;
       L = logf(L);
       float pos[3] = { i * inv_sigma_s, j * inv_sigma_s, L * inv_sigma_r };
       float val[2] = { L, 1.0 };
-      lattice.splat(pos, val, index, thread);
+      lattice.splat(pos, val, thread);
     }
   }
 
@@ -178,16 +176,16 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
 #endif
   for(int j = 0; j < height; j++)
   {
-    size_t index = (size_t)j * width;
     const float *in = (const float *)ivoid + (size_t)j * width * ch;
     float *out = (float *)ovoid + (size_t)j * width * ch;
-    for(int i = 0; i < width; i++, index++, in += ch, out += ch)
+    for(int i = 0; i < width; i++, in += ch, out += ch)
     {
-      float val[2];
-      lattice.slice(val, index);
       float L = 0.2126 * in[0] + 0.7152 * in[1] + 0.0722 * in[2];
       if(L <= 0.0) L = 1e-6;
       L = logf(L);
+      float pos[3] = { i * inv_sigma_s, j * inv_sigma_s, L * inv_sigma_r };
+      float val[2];
+      lattice.slice(val, pos);
       const float B = val[0] / val[1];
       const float detail = L - B;
       const float Ln = expf(B * (contr - 1.0f) + detail - 1.0f);
@@ -86,7 +86,8 @@ const char *name()
 
 int flags()
 {
-  return IOP_FLAGS_INCLUDE_IN_STYLES | IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_ALLOW_TILING;
+  return IOP_FLAGS_INCLUDE_IN_STYLES | IOP_FLAGS_SUPPORTS_BLENDING | IOP_FLAGS_ALLOW_TILING
+         | IOP_FLAGS_HALF_INPUT;
 }
 
 int default_group()
@@ -175,6 +176,39 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   if(piece->pipe->mask_display & DT_DEV_PIXELPIPE_DISPLAY_MASK) dt_iop_alpha_copy(ivoid, ovoid, roi_out->width, roi_out->height);
 }
 
+void process_pointwise(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const float *const in,
+                       float *const out, const size_t npixels)
+{
+  const dt_iop_velvia_data_t *const data = (dt_iop_velvia_data_t *)piece->data;
+  const float strength = data->strength / 100.0f;
+
+  if(strength <= 0.0)
+  {
+    if(in != out) memcpy(out, in, sizeof(float) * 4 * npixels);
+    return;
+  }
+
+  for(size_t k = 0; k < 4 * npixels; k += 4)
+  {
+    // same as process(), see there
+    const float pmax = MAX(in[k], MAX(in[k + 1], in[k + 2]));
+    const float pmin = MIN(in[k], MIN(in[k + 1], in[k + 2]));
+    const float plum = (pmax + pmin) / 2.0f;
+    const float psat = (plum <= 0.5f) ? (pmax - pmin) / (1e-5f + pmax + pmin)
+                                      : (pmax - pmin) / (1e-5f + MAX(0.0f, 2.0f - pmax - pmin));
+    const float pweight
+        = CLAMPS(((1.0f - (1.5f * psat)) + ((1.0f + (fabsf(plum - 0.5f) * 2.0f)) * (1.0f - data->bias)))
+                     / (1.0f + (1.0f - data->bias)),
+                 0.0f, 1.0f);
+    const float saturation = strength * pweight;
+    const float r = in[k], g = in[k + 1], b = in[k + 2];
+    out[k] = CLAMPS(r + saturation * (r - 0.5f * (g + b)), 0.0f, 1.0f);
+    out[k + 1] = CLAMPS(g + saturation * (g - 0.5f * (b + r)), 0.0f, 1.0f);
+    out[k + 2] = CLAMPS(b + saturation * (b - 0.5f * (r + g)), 0.0f, 1.0f);
+    out[k + 3] = in[k + 3];
+  }
+}
+
 #if defined(__SSE__)
 void process_sse2(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
                   void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
@@ -98,6 +98,25 @@ typedef struct dt_iop_watermark_data_t
   char font[64];
 } dt_iop_watermark_data_t;
 
+// a watermark rendered at one scale, with the margins of the safe text boxes
+typedef struct dt_iop_watermark_raster_t
+{
+  gchar *svgdoc; // after the substitution of the variables
+  float scale;
+  RsvgDimensionData dimension;
+  cairo_surface_t *surface;
+} dt_iop_watermark_raster_t;
+
+// the last rendered watermarks, so that a darkroom refresh or a batch export with the same watermark and size
+// doesn't parse and render the svg again. only used with darktable.plugin_threadsafe held, as is rsvg.
+typedef struct dt_iop_watermark_global_data_t
+{
+  GList *rasters; // most recently used first
+} dt_iop_watermark_global_data_t;
+
+// the rendered watermarks kept beyond the most recent one
+#define DT_IOP_WATERMARK_CACHE_BYTES ((size_t)128 << 20)
+
 typedef struct dt_iop_watermark_gui_data_t
 {
   GtkWidget *watermarks;                             // watermark
@@ -882,9 +901,77 @@ static gchar *_watermark_get_svgdoc(dt_iop_module_t *self, dt_iop_watermark_data
   return svgdoc;
 }
 
+static void _raster_free(gpointer data)
+{
+  dt_iop_watermark_raster_t *raster = (dt_iop_watermark_raster_t *)data;
+  g_free(raster->svgdoc);
+  cairo_surface_destroy(raster->surface);
+  g_free(raster);
+}
+
+// a negative scale finds the watermark at any scale, for its dimension
+static dt_iop_watermark_raster_t *_raster_find(dt_iop_watermark_global_data_t *gd, const gchar *svgdoc,
+                                               const float scale)
+{
+  for(GList *l = gd->rasters; l; l = g_list_next(l))
+  {
+    dt_iop_watermark_raster_t *raster = (dt_iop_watermark_raster_t *)l->data;
+    if((scale < 0.0f || raster->scale == scale) && !strcmp(raster->svgdoc, svgdoc))
+    {
+      gd->rasters = g_list_remove_link(gd->rasters, l);
+      gd->rasters = g_list_concat(l, gd->rasters);
+      return raster;
+    }
+  }
+  return NULL;
+}
+
+// takes the surface
+static dt_iop_watermark_raster_t *_raster_insert(dt_iop_watermark_global_data_t *gd, const gchar *svgdoc,
+                                                 const float scale, const RsvgDimensionData *dimension,
+                                                 cairo_surface_t *surface)
+{
+  dt_iop_watermark_raster_t *raster = g_malloc0(sizeof(dt_iop_watermark_raster_t));
+  raster->svgdoc = g_strdup(svgdoc);
+  raster->scale = scale;
+  raster->dimension = *dimension;
+  raster->surface = surface;
+  gd->rasters = g_list_prepend(gd->rasters, raster);
+
+  size_t bytes = 0;
+  for(GList *l = g_list_next(gd->rasters); l; l = g_list_next(l))
+  {
+    cairo_surface_t *s = ((dt_iop_watermark_raster_t *)l->data)->surface;
+    bytes += (size_t)cairo_image_surface_get_stride(s) * cairo_image_surface_get_height(s);
+    if(bytes > DT_IOP_WATERMARK_CACHE_BYTES)
+    {
+      l->prev->next = NULL;
+      l->prev = NULL;
+      g_list_free_full(l, _raster_free);
+      break;
+    }
+  }
+  return raster;
+}
+
+static RsvgHandle *_svg_parse(const gchar *svgdoc)
+{
+  GError *error = NULL;
+  RsvgHandle *svg = rsvg_handle_new_from_data((const guint8 *)svgdoc, strlen(svgdoc), &error);
+  if(!svg || error)
+  {
+    fprintf(stderr, "[watermark] error processing svg file: %s\n", error ? error->message : "");
+    if(error) g_error_free(error);
+    if(svg) g_object_unref(svg);
+    return NULL;
+  }
+  return svg;
+}
+
 void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
              void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
+  dt_iop_watermark_global_data_t *gd = (dt_iop_watermark_global_data_t *)self->global_data;
   dt_iop_watermark_data_t *data = (dt_iop_watermark_data_t *)piece->data;
   float *in = (float *)ivoid;
   float *out = (float *)ovoid;
@@ -909,7 +996,9 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   if((cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) || (image == NULL))
   {
     fprintf(stderr,"[watermark] Cairo surface error: %s\n",cairo_status_to_string(cairo_surface_status(surface)));
+    cairo_surface_destroy(surface);
     g_free(image);
+    g_free(svgdoc);
     memcpy(ovoid, ivoid, (size_t)sizeof(float) * ch * roi_out->width * roi_out->height);
     return;
   }
@@ -917,24 +1006,19 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   // rsvg (or some part of cairo which is used underneath) isn't thread safe, for example when handling fonts
   dt_pthread_mutex_lock(&darktable.plugin_threadsafe);
 
-  /* create the rsvghandle from parsed svg data */
-  GError *error = NULL;
-  RsvgHandle *svg = rsvg_handle_new_from_data((const guint8 *)svgdoc, strlen(svgdoc), &error);
-  g_free(svgdoc);
-  if(!svg || error)
+  /* get the dimension of svg, from the same watermark rendered before at any scale if there is one */
+  RsvgHandle *svg = NULL;
+  RsvgDimensionData dimension;
+  const dt_iop_watermark_raster_t *known = _raster_find(gd, svgdoc, -1.0f);
+  if(known)
+    dimension = known->dimension;
+  else
   {
-    cairo_surface_destroy(surface);
-    g_free(image);
-    memcpy(ovoid, ivoid, (size_t)sizeof(float) * ch * roi_out->width * roi_out->height);
-    dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
-    fprintf(stderr, "[watermark] error processing svg file: %s\n", error->message);
-    g_error_free(error);
-    return;
+    /* create the rsvghandle from parsed svg data */
+    svg = _svg_parse(svgdoc);
+    if(!svg) goto error;
+    rsvg_handle_get_dimensions(svg, &dimension);
   }
-
-  /* get the dimension of svg */
-  RsvgDimensionData dimension;
-  rsvg_handle_get_dimensions(svg, &dimension);
   // if no text is given dimensions are null
   if(!dimension.width) dimension.width = 1;
   if(!dimension.height) dimension.height = 1;
@@ -1025,30 +1109,39 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   const float svg_offset_x = ceilf(3.0f * scale);
   const float svg_offset_y = ceilf(3.0f * scale);
 
-  const int watermark_width =  (int)((dimension.width  * scale) + 3* svg_offset_x);
-  const int watermark_height = (int)((dimension.height * scale) + 3* svg_offset_y) ;
+  dt_iop_watermark_raster_t *raster = _raster_find(gd, svgdoc, scale);
+  if(!raster)
+  {
+    if(!svg) svg = _svg_parse(svgdoc);
+    if(!svg) goto error;
 
-  const int stride_two = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, watermark_width);
-  guint8 *image_two = (guint8 *)g_malloc0_n(watermark_height, stride_two);
+    const int watermark_width =  (int)((dimension.width  * scale) + 3* svg_offset_x);
+    const int watermark_height = (int)((dimension.height * scale) + 3* svg_offset_y) ;
 
-  cairo_surface_t *surface_two = cairo_image_surface_create_for_data(image_two, CAIRO_FORMAT_ARGB32, watermark_width,
-                                                                 watermark_height, stride_two);
-  if((cairo_surface_status(surface_two) != CAIRO_STATUS_SUCCESS) || (image_two == NULL))
-  {
-    fprintf(stderr,"[watermark] Cairo surface error: %s\n",cairo_status_to_string(cairo_surface_status(surface_two)));
-    cairo_surface_destroy(surface);
-    g_object_unref(svg);
-    g_free(image);
-    g_free(image_two);
-    memcpy(ovoid, ivoid, (size_t)sizeof(float) * ch * roi_out->width * roi_out->height);
-    dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
-    return;
+    cairo_surface_t *surface_two = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, watermark_width,
+                                                              watermark_height);
+    if(cairo_surface_status(surface_two) != CAIRO_STATUS_SUCCESS)
+    {
+      fprintf(stderr, "[watermark] Cairo surface error: %s\n",
+              cairo_status_to_string(cairo_surface_status(surface_two)));
+      cairo_surface_destroy(surface_two);
+      goto error;
+    }
+
+    // now set proper scale and translationfor the watermark itself
+    cairo_t *cr_two = cairo_create(surface_two);
+    cairo_translate(cr_two, svg_offset_x,svg_offset_y);
+    cairo_scale(cr_two, scale, scale);
+    /* render svg into surface*/
+    rsvg_handle_render_cairo(svg, cr_two);
+    cairo_destroy(cr_two);
+    cairo_surface_flush(surface_two);
+
+    raster = _raster_insert(gd, svgdoc, scale, &dimension, surface_two);
   }
 
   /* create cairo context and setup transformation/scale */
   cairo_t *cr = cairo_create(surface);
-  /* create cairo context for the scaled watermark */
-  cairo_t *cr_two = cairo_create(surface_two);
 
   // compute bounding box of rotated watermark
   const float bb_width = fabsf(svg_width * cosf(angle)) + fabsf(svg_height * sinf(angle));
@@ -1090,22 +1183,13 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
   cairo_rotate(cr, angle);
   cairo_translate(cr, -cX, -cY);
 
-  // now set proper scale and translationfor the watermark itself
-  cairo_translate(cr_two, svg_offset_x,svg_offset_y);
-  cairo_scale(cr_two, scale, scale);
-  /* render svg into surface*/
-  rsvg_handle_render_cairo(svg, cr_two);
-  cairo_surface_flush(surface_two);
-
-  cairo_set_source_surface(cr, surface_two,-svg_offset_x,-svg_offset_y);
+  cairo_set_source_surface(cr, raster->surface,-svg_offset_x,-svg_offset_y);
   cairo_paint(cr);
+  cairo_destroy(cr);
 
-  // no more non-thread safe rsvg usage
+  // no more non-thread safe rsvg usage, and the cached raster may go from here on
   dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
 
-  cairo_destroy(cr);
-  cairo_destroy(cr_two);
-
   /* ensure that all operations on surface finishing up */
   cairo_surface_flush(surface);
 
@@ -1135,10 +1219,18 @@ void process(struct dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const
 
   /* clean up */
   cairo_surface_destroy(surface);
-  cairo_surface_destroy(surface_two);
-  g_object_unref(svg);
+  if(svg) g_object_unref(svg);
+  g_free(image);
+  g_free(svgdoc);
+  return;
+
+error:
+  dt_pthread_mutex_unlock(&darktable.plugin_threadsafe);
+  cairo_surface_destroy(surface);
+  if(svg) g_object_unref(svg);
   g_free(image);
-  g_free(image_two);
+  g_free(svgdoc);
+  memcpy(ovoid, ivoid, (size_t)sizeof(float) * ch * roi_out->width * roi_out->height);
 }
 
 static void watermark_callback(GtkWidget *tb, gpointer user_data)
@@ -1336,6 +1428,19 @@ void commit_params(struct dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pix
 // fprintf(stderr,"Commit params: %s...\n",d->filename);
 }
 
+void init_global(dt_iop_module_so_t *module)
+{
+  module->data = calloc(1, sizeof(dt_iop_watermark_global_data_t));
+}
+
+void cleanup_global(dt_iop_module_so_t *module)
+{
+  dt_iop_watermark_global_data_t *gd = (dt_iop_watermark_global_data_t *)module->data;
+  g_list_free_full(gd->rasters, _raster_free);
+  free(module->data);
+  module->data = NULL;
+}
+
 void init_pipe(struct dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
   piece->data = malloc(sizeof(dt_iop_watermark_data_t));
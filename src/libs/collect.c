@@ -61,6 +61,11 @@ typedef struct dt_lib_collect_t
   GtkTreeView *view;
   int view_rule;
 
+  // what the view was last built from, so that a refresh which finds the same rows keeps it
+  gchar *view_key;    // rule, property and query
+  gchar *view_names;  // checksum of the names and ids of the rows, in order
+  gchar *view_counts; // checksum of their counts
+
   GtkTreeModel *treefilter;
   GtkTreeModel *listfilter;
   GtkScrolledWindow *scrolledwindow;
@@ -1070,6 +1075,7 @@ static char **split_path(const char *path)
 typedef struct name_key_tuple_t
 {
   char *name, *collate_key;
+  int id;
   int count;
 } name_key_tuple_t;
 
@@ -1097,6 +1103,116 @@ static gint neg_sort_folder_tag(gconstpointer a, gconstpointer b)
   return -g_strcmp0(tuple_a->collate_key, tuple_b->collate_key);
 }
 
+typedef enum _view_change_t
+{
+  _VIEW_REBUILD, // other rows, the view has to be built again
+  _VIEW_COUNTS,  // the same rows with other counts
+  _VIEW_KEEP     // nothing changed
+} _view_change_t;
+
+// compares the rows of the query with the ones the view was last built from, and remembers them
+static _view_change_t _view_cache_update(dt_lib_collect_t *d, const dt_lib_collect_rule_t *dr, const int property,
+                                         const gchar *query, GList *rows)
+{
+  GChecksum *names = g_checksum_new(G_CHECKSUM_MD5);
+  GChecksum *counts = g_checksum_new(G_CHECKSUM_MD5);
+  for(GList *r = rows; r; r = g_list_next(r))
+  {
+    const name_key_tuple_t *tuple = (name_key_tuple_t *)r->data;
+    if(tuple->name) g_checksum_update(names, (const guchar *)tuple->name, strlen(tuple->name) + 1);
+    g_checksum_update(names, (const guchar *)&tuple->id, sizeof(tuple->id));
+    g_checksum_update(counts, (const guchar *)&tuple->count, sizeof(tuple->count));
+  }
+
+  gchar *key = g_strdup_printf("%d %d %s", dr->num, property, query);
+  _view_change_t change = _VIEW_REBUILD;
+  if(!g_strcmp0(key, d->view_key) && !g_strcmp0(g_checksum_get_string(names), d->view_names))
+    change = g_strcmp0(g_checksum_get_string(counts), d->view_counts) ? _VIEW_COUNTS : _VIEW_KEEP;
+
+  g_free(d->view_key);
+  g_free(d->view_names);
+  g_free(d->view_counts);
+  d->view_key = key;
+  d->view_names = g_strdup(g_checksum_get_string(names));
+  d->view_counts = g_strdup(g_checksum_get_string(counts));
+  g_checksum_free(names);
+  g_checksum_free(counts);
+  return change;
+}
+
+// forgets the rows of the view, so that the next refresh builds it again
+static void _view_cache_clear(dt_lib_collect_t *d)
+{
+  g_free(d->view_key);
+  g_free(d->view_names);
+  g_free(d->view_counts);
+  d->view_key = d->view_names = d->view_counts = NULL;
+}
+
+static guint _tree_set_counts(GtkTreeModel *model, GtkTreeIter *parent, GHashTable *counts, const gboolean sum)
+{
+  guint total = 0;
+  GtkTreeIter iter;
+  gboolean valid = gtk_tree_model_iter_children(model, &iter, parent);
+  while(valid)
+  {
+    gchar *path = NULL;
+    gtk_tree_model_get(model, &iter, DT_LIB_COLLECT_COL_PATH, &path, -1);
+    guint count = path ? GPOINTER_TO_UINT(g_hash_table_lookup(counts, path)) : 0;
+    g_free(path);
+
+    const guint children = _tree_set_counts(model, &iter, counts, sum);
+    if(sum) count += children;
+    gtk_tree_store_set(GTK_TREE_STORE(model), &iter, DT_LIB_COLLECT_COL_COUNT, count, -1);
+    total += count;
+    valid = gtk_tree_model_iter_next(model, &iter);
+  }
+  return total;
+}
+
+// sets the counts of a tree built from rows of the same names, the parents get the sum of their children if sum
+static void _tree_update_counts(GtkTreeModel *model, GList *rows, const gboolean sum)
+{
+  GHashTable *counts = g_hash_table_new(g_str_hash, g_str_equal);
+  for(GList *r = rows; r; r = g_list_next(r))
+  {
+    const name_key_tuple_t *tuple = (name_key_tuple_t *)r->data;
+    if(!tuple->name) continue;
+    const guint count = GPOINTER_TO_UINT(g_hash_table_lookup(counts, tuple->name)) + tuple->count;
+    g_hash_table_insert(counts, tuple->name, GUINT_TO_POINTER(count));
+  }
+  _tree_set_counts(model, NULL, counts, sum);
+  g_hash_table_destroy(counts);
+}
+
+// shows the rows a former search has hidden, as a view built again would
+static gboolean _view_show_row(GtkTreeModel *model, GtkTreePath *path, GtkTreeIter *iter, gpointer data)
+{
+  gboolean visible;
+  gtk_tree_model_get(model, iter, DT_LIB_COLLECT_COL_VISIBLE, &visible, -1);
+  if(!visible)
+  {
+    if(GTK_IS_TREE_STORE(model))
+      gtk_tree_store_set(GTK_TREE_STORE(model), iter, DT_LIB_COLLECT_COL_VISIBLE, TRUE, -1);
+    else
+      gtk_list_store_set(GTK_LIST_STORE(model), iter, DT_LIB_COLLECT_COL_VISIBLE, TRUE, -1);
+  }
+  return FALSE;
+}
+
+// sets the counts of a list built from rows of the same names, in the same order
+static void _list_update_counts(GtkTreeModel *model, GList *rows)
+{
+  GtkTreeIter iter;
+  gboolean valid = gtk_tree_model_get_iter_first(model, &iter);
+  for(GList *r = rows; r && valid; r = g_list_next(r))
+  {
+    gtk_list_store_set(GTK_LIST_STORE(model), &iter, DT_LIB_COLLECT_COL_COUNT,
+                       ((name_key_tuple_t *)r->data)->count, -1);
+    valid = gtk_tree_model_iter_next(model, &iter);
+  }
+}
+
 // create a key such that "darktable|" is coming first, and the rest is ordered such that sub tags are coming directly
 // behind their parent
 static char *tag_collate_key(char *tag)
@@ -1174,13 +1290,6 @@ static void tree_view(dt_lib_collect_rule_t *dr)
     GtkTreeIter uncategorized = { 0 };
     GtkTreeIter temp;
 
-    g_object_ref(model);
-    g_object_unref(d->treefilter);
-    gtk_tree_view_set_model(GTK_TREE_VIEW(d->view), NULL);
-    gtk_tree_store_clear(GTK_TREE_STORE(model));
-    gtk_widget_hide(GTK_WIDGET(d->scrolledwindow));
-    gtk_widget_hide(GTK_WIDGET(d->sw2));
-
     /* query construction */
     gchar *where_ext = dt_collection_get_extended_where(darktable.collection, dr->num);
     gchar *query = 0;
@@ -1272,11 +1381,11 @@ static void tree_view(dt_lib_collect_rule_t *dr)
       name_key_tuple_t *tuple = (name_key_tuple_t *)malloc(sizeof(name_key_tuple_t));
       tuple->name = name;
       tuple->collate_key = collate_key;
+      tuple->id = sqlite3_column_int(stmt, 1);
       tuple->count = count;
       sorted_names = g_list_prepend(sorted_names, tuple);
     }
     sqlite3_finalize(stmt);
-    g_free(query);
     sorted_names = g_list_sort(sorted_names, (sort_descend && (property == DT_COLLECTION_PROP_FOLDERS
                                                               || property == DT_COLLECTION_PROP_DAY
                                                               || is_time_property(property)
@@ -1284,144 +1393,164 @@ static void tree_view(dt_lib_collect_rule_t *dr)
                                              ) ? neg_sort_folder_tag : sort_folder_tag
                               );
 
-    for(GList *names = sorted_names; names; names = g_list_next(names))
-    {
-      name_key_tuple_t *tuple = (name_key_tuple_t *)names->data;
-      char *name = tuple->name;
-      const int count = tuple->count;
-      if(name == NULL) continue; // safeguard against degenerated db entries
+    const _view_change_t change = _view_cache_update(d, dr, property, query, sorted_names);
+    g_free(query);
+
+    if(change == _VIEW_COUNTS)
+      _tree_update_counts(model, sorted_names, property == DT_COLLECTION_PROP_FOLDERS
+                                               || property == DT_COLLECTION_PROP_DAY
+                                               || is_time_property(property));
+    if(change != _VIEW_REBUILD && !dr->typing)
+      gtk_tree_model_foreach(model, _view_show_row, NULL);
 
-      if(property == DT_COLLECTION_PROP_TAG && strchr(name, '|') == 0 && (last_tokens_length == 0 || strcmp(name, *last_tokens)))
+    if(change == _VIEW_REBUILD)
+    {
+      g_object_ref(model);
+      g_object_unref(d->treefilter);
+      gtk_tree_view_set_model(GTK_TREE_VIEW(d->view), NULL);
+      gtk_tree_store_clear(GTK_TREE_STORE(model));
+      gtk_widget_hide(GTK_WIDGET(d->scrolledwindow));
+      gtk_widget_hide(GTK_WIDGET(d->sw2));
+
+      for(GList *names = sorted_names; names; names = g_list_next(names))
       {
-        /* add uncategorized root iter if not exists */
-        if(!uncategorized.stamp)
+        name_key_tuple_t *tuple = (name_key_tuple_t *)names->data;
+        char *name = tuple->name;
+        const int count = tuple->count;
+        if(name == NULL) continue; // safeguard against degenerated db entries
+
+        if(property == DT_COLLECTION_PROP_TAG && strchr(name, '|') == 0 && (last_tokens_length == 0 || strcmp(name, *last_tokens)))
         {
-          gtk_tree_store_insert(GTK_TREE_STORE(model), &uncategorized, NULL, 0);
-          gtk_tree_store_set(GTK_TREE_STORE(model), &uncategorized, DT_LIB_COLLECT_COL_TEXT,
-                             _(UNCATEGORIZED_TAG), DT_LIB_COLLECT_COL_PATH, "", DT_LIB_COLLECT_COL_VISIBLE,
-                             TRUE, -1);
-        }
+          /* add uncategorized root iter if not exists */
+          if(!uncategorized.stamp)
+          {
+            gtk_tree_store_insert(GTK_TREE_STORE(model), &uncategorized, NULL, 0);
+            gtk_tree_store_set(GTK_TREE_STORE(model), &uncategorized, DT_LIB_COLLECT_COL_TEXT,
+                               _(UNCATEGORIZED_TAG), DT_LIB_COLLECT_COL_PATH, "", DT_LIB_COLLECT_COL_VISIBLE,
+                               TRUE, -1);
+          }
 
-        /* adding an uncategorized tag */
-        gtk_tree_store_insert(GTK_TREE_STORE(model), &temp, &uncategorized, -1);
-        gtk_tree_store_set(GTK_TREE_STORE(model), &temp, DT_LIB_COLLECT_COL_TEXT, name,
-                           DT_LIB_COLLECT_COL_PATH, name, DT_LIB_COLLECT_COL_VISIBLE, TRUE,
-                           DT_LIB_COLLECT_COL_COUNT, count, -1);
-      }
-      else
-      {
-        char **tokens;
-        if(property == DT_COLLECTION_PROP_FOLDERS)
-          tokens = split_path(name);
-        else if(property == DT_COLLECTION_PROP_DAY)
-          tokens = g_strsplit(name, ":", -1);
-        else if(is_time_property(property))
-          tokens = g_strsplit_set(name, ": ", 4);
+          /* adding an uncategorized tag */
+          gtk_tree_store_insert(GTK_TREE_STORE(model), &temp, &uncategorized, -1);
+          gtk_tree_store_set(GTK_TREE_STORE(model), &temp, DT_LIB_COLLECT_COL_TEXT, name,
+                             DT_LIB_COLLECT_COL_PATH, name, DT_LIB_COLLECT_COL_VISIBLE, TRUE,
+                             DT_LIB_COLLECT_COL_COUNT, count, -1);
+        }
         else
-          tokens = g_strsplit(name, "|", -1);
-
-        if(tokens != NULL)
         {
-          // find the number of common parts at the beginning of tokens and last_tokens
-          GtkTreeIter parent = last_parent;
-          const int tokens_length = string_array_length(tokens);
-          int common_length = 0;
-          if(last_tokens)
+          char **tokens;
+          if(property == DT_COLLECTION_PROP_FOLDERS)
+            tokens = split_path(name);
+          else if(property == DT_COLLECTION_PROP_DAY)
+            tokens = g_strsplit(name, ":", -1);
+          else if(is_time_property(property))
+            tokens = g_strsplit_set(name, ": ", 4);
+          else
+            tokens = g_strsplit(name, "|", -1);
+
+          if(tokens != NULL)
           {
-            while(tokens[common_length] && last_tokens[common_length] &&
-                  !g_strcmp0(tokens[common_length], last_tokens[common_length]))
+            // find the number of common parts at the beginning of tokens and last_tokens
+            GtkTreeIter parent = last_parent;
+            const int tokens_length = string_array_length(tokens);
+            int common_length = 0;
+            if(last_tokens)
             {
-              common_length++;
-            }
+              while(tokens[common_length] && last_tokens[common_length] &&
+                    !g_strcmp0(tokens[common_length], last_tokens[common_length]))
+              {
+                common_length++;
+              }
 
-            // point parent iter to where the entries should be added
-            for(int i = common_length; i < last_tokens_length; i++)
-            {
-              gtk_tree_model_iter_parent(model, &parent, &last_parent);
-              last_parent = parent;
+              // point parent iter to where the entries should be added
+              for(int i = common_length; i < last_tokens_length; i++)
+              {
+                gtk_tree_model_iter_parent(model, &parent, &last_parent);
+                last_parent = parent;
+              }
             }
-          }
 
-          // insert everything from tokens past the common part
+            // insert everything from tokens past the common part
 
-          char *pth = NULL;
-#ifndef _WIN32
-          if(property == DT_COLLECTION_PROP_FOLDERS) pth = g_strdup("/");
-#endif
-          for(int i = 0; i < common_length; i++)
-            pth = dt_util_dstrcat(pth, format_separator, tokens[i]);
+            char *pth = NULL;
+  #ifndef _WIN32
+            if(property == DT_COLLECTION_PROP_FOLDERS) pth = g_strdup("/");
+  #endif
+            for(int i = 0; i < common_length; i++)
+              pth = dt_util_dstrcat(pth, format_separator, tokens[i]);
 
-          for(char **token = &tokens[common_length]; *token; token++)
-          {
-            GtkTreeIter iter;
-
-            pth = dt_util_dstrcat(pth, format_separator, *token);
-            if(is_time_property(property) && !*(token + 1))
-              pth[10] = ' ';
-
-            gchar *pth2 = g_strdup(pth);
-            pth2[strlen(pth2) - 1] = '\0';
-            gtk_tree_store_insert(GTK_TREE_STORE(model), &iter, common_length > 0 ? &parent : NULL, -1);
-            gtk_tree_store_set(GTK_TREE_STORE(model), &iter, DT_LIB_COLLECT_COL_TEXT, *token,
-                               DT_LIB_COLLECT_COL_PATH, pth2, DT_LIB_COLLECT_COL_VISIBLE, TRUE,
-                               DT_LIB_COLLECT_COL_COUNT, (*(token + 1)?0:count), -1);
-
-            // also add the item count to parents
-            if((property == DT_COLLECTION_PROP_FOLDERS
-                || property == DT_COLLECTION_PROP_DAY
-                ||  is_time_property(property)
-                ) && !*(token + 1))
+            for(char **token = &tokens[common_length]; *token; token++)
             {
-              guint parentcount;
-              GtkTreeIter parent2, child = iter;
-
-              while(gtk_tree_model_iter_parent(model, &parent2, &child))
+              GtkTreeIter iter;
+
+              pth = dt_util_dstrcat(pth, format_separator, *token);
+              if(is_time_property(property) && !*(token + 1))
+                pth[10] = ' ';
+
+              gchar *pth2 = g_strdup(pth);
+              pth2[strlen(pth2) - 1] = '\0';
+              gtk_tree_store_insert(GTK_TREE_STORE(model), &iter, common_length > 0 ? &parent : NULL, -1);
+              gtk_tree_store_set(GTK_TREE_STORE(model), &iter, DT_LIB_COLLECT_COL_TEXT, *token,
+                                 DT_LIB_COLLECT_COL_PATH, pth2, DT_LIB_COLLECT_COL_VISIBLE, TRUE,
+                                 DT_LIB_COLLECT_COL_COUNT, (*(token + 1)?0:count), -1);
+
+              // also add the item count to parents
+              if((property == DT_COLLECTION_PROP_FOLDERS
+                  || property == DT_COLLECTION_PROP_DAY
+                  ||  is_time_property(property)
+                  ) && !*(token + 1))
               {
-                gtk_tree_model_get(model, &parent2, DT_LIB_COLLECT_COL_COUNT, &parentcount, -1);
-                gtk_tree_store_set(GTK_TREE_STORE(model), &parent2, DT_LIB_COLLECT_COL_COUNT, count + parentcount, -1);
-                child = parent2;
+                guint parentcount;
+                GtkTreeIter parent2, child = iter;
+
+                while(gtk_tree_model_iter_parent(model, &parent2, &child))
+                {
+                  gtk_tree_model_get(model, &parent2, DT_LIB_COLLECT_COL_COUNT, &parentcount, -1);
+                  gtk_tree_store_set(GTK_TREE_STORE(model), &parent2, DT_LIB_COLLECT_COL_COUNT, count + parentcount, -1);
+                  child = parent2;
+                }
               }
-            }
 
-            if(property == DT_COLLECTION_PROP_FOLDERS)
-              gtk_tree_store_set(GTK_TREE_STORE(model), &iter, DT_LIB_COLLECT_COL_UNREACHABLE,
-                                 !(g_file_test(pth, G_FILE_TEST_IS_DIR)), -1);
-            common_length++;
-            parent = iter;
-            g_free(pth2);
-          }
+              if(property == DT_COLLECTION_PROP_FOLDERS)
+                gtk_tree_store_set(GTK_TREE_STORE(model), &iter, DT_LIB_COLLECT_COL_UNREACHABLE,
+                                   !(g_file_test(pth, G_FILE_TEST_IS_DIR)), -1);
+              common_length++;
+              parent = iter;
+              g_free(pth2);
+            }
 
-          g_free(pth);
+            g_free(pth);
 
-          // remember things for the next round
-          if(last_tokens) g_strfreev(last_tokens);
-          last_tokens = tokens;
-          last_parent = parent;
-          last_tokens_length = tokens_length;
+            // remember things for the next round
+            if(last_tokens) g_strfreev(last_tokens);
+            last_tokens = tokens;
+            last_parent = parent;
+            last_tokens_length = tokens_length;
+          }
         }
       }
-    }
-    g_list_free_full(sorted_names, free_tuple);
 
-    gtk_tree_view_set_tooltip_column(GTK_TREE_VIEW(d->view), DT_LIB_COLLECT_COL_TOOLTIP);
+      gtk_tree_view_set_tooltip_column(GTK_TREE_VIEW(d->view), DT_LIB_COLLECT_COL_TOOLTIP);
 
-    d->treefilter = _create_filtered_model(model, dr);
+      d->treefilter = _create_filtered_model(model, dr);
 
-    GtkTreeSelection *selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(d->view));
-    if(property == DT_COLLECTION_PROP_DAY || is_time_property(property))
-    {
-      gtk_tree_selection_set_mode(selection, GTK_SELECTION_MULTIPLE);
-    }
-    else
-    {
-      gtk_tree_selection_set_mode(selection, GTK_SELECTION_SINGLE);
-    }
+      GtkTreeSelection *selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(d->view));
+      if(property == DT_COLLECTION_PROP_DAY || is_time_property(property))
+      {
+        gtk_tree_selection_set_mode(selection, GTK_SELECTION_MULTIPLE);
+      }
+      else
+      {
+        gtk_tree_selection_set_mode(selection, GTK_SELECTION_SINGLE);
+      }
 
-    gtk_tree_view_set_model(GTK_TREE_VIEW(d->view), d->treefilter);
-    gtk_widget_set_no_show_all(GTK_WIDGET(d->scrolledwindow), FALSE);
-    gtk_widget_show_all(GTK_WIDGET(d->scrolledwindow));
+      gtk_tree_view_set_model(GTK_TREE_VIEW(d->view), d->treefilter);
+      gtk_widget_set_no_show_all(GTK_WIDGET(d->scrolledwindow), FALSE);
+      gtk_widget_show_all(GTK_WIDGET(d->scrolledwindow));
 
-    g_object_unref(model);
+      g_object_unref(model);
+    }
+    g_list_free_full(sorted_names, free_tuple);
     g_strfreev(last_tokens);
     d->view_rule = property;
   }
@@ -1484,12 +1613,6 @@ static void list_view(dt_lib_collect_rule_t *dr)
   {
     sqlite3_stmt *stmt;
     GtkTreeIter iter;
-    g_object_unref(d->listfilter);
-    g_object_ref(model);
-    gtk_tree_view_set_model(GTK_TREE_VIEW(d->view), NULL);
-    gtk_list_store_clear(GTK_LIST_STORE(model));
-    gtk_widget_hide(GTK_WIDGET(d->scrolledwindow));
-    gtk_widget_hide(GTK_WIDGET(d->sw2));
     gchar *where_ext = dt_collection_get_extended_where(darktable.collection, dr->num);
 
     char query[1024] = { 0 };
@@ -1758,21 +1881,53 @@ static void list_view(dt_lib_collect_rule_t *dr)
 
     g_free(where_ext);
 
+    GList *rows = NULL;
     if(strlen(query) > 0)
     {
       DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
       while(sqlite3_step(stmt) == SQLITE_ROW)
       {
-        const char *folder = (const char *)sqlite3_column_text(stmt, 0);
-        if(folder == NULL) continue; // safeguard against degenerated db entries
+        const char *value = (const char *)sqlite3_column_text(stmt, 0);
+        if(value == NULL) continue; // safeguard against degenerated db entries
+
+        name_key_tuple_t *tuple = (name_key_tuple_t *)malloc(sizeof(name_key_tuple_t));
+        tuple->name = g_strdup(value);
+        tuple->collate_key = NULL;
+        tuple->id = sqlite3_column_int(stmt, 1);
+        tuple->count = sqlite3_column_int(stmt, 2);
+        rows = g_list_prepend(rows, tuple);
+      }
+      sqlite3_finalize(stmt);
+      rows = g_list_reverse(rows);
+    }
+
+    const _view_change_t change = _view_cache_update(d, dr, property, query, rows);
+
+    if(change == _VIEW_COUNTS)
+      _list_update_counts(model, rows);
+    if(change != _VIEW_REBUILD && !dr->typing)
+      gtk_tree_model_foreach(model, _view_show_row, NULL);
+
+    if(change == _VIEW_REBUILD)
+    {
+      g_object_unref(d->listfilter);
+      g_object_ref(model);
+      gtk_tree_view_set_model(GTK_TREE_VIEW(d->view), NULL);
+      gtk_list_store_clear(GTK_LIST_STORE(model));
+      gtk_widget_hide(GTK_WIDGET(d->scrolledwindow));
+      gtk_widget_hide(GTK_WIDGET(d->sw2));
+
+      for(GList *r = rows; r; r = g_list_next(r))
+      {
+        const name_key_tuple_t *tuple = (name_key_tuple_t *)r->data;
+        const gchar *value = tuple->name;
+        const char *folder = value;
 
         gtk_list_store_append(GTK_LIST_STORE(model), &iter);
         if(property == DT_COLLECTION_PROP_FILMROLL)
         {
           folder = dt_image_film_roll_name(folder);
         }
-        const gchar *value = (gchar *)sqlite3_column_text(stmt, 0);
-        const int count = sqlite3_column_int(stmt, 2);
 
         // replace invalid utf8 characters if any
         gchar *text = g_strdup(value);
@@ -1782,37 +1937,37 @@ static void list_view(dt_lib_collect_rule_t *dr)
         gchar *escaped_text = g_markup_escape_text(text, -1);
 
         gtk_list_store_set(GTK_LIST_STORE(model), &iter, DT_LIB_COLLECT_COL_TEXT, folder,
-                           DT_LIB_COLLECT_COL_ID, sqlite3_column_int(stmt, 1), DT_LIB_COLLECT_COL_TOOLTIP,
+                           DT_LIB_COLLECT_COL_ID, tuple->id, DT_LIB_COLLECT_COL_TOOLTIP,
                            escaped_text, DT_LIB_COLLECT_COL_PATH, value, DT_LIB_COLLECT_COL_VISIBLE, TRUE,
-                           DT_LIB_COLLECT_COL_COUNT, count,
+                           DT_LIB_COLLECT_COL_COUNT, tuple->count,
                            -1);
         g_free(text);
         g_free(escaped_text);
       }
-      sqlite3_finalize(stmt);
-    }
 
-    gtk_tree_view_set_tooltip_column(GTK_TREE_VIEW(d->view), DT_LIB_COLLECT_COL_TOOLTIP);
+      gtk_tree_view_set_tooltip_column(GTK_TREE_VIEW(d->view), DT_LIB_COLLECT_COL_TOOLTIP);
 
-    d->listfilter = _create_filtered_model(model, dr);
+      d->listfilter = _create_filtered_model(model, dr);
 
-    GtkTreeSelection *selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(d->view));
-    if(property == DT_COLLECTION_PROP_APERTURE || property == DT_COLLECTION_PROP_FOCAL_LENGTH
-       || property == DT_COLLECTION_PROP_ISO || property == DT_COLLECTION_PROP_EXPOSURE
-       || property == DT_COLLECTION_PROP_ASPECT_RATIO)
-    {
-      gtk_tree_selection_set_mode(selection, GTK_SELECTION_MULTIPLE);
-    }
-    else
-    {
-      gtk_tree_selection_set_mode(selection, GTK_SELECTION_SINGLE);
-    }
+      GtkTreeSelection *selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(d->view));
+      if(property == DT_COLLECTION_PROP_APERTURE || property == DT_COLLECTION_PROP_FOCAL_LENGTH
+         || property == DT_COLLECTION_PROP_ISO || property == DT_COLLECTION_PROP_EXPOSURE
+         || property == DT_COLLECTION_PROP_ASPECT_RATIO)
+      {
+        gtk_tree_selection_set_mode(selection, GTK_SELECTION_MULTIPLE);
+      }
+      else
+      {
+        gtk_tree_selection_set_mode(selection, GTK_SELECTION_SINGLE);
+      }
 
-    gtk_tree_view_set_model(GTK_TREE_VIEW(d->view), d->listfilter);
-    gtk_widget_set_no_show_all(GTK_WIDGET(d->scrolledwindow), FALSE);
-    gtk_widget_show_all(GTK_WIDGET(d->scrolledwindow));
+      gtk_tree_view_set_model(GTK_TREE_VIEW(d->view), d->listfilter);
+      gtk_widget_set_no_show_all(GTK_WIDGET(d->scrolledwindow), FALSE);
+      gtk_widget_show_all(GTK_WIDGET(d->scrolledwindow));
 
-    g_object_unref(model);
+      g_object_unref(model);
+    }
+    g_list_free_full(rows, free_tuple);
 
     d->view_rule = property;
   }
@@ -1953,6 +2108,17 @@ static void _lib_collect_gui_update(dt_lib_module_t *self)
   --darktable.gui->reset;
 }
 
+// the signals only mark the view out of date while the module can't be seen, it is refreshed when it is shown
+static void _lib_collect_gui_update_if_shown(dt_lib_module_t *self)
+{
+  if(gtk_widget_get_mapped(self->widget)) _lib_collect_gui_update(self);
+}
+
+static void _lib_collect_map(GtkWidget *widget, dt_lib_module_t *self)
+{
+  _lib_collect_gui_update(self);
+}
+
 void gui_reset(dt_lib_module_t *self)
 {
   dt_conf_set_int("plugins/lighttable/collect/num_rules", 1);
@@ -2282,14 +2448,19 @@ static void collection_updated(gpointer instance, dt_collection_change_t query_c
   // update tree
   d->view_rule = -1;
   d->rule[d->active_rule].typing = FALSE;
-  _lib_collect_gui_update(self);
+  _lib_collect_gui_update_if_shown(self);
 }
 
 
 static void filmrolls_updated(gpointer instance, gpointer self)
 {
+  dt_lib_module_t *dm = (dt_lib_module_t *)self;
+  dt_lib_collect_t *d = (dt_lib_collect_t *)dm->data;
+
+  // folders may have been moved, test them again when the view is refreshed
+  _view_cache_clear(d);
   // TODO: We should update the count of images here
-  _lib_collect_gui_update(self);
+  _lib_collect_gui_update_if_shown(self);
 }
 
 static void filmrolls_imported(gpointer instance, int film_id, gpointer self)
@@ -2300,7 +2471,7 @@ static void filmrolls_imported(gpointer instance, int film_id, gpointer self)
   // update tree
   d->view_rule = -1;
   d->rule[d->active_rule].typing = FALSE;
-  _lib_collect_gui_update(self);
+  _lib_collect_gui_update_if_shown(self);
 }
 
 static void preferences_changed(gpointer instance, gpointer self)
@@ -2319,7 +2490,7 @@ static void filmrolls_removed(gpointer instance, gpointer self)
     d->view_rule = -1;
   }
   d->rule[d->active_rule].typing = FALSE;
-  _lib_collect_gui_update(self);
+  _lib_collect_gui_update_if_shown(self);
 }
 
 static void tag_changed(gpointer instance, gpointer self)
@@ -2331,7 +2502,7 @@ static void tag_changed(gpointer instance, gpointer self)
   {
     d->view_rule = -1;
     d->rule[d->active_rule].typing = FALSE;
-    _lib_collect_gui_update(self);
+    _lib_collect_gui_update_if_shown(self);
 
     //need to reload collection since we have tags as active collection filter
     dt_control_signal_block_by_func(darktable.signals, G_CALLBACK(collection_updated),
@@ -2402,7 +2573,7 @@ static void metadata_changed(gpointer instance, int type, gpointer self)
   {
     d->view_rule = -1;
     d->rule[d->active_rule].typing = FALSE;
-    _lib_collect_gui_update(self);
+    _lib_collect_gui_update_if_shown(self);
     // update images collection
     dt_control_signal_block_by_func(darktable.signals, G_CALLBACK(collection_updated),
                                     darktable.view_manager->proxy.module_collect.module);
@@ -2639,6 +2810,7 @@ void gui_init(dt_lib_module_t *self)
   darktable.view_manager->proxy.module_collect.update = _lib_collect_gui_update;
 
   _lib_collect_gui_update(self);
+  g_signal_connect(G_OBJECT(self->widget), "map", G_CALLBACK(_lib_collect_map), self);
 
   if(_combo_get_active_collection(GTK_COMBO_BOX(d->rule[0].combo)) == DT_COLLECTION_PROP_TAG)
   {
@@ -2687,6 +2859,7 @@ void gui_cleanup(dt_lib_module_t *self)
   dt_control_signal_disconnect(darktable.signals, G_CALLBACK(view_set_click), self);
   darktable.view_manager->proxy.module_collect.module = NULL;
   free(d->params);
+  _view_cache_clear(d);
 
   /* cleanup mem */
 
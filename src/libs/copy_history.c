@@ -42,7 +42,7 @@ typedef struct dt_lib_copy_history_t
 {
   GtkWidget *pastemode;
   GtkButton *paste, *paste_parts;
-  GtkWidget *copy_button, *delete_button, *load_button, *write_button;
+  GtkWidget *copy_button, *delete_button, *load_button, *write_button, *lightroom_button;
   GtkWidget *copy_parts_button;
   GtkButton *compress_button;
   guint timeout_handle;
@@ -80,6 +80,7 @@ static void _update(dt_lib_module_t *self)
   gtk_widget_set_sensitive(GTK_WIDGET(d->compress_button), act_on_cnt > 0);
   gtk_widget_set_sensitive(GTK_WIDGET(d->load_button), act_on_cnt > 0);
   gtk_widget_set_sensitive(GTK_WIDGET(d->write_button), act_on_cnt > 0);
+  gtk_widget_set_sensitive(GTK_WIDGET(d->lightroom_button), act_on_cnt > 0);
 
   gtk_widget_set_sensitive(GTK_WIDGET(d->copy_button), act_on_cnt == 1);
   gtk_widget_set_sensitive(GTK_WIDGET(d->copy_parts_button), act_on_cnt == 1);
@@ -109,6 +110,11 @@ static void write_button_clicked(GtkWidget *widget, dt_lib_module_t *self)
   dt_control_write_sidecar_files();
 }
 
+static void lightroom_button_clicked(GtkWidget *widget, dt_lib_module_t *self)
+{
+  dt_control_lightroom_import();
+}
+
 static void load_button_clicked(GtkWidget *widget, dt_lib_module_t *self)
 {
   GtkWidget *win = dt_ui_main_window(darktable.gui->ui);
@@ -162,29 +168,11 @@ static void load_button_clicked(GtkWidget *widget, dt_lib_module_t *self)
 
 static void compress_button_clicked(GtkWidget *widget, gpointer user_data)
 {
-  const GtkWidget *win = dt_ui_main_window(darktable.gui->ui);
   const GList *imgs = dt_view_get_images_to_act_on(TRUE, TRUE);
   if(g_list_length((GList *)imgs) < 1) return;
 
-  const int missing = dt_history_compress_on_list(imgs);
-
-  dt_collection_update_query(darktable.collection, DT_COLLECTION_CHANGE_RELOAD,
-                             g_list_copy((GList *)imgs));
-  dt_control_queue_redraw_center();
-  if (missing)
-  {
-    GtkWidget *dialog = gtk_message_dialog_new(
-    GTK_WINDOW(win), GTK_DIALOG_DESTROY_WITH_PARENT, GTK_MESSAGE_QUESTION, GTK_BUTTONS_CLOSE,
-    ngettext("no history compression of 1 image.\nsee tag: darktable|problem|history-compress.",
-             "no history compression of %d images.\nsee tag: darktable|problem|history-compress.", missing ), missing);
-#ifdef GDK_WINDOWING_QUARTZ
-    dt_osx_disallow_fullscreen(dialog);
-#endif
-
-    gtk_window_set_title(GTK_WINDOW(dialog), _("history compression warning"));
-    gtk_dialog_run(GTK_DIALOG(dialog));
-    gtk_widget_destroy(dialog);
-  }
+  // large selections take long, the job reports the images it could not compress when done
+  dt_control_compress_history();
 }
 
 
@@ -399,9 +387,18 @@ void gui_init(dt_lib_module_t *self)
   d->write_button = button;
   gtk_widget_set_tooltip_text(button, _("write history stack and tags to XMP sidecar files"));
   dt_gui_add_help_link(button, "history_stack.html#history_stack_usage");
-  gtk_grid_attach(grid, button, 3, line, 3, 1);
+  gtk_grid_attach(grid, button, 3, line++, 3, 1);
   g_signal_connect(G_OBJECT(button), "clicked", G_CALLBACK(write_button_clicked), (gpointer)self);
 
+  button = gtk_button_new_with_label(_("import lightroom"));
+  ellipsize_button(button);
+  d->lightroom_button = button;
+  gtk_widget_set_tooltip_text(button, _("import the develop data of lightroom XMP sidecar files\n"
+                                        "into the selected images without a history stack"));
+  dt_gui_add_help_link(button, "history_stack.html#history_stack_usage");
+  gtk_grid_attach(grid, button, 0, line, 6, 1);
+  g_signal_connect(G_OBJECT(button), "clicked", G_CALLBACK(lightroom_button_clicked), (gpointer)self);
+
   dt_control_signal_connect(darktable.signals, DT_SIGNAL_SELECTION_CHANGED,
                             G_CALLBACK(_image_selection_changed_callback), self);
   dt_control_signal_connect(darktable.signals, DT_SIGNAL_MOUSE_OVER_IMAGE_CHANGE,
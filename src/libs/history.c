@@ -16,12 +16,14 @@
     along with darktable.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include "bauhaus/bauhaus.h"
 #include "common/darktable.h"
 #include "common/debug.h"
 #include "common/styles.h"
 #include "common/undo.h"
 #include "control/conf.h"
 #include "control/control.h"
+#include "develop/blend.h"
 #include "develop/develop.h"
 #include "develop/masks.h"
 #include "gui/accelerators.h"
@@ -36,6 +38,8 @@ DT_MODULE(1)
 
 typedef struct dt_undo_history_t
 {
+  // the before snapshot is a delta: the items equal to the item at the same position of the after snapshot
+  // are NULL, see _history_delta()
   GList *before_snapshot, *after_snapshot;
   int before_end, after_end;
   GList *before_iop_order_list, *after_iop_order_list;
@@ -52,6 +56,10 @@ typedef struct dt_lib_history_t
   GList *previous_snapshot;
   int previous_history_end;
   GList *previous_iop_order_list;
+  // the undo record of the slider being dragged
+  dt_undo_history_t *drag_undo;
+  // the list is rebuilt from an idle callback while the darkroom changes images
+  guint rebuild_source;
 } dt_lib_history_t;
 
 /* 3 widgets in each history line */
@@ -159,6 +167,8 @@ void gui_init(dt_lib_module_t *self)
 
 void gui_cleanup(dt_lib_module_t *self)
 {
+  dt_lib_history_t *d = (dt_lib_history_t *)self->data;
+  if(d->rebuild_source) g_source_remove(d->rebuild_source);
   dt_control_signal_disconnect(darktable.signals, G_CALLBACK(_lib_history_change_callback), self);
   dt_control_signal_disconnect(darktable.signals, G_CALLBACK(_lib_history_module_remove_callback), self);
   g_free(self->data);
@@ -270,6 +280,59 @@ static void _history_invalidate_cb(gpointer user_data, dt_undo_type_t type, dt_u
   dt_dev_invalidate_history_module(hist->after_snapshot, module);
 }
 
+static gboolean _history_item_equal(const dt_dev_history_item_t *a, const dt_dev_history_item_t *b)
+{
+  // the masks are not compared, items holding forms are always kept
+  return a->module && a->module == b->module && !a->forms && !b->forms && a->enabled == b->enabled
+         && a->iop_order == b->iop_order && a->multi_priority == b->multi_priority && a->num == b->num
+         && !strcmp(a->op_name, b->op_name) && !strcmp(a->multi_name, b->multi_name)
+         && !memcmp(a->params, b->params, a->module->params_size)
+         && !memcmp(a->blend_params, b->blend_params, sizeof(dt_develop_blend_params_t));
+}
+
+// a copy of history in which the items equal to those of base at the same position are NULL. most changes
+// touch a single item, so an undo step then keeps one copy of the history instead of two.
+static GList *_history_delta(GList *history, GList *base)
+{
+  GList *delta = NULL;
+  for(GList *h = history; h; h = g_list_next(h))
+  {
+    const dt_dev_history_item_t *item = (dt_dev_history_item_t *)h->data;
+    const dt_dev_history_item_t *b = base ? (dt_dev_history_item_t *)base->data : NULL;
+    if(b && _history_item_equal(item, b))
+      delta = g_list_prepend(delta, NULL);
+    else
+    {
+      GList *one = g_list_prepend(NULL, h->data);
+      delta = g_list_concat(dt_history_duplicate(one), delta);
+      g_list_free(one);
+    }
+    if(base) base = g_list_next(base);
+  }
+  return g_list_reverse(delta);
+}
+
+// the full history of a delta against base
+static GList *_history_undelta(GList *delta, GList *base)
+{
+  GList *history = NULL;
+  for(GList *h = delta; h; h = g_list_next(h))
+  {
+    GList *one = g_list_prepend(NULL, h->data ? h->data : (base ? base->data : NULL));
+    history = g_list_concat(dt_history_duplicate(one), history);
+    g_list_free(one);
+    if(base) base = g_list_next(base);
+  }
+  return g_list_reverse(history);
+}
+
+static void _history_delta_free(GList *delta)
+{
+  for(GList *h = delta; h; h = g_list_next(h))
+    if(h->data) dt_dev_free_history_item(h->data);
+  g_list_free(delta);
+}
+
 static void _add_module_expander(GList *iop_list, dt_iop_module_t *module)
 {
   // dt_dev_reload_history_items won't do this for base instances
@@ -552,7 +615,7 @@ static void _pop_undo(gpointer user_data, dt_undo_type_t type, dt_undo_data_t da
 
     if(action == DT_ACTION_UNDO)
     {
-      history_temp = dt_history_duplicate(hist->before_snapshot);
+      history_temp = _history_undelta(hist->before_snapshot, hist->after_snapshot);
       hist_end = hist->before_end;
       dev->iop_order_list = dt_ioppr_iop_order_copy_deep(hist->before_iop_order_list);
     }
@@ -635,7 +698,7 @@ static void _pop_undo(gpointer user_data, dt_undo_type_t type, dt_undo_data_t da
 static void _history_undo_data_free(gpointer data)
 {
   dt_undo_history_t *hist = (dt_undo_history_t *)data;
-  g_list_free_full(hist->before_snapshot, dt_dev_free_history_item);
+  _history_delta_free(hist->before_snapshot);
   g_list_free_full(hist->after_snapshot, dt_dev_free_history_item);
   g_list_free_full(hist->before_iop_order_list, free);
   g_list_free_full(hist->after_iop_order_list, free);
@@ -665,11 +728,16 @@ static void _lib_history_will_change_callback(gpointer instance, GList *history,
   }
 }
 
-static void _lib_history_change_callback(gpointer instance, gpointer user_data)
+static void _lib_history_rebuild(dt_lib_module_t *self)
 {
-  dt_lib_module_t *self = (dt_lib_module_t *)user_data;
   dt_lib_history_t *d = (dt_lib_history_t *)self->data;
 
+  if(d->rebuild_source)
+  {
+    g_source_remove(d->rebuild_source);
+    d->rebuild_source = 0;
+  }
+
   /* first destroy all buttons in list */
   gtk_container_foreach(GTK_CONTAINER(d->history_box), (GtkCallback)gtk_widget_destroy, 0);
 
@@ -680,24 +748,6 @@ static void _lib_history_change_callback(gpointer instance, gpointer user_data)
   gtk_box_pack_start(GTK_BOX(d->history_box), widget, TRUE, TRUE, 0);
   num++;
 
-  if (d->record_undo == TRUE)
-  {
-    /* record undo/redo history snapshot */
-    dt_undo_history_t *hist = malloc(sizeof(dt_undo_history_t));
-    hist->before_snapshot = dt_history_duplicate(d->previous_snapshot);
-    hist->before_end = d->previous_history_end;
-    hist->before_iop_order_list = dt_ioppr_iop_order_copy_deep(d->previous_iop_order_list);
-
-    hist->after_snapshot = dt_history_duplicate(darktable.develop->history);
-    hist->after_end = darktable.develop->history_end;
-    hist->after_iop_order_list = dt_ioppr_iop_order_copy_deep(darktable.develop->iop_order_list);
-
-    dt_undo_record(darktable.undo, self, DT_UNDO_HISTORY, (dt_undo_data_t)hist,
-                   _pop_undo, _history_undo_data_free);
-  }
-  else
-    d->record_undo = TRUE;
-
   /* lock history mutex */
   dt_pthread_mutex_lock(&darktable.develop->history_mutex);
 
@@ -733,6 +783,65 @@ static void _lib_history_change_callback(gpointer instance, gpointer user_data)
   dt_pthread_mutex_unlock(&darktable.develop->history_mutex);
 }
 
+static gboolean _lib_history_rebuild_idle(gpointer user_data)
+{
+  dt_lib_module_t *self = (dt_lib_module_t *)user_data;
+  dt_lib_history_t *d = (dt_lib_history_t *)self->data;
+  d->rebuild_source = 0;
+  _lib_history_rebuild(self);
+  return G_SOURCE_REMOVE;
+}
+
+static void _lib_history_change_callback(gpointer instance, gpointer user_data)
+{
+  dt_lib_module_t *self = (dt_lib_module_t *)user_data;
+  dt_lib_history_t *d = (dt_lib_history_t *)self->data;
+
+  if(d->record_undo == TRUE && darktable.bauhaus->dragging && d->drag_undo
+     && d->drag_undo->after_end == darktable.develop->history_end
+     && dt_undo_is_last(darktable.undo, DT_UNDO_HISTORY, d->drag_undo))
+  {
+    /* the values of a dragged slider change the same history item, keep one undo step for the drag */
+    dt_undo_history_t *hist = d->drag_undo;
+    GList *before = _history_undelta(hist->before_snapshot, hist->after_snapshot);
+    _history_delta_free(hist->before_snapshot);
+    g_list_free_full(hist->after_snapshot, dt_dev_free_history_item);
+    g_list_free_full(hist->after_iop_order_list, free);
+    hist->after_snapshot = dt_history_duplicate(darktable.develop->history);
+    hist->before_snapshot = _history_delta(before, hist->after_snapshot);
+    g_list_free_full(before, dt_dev_free_history_item);
+    hist->after_iop_order_list = dt_ioppr_iop_order_copy_deep(darktable.develop->iop_order_list);
+  }
+  else if (d->record_undo == TRUE)
+  {
+    /* record undo/redo history snapshot */
+    dt_undo_history_t *hist = malloc(sizeof(dt_undo_history_t));
+    hist->after_snapshot = dt_history_duplicate(darktable.develop->history);
+    hist->before_snapshot = _history_delta(d->previous_snapshot, hist->after_snapshot);
+    hist->before_end = d->previous_history_end;
+    hist->before_iop_order_list = dt_ioppr_iop_order_copy_deep(d->previous_iop_order_list);
+
+    hist->after_end = darktable.develop->history_end;
+    hist->after_iop_order_list = dt_ioppr_iop_order_copy_deep(darktable.develop->iop_order_list);
+
+    dt_undo_record(darktable.undo, self, DT_UNDO_HISTORY, (dt_undo_data_t)hist,
+                   _pop_undo, _history_undo_data_free);
+    d->drag_undo = darktable.bauhaus->dragging ? hist : NULL;
+  }
+  else
+    d->record_undo = TRUE;
+
+  if(darktable.develop->gui_lazy)
+  {
+    /* the items of the previous image go right away, the new ones come once the image is on screen */
+    gtk_container_foreach(GTK_CONTAINER(d->history_box), (GtkCallback)gtk_widget_destroy, 0);
+    if(!d->rebuild_source) d->rebuild_source = g_idle_add_full(G_PRIORITY_LOW, _lib_history_rebuild_idle, self, NULL);
+    return;
+  }
+
+  _lib_history_rebuild(self);
+}
+
 static void _lib_history_compress_clicked_callback(GtkWidget *widget, gpointer user_data)
 {
   const int32_t imgid = darktable.develop->image_storage.id;
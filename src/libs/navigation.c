@@ -36,6 +36,10 @@ typedef struct dt_lib_navigation_t
 {
   int dragging;
   int zoom_w, zoom_h;
+  // the preview at the size of the widget, made once for every preview so that panning only draws the box
+  cairo_surface_t *surface;
+  uint64_t surface_hash;
+  int surface_imgid, surface_max_width, surface_max_height;
 } dt_lib_navigation_t;
 
 
@@ -148,12 +152,67 @@ void gui_cleanup(dt_lib_module_t *self)
   /* disconnect from signal */
   dt_control_signal_disconnect(darktable.signals, G_CALLBACK(_lib_navigation_control_redraw_callback), self);
 
+  dt_lib_navigation_t *d = (dt_lib_navigation_t *)self->data;
+  if(d->surface) cairo_surface_destroy(d->surface);
   g_free(self->data);
   self->data = NULL;
 }
 
 
 
+// the output of the preview pipe scaled to fit max_wd x max_ht pixels, NULL if there is none for the image. it
+// comes from the copy the preview worker downscaled to that size, or from the whole output until there is one.
+static cairo_surface_t *_lib_navigation_get_surface(dt_lib_navigation_t *d, dt_develop_t *dev, const int max_wd,
+                                                    const int max_ht)
+{
+  dt_dev_pixelpipe_t *pipe = dev->preview_pipe;
+  dt_pthread_mutex_lock(&pipe->backbuf_mutex);
+
+  // the next preview is downscaled for the current size of the widget
+  dev->preview_thumb.max_width = max_wd;
+  dev->preview_thumb.max_height = max_ht;
+
+  if(!pipe->output_backbuf || dev->image_storage.id != pipe->output_imgid)
+  {
+    dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
+    return NULL;
+  }
+
+  if(d->surface && d->surface_hash == pipe->backbuf_hash && d->surface_imgid == pipe->output_imgid
+     && d->surface_max_width == max_wd && d->surface_max_height == max_ht)
+  {
+    dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
+    return d->surface;
+  }
+
+  const gboolean thumb = dev->preview_thumb.buf && dev->preview_thumb.hash == pipe->backbuf_hash
+                         && dev->preview_thumb.imgid == pipe->output_imgid;
+  uint8_t *buf = thumb ? dev->preview_thumb.buf : pipe->output_backbuf;
+  const int wd = thumb ? dev->preview_thumb.width : pipe->output_backbuf_width;
+  const int ht = thumb ? dev->preview_thumb.height : pipe->output_backbuf_height;
+  const float scale = fminf(1.0f, fminf(max_wd / (float)wd, max_ht / (float)ht));
+  const int sw = MAX(1, (int)(wd * scale)), sh = MAX(1, (int)(ht * scale));
+
+  if(d->surface) cairo_surface_destroy(d->surface);
+  d->surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, sw, sh);
+  const int stride = cairo_format_stride_for_width(CAIRO_FORMAT_RGB24, wd);
+  cairo_surface_t *source = cairo_image_surface_create_for_data(buf, CAIRO_FORMAT_RGB24, wd, ht, stride);
+  cairo_t *cr = cairo_create(d->surface);
+  cairo_scale(cr, sw / (double)wd, sh / (double)ht);
+  cairo_set_source_surface(cr, source, 0, 0);
+  cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_GOOD);
+  cairo_paint(cr);
+  cairo_destroy(cr);
+  cairo_surface_destroy(source);
+
+  d->surface_hash = pipe->backbuf_hash;
+  d->surface_imgid = pipe->output_imgid;
+  d->surface_max_width = max_wd;
+  d->surface_max_height = max_ht;
+  dt_pthread_mutex_unlock(&pipe->backbuf_mutex);
+  return d->surface;
+}
+
 static gboolean _lib_navigation_draw_callback(GtkWidget *widget, cairo_t *crf, gpointer user_data)
 {
   dt_lib_module_t *self = (dt_lib_module_t *)user_data;
@@ -173,19 +232,15 @@ static gboolean _lib_navigation_draw_callback(GtkWidget *widget, cairo_t *crf, g
   gtk_render_background(context, cr, 0, 0, allocation.width, allocation.height);
 
   /* draw navigation image if available */
-  if(dev->preview_pipe->output_backbuf && dev->image_storage.id == dev->preview_pipe->output_imgid)
+  cairo_surface_t *surface
+      = _lib_navigation_get_surface(d, dev, width * darktable.gui->ppd, height * darktable.gui->ppd);
+  if(surface)
   {
-    dt_pthread_mutex_t *mutex = &dev->preview_pipe->backbuf_mutex;
-    dt_pthread_mutex_lock(mutex);
-
     cairo_save(cr);
-    const int wd = dev->preview_pipe->output_backbuf_width;
-    const int ht = dev->preview_pipe->output_backbuf_height;
+    const int wd = cairo_image_surface_get_width(surface);
+    const int ht = cairo_image_surface_get_height(surface);
     const float scale = fminf(width / (float)wd, height / (float)ht);
 
-    const int stride = cairo_format_stride_for_width(CAIRO_FORMAT_RGB24, wd);
-    cairo_surface_t *surface
-        = cairo_image_surface_create_for_data(dev->preview_pipe->output_backbuf, CAIRO_FORMAT_RGB24, wd, ht, stride);
     cairo_translate(cr, width / 2.0, height / 2.0f);
     cairo_scale(cr, scale, scale);
     cairo_translate(cr, -.5f * wd, -.5f * ht);
@@ -334,9 +389,6 @@ static gboolean _lib_navigation_draw_callback(GtkWidget *widget, cairo_t *crf, g
     cairo_line_to(cr, width - 0.05 * h, -0.9 * h);
     cairo_line_to(cr, width - 0.5 * h, -0.1 * h);
     cairo_fill(cr);
-    cairo_surface_destroy(surface);
-
-    dt_pthread_mutex_unlock(mutex);
   }
 
   /* blit memsurface into widget */
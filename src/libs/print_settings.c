@@ -126,6 +126,13 @@ typedef struct dt_print_format_t
   dt_imageio_module_data_t head;
   int bpp;
   dt_lib_print_job_t *params;
+  // to stream the image into the pdf while it is processed
+  cmsHPROFILE buf_profile, p_profile;
+  float page_width, page_height;
+  dt_pdf_t *pdf;
+  cmsHTRANSFORM transform;
+  uint8_t *rows, *converted; // one strip without alpha, and converted to the printer profile
+  size_t rows_size;
 } dt_print_format_t;
 
 static int bpp(dt_imageio_module_data_t *data)
@@ -145,6 +152,30 @@ static const char *mime(dt_imageio_module_data_t *data)
   return "memory";
 }
 
+static int flags(dt_imageio_module_data_t *data)
+{
+  // a print at the printer resolution can be huge, it's never held in memory in one piece
+  return FORMAT_FLAGS_STREAMED;
+}
+
+static void _drop_alpha(const void *in, void *out, const size_t pixels, const int bpp)
+{
+  if (bpp == 8)
+  {
+    const uint8_t *in_ptr = (const uint8_t *)in;
+    uint8_t *out_ptr = (uint8_t *)out;
+    for(size_t k = 0; k < pixels; k++, in_ptr += 4, out_ptr += 3)
+      memcpy(out_ptr, in_ptr, 3);
+  }
+  else
+  {
+    const uint16_t *in_ptr = (const uint16_t *)in;
+    uint16_t *out_ptr = (uint16_t *)out;
+    for(size_t k = 0; k < pixels; k++, in_ptr += 4, out_ptr += 3)
+      memcpy(out_ptr, in_ptr, 6);
+  }
+}
+
 static int write_image(dt_imageio_module_data_t *data, const char *filename, const void *in,
                        dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
                        void *exif, int exif_len, int imgid, int num, int total, dt_dev_pixelpipe_t *pipe,
@@ -152,30 +183,88 @@ static int write_image(dt_imageio_module_data_t *data, const char *filename, con
 {
   dt_print_format_t *d = (dt_print_format_t *)data;
 
-  d->params->buf = (uint16_t *)malloc(d->head.width * d->head.height * 3 * (d->bpp == 8?1:2));
+  d->params->buf = (uint16_t *)malloc((size_t)d->head.width * d->head.height * 3 * (d->bpp == 8?1:2));
+  if(!d->params->buf) return 1;
+
+  _drop_alpha(in, d->params->buf, (size_t)d->head.width * d->head.height, d->bpp);
+
+  return 0;
+}
+
+// the streamed export: the strips are converted to the printer profile one by one and compressed into the pdf
+// right away. returning NULL falls back to write_image().
+static void *write_image_begin(dt_imageio_module_data_t *data, const char *filename,
+                               dt_colorspaces_color_profile_type_t over_type, const char *over_filename,
+                               void *exif, int exif_len, int imgid, int num, int total)
+{
+  dt_print_format_t *d = (dt_print_format_t *)data;
 
-  if (d->bpp == 8)
+  if(d->p_profile)
   {
-    const uint8_t *in_ptr = (const uint8_t *)in;
-    uint8_t *out_ptr = (uint8_t *)d->params->buf;
-    for(int y = 0; y < d->head.height; y++)
-    {
-      for(int x = 0; x < d->head.width; x++, in_ptr += 4, out_ptr += 3)
-        memcpy(out_ptr, in_ptr, 3);
-    }
+    d->transform = dt_printer_profile_create_transform(d->buf_profile, d->p_profile, d->bpp,
+                                                       d->params->p_icc_intent,
+                                                       d->params->black_point_compensation);
+    if(!d->transform) return NULL;
   }
-  else
+
+  d->pdf = dt_pdf_start(d->params->pdf_filename, d->page_width, d->page_height, d->params->prt.printer.resolution,
+                        DT_PDF_STREAM_ENCODER_FLATE);
+  if(d->pdf)
+    d->params->pdf_image = dt_pdf_add_image_begin(d->pdf, FALSE, d->head.width, d->head.height, 8, 0, 0.0);
+
+  if(!d->params->pdf_image)
   {
-    const uint16_t *in_ptr = (const uint16_t *)in;
-    uint16_t *out_ptr = (uint16_t *)d->params->buf;
-    for(int y = 0; y < d->head.height; y++)
-    {
-      for(int x = 0; x < d->head.width; x++, in_ptr += 4, out_ptr += 3)
-        memcpy(out_ptr, in_ptr, 6);
-    }
+    if(d->pdf) dt_pdf_finish(d->pdf, NULL, 0);
+    d->pdf = NULL;
+    if(d->transform) cmsDeleteTransform(d->transform);
+    d->transform = NULL;
+    return NULL;
+  }
+  return d;
+}
+
+static int write_rows(dt_imageio_module_data_t *data, void *state, const void *in, int y, int height)
+{
+  dt_print_format_t *d = (dt_print_format_t *)data;
+  const size_t pixels = (size_t)d->head.width * height;
+
+  // all strips but the last one have the same height
+  if(pixels * 3 * (d->bpp / 8) > d->rows_size)
+  {
+    free(d->rows);
+    free(d->converted);
+    d->rows_size = pixels * 3 * (d->bpp / 8);
+    d->rows = malloc(d->rows_size);
+    d->converted = d->transform ? malloc(pixels * 3) : NULL;
+    if(!d->rows || (d->transform && !d->converted)) return 1;
   }
 
-  return 0;
+  _drop_alpha(in, d->rows, pixels, d->bpp);
+
+  const uint8_t *out = d->rows;
+  if(d->transform)
+  {
+    dt_apply_printer_transform(d->transform, d->rows, d->converted, d->head.width, height, d->bpp);
+    out = d->converted;
+  }
+
+  return dt_pdf_add_image_rows(d->pdf, d->params->pdf_image, out, height);
+}
+
+static int write_image_end(dt_imageio_module_data_t *data, void *state, const gboolean failed)
+{
+  dt_print_format_t *d = (dt_print_format_t *)data;
+
+  // the pdf stays open for the page, which needs the layout
+  const int res = dt_pdf_add_image_end(d->pdf, d->params->pdf_image) || failed;
+
+  if(d->transform) cmsDeleteTransform(d->transform);
+  d->transform = NULL;
+  free(d->rows);
+  free(d->converted);
+  d->rows = d->converted = NULL;
+  d->rows_size = 0;
+  return res;
 }
 
 static int _print_job_run(dt_job_t *job)
@@ -217,19 +306,66 @@ static int _print_job_run(dt_job_t *job)
 
   dt_print(DT_DEBUG_PRINT, "[print] max image size %d x %d (at resolution %d)\n", max_width, max_height, params->prt.printer.resolution);
 
-  dt_imageio_module_format_t buf;
+  const float page_width  = dt_pdf_mm_to_point(width);
+  const float page_height = dt_pdf_mm_to_point(height);
+
+  const dt_colorspaces_color_profile_t *buf_profile = dt_colorspaces_get_output_profile(params->imgid,
+                                                                                        params->buf_icc_type,
+                                                                                        params->buf_icc_profile);
+  const dt_colorspaces_color_profile_t *pprof = NULL;
+
+  if (*params->p_icc_profile)
+  {
+    pprof = dt_colorspaces_get_profile(params->p_icc_type, params->p_icc_profile, DT_PROFILE_DIRECTION_OUT);
+    if (!pprof)
+    {
+      dt_control_log(_("cannot open printer profile `%s'"), params->p_icc_profile);
+      fprintf(stderr, "cannot open printer profile `%s'\n", params->p_icc_profile);
+      dt_control_queue_redraw();
+      return 1;
+    }
+    if(!buf_profile || !buf_profile->profile)
+    {
+      dt_control_log(_("error getting output profile for image %d"), params->imgid);
+      fprintf(stderr, "error getting output profile for image %d\n", params->imgid);
+      dt_control_queue_redraw();
+      return 1;
+    }
+  }
+
+  dt_loc_get_tmp_dir(params->pdf_filename, sizeof(params->pdf_filename));
+  g_strlcat(params->pdf_filename, "/pf.XXXXXX.pdf", sizeof(params->pdf_filename));
+
+  gint fd = g_mkstemp(params->pdf_filename);
+  if(fd == -1)
+  {
+    dt_control_log(_("failed to create temporary pdf for printing"));
+    fprintf(stderr, "failed to create temporary pdf for printing\n");
+    return 1;
+  }
+  close(fd);
+
+  dt_imageio_module_format_t buf = { 0 };
   buf.mime = mime;
   buf.levels = levels;
   buf.bpp = bpp;
+  buf.flags = flags;
   buf.write_image = write_image;
+  buf.write_image_begin = write_image_begin;
+  buf.write_rows = write_rows;
+  buf.write_image_end = write_image_end;
 
-  dt_print_format_t dat;
+  dt_print_format_t dat = { 0 };
   dat.head.max_width = max_width;
   dat.head.max_height = max_height;
   dat.head.style[0] = '\0';
   dat.head.style_append = params->style_append;
   dat.bpp = *params->p_icc_profile ? 16 : 8; // set to 16bit when a profile is to be applied
   dat.params = params;
+  dat.buf_profile = pprof ? buf_profile->profile : NULL;
+  dat.p_profile = pprof ? pprof->profile : NULL;
+  dat.page_width = page_width;
+  dat.page_height = page_height;
 
   if (params->style) g_strlcpy(dat.head.style, params->style, sizeof(dat.head.style));
 
@@ -240,13 +376,11 @@ static int _print_job_run(dt_job_t *job)
   const gboolean high_quality = TRUE;
   const gboolean upscale = TRUE;
   const gboolean export_masks = FALSE;
-  const dt_colorspaces_color_profile_t *buf_profile = dt_colorspaces_get_output_profile(params->imgid,
-                                                                                        params->buf_icc_type,
-                                                                                        params->buf_icc_profile);
 
-  dt_imageio_export_with_flags(params->imgid, "unused", &buf, (dt_imageio_module_data_t *)&dat, TRUE, FALSE,
-                               high_quality, upscale, FALSE, NULL, FALSE, export_masks, params->buf_icc_type,
-                               params->buf_icc_profile, params->buf_icc_intent,  NULL, NULL, 1, 1, NULL);
+  const int export_err
+      = dt_imageio_export_with_flags(params->imgid, "unused", &buf, (dt_imageio_module_data_t *)&dat, TRUE, FALSE,
+                                     high_quality, upscale, FALSE, NULL, FALSE, export_masks, params->buf_icc_type,
+                                     params->buf_icc_profile, params->buf_icc_intent,  NULL, NULL, 1, 1, NULL);
 
   // after exporting we know the real size of the image, compute the layout
 
@@ -270,67 +404,49 @@ static int _print_job_run(dt_job_t *job)
   dt_print(DT_DEBUG_PRINT, "[print] margins top %d ; bottom %d ; left %d ; right %d\n",
            margin_top, margin_bottom, margin_left, margin_right);
 
-  // we have the exported buffer, let's apply the printer profile
+  dt_pdf_t *pdf = dat.pdf;
 
-  if (*params->p_icc_profile)
+  if(pdf)
   {
-    const dt_colorspaces_color_profile_t *pprof = dt_colorspaces_get_profile(params->p_icc_type, params->p_icc_profile,
-                                                                             DT_PROFILE_DIRECTION_OUT);
-    if (!pprof)
+    // the image went into the pdf strip by strip while it was processed, only the page is missing
+    if(export_err)
     {
-      dt_control_log(_("cannot open printer profile `%s'"), params->p_icc_profile);
-      fprintf(stderr, "cannot open printer profile `%s'\n", params->p_icc_profile);
+      dt_pdf_finish(pdf, NULL, 0);
+      dt_control_log(_("cannot process `%s' for printing"), params->job_title);
+      fprintf(stderr, "cannot process image %d for printing\n", params->imgid);
       dt_control_queue_redraw();
       return 1;
     }
-    else
-    {
-      if(!buf_profile || !buf_profile->profile)
-      {
-        dt_control_log(_("error getting output profile for image %d"), params->imgid);
-        fprintf(stderr, "error getting output profile for image %d\n", params->imgid);
-        dt_control_queue_redraw();
-        return 1;
-      }
-      if (dt_apply_printer_profile((void **)&(params->buf), dat.head.width, dat.head.height, dat.bpp, buf_profile->profile,
-                                   pprof->profile, params->p_icc_intent, params->black_point_compensation))
-      {
-        dt_control_log(_("cannot apply printer profile `%s'"), params->p_icc_profile);
-        fprintf(stderr, "cannot apply printer profile `%s'\n", params->p_icc_profile);
-        dt_control_queue_redraw();
-        return 1;
-      }
-    }
   }
+  else
+  {
+    // we have the exported buffer, let's apply the printer profile
 
-  const float page_width  = dt_pdf_mm_to_point(width);
-  const float page_height = dt_pdf_mm_to_point(height);
-
-  if(dt_control_job_get_state(job) == DT_JOB_STATE_CANCELLED) return 0;
-  dt_control_job_set_progress(job, 0.9);
-
-  dt_loc_get_tmp_dir(params->pdf_filename, sizeof(params->pdf_filename));
-  g_strlcat(params->pdf_filename, "/pf.XXXXXX.pdf", sizeof(params->pdf_filename));
+    if (pprof && dt_apply_printer_profile((void **)&(params->buf), dat.head.width, dat.head.height, dat.bpp,
+                                          buf_profile->profile, pprof->profile, params->p_icc_intent,
+                                          params->black_point_compensation))
+    {
+      dt_control_log(_("cannot apply printer profile `%s'"), params->p_icc_profile);
+      fprintf(stderr, "cannot apply printer profile `%s'\n", params->p_icc_profile);
+      dt_control_queue_redraw();
+      return 1;
+    }
 
-  gint fd = g_mkstemp(params->pdf_filename);
-  if(fd == -1)
-  {
-    dt_control_log(_("failed to create temporary pdf for printing"));
-    fprintf(stderr, "failed to create temporary pdf for printing\n");
-    return 1;
-  }
-  close(fd);
+    if(dt_control_job_get_state(job) == DT_JOB_STATE_CANCELLED) return 0;
 
-  const int icc_id = 0;
+    const int icc_id = 0;
 
-  dt_pdf_t *pdf = dt_pdf_start(params->pdf_filename, page_width, page_height, params->prt.printer.resolution, DT_PDF_STREAM_ENCODER_FLATE);
+    pdf = dt_pdf_start(params->pdf_filename, page_width, page_height, params->prt.printer.resolution, DT_PDF_STREAM_ENCODER_FLATE);
 
 /*
-  // ??? should a profile be embedded here?
-  if (*printer_profile)
-    icc_id = dt_pdf_add_icc(pdf, printer_profile);
+    // ??? should a profile be embedded here?
+    if (*printer_profile)
+      icc_id = dt_pdf_add_icc(pdf, printer_profile);
 */
-  params->pdf_image = dt_pdf_add_image(pdf, (uint8_t *)params->buf, dat.head.width, dat.head.height, 8, icc_id, 0.0);
+    params->pdf_image = dt_pdf_add_image(pdf, (uint8_t *)params->buf, dat.head.width, dat.head.height, 8, icc_id, 0.0);
+  }
+
+  dt_control_job_set_progress(job, 0.9);
 
   //  PDF bounding-box has origin on bottom-left
   params->pdf_image->bb_x      = dt_pdf_pixel_to_point((float)margin_left, params->prt.printer.resolution);
@@ -29,6 +29,12 @@
 #include "libs/lib.h"
 #include "libs/lib_api.h"
 
+#include <fcntl.h>
+#include <glib/gstdio.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
 DT_MODULE(1)
 
 #define DT_LIB_SNAPSHOTS_COUNT 4
@@ -41,7 +47,8 @@ typedef struct dt_lib_snapshot_t
   GtkWidget *button;
   float zoom_x, zoom_y, zoom_scale;
   int32_t zoom, closeup;
-  char filename[512];
+  cairo_surface_t *surface; // the center view as it was drawn, kept in memory
+  char filename[512];       // only written for lua, see _snapshot_write()
 } dt_lib_snapshot_t;
 
 
@@ -342,14 +349,22 @@ int mouse_moved(dt_lib_module_t *self, double x, double y, double pressure, int
   return 0;
 }
 
+static void _snapshot_clear(dt_lib_snapshot_t *s)
+{
+  if(s->surface) cairo_surface_destroy(s->surface);
+  s->surface = NULL;
+}
+
 void gui_reset(dt_lib_module_t *self)
 {
   dt_lib_snapshots_t *d = (dt_lib_snapshots_t *)self->data;
   d->num_snapshots = 0;
+  if(d->snapshot_image) cairo_surface_destroy(d->snapshot_image);
   d->snapshot_image = NULL;
 
   for(uint32_t k = 0; k < d->size; k++)
   {
+    _snapshot_clear(d->snapshot + k);
     gtk_widget_hide(d->snapshot[k].button);
     gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(d->snapshot[k].button), FALSE);
   }
@@ -425,6 +440,10 @@ void gui_cleanup(dt_lib_module_t *self)
 {
   dt_lib_snapshots_t *d = (dt_lib_snapshots_t *)self->data;
 
+  // a pending request would fill a slot which is gone
+  darktable.develop->proxy.snapshot.request = FALSE;
+  if(d->snapshot_image) cairo_surface_destroy(d->snapshot_image);
+  for(uint32_t k = 0; k < d->size; k++) _snapshot_clear(d->snapshot + k);
   g_free(d->snapshot);
 
   g_free(self->data);
@@ -456,6 +475,8 @@ static void _lib_snapshots_add_button_clicked_callback(GtkWidget *widget, gpoint
   GtkWidget *b = d->snapshot[0].button;
   d->snapshot[0] = last;
   d->snapshot[0].button = b;
+  // the one shown keeps its own reference
+  _snapshot_clear(d->snapshot + 0);
   const gchar *name = _("original");
   if(darktable.develop->history_end > 0)
   {
@@ -485,7 +506,7 @@ static void _lib_snapshots_add_button_clicked_callback(GtkWidget *widget, gpoint
   for(uint32_t k = 0; k < d->num_snapshots; k++) gtk_widget_show(d->snapshot[k].button);
 
   /* request a new snapshot for top slot */
-  dt_dev_snapshot_request(darktable.develop, (const char *)&d->snapshot[0].filename);
+  dt_dev_snapshot_request(darktable.develop, &d->snapshot[0].surface);
 }
 #undef ellipsize_button
 
@@ -522,7 +543,7 @@ static void _lib_snapshots_toggled_callback(GtkToggleButton *widget, gpointer us
 
     dt_dev_invalidate(darktable.develop);
 
-    d->snapshot_image = dt_cairo_image_surface_create_from_png(s->filename);
+    if(s->surface) d->snapshot_image = cairo_surface_reference(s->surface);
   }
 
   /* redraw center view */
@@ -545,6 +566,25 @@ static gboolean _lib_snapshots_toggle_last(GtkAccelGroup *accel_group, GObject *
 }
 
 #ifdef USE_LUA
+static cairo_status_t _write_snapshot_data(void *closure, const unsigned char *data, unsigned int length)
+{
+  const int fd = GPOINTER_TO_INT(closure);
+  ssize_t res = write(fd, data, length);
+  if(res != length)
+    return CAIRO_STATUS_WRITE_ERROR;
+  return CAIRO_STATUS_SUCCESS;
+}
+
+// the snapshots stay in memory, the file is only there for scripts which want to read it
+static void _snapshot_write(dt_lib_snapshot_t *s)
+{
+  if(!s->surface) return;
+  const int fd = g_open(s->filename, O_CREAT | O_TRUNC | O_WRONLY | O_BINARY, 0600);
+  if(fd < 0) return;
+  cairo_surface_write_to_png_stream(s->surface, _write_snapshot_data, GINT_TO_POINTER(fd));
+  close(fd);
+}
+
 typedef enum
 {
   SNS_LEFT,
@@ -727,6 +767,7 @@ static int filename_member(lua_State *L)
   {
     return luaL_error(L, "Accessing a non-existent snapshot");
   }
+  _snapshot_write(d->snapshot + index);
   lua_pushstring(L, d->snapshot[index].filename);
   return 1;
 }
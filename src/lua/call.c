@@ -612,6 +612,74 @@ static int sleep_cb(lua_State*L)
   return 0;
 }
 
+/*
+   EXPORT SLOTS
+   write_image releases the lua lock while it exports, so the functions started with darktable.control.dispatch
+   export in parallel. darktable.control.export_slots bounds how many do at once (0 : no bound), the others wait
+   for a slot without holding the lock.
+   */
+static struct
+{
+  GMutex mutex;
+  GCond cond;
+  int limit;
+  int running;
+  int waiting;
+} export_slots;
+
+void dt_lua_export_slot_acquire(void)
+{
+  g_mutex_lock(&export_slots.mutex);
+  export_slots.waiting++;
+  while(export_slots.limit > 0 && export_slots.running >= export_slots.limit)
+    g_cond_wait(&export_slots.cond, &export_slots.mutex);
+  export_slots.waiting--;
+  export_slots.running++;
+  g_mutex_unlock(&export_slots.mutex);
+}
+
+void dt_lua_export_slot_release(void)
+{
+  g_mutex_lock(&export_slots.mutex);
+  export_slots.running--;
+  g_cond_signal(&export_slots.cond);
+  g_mutex_unlock(&export_slots.mutex);
+}
+
+static int export_slots_member(lua_State *L)
+{
+  if(lua_gettop(L) != 3)
+  {
+    g_mutex_lock(&export_slots.mutex);
+    lua_pushinteger(L, export_slots.limit);
+    g_mutex_unlock(&export_slots.mutex);
+    return 1;
+  }
+  const int limit = luaL_checkinteger(L, 3);
+  if(limit < 0) return luaL_error(L, "the number of export slots can't be negative");
+  g_mutex_lock(&export_slots.mutex);
+  export_slots.limit = limit;
+  g_cond_broadcast(&export_slots.cond);
+  g_mutex_unlock(&export_slots.mutex);
+  return 0;
+}
+
+static int exports_running_member(lua_State *L)
+{
+  g_mutex_lock(&export_slots.mutex);
+  lua_pushinteger(L, export_slots.running);
+  g_mutex_unlock(&export_slots.mutex);
+  return 1;
+}
+
+static int exports_waiting_member(lua_State *L)
+{
+  g_mutex_lock(&export_slots.mutex);
+  lua_pushinteger(L, export_slots.waiting);
+  g_mutex_unlock(&export_slots.mutex);
+  return 1;
+}
+
 #if !defined (_WIN32)
 static int read_cb(lua_State*L)
 {
@@ -709,6 +777,12 @@ int dt_lua_init_call(lua_State *L)
   lua_pushcfunction(L,sleep_cb);
   lua_pushcclosure(L, dt_lua_type_member_common, 1);
   dt_lua_type_register_const_type(L, type_id, "sleep");
+  lua_pushcfunction(L, export_slots_member);
+  dt_lua_type_register_type(L, type_id, "export_slots");
+  lua_pushcfunction(L, exports_running_member);
+  dt_lua_type_register_const_type(L, type_id, "exports_running");
+  lua_pushcfunction(L, exports_waiting_member);
+  dt_lua_type_register_const_type(L, type_id, "exports_waiting");
 #if !defined (_WIN32)
   lua_pushcfunction(L,read_cb);
   lua_pushcclosure(L, dt_lua_type_member_common, 1);
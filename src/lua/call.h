@@ -83,6 +83,13 @@ void dt_lua_async_call_string_internal(const char* function, int line,const char
 
 
 
+/*
+   bound the exports run by lua at once to darktable.control.export_slots.
+   call without the lua lock, acquire blocks until a slot is free.
+   */
+void dt_lua_export_slot_acquire(void);
+void dt_lua_export_slot_release(void);
+
 int dt_lua_init_call(lua_State *L);
 
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
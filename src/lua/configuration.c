@@ -20,6 +20,8 @@
 #endif
 #include "common/darktable.h"
 #include "common/file_location.h"
+#include "common/metrics.h"
+#include "common/opencl.h"
 #include "lua/configuration.h"
 #include "lua/lua.h"
 
@@ -70,6 +72,85 @@ static int check_version(lua_State *L)
   return 0;
 }
 
+// one table per OpenCL device with the bytes moved and the run times of its kernels, empty without OpenCL
+static int opencl_statistics(lua_State *L)
+{
+  lua_newtable(L);
+#ifdef HAVE_OPENCL
+  if(!dt_opencl_is_inited()) return 1;
+  for(int devid = 0; devid < darktable.opencl->num_devs; devid++)
+  {
+    lua_newtable(L);
+    lua_pushstring(L, darktable.opencl->dev[devid].name);
+    lua_setfield(L, -2, "name");
+
+    size_t to_device, from_device;
+    dt_opencl_get_transfer_stats(devid, &to_device, &from_device);
+    lua_pushinteger(L, to_device);
+    lua_setfield(L, -2, "bytes_to_device");
+    lua_pushinteger(L, from_device);
+    lua_setfield(L, -2, "bytes_from_device");
+
+    lua_newtable(L);
+    GList *list = dt_opencl_get_kernel_stats(devid);
+    for(GList *l = list; l; l = g_list_next(l))
+    {
+      const dt_opencl_kernel_stats_t *stats = (dt_opencl_kernel_stats_t *)l->data;
+      lua_newtable(L);
+      lua_pushinteger(L, stats->count);
+      lua_setfield(L, -2, "count");
+      lua_pushnumber(L, stats->total);
+      lua_setfield(L, -2, "total");
+      lua_pushnumber(L, stats->p50);
+      lua_setfield(L, -2, "p50");
+      lua_pushnumber(L, stats->p99);
+      lua_setfield(L, -2, "p99");
+      lua_setfield(L, -2, stats->name);
+    }
+    g_list_free_full(list, g_free);
+    lua_setfield(L, -2, "kernels");
+
+    lua_seti(L, -2, devid + 1);
+  }
+#endif
+  return 1;
+}
+
+// name -> value for counters and gauges, name -> { count, sum, min, max, p50, p90, p95, p99 } for histograms
+static int metrics(lua_State *L)
+{
+  lua_newtable(L);
+  GList *list = dt_metrics_snapshot();
+  for(GList *l = list; l; l = g_list_next(l))
+  {
+    const dt_metric_value_t *value = (dt_metric_value_t *)l->data;
+    if(value->type == DT_METRIC_HISTOGRAM)
+    {
+      lua_newtable(L);
+      lua_pushinteger(L, value->count);
+      lua_setfield(L, -2, "count");
+      lua_pushnumber(L, value->sum);
+      lua_setfield(L, -2, "sum");
+      lua_pushnumber(L, value->min);
+      lua_setfield(L, -2, "min");
+      lua_pushnumber(L, value->max);
+      lua_setfield(L, -2, "max");
+      lua_pushnumber(L, value->p50);
+      lua_setfield(L, -2, "p50");
+      lua_pushnumber(L, value->p90);
+      lua_setfield(L, -2, "p90");
+      lua_pushnumber(L, value->p95);
+      lua_setfield(L, -2, "p95");
+      lua_pushnumber(L, value->p99);
+      lua_setfield(L, -2, "p99");
+    }
+    else
+      lua_pushinteger(L, value->value);
+    lua_setfield(L, -2, value->name);
+  }
+  g_list_free_full(list, g_free);
+  return 1;
+}
 
 typedef enum
 {
@@ -156,6 +237,14 @@ int dt_lua_init_configuration(lua_State *L)
   lua_pushcfunction(L, check_version);
   lua_settable(L, -3);
 
+  lua_pushstring(L, "opencl_statistics");
+  lua_pushcfunction(L, opencl_statistics);
+  lua_settable(L, -3);
+
+  lua_pushstring(L, "metrics");
+  lua_pushcfunction(L, metrics);
+  lua_settable(L, -3);
+
   luaA_enum(L, lua_os_type);
   luaA_enum_value_name(L, lua_os_type, os_windows, "windows");
   luaA_enum_value_name(L, lua_os_type, os_macos, "macos");
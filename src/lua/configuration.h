@@ -37,7 +37,7 @@
 /* incompatible API change */
 #define LUA_API_VERSION_MAJOR 6
 /* backward compatible API change */
-#define LUA_API_VERSION_MINOR 0
+#define LUA_API_VERSION_MINOR 2
 /* bugfixes that should not change anything to the API */
 #define LUA_API_VERSION_PATCH 0
 /* suffix for unstable version */
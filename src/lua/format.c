@@ -17,6 +17,7 @@
  */
 #include "common/imageio.h"
 #include "control/conf.h"
+#include "lua/call.h"
 #include "lua/image.h"
 #include "lua/modules.h"
 #include "lua/types.h"
@@ -163,8 +164,10 @@ static int write_image(lua_State *L)
   // TODO: expose icc overwrites to the user!
   dt_colorspaces_color_profile_type_t icc_type = dt_conf_get_int("plugins/lighttable/export/icctype");
   gchar *icc_filename = dt_conf_get_string("plugins/lighttable/export/iccprofile");
+  dt_lua_export_slot_acquire();
   gboolean result = dt_imageio_export(imgid, filename, format, fdata, high_quality, upscale, FALSE, export_masks,
                                       icc_type, icc_filename, DT_INTENT_LAST, NULL, NULL, 1, 1, NULL);
+  dt_lua_export_slot_release();
   g_free(icc_filename);
   dt_lua_lock();
   lua_pushboolean(L, result);
@@ -16,117 +16,319 @@
     along with darktable.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+// stress test and benchmark of the cache: threads get, release and remove entries with keys drawn from several
+// distributions, against every variant the cache is built in (see cache_variant.h). the entries and the lists
+// are checked after every run, and one tab separated line is written per run with the throughput, the hit rate
+// and the time spent waiting in the locks of the cache.
 
-#define DT_UNIT_TEST
-// define dt alloc, so we don't need to include the rest of dt:
-#define dt_alloc_align(A, B) malloc(B)
-#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#include "common/darktable.h"
+#include "cache_bench.h"
 
-// unit test for the concurrent hopscotch hashmap and the LRU cache built on top of it.
-#include "common/cache.h"
-#include "common/cache.c"
-
-#include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #ifdef _OPENMP
 #include <omp.h>
 #endif
 
-int32_t alloc_dummy(void *data, const uint32_t key, int32_t *cost, void **buf)
+#define CACHE_BENCH_MAX_VALUES 32
+
+__thread double dt_cache_bench_wait = 0.0;
+__thread uint64_t dt_cache_bench_retries = 0;
+// misses of this thread, counted by the allocate callback
+static __thread uint64_t _allocations = 0;
+
+typedef enum dt_cache_bench_dist_t
+{
+  DT_CACHE_BENCH_UNIFORM = 0,
+  DT_CACHE_BENCH_ZIPF = 1,
+  // a hot set which fits into the cache, with a sweep through all keys in between, like scrolling through the
+  // lighttable while editing a few images
+  DT_CACHE_BENCH_SCAN = 2,
+} dt_cache_bench_dist_t;
+
+static const char *_dist_names[] = { "uniform", "zipf", "scan" };
+
+typedef struct dt_cache_bench_options_t
+{
+  const dt_cache_bench_variant_t *variants[3];
+  int num_variants;
+  int dists[3];
+  int num_dists;
+  int threads[CACHE_BENCH_MAX_VALUES];
+  int num_threads;
+  uint64_t ops;      // per run, over all threads
+  uint32_t keys;     // keys are drawn from 0..keys-1
+  size_t capacity;   // cost quota of the cache, every entry costs 1
+  int mix[3];        // percentage of read gets, write gets and removes
+  int alloc_us;      // time an allocation takes, to make misses expensive
+  double zipf_s;     // exponent of the zipf distribution
+  float *zipf_cdf;
+} dt_cache_bench_options_t;
+
+static int _alloc_us = 0;
+
+static void _allocate(void *data, dt_cache_entry_t *entry)
 {
-  *cost = 1; // also the default
-  *buf = (void *)(long int)key;
-  // request write lock for our buffer?
-  return 0;
+  _allocations++;
+  if(_alloc_us) g_usleep(_alloc_us);
+  entry->data_size = 4 * sizeof(uint32_t);
+  entry->data = g_malloc(entry->data_size);
+  ((uint32_t *)entry->data)[0] = entry->key;
+  entry->cost = 1;
 }
 
-int main(int argc, char *arg[])
+static void _cleanup(void *data, dt_cache_entry_t *entry)
 {
-  dt_cache_t cache;
-  // dt_cache_init(&cache, 110000, 16, 64, 100000);
-  // really hammer it, make quota insanely low:
-  dt_cache_init(&cache, 110000, 16, 64, 100);
-  dt_cache_set_allocate_callback(&cache, alloc_dummy, NULL);
+  g_free(entry->data);
+}
+
+static inline uint32_t _xorshift(uint32_t *state)
+{
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *state = x;
+}
 
+static inline float _uniform(uint32_t *state)
+{
+  return (_xorshift(state) >> 8) * (1.0f / (1 << 24));
+}
+
+static float *_zipf_cdf(const uint32_t keys, const double s)
+{
+  float *cdf = malloc(sizeof(float) * keys);
+  double sum = 0.0;
+  for(uint32_t k = 0; k < keys; k++) sum += 1.0 / pow(k + 1, s);
+  double acc = 0.0;
+  for(uint32_t k = 0; k < keys; k++)
+  {
+    acc += 1.0 / pow(k + 1, s) / sum;
+    cdf[k] = acc;
+  }
+  cdf[keys - 1] = 1.0f;
+  return cdf;
+}
+
+static inline uint32_t _key(const dt_cache_bench_options_t *opt, const int dist, uint32_t *state, uint32_t *scan)
+{
+  if(dist == DT_CACHE_BENCH_ZIPF)
+  {
+    // the rank of the key, the most used keys are the lowest ids as with the images of the last import
+    const float u = _uniform(state);
+    uint32_t lo = 0, hi = opt->keys - 1;
+    while(lo < hi)
+    {
+      const uint32_t mid = (lo + hi) / 2;
+      if(opt->zipf_cdf[mid] < u)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    return lo;
+  }
+  else if(dist == DT_CACHE_BENCH_SCAN)
+  {
+    const uint32_t hot = MAX(opt->capacity / 2, 1);
+    if(_xorshift(state) % 5) return _xorshift(state) % MIN(hot, opt->keys);
+    *scan = (*scan + 1) % opt->keys;
+    return *scan;
+  }
+  return _xorshift(state) % opt->keys;
+}
+
+// runs the mix of operations, returns the number of errors
+static int _run(const dt_cache_bench_options_t *opt, const dt_cache_bench_variant_t *variant, const int dist,
+                const int nthreads, FILE *out)
+{
+  void *cache = variant->create(opt->capacity, _allocate, _cleanup);
+  uint64_t gets = 0, allocations = 0, retries = 0;
+  double wait = 0.0;
+  int errors = 0;
+
+  const double start = dt_get_wtime();
 #ifdef _OPENMP
-#pragma omp parallel for default(none) schedule(guided) shared(cache, stderr) num_threads(16)
+#pragma omp parallel num_threads(nthreads) reduction(+ : gets, allocations, retries, wait, errors)
 #endif
-  for(int k = 0; k < 100000; k++)
   {
-    void *data = (void *)(long int)k;
-    const int size = 0; // dt_cache_size(&cache);
-    const int con1 = dt_cache_contains(&cache, k);
-    const int val1 = (int)(long int)dt_cache_read_get(&cache, k);
-    const int val2 = (int)(long int)dt_cache_read_get(&cache, k);
-    // fprintf(stderr, "\rinserted number %d, size %d, value %d - %d, contains %d - %d", k, size, val1, val2,
-    // con1, con2);
-    const int con2 = dt_cache_contains(&cache, k);
-    assert(con1 == 0);
-    assert(con2 == 1);
-    assert(val2 == k);
-    dt_cache_read_release(&cache, k);
-    dt_cache_read_release(&cache, k);
+#ifdef _OPENMP
+    const int tid = omp_get_thread_num();
+    const int count = omp_get_num_threads();
+#else
+    const int tid = 0;
+    const int count = 1;
+#endif
+    uint32_t state = 2463534242u + 7919u * tid;
+    uint32_t scan = (uint64_t)opt->keys * tid / count;
+    dt_cache_bench_wait = 0.0;
+    dt_cache_bench_retries = 0;
+    _allocations = 0;
+
+    for(uint64_t k = tid; k < opt->ops; k += count)
+    {
+      const uint32_t key = _key(opt, dist, &state, &scan);
+      const int op = _xorshift(&state) % 100;
+      if(op < opt->mix[0] + opt->mix[1])
+      {
+        dt_cache_entry_t *entry = variant->get(cache, key, op < opt->mix[0] ? 'r' : 'w');
+        ASAN_UNPOISON_MEMORY_REGION(entry->data, entry->data_size);
+        // it can't go away while we hold it
+        if(entry->key != key || ((uint32_t *)entry->data)[0] != key || !variant->contains(cache, key)) errors++;
+        variant->release(cache, entry);
+        gets++;
+      }
+      else
+        variant->remove(cache, key);
+    }
+
+    allocations = _allocations;
+    retries = dt_cache_bench_retries;
+    wait = dt_cache_bench_wait;
   }
-  dt_cache_print_locked(&cache);
-  // fprintf(stderr, "\n");
-  fprintf(stderr, "[passed] inserting 100000 entries concurrently\n");
+  const double seconds = dt_get_wtime() - start;
 
-  const int size = dt_cache_size(&cache);
-  const int lru_cnt = lru_check_consistency(&cache);
-  const int lru_cnt_r = lru_check_consistency_reverse(&cache);
-  // fprintf(stderr, "lru list contains %d|%d/%d entries\n", lru_cnt, lru_cnt_r, size);
-  assert(size == lru_cnt);
-  assert(lru_cnt_r == lru_cnt);
-  fprintf(stderr, "[passed] cache lru consistency after removals, have %d entries left.\n", size);
+  const int entries = variant->check(cache);
+  if(entries < 0)
+  {
+    fprintf(stderr, "[cache] %s: the hash tables and the lru lists don't agree after %s with %d threads\n",
+            variant->name, _dist_names[dist], nthreads);
+    errors++;
+  }
+  // everything has to go again
+  for(uint32_t k = 0; k < opt->keys; k++) variant->remove(cache, k);
+  if(variant->check(cache) != 0)
+  {
+    fprintf(stderr, "[cache] %s: entries left after removing all keys\n", variant->name);
+    errors++;
+  }
+  variant->destroy(cache);
 
-  dt_cache_cleanup(&cache);
+  fprintf(out, "%s\t%s\t%d\t%" PRIu64 "\t%.0f\t%.1f\t%.3f\t%.4f\t%d\n", variant->name, _dist_names[dist],
+          nthreads, opt->ops, opt->ops / seconds, gets ? 100.0 * (1.0 - (double)allocations / gets) : 0.0,
+          1e6 * wait / opt->ops, (double)retries / opt->ops, entries);
+  fflush(out);
+  return errors;
+}
 
+static void usage(const char *progname)
+{
+  fprintf(stderr, "usage: %s [options]\n", progname);
+  fprintf(stderr, "\n");
+  fprintf(stderr, "options:\n");
+  fprintf(stderr, "   --variants <name>[,<name>...] current, unsharded or clock. default: all of them\n");
+  fprintf(stderr, "   --dist <name>[,<name>...] uniform, zipf or scan. default: all of them\n");
+  fprintf(stderr, "   --threads <n>[,<n>...] default: 1, 2, 4 ... up to all cores\n");
+  fprintf(stderr, "   --ops <n> operations per run, default: 1000000\n");
+  fprintf(stderr, "   --keys <n> number of keys, default: 20000\n");
+  fprintf(stderr, "   --capacity <n> entries the cache keeps, default: 2000\n");
+  fprintf(stderr, "   --mix <read>,<write>,<remove> percentage of each operation, default: 80,15,5\n");
+  fprintf(stderr, "   --alloc-us <n> microseconds an allocation takes, default: 0\n");
+  fprintf(stderr, "   --zipf <s> exponent of the zipf distribution, default: 1.0\n");
+  fprintf(stderr, "   --help,-h\n");
+}
+
+static int _parse_list(const char *arg, int *values, const int max)
+{
+  gchar **tokens = g_strsplit(arg, ",", max);
+  int n = 0;
+  for(gchar **t = tokens; *t && n < max; t++) values[n++] = atoi(*t);
+  g_strfreev(tokens);
+  return n;
+}
+
+static int _parse_names(const char *arg, const char **names, const int num_names, int *values)
+{
+  gchar **tokens = g_strsplit(arg, ",", -1);
+  int n = 0;
+  for(gchar **t = tokens; *t; t++)
+    for(int i = 0; i < num_names; i++)
+      if(!strcmp(*t, names[i]) && n < num_names) values[n++] = i;
+  g_strfreev(tokens);
+  return n;
+}
 
+int main(int argc, char *arg[])
+{
+  const dt_cache_bench_variant_t *all_variants[3]
+      = { &dt_cache_bench_current, &dt_cache_bench_unsharded, &dt_cache_bench_clock };
+  const char *variant_names[3] = { "current", "unsharded", "clock" };
 
+  dt_cache_bench_options_t opt = { .num_variants = 3, .num_dists = 3, .ops = 1000000, .keys = 20000,
+                                   .capacity = 2000, .mix = { 80, 15, 5 }, .zipf_s = 1.0 };
+  for(int i = 0; i < 3; i++)
   {
-    // now a harder case: a cache with only one entry and a lot of threads fighting over it:
-    dt_cache_t cache2;
-    // really hammer it, make quota insanely low:
-    // capacity 1 num threads 1 cache line size 64 ignored, quota 2 (80% => 1)
-    dt_cache_init(&cache2, 1, 1, 64, 2);
-    dt_cache_set_allocate_callback(&cache2, alloc_dummy, NULL);
+    opt.variants[i] = all_variants[i];
+    opt.dists[i] = i;
+  }
+  for(int t = 1; t < dt_get_num_threads() && opt.num_threads < CACHE_BENCH_MAX_VALUES; t *= 2)
+    opt.threads[opt.num_threads++] = t;
+  opt.threads[opt.num_threads++] = dt_get_num_threads();
 
-#ifdef _OPENMP
-#pragma omp parallel for default(none) schedule(guided) shared(cache2, stderr) num_threads(16)
-#endif
-    for(int k = 0; k < 100000; k++)
+  for(int k = 1; k < argc; k++)
+  {
+    if(!strcmp(arg[k], "-h") || !strcmp(arg[k], "--help"))
+    {
+      usage(arg[0]);
+      exit(1);
+    }
+    else if(!strcmp(arg[k], "--variants") && argc > k + 1)
     {
-      void *data = (void *)(long int)k;
-      const int size = 0; // dt_cache_size(&cache);
-      const int con1 = dt_cache_contains(&cache2, k);
-      const int val1 = (int)(long int)dt_cache_read_get(&cache2, k);
-      const int val2 = (int)(long int)dt_cache_read_get(&cache2, k);
-      // fprintf(stderr, "\rinserted number %d, size %d, value %d - %d, contains %d - %d", k, size, val1,
-      // val2, con1, con2);
-      const int con2 = dt_cache_contains(&cache2, k);
-      assert(con1 == 0);
-      assert(con2 == 1);
-      assert(val2 == k);
-      dt_cache_read_release(&cache2, k);
-      dt_cache_read_release(&cache2, k);
+      int v[3];
+      opt.num_variants = _parse_names(arg[++k], variant_names, 3, v);
+      for(int i = 0; i < opt.num_variants; i++) opt.variants[i] = all_variants[v[i]];
     }
-    dt_cache_print_locked(&cache2);
-    // fprintf(stderr, "\n");
-    fprintf(stderr, "[passed] inserting 100000 entries concurrently\n");
-
-    const int size = dt_cache_size(&cache2);
-    const int lru_cnt = lru_check_consistency(&cache2);
-    const int lru_cnt_r = lru_check_consistency_reverse(&cache2);
-    // fprintf(stderr, "lru list contains %d|%d/%d entries\n", lru_cnt, lru_cnt_r, size);
-    assert(size == lru_cnt);
-    assert(lru_cnt_r == lru_cnt);
-    fprintf(stderr, "[passed] cache lru consistency after removals, have %d entries left.\n", size);
-    dt_cache_cleanup(&cache2);
+    else if(!strcmp(arg[k], "--dist") && argc > k + 1)
+      opt.num_dists = _parse_names(arg[++k], _dist_names, 3, opt.dists);
+    else if(!strcmp(arg[k], "--threads") && argc > k + 1)
+      opt.num_threads = _parse_list(arg[++k], opt.threads, CACHE_BENCH_MAX_VALUES);
+    else if(!strcmp(arg[k], "--ops") && argc > k + 1)
+      opt.ops = g_ascii_strtoull(arg[++k], NULL, 10);
+    else if(!strcmp(arg[k], "--keys") && argc > k + 1)
+      opt.keys = MAX(atoi(arg[++k]), 1);
+    else if(!strcmp(arg[k], "--capacity") && argc > k + 1)
+      opt.capacity = MAX(atoi(arg[++k]), 1);
+    else if(!strcmp(arg[k], "--mix") && argc > k + 1)
+    {
+      if(_parse_list(arg[++k], opt.mix, 3) != 3 || opt.mix[0] < 0 || opt.mix[1] < 0 || opt.mix[2] < 0
+         || opt.mix[0] + opt.mix[1] + opt.mix[2] != 100)
+      {
+        usage(arg[0]);
+        exit(1);
+      }
+    }
+    else if(!strcmp(arg[k], "--alloc-us") && argc > k + 1)
+      opt.alloc_us = MAX(atoi(arg[++k]), 0);
+    else if(!strcmp(arg[k], "--zipf") && argc > k + 1)
+      opt.zipf_s = g_ascii_strtod(arg[++k], NULL);
+    else
+    {
+      usage(arg[0]);
+      exit(1);
+    }
+  }
+  if(!opt.num_variants || !opt.num_dists || !opt.num_threads)
+  {
+    usage(arg[0]);
+    exit(1);
   }
 
-  exit(0);
+  _alloc_us = opt.alloc_us;
+  opt.zipf_cdf = _zipf_cdf(opt.keys, opt.zipf_s);
+
+  printf("variant\tdist\tthreads\tops\tops_per_s\thit_rate\twait_us_per_op\tretries_per_op\tentries\n");
+  int errors = 0;
+  for(int d = 0; d < opt.num_dists; d++)
+    for(int t = 0; t < opt.num_threads; t++)
+      for(int v = 0; v < opt.num_variants; v++)
+        errors += _run(&opt, opt.variants[v], opt.dists[d], MAX(opt.threads[t], 1), stdout);
+
+  free(opt.zipf_cdf);
+  if(errors) fprintf(stderr, "[cache] %d errors\n", errors);
+  exit(errors ? 1 : 0);
 }
+
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
 // kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,49 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "common/cache.h"
+
+// one build of common/cache.c, see cache_variant.h. the entries are the same in all of them, only the cache
+// itself differs, so it is passed around as void *.
+typedef struct dt_cache_bench_variant_t
+{
+  const char *name;
+  void *(*create)(size_t cost_quota, dt_cache_allocate_t allocate, dt_cache_cleanup_t cleanup);
+  void (*destroy)(void *cache);
+  dt_cache_entry_t *(*get)(void *cache, const uint32_t key, char mode);
+  void (*release)(void *cache, dt_cache_entry_t *entry);
+  int32_t (*remove)(void *cache, const uint32_t key);
+  int32_t (*contains)(void *cache, const uint32_t key);
+  // returns the number of entries, or -1 if the hash tables, the lru lists and the cost don't agree.
+  // the cache must not be used meanwhile.
+  int (*check)(void *cache);
+} dt_cache_bench_variant_t;
+
+// what the thread spent waiting in the locks of the cache and how often it had to try again to get an entry
+extern __thread double dt_cache_bench_wait;
+extern __thread uint64_t dt_cache_bench_retries;
+
+extern const dt_cache_bench_variant_t dt_cache_bench_current;
+extern const dt_cache_bench_variant_t dt_cache_bench_unsharded;
+extern const dt_cache_bench_variant_t dt_cache_bench_clock;
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -0,0 +1,140 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2020 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// builds common/cache.c once more, under other names, as one variant for the benchmark. to be included with
+// CACHE_VARIANT defined to the name of the variant, and DT_CACHE_SHARDS_BITS and DT_CACHE_PROTECTED_SHARE if
+// they should differ from the defaults. the locks the cache takes are timed.
+
+#include "common/darktable.h"
+#include "common/dtpthread.h"
+
+#define _CACHE_VARIANT_CAT(a, b, c) a##b##c
+#define _CACHE_VARIANT_NAME(a, b, c) _CACHE_VARIANT_CAT(a, b, c)
+
+#define dt_cache_init _CACHE_VARIANT_NAME(dt_cache_, CACHE_VARIANT, _init)
+#define dt_cache_cleanup _CACHE_VARIANT_NAME(dt_cache_, CACHE_VARIANT, _cleanup)
+#define dt_cache_get_with_caller _CACHE_VARIANT_NAME(dt_cache_, CACHE_VARIANT, _get_with_caller)
+#define dt_cache_testget _CACHE_VARIANT_NAME(dt_cache_, CACHE_VARIANT, _testget)
+#define dt_cache_release_with_caller _CACHE_VARIANT_NAME(dt_cache_, CACHE_VARIANT, _release_with_caller)
+#define dt_cache_contains _CACHE_VARIANT_NAME(dt_cache_, CACHE_VARIANT, _contains)
+#define dt_cache_remove _CACHE_VARIANT_NAME(dt_cache_, CACHE_VARIANT, _remove)
+#define dt_cache_gc _CACHE_VARIANT_NAME(dt_cache_, CACHE_VARIANT, _gc)
+#define dt_cache_for_all _CACHE_VARIANT_NAME(dt_cache_, CACHE_VARIANT, _for_all)
+
+#include "cache_bench.h"
+
+// only the blocking locks are timed, the cache never waits in the others
+static inline int _cache_variant_lock(dt_pthread_mutex_t *mutex)
+{
+  if(!dt_pthread_mutex_trylock(mutex)) return 0;
+  const double start = dt_get_wtime();
+  const int ret = dt_pthread_mutex_lock(mutex);
+  dt_cache_bench_wait += dt_get_wtime() - start;
+  return ret;
+}
+
+#undef dt_pthread_mutex_lock
+#define dt_pthread_mutex_lock(A) _cache_variant_lock(A)
+// the cache sleeps whenever an entry is locked by someone else and looks again
+#define g_usleep(A) (dt_cache_bench_retries++, g_usleep(A))
+
+#include "common/cache.c"
+
+#undef dt_pthread_mutex_lock
+#undef g_usleep
+
+static void *_cache_variant_create(size_t cost_quota, dt_cache_allocate_t allocate, dt_cache_cleanup_t cleanup)
+{
+  dt_cache_t *cache = g_malloc0(sizeof(dt_cache_t));
+  dt_cache_init(cache, 0, cost_quota);
+  dt_cache_set_allocate_callback(cache, allocate, NULL);
+  dt_cache_set_cleanup_callback(cache, cleanup, NULL);
+  return cache;
+}
+
+static void _cache_variant_destroy(void *cache)
+{
+  dt_cache_cleanup(cache);
+  g_free(cache);
+}
+
+static dt_cache_entry_t *_cache_variant_get(void *cache, const uint32_t key, char mode)
+{
+  return dt_cache_get(cache, key, mode);
+}
+
+static void _cache_variant_release(void *cache, dt_cache_entry_t *entry)
+{
+  dt_cache_release(cache, entry);
+}
+
+static int32_t _cache_variant_remove(void *cache, const uint32_t key)
+{
+  return dt_cache_remove(cache, key);
+}
+
+static int32_t _cache_variant_contains(void *cache, const uint32_t key)
+{
+  return dt_cache_contains(cache, key);
+}
+
+static int _cache_variant_check_list(dt_cache_t *cache, GList *list, const int protected, size_t *cost)
+{
+  int n = 0;
+  for(GList *l = list; l; l = g_list_next(l))
+  {
+    dt_cache_entry_t *entry = (dt_cache_entry_t *)l->data;
+    if(entry->link != l || entry->_protected != protected
+       || g_hash_table_lookup(_shard(cache, entry->key)->hashtable, GINT_TO_POINTER(entry->key)) != entry)
+      return -1;
+    *cost += entry->cost;
+    n++;
+  }
+  return n;
+}
+
+static int _cache_variant_check(void *data)
+{
+  dt_cache_t *cache = (dt_cache_t *)data;
+  int entries = 0;
+  for(int k = 0; k < DT_CACHE_SHARDS; k++) entries += g_hash_table_size(cache->shard[k].hashtable);
+
+  size_t cost = 0, protected_cost = 0;
+  const int probation = _cache_variant_check_list(cache, cache->lru.head, 0, &cost);
+  const int protected = _cache_variant_check_list(cache, cache->lru_protected.head, 1, &protected_cost);
+  if(probation < 0 || protected < 0 || probation + protected != entries || probation != cache->lru.length
+     || protected != cache->lru_protected.length
+     || cost + protected_cost != cache->cost || protected_cost != cache->protected_cost)
+    return -1;
+  return entries;
+}
+
+const dt_cache_bench_variant_t _CACHE_VARIANT_NAME(dt_cache_bench_, CACHE_VARIANT, ) = {
+  .name = G_STRINGIFY(CACHE_VARIANT),
+  .create = _cache_variant_create,
+  .destroy = _cache_variant_destroy,
+  .get = _cache_variant_get,
+  .release = _cache_variant_release,
+  .remove = _cache_variant_remove,
+  .contains = _cache_variant_contains,
+  .check = _cache_variant_check,
+};
+
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.sh
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
@@ -4,7 +4,38 @@ CDPATH=
 
 PATTERN="[0-9]*"
 
-[ ! -z $1 ] && PATTERN="$(basename $1)"
+# timing mode, see README.txt
+PERF=0
+RUNS=5
+THRESHOLD=10
+UPDATE=0
+OPENCL=--disable-opencl
+MACHINE=
+
+while [ $# -gt 0 ]; do
+    case "$1" in
+        --perf) PERF=1 ;;
+        --runs) RUNS=$2; shift ;;
+        --threshold) THRESHOLD=$2; shift ;;
+        --machine) MACHINE=$2; shift ;;
+        --update-baseline) UPDATE=1 ;;
+        --opencl) OPENCL= ;;
+        *) PATTERN="$(basename $1)" ;;
+    esac
+    shift
+done
+
+if [ -z "$MACHINE" ]; then
+    # the cpu model and the number of cores, as far as they can be found
+    CPU=$(grep -m1 "model name" /proc/cpuinfo 2>/dev/null | cut -d: -f2)
+    [ -z "$CPU" ] && CPU=$(sysctl -n machdep.cpu.brand_string 2>/dev/null)
+    CORES=$(getconf _NPROCESSORS_ONLN 2>/dev/null)
+    MACHINE=$(echo "$CPU-${CORES}cores" | tr -cs 'A-Za-z0-9.-' '_' | sed 's/^_*//')
+fi
+
+[ -z $OPENCL ] && MACHINE=$MACHINE-opencl
+
+BASELINE=$PWD/perf-baselines/$MACHINE.json
 
 CLI=darktable-cli
 TEST_IMAGES=$PWD/images
@@ -15,11 +46,16 @@ COMPARE=$(which compare)
 
 [ -z $(which $CLI) ] && echo Make sure $CLI is in the path && exit 1
 
+[ $PERF = 1 ] && echo "Timing $RUNS runs per test against $BASELINE" && echo
+
 for dir in $(ls -d $PATTERN); do
     echo Test $dir
     TEST_COUNT=$((TEST_COUNT + 1))
 
-    if [ -f $dir/test.sh ]; then
+    if [ $PERF = 1 -a -f $dir/test.sh ]; then
+        echo "  SKIPPED: specific test, no timing"
+
+    elif [ -f $dir/test.sh ]; then
         # The test has a specific driver
         (
             $dir/test.sh
@@ -55,7 +91,7 @@ for dir in $(ls -d $PATTERN); do
 
             # Remove previous output and diff if any
 
-            rm -f output*.png diff*.png
+            rm -f output*.png diff*.png trace-*.json
 
             # Create the output
             #
@@ -71,6 +107,41 @@ for dir in $(ls -d $PATTERN); do
                  --conf plugins/lighttable/export/force_lcms2=FALSE \
                  --conf plugins/lighttable/export/iccintent=0"
 
+            if [ $PERF = 1 ]; then
+                # the wall time of every run, and the time of every module from the trace of the run
+                WALLS=
+                TRACES=
+                for run in $(seq $RUNS); do
+                    START=$(date +%s.%N)
+                    $CLI --width 2048 --height 2048 \
+                         --hq true --apply-custom-presets false \
+                         "$TEST_IMAGES/$IMAGE" "$TEST.xmp" output-perf.png \
+                         --core $OPENCL --trace trace-$run.json $CORE_OPTIONS 1> /dev/null 2> /dev/null
+
+                    if [ $? -ne 0 ]; then
+                        echo "  FAILS : darktable-cli errored"
+                        exit 1
+                    fi
+
+                    END=$(date +%s.%N)
+                    WALLS=$WALLS$(awk "BEGIN { print $END - $START }"),
+                    TRACES="$TRACES trace-$run.json"
+                    rm -f output-perf.png
+                done
+
+                ../perf "$BASELINE" "$dir" $THRESHOLD $UPDATE $WALLS $TRACES
+                res=$?
+                rm -f $TRACES
+
+                case $res in
+                    0) echo "  OK" ;;
+                    1) echo "  OK: no baseline yet" ; res=0 ;;
+                    *) echo "  FAILS: slower than the baseline by more than $THRESHOLD%" ;;
+                esac
+
+                exit $res
+            fi
+
             $CLI --width 2048 --height 2048 \
                  --hq true --apply-custom-presets false \
                  "$TEST_IMAGES/$IMAGE" "$TEST.xmp" output.png \
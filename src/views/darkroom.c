@@ -34,6 +34,7 @@
 #include "control/conf.h"
 #include "control/control.h"
 #include "control/jobs.h"
+#include "control/jobs/image_jobs.h"
 #include "develop/blend.h"
 #include "develop/develop.h"
 #include "develop/imageop.h"
@@ -181,15 +182,6 @@ void cleanup(dt_view_t *self)
   free(dev);
 }
 
-static cairo_status_t write_snapshot_data(void *closure, const unsigned char *data, unsigned int length)
-{
-  const int fd = GPOINTER_TO_INT(closure);
-  ssize_t res = write(fd, data, length);
-  if(res != length)
-    return CAIRO_STATUS_WRITE_ERROR;
-  return CAIRO_STATUS_SUCCESS;
-}
-
 static dt_darkroom_layout_t _lib_darkroom_get_layout(dt_view_t *self)
 {
   dt_develop_t *dev = (dt_develop_t *)self->data;
@@ -303,12 +295,14 @@ void expose(
     // draw image
     mutex = &dev->pipe->backbuf_mutex;
     dt_pthread_mutex_lock(mutex);
+    // a progressive update may not have rendered at full resolution yet
+    const int coarse = dev->pipe->output_backbuf_coarse;
     float wd = dev->pipe->output_backbuf_width;
     float ht = dev->pipe->output_backbuf_height;
     stride = cairo_format_stride_for_width(CAIRO_FORMAT_RGB24, wd);
     surface = dt_cairo_image_surface_create_for_data(dev->pipe->output_backbuf, CAIRO_FORMAT_RGB24, wd, ht, stride);
-    wd /= darktable.gui->ppd;
-    ht /= darktable.gui->ppd;
+    wd *= coarse / darktable.gui->ppd;
+    ht *= coarse / darktable.gui->ppd;
 
     if(dev->iso_12646.enabled)
     {
@@ -341,17 +335,21 @@ void expose(
     }
 
     cairo_rectangle(cr, 0, 0, wd, ht);
+    cairo_save(cr);
+    cairo_scale(cr, coarse, coarse);
     cairo_set_source_surface(cr, surface, 0, 0);
     cairo_pattern_set_filter(cairo_get_source(cr), darktable.gui->filter_image);
     cairo_paint(cr);
+    cairo_restore(cr);
 
-    if(darktable.gui->show_focus_peaking)
+    if(darktable.gui->show_focus_peaking && coarse == 1)
     {
       cairo_save(cr);
       cairo_scale(cr, 1./ darktable.gui->ppd, 1. / darktable.gui->ppd);
       dt_focuspeaking(cr, wd, ht, cairo_image_surface_get_data(surface),
                                   cairo_image_surface_get_width(surface),
-                                  cairo_image_surface_get_height(surface));
+                                  cairo_image_surface_get_height(surface),
+                                  dev->image_storage.id, DT_MIPMAP_NONE);
       cairo_restore(cr);
     }
 
@@ -476,15 +474,21 @@ void expose(
     /* reset the request */
     darktable.develop->proxy.snapshot.request = FALSE;
 
-    /* validation of snapshot filename */
-    g_assert(darktable.develop->proxy.snapshot.filename != NULL);
+    /* validation of snapshot storage */
+    g_assert(darktable.develop->proxy.snapshot.surface != NULL);
 
-    /* Store current image surface to snapshot file.
+    /* Keep a copy of the current image surface in memory, it is only written to disk if lua asks for it.
        FIXME: add checks so that we don't make snapshots of preview pipe image surface.
     */
-    int fd = g_open(darktable.develop->proxy.snapshot.filename, O_CREAT | O_WRONLY | O_BINARY, 0600);
-    cairo_surface_write_to_png_stream(image_surface, write_snapshot_data, GINT_TO_POINTER(fd));
-    close(fd);
+    cairo_surface_t *snapshot = dt_cairo_image_surface_create(CAIRO_FORMAT_RGB24, width, height);
+    cairo_t *scr = cairo_create(snapshot);
+    cairo_set_source_surface(scr, image_surface, 0, 0);
+    cairo_paint(scr);
+    cairo_destroy(scr);
+
+    cairo_surface_t **target = darktable.develop->proxy.snapshot.surface;
+    if(*target) cairo_surface_destroy(*target);
+    *target = snapshot;
   }
 
   // Displaying sample areas if enabled
@@ -720,6 +724,39 @@ static void dt_dev_cleanup_module_accels(dt_iop_module_t *module)
   dt_accel_cleanup_locals_iop(module);
 }
 
+// the direction of the last jump through the collection, its neighbour that way gets loaded first
+static int _jump_direction = 1;
+
+// loads the full buffers of the images before and after this one in the collection in the background, so that
+// going to one of them doesn't wait for the raw decode. room is left in the full cache for the image shown and
+// for the thumbnails.
+static void _prefetch_neighbours(const uint32_t imgid)
+{
+  GList *imgids = NULL;
+  const int room = (int)darktable.mipmap_cache->mip_full.cache.cost_quota - 2;
+  if(room > 0 && dt_conf_get_bool("plugins/darkroom/prefetch_neighbours"))
+  {
+    sqlite3_stmt *stmt;
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                                "SELECT imgid FROM memory.collected_images "
+                                "WHERE rowid=(SELECT rowid FROM memory.collected_images WHERE imgid=?1)+?2",
+                                -1, &stmt, NULL);
+    const int diff[2] = { _jump_direction, -_jump_direction };
+    for(int k = 0; k < MIN(room, 2); k++)
+    {
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, diff[k]);
+      if(sqlite3_step(stmt) == SQLITE_ROW)
+        imgids = g_list_append(imgids, GINT_TO_POINTER(sqlite3_column_int(stmt, 0)));
+      sqlite3_reset(stmt);
+      sqlite3_clear_bindings(stmt);
+    }
+    sqlite3_finalize(stmt);
+  }
+  dt_image_prefetch_full(imgids);
+  g_list_free(imgids);
+}
+
 static void dt_dev_change_image(dt_develop_t *dev, const uint32_t imgid)
 {
   // stop crazy users from sleeping on key-repeat spacebar:
@@ -842,6 +879,9 @@ static void dt_dev_change_image(dt_develop_t *dev, const uint32_t imgid)
     dev->history = g_list_delete_link(dev->history, dev->history);
   }
 
+  // the widgets nobody sees are updated once the new image is processing
+  dt_dev_gui_lazy_begin(dev);
+
   // get new image:
   dt_dev_reload_image(dev, imgid);
 
@@ -986,6 +1026,8 @@ static void dt_dev_change_image(dt_develop_t *dev, const uint32_t imgid)
     g_free(active_plugin);
   }
 
+  dt_dev_gui_lazy_end(dev);
+
   // Signal develop initialize
   dt_control_signal_raise(darktable.signals, DT_SIGNAL_DEVELOP_IMAGE_CHANGED);
 
@@ -1008,6 +1050,8 @@ static void dt_dev_change_image(dt_develop_t *dev, const uint32_t imgid)
 
   //connect iop accelerators
   dt_iop_connect_accels_all();
+
+  _prefetch_neighbours(imgid);
 }
 
 static void _view_darkroom_filmstrip_activate_callback(gpointer instance, int imgid, gpointer user_data)
@@ -1059,6 +1103,7 @@ static void dt_dev_jump_image(dt_develop_t *dev, int diff, gboolean by_key)
   if(new_id < 0 || new_id == imgid) return;
 
   // if id seems valid, we change the image and move filmstrip
+  _jump_direction = diff < 0 ? -1 : 1;
   dt_dev_change_image(dev, new_id);
   dt_thumbtable_set_offset(dt_ui_thumbtable(darktable.gui->ui), new_offset, TRUE);
 
@@ -1399,7 +1444,7 @@ static void _overexposed_quickbutton_clicked(GtkWidget *w, gpointer user_data)
 {
   dt_develop_t *d = (dt_develop_t *)user_data;
   d->overexposed.enabled = !d->overexposed.enabled;
-  dt_dev_reprocess_center(d);
+  dt_dev_reprocess_display(d);
 }
 
 static gboolean _overexposed_quickbutton_pressed(GtkWidget *widget, GdkEvent *event, gpointer user_data)
@@ -1433,7 +1478,7 @@ static void colorscheme_callback(GtkWidget *combo, gpointer user_data)
   if(d->overexposed.enabled == FALSE)
     gtk_button_clicked(GTK_BUTTON(d->overexposed.button));
   else
-    dt_dev_reprocess_center(d);
+    dt_dev_reprocess_display(d);
 }
 
 static void lower_callback(GtkWidget *slider, gpointer user_data)
@@ -1443,7 +1488,7 @@ static void lower_callback(GtkWidget *slider, gpointer user_data)
   if(d->overexposed.enabled == FALSE)
     gtk_button_clicked(GTK_BUTTON(d->overexposed.button));
   else
-    dt_dev_reprocess_center(d);
+    dt_dev_reprocess_display(d);
 }
 
 static void upper_callback(GtkWidget *slider, gpointer user_data)
@@ -1453,7 +1498,7 @@ static void upper_callback(GtkWidget *slider, gpointer user_data)
   if(d->overexposed.enabled == FALSE)
     gtk_button_clicked(GTK_BUTTON(d->overexposed.button));
   else
-    dt_dev_reprocess_center(d);
+    dt_dev_reprocess_display(d);
 }
 
 /* rawoverexposed */
@@ -1461,7 +1506,7 @@ static void _rawoverexposed_quickbutton_clicked(GtkWidget *w, gpointer user_data
 {
   dt_develop_t *d = (dt_develop_t *)user_data;
   d->rawoverexposed.enabled = !d->rawoverexposed.enabled;
-  dt_dev_reprocess_center(d);
+  dt_dev_reprocess_display(d);
 }
 
 static gboolean _rawoverexposed_quickbutton_pressed(GtkWidget *widget, GdkEvent *event, gpointer user_data)
@@ -1495,7 +1540,7 @@ static void rawoverexposed_mode_callback(GtkWidget *combo, gpointer user_data)
   if(d->rawoverexposed.enabled == FALSE)
     gtk_button_clicked(GTK_BUTTON(d->rawoverexposed.button));
   else
-    dt_dev_reprocess_center(d);
+    dt_dev_reprocess_display(d);
 }
 
 static void rawoverexposed_colorscheme_callback(GtkWidget *combo, gpointer user_data)
@@ -1505,7 +1550,7 @@ static void rawoverexposed_colorscheme_callback(GtkWidget *combo, gpointer user_
   if(d->rawoverexposed.enabled == FALSE)
     gtk_button_clicked(GTK_BUTTON(d->rawoverexposed.button));
   else
-    dt_dev_reprocess_center(d);
+    dt_dev_reprocess_display(d);
 }
 
 static void rawoverexposed_threshold_callback(GtkWidget *slider, gpointer user_data)
@@ -1515,7 +1560,7 @@ static void rawoverexposed_threshold_callback(GtkWidget *slider, gpointer user_d
   if(d->rawoverexposed.enabled == FALSE)
     gtk_button_clicked(GTK_BUTTON(d->rawoverexposed.button));
   else
-    dt_dev_reprocess_center(d);
+    dt_dev_reprocess_display(d);
 }
 
 static gboolean _toolbox_toggle_callback(GtkAccelGroup *accel_group, GObject *acceleratable, guint keyval,
@@ -2729,7 +2774,11 @@ void enter(dt_view_t *self)
 
   // take a copy of the image struct for convenience.
 
+  // as when changing images, collapsed modules, the history and the mask manager follow the first expose
+  dt_dev_gui_lazy_begin(dev);
+
   dt_dev_load_image(darktable.develop, dev->image_storage.id);
+  _prefetch_neighbours(dev->image_storage.id);
 
 
   /*
@@ -2792,6 +2841,8 @@ void enter(dt_view_t *self)
     g_free(active_plugin);
   }
 
+  dt_dev_gui_lazy_end(dev);
+
   // update module multishow state now modules are loaded
   dt_dev_modules_update_multishow(dev);
 
@@ -2843,6 +2894,9 @@ void leave(dt_view_t *self)
   dt_control_signal_disconnect(darktable.signals, G_CALLBACK(_darkroom_ui_preview2_pipe_finish_signal_callback),
                                (gpointer)self);
 
+  // the neighbours aren't going to be opened any more
+  dt_image_prefetch_full(NULL);
+
   // store groups for next time:
   dt_conf_set_int("plugins/darkroom/groups", dt_dev_modulegroups_get(darktable.develop));
 
@@ -2890,6 +2944,8 @@ void leave(dt_view_t *self)
 
   // clear gui.
 
+  dt_dev_gui_lazy_flush(dev, TRUE);
+
   dt_pthread_mutex_lock(&dev->preview_pipe_mutex);
   dt_pthread_mutex_lock(&dev->preview2_pipe_mutex);
   dt_pthread_mutex_lock(&dev->pipe_mutex);
@@ -3292,6 +3348,8 @@ void scrolled(dt_view_t *self, double x, double y, int up, int state)
   {
     GtkWidget *widget = self->dynamic_accel_current->widget;
     dt_bauhaus_widget_t *w = (dt_bauhaus_widget_t *)DT_BAUHAUS_WIDGET(widget);
+    // the slider of a collapsed module may not show this image yet
+    if(w->module) dt_iop_gui_update_pending(w->module);
 
     if(w->type == DT_BAUHAUS_SLIDER)
     {
@@ -3951,7 +4009,8 @@ static void second_window_expose(GtkWidget *widget, dt_develop_t *dev, cairo_t *
       cairo_scale(cr, 1./ darktable.gui->ppd, 1. / darktable.gui->ppd);
       dt_focuspeaking(cr, wd, ht, cairo_image_surface_get_data(surface),
                                   cairo_image_surface_get_width(surface),
-                                  cairo_image_surface_get_height(surface));
+                                  cairo_image_surface_get_height(surface),
+                                  dev->image_storage.id, DT_MIPMAP_NONE);
       cairo_restore(cr);
     }
 
@@ -62,15 +62,35 @@ typedef struct dt_map_t
   gboolean drop_filmstrip_activated;
   gboolean filter_images_drawn;
   int max_images_drawn;
+  // spatial index of the geotagged images: cell -> GArray of dt_map_point_t, and imgid -> cell
+  GHashTable *index;
+  GHashTable *index_cells;
+  gboolean index_valid;
 } dt_map_t;
 
+// a marker on the map, the thumbnail of one image or of a cluster of images
 typedef struct dt_map_image_t
 {
   gint imgid;
+  gint count;
+  gint zoom, cx, cy; // the cell of the cluster
+  float latitude, longitude;
   OsmGpsMapImage *image;
   gint width, height;
 } dt_map_image_t;
 
+typedef struct dt_map_point_t
+{
+  gint imgid;
+  float latitude, longitude;
+} dt_map_point_t;
+
+// the tile level of the cells of the spatial index, 256 x 256 cells over the world
+#define DT_MAP_INDEX_LEVEL 8
+#define DT_MAP_INDEX_CELLS (1 << DT_MAP_INDEX_LEVEL)
+// the size of the cells images are clustered in, in thumbnails
+#define DT_MAP_CLUSTER_SIZE 1.5
+
 static const int thumb_size = 64, thumb_border = 1, image_pin_size = 13, place_pin_size = 72;
 static const uint32_t thumb_frame_color = 0x000000aa;
 static const uint32_t pin_outer_color = 0x0000aaaa;
@@ -99,6 +119,9 @@ static void _view_map_collection_changed(gpointer instance, dt_collection_change
                                          int next, gpointer user_data);
 /* callback when an image is selected in filmstrip, centers map */
 static void _view_map_filmstrip_activate_callback(gpointer instance, int imgid, gpointer user_data);
+static void _view_map_image_info_changed(gpointer instance, gpointer imgs, gpointer user_data);
+static void _view_map_filmrolls_changed(gpointer instance, gpointer user_data);
+static void _view_map_filmrolls_imported(gpointer instance, int film_id, gpointer user_data);
 /* callback when an image is dropped from filmstrip */
 static void drag_and_drop_received(GtkWidget *widget, GdkDragContext *context, gint x, gint y,
                                    GtkSelectionData *selection_data, guint target_type, guint time,
@@ -453,6 +476,9 @@ void init(dt_view_t *self)
 
   /* build the query string */
   lib->statements.main_query = NULL;
+  lib->index = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)g_array_unref);
+  lib->index_cells = g_hash_table_new(g_direct_hash, g_direct_equal);
+  lib->index_valid = FALSE;
   _view_map_build_main_query(lib);
 
 #ifdef USE_LUA
@@ -475,6 +501,15 @@ void init(dt_view_t *self)
   /* connect preference changed signal */
   dt_control_signal_connect(darktable.signals, DT_SIGNAL_PREFERENCES_CHANGE,
                             G_CALLBACK(_view_map_check_preference_changed), (gpointer)self);
+  /* keep the spatial index up to date */
+  dt_control_signal_connect(darktable.signals, DT_SIGNAL_IMAGE_INFO_CHANGED,
+                            G_CALLBACK(_view_map_image_info_changed), (gpointer)self);
+  dt_control_signal_connect(darktable.signals, DT_SIGNAL_FILMROLLS_CHANGED,
+                            G_CALLBACK(_view_map_filmrolls_changed), (gpointer)self);
+  dt_control_signal_connect(darktable.signals, DT_SIGNAL_FILMROLLS_IMPORTED,
+                            G_CALLBACK(_view_map_filmrolls_imported), (gpointer)self);
+  dt_control_signal_connect(darktable.signals, DT_SIGNAL_FILMROLLS_REMOVED,
+                            G_CALLBACK(_view_map_filmrolls_changed), (gpointer)self);
 }
 
 void cleanup(dt_view_t *self)
@@ -483,6 +518,9 @@ void cleanup(dt_view_t *self)
 
   dt_control_signal_disconnect(darktable.signals, G_CALLBACK(_view_map_collection_changed), self);
   dt_control_signal_disconnect(darktable.signals, G_CALLBACK(_view_map_check_preference_changed), self);
+  dt_control_signal_disconnect(darktable.signals, G_CALLBACK(_view_map_image_info_changed), self);
+  dt_control_signal_disconnect(darktable.signals, G_CALLBACK(_view_map_filmrolls_changed), self);
+  dt_control_signal_disconnect(darktable.signals, G_CALLBACK(_view_map_filmrolls_imported), self);
 
   if(darktable.gui)
   {
@@ -500,6 +538,8 @@ void cleanup(dt_view_t *self)
     //     g_object_unref(G_OBJECT(lib->map));
   }
   if(lib->statements.main_query) sqlite3_finalize(lib->statements.main_query);
+  g_hash_table_destroy(lib->index);
+  g_hash_table_destroy(lib->index_cells);
   free(self->data);
 }
 
@@ -521,6 +561,304 @@ static gboolean _view_map_redraw(gpointer user_data)
   return FALSE; // remove the function again
 }
 
+// the position of a point in pixels of the map at the zoom level
+static void _view_map_world_position(const float lat, const float lon, const int zoom, double *x, double *y)
+{
+  const double size = ldexp(256.0, zoom);
+  const double la = deg2rad(CLAMP(lat, -85.0511f, 85.0511f));
+  *x = (CLAMP(lon, -180.0f, 180.0f) + 180.0) / 360.0 * size;
+  *y = (1.0 - log(tan(la) + 1.0 / cos(la)) / M_PI) / 2.0 * size;
+}
+
+// the cell of the spatial index at a position, never 0
+static gpointer _view_map_index_cell(const float lat, const float lon)
+{
+  double x, y;
+  _view_map_world_position(lat, lon, 0, &x, &y);
+  const int cx = CLAMP((int)(x * DT_MAP_INDEX_CELLS / 256.0), 0, DT_MAP_INDEX_CELLS - 1);
+  const int cy = CLAMP((int)(y * DT_MAP_INDEX_CELLS / 256.0), 0, DT_MAP_INDEX_CELLS - 1);
+  return GUINT_TO_POINTER((cy * DT_MAP_INDEX_CELLS + cx) + 1);
+}
+
+static void _view_map_index_insert(dt_map_t *lib, const dt_map_point_t *point)
+{
+  gpointer cell = _view_map_index_cell(point->latitude, point->longitude);
+  GArray *points = g_hash_table_lookup(lib->index, cell);
+  if(!points)
+  {
+    points = g_array_new(FALSE, FALSE, sizeof(dt_map_point_t));
+    g_hash_table_insert(lib->index, cell, points);
+  }
+  g_array_append_val(points, *point);
+  g_hash_table_insert(lib->index_cells, GINT_TO_POINTER(point->imgid), cell);
+}
+
+static void _view_map_index_remove(dt_map_t *lib, const int imgid)
+{
+  gpointer cell = g_hash_table_lookup(lib->index_cells, GINT_TO_POINTER(imgid));
+  if(!cell) return;
+  g_hash_table_remove(lib->index_cells, GINT_TO_POINTER(imgid));
+
+  GArray *points = g_hash_table_lookup(lib->index, cell);
+  for(guint k = 0; points && k < points->len; k++)
+  {
+    if(g_array_index(points, dt_map_point_t, k).imgid == imgid)
+    {
+      g_array_remove_index_fast(points, k);
+      break;
+    }
+  }
+  if(points && points->len == 0) g_hash_table_remove(lib->index, cell);
+}
+
+// reads all the geotagged images to draw into the spatial index
+static void _view_map_index_build(dt_map_t *lib)
+{
+  g_hash_table_remove_all(lib->index);
+  g_hash_table_remove_all(lib->index_cells);
+
+  DT_DEBUG_SQLITE3_RESET(lib->statements.main_query);
+  while(sqlite3_step(lib->statements.main_query) == SQLITE_ROW)
+  {
+    const dt_map_point_t point = { sqlite3_column_int(lib->statements.main_query, 0),
+                                   sqlite3_column_double(lib->statements.main_query, 1),
+                                   sqlite3_column_double(lib->statements.main_query, 2) };
+    _view_map_index_insert(lib, &point);
+  }
+  lib->index_valid = TRUE;
+}
+
+// updates the images in the spatial index after their location has changed
+static void _view_map_index_update(dt_map_t *lib, const GList *imgs)
+{
+  sqlite3_stmt *stmt = NULL;
+  if(lib->filter_images_drawn)
+    DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                                "SELECT 1 FROM memory.collected_images WHERE imgid = ?1", -1, &stmt, NULL);
+
+  for(const GList *l = imgs; l; l = g_list_next(l))
+  {
+    const int imgid = GPOINTER_TO_INT(l->data);
+    _view_map_index_remove(lib, imgid);
+
+    if(stmt)
+    {
+      DT_DEBUG_SQLITE3_RESET(stmt);
+      DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, imgid);
+      if(sqlite3_step(stmt) != SQLITE_ROW) continue;
+    }
+
+    const dt_image_t *cimg = dt_image_cache_get(darktable.image_cache, imgid, 'r');
+    if(!cimg) continue;
+    const dt_map_point_t point = { imgid, cimg->geoloc.latitude, cimg->geoloc.longitude };
+    dt_image_cache_read_release(darktable.image_cache, cimg);
+
+    if(!isnan(point.latitude) && !isnan(point.longitude)) _view_map_index_insert(lib, &point);
+  }
+
+  if(stmt) sqlite3_finalize(stmt);
+}
+
+// calls func for all the images of the index in [lat0, lat1] x [lon0, lon1]
+static void _view_map_index_foreach(dt_map_t *lib, const float lat0, const float lat1, const float lon0,
+                                    const float lon1, void (*func)(const dt_map_point_t *point, gpointer data),
+                                    gpointer data)
+{
+  double x0, y0, x1, y1;
+  _view_map_world_position(lat1, lon0, 0, &x0, &y0);
+  _view_map_world_position(lat0, lon1, 0, &x1, &y1);
+  const int cx0 = CLAMP((int)(x0 * DT_MAP_INDEX_CELLS / 256.0), 0, DT_MAP_INDEX_CELLS - 1);
+  const int cx1 = CLAMP((int)(x1 * DT_MAP_INDEX_CELLS / 256.0), 0, DT_MAP_INDEX_CELLS - 1);
+  const int cy0 = CLAMP((int)(y0 * DT_MAP_INDEX_CELLS / 256.0), 0, DT_MAP_INDEX_CELLS - 1);
+  const int cy1 = CLAMP((int)(y1 * DT_MAP_INDEX_CELLS / 256.0), 0, DT_MAP_INDEX_CELLS - 1);
+
+  // look the cells up one by one unless there are fewer cells with images than that
+  GList *cells = NULL;
+  if((guint)((cx1 - cx0 + 1) * (cy1 - cy0 + 1)) <= g_hash_table_size(lib->index))
+  {
+    for(int cy = cy0; cy <= cy1; cy++)
+      for(int cx = cx0; cx <= cx1; cx++)
+      {
+        GArray *points = g_hash_table_lookup(lib->index, GUINT_TO_POINTER((cy * DT_MAP_INDEX_CELLS + cx) + 1));
+        if(points) cells = g_list_prepend(cells, points);
+      }
+  }
+  else
+    cells = g_hash_table_get_values(lib->index);
+
+  for(GList *c = cells; c; c = g_list_next(c))
+  {
+    GArray *points = (GArray *)c->data;
+    for(guint k = 0; k < points->len; k++)
+    {
+      const dt_map_point_t *point = &g_array_index(points, dt_map_point_t, k);
+      if(point->latitude >= lat0 && point->latitude <= lat1 && point->longitude >= lon0
+         && point->longitude <= lon1)
+        func(point, data);
+    }
+  }
+  g_list_free(cells);
+}
+
+typedef struct dt_map_clusters_t
+{
+  int zoom;
+  double cell;   // the size of a cluster cell in pixels
+  int cx0, cy0;  // the first cell
+  int ncx, ncy;  // the cells in both directions
+  struct
+  {
+    int imgid, count;
+    double latitude, longitude;
+  } *clusters;
+} dt_map_clusters_t;
+
+static void _view_map_cluster_point(const dt_map_point_t *point, gpointer data)
+{
+  dt_map_clusters_t *c = (dt_map_clusters_t *)data;
+  double x, y;
+  _view_map_world_position(point->latitude, point->longitude, c->zoom, &x, &y);
+  const int cx = (int)floor(x / c->cell) - c->cx0, cy = (int)floor(y / c->cell) - c->cy0;
+  if(cx < 0 || cx >= c->ncx || cy < 0 || cy >= c->ncy) return;
+
+  // the cluster is shown by the thumbnail of its first image and sits at the mean of all
+  const size_t k = (size_t)cy * c->ncx + cx;
+  if(!c->clusters[k].count || point->imgid < c->clusters[k].imgid) c->clusters[k].imgid = point->imgid;
+  c->clusters[k].count++;
+  c->clusters[k].latitude += point->latitude;
+  c->clusters[k].longitude += point->longitude;
+}
+
+typedef struct dt_map_cluster_images_t
+{
+  const dt_map_image_t *entry;
+  double cell;
+  GList *imgs;
+} dt_map_cluster_images_t;
+
+static void _view_map_collect_point(const dt_map_point_t *point, gpointer data)
+{
+  dt_map_cluster_images_t *c = (dt_map_cluster_images_t *)data;
+  double x, y;
+  _view_map_world_position(point->latitude, point->longitude, c->entry->zoom, &x, &y);
+  if((int)floor(x / c->cell) == c->entry->cx && (int)floor(y / c->cell) == c->entry->cy)
+    c->imgs = g_list_prepend(c->imgs, GINT_TO_POINTER(point->imgid));
+}
+
+// the images of the cluster of a marker
+static GList *_view_map_cluster_images(dt_map_t *lib, const dt_map_image_t *entry)
+{
+  if(entry->count <= 1) return g_list_append(NULL, GINT_TO_POINTER(entry->imgid));
+
+  // the bounds of the cell, a little larger to be sure to get the same images as the clustering
+  dt_map_cluster_images_t c = { entry, DT_MAP_CLUSTER_SIZE * DT_PIXEL_APPLY_DPI(thumb_size), NULL };
+  const double size = ldexp(256.0, entry->zoom);
+  const double west = entry->cx * c.cell / size * 360.0 - 180.0;
+  const double east = (entry->cx + 1) * c.cell / size * 360.0 - 180.0;
+  const double north = atan(sinh(M_PI * (1.0 - 2.0 * entry->cy * c.cell / size))) * 180.0 / M_PI;
+  const double south = atan(sinh(M_PI * (1.0 - 2.0 * (entry->cy + 1) * c.cell / size))) * 180.0 / M_PI;
+  _view_map_index_foreach(lib, south - 1e-4, north + 1e-4, west - 1e-4, east + 1e-4, _view_map_collect_point, &c);
+  return c.imgs;
+}
+
+// the thumbnail of a marker with the pin below and the number of images of a cluster on it
+static GdkPixbuf *_view_map_marker_thumb(dt_map_t *lib, const int imgid, const int count, int *width,
+                                         int *height, gboolean *needs_redraw)
+{
+  const int _thumb_size = DT_PIXEL_APPLY_DPI(thumb_size);
+  const dt_mipmap_size_t mip
+      = dt_mipmap_cache_get_matching_size(darktable.mipmap_cache, _thumb_size, _thumb_size);
+  dt_mipmap_buffer_t buf;
+  dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, mip, DT_MIPMAP_BEST_EFFORT, 'r');
+
+  GdkPixbuf *source = NULL, *thumb = NULL;
+  if(!buf.buf)
+  {
+    *needs_redraw = TRUE;
+    goto marker_thumb_failure;
+  }
+
+  for(size_t i = 3; i < (size_t)4 * buf.width * buf.height; i += 4) buf.buf[i] = UINT8_MAX;
+
+  int w = _thumb_size, h = _thumb_size;
+  const float _thumb_border = DT_PIXEL_APPLY_DPI(thumb_border), _pin_size = DT_PIXEL_APPLY_DPI(image_pin_size);
+  if(buf.width < buf.height)
+    w = (buf.width * _thumb_size) / buf.height; // portrait
+  else
+    h = (buf.height * _thumb_size) / buf.width; // landscape
+
+  // next we get a pixbuf for the image
+  source = gdk_pixbuf_new_from_data(buf.buf, GDK_COLORSPACE_RGB, TRUE, 8, buf.width, buf.height,
+                                    buf.width * 4, NULL, NULL);
+  if(!source) goto marker_thumb_failure;
+
+  // now we want a slightly larger pixbuf that we can put the image on
+  thumb = gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8, w + 2 * _thumb_border, h + 2 * _thumb_border + _pin_size);
+  if(!thumb) goto marker_thumb_failure;
+  gdk_pixbuf_fill(thumb, thumb_frame_color);
+
+  // put the image onto the frame
+  gdk_pixbuf_scale(source, thumb, _thumb_border, _thumb_border, w, h, _thumb_border, _thumb_border,
+                   (1.0 * w) / buf.width, (1.0 * h) / buf.height, GDK_INTERP_HYPER);
+
+  // and finally add the pin
+  gdk_pixbuf_copy_area(lib->image_pin, 0, 0, w + 2 * _thumb_border, _pin_size, thumb, 0, h + 2 * _thumb_border);
+
+  // a cluster gets the number of its images in the corner
+  if(count > 1)
+  {
+    const int tw = gdk_pixbuf_get_width(thumb), th = gdk_pixbuf_get_height(thumb);
+    cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, tw, th);
+    cairo_t *cr = cairo_create(surface);
+    gdk_cairo_set_source_pixbuf(cr, thumb, 0, 0);
+    cairo_paint(cr);
+
+    gchar *text = g_strdup_printf("%d", count);
+    PangoLayout *layout = pango_cairo_create_layout(cr);
+    PangoFontDescription *desc = pango_font_description_from_string("sans bold");
+    pango_font_description_set_absolute_size(desc, DT_PIXEL_APPLY_DPI(11) * PANGO_SCALE);
+    pango_layout_set_font_description(layout, desc);
+    pango_layout_set_text(layout, text, -1);
+    PangoRectangle ink;
+    pango_layout_get_pixel_extents(layout, &ink, NULL);
+    const double pad = DT_PIXEL_APPLY_DPI(2);
+    const double bx = tw - _thumb_border - ink.width - 2 * pad, by = _thumb_border;
+    cairo_set_source_rgba(cr, 0.0, 0.0, 0.0, 0.67);
+    cairo_rectangle(cr, bx, by, ink.width + 2 * pad, ink.height + 2 * pad);
+    cairo_fill(cr);
+    cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
+    cairo_move_to(cr, bx + pad - ink.x, by + pad - ink.y);
+    pango_cairo_show_layout(cr, layout);
+    pango_font_description_free(desc);
+    g_object_unref(layout);
+    g_free(text);
+    cairo_destroy(cr);
+
+    GdkPixbuf *labelled = gdk_pixbuf_get_from_surface(surface, 0, 0, tw, th);
+    cairo_surface_destroy(surface);
+    if(labelled)
+    {
+      g_object_unref(thumb);
+      thumb = labelled;
+    }
+  }
+
+  *width = w;
+  *height = h;
+
+marker_thumb_failure:
+  if(source) g_object_unref(source);
+  dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+  return thumb;
+}
+
+static gint _view_map_cluster_distance_cmp(gconstpointer a, gconstpointer b, gpointer user_data)
+{
+  const double *dist = (const double *)user_data;
+  const double da = dist[GPOINTER_TO_INT(a) - 1], db = dist[GPOINTER_TO_INT(b) - 1];
+  return da < db ? -1 : (da > db ? 1 : 0);
+}
+
 static void _view_map_changed_callback(OsmGpsMap *map, dt_view_t *self)
 {
   dt_map_t *lib = (dt_map_t *)self->data;
@@ -553,99 +891,107 @@ static void _view_map_changed_callback(OsmGpsMap *map, dt_view_t *self)
   dt_conf_set_float("plugins/map/latitude", center_lat);
   dt_conf_set_int("plugins/map/zoom", zoom);
 
-  /* check if the prefs have changed and rebuild main_query if needed */
+  /* check if the prefs have changed and rebuild main_query and the index if needed */
   if(_view_map_prefs_changed(lib)) _view_map_build_main_query(lib);
+  if(!lib->index_valid) _view_map_index_build(lib);
+
+  /* cluster the images in the bounding box by cells of the map at this zoom level */
+  const float south = bb_1_lat - south_border, north = bb_0_lat;
+  const float west = bb_0_lon - west_border, east = bb_1_lon;
+  dt_map_clusters_t c = { .zoom = zoom, .cell = DT_MAP_CLUSTER_SIZE * DT_PIXEL_APPLY_DPI(thumb_size) };
+  double x0, y0, x1, y1;
+  _view_map_world_position(north, west, zoom, &x0, &y0);
+  _view_map_world_position(south, east, zoom, &x1, &y1);
+  c.cx0 = (int)floor(x0 / c.cell);
+  c.cy0 = (int)floor(y0 / c.cell);
+  c.ncx = CLAMP((int)floor(x1 / c.cell) - c.cx0 + 1, 1, 4096);
+  c.ncy = CLAMP((int)floor(y1 / c.cell) - c.cy0 + 1, 1, 4096);
+  c.clusters = calloc((size_t)c.ncx * c.ncy, sizeof(*c.clusters));
+  if(c.clusters) _view_map_index_foreach(lib, south, north, west, east, _view_map_cluster_point, &c);
+
+  /* the clusters nearest to the center get a marker, up to the maximum number of images drawn */
+  double xc, yc;
+  _view_map_world_position(center_lat, center_lon, zoom, &xc, &yc);
+  const int ncells = c.clusters ? c.ncx * c.ncy : 0;
+  double *dist = malloc(sizeof(double) * MAX(ncells, 1));
+  GList *cells = NULL;
+  for(int k = 0; k < ncells; k++)
+  {
+    if(!c.clusters[k].count) continue;
+    c.clusters[k].latitude /= c.clusters[k].count;
+    c.clusters[k].longitude /= c.clusters[k].count;
+    const double dx = (k % c.ncx + c.cx0 + 0.5) * c.cell - xc, dy = (k / c.ncx + c.cy0 + 0.5) * c.cell - yc;
+    dist[k] = dx * dx + dy * dy;
+    cells = g_list_prepend(cells, GINT_TO_POINTER(k + 1));
+  }
+  cells = g_list_sort_with_data(cells, _view_map_cluster_distance_cmp, dist);
 
-  /* let's reset and reuse the main_query statement */
-  DT_DEBUG_SQLITE3_CLEAR_BINDINGS(lib->statements.main_query);
-  DT_DEBUG_SQLITE3_RESET(lib->statements.main_query);
-
-  /* bind bounding box coords for the main query */
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(lib->statements.main_query, 1, bb_0_lon - west_border);
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(lib->statements.main_query, 2, bb_1_lon);
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(lib->statements.main_query, 3, bb_0_lat);
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(lib->statements.main_query, 4, bb_1_lat - south_border);
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(lib->statements.main_query, 5, center_lat);
-  DT_DEBUG_SQLITE3_BIND_DOUBLE(lib->statements.main_query, 6, center_lon);
+  /* keep the markers which are still there, remove the others */
+  GHashTable *kept = g_hash_table_new(g_direct_hash, g_direct_equal);
+  int drawn = 0;
+  for(GList *l = cells; l && drawn < lib->max_images_drawn; l = g_list_next(l), drawn++)
+    g_hash_table_add(kept, l->data);
 
-  /* remove the old images */
-  if(lib->images)
+  GSList *images = NULL;
+  for(GSList *iter = lib->images; iter; iter = g_slist_next(iter))
   {
-    // we can't use osm_gps_map_image_remove_all() because we want to keep the marker
-    for(GSList *iter = lib->images; iter; iter = g_slist_next(iter))
+    dt_map_image_t *entry = (dt_map_image_t *)iter->data;
+    const int cx = entry->cx - c.cx0, cy = entry->cy - c.cy0;
+    const int k = cy * c.ncx + cx;
+    if(entry->zoom == zoom && cx >= 0 && cx < c.ncx && cy >= 0 && cy < c.ncy
+       && g_hash_table_contains(kept, GINT_TO_POINTER(k + 1)) && c.clusters[k].imgid == entry->imgid
+       && c.clusters[k].count == entry->count && c.clusters[k].latitude == entry->latitude
+       && c.clusters[k].longitude == entry->longitude)
+    {
+      // nothing to add for this cluster
+      c.clusters[k].count = 0;
+      images = g_slist_prepend(images, entry);
+    }
+    else
     {
-      dt_map_image_t *image = (dt_map_image_t *)iter->data;
-      osm_gps_map_image_remove(map, image->image);
+      osm_gps_map_image_remove(map, entry->image);
+      g_free(entry);
     }
-    g_slist_free_full(lib->images, g_free);
-    lib->images = NULL;
   }
+  g_slist_free(lib->images);
+  lib->images = images;
 
-  /* add all images to the map */
+  /* add the new markers to the map */
   gboolean needs_redraw = FALSE;
-  const int _thumb_size = DT_PIXEL_APPLY_DPI(thumb_size);
-  dt_mipmap_size_t mip = dt_mipmap_cache_get_matching_size(darktable.mipmap_cache, _thumb_size, _thumb_size);
-  while(sqlite3_step(lib->statements.main_query) == SQLITE_ROW)
+  drawn = 0;
+  for(GList *l = cells; l && drawn < lib->max_images_drawn; l = g_list_next(l), drawn++)
   {
-    int imgid = sqlite3_column_int(lib->statements.main_query, 0);
-    dt_mipmap_buffer_t buf;
-    dt_mipmap_cache_get(darktable.mipmap_cache, &buf, imgid, mip, DT_MIPMAP_BEST_EFFORT, 'r');
+    const int k = GPOINTER_TO_INT(l->data) - 1;
+    if(!c.clusters[k].count) continue;
 
-    if(buf.buf)
-    {
-      GdkPixbuf *source = NULL, *thumb = NULL;
-
-      for(size_t i = 3; i < (size_t)4 * buf.width * buf.height; i += 4) buf.buf[i] = UINT8_MAX;
+    int w = 0, h = 0;
+    GdkPixbuf *thumb = _view_map_marker_thumb(lib, c.clusters[k].imgid, c.clusters[k].count, &w, &h,
+                                              &needs_redraw);
+    if(!thumb) continue;
 
-      int w = _thumb_size, h = _thumb_size;
-      const float _thumb_border = DT_PIXEL_APPLY_DPI(thumb_border), _pin_size = DT_PIXEL_APPLY_DPI(image_pin_size);
-      if(buf.width < buf.height)
-        w = (buf.width * _thumb_size) / buf.height; // portrait
-      else
-        h = (buf.height * _thumb_size) / buf.width; // landscape
-
-      // next we get a pixbuf for the image
-      source = gdk_pixbuf_new_from_data(buf.buf, GDK_COLORSPACE_RGB, TRUE, 8, buf.width, buf.height,
-                                        buf.width * 4, NULL, NULL);
-      if(!source) goto map_changed_failure;
-
-      // now we want a slightly larger pixbuf that we can put the image on
-      thumb = gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8, w + 2 * _thumb_border,
-                             h + 2 * _thumb_border + _pin_size);
-      if(!thumb) goto map_changed_failure;
-      gdk_pixbuf_fill(thumb, thumb_frame_color);
-
-      // put the image onto the frame
-      gdk_pixbuf_scale(source, thumb, _thumb_border, _thumb_border, w, h, _thumb_border, _thumb_border,
-                       (1.0 * w) / buf.width, (1.0 * h) / buf.height, GDK_INTERP_HYPER);
-
-      // and finally add the pin
-      gdk_pixbuf_copy_area(lib->image_pin, 0, 0, w + 2 * _thumb_border, _pin_size, thumb, 0, h + 2 * _thumb_border);
-
-      const dt_image_t *cimg = dt_image_cache_get(darktable.image_cache, imgid, 'r');
-      if(!cimg) goto map_changed_failure;
-      dt_map_image_t *entry = (dt_map_image_t *)malloc(sizeof(dt_map_image_t));
-      if(!entry)
-      {
-        dt_image_cache_read_release(darktable.image_cache, cimg);
-        goto map_changed_failure;
-      }
-      entry->imgid = imgid;
-      entry->image = osm_gps_map_image_add_with_alignment(map, cimg->geoloc.latitude, cimg->geoloc.longitude, thumb, 0, 1);
+    dt_map_image_t *entry = (dt_map_image_t *)malloc(sizeof(dt_map_image_t));
+    if(entry)
+    {
+      entry->imgid = c.clusters[k].imgid;
+      entry->count = c.clusters[k].count;
+      entry->zoom = zoom;
+      entry->cx = k % c.ncx + c.cx0;
+      entry->cy = k / c.ncx + c.cy0;
+      entry->latitude = c.clusters[k].latitude;
+      entry->longitude = c.clusters[k].longitude;
+      entry->image = osm_gps_map_image_add_with_alignment(map, entry->latitude, entry->longitude, thumb, 0, 1);
       entry->width = w;
       entry->height = h;
       lib->images = g_slist_prepend(lib->images, entry);
-      dt_image_cache_read_release(darktable.image_cache, cimg);
-
-    map_changed_failure:
-      if(source) g_object_unref(source);
-      if(thumb) g_object_unref(thumb);
     }
-    else
-      needs_redraw = TRUE;
-    dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+    g_object_unref(thumb);
   }
 
+  g_hash_table_destroy(kept);
+  g_list_free(cells);
+  free(dist);
+  free(c.clusters);
+
   // not exactly thread safe, but should be good enough for updating the display
   static int timeout_event_source = 0;
   if(needs_redraw && timeout_event_source == 0)
@@ -680,7 +1026,8 @@ static GList *_view_map_get_imgs_at_pos(dt_view_t *self, const double x,
     img_y -= DT_PIXEL_APPLY_DPI(image_pin_size);
     if(x >= img_x && x <= img_x + entry->width && y <= img_y && y >= img_y - entry->height)
     {
-      imgs = g_list_append(imgs,GINT_TO_POINTER(entry->imgid));
+      // a cluster stands for all its images
+      imgs = g_list_concat(imgs, _view_map_cluster_images(lib, entry));
       if(first_on) break;
     }
   }
@@ -784,7 +1131,7 @@ static gboolean _view_map_button_press_callback(GtkWidget *w, GdkEventButton *e,
     }
     if(e->type == GDK_2BUTTON_PRESS)
     {
-      if(lib->selected_images)
+      if(lib->selected_images && !lib->selected_images->next)
       {
         // open the image in darkroom
         dt_control_set_mouse_over_id(GPOINTER_TO_INT(lib->selected_images->data));
@@ -793,7 +1140,7 @@ static gboolean _view_map_button_press_callback(GtkWidget *w, GdkEventButton *e,
       }
       else
       {
-        // zoom into that position
+        // zoom into that position, or into a cluster of images
         float longitude, latitude;
         OsmGpsMapPoint *pt = osm_gps_map_point_new_degrees(0.0, 0.0);
         osm_gps_map_convert_screen_to_geographic(lib->map, e->x, e->y, pt);
@@ -1118,13 +1465,43 @@ static void _view_map_collection_changed(gpointer instance, dt_collection_change
     }
   }
 
-  if(dt_conf_get_bool("plugins/map/filter_images_drawn"))
+  // the images of a reload may have got other locations, e.g. by undo. the index holds the collected
+  // images only when they are filtered.
+  if(query_change == DT_COLLECTION_CHANGE_RELOAD && imgs)
+    _view_map_index_update(lib, (GList *)imgs);
+  else if(lib->filter_images_drawn)
+    lib->index_valid = FALSE;
+
+  if(dt_conf_get_bool("plugins/map/filter_images_drawn") || imgs)
   {
     /* only redraw when map mode is currently active, otherwise enter() does the magic */
     if(darktable.view_manager->proxy.map.view) g_signal_emit_by_name(lib->map, "changed");
   }
 }
 
+static void _view_map_image_info_changed(gpointer instance, gpointer imgs, gpointer user_data)
+{
+  dt_view_t *self = (dt_view_t *)user_data;
+  dt_map_t *lib = (dt_map_t *)self->data;
+
+  if(lib->index_valid) _view_map_index_update(lib, (GList *)imgs);
+}
+
+static void _view_map_filmrolls_changed(gpointer instance, gpointer user_data)
+{
+  dt_view_t *self = (dt_view_t *)user_data;
+  dt_map_t *lib = (dt_map_t *)self->data;
+
+  // images have been imported or removed, read them again when the map is drawn next
+  lib->index_valid = FALSE;
+  if(darktable.view_manager->proxy.map.view) g_signal_emit_by_name(lib->map, "changed");
+}
+
+static void _view_map_filmrolls_imported(gpointer instance, int film_id, gpointer user_data)
+{
+  _view_map_filmrolls_changed(instance, user_data);
+}
+
 static void _view_map_center_on_image(dt_view_t *self, const int32_t imgid)
 {
   if(imgid)
@@ -1351,14 +1728,13 @@ static void _view_map_build_main_query(dt_map_t *lib)
   lib->max_images_drawn = dt_conf_get_int("plugins/map/max_images_drawn");
   if(lib->max_images_drawn == 0) lib->max_images_drawn = 100;
   lib->filter_images_drawn = dt_conf_get_bool("plugins/map/filter_images_drawn");
-  geo_query = g_strdup_printf("SELECT * FROM (SELECT id, latitude FROM %s WHERE longitude >= ?1 AND "
-                              "longitude <= ?2 AND latitude <= ?3 AND latitude >= ?4 AND longitude NOT NULL AND "
-                              "latitude NOT NULL ORDER BY ABS(latitude - ?5), ABS(longitude - ?6) LIMIT 0, %d) "
-                              "ORDER BY (180 - latitude), id",
+  // all the geotagged images, to build the spatial index from
+  geo_query = g_strdup_printf("SELECT id, latitude, longitude FROM %s WHERE longitude NOT NULL AND "
+                              "latitude NOT NULL",
                               lib->filter_images_drawn
                               ? "main.images i INNER JOIN memory.collected_images c ON i.id = c.imgid"
-                              : "main.images",
-                              lib->max_images_drawn);
+                              : "main.images");
+  lib->index_valid = FALSE;
 
   /* prepare the main query statement */
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), geo_query, -1, &lib->statements.main_query, NULL);
@@ -22,6 +22,7 @@
 #include "common/dtpthread.h"
 #include "common/imageio.h"
 #include "common/imageio_module.h"
+#include "common/opencl.h"
 #include "control/conf.h"
 #include "control/control.h"
 #include "dtgtk/thumbtable.h"
@@ -41,13 +42,9 @@ typedef enum dt_slideshow_event_t
   S_REQUEST_STEP_BACK,
 } dt_slideshow_event_t;
 
-typedef enum dt_slideshow_slot_t
-{
-  S_LEFT      = 0,
-  S_CURRENT   = 1,
-  S_RIGHT     = 2,
-  S_SLOT_LAST = 3
-} dt_slideshow_slot_t;
+// the most images rendered ahead and behind the current one
+#define S_AHEAD_MAX 6
+#define S_SLOT_MAX (2 * S_AHEAD_MAX + 1)
 
 typedef struct _slideshow_buf_t
 {
@@ -56,6 +53,7 @@ typedef struct _slideshow_buf_t
   uint32_t height;
   int32_t rank;
   gboolean invalidated;
+  gboolean processing; // a job renders it right now
 } dt_slideshow_buf_t;
 
 typedef struct dt_slideshow_t
@@ -63,10 +61,17 @@ typedef struct dt_slideshow_t
   int32_t col_count;
   uint32_t width, height;
 
-  // buffers
-  dt_slideshow_buf_t buf[S_SLOT_LAST];
+  // ring of buffers, the current image is in the middle with ahead images rendered before and after it
+  dt_slideshow_buf_t buf[S_SLOT_MAX];
+  int ahead;
+  int slots;
   gboolean init_phase;
 
+  // images rendered at once, and the jobs queued or running for them
+  int renders;
+  int queued;
+  int running;
+
   // state machine stuff for image transitions:
   dt_pthread_mutex_t lock;
 
@@ -120,43 +125,80 @@ static int write_image(dt_imageio_module_data_t *datai, const char *filename, co
   return 0;
 }
 
+static void _copy_slot(dt_slideshow_buf_t *to, const dt_slideshow_buf_t *from)
+{
+  to->buf         = from->buf;
+  to->rank        = from->rank;
+  to->width       = from->width;
+  to->height      = from->height;
+  to->invalidated = from->invalidated;
+  to->processing  = from->processing;
+}
+
 static void shift_left(dt_slideshow_t *d)
 {
-  uint32_t *tmp_buf = d->buf[S_LEFT].buf;
+  uint32_t *tmp_buf = d->buf[0].buf;
 
-  for(int k=S_LEFT; k<S_RIGHT; k++)
-  {
-    d->buf[k].buf         = d->buf[k+1].buf;
-    d->buf[k].rank        = d->buf[k+1].rank;
-    d->buf[k].width       = d->buf[k+1].width;
-    d->buf[k].height      = d->buf[k+1].height;
-    d->buf[k].invalidated = d->buf[k+1].invalidated;
-  }
-  d->buf[S_RIGHT].invalidated = TRUE;
-  d->buf[S_RIGHT].rank = d->buf[S_CURRENT].rank + 1;
-  d->buf[S_RIGHT].buf = tmp_buf;
+  for(int k = 0; k < d->slots - 1; k++) _copy_slot(&d->buf[k], &d->buf[k + 1]);
+
+  dt_slideshow_buf_t *last = &d->buf[d->slots - 1];
+  last->buf = tmp_buf;
+  last->rank = d->buf[d->slots - 2].rank + 1;
+  last->invalidated = last->rank < d->col_count;
+  last->processing = FALSE;
 }
 
 static void shift_right(dt_slideshow_t *d)
 {
-  uint32_t *tmp_buf = d->buf[S_RIGHT].buf;
+  uint32_t *tmp_buf = d->buf[d->slots - 1].buf;
+
+  for(int k = d->slots - 1; k > 0; k--) _copy_slot(&d->buf[k], &d->buf[k - 1]);
+
+  dt_slideshow_buf_t *first = &d->buf[0];
+  first->buf = tmp_buf;
+  first->rank = d->buf[1].rank - 1;
+  first->invalidated = first->rank >= 0;
+  first->processing = FALSE;
+}
 
-  for(int k=S_RIGHT; k>S_LEFT; k--)
+// the slot to render next: the current image, then alternately the ones after and before it, nearest first.
+// -1 if there's none. has to be called with the lock held.
+static int _next_slot(dt_slideshow_t *d)
+{
+  for(int k = 0; k <= d->ahead; k++)
+  {
+    const int slots[2] = { d->ahead + k, d->ahead - k };
+    for(int i = 0; i < (k ? 2 : 1); i++)
+    {
+      const dt_slideshow_buf_t *b = &d->buf[slots[i]];
+      if(b->buf && b->invalidated && !b->processing && b->rank >= 0 && b->rank < d->col_count) return slots[i];
+    }
+  }
+  return -1;
+}
+
+// the slots still to render, not taken by a running job. has to be called with the lock held.
+static int _pending_slots(dt_slideshow_t *d)
+{
+  int count = 0;
+  for(int k = 0; k < d->slots; k++)
   {
-    d->buf[k].buf         = d->buf[k-1].buf;
-    d->buf[k].rank        = d->buf[k-1].rank;
-    d->buf[k].width       = d->buf[k-1].width;
-    d->buf[k].height      = d->buf[k-1].height;
-    d->buf[k].invalidated = d->buf[k-1].invalidated;
+    const dt_slideshow_buf_t *b = &d->buf[k];
+    if(b->buf && b->invalidated && !b->processing && b->rank >= 0 && b->rank < d->col_count) count++;
   }
-  d->buf[S_LEFT].invalidated = TRUE;
-  d->buf[S_LEFT].rank = d->buf[S_CURRENT].rank - 1;
-  d->buf[S_LEFT].buf = tmp_buf;
+  return count;
 }
 
+// queues as many jobs as there are images to render, up to the renders at once
 static void requeue_job(dt_slideshow_t *d)
 {
-  dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_BG, process_job_create(d));
+  dt_pthread_mutex_lock(&d->lock);
+  const int pending = _pending_slots(d);
+  int add = MIN(d->renders - d->queued - d->running, pending - d->queued);
+  d->queued += MAX(add, 0);
+  dt_pthread_mutex_unlock(&d->lock);
+
+  for(; add > 0; add--) dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_BG, process_job_create(d));
 }
 
 static void _set_delay(dt_slideshow_t *d, int value)
@@ -165,9 +207,9 @@ static void _set_delay(dt_slideshow_t *d, int value)
   dt_conf_set_int("slideshow_delay", d->delay);
 }
 
-static int process_image(dt_slideshow_t *d, dt_slideshow_slot_t slot)
+static int process_image(dt_slideshow_t *d, const int slot)
 {
-  dt_imageio_module_format_t buf;
+  dt_imageio_module_format_t buf = { 0 };
   buf.mime = mime;
   buf.levels = levels;
   buf.bpp = bpp;
@@ -189,6 +231,7 @@ static int process_image(dt_slideshow_t *d, dt_slideshow_slot_t slot)
 
   if(rank<0 || rank>=d->col_count || !query)
   {
+    d->buf[slot].processing = FALSE;
     d->exporting--;
     dt_pthread_mutex_unlock(&d->lock);
     goto error;
@@ -216,20 +259,33 @@ static int process_image(dt_slideshow_t *d, dt_slideshow_slot_t slot)
                                  high_quality, TRUE, FALSE, NULL, FALSE, FALSE, DT_COLORSPACE_DISPLAY,
                                  NULL, DT_INTENT_LAST, NULL, NULL, 1, 1, NULL);
 
-    // lock to copy back into the slot the rendered buffer, not that this is done only if
-    // the slot rank is still the same as the local buffer rank. This can be false if the
-    // buffers have been shifted to advance to next image.
+    // lock to copy back the rendered buffer into the slot which has the rank now. the buffers may have
+    // been shifted to advance to another image meanwhile, or the image be out of the ring.
     dt_pthread_mutex_lock(&d->lock);
-    if(dat.rank == d->buf[slot].rank)
+    for(int k = 0; k < d->slots; k++)
     {
-      memcpy(d->buf[slot].buf, dat.buf.buf, sizeof(uint32_t) * dat.buf.width * dat.buf.height);
-      d->buf[slot].width = dat.buf.width;
-      d->buf[slot].height = dat.buf.height;
-      d->buf[slot].invalidated = FALSE;
+      dt_slideshow_buf_t *b = &d->buf[k];
+      if(b->rank != dat.rank || !b->buf) continue;
+      if(b->invalidated)
+      {
+        memcpy(b->buf, dat.buf.buf, sizeof(uint32_t) * dat.buf.width * dat.buf.height);
+        b->width = dat.buf.width;
+        b->height = dat.buf.height;
+        b->invalidated = FALSE;
+      }
+      b->processing = FALSE;
     }
     d->exporting--;
     dt_pthread_mutex_unlock(&d->lock);
   }
+  else
+  {
+    dt_pthread_mutex_lock(&d->lock);
+    for(int k = 0; k < d->slots; k++)
+      if(d->buf[k].rank == dat.rank) d->buf[k].processing = FALSE;
+    d->exporting--;
+    dt_pthread_mutex_unlock(&d->lock);
+  }
 
   dt_free_align(dat.buf.buf);
   return 0;
@@ -239,18 +295,23 @@ static int process_image(dt_slideshow_t *d, dt_slideshow_slot_t slot)
   return 1;
 }
 
-static gboolean _is_idle(dt_slideshow_t *d)
+// is the image shown next rendered?
+static gboolean _next_ready(dt_slideshow_t *d)
 {
-  return !((d->buf[S_LEFT].invalidated && d->buf[S_LEFT].rank <= d->col_count)
-           || (d->buf[S_CURRENT].invalidated && d->buf[S_CURRENT].rank <= d->col_count)
-           || (d->buf[S_RIGHT].invalidated && d->buf[S_RIGHT].rank <= d->col_count));
+  dt_pthread_mutex_lock(&d->lock);
+  const dt_slideshow_buf_t *current = &d->buf[d->ahead];
+  const dt_slideshow_buf_t *next = &d->buf[d->ahead + 1];
+  const gboolean ready = !(current->invalidated && current->rank < d->col_count)
+                         && !(next->invalidated && next->rank < d->col_count);
+  dt_pthread_mutex_unlock(&d->lock);
+  return ready;
 }
 
 static gboolean auto_advance(gpointer user_data)
 {
   dt_slideshow_t *d = (dt_slideshow_t *)user_data;
   if(!d->auto_advance) return FALSE;
-  if(!_is_idle(d)) return TRUE; // never try to advance if still exporting, but call me back again
+  if(!_next_ready(d)) return TRUE; // never try to advance if still exporting, but call me back again
   _step_state(d, S_REQUEST_STEP);
   return FALSE;
 }
@@ -259,23 +320,26 @@ static int32_t process_job_run(dt_job_t *job)
 {
   dt_slideshow_t *d = dt_control_job_get_params(job);
 
-  if(d->buf[S_CURRENT].invalidated && d->buf[S_CURRENT].rank <= d->col_count)
-  {
-    process_image(d, S_CURRENT);
-    dt_control_queue_redraw_center();
-  }
-  else if(d->buf[S_RIGHT].invalidated && d->buf[S_RIGHT].rank <= d->col_count)
-  {
-    process_image(d, S_RIGHT);
-  }
-  else if(d->buf[S_LEFT].invalidated && d->buf[S_LEFT].rank >= 0)
+  dt_pthread_mutex_lock(&d->lock);
+  d->queued--;
+  const int slot = _next_slot(d);
+  if(slot >= 0)
   {
-    process_image(d, S_LEFT);
+    d->buf[slot].processing = TRUE;
+    d->running++;
   }
+  dt_pthread_mutex_unlock(&d->lock);
+  if(slot < 0) return 0;
+
+  process_image(d, slot);
+  if(slot == d->ahead) dt_control_queue_redraw_center();
+
+  dt_pthread_mutex_lock(&d->lock);
+  d->running--;
+  dt_pthread_mutex_unlock(&d->lock);
 
   // any other slot to fill?
-  if(!_is_idle(d))
-    requeue_job(d);
+  requeue_job(d);
 
   return 0;
 }
@@ -290,7 +354,7 @@ static dt_job_t *process_job_create(dt_slideshow_t *d)
 
 static void _refresh_display(dt_slideshow_t *d)
 {
-  if(!d->buf[S_CURRENT].invalidated && d->buf[S_CURRENT].rank >= 0)
+  if(!d->buf[d->ahead].invalidated && d->buf[d->ahead].rank >= 0)
     dt_control_queue_redraw_center();
 }
 
@@ -299,15 +363,14 @@ static void _step_state(dt_slideshow_t *d, dt_slideshow_event_t event)
 {
   dt_pthread_mutex_lock(&d->lock);
 
+  gboolean moved = FALSE;
   if(event == S_REQUEST_STEP)
   {
-    if(d->buf[S_CURRENT].rank < d->col_count - 1)
+    if(d->buf[d->ahead].rank < d->col_count - 1)
     {
       shift_left(d);
-      d->buf[S_RIGHT].rank = d->buf[S_CURRENT].rank + 1;
-      d->buf[S_RIGHT].invalidated = d->buf[S_RIGHT].rank < d->col_count;
       _refresh_display(d);
-      requeue_job(d);
+      moved = TRUE;
     }
     else
     {
@@ -317,13 +380,11 @@ static void _step_state(dt_slideshow_t *d, dt_slideshow_event_t event)
   }
   else if(event == S_REQUEST_STEP_BACK)
   {
-    if(d->buf[S_CURRENT].rank > 0)
+    if(d->buf[d->ahead].rank > 0)
     {
       shift_right(d);
-      d->buf[S_LEFT].rank = d->buf[S_CURRENT].rank - 1;
-      d->buf[S_LEFT].invalidated = d->buf[S_LEFT].rank >= 0;
       _refresh_display(d);
-      requeue_job(d);
+      moved = TRUE;
     }
     else
     {
@@ -334,6 +395,7 @@ static void _step_state(dt_slideshow_t *d, dt_slideshow_event_t event)
 
   dt_pthread_mutex_unlock(&d->lock);
 
+  if(moved) requeue_job(d);
   if(d->auto_advance) g_timeout_add_seconds(d->delay, auto_advance, d);
 }
 
@@ -416,12 +478,27 @@ void enter(dt_view_t *self)
   d->width = rect.width * darktable.gui->ppd;
   d->height = rect.height * darktable.gui->ppd;
 
-  for(int k=S_LEFT; k<S_SLOT_LAST; k++)
+  // the ring takes up to an eighth of the host memory, and every render at once a pipe of its own
+  const size_t memory = (size_t)MAX(dt_conf_get_int("host_memory_limit"), 500) << 20;
+  const size_t frame = sizeof(uint32_t) * d->width * d->height;
+  d->ahead = CLAMP((int)(memory / 8 / MAX(frame, 1) - 1) / 2, 1, S_AHEAD_MAX);
+  d->slots = 2 * d->ahead + 1;
+
+  // one render per opencl device and one on the cpu, as far as workers and memory go
+  const int devices = (darktable.opencl->inited && darktable.opencl->enabled && !darktable.opencl->stopped)
+                          ? darktable.opencl->num_devs
+                          : 0;
+  d->renders = MIN(1 + devices, (int)(memory >> 30) / 2);
+  d->renders = CLAMP(d->renders, 1, MAX(darktable.control->num_threads - 1, 1));
+  d->queued = d->running = 0;
+
+  for(int k = 0; k < d->slots; k++)
   {
     d->buf[k].buf = dt_alloc_align(64, sizeof(uint32_t) * d->width * d->height);
     d->buf[k].width =  d->width;
     d->buf[k].height = d->height;
     d->buf[k].invalidated = TRUE;
+    d->buf[k].processing = FALSE;
   }
 
   // if one selected start with it, otherwise start at the current lighttable offset
@@ -441,9 +518,8 @@ void enter(dt_view_t *self)
     sqlite3_finalize(stmt);
   }
 
-  d->buf[S_CURRENT].rank = selrank == -1 ? dt_thumbtable_get_offset(dt_ui_thumbtable(darktable.gui->ui)) : selrank;
-  d->buf[S_LEFT].rank = d->buf[S_CURRENT].rank - 1;
-  d->buf[S_RIGHT].rank = d->buf[S_CURRENT].rank + 1;
+  const int32_t current = selrank == -1 ? dt_thumbtable_get_offset(dt_ui_thumbtable(darktable.gui->ui)) : selrank;
+  for(int k = 0; k < d->slots; k++) d->buf[k].rank = current + k - d->ahead;
 
   d->col_count = dt_collection_get_count(darktable.collection);
 
@@ -454,8 +530,8 @@ void enter(dt_view_t *self)
 
   gtk_widget_grab_focus(dt_ui_center(darktable.gui->ui));
 
-  // start first job
-  dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_BG, process_job_create(d));
+  // start first jobs
+  requeue_job(d);
   dt_control_log(_("waiting to start slideshow"));
 }
 
@@ -472,11 +548,11 @@ void leave(dt_view_t *self)
   // otherwise we will crash releasing lock and memory.
   while(d->exporting > 0) sleep(1);
 
-  dt_thumbtable_set_offset(dt_ui_thumbtable(darktable.gui->ui), d->buf[S_CURRENT].rank, FALSE);
+  dt_thumbtable_set_offset(dt_ui_thumbtable(darktable.gui->ui), d->buf[d->ahead].rank, FALSE);
 
   dt_pthread_mutex_lock(&d->lock);
 
-  for(int k=S_LEFT; k<S_SLOT_LAST; k++)
+  for(int k = 0; k < d->slots; k++)
   {
     dt_free_align(d->buf[k].buf);
     d->buf[k].buf = NULL;
@@ -492,7 +568,7 @@ void expose(dt_view_t *self, cairo_t *cr, int32_t width, int32_t height, int32_t
   dt_pthread_mutex_lock(&d->lock);
   cairo_paint(cr);
 
-  const dt_slideshow_buf_t *slot = &(d->buf[S_CURRENT]);
+  const dt_slideshow_buf_t *slot = &(d->buf[d->ahead]);
 
   if(slot->buf && slot->rank >= 0 && !slot->invalidated)
   {
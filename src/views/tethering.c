@@ -32,7 +32,9 @@
 #include "common/camera_control.h"
 #include "common/collection.h"
 #include "common/darktable.h"
+#include "common/exif.h"
 #include "common/image_cache.h"
+#include "common/imageio.h"
 #include "common/import_session.h"
 #include "common/selection.h"
 #include "common/utility.h"
@@ -41,6 +43,7 @@
 #include "control/control.h"
 #include "control/jobs.h"
 #include "control/settings.h"
+#include "develop/imageop_math.h"
 #include "dtgtk/thumbtable.h"
 #include "gui/accelerators.h"
 #include "gui/draw.h"
@@ -83,6 +86,12 @@ typedef struct dt_capture_t
   double live_view_zoom_cursor_x, live_view_zoom_cursor_y;
 
   gboolean busy;
+
+  /** The embedded preview of the last shot, shown until its import is done and the image can be drawn */
+  cairo_surface_t *capture_preview;
+  /** The image shown when the shot arrived, the preview is kept while it's still active */
+  int32_t capture_preview_over;
+  dt_pthread_mutex_t capture_preview_mutex;
 } dt_capture_t;
 
 /* signal handler for filmstrip image switching */
@@ -122,6 +131,8 @@ static void _view_capture_filmstrip_activate_callback(gpointer instance, int img
 void init(dt_view_t *self)
 {
   self->data = calloc(1, sizeof(dt_capture_t));
+  dt_capture_t *lib = (dt_capture_t *)self->data;
+  dt_pthread_mutex_init(&lib->capture_preview_mutex, NULL);
 
   /* setup the tethering view proxy */
   darktable.view_manager->proxy.tethering.view               = self;
@@ -132,6 +143,9 @@ void init(dt_view_t *self)
 
 void cleanup(dt_view_t *self)
 {
+  dt_capture_t *lib = (dt_capture_t *)self->data;
+  if(lib->capture_preview) cairo_surface_destroy(lib->capture_preview);
+  dt_pthread_mutex_destroy(&lib->capture_preview_mutex);
   free(self->data);
 }
 
@@ -189,6 +203,12 @@ static void _expose_tethered_mode(dt_view_t *self, cairo_t *cr, int32_t width, i
 
   if(cam->is_live_viewing == TRUE) // display the preview
   {
+    // the frames are decoded at the size they are shown at
+    dt_pthread_mutex_lock(&cam->live_view_frame_mutex);
+    cam->live_view_width = cam->live_view_rotation % 2 == 0 ? width - MARGIN * 2 : height - MARGIN * 2 - BAR_HEIGHT;
+    cam->live_view_height = cam->live_view_rotation % 2 == 0 ? height - MARGIN * 2 - BAR_HEIGHT : width - MARGIN * 2;
+    dt_pthread_mutex_unlock(&cam->live_view_frame_mutex);
+
     dt_pthread_mutex_lock(&cam->live_view_pixbuf_mutex);
     if(GDK_IS_PIXBUF(cam->live_view_pixbuf))
     {
@@ -216,19 +236,22 @@ static void _expose_tethered_mode(dt_view_t *self, cairo_t *cr, int32_t width, i
     }
     dt_pthread_mutex_unlock(&cam->live_view_pixbuf_mutex);
   }
-  else if(lib->image_id >= 0) // First of all draw image if available
+  else
   {
+    cairo_surface_t *preview = NULL;
+    dt_pthread_mutex_lock(&lib->capture_preview_mutex);
+    if(lib->capture_preview) preview = cairo_surface_reference(lib->capture_preview);
+    const int32_t preview_over = lib->capture_preview_over;
+    dt_pthread_mutex_unlock(&lib->capture_preview_mutex);
+
+    // the image of the last shot can't be drawn before its import activates it
+    int res = 1;
     cairo_surface_t *surf = NULL;
-    const int res
-        = dt_view_image_get_surface(lib->image_id, width - (MARGIN * 2.0f), height - (MARGIN * 2.0f), &surf, FALSE);
-    if(res)
-    {
-      // if the image is missing, we reload it again
-      g_timeout_add(250, _expose_again, NULL);
-      if(!lib->busy) dt_control_log_busy_enter();
-      lib->busy = TRUE;
-    }
-    else
+    if(lib->image_id >= 0 && (!preview || lib->image_id != preview_over))
+      res = dt_view_image_get_surface(lib->image_id, width - (MARGIN * 2.0f), height - (MARGIN * 2.0f), &surf,
+                                      FALSE);
+
+    if(!res) // First of all draw image if available
     {
       cairo_translate(cr, (width - cairo_image_surface_get_width(surf)) / 2,
                       (height - cairo_image_surface_get_height(surf)) / 2);
@@ -237,11 +260,44 @@ static void _expose_tethered_mode(dt_view_t *self, cairo_t *cr, int32_t width, i
       cairo_surface_destroy(surf);
       if(lib->busy) dt_control_log_busy_leave();
       lib->busy = FALSE;
+
+      if(preview)
+      {
+        // the imported image replaces the preview
+        dt_pthread_mutex_lock(&lib->capture_preview_mutex);
+        if(lib->capture_preview == preview)
+        {
+          cairo_surface_destroy(lib->capture_preview);
+          lib->capture_preview = NULL;
+        }
+        dt_pthread_mutex_unlock(&lib->capture_preview_mutex);
+      }
     }
+    else if(preview)
+    {
+      const int pw = cairo_image_surface_get_width(preview);
+      const int ph = cairo_image_surface_get_height(preview);
+      const float scale
+          = fminf(1.0f, fminf((width - MARGIN * 2.0f) / pw, (height - MARGIN * 2.0f) / ph));
+      cairo_translate(cr, width * 0.5, height * 0.5);
+      cairo_scale(cr, scale, scale);
+      cairo_translate(cr, -0.5 * pw, -0.5 * ph);
+      cairo_set_source_surface(cr, preview, 0, 0);
+      cairo_paint(cr);
+      // the imported image is active but not there yet
+      if(lib->image_id >= 0 && lib->image_id != preview_over) g_timeout_add(250, _expose_again, NULL);
+    }
+    else if(lib->image_id >= 0)
+    {
+      // if the image is missing, we reload it again
+      g_timeout_add(250, _expose_again, NULL);
+      if(!lib->busy) dt_control_log_busy_enter();
+      lib->busy = TRUE;
+    }
+    if(preview) cairo_surface_destroy(preview);
   }
 }
 
-
 void expose(dt_view_t *self, cairo_t *cri, int32_t width, int32_t height, int32_t pointerx,
             int32_t pointery)
 {
@@ -295,6 +351,8 @@ static const char *_camera_request_image_filename(const dt_camera_t *camera, con
                                                   time_t *exif_time, void *data)
 {
   struct dt_capture_t *lib = (dt_capture_t *)data;
+  /* files of cards imported meanwhile are none of our business */
+  if(camera != darktable.camctl->active_camera) return NULL;
 
   /* update import session with original filename so that $(FILE_EXTENSION)
    *     and alikes can be expanded. */
@@ -309,15 +367,68 @@ static const char *_camera_request_image_filename(const dt_camera_t *camera, con
 static const char *_camera_request_image_path(const dt_camera_t *camera, time_t *exif_time, void *data)
 {
   struct dt_capture_t *lib = (dt_capture_t *)data;
+  if(camera != darktable.camctl->active_camera) return NULL;
   return dt_import_session_path(lib->session, FALSE);
 }
 
+// the embedded preview of the image in filename as a surface, upright. NULL if there is none.
+static cairo_surface_t *_capture_preview_create(const char *filename)
+{
+  uint8_t *thumb = NULL;
+  int32_t tw, th;
+  dt_colorspaces_color_profile_type_t color_space;
+  if(dt_imageio_large_thumbnail(filename, &thumb, &tw, &th, &color_space)) return NULL;
+
+  const int32_t size = MAX(tw, th);
+  uint8_t *buf = dt_alloc_align(64, (size_t)4 * size * size);
+  if(!buf)
+  {
+    dt_free_align(thumb);
+    return NULL;
+  }
+  uint32_t wd, ht;
+  dt_iop_flip_and_zoom_8(thumb, tw, th, buf, size, size, dt_exif_get_orientation(filename), &wd, &ht);
+  dt_free_align(thumb);
+
+  cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, wd, ht);
+  uint8_t *data = cairo_image_surface_get_data(surface);
+  const int stride = cairo_image_surface_get_stride(surface);
+  for(uint32_t j = 0; j < ht; j++)
+  {
+    const uint8_t *in = buf + (size_t)4 * wd * j;
+    uint8_t *out = data + (size_t)stride * j;
+    for(uint32_t i = 0; i < wd; i++, in += 4, out += 4)
+    {
+      out[0] = in[2];
+      out[1] = in[1];
+      out[2] = in[0];
+      out[3] = 0xff;
+    }
+  }
+  cairo_surface_mark_dirty(surface);
+  dt_free_align(buf);
+  return surface;
+}
+
 static void _camera_capture_image_downloaded(const dt_camera_t *camera, const char *filename, void *data)
 {
   dt_capture_t *lib = (dt_capture_t *)data;
+  if(camera != darktable.camctl->active_camera) return;
+
+  /* show the embedded preview right away, the import reads the whole file and writes the database first */
+  cairo_surface_t *preview = _capture_preview_create(filename);
+  if(preview)
+  {
+    dt_pthread_mutex_lock(&lib->capture_preview_mutex);
+    if(lib->capture_preview) cairo_surface_destroy(lib->capture_preview);
+    lib->capture_preview = preview;
+    lib->capture_preview_over = lib->image_id;
+    dt_pthread_mutex_unlock(&lib->capture_preview_mutex);
+    dt_control_queue_redraw_center();
+  }
 
-  /* create an import job of downloaded image */
-  dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_BG,
+  /* create an import job of downloaded image, ahead of the background jobs */
+  dt_control_add_job(darktable.control, DT_JOB_QUEUE_USER_FG,
                      dt_image_import_job_create(dt_import_session_film_id(lib->session), filename));
 }
 
@@ -55,6 +55,143 @@ static void dt_view_manager_load_modules(dt_view_manager_t *vm);
 static int dt_view_load_module(void *v, const char *libname, const char *module_name);
 static void dt_view_unload_module(dt_view_t *view);
 
+// the cairo surfaces of the thumbnails, prepared by background jobs so the gui thread only draws them. a
+// surface is known by its image, its size and the times the mipmaps of the image got updated.
+typedef struct dt_view_surface_t
+{
+  int32_t imgid;
+  int32_t width;
+  int32_t height;
+  int32_t generation;
+  gboolean focus_peaking;
+  cairo_surface_t *surface; // NULL while a job prepares it
+  size_t size;
+  GList link; // in _surfaces.lru once ready
+} dt_view_surface_t;
+
+// the memory the ready surfaces may take
+#define DT_VIEW_SURFACES_MAX_SIZE ((size_t)256 << 20)
+
+// static, as queued jobs may be disposed after the view manager
+static struct
+{
+  dt_pthread_mutex_t lock;
+  GHashTable *surfaces;    // dt_view_surface_t, ready or being prepared
+  GQueue lru;              // the ready ones, most recently used first
+  size_t size;             // bytes of the ready surfaces
+  GHashTable *generations; // imgid -> times its mipmaps got updated
+  int32_t generation;      // times all the mipmaps got updated
+} _surfaces = { .surfaces = NULL };
+
+static guint _surface_hash(gconstpointer key)
+{
+  const dt_view_surface_t *s = (const dt_view_surface_t *)key;
+  return ((((s->imgid * 31u) + s->width) * 31u + s->height) * 31u + s->generation) * 2u + s->focus_peaking;
+}
+
+static gboolean _surface_equal(gconstpointer a, gconstpointer b)
+{
+  const dt_view_surface_t *sa = (const dt_view_surface_t *)a;
+  const dt_view_surface_t *sb = (const dt_view_surface_t *)b;
+  return sa->imgid == sb->imgid && sa->width == sb->width && sa->height == sb->height
+         && sa->generation == sb->generation && sa->focus_peaking == sb->focus_peaking;
+}
+
+static void _surface_free(gpointer data)
+{
+  dt_view_surface_t *s = (dt_view_surface_t *)data;
+  if(s->surface)
+  {
+    g_queue_unlink(&_surfaces.lru, &s->link);
+    _surfaces.size -= s->size;
+    cairo_surface_destroy(s->surface);
+  }
+  free(s);
+}
+
+// has to be called with the lock held
+static int32_t _surface_generation(const int32_t imgid)
+{
+  return _surfaces.generation
+         + GPOINTER_TO_INT(g_hash_table_lookup(_surfaces.generations, GINT_TO_POINTER(imgid)));
+}
+
+// the surfaces of an image, or of all images for imgid <= 0, aren't found any more once its mipmaps changed.
+// the outdated ones of a single image get evicted as the others come in.
+static void _surfaces_mipmap_updated_callback(gpointer instance, int imgid, gpointer user_data)
+{
+  dt_pthread_mutex_lock(&_surfaces.lock);
+  if(_surfaces.surfaces)
+  {
+    if(imgid > 0)
+    {
+      const int32_t gen = GPOINTER_TO_INT(g_hash_table_lookup(_surfaces.generations, GINT_TO_POINTER(imgid)));
+      g_hash_table_insert(_surfaces.generations, GINT_TO_POINTER(imgid), GINT_TO_POINTER(gen + 1));
+    }
+    else
+    {
+      _surfaces.generation++;
+      g_hash_table_remove_all(_surfaces.surfaces);
+    }
+  }
+  dt_pthread_mutex_unlock(&_surfaces.lock);
+}
+
+static int32_t _surface_job_run(dt_job_t *job)
+{
+  const dt_view_surface_t *key = dt_control_job_get_params(job);
+
+  // we load the mipmap here rather than leaving it to another job, so the surface is there when we are done
+  dt_mipmap_buffer_t buf;
+  const dt_mipmap_size_t mip = dt_mipmap_cache_get_matching_size(darktable.mipmap_cache,
+                                                                 key->width * darktable.gui->ppd,
+                                                                 key->height * darktable.gui->ppd);
+  dt_mipmap_cache_get(darktable.mipmap_cache, &buf, key->imgid, mip, DT_MIPMAP_BLOCKING, 'r');
+  dt_mipmap_cache_release(darktable.mipmap_cache, &buf);
+
+  cairo_surface_t *surface = NULL;
+  if(dt_view_image_get_surface(key->imgid, key->width, key->height, &surface, FALSE))
+  {
+    // the mipmap isn't there yet, the thumb asks again
+    if(surface) cairo_surface_destroy(surface);
+    return 0;
+  }
+
+  gboolean stored = FALSE;
+  dt_pthread_mutex_lock(&_surfaces.lock);
+  dt_view_surface_t *s = _surfaces.surfaces ? g_hash_table_lookup(_surfaces.surfaces, key) : NULL;
+  if(s && !s->surface)
+  {
+    s->surface = surface;
+    s->size = (size_t)cairo_image_surface_get_stride(surface) * cairo_image_surface_get_height(surface);
+    g_queue_push_head_link(&_surfaces.lru, &s->link);
+    _surfaces.size += s->size;
+    stored = TRUE;
+
+    // evict the least recently used ones, never the new one
+    while(_surfaces.size > DT_VIEW_SURFACES_MAX_SIZE && _surfaces.lru.tail != &s->link)
+      g_hash_table_remove(_surfaces.surfaces, _surfaces.lru.tail->data);
+  }
+  dt_pthread_mutex_unlock(&_surfaces.lock);
+
+  if(stored)
+    dt_control_signal_raise(darktable.signals, DT_SIGNAL_VIEWMANAGER_SURFACE_READY, key->imgid);
+  else
+    cairo_surface_destroy(surface);
+  return 0;
+}
+
+// a job which didn't store its surface leaves the place to a new one
+static void _surface_job_cleanup(void *data)
+{
+  dt_view_surface_t *key = (dt_view_surface_t *)data;
+  dt_pthread_mutex_lock(&_surfaces.lock);
+  dt_view_surface_t *s = _surfaces.surfaces ? g_hash_table_lookup(_surfaces.surfaces, key) : NULL;
+  if(s && !s->surface) g_hash_table_remove(_surfaces.surfaces, s);
+  dt_pthread_mutex_unlock(&_surfaces.lock);
+  free(key);
+}
+
 void dt_view_manager_init(dt_view_manager_t *vm)
 {
   /* prepare statements */
@@ -89,6 +226,17 @@ void dt_view_manager_init(dt_view_manager_t *vm)
 
   vm->current_view = NULL;
   vm->audio.audio_player_id = -1;
+
+  if(!_surfaces.surfaces)
+  {
+    dt_pthread_mutex_init(&_surfaces.lock, NULL);
+    _surfaces.surfaces = g_hash_table_new_full(_surface_hash, _surface_equal, NULL, _surface_free);
+    _surfaces.generations = g_hash_table_new(g_direct_hash, g_direct_equal);
+    g_queue_init(&_surfaces.lru);
+  }
+  // connected before any thumb, so the surfaces are outdated when the thumbs ask for them again
+  dt_control_signal_connect(darktable.signals, DT_SIGNAL_DEVELOP_MIPMAP_UPDATED,
+                            G_CALLBACK(_surfaces_mipmap_updated_callback), NULL);
 }
 
 void dt_view_manager_gui_init(dt_view_manager_t *vm)
@@ -103,6 +251,18 @@ void dt_view_manager_gui_init(dt_view_manager_t *vm)
 void dt_view_manager_cleanup(dt_view_manager_t *vm)
 {
   for(GList *iter = vm->views; iter; iter = g_list_next(iter)) dt_view_unload_module((dt_view_t *)iter->data);
+
+  dt_control_signal_disconnect(darktable.signals, G_CALLBACK(_surfaces_mipmap_updated_callback), NULL);
+  // the lock stays for the jobs still queued
+  dt_pthread_mutex_lock(&_surfaces.lock);
+  if(_surfaces.surfaces)
+  {
+    g_hash_table_destroy(_surfaces.surfaces);
+    g_hash_table_destroy(_surfaces.generations);
+    _surfaces.surfaces = NULL;
+    _surfaces.generations = NULL;
+  }
+  dt_pthread_mutex_unlock(&_surfaces.lock);
 }
 
 const dt_view_t *dt_view_manager_get_current_view(dt_view_manager_t *vm)
@@ -310,6 +470,7 @@ int dt_view_manager_switch_by_view(dt_view_manager_t *vm, const dt_view_t *nv)
     {
       /* leave the current view*/
       if(old_view->leave) old_view->leave(old_view);
+      dt_image_sidecar_flush();
 
       /* iterator plugins and cleanup plugins in current view */
       for(GList *iter = darktable.lib->plugins; iter; iter = g_list_next(iter))
@@ -354,6 +515,9 @@ int dt_view_manager_switch_by_view(dt_view_manager_t *vm, const dt_view_t *nv)
     if(old_view->leave) old_view->leave(old_view);
     dt_accel_disconnect_list(&old_view->accel_closures);
 
+    /* the sidecars of the edits in the view are on disk once it is left */
+    dt_image_sidecar_flush();
+
     /* iterator plugins and cleanup plugins in current view */
     for(GList *iter = darktable.lib->plugins; iter; iter = g_list_next(iter))
     {
@@ -720,11 +884,10 @@ static void _images_to_act_on_insert_in_list(GList **list, const int imgid, gboo
     return;
   }
 
-  const dt_image_t *image = dt_image_cache_get(darktable.image_cache, imgid, 'r');
-  if(image)
+  dt_image_snapshot_t image;
+  if(dt_image_cache_get_snapshot(darktable.image_cache, imgid, &image))
   {
-    const int img_group_id = image->group_id;
-    dt_image_cache_read_release(darktable.image_cache, image);
+    const int img_group_id = image.group_id;
 
     if(!darktable.gui || !darktable.gui->grouping || darktable.gui->expanded_group_id == img_group_id
        || !dt_selection_get_collection(darktable.selection))
@@ -1054,15 +1217,11 @@ int dt_view_image_get_surface(int imgid, int width, int height, cairo_surface_t
       ? CAIRO_FILTER_GOOD : darktable.gui->filter_image) ;
 
     cairo_paint(cr);
-    /* from focus_peaking.h
-       static inline void dt_focuspeaking(cairo_t *cr, int width, int height,
-                                       uint8_t *const restrict image,
-                                       const int buf_width, const int buf_height)
-       The current implementation assumes the data at image is organized as a rectangle without a stride,
+    /* dt_focuspeaking() assumes the data at image is organized as a rectangle without a stride,
        So we pass the raw data to be processed, this is more data but correct.
     */
     if(darktable.gui->show_focus_peaking)
-      dt_focuspeaking(cr, img_width, img_height, rgbbuf, buf_wd, buf_ht);
+      dt_focuspeaking(cr, img_width, img_height, rgbbuf, buf_wd, buf_ht, imgid, buf.size);
 
     cairo_surface_destroy(tmp_surface);
     cairo_destroy(cr);
@@ -1073,6 +1232,70 @@ int dt_view_image_get_surface(int imgid, int width, int height, cairo_surface_t
   return 0;
 }
 
+int dt_view_image_get_surface_async(int imgid, int width, int height, cairo_surface_t **surface)
+{
+  // without workers, the surface is prepared here
+  if(!dt_control_running()) return dt_view_image_get_surface(imgid, width, height, surface, FALSE);
+
+  if(*surface && cairo_surface_get_reference_count(*surface) > 0) cairo_surface_destroy(*surface);
+  *surface = NULL;
+
+  dt_view_surface_t key = { .imgid = imgid, .width = width, .height = height,
+                            .focus_peaking = darktable.gui->show_focus_peaking };
+  dt_view_surface_t *job_key = NULL;
+
+  dt_pthread_mutex_lock(&_surfaces.lock);
+  if(!_surfaces.surfaces)
+  {
+    dt_pthread_mutex_unlock(&_surfaces.lock);
+    return 1;
+  }
+  key.generation = _surface_generation(imgid);
+  dt_view_surface_t *s = g_hash_table_lookup(_surfaces.surfaces, &key);
+  if(s && s->surface)
+  {
+    // most recently used
+    g_queue_unlink(&_surfaces.lru, &s->link);
+    g_queue_push_head_link(&_surfaces.lru, &s->link);
+    *surface = cairo_surface_reference(s->surface);
+  }
+  else if(!s)
+  {
+    // the place of the surface, the job fills it
+    s = (dt_view_surface_t *)calloc(1, sizeof(dt_view_surface_t));
+    job_key = (dt_view_surface_t *)calloc(1, sizeof(dt_view_surface_t));
+    if(s && job_key)
+    {
+      *s = key;
+      s->link.data = s;
+      *job_key = key;
+      g_hash_table_add(_surfaces.surfaces, s);
+    }
+    else
+    {
+      free(s);
+      free(job_key);
+      job_key = NULL;
+    }
+  }
+  dt_pthread_mutex_unlock(&_surfaces.lock);
+
+  if(*surface) return 0;
+
+  if(job_key)
+  {
+    dt_job_t *job = dt_control_job_create(&_surface_job_run, "thumbnail surface %d", imgid);
+    if(job)
+    {
+      dt_control_job_set_params_with_size(job, job_key, sizeof(dt_view_surface_t), _surface_job_cleanup);
+      dt_control_add_job(darktable.control, DT_JOB_QUEUE_SYSTEM_FG, job);
+    }
+    else
+      _surface_job_cleanup(job_key);
+  }
+  return 1;
+}
+
 char* dt_view_extend_modes_str(const char * name, const gboolean is_hdr, const gboolean is_bw)
 {
   char* upcase = g_ascii_strup(name, -1);  // extension in capital letters to avoid character descenders
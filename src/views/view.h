@@ -197,6 +197,10 @@ int dt_view_get_image_to_act_on();
 char* dt_view_extend_modes_str(const char * name, const int is_hdr, const int is_bw);
 /** expose an image and return a cairi_surface. return != 0 if thumbnail wasn't loaded yet. */
 int dt_view_image_get_surface(int imgid, int width, int height, cairo_surface_t **surface, const gboolean quality);
+/** the same for the thumbnails, from a cache of the surfaces. if the surface isn't ready, return != 0 and a
+ * background job prepares it, DT_SIGNAL_VIEWMANAGER_SURFACE_READY is raised once it's there. the surface must
+ * not be drawn on. */
+int dt_view_image_get_surface_async(int imgid, int width, int height, cairo_surface_t **surface);
 
 
 /** Set the selection bit to a given value for the specified image */
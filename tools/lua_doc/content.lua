@@ -530,6 +530,9 @@ darktable.control.execute:add_parameter("command","string","The command to run,
 darktable.control.execute:add_return("int","The result of the system call")
 darktable.control.read:set_text("Block until a file is readable while not blocking darktable"..para()..emphasis("This function is not available on Windows builds"))
 darktable.control.read:add_parameter("file","file","The file object to wait for")
+darktable.control.export_slots:set_text([[The number of images ]]..my_tostring(darktable.control.dispatch)..[[ed functions may export with write_image at the same time, 0 for no limit. write_image waits for a free slot without blocking darktable.]])
+darktable.control.exports_running:set_text([[The number of images being exported with write_image]])
+darktable.control.exports_waiting:set_text([[The number of write_image calls waiting for an export slot]])
 
 
 darktable.gettext:set_text([[This table contains functions related to translating lua scripts]])